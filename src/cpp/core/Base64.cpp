@@ -13,59 +13,134 @@
  *
  */
 
-#include <sstream>
+#include <core/Base64.hpp>
 
-#include <algorithm>
+#include <vector>
+#include <istream>
 
-#include <boost/archive/iterators/base64_from_binary.hpp>
-#include <boost/archive/iterators/transform_width.hpp>
-#include <boost/archive/iterators/ostream_iterator.hpp>
+#include <boost/shared_ptr.hpp>
 
 #include <core/Error.hpp>
 #include <core/Log.hpp>
-#include <core/FileSerializer.hpp>
+#include <core/FilePath.hpp>
 
 namespace core {
 namespace base64 {
 
-Error encode(const std::string& input, std::string* pOutput)
-{
-   using namespace boost::archive::iterators;
+namespace {
 
-   try
+const char kAlphabet[] =
+   "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// encode a block of input (which must be a multiple of 3 bytes unless it
+// is the final block) appending to the output
+void encodeBlock(const unsigned char* pData,
+                 std::size_t size,
+                 std::string* pOutput)
+{
+   std::size_t fullGroups = size / 3;
+   if (fullGroups > 0)
    {
-      typedef base64_from_binary<transform_width<const char *,6,8> > b64_text;
-      std::stringstream os;
-      std::copy(b64_text(input.c_str()),
-                b64_text(input.c_str() + input.size()),
-                ostream_iterator<char>(os));
-
-      pOutput->clear();
-      pOutput->reserve(((input.size() * 4) / 3) + 3);
-      pOutput->append(os.str());
-
-      std::size_t mod = input.size() % 3;
-      if (mod == 1)
-         pOutput->append("==");
-      else if(mod == 2)
-         pOutput->append("=");
+      std::size_t offset = pOutput->size();
+      pOutput->resize(offset + (fullGroups * 4));
+      char* pOut = &((*pOutput)[0]) + offset;
+
+      for (std::size_t i = 0; i < fullGroups; i++, pData += 3)
+      {
+         unsigned int group = (pData[0] << 16) | (pData[1] << 8) | pData[2];
+         *pOut++ = kAlphabet[(group >> 18) & 0x3F];
+         *pOut++ = kAlphabet[(group >> 12) & 0x3F];
+         *pOut++ = kAlphabet[(group >> 6) & 0x3F];
+         *pOut++ = kAlphabet[group & 0x3F];
+      }
+   }
 
-      return Success();
+   // remainder (padded)
+   std::size_t remaining = size % 3;
+   if (remaining == 1)
+   {
+      unsigned int group = pData[0] << 16;
+      pOutput->push_back(kAlphabet[(group >> 18) & 0x3F]);
+      pOutput->push_back(kAlphabet[(group >> 12) & 0x3F]);
+      pOutput->append("==");
+   }
+   else if (remaining == 2)
+   {
+      unsigned int group = (pData[0] << 16) | (pData[1] << 8);
+      pOutput->push_back(kAlphabet[(group >> 18) & 0x3F]);
+      pOutput->push_back(kAlphabet[(group >> 12) & 0x3F]);
+      pOutput->push_back(kAlphabet[(group >> 6) & 0x3F]);
+      pOutput->push_back('=');
    }
-   CATCH_UNEXPECTED_EXCEPTION
+}
+
+std::size_t encodedSize(std::size_t size)
+{
+   return ((size + 2) / 3) * 4;
+}
 
-   // keep compiler happy
+} // anonymous namespace
+
+Error encode(const std::string& input, std::string* pOutput)
+{
+   pOutput->clear();
+   pOutput->reserve(encodedSize(input.size()));
+   encodeBlock(reinterpret_cast<const unsigned char*>(input.data()),
+               input.size(),
+               pOutput);
    return Success();
 }
 
 Error encode(const FilePath& inputFile, std::string* pOutput)
 {
-   std::string contents;
-   Error error = core::readStringFromFile(inputFile, &contents);
+   boost::shared_ptr<std::istream> pIfs;
+   Error error = inputFile.open_r(&pIfs);
    if (error)
       return error;
 
-   return encode(contents, pOutput);
+   pOutput->clear();
+   pOutput->reserve(encodedSize(static_cast<std::size_t>(inputFile.size())));
+
+   try
+   {
+      // read a multiple of 3 bytes at a time so that each read can be
+      // encoded directly into the output
+      const std::size_t kBufferSize = 3 * 16384;
+      std::vector<char> buffer(kBufferSize);
+      while (pIfs->good())
+      {
+         pIfs->read(&buffer[0], kBufferSize);
+         std::size_t read = static_cast<std::size_t>(pIfs->gcount());
+         if (read == 0)
+            break;
+
+         // short reads only happen at the end of the file (where the
+         // remainder is padded)
+         encodeBlock(reinterpret_cast<const unsigned char*>(&buffer[0]),
+                     read,
+                     pOutput);
+         if (read < kBufferSize)
+            break;
+      }
+
+      if (pIfs->bad())
+      {
+         Error error = systemError(boost::system::errc::io_error,
+                                   ERROR_LOCATION);
+         error.addProperty("path", inputFile.absolutePath());
+         return error;
+      }
+
+      return Success();
+   }
+   catch(const std::exception& e)
+   {
+      Error error = systemError(boost::system::errc::io_error,
+                                ERROR_LOCATION);
+      error.addProperty("what", e.what());
+      error.addProperty("path", inputFile.absolutePath());
+      return error;
+   }
 }
 
 
@@ -74,4 +149,3 @@ Error encode(const FilePath& inputFile, std::string* pOutput)
 
 
 
-
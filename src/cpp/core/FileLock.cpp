@@ -15,13 +15,29 @@
 
 #include <core/FileLock.hpp>
 
-#include <boost/scope_exit.hpp>
+#include <algorithm>
+#include <ctime>
+#include <map>
+#include <vector>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#else
+#include <process.h>
+#endif
 
 #include <core/Error.hpp>
 #include <core/Log.hpp>
 #include <core/FilePath.hpp>
 #include <core/FileSerializer.hpp>
+#include <core/SafeConvert.hpp>
 #include <core/StringUtils.hpp>
+#include <core/Thread.hpp>
+
+#include <core/system/System.hpp>
+#include <core/system/Environment.hpp>
 
 #include <core/BoostErrors.hpp>
 
@@ -35,15 +51,144 @@
 
 namespace core {
 
-bool FileLock::isLocked(const FilePath& lockFilePath)
+namespace {
+
+// lease timeout (leases are refreshed every third of this)
+const int kDefaultLeaseTimeoutSeconds = 60;
+int s_leaseTimeoutSeconds = kDefaultLeaseTimeoutSeconds;
+
+// leases held by this process (lock file path => nonce) along with the
+// thread which refreshes them
+boost::mutex s_leasesMutex;
+std::map<std::string,std::string> s_leases;
+boost::thread s_heartbeatThread;
+
+struct Lease
 {
-   using namespace boost::interprocess;
+   Lease() : pid(0), refreshed(0) {}
+   std::string host;
+   long pid;
+   std::string nonce;
+   std::time_t refreshed;
+};
+
+std::string hostName()
+{
+#ifndef _WIN32
+   char buffer[256];
+   if (::gethostname(buffer, sizeof(buffer)) == 0)
+   {
+      buffer[sizeof(buffer) - 1] = '\0';
+      return buffer;
+   }
+   return std::string();
+#else
+   return core::system::getenv("COMPUTERNAME");
+#endif
+}
+
+long processId()
+{
+#ifndef _WIN32
+   return ::getpid();
+#else
+   return ::_getpid();
+#endif
+}
+
+// can we tell that the process which wrote a lease has exited? (only
+// possible for processes on this host)
+bool ownerHasExited(const Lease& lease)
+{
+#ifndef _WIN32
+   if (lease.host != hostName() || lease.pid <= 0)
+      return false;
+
+   return ::kill(lease.pid, 0) != 0 && errno == ESRCH;
+#else
+   return false;
+#endif
+}
+
+std::string leaseContents(const std::string& nonce)
+{
+   return hostName() + "\n" +
+          safe_convert::numberToString(processId()) + "\n" +
+          nonce + "\n" +
+          safe_convert::numberToString(std::time(NULL)) + "\n";
+}
+
+bool parseLease(const std::string& contents, Lease* pLease)
+{
+   std::vector<std::string> lines;
+   std::string::size_type pos = 0;
+   while (pos < contents.size())
+   {
+      std::string::size_type end = contents.find('\n', pos);
+      if (end == std::string::npos)
+         end = contents.size();
+      lines.push_back(contents.substr(pos, end - pos));
+      pos = end + 1;
+   }
+
+   if (lines.size() < 4)
+      return false;
 
-   // if the lock file doesn't exist then it's not locked
-   if (!lockFilePath.exists())
+   pLease->host = lines[0];
+   pLease->pid = safe_convert::stringTo<long>(lines[1], 0);
+   pLease->nonce = lines[2];
+   pLease->refreshed = safe_convert::stringTo<std::time_t>(lines[3], 0);
+   return !pLease->nonce.empty() && pLease->refreshed != 0;
+}
+
+bool readLease(const FilePath& lockFilePath,
+               bool* pLegacy,
+               Lease* pLease)
+{
+   *pLegacy = false;
+
+   std::string contents;
+   Error error = readStringFromFile(lockFilePath, &contents);
+   if (error)
       return false;
 
-   // check if it is locked
+   // lock files written by earlier versions are empty (they were locked
+   // using advisory locks)
+   if (contents.empty())
+   {
+      *pLegacy = true;
+      return false;
+   }
+
+   return parseLease(contents, pLease);
+}
+
+// write the lease to a temporary file and rename it over the lock file so
+// that readers never see a partially written lease
+Error writeLease(const FilePath& lockFilePath, const std::string& nonce)
+{
+   FilePath tempPath = lockFilePath.parent().complete(
+                                 lockFilePath.filename() + "." + nonce);
+   Error error = writeStringToFile(tempPath, leaseContents(nonce));
+   if (error)
+      return error;
+
+   error = tempPath.move(lockFilePath);
+   if (error)
+   {
+      Error removeError = tempPath.removeIfExists();
+      if (removeError)
+         LOG_ERROR(removeError);
+      return error;
+   }
+
+   return Success();
+}
+
+bool isLegacyLocked(const FilePath& lockFilePath)
+{
+   using namespace boost::interprocess;
+
    try
    {
       file_lock lock(string_utils::utf8ToSystem(lockFilePath.absolutePath()).c_str());
@@ -67,11 +212,90 @@ bool FileLock::isLocked(const FilePath& lockFilePath)
    }
 }
 
+void refreshLeases()
+{
+   std::map<std::string,std::string> leases;
+   LOCK_MUTEX(s_leasesMutex)
+   {
+      leases = s_leases;
+   }
+   END_LOCK_MUTEX
+
+   for (std::map<std::string,std::string>::const_iterator
+        it = leases.begin(); it != leases.end(); ++it)
+   {
+      // don't clobber a lease which has been taken over by someone else
+      // (e.g. because we were suspended for longer than the timeout)
+      FilePath lockFilePath(it->first);
+      bool legacy;
+      Lease lease;
+      if (!readLease(lockFilePath, &legacy, &lease) ||
+          lease.nonce != it->second)
+      {
+         LOG_WARNING_MESSAGE("Lost lease on lock file " + it->first);
+         LOCK_MUTEX(s_leasesMutex)
+         {
+            s_leases.erase(it->first);
+         }
+         END_LOCK_MUTEX
+         continue;
+      }
+
+      Error error = writeLease(lockFilePath, it->second);
+      if (error)
+         LOG_ERROR(error);
+   }
+}
+
+void heartbeatThreadMain()
+{
+   try
+   {
+      while (true)
+      {
+         int interval = std::max(1, s_leaseTimeoutSeconds / 3);
+         boost::this_thread::sleep(boost::posix_time::seconds(interval));
+         refreshLeases();
+      }
+   }
+   catch(const boost::thread_interrupted&)
+   {
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+}
+
+// NOTE: called with s_leasesMutex held
+void ensureHeartbeatThread()
+{
+   if (s_heartbeatThread.get_id() == boost::thread::id())
+      core::thread::safeLaunchThread(heartbeatThreadMain, &s_heartbeatThread);
+}
+
+} // anonymous namespace
+
+bool FileLock::isLocked(const FilePath& lockFilePath)
+{
+   // read the lease (if the lock file doesn't exist then it's not locked)
+   bool legacy;
+   Lease lease;
+   if (!readLease(lockFilePath, &legacy, &lease))
+      return legacy ? isLegacyLocked(lockFilePath) : false;
+
+   // locked if the lease is current and its owner hasn't exited
+   std::time_t age = std::time(NULL) - lease.refreshed;
+   return age < s_leaseTimeoutSeconds && !ownerHasExited(lease);
+}
+
+void FileLock::setLeaseTimeout(int seconds)
+{
+   s_leaseTimeoutSeconds = std::max(3, seconds);
+}
+
 
 struct FileLock::Impl
 {
    FilePath lockFilePath;
-   boost::interprocess::file_lock lock;
+   std::string nonce;
 };
 
 FileLock::FileLock()
@@ -81,86 +305,101 @@ FileLock::FileLock()
 
 FileLock::~FileLock()
 {
+   try
+   {
+      // stop refreshing the lease (it will lapse once the timeout elapses)
+      if (!pImpl_->lockFilePath.empty())
+      {
+         LOCK_MUTEX(s_leasesMutex)
+         {
+            s_leases.erase(pImpl_->lockFilePath.absolutePath());
+         }
+         END_LOCK_MUTEX
+      }
+   }
+   catch(...)
+   {
+   }
 }
 
 Error FileLock::acquire(const FilePath& lockFilePath)
 {
-   using namespace boost::interprocess;
-
-   // make sure the lock file exists
-   if (!lockFilePath.exists())
+   // fail if someone else holds the lock
+   if (isLocked(lockFilePath))
    {
-      Error error = core::writeStringToFile(lockFilePath, "");
-      if (error)
-         return error;
+      Error error = systemError(boost::system::errc::no_lock_available,
+                                ERROR_LOCATION);
+      error.addProperty("lock-file", lockFilePath);
+      return error;
    }
 
-   // try to acquire the lock
-   try
+   // write our lease
+   std::string nonce = core::system::generateShortenedUuid();
+   Error error = writeLease(lockFilePath, nonce);
+   if (error)
    {
-      file_lock lock(string_utils::utf8ToSystem(lockFilePath.absolutePath()).c_str());
-
-      if (lock.try_lock())
-      {
-         // set members
-         pImpl_->lockFilePath = lockFilePath;
-         pImpl_->lock.swap(lock);
-
-         return Success();
-      }
-      else
-      {
-         return systemError(boost::system::errc::no_lock_available,
-                            ERROR_LOCATION);
-      }
+      error.addProperty("lock-file", lockFilePath);
+      return error;
    }
-   catch(interprocess_exception& e)
+
+   // if another process claimed an abandoned lease at the same time as us
+   // then only one of the renames won; make sure it was ours
+   bool legacy;
+   Lease lease;
+   if (!readLease(lockFilePath, &legacy, &lease) || lease.nonce != nonce)
    {
-      Error error(ec_from_exception(e), ERROR_LOCATION);
+      Error error = systemError(boost::system::errc::no_lock_available,
+                                ERROR_LOCATION);
       error.addProperty("lock-file", lockFilePath);
       return error;
    }
 
+   // set members and start refreshing the lease
+   pImpl_->lockFilePath = lockFilePath;
+   pImpl_->nonce = nonce;
+   LOCK_MUTEX(s_leasesMutex)
+   {
+      s_leases[lockFilePath.absolutePath()] = nonce;
+      ensureHeartbeatThread();
+   }
+   END_LOCK_MUTEX
+
    return Success();
 }
 
 Error FileLock::release()
 {
-   using namespace boost::interprocess;
-
    // make sure the lock file exists
-   if (!pImpl_->lockFilePath.exists())
+   FilePath lockFilePath = pImpl_->lockFilePath;
+   if (lockFilePath.empty() || !lockFilePath.exists())
    {
       return systemError(boost::system::errc::no_lock_available,
                          ERROR_LOCATION);
    }
 
-   // always cleanup the lock file on exit
-   FilePath lockFilePath = pImpl_->lockFilePath;
-   BOOST_SCOPE_EXIT( (&lockFilePath) )
+   // stop refreshing the lease
+   LOCK_MUTEX(s_leasesMutex)
    {
-      Error error = lockFilePath.remove();
-      if (error)
-         LOG_ERROR(error);
+      s_leases.erase(lockFilePath.absolutePath());
    }
-   BOOST_SCOPE_EXIT_END
+   END_LOCK_MUTEX
 
-   // try to unlock it
-   try
-   {
-      pImpl_->lock.unlock();
-      pImpl_->lock = file_lock();
-      pImpl_->lockFilePath = FilePath();
-      return Success();
-   }
-   catch(interprocess_exception& e)
+   std::string nonce = pImpl_->nonce;
+   pImpl_->lockFilePath = FilePath();
+   pImpl_->nonce.clear();
+
+   // remove the lock file (provided the lease is still ours)
+   bool legacy;
+   Lease lease;
+   if (readLease(lockFilePath, &legacy, &lease) && lease.nonce != nonce)
    {
-      Error error(ec_from_exception(e), ERROR_LOCATION);
-      error.addProperty("lock-file", pImpl_->lockFilePath);
+      Error error = systemError(boost::system::errc::no_lock_available,
+                                ERROR_LOCATION);
+      error.addProperty("lock-file", lockFilePath);
       return error;
    }
 
-   return Success();
+   return lockFilePath.remove();
 }
 
 FilePath FileLock::lockFilePath() const
@@ -170,6 +409,3 @@ FilePath FileLock::lockFilePath() const
 
 
 } // namespace core
-
-
-
@@ -15,18 +15,64 @@
 
 #include <core/FileLogWriter.hpp>
 
+#include <cstdlib>
+#include <ostream>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include <boost/bind.hpp>
+#include <boost/format.hpp>
+#include <boost/foreach.hpp>
 
 #include <core/FileInfo.hpp>
 #include <core/FileSerializer.hpp>
+#include <core/Thread.hpp>
 #include <core/system/System.hpp>
 
 namespace core {
 
+namespace {
+
+// maximum number of entries waiting to be written
+const std::size_t kMaxQueuedEntries = 1000;
+
+// maximum number of entries accepted per second (a runaway error loop
+// shouldn't be able to fill the disk)
+const std::size_t kMaxEntriesPerSecond = 200;
+
+long currentPid()
+{
+#ifdef _WIN32
+   return 0;
+#else
+   return static_cast<long>(::getpid());
+#endif
+}
+
+// the writer for this process (so we can flush it at exit)
+FileLogWriter* s_pExitWriter = NULL;
+
+void flushAtExit()
+{
+   if (s_pExitWriter)
+      s_pExitWriter->flush();
+}
+
+} // anonymous namespace
+
 FileLogWriter::FileLogWriter(const std::string& programIdentity,
                              int logLevel,
                              const FilePath& logDir)
                                 : programIdentity_(programIdentity),
-                                  logLevel_(logLevel)
+                                  logLevel_(logLevel),
+                                  dropped_(0),
+                                  rateWindow_(0),
+                                  rateWindowCount_(0),
+                                  writerStarted_(false),
+                                  stopWriter_(false),
+                                  writerPid_(currentPid())
 {
    logDir.ensureDirectory();
 
@@ -37,13 +83,37 @@ FileLogWriter::FileLogWriter(const std::string& programIdentity,
       // swallow errors -- we can't log so it doesn't matter
       core::appendToFile(logFile_, "");
    }
+
+   static bool s_registeredAtExit = false;
+   if (!s_registeredAtExit)
+   {
+      std::atexit(flushAtExit);
+      s_registeredAtExit = true;
+   }
+   s_pExitWriter = this;
 }
 
 FileLogWriter::~FileLogWriter()
 {
    try
    {
-      // we don't keep a file handle open so do nothing here
+      if (s_pExitWriter == this)
+         s_pExitWriter = NULL;
+
+      // stop the writer thread (it writes anything outstanding first)
+      if (currentPid() == writerPid_ && writerThread_.joinable())
+      {
+         {
+            boost::lock_guard<boost::mutex> lock(mutex_);
+            stopWriter_ = true;
+         }
+         queueCondition_.notify_one();
+         writerThread_.join();
+      }
+      else
+      {
+         flush();
+      }
    }
    catch(...)
    {
@@ -56,10 +126,160 @@ void FileLogWriter::log(core::system::LogLevel logLevel,
    if (logLevel > logLevel_)
       return;
 
+   std::string entry = formatLogEntry(programIdentity_, message);
+
+   // forked children don't inherit the writer thread (and the queue's
+   // mutex may have been held at the time of the fork) so they write
+   // synchronously, as we did before the writer thread existed
+   if (currentPid() != writerPid_)
+   {
+      logSynchronously(entry);
+      return;
+   }
+
+   // swallow errors -- we can't log so it doesn't matter
+   try
+   {
+      bool startWriter = false;
+      {
+         boost::lock_guard<boost::mutex> lock(mutex_);
+
+         std::time_t now = std::time(NULL);
+         if (now != rateWindow_)
+         {
+            rateWindow_ = now;
+            rateWindowCount_ = 0;
+         }
+
+         if (queue_.size() >= kMaxQueuedEntries ||
+             rateWindowCount_ >= kMaxEntriesPerSecond)
+         {
+            dropped_++;
+            return;
+         }
+
+         rateWindowCount_++;
+         queue_.push_back(entry);
+
+         if (!writerStarted_)
+         {
+            writerStarted_ = true;
+            startWriter = true;
+         }
+      }
+
+      if (startWriter)
+         core::thread::safeLaunchThread(
+                        boost::bind(&FileLogWriter::writerThread, this),
+                        &writerThread_);
+      else
+         queueCondition_.notify_one();
+   }
+   catch(...)
+   {
+   }
+}
+
+void FileLogWriter::flush()
+{
+   if (currentPid() != writerPid_)
+      return;
+
+   std::vector<std::string> entries;
+   std::size_t dropped = 0;
+   {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      entries.swap(queue_);
+      dropped = dropped_;
+      dropped_ = 0;
+   }
+
+   writeEntries(entries, dropped);
+}
+
+void FileLogWriter::writerThread()
+{
+   try
+   {
+      bool stop = false;
+      while (!stop)
+      {
+         std::vector<std::string> entries;
+         std::size_t dropped = 0;
+         {
+            boost::unique_lock<boost::mutex> lock(mutex_);
+            while (queue_.empty() && dropped_ == 0 && !stopWriter_)
+               queueCondition_.wait(lock);
+
+            entries.swap(queue_);
+            dropped = dropped_;
+            dropped_ = 0;
+            stop = stopWriter_;
+         }
+
+         writeEntries(entries, dropped);
+      }
+   }
+   catch(...)
+   {
+      // can't log so nothing to do
+   }
+}
+
+void FileLogWriter::writeEntries(const std::vector<std::string>& entries,
+                                 std::size_t dropped)
+{
+   if (entries.empty() && dropped == 0)
+      return;
+
+   try
+   {
+      boost::lock_guard<boost::mutex> lock(writeMutex_);
+
+      // reopen the file if it has been rotated (possibly by another
+      // process which shares the log)
+      if (rotateLogFile() || !logFile_.exists())
+         pLogStream_.reset();
+
+      if (!pLogStream_)
+      {
+         // swallow errors -- we can't log so it doesn't matter
+         Error error = logFile_.open_w(&pLogStream_, false);
+         if (error)
+            return;
+      }
+
+      BOOST_FOREACH(const std::string& entry, entries)
+      {
+         *pLogStream_ << entry;
+      }
+
+      if (dropped > 0)
+      {
+         boost::format fmt("%1% log entries were dropped (too many entries)");
+         *pLogStream_ << formatLogEntry(programIdentity_,
+                                        boost::str(fmt % dropped));
+      }
+
+      pLogStream_->flush();
+
+#ifdef _WIN32
+      // files are opened for exclusive access on windows so don't keep
+      // the log open (other processes may share it)
+      pLogStream_.reset();
+#endif
+   }
+   catch(...)
+   {
+   }
+}
+
+void FileLogWriter::logSynchronously(const std::string& entry)
+{
    rotateLogFile();
 
    // Swallow errors--we can't do anything anyway
-   core::appendToFile(logFile_, formatLogEntry(programIdentity_, message));
+   core::appendToFile(logFile_, entry);
 }
 
 
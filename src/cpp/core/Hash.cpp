@@ -15,7 +15,9 @@
 
 #include <core/Hash.hpp>
 
+#include <cstring>
 #include <sstream>
+#include <iomanip>
 
 #include <boost/crc.hpp>
 #include <boost/lexical_cast.hpp>
@@ -25,6 +27,63 @@
 namespace core {
 namespace hash {   
 
+namespace {
+
+const boost::uint64_t kPrime1 = 11400714785074694791ULL;
+const boost::uint64_t kPrime2 = 14029467366897019727ULL;
+const boost::uint64_t kPrime3 =  1609587929392839161ULL;
+const boost::uint64_t kPrime4 =  9650029242287828579ULL;
+const boost::uint64_t kPrime5 =  2870177450012600261ULL;
+
+inline boost::uint64_t rotateLeft(boost::uint64_t value, int bits)
+{
+   return (value << bits) | (value >> (64 - bits));
+}
+
+// reads are done with memcpy so that unaligned input is safe (compilers
+// turn this into a single load). xxHash is defined over little-endian
+// input so swap bytes on big-endian platforms
+inline boost::uint64_t read64(const char* p)
+{
+   boost::uint64_t value;
+   std::memcpy(&value, p, sizeof(value));
+#ifdef BOOST_BIG_ENDIAN
+   value = ((value & 0x00000000000000FFULL) << 56) |
+           ((value & 0x000000000000FF00ULL) << 40) |
+           ((value & 0x0000000000FF0000ULL) << 24) |
+           ((value & 0x00000000FF000000ULL) <<  8) |
+           ((value & 0x000000FF00000000ULL) >>  8) |
+           ((value & 0x0000FF0000000000ULL) >> 24) |
+           ((value & 0x00FF000000000000ULL) >> 40) |
+           ((value & 0xFF00000000000000ULL) >> 56);
+#endif
+   return value;
+}
+
+inline boost::uint64_t read32(const char* p)
+{
+   const unsigned char* bytes = reinterpret_cast<const unsigned char*>(p);
+   return static_cast<boost::uint64_t>(bytes[0])         |
+          (static_cast<boost::uint64_t>(bytes[1]) <<  8) |
+          (static_cast<boost::uint64_t>(bytes[2]) << 16) |
+          (static_cast<boost::uint64_t>(bytes[3]) << 24);
+}
+
+inline boost::uint64_t round(boost::uint64_t acc, boost::uint64_t input)
+{
+   acc += input * kPrime2;
+   acc = rotateLeft(acc, 31);
+   return acc * kPrime1;
+}
+
+inline boost::uint64_t mergeRound(boost::uint64_t acc, boost::uint64_t value)
+{
+   acc ^= round(0, value);
+   return acc * kPrime1 + kPrime4;
+}
+
+} // anonymous namespace
+
 std::string crc32Hash(const std::string& content)
 {
    boost::crc_32_type result;
@@ -43,6 +102,87 @@ std::string crc32HexHash(const std::string& content)
    output << std::uppercase << std::hex << result.checksum();
    return output.str();
 }
+
+boost::uint64_t xxHash64(const char* data,
+                         std::size_t length,
+                         boost::uint64_t seed)
+{
+   const char* p = data;
+   const char* end = data + length;
+   boost::uint64_t hash;
+
+   if (length >= 32)
+   {
+      // four independent accumulators (which the cpu can process in
+      // parallel) each consume 8 bytes of every 32 byte stripe
+      boost::uint64_t v1 = seed + kPrime1 + kPrime2;
+      boost::uint64_t v2 = seed + kPrime2;
+      boost::uint64_t v3 = seed;
+      boost::uint64_t v4 = seed - kPrime1;
+
+      const char* limit = end - 32;
+      do
+      {
+         v1 = round(v1, read64(p));
+         v2 = round(v2, read64(p + 8));
+         v3 = round(v3, read64(p + 16));
+         v4 = round(v4, read64(p + 24));
+         p += 32;
+      }
+      while (p <= limit);
+
+      hash = rotateLeft(v1, 1) + rotateLeft(v2, 7) +
+             rotateLeft(v3, 12) + rotateLeft(v4, 18);
+      hash = mergeRound(hash, v1);
+      hash = mergeRound(hash, v2);
+      hash = mergeRound(hash, v3);
+      hash = mergeRound(hash, v4);
+   }
+   else
+   {
+      hash = seed + kPrime5;
+   }
+
+   hash += static_cast<boost::uint64_t>(length);
+
+   // remaining bytes
+   for (; p + 8 <= end; p += 8)
+   {
+      hash ^= round(0, read64(p));
+      hash = rotateLeft(hash, 27) * kPrime1 + kPrime4;
+   }
+   if (p + 4 <= end)
+   {
+      hash ^= read32(p) * kPrime1;
+      hash = rotateLeft(hash, 23) * kPrime2 + kPrime3;
+      p += 4;
+   }
+   for (; p < end; p++)
+   {
+      hash ^= static_cast<boost::uint64_t>(
+                        static_cast<unsigned char>(*p)) * kPrime5;
+      hash = rotateLeft(hash, 11) * kPrime1;
+   }
+
+   // avalanche
+   hash ^= hash >> 33;
+   hash *= kPrime2;
+   hash ^= hash >> 29;
+   hash *= kPrime3;
+   hash ^= hash >> 32;
+
+   return hash;
+}
+
+std::string xxHash64(const std::string& content)
+{
+   boost::uint64_t hash = xxHash64(content.data(), content.length(), 0);
+
+   std::ostringstream output;
+   output << std::uppercase << std::hex
+          << std::setw(16) << std::setfill('0') << hash;
+   return output.str();
+}
    
 } // namespace hash
 } // namespace core 
@@ -15,7 +15,12 @@
 
 #include <core/HtmlUtils.hpp>
 
+#include <map>
+#include <cctype>
+
+#include <boost/bind.hpp>
 #include <boost/format.hpp>
+#include <boost/make_shared.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 
 #include <core/Base64.hpp>
@@ -35,39 +40,177 @@ std::string defaultTitle(const std::string& htmlContent)
 }
 
 
+namespace {
+
+bool isHtmlSpace(char c)
+{
+   return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\f';
+}
+
+bool matchesIgnoreCase(const std::string& str,
+                       std::size_t pos,
+                       const char* lowerText)
+{
+   for (std::size_t i = 0; lowerText[i]; i++, pos++)
+   {
+      if (pos >= str.size() || std::tolower(str[pos]) != lowerText[i])
+         return false;
+   }
+   return true;
+}
+
+// data url for an image within the base directory (empty if the path
+// doesn't refer to one)
+std::string imageDataUrl(const FilePath& basePath, const std::string& imgRef)
+{
+   FilePath imagePath = basePath.childPath(imgRef);
+   std::string mimeType = imagePath.mimeContentType();
+   if (!imagePath.exists() || !boost::algorithm::starts_with(mimeType, "image/"))
+      return std::string();
+
+   std::string imageBase64;
+   Error error = core::base64::encode(imagePath, &imageBase64);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return std::string();
+   }
+
+   std::string dataUrl = "data:" + mimeType + ";base64,";
+   dataUrl.append(imageBase64);
+   return dataUrl;
+}
+
+// locate the src attribute value of the img tag starting at tagPos. this
+// matches what Base64ImageFilter's regex does: the tag is '<', optional
+// space, 'img' and a space, and the value is that of the last src=
+// within the tag (followed by optional space and a quoted value)
+bool findImgSrc(const std::string& html,
+                std::size_t tagPos,
+                std::size_t* pValueBegin,
+                std::size_t* pValueEnd)
+{
+   std::size_t pos = tagPos + 1;
+   while (pos < html.size() && isHtmlSpace(html[pos]))
+      pos++;
+   if (!matchesIgnoreCase(html, pos, "img ") )
+      return false;
+
+   std::size_t tagEnd = html.find('>', pos);
+   if (tagEnd == std::string::npos)
+      tagEnd = html.size();
+
+   // search backwards for the last src= within the tag
+   for (std::size_t srcPos = tagEnd; srcPos > pos + 3; )
+   {
+      srcPos--;
+      if (!matchesIgnoreCase(html, srcPos, "src"))
+         continue;
+
+      std::size_t valuePos = srcPos + 3;
+      while (valuePos < html.size() && isHtmlSpace(html[valuePos]))
+         valuePos++;
+      if (valuePos >= html.size() || html[valuePos] != '=')
+         continue;
+      valuePos++;
+      while (valuePos < html.size() && isHtmlSpace(html[valuePos]))
+         valuePos++;
+      if (valuePos >= html.size() ||
+          (html[valuePos] != '"' && html[valuePos] != '\''))
+         continue;
+
+      std::size_t valueEnd = html.find(html[valuePos], valuePos + 1);
+      if (valueEnd == std::string::npos)
+         continue;
+
+      *pValueBegin = valuePos + 1;
+      *pValueEnd = valueEnd;
+      return true;
+   }
+
+   return false;
+}
+
+} // anonymous namespace
+
+std::string base64EncodeImages(const std::string& html,
+                               const FilePath& basePath)
+{
+   // data urls for the images we've seen (empty if they aren't encodable)
+   std::map<std::string, std::string> dataUrls;
+
+   std::string result;
+   std::size_t tail = 0;
+   std::size_t pos = html.find('<');
+   while (pos != std::string::npos)
+   {
+      std::size_t valueBegin, valueEnd;
+      if (!findImgSrc(html, pos, &valueBegin, &valueEnd))
+      {
+         pos = html.find('<', pos + 1);
+         continue;
+      }
+
+      std::string imgRef = html.substr(valueBegin, valueEnd - valueBegin);
+      std::map<std::string, std::string>::iterator it = dataUrls.find(imgRef);
+      if (it == dataUrls.end())
+      {
+         it = dataUrls.insert(
+                  std::make_pair(imgRef, imageDataUrl(basePath, imgRef))).first;
+      }
+
+      if (!it->second.empty())
+      {
+         if (result.empty())
+            result.reserve(html.size());
+         result.append(html, tail, valueBegin - tail);
+         result.append(it->second);
+         tail = valueEnd;
+      }
+
+      pos = html.find('<', valueEnd);
+   }
+
+   // nothing replaced
+   if (tail == 0)
+      return html;
+
+   result.append(html, tail, std::string::npos);
+   return result;
+}
+
 Base64ImageFilter::Base64ImageFilter(const FilePath& basePath)
    : boost::iostreams::regex_filter(
        boost::regex(
         "(<\\s*[Ii][Mm][Gg] [^\\>]*[Ss][Rr][Cc]\\s*=\\s*)([\"'])(.*?)(\\2)"),
-        boost::bind(&Base64ImageFilter::toBase64Image, this, _1)),
-     basePath_(basePath)
+        boost::bind(&Base64ImageFilter::toBase64Image,
+                    basePath,
+                    boost::make_shared<DataUrls>(),
+                    _1))
 {
 }
 
 
-std::string Base64ImageFilter::toBase64Image(const boost::cmatch& match)
+// (bound by value rather than to this since the filter is copied when it
+// is pushed onto a stream)
+std::string Base64ImageFilter::toBase64Image(const FilePath& basePath,
+                                             boost::shared_ptr<DataUrls> pCache,
+                                             const boost::cmatch& match)
 {
    // extract image reference
    std::string imgRef = match[3];
 
    // see if this is an image within the base directory. if it is then
-   // base64 encode it
-   FilePath imagePath = basePath_.childPath(imgRef);
-   if (imagePath.exists() &&
-       boost::algorithm::starts_with(imagePath.mimeContentType(), "image/"))
-   {     
-      std::string imageBase64;
-      Error error = core::base64::encode(imagePath, &imageBase64);
-      if (!error)
-      {
-         imgRef = "data:" + imagePath.mimeContentType() + ";base64,";
-         imgRef.append(imageBase64);
-      }
-      else
-      {
-         LOG_ERROR(error);
-      }
+   // base64 encode it (images referenced more than once are only encoded
+   // the first time)
+   DataUrls::iterator it = pCache->find(imgRef);
+   if (it == pCache->end())
+   {
+      it = pCache->insert(
+               std::make_pair(imgRef, imageDataUrl(basePath, imgRef))).first;
    }
+   if (!it->second.empty())
+      imgRef = it->second;
 
    // return the filtered result
    return match[1] + match[2] + imgRef + match[4];
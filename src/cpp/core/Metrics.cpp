@@ -0,0 +1,362 @@
+/*
+ * Metrics.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/Metrics.hpp>
+
+#include <cmath>
+#include <sstream>
+#include <algorithm>
+
+#include <core/Log.hpp>
+#include <core/Error.hpp>
+#include <core/Thread.hpp>
+
+#include <core/http/Request.hpp>
+#include <core/http/Response.hpp>
+
+namespace core {
+namespace metrics {
+
+namespace {
+
+// values below this are recorded exactly
+const boost::uint64_t kLinearBuckets = 16;
+
+// sub-buckets per power of two (2^kSubBucketBits)
+const int kSubBucketBits = 3;
+const boost::uint64_t kSubBuckets = 1 << kSubBucketBits;
+
+// values are clamped to 2^kMaxBits microseconds (about 12 days)
+const int kMaxBits = 40;
+const boost::uint64_t kMaxValue = (static_cast<boost::uint64_t>(1) << kMaxBits) - 1;
+
+const std::size_t kBucketCount =
+      kLinearBuckets + (kMaxBits - (kSubBucketBits + 1)) * kSubBuckets;
+
+int mostSignificantBit(boost::uint64_t value)
+{
+   int bit = 0;
+   while (value >>= 1)
+      bit++;
+   return bit;
+}
+
+std::size_t bucketIndex(boost::uint64_t value)
+{
+   if (value < kLinearBuckets)
+      return static_cast<std::size_t>(value);
+
+   int msb = mostSignificantBit(value);
+   int shift = msb - kSubBucketBits;
+   boost::uint64_t subBucket = (value >> shift) - kSubBuckets;
+   return kLinearBuckets +
+          (msb - (kSubBucketBits + 1)) * kSubBuckets +
+          static_cast<std::size_t>(subBucket);
+}
+
+boost::uint64_t bucketUpperBound(std::size_t index)
+{
+   if (index < kLinearBuckets)
+      return index;
+
+   std::size_t offset = index - kLinearBuckets;
+   int msb = static_cast<int>(offset / kSubBuckets) + kSubBucketBits + 1;
+   boost::uint64_t subBucket = offset % kSubBuckets;
+   int shift = msb - kSubBucketBits;
+   return ((kSubBuckets + subBucket + 1) << shift) - 1;
+}
+
+struct Metric
+{
+   std::string labelName;
+   Histograms histograms;
+};
+
+struct Gauge
+{
+   std::string labelName;
+   std::map<std::string, double> values;
+};
+
+boost::mutex s_metricsMutex;
+std::map<std::string, Metric> s_metrics;
+std::map<std::string, Metric> s_sizes;
+std::map<std::string, Gauge> s_gauges;
+
+std::string escapeLabelValue(const std::string& value)
+{
+   std::string escaped;
+   escaped.reserve(value.size());
+   for (std::string::const_iterator it = value.begin();
+        it != value.end();
+        ++it)
+   {
+      switch (*it)
+      {
+         case '\\': escaped.append("\\\\"); break;
+         case '"':  escaped.append("\\\""); break;
+         case '\n': escaped.append("\\n");  break;
+         default:   escaped.push_back(*it); break;
+      }
+   }
+   return escaped;
+}
+
+double toSeconds(boost::uint64_t microseconds)
+{
+   return static_cast<double>(microseconds) / 1000000.0;
+}
+
+double toBytes(boost::uint64_t bytes)
+{
+   return static_cast<double>(bytes);
+}
+
+void recordHistogramValue(std::map<std::string, Metric>* pMetrics,
+                          const std::string& name,
+                          const std::string& labelName,
+                          const std::string& labelValue,
+                          boost::uint64_t value)
+{
+   LOCK_MUTEX(s_metricsMutex)
+   {
+      Metric& metric = (*pMetrics)[name];
+      if (metric.labelName.empty())
+         metric.labelName = labelName;
+      metric.histograms[labelValue].record(value);
+   }
+   END_LOCK_MUTEX
+}
+
+Histograms copyHistograms(const std::map<std::string, Metric>& metrics,
+                          const std::string& name)
+{
+   LOCK_MUTEX(s_metricsMutex)
+   {
+      std::map<std::string, Metric>::const_iterator it = metrics.find(name);
+      if (it != metrics.end())
+         return it->second.histograms;
+   }
+   END_LOCK_MUTEX
+
+   return Histograms();
+}
+
+void writeSummaries(const std::map<std::string, Metric>& metrics,
+                    const std::string& suffix,
+                    double (*scale)(boost::uint64_t),
+                    std::ostream& ostr)
+{
+   const double kQuantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+   for (std::map<std::string, Metric>::const_iterator it = metrics.begin();
+        it != metrics.end();
+        ++it)
+   {
+      std::string name = it->first + suffix;
+      const Metric& metric = it->second;
+      ostr << "# TYPE " << name << " summary\n";
+
+      for (Histograms::const_iterator hIt = metric.histograms.begin();
+           hIt != metric.histograms.end();
+           ++hIt)
+      {
+         std::string label = metric.labelName + "=\"" +
+                             escapeLabelValue(hIt->first) + "\"";
+         const LatencyHistogram& histogram = hIt->second;
+
+         for (std::size_t i = 0;
+              i < sizeof(kQuantiles) / sizeof(kQuantiles[0]);
+              i++)
+         {
+            ostr << name << "{" << label
+                 << ",quantile=\"" << kQuantiles[i] << "\"} "
+                 << scale(histogram.valueAtQuantile(kQuantiles[i]))
+                 << "\n";
+         }
+
+         ostr << name << "_sum{" << label << "} "
+              << scale(histogram.sum()) << "\n";
+         ostr << name << "_count{" << label << "} "
+              << histogram.count() << "\n";
+      }
+   }
+}
+
+} // anonymous namespace
+
+LatencyHistogram::LatencyHistogram()
+   : buckets_(kBucketCount, 0), count_(0), sum_(0), max_(0)
+{
+}
+
+void LatencyHistogram::record(boost::uint64_t microseconds)
+{
+   microseconds = std::min(microseconds, kMaxValue);
+   buckets_[bucketIndex(microseconds)]++;
+   count_++;
+   sum_ += microseconds;
+   max_ = std::max(max_, microseconds);
+}
+
+boost::uint64_t LatencyHistogram::valueAtQuantile(double quantile) const
+{
+   if (count_ == 0)
+      return 0;
+
+   quantile = std::max(0.0, std::min(1.0, quantile));
+   boost::uint64_t target = static_cast<boost::uint64_t>(
+                              std::ceil(quantile * static_cast<double>(count_)));
+   target = std::max(target, static_cast<boost::uint64_t>(1));
+
+   boost::uint64_t cumulative = 0;
+   for (std::size_t i = 0; i < buckets_.size(); i++)
+   {
+      cumulative += buckets_[i];
+      if (cumulative >= target)
+         return std::min(bucketUpperBound(i), max_);
+   }
+
+   return max_;
+}
+
+void recordLatency(const std::string& name,
+                   const std::string& labelName,
+                   const std::string& labelValue,
+                   const boost::posix_time::time_duration& latency)
+{
+   // guard against the clock moving backwards
+   boost::int64_t microseconds = latency.total_microseconds();
+   if (microseconds < 0)
+      microseconds = 0;
+
+   recordHistogramValue(&s_metrics,
+                        name,
+                        labelName,
+                        labelValue,
+                        static_cast<boost::uint64_t>(microseconds));
+}
+
+void recordLatencySince(const std::string& name,
+                        const std::string& labelName,
+                        const std::string& labelValue,
+                        const boost::posix_time::ptime& startTime)
+{
+   if (startTime.is_not_a_date_time())
+      return;
+
+   using namespace boost::posix_time;
+   recordLatency(name,
+                 labelName,
+                 labelValue,
+                 microsec_clock::universal_time() - startTime);
+}
+
+void recordSize(const std::string& name,
+                const std::string& labelName,
+                const std::string& labelValue,
+                boost::uint64_t bytes)
+{
+   recordHistogramValue(&s_sizes, name, labelName, labelValue, bytes);
+}
+
+Histograms latencyHistograms(const std::string& name)
+{
+   return copyHistograms(s_metrics, name);
+}
+
+Histograms sizeHistograms(const std::string& name)
+{
+   return copyHistograms(s_sizes, name);
+}
+
+void setGauge(const std::string& name,
+              const std::string& labelName,
+              const std::string& labelValue,
+              double value)
+{
+   LOCK_MUTEX(s_metricsMutex)
+   {
+      Gauge& gauge = s_gauges[name];
+      if (gauge.labelName.empty())
+         gauge.labelName = labelName;
+      gauge.values[labelValue] = value;
+   }
+   END_LOCK_MUTEX
+}
+
+void removeGauge(const std::string& name, const std::string& labelValue)
+{
+   LOCK_MUTEX(s_metricsMutex)
+   {
+      std::map<std::string, Gauge>::iterator it = s_gauges.find(name);
+      if (it != s_gauges.end())
+         it->second.values.erase(labelValue);
+   }
+   END_LOCK_MUTEX
+}
+
+std::string prometheusText()
+{
+   // copy the metrics so that formatting happens outside of the lock
+   std::map<std::string, Metric> metrics;
+   std::map<std::string, Metric> sizes;
+   std::map<std::string, Gauge> gauges;
+   LOCK_MUTEX(s_metricsMutex)
+   {
+      metrics = s_metrics;
+      sizes = s_sizes;
+      gauges = s_gauges;
+   }
+   END_LOCK_MUTEX
+
+   std::ostringstream ostr;
+   writeSummaries(metrics, "_seconds", toSeconds, ostr);
+   writeSummaries(sizes, "_bytes", toBytes, ostr);
+
+   for (std::map<std::string, Gauge>::const_iterator it = gauges.begin();
+        it != gauges.end();
+        ++it)
+   {
+      const Gauge& gauge = it->second;
+      ostr << "# TYPE " << it->first << " gauge\n";
+
+      for (std::map<std::string, double>::const_iterator
+              vIt = gauge.values.begin();
+           vIt != gauge.values.end();
+           ++vIt)
+      {
+         ostr << it->first << "{" << gauge.labelName << "=\""
+              << escapeLabelValue(vIt->first) << "\"} "
+              << vIt->second << "\n";
+      }
+   }
+
+   return ostr.str();
+}
+
+void handleMetricsRequest(const http::Request& request,
+                          http::Response* pResponse)
+{
+   pResponse->setNoCacheHeaders();
+   pResponse->setContentType("text/plain; version=0.0.4");
+   Error error = pResponse->setBody(prometheusText());
+   if (error)
+      LOG_ERROR(error);
+}
+
+} // namespace metrics
+} // namespace core
+
@@ -21,17 +21,27 @@
 #include <core/FilePath.hpp>
 #include <core/SafeConvert.hpp>
 #include <core/FileSerializer.hpp>
+#include <core/system/System.hpp>
 
 namespace core {
 
 Settings::Settings()
    : updatePending_(false),
-     isDirty_(false)
+     isDirty_(false),
+     writeBehind_(false)
 {
 }
 
 Settings::~Settings()
 {
+   try
+   {
+      if (writeBehind_)
+         flush();
+   }
+   catch(...)
+   {
+   }
 }
 
 Error Settings::initialize(const FilePath& filePath) 
@@ -49,6 +59,13 @@ Error Settings::initialize(const FilePath& filePath)
          return error ;
       }
    }
+
+   // re-apply changes which haven't yet been written
+   for (std::map<std::string,std::string>::const_iterator
+         it = unflushed_.begin(); it != unflushed_.end(); ++it)
+   {
+      settingsMap_[it->first] = it->second;
+   }
    
    return Success() ;
 }
@@ -59,8 +76,10 @@ void Settings::set(const std::string& name, const std::string& value)
    {
       settingsMap_[name] = value ;
       isDirty_ = true;
-      
-      if (!updatePending_)
+
+      if (writeBehind_)
+         unflushed_[name] = value;
+      else if (!updatePending_)
          writeSettings() ;
    }
 }
@@ -132,12 +151,46 @@ void Settings::endUpdate()
       writeSettings();
 }
 
+void Settings::setWriteBehind(bool writeBehind)
+{
+   writeBehind_ = writeBehind;
+   if (!writeBehind_)
+      flush();
+}
+
+void Settings::flush()
+{
+   if (isDirty_ && !updatePending_)
+      writeSettings();
+}
+
 void Settings::writeSettings() 
 {
    isDirty_ = false;
-   Error error = core::writeStringMapToFile(settingsFile_, settingsMap_) ; 
-   if (error)
-     LOG_ERROR(error);
+   unflushed_.clear();
+
+   if (writeBehind_)
+   {
+      // write to a temporary file and then move it into place (so that
+      // readers never see a partially written file)
+      FilePath tempFile = settingsFile_.parent().childPath(
+                  "." + settingsFile_.filename() + "-" +
+                  core::system::generateShortenedUuid());
+      Error error = core::writeStringMapToFile(tempFile, settingsMap_);
+      if (!error)
+         error = tempFile.move(settingsFile_);
+      if (error)
+      {
+         LOG_ERROR(error);
+         tempFile.removeIfExists();
+      }
+   }
+   else
+   {
+      Error error = core::writeStringMapToFile(settingsFile_, settingsMap_) ; 
+      if (error)
+        LOG_ERROR(error);
+   }
 }
 
 
@@ -15,12 +15,10 @@
 
 #include <core/StringUtils.hpp>
 
-#include <map>
 #include <ostream>
 
 #include <algorithm>
 #include <boost/algorithm/string/classification.hpp>
-#include <boost/algorithm/string/replace.hpp>
 #include <boost/algorithm/string/split.hpp>
 #include <boost/regex.hpp>
 
@@ -33,9 +31,138 @@
 #include <winnls.h>
 #endif
 
+// scan for special characters 16 bytes at a time where sse2 is available
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define STRING_UTILS_SSE2
+#include <emmintrin.h>
+#endif
+
 namespace core {
 namespace string_utils {   
 
+namespace {
+
+// small set of characters which need special handling (e.g. escaping) and
+// a fast scan for the next of them
+class SpecialChars
+{
+public:
+   explicit SpecialChars(const char* chars)
+      : count_(0)
+   {
+      std::fill(special_, special_ + sizeof(special_), false);
+      for (const char* pChar = chars; *pChar && count_ < kMaxChars; ++pChar)
+      {
+         special_[static_cast<unsigned char>(*pChar)] = true;
+         chars_[count_++] = *pChar;
+      }
+   }
+
+   bool contains(char c) const
+   {
+      return special_[static_cast<unsigned char>(c)];
+   }
+
+   // the next special char in [begin, end) (or end if there are none)
+   const char* find(const char* begin, const char* end) const
+   {
+#ifdef STRING_UTILS_SSE2
+      // skip over clean blocks (falling through to the byte by byte scan
+      // for the block containing the match)
+      while (end - begin >= 16)
+      {
+         __m128i block = _mm_loadu_si128(
+                              reinterpret_cast<const __m128i*>(begin));
+         __m128i matches = _mm_setzero_si128();
+         for (std::size_t i = 0; i < count_; i++)
+         {
+            matches = _mm_or_si128(matches,
+                              _mm_cmpeq_epi8(block, _mm_set1_epi8(chars_[i])));
+         }
+         if (_mm_movemask_epi8(matches) != 0)
+            break;
+         begin += 16;
+      }
+#endif
+      for (; begin != end; ++begin)
+      {
+         if (contains(*begin))
+            return begin;
+      }
+      return end;
+   }
+
+private:
+   static const std::size_t kMaxChars = 8;
+   bool special_[256];
+   char chars_[kMaxChars];
+   std::size_t count_;
+};
+
+// replaces each of a set of special characters with its escaped form
+class Escaper
+{
+public:
+   Escaper(const char* chars, const char* const* replacements)
+      : chars_(chars)
+   {
+      std::fill(replacements_, replacements_ + 256,
+                static_cast<const char*>(NULL));
+      for (std::size_t i = 0; chars[i]; i++)
+         replacements_[static_cast<unsigned char>(chars[i])] = replacements[i];
+   }
+
+   std::string escape(const std::string& str) const
+   {
+      const char* begin = str.data();
+      const char* end = begin + str.size();
+      const char* pos = chars_.find(begin, end);
+      if (pos == end)
+         return str;
+
+      std::string result;
+      result.reserve(str.size() + (str.size() / 8));
+      const char* tail = begin;
+      while (pos != end)
+      {
+         result.append(tail, pos);
+         result.append(replacements_[static_cast<unsigned char>(*pos)]);
+         tail = pos + 1;
+         pos = chars_.find(tail, end);
+      }
+      result.append(tail, end);
+      return result;
+   }
+
+private:
+   SpecialChars chars_;
+   const char* replacements_[256];
+};
+
+const char* const kTextToHtmlSubs[] = { "&amp;", "&lt;" };
+const Escaper s_textToHtmlEscaper("&<", kTextToHtmlSubs);
+
+const char* const kHtmlSubs[] = { "&lt;", "&gt;", "&amp;" };
+const Escaper s_htmlEscaper("<>&", kHtmlSubs);
+
+const char* const kHtmlAttributeSubs[] =
+   { "&lt;", "&gt;", "&amp;", "&#39;", "&quot;", "&#13;", "&#10;" };
+const Escaper s_htmlAttributeEscaper("<>&'\"\r\n", kHtmlAttributeSubs);
+
+const char* const kJsLiteralSubs[] =
+   { "\\\\", "\\'", "\\\"", "\\r", "\\n", "\074" };
+const Escaper s_jsLiteralEscaper("\\'\"\r\n<", kJsLiteralSubs);
+
+const char* const kJsonLiteralSubs[] = { "\\\\", "\\\"", "\\r", "\\n" };
+const Escaper s_jsonLiteralEscaper("\\\"\r\n", kJsonLiteralSubs);
+
+// line endings: \n, \r\n, and the unicode line and paragraph separators
+// (U+2028 and U+2029, which are E2 80 A8 and E2 80 A9 in utf8)
+const SpecialChars s_lineEndingChars("\r\n\xE2");
+
+} // anonymous namespace
+
 void convertLineEndings(std::string* pStr, LineEnding type)
 {
    std::string replacement;
@@ -59,7 +186,180 @@ void convertLineEndings(std::string* pStr, LineEnding type)
       return;
    }
 
-   *pStr = boost::regex_replace(*pStr, boost::regex("\\r?\\n|\\xE2\\x80[\\xA8\\xA9]"), replacement);
+   const std::string& str = *pStr;
+   const char* begin = str.data();
+   const char* end = begin + str.size();
+   const char* pos = s_lineEndingChars.find(begin, end);
+
+   // nothing to convert (common for posix line endings)
+   bool posix = (replacement == "\n");
+   while (posix && pos != end && *pos == '\n')
+      pos = s_lineEndingChars.find(pos + 1, end);
+   if (pos == end)
+      return;
+
+   std::string result;
+   result.reserve(str.size() + (str.size() / 16));
+   pos = s_lineEndingChars.find(begin, end);
+   const char* tail = begin;
+   while (pos != end)
+   {
+      // length of the line ending at pos (0 if it isn't one)
+      std::size_t length = 0;
+      if (*pos == '\n')
+         length = 1;
+      else if (*pos == '\r' && (pos + 1) != end && *(pos + 1) == '\n')
+         length = 2;
+      else if (*pos == '\xE2' && (end - pos) >= 3 && *(pos + 1) == '\x80' &&
+               (*(pos + 2) == '\xA8' || *(pos + 2) == '\xA9'))
+         length = 3;
+
+      if (length > 0)
+      {
+         result.append(tail, pos);
+         result.append(replacement);
+         tail = pos + length;
+         pos = s_lineEndingChars.find(tail, end);
+      }
+      else
+      {
+         pos = s_lineEndingChars.find(pos + 1, end);
+      }
+   }
+   result.append(tail, end);
+   pStr->swap(result);
+}
+
+bool isAscii(const char* begin, const char* end)
+{
+#ifdef STRING_UTILS_SSE2
+   // the high bit of every byte in a block is collected by movemask
+   for (; end - begin >= 16; begin += 16)
+   {
+      __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+      if (_mm_movemask_epi8(block) != 0)
+         return false;
+   }
+#endif
+   for (; begin != end; ++begin)
+   {
+      if (static_cast<unsigned char>(*begin) & 0x80)
+         return false;
+   }
+   return true;
+}
+
+bool isAscii(const std::string& str)
+{
+   return isAscii(str.data(), str.data() + str.size());
+}
+
+namespace {
+
+// \a, \b, \t, \n, \v, \f, \r and escape are allowed in text
+inline bool isBinaryControlChar(char c)
+{
+   static const unsigned int kTextControlChars =
+         (1 << 7) | (1 << 8) | (1 << 9) | (1 << 10) | (1 << 11) | (1 << 12) |
+         (1 << 13) | (1 << 27);
+
+   unsigned char ch = static_cast<unsigned char>(c);
+   return ch < 0x20 && !(kTextControlChars & (1u << ch));
+}
+
+} // anonymous namespace
+
+bool hasBinaryControlChars(const char* begin, const char* end)
+{
+#ifdef STRING_UTILS_SSE2
+   // only blocks which have control characters (bytes which subtracting
+   // 0x1F saturates to zero) need to be examined byte by byte
+   const __m128i controlMax = _mm_set1_epi8(0x1F);
+   const __m128i zero = _mm_setzero_si128();
+   for (; end - begin >= 16; begin += 16)
+   {
+      __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+      __m128i controls = _mm_cmpeq_epi8(_mm_subs_epu8(block, controlMax),
+                                        zero);
+      if (_mm_movemask_epi8(controls) == 0)
+         continue;
+
+      for (const char* pos = begin; pos != begin + 16; ++pos)
+      {
+         if (isBinaryControlChar(*pos))
+            return true;
+      }
+   }
+#endif
+   for (; begin != end; ++begin)
+   {
+      if (isBinaryControlChar(*begin))
+         return true;
+   }
+   return false;
+}
+
+bool isValidUtf8(const char* begin, const char* end)
+{
+   const unsigned char* pos = reinterpret_cast<const unsigned char*>(begin);
+   const unsigned char* last = reinterpret_cast<const unsigned char*>(end);
+   while (pos != last)
+   {
+      // skip over ascii (a block at a time where possible)
+      if (last - pos >= 16 && isAscii(reinterpret_cast<const char*>(pos),
+                                      reinterpret_cast<const char*>(pos + 16)))
+      {
+         pos += 16;
+         continue;
+      }
+      else if (*pos < 0x80)
+      {
+         ++pos;
+         continue;
+      }
+
+      // sequence length and the allowed range of its second byte (which
+      // rules out overlong forms, surrogates and values beyond U+10FFFF)
+      std::size_t length;
+      unsigned char low = 0x80, high = 0xBF;
+      if (*pos >= 0xC2 && *pos <= 0xDF)
+         length = 2;
+      else if (*pos >= 0xE0 && *pos <= 0xEF)
+      {
+         length = 3;
+         if (*pos == 0xE0)
+            low = 0xA0;
+         else if (*pos == 0xED)
+            high = 0x9F;
+      }
+      else if (*pos >= 0xF0 && *pos <= 0xF4)
+      {
+         length = 4;
+         if (*pos == 0xF0)
+            low = 0x90;
+         else if (*pos == 0xF4)
+            high = 0x8F;
+      }
+      else
+         return false;
+
+      if (static_cast<std::size_t>(last - pos) < length)
+         return false;
+      if (pos[1] < low || pos[1] > high)
+         return false;
+      for (std::size_t i = 2; i < length; i++)
+      {
+         if ((pos[i] & 0xC0) != 0x80)
+            return false;
+      }
+      pos += length;
+   }
+   return true;
+}
+
+bool isValidUtf8(const std::string& str)
+{
+   return isValidUtf8(str.data(), str.data() + str.size());
 }
 
 std::string utf8ToSystem(const std::string& str,
@@ -69,6 +369,10 @@ std::string utf8ToSystem(const std::string& str,
       return std::string();
 
 #ifdef _WIN32
+   // ascii is the same in every code page
+   if (isAscii(str))
+      return str;
+
    wchar_t wide[str.length() + 1];
    int chars = ::MultiByteToWideChar(CP_UTF8, 0, str.c_str(), -1, wide, sizeof(wide));
    if (chars < 0)
@@ -106,6 +410,9 @@ std::string systemToUtf8(const std::string& str)
       return std::string();
 
 #ifdef _WIN32
+   if (isAscii(str))
+      return str;
+
    wchar_t wide[str.length() + 1];
    int chars = ::MultiByteToWideChar(CP_ACP, 0, str.c_str(), str.length(), wide, sizeof(wide));
    if (chars < 0)
@@ -141,87 +448,25 @@ std::string toLower(const std::string& str)
    
 std::string textToHtml(const std::string& str)
 {
-   std::string html = str;
-   boost::replace_all(html, "&", "&amp;");
-   boost::replace_all(html, "<", "&lt;");
-   return html;
+   return s_textToHtmlEscaper.escape(str);
 }
 
-namespace {
-std::string escape(std::string specialChars,
-                   const std::map<char, std::string>& replacements,
-                   std::string str)
-{
-   std::string result;
-   result.reserve(static_cast<size_t>(str.size() * 1.2));
-
-   size_t tail = 0;
-   for (size_t head = 0;
-        head < str.size()
-           && str.npos != (head = str.find_first_of(specialChars, head));
-        tail = ++head)
-   {
-      if (tail < head)
-         result.append(str, tail, head - tail);
-
-      result.append(replacements.find(str.at(head))->second);
-   }
-
-   if (tail < str.size())
-      result.append(str, tail, std::string::npos);
-
-   return result;
-
-}
-} // anonymous namespace
-
 std::string htmlEscape(const std::string& str, bool isAttributeValue)
 {
-   std::string escapes = isAttributeValue ?
-                         "<>&'\"\r\n" :
-                         "<>&" ;
-
-   std::map<char, std::string> subs;
-   subs['<'] = "&lt;";
-   subs['>'] = "&gt;";
-   subs['&'] = "&amp;";
    if (isAttributeValue)
-   {
-      subs['\''] = "&#39;";
-      subs['"'] = "&quot;";
-      subs['\r'] = "&#13;";
-      subs['\n'] = "&#10;";
-   }
-
-   return escape(escapes, subs, str);
+      return s_htmlAttributeEscaper.escape(str);
+   else
+      return s_htmlEscaper.escape(str);
 }
 
 std::string jsLiteralEscape(const std::string& str)
 {
-   std::string escapes = "\\'\"\r\n<";
-
-   std::map<char, std::string> subs;
-   subs['\\'] = "\\\\";
-   subs['\''] = "\\'";
-   subs['"'] = "\\\"";
-   subs['\r'] = "\\r";
-   subs['\n'] = "\\n";
-   subs['<'] = "\074";
-
-   return escape(escapes, subs, str);
+   return s_jsLiteralEscaper.escape(str);
 }
 
 std::string jsonLiteralEscape(const std::string& str)
 {
-   std::string escapes = "\\\"\r\n";
-
-   std::map<char, std::string> subs;
-   subs['\\'] = "\\\\";
-   subs['"'] = "\\\"";
-   subs['\r'] = "\\r";
-   subs['\n'] = "\\n";
-
-   return escape(escapes, subs, str);
+   return s_jsonLiteralEscaper.escape(str);
 }
 
 // The str that is passed in should INCLUDE the " " around the value!
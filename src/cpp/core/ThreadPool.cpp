@@ -0,0 +1,208 @@
+/*
+ * ThreadPool.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/ThreadPool.hpp>
+
+#include <algorithm>
+
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/Thread.hpp>
+
+namespace core {
+namespace thread {
+
+namespace {
+
+std::size_t defaultThreads()
+{
+   // one thread per core (within reason)
+   unsigned int threads = boost::thread::hardware_concurrency();
+   return std::max(2u, std::min(threads, 8u));
+}
+
+} // anonymous namespace
+
+ThreadPool::ThreadPool(std::size_t threads)
+   : threads_(threads > 0 ? threads : defaultThreads()),
+     started_(false),
+     stopping_(false),
+     pending_(0),
+     nextQueue_(0)
+{
+   for (std::size_t i = 0; i < threads_; i++)
+      queues_.push_back(boost::shared_ptr<WorkQueue>(new WorkQueue()));
+}
+
+ThreadPool::~ThreadPool()
+{
+   try
+   {
+      stop();
+   }
+   catch(...)
+   {
+   }
+}
+
+void ThreadPool::execute(const Work& work)
+{
+   std::size_t queue = 0;
+   LOCK_MUTEX(mutex_)
+   {
+      if (stopping_)
+         return;
+
+      if (!started_)
+         start();
+
+      queue = nextQueue_;
+      nextQueue_ = (nextQueue_ + 1) % queues_.size();
+   }
+   END_LOCK_MUTEX
+
+   LOCK_MUTEX(queues_[queue]->mutex)
+   {
+      queues_[queue]->work.push_back(work);
+   }
+   END_LOCK_MUTEX
+
+   LOCK_MUTEX(mutex_)
+   {
+      pending_++;
+   }
+   END_LOCK_MUTEX
+
+   workAvailable_.notify_one();
+}
+
+void ThreadPool::stop()
+{
+   std::vector<boost::shared_ptr<boost::thread> > workers;
+   LOCK_MUTEX(mutex_)
+   {
+      if (stopping_)
+         return;
+      stopping_ = true;
+      workers.swap(workers_);
+   }
+   END_LOCK_MUTEX
+
+   workAvailable_.notify_all();
+
+   // give running work a moment to finish (threads which are still busy
+   // after that are left to exit on their own)
+   BOOST_FOREACH(boost::shared_ptr<boost::thread> pWorker, workers)
+   {
+      pWorker->interrupt();
+      pWorker->timed_join(boost::posix_time::seconds(1));
+   }
+}
+
+// NOTE: called with mutex_ held
+void ThreadPool::start()
+{
+   started_ = true;
+   for (std::size_t i = 0; i < threads_; i++)
+   {
+      boost::shared_ptr<boost::thread> pWorker(new boost::thread());
+      safeLaunchThread(boost::bind(&ThreadPool::workerMain, this, i),
+                       pWorker.get());
+      workers_.push_back(pWorker);
+   }
+}
+
+bool ThreadPool::takeWork(std::size_t index, Work* pWork)
+{
+   // take from the front of our own queue first then steal from the back
+   // of the other queues
+   bool found = false;
+   for (std::size_t i = 0; i < queues_.size() && !found; i++)
+   {
+      WorkQueue& queue = *queues_[(index + i) % queues_.size()];
+      LOCK_MUTEX(queue.mutex)
+      {
+         if (!queue.work.empty())
+         {
+            if (i == 0)
+            {
+               *pWork = queue.work.front();
+               queue.work.pop_front();
+            }
+            else
+            {
+               *pWork = queue.work.back();
+               queue.work.pop_back();
+            }
+            found = true;
+         }
+      }
+      END_LOCK_MUTEX
+   }
+
+   if (found)
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         pending_--;
+      }
+      END_LOCK_MUTEX
+   }
+
+   return found;
+}
+
+void ThreadPool::workerMain(std::size_t index)
+{
+   try
+   {
+      while (true)
+      {
+         // wait for work to be available
+         {
+            boost::unique_lock<boost::mutex> lock(mutex_);
+            while (pending_ == 0 && !stopping_)
+               workAvailable_.wait(lock);
+            if (stopping_)
+               return;
+         }
+
+         // take and execute it (another worker may have beaten us to it)
+         Work work;
+         if (takeWork(index, &work))
+         {
+            try
+            {
+               work();
+            }
+            catch(const boost::thread_interrupted&)
+            {
+               throw;
+            }
+            CATCH_UNEXPECTED_EXCEPTION
+         }
+      }
+   }
+   catch(const boost::thread_interrupted&)
+   {
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+}
+
+} // namespace thread
+} // namespace core
@@ -17,18 +17,74 @@
 #include <core/Trace.hpp>
 
 #include <map>
+#include <deque>
+#include <sstream>
 
 #include <boost/utility.hpp>
 
+#include <core/Log.hpp>
+#include <core/Error.hpp>
 #include <core/Thread.hpp>
 
+#include <core/system/System.hpp>
+
+#include <core/http/Request.hpp>
+#include <core/http/Response.hpp>
+
 namespace core {
 namespace trace {
 
+const char * const kTraceIdHeader = "X-RS-Trace-Id";
+
 namespace {
 
 boost::mutex s_traceMutex ;
 
+// only the most recent spans are retained
+const std::size_t kMaxSpans = 10000;
+
+struct Span
+{
+   std::string traceId;
+   std::string name;
+   boost::posix_time::ptime startTime;
+   boost::posix_time::time_duration duration;
+};
+
+bool s_requestTracingEnabled = false;
+boost::mutex s_spansMutex;
+std::deque<Span> s_spans;
+
+// trace ids end up in logs and responses so we only accept short
+// alphanumeric ones from clients
+bool isValidTraceId(const std::string& traceId)
+{
+   if (traceId.empty() || traceId.size() > 64)
+      return false;
+
+   for (std::string::const_iterator it = traceId.begin();
+        it != traceId.end();
+        ++it)
+   {
+      char ch = *it;
+      bool valid = (ch >= '0' && ch <= '9') ||
+                   (ch >= 'a' && ch <= 'z') ||
+                   (ch >= 'A' && ch <= 'Z') ||
+                   ch == '-';
+      if (!valid)
+         return false;
+   }
+
+   return true;
+}
+
+boost::int64_t microsecondsSinceEpoch(const boost::posix_time::ptime& time)
+{
+   using namespace boost::posix_time;
+   static const ptime epoch(boost::gregorian::date(1970, 1, 1));
+   return (time - epoch).total_microseconds();
+}
+
 } // anonymous namespace
 
 
@@ -41,5 +97,113 @@ void add(void* key, const std::string& functionName)
    END_LOCK_MUTEX
 }
 
+void setRequestTracingEnabled(bool enabled)
+{
+   s_requestTracingEnabled = enabled;
+}
+
+bool requestTracingEnabled()
+{
+   return s_requestTracingEnabled;
+}
+
+void assignTraceId(http::Request* pRequest)
+{
+   if (!requestTracingEnabled())
+   {
+      pRequest->removeHeader(kTraceIdHeader);
+      return;
+   }
+
+   if (!isValidTraceId(pRequest->headerValue(kTraceIdHeader)))
+      pRequest->setHeader(kTraceIdHeader, system::generateShortenedUuid());
+}
+
+std::string traceId(const http::Request& request)
+{
+   std::string traceId = request.headerValue(kTraceIdHeader);
+   return isValidTraceId(traceId) ? traceId : std::string();
+}
+
+void recordSpan(const std::string& traceId,
+                const std::string& name,
+                const boost::posix_time::ptime& startTime,
+                const boost::posix_time::ptime& endTime)
+{
+   if (traceId.empty() ||
+       startTime.is_not_a_date_time() ||
+       endTime.is_not_a_date_time())
+   {
+      return;
+   }
+
+   Span span;
+   span.traceId = traceId;
+   span.name = name;
+   span.startTime = startTime;
+   span.duration = endTime - startTime;
+
+   LOCK_MUTEX(s_spansMutex)
+   {
+      s_spans.push_back(span);
+      if (s_spans.size() > kMaxSpans)
+         s_spans.pop_front();
+   }
+   END_LOCK_MUTEX
+}
+
+void recordSpanSince(const std::string& traceId,
+                     const std::string& name,
+                     const boost::posix_time::ptime& startTime)
+{
+   if (traceId.empty())
+      return;
+
+   recordSpan(traceId,
+              name,
+              startTime,
+              boost::posix_time::microsec_clock::universal_time());
+}
+
+std::string spansAsJsonLines(const std::string& traceId)
+{
+   // copy the spans so that formatting happens outside of the lock
+   std::deque<Span> spans;
+   LOCK_MUTEX(s_spansMutex)
+   {
+      spans = s_spans;
+   }
+   END_LOCK_MUTEX
+
+   // trace ids and span names are validated/fixed so need no escaping
+   std::ostringstream ostr;
+   for (std::deque<Span>::const_iterator it = spans.begin();
+        it != spans.end();
+        ++it)
+   {
+      if (!traceId.empty() && it->traceId != traceId)
+         continue;
+
+      boost::int64_t duration = it->duration.total_microseconds();
+      ostr << "{\"trace\":\"" << it->traceId << "\","
+           << "\"span\":\"" << it->name << "\","
+           << "\"start_us\":" << microsecondsSinceEpoch(it->startTime) << ","
+           << "\"duration_us\":" << (duration < 0 ? 0 : duration) << "}\n";
+   }
+
+   return ostr.str();
+}
+
+void handleTraceRequest(const http::Request& request,
+                        http::Response* pResponse)
+{
+   pResponse->setNoCacheHeaders();
+   pResponse->setContentType("application/x-ndjson");
+   Error error = pResponse->setBody(
+                        spansAsJsonLines(request.queryParamValue("trace")));
+   if (error)
+      LOG_ERROR(error);
+}
+
 } // namespace trace
 } // namespace core
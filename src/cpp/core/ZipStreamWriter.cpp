@@ -0,0 +1,470 @@
+/*
+ * ZipStreamWriter.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/ZipStreamWriter.hpp>
+
+#include <istream>
+#include <algorithm>
+
+#include <boost/foreach.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/date_time/c_local_time_adjustor.hpp>
+
+#include <zlib.h>
+
+#include <core/Log.hpp>
+#include <core/FilePath.hpp>
+
+namespace core {
+
+namespace {
+
+const std::size_t kBufferSize = 65536;
+
+const boost::uint32_t kLocalHeaderSignature = 0x04034b50;
+const boost::uint32_t kDataDescriptorSignature = 0x08074b50;
+const boost::uint32_t kCentralHeaderSignature = 0x02014b50;
+const boost::uint32_t kZip64EndSignature = 0x06064b50;
+const boost::uint32_t kZip64LocatorSignature = 0x07064b50;
+const boost::uint32_t kEndSignature = 0x06054b50;
+
+const boost::uint16_t kMethodStored = 0;
+const boost::uint16_t kMethodDeflated = 8;
+
+// data descriptor follows the data, names are utf8
+const boost::uint16_t kFlagDataDescriptor = 0x0008;
+const boost::uint16_t kFlagUtf8 = 0x0800;
+
+const boost::uint16_t kVersion = 20;
+const boost::uint16_t kVersionZip64 = 45;
+const boost::uint16_t kMadeByUnix = 3 << 8;
+
+const boost::uint32_t kMax32 = 0xFFFFFFFF;
+const boost::uint16_t kMax16 = 0xFFFF;
+
+// files larger than this use zip64 sizes (leaving headroom for deflate
+// output being slightly larger than its input)
+const boost::uint64_t kZip64Threshold = 0xFF000000;
+
+void putUInt16(boost::uint16_t value, std::string* pData)
+{
+   pData->push_back(static_cast<char>(value & 0xFF));
+   pData->push_back(static_cast<char>((value >> 8) & 0xFF));
+}
+
+void putUInt32(boost::uint32_t value, std::string* pData)
+{
+   putUInt16(static_cast<boost::uint16_t>(value & 0xFFFF), pData);
+   putUInt16(static_cast<boost::uint16_t>(value >> 16), pData);
+}
+
+void putUInt64(boost::uint64_t value, std::string* pData)
+{
+   putUInt32(static_cast<boost::uint32_t>(value & kMax32), pData);
+   putUInt32(static_cast<boost::uint32_t>(value >> 32), pData);
+}
+
+boost::uint32_t clamp32(boost::uint64_t value)
+{
+   return value >= kMax32 ? kMax32 : static_cast<boost::uint32_t>(value);
+}
+
+// formats whose contents are already compressed (deflating them would
+// cost time for no gain)
+bool isCompressed(const FilePath& filePath)
+{
+   static const char* const kExtensions[] = {
+      ".zip", ".gz", ".tgz", ".bz2", ".xz", ".7z", ".rar", ".jar",
+      ".rda", ".rdata", ".rds",
+      ".png", ".jpg", ".jpeg", ".gif",
+      ".mp3", ".mp4", ".mov", ".avi",
+      ".docx", ".xlsx", ".pptx", ".odt", ".ods", ".pdf"
+   };
+
+   std::string ext = filePath.extensionLowerCase();
+   for (std::size_t i = 0; i < sizeof(kExtensions)/sizeof(kExtensions[0]); i++)
+   {
+      if (ext == kExtensions[i])
+         return true;
+   }
+   return false;
+}
+
+Error zlibError(int code, const ErrorLocation& location)
+{
+   Error error = systemError(boost::system::errc::io_error, location);
+   error.addProperty("zlib-error", code);
+   return error;
+}
+
+} // anonymous namespace
+
+ZipStreamWriter::ZipStreamWriter(const Sink& sink)
+   : sink_(sink), offset_(0), inBuffer_(kBufferSize), outBuffer_(kBufferSize)
+{
+}
+
+Error ZipStreamWriter::addPath(const FilePath& filePath,
+                               const std::string& archivePath)
+{
+   if (filePath.isDirectory())
+      return addDirectory(filePath, archivePath);
+   else
+      return addFile(filePath, archivePath);
+}
+
+Error ZipStreamWriter::addDirectory(const FilePath& dirPath,
+                                    const std::string& name)
+{
+   Entry entry;
+   entry.name = name + "/";
+   entry.method = kMethodStored;
+   entry.flags = kFlagUtf8;
+   entry.crc = 0;
+   entry.compressedSize = 0;
+   entry.uncompressedSize = 0;
+   entry.offset = offset_;
+   entry.externalAttributes = (040755 << 16) | 0x10;
+   entry.zip64 = false;
+   setDosTime(dirPath.lastWriteTime(), &entry);
+
+   Error error = writeLocalHeader(entry);
+   if (error)
+      return error;
+   entries_.push_back(entry);
+
+   std::vector<FilePath> children;
+   error = dirPath.children(&children);
+   if (error)
+      return error;
+
+   BOOST_FOREACH(const FilePath& child, children)
+   {
+      // don't follow symlinked directories (they may form cycles)
+      if (child.isSymlink() && child.isDirectory())
+         continue;
+
+      error = addPath(child, name + "/" + child.filename());
+      if (error)
+         return error;
+   }
+
+   return Success();
+}
+
+Error ZipStreamWriter::addFile(const FilePath& filePath,
+                               const std::string& name)
+{
+   Entry entry;
+   entry.name = name;
+   entry.method = isCompressed(filePath) ? kMethodStored : kMethodDeflated;
+   entry.flags = kFlagUtf8 | kFlagDataDescriptor;
+   entry.crc = 0;
+   entry.compressedSize = 0;
+   entry.uncompressedSize = 0;
+   entry.offset = offset_;
+   entry.externalAttributes = 0100644 << 16;
+   entry.zip64 = filePath.size() >= kZip64Threshold;
+   setDosTime(filePath.lastWriteTime(), &entry);
+
+   Error error = writeLocalHeader(entry);
+   if (error)
+      return error;
+
+   error = writeFileData(filePath, &entry);
+   if (error)
+      return error;
+
+   error = writeDataDescriptor(entry);
+   if (error)
+      return error;
+
+   entries_.push_back(entry);
+   return Success();
+}
+
+Error ZipStreamWriter::writeFileData(const FilePath& filePath, Entry* pEntry)
+{
+   boost::shared_ptr<std::istream> pIfs;
+   Error error = filePath.open_r(&pIfs);
+   if (error)
+      return error;
+
+   z_stream zs;
+   bool deflating = pEntry->method == kMethodDeflated;
+   if (deflating)
+   {
+      zs.zalloc = Z_NULL;
+      zs.zfree = Z_NULL;
+      zs.opaque = Z_NULL;
+      int result = deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                                -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+      if (result != Z_OK)
+         return zlibError(result, ERROR_LOCATION);
+   }
+
+   uLong crc = crc32(0L, Z_NULL, 0);
+   bool done = false;
+   while (!done && !error)
+   {
+      pIfs->read(&(inBuffer_[0]), inBuffer_.size());
+      std::size_t bytesRead = static_cast<std::size_t>(pIfs->gcount());
+      if (pIfs->bad())
+      {
+         error = systemError(boost::system::errc::io_error, ERROR_LOCATION);
+         error.addProperty("path", filePath.absolutePath());
+         break;
+      }
+      done = pIfs->eof() || bytesRead == 0;
+
+      crc = crc32(crc,
+                  reinterpret_cast<const Bytef*>(&(inBuffer_[0])),
+                  static_cast<uInt>(bytesRead));
+      pEntry->uncompressedSize += bytesRead;
+
+      if (!deflating)
+      {
+         error = write(&(inBuffer_[0]), bytesRead);
+         pEntry->compressedSize += bytesRead;
+         continue;
+      }
+
+      zs.next_in = reinterpret_cast<Bytef*>(&(inBuffer_[0]));
+      zs.avail_in = static_cast<uInt>(bytesRead);
+      int flush = done ? Z_FINISH : Z_NO_FLUSH;
+      do
+      {
+         zs.next_out = reinterpret_cast<Bytef*>(&(outBuffer_[0]));
+         zs.avail_out = static_cast<uInt>(outBuffer_.size());
+         int result = deflate(&zs, flush);
+         if (result == Z_STREAM_ERROR)
+         {
+            error = zlibError(result, ERROR_LOCATION);
+            break;
+         }
+
+         std::size_t size = outBuffer_.size() - zs.avail_out;
+         pEntry->compressedSize += size;
+         error = write(&(outBuffer_[0]), size);
+      }
+      while (!error && zs.avail_out == 0);
+   }
+
+   if (deflating)
+      deflateEnd(&zs);
+
+   pEntry->crc = static_cast<boost::uint32_t>(crc);
+
+   // the file may have grown past the zip64 threshold as we read it
+   if (!error && !pEntry->zip64 &&
+       (pEntry->compressedSize >= kMax32 || pEntry->uncompressedSize >= kMax32))
+   {
+      error = systemError(boost::system::errc::file_too_large,
+                          ERROR_LOCATION);
+      error.addProperty("path", filePath.absolutePath());
+   }
+
+   return error;
+}
+
+Error ZipStreamWriter::writeLocalHeader(const Entry& entry)
+{
+   // sizes and crc are in the data descriptor (zip64 entries carry an
+   // extra field so that readers know to expect 8 byte sizes there)
+   std::string extra;
+   if (entry.zip64)
+   {
+      putUInt16(0x0001, &extra);
+      putUInt16(16, &extra);
+      putUInt64(0, &extra);
+      putUInt64(0, &extra);
+   }
+
+   std::string header;
+   putUInt32(kLocalHeaderSignature, &header);
+   putUInt16(entry.zip64 ? kVersionZip64 : kVersion, &header);
+   putUInt16(entry.flags, &header);
+   putUInt16(entry.method, &header);
+   putUInt16(entry.dosTime, &header);
+   putUInt16(entry.dosDate, &header);
+   putUInt32(0, &header);
+   putUInt32(entry.zip64 ? kMax32 : 0, &header);
+   putUInt32(entry.zip64 ? kMax32 : 0, &header);
+   putUInt16(static_cast<boost::uint16_t>(entry.name.size()), &header);
+   putUInt16(static_cast<boost::uint16_t>(extra.size()), &header);
+   header.append(entry.name);
+   header.append(extra);
+
+   return write(header);
+}
+
+Error ZipStreamWriter::writeDataDescriptor(const Entry& entry)
+{
+   std::string descriptor;
+   putUInt32(kDataDescriptorSignature, &descriptor);
+   putUInt32(entry.crc, &descriptor);
+   if (entry.zip64)
+   {
+      putUInt64(entry.compressedSize, &descriptor);
+      putUInt64(entry.uncompressedSize, &descriptor);
+   }
+   else
+   {
+      putUInt32(static_cast<boost::uint32_t>(entry.compressedSize),
+                &descriptor);
+      putUInt32(static_cast<boost::uint32_t>(entry.uncompressedSize),
+                &descriptor);
+   }
+
+   return write(descriptor);
+}
+
+Error ZipStreamWriter::finish()
+{
+   boost::uint64_t centralOffset = offset_;
+
+   BOOST_FOREACH(const Entry& entry, entries_)
+   {
+      // values which don't fit are moved into a zip64 extra field
+      std::string extra;
+      if (entry.zip64 || entry.offset >= kMax32)
+      {
+         putUInt16(0x0001, &extra);
+         putUInt16(0, &extra);
+         if (entry.uncompressedSize >= kMax32)
+            putUInt64(entry.uncompressedSize, &extra);
+         if (entry.compressedSize >= kMax32)
+            putUInt64(entry.compressedSize, &extra);
+         if (entry.offset >= kMax32)
+            putUInt64(entry.offset, &extra);
+
+         boost::uint16_t extraSize =
+                        static_cast<boost::uint16_t>(extra.size() - 4);
+         if (extraSize == 0)
+         {
+            extra.clear();
+         }
+         else
+         {
+            extra[2] = static_cast<char>(extraSize & 0xFF);
+            extra[3] = static_cast<char>(extraSize >> 8);
+         }
+      }
+
+      boost::uint16_t version = extra.empty() && !entry.zip64 ?
+                                                kVersion : kVersionZip64;
+
+      std::string header;
+      putUInt32(kCentralHeaderSignature, &header);
+      putUInt16(kMadeByUnix | version, &header);
+      putUInt16(version, &header);
+      putUInt16(entry.flags, &header);
+      putUInt16(entry.method, &header);
+      putUInt16(entry.dosTime, &header);
+      putUInt16(entry.dosDate, &header);
+      putUInt32(entry.crc, &header);
+      putUInt32(clamp32(entry.compressedSize), &header);
+      putUInt32(clamp32(entry.uncompressedSize), &header);
+      putUInt16(static_cast<boost::uint16_t>(entry.name.size()), &header);
+      putUInt16(static_cast<boost::uint16_t>(extra.size()), &header);
+      putUInt16(0, &header); // comment length
+      putUInt16(0, &header); // disk number
+      putUInt16(0, &header); // internal attributes
+      putUInt32(entry.externalAttributes, &header);
+      putUInt32(clamp32(entry.offset), &header);
+      header.append(entry.name);
+      header.append(extra);
+
+      Error error = write(header);
+      if (error)
+         return error;
+   }
+
+   boost::uint64_t centralSize = offset_ - centralOffset;
+   boost::uint64_t entryCount = entries_.size();
+
+   std::string end;
+   if (entryCount >= kMax16 ||
+       centralSize >= kMax32 ||
+       centralOffset >= kMax32)
+   {
+      boost::uint64_t zip64EndOffset = offset_;
+
+      putUInt32(kZip64EndSignature, &end);
+      putUInt64(44, &end);
+      putUInt16(kMadeByUnix | kVersionZip64, &end);
+      putUInt16(kVersionZip64, &end);
+      putUInt32(0, &end);
+      putUInt32(0, &end);
+      putUInt64(entryCount, &end);
+      putUInt64(entryCount, &end);
+      putUInt64(centralSize, &end);
+      putUInt64(centralOffset, &end);
+
+      putUInt32(kZip64LocatorSignature, &end);
+      putUInt32(0, &end);
+      putUInt64(zip64EndOffset, &end);
+      putUInt32(1, &end);
+   }
+
+   boost::uint16_t count16 = entryCount >= kMax16 ?
+                  kMax16 : static_cast<boost::uint16_t>(entryCount);
+   putUInt32(kEndSignature, &end);
+   putUInt16(0, &end);
+   putUInt16(0, &end);
+   putUInt16(count16, &end);
+   putUInt16(count16, &end);
+   putUInt32(clamp32(centralSize), &end);
+   putUInt32(clamp32(centralOffset), &end);
+   putUInt16(0, &end);
+
+   return write(end);
+}
+
+Error ZipStreamWriter::write(const std::string& data)
+{
+   return write(data.data(), data.size());
+}
+
+Error ZipStreamWriter::write(const char* data, std::size_t size)
+{
+   if (size == 0)
+      return Success();
+
+   offset_ += size;
+   return sink_(data, size);
+}
+
+void ZipStreamWriter::setDosTime(std::time_t time, Entry* pEntry)
+{
+   using namespace boost::posix_time;
+   typedef boost::date_time::c_local_adjustor<ptime> local_adj;
+
+   // dos dates begin in 1980
+   ptime local = local_adj::utc_to_local(from_time_t(time));
+   int year = std::max(1980, static_cast<int>(local.date().year()));
+   time_duration tod = local.time_of_day();
+
+   pEntry->dosDate = static_cast<boost::uint16_t>(
+                        ((year - 1980) << 9) |
+                        (local.date().month() << 5) |
+                        local.date().day());
+   pEntry->dosTime = static_cast<boost::uint16_t>(
+                        (tod.hours() << 11) |
+                        (tod.minutes() << 5) |
+                        (tod.seconds() / 2));
+}
+
+} // namespace core
@@ -15,12 +15,20 @@
 
 #include <core/gwt/GwtFileHandler.hpp>
 
-#include <boost/regex.hpp>
+#include <map>
+
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/algorithm/string/predicate.hpp>
 
 #include <core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/Hash.hpp>
+#include <core/Thread.hpp>
 #include <core/system/System.hpp>
 #include <core/http/Request.hpp>
 #include <core/http/Response.hpp>
+#include <core/http/Util.hpp>
 
 
 namespace core {
@@ -87,6 +95,150 @@ FilePath requestedFile(const std::string& wwwLocalPath,
 
 }
 
+// www files are static so we hold them in memory (along with their
+// compressed representation) rather than reading and compressing them
+// on every request. entries are revalidated against the file's size and
+// modification time so edits are still picked up during development.
+struct CachedFile
+{
+   std::time_t lastWriteTime;
+   uintmax_t size;
+   std::string contentType;
+   std::string eTag;
+   std::string contents;
+   std::string gzipContents;
+};
+
+// files larger than this are served directly from disk
+const uintmax_t kMaxCachedFileSize = 16 * 1024 * 1024;
+
+boost::mutex s_fileCacheMutex;
+std::map<std::string, boost::shared_ptr<CachedFile> > s_fileCache;
+
+boost::shared_ptr<CachedFile> loadCachedFile(const FilePath& filePath)
+{
+   boost::shared_ptr<CachedFile> pFile(new CachedFile());
+   pFile->lastWriteTime = filePath.lastWriteTime();
+   pFile->size = filePath.size();
+   if (pFile->size > kMaxCachedFileSize)
+      return boost::shared_ptr<CachedFile>();
+
+   Error error = readStringFromFile(filePath, &(pFile->contents));
+   if (error)
+   {
+      LOG_ERROR(error);
+      return boost::shared_ptr<CachedFile>();
+   }
+
+   pFile->contentType = filePath.mimeContentType();
+   pFile->eTag = hash::xxHash64(pFile->contents);
+
+#ifndef _WIN32
+   // prefer a precompressed sibling (e.g. produced by the build) if the
+   // policy allows it, otherwise compress once here
+   const http::CompressionPolicy& policy = http::compressionPolicy();
+   FilePath gzPath(filePath.absolutePath() + ".gz");
+   if (policy.precompressedFiles && gzPath.exists() &&
+       gzPath.lastWriteTime() >= pFile->lastWriteTime)
+   {
+      error = readStringFromFile(gzPath, &(pFile->gzipContents));
+      if (error)
+      {
+         LOG_ERROR(error);
+         pFile->gzipContents.clear();
+      }
+   }
+   else if (policy.shouldCompress(pFile->contentType,
+                                  pFile->contents.size()))
+   {
+      // the result is cached so use the best compression available
+      error = http::gzipContent(pFile->contents, 9, &(pFile->gzipContents));
+      if (error)
+      {
+         // serve uncompressed
+         LOG_ERROR(error);
+         pFile->gzipContents.clear();
+      }
+   }
+#endif
+
+   return pFile;
+}
+
+boost::shared_ptr<CachedFile> cachedFile(const FilePath& filePath)
+{
+   std::string path = filePath.absolutePath();
+
+   LOCK_MUTEX(s_fileCacheMutex)
+   {
+      std::map<std::string, boost::shared_ptr<CachedFile> >::const_iterator
+                                                   it = s_fileCache.find(path);
+      if (it != s_fileCache.end() &&
+          it->second->lastWriteTime == filePath.lastWriteTime() &&
+          it->second->size == filePath.size())
+      {
+         return it->second;
+      }
+   }
+   END_LOCK_MUTEX
+
+   // load outside of the lock (concurrent loads of the same file are
+   // harmless, the last one in wins)
+   boost::shared_ptr<CachedFile> pFile = loadCachedFile(filePath);
+
+   LOCK_MUTEX(s_fileCacheMutex)
+   {
+      if (pFile)
+         s_fileCache[path] = pFile;
+      else
+         s_fileCache.erase(path);
+   }
+   END_LOCK_MUTEX
+
+   return pFile;
+}
+
+void setCachedFileBody(const CachedFile& file,
+                       const http::Request& request,
+                       http::Response* pResponse)
+{
+   pResponse->setContentType(file.contentType);
+
+   // body is already encoded so set it directly
+   if (!file.gzipContents.empty() &&
+       request.acceptsEncoding(http::kGzipEncoding))
+   {
+      pResponse->setBodyUnencoded(file.gzipContents);
+      pResponse->setContentEncoding(http::kGzipEncoding);
+   }
+   else
+   {
+      pResponse->setBodyUnencoded(file.contents);
+   }
+}
+
+// serve a file which is designated to be revalidated by the client
+void setCachedFileWithRevalidation(const CachedFile& file,
+                                   const http::Request& request,
+                                   http::Response* pResponse)
+{
+   using namespace boost::posix_time;
+   ptime lastModifiedDate = from_time_t(file.lastWriteTime);
+   pResponse->setHeader("Last-Modified", http::util::httpDate(lastModifiedDate));
+   pResponse->setHeader("ETag", file.eTag);
+
+   if (file.eTag == request.headerValue("If-None-Match") ||
+       lastModifiedDate == request.ifModifiedSince())
+   {
+      pResponse->removeHeader("Content-Type"); // upstream code may have set this
+      pResponse->setStatusCode(http::status::NotModified);
+   }
+   else
+   {
+      setCachedFileBody(file, request, pResponse);
+   }
+}
+
 void handleFileRequest(const std::string& wwwLocalPath,
                        const std::string& baseUri,
                        core::http::UriFilterFunction mainPageFilter,
@@ -146,18 +298,27 @@ void handleFileRequest(const std::string& wwwLocalPath,
       return;
    }
    
+   // files which are too large to hold in memory are served from disk
+   boost::shared_ptr<CachedFile> pFile = cachedFile(filePath);
+
    // case: files designated to be cached "forever"
-   if (regex_match(uri, boost::regex(".*\\.cache\\..*")))
+   if (boost::algorithm::contains(uri, ".cache."))
    {
       pResponse->setCacheForeverHeaders();
-      pResponse->setFile(filePath, request);
+      if (pFile)
+         setCachedFileBody(*pFile, request, pResponse);
+      else
+         pResponse->setFile(filePath, request);
    }
    
    // case: files designated to never be cached 
-   else if (regex_match(uri, boost::regex(".*\\.nocache\\..*")))
+   else if (boost::algorithm::contains(uri, ".nocache."))
    {
       pResponse->setNoCacheHeaders();
-      pResponse->setFile(filePath, request);
+      if (pFile)
+         setCachedFileBody(*pFile, request, pResponse);
+      else
+         pResponse->setFile(filePath, request);
    }
    
    // case: normal cacheable file
@@ -165,7 +326,10 @@ void handleFileRequest(const std::string& wwwLocalPath,
    {
       // since these are application components we force revalidation
       pResponse->setCacheWithRevalidationHeaders();
-      pResponse->setCacheableFile(filePath, request);
+      if (pFile)
+         setCachedFileWithRevalidation(*pFile, request, pResponse);
+      else
+         pResponse->setCacheableFile(filePath, request);
    }
   
 }
@@ -0,0 +1,170 @@
+/*
+ * FileBody.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/http/FileBody.hpp>
+
+#include <istream>
+#include <algorithm>
+
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#endif
+
+namespace core {
+namespace http {
+
+namespace {
+
+Error fileBodyTruncatedError(const FilePath& filePath,
+                             const ErrorLocation& location)
+{
+   Error error = systemError(boost::system::errc::io_error, location);
+   error.addProperty("description", "File shorter than response body");
+   error.addProperty("path", filePath.absolutePath());
+   return error;
+}
+
+} // anonymous namespace
+
+FileBodyReader::FileBodyReader(const Response& response)
+   : filePath_(response.fileBodyPath()),
+     offset_(response.fileBodyOffset()),
+     remaining_(response.fileBodyLength())
+{
+}
+
+Error FileBodyReader::open()
+{
+   Error error = filePath_.open_r(&pIfs_);
+   if (error)
+      return error;
+
+   try
+   {
+      pIfs_->exceptions(std::istream::failbit | std::istream::badbit);
+      pIfs_->seekg(static_cast<std::streamoff>(offset_));
+      return Success();
+   }
+   catch(const std::exception& e)
+   {
+      Error error = systemError(boost::system::errc::io_error,
+                                ERROR_LOCATION);
+      error.addProperty("what", e.what());
+      error.addProperty("path", filePath_.absolutePath());
+      return error;
+   }
+}
+
+Error FileBodyReader::read(char* buffer,
+                           std::size_t bufferSize,
+                           std::size_t* pBytesRead)
+{
+   *pBytesRead = 0;
+   if (remaining_ == 0)
+      return Success();
+
+   std::size_t size = static_cast<std::size_t>(
+                  std::min(remaining_, static_cast<uintmax_t>(bufferSize)));
+   try
+   {
+      pIfs_->read(buffer, size);
+   }
+   catch(const std::exception& e)
+   {
+      // short reads also land here (failbit is set at eof)
+      if (pIfs_->eof())
+         return fileBodyTruncatedError(filePath_, ERROR_LOCATION);
+
+      Error error = systemError(boost::system::errc::io_error,
+                                ERROR_LOCATION);
+      error.addProperty("what", e.what());
+      error.addProperty("path", filePath_.absolutePath());
+      return error;
+   }
+
+   remaining_ -= size;
+   *pBytesRead = size;
+   return Success();
+}
+
+#ifdef __linux__
+
+Error sendFile(int socket,
+               const FilePath& filePath,
+               uintmax_t offset,
+               uintmax_t length)
+{
+   int fd = ::open(filePath.absolutePath().c_str(), O_RDONLY);
+   if (fd == -1)
+   {
+      Error error = systemError(errno, ERROR_LOCATION);
+      error.addProperty("path", filePath.absolutePath());
+      return error;
+   }
+
+   Error error;
+   off_t fileOffset = static_cast<off_t>(offset);
+   uintmax_t remaining = length;
+   while (remaining > 0)
+   {
+      std::size_t count = static_cast<std::size_t>(
+                  std::min(remaining, static_cast<uintmax_t>(1024 * 1024)));
+      ssize_t sent = ::sendfile(socket, fd, &fileOffset, count);
+      if (sent > 0)
+      {
+         remaining -= sent;
+      }
+      else if (sent == 0)
+      {
+         error = fileBodyTruncatedError(filePath, ERROR_LOCATION);
+         break;
+      }
+      else if (errno == EINTR)
+      {
+         continue;
+      }
+      else if (errno == EAGAIN || errno == EWOULDBLOCK)
+      {
+         // the socket may be in non-blocking mode (asio sets it when
+         // performing async operations) so wait until it is writeable
+         pollfd pfd;
+         pfd.fd = socket;
+         pfd.events = POLLOUT;
+         pfd.revents = 0;
+         if (::poll(&pfd, 1, -1) == -1 && errno != EINTR)
+         {
+            error = systemError(errno, ERROR_LOCATION);
+            break;
+         }
+      }
+      else
+      {
+         error = systemError(errno, ERROR_LOCATION);
+         break;
+      }
+   }
+
+   ::close(fd);
+   return error;
+}
+
+#endif
+
+} // namespace http
+} // namespace core
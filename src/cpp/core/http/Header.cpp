@@ -17,6 +17,9 @@
 
 #include <algorithm>
 
+#include <boost/assert.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/unordered_map.hpp>
 #include <boost/algorithm/string.hpp>
 
 namespace core {
@@ -27,6 +30,102 @@ bool HeaderNamePredicate::operator()(const Header& header) const
    return boost::iequals(name_, header.name); 
 }
    
+namespace {
+
+// (header names are ascii so we don't need a locale aware tolower)
+inline char asciiLower(char c)
+{
+   return (c >= 'A' && c <= 'Z') ? (c + ('a' - 'A')) : c;
+}
+
+struct HeaderNameHash
+{
+   std::size_t operator()(const std::string& name) const
+   {
+      std::size_t seed = 0;
+      for (std::string::const_iterator it = name.begin(); it != name.end(); ++it)
+         boost::hash_combine(seed, asciiLower(*it));
+      return seed;
+   }
+};
+
+struct HeaderNameEqual
+{
+   bool operator()(const std::string& a, const std::string& b) const
+   {
+      if (a.size() != b.size())
+         return false;
+      for (std::size_t i = 0; i < a.size(); i++)
+      {
+         if (asciiLower(a[i]) != asciiLower(b[i]))
+            return false;
+      }
+      return true;
+   }
+};
+
+typedef boost::unordered_map<std::string,
+                             WellKnownHeader,
+                             HeaderNameHash,
+                             HeaderNameEqual> WellKnownHeaders;
+
+// (order must match the WellKnownHeader enum)
+const char * const kWellKnownHeaderNames[] =
+{
+   "Accept",
+   "Accept-Encoding",
+   "Authorization",
+   "Cache-Control",
+   "Connection",
+   "Content-Disposition",
+   "Content-Encoding",
+   "Content-Length",
+   "Content-Type",
+   "Cookie",
+   "Date",
+   "ETag",
+   "Expires",
+   "Host",
+   "If-Modified-Since",
+   "If-None-Match",
+   "Last-Modified",
+   "Location",
+   "Pragma",
+   "Range",
+   "Referer",
+   "Set-Cookie",
+   "Transfer-Encoding",
+   "Upgrade",
+   "User-Agent",
+   "Vary",
+   "X-Forwarded-For"
+};
+
+WellKnownHeaders createWellKnownHeaders()
+{
+   BOOST_ASSERT(sizeof(kWellKnownHeaderNames) / sizeof(const char*) ==
+                static_cast<std::size_t>(kWellKnownHeaderCount));
+
+   WellKnownHeaders headers;
+   for (int i = 0; i < kWellKnownHeaderCount; i++)
+      headers[kWellKnownHeaderNames[i]] = static_cast<WellKnownHeader>(i);
+   return headers;
+}
+
+// (initialized during static initialization, before any threads exist)
+const WellKnownHeaders s_wellKnownHeaders = createWellKnownHeaders();
+
+} // anonymous namespace
+
+WellKnownHeader wellKnownHeader(const std::string& name)
+{
+   WellKnownHeaders::const_iterator it = s_wellKnownHeaders.find(name);
+   if (it != s_wellKnownHeaders.end())
+      return it->second;
+   else
+      return kUnknownHeader;
+}
+
 bool containsHeader(const Headers& headers, const std::string& name)
 {
    return findHeader(headers, name) != headers.end();
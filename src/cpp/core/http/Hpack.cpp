@@ -0,0 +1,504 @@
+/*
+ * Hpack.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/http/Hpack.hpp>
+
+#include <algorithm>
+
+#include <boost/cstdint.hpp>
+#include <boost/foreach.hpp>
+#include <boost/algorithm/string/case_conv.hpp>
+
+namespace core {
+namespace http {
+namespace hpack {
+
+namespace {
+
+// per entry overhead which counts towards the table size
+const std::size_t kEntryOverhead = 32;
+
+// limit on the decoded size of a header block (guards against a peer
+// exhausting our memory with a small, highly compressed block)
+const std::size_t kMaxHeaderListSize = 256 * 1024;
+
+// values longer than this aren't worth keeping in the dynamic table
+const std::size_t kMaxIndexedValueSize = 512;
+
+struct StaticEntry
+{
+   const char* name;
+   const char* value;
+};
+
+// RFC 7541 Appendix A
+const StaticEntry kStaticTable[] =
+{
+   { ":authority", "" },
+   { ":method", "GET" },
+   { ":method", "POST" },
+   { ":path", "/" },
+   { ":path", "/index.html" },
+   { ":scheme", "http" },
+   { ":scheme", "https" },
+   { ":status", "200" },
+   { ":status", "204" },
+   { ":status", "206" },
+   { ":status", "304" },
+   { ":status", "400" },
+   { ":status", "404" },
+   { ":status", "500" },
+   { "accept-charset", "" },
+   { "accept-encoding", "gzip, deflate" },
+   { "accept-language", "" },
+   { "accept-ranges", "" },
+   { "accept", "" },
+   { "access-control-allow-origin", "" },
+   { "age", "" },
+   { "allow", "" },
+   { "authorization", "" },
+   { "cache-control", "" },
+   { "content-disposition", "" },
+   { "content-encoding", "" },
+   { "content-language", "" },
+   { "content-length", "" },
+   { "content-location", "" },
+   { "content-range", "" },
+   { "content-type", "" },
+   { "cookie", "" },
+   { "date", "" },
+   { "etag", "" },
+   { "expect", "" },
+   { "expires", "" },
+   { "from", "" },
+   { "host", "" },
+   { "if-match", "" },
+   { "if-modified-since", "" },
+   { "if-none-match", "" },
+   { "if-range", "" },
+   { "if-unmodified-since", "" },
+   { "last-modified", "" },
+   { "link", "" },
+   { "location", "" },
+   { "max-forwards", "" },
+   { "proxy-authenticate", "" },
+   { "proxy-authorization", "" },
+   { "range", "" },
+   { "referer", "" },
+   { "refresh", "" },
+   { "retry-after", "" },
+   { "server", "" },
+   { "set-cookie", "" },
+   { "strict-transport-security", "" },
+   { "transfer-encoding", "" },
+   { "user-agent", "" },
+   { "vary", "" },
+   { "via", "" },
+   { "www-authenticate", "" }
+};
+
+const std::size_t kStaticTableSize =
+                           sizeof(kStaticTable) / sizeof(kStaticTable[0]);
+
+std::size_t entrySize(const Header& header)
+{
+   return header.name.size() + header.value.size() + kEntryOverhead;
+}
+
+// Huffman codes (RFC 7541 Appendix B) are canonical, so within each code
+// length the codes are consecutive and in symbol order. browsers only
+// Huffman encode the printable ASCII characters in header values, so we
+// decode just those (plus NUL which shares a code length with them)
+struct HuffmanCodeLength
+{
+   int length;
+   boost::uint32_t firstCode;
+   const char* symbols;
+   std::size_t symbolCount;
+};
+
+const HuffmanCodeLength kHuffmanCodeLengths[] =
+{
+   {  5, 0x0,     "012aceiost", 10 },
+   {  6, 0x14,    " %-./3456789=A_bdfghlmnpru", 26 },
+   {  7, 0x5c,    ":BCDEFGHIJKLMNOPQRSTUVWYjkqvwxyz", 32 },
+   {  8, 0xf8,    "&*,;XZ", 6 },
+   { 10, 0x3f8,   "!\"()?", 5 },
+   { 11, 0x7fa,   "'+|", 3 },
+   { 12, 0xffa,   "#>", 2 },
+   { 13, 0x1ff8,  "\0$@[]~", 6 },
+   { 14, 0x3ffc,  "^}", 2 },
+   { 15, 0x7ffc,  "<`{", 3 },
+   { 19, 0x7fff0, "\\", 1 }
+};
+
+const std::size_t kHuffmanCodeLengthCount =
+                  sizeof(kHuffmanCodeLengths) / sizeof(kHuffmanCodeLengths[0]);
+
+// the longest code in the full table
+const int kMaxHuffmanCodeLength = 30;
+
+bool huffmanDecode(std::string::const_iterator begin,
+                   std::string::const_iterator end,
+                   std::string* pDecoded)
+{
+   boost::uint32_t code = 0;
+   int length = 0;
+   for (std::string::const_iterator it = begin; it != end; ++it)
+   {
+      unsigned char byte = static_cast<unsigned char>(*it);
+      for (int bit = 7; bit >= 0; bit--)
+      {
+         code = (code << 1) | ((byte >> bit) & 1);
+         length++;
+
+         for (std::size_t i = 0; i < kHuffmanCodeLengthCount; i++)
+         {
+            const HuffmanCodeLength& codeLength = kHuffmanCodeLengths[i];
+            if (codeLength.length != length)
+               continue;
+
+            if (code >= codeLength.firstCode &&
+                code < codeLength.firstCode + codeLength.symbolCount)
+            {
+               pDecoded->push_back(
+                     codeLength.symbols[code - codeLength.firstCode]);
+               code = 0;
+               length = 0;
+            }
+            break;
+         }
+
+         if (length >= kMaxHuffmanCodeLength)
+            return false;
+      }
+   }
+
+   // padding is the (most significant bits of the) EOS code: all ones
+   // and less than a byte
+   boost::uint32_t padding = (1u << length) - 1;
+   return length < 8 && code == padding;
+}
+
+bool decodeInteger(const std::string& block,
+                   std::size_t* pPos,
+                   int prefixBits,
+                   std::size_t* pValue)
+{
+   if (*pPos >= block.size())
+      return false;
+
+   std::size_t mask = (1u << prefixBits) - 1;
+   std::size_t value = static_cast<unsigned char>(block[*pPos]) & mask;
+   (*pPos)++;
+   if (value < mask)
+   {
+      *pValue = value;
+      return true;
+   }
+
+   int shift = 0;
+   while (true)
+   {
+      if (*pPos >= block.size() || shift > 28)
+         return false;
+
+      unsigned char byte = static_cast<unsigned char>(block[*pPos]);
+      (*pPos)++;
+      value += static_cast<std::size_t>(byte & 0x7f) << shift;
+      shift += 7;
+      if ((byte & 0x80) == 0)
+         break;
+   }
+
+   *pValue = value;
+   return true;
+}
+
+bool decodeString(const std::string& block,
+                  std::size_t* pPos,
+                  std::string* pValue)
+{
+   if (*pPos >= block.size())
+      return false;
+
+   bool huffman = (block[*pPos] & 0x80) != 0;
+   std::size_t length;
+   if (!decodeInteger(block, pPos, 7, &length))
+      return false;
+   if (length > block.size() - *pPos)
+      return false;
+
+   std::string::const_iterator begin = block.begin() + *pPos;
+   std::string::const_iterator end = begin + length;
+   *pPos += length;
+
+   pValue->clear();
+   if (huffman)
+      return huffmanDecode(begin, end, pValue);
+
+   pValue->assign(begin, end);
+   return true;
+}
+
+void encodeInteger(std::size_t value,
+                   int prefixBits,
+                   unsigned char flags,
+                   std::string* pBlock)
+{
+   std::size_t mask = (1u << prefixBits) - 1;
+   if (value < mask)
+   {
+      pBlock->push_back(static_cast<char>(flags | value));
+      return;
+   }
+
+   pBlock->push_back(static_cast<char>(flags | mask));
+   value -= mask;
+   while (value >= 0x80)
+   {
+      pBlock->push_back(static_cast<char>((value & 0x7f) | 0x80));
+      value >>= 7;
+   }
+   pBlock->push_back(static_cast<char>(value));
+}
+
+void encodeString(const std::string& value, std::string* pBlock)
+{
+   encodeInteger(value.size(), 7, 0, pBlock);
+   pBlock->append(value);
+}
+
+bool shouldIndex(const Header& header)
+{
+   // values which change with every response would just churn the table
+   if (header.value.size() > kMaxIndexedValueSize)
+      return false;
+
+   return header.name != "date" &&
+          header.name != "content-length" &&
+          header.name != "etag" &&
+          header.name != "last-modified" &&
+          header.name != "set-cookie";
+}
+
+} // anonymous namespace
+
+bool HeaderTable::get(std::size_t index, Header* pHeader) const
+{
+   if (index == 0)
+      return false;
+
+   if (index <= kStaticTableSize)
+   {
+      const StaticEntry& entry = kStaticTable[index - 1];
+      *pHeader = Header(entry.name, entry.value);
+      return true;
+   }
+
+   index -= kStaticTableSize + 1;
+   if (index >= entries_.size())
+      return false;
+
+   *pHeader = entries_[index];
+   return true;
+}
+
+std::size_t HeaderTable::find(const std::string& name,
+                              const std::string& value,
+                              bool* pValueMatched) const
+{
+   std::size_t nameIndex = 0;
+   *pValueMatched = false;
+
+   for (std::size_t i = 0; i < kStaticTableSize; i++)
+   {
+      if (name == kStaticTable[i].name)
+      {
+         if (value == kStaticTable[i].value)
+         {
+            *pValueMatched = true;
+            return i + 1;
+         }
+         if (nameIndex == 0)
+            nameIndex = i + 1;
+      }
+   }
+
+   for (std::size_t i = 0; i < entries_.size(); i++)
+   {
+      if (name == entries_[i].name)
+      {
+         if (value == entries_[i].value)
+         {
+            *pValueMatched = true;
+            return kStaticTableSize + i + 1;
+         }
+         if (nameIndex == 0)
+            nameIndex = kStaticTableSize + i + 1;
+      }
+   }
+
+   return nameIndex;
+}
+
+void HeaderTable::add(const Header& header)
+{
+   // an entry larger than the table empties it
+   std::size_t size = entrySize(header);
+   if (size > maxSize_)
+   {
+      evict(0);
+      return;
+   }
+
+   evict(maxSize_ - size);
+   entries_.push_front(header);
+   size_ += size;
+}
+
+void HeaderTable::setMaxSize(std::size_t maxSize)
+{
+   maxSize_ = maxSize;
+   evict(maxSize_);
+}
+
+void HeaderTable::evict(std::size_t targetSize)
+{
+   while (size_ > targetSize && !entries_.empty())
+   {
+      size_ -= entrySize(entries_.back());
+      entries_.pop_back();
+   }
+}
+
+bool Decoder::decode(const std::string& block, std::vector<Header>* pHeaders)
+{
+   std::size_t listSize = 0;
+   std::size_t pos = 0;
+   while (pos < block.size())
+   {
+      unsigned char byte = static_cast<unsigned char>(block[pos]);
+      Header header;
+
+      if (byte & 0x80)
+      {
+         // indexed header field
+         std::size_t index;
+         if (!decodeInteger(block, &pos, 7, &index))
+            return false;
+         if (!table_.get(index, &header))
+            return false;
+      }
+      else if ((byte & 0xe0) == 0x20)
+      {
+         // dynamic table size update (we advertise the default size so
+         // that is all a peer may use)
+         std::size_t maxSize;
+         if (!decodeInteger(block, &pos, 5, &maxSize))
+            return false;
+         if (maxSize > kDefaultTableSize)
+            return false;
+         table_.setMaxSize(maxSize);
+         continue;
+      }
+      else
+      {
+         // literal header field, with incremental indexing (01) or
+         // without indexing (0000) or never indexed (0001)
+         bool incremental = (byte & 0xc0) == 0x40;
+         int prefixBits = incremental ? 6 : 4;
+
+         std::size_t index;
+         if (!decodeInteger(block, &pos, prefixBits, &index))
+            return false;
+         if (index == 0)
+         {
+            if (!decodeString(block, &pos, &header.name))
+               return false;
+         }
+         else if (!table_.get(index, &header))
+         {
+            return false;
+         }
+
+         if (!decodeString(block, &pos, &header.value))
+            return false;
+
+         if (incremental)
+            table_.add(header);
+      }
+
+      listSize += entrySize(header);
+      if (listSize > kMaxHeaderListSize)
+         return false;
+
+      pHeaders->push_back(header);
+   }
+
+   return true;
+}
+
+void Encoder::setMaxTableSize(std::size_t maxSize)
+{
+   // we never use more than the default (even if the peer allows it)
+   maxSize = std::min(maxSize, kDefaultTableSize);
+   if (maxSize != table_.maxSize())
+   {
+      table_.setMaxSize(maxSize);
+      pendingSizeUpdate_ = true;
+   }
+}
+
+void Encoder::encode(const std::vector<Header>& headers, std::string* pBlock)
+{
+   if (pendingSizeUpdate_)
+   {
+      encodeInteger(table_.maxSize(), 5, 0x20, pBlock);
+      pendingSizeUpdate_ = false;
+   }
+
+   BOOST_FOREACH(const Header& source, headers)
+   {
+      Header header(boost::algorithm::to_lower_copy(source.name),
+                    source.value);
+
+      bool valueMatched;
+      std::size_t index = table_.find(header.name, header.value, &valueMatched);
+      if (valueMatched)
+      {
+         encodeInteger(index, 7, 0x80, pBlock);
+         continue;
+      }
+
+      if (shouldIndex(header))
+      {
+         encodeInteger(index, 6, 0x40, pBlock);
+         table_.add(header);
+      }
+      else
+      {
+         encodeInteger(index, 4, 0x00, pBlock);
+      }
+
+      if (index == 0)
+         encodeString(header.name, pBlock);
+      encodeString(header.value, pBlock);
+   }
+}
+
+} // namespace hpack
+} // namespace http
+} // namespace core
@@ -0,0 +1,1025 @@
+/*
+ * Http2Session.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/http/Http2Session.hpp>
+
+#include <algorithm>
+
+#include <boost/foreach.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/Trace.hpp>
+#include <core/SafeConvert.hpp>
+
+#include <core/http/Util.hpp>
+#include <core/http/Request.hpp>
+#include <core/http/Response.hpp>
+#include <core/http/FileBody.hpp>
+#include <core/http/AsyncConnection.hpp>
+
+namespace core {
+namespace http {
+
+const char * const kHttp2Preface = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+namespace {
+
+// frame types
+const boost::uint8_t kDataFrame = 0x0;
+const boost::uint8_t kHeadersFrame = 0x1;
+const boost::uint8_t kPriorityFrame = 0x2;
+const boost::uint8_t kRstStreamFrame = 0x3;
+const boost::uint8_t kSettingsFrame = 0x4;
+const boost::uint8_t kPushPromiseFrame = 0x5;
+const boost::uint8_t kPingFrame = 0x6;
+const boost::uint8_t kGoAwayFrame = 0x7;
+const boost::uint8_t kWindowUpdateFrame = 0x8;
+const boost::uint8_t kContinuationFrame = 0x9;
+
+// frame flags
+const boost::uint8_t kEndStreamFlag = 0x1;
+const boost::uint8_t kAckFlag = 0x1;
+const boost::uint8_t kEndHeadersFlag = 0x4;
+const boost::uint8_t kPaddedFlag = 0x8;
+const boost::uint8_t kPriorityFlag = 0x20;
+
+// error codes
+const boost::uint32_t kProtocolError = 0x1;
+const boost::uint32_t kInternalError = 0x2;
+const boost::uint32_t kFlowControlError = 0x3;
+const boost::uint32_t kStreamClosedError = 0x5;
+const boost::uint32_t kFrameSizeError = 0x6;
+const boost::uint32_t kRefusedStream = 0x7;
+const boost::uint32_t kCancel = 0x8;
+const boost::uint32_t kCompressionError = 0x9;
+const boost::uint32_t kEnhanceYourCalm = 0xb;
+const boost::uint32_t kHttp11Required = 0xd;
+
+// settings
+const boost::uint16_t kSettingsHeaderTableSize = 0x1;
+const boost::uint16_t kSettingsMaxConcurrentStreams = 0x3;
+const boost::uint16_t kSettingsInitialWindowSize = 0x4;
+const boost::uint16_t kSettingsMaxFrameSize = 0x5;
+
+const std::size_t kFrameHeaderSize = 9;
+
+// we don't change the frame size or window size we receive with from
+// their defaults (we consume data as soon as it arrives)
+const std::size_t kDefaultMaxFrameSize = 16384;
+const std::size_t kLargestMaxFrameSize = 16777215;
+const boost::int64_t kDefaultWindowSize = 65535;
+const boost::int64_t kMaxWindowSize = 0x7fffffff;
+
+const std::size_t kMaxConcurrentStreams = 128;
+
+// guards against a peer sending an endless header block
+const std::size_t kMaxHeaderBlockSize = 256 * 1024;
+
+// how much output to collect for each write to the connection
+const std::size_t kOutputChunkSize = 65536;
+
+boost::uint32_t readUInt32(const std::string& data, std::size_t pos)
+{
+   const unsigned char* p =
+               reinterpret_cast<const unsigned char*>(data.data() + pos);
+   return (static_cast<boost::uint32_t>(p[0]) << 24) |
+          (static_cast<boost::uint32_t>(p[1]) << 16) |
+          (static_cast<boost::uint32_t>(p[2]) << 8) |
+          static_cast<boost::uint32_t>(p[3]);
+}
+
+void appendUInt(boost::uint32_t value, int bytes, std::string* pData)
+{
+   for (int i = bytes - 1; i >= 0; i--)
+      pData->push_back(static_cast<char>((value >> (i * 8)) & 0xff));
+}
+
+// headers which are specific to an HTTP/1 connection
+bool isConnectionHeader(const std::string& name)
+{
+   using namespace boost::algorithm;
+   return iequals(name, "Connection") ||
+          iequals(name, "Keep-Alive") ||
+          iequals(name, "Proxy-Connection") ||
+          iequals(name, "Transfer-Encoding") ||
+          iequals(name, "Upgrade");
+}
+
+// strip the padding (and optionally priority fields) from a payload
+bool payloadBounds(const std::string& payload,
+                   boost::uint8_t flags,
+                   bool hasPriority,
+                   std::size_t* pBegin,
+                   std::size_t* pEnd)
+{
+   *pBegin = 0;
+   *pEnd = payload.size();
+   if (flags & kPaddedFlag)
+   {
+      if (payload.empty())
+         return false;
+      std::size_t padLength = static_cast<unsigned char>(payload[0]);
+      *pBegin = 1;
+      if (padLength > *pEnd - *pBegin)
+         return false;
+      *pEnd -= padLength;
+   }
+   if (hasPriority)
+   {
+      if (*pEnd - *pBegin < 5)
+         return false;
+      *pBegin += 5;
+   }
+   return true;
+}
+
+} // anonymous namespace
+
+// a request stream, presented to handlers as a connection of its own
+class Http2Stream : public AsyncConnection, boost::noncopyable
+{
+public:
+   Http2Stream(boost::shared_ptr<Http2Session> pSession,
+               boost::uint32_t streamId)
+      : pSession_(pSession), streamId_(streamId)
+   {
+   }
+
+   virtual boost::asio::io_service& ioService()
+   {
+      return pSession_->ioService();
+   }
+
+   virtual const http::Request& request() const
+   {
+      return request_;
+   }
+
+   virtual http::Response& response()
+   {
+      return response_;
+   }
+
+   virtual void writeResponse()
+   {
+      pSession_->writeResponse(streamId_, request_, requestTime_, &response_);
+   }
+
+   virtual void writeResponse(const http::Response& response)
+   {
+      response_.assign(response);
+      writeResponse();
+   }
+
+   virtual void writeError(const Error& error)
+   {
+      response_.setError(error);
+      writeResponse();
+   }
+
+   // protocols tunnelled over a connection (websockets) need HTTP/1.1,
+   // which the peer can retry with when we reset the stream like this
+   virtual void startStreaming(const StreamDataHandler& onData,
+                               const StreamClosedHandler& onClosed)
+   {
+      pSession_->resetStream(streamId_, kHttp11Required);
+      if (onClosed)
+         onClosed();
+   }
+
+   virtual void writeStreamData(const std::string& data)
+   {
+   }
+
+   virtual void writeStreamData(const std::string& data,
+                                const StreamWrittenHandler& onWritten)
+   {
+   }
+
+   virtual void closeStream()
+   {
+      pSession_->resetStream(streamId_, kCancel);
+   }
+
+private:
+   friend class Http2Session;
+
+   boost::shared_ptr<Http2Session> pSession_;
+   boost::uint32_t streamId_;
+   http::Request request_;
+   boost::posix_time::ptime requestTime_;
+   http::Response response_;
+};
+
+Http2Session::Http2Session(boost::asio::io_service& ioService,
+                           const RequestHandler& requestHandler,
+                           const ResponseFilter& responseFilter,
+                           const OutputHandler& onOutput)
+   : ioService_(ioService),
+     requestHandler_(requestHandler),
+     responseFilter_(responseFilter),
+     onOutput_(onOutput),
+     prefaceRemaining_(kHttp2PrefaceLength),
+     lastStreamId_(0),
+     nextDataStreamId_(0),
+     headerStreamId_(0),
+     headerEndStream_(false),
+     connectionSendWindow_(kDefaultWindowSize),
+     initialWindowSize_(kDefaultWindowSize),
+     maxFrameSize_(kDefaultMaxFrameSize),
+     goingAway_(false),
+     failed_(false),
+     closed_(false)
+{
+}
+
+void Http2Session::start()
+{
+   LOCK_MUTEX(mutex_)
+   {
+      std::string settings;
+      appendUInt(kSettingsMaxConcurrentStreams, 2, &settings);
+      appendUInt(kMaxConcurrentStreams, 4, &settings);
+      queueFrame(kSettingsFrame, 0, 0, settings);
+   }
+   END_LOCK_MUTEX
+}
+
+bool Http2Session::receive(const char* data, std::size_t size)
+{
+   bool more = false;
+   std::vector<boost::shared_ptr<Http2Stream> > ready;
+   RequestHandler requestHandler;
+
+   LOCK_MUTEX(mutex_)
+   {
+      if (closed_ || failed_)
+         return false;
+
+      input_.append(data, size);
+
+      if (prefaceRemaining_ > 0)
+      {
+         std::size_t length = std::min(prefaceRemaining_, input_.size());
+         const char* expected = kHttp2Preface +
+                                (kHttp2PrefaceLength - prefaceRemaining_);
+         if (input_.compare(0, length, expected, length) != 0)
+            return connectionError(kProtocolError);
+         input_.erase(0, length);
+         prefaceRemaining_ -= length;
+      }
+
+      more = processFrames(&ready);
+      requestHandler = requestHandler_;
+   }
+   END_LOCK_MUTEX
+
+   // hand off complete requests outside of the lock (handlers may well
+   // write their response before returning)
+   BOOST_FOREACH(const boost::shared_ptr<Http2Stream>& pStream, ready)
+   {
+      if (requestHandler)
+         requestHandler(pStream, &(pStream->request_));
+   }
+
+   return more;
+}
+
+bool Http2Session::takeOutput(std::string* pOutput)
+{
+   pOutput->clear();
+
+   LOCK_MUTEX(mutex_)
+   {
+      if (closed_)
+         return false;
+
+      // send response data for each of the streams in turn (so that one
+      // large response doesn't hold up the others)
+      while (!failed_ && output_.size() < kOutputChunkSize)
+      {
+         bool queued = false;
+         Streams::iterator it = streams_.upper_bound(nextDataStreamId_);
+         for (std::size_t i = 0; i < streams_.size(); i++)
+         {
+            if (it == streams_.end())
+               it = streams_.begin();
+
+            Streams::iterator current = it++;
+            if (!current->second.responding)
+               continue;
+
+            boost::uint32_t streamId = current->first;
+            if (queueData(current))
+            {
+               nextDataStreamId_ = streamId;
+               queued = true;
+               break;
+            }
+         }
+
+         if (!queued)
+            break;
+      }
+
+      pOutput->swap(output_);
+   }
+   END_LOCK_MUTEX
+
+   return !pOutput->empty();
+}
+
+bool Http2Session::finished()
+{
+   LOCK_MUTEX(mutex_)
+   {
+      return closed_ ||
+             (output_.empty() && (failed_ || (goingAway_ && streams_.empty())));
+   }
+   END_LOCK_MUTEX
+
+   return true;
+}
+
+void Http2Session::close()
+{
+   // streams and handlers may hold the last references to us, so they
+   // are released outside of the lock
+   Streams streams;
+   RequestHandler requestHandler;
+   ResponseFilter responseFilter;
+   OutputHandler onOutput;
+
+   LOCK_MUTEX(mutex_)
+   {
+      closed_ = true;
+      streams.swap(streams_);
+      requestHandler.swap(requestHandler_);
+      responseFilter.swap(responseFilter_);
+      onOutput.swap(onOutput_);
+   }
+   END_LOCK_MUTEX
+}
+
+void Http2Session::writeResponse(boost::uint32_t streamId,
+                                 const http::Request& request,
+                                 const boost::posix_time::ptime& requestTime,
+                                 http::Response* pResponse)
+{
+   using namespace boost::posix_time;
+
+   pResponse->setHeader("Date", util::httpDate());
+
+   ResponseFilter responseFilter;
+   LOCK_MUTEX(mutex_)
+   {
+      responseFilter = responseFilter_;
+   }
+   END_LOCK_MUTEX
+
+   if (responseFilter)
+      responseFilter(request, requestTime, pResponse);
+
+   bool isHead = request.method() == "HEAD";
+   boost::shared_ptr<FileBodyReader> pFileBodyReader;
+   if (!isHead && pResponse->hasFileBody())
+   {
+      pFileBodyReader.reset(new FileBodyReader(*pResponse));
+      Error error = pFileBodyReader->open();
+      if (error)
+      {
+         LOG_ERROR(error);
+         resetStream(streamId, kInternalError);
+         return;
+      }
+   }
+
+   LOCK_MUTEX(mutex_)
+   {
+      // the stream may have been reset by the peer in the meantime
+      Streams::iterator it = streams_.find(streamId);
+      if (closed_ || failed_ || it == streams_.end() || it->second.responding)
+         return;
+
+      Stream& stream = it->second;
+      stream.responding = true;
+      stream.traceId = trace::traceId(request);
+      stream.writeTime = microsec_clock::universal_time();
+
+      bool hasBody = false;
+      if (pFileBodyReader)
+      {
+         stream.pFileBodyReader = pFileBodyReader;
+         hasBody = true;
+      }
+      else if (!isHead && !pResponse->body().empty())
+      {
+         stream.data = pResponse->body();
+         hasBody = true;
+      }
+
+      std::vector<Header> headers;
+      headers.push_back(Header(":status", safe_convert::numberToString(
+                                                   pResponse->statusCode())));
+      BOOST_FOREACH(const Header& header, pResponse->headers())
+      {
+         if (!isConnectionHeader(header.name))
+            headers.push_back(header);
+      }
+
+      std::string block;
+      encoder_.encode(headers, &block);
+
+      // the header block goes in a HEADERS frame and as many CONTINUATION
+      // frames as it takes (with nothing else in between)
+      std::size_t pos = 0;
+      do
+      {
+         std::size_t length = std::min(maxFrameSize_, block.size() - pos);
+         boost::uint8_t flags = 0;
+         if (pos + length == block.size())
+            flags |= kEndHeadersFlag;
+         if (pos == 0 && !hasBody)
+            flags |= kEndStreamFlag;
+         queueFrame(pos == 0 ? kHeadersFrame : kContinuationFrame,
+                    flags,
+                    streamId,
+                    block.substr(pos, length));
+         pos += length;
+      }
+      while (pos < block.size());
+
+      if (!hasBody)
+         finishStream(it);
+   }
+   END_LOCK_MUTEX
+
+   notifyOutput();
+}
+
+void Http2Session::resetStream(boost::uint32_t streamId,
+                               boost::uint32_t errorCode)
+{
+   LOCK_MUTEX(mutex_)
+   {
+      Streams::iterator it = streams_.find(streamId);
+      if (closed_ || it == streams_.end())
+         return;
+
+      queueRstStream(streamId, errorCode);
+      streams_.erase(it);
+   }
+   END_LOCK_MUTEX
+
+   notifyOutput();
+}
+
+void Http2Session::notifyOutput()
+{
+   OutputHandler onOutput;
+   LOCK_MUTEX(mutex_)
+   {
+      onOutput = onOutput_;
+   }
+   END_LOCK_MUTEX
+
+   if (onOutput)
+      onOutput();
+}
+
+bool Http2Session::processFrames(
+                     std::vector<boost::shared_ptr<Http2Stream> >* pReady)
+{
+   bool more = true;
+   std::size_t pos = 0;
+   while (input_.size() - pos >= kFrameHeaderSize)
+   {
+      std::size_t length = readUInt32(input_, pos) >> 8;
+      boost::uint8_t type = static_cast<boost::uint8_t>(input_[pos + 3]);
+      boost::uint8_t flags = static_cast<boost::uint8_t>(input_[pos + 4]);
+      boost::uint32_t streamId = readUInt32(input_, pos + 5) & 0x7fffffff;
+
+      if (length > kDefaultMaxFrameSize)
+      {
+         more = connectionError(kFrameSizeError);
+         break;
+      }
+
+      if (input_.size() - pos - kFrameHeaderSize < length)
+         break;
+
+      std::string payload = input_.substr(pos + kFrameHeaderSize, length);
+      pos += kFrameHeaderSize + length;
+
+      if (!processFrame(type, flags, streamId, payload, pReady))
+      {
+         more = false;
+         break;
+      }
+   }
+
+   input_.erase(0, pos);
+   return more;
+}
+
+bool Http2Session::processFrame(
+                     boost::uint8_t type,
+                     boost::uint8_t flags,
+                     boost::uint32_t streamId,
+                     const std::string& payload,
+                     std::vector<boost::shared_ptr<Http2Stream> >* pReady)
+{
+   // a header block can't be interrupted by any other frame
+   if (headerStreamId_ != 0 &&
+       (type != kContinuationFrame || streamId != headerStreamId_))
+   {
+      return connectionError(kProtocolError);
+   }
+
+   switch (type)
+   {
+      case kDataFrame:
+         return processData(flags, streamId, payload, pReady);
+
+      case kHeadersFrame:
+      case kContinuationFrame:
+         return processHeaders(type, flags, streamId, payload, pReady);
+
+      case kRstStreamFrame:
+         if (streamId == 0 || streamId > lastStreamId_)
+            return connectionError(kProtocolError);
+         if (payload.size() != 4)
+            return connectionError(kFrameSizeError);
+         streams_.erase(streamId);
+         return true;
+
+      case kSettingsFrame:
+         if (streamId != 0)
+            return connectionError(kProtocolError);
+         return processSettings(flags, payload);
+
+      case kPushPromiseFrame:
+         // clients can't push
+         return connectionError(kProtocolError);
+
+      case kPingFrame:
+         if (streamId != 0)
+            return connectionError(kProtocolError);
+         if (payload.size() != 8)
+            return connectionError(kFrameSizeError);
+         if (!(flags & kAckFlag))
+            queueFrame(kPingFrame, kAckFlag, 0, payload);
+         return true;
+
+      case kGoAwayFrame:
+         // finish the streams in progress but accept no more
+         if (streamId != 0)
+            return connectionError(kProtocolError);
+         goingAway_ = true;
+         return true;
+
+      case kWindowUpdateFrame:
+         return processWindowUpdate(streamId, payload);
+
+      case kPriorityFrame:
+      default:
+         // we respond in the order requests complete (and unknown frame
+         // types must be ignored)
+         return true;
+   }
+}
+
+bool Http2Session::processSettings(boost::uint8_t flags,
+                                   const std::string& payload)
+{
+   if (flags & kAckFlag)
+   {
+      if (!payload.empty())
+         return connectionError(kFrameSizeError);
+      return true;
+   }
+
+   if (payload.size() % 6 != 0)
+      return connectionError(kFrameSizeError);
+
+   for (std::size_t pos = 0; pos < payload.size(); pos += 6)
+   {
+      boost::uint16_t id = readUInt32(payload, pos) >> 16;
+      boost::uint32_t value = readUInt32(payload, pos + 2);
+
+      switch (id)
+      {
+         case kSettingsHeaderTableSize:
+            encoder_.setMaxTableSize(value);
+            break;
+
+         case kSettingsInitialWindowSize:
+         {
+            if (value > kMaxWindowSize)
+               return connectionError(kFlowControlError);
+
+            // applies to the windows of the streams in progress too
+            boost::int64_t delta = value - initialWindowSize_;
+            for (Streams::iterator it = streams_.begin();
+                 it != streams_.end();
+                 ++it)
+            {
+               it->second.sendWindow += delta;
+               if (it->second.sendWindow > kMaxWindowSize)
+                  return connectionError(kFlowControlError);
+            }
+            initialWindowSize_ = value;
+            break;
+         }
+
+         case kSettingsMaxFrameSize:
+            if (value < kDefaultMaxFrameSize || value > kLargestMaxFrameSize)
+               return connectionError(kProtocolError);
+            maxFrameSize_ = value;
+            break;
+
+         default:
+            // we never push so the remaining settings don't affect us
+            break;
+      }
+   }
+
+   queueFrame(kSettingsFrame, kAckFlag, 0, std::string());
+   return true;
+}
+
+bool Http2Session::processHeaders(
+                     boost::uint8_t type,
+                     boost::uint8_t flags,
+                     boost::uint32_t streamId,
+                     const std::string& payload,
+                     std::vector<boost::shared_ptr<Http2Stream> >* pReady)
+{
+   if (streamId == 0)
+      return connectionError(kProtocolError);
+
+   std::size_t begin = 0, end = payload.size();
+   if (type == kHeadersFrame)
+   {
+      if (!payloadBounds(payload, flags, flags & kPriorityFlag, &begin, &end))
+         return connectionError(kProtocolError);
+
+      headerStreamId_ = streamId;
+      headerEndStream_ = (flags & kEndStreamFlag) != 0;
+      headerBlock_.clear();
+   }
+   else if (headerStreamId_ == 0)
+   {
+      // CONTINUATION without a HEADERS frame to continue
+      return connectionError(kProtocolError);
+   }
+
+   headerBlock_.append(payload, begin, end - begin);
+   if (headerBlock_.size() > kMaxHeaderBlockSize)
+      return connectionError(kEnhanceYourCalm);
+
+   if (flags & kEndHeadersFlag)
+      return processHeaderBlock(pReady);
+
+   return true;
+}
+
+bool Http2Session::processHeaderBlock(
+                     std::vector<boost::shared_ptr<Http2Stream> >* pReady)
+{
+   using namespace boost::posix_time;
+
+   boost::uint32_t streamId = headerStreamId_;
+   headerStreamId_ = 0;
+
+   // every header block has to be decoded (even those we go on to ignore)
+   // to keep the decoder's table in step with the peer's
+   std::vector<Header> headers;
+   bool decoded = decoder_.decode(headerBlock_, &headers);
+   headerBlock_.clear();
+   if (!decoded)
+      return connectionError(kCompressionError);
+
+   Streams::iterator it = streams_.find(streamId);
+   if (it != streams_.end())
+   {
+      // trailers (which we have no use for) must end the request
+      if (it->second.remoteClosed || !headerEndStream_)
+      {
+         queueRstStream(streamId, kProtocolError);
+         streams_.erase(it);
+         return true;
+      }
+
+      requestComplete(streamId, pReady);
+      return true;
+   }
+
+   // otherwise a new stream (whose id must be larger than any before)
+   if (streamId <= lastStreamId_ || (streamId % 2) == 0)
+      return connectionError(kProtocolError);
+   lastStreamId_ = streamId;
+
+   if (goingAway_)
+      return true;
+
+   if (streams_.size() >= kMaxConcurrentStreams)
+   {
+      queueRstStream(streamId, kRefusedStream);
+      return true;
+   }
+
+   boost::shared_ptr<Http2Stream> pStream(
+                              new Http2Stream(shared_from_this(), streamId));
+   http::Request& request = pStream->request_;
+
+   std::string cookies;
+   BOOST_FOREACH(const Header& header, headers)
+   {
+      if (header.name == ":method")
+      {
+         request.setMethod(header.value);
+      }
+      else if (header.name == ":path")
+      {
+         request.setUri(header.value);
+      }
+      else if (header.name == ":authority")
+      {
+         request.setHost(header.value);
+      }
+      else if (header.name == ":scheme")
+      {
+         // implied by the connection
+      }
+      else if (boost::algorithm::starts_with(header.name, ":"))
+      {
+         queueRstStream(streamId, kProtocolError);
+         return true;
+      }
+      else if (header.name == "cookie")
+      {
+         // cookies may be split across several fields
+         if (!cookies.empty())
+            cookies.append("; ");
+         cookies.append(header.value);
+      }
+      else
+      {
+         request.addHeader(header);
+      }
+   }
+
+   if (!cookies.empty())
+      request.setHeader("Cookie", cookies);
+
+   if (request.method().empty() || request.uri().empty())
+   {
+      queueRstStream(streamId, kProtocolError);
+      return true;
+   }
+
+   // present the request as HTTP/1.1 (handlers which proxy requests on
+   // don't know about HTTP/2)
+   request.setHttpVersion(1, 1);
+
+   Stream& stream = streams_[streamId];
+   stream.pPending = pStream;
+   stream.sendWindow = initialWindowSize_;
+   stream.openTime = microsec_clock::universal_time();
+
+   if (headerEndStream_)
+      requestComplete(streamId, pReady);
+
+   return true;
+}
+
+bool Http2Session::processData(
+                     boost::uint8_t flags,
+                     boost::uint32_t streamId,
+                     const std::string& payload,
+                     std::vector<boost::shared_ptr<Http2Stream> >* pReady)
+{
+   if (streamId == 0)
+      return connectionError(kProtocolError);
+
+   std::size_t begin, end;
+   if (!payloadBounds(payload, flags, false, &begin, &end))
+      return connectionError(kProtocolError);
+
+   // the whole frame counts against the window and we consume data as
+   // soon as it arrives, so replenish the window straight away
+   if (!payload.empty())
+      queueWindowUpdate(0, payload.size());
+
+   Streams::iterator it = streams_.find(streamId);
+   if (it == streams_.end())
+   {
+      // data for a stream we've reset or finished with is ignored
+      if (streamId > lastStreamId_)
+         return connectionError(kProtocolError);
+      return true;
+   }
+
+   Stream& stream = it->second;
+   if (stream.remoteClosed)
+   {
+      queueRstStream(streamId, kStreamClosedError);
+      streams_.erase(it);
+      return true;
+   }
+
+   stream.requestBody.append(payload, begin, end - begin);
+
+   if (flags & kEndStreamFlag)
+      requestComplete(streamId, pReady);
+   else if (!payload.empty())
+      queueWindowUpdate(streamId, payload.size());
+
+   return true;
+}
+
+bool Http2Session::processWindowUpdate(boost::uint32_t streamId,
+                                       const std::string& payload)
+{
+   if (payload.size() != 4)
+      return connectionError(kFrameSizeError);
+
+   boost::uint32_t increment = readUInt32(payload, 0) & 0x7fffffff;
+
+   if (streamId == 0)
+   {
+      connectionSendWindow_ += increment;
+      if (increment == 0)
+         return connectionError(kProtocolError);
+      if (connectionSendWindow_ > kMaxWindowSize)
+         return connectionError(kFlowControlError);
+      return true;
+   }
+
+   // updates can arrive for streams we've already finished with
+   Streams::iterator it = streams_.find(streamId);
+   if (it == streams_.end())
+      return true;
+
+   it->second.sendWindow += increment;
+   if (increment == 0 || it->second.sendWindow > kMaxWindowSize)
+   {
+      queueRstStream(streamId, increment == 0 ? kProtocolError :
+                                                kFlowControlError);
+      streams_.erase(it);
+   }
+
+   return true;
+}
+
+void Http2Session::requestComplete(
+                     boost::uint32_t streamId,
+                     std::vector<boost::shared_ptr<Http2Stream> >* pReady)
+{
+   using namespace boost::posix_time;
+
+   Stream& stream = streams_[streamId];
+   stream.remoteClosed = true;
+
+   boost::shared_ptr<Http2Stream> pStream = stream.pPending;
+   stream.pPending.reset();
+
+   http::Request& request = pStream->request_;
+   if (!stream.requestBody.empty())
+   {
+      request.setBody(stream.requestBody);
+      stream.requestBody.clear();
+   }
+
+   pStream->requestTime_ = microsec_clock::universal_time();
+   trace::assignTraceId(&request);
+   trace::recordSpan(trace::traceId(request),
+                     "read_request",
+                     stream.openTime,
+                     pStream->requestTime_);
+
+   pReady->push_back(pStream);
+}
+
+void Http2Session::finishStream(Streams::iterator it)
+{
+   trace::recordSpanSince(it->second.traceId,
+                          "write_response",
+                          it->second.writeTime);
+   streams_.erase(it);
+}
+
+bool Http2Session::connectionError(boost::uint32_t errorCode)
+{
+   if (!failed_)
+   {
+      std::string payload;
+      appendUInt(lastStreamId_, 4, &payload);
+      appendUInt(errorCode, 4, &payload);
+      queueFrame(kGoAwayFrame, 0, 0, payload);
+      failed_ = true;
+   }
+
+   return false;
+}
+
+void Http2Session::queueFrame(boost::uint8_t type,
+                              boost::uint8_t flags,
+                              boost::uint32_t streamId,
+                              const std::string& payload)
+{
+   appendUInt(payload.size(), 3, &output_);
+   output_.push_back(static_cast<char>(type));
+   output_.push_back(static_cast<char>(flags));
+   appendUInt(streamId, 4, &output_);
+   output_.append(payload);
+}
+
+void Http2Session::queueRstStream(boost::uint32_t streamId,
+                                  boost::uint32_t errorCode)
+{
+   std::string payload;
+   appendUInt(errorCode, 4, &payload);
+   queueFrame(kRstStreamFrame, 0, streamId, payload);
+}
+
+void Http2Session::queueWindowUpdate(boost::uint32_t streamId,
+                                     boost::uint32_t increment)
+{
+   std::string payload;
+   appendUInt(increment, 4, &payload);
+   queueFrame(kWindowUpdateFrame, 0, streamId, payload);
+}
+
+// queue a DATA frame for a responding stream. returns false if the
+// stream can't send anything until its window is updated
+bool Http2Session::queueData(Streams::iterator it)
+{
+   boost::uint32_t streamId = it->first;
+   Stream& stream = it->second;
+
+   // file bodies are read a chunk at a time as the windows allow
+   if (stream.dataOffset == stream.data.size() && stream.pFileBodyReader)
+   {
+      std::size_t bytesRead;
+      stream.data.resize(kOutputChunkSize);
+      Error error = stream.pFileBodyReader->read(&(stream.data[0]),
+                                                 stream.data.size(),
+                                                 &bytesRead);
+      if (error)
+      {
+         LOG_ERROR(error);
+         queueRstStream(streamId, kInternalError);
+         streams_.erase(it);
+         return true;
+      }
+
+      stream.data.resize(bytesRead);
+      stream.dataOffset = 0;
+      if (bytesRead == 0)
+         stream.pFileBodyReader.reset();
+   }
+
+   std::size_t remaining = stream.data.size() - stream.dataOffset;
+   boost::int64_t window = std::min(connectionSendWindow_, stream.sendWindow);
+   std::size_t length = std::min(remaining, maxFrameSize_);
+   if (window <= 0)
+      length = 0;
+   else if (static_cast<boost::uint64_t>(window) < length)
+      length = static_cast<std::size_t>(window);
+
+   bool endStream = !stream.pFileBodyReader && length == remaining;
+   if (length == 0 && !endStream)
+      return false;
+
+   queueFrame(kDataFrame,
+              endStream ? kEndStreamFlag : 0,
+              streamId,
+              stream.data.substr(stream.dataOffset, length));
+   stream.dataOffset += length;
+   connectionSendWindow_ -= length;
+   stream.sendWindow -= length;
+
+   if (endStream)
+      finishStream(it);
+
+   return true;
+}
+
+} // namespace http
+} // namespace core
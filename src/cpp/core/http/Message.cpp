@@ -43,12 +43,16 @@ void Message::setContentType(const std::string& contentType)
 
 std::string Message::contentType() const 
 {
-   return headerValue("Content-Type") ;
+   int pos = headerPosition(kContentTypeHeader);
+   return pos >= 0 ? headers_[pos].value : std::string();
 }
 
 std::size_t Message::contentLength() const
 {
-   return safe_convert::stringTo<std::size_t>(headerValue("Content-Length"), 0);
+   int pos = headerPosition(kContentLengthHeader);
+   if (pos < 0)
+      return 0;
+   return safe_convert::stringTo<std::size_t>(headers_[pos].value, 0);
 }
 
 void Message::setContentLength(int contentLength)
@@ -67,6 +71,15 @@ void Message::addHeader(const std::string& name, const std::string& value)
 void Message::addHeader(const Header& header)
 {
    headers_.push_back(header);
+
+   // keep the index up to date (if we have one)
+   if (!headerIndex_.empty() && indexedHeaderCount_ == headers_.size() - 1)
+   {
+      WellKnownHeader id = wellKnownHeader(header.name);
+      if (id != kUnknownHeader && headerIndex_[id] < 0)
+         headerIndex_[id] = static_cast<int>(headers_.size() - 1);
+      indexedHeaderCount_ = headers_.size();
+   }
 }
    
 void Message::addHeaders(const std::vector<Header>& headers)
@@ -76,12 +89,45 @@ void Message::addHeaders(const std::vector<Header>& headers)
 
 std::string Message::headerValue(const std::string& name) const
 {
-   return http::headerValue(headers_, name);
+   int pos = headerPosition(name);
+   return pos >= 0 ? headers_[pos].value : std::string();
 }
 
 bool Message::containsHeader(const std::string& name) const
 {
-   return http::containsHeader(headers_, name);
+   return headerPosition(name) >= 0;
+}
+
+int Message::headerPosition(const std::string& name) const
+{
+   WellKnownHeader id = wellKnownHeader(name);
+   if (id != kUnknownHeader)
+      return headerPosition(id);
+
+   Headers::const_iterator it = std::find_if(headers_.begin(),
+                                             headers_.end(),
+                                             HeaderNamePredicate(name));
+   return it != headers_.end() ? static_cast<int>(it - headers_.begin()) : -1;
+}
+
+int Message::headerPosition(WellKnownHeader header) const
+{
+   if (headerIndex_.empty() || indexedHeaderCount_ != headers_.size())
+      indexHeaders();
+
+   return headerIndex_[header];
+}
+
+void Message::indexHeaders() const
+{
+   headerIndex_.assign(kWellKnownHeaderCount, -1);
+   for (std::size_t i = 0; i < headers_.size(); i++)
+   {
+      WellKnownHeader id = wellKnownHeader(headers_[i].name);
+      if (id != kUnknownHeader && headerIndex_[id] < 0)
+         headerIndex_[id] = static_cast<int>(i);
+   }
+   indexedHeaderCount_ = headers_.size();
 }
    
 void Message::setHeaderLine(const std::string& line)
@@ -98,15 +144,14 @@ void Message::setHeader(const Header& header)
 
 void Message::setHeader(const std::string& name, const std::string& value) 
 {
-   Headers::iterator it = std::find_if(headers_.begin(), 
-                                       headers_.end(),
-                                       HeaderNamePredicate(name));
-   if ( it != headers_.end() )
+   // (replacing a header in place doesn't invalidate the index)
+   int pos = headerPosition(name);
+   if ( pos >= 0 )
    {
       Header hdr ;
       hdr.name = name ;
       hdr.value = value ;
-      *it = hdr ;
+      headers_[pos] = hdr ;
    }
    else
    {
@@ -133,10 +178,14 @@ void Message::replaceHeader(const std::string& name, const std::string& value)
 
 void Message::removeHeader(const std::string& name) 
 {
+   if (headerPosition(name) < 0)
+      return;
+
    headers_.erase(std::remove_if(headers_.begin(), 
                                  headers_.end(),
                                  HeaderNamePredicate(name)), 
                   headers_.end())  ;
+   headerIndex_.clear();
 }
  
    
@@ -145,6 +194,7 @@ void Message::reset()
    setHttpVersion(1,1) ;
    httpVersion_.clear() ;
    headers_.clear() ;
+   headerIndex_.clear() ;
    body_.clear() ;
    
    // allow additional reseting by subclasses
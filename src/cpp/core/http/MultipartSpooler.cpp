@@ -0,0 +1,325 @@
+/*
+ * MultipartSpooler.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/http/MultipartSpooler.hpp>
+
+#include <sstream>
+
+#include <boost/regex.hpp>
+#include <boost/foreach.hpp>
+#include <boost/algorithm/string/trim.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/http/Header.hpp>
+#include <core/system/System.hpp>
+
+namespace core {
+namespace http {
+
+namespace {
+
+// limit on the size of a part's headers (guards against being fed a body
+// which isn't really multipart)
+const std::size_t kMaxHeadersSize = 65536;
+
+} // anonymous namespace
+
+MultipartSpooler::MultipartSpooler(const std::string& contentType,
+                                   const FilePath& spoolDir)
+   : state_(Preamble), spoolDir_(spoolDir), partIsFile_(false)
+{
+   // get the boundary token
+   std::string boundaryPrefix("boundary=");
+   std::string boundary;
+   size_t prefixLoc = contentType.find(boundaryPrefix);
+   if (prefixLoc != std::string::npos)
+   {
+      boundary = contentType.substr(prefixLoc+boundaryPrefix.size(),
+                                    std::string::npos);
+      boost::algorithm::trim(boundary);
+      if (boundary.size() > 1 &&
+          boundary[0] == '"' && boundary[boundary.size()-1] == '"')
+      {
+         boundary = boundary.substr(1, boundary.size()-2);
+      }
+   }
+
+   if (boundary.empty())
+   {
+      state_ = Failed;
+      return;
+   }
+
+   // every delimiter is preceded by a CRLF (seed the buffer with one so
+   // that the first delimiter can be matched the same way)
+   delimiter_ = "\r\n--" + boundary;
+   buffer_ = "\r\n";
+}
+
+MultipartSpooler::~MultipartSpooler()
+{
+   try
+   {
+      pPartStream_.reset();
+
+      BOOST_FOREACH(const FilePath& spooledFile, spooledFiles_)
+      {
+         Error error = spooledFile.removeIfExists();
+         if (error)
+            LOG_ERROR(error);
+      }
+   }
+   catch(...)
+   {
+   }
+}
+
+bool MultipartSpooler::write(const char* data, std::size_t size)
+{
+   if (state_ == Failed)
+      return false;
+   else if (state_ == Epilogue)
+      return true;
+
+   buffer_.append(data, size);
+   if (!processBuffer())
+   {
+      state_ = Failed;
+      pPartStream_.reset();
+      return false;
+   }
+
+   return true;
+}
+
+bool MultipartSpooler::finish(Fields* pFields, Files* pFiles)
+{
+   if (state_ != Epilogue)
+      return false;
+
+   pFields->insert(pFields->end(), fields_.begin(), fields_.end());
+   pFiles->insert(files_.begin(), files_.end());
+   return true;
+}
+
+bool MultipartSpooler::processBuffer()
+{
+   while (true)
+   {
+      switch (state_)
+      {
+      case Preamble:
+      {
+         std::size_t pos = buffer_.find(delimiter_);
+         if (pos == std::string::npos)
+         {
+            // discard all but what could be the start of the delimiter
+            if (buffer_.size() >= delimiter_.size())
+               buffer_.erase(0, buffer_.size() - delimiter_.size() + 1);
+            return true;
+         }
+
+         buffer_.erase(0, pos + delimiter_.size());
+         state_ = Delimiter;
+         break;
+      }
+
+      case Delimiter:
+      {
+         // the close delimiter is followed by "--", otherwise the rest of
+         // the line (which may contain transport padding) is skipped
+         if (buffer_.size() < 2)
+            return true;
+
+         if (buffer_.compare(0, 2, "--") == 0)
+         {
+            buffer_.clear();
+            state_ = Epilogue;
+            return true;
+         }
+
+         std::size_t pos = buffer_.find("\r\n");
+         if (pos == std::string::npos)
+            return buffer_.size() < kMaxHeadersSize;
+
+         buffer_.erase(0, pos + 2);
+         state_ = PartHeaders;
+         break;
+      }
+
+      case PartHeaders:
+      {
+         std::string headers;
+         if (buffer_.compare(0, 2, "\r\n") == 0)
+         {
+            buffer_.erase(0, 2);
+         }
+         else
+         {
+            std::size_t pos = buffer_.find("\r\n\r\n");
+            if (pos == std::string::npos)
+               return buffer_.size() < kMaxHeadersSize;
+
+            headers = buffer_.substr(0, pos + 2);
+            buffer_.erase(0, pos + 4);
+         }
+
+         if (!beginPart(headers))
+            return false;
+
+         state_ = PartData;
+         break;
+      }
+
+      case PartData:
+      {
+         std::size_t pos = buffer_.find(delimiter_);
+         if (pos == std::string::npos)
+         {
+            // write all but what could be the start of the delimiter
+            if (buffer_.size() >= delimiter_.size())
+            {
+               std::size_t size = buffer_.size() - delimiter_.size() + 1;
+               if (!writePartData(buffer_.data(), size))
+                  return false;
+               buffer_.erase(0, size);
+            }
+            return true;
+         }
+
+         if (!writePartData(buffer_.data(), pos))
+            return false;
+         endPart();
+
+         buffer_.erase(0, pos + delimiter_.size());
+         state_ = Delimiter;
+         break;
+      }
+
+      case Epilogue:
+         buffer_.clear();
+         return true;
+
+      case Failed:
+      default:
+         return false;
+      }
+   }
+}
+
+bool MultipartSpooler::beginPart(const std::string& headers)
+{
+   partName_.clear();
+   partIsFile_ = false;
+   partFile_ = File();
+   partValue_.clear();
+
+   std::istringstream headerStream(headers);
+   headerStream.unsetf(std::ios::skipws);
+   Headers partHeaders;
+   http::parseHeaders(headerStream, &partHeaders);
+
+   // parts without a (form-data) content disposition are skipped
+   std::string cDisp = http::headerValue(partHeaders, "Content-Disposition");
+   std::string nameRegex("form-data; name=\"(.*)\"");
+   boost::smatch nameMatch;
+   if (!regex_match(cDisp, nameMatch, boost::regex(nameRegex)))
+      return true;
+
+   std::string filenameRegex(nameRegex + "; filename=\"(.*)\"");
+   boost::smatch fileMatch;
+   if (regex_match(cDisp, fileMatch, boost::regex(filenameRegex)))
+   {
+      partName_ = fileMatch[1];
+      partIsFile_ = true;
+      partFile_.name = fileMatch[2];
+      partFile_.contentType = http::headerValue(partHeaders, "Content-Type");
+      if (partFile_.contentType.empty())
+         partFile_.contentType = "application/octet-stream";
+
+      Error error = spoolDir_.ensureDirectory();
+      if (error)
+      {
+         LOG_ERROR(error);
+         return false;
+      }
+
+      partFile_.path = spoolDir_.complete(
+                              "upload-" + core::system::generateUuid(false));
+      error = partFile_.path.open_w(&pPartStream_);
+      if (error)
+      {
+         LOG_ERROR(error);
+         return false;
+      }
+      spooledFiles_.push_back(partFile_.path);
+   }
+   else
+   {
+      partName_ = nameMatch[1];
+   }
+
+   return true;
+}
+
+bool MultipartSpooler::writePartData(const char* data, std::size_t size)
+{
+   if (partName_.empty() || size == 0)
+      return true;
+
+   if (partIsFile_)
+   {
+      pPartStream_->write(data, size);
+      if (pPartStream_->fail())
+      {
+         LOG_ERROR_MESSAGE("Error writing upload to " +
+                           partFile_.path.absolutePath());
+         return false;
+      }
+   }
+   else
+   {
+      // form fields are small by nature, but don't let them grow unbounded
+      if (partValue_.size() + size > kMaxHeadersSize)
+         return false;
+      partValue_.append(data, size);
+   }
+
+   return true;
+}
+
+void MultipartSpooler::endPart()
+{
+   if (partName_.empty())
+      return;
+
+   if (partIsFile_)
+   {
+      pPartStream_->flush();
+      pPartStream_.reset();
+      files_.insert(std::make_pair(partName_, partFile_));
+   }
+   else
+   {
+      boost::algorithm::trim(partValue_);
+      fields_.push_back(std::make_pair(partName_, partValue_));
+   }
+
+   partName_.clear();
+}
+
+} // namespace http
+} // namespace core
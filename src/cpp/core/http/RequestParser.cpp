@@ -16,16 +16,31 @@
 
 #include <core/http/RequestParser.hpp>
 
+#include <cstring>
+
 #include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+
+#include <core/http/MultipartSpooler.hpp>
 
 namespace core {
 namespace http {
 
+namespace {
+
+// in memory bodies are grown as they arrive beyond this size (so that a
+// bogus content length can't make us allocate an arbitrary amount)
+const std::size_t kMaxBodyReserve = 64 * 1024 * 1024;
+
+} // anonymous namespace
+
 RequestParser::RequestParser()
   : state_(method_start), 
     content_length_(0), 
     parsing_content_length_(false), 
-    parsing_body_(false)
+    parsing_body_(false),
+    body_bytes_read_(0),
+    progress_percent_(0)
 {
 }
 
@@ -35,6 +50,100 @@ void RequestParser::reset()
   content_length_ = 0 ;
   parsing_content_length_ = false ;
   parsing_body_ = false ;
+  body_bytes_read_ = 0 ;
+  progress_percent_ = 0 ;
+  spooler_.reset() ;
+}
+
+void RequestParser::setBodySpooling(const FilePath& spoolDir,
+                                    const ProgressHandler& onProgress)
+{
+  spool_dir_ = spoolDir ;
+  on_progress_ = onProgress ;
+}
+
+void RequestParser::beginBody(Request& req)
+{
+  body_bytes_read_ = 0 ;
+  progress_percent_ = 0 ;
+
+  std::string contentType = req.headerValue("Content-Type");
+  if (!spool_dir_.empty() &&
+      boost::algorithm::starts_with(contentType, "multipart/form-data"))
+  {
+     spooler_.reset(new MultipartSpooler(contentType, spool_dir_));
+  }
+  else
+  {
+     req.body_.reserve(std::min(content_length_, kMaxBodyReserve));
+  }
+}
+
+bool RequestParser::consumeBody(Request& req,
+                                const char* data,
+                                std::size_t size)
+{
+  if (spooler_)
+  {
+     if (!spooler_->write(data, size))
+        return false ;
+  }
+  else
+  {
+     req.body_.append(data, size);
+  }
+
+  body_bytes_read_ += size ;
+
+  if (on_progress_)
+  {
+     int percent = static_cast<int>(
+        (static_cast<double>(body_bytes_read_) / content_length_) * 100);
+     if (percent != progress_percent_)
+     {
+        progress_percent_ = percent ;
+        on_progress_(req, body_bytes_read_, content_length_);
+     }
+  }
+
+  return true ;
+}
+
+RequestParser::status RequestParser::endBody(Request& req)
+{
+  if (spooler_)
+  {
+     if (!spooler_->finish(&req.formFields_, &req.files_))
+        return error ;
+     req.parsedFormFields_ = true ;
+  }
+
+  return complete ;
+}
+
+bool RequestParser::consumeRun(Request& req,
+                               const char* data,
+                               std::size_t size,
+                               std::size_t* pCount)
+{
+  // memchr is the fastest scan for the terminator we have available
+  // (typically vectorized) so find it first and then validate the run
+  char terminator = (state_ == uri) ? ' ' : '\r';
+  const char* end = static_cast<const char*>(
+                                    std::memchr(data, terminator, size));
+  std::size_t count = end ? (end - data) : size;
+
+  for (std::size_t i = 0; i < count; i++)
+  {
+     if (is_ctl(data[i]))
+        return false;
+  }
+
+  std::string* pTarget = (state_ == uri) ? &req.uri_
+                                         : &req.headers_.back().value;
+  pTarget->append(data, count);
+  *pCount = count;
+  return true;
 }
 
 RequestParser::status RequestParser::consume(Request& req, char input)
@@ -287,8 +396,16 @@ RequestParser::status RequestParser::consume(Request& req, char input)
       // if this header was Content-Length then save it
       if (parsing_content_length_)
       {
-         content_length_ = boost::lexical_cast<int>(req.headers_.back().value);
          parsing_content_length_ = false ;
+         try
+         {
+            content_length_ = boost::lexical_cast<std::size_t>(
+                                             req.headers_.back().value);
+         }
+         catch(const boost::bad_lexical_cast&)
+         {
+            return error;
+         }
       }
 
       return incomplete;
@@ -315,6 +432,9 @@ RequestParser::status RequestParser::consume(Request& req, char input)
   case expecting_newline_3:
     if ( input == '\n' )
     {
+      // index the headers now that they are complete (so that later reads
+      // of them, potentially from other threads, don't need to)
+      req.indexHeaders();
       return complete ;
     }
     else
@@ -19,6 +19,7 @@
 
 #include <boost/regex.hpp>
 #include <boost/format.hpp>
+#include <boost/foreach.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
@@ -28,14 +29,101 @@
 #include <core/http/Util.hpp>
 #include <core/http/Cookie.hpp>
 #include <core/Hash.hpp>
+#include <core/Log.hpp>
 
 #include <core/FileSerializer.hpp>
 
 namespace core {
 namespace http {
 
+namespace {
+
+CompressionPolicy s_compressionPolicy;
+
+} // anonymous namespace
+
+CompressionPolicy::CompressionPolicy()
+   : level(6),
+     minimumSize(1024),
+     bufferSize(65536),
+     precompressedFiles(false)
+{
+   // textual types compress well, binary formats (images, archives, etc.)
+   // are typically already compressed
+   contentTypes.push_back("text/");
+   contentTypes.push_back("application/json");
+   contentTypes.push_back("application/javascript");
+   contentTypes.push_back("application/x-javascript");
+   contentTypes.push_back("application/xml");
+   contentTypes.push_back("application/xhtml+xml");
+   contentTypes.push_back("image/svg+xml");
+}
+
+bool CompressionPolicy::shouldCompress(const std::string& contentType,
+                                       std::size_t size) const
+{
+   if (size < minimumSize)
+      return false;
+
+   // responses with no content type (e.g. set by handlers which don't
+   // bother) are compressed as they were before there was a policy
+   if (contentType.empty() || contentTypes.empty())
+      return true;
+
+   BOOST_FOREACH(const std::string& type, contentTypes)
+   {
+      if (boost::algorithm::istarts_with(contentType, type))
+         return true;
+   }
+
+   return false;
+}
+
+void setCompressionPolicy(const CompressionPolicy& policy)
+{
+   s_compressionPolicy = policy;
+}
+
+const CompressionPolicy& compressionPolicy()
+{
+   return s_compressionPolicy;
+}
+
+Error gzipContent(const std::string& content,
+                  int level,
+                  std::string* pCompressed)
+{
+#ifdef _WIN32
+   return systemError(boost::system::errc::not_supported, ERROR_LOCATION);
+#else
+   try
+   {
+      pCompressed->clear();
+      boost::iostreams::filtering_ostream filteringStream;
+      filteringStream.push(boost::iostreams::gzip_compressor(
+                              boost::iostreams::gzip_params(level)),
+                           s_compressionPolicy.bufferSize);
+      filteringStream.push(boost::iostreams::back_inserter(*pCompressed),
+                           s_compressionPolicy.bufferSize);
+      filteringStream.write(content.data(), content.size());
+
+      // flush and close the chain (writes the gzip footer)
+      filteringStream.reset();
+
+      return Success();
+   }
+   catch(const std::exception& e)
+   {
+      Error error = systemError(boost::system::errc::io_error,
+                                ERROR_LOCATION);
+      error.addProperty("what", e.what());
+      return error;
+   }
+#endif
+}
+
 Response::Response() 
-   : Message(), statusCode_(status::Ok) 
+   : Message(), statusCode_(status::Ok), fileBodyOffset_(0), fileBodyLength_(0)
 {
 }   
    
@@ -142,16 +230,154 @@ void Response::setDynamicHtml(const std::string& html,
 void Response::setRangeableFile(const FilePath& filePath,
                                 const Request& request)
 {
-   // read the file in from disk
-   std::string contents;
-   Error error = core::readStringFromFile(filePath, &contents);
-   if (error)
+   setContentType(filePath.mimeContentType());
+   setStreamedFile(filePath, request);
+}
+
+void Response::setStreamedFile(const FilePath& filePath,
+                               const Request& request)
+{
+   uintmax_t total = filePath.size();
+   addHeader("Accept-Ranges", "bytes");
+
+   // we only honor single ranges (others get the whole file)
+   std::string range = request.headerValue("Range");
+   boost::regex re("bytes=(\\d*)\\-(\\d*)");
+   boost::smatch match;
+   if (!range.empty() && boost::regex_match(range, match, re) &&
+       (match[1].length() > 0 || match[2].length() > 0))
    {
-      setError(error);
-      return;
+      const uintmax_t kNone = static_cast<uintmax_t>(-1);
+      uintmax_t begin = safe_convert::stringTo<uintmax_t>(match[1], kNone);
+      uintmax_t end = safe_convert::stringTo<uintmax_t>(match[2], kNone);
+
+      // suffix range (the last n bytes)
+      if (begin == kNone)
+      {
+         begin = end < total ? total - end : 0;
+         end = total - 1;
+      }
+      else if (end == kNone || end >= total)
+      {
+         end = total - 1;
+      }
+
+      if (total == 0 || begin >= total || begin > end)
+      {
+         setStatusCode(status::RangeNotSatisfiable);
+         boost::format fmt("bytes */%1%");
+         setHeader("Content-Range", boost::str(fmt % total));
+         setBodyUnencoded(std::string());
+         return;
+      }
+
+      setStatusCode(status::PartialContent);
+      boost::format fmt("bytes %1%-%2%/%3%");
+      setHeader("Content-Range", boost::str(fmt % begin % end % total));
+      setFileBody(filePath, begin, end - begin + 1);
+   }
+   else
+   {
+      setFileBody(filePath, 0, total);
    }
+}
+
+void Response::setFileBody(const FilePath& filePath,
+                           uintmax_t offset,
+                           uintmax_t length)
+{
+   removeHeader("Content-Encoding");
+   body_.clear();
+   fileBodyPath_ = filePath.absolutePath();
+   fileBodyOffset_ = offset;
+   fileBodyLength_ = length;
+   streamBodyWriter_ = StreamBodyWriter();
+   setHeader("Content-Length", safe_convert::numberToString(length));
+}
 
-   setRangeableFile(contents, filePath.mimeContentType(), request);
+void Response::setStreamBody(const StreamBodyWriter& writer)
+{
+   clearFileBody();
+   removeHeader("Content-Encoding");
+   removeHeader("Content-Length");
+   body_.clear();
+   streamBodyWriter_ = writer;
+}
+
+bool Response::setPrecompressedFile(const FilePath& filePath,
+                                    const Request& request)
+{
+   // only when enabled, accepted, and for the whole file (ranges apply
+   // to the uncompressed content so we can't satisfy them from the gz)
+   if (!s_compressionPolicy.precompressedFiles ||
+       !request.acceptsEncoding(kGzipEncoding) ||
+       !request.headerValue("Range").empty())
+   {
+      return false;
+   }
+
+   FilePath gzPath(filePath.absolutePath() + ".gz");
+   if (!gzPath.exists() ||
+       gzPath.lastWriteTime() < filePath.lastWriteTime())
+   {
+      return false;
+   }
+
+   uintmax_t size = gzPath.size();
+   if (size >= kMinStreamedFileSize)
+   {
+      setFileBody(gzPath, 0, size);
+   }
+   else
+   {
+      std::string contents;
+      Error error = core::readStringFromFile(gzPath, &contents);
+      if (error)
+      {
+         LOG_ERROR(error);
+         return false;
+      }
+      setBodyUnencoded(contents);
+   }
+
+   setContentEncoding(kGzipEncoding);
+   return true;
+}
+
+Error Response::encodeBody()
+{
+   if (contentEncoding() == kGzipEncoding)
+   {
+#ifdef _WIN32
+      // never gzip on win32
+      removeHeader("Content-Encoding");
+#else
+      if (s_compressionPolicy.shouldCompress(contentType(), body_.size()))
+      {
+         std::string compressed;
+         Error error = gzipContent(body_, s_compressionPolicy.level,
+                                   &compressed);
+         if (error)
+            return error;
+         body_.swap(compressed);
+      }
+      else
+      {
+         removeHeader("Content-Encoding");
+      }
+#endif
+   }
+
+   setContentLength(body_.length());
+   return Success();
+}
+
+void Response::clearFileBody()
+{
+   fileBodyPath_.clear();
+   fileBodyOffset_ = 0;
+   fileBodyLength_ = 0;
+   streamBodyWriter_ = StreamBodyWriter();
 }
 
 void Response::setRangeableFile(const std::string& contents,
@@ -214,6 +440,7 @@ void Response::setRangeableFile(const std::string& contents,
 void Response::setBodyUnencoded(const std::string& body)
 {
    removeHeader("Content-Encoding");
+   clearFileBody();
    body_ = body;
    setContentLength(body_.length());
 }
@@ -270,6 +497,7 @@ void Response::resetMembers()
 	statusCode_ = status::Ok ;
 	statusCodeStr_.clear() ;
 	statusMessage_.clear() ;
+	clearFileBody();
 }
    
 void Response::removeCachingHeaders()
@@ -283,7 +511,7 @@ void Response::removeCachingHeaders()
    
 std::string Response::eTagForContent(const std::string& content)
 {
-   return core::hash::crc32Hash(content);
+   return core::hash::xxHash64(content);
 }   
 
 void Response::appendFirstLineBuffers(
@@ -306,6 +534,7 @@ void Response::appendFirstLineBuffers(
 
 namespace status {
 namespace Message {
+   const char * const SwitchingProtocols = "Switching Protocols";
 	const char * const Ok = "OK" ;
    const char * const Created = "Created";
    const char * const PartialContent = "Partial Content";
@@ -337,6 +566,10 @@ void Response::ensureStatusMessage() const
 
 		switch(statusCode_)
 		{
+         case SwitchingProtocols:
+            statusMessage_ = status::Message::SwitchingProtocols;
+            break;
+
 			case Ok:
 				statusMessage_ = status::Message::Ok ;
 				break;
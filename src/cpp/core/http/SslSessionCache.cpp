@@ -0,0 +1,95 @@
+/*
+ * SslSessionCache.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/http/SslSessionCache.hpp>
+
+#include <map>
+
+#include <core/Thread.hpp>
+
+namespace core {
+namespace http {
+namespace ssl_session_cache {
+
+namespace {
+
+// we hold a reference to each of the cached sessions
+boost::mutex s_mutex;
+std::map<std::string, SSL_SESSION*> s_sessions;
+
+} // anonymous namespace
+
+void offer(const std::string& server, SSL* pSSL)
+{
+   LOCK_MUTEX(s_mutex)
+   {
+      std::map<std::string, SSL_SESSION*>::const_iterator it =
+                                                      s_sessions.find(server);
+      if (it != s_sessions.end())
+      {
+         // if the server won't resume it we get a full handshake as usual
+         SSL_set_session(pSSL, it->second);
+      }
+   }
+   END_LOCK_MUTEX
+}
+
+void save(const std::string& server, SSL* pSSL)
+{
+   if (!SSL_is_init_finished(pSSL))
+      return;
+
+   SSL_SESSION* pSession = SSL_get1_session(pSSL);
+   if (pSession == NULL)
+      return;
+
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+   // TLS 1.3 sessions can only be resumed once the server has sent a
+   // ticket for them (which it does after the handshake)
+   if (!SSL_SESSION_is_resumable(pSession))
+   {
+      SSL_SESSION_free(pSession);
+      return;
+   }
+#endif
+
+   LOCK_MUTEX(s_mutex)
+   {
+      SSL_SESSION*& pCached = s_sessions[server];
+      if (pCached != NULL)
+         SSL_SESSION_free(pCached);
+      pCached = pSession;
+   }
+   END_LOCK_MUTEX
+}
+
+void remove(const std::string& server)
+{
+   LOCK_MUTEX(s_mutex)
+   {
+      std::map<std::string, SSL_SESSION*>::iterator it =
+                                                      s_sessions.find(server);
+      if (it != s_sessions.end())
+      {
+         SSL_SESSION_free(it->second);
+         s_sessions.erase(it);
+      }
+   }
+   END_LOCK_MUTEX
+}
+
+} // namespace ssl_session_cache
+} // namespace http
+} // namespace core
@@ -20,7 +20,6 @@
 #include <sstream>
 #include <algorithm>
 
-#include <boost/tokenizer.hpp>
 #include <boost/algorithm/string/trim.hpp>
 #include <boost/regex.hpp>
 #include <boost/date_time/gregorian/gregorian.hpp>
@@ -50,46 +49,104 @@ std::string fieldValue(const Fields& fields, const std::string& name)
       return std::string();
 }
    
+namespace {
+
+// set of delimiter characters (for cheap membership tests)
+class Delimiters
+{
+public:
+   explicit Delimiters(const char* delims)
+   {
+      std::fill(delims_, delims_ + sizeof(delims_), false);
+      for (const char* pDelim = delims; *pDelim; ++pDelim)
+         delims_[static_cast<unsigned char>(*pDelim)] = true;
+   }
+
+   bool contains(char c) const
+   {
+      return delims_[static_cast<unsigned char>(c)];
+   }
+
+private:
+   bool delims_[256];
+};
+
+// find the next token in [begin, end) (skipping leading delimiters in the
+// same fashion as boost::char_separator). returns false if there are none
+bool nextToken(const char* begin,
+               const char* end,
+               const Delimiters& delims,
+               const char** pTokenBegin,
+               const char** pTokenEnd)
+{
+   while (begin != end && delims.contains(*begin))
+      ++begin;
+   if (begin == end)
+      return false;
+
+   const char* tokenEnd = begin;
+   while (tokenEnd != end && !delims.contains(*tokenEnd))
+      ++tokenEnd;
+
+   *pTokenBegin = begin;
+   *pTokenEnd = tokenEnd;
+   return true;
+}
+
+std::string decodeField(const char* begin,
+                        const char* end,
+                        FieldDecodeType fieldDecode)
+{
+   if (fieldDecode == FieldDecodeNone)
+      return std::string(begin, end);
+
+   // only pay for decoding when there is something to decode
+   bool queryString = (fieldDecode == FieldDecodeQueryString);
+   for (const char* it = begin; it != end; ++it)
+   {
+      if (*it == '%' || (queryString && *it == '+'))
+         return util::urlDecode(std::string(begin, end), queryString);
+   }
+   return std::string(begin, end);
+}
+
+} // anonymous namespace
+
 void parseFields(const std::string& fields, 
                  const char* fieldDelim, 
                  const char* valueDelim,
                  Fields* pFields, 
                  FieldDecodeType fieldDecode)
 {
-   // enable straightforward references to tokenizer class & helpers
-   using namespace boost ;
-
-   // delimiters
-   char_separator<char> fieldSeparator(fieldDelim);
-   char_separator<char> valueSeparator(valueDelim) ;
-
-   // iterate over the fields
-   tokenizer<char_separator<char> > fieldTokens(fields, fieldSeparator) ;
-   for (tokenizer<char_separator<char> >::iterator 
-         fieldIter = fieldTokens.begin(); 
-         fieldIter != fieldTokens.end();
-         ++fieldIter)
+   // single pass over the fields (splitting each into the first two tokens
+   // delimited by valueDelim, which are the name and value)
+   Delimiters fieldDelims(fieldDelim);
+   Delimiters valueDelims(valueDelim);
+
+   const char* pos = fields.data();
+   const char* end = fields.data() + fields.size();
+   const char* fieldBegin;
+   const char* fieldEnd;
+   while (nextToken(pos, end, fieldDelims, &fieldBegin, &fieldEnd))
    {
-      // split into name and value
-      std::string name ;
-      std::string value ;
-      tokenizer<char_separator<char> > valTokens(*fieldIter, valueSeparator);
-      tokenizer<char_separator<char> >::iterator valIter = valTokens.begin();
-
-      if ( valIter != valTokens.end() )
-         name = *valIter++ ;
-      if ( valIter != valTokens.end() )
-         value = *valIter ;
-
-      if ( fieldDecode != FieldDecodeNone )
-      {
-         bool queryString = (fieldDecode == FieldDecodeQueryString);
-         name = util::urlDecode(name, queryString);
-         value = util::urlDecode(value, queryString) ;
-      }
+      pos = fieldEnd;
+
+      const char* nameBegin;
+      const char* nameEnd;
+      if (!nextToken(fieldBegin, fieldEnd, valueDelims, &nameBegin, &nameEnd))
+         continue;
+
+      std::string name = decodeField(nameBegin, nameEnd, fieldDecode);
+      if (name.empty())
+         continue;
 
-      if ( !name.empty() )
-         pFields->push_back(std::make_pair(name,value));
+      const char* valueBegin;
+      const char* valueEnd;
+      std::string value;
+      if (nextToken(nameEnd, fieldEnd, valueDelims, &valueBegin, &valueEnd))
+         value = decodeField(valueBegin, valueEnd, fieldDecode);
+
+      pFields->push_back(std::make_pair(name, value));
    }
 }
    
@@ -243,6 +300,22 @@ std::string urlEncode(const std::string& in, bool queryStringSpaces)
    return encodedURL;
 }
    
+namespace {
+
+int hexDigitValue(char c)
+{
+   if (c >= '0' && c <= '9')
+      return c - '0';
+   else if (c >= 'a' && c <= 'f')
+      return c - 'a' + 10;
+   else if (c >= 'A' && c <= 'F')
+      return c - 'A' + 10;
+   else
+      return -1;
+}
+
+} // anonymous namespace
+
 std::string urlDecode(const std::string& in, bool fromQueryString)
 {
    std::string out;
@@ -253,10 +326,13 @@ std::string urlDecode(const std::string& in, bool fromQueryString)
     {
       if (i + 3 <= in.size())
       {
-        int value;
-        std::istringstream is(in.substr(i + 1, 2));
-        if (is >> std::hex >> value)
+        int high = hexDigitValue(in[i + 1]);
+        int low = hexDigitValue(in[i + 2]);
+        if (high >= 0)
         {
+          // (a single hex digit decodes on its own, as it did when this
+          // was read with std::hex)
+          int value = (low >= 0) ? (high * 16 + low) : high;
           out += static_cast<char>(value);
           i += 2;
         }
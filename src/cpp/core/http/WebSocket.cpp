@@ -0,0 +1,312 @@
+/*
+ * WebSocket.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/http/WebSocket.hpp>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/algorithm/string/trim.hpp>
+
+#include <core/Base64.hpp>
+#include <core/Error.hpp>
+
+#include <core/http/Request.hpp>
+#include <core/http/Response.hpp>
+
+namespace core {
+namespace http {
+namespace websocket {
+
+namespace {
+
+// guid which is appended to the client's key to compute the accept key
+const char * const kHandshakeGuid = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+// largest message we'll accept from a client (clients only send us
+// small control and acknowledgement messages)
+const boost::uint64_t kMaxMessageSize = 1024 * 1024;
+
+inline boost::uint32_t rotateLeft(boost::uint32_t value, int bits)
+{
+   return (value << bits) | (value >> (32 - bits));
+}
+
+// sha1 digest (required only to compute the handshake accept key)
+std::string sha1(const std::string& input)
+{
+   boost::uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE,
+                            0x10325476, 0xC3D2E1F0 };
+
+   // pad the message to a multiple of 64 bytes (including its bit length)
+   std::string message(input);
+   boost::uint64_t bitLength = static_cast<boost::uint64_t>(input.size()) * 8;
+   message.push_back(static_cast<char>(0x80));
+   while ((message.size() % 64) != 56)
+      message.push_back(0);
+   for (int i = 7; i >= 0; i--)
+      message.push_back(static_cast<char>((bitLength >> (i * 8)) & 0xFF));
+
+   for (std::size_t chunk = 0; chunk < message.size(); chunk += 64)
+   {
+      boost::uint32_t w[80];
+      for (int i = 0; i < 16; i++)
+      {
+         const unsigned char* p = reinterpret_cast<const unsigned char*>(
+                                          message.data() + chunk + (i * 4));
+         w[i] = (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+      }
+      for (int i = 16; i < 80; i++)
+         w[i] = rotateLeft(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);
+
+      boost::uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+      for (int i = 0; i < 80; i++)
+      {
+         boost::uint32_t f, k;
+         if (i < 20)
+         {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+         }
+         else if (i < 40)
+         {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+         }
+         else if (i < 60)
+         {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+         }
+         else
+         {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+         }
+
+         boost::uint32_t temp = rotateLeft(a, 5) + f + e + k + w[i];
+         e = d;
+         d = c;
+         c = rotateLeft(b, 30);
+         b = a;
+         a = temp;
+      }
+
+      h[0] += a;
+      h[1] += b;
+      h[2] += c;
+      h[3] += d;
+      h[4] += e;
+   }
+
+   std::string digest;
+   for (int i = 0; i < 5; i++)
+   {
+      for (int j = 3; j >= 0; j--)
+         digest.push_back(static_cast<char>((h[i] >> (j * 8)) & 0xFF));
+   }
+   return digest;
+}
+
+bool headerContainsToken(const Request& request,
+                         const std::string& name,
+                         const std::string& token)
+{
+   // headers such as Connection can contain a list of tokens
+   std::string value = request.headerValue(name);
+   std::string::size_type pos = 0;
+   while (pos <= value.size())
+   {
+      std::string::size_type next = value.find(',', pos);
+      if (next == std::string::npos)
+         next = value.size();
+      std::string item = boost::algorithm::trim_copy(
+                                          value.substr(pos, next - pos));
+      if (boost::algorithm::iequals(item, token))
+         return true;
+      pos = next + 1;
+   }
+   return false;
+}
+
+} // anonymous namespace
+
+bool isUpgradeRequest(const Request& request)
+{
+   return request.method() == "GET" &&
+          headerContainsToken(request, "Upgrade", "websocket") &&
+          headerContainsToken(request, "Connection", "Upgrade") &&
+          !request.headerValue("Sec-WebSocket-Key").empty();
+}
+
+Error setHandshakeResponse(const Request& request, Response* pResponse)
+{
+   // compute the accept key
+   std::string key = boost::algorithm::trim_copy(
+                                    request.headerValue("Sec-WebSocket-Key"));
+   std::string acceptKey;
+   Error error = base64::encode(sha1(key + kHandshakeGuid), &acceptKey);
+   if (error)
+      return error;
+
+   pResponse->setStatusCode(status::SwitchingProtocols);
+   pResponse->setHeader("Upgrade", "websocket");
+   pResponse->setHeader("Connection", "Upgrade");
+   pResponse->setHeader("Sec-WebSocket-Accept", acceptKey);
+   return Success();
+}
+
+std::string frame(Opcode opcode, const std::string& payload)
+{
+   std::string frame;
+   frame.reserve(payload.size() + 10);
+
+   // we never fragment messages and server frames are never masked
+   frame.push_back(static_cast<char>(0x80 | opcode));
+
+   boost::uint64_t length = payload.size();
+   if (length < 126)
+   {
+      frame.push_back(static_cast<char>(length));
+   }
+   else if (length <= 0xFFFF)
+   {
+      frame.push_back(static_cast<char>(126));
+      frame.push_back(static_cast<char>((length >> 8) & 0xFF));
+      frame.push_back(static_cast<char>(length & 0xFF));
+   }
+   else
+   {
+      frame.push_back(static_cast<char>(127));
+      for (int i = 7; i >= 0; i--)
+         frame.push_back(static_cast<char>((length >> (i * 8)) & 0xFF));
+   }
+
+   frame.append(payload);
+   return frame;
+}
+
+bool FrameParser::parse(const char* begin,
+                        const char* end,
+                        std::vector<Message>* pMessages)
+{
+   buffer_.append(begin, end);
+
+   std::size_t pos = 0;
+   while (true)
+   {
+      // read the frame header
+      const unsigned char* data =
+                  reinterpret_cast<const unsigned char*>(buffer_.data()) + pos;
+      std::size_t available = buffer_.size() - pos;
+      if (available < 2)
+         break;
+
+      bool fin = (data[0] & 0x80) != 0;
+      Opcode opcode = static_cast<Opcode>(data[0] & 0x0F);
+      bool masked = (data[1] & 0x80) != 0;
+      boost::uint64_t length = data[1] & 0x7F;
+      std::size_t headerSize = 2;
+
+      // clients are required to mask their frames
+      if (!masked)
+         return false;
+
+      if (length == 126)
+      {
+         if (available < 4)
+            break;
+         length = (data[2] << 8) | data[3];
+         headerSize = 4;
+      }
+      else if (length == 127)
+      {
+         if (available < 10)
+            break;
+         length = 0;
+         for (int i = 0; i < 8; i++)
+            length = (length << 8) | data[2 + i];
+         headerSize = 10;
+      }
+
+      if (length > kMaxMessageSize ||
+          (fragment_.size() + length) > kMaxMessageSize)
+      {
+         return false;
+      }
+
+      // wait for the rest of the frame
+      std::size_t frameSize = headerSize + 4 + static_cast<std::size_t>(length);
+      if (available < frameSize)
+         break;
+
+      // unmask the payload
+      const unsigned char* mask = data + headerSize;
+      std::string payload(reinterpret_cast<const char*>(mask + 4),
+                          static_cast<std::size_t>(length));
+      for (std::size_t i = 0; i < payload.size(); i++)
+         payload[i] = static_cast<char>(payload[i] ^ mask[i % 4]);
+
+      pos += frameSize;
+
+      switch (opcode)
+      {
+      // control frames can't be fragmented (and can arrive between the
+      // fragments of a message)
+      case Close:
+      case Ping:
+      case Pong:
+         if (!fin || length > 125)
+            return false;
+         pMessages->push_back(Message(opcode, payload));
+         break;
+
+      case Text:
+      case Binary:
+         if (fragmentOpcode_ != Continuation)
+            return false;
+         if (fin)
+         {
+            pMessages->push_back(Message(opcode, payload));
+         }
+         else
+         {
+            fragmentOpcode_ = opcode;
+            fragment_ = payload;
+         }
+         break;
+
+      case Continuation:
+         if (fragmentOpcode_ == Continuation)
+            return false;
+         fragment_.append(payload);
+         if (fin)
+         {
+            pMessages->push_back(Message(fragmentOpcode_, fragment_));
+            fragmentOpcode_ = Continuation;
+            fragment_.clear();
+         }
+         break;
+
+      default:
+         return false;
+      }
+   }
+
+   buffer_.erase(0, pos);
+   return true;
+}
+
+} // namespace websocket
+} // namespace http
+} // namespace core
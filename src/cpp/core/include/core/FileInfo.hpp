@@ -94,6 +94,13 @@ public:
    std::time_t lastWriteTime() const { return lastWriteTime_; }
    bool isSymlink() const { return isSymlink_; }
    
+private:
+   // these compare the stored path directly (absolutePath returns a deep
+   // copy which is too expensive when sorting or diffing large listings)
+   friend int fileInfoPathCompare(const FileInfo& a, const FileInfo& b);
+   friend bool fileInfoHasPath(const FileInfo& fileInfo,
+                               const std::string& path);
+
 private:
    std::string absolutePath_;
    bool isDirectory_;
@@ -106,7 +113,7 @@ inline int fileInfoPathCompare(const FileInfo& a, const FileInfo& b)
 {
    // use stcoll because that is what alphasort (comp function passed to
    // scandir) uses for its sorting)
-   int result = ::strcoll(a.absolutePath().c_str(), b.absolutePath().c_str());
+   int result = ::strcoll(a.absolutePath_.c_str(), b.absolutePath_.c_str());
 
    if (result != 0)
       return result;
@@ -125,7 +132,7 @@ inline bool fileInfoPathLessThan(const FileInfo& a, const FileInfo& b)
 
 inline bool fileInfoHasPath(const FileInfo& fileInfo, const std::string& path)
 {
-   return fileInfo.absolutePath() == path;
+   return fileInfo.absolutePath_ == path;
 }
 
 inline FilePath toFilePath(const FileInfo& fileInfo)
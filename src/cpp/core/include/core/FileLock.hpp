@@ -24,11 +24,22 @@ namespace core {
 class Error;
 class FilePath;
 
+// Lease based lock. The lock file holds the host, pid and a nonce of the
+// owner along with the time the lease was last refreshed; a background
+// thread refreshes the leases held by the process. A lease is considered
+// abandoned once it hasn't been refreshed within the lease timeout (or
+// immediately if its owner was a process on this host which has exited),
+// so checking a lock costs a single read and works on filesystems (e.g.
+// NFS) that don't reliably support advisory locks.
 class FileLock : boost::noncopyable
 {
 public:
    static bool isLocked(const FilePath& lockFilePath);
 
+   // lease timeout in seconds (this should comfortably exceed any clock
+   // skew between hosts sharing the lock files)
+   static void setLeaseTimeout(int seconds);
+
 public:
    FileLock();
    virtual ~FileLock();
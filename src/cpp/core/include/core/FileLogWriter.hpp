@@ -16,11 +16,23 @@
 #ifndef FILE_LOG_WRITER_HPP
 #define FILE_LOG_WRITER_HPP
 
+#include <ctime>
+#include <vector>
+#include <iosfwd>
+
+#include <boost/shared_ptr.hpp>
+
+#include <core/BoostThread.hpp>
 #include <core/FilePath.hpp>
 #include <core/LogWriter.hpp>
 
 namespace core {
 
+// Writes log entries to <logDir>/<programIdentity>.log. Entries are queued
+// and written in batches by a background thread (so callers never wait on
+// the filesystem). The queue is bounded and entries are rate limited;
+// entries which don't fit are dropped and the number dropped is recorded
+// in the log.
 class FileLogWriter : public LogWriter
 {
 public:
@@ -32,12 +44,35 @@ public:
     virtual void log(core::system::LogLevel level,
                      const std::string& message);
 
+    // write any queued entries now (called automatically at exit)
+    void flush();
+
 private:
     bool rotateLogFile();
+    void writerThread();
+    void writeEntries(const std::vector<std::string>& entries,
+                      std::size_t dropped);
+    void logSynchronously(const std::string& entry);
 
     std::string programIdentity_;
     int logLevel_;
     FilePath logFile_;
+
+    // queue (and rate limiting/drop state) shared with the writer thread
+    boost::mutex mutex_;
+    boost::condition queueCondition_;
+    std::vector<std::string> queue_;
+    std::size_t dropped_;
+    std::time_t rateWindow_;
+    std::size_t rateWindowCount_;
+    bool writerStarted_;
+    bool stopWriter_;
+    long writerPid_;
+    boost::thread writerThread_;
+
+    // serializes writes to the file (the writer thread and flush)
+    boost::mutex writeMutex_;
+    boost::shared_ptr<std::ostream> pLogStream_;
 };
 
 } // namespace core
@@ -18,6 +18,8 @@
 
 #include <string>
 
+#include <boost/cstdint.hpp>
+
 namespace core {
 namespace hash {
    
@@ -25,6 +27,16 @@ std::string crc32Hash(const std::string& content);
 
 std::string crc32HexHash(const std::string& content);
 
+// 64-bit xxHash (XXH64). this is several times faster than crc32 and
+// has far fewer collisions so should be preferred for fingerprinting
+// content (document contents, etags, cache keys, etc.)
+boost::uint64_t xxHash64(const char* data,
+                         std::size_t length,
+                         boost::uint64_t seed);
+
+// hex representation of xxHash64 (seed 0)
+std::string xxHash64(const std::string& content);
+
 } // namespace hash
 } // namespace core 
 
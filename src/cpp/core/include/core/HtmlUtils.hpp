@@ -16,8 +16,10 @@
 #ifndef CORE_HTML_UTILS_HPP
 #define CORE_HTML_UTILS_HPP
 
+#include <map>
 #include <string>
 
+#include <boost/shared_ptr.hpp>
 #include <boost/regex.hpp>
 #include <boost/iostreams/filter/regex.hpp>
 
@@ -28,6 +30,13 @@ namespace html_utils {
    
 std::string defaultTitle(const std::string& htmlContent);
 
+// convert images within the base directory which are referenced by img
+// tags to base64 data urls (a single pass over the html which encodes each
+// distinct image once). this is much faster than Base64ImageFilter for
+// large documents so should be preferred when the html is in memory
+std::string base64EncodeImages(const std::string& html,
+                               const FilePath& basePath);
+
 // convert images to base64
 class Base64ImageFilter : public boost::iostreams::regex_filter
 {
@@ -35,10 +44,10 @@ public:
    explicit Base64ImageFilter(const FilePath& basePath);
 
 private:
-   std::string toBase64Image(const boost::cmatch& match);
-
-private:
-   FilePath basePath_;
+   typedef std::map<std::string, std::string> DataUrls;
+   static std::string toBase64Image(const FilePath& basePath,
+                                    boost::shared_ptr<DataUrls> pCache,
+                                    const boost::cmatch& match);
 };
 
 // convert fonts to base64
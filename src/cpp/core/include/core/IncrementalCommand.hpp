@@ -51,6 +51,12 @@ public:
       executeUntil(now() + incrementalDuration_);
    }
 
+   // incremental commands execute at every opportunity until finished
+   virtual boost::posix_time::ptime nextExecutionTime() const
+   {
+      return now();
+   }
+
 private:
    void executeUntil(const boost::posix_time::ptime& time)
    {
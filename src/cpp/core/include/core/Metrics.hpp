@@ -0,0 +1,113 @@
+/*
+ * Metrics.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_METRICS_HPP
+#define CORE_METRICS_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+namespace core {
+
+namespace http {
+   class Request;
+   class Response;
+}
+
+namespace metrics {
+
+// histogram of latencies in the style of HdrHistogram: values are
+// recorded with microsecond resolution into log-linear buckets (8 per
+// power of two) so quantiles are accurate to within 12.5% regardless of
+// magnitude while recording remains constant time. (also used for sizes,
+// which are recorded in bytes rather than microseconds)
+class LatencyHistogram
+{
+public:
+   LatencyHistogram();
+
+   // COPYING: via compiler
+
+   void record(boost::uint64_t microseconds);
+
+   boost::uint64_t count() const { return count_; }
+   boost::uint64_t sum() const { return sum_; }
+
+   // (upper bound of the) value in microseconds at the quantile (0-1)
+   boost::uint64_t valueAtQuantile(double quantile) const;
+
+private:
+   std::vector<boost::uint64_t> buckets_;
+   boost::uint64_t count_;
+   boost::uint64_t sum_;
+   boost::uint64_t max_;
+};
+
+// record the latency of an operation. metrics are keyed by name (e.g.
+// "rserver_http_request") and a single label (e.g. "handler", "/rpc").
+// label values should come from a small fixed set (uri prefixes, method
+// names) rather than e.g. full uris. safe to call from any thread
+void recordLatency(const std::string& name,
+                   const std::string& labelName,
+                   const std::string& labelValue,
+                   const boost::posix_time::time_duration& latency);
+
+// record the latency between the start time and now
+void recordLatencySince(const std::string& name,
+                        const std::string& labelName,
+                        const std::string& labelValue,
+                        const boost::posix_time::ptime& startTime);
+
+// record the size (in bytes) of e.g. a response. sizes are keyed by name
+// and a single label in the same way as latencies
+void recordSize(const std::string& name,
+                const std::string& labelName,
+                const std::string& labelValue,
+                boost::uint64_t bytes);
+
+// copies of the histograms recorded for a latency or size metric (keyed
+// by label value)
+typedef std::map<std::string, LatencyHistogram> Histograms;
+Histograms latencyHistograms(const std::string& name);
+Histograms sizeHistograms(const std::string& name);
+
+// set the current value of a gauge (e.g. memory in use by a session).
+// gauges are keyed by name and a single label in the same way as latencies
+void setGauge(const std::string& name,
+              const std::string& labelName,
+              const std::string& labelValue,
+              double value);
+
+// remove a label value from a gauge (e.g. once the session has exited)
+void removeGauge(const std::string& name, const std::string& labelValue);
+
+// all metrics in the prometheus text exposition format (latencies are
+// reported as summaries in seconds, sizes as summaries in bytes, gauges
+// as is)
+std::string prometheusText();
+
+// uri handler which serves prometheusText
+void handleMetricsRequest(const http::Request& request,
+                          http::Response* pResponse);
+
+} // namespace metrics
+} // namespace core
+
+#endif // CORE_METRICS_HPP
+
@@ -38,15 +38,16 @@ public:
    void advance(const std::string& step);
    void stop();
    bool running() const;
+
+   typedef std::pair<std::string,boost::posix_time::time_duration> Step;
+   typedef std::vector<Step> Steps;
+   const Steps& steps() const { return steps_; }
    
 private:
    boost::posix_time::ptime now() const;
    void recordPendingStep();
    
 private:
-   typedef std::pair<std::string,boost::posix_time::time_duration> Step;
-   typedef std::vector<Step> Steps;
-   
    boost::posix_time::ptime startTime_;
    Steps steps_ ;
    
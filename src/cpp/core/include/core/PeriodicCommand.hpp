@@ -44,7 +44,7 @@ public:
 public:
    virtual void execute()
    {
-      if (now() > nextExecutionTime_)
+      if (now() >= nextExecutionTime_)
       {
          if (execute_())
          {
@@ -57,6 +57,11 @@ public:
       }
    }
 
+   virtual boost::posix_time::ptime nextExecutionTime() const
+   {
+      return nextExecutionTime_;
+   }
+
 private:
    const boost::posix_time::time_duration period_;
    boost::posix_time::ptime nextExecutionTime_;
@@ -42,6 +42,14 @@ public:
 public:
    virtual void execute() = 0;
 
+   // time at which the command next needs to execute (schedulers which
+   // support per-command deadlines use this to avoid polling). commands
+   // without a deadline of their own execute at the default interval
+   virtual boost::posix_time::ptime nextExecutionTime() const
+   {
+      return now() + boost::posix_time::seconds(3);
+   }
+
    bool finished() const { return finished_; }
 
 protected:
@@ -54,6 +54,14 @@ public:
    void beginUpdate();
    void endUpdate();
 
+   // in write-behind mode changes are not written immediately but rather
+   // accumulated until the next call to flush (or endUpdate). unflushed
+   // changes survive re-reading the file with initialize. in this mode
+   // the file is replaced atomically (written to a temporary file which
+   // is then renamed over it)
+   void setWriteBehind(bool writeBehind);
+   void flush();
+
 private:
    void writeSettings() ;
 
@@ -62,6 +70,8 @@ private:
    std::map<std::string, std::string> settingsMap_ ;
    bool updatePending_ ;
    bool isDirty_;
+   bool writeBehind_;
+   std::map<std::string, std::string> unflushed_;
 };
 
 }
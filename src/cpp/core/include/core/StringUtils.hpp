@@ -30,6 +30,17 @@ enum LineEnding {
    LineEndingPassthrough
 };
 
+// fast (sse2 where available) checks for text which needs no transcoding
+bool isAscii(const char* begin, const char* end);
+bool isAscii(const std::string& str);
+bool isValidUtf8(const char* begin, const char* end);
+bool isValidUtf8(const std::string& str);
+
+// does the text contain control characters which don't appear in text files
+// (i.e. other than backspace, tab, newlines, form feed, carriage return and
+// escape)? used to recognize binary content
+bool hasBinaryControlChars(const char* begin, const char* end);
+
 std::string utf8ToSystem(const std::string& str,
                          bool escapeInvalidChars=false);
 std::string systemToUtf8(const std::string& str);
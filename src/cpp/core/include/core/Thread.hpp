@@ -34,8 +34,8 @@
 #define END_LOCK_MUTEX } \
    catch(const boost::thread_resource_error& e) \
    { \
-      Error threadError(boost::thread_error::ec_from_exception(e), \
-                        ERROR_LOCATION) ; \
+      core::Error threadError(boost::thread_error::ec_from_exception(e), \
+                              ERROR_LOCATION) ; \
       LOG_ERROR(threadError); \
    }
 
@@ -0,0 +1,84 @@
+/*
+ * ThreadPool.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_THREAD_POOL_HPP
+#define CORE_THREAD_POOL_HPP
+
+#include <deque>
+#include <vector>
+
+#include <boost/utility.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <core/BoostThread.hpp>
+
+namespace core {
+namespace thread {
+
+// Fixed size pool of worker threads. Each worker has its own queue of work
+// (work is distributed across the queues round-robin) and workers which
+// run out of work steal from the back of the other workers' queues. Work
+// must not touch the R interpreter or any other main-thread-only state.
+class ThreadPool : boost::noncopyable
+{
+public:
+   typedef boost::function<void()> Work;
+
+   // threads == 0 means one per core (within reason)
+   explicit ThreadPool(std::size_t threads = 0);
+   virtual ~ThreadPool();
+   // COPYING: boost::noncopyable
+
+public:
+   // queue work for execution on one of the pool's threads (the threads
+   // are started on first use)
+   void execute(const Work& work);
+
+   // stop the pool (work which hasn't yet started is discarded)
+   void stop();
+
+   std::size_t threads() const { return threads_; }
+
+private:
+   struct WorkQueue
+   {
+      boost::mutex mutex;
+      std::deque<Work> work;
+   };
+
+   void start();
+   void workerMain(std::size_t index);
+   bool takeWork(std::size_t index, Work* pWork);
+
+private:
+   const std::size_t threads_;
+   std::vector<boost::shared_ptr<WorkQueue> > queues_;
+   std::vector<boost::shared_ptr<boost::thread> > workers_;
+
+   // protects the members below (pending_ is the number of queued items
+   // which haven't yet been taken by a worker)
+   boost::mutex mutex_;
+   boost::condition workAvailable_;
+   bool started_;
+   bool stopping_;
+   std::size_t pending_;
+   std::size_t nextQueue_;
+};
+
+} // namespace thread
+} // namespace core
+
+#endif // CORE_THREAD_POOL_HPP
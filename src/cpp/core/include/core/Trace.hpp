@@ -20,17 +20,62 @@
 #include <string>
 
 #include <boost/current_function.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 
 namespace core { 
+
+namespace http {
+   class Request;
+   class Response;
+}
+
 namespace trace {
 
 void add(void* key, const std::string& functionName);
 
+// request tracing: rserver assigns each request a trace id (which is
+// passed along to the session in the kTraceIdHeader header) and each
+// stage of handling a traced request records a span. spans are kept in
+// a bounded in-memory log which can be exported as json (one span per
+// line) to see where the time for a given request went
+extern const char * const kTraceIdHeader;
+
+void setRequestTracingEnabled(bool enabled);
+bool requestTracingEnabled();
+
+// when tracing is enabled assign the request a trace id (keeping a well
+// formed one supplied by the client so that client side timings can be
+// correlated with ours). otherwise remove any trace id it carries
+void assignTraceId(http::Request* pRequest);
+
+// trace id of the request (empty if it isn't being traced)
+std::string traceId(const http::Request& request);
+
+// record a span for a traced request (no-op for an empty trace id).
+// safe to call from any thread
+void recordSpan(const std::string& traceId,
+                const std::string& name,
+                const boost::posix_time::ptime& startTime,
+                const boost::posix_time::ptime& endTime);
+
+// record a span which ends now
+void recordSpanSince(const std::string& traceId,
+                     const std::string& name,
+                     const boost::posix_time::ptime& startTime);
+
+// recorded spans as json lines (optionally just those of one trace)
+std::string spansAsJsonLines(const std::string& traceId = std::string());
+
+// uri handler which serves spansAsJsonLines (the trace query parameter
+// selects a single trace)
+void handleTraceRequest(const http::Request& request,
+                        http::Response* pResponse);
+
 } // namespace trace
 } // namespace core 
 
 #define TRACE_CURRENT_METHOD \
    core::trace::add(this, BOOST_CURRENT_FUNCTION);
 
-#endif // CORE_PERFORMANCE_TIMER_HPP
+#endif // CORE_TRACE_HPP
 
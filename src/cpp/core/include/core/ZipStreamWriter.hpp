@@ -0,0 +1,90 @@
+/*
+ * ZipStreamWriter.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_ZIP_STREAM_WRITER_HPP
+#define CORE_ZIP_STREAM_WRITER_HPP
+
+#include <string>
+#include <vector>
+#include <ctime>
+
+#include <boost/cstdint.hpp>
+#include <boost/function.hpp>
+#include <boost/utility.hpp>
+
+#include <core/Error.hpp>
+
+namespace core {
+
+class FilePath;
+
+// Writes a zip archive to a sink as it is built. Nothing is seeked back
+// to (entry sizes and checksums follow their data in data descriptors) so
+// the archive can be sent as it is written. Files which are already
+// compressed are stored rather than deflated, and zip64 records are used
+// for entries and archives too large for the classic format.
+class ZipStreamWriter : boost::noncopyable
+{
+public:
+   typedef boost::function<Error(const char*, std::size_t)> Sink;
+
+   explicit ZipStreamWriter(const Sink& sink);
+   // COPYING: boost::noncopyable
+
+public:
+   // add a file or directory (recursively) under the given path within the
+   // archive (use forward slashes)
+   Error addPath(const FilePath& filePath, const std::string& archivePath);
+
+   // write the central directory (must be called once all paths are added)
+   Error finish();
+
+private:
+   struct Entry
+   {
+      std::string name;
+      boost::uint16_t method;
+      boost::uint16_t flags;
+      boost::uint16_t dosTime;
+      boost::uint16_t dosDate;
+      boost::uint32_t crc;
+      boost::uint64_t compressedSize;
+      boost::uint64_t uncompressedSize;
+      boost::uint64_t offset;
+      boost::uint32_t externalAttributes;
+      bool zip64;
+   };
+
+   Error addDirectory(const FilePath& dirPath, const std::string& name);
+   Error addFile(const FilePath& filePath, const std::string& name);
+   Error writeFileData(const FilePath& filePath, Entry* pEntry);
+   Error writeLocalHeader(const Entry& entry);
+   Error writeDataDescriptor(const Entry& entry);
+   Error write(const std::string& data);
+   Error write(const char* data, std::size_t size);
+
+   static void setDosTime(std::time_t time, Entry* pEntry);
+
+private:
+   Sink sink_;
+   boost::uint64_t offset_;
+   std::vector<Entry> entries_;
+   std::vector<char> inBuffer_;
+   std::vector<char> outBuffer_;
+};
+
+} // namespace core
+
+#endif // CORE_ZIP_STREAM_WRITER_HPP
@@ -57,6 +57,8 @@
 #include <algorithm>
 #include <cstddef>
 
+#include <boost/pool/pool_alloc.hpp>
+
 
 /// A node in the tree, combining links to other nodes as well as the actual data.
 template<class T>
@@ -83,7 +85,22 @@ tree_node_<T>::tree_node_(const T& val)
 	{
 	}
 
-template <class T, class tree_node_allocator = std::allocator<tree_node_<T> > >
+// RStudio: nodes are allocated from a pool by default rather than with
+// std::allocator. trees are used for file monitor snapshots which can have
+// hundreds of thousands of nodes, pooling them avoids an individual heap
+// allocation per node and keeps nodes close together in memory. note that
+// the pool retains freed nodes for reuse (it doesn't return them to the
+// system) and that it is shared by all trees with the same node size
+template<class T>
+struct tree_node_pool_allocator
+{
+	typedef boost::fast_pool_allocator<tree_node_<T>,
+	                                   boost::default_user_allocator_new_delete,
+	                                   boost::details::pool::default_mutex,
+	                                   1024> type;
+};
+
+template <class T, class tree_node_allocator = typename tree_node_pool_allocator<T>::type >
 class tree {
 	protected:
 		typedef tree_node_<T> tree_node;
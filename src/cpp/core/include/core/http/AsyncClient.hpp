@@ -16,9 +16,14 @@
 #ifndef CORE_HTTP_ASYNC_CLIENT_HPP
 #define CORE_HTTP_ASYNC_CLIENT_HPP
 
+#include <map>
+#include <deque>
+
 #include <boost/shared_ptr.hpp>
 #include <boost/function.hpp>
 #include <boost/enable_shared_from_this.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/algorithm/string/predicate.hpp>
 
 #include <boost/asio/write.hpp>
 #include <boost/asio/io_service.hpp>
@@ -30,6 +35,7 @@
 
 #include <core/Error.hpp>
 #include <core/Log.hpp>
+#include <core/Thread.hpp>
 
 #include <core/http/Request.hpp>
 #include <core/http/Response.hpp>
@@ -65,7 +71,9 @@ class AsyncClient :
 public:
    AsyncClient(boost::asio::io_service& ioService)
       : ioService_(ioService),
-        connectionRetryContext_(ioService)
+        connectionRetryContext_(ioService),
+        keepAlive_(false),
+        reusedConnection_(false)
    {
    }
 
@@ -82,6 +90,23 @@ public:
            const http::ConnectionRetryProfile& connectionRetryProfile)
    {
       connectionRetryContext_.profile = connectionRetryProfile;
+      connectionRetryContext_.stopTryingTime =
+                                    boost::posix_time::not_a_date_time;
+   }
+
+   // request that the connection be kept open after the response is
+   // received (so that the client can be executed again with a new
+   // request). whether the connection is actually kept open depends
+   // on the server agreeing and the response having a Content-Length
+   void setKeepAlive(bool keepAlive)
+   {
+      keepAlive_ = keepAlive;
+   }
+
+   // can this client be executed again over its existing connection?
+   bool isReusable()
+   {
+      return keepAlive_ && socket().lowest_layer().is_open();
    }
 
    // execute the async client
@@ -92,9 +117,24 @@ public:
       responseHandler_ = responseHandler;
       errorHandler_ = errorHandler;
 
-      // connect and write request (implmented in a protocol
-      // specific manner by subclassees)
-      connectAndWriteRequest();
+      // reset response state (we may be executing a second time over
+      // a kept-alive connection)
+      response_.reset();
+      responseBuffer_.consume(responseBuffer_.size());
+
+      // if we have a live connection from a previous request then
+      // write directly to it, otherwise connect and write request
+      // (implmented in a protocol specific manner by subclassees)
+      if (isReusable())
+      {
+         reusedConnection_ = true;
+         writeRequest();
+      }
+      else
+      {
+         reusedConnection_ = false;
+         connectAndWriteRequest();
+      }
    }
 
    // if an embedder of this class calls close() on AsyncClient in it's
@@ -139,7 +179,8 @@ protected:
       // write
       boost::asio::async_write(
           socket(),
-          request_.toBuffers(Header::connectionClose()),
+          request_.toBuffers(keepAlive_ ? Header("Connection", "keep-alive")
+                                        : Header::connectionClose()),
           boost::bind(
                &AsyncClient<SocketService>::handleWrite,
                AsyncClient<SocketService>::shared_from_this(),
@@ -152,8 +193,12 @@ protected:
       // close the socket
       close();
 
-      if (errorHandler_)
-         errorHandler_(error);
+      // clear handlers before calling so that any references they
+      // hold (e.g. to this client) are released
+      ErrorHandler errorHandler = errorHandler_;
+      disableHandlers();
+      if (errorHandler)
+         errorHandler(error);
    }
 
    void handleErrorCode(const boost::system::error_code& ec,
@@ -274,7 +319,7 @@ private:
                           AsyncClient<SocketService>::shared_from_this(),
                           boost::asio::placeholders::error));
          }
-         else
+         else if (!retryStaleConnectionIfRequired(ec))
          {
             handleErrorCode(ec, ERROR_LOCATION);
          }
@@ -282,6 +327,28 @@ private:
       CATCH_UNEXPECTED_ASYNC_CLIENT_EXCEPTION
    }
 
+   // a kept-alive connection may have been closed by the server while it
+   // was idle. in that case the write or the read of the status line
+   // fails before any part of the response is seen and we can safely
+   // re-issue the request over a fresh connection
+   bool retryStaleConnectionIfRequired(const boost::system::error_code& ec)
+   {
+      if (reusedConnection_ &&
+          (ec == boost::asio::error::eof ||
+           http::isConnectionTerminatedError(Error(ec, ERROR_LOCATION))))
+      {
+         reusedConnection_ = false;
+         close();
+         responseBuffer_.consume(responseBuffer_.size());
+         connectAndWriteRequest();
+         return true;
+      }
+      else
+      {
+         return false;
+      }
+   }
+
    void handleReadStatusLine(const boost::system::error_code& ec)
    {
       try
@@ -307,7 +374,7 @@ private:
                              boost::asio::placeholders::error));
             }
          }
-         else
+         else if (!retryStaleConnectionIfRequired(ec))
          {
             handleErrorCode(ec, ERROR_LOCATION);
          }
@@ -357,8 +424,11 @@ private:
             if (responseBuffer_.size() > 0)
                ResponseParser::appendToBody(&responseBuffer_, &response_);
 
-            // start reading content
-            readSomeContent();
+            // start reading content (unless we already have all of it)
+            if (keepAlive_ && responseComplete())
+               respondAndKeepAlive();
+            else
+               readSomeContent();
          }
          else
          {
@@ -377,8 +447,11 @@ private:
             // copy content
             ResponseParser::appendToBody(&responseBuffer_, &response_);
 
-            // continue reading content
-            readSomeContent();
+            // continue reading content (unless we already have all of it)
+            if (keepAlive_ && responseComplete())
+               respondAndKeepAlive();
+            else
+               readSomeContent();
          }
          else if (ec == boost::asio::error::eof ||
                   isShutdownError(ec))
@@ -402,8 +475,46 @@ private:
    {
       close();
 
-      if (responseHandler_)
-         responseHandler_(response_);
+      respond();
+   }
+
+   // for kept-alive connections we can't rely on eof to delimit the
+   // response so we need the server to agree to keep the connection
+   // open and to tell us the length of the content
+   bool responseComplete()
+   {
+      if (response_.isHttp10() ||
+          !response_.containsHeader("Content-Length") ||
+          boost::algorithm::iequals(response_.headerValue("Connection"),
+                                    "close"))
+      {
+         return false;
+      }
+
+      return response_.body().size() >= response_.contentLength();
+   }
+
+   void respondAndKeepAlive()
+   {
+      // if the server sent more than it said it would then the
+      // connection is not in a state where it can be reused
+      if (response_.body().size() > response_.contentLength() ||
+          responseBuffer_.size() > 0)
+      {
+         close();
+      }
+
+      respond();
+   }
+
+   void respond()
+   {
+      // clear handlers before calling so that any references they
+      // hold (e.g. to this client) are released
+      ResponseHandler responseHandler = responseHandler_;
+      disableHandlers();
+      if (responseHandler)
+         responseHandler(response_);
    }
 
 // struct and instance variable to track connection retry state
@@ -431,6 +542,147 @@ private:
    ErrorHandler errorHandler_;
    http::Request request_;
    boost::asio::streambuf responseBuffer_;
+   bool keepAlive_;
+   bool reusedConnection_;
+};
+
+
+// pool of idle kept-alive clients, keyed by destination (e.g. username).
+// callers checkout a client (creating a new one with setKeepAlive(true)
+// if none is available) and check it back in once they have consumed its
+// response. at most maxIdlePerKey clients are retained for each key and
+// clients which sit idle for longer than idleTimeout are closed
+template <typename ClientType>
+class AsyncClientPool : boost::noncopyable
+{
+public:
+   AsyncClientPool(std::size_t maxIdlePerKey,
+                   const boost::posix_time::time_duration& idleTimeout)
+      : maxIdlePerKey_(maxIdlePerKey),
+        idleTimeout_(idleTimeout),
+        lastEvictionTime_(now())
+   {
+   }
+
+   // get an idle client for the key (returns an empty pointer if there
+   // are none available)
+   boost::shared_ptr<ClientType> checkout(const std::string& key)
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         evictIdle();
+
+         typename IdleMap::iterator it = idle_.find(key);
+         while (it != idle_.end() && !it->second.empty())
+         {
+            boost::shared_ptr<ClientType> pClient =
+                                       it->second.back().pClient;
+            it->second.pop_back();
+            if (pClient->isReusable())
+               return pClient;
+         }
+      }
+      END_LOCK_MUTEX
+
+      return boost::shared_ptr<ClientType>();
+   }
+
+   // return a client to the pool. clients which are no longer reusable
+   // or which would exceed the idle limit for the key are discarded
+   void checkin(const std::string& key, boost::shared_ptr<ClientType> pClient)
+   {
+      if (!pClient->isReusable())
+         return;
+
+      LOCK_MUTEX(mutex_)
+      {
+         std::deque<IdleClient>& clients = idle_[key];
+         if (clients.size() < maxIdlePerKey_)
+         {
+            IdleClient idleClient;
+            idleClient.pClient = pClient;
+            idleClient.idleSince = now();
+            clients.push_back(idleClient);
+            return;
+         }
+      }
+      END_LOCK_MUTEX
+
+      // pool is full (or we failed to lock), so close the client
+      pClient->close();
+   }
+
+   // close and discard all idle clients for the key (e.g. because the
+   // destination has gone away)
+   void evict(const std::string& key)
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         typename IdleMap::iterator it = idle_.find(key);
+         if (it != idle_.end())
+         {
+            closeAll(it->second);
+            idle_.erase(it);
+         }
+      }
+      END_LOCK_MUTEX
+   }
+
+private:
+   struct IdleClient
+   {
+      boost::shared_ptr<ClientType> pClient;
+      boost::posix_time::ptime idleSince;
+   };
+   typedef std::map<std::string, std::deque<IdleClient> > IdleMap;
+
+   static boost::posix_time::ptime now()
+   {
+      return boost::posix_time::microsec_clock::universal_time();
+   }
+
+   static void closeAll(const std::deque<IdleClient>& clients)
+   {
+      for (typename std::deque<IdleClient>::const_iterator it =
+              clients.begin(); it != clients.end(); ++it)
+      {
+         it->pClient->close();
+      }
+   }
+
+   // NOTE: must be called with mutex_ held. eviction is done lazily from
+   // checkout so we only sweep the whole pool once per idle timeout
+   void evictIdle()
+   {
+      boost::posix_time::ptime currentTime = now();
+      if (currentTime < (lastEvictionTime_ + idleTimeout_))
+         return;
+      lastEvictionTime_ = currentTime;
+
+      for (typename IdleMap::iterator it = idle_.begin(); it != idle_.end(); )
+      {
+         // idle clients are ordered oldest first
+         std::deque<IdleClient>& clients = it->second;
+         while (!clients.empty() &&
+                (clients.front().idleSince + idleTimeout_) < currentTime)
+         {
+            clients.front().pClient->close();
+            clients.pop_front();
+         }
+
+         if (clients.empty())
+            idle_.erase(it++);
+         else
+            ++it;
+      }
+   }
+
+private:
+   const std::size_t maxIdlePerKey_;
+   const boost::posix_time::time_duration idleTimeout_;
+   boost::posix_time::ptime lastEvictionTime_;
+   boost::mutex mutex_;
+   IdleMap idle_;
 };
    
 
@@ -16,7 +16,10 @@
 #ifndef CORE_HTTP_ASYNC_CONNECTION_HPP
 #define CORE_HTTP_ASYNC_CONNECTION_HPP
 
+#include <string>
+
 #include <boost/shared_ptr.hpp>
+#include <boost/function.hpp>
 #include <boost/asio/io_service.hpp>
 
 namespace core {
@@ -47,6 +50,23 @@ public:
    // simple wrappers for writing an existing response or error
    virtual void writeResponse(const http::Response& response) = 0;
    virtual void writeError(const Error& error) = 0;
+
+   // stream raw data in both directions rather than responding (used to
+   // tunnel protocols such as websockets which the request upgraded to).
+   // data read from the client is passed to the data handler and the
+   // closed handler is called once the connection is closed (by either
+   // side). the (optional) written handler is called once the data has
+   // been sent so that callers can avoid queueing up large amounts of data.
+   // all of these are safe to call from any thread
+   typedef boost::function<void(const char*, std::size_t)> StreamDataHandler;
+   typedef boost::function<void()> StreamClosedHandler;
+   typedef boost::function<void()> StreamWrittenHandler;
+   virtual void startStreaming(const StreamDataHandler& onData,
+                               const StreamClosedHandler& onClosed) = 0;
+   virtual void writeStreamData(const std::string& data) = 0;
+   virtual void writeStreamData(const std::string& data,
+                                const StreamWrittenHandler& onWritten) = 0;
+   virtual void closeStream() = 0;
 };
 
 } // namespace http
@@ -16,10 +16,17 @@
 #ifndef CORE_HTTP_ASYNC_CONNECTION_IMPL_HPP
 #define CORE_HTTP_ASYNC_CONNECTION_IMPL_HPP
 
+#include <deque>
+#include <string>
+#include <algorithm>
+#include <vector>
+
+#include <boost/bind.hpp>
 #include <boost/array.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/function.hpp>
 #include <boost/enable_shared_from_this.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 
 #include <boost/asio/write.hpp>
 #include <boost/asio/io_service.hpp>
@@ -27,10 +34,14 @@
 
 #include <core/Error.hpp>
 #include <core/Log.hpp>
+#include <core/Thread.hpp>
+#include <core/Trace.hpp>
 
+#include <core/http/FileBody.hpp>
 #include <core/http/Request.hpp>
 #include <core/http/Response.hpp>
 #include <core/http/SocketUtils.hpp>
+#include <core/http/Http2Session.hpp>
 #include <core/http/RequestParser.hpp>
 #include <core/http/AsyncConnection.hpp>
 
@@ -44,11 +55,18 @@ class AsyncConnectionImpl :
    boost::noncopyable
 {
 public:
+   // the socket is passed along with the connection since HTTP/2 requests
+   // each have a connection of their own (but share the socket)
    typedef boost::function<void(
-         boost::shared_ptr<AsyncConnectionImpl<ProtocolType> >,
+         boost::shared_ptr<AsyncConnection>,
+         typename ProtocolType::socket*,
          http::Request*)> Handler;
 
-   typedef boost::function<void(http::Response*)> ResponseFilter;
+   // called just before the response is written. the time is when the
+   // request was fully read (not_a_date_time if it never was)
+   typedef boost::function<void(const http::Request&,
+                                const boost::posix_time::ptime&,
+                                http::Response*)> ResponseFilter;
 
 public:
    AsyncConnectionImpl(boost::asio::io_service& ioService,
@@ -57,8 +75,10 @@ public:
       : ioService_(ioService),
         socket_(ioService),
         handler_(handler),
-        responseFilter_(responseFilter)
-        
+        responseFilter_(responseFilter),
+        protocolDetected_(false),
+        http2Writing_(false),
+        streamClosed_(false)
    {
    }
    
@@ -69,6 +89,7 @@ public:
 
    void startReading()
    {
+      acceptTime_ = boost::posix_time::microsec_clock::universal_time();
       readSome();
    }
 
@@ -95,7 +116,9 @@ public:
 
       // call the response filter if we have one
       if (responseFilter_)
-         responseFilter_(&response_);
+         responseFilter_(request_, requestTime_, &response_);
+
+      writeTime_ = boost::posix_time::microsec_clock::universal_time();
 
       // write
       boost::asio::async_write(
@@ -119,8 +142,167 @@ public:
       response_.setError(error);
       writeResponse();
    }
+
+   virtual void startStreaming(const StreamDataHandler& onData,
+                               const StreamClosedHandler& onClosed)
+   {
+      LOCK_MUTEX(streamMutex_)
+      {
+         onStreamData_ = onData;
+         onStreamClosed_ = onClosed;
+      }
+      END_LOCK_MUTEX
+
+      readStream();
+   }
+
+   virtual void writeStreamData(const std::string& data)
+   {
+      writeStreamData(data, StreamWrittenHandler());
+   }
+
+   virtual void writeStreamData(const std::string& data,
+                                const StreamWrittenHandler& onWritten)
+   {
+      LOCK_MUTEX(streamMutex_)
+      {
+         if (streamClosed_)
+            return;
+
+         // writes are queued so that only one is outstanding at a time
+         streamWrites_.push_back(data);
+         streamWrittenHandlers_.push_back(onWritten);
+         if (streamWrites_.size() == 1)
+            writeNextStreamData();
+      }
+      END_LOCK_MUTEX
+   }
+
+   virtual void closeStream()
+   {
+      LOCK_MUTEX(streamMutex_)
+      {
+         doCloseStream();
+      }
+      END_LOCK_MUTEX
+   }
    
 private:
+
+   void readStream()
+   {
+      socket_.async_read_some(
+         boost::asio::buffer(buffer_),
+         boost::bind(
+               &AsyncConnectionImpl<ProtocolType>::handleStreamRead,
+               AsyncConnectionImpl<ProtocolType>::shared_from_this(),
+               boost::asio::placeholders::error,
+               boost::asio::placeholders::bytes_transferred)
+      );
+   }
+
+   void handleStreamRead(const boost::system::error_code& e,
+                         std::size_t bytesTransferred)
+   {
+      try
+      {
+         if (!e)
+         {
+            onStreamData_(buffer_.data(), bytesTransferred);
+            readStream();
+         }
+         else
+         {
+            // log the error if it wasn't connection terminated (or caused
+            // by the stream being closed on our side)
+            Error error(e, ERROR_LOCATION);
+            if (!isConnectionTerminatedError(error) &&
+                e != boost::asio::error::operation_aborted)
+            {
+               LOG_ERROR(error);
+            }
+
+            closeStream();
+
+            // notify and then release the handlers (they may hold
+            // references back to this connection)
+            StreamClosedHandler onClosed = onStreamClosed_;
+            onStreamData_ = StreamDataHandler();
+            onStreamClosed_ = StreamClosedHandler();
+            if (onClosed)
+               onClosed();
+         }
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
+   // NOTE: must be called with streamMutex_ held
+   void writeNextStreamData()
+   {
+      boost::asio::async_write(
+          socket_,
+          boost::asio::buffer(streamWrites_.front()),
+          boost::bind(
+               &AsyncConnectionImpl<ProtocolType>::handleStreamWrite,
+               AsyncConnectionImpl<ProtocolType>::shared_from_this(),
+               boost::asio::placeholders::error)
+      );
+   }
+
+   void handleStreamWrite(const boost::system::error_code& e)
+   {
+      try
+      {
+         StreamWrittenHandler onWritten;
+         LOCK_MUTEX(streamMutex_)
+         {
+            if (e)
+            {
+               Error error(e, ERROR_LOCATION);
+               if (!isConnectionTerminatedError(error) &&
+                   e != boost::asio::error::operation_aborted)
+               {
+                  LOG_ERROR(error);
+               }
+
+               doCloseStream();
+               return;
+            }
+
+            if (!streamWrites_.empty())
+            {
+               streamWrites_.pop_front();
+               onWritten = streamWrittenHandlers_.front();
+               streamWrittenHandlers_.pop_front();
+            }
+            if (!streamWrites_.empty() && !streamClosed_)
+               writeNextStreamData();
+         }
+         END_LOCK_MUTEX
+
+         // notify outside of the lock (the handler typically writes more)
+         if (onWritten)
+            onWritten();
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
+   // NOTE: must be called with streamMutex_ held
+   void doCloseStream()
+   {
+      if (streamClosed_)
+         return;
+
+      streamClosed_ = true;
+      streamWrites_.clear();
+      streamWrittenHandlers_.clear();
+
+      // closing the socket aborts the outstanding read (which then
+      // calls the closed handler)
+      Error error = closeSocket(socket_);
+      if (error)
+         LOG_ERROR(error);
+   }
    
    void handleRead(const boost::system::error_code& e,
                    std::size_t bytesTransferred)
@@ -129,31 +311,30 @@ private:
       {
          if (!e)
          {
-            // parse next chunk
-            RequestParser::status status = requestParser_.parse(
-                                             request_,
-                                             buffer_.data(), 
-                                             buffer_.data() + bytesTransferred);
-            
-            // error - return bad request
-            if (status == RequestParser::error)
+            if (protocolDetected_)
             {
-               response_.setStatusCode(http::status::BadRequest);
-               writeResponse();
+               parseRequest(buffer_.data(), buffer_.data() + bytesTransferred);
+               return;
             }
-            
-            // incomplete -- keep reading
-            else if (status == RequestParser::incomplete)
-            {
-               readSome();
-            }
-            
-            // got valid request -- handle it 
-            else
+
+            // HTTP/2 connections (with prior knowledge) start with the
+            // preface, which no HTTP/1 request can start with
+            prefaceBuffer_.append(buffer_.data(), bytesTransferred);
+            std::size_t length = std::min(prefaceBuffer_.size(),
+                                          kHttp2PrefaceLength);
+            if (prefaceBuffer_.compare(0, length, kHttp2Preface, length) == 0)
             {
-               handler_(AsyncConnectionImpl<ProtocolType>::shared_from_this(),
-                        &request_);
+               if (length < kHttp2PrefaceLength)
+                  readSome();
+               else
+                  startHttp2();
+               return;
             }
+
+            protocolDetected_ = true;
+            std::string data;
+            data.swap(prefaceBuffer_);
+            parseRequest(data.data(), data.data() + data.size());
          }
          else // error reading
          {
@@ -177,6 +358,185 @@ private:
    }
    
 
+   void parseRequest(const char* begin, const char* end)
+   {
+      // parse next chunk
+      RequestParser::status status = requestParser_.parse(request_,
+                                                          begin,
+                                                          end);
+
+      // error - return bad request
+      if (status == RequestParser::error)
+      {
+         response_.setStatusCode(http::status::BadRequest);
+         writeResponse();
+      }
+
+      // incomplete -- keep reading
+      else if (status == RequestParser::incomplete)
+      {
+         readSome();
+      }
+
+      // got valid request -- handle it
+      else
+      {
+         requestTime_ = boost::posix_time::microsec_clock::universal_time();
+
+         // tag the request for tracing (the trace id is forwarded
+         // along with the request's other headers)
+         trace::assignTraceId(&request_);
+         trace::recordSpan(trace::traceId(request_),
+                           "read_request",
+                           acceptTime_,
+                           requestTime_);
+
+         handler_(AsyncConnectionImpl<ProtocolType>::shared_from_this(),
+                  &socket_,
+                  &request_);
+      }
+   }
+
+   void startHttp2()
+   {
+      protocolDetected_ = true;
+
+      // NOTE: the session's handlers keep this connection alive until
+      // the session is closed (in closeHttp2)
+      pHttp2Session_.reset(new Http2Session(
+         ioService_,
+         boost::bind(&AsyncConnectionImpl<ProtocolType>::handleHttp2Request,
+                     AsyncConnectionImpl<ProtocolType>::shared_from_this(),
+                     _1, _2),
+         responseFilter_,
+         boost::bind(&AsyncConnectionImpl<ProtocolType>::writeHttp2Output,
+                     AsyncConnectionImpl<ProtocolType>::shared_from_this())
+      ));
+      pHttp2Session_->start();
+
+      std::string data;
+      data.swap(prefaceBuffer_);
+      receiveHttp2(data.data(), data.size());
+   }
+
+   void handleHttp2Request(boost::shared_ptr<AsyncConnection> pStream,
+                           http::Request* pRequest)
+   {
+      handler_(pStream, &socket_, pRequest);
+   }
+
+   void receiveHttp2(const char* data, std::size_t size)
+   {
+      bool more = pHttp2Session_->receive(data, size);
+      writeHttp2Output();
+      if (more)
+         readHttp2();
+   }
+
+   void readHttp2()
+   {
+      socket_.async_read_some(
+         boost::asio::buffer(buffer_),
+         boost::bind(
+               &AsyncConnectionImpl<ProtocolType>::handleHttp2Read,
+               AsyncConnectionImpl<ProtocolType>::shared_from_this(),
+               boost::asio::placeholders::error,
+               boost::asio::placeholders::bytes_transferred)
+      );
+   }
+
+   void handleHttp2Read(const boost::system::error_code& e,
+                        std::size_t bytesTransferred)
+   {
+      try
+      {
+         if (!e)
+         {
+            receiveHttp2(buffer_.data(), bytesTransferred);
+         }
+         else
+         {
+            // log the error if it wasn't connection terminated (or caused
+            // by our closing the connection)
+            Error error(e, ERROR_LOCATION);
+            if (!isConnectionTerminatedError(error) &&
+                e != boost::asio::error::operation_aborted)
+            {
+               LOG_ERROR(error);
+            }
+
+            closeHttp2();
+         }
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
+   // write the session's output (one write is outstanding at a time)
+   void writeHttp2Output()
+   {
+      LOCK_MUTEX(http2WriteMutex_)
+      {
+         if (http2Writing_)
+            return;
+
+         if (!pHttp2Session_->takeOutput(&http2Output_))
+         {
+            if (pHttp2Session_->finished())
+               closeHttp2();
+            return;
+         }
+
+         http2Writing_ = true;
+         boost::asio::async_write(
+             socket_,
+             boost::asio::buffer(http2Output_),
+             boost::bind(
+                  &AsyncConnectionImpl<ProtocolType>::handleHttp2Write,
+                  AsyncConnectionImpl<ProtocolType>::shared_from_this(),
+                  boost::asio::placeholders::error)
+         );
+      }
+      END_LOCK_MUTEX
+   }
+
+   void handleHttp2Write(const boost::system::error_code& e)
+   {
+      try
+      {
+         LOCK_MUTEX(http2WriteMutex_)
+         {
+            http2Writing_ = false;
+         }
+         END_LOCK_MUTEX
+
+         if (e)
+         {
+            Error error(e, ERROR_LOCATION);
+            if (!isConnectionTerminatedError(error) &&
+                e != boost::asio::error::operation_aborted)
+            {
+               LOG_ERROR(error);
+            }
+
+            closeHttp2();
+            return;
+         }
+
+         writeHttp2Output();
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
+   void closeHttp2()
+   {
+      pHttp2Session_->close();
+
+      // closing the socket aborts the outstanding read
+      Error error = closeSocket(socket_);
+      if (error)
+         LOG_ERROR(error);
+   }
+
    void handleWrite(const boost::system::error_code& e)
    {
       try
@@ -188,6 +548,17 @@ private:
             if (!http::isConnectionTerminatedError(error))
                LOG_ERROR(error);
          }
+
+         // file bodies are sent from disk a chunk at a time once the
+         // headers have been written
+         else if (response_.hasFileBody() && writeFileBodyChunk())
+         {
+            return;
+         }
+
+         trace::recordSpanSince(trace::traceId(request_),
+                                "write_response",
+                                writeTime_);
          
          // close the socket
          Error error = closeSocket(socket_);
@@ -202,6 +573,47 @@ private:
       CATCH_UNEXPECTED_EXCEPTION
    }
    
+   // write the next chunk of the response's file body (returns false
+   // if there is nothing more to write)
+   bool writeFileBodyChunk()
+   {
+      if (!pFileBodyReader_)
+      {
+         pFileBodyReader_.reset(new FileBodyReader(response_));
+         fileBodyBuffer_.resize(65536);
+         Error error = pFileBodyReader_->open();
+         if (error)
+         {
+            LOG_ERROR(error);
+            return false;
+         }
+      }
+
+      std::size_t bytesRead;
+      Error error = pFileBodyReader_->read(&(fileBodyBuffer_[0]),
+                                           fileBodyBuffer_.size(),
+                                           &bytesRead);
+      if (error)
+      {
+         LOG_ERROR(error);
+         return false;
+      }
+      else if (bytesRead == 0)
+      {
+         return false;
+      }
+
+      boost::asio::async_write(
+          socket_,
+          boost::asio::buffer(fileBodyBuffer_, bytesRead),
+          boost::bind(
+               &AsyncConnectionImpl<ProtocolType>::handleWrite,
+               AsyncConnectionImpl<ProtocolType>::shared_from_this(),
+               boost::asio::placeholders::error)
+      );
+      return true;
+   }
+
    void readSome()
    {
       socket_.async_read_some(
@@ -222,7 +634,28 @@ private:
    boost::array<char, 8192> buffer_ ;
    RequestParser requestParser_ ;
    http::Request request_;
+   boost::posix_time::ptime acceptTime_;
+   boost::posix_time::ptime requestTime_;
+   boost::posix_time::ptime writeTime_;
    http::Response response_;
+   boost::shared_ptr<FileBodyReader> pFileBodyReader_;
+   std::vector<char> fileBodyBuffer_;
+
+   // protocol detection and HTTP/2 state
+   bool protocolDetected_;
+   std::string prefaceBuffer_;
+   boost::shared_ptr<Http2Session> pHttp2Session_;
+   boost::mutex http2WriteMutex_;
+   bool http2Writing_;
+   std::string http2Output_;
+
+   // streaming state
+   boost::mutex streamMutex_;
+   bool streamClosed_;
+   std::deque<std::string> streamWrites_;
+   std::deque<StreamWrittenHandler> streamWrittenHandlers_;
+   StreamDataHandler onStreamData_;
+   StreamClosedHandler onStreamClosed_;
 };
    
 
@@ -16,8 +16,10 @@
 #ifndef CORE_HTTP_ASYNC_SERVER_HPP
 #define CORE_HTTP_ASYNC_SERVER_HPP
 
+#include <map>
 #include <vector>
 
+#include <boost/foreach.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/function.hpp>
 #include <boost/algorithm/string.hpp>
@@ -30,7 +32,9 @@
 #include <core/Error.hpp>
 #include <core/BoostErrors.hpp>
 #include <core/Log.hpp>
+#include <core/Metrics.hpp>
 #include <core/ScheduledCommand.hpp>
+#include <core/Trace.hpp>
 #include <core/system/System.hpp>
 
 #include <core/http/Request.hpp>
@@ -100,10 +104,19 @@ public:
                                     _1));
    }
 
+   // record the latency of each request (keyed by the prefix of the
+   // handler which served it) under this metric name
+   void setRequestMetricName(const std::string& name)
+   {
+      BOOST_ASSERT(!running_);
+      requestMetricName_ = name;
+   }
+
    void addScheduledCommand(boost::shared_ptr<ScheduledCommand> pCmd)
    {
       BOOST_ASSERT(!running_);
-      scheduledCommands_.push_back(pCmd);
+      scheduledCommands_.insert(std::make_pair(pCmd->nextExecutionTime(),
+                                               pCmd));
    }
 
    Error runSingleThreaded()
@@ -214,11 +227,11 @@ private:
 
          // connection handler
          boost::bind(&AsyncServer<ProtocolType>::handleConnection,
-                     this, _1, _2),
+                     this, _1, _2, _3),
 
          // response filter
          boost::bind(&AsyncServer<ProtocolType>::connectionResponseFilter,
-                     this, _1)
+                     this, _1, _2, _3)
       ));
       
       // wait for next connection
@@ -273,26 +286,28 @@ private:
       CATCH_UNEXPECTED_EXCEPTION
    }
    
-   void handleConnection(
-         boost::shared_ptr<AsyncConnectionImpl<ProtocolType> > pConnection,
-         http::Request* pRequest)
+   void handleConnection(boost::shared_ptr<AsyncConnection> pAsyncConnection,
+                         typename ProtocolType::socket* pSocket,
+                         http::Request* pRequest)
    {
       try
       {
          // call filter
-         onRequest(&(pConnection->socket()), pRequest);
-         
-         // convert to cannonical HttpConnection
-         boost::shared_ptr<AsyncConnection> pAsyncConnection =
-             boost::static_pointer_cast<AsyncConnection>(pConnection);
+         onRequest(pSocket, pRequest);
 
          // call the appropriate handler to generate a response
          std::string uri = pRequest->uri();
          AsyncUriHandlerFunction handler = uriHandlers_.handlerFor(uri);
          if (handler)
          {
-            // call the handler
+            // call the handler (for proxied requests this covers
+            // authentication and sending the request on)
+            using namespace boost::posix_time;
+            ptime dispatchTime = microsec_clock::universal_time();
             handler(pAsyncConnection) ;
+            trace::recordSpanSince(trace::traceId(*pRequest),
+                                   "dispatch",
+                                   dispatchTime);
          }
          else if (defaultHandler_)
          {
@@ -305,7 +320,8 @@ private:
             LOG_ERROR_MESSAGE("Handler not found for uri: " + pRequest->uri());
             
             // return 404 not found
-            pConnection->response().setStatusCode(http::status::NotFound) ;
+            pAsyncConnection->response().setStatusCode(
+                                                   http::status::NotFound);
          }
       }
       catch(const boost::system::system_error& e)
@@ -319,19 +335,40 @@ private:
       CATCH_UNEXPECTED_EXCEPTION
    }
 
-   void connectionResponseFilter(http::Response* pResponse)
+   void connectionResponseFilter(const http::Request& request,
+                                 const boost::posix_time::ptime& requestTime,
+                                 http::Response* pResponse)
    {
       // set server header (evade ref-counting to defend against
       // non-threadsafe std::string implementations)
       pResponse->setHeader("Server", std::string(serverName_.c_str()));
+
+      // let the client know the trace id so it can look up the spans
+      std::string traceId = trace::traceId(request);
+      if (!traceId.empty())
+         pResponse->setHeader(trace::kTraceIdHeader, traceId);
+
+      // record how long it took to generate the response (by handler
+      // prefix rather than uri to bound the number of series)
+      if (!requestMetricName_.empty())
+      {
+         std::string prefix = uriHandlers_.prefixFor(request.uri());
+         metrics::recordLatencySince(requestMetricName_,
+                                     "handler",
+                                     prefix.empty() ? "default" : prefix,
+                                     requestTime);
+      }
    }
 
    void waitForScheduledCommandTimer()
    {
-      // set expiration time for 3 seconds from now
+      // nothing to wait for
+      if (scheduledCommands_.empty())
+         return;
+
+      // wake up when the earliest command is due
       boost::system::error_code ec;
-      scheduledCommandTimer_.expires_from_now(boost::posix_time::seconds(3),
-                                              ec);
+      scheduledCommandTimer_.expires_at(scheduledCommands_.begin()->first, ec);
 
       // attempt to schedule timer (should always succeed but
       // include error check to be paranoid/robust)
@@ -355,17 +392,33 @@ private:
       {
          if (!ec)
          {
-            // execute all commands
-            std::for_each(scheduledCommands_.begin(),
-                          scheduledCommands_.end(),
-                          boost::bind(&ScheduledCommand::execute, _1));
-
-            // remove any commands which are finished
-            scheduledCommands_.erase(
-                 std::remove_if(scheduledCommands_.begin(),
-                                scheduledCommands_.end(),
-                                boost::bind(&ScheduledCommand::finished, _1)),
-                 scheduledCommands_.end());
+            // remove all of the commands which are due
+            using namespace boost::posix_time;
+            ptime now = microsec_clock::universal_time();
+            std::vector<boost::shared_ptr<ScheduledCommand> > dueCommands;
+            while (!scheduledCommands_.empty() &&
+                   scheduledCommands_.begin()->first <= now)
+            {
+               dueCommands.push_back(scheduledCommands_.begin()->second);
+               scheduledCommands_.erase(scheduledCommands_.begin());
+            }
+
+            // execute them and reschedule the ones which aren't finished
+            BOOST_FOREACH(boost::shared_ptr<ScheduledCommand> pCmd,
+                          dueCommands)
+            {
+               try
+               {
+                  pCmd->execute();
+               }
+               CATCH_UNEXPECTED_EXCEPTION
+
+               if (!pCmd->finished())
+               {
+                  scheduledCommands_.insert(
+                           std::make_pair(pCmd->nextExecutionTime(), pCmd));
+               }
+            }
 
            // wait for the timer again
            waitForScheduledCommandTimer();
@@ -437,13 +490,16 @@ private:
    bool abortOnResourceError_;
    std::string serverName_;
    std::string baseUri_;
+   std::string requestMetricName_;
    boost::shared_ptr<AsyncConnectionImpl<ProtocolType> > ptrNextConnection_;
    AsyncUriHandlers uriHandlers_ ;
    AsyncUriHandlerFunction defaultHandler_;
    std::vector<boost::shared_ptr<boost::thread> > threads_;
    SocketAcceptorService<ProtocolType> acceptorService_;
    boost::asio::deadline_timer scheduledCommandTimer_;
-   std::vector<boost::shared_ptr<ScheduledCommand> > scheduledCommands_;
+   // scheduled commands ordered by the time they next need to execute
+   std::multimap<boost::posix_time::ptime,
+                 boost::shared_ptr<ScheduledCommand> > scheduledCommands_;
    bool running_;
 };
 
@@ -54,6 +54,11 @@ public:
       return boost::algorithm::starts_with(uri, prefix_);
    }
 
+   const std::string& prefix() const
+   {
+      return prefix_;
+   }
+
    AsyncUriHandlerFunction function() const
    {
       return function_;
@@ -99,6 +104,20 @@ public:
       }
    }
 
+   // prefix of the handler for the uri (empty if there isn't one)
+   std::string prefixFor(const std::string& uri) const
+   {
+      std::vector<AsyncUriHandler>::const_iterator handler =
+            std::find_if(
+              uriHandlers_.begin(),
+              uriHandlers_.end(),
+              boost::bind(&AsyncUriHandler::matches, _1, uri));
+      if ( handler != uriHandlers_.end() )
+         return handler->prefix();
+      else
+         return std::string();
+   }
+
 private:
    std::vector<AsyncUriHandler> uriHandlers_;
 };
@@ -0,0 +1,109 @@
+/*
+ * FileBody.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_HTTP_FILE_BODY_HPP
+#define CORE_HTTP_FILE_BODY_HPP
+
+#include <iosfwd>
+#include <string>
+
+#include <boost/array.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/utility.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/asio/buffer.hpp>
+
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+
+#include <core/http/Response.hpp>
+
+namespace core {
+namespace http {
+
+// reads the file body of a response (see Response::setFileBody) in chunks
+class FileBodyReader : boost::noncopyable
+{
+public:
+   explicit FileBodyReader(const Response& response);
+
+   // COPYING: boost::noncopyable
+
+   Error open();
+
+   // read the next chunk of the body. *pBytesRead is 0 once all of the
+   // body has been read
+   Error read(char* buffer, std::size_t bufferSize, std::size_t* pBytesRead);
+
+private:
+   FilePath filePath_;
+   uintmax_t offset_;
+   uintmax_t remaining_;
+   boost::shared_ptr<std::istream> pIfs_;
+};
+
+#ifdef __linux__
+// send part of a file to a socket using sendfile
+Error sendFile(int socket,
+               const FilePath& filePath,
+               uintmax_t offset,
+               uintmax_t length);
+#endif
+
+// write the file body of a response (if it has one) to a socket. the
+// response headers must already have been written
+template <typename Socket>
+Error writeFileBody(const Response& response, Socket& socket)
+{
+   if (!response.hasFileBody())
+      return Success();
+
+#ifdef __linux__
+   return sendFile(socket.native(),
+                   FilePath(response.fileBodyPath()),
+                   response.fileBodyOffset(),
+                   response.fileBodyLength());
+#else
+   FileBodyReader reader(response);
+   Error error = reader.open();
+   if (error)
+      return error;
+
+   boost::array<char, 65536> buffer;
+   while (true)
+   {
+      std::size_t bytesRead;
+      error = reader.read(buffer.data(), buffer.size(), &bytesRead);
+      if (error)
+         return error;
+      if (bytesRead == 0)
+         return Success();
+
+      try
+      {
+         boost::asio::write(socket, boost::asio::buffer(buffer, bytesRead));
+      }
+      catch(const boost::system::system_error& e)
+      {
+         return Error(e.code(), ERROR_LOCATION);
+      }
+   }
+#endif
+}
+
+} // namespace http
+} // namespace core
+
+#endif // CORE_HTTP_FILE_BODY_HPP
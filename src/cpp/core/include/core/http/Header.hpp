@@ -51,6 +51,43 @@ private:
    std::string name_ ;
 };
    
+// well-known header names are interned (case-insensitively) so that
+// messages can find them by id rather than by scanning and comparing names
+enum WellKnownHeader
+{
+   kUnknownHeader = -1,
+   kAcceptHeader = 0,
+   kAcceptEncodingHeader,
+   kAuthorizationHeader,
+   kCacheControlHeader,
+   kConnectionHeader,
+   kContentDispositionHeader,
+   kContentEncodingHeader,
+   kContentLengthHeader,
+   kContentTypeHeader,
+   kCookieHeader,
+   kDateHeader,
+   kETagHeader,
+   kExpiresHeader,
+   kHostHeader,
+   kIfModifiedSinceHeader,
+   kIfNoneMatchHeader,
+   kLastModifiedHeader,
+   kLocationHeader,
+   kPragmaHeader,
+   kRangeHeader,
+   kRefererHeader,
+   kSetCookieHeader,
+   kTransferEncodingHeader,
+   kUpgradeHeader,
+   kUserAgentHeader,
+   kVaryHeader,
+   kXForwardedForHeader,
+   kWellKnownHeaderCount
+};
+
+WellKnownHeader wellKnownHeader(const std::string& name);
+
 bool containsHeader(const Headers& headers, const std::string& name);
    
 Headers::const_iterator findHeader(const Headers& headers, 
@@ -0,0 +1,102 @@
+/*
+ * Hpack.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_HTTP_HPACK_HPP
+#define CORE_HTTP_HPACK_HPP
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <core/http/Header.hpp>
+
+namespace core {
+namespace http {
+namespace hpack {
+
+// HPACK header compression for HTTP/2 (RFC 7541). header names are
+// always lower case on the wire
+
+// default (and our advertised) size of the dynamic table
+const std::size_t kDefaultTableSize = 4096;
+
+// the static table followed by a dynamic table of recently sent headers
+class HeaderTable
+{
+public:
+   explicit HeaderTable(std::size_t maxSize = kDefaultTableSize)
+      : size_(0), maxSize_(maxSize)
+   {
+   }
+
+   // COPYING: via compiler
+
+   // 1-based index across the static and dynamic tables. returns false
+   // if there is no such entry
+   bool get(std::size_t index, Header* pHeader) const;
+
+   // index of an entry with this name and value (or failing that just
+   // the name). returns 0 if there is none
+   std::size_t find(const std::string& name,
+                    const std::string& value,
+                    bool* pValueMatched) const;
+
+   void add(const Header& header);
+
+   std::size_t maxSize() const { return maxSize_; }
+   void setMaxSize(std::size_t maxSize);
+
+private:
+   void evict(std::size_t targetSize);
+
+private:
+   std::deque<Header> entries_;
+   std::size_t size_;
+   std::size_t maxSize_;
+};
+
+class Decoder
+{
+public:
+   Decoder() {}
+
+   // decode a complete header block. returns false on a compression error
+   // (which leaves the table unusable and so is fatal to the connection)
+   bool decode(const std::string& block, std::vector<Header>* pHeaders);
+
+private:
+   HeaderTable table_;
+};
+
+class Encoder
+{
+public:
+   Encoder() : pendingSizeUpdate_(false) {}
+
+   // the peer's limit on the size of our dynamic table
+   void setMaxTableSize(std::size_t maxSize);
+
+   void encode(const std::vector<Header>& headers, std::string* pBlock);
+
+private:
+   HeaderTable table_;
+   bool pendingSizeUpdate_;
+};
+
+} // namespace hpack
+} // namespace http
+} // namespace core
+
+#endif // CORE_HTTP_HPACK_HPP
@@ -0,0 +1,198 @@
+/*
+ * Http2Session.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_HTTP_HTTP2_SESSION_HPP
+#define CORE_HTTP_HTTP2_SESSION_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/utility.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <core/Thread.hpp>
+#include <core/http/Hpack.hpp>
+
+namespace core {
+namespace http {
+
+class Request;
+class Response;
+class AsyncConnection;
+class FileBodyReader;
+class Http2Stream;
+
+// the client connection preface which starts every HTTP/2 connection
+extern const char * const kHttp2Preface;
+const std::size_t kHttp2PrefaceLength = 24;
+
+// The HTTP/2 protocol (RFC 7540) for one connection, independent of its
+// transport: bytes read from the connection are passed to receive and the
+// bytes to write are collected with takeOutput. Each request stream is
+// passed to the request handler as an AsyncConnection of its own (so uri
+// handlers work unchanged) and any number of them can be in progress at
+// once. All methods are safe to call from any thread.
+class Http2Session : public boost::enable_shared_from_this<Http2Session>,
+                     boost::noncopyable
+{
+public:
+   typedef boost::function<void(boost::shared_ptr<AsyncConnection>,
+                                http::Request*)> RequestHandler;
+
+   typedef boost::function<void(const http::Request&,
+                                const boost::posix_time::ptime&,
+                                http::Response*)> ResponseFilter;
+
+   // called when output becomes available other than as a result of
+   // receive (e.g. a response written from a handler thread)
+   typedef boost::function<void()> OutputHandler;
+
+public:
+   Http2Session(boost::asio::io_service& ioService,
+                const RequestHandler& requestHandler,
+                const ResponseFilter& responseFilter,
+                const OutputHandler& onOutput);
+
+   // COPYING: boost::noncopyable
+
+   // queue our settings (must be called before receive)
+   void start();
+
+   // process bytes read from the connection (starting with the preface).
+   // returns false once the connection should no longer be read from
+   bool receive(const char* data, std::size_t size);
+
+   // take (up to roughly a write's worth of) the bytes to write to the
+   // connection. returns false if there are none
+   bool takeOutput(std::string* pOutput);
+
+   // true once the connection should be closed (after writing any
+   // remaining output)
+   bool finished();
+
+   // the connection has gone away: drop all streams and handlers
+   void close();
+
+private:
+   friend class Http2Stream;
+
+   struct Stream
+   {
+      Stream()
+         : remoteClosed(false), responding(false), sendWindow(0), dataOffset(0)
+      {
+      }
+
+      // held until the request is complete and handed to the handler
+      boost::shared_ptr<Http2Stream> pPending;
+      std::string requestBody;
+      bool remoteClosed;
+      boost::posix_time::ptime openTime;
+
+      // response body still to be sent
+      bool responding;
+      boost::int64_t sendWindow;
+      std::string data;
+      std::size_t dataOffset;
+      boost::shared_ptr<FileBodyReader> pFileBodyReader;
+      std::string traceId;
+      boost::posix_time::ptime writeTime;
+   };
+
+   typedef std::map<boost::uint32_t, Stream> Streams;
+
+   // called by streams
+   boost::asio::io_service& ioService() { return ioService_; }
+   void writeResponse(boost::uint32_t streamId,
+                      const http::Request& request,
+                      const boost::posix_time::ptime& requestTime,
+                      http::Response* pResponse);
+   void resetStream(boost::uint32_t streamId, boost::uint32_t errorCode);
+   void notifyOutput();
+
+   // NOTE: the remaining methods must be called with mutex_ held
+   bool processFrames(std::vector<boost::shared_ptr<Http2Stream> >* pReady);
+   bool processFrame(boost::uint8_t type,
+                     boost::uint8_t flags,
+                     boost::uint32_t streamId,
+                     const std::string& payload,
+                     std::vector<boost::shared_ptr<Http2Stream> >* pReady);
+   bool processSettings(boost::uint8_t flags, const std::string& payload);
+   bool processHeaders(boost::uint8_t type,
+                       boost::uint8_t flags,
+                       boost::uint32_t streamId,
+                       const std::string& payload,
+                       std::vector<boost::shared_ptr<Http2Stream> >* pReady);
+   bool processHeaderBlock(
+                       std::vector<boost::shared_ptr<Http2Stream> >* pReady);
+   bool processData(boost::uint8_t flags,
+                    boost::uint32_t streamId,
+                    const std::string& payload,
+                    std::vector<boost::shared_ptr<Http2Stream> >* pReady);
+   bool processWindowUpdate(boost::uint32_t streamId,
+                            const std::string& payload);
+   void requestComplete(boost::uint32_t streamId,
+                        std::vector<boost::shared_ptr<Http2Stream> >* pReady);
+   void finishStream(Streams::iterator it);
+   bool connectionError(boost::uint32_t errorCode);
+   void queueFrame(boost::uint8_t type,
+                   boost::uint8_t flags,
+                   boost::uint32_t streamId,
+                   const std::string& payload);
+   void queueRstStream(boost::uint32_t streamId, boost::uint32_t errorCode);
+   void queueWindowUpdate(boost::uint32_t streamId, boost::uint32_t increment);
+   bool queueData(Streams::iterator it);
+
+private:
+   boost::asio::io_service& ioService_;
+   RequestHandler requestHandler_;
+   ResponseFilter responseFilter_;
+   OutputHandler onOutput_;
+
+   boost::mutex mutex_;
+   std::string input_;
+   std::size_t prefaceRemaining_;
+   std::string output_;
+   hpack::Decoder decoder_;
+   hpack::Encoder encoder_;
+   Streams streams_;
+   boost::uint32_t lastStreamId_;
+   boost::uint32_t nextDataStreamId_;
+
+   // header block being received (across CONTINUATION frames)
+   boost::uint32_t headerStreamId_;
+   bool headerEndStream_;
+   std::string headerBlock_;
+
+   // peer settings
+   boost::int64_t connectionSendWindow_;
+   boost::int64_t initialWindowSize_;
+   std::size_t maxFrameSize_;
+
+   bool goingAway_;
+   bool failed_;
+   bool closed_;
+};
+
+} // namespace http
+} // namespace core
+
+#endif // CORE_HTTP_HTTP2_SESSION_HPP
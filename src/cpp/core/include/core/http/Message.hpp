@@ -44,7 +44,10 @@ class Response;
 class Message : boost::noncopyable
 {
 public:
-   Message() : httpVersionMajor_(1), httpVersionMinor_(1) {}
+   Message()
+      : httpVersionMajor_(1), httpVersionMinor_(1), indexedHeaderCount_(0)
+   {
+   }
    virtual ~Message() {}
    // COPYING: boost::noncopyable
 
@@ -110,12 +113,20 @@ protected:
       httpVersionMajor_ = message.httpVersionMajor_;
       httpVersionMinor_ = message.httpVersionMinor_;
       headers_ = message.headers_;
+      headerIndex_.clear();
       overrideHeader_ = message.overrideHeader_;
       httpVersion_ = message.httpVersion_;
    }
 
 private:
-   
+
+   // position of a header in headers_ (or -1 if it isn't present)
+   int headerPosition(const std::string& name) const;
+   int headerPosition(WellKnownHeader header) const;
+
+   // (re)build the index of well-known headers
+   void indexHeaders() const;
+
    virtual void appendFirstLineBuffers(
          std::vector<boost::asio::const_buffer>& buffers) const = 0;
 
@@ -130,6 +141,14 @@ private:
    int httpVersionMajor_;
    int httpVersionMinor_;
    std::vector<Header> headers_;
+
+   // position of the first occurrence of each well-known header within
+   // headers_ (or -1 if it isn't present). the index is built on demand and
+   // rebuilt whenever the number of headers has changed in a way that add
+   // didn't account for (e.g. parsers appending directly to headers_). it is
+   // cleared (marking it invalid) when headers are removed
+   mutable std::vector<int> headerIndex_;
+   mutable std::size_t indexedHeaderCount_;
    
    // storage for override header (used by toBuffers to override a header
    // when asking for the message bytes)
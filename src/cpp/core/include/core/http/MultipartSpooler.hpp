@@ -0,0 +1,92 @@
+/*
+ * MultipartSpooler.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_HTTP_MULTIPART_SPOOLER_HPP
+#define CORE_HTTP_MULTIPART_SPOOLER_HPP
+
+#include <string>
+#include <vector>
+#include <iosfwd>
+
+#include <boost/utility.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <core/FilePath.hpp>
+#include <core/http/Util.hpp>
+
+namespace core {
+namespace http {
+
+// Incremental parser for multipart/form-data bodies. The body may be
+// written in chunks of any size; form fields are kept in memory and the
+// contents of file parts are written to files within the spool directory
+// as they arrive (so the body as a whole is never held in memory). Any
+// spooled files which still exist when the spooler is destroyed are
+// removed, so consumers should move the files they want to keep.
+class MultipartSpooler : boost::noncopyable
+{
+public:
+   MultipartSpooler(const std::string& contentType,
+                    const FilePath& spoolDir);
+   virtual ~MultipartSpooler();
+   // COPYING: boost::noncopyable
+
+public:
+   // returns false if the body is malformed or can't be spooled
+   bool write(const char* data, std::size_t size);
+
+   // call once the whole body has been written. returns false if the
+   // body was incomplete
+   bool finish(Fields* pFields, Files* pFiles);
+
+private:
+   bool processBuffer();
+   bool beginPart(const std::string& headers);
+   bool writePartData(const char* data, std::size_t size);
+   void endPart();
+
+private:
+   enum State
+   {
+      Preamble,
+      Delimiter,
+      PartHeaders,
+      PartData,
+      Epilogue,
+      Failed
+   };
+
+   State state_;
+   FilePath spoolDir_;
+   std::string delimiter_;
+   std::string buffer_;
+
+   // current part
+   std::string partName_;
+   bool partIsFile_;
+   File partFile_;
+   std::string partValue_;
+   boost::shared_ptr<std::ostream> pPartStream_;
+
+   Fields fields_;
+   Files files_;
+   std::vector<FilePath> spooledFiles_;
+};
+
+} // namespace http
+} // namespace core
+
+
+#endif // CORE_HTTP_MULTIPART_SPOOLER_HPP
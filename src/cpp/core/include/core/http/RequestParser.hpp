@@ -17,11 +17,20 @@
 #ifndef CORE_HTTP_REQUEST_PARSER_HPP
 #define CORE_HTTP_REQUEST_PARSER_HPP
 
+#include <algorithm>
+#include <iterator>
+
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <core/FilePath.hpp>
 #include <core/http/Request.hpp>
 
 namespace core {
 namespace http {
 
+class MultipartSpooler;
+
 /// Parser for incoming requests.
 class RequestParser
 {
@@ -32,6 +41,17 @@ public:
   /// Reset to initial parser state.
   void reset();
 
+  // by default request bodies are accumulated in memory. once a spool
+  // directory is set multipart/form-data bodies are instead parsed as they
+  // arrive, with uploaded files written straight to the spool directory
+  // (the form fields and files are available from the request once it is
+  // complete). the progress handler is called as the body is read (with
+  // the bytes read so far and the total) whenever another percent arrives
+  typedef boost::function<void(const Request&, std::size_t, std::size_t)>
+                                                            ProgressHandler;
+  void setBodySpooling(const FilePath& spoolDir,
+                       const ProgressHandler& onProgress = ProgressHandler());
+
   // enum for parse results
   enum status
   {
@@ -42,12 +62,44 @@ public:
 
   template <typename InputIterator>
   status parse(Request& req, InputIterator begin, InputIterator end)
+  {
+     return parse(req, begin, end, &begin);
+  }
+
+  // variation which also provides the position at which parsing stopped
+  // (enables reading of multiple pipelined requests from a single buffer)
+  template <typename InputIterator>
+  status parse(Request& req,
+               InputIterator begin,
+               InputIterator end,
+               InputIterator* pStop)
+  {
+    status st = doParse(req, begin, end);
+    *pStop = begin;
+    return st;
+  }
+
+private:
+  template <typename InputIterator>
+  status doParse(Request& req, InputIterator& begin, InputIterator end)
   {
     while (begin != end)
     {
        // header parsing
       if (!parsing_body_)
       {
+         // the uri and header values make up most of the bytes of the
+         // headers so runs of them are scanned and appended in bulk
+         if (state_ == uri || state_ == header_value)
+         {
+            std::size_t count ;
+            if (!consumeRun(req, &(*begin), std::distance(begin, end), &count))
+               return error ;
+            std::advance(begin, count);
+            if (begin == end)
+               break ;
+         }
+
          status st = consume(req, *begin++);
          if ( st == error )
          {
@@ -58,6 +110,7 @@ public:
             // if we have a body then continue parsing it
             if (content_length_ > 0)
             {
+               beginBody(req);
                parsing_body_ = true ;
                continue ;
             }
@@ -67,21 +120,38 @@ public:
             }
          }
       }
-      // body parsing
+      // body parsing (a chunk at a time)
       else
       {
-         req.body_.push_back(*begin++) ;
-         if (req.body_.size() == content_length_)
-            return complete ;
+         std::size_t count = std::min<std::size_t>(
+                                       std::distance(begin, end),
+                                       content_length_ - body_bytes_read_);
+         bool consumed = consumeBody(req, &(*begin), count);
+         std::advance(begin, count);
+         if (!consumed)
+            return error ;
+         else if (body_bytes_read_ == content_length_)
+            return endBody(req) ;
       }
     }
     return incomplete ;
   }
 
-private:
   /// Handle the next character of input.
   status consume(Request& req, char input);
 
+  // append the run of uri or header value characters at the start of the
+  // input (stopping at the character which ends it)
+  bool consumeRun(Request& req,
+                  const char* data,
+                  std::size_t size,
+                  std::size_t* pCount);
+
+  // body handling
+  void beginBody(Request& req);
+  bool consumeBody(Request& req, const char* data, std::size_t size);
+  status endBody(Request& req);
+
   /// Check if a byte is an HTTP character.
   static bool is_char(int c);
 
@@ -123,6 +193,13 @@ private:
   std::size_t content_length_ ;
   bool parsing_content_length_ ;
   bool parsing_body_ ;
+  std::size_t body_bytes_read_ ;
+
+  // body spooling
+  FilePath spool_dir_ ;
+  ProgressHandler on_progress_ ;
+  int progress_percent_ ;
+  boost::shared_ptr<MultipartSpooler> spooler_ ;
 };
 
 } // namespace http
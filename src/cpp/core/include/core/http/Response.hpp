@@ -18,8 +18,11 @@
 
 #include <iostream>
 #include <sstream>
+#include <vector>
+#include <boost/function.hpp>
 #include <boost/type_traits/is_same.hpp>
 #include <boost/iostreams/copy.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
 #include <boost/iostreams/concepts.hpp>
 #include <boost/iostreams/filtering_stream.hpp>
 
@@ -44,6 +47,7 @@ class Cookie ;
    
 namespace status {
 enum Code {
+   SwitchingProtocols = 101,
    Ok = 200,
    Created = 201,
    PartialContent = 206,
@@ -79,8 +83,54 @@ public:
    }   
 };     
    
+// policy which determines when and how response bodies are compressed
+// (responses are only compressed when the client accepts it and the
+// response's content encoding has been set to gzip)
+struct CompressionPolicy
+{
+   CompressionPolicy();
+
+   // is a body of this type and size worth compressing
+   bool shouldCompress(const std::string& contentType,
+                       std::size_t size) const;
+
+   // zlib compression level (1-9)
+   int level;
+
+   // bodies smaller than this aren't compressed (they'd gain little and
+   // still pay for the gzip header and the cpu)
+   std::size_t minimumSize;
+
+   // content types (or type prefixes e.g. "text/") which are compressed.
+   // an empty list means all content types are compressed
+   std::vector<std::string> contentTypes;
+
+   // buffer size used by the compressor
+   std::streamsize bufferSize;
+
+   // serve a precompressed sibling of a file (e.g. foo.js.gz) when it
+   // exists and is at least as new as the file
+   bool precompressedFiles;
+};
+
+// set the policy (should be done once at startup, before serving requests)
+void setCompressionPolicy(const CompressionPolicy& policy);
+const CompressionPolicy& compressionPolicy();
+
+// gzip content using the given compression level
+Error gzipContent(const std::string& content,
+                  int level,
+                  std::string* pCompressed);
+
 class Response : public Message
 {
+public:
+   // files at least this large are sent by setFile directly from disk
+   static const uintmax_t kMinStreamedFileSize = 1024 * 1024;
+
+   // buffer size used when reading and filtering bodies
+   static const std::streamsize kDefaultBufferSize = 8192;
+
 public:
    Response();
    virtual ~Response() {}
@@ -93,6 +143,10 @@ public:
       statusCode_ = response.statusCode_;
       statusCodeStr_ = response.statusCodeStr_;
       statusMessage_ = response.statusMessage_;
+      fileBodyPath_ = response.fileBodyPath_;
+      fileBodyOffset_ = response.fileBodyOffset_;
+      fileBodyLength_ = response.fileBodyLength_;
+      streamBodyWriter_ = response.streamBodyWriter_;
    }
 
 public:   
@@ -147,13 +201,13 @@ public:
    template <typename Filter>
    Error setBody(const std::string& content, 
                  const Filter& filter,
-                 std::streamsize buffSize = 128)
+                 std::streamsize buffSize = kDefaultBufferSize)
    {
       std::istringstream is(content);
       return setBody(is, filter, buffSize);
    }   
       
-   Error setBody(std::istream& is, std::streamsize buffSize = 128)
+   Error setBody(std::istream& is, std::streamsize buffSize = kDefaultBufferSize)
    {
       NullOutputFilter nullFilter;
       return setBody(is, nullFilter, buffSize);
@@ -162,7 +216,7 @@ public:
    template <typename Filter>
    Error setBody(std::istream& is, 
                  const Filter& filter, 
-                 std::streamsize buffSize = 128) 
+                 std::streamsize buffSize = kDefaultBufferSize) 
    {
       try
       {
@@ -176,29 +230,16 @@ public:
          if ( !boost::is_same<Filter, NullOutputFilter>::value )
             filteringStream.push(filter, buffSize);
 
-         // handle gzip
-         if (contentEncoding() == kGzipEncoding)
-#ifdef _WIN32
-            // never gzip on win32
-            removeHeader("Content-Encoding");
-#else
-            // add gzip compressor on posix
-            filteringStream.push(boost::iostreams::gzip_compressor(), buffSize);
-#endif
-
-         // buffer to write to
-         std::ostringstream bodyStream;
-         filteringStream.push(bodyStream, buffSize);
+         // write directly into the body
+         clearFileBody();
+         body_.clear();
+         filteringStream.push(boost::iostreams::back_inserter(body_), buffSize);
          
          // copy input stream
          boost::iostreams::copy(is, filteringStream, buffSize);
          
-         // set body 
-         body_ = bodyStream.str();
-         setContentLength(body_.length());
-         
-         // return success
-         return Success();
+         // compress (if requested and the policy permits) and set length
+         return encodeBody();
       }
       catch(const std::exception& e)
       {
@@ -209,7 +250,40 @@ public:
       }
    }   
 
-   Error setBody(const FilePath& filePath, std::streamsize buffSize = 512)
+   // set the body by having the writer stream it directly into the
+   // response buffer
+   typedef boost::function<void(std::ostream&)> BodyWriter;
+   Error setStreamedBody(const BodyWriter& writer,
+                         std::streamsize buffSize = kDefaultBufferSize)
+   {
+      try
+      {
+         boost::iostreams::filtering_ostream filteringStream;
+         filteringStream.exceptions(std::ostream::failbit |
+                                    std::ostream::badbit);
+
+         clearFileBody();
+         body_.clear();
+         filteringStream.push(boost::iostreams::back_inserter(body_), buffSize);
+
+         writer(filteringStream);
+
+         // flush and close the chain
+         filteringStream.reset();
+
+         return encodeBody();
+      }
+      catch(const std::exception& e)
+      {
+         Error error = systemError(boost::system::errc::io_error,
+                                   ERROR_LOCATION);
+         error.addProperty("what", e.what());
+         return error;
+      }
+   }
+
+   Error setBody(const FilePath& filePath,
+                 std::streamsize buffSize = kDefaultBufferSize)
    {
       NullOutputFilter nullFilter;
       return setBody(filePath, nullFilter, buffSize);
@@ -218,7 +292,7 @@ public:
    template <typename Filter>
    Error setBody(const FilePath& filePath, 
                  const Filter& filter,
-                 std::streamsize buffSize = 128)
+                 std::streamsize buffSize = kDefaultBufferSize)
    {
       // open the file
       boost::shared_ptr<std::istream> pIfs;
@@ -263,6 +337,23 @@ public:
       
       // set content type
       setContentType(filePath.mimeContentType());
+
+      // use a precompressed version of the file if there is one
+      if (boost::is_same<Filter, NullOutputFilter>::value &&
+          setPrecompressedFile(filePath, request))
+      {
+         return;
+      }
+      
+      // large files (and byte range requests) are sent directly from disk
+      // as the response is written (unless they need to be filtered)
+      if (boost::is_same<Filter, NullOutputFilter>::value &&
+          (filePath.size() >= kMinStreamedFileSize ||
+           !request.headerValue("Range").empty()))
+      {
+         setStreamedFile(filePath, request);
+         return;
+      }
       
       // gzip if possible
       if (request.acceptsEncoding(kGzipEncoding))
@@ -311,6 +402,35 @@ public:
 
    void setRangeableFile(const FilePath& filePath, const Request& request);
 
+   // send a file directly from disk (rather than reading it into memory)
+   // honoring any byte range specified by the request. the file is never
+   // compressed
+   void setStreamedFile(const FilePath& filePath, const Request& request);
+
+   // set the body to a range of a file which is written directly from
+   // disk by the connection (the body itself remains empty)
+   void setFileBody(const FilePath& filePath,
+                    uintmax_t offset,
+                    uintmax_t length);
+   bool hasFileBody() const { return !fileBodyPath_.empty(); }
+   const std::string& fileBodyPath() const { return fileBodyPath_; }
+   uintmax_t fileBodyOffset() const { return fileBodyOffset_; }
+   uintmax_t fileBodyLength() const { return fileBodyLength_; }
+
+   // set the body to be generated as it is sent. once the headers are
+   // written the writer is called (on a background thread) with a sink for
+   // the body's data. the length isn't known in advance so the body is
+   // ended by closing the connection. only session connections support
+   // streamed bodies
+   typedef boost::function<Error(const char*, std::size_t)> StreamBodySink;
+   typedef boost::function<Error(const StreamBodySink&)> StreamBodyWriter;
+   void setStreamBody(const StreamBodyWriter& writer);
+   bool hasStreamBody() const { return !streamBodyWriter_.empty(); }
+   const StreamBodyWriter& streamBodyWriter() const
+   {
+      return streamBodyWriter_;
+   }
+
    void setRangeableFile(const std::string& contents,
                          const std::string& mimeType,
                          const Request& request);
@@ -332,6 +452,9 @@ private:
       
 private:
    void ensureStatusMessage() const ;
+   void clearFileBody();
+   Error encodeBody();
+   bool setPrecompressedFile(const FilePath& filePath, const Request& request);
    void removeCachingHeaders();
    void setCacheForeverHeaders(bool publicAccessiblity);
    std::string eTagForContent(const std::string& content);
@@ -347,6 +470,14 @@ private:
 
    // string storage for integer members (need for toBuffers)
    mutable std::string statusCodeStr_ ;
+
+   // file which is sent as the body
+   std::string fileBodyPath_;
+   uintmax_t fileBodyOffset_;
+   uintmax_t fileBodyLength_;
+
+   // writer which generates the body as it is sent
+   StreamBodyWriter streamBodyWriter_;
 };
 
 std::ostream& operator << (std::ostream& stream, const Response& r) ;
@@ -18,6 +18,7 @@
 
 #include <iostream>
 #include <sstream>
+#include <algorithm>
 
 #include <boost/lexical_cast.hpp>
 #include <boost/algorithm/string/trim.hpp>
@@ -90,15 +91,28 @@ public:
       std::for_each(headers.begin(),
                     headers.end(),
                     boost::bind(&Response::addHeader, pResponse, _1));
+
+      // reserve space for the body up front (capped so that a bogus
+      // content length can't make us allocate an arbitrary amount)
+      const std::size_t kMaxBodyReserve = 64 * 1024 * 1024;
+      pResponse->body_.reserve(std::min(pResponse->contentLength(),
+                                        kMaxBodyReserve));
    }
 
    static void appendToBody(boost::asio::streambuf* pResponseBuffer,
                             Response* pResponse)
    {
-      std::ostringstream bodyStream ;
-      if (pResponseBuffer->size() > 0)
-         bodyStream << pResponseBuffer;
-      pResponse->body_ += bodyStream.str();
+      // append straight from the buffer (rather than through a stream)
+      typedef boost::asio::streambuf::const_buffers_type Buffers;
+      Buffers buffers = pResponseBuffer->data();
+      for (Buffers::const_iterator it = buffers.begin();
+           it != buffers.end();
+           ++it)
+      {
+         pResponse->body_.append(boost::asio::buffer_cast<const char*>(*it),
+                                 boost::asio::buffer_size(*it));
+      }
+      pResponseBuffer->consume(pResponseBuffer->size());
    }
 
    template <typename SyncReadStream>
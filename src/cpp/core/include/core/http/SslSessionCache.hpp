@@ -0,0 +1,44 @@
+/*
+ * SslSessionCache.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_HTTP_SSL_SESSION_CACHE_HPP
+#define CORE_HTTP_SSL_SESSION_CACHE_HPP
+
+#include <string>
+
+#include <openssl/ssl.h>
+
+namespace core {
+namespace http {
+namespace ssl_session_cache {
+
+// TLS sessions negotiated with the servers we connect to (keyed by address
+// and port) so that later connections can resume them rather than doing a
+// full handshake each time. all of these are safe to call from any thread
+
+// offer the session cached for the server (if any) on a new connection
+void offer(const std::string& server, SSL* pSSL);
+
+// cache the connection's session (if the server will let us resume it)
+void save(const std::string& server, SSL* pSSL);
+
+// forget the server's session
+void remove(const std::string& server);
+
+} // namespace ssl_session_cache
+} // namespace http
+} // namespace core
+
+#endif // CORE_HTTP_SSL_SESSION_CACHE_HPP
@@ -27,6 +27,7 @@
 #include "BoostAsioSsl.hpp"
 
 #include <core/http/AsyncClient.hpp>
+#include <core/http/SslSessionCache.hpp>
 #include <core/http/TcpIpAsyncConnector.hpp>
 
 namespace core {
@@ -49,6 +50,25 @@ public:
       // use scoped ptr so we can call the constructor after we've configured
       // the ssl::context (immediately above)
       ptrSslStream_.reset(new boost::asio::ssl::stream<boost::asio::ip::tcp::socket>(ioService, sslContext_));
+
+      // resume the session from our last connection to this server (if
+      // any) rather than doing a full handshake
+      ssl_session_cache::offer(sessionCacheKey(),
+                               ptrSslStream_->native_handle());
+   }
+
+   virtual ~TcpIpAsyncClientSsl()
+   {
+      try
+      {
+         // TLS 1.3 servers send session tickets after the handshake so
+         // the session is only resumable once we've read the response
+         ssl_session_cache::save(sessionCacheKey(),
+                                 ptrSslStream_->native_handle());
+      }
+      catch(...)
+      {
+      }
    }
 
 
@@ -93,17 +113,26 @@ private:
       {
          if (!ec)
          {
+            ssl_session_cache::save(sessionCacheKey(),
+                                    ptrSslStream_->native_handle());
+
             // finished handshake, commence with request
             writeRequest();
          }
          else
          {
+            ssl_session_cache::remove(sessionCacheKey());
             handleErrorCode(ec, ERROR_LOCATION);
          }
       }
       CATCH_UNEXPECTED_ASYNC_CLIENT_EXCEPTION
    }
 
+   std::string sessionCacheKey() const
+   {
+      return address_ + ":" + port_;
+   }
+
    const boost::shared_ptr<TcpIpAsyncClientSsl> sharedFromThis()
    {
       boost::shared_ptr<AsyncClient<boost::asio::ssl::stream<boost::asio::ip::tcp::socket> > > ptrShared
@@ -34,9 +34,11 @@ public:
    }
    
 public:
-   Error init(const std::string& address, const std::string& port)
+   Error init(const std::string& address,
+              const std::string& port,
+              bool reusePort = false)
    {
-      return initTcpIpAcceptor(acceptorService(), address, port);
+      return initTcpIpAcceptor(acceptorService(), address, port, reusePort);
    }
 };
 
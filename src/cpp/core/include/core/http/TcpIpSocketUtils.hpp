@@ -68,10 +68,14 @@ Error connect(boost::asio::io_service& ioService,
 }
                      
 
+// when reusePort is true the acceptor is bound with SO_REUSEPORT so that
+// several acceptors can listen on the same port (the kernel distributes
+// incoming connections between them)
 inline Error initTcpIpAcceptor(
             SocketAcceptorService<boost::asio::ip::tcp>& acceptorService,
             const std::string& address,
-            const std::string& port)
+            const std::string& port,
+            bool reusePort = false)
 {
    using boost::asio::ip::tcp;
    
@@ -96,6 +100,20 @@ inline Error initTcpIpAcceptor(
    acceptor.set_option(tcp::no_delay(true), ec) ;
    if (ec)
       return Error(ec, ERROR_LOCATION) ;
+
+   if (reusePort)
+   {
+#ifdef SO_REUSEPORT
+      typedef boost::asio::detail::socket_option::boolean<SOL_SOCKET,
+                                                          SO_REUSEPORT>
+                                                                  reuse_port;
+      acceptor.set_option(reuse_port(true), ec);
+      if (ec)
+         return Error(ec, ERROR_LOCATION);
+#else
+      return systemError(boost::system::errc::not_supported, ERROR_LOCATION);
+#endif
+   }
    
    acceptor.bind(endpoint, ec) ;
    if (ec)
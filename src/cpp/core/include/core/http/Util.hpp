@@ -23,6 +23,8 @@
 #include <boost/lexical_cast.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 
+#include <core/FilePath.hpp>
+
 namespace core {
    
 class Error;
@@ -55,6 +57,10 @@ struct File
    std::string name;
    std::string contentType;
    std::string contents;   
+
+   // set (and contents left empty) when the file was spooled to disk
+   // as the request was read
+   FilePath path;
 };
 
 typedef std::map<std::string,File> Files;
@@ -0,0 +1,93 @@
+/*
+ * WebSocket.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_HTTP_WEB_SOCKET_HPP
+#define CORE_HTTP_WEB_SOCKET_HPP
+
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+
+namespace core {
+
+class Error;
+
+namespace http {
+
+class Request;
+class Response;
+
+// server side support for the websocket protocol (RFC 6455)
+namespace websocket {
+
+enum Opcode
+{
+   Continuation = 0x0,
+   Text = 0x1,
+   Binary = 0x2,
+   Close = 0x8,
+   Ping = 0x9,
+   Pong = 0xA
+};
+
+struct Message
+{
+   Message() : opcode(Text) {}
+   Message(Opcode opcode, const std::string& payload)
+      : opcode(opcode), payload(payload)
+   {
+   }
+
+   Opcode opcode;
+   std::string payload;
+};
+
+// is this a request to upgrade the connection to a websocket
+bool isUpgradeRequest(const Request& request);
+
+// populate the response which accepts a websocket upgrade request
+Error setHandshakeResponse(const Request& request, Response* pResponse);
+
+// frame a message for sending to the client
+std::string frame(Opcode opcode, const std::string& payload);
+
+// parser for the (masked) frames sent by a client. complete messages
+// (reassembled from fragments where necessary) are returned from parse
+class FrameParser
+{
+public:
+   FrameParser() : fragmentOpcode_(Continuation) {}
+
+   // COPYING: via compiler
+
+   // parse the next chunk of data read from the client. returns false if
+   // the client violated the protocol (in which case the connection
+   // should be closed)
+   bool parse(const char* begin,
+              const char* end,
+              std::vector<Message>* pMessages);
+
+private:
+   std::string buffer_;
+   Opcode fragmentOpcode_;
+   std::string fragment_;
+};
+
+} // namespace websocket
+} // namespace http
+} // namespace core
+
+#endif // CORE_HTTP_WEB_SOCKET_HPP
@@ -79,10 +79,21 @@ json::Array toJsonArray(const std::vector<T>& val)
    return results;
 }
 
+// wire encodings for values (json text unless a client opts in to cbor)
+enum Encoding
+{
+   JsonEncoding,
+   CborEncoding
+};
+
 bool parse(const std::string& input, Value* pValue);
 
 void write(const Value& value, std::ostream& os);
 void writeFormatted(const Value& value, std::ostream& os);
+
+// approximate bytes of memory held by a value (for memory accounting)
+std::size_t estimatedSize(const Value& value);
+std::size_t estimatedSize(const Object& object);
    
 } // namespace json
 } // namespace core
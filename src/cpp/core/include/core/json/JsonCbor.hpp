@@ -0,0 +1,75 @@
+/*
+ * JsonCbor.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_JSON_CBOR_HPP
+#define CORE_JSON_CBOR_HPP
+
+#include <string>
+#include <iosfwd>
+
+#include <boost/cstdint.hpp>
+
+#include <core/json/Json.hpp>
+
+// CBOR (RFC 7049) encoding of json values. this is an opt-in alternative
+// to json text for clients which ask for it: it's more compact (numbers in
+// particular) and cheaper to produce and parse. reals are always written
+// as doubles and integers as integers so values round trip with the same
+// types as they would through json text
+
+namespace core {
+namespace json {
+
+extern const char * const kCborContentType;
+
+void writeCbor(const Value& value, std::ostream& os);
+void writeCbor(const Object& object, std::ostream& os);
+
+// accepts both definite and indefinite length items. byte strings are read
+// as strings, tags are ignored and undefined is read as null
+bool parseCbor(const std::string& input, Value* pValue);
+
+namespace cbor {
+
+// low level encoding (for streaming writers)
+enum MajorType
+{
+   UnsignedType = 0,
+   NegativeType = 1,
+   ByteStringType = 2,
+   TextStringType = 3,
+   ArrayType = 4,
+   MapType = 5,
+   TagType = 6,
+   SimpleType = 7
+};
+
+void writeHead(MajorType type, boost::uint64_t argument, std::ostream& os);
+void writeIndefiniteHead(MajorType type, std::ostream& os);
+void writeBreak(std::ostream& os);
+
+void writeInteger(boost::int64_t value, std::ostream& os);
+void writeUnsigned(boost::uint64_t value, std::ostream& os);
+void writeDouble(double value, std::ostream& os);
+void writeBool(bool value, std::ostream& os);
+void writeNull(std::ostream& os);
+void writeString(const std::string& value, std::ostream& os);
+
+} // namespace cbor
+
+} // namespace json
+} // namespace core
+
+#endif // CORE_JSON_CBOR_HPP
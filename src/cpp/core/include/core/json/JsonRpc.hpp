@@ -70,6 +70,7 @@ struct is_error_code_enum<core::json::errc::errc_t>
 
 
 #include <string>
+#include <vector>
 
 #include <boost/bind.hpp>
 #include <boost/function.hpp>
@@ -83,6 +84,9 @@ namespace core {
 namespace http {
    class Response ;
 }
+namespace json {
+   class Writer ;
+}
 }
 
 namespace core {
@@ -144,7 +148,14 @@ struct JsonRpcRequest
 // 
 // json request parsing
 //
-Error parseJsonRpcRequest(const std::string& input, JsonRpcRequest* pRequest) ;
+Error parseJsonRpcRequest(const std::string& input,
+                          JsonRpcRequest* pRequest,
+                          Encoding encoding = JsonEncoding);
+
+// batches are sent as a (json-rpc 2.0 style) array of request objects
+Error parseJsonRpcBatchRequest(const std::string& input,
+                               std::vector<JsonRpcRequest>* pRequests,
+                               Encoding encoding = JsonEncoding);
 
 bool parseJsonRpcRequestForMethod(const std::string& input, 
                                   const std::string& method,
@@ -906,9 +917,21 @@ public:
    template <typename T>
    void setResult(const T& result)
    {
+      resultWriter_.clear();
       setField(kRpcResult, result);
    }
 
+   // provide a function which streams the result directly into the
+   // response (avoids building a json::Value for large results). note
+   // that it is called when the response is written (rather than now)
+   // so should hold its own copy of any data it needs
+   typedef boost::function<void(json::Writer&)> ResultWriter;
+   void setResultWriter(const ResultWriter& resultWriter)
+   {
+      response_[kRpcResult] = json::Value();
+      resultWriter_ = resultWriter;
+   }
+
    json::Value& result()
    {
       return response_[kRpcResult];
@@ -936,6 +959,7 @@ public:
    // low level hook to set the full response
    void setResponse(const json::Object& response)
    {
+      resultWriter_.clear();
       response_ = response;
    }
    
@@ -952,20 +976,28 @@ public:
 
    json::Object getRawResponse();
    
-   void write(std::ostream& os) const;
+   void write(std::ostream& os, Encoding encoding = JsonEncoding) const;
    
 private:
    json::Object response_;
+   ResultWriter resultWriter_;
    boost::function<void()> afterResponse_ ;
    bool suppressDetectChanges_;
 };
    
    
-// convenience functions for sending json-rpc responses
+// convenience functions for sending json-rpc responses (cbor encoded
+// responses are only sent to clients which have asked for them)
    
 void setJsonRpcResponse(const JsonRpcResponse& jsonRpcResponse,
-                        http::Response* pResponse); 
+                        http::Response* pResponse,
+                        Encoding encoding = JsonEncoding);
+
 
+// batch responses are an array of responses (in the order of the requests)
+void setJsonRpcBatchResponse(const std::vector<JsonRpcResponse>& responses,
+                             http::Response* pResponse,
+                             Encoding encoding = JsonEncoding);
 
 inline void setVoidJsonRpcResult(http::Response* pResponse)
 {
@@ -0,0 +1,98 @@
+/*
+ * JsonWriter.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_JSON_WRITER_HPP
+#define CORE_JSON_WRITER_HPP
+
+#include <string>
+#include <vector>
+#include <iosfwd>
+
+#include <boost/cstdint.hpp>
+#include <boost/utility.hpp>
+
+#include <core/json/Json.hpp>
+
+namespace core {
+namespace json {
+
+// Writer which serializes json directly to an output stream as it is
+// generated (rather than first building a json::Value tree). Output is
+// compatible with json::write (or with json::writeCbor for CborEncoding,
+// in which case containers are written with indefinite lengths). Callers
+// are responsible for balancing their start/end calls and for providing a
+// key for each object member.
+class Writer : boost::noncopyable
+{
+public:
+   explicit Writer(std::ostream& os, Encoding encoding = JsonEncoding);
+
+   // COPYING: boost::noncopyable
+
+public:
+   Writer& startObject();
+   Writer& endObject();
+
+   Writer& startArray();
+   Writer& endArray();
+
+   // name of the next object member
+   Writer& key(const std::string& name);
+
+   Writer& value(const std::string& value);
+   Writer& value(const char* value);
+   Writer& value(int value);
+   Writer& value(boost::int64_t value);
+   Writer& value(boost::uint64_t value);
+   Writer& value(double value);
+   Writer& value(bool value);
+   Writer& value(const json::Value& value);
+   Writer& nullValue();
+
+   // convenience for writing a member
+   template <typename T>
+   Writer& member(const std::string& name, const T& val)
+   {
+      key(name);
+      return value(val);
+   }
+
+   // convenience for writing an array of values
+   template <typename InputIterator>
+   Writer& array(InputIterator begin, InputIterator end)
+   {
+      startArray();
+      for (; begin != end; ++begin)
+         value(*begin);
+      return endArray();
+   }
+
+private:
+   void beginValue();
+   void writeString(const std::string& str);
+
+private:
+   std::ostream& os_;
+   Encoding encoding_;
+   // one entry per open container recording whether it has any
+   // elements yet (so we know when a separator is required)
+   std::vector<bool> hasElements_;
+   bool pendingKey_;
+};
+
+} // namespace json
+} // namespace core
+
+#endif // CORE_JSON_WRITER_HPP
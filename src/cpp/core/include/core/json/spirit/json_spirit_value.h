@@ -68,8 +68,9 @@ namespace json_spirit
         boost::uint64_t    get_uint64() const;
         double             get_real()   const;
 
-        Object& get_obj();
-        Array&  get_array();
+        String_type& get_str();
+        Object&      get_obj();
+        Array&       get_array();
 
         template< typename T > T get_value() const;  // example usage: int    i = value.get_value< int >();
                                                      // or             double d = value.get_value< double >();
@@ -297,11 +298,11 @@ namespace json_spirit
     template< class Config >
     Value_impl< Config >& Value_impl< Config >::operator=( const Value_impl& lhs )
     {
-        Value_impl tmp( lhs );
-
-        std::swap( type_, tmp.type_ );
-        std::swap( v_, tmp.v_ );
-        std::swap( is_uint64_, tmp.is_uint64_ );
+        // assign the variant directly (std::swap of variants copies the
+        // contents of both several times)
+        v_ = lhs.v_;
+        type_ = lhs.type_;
+        is_uint64_ = lhs.is_uint64_;
 
         return *this;
     }
@@ -417,6 +418,14 @@ namespace json_spirit
         return boost::get< double >( v_ );
     }
 
+    template< class Config >
+    typename Config::String_type& Value_impl< Config >::get_str()
+    {
+        check_type(  str_type );
+
+        return *boost::get< String_type >( &v_ );
+    }
+
     template< class Config >
     typename Value_impl< Config >::Object& Value_impl< Config >::get_obj()
     {
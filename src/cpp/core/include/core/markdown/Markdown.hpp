@@ -17,6 +17,10 @@
 #define CORE_MARKDOWN_MARKDOWN_HPP
 
 #include <string>
+#include <map>
+
+#include <boost/utility.hpp>
+#include <boost/cstdint.hpp>
 
 namespace core {
 
@@ -80,6 +84,20 @@ struct HTMLOptions
    bool escape;
 };
 
+// what the rendered HTML needs to display correctly (detected while
+// rendering so that callers needn't rescan the output)
+struct RenderInfo
+{
+   RenderInfo()
+      : requiresMathjax(false),
+        requiresHighlighting(false)
+   {
+   }
+
+   bool requiresMathjax;
+   bool requiresHighlighting;   // r or cpp code blocks
+};
+
 // render markdown to HTML -- assumes UTF-8 encoding
 Error markdownToHTML(const FilePath& markdownFile,
                      const Extensions& extensions,
@@ -98,6 +116,44 @@ Error markdownToHTML(const std::string& markdownInput,
                      const HTMLOptions& htmlOptions,
                      std::string* pHTMLOutput);
 
+// render markdown to HTML -- assumes UTF-8 encoding
+Error markdownToHTML(const std::string& markdownInput,
+                     const Extensions& extensions,
+                     const HTMLOptions& htmlOptions,
+                     std::string* pHTMLOutput,
+                     RenderInfo* pRenderInfo);
+
+// renders successive versions of a document, re-rendering only what changed.
+// the document is split into sections at top level (atx) headers and the
+// html for each section is cached by a hash of its source. documents whose
+// sections can't be rendered independently (reference links, html blocks,
+// table of contents) are always rendered in full
+class IncrementalRenderer : boost::noncopyable
+{
+public:
+   IncrementalRenderer(const Extensions& extensions,
+                       const HTMLOptions& htmlOptions)
+      : extensions_(extensions), htmlOptions_(htmlOptions)
+   {
+   }
+   // COPYING: boost::noncopyable
+
+   // render markdown to HTML -- assumes UTF-8 encoding
+   Error render(const std::string& markdownInput,
+                std::string* pHTMLOutput,
+                RenderInfo* pRenderInfo);
+
+private:
+   struct Section
+   {
+      std::string html;
+      RenderInfo renderInfo;
+   };
+
+   Extensions extensions_;
+   HTMLOptions htmlOptions_;
+   std::map<boost::uint64_t, Section> sections_;
+};
 
 bool isMathJaxRequired(const std::string& htmlOutput);
 
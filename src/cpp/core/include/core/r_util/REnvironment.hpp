@@ -35,6 +35,16 @@ bool detectREnvironment(const FilePath& whichRScript,
                         EnvironmentVars* pVars,
                         std::string* pErrMsg);
 
+// variant which caches the detected R locations in the specified file
+// (detection is skipped when the R and ldpaths scripts are unchanged)
+bool detectREnvironment(const FilePath& whichRScript,
+                        const FilePath& ldPathsScript,
+                        const std::string& ldLibraryPath,
+                        const FilePath& cacheFile,
+                        std::string* pRScriptPath,
+                        EnvironmentVars* pVars,
+                        std::string* pErrMsg);
+
 void setREnvironmentVars(const EnvironmentVars& vars);
 
 } // namespace r_util
@@ -45,6 +45,7 @@ public:
 
    const std::string& name() const { return name_; }
    const std::string& version() const { return version_; }
+   const std::string& title() const { return title_; }
    const std::string& linkingTo() const { return linkingTo_; }
 
    std::string sourcePackageFilename() const;
@@ -55,6 +56,7 @@ private:
 private:
    std::string name_;
    std::string version_;
+   std::string title_;
    std::string linkingTo_;
 };
 
@@ -0,0 +1,73 @@
+/*
+ * RRepositoryIndex.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_R_UTIL_R_REPOSITORY_INDEX_HPP
+#define CORE_R_UTIL_R_REPOSITORY_INDEX_HPP
+
+#include <string>
+#include <vector>
+
+namespace core {
+
+class Error;
+class FilePath;
+
+namespace r_util {
+
+// Index of the packages available from a repository (the fields which
+// available.packages reports, parsed from the PACKAGES file under the
+// repository's contrib url). Indexes are shared between sessions on a host
+// in a compact binary format so that each session needn't download and
+// parse the (multi megabyte) PACKAGES file itself.
+class RRepositoryIndex
+{
+public:
+   RRepositoryIndex() {}
+
+   // COPYING: via compiler
+
+   // parse the contents of a PACKAGES file
+   Error parse(const std::string& packagesFile);
+
+   Error readFromFile(const FilePath& indexFile);
+
+   // (written to a temporary file which is then renamed into place so
+   // that readers never see a partially written index)
+   Error writeToFile(const FilePath& indexFile) const;
+
+   // the indexed fields (Package is always the first)
+   const std::vector<std::string>& fields() const { return fields_; }
+
+   // values of the fields for each package (empty if not specified)
+   const std::vector<std::vector<std::string> >& packages() const
+   {
+      return packages_;
+   }
+
+   bool empty() const { return packages_.empty(); }
+
+private:
+   std::vector<std::string> fields_;
+   std::vector<std::vector<std::string> > packages_;
+};
+
+// name of the index file for a contrib url within a shared index directory
+std::string repositoryIndexFilename(const std::string& contribUrl);
+
+} // namespace r_util
+} // namespace core
+
+
+#endif // CORE_R_UTIL_R_REPOSITORY_INDEX_HPP
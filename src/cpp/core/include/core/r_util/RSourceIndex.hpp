@@ -159,6 +159,17 @@ public:
                          column_);
    }
 
+   RSourceItem withPosition(std::size_t line, std::size_t column) const
+   {
+      return RSourceItem(context_,
+                         type_,
+                         name_,
+                         signature_,
+                         braceLevel_,
+                         line,
+                         column);
+   }
+
 private:
    std::string context_;
    int type_;
@@ -183,8 +194,26 @@ public:
    RSourceIndex(const std::string& context,
                 const std::string& code);
 
+   // Index new code for a document, re-indexing only the lines around
+   // those which have changed since the previous index of it
+   RSourceIndex(const std::string& context,
+                const std::string& code,
+                const RSourceIndex& previous);
+
+   // Create an index from previously indexed items (e.g. read from a cache)
+   RSourceIndex(const std::string& context,
+                const std::vector<RSourceItem>& items)
+      : context_(context), items_(items)
+   {
+   }
+
    const std::string& context() const { return context_; }
 
+   const std::vector<RSourceItem>& items() const { return items_; }
+
+   // approximate bytes held by the index (for memory accounting)
+   std::size_t memoryUsage() const;
+
    template <typename OutputIterator>
    OutputIterator search(
                   const std::string& newContext,
@@ -259,6 +288,11 @@ public:
 private:
    std::string context_;
    std::vector<RSourceItem> items_;
+
+   // code and the lines at which indexing of it can be resumed (only
+   // available when indexed from code)
+   std::string code_;
+   std::vector<std::size_t> checkpoints_;
 };
 
 
@@ -0,0 +1,78 @@
+/*
+ * RSourceIndexCache.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_R_UTIL_R_SOURCE_INDEX_CACHE_HPP
+#define CORE_R_UTIL_R_SOURCE_INDEX_CACHE_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include <boost/utility.hpp>
+
+#include <core/FileInfo.hpp>
+
+#include <core/r_util/RSourceIndex.hpp>
+
+namespace core {
+
+class Error;
+class FilePath;
+
+namespace r_util {
+
+// Cache of the items indexed from a set of source files, persisted in a
+// compact binary format. Entries are keyed by path and are only considered
+// valid if the size and last write time of the file are unchanged.
+class RSourceIndexCache : boost::noncopyable
+{
+public:
+   RSourceIndexCache() {}
+
+   // COPYING: boost::noncopyable
+
+   Error readFromFile(const FilePath& cacheFile);
+   Error writeToFile(const FilePath& cacheFile) const;
+
+   void add(const FileInfo& fileInfo, const std::vector<RSourceItem>& items);
+
+   // find the items for a file (returns false if there is no entry for
+   // the file or if the file has changed since it was indexed)
+   bool find(const FileInfo& fileInfo, std::vector<RSourceItem>* pItems) const;
+
+   void remove(const std::string& path) { entries_.erase(path); }
+
+   void clear() { entries_.clear(); }
+
+   bool empty() const { return entries_.empty(); }
+
+private:
+   struct Entry
+   {
+      Entry() : size(0), lastWriteTime(0) {}
+
+      uintmax_t size;
+      std::time_t lastWriteTime;
+      std::vector<RSourceItem> items;
+   };
+
+   std::map<std::string,Entry> entries_;
+};
+
+} // namespace r_util
+} // namespace core
+
+
+#endif // CORE_R_UTIL_R_SOURCE_INDEX_CACHE_HPP
@@ -0,0 +1,95 @@
+/*
+ * RSourceSymbolIndex.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_R_UTIL_R_SOURCE_SYMBOL_INDEX_HPP
+#define CORE_R_UTIL_R_SOURCE_SYMBOL_INDEX_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/utility.hpp>
+
+#include <core/r_util/RSourceIndex.hpp>
+
+namespace core {
+namespace r_util {
+
+// Index of the items within a set of RSourceIndex objects (e.g. all of the
+// R source files in a project), keyed by lower-cased item name. Prefix and
+// exact name lookups are done with a range lookup rather than by scanning
+// every item of every index. Indexes are added and removed individually
+// (by context) so the symbol index can be kept up to date incrementally
+// as files change.
+class RSourceSymbolIndex : boost::noncopyable
+{
+public:
+   RSourceSymbolIndex() {}
+
+   // add (or replace) the index for a context
+   void add(boost::shared_ptr<RSourceIndex> pIndex);
+
+   // remove the index for a context
+   void remove(const std::string& context);
+
+   void clear();
+
+   bool empty() const { return indexes_.empty(); }
+
+   // search for items whose name matches the term (which may include
+   // wildcards). items from the exclude contexts are not returned and
+   // no more than maxResults items are returned. results are in name order.
+   void search(const std::string& term,
+               bool prefixOnly,
+               bool caseSensitive,
+               std::size_t maxResults,
+               const std::set<std::string>& excludeContexts,
+               std::vector<RSourceItem>* pItems) const;
+
+   // find a global function (or S4 method) with the specified name
+   bool findGlobalFunction(const std::string& name,
+                           const std::set<std::string>& excludeContexts,
+                           RSourceItem* pItem) const;
+
+private:
+   struct ItemRef
+   {
+      ItemRef(const RSourceIndex* pIndex, std::size_t item)
+         : pIndex(pIndex), item(item)
+      {
+      }
+
+      const RSourceItem& sourceItem() const { return pIndex->items()[item]; }
+
+      const RSourceIndex* pIndex;
+      std::size_t item;
+   };
+
+   typedef std::multimap<std::string,ItemRef> Symbols;
+
+   typedef std::map<std::string,boost::shared_ptr<RSourceIndex> > Indexes;
+
+private:
+   Indexes indexes_;
+   Symbols symbols_;
+};
+
+} // namespace r_util
+} // namespace core
+
+
+#endif // CORE_R_UTIL_R_SOURCE_SYMBOL_INDEX_HPP
@@ -17,12 +17,11 @@
 #define CORE_R_UTIL_R_TOKENIZER_HPP
 
 #include <string>
-#include <deque>
+#include <vector>
 #include <algorithm>
 
 #include <boost/utility.hpp>
 #include <boost/shared_ptr.hpp>
-#include <boost/regex_fwd.hpp>
 
 // On Linux confirm that wchar_t is Unicode
 #if !defined(_WIN32) && !defined(__APPLE__) && !defined(__STDC_ISO_10646__)
@@ -35,21 +34,12 @@ class Error;
 
 namespace r_util {
 
-// Make RToken non-subclassable (since it has copy/byval semantics any
-// subclass would be sliced
-class RToken_lock
-{
-   friend class RToken ;
-private:
-   RToken_lock() {}
-   RToken_lock(const RToken_lock&) {}
-};
-
 // RToken. Note that RToken instances are only valid as long as the class
 // which yielded them (RTokenizer or RTokens) is alive. This is because
 // they contain iterators into the original source data rather than their
-// own copy of their contents.
-class RToken : public virtual RToken_lock
+// own copy of their contents. RToken has copy/byval semantics so it
+// shouldn't be subclassed (any subclass would be sliced).
+class RToken
 {
 public:
 
@@ -168,8 +158,7 @@ private:
    wchar_t peek();
    wchar_t peek(std::size_t lookahead);
    wchar_t eat();
-   std::wstring peek(const boost::wregex& regex);
-   void eatUntil(const boost::wregex& regex);
+   std::size_t lengthToDelimiter(wchar_t delim);
    RToken consumeToken(wchar_t tokenType, std::size_t length);
 
 private:
@@ -181,7 +170,7 @@ private:
 // Set of RTokens. Note that the RTokens returned from the set
 // are conceptually iterators so are only valid for the lifetime of
 // the RTokens object which yielded them.
-class RTokens : public std::deque<RToken>, boost::noncopyable
+class RTokens : public std::vector<RToken>, boost::noncopyable
 {
 public:
    enum Flags
@@ -195,6 +184,9 @@ public:
    explicit RTokens(const std::wstring& code, int flags = None)
       : tokenizer_(code)
    {
+      // most tokens are at least a couple of characters long
+      reserve(code.length() / 2);
+
       RToken token;
       while ((token = tokenizer_.nextToken()))
       {
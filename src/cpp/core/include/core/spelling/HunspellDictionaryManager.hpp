@@ -90,6 +90,10 @@ public:
 
    const HunspellCustomDictionaries& custom() const;
 
+   // location of the precompiled (memory-mappable) copy of a dictionary
+   core::FilePath precompiledDicPath(
+                              const HunspellDictionary& dictionary) const;
+
 private:
    core::FilePath allLanguagesDir() const;
    core::FilePath userLanguagesDir() const;
@@ -34,6 +34,10 @@ core::Error HMAC_SHA1(const std::string& data,
 core::Error HMAC_SHA1(const std::string& data, 
                       const std::vector<unsigned char>& key,
                       std::vector<unsigned char>* pHMAC);   
+
+core::Error HMAC_SHA256(const std::string& data,
+                        const std::string& key,
+                        std::vector<unsigned char>* pHMAC);
    
 core::Error base64Encode(const std::vector<unsigned char>& data, 
                          std::string* pEncoded);   
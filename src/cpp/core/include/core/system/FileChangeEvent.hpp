@@ -23,10 +23,15 @@
 #include <boost/function.hpp>
 
 #include <core/FileInfo.hpp>
+#include <core/collection/Tree.hpp>
 
 namespace core {
 
 class Error;
+
+namespace thread {
+   class ThreadPool;
+}
    
 namespace system {
 
@@ -170,6 +175,20 @@ void collectFileChangeEvents(PreviousIterator prevBegin,
                            boost::function<bool(const FileInfo&)>(),
                            pEvents);
 }
+
+// collect the changes between two scans of the same directory tree. the
+// trees are diffed a top level subtree at a time (subtrees which are
+// unchanged are detected with a linear pass and skip the sort) and if a
+// thread pool is provided large trees are diffed in parallel on it. the
+// calling thread takes part in the diff so it's safe to call this from
+// one of the pool's threads (or while the pool is being stopped). the
+// events for each subtree are in path order. note that the filter (if
+// provided) is called on the pool's threads
+void collectFileChangeEvents(const tree<FileInfo>& prevTree,
+                             const tree<FileInfo>& currTree,
+                             const boost::function<bool(const FileInfo&)>& filter,
+                             core::thread::ThreadPool* pThreadPool,
+                             std::vector<FileChangeEvent>* pEvents);
   
 } // namespace system
 } // namespace core 
@@ -38,9 +38,28 @@ namespace core {
 namespace system {
 namespace file_monitor {
 
+// file monitoring backends. the fanotify backend (linux only) marks the
+// whole filesystem containing a monitored directory rather than adding a
+// watch for every directory (so it isn't subject to max_user_watches and
+// registration doesn't need to add watches). it requires CAP_SYS_ADMIN and
+// linux 5.9 or later, monitors fall back to the default backend if it
+// can't be initialized
+enum Backend
+{
+   DefaultBackend,
+   FanotifyBackend
+};
+
 // initialize the file monitoring service (creates a background thread
-// which performs the monitoring)
-void initialize();
+// which performs the monitoring). the optional onCallbacksPending handler
+// is called on the monitoring thread whenever callbacks are queued for
+// checkForChanges (e.g. to wake up the thread which calls it). if a thread
+// pool is provided then the changes found by rescans of large subtrees are
+// collected in parallel on it
+void initialize(const boost::function<void()>& onCallbacksPending =
+                                                boost::function<void()>(),
+                Backend backend = DefaultBackend,
+                core::thread::ThreadPool* pThreadPool = NULL);
 
 // stop the file monitoring service (automatically unregisters all
 // active file monitoring handles)
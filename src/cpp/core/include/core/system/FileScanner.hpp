@@ -38,12 +38,20 @@ namespace system {
 struct FileScannerOptions
 {
    FileScannerOptions()
-      : recursive(false), yield(false)
+      : recursive(false), yield(false), threads(1)
    {
    }
 
    bool recursive;
    bool yield;
+
+   // number of threads to use for recursive scans (directories are read
+   // in parallel, which helps a lot on high latency filesystems like NFS).
+   // filter and onBeforeScanDir are never called concurrently so they
+   // needn't be thread safe (they are however called on the scanning
+   // threads). currently only supported on posix
+   int threads;
+
    boost::function<bool(const FileInfo&)> filter;
    boost::function<Error(const FileInfo&)> onBeforeScanDir;
 };
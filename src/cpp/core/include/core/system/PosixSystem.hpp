@@ -90,6 +90,11 @@ struct ProcessConfig
    RLimitType memoryLimitBytes;
    RLimitType stackLimitBytes;
    RLimitType userProcessesLimit;
+
+   // cgroup (v2) to create and move the child into (requires root), along
+   // with interface files to write within it (e.g. "memory.max", "1G")
+   std::string cgroupPath;
+   core::system::Options cgroupSettings;
 };
 
 core::Error waitForProcessExit(PidType processId);
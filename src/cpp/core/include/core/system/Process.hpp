@@ -222,6 +222,12 @@ struct ProcessCallbacks
    // is terminated.
    boost::function<bool(ProcessOperations&)> onContinue;
 
+   // Called at each poll (after onContinue) to check whether the consumer
+   // is ready for more output. If it returns false then output is left
+   // unread (so the child blocks once the pipe fills) and the child's exit
+   // isn't reported (so that it always follows the child's output)
+   boost::function<bool(ProcessOperations&)> onReadyForOutput;
+
    // Streaming callback for standard output
    boost::function<void(ProcessOperations&, const std::string&)> onStdout;
 
@@ -300,6 +306,13 @@ public:
             const boost::function<void(const ProcessResult&)>& onCompleted);
 
 
+   // Watch the output pipes of children on a background thread so that
+   // poll only needs to service children with pending output (or exits).
+   // The onOutput callback is invoked on the watcher thread whenever output
+   // arrives and should simply wake the thread that calls poll (which can
+   // then poll immediately rather than waiting out its polling interval).
+   Error watchOutput(const boost::function<void()>& onOutput);
+
    // Check whether any children are currently active
    bool hasRunningChildren();
 
@@ -317,6 +330,9 @@ public:
       const boost::posix_time::time_duration& maxWait =
          boost::posix_time::time_duration(boost::posix_time::not_a_date_time));
 
+private:
+   void pollWatchedChildren();
+
 private:
    struct Impl;
    boost::scoped_ptr<Impl> pImpl_;
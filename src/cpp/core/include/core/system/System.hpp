@@ -254,6 +254,20 @@ void fixupExecutablePath(FilePath* pExePath);
 void abort();
 
 Error terminateProcess(PidType pid);
+
+// memory held by the allocator (in use and free but not yet returned to
+// the operating system). zero where the allocator doesn't report it
+struct HeapStatistics
+{
+   HeapStatistics() : inUse(0), free(0) {}
+   uintmax_t inUse;
+   uintmax_t free;
+};
+HeapStatistics heapStatistics();
+
+// return free heap memory to the operating system (where the allocator
+// supports doing so)
+void releaseFreeHeap();
    
 } // namespace system
 } // namespace core 
@@ -19,6 +19,10 @@
 #include <string>
 #include <vector>
 
+#include <boost/utility.hpp>
+#include <boost/function.hpp>
+#include <boost/scoped_ptr.hpp>
+
 #include <core/FilePath.hpp>
 
 namespace core {
@@ -74,6 +78,31 @@ private:
 
 typedef std::vector<LogEntry> LogEntries;
 
+// Incremental parser for LaTeX logs. Log text (or the terminal output of a
+// running compile, which mirrors the log) can be passed in chunks of any
+// size as it becomes available, and each entry is passed to the handler as
+// soon as it is complete. Only the line currently being parsed is retained
+// so memory use doesn't grow with the size of the log.
+class LatexLogParser : boost::noncopyable
+{
+public:
+   typedef boost::function<void(const LogEntry&)> Handler;
+
+   LatexLogParser(const FilePath& logFilePath, const Handler& onLogEntry);
+   virtual ~LatexLogParser();
+   // COPYING: prohibited
+
+public:
+   void parse(const std::string& output);
+
+   // call once all output has been parsed (flushes the last line)
+   void finish();
+
+private:
+   struct Impl;
+   boost::scoped_ptr<Impl> pImpl_;
+};
+
 Error parseLatexLog(const FilePath& logFilePath, LogEntries* pLogEntries);
 
 Error parseBibtexLog(const FilePath& logFilePath, LogEntries* pLogEntries);
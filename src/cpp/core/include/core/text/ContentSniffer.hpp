@@ -0,0 +1,43 @@
+/*
+ * ContentSniffer.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_TEXT_CONTENT_SNIFFER_HPP
+#define CORE_TEXT_CONTENT_SNIFFER_HPP
+
+namespace core {
+
+class Error;
+class FilePath;
+
+namespace text {
+
+// Classification of files as text or binary from their leading bytes (an
+// in-process approximation of `file --mime-type`). Binary formats are
+// recognized by their magic numbers and otherwise content is considered
+// text unless it has control characters that text doesn't (8-bit encodings
+// such as latin1 are text as far as `file` is concerned so bytes >= 0x80
+// don't count against it).
+
+// does content (which may be just the start of a file) look like text?
+bool looksLikeText(const char* begin, const char* end);
+
+// does the file look like text? only the start of the file is read and
+// results are cached by path, modification time and size
+Error isTextFile(const FilePath& filePath, bool* pIsText);
+
+} // namespace text
+} // namespace core
+
+#endif // CORE_TEXT_CONTENT_SNIFFER_HPP
@@ -0,0 +1,101 @@
+/*
+ * CsvReader.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_TEXT_CSV_READER_HPP
+#define CORE_TEXT_CSV_READER_HPP
+
+#include <string>
+#include <vector>
+
+#include <boost/utility.hpp>
+#include <boost/scoped_ptr.hpp>
+
+namespace core {
+
+class Error;
+class FilePath;
+
+namespace text {
+
+// a field within the reader's mapped file. fields which contain quotes
+// are left as is (csvFieldValue removes the quoting)
+struct CsvField
+{
+   CsvField() : begin(NULL), length(0), quoted(false) {}
+   CsvField(const char* begin, std::size_t length, bool quoted)
+      : begin(begin), length(length), quoted(quoted)
+   {
+   }
+   const char* begin;
+   std::size_t length;
+   bool quoted;
+};
+
+enum CsvColumnType
+{
+   kCsvLogical,
+   kCsvInteger,
+   kCsvDouble,
+   kCsvString
+};
+
+// field conversions (empty and "NA" unquoted fields are missing values)
+std::string csvFieldValue(const CsvField& field);
+bool isCsvMissing(const CsvField& field);
+bool csvFieldAsLogical(const CsvField& field, bool* pValue);
+bool csvFieldAsInteger(const CsvField& field, int* pValue);
+bool csvFieldAsDouble(const CsvField& field, double* pValue);
+
+// Reads RFC4180 delimited data from a memory mapped file (as with
+// parseCsvLine a quote anywhere in a field starts or ends quoting, and
+// blank lines are skipped). Large files are split at record boundaries
+// and the pieces are parsed in parallel. Fields refer directly into the
+// mapped file so they are only valid for the lifetime of the reader.
+class CsvReader : boost::noncopyable
+{
+public:
+   explicit CsvReader(char delimiter = ',');
+   virtual ~CsvReader();
+   // COPYING: boost::noncopyable
+
+public:
+   Error open(const FilePath& filePath);
+
+   // read up to maxRows records (all of them if maxRows is 0). reading a
+   // limited number of rows only touches the start of the file
+   Error read(std::size_t maxRows = 0);
+
+   std::size_t rowCount() const;
+   std::size_t fieldCount(std::size_t row) const;
+   std::size_t maxFieldCount() const;
+
+   // fields beyond the end of a short row are empty
+   CsvField field(std::size_t row, std::size_t column) const;
+
+   // infer the type of a column from its first sampleRows rows (starting
+   // at firstRow, e.g. to skip a header)
+   CsvColumnType inferColumnType(std::size_t column,
+                                 std::size_t firstRow,
+                                 std::size_t sampleRows) const;
+
+private:
+   struct Impl;
+   boost::scoped_ptr<Impl> pImpl_;
+};
+
+} // namespace text
+} // namespace core
+
+#endif // CORE_TEXT_CSV_READER_HPP
@@ -0,0 +1,96 @@
+/*
+ * TrigramIndex.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_TEXT_TRIGRAM_INDEX_HPP
+#define CORE_TEXT_TRIGRAM_INDEX_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include <boost/cstdint.hpp>
+#include <boost/utility.hpp>
+#include <boost/unordered_map.hpp>
+
+namespace core {
+namespace text {
+
+// index of the (case folded) three byte sequences which appear in a set of
+// documents. used to narrow the set of documents which could possibly
+// contain a given literal string. note that candidates are a superset of
+// the documents which actually match (the caller must still search them)
+class TrigramIndex : boost::noncopyable
+{
+public:
+   TrigramIndex() : removedCount_(0) {}
+
+   // COPYING: prohibited
+
+   // add (or replace) a document using the specified contents
+   void add(const std::string& document, const char* begin, const char* end);
+
+   // add (or replace) a document whose contents weren't indexed (e.g.
+   // because they're too large). such documents are always candidates
+   void addUnindexed(const std::string& document);
+
+   // remove a document
+   void remove(const std::string& document);
+
+   // remove all documents whose names begin with prefix
+   void removePrefix(const std::string& prefix);
+
+   void clear();
+
+   bool empty() const { return documents_.empty(); }
+   std::size_t size() const { return documents_.size(); }
+
+   // find candidate documents which could contain all of the specified
+   // literals. returns false if the literals are too short to be used
+   // with the index (in which case all documents are candidates)
+   bool candidates(const std::vector<std::string>& literals,
+                   std::vector<std::string>* pDocuments) const;
+
+   // extract literal strings which must appear in any text matched by the
+   // specified (basic syntax) regular expression. if none can be reliably
+   // determined then no literals are returned
+   static std::vector<std::string> requiredLiterals(const std::string& regex);
+
+private:
+   typedef boost::uint32_t Trigram;
+   typedef boost::uint32_t DocumentId;
+
+   struct Document
+   {
+      Document() : removed(false) {}
+      std::string name;
+      bool removed;
+   };
+
+   DocumentId addDocument(const std::string& document);
+   void removeDocument(DocumentId id);
+   void compact();
+
+private:
+   std::map<std::string,DocumentId> documents_;
+   std::vector<Document> documentTable_;
+   std::vector<DocumentId> unindexed_;
+   boost::unordered_map<Trigram, std::vector<DocumentId> > postings_;
+   std::size_t removedCount_;
+};
+
+} // namespace text
+} // namespace core
+
+#endif // CORE_TEXT_TRIGRAM_INDEX_HPP
@@ -15,14 +15,17 @@
 
 #include <core/json/Json.hpp>
 
+#include <cctype>
 #include <cstdlib>
+#include <limits>
+#include <locale>
 #include <sstream>
 
 #include <boost/format.hpp>
+#include <boost/cstdint.hpp>
 #include <boost/scoped_array.hpp>
 
 #include <core/Log.hpp>
-#include <core/Thread.hpp>
 
 #include "spirit/json_spirit.h"
 
@@ -42,24 +45,454 @@ json::Value toJsonString(const std::string& val)
    return json::Value(val);
 }
 
+namespace {
+
+// deepest nesting of objects and arrays we'll accept (guards the stack)
+const int kMaxParseDepth = 512;
+
+// single pass recursive descent parser. values are constructed in place
+// within their parent containers and strings are copied out of the input
+// in a single operation whenever they contain no escapes. lenient in the
+// same ways as the json_spirit reader it replaces (leading '+' on numbers,
+// \x escapes, control characters within strings, content following the
+// top level value is ignored)
+class Parser
+{
+public:
+   explicit Parser(const std::string& input)
+      : pos_(input.data()), end_(input.data() + input.size()), depth_(0)
+   {
+   }
+
+   bool parse(Value* pValue)
+   {
+      skipWhitespace();
+      return parseValue(pValue);
+   }
+
+private:
+   bool parseValue(Value* pValue)
+   {
+      if (pos_ == end_)
+         return false;
+
+      switch (*pos_)
+      {
+         case '{':
+            return parseObject(pValue);
+         case '[':
+            return parseArray(pValue);
+         case '"':
+            *pValue = Value(std::string());
+            return parseString(&(pValue->get_str()));
+         case 't':
+            *pValue = Value(true);
+            return parseLiteral("true");
+         case 'f':
+            *pValue = Value(false);
+            return parseLiteral("false");
+         case 'n':
+            *pValue = Value();
+            return parseLiteral("null");
+         default:
+            return parseNumber(pValue);
+      }
+   }
+
+   bool parseObject(Value* pValue)
+   {
+      if (++depth_ > kMaxParseDepth)
+         return false;
+
+      *pValue = Value(Object());
+      Object& object = pValue->get_obj();
+
+      ++pos_;
+      skipWhitespace();
+      if (pos_ != end_ && *pos_ == '}')
+      {
+         ++pos_;
+         --depth_;
+         return true;
+      }
+
+      std::string name;
+      while (true)
+      {
+         if (pos_ == end_ || *pos_ != '"')
+            return false;
+         if (!parseString(&name))
+            return false;
+
+         skipWhitespace();
+         if (pos_ == end_ || *pos_ != ':')
+            return false;
+         ++pos_;
+         skipWhitespace();
+
+         // later duplicates replace earlier ones
+         Value& member = object[name];
+         if (!parseValue(&member))
+            return false;
+
+         skipWhitespace();
+         if (pos_ == end_)
+            return false;
+         else if (*pos_ == ',')
+         {
+            ++pos_;
+            skipWhitespace();
+         }
+         else if (*pos_ == '}')
+         {
+            ++pos_;
+            break;
+         }
+         else
+            return false;
+      }
+
+      --depth_;
+      return true;
+   }
+
+   bool parseArray(Value* pValue)
+   {
+      if (++depth_ > kMaxParseDepth)
+         return false;
+
+      *pValue = Value(Array());
+      Array& array = pValue->get_array();
+
+      ++pos_;
+      skipWhitespace();
+      if (pos_ != end_ && *pos_ == ']')
+      {
+         ++pos_;
+         --depth_;
+         return true;
+      }
+
+      // reserve up front so that elements (which may be large subtrees)
+      // aren't copied as the array grows
+      array.reserve(countElements());
+
+      while (true)
+      {
+         array.push_back(Value());
+         if (!parseValue(&array.back()))
+            return false;
+
+         skipWhitespace();
+         if (pos_ == end_)
+            return false;
+         else if (*pos_ == ',')
+         {
+            ++pos_;
+            skipWhitespace();
+         }
+         else if (*pos_ == ']')
+         {
+            ++pos_;
+            break;
+         }
+         else
+            return false;
+      }
+
+      --depth_;
+      return true;
+   }
+
+   // count the elements of the array at pos_ (a quick scan which only
+   // needs to track nesting and strings)
+   std::size_t countElements() const
+   {
+      std::size_t count = 1;
+      int depth = 0;
+      for (const char* p = pos_; p < end_; ++p)
+      {
+         switch (*p)
+         {
+            case '"':
+               // skip the string (and any escapes within it)
+               for (p = scanString(p + 1);
+                    p < end_ && *p == '\\';
+                    p = scanString(p + 2))
+               {
+               }
+               break;
+            case '[':
+            case '{':
+               ++depth;
+               break;
+            case ']':
+            case '}':
+               if (depth-- == 0)
+                  return count;
+               break;
+            case ',':
+               if (depth == 0)
+                  ++count;
+               break;
+         }
+      }
+      return count;
+   }
+
+   bool parseString(std::string* pStr)
+   {
+      // skip opening quote
+      ++pos_;
+
+      pStr->clear();
+      while (true)
+      {
+         // copy the run of characters up to the next quote or escape
+         const char* runEnd = scanString(pos_);
+         if (runEnd == end_)
+            return false; // unterminated string
+
+         pStr->append(pos_, runEnd);
+         pos_ = runEnd + 1;
+
+         if (*runEnd == '"')
+            return true;
+         else if (!parseEscape(pStr))
+            return false;
+      }
+   }
+
+   // find the next quote or backslash (or the end of input)
+   const char* scanString(const char* p) const
+   {
+      const char* end = end_;
+      while (p < end && *p != '"' && *p != '\\')
+         ++p;
+      return p < end ? p : end;
+   }
+
+   bool parseEscape(std::string* pStr)
+   {
+      if (pos_ == end_)
+         return false;
+
+      char ch = *pos_++;
+      switch (ch)
+      {
+         case '"':  pStr->push_back('"');  break;
+         case '\\': pStr->push_back('\\'); break;
+         case '/':  pStr->push_back('/');  break;
+         case 'b':  pStr->push_back('\b'); break;
+         case 'f':  pStr->push_back('\f'); break;
+         case 'n':  pStr->push_back('\n'); break;
+         case 'r':  pStr->push_back('\r'); break;
+         case 't':  pStr->push_back('\t'); break;
+         case 'x':
+         {
+            unsigned int value;
+            if (!parseHex(2, &value))
+               return false;
+            pStr->push_back(static_cast<char>(value));
+            break;
+         }
+         case 'u':
+         {
+            unsigned int codePoint;
+            if (!parseHex(4, &codePoint))
+               return false;
+
+            // combine surrogate pairs
+            if (codePoint >= 0xD800 && codePoint <= 0xDBFF &&
+                (end_ - pos_) >= 6 && pos_[0] == '\\' && pos_[1] == 'u')
+            {
+               const char* mark = pos_;
+               pos_ += 2;
+               unsigned int low;
+               if (parseHex(4, &low) && low >= 0xDC00 && low <= 0xDFFF)
+                  codePoint = 0x10000 + ((codePoint - 0xD800) << 10) +
+                              (low - 0xDC00);
+               else
+                  pos_ = mark;
+            }
+
+            appendUtf8(codePoint, pStr);
+            break;
+         }
+         default:
+            // unknown escapes are dropped (as json_spirit did)
+            break;
+      }
+
+      return true;
+   }
+
+   bool parseHex(int digits, unsigned int* pValue)
+   {
+      if ((end_ - pos_) < digits)
+         return false;
+
+      unsigned int value = 0;
+      for (int i = 0; i < digits; i++)
+      {
+         char ch = *pos_++;
+         value <<= 4;
+         if (ch >= '0' && ch <= '9')
+            value += ch - '0';
+         else if (ch >= 'a' && ch <= 'f')
+            value += ch - 'a' + 10;
+         else if (ch >= 'A' && ch <= 'F')
+            value += ch - 'A' + 10;
+         else
+            return false;
+      }
+
+      *pValue = value;
+      return true;
+   }
+
+   static void appendUtf8(unsigned int codePoint, std::string* pStr)
+   {
+      if (codePoint < 0x80)
+      {
+         pStr->push_back(static_cast<char>(codePoint));
+      }
+      else if (codePoint < 0x800)
+      {
+         pStr->push_back(static_cast<char>(0xC0 | (codePoint >> 6)));
+         pStr->push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+      }
+      else if (codePoint < 0x10000)
+      {
+         pStr->push_back(static_cast<char>(0xE0 | (codePoint >> 12)));
+         pStr->push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+         pStr->push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+      }
+      else
+      {
+         pStr->push_back(static_cast<char>(0xF0 | (codePoint >> 18)));
+         pStr->push_back(static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F)));
+         pStr->push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+         pStr->push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+      }
+   }
+
+   bool parseLiteral(const char* literal)
+   {
+      for (; *literal; ++literal, ++pos_)
+      {
+         if (pos_ == end_ || *pos_ != *literal)
+            return false;
+      }
+      return true;
+   }
+
+   bool parseNumber(Value* pValue)
+   {
+      const char* start = pos_;
+
+      bool negative = false;
+      if (pos_ != end_ && (*pos_ == '-' || *pos_ == '+'))
+         negative = (*pos_++ == '-');
+
+      // accumulate the integer part (noting overflow)
+      boost::uint64_t magnitude = 0;
+      bool overflow = false;
+      const char* digitsStart = pos_;
+      while (pos_ != end_ && *pos_ >= '0' && *pos_ <= '9')
+      {
+         unsigned int digit = *pos_++ - '0';
+         if (magnitude > (std::numeric_limits<boost::uint64_t>::max() - digit) / 10)
+            overflow = true;
+         else
+            magnitude = (magnitude * 10) + digit;
+      }
+      bool haveDigits = pos_ != digitsStart;
+
+      // fraction and exponent make this a real
+      bool isReal = false;
+      if (pos_ != end_ && *pos_ == '.')
+      {
+         isReal = true;
+         ++pos_;
+         const char* fractionStart = pos_;
+         while (pos_ != end_ && *pos_ >= '0' && *pos_ <= '9')
+            ++pos_;
+         haveDigits = haveDigits || (pos_ != fractionStart);
+      }
+
+      if (!haveDigits)
+         return false;
+
+      if (pos_ != end_ && (*pos_ == 'e' || *pos_ == 'E'))
+      {
+         const char* mark = pos_;
+         ++pos_;
+         if (pos_ != end_ && (*pos_ == '-' || *pos_ == '+'))
+            ++pos_;
+         const char* exponentStart = pos_;
+         while (pos_ != end_ && *pos_ >= '0' && *pos_ <= '9')
+            ++pos_;
+         if (pos_ == exponentStart)
+            pos_ = mark;
+         else
+            isReal = true;
+      }
+
+      const boost::uint64_t kMaxInt64 =
+                     static_cast<boost::uint64_t>(
+                           std::numeric_limits<boost::int64_t>::max());
+
+      if (!isReal && !overflow)
+      {
+         if (!negative && magnitude <= kMaxInt64)
+         {
+            *pValue = Value(static_cast<boost::int64_t>(magnitude));
+            return true;
+         }
+         else if (!negative)
+         {
+            *pValue = Value(magnitude);
+            return true;
+         }
+         else if (magnitude <= kMaxInt64 + 1)
+         {
+            *pValue = Value(static_cast<boost::int64_t>(0 - magnitude));
+            return true;
+         }
+      }
+
+      // reals (and integers too large to represent) are converted
+      // independently of the current locale
+      std::istringstream istr(std::string(start, pos_));
+      istr.imbue(std::locale::classic());
+      double value;
+      istr >> value;
+      if (istr.fail())
+         return false;
+
+      *pValue = Value(value);
+      return true;
+   }
+
+   void skipWhitespace()
+   {
+      while (pos_ != end_ && std::isspace(static_cast<unsigned char>(*pos_)))
+         ++pos_;
+   }
+
+private:
+   const char* pos_;
+   const char* end_;
+   int depth_;
+};
+
+} // anonymous namespace
+
 bool parse(const std::string& input, Value* pValue)
 {
-   // two threads simultaneously using the json parser has been observed
-   // to crash the process. protect it globally with a mutex. note this was
-   // probably a result of not defining BOOST_SPIRIT_THREADSAFE (which we
-   // have subsequently defined) however since there isn't much documentation 
-   // on the behavior of boost spirit w/ threads and the specific behavior
-   // of this constant we leave in mutex just to be sure   
-      
-   static boost::mutex s_spiritMutex ;
-   LOCK_MUTEX(s_spiritMutex)
-   {
-      return json_spirit::read(input, *pValue);
-   }
-   END_LOCK_MUTEX
-   
-   // mutex related error
-   return false;
+   Parser parser(input);
+   return parser.parse(pValue);
 }
 
 void write(const Value& value, std::ostream& os)
@@ -71,6 +504,38 @@ void writeFormatted(const Value& value, std::ostream& os)
 {
    json_spirit::write_formatted(value, os);
 }   
+
+std::size_t estimatedSize(const Value& value)
+{
+   std::size_t size = sizeof(Value);
+   if (value.type() == StringType)
+   {
+      size += value.get_str().capacity();
+   }
+   else if (value.type() == ArrayType)
+   {
+      const Array& array = value.get_array();
+      for (Array::const_iterator it = array.begin(); it != array.end(); ++it)
+         size += estimatedSize(*it);
+   }
+   else if (value.type() == ObjectType)
+   {
+      size += estimatedSize(value.get_obj());
+   }
+   return size;
+}
+
+std::size_t estimatedSize(const Object& object)
+{
+   // (members are map nodes: a key and value plus tree pointers)
+   std::size_t size = 0;
+   for (Object::const_iterator it = object.begin(); it != object.end(); ++it)
+   {
+      size += (4 * sizeof(void*)) + sizeof(std::string) +
+              it->first.capacity() + estimatedSize(it->second);
+   }
+   return size;
+}
    
 } // namespace json
 } // namespace core
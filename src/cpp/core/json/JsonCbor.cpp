@@ -0,0 +1,493 @@
+/*
+ * JsonCbor.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/json/JsonCbor.hpp>
+
+#include <cmath>
+#include <cstring>
+#include <ostream>
+#include <limits>
+
+#include <boost/foreach.hpp>
+
+namespace core {
+namespace json {
+
+const char * const kCborContentType = "application/cbor";
+
+namespace cbor {
+
+namespace {
+
+const unsigned char kIndefinite = 31;
+const unsigned char kBreak = 0xFF;
+
+const unsigned char kFalse = 20;
+const unsigned char kTrue = 21;
+const unsigned char kNull = 22;
+const unsigned char kUndefined = 23;
+const unsigned char kFloat16 = 25;
+const unsigned char kFloat32 = 26;
+const unsigned char kFloat64 = 27;
+
+void writeBigEndian(boost::uint64_t value, int bytes, std::ostream& os)
+{
+   char buffer[8];
+   for (int i = 0; i < bytes; i++)
+      buffer[i] = static_cast<char>((value >> (8 * (bytes - i - 1))) & 0xFF);
+   os.write(buffer, bytes);
+}
+
+} // anonymous namespace
+
+void writeHead(MajorType type, boost::uint64_t argument, std::ostream& os)
+{
+   unsigned char major = static_cast<unsigned char>(type << 5);
+   if (argument < 24)
+   {
+      os.put(static_cast<char>(major | argument));
+   }
+   else if (argument <= 0xFF)
+   {
+      os.put(static_cast<char>(major | 24));
+      writeBigEndian(argument, 1, os);
+   }
+   else if (argument <= 0xFFFF)
+   {
+      os.put(static_cast<char>(major | 25));
+      writeBigEndian(argument, 2, os);
+   }
+   else if (argument <= 0xFFFFFFFFULL)
+   {
+      os.put(static_cast<char>(major | 26));
+      writeBigEndian(argument, 4, os);
+   }
+   else
+   {
+      os.put(static_cast<char>(major | 27));
+      writeBigEndian(argument, 8, os);
+   }
+}
+
+void writeIndefiniteHead(MajorType type, std::ostream& os)
+{
+   os.put(static_cast<char>((type << 5) | kIndefinite));
+}
+
+void writeBreak(std::ostream& os)
+{
+   os.put(static_cast<char>(kBreak));
+}
+
+void writeInteger(boost::int64_t value, std::ostream& os)
+{
+   // negative integers are encoded as -1 - n
+   if (value < 0)
+      writeHead(NegativeType, static_cast<boost::uint64_t>(-(value + 1)), os);
+   else
+      writeHead(UnsignedType, static_cast<boost::uint64_t>(value), os);
+}
+
+void writeUnsigned(boost::uint64_t value, std::ostream& os)
+{
+   writeHead(UnsignedType, value, os);
+}
+
+void writeDouble(double value, std::ostream& os)
+{
+   // always full precision (json text is written with 16 significant
+   // digits so this never loses anything relative to it)
+   boost::uint64_t bits;
+   std::memcpy(&bits, &value, sizeof(bits));
+   os.put(static_cast<char>((SimpleType << 5) | kFloat64));
+   writeBigEndian(bits, 8, os);
+}
+
+void writeBool(bool value, std::ostream& os)
+{
+   os.put(static_cast<char>((SimpleType << 5) | (value ? kTrue : kFalse)));
+}
+
+void writeNull(std::ostream& os)
+{
+   os.put(static_cast<char>((SimpleType << 5) | kNull));
+}
+
+void writeString(const std::string& value, std::ostream& os)
+{
+   writeHead(TextStringType, value.size(), os);
+   os.write(value.data(), value.size());
+}
+
+} // namespace cbor
+
+namespace {
+
+// deeper nesting than this is certainly malformed (and would otherwise
+// let a hostile request exhaust the stack)
+const int kMaxDepth = 512;
+
+class Parser
+{
+public:
+   explicit Parser(const std::string& input)
+      : pos_(reinterpret_cast<const unsigned char*>(input.data())),
+        end_(pos_ + input.size())
+   {
+   }
+
+   bool parse(Value* pValue)
+   {
+      return parseItem(pValue, 0) && pos_ == end_;
+   }
+
+private:
+   bool readByte(unsigned char* pByte)
+   {
+      if (pos_ == end_)
+         return false;
+      *pByte = *pos_++;
+      return true;
+   }
+
+   bool readBigEndian(int bytes, boost::uint64_t* pValue)
+   {
+      if (end_ - pos_ < bytes)
+         return false;
+      boost::uint64_t value = 0;
+      for (int i = 0; i < bytes; i++)
+         value = (value << 8) | *pos_++;
+      *pValue = value;
+      return true;
+   }
+
+   // reads the argument of a head (false for reserved encodings). the
+   // indefinite length encoding is flagged via pIndefinite
+   bool readArgument(unsigned char info,
+                     boost::uint64_t* pArgument,
+                     bool* pIndefinite)
+   {
+      *pIndefinite = false;
+      if (info < 24)
+      {
+         *pArgument = info;
+         return true;
+      }
+
+      switch (info)
+      {
+         case 24: return readBigEndian(1, pArgument);
+         case 25: return readBigEndian(2, pArgument);
+         case 26: return readBigEndian(4, pArgument);
+         case 27: return readBigEndian(8, pArgument);
+         case cbor::kIndefinite:
+            *pIndefinite = true;
+            return true;
+         default:
+            return false;
+      }
+   }
+
+   bool atBreak()
+   {
+      if (pos_ != end_ && *pos_ == cbor::kBreak)
+      {
+         pos_++;
+         return true;
+      }
+      return false;
+   }
+
+   bool readChunk(boost::uint64_t length, std::string* pString)
+   {
+      if (length > static_cast<boost::uint64_t>(end_ - pos_))
+         return false;
+      pString->append(reinterpret_cast<const char*>(pos_),
+                      static_cast<std::size_t>(length));
+      pos_ += length;
+      return true;
+   }
+
+   bool parseString(cbor::MajorType type,
+                    boost::uint64_t length,
+                    bool indefinite,
+                    std::string* pString)
+   {
+      if (!indefinite)
+         return readChunk(length, pString);
+
+      // indefinite length strings are a series of definite length chunks
+      // of the same major type
+      while (!atBreak())
+      {
+         unsigned char head;
+         if (!readByte(&head) || (head >> 5) != type)
+            return false;
+         boost::uint64_t chunkLength;
+         bool chunkIndefinite;
+         if (!readArgument(head & 0x1F, &chunkLength, &chunkIndefinite) ||
+             chunkIndefinite)
+         {
+            return false;
+         }
+         if (!readChunk(chunkLength, pString))
+            return false;
+      }
+      return true;
+   }
+
+   bool parseSimple(unsigned char info,
+                    boost::uint64_t argument,
+                    Value* pValue)
+   {
+      switch (info)
+      {
+         case cbor::kFalse:
+            *pValue = Value(false);
+            return true;
+         case cbor::kTrue:
+            *pValue = Value(true);
+            return true;
+         case cbor::kNull:
+         case cbor::kUndefined:
+            *pValue = Value();
+            return true;
+         case cbor::kFloat16:
+            *pValue = Value(halfToDouble(static_cast<unsigned>(argument)));
+            return true;
+         case cbor::kFloat32:
+         {
+            boost::uint32_t bits = static_cast<boost::uint32_t>(argument);
+            float value;
+            std::memcpy(&value, &bits, sizeof(value));
+            *pValue = Value(static_cast<double>(value));
+            return true;
+         }
+         case cbor::kFloat64:
+         {
+            double value;
+            std::memcpy(&value, &argument, sizeof(value));
+            *pValue = Value(value);
+            return true;
+         }
+         default:
+            // other simple values have no json equivalent
+            return false;
+      }
+   }
+
+   static double halfToDouble(unsigned half)
+   {
+      int exponent = (half >> 10) & 0x1F;
+      int mantissa = half & 0x3FF;
+      double value;
+      if (exponent == 0)
+         value = std::ldexp(static_cast<double>(mantissa), -24);
+      else if (exponent != 31)
+         value = std::ldexp(static_cast<double>(mantissa + 1024),
+                            exponent - 25);
+      else if (mantissa == 0)
+         value = std::numeric_limits<double>::infinity();
+      else
+         value = std::numeric_limits<double>::quiet_NaN();
+      return (half & 0x8000) ? -value : value;
+   }
+
+   bool parseItem(Value* pValue, int depth)
+   {
+      if (depth > kMaxDepth)
+         return false;
+
+      unsigned char head;
+      if (!readByte(&head))
+         return false;
+
+      cbor::MajorType type = static_cast<cbor::MajorType>(head >> 5);
+      unsigned char info = head & 0x1F;
+      boost::uint64_t argument;
+      bool indefinite;
+      if (!readArgument(info, &argument, &indefinite))
+         return false;
+
+      switch (type)
+      {
+         case cbor::UnsignedType:
+         {
+            if (indefinite)
+               return false;
+            if (argument > static_cast<boost::uint64_t>(
+                              std::numeric_limits<boost::int64_t>::max()))
+               *pValue = Value(argument);
+            else
+               *pValue = Value(static_cast<boost::int64_t>(argument));
+            return true;
+         }
+
+         case cbor::NegativeType:
+         {
+            if (indefinite || argument > static_cast<boost::uint64_t>(
+                              std::numeric_limits<boost::int64_t>::max()))
+               return false;
+            *pValue = Value(-1 - static_cast<boost::int64_t>(argument));
+            return true;
+         }
+
+         case cbor::ByteStringType:
+         case cbor::TextStringType:
+         {
+            std::string str;
+            if (!parseString(type, argument, indefinite, &str))
+               return false;
+            *pValue = Value(str);
+            return true;
+         }
+
+         case cbor::ArrayType:
+         {
+            Array array;
+            if (indefinite)
+            {
+               while (!atBreak())
+               {
+                  array.push_back(Value());
+                  if (!parseItem(&array.back(), depth + 1))
+                     return false;
+               }
+            }
+            else
+            {
+               // every element is at least a byte so a longer array than
+               // the remaining input is malformed (don't reserve it)
+               if (argument > static_cast<boost::uint64_t>(end_ - pos_))
+                  return false;
+               array.reserve(static_cast<std::size_t>(argument));
+               for (boost::uint64_t i = 0; i < argument; i++)
+               {
+                  array.push_back(Value());
+                  if (!parseItem(&array.back(), depth + 1))
+                     return false;
+               }
+            }
+            *pValue = Value(array);
+            return true;
+         }
+
+         case cbor::MapType:
+         {
+            Object object;
+            for (boost::uint64_t i = 0; indefinite || i < argument; i++)
+            {
+               if (indefinite && atBreak())
+                  break;
+
+               Value key;
+               if (!parseItem(&key, depth + 1))
+                  return false;
+               if (key.type() != StringType)
+                  return false;
+
+               if (!parseItem(&object[key.get_str()], depth + 1))
+                  return false;
+            }
+            *pValue = Value(object);
+            return true;
+         }
+
+         case cbor::TagType:
+         {
+            // tags (e.g. dates, bignums) only annotate the item which
+            // follows so we just read that item
+            if (indefinite)
+               return false;
+            return parseItem(pValue, depth + 1);
+         }
+
+         case cbor::SimpleType:
+         {
+            if (indefinite)
+               return false;
+            return parseSimple(info, argument, pValue);
+         }
+
+         default:
+            return false;
+      }
+   }
+
+private:
+   const unsigned char* pos_;
+   const unsigned char* end_;
+};
+
+} // anonymous namespace
+
+void writeCbor(const Value& value, std::ostream& os)
+{
+   if (value.type() == ObjectType)
+   {
+      writeCbor(value.get_obj(), os);
+   }
+   else if (value.type() == ArrayType)
+   {
+      const Array& array = value.get_array();
+      cbor::writeHead(cbor::ArrayType, array.size(), os);
+      BOOST_FOREACH(const Value& element, array)
+      {
+         writeCbor(element, os);
+      }
+   }
+   else if (value.type() == StringType)
+   {
+      cbor::writeString(value.get_str(), os);
+   }
+   else if (value.type() == BooleanType)
+   {
+      cbor::writeBool(value.get_bool(), os);
+   }
+   else if (value.type() == IntegerType)
+   {
+      if (value.is_uint64())
+         cbor::writeUnsigned(value.get_uint64(), os);
+      else
+         cbor::writeInteger(value.get_int64(), os);
+   }
+   else if (value.type() == RealType)
+   {
+      cbor::writeDouble(value.get_real(), os);
+   }
+   else
+   {
+      cbor::writeNull(os);
+   }
+}
+
+void writeCbor(const Object& object, std::ostream& os)
+{
+   cbor::writeHead(cbor::MapType, object.size(), os);
+   for (Object::const_iterator it = object.begin(); it != object.end(); ++it)
+   {
+      cbor::writeString(it->first, os);
+      writeCbor(it->second, os);
+   }
+}
+
+bool parseCbor(const std::string& input, Value* pValue)
+{
+   Parser parser(input);
+   return parser.parse(pValue);
+}
+
+} // namespace json
+} // namespace core
@@ -17,8 +17,12 @@
 
 #include <sstream>
 
+#include <boost/ref.hpp>
+
 #include <core/Log.hpp>
 #include <core/http/Response.hpp>
+#include <core/json/JsonWriter.hpp>
+#include <core/json/JsonCbor.hpp>
 
 
 namespace core {
@@ -29,7 +33,86 @@ const char * const kRpcAsyncHandle = "asyncHandle";
 const char * const kRpcError = "error";
 const char * const kJsonContentType = "application/json" ;   
    
-Error parseJsonRpcRequest(const std::string& input, JsonRpcRequest* pRequest) 
+namespace {
+
+// extract the fields of a request object
+// (params are swapped out rather than copied since they can be
+// large, e.g. the contents of a document being saved)
+Error readJsonRpcRequestObject(json::Object& requestObject,
+                               JsonRpcRequest* pRequest)
+{
+   for (json::Object::iterator it = 
+         requestObject.begin(); it != requestObject.end(); ++it)
+   {
+      const std::string& fieldName = it->first ;
+      json::Value& fieldValue = it->second ;
+
+      if ( fieldName == "method" )
+      {
+         if (fieldValue.type() != json::StringType)
+            return Error(errc::InvalidRequest, ERROR_LOCATION) ;
+
+         pRequest->method = fieldValue.get_str() ;
+      }
+      else if ( fieldName == "params" )
+      {
+         if (fieldValue.type() != json::ArrayType)
+            return Error(errc::ParamTypeMismatch, ERROR_LOCATION) ;
+
+         pRequest->params.swap(fieldValue.get_array());
+      }
+      else if ( fieldName == "kwparams" )
+      {
+         if (fieldValue.type() != json::ObjectType)
+            return Error(errc::ParamTypeMismatch, ERROR_LOCATION) ;
+
+         pRequest->kwparams.swap(fieldValue.get_obj());
+      }
+      else if (fieldName == "sourceWnd")
+      {
+         if (fieldValue.type() != json::StringType)
+            return Error(errc::InvalidRequest, ERROR_LOCATION);
+
+         pRequest->sourceWindow = fieldValue.get_str();
+      }
+      else if (fieldName == "clientId" )
+      {
+         if (fieldValue.type() != json::StringType)
+            return Error(errc::InvalidRequest, ERROR_LOCATION);
+         
+         pRequest->clientId = fieldValue.get_str();
+      }
+      else if (fieldName == "version" )
+      {
+         if (!json::isType<double>(fieldValue))
+            return Error(errc::InvalidRequest, ERROR_LOCATION);
+         
+         pRequest->version = fieldValue.get_value<double>();
+      }
+   }
+
+   // method is required
+   if (pRequest->method.empty() )
+      return Error(errc::InvalidRequest, ERROR_LOCATION) ;
+
+   return Success() ;
+}
+
+bool parseRequestValue(const std::string& input,
+                       Encoding encoding,
+                       json::Value* pValue)
+{
+   if (encoding == CborEncoding)
+      return json::parseCbor(input, pValue);
+   else
+      return json::parse(input, pValue);
+}
+
+} // anonymous namespace
+
+Error parseJsonRpcRequest(const std::string& input,
+                          JsonRpcRequest* pRequest,
+                          Encoding encoding)
 {
    // json_spirit is not documented to throw an exceptions but surround 
    // the code with an exception handling block just to be defensive...
@@ -37,69 +120,52 @@ Error parseJsonRpcRequest(const std::string& input, JsonRpcRequest* pRequest)
    {
       // parse data and verify it contains an object
       json::Value var;
-      if ( !json::parse(input, &var) || 
+      if ( !parseRequestValue(input, encoding, &var) ||
            (var.type() != json::ObjectType) )
       {
          return Error(errc::InvalidRequest, ERROR_LOCATION) ;
       }
 
-      // extract the fields
-      json::Object& requestObject = var.get_obj();
-      for (json::Object::const_iterator it = 
-            requestObject.begin(); it != requestObject.end(); ++it)
+      return readJsonRpcRequestObject(var.get_obj(), pRequest);
+   }
+   catch(const std::exception& e)
+   {
+      Error error = Error(errc::ParseError, ERROR_LOCATION);
+      error.addProperty("exception", e.what()) ;
+      return error ;
+   }
+}
+
+Error parseJsonRpcBatchRequest(const std::string& input,
+                               std::vector<JsonRpcRequest>* pRequests,
+                               Encoding encoding)
+{
+   try
+   {
+      // parse data and verify it contains a (non-empty) array
+      json::Value var;
+      if ( !parseRequestValue(input, encoding, &var) ||
+           (var.type() != json::ArrayType) ||
+           var.get_array().empty() )
       {
-         std::string fieldName = it->first ;
-         json::Value fieldValue = it->second ;
-
-         if ( fieldName == "method" )
-         {
-            if (fieldValue.type() != json::StringType)
-               return Error(errc::InvalidRequest, ERROR_LOCATION) ;
-
-            pRequest->method = fieldValue.get_str() ;
-         }
-         else if ( fieldName == "params" )
-         {
-            if (fieldValue.type() != json::ArrayType)
-               return Error(errc::ParamTypeMismatch, ERROR_LOCATION) ;
-
-            pRequest->params = fieldValue.get_array();
-         }
-         else if ( fieldName == "kwparams" )
-         {
-            if (fieldValue.type() != json::ObjectType)
-               return Error(errc::ParamTypeMismatch, ERROR_LOCATION) ;
-
-            pRequest->kwparams = fieldValue.get_obj();
-         }
-         else if (fieldName == "sourceWnd")
-         {
-            if (fieldValue.type() != json::StringType)
-               return Error(errc::InvalidRequest, ERROR_LOCATION);
-
-            pRequest->sourceWindow = fieldValue.get_str();
-         }
-         else if (fieldName == "clientId" )
-         {
-            if (fieldValue.type() != json::StringType)
-               return Error(errc::InvalidRequest, ERROR_LOCATION);
-            
-            pRequest->clientId = fieldValue.get_str();
-         }
-         else if (fieldName == "version" )
-         {
-            if (!json::isType<double>(fieldValue))
-               return Error(errc::InvalidRequest, ERROR_LOCATION);
-            
-            pRequest->version = fieldValue.get_value<double>();
-         }
+         return Error(errc::InvalidRequest, ERROR_LOCATION) ;
       }
 
-      // method is required
-      if (pRequest->method.empty() )
-         return Error(errc::InvalidRequest, ERROR_LOCATION) ;
+      json::Array& requestsArray = var.get_array();
+      pRequests->clear();
+      pRequests->resize(requestsArray.size());
+      for (std::size_t i = 0; i < requestsArray.size(); i++)
+      {
+         if (requestsArray[i].type() != json::ObjectType)
+            return Error(errc::InvalidRequest, ERROR_LOCATION) ;
+
+         Error error = readJsonRpcRequestObject(requestsArray[i].get_obj(),
+                                                &(pRequests->at(i)));
+         if (error)
+            return error;
+      }
 
-      return Success() ;
+      return Success();
    }
    catch(const std::exception& e)
    {
@@ -168,12 +234,52 @@ void JsonRpcResponse::runAfterResponse()
    
 json::Object JsonRpcResponse::getRawResponse()
 {
+   // materialize streamed results
+   if (resultWriter_)
+   {
+      std::ostringstream ostr;
+      Writer writer(ostr);
+      resultWriter_(writer);
+
+      json::Value result;
+      if (!json::parse(ostr.str(), &result))
+         LOG_ERROR_MESSAGE("Unable to parse streamed json-rpc result");
+
+      json::Object response = response_;
+      response[kRpcResult] = result;
+      return response;
+   }
+
    return response_;
 }
    
-void JsonRpcResponse::write(std::ostream& os) const
+void JsonRpcResponse::write(std::ostream& os, Encoding encoding) const
 {
-   json::write(response_, os);
+   if (resultWriter_)
+   {
+      // write the other fields and then stream the result
+      Writer writer(os, encoding);
+      writer.startObject();
+      for (json::Object::const_iterator it = response_.begin();
+           it != response_.end();
+           ++it)
+      {
+         writer.key(it->first);
+         if (it->first == kRpcResult)
+            resultWriter_(writer);
+         else
+            writer.value(it->second);
+      }
+      writer.endObject();
+   }
+   else if (encoding == CborEncoding)
+   {
+      json::writeCbor(response_, os);
+   }
+   else
+   {
+      json::write(response_, os);
+   }
 }
    
 void JsonRpcResponse::setError(const Error& error, const json::Value& clientInfo)
@@ -181,6 +287,7 @@ void JsonRpcResponse::setError(const Error& error, const json::Value& clientInfo
    // remove result
    response_.erase(kRpcResult);
    response_.erase(kRpcAsyncHandle);
+   resultWriter_.clear();
 
    const boost::system::error_code& ec = error.code();
    
@@ -222,6 +329,7 @@ void JsonRpcResponse::setError(const boost::system::error_code& ec)
    // remove result
    response_.erase(kRpcResult);
    response_.erase(kRpcAsyncHandle);
+   resultWriter_.clear();
 
    // error from error code
    json::Object error ;
@@ -238,12 +346,14 @@ void JsonRpcResponse::setAsyncHandle(const std::string& handle)
 {
    response_.erase(kRpcResult);
    response_.erase(kRpcError);
+   resultWriter_.clear();
 
    setField(kRpcAsyncHandle, handle);
 }
 
 void setJsonRpcResponse(const core::json::JsonRpcResponse& jsonRpcResponse,
-                        core::http::Response* pResponse)
+                        core::http::Response* pResponse,
+                        Encoding encoding)
 {
    // no cache!
    pResponse->setNoCacheHeaders();
@@ -253,12 +363,15 @@ void setJsonRpcResponse(const core::json::JsonRpcResponse& jsonRpcResponse,
    // circumstances such as returning results to the GWT FileUpload widget
    // (which expects text/html)
    if (pResponse->contentType().empty())
-       pResponse->setContentType(kJsonContentType) ; 
+   {
+      pResponse->setContentType(encoding == CborEncoding ? kCborContentType
+                                                         : kJsonContentType);
+   }
    
-   // set body 
-   std::stringstream responseStream ;
-   jsonRpcResponse.write(responseStream);
-   Error error = pResponse->setBody(responseStream);
+   // set body (streamed directly into the response)
+   Error error = pResponse->setStreamedBody(
+                     boost::bind(&JsonRpcResponse::write,
+                                 &jsonRpcResponse, _1, encoding));
    
    // report error to client if one occurred
    if (error)
@@ -270,6 +383,51 @@ void setJsonRpcResponse(const core::json::JsonRpcResponse& jsonRpcResponse,
 }     
    
  
+namespace {
+
+void writeBatchResponse(const std::vector<JsonRpcResponse>& responses,
+                        Encoding encoding,
+                        std::ostream& os)
+{
+   if (encoding == CborEncoding)
+   {
+      cbor::writeHead(cbor::ArrayType, responses.size(), os);
+      for (std::size_t i = 0; i < responses.size(); i++)
+         responses[i].write(os, encoding);
+      return;
+   }
+
+   os << "[";
+   for (std::size_t i = 0; i < responses.size(); i++)
+   {
+      if (i > 0)
+         os << ",";
+      responses[i].write(os);
+   }
+   os << "]";
+}
+
+} // anonymous namespace
+
+void setJsonRpcBatchResponse(const std::vector<JsonRpcResponse>& responses,
+                             core::http::Response* pResponse,
+                             Encoding encoding)
+{
+   pResponse->setNoCacheHeaders();
+   pResponse->setContentType(encoding == CborEncoding ? kCborContentType
+                                                      : kJsonContentType);
+
+   Error error = pResponse->setStreamedBody(
+                     boost::bind(writeBatchResponse,
+                                 boost::cref(responses), encoding, _1));
+   if (error)
+   {
+      LOG_ERROR(error);
+      pResponse->setError(http::status::InternalServerError,
+                          error.code().message());
+   }
+}
+
 class JsonRpcErrorCategory : public boost::system::error_category
 {
 public:
@@ -0,0 +1,244 @@
+/*
+ * JsonWriter.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/json/JsonWriter.hpp>
+
+#include <ostream>
+#include <iomanip>
+
+#include <boost/assert.hpp>
+
+#include <core/json/JsonCbor.hpp>
+
+namespace core {
+namespace json {
+
+namespace {
+
+const char * const kHexDigits = "0123456789ABCDEF";
+
+} // anonymous namespace
+
+Writer::Writer(std::ostream& os, Encoding encoding)
+   : os_(os), encoding_(encoding), pendingKey_(false)
+{
+}
+
+Writer& Writer::startObject()
+{
+   beginValue();
+   if (encoding_ == CborEncoding)
+      cbor::writeIndefiniteHead(cbor::MapType, os_);
+   else
+      os_.put('{');
+   hasElements_.push_back(false);
+   return *this;
+}
+
+Writer& Writer::endObject()
+{
+   BOOST_ASSERT(!hasElements_.empty() && !pendingKey_);
+   hasElements_.pop_back();
+   if (encoding_ == CborEncoding)
+      cbor::writeBreak(os_);
+   else
+      os_.put('}');
+   return *this;
+}
+
+Writer& Writer::startArray()
+{
+   beginValue();
+   if (encoding_ == CborEncoding)
+      cbor::writeIndefiniteHead(cbor::ArrayType, os_);
+   else
+      os_.put('[');
+   hasElements_.push_back(false);
+   return *this;
+}
+
+Writer& Writer::endArray()
+{
+   BOOST_ASSERT(!hasElements_.empty());
+   hasElements_.pop_back();
+   if (encoding_ == CborEncoding)
+      cbor::writeBreak(os_);
+   else
+      os_.put(']');
+   return *this;
+}
+
+Writer& Writer::key(const std::string& name)
+{
+   BOOST_ASSERT(!hasElements_.empty() && !pendingKey_);
+   if (hasElements_.back() && encoding_ == JsonEncoding)
+      os_.put(',');
+   hasElements_.back() = true;
+   writeString(name);
+   if (encoding_ == JsonEncoding)
+      os_.put(':');
+   pendingKey_ = true;
+   return *this;
+}
+
+Writer& Writer::value(const std::string& value)
+{
+   beginValue();
+   writeString(value);
+   return *this;
+}
+
+Writer& Writer::value(const char* value)
+{
+   return this->value(std::string(value));
+}
+
+Writer& Writer::value(int value)
+{
+   beginValue();
+   if (encoding_ == CborEncoding)
+      cbor::writeInteger(value, os_);
+   else
+      os_ << value;
+   return *this;
+}
+
+Writer& Writer::value(boost::int64_t value)
+{
+   beginValue();
+   if (encoding_ == CborEncoding)
+      cbor::writeInteger(value, os_);
+   else
+      os_ << value;
+   return *this;
+}
+
+Writer& Writer::value(boost::uint64_t value)
+{
+   beginValue();
+   if (encoding_ == CborEncoding)
+      cbor::writeUnsigned(value, os_);
+   else
+      os_ << value;
+   return *this;
+}
+
+Writer& Writer::value(double value)
+{
+   beginValue();
+
+   if (encoding_ == CborEncoding)
+   {
+      cbor::writeDouble(value, os_);
+      return *this;
+   }
+
+   // same formatting as json_spirit (but don't leave it applied to the
+   // underlying stream)
+   std::ios_base::fmtflags flags = os_.flags();
+   std::streamsize precision = os_.precision();
+   os_ << std::showpoint << std::setprecision(16) << value;
+   os_.flags(flags);
+   os_.precision(precision);
+
+   return *this;
+}
+
+Writer& Writer::value(bool value)
+{
+   beginValue();
+   if (encoding_ == CborEncoding)
+      cbor::writeBool(value, os_);
+   else
+      os_ << (value ? "true" : "false");
+   return *this;
+}
+
+Writer& Writer::value(const json::Value& value)
+{
+   beginValue();
+   if (encoding_ == CborEncoding)
+      json::writeCbor(value, os_);
+   else
+      json::write(value, os_);
+   return *this;
+}
+
+Writer& Writer::nullValue()
+{
+   beginValue();
+   if (encoding_ == CborEncoding)
+      cbor::writeNull(os_);
+   else
+      os_ << "null";
+   return *this;
+}
+
+void Writer::beginValue()
+{
+   if (pendingKey_)
+   {
+      pendingKey_ = false;
+   }
+   else if (!hasElements_.empty())
+   {
+      if (hasElements_.back() && encoding_ == JsonEncoding)
+         os_.put(',');
+      hasElements_.back() = true;
+   }
+}
+
+void Writer::writeString(const std::string& str)
+{
+   if (encoding_ == CborEncoding)
+   {
+      cbor::writeString(str, os_);
+      return;
+   }
+
+   os_.put('"');
+
+   // write unescaped runs of characters in a single call
+   std::string::size_type runStart = 0;
+   for (std::string::size_type i = 0; i < str.size(); i++)
+   {
+      unsigned char ch = static_cast<unsigned char>(str[i]);
+      if (ch >= 0x20 && ch != '"' && ch != '\\')
+         continue;
+
+      os_.write(str.data() + runStart, i - runStart);
+      runStart = i + 1;
+
+      switch (ch)
+      {
+         case '"':  os_ << "\\\""; break;
+         case '\\': os_ << "\\\\"; break;
+         case '\b': os_ << "\\b";  break;
+         case '\f': os_ << "\\f";  break;
+         case '\n': os_ << "\\n";  break;
+         case '\r': os_ << "\\r";  break;
+         case '\t': os_ << "\\t";  break;
+         default:
+            os_ << "\\u00" << kHexDigits[ch >> 4] << kHexDigits[ch & 0x0F];
+            break;
+      }
+   }
+   os_.write(str.data() + runStart, str.size() - runStart);
+
+   os_.put('"');
+}
+
+} // namespace json
+} // namespace core
@@ -15,6 +15,7 @@
 
 #include <core/markdown/Markdown.hpp>
 
+#include <cctype>
 #include <iostream>
 
 #include <boost/foreach.hpp>
@@ -23,9 +24,11 @@
 #include <boost/algorithm/string/join.hpp>
 #include <boost/algorithm/string/split.hpp>
 #include <boost/algorithm/string/predicate.hpp>
+#include <boost/algorithm/string/trim.hpp>
 
 #include <core/Error.hpp>
 #include <core/FilePath.hpp>
+#include <core/Hash.hpp>
 #include <core/StringUtils.hpp>
 #include <core/FileSerializer.hpp>
 
@@ -305,6 +308,120 @@ void stripMetadata(std::string* pInput)
    }
 }
 
+// html renderer options along with what we need to detect highlighted
+// code blocks. the html callbacks cast their opaque pointer to the render
+// options so they must be the first member
+struct DetectingRenderOptions
+{
+   struct html_renderopt html;
+   void (*blockcode)(struct buf*, const struct buf*, const struct buf*, void*);
+   RenderInfo* pRenderInfo;
+};
+
+void detectingBlockCode(struct buf* ob,
+                        const struct buf* text,
+                        const struct buf* lang,
+                        void* opaque)
+{
+   DetectingRenderOptions* pOptions =
+                           static_cast<DetectingRenderOptions*>(opaque);
+   if (lang && lang->size)
+   {
+      std::string language(reinterpret_cast<const char*>(lang->data),
+                           lang->size);
+      boost::algorithm::trim(language);
+      if (boost::algorithm::starts_with(language, "."))
+         language.erase(0, 1);
+      if (language == "r" || language == "cpp")
+         pOptions->pRenderInfo->requiresHighlighting = true;
+   }
+
+   pOptions->blockcode(ob, text, lang, opaque);
+}
+
+bool isFenceLine(const std::string& line)
+{
+   return boost::algorithm::starts_with(line, "```") ||
+          boost::algorithm::starts_with(line, "~~~");
+}
+
+bool isHeaderLine(const std::string& line, bool spaceHeaders)
+{
+   std::size_t level = 0;
+   while (level < line.size() && line[level] == '#')
+      level++;
+
+   if (level == 0 || level > 6)
+      return false;
+   else if (!spaceHeaders)
+      return true;
+   else
+      return level < line.size() && line[level] == ' ';
+}
+
+bool isReferenceLine(const std::string& line)
+{
+   std::size_t indent = line.find_first_not_of(' ');
+   if (indent == std::string::npos || indent > 3 || line[indent] != '[')
+      return false;
+
+   std::size_t close = line.find("]:", indent);
+   return close != std::string::npos && close > indent + 1;
+}
+
+bool isHTMLBlockLine(const std::string& line)
+{
+   return line.size() > 1 && line[0] == '<' &&
+          (std::isalpha(line[1]) || line[1] == '!' || line[1] == '/');
+}
+
+// split a document into sections which each start at a top level header
+// preceded by a blank line (otherwise the header could be a lazy
+// continuation of a list item). returns false if the document contains
+// constructs which may span sections
+bool splitSections(const std::string& input,
+                   bool spaceHeaders,
+                   std::vector<std::string>* pSections)
+{
+   bool inFence = false;
+   bool prevBlank = true;
+   std::string section;
+   std::size_t pos = 0;
+   while (pos < input.size())
+   {
+      std::size_t end = input.find('\n', pos);
+      end = (end == std::string::npos) ? input.size() : end + 1;
+      std::string line = input.substr(pos, end - pos);
+      pos = end;
+
+      if (isFenceLine(line))
+      {
+         inFence = !inFence;
+      }
+      else if (!inFence)
+      {
+         if (isReferenceLine(line) || isHTMLBlockLine(line))
+            return false;
+
+         if (prevBlank &&
+             isHeaderLine(line, spaceHeaders) &&
+             !section.empty())
+         {
+            pSections->push_back(section);
+            section.clear();
+         }
+      }
+
+      prevBlank = boost::algorithm::trim_copy(line).empty();
+      section.append(line);
+   }
+
+   if (!section.empty())
+      pSections->push_back(section);
+
+   return true;
+}
+
 } // anonymous namespace
 
 // render markdown to HTML -- assumes UTF-8 encoding
@@ -347,7 +464,21 @@ Error markdownToHTML(const std::string& markdownInput,
                      const Extensions& extensions,
                      const HTMLOptions& options,
                      std::string* pHTMLOutput)
+{
+   RenderInfo renderInfo;
+   return markdownToHTML(markdownInput,
+                         extensions,
+                         options,
+                         pHTMLOutput,
+                         &renderInfo);
+}
 
+// render markdown to HTML -- assumes UTF-8 encoding
+Error markdownToHTML(const std::string& markdownInput,
+                     const Extensions& extensions,
+                     const HTMLOptions& options,
+                     std::string* pHTMLOutput,
+                     RenderInfo* pRenderInfo)
 {
    // exclude fenced code blocks
    std::vector<ExcludePattern> excludePatterns;
@@ -368,8 +499,13 @@ Error markdownToHTML(const std::string& markdownInput,
       pMathFilter.reset(new MathJaxFilter(excludePatterns,
                                           &input,
                                           pHTMLOutput));
+      pRenderInfo->requiresMathjax = pMathFilter->hasMath();
    }
 
+   // mathml passes through as raw html
+   if (input.find("<math") != std::string::npos)
+      pRenderInfo->requiresMathjax = true;
+
    // strip yaml front-matter / pandoc metadata if requested
    if (extensions.stripMetadata)
       stripMetadata(&input);
@@ -410,7 +546,8 @@ Error markdownToHTML(const std::string& markdownInput,
 
    // setup html renderer
    struct sd_callbacks htmlCallbacks;
-   struct html_renderopt htmlOptions;
+   DetectingRenderOptions htmlOptions;
+   htmlOptions.pRenderInfo = pRenderInfo;
    int htmlRenderMode = 0;
    if (options.useXHTML)
       htmlRenderMode |= HTML_USE_XHTML;
@@ -430,7 +567,9 @@ Error markdownToHTML(const std::string& markdownInput,
       htmlRenderMode |= HTML_SKIP_LINKS;
    if (options.escape)
       htmlRenderMode |= HTML_ESCAPE;
-   ::sdhtml_renderer(&htmlCallbacks, &htmlOptions, htmlRenderMode);
+   ::sdhtml_renderer(&htmlCallbacks, &htmlOptions.html, htmlRenderMode);
+   htmlOptions.blockcode = htmlCallbacks.blockcode;
+   htmlCallbacks.blockcode = detectingBlockCode;
 
    // render page
    std::string output;
@@ -438,16 +577,83 @@ Error markdownToHTML(const std::string& markdownInput,
                                 extensions,
                                 options.smartypants,
                                 &htmlCallbacks,
-                                &htmlOptions,
+                                &htmlOptions.html,
                                 &output);
    if (error)
       return error;
 
+   // without the math filter we can only tell by looking at the output
+   if (!extensions.ignoreMath && !pRenderInfo->requiresMathjax)
+      pRenderInfo->requiresMathjax = requiresMathjax(output);
+
    // append output and return success
    pHTMLOutput->append(output);
    return Success();
 }
 
+Error IncrementalRenderer::render(const std::string& markdownInput,
+                                 std::string* pHTMLOutput,
+                                 RenderInfo* pRenderInfo)
+{
+   // strip metadata up front (front matter can contain header like lines)
+   std::string input = markdownInput;
+   if (extensions_.stripMetadata)
+      stripMetadata(&input);
+   Extensions extensions = extensions_;
+   extensions.stripMetadata = false;
+
+   // render the whole document if it can't be split into sections
+   std::vector<std::string> sections;
+   if (htmlOptions_.toc ||
+       !splitSections(input, extensions.spaceHeaders, &sections))
+   {
+      sections_.clear();
+      return markdownToHTML(input,
+                            extensions,
+                            htmlOptions_,
+                            pHTMLOutput,
+                            pRenderInfo);
+   }
+
+   // render sections we haven't seen (only the sections of this version
+   // of the document are kept for next time)
+   std::map<boost::uint64_t, Section> rendered;
+   BOOST_FOREACH(const std::string& source, sections)
+   {
+      boost::uint64_t key = hash::xxHash64(source.data(), source.size(), 0);
+      Section& section = rendered[key];
+      if (section.html.empty())
+      {
+         std::map<boost::uint64_t, Section>::iterator it =
+                                                      sections_.find(key);
+         if (it != sections_.end())
+         {
+            section.html.swap(it->second.html);
+            section.renderInfo = it->second.renderInfo;
+         }
+         else
+         {
+            Error error = markdownToHTML(source,
+                                         extensions,
+                                         htmlOptions_,
+                                         &section.html,
+                                         &section.renderInfo);
+            if (error)
+               return error;
+         }
+      }
+
+      pHTMLOutput->append(section.html);
+      if (section.renderInfo.requiresMathjax)
+         pRenderInfo->requiresMathjax = true;
+      if (section.renderInfo.requiresHighlighting)
+         pRenderInfo->requiresHighlighting = true;
+   }
+
+   sections_.swap(rendered);
+   return Success();
+}
+
 bool isMathJaxRequired(const std::string& htmlOutput)
 {
    return requiresMathjax(htmlOutput);
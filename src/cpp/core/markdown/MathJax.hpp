@@ -62,6 +62,11 @@ public:
                  std::string* pHTMLOutput);
    ~MathJaxFilter();
 
+   bool hasMath() const
+   {
+      return !displayMathBlocks_.empty() || !inlineMathBlocks_.empty();
+   }
+
 private:
    void filter(const boost::regex& re,
                std::string* pInput,
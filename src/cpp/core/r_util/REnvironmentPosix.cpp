@@ -15,6 +15,7 @@
 
 #include <core/r_util/REnvironment.hpp>
 
+#include <map>
 #include <algorithm>
 
 #include <boost/tokenizer.hpp>
@@ -25,6 +26,8 @@
 
 #include <core/Error.hpp>
 #include <core/FilePath.hpp>
+#include <core/SafeConvert.hpp>
+#include <core/FileSerializer.hpp>
 #include <core/ConfigUtils.hpp>
 #include <core/system/System.hpp>
 #include <core/system/Process.hpp>
@@ -550,44 +553,24 @@ bool detectRLocationsUsingR(const std::string& rScriptPath,
 }
 #endif
 
-} // anonymous namespace
-
-
-bool detectREnvironment(const FilePath& whichRScript,
-                        const FilePath& ldPathsScript,
-                        const std::string& ldLibraryPath,
-                        std::string* pRScriptPath,
-                        EnvironmentVars* pVars,
-                        std::string* pErrMsg)
+struct RLocations
 {
-   // if there is a which R script override then validate it
-   if (!whichRScript.empty())
-   {
-      // validate
-      if (!validateRScriptPath(whichRScript.absolutePath(), pErrMsg))
-         return false;
-
-      // set it
-      *pRScriptPath = whichRScript.absolutePath();
-   }
-   // otherwise use the system default (after validating it as well)
-   else
-   {
-      // get system default
-      FilePath sysRScript = systemDefaultRScript(pErrMsg);
-      if (sysRScript.empty())
-         return false;
-
-      if (!validateRScriptPath(sysRScript.absolutePath(), pErrMsg))
-         return false;
+   std::string rScriptPath;
+   FilePath rHomePath;
+   FilePath rLibPath;
+   config_utils::Variables scriptVars;
+   std::string extraPaths;
+};
 
-      // set it
-      *pRScriptPath = sysRScript.absolutePath();
-   }
+bool detectRLocations(const FilePath& ldPathsScript,
+                      RLocations* pLocations,
+                      std::string* pErrMsg)
+{
+   std::string* pRScriptPath = &(pLocations->rScriptPath);
+   FilePath& rHomePath = pLocations->rHomePath;
+   FilePath& rLibPath = pLocations->rLibPath;
+   config_utils::Variables& scriptVars = pLocations->scriptVars;
 
-   // detect R locations
-   FilePath rHomePath, rLibPath;
-   config_utils::Variables scriptVars;
 #ifdef __APPLE__
    if (!detectRLocationsUsingScript(FilePath(*pRScriptPath),
                                     &rHomePath,
@@ -635,6 +618,146 @@ bool detectREnvironment(const FilePath& whichRScript,
    }
 #endif
 
+   // extra library paths (e.g. for rJava) from ldpaths
+   pLocations->extraPaths = extraLibraryPaths(ldPathsScript,
+                                              rHomePath.absolutePath());
+
+   return true;
+}
+
+// the cache is keyed by the paths of the R and ldpaths scripts along with
+// their modification times (if either changes we detect again)
+std::string cacheKey(const FilePath& path)
+{
+   if (path.empty() || !path.exists())
+      return path.absolutePath();
+   else
+      return path.absolutePath() + ":" +
+             safe_convert::numberToString(path.lastWriteTime());
+}
+
+const char * const kRScriptKey = "r-script";
+const char * const kLdPathsKey = "ldpaths-script";
+const char * const kResolvedRScriptKey = "r-script-resolved";
+const char * const kRHomeKey = "r-home";
+const char * const kRLibKey = "r-lib";
+const char * const kExtraPathsKey = "extra-paths";
+const char * const kScriptVars[] = { "R_SHARE_DIR",
+                                     "R_INCLUDE_DIR",
+                                     "R_DOC_DIR" };
+
+bool readCachedRLocations(const FilePath& cacheFile,
+                          const FilePath& ldPathsScript,
+                          RLocations* pLocations)
+{
+   if (cacheFile.empty() || !cacheFile.exists())
+      return false;
+
+   std::map<std::string,std::string> cache;
+   Error error = readStringMapFromFile(cacheFile, &cache);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return false;
+   }
+
+   if (cache[kRScriptKey] != cacheKey(FilePath(pLocations->rScriptPath)) ||
+       cache[kLdPathsKey] != cacheKey(ldPathsScript) ||
+       cache[kRHomeKey].empty())
+   {
+      return false;
+   }
+
+   pLocations->rScriptPath = cache[kResolvedRScriptKey];
+   pLocations->rHomePath = FilePath(cache[kRHomeKey]);
+   pLocations->rLibPath = FilePath(cache[kRLibKey]);
+   for (std::size_t i = 0; i < sizeof(kScriptVars)/sizeof(kScriptVars[0]); i++)
+      pLocations->scriptVars[kScriptVars[i]] = cache[kScriptVars[i]];
+   pLocations->extraPaths = cache[kExtraPathsKey];
+   return true;
+}
+
+void writeCachedRLocations(const FilePath& cacheFile,
+                           const std::string& rScriptPath,
+                           const FilePath& ldPathsScript,
+                           const RLocations& locations)
+{
+   if (cacheFile.empty())
+      return;
+
+   std::map<std::string,std::string> cache;
+   cache[kRScriptKey] = cacheKey(FilePath(rScriptPath));
+   cache[kLdPathsKey] = cacheKey(ldPathsScript);
+   cache[kResolvedRScriptKey] = locations.rScriptPath;
+   cache[kRHomeKey] = locations.rHomePath.absolutePath();
+   cache[kRLibKey] = locations.rLibPath.absolutePath();
+   for (std::size_t i = 0; i < sizeof(kScriptVars)/sizeof(kScriptVars[0]); i++)
+   {
+      config_utils::Variables::const_iterator it =
+                                 locations.scriptVars.find(kScriptVars[i]);
+      if (it != locations.scriptVars.end())
+         cache[kScriptVars[i]] = it->second;
+   }
+   cache[kExtraPathsKey] = locations.extraPaths;
+
+   Error error = cacheFile.parent().ensureDirectory();
+   if (!error)
+      error = writeStringMapToFile(cacheFile, cache);
+   if (error)
+      LOG_ERROR(error);
+}
+
+} // anonymous namespace
+
+
+bool detectREnvironment(const FilePath& whichRScript,
+                        const FilePath& ldPathsScript,
+                        const std::string& ldLibraryPath,
+                        const FilePath& cacheFile,
+                        std::string* pRScriptPath,
+                        EnvironmentVars* pVars,
+                        std::string* pErrMsg)
+{
+   // if there is a which R script override then validate it
+   if (!whichRScript.empty())
+   {
+      // validate
+      if (!validateRScriptPath(whichRScript.absolutePath(), pErrMsg))
+         return false;
+
+      // set it
+      *pRScriptPath = whichRScript.absolutePath();
+   }
+   // otherwise use the system default (after validating it as well)
+   else
+   {
+      // get system default
+      FilePath sysRScript = systemDefaultRScript(pErrMsg);
+      if (sysRScript.empty())
+         return false;
+
+      if (!validateRScriptPath(sysRScript.absolutePath(), pErrMsg))
+         return false;
+
+      // set it
+      *pRScriptPath = sysRScript.absolutePath();
+   }
+
+   // detect R locations (using the cache if it is still valid)
+   RLocations locations;
+   locations.rScriptPath = *pRScriptPath;
+   bool cached = readCachedRLocations(cacheFile, ldPathsScript, &locations);
+   if (!cached)
+   {
+      if (!detectRLocations(ldPathsScript, &locations, pErrMsg))
+         return false;
+   }
+   std::string rScriptPath = *pRScriptPath;
+   *pRScriptPath = locations.rScriptPath;
+   FilePath rHomePath = locations.rHomePath;
+   FilePath rLibPath = locations.rLibPath;
+   config_utils::Variables& scriptVars = locations.scriptVars;
+   std::string extraPaths = locations.extraPaths;
 
    // set R home path
    pVars->push_back(std::make_pair("R_HOME", rHomePath.absolutePath()));
@@ -668,8 +791,6 @@ bool detectREnvironment(const FilePath& whichRScript,
    if (!libraryPath.empty())
       libraryPath.append(":");
    libraryPath.append(rLibPath.absolutePath());
-   std::string extraPaths = extraLibraryPaths(ldPathsScript,
-                                              rHomePath.absolutePath());
    if (!extraPaths.empty())
       libraryPath.append(":" + extraPaths);
    pVars->push_back(std::make_pair(kLibraryPathEnvVariable, libraryPath));
@@ -688,7 +809,48 @@ bool detectREnvironment(const FilePath& whichRScript,
 #endif
 
 
-   return validateREnvironment(*pVars, rLibPath, pErrMsg);
+   if (!validateREnvironment(*pVars, rLibPath, pErrMsg))
+   {
+      // cached locations may have been invalidated without the scripts
+      // changing (e.g. R removed or moved) so discard them and try again
+      if (cached)
+      {
+         Error error = cacheFile.removeIfExists();
+         if (error)
+            LOG_ERROR(error);
+         pVars->clear();
+         pErrMsg->clear();
+         return detectREnvironment(whichRScript,
+                                   ldPathsScript,
+                                   ldLibraryPath,
+                                   FilePath(),
+                                   pRScriptPath,
+                                   pVars,
+                                   pErrMsg);
+      }
+      return false;
+   }
+
+   if (!cached)
+      writeCachedRLocations(cacheFile, rScriptPath, ldPathsScript, locations);
+
+   return true;
+}
+
+bool detectREnvironment(const FilePath& whichRScript,
+                        const FilePath& ldPathsScript,
+                        const std::string& ldLibraryPath,
+                        std::string* pRScriptPath,
+                        EnvironmentVars* pVars,
+                        std::string* pErrMsg)
+{
+   return detectREnvironment(whichRScript,
+                             ldPathsScript,
+                             ldLibraryPath,
+                             FilePath(),
+                             pRScriptPath,
+                             pVars,
+                             pErrMsg);
 }
 
 
@@ -66,6 +66,11 @@ Error RPackageInfo::read(const FilePath& packageDir)
    else
       return fieldNotFoundError(descFilePath, "Version", ERROR_LOCATION);
 
+   // Title field
+   it = fields.find("Title");
+   if (it != fields.end())
+      title_ = text::dcfMultilineAsFolded(it->second);
+
    // Linking to field
    it = fields.find("LinkingTo");
    if (it != fields.end())
@@ -0,0 +1,259 @@
+/*
+ * RRepositoryIndex.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/r_util/RRepositoryIndex.hpp>
+
+#include <iostream>
+#include <algorithm>
+
+#include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+#include <core/Hash.hpp>
+
+#include <core/system/System.hpp>
+
+#include <core/text/DcfParser.hpp>
+
+namespace core {
+namespace r_util {
+
+namespace {
+
+// the fields reported by available.packages (other than Repository,
+// which R adds from the contrib url)
+const char * const kIndexFields[] = {
+   "Package", "Version", "Priority", "Depends", "Imports", "LinkingTo",
+   "Suggests", "Enhances", "License", "License_is_FOSS",
+   "License_restricts_use", "OS_type", "Archs", "MD5sum",
+   "NeedsCompilation", "File"
+};
+const std::size_t kIndexFieldCount =
+                        sizeof(kIndexFields) / sizeof(kIndexFields[0]);
+
+// file format: magic and version, followed by a count of fields and their
+// names, then a count of packages each of which has a value for every
+// field. integers are written little endian and strings are written as a
+// length followed by their bytes
+const char kMagic[] = { 'R', 'S', 'R', 'I' };
+const boost::uint32_t kVersion = 1;
+
+// sanity limit on counts and string lengths read from the index
+const boost::uint32_t kMaxCount = 64 * 1024 * 1024;
+
+void writeUInt32(std::ostream& os, boost::uint32_t value)
+{
+   for (std::size_t i = 0; i < 4; i++)
+      os.put(static_cast<char>((value >> (i * 8)) & 0xFF));
+}
+
+void writeString(std::ostream& os, const std::string& value)
+{
+   writeUInt32(os, static_cast<boost::uint32_t>(value.size()));
+   os.write(value.data(), value.size());
+}
+
+bool readUInt32(std::istream& is, boost::uint32_t* pValue)
+{
+   *pValue = 0;
+   for (std::size_t i = 0; i < 4; i++)
+   {
+      int c = is.get();
+      if (c == std::char_traits<char>::eof())
+         return false;
+      *pValue |= static_cast<boost::uint32_t>(c & 0xFF) << (i * 8);
+   }
+   return true;
+}
+
+bool readString(std::istream& is, std::string* pValue)
+{
+   boost::uint32_t size;
+   if (!readUInt32(is, &size) || size > kMaxCount)
+      return false;
+
+   pValue->resize(size);
+   if (size > 0)
+      is.read(&(*pValue)[0], size);
+   return is.good();
+}
+
+Error corruptIndexError(const FilePath& indexFile,
+                        const ErrorLocation& location)
+{
+   Error error = systemError(boost::system::errc::illegal_byte_sequence,
+                             location);
+   error.addProperty("path", indexFile.absolutePath());
+   return error;
+}
+
+// PACKAGES files are a sequence of dcf records each of which begins with
+// its Package field
+void recordField(const std::vector<std::string>& fields,
+                 std::vector<std::vector<std::string> >* pPackages,
+                 const std::pair<std::string,std::string>& field)
+{
+   if (field.first == "Package")
+      pPackages->push_back(std::vector<std::string>(fields.size()));
+   else if (pPackages->empty())
+      return;
+
+   std::vector<std::string>::const_iterator it =
+                     std::find(fields.begin(), fields.end(), field.first);
+   if (it != fields.end())
+      pPackages->back()[it - fields.begin()] = field.second;
+}
+
+} // anonymous namespace
+
+Error RRepositoryIndex::parse(const std::string& packagesFile)
+{
+   fields_.assign(kIndexFields, kIndexFields + kIndexFieldCount);
+   packages_.clear();
+
+   std::string userErrMsg;
+   Error error = text::parseDcfFile(packagesFile,
+                                    true,
+                                    boost::bind(recordField,
+                                                boost::cref(fields_),
+                                                &packages_,
+                                                _1),
+                                    &userErrMsg);
+   if (error)
+      packages_.clear();
+   return error;
+}
+
+Error RRepositoryIndex::readFromFile(const FilePath& indexFile)
+{
+   fields_.clear();
+   packages_.clear();
+
+   boost::shared_ptr<std::istream> pIfs;
+   Error error = indexFile.open_r(&pIfs);
+   if (error)
+      return error;
+   std::istream& is = *pIfs;
+
+   // check magic and version (stale versions are treated as empty)
+   char magic[sizeof(kMagic)];
+   is.read(magic, sizeof(kMagic));
+   boost::uint32_t version;
+   if (!is.good() ||
+       !std::equal(magic, magic + sizeof(kMagic), kMagic) ||
+       !readUInt32(is, &version))
+   {
+      return corruptIndexError(indexFile, ERROR_LOCATION);
+   }
+   else if (version != kVersion)
+   {
+      return Success();
+   }
+
+   boost::uint32_t fieldCount;
+   if (!readUInt32(is, &fieldCount) || fieldCount == 0 ||
+       fieldCount > kMaxCount)
+   {
+      return corruptIndexError(indexFile, ERROR_LOCATION);
+   }
+   fields_.resize(fieldCount);
+   for (boost::uint32_t i = 0; i < fieldCount; i++)
+   {
+      if (!readString(is, &fields_[i]))
+      {
+         fields_.clear();
+         return corruptIndexError(indexFile, ERROR_LOCATION);
+      }
+   }
+
+   boost::uint32_t packageCount;
+   if (!readUInt32(is, &packageCount) || packageCount > kMaxCount)
+   {
+      fields_.clear();
+      return corruptIndexError(indexFile, ERROR_LOCATION);
+   }
+   packages_.reserve(packageCount);
+   for (boost::uint32_t i = 0; i < packageCount; i++)
+   {
+      packages_.push_back(std::vector<std::string>(fieldCount));
+      for (boost::uint32_t j = 0; j < fieldCount; j++)
+      {
+         if (!readString(is, &(packages_.back()[j])))
+         {
+            fields_.clear();
+            packages_.clear();
+            return corruptIndexError(indexFile, ERROR_LOCATION);
+         }
+      }
+   }
+
+   return Success();
+}
+
+Error RRepositoryIndex::writeToFile(const FilePath& indexFile) const
+{
+   FilePath tempFile = indexFile.parent().complete(
+         indexFile.filename() + "." + core::system::generateShortenedUuid());
+
+   {
+      boost::shared_ptr<std::ostream> pOfs;
+      Error error = tempFile.open_w(&pOfs);
+      if (error)
+         return error;
+      std::ostream& os = *pOfs;
+
+      os.write(kMagic, sizeof(kMagic));
+      writeUInt32(os, kVersion);
+      writeUInt32(os, static_cast<boost::uint32_t>(fields_.size()));
+      for (std::size_t i = 0; i < fields_.size(); i++)
+         writeString(os, fields_[i]);
+      writeUInt32(os, static_cast<boost::uint32_t>(packages_.size()));
+      for (std::size_t i = 0; i < packages_.size(); i++)
+      {
+         for (std::size_t j = 0; j < fields_.size(); j++)
+            writeString(os, packages_[i][j]);
+      }
+
+      os.flush();
+      if (!os.good())
+      {
+         Error error = systemError(boost::system::errc::io_error,
+                                   ERROR_LOCATION);
+         error.addProperty("path", tempFile.absolutePath());
+         tempFile.removeIfExists();
+         return error;
+      }
+   }
+
+   Error error = tempFile.move(indexFile);
+   if (error)
+      tempFile.removeIfExists();
+   return error;
+}
+
+std::string repositoryIndexFilename(const std::string& contribUrl)
+{
+   // (trailing slashes don't distinguish urls)
+   std::string url = contribUrl;
+   while (!url.empty() && url[url.size() - 1] == '/')
+      url.erase(url.size() - 1);
+   return hash::xxHash64(url) + ".index";
+}
+
+} // namespace r_util
+} // namespace core
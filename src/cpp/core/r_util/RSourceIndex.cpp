@@ -15,6 +15,9 @@
 
 #include <core/r_util/RSourceIndex.hpp>
 
+#include <algorithm>
+
+#include <boost/foreach.hpp>
 #include <boost/algorithm/string.hpp>
 
 #include <core/StringUtils.hpp>
@@ -190,11 +193,33 @@ void parseSignature(RTokens::const_iterator begin,
 }
 
 
-}  // anonymous namespace
+// can a fresh scan begin at a line start which follows this token (i.e.
+// is the previous statement complete and unable to affect the scan of
+// what follows)
+bool canResumeAfter(const RToken& token)
+{
+   if (!token)
+      return true;
 
-RSourceIndex::RSourceIndex(const std::string& context,
-                           const std::string& code)
-   : context_(context)
+   wchar_t type = token.type();
+   return type == RToken::RPAREN ||
+          type == RToken::RBRACE ||
+          type == RToken::RBRACKET ||
+          type == RToken::RDBRACKET ||
+          type == RToken::STRING ||
+          type == RToken::NUMBER ||
+          type == RToken::SEMI;
+}
+
+// index the code, which begins at the specified line of a document (and
+// at a point where indexing can begin), adding to the items and the lines
+// at which it could be resumed. returns true if the code ends at a point
+// where indexing could be resumed
+bool indexCode(const std::string& context,
+               const std::string& code,
+               std::size_t firstLine,
+               std::vector<RSourceItem>* pItems,
+               std::vector<std::size_t>* pCheckpoints)
 {
    // convert code to wide
    std::wstring wCode = string_utils::utf8ToWide(code, context);
@@ -208,11 +233,79 @@ RSourceIndex::RSourceIndex(const std::string& context,
    std::vector<std::size_t>::const_iterator newlineIter = newlineLocs.begin();
    std::vector<std::size_t>::const_iterator endNewlines = newlineLocs.end();
 
-   // tokenize
-   RTokens rTokens(wCode, RTokens::StripWhitespace | RTokens::StripComments);
+   // tokenize, stripping whitespace and comments and noting the lines
+   // which start at the top level between complete statements
+   RTokens allTokens(wCode);
+   std::vector<RToken> tokens;
+   tokens.reserve(allTokens.size() / 2);
+   if (firstLine == 1 || !wCode.empty())
+      pCheckpoints->push_back(firstLine);
+   std::size_t currentLine = firstLine;
+   int braceLevel = 0;
+   int nestingLevel = 0;
+   RToken lastToken;
+   bool unclosedDelimiter = false;
+   bool atCheckpoint = true;
+   BOOST_FOREACH(const RToken& token, allTokens)
+   {
+      if (token.type() == RToken::WHITESPACE)
+      {
+         bool canResume = braceLevel == 0 &&
+                          nestingLevel == 0 &&
+                          !unclosedDelimiter &&
+                          canResumeAfter(lastToken);
+         for (std::size_t i = 0; i < token.length(); i++)
+         {
+            if (wCode[token.offset() + i] != L'\n')
+               continue;
+
+            currentLine++;
+            if (canResume && (token.offset() + i + 1) < wCode.length())
+               pCheckpoints->push_back(currentLine);
+         }
+         atCheckpoint = canResume &&
+                        wCode[token.offset() + token.length() - 1] == L'\n';
+         continue;
+      }
+      else if (token.type() == RToken::COMMENT)
+      {
+         atCheckpoint = false;
+         continue;
+      }
+      else if (token.type() == RToken::LBRACE)
+         braceLevel++;
+      else if (token.type() == RToken::RBRACE)
+         braceLevel--;
+      else if (token.type() == RToken::LPAREN ||
+               token.type() == RToken::LBRACKET)
+         nestingLevel++;
+      else if (token.type() == RToken::RPAREN ||
+               token.type() == RToken::RBRACKET)
+         nestingLevel = std::max(0, nestingLevel - 1);
+      else if (token.type() == RToken::LDBRACKET)
+         nestingLevel += 2;
+      else if (token.type() == RToken::RDBRACKET)
+         nestingLevel = std::max(0, nestingLevel - 2);
+
+      // an unclosed ` or % is matched against the rest of the document so
+      // everything after it depends on what follows
+      if (token.type() == RToken::ERR &&
+               (wCode[token.offset()] == L'`' || wCode[token.offset()] == L'%'))
+         unclosedDelimiter = true;
+
+      // newlines within other tokens (e.g. strings)
+      currentLine += std::count(wCode.begin() + token.offset(),
+                                wCode.begin() + token.offset() +
+                                                         token.length(),
+                                L'\n');
+
+      atCheckpoint = false;
+      lastToken = token;
+      tokens.push_back(token);
+   }
 
    // scan for function, method, and class definitions (track indent level)
-   int braceLevel = 0;
+   braceLevel = 0;
    std::wstring function(L"function");
    std::wstring set(L"set");
    std::wstring setGeneric(L"setGeneric");
@@ -223,7 +316,7 @@ RSourceIndex::RSourceIndex(const std::string& context,
    std::wstring eqOp(L"=");
    std::wstring assignOp(L"<-");
    std::wstring parentAssignOp(L"<<-");
-   for (std::size_t i=0; i<rTokens.size(); i++)
+   for (std::size_t i=0; i<tokens.size(); i++)
    {
       // initial name, qualifer, and type are nil
       RSourceItem::Type type = RSourceItem::None;
@@ -233,7 +326,7 @@ RSourceIndex::RSourceIndex(const std::string& context,
       std::vector<RS4MethodParam> signature;
 
       // alias the token
-      const RToken& token = rTokens.at(i);
+      const RToken& token = tokens.at(i);
 
       // see if this is a begin or end brace and update the level
       if (token.type() == RToken::LBRACE)
@@ -279,25 +372,25 @@ RSourceIndex::RSourceIndex(const std::string& context,
          }
 
          // make sure there are at least 4 more tokens
-         if ( (i + 3) >= rTokens.size())
+         if ( (i + 3) >= tokens.size())
             continue;
 
          // check for the rest of the token sequene for a valid call to set*
-         if ( (rTokens.at(i+1).type() != RToken::LPAREN) ||
-              (rTokens.at(i+2).type() != RToken::STRING) ||
-              (rTokens.at(i+3).type() != RToken::COMMA))
+         if ( (tokens.at(i+1).type() != RToken::LPAREN) ||
+              (tokens.at(i+2).type() != RToken::STRING) ||
+              (tokens.at(i+3).type() != RToken::COMMA))
             continue;
 
          // found a class or method definition (will find location below)
          type = setType;
-         name = removeQuoteDelims(rTokens.at(i+2).content());
+         name = removeQuoteDelims(tokens.at(i+2).content());
          tokenOffset = token.offset();
 
          // if this was a setMethod then try to lookahead for the signature
          if (isSetMethod)
          {
-            parseSignature(rTokens.begin() + (i+4),
-                           rTokens.end(),
+            parseSignature(tokens.begin() + (i+4),
+                           tokens.end(),
                            &signature);
          }
       }
@@ -311,7 +404,7 @@ RSourceIndex::RSourceIndex(const std::string& context,
             continue;
 
          // check for an assignment operator
-         const RToken& opToken = rTokens.at(i-1);
+         const RToken& opToken = tokens.at(i-1);
          if ( opToken.type() != RToken::OPER)
             continue;
          if (!opToken.isOperator(eqOp) &&
@@ -320,7 +413,7 @@ RSourceIndex::RSourceIndex(const std::string& context,
             continue;
 
          // check for an identifier
-         const RToken& idToken = rTokens.at(i-2);
+         const RToken& idToken = tokens.at(i-2);
          if ( idToken.type() != RToken::ID )
             continue;
 
@@ -328,7 +421,7 @@ RSourceIndex::RSourceIndex(const std::string& context,
          // comma or an open paren
          if ( i > 2 )
          {
-            const RToken& prevToken = rTokens.at(i-3);
+            const RToken& prevToken = tokens.at(i-3);
             if (prevToken.type() == RToken::LPAREN ||
                 prevToken.type() == RToken::COMMA)
                continue;
@@ -349,24 +442,187 @@ RSourceIndex::RSourceIndex(const std::string& context,
       newlineIter = std::upper_bound(newlineIter,
                                      endNewlines,
                                      tokenOffset);
-      std::size_t line = newlineIter - newlineLocs.begin() + 1;
+      std::size_t line = newlineIter - newlineLocs.begin() + firstLine;
 
       // compute column by comparing the offset to the PREVIOUS newline
-      // (guard against no previous newline)
+      // (guard against no previous newline, which is the start of the
+      // document or a line following a newline before this code)
       std::size_t column;
-      if (line > 1)
+      if (newlineIter != newlineLocs.begin())
          column = tokenOffset - *(newlineIter - 1);
+      else if (firstLine > 1)
+         column = tokenOffset + 1;
       else
          column = tokenOffset;
 
       // add to index
-      items_.push_back(RSourceItem(type,
-                                   string_utils::wideToUtf8(name),
-                                   signature,
-                                   braceLevel,
-                                   line,
-                                   column));
+      pItems->push_back(RSourceItem(type,
+                                    string_utils::wideToUtf8(name),
+                                    signature,
+                                    braceLevel,
+                                    line,
+                                    column));
+   }
+
+   return atCheckpoint;
+}
+
+// offsets of the starts of each line
+std::vector<std::size_t> lineStarts(const std::string& code)
+{
+   std::vector<std::size_t> starts;
+   starts.push_back(0);
+   std::size_t nextNL = 0;
+   while ( (nextNL = code.find('\n', nextNL)) != std::string::npos )
+      starts.push_back(++nextNL);
+   return starts;
+}
+
+}  // anonymous namespace
+
+RSourceIndex::RSourceIndex(const std::string& context,
+                           const std::string& code)
+   : context_(context), code_(code)
+{
+   indexCode(context_, code_, 1, &items_, &checkpoints_);
+}
+
+RSourceIndex::RSourceIndex(const std::string& context,
+                           const std::string& code,
+                           const RSourceIndex& previous)
+   : context_(context), code_(code)
+{
+   // if the previous index wasn't created from code then index it all
+   const std::string& prevCode = previous.code_;
+   if (previous.checkpoints_.empty())
+   {
+      indexCode(context_, code_, 1, &items_, &checkpoints_);
+      return;
+   }
+
+   // find the extent of the change
+   std::size_t maxCommon = std::min(prevCode.length(), code_.length());
+   std::size_t prefix = std::mismatch(prevCode.begin(),
+                                      prevCode.begin() + maxCommon,
+                                      code_.begin()).first - prevCode.begin();
+   std::size_t suffix = std::mismatch(prevCode.rbegin(),
+                                      prevCode.rbegin() + (maxCommon - prefix),
+                                      code_.rbegin()).first - prevCode.rbegin();
+
+   std::vector<std::size_t> prevStarts = lineStarts(prevCode);
+   std::vector<std::size_t> starts = lineStarts(code_);
+   int lineDelta = static_cast<int>(starts.size()) -
+                   static_cast<int>(prevStarts.size());
+
+   // start from the last checkpoint at or before the changed line
+   std::size_t changedLine = std::upper_bound(prevStarts.begin(),
+                                              prevStarts.end(),
+                                              prefix) - prevStarts.begin();
+   std::vector<std::size_t>::const_iterator startIt = std::upper_bound(
+                                                  previous.checkpoints_.begin(),
+                                                  previous.checkpoints_.end(),
+                                                  changedLine) - 1;
+   std::size_t startLine = *startIt;
+
+   // resume the previous index at the first checkpoint within the
+   // unchanged trailing lines (if the new code is in the same state there)
+   std::size_t resumeLine = 0;
+   std::size_t unchangedFrom = prevCode.length() - suffix;
+   std::vector<std::size_t>::const_iterator resumeIt = startIt;
+   for (; resumeIt != previous.checkpoints_.end(); ++resumeIt)
+   {
+      // the line must also start a line in the new code
+      std::size_t offset = prevStarts[*resumeIt - 1];
+      std::size_t newOffset = offset + code_.length() - prevCode.length();
+      if (offset >= unchangedFrom &&
+          offset < prevCode.length() &&
+          newOffset > 0 &&
+          code_[newOffset - 1] == '\n')
+      {
+         resumeLine = *resumeIt;
+         break;
+      }
+   }
+
+   // keep the items and checkpoints before the start line
+   BOOST_FOREACH(const RSourceItem& item, previous.items_)
+   {
+      if (static_cast<std::size_t>(item.line()) < startLine)
+         items_.push_back(item);
+   }
+   checkpoints_.assign(previous.checkpoints_.begin(), startIt);
+
+   // index the changed lines
+   std::size_t begin = starts[startLine - 1];
+   bool resumed = false;
+   if (resumeLine != 0)
+   {
+      // (nothing to index if lines were just removed)
+      std::size_t end = starts[resumeLine + lineDelta - 1];
+      resumed = (end == begin) || indexCode(context_,
+                          code_.substr(begin, end - begin),
+                          startLine,
+                          &items_,
+                          &checkpoints_);
+
+      // if the new code isn't in the same state at the resume point then
+      // index everything from the start line
+      if (!resumed)
+      {
+         items_.erase(std::remove_if(items_.begin(),
+                                     items_.end(),
+                                     boost::bind(&RSourceItem::line, _1) >=
+                                                static_cast<int>(startLine)),
+                      items_.end());
+         checkpoints_.assign(previous.checkpoints_.begin(), startIt);
+      }
+   }
+   if (!resumed)
+   {
+      indexCode(context_,
+                code_.substr(begin),
+                startLine,
+                &items_,
+                &checkpoints_);
+      return;
+   }
+
+   // shift the items and checkpoints from the resume line onwards
+   BOOST_FOREACH(const RSourceItem& item, previous.items_)
+   {
+      if (static_cast<std::size_t>(item.line()) >= resumeLine)
+      {
+         // columns on the first line are zero based
+         int line = item.line() + lineDelta;
+         int column = item.column();
+         if (item.line() == 1 && line > 1)
+            column++;
+         else if (item.line() > 1 && line == 1)
+            column--;
+         items_.push_back(item.withPosition(line, column));
+      }
+   }
+   for (; resumeIt != previous.checkpoints_.end(); ++resumeIt)
+      checkpoints_.push_back(*resumeIt + lineDelta);
+}
+
+std::size_t RSourceIndex::memoryUsage() const
+{
+   std::size_t bytes = sizeof(RSourceIndex) +
+                       context_.capacity() +
+                       code_.capacity() +
+                       (checkpoints_.capacity() * sizeof(std::size_t)) +
+                       (items_.capacity() * sizeof(RSourceItem));
+   BOOST_FOREACH(const RSourceItem& item, items_)
+   {
+      bytes += item.context().capacity() + item.name().capacity();
+      BOOST_FOREACH(const RS4MethodParam& param, item.signature())
+      {
+         bytes += sizeof(RS4MethodParam) +
+                  param.name().capacity() + param.type().capacity();
+      }
    }
+   return bytes;
 }
 
 } // namespace r_util
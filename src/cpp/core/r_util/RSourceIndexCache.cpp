@@ -0,0 +1,301 @@
+/*
+ * RSourceIndexCache.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/r_util/RSourceIndexCache.hpp>
+
+#include <iostream>
+#include <algorithm>
+
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+
+namespace core {
+namespace r_util {
+
+namespace {
+
+// file format: magic and version, followed by a count of entries. each
+// entry is the path, size and last write time of the file followed by
+// a count of items and then the items. integers are written little
+// endian and strings are written as a length followed by their bytes
+const char kMagic[] = { 'R', 'S', 'I', 'X' };
+const boost::uint32_t kVersion = 1;
+
+// sanity limit on counts and string lengths read from the cache
+const boost::uint32_t kMaxCount = 64 * 1024 * 1024;
+
+void writeUInt(std::ostream& os, boost::uint64_t value, std::size_t bytes)
+{
+   for (std::size_t i = 0; i < bytes; i++)
+      os.put(static_cast<char>((value >> (i * 8)) & 0xFF));
+}
+
+void writeUInt32(std::ostream& os, boost::uint32_t value)
+{
+   writeUInt(os, value, 4);
+}
+
+void writeUInt64(std::ostream& os, boost::uint64_t value)
+{
+   writeUInt(os, value, 8);
+}
+
+void writeString(std::ostream& os, const std::string& value)
+{
+   writeUInt32(os, static_cast<boost::uint32_t>(value.size()));
+   os.write(value.data(), value.size());
+}
+
+bool readUInt(std::istream& is, std::size_t bytes, boost::uint64_t* pValue)
+{
+   *pValue = 0;
+   for (std::size_t i = 0; i < bytes; i++)
+   {
+      int c = is.get();
+      if (c == std::char_traits<char>::eof())
+         return false;
+      *pValue |= static_cast<boost::uint64_t>(c & 0xFF) << (i * 8);
+   }
+   return true;
+}
+
+bool readUInt32(std::istream& is, boost::uint32_t* pValue)
+{
+   boost::uint64_t value;
+   if (!readUInt(is, 4, &value))
+      return false;
+   *pValue = static_cast<boost::uint32_t>(value);
+   return true;
+}
+
+bool readUInt64(std::istream& is, boost::uint64_t* pValue)
+{
+   return readUInt(is, 8, pValue);
+}
+
+bool readInt(std::istream& is, int* pValue)
+{
+   boost::uint32_t value;
+   if (!readUInt32(is, &value))
+      return false;
+   *pValue = static_cast<boost::int32_t>(value);
+   return true;
+}
+
+bool readString(std::istream& is, std::string* pValue)
+{
+   boost::uint32_t size;
+   if (!readUInt32(is, &size) || size > kMaxCount)
+      return false;
+
+   pValue->resize(size);
+   if (size > 0)
+      is.read(&(*pValue)[0], size);
+   return is.good();
+}
+
+void writeItem(std::ostream& os, const RSourceItem& item)
+{
+   writeUInt32(os, static_cast<boost::uint32_t>(item.type()));
+   writeString(os, item.name());
+
+   const std::vector<RS4MethodParam>& signature = item.signature();
+   writeUInt32(os, static_cast<boost::uint32_t>(signature.size()));
+   for (std::size_t i = 0; i < signature.size(); i++)
+   {
+      writeString(os, signature[i].name());
+      writeString(os, signature[i].type());
+   }
+
+   writeUInt32(os, static_cast<boost::uint32_t>(item.braceLevel()));
+   writeUInt32(os, static_cast<boost::uint32_t>(item.line()));
+   writeUInt32(os, static_cast<boost::uint32_t>(item.column()));
+}
+
+bool readItem(std::istream& is, RSourceItem* pItem)
+{
+   int type;
+   std::string name;
+   boost::uint32_t signatureSize;
+   if (!readInt(is, &type) ||
+       !readString(is, &name) ||
+       !readUInt32(is, &signatureSize) ||
+       signatureSize > kMaxCount)
+   {
+      return false;
+   }
+
+   std::vector<RS4MethodParam> signature;
+   for (boost::uint32_t i = 0; i < signatureSize; i++)
+   {
+      std::string paramName, paramType;
+      if (!readString(is, &paramName) || !readString(is, &paramType))
+         return false;
+      signature.push_back(RS4MethodParam(paramName, paramType));
+   }
+
+   int braceLevel, line, column;
+   if (!readInt(is, &braceLevel) || !readInt(is, &line) || !readInt(is, &column))
+      return false;
+
+   *pItem = RSourceItem(type, name, signature, braceLevel, line, column);
+   return true;
+}
+
+Error corruptCacheError(const FilePath& cacheFile,
+                        const ErrorLocation& location)
+{
+   Error error = systemError(boost::system::errc::illegal_byte_sequence,
+                             location);
+   error.addProperty("path", cacheFile.absolutePath());
+   return error;
+}
+
+} // anonymous namespace
+
+Error RSourceIndexCache::readFromFile(const FilePath& cacheFile)
+{
+   // clear existing
+   entries_.clear();
+
+   // open the file
+   boost::shared_ptr<std::istream> pIfs;
+   Error error = cacheFile.open_r(&pIfs);
+   if (error)
+      return error;
+   std::istream& is = *pIfs;
+
+   // check magic and version (stale versions are silently ignored)
+   char magic[sizeof(kMagic)];
+   is.read(magic, sizeof(kMagic));
+   boost::uint32_t version;
+   if (!is.good() ||
+       !std::equal(magic, magic + sizeof(kMagic), kMagic) ||
+       !readUInt32(is, &version))
+   {
+      return corruptCacheError(cacheFile, ERROR_LOCATION);
+   }
+   else if (version != kVersion)
+   {
+      return Success();
+   }
+
+   // read entries
+   boost::uint32_t entryCount;
+   if (!readUInt32(is, &entryCount) || entryCount > kMaxCount)
+      return corruptCacheError(cacheFile, ERROR_LOCATION);
+   for (boost::uint32_t i = 0; i < entryCount; i++)
+   {
+      std::string path;
+      boost::uint64_t size, lastWriteTime;
+      boost::uint32_t itemCount;
+      if (!readString(is, &path) ||
+          !readUInt64(is, &size) ||
+          !readUInt64(is, &lastWriteTime) ||
+          !readUInt32(is, &itemCount) ||
+          itemCount > kMaxCount)
+      {
+         entries_.clear();
+         return corruptCacheError(cacheFile, ERROR_LOCATION);
+      }
+
+      Entry& entry = entries_[path];
+      entry.size = static_cast<uintmax_t>(size);
+      entry.lastWriteTime = static_cast<std::time_t>(lastWriteTime);
+      entry.items.reserve(itemCount);
+      for (boost::uint32_t j = 0; j < itemCount; j++)
+      {
+         RSourceItem item;
+         if (!readItem(is, &item))
+         {
+            entries_.clear();
+            return corruptCacheError(cacheFile, ERROR_LOCATION);
+         }
+         entry.items.push_back(item);
+      }
+   }
+
+   return Success();
+}
+
+Error RSourceIndexCache::writeToFile(const FilePath& cacheFile) const
+{
+   boost::shared_ptr<std::ostream> pOfs;
+   Error error = cacheFile.open_w(&pOfs);
+   if (error)
+      return error;
+   std::ostream& os = *pOfs;
+
+   os.write(kMagic, sizeof(kMagic));
+   writeUInt32(os, kVersion);
+   writeUInt32(os, static_cast<boost::uint32_t>(entries_.size()));
+   for (std::map<std::string,Entry>::const_iterator it = entries_.begin();
+        it != entries_.end();
+        ++it)
+   {
+      const Entry& entry = it->second;
+      writeString(os, it->first);
+      writeUInt64(os, entry.size);
+      writeUInt64(os, static_cast<boost::uint64_t>(entry.lastWriteTime));
+      writeUInt32(os, static_cast<boost::uint32_t>(entry.items.size()));
+      for (std::size_t i = 0; i < entry.items.size(); i++)
+         writeItem(os, entry.items[i]);
+   }
+
+   os.flush();
+   if (!os.good())
+   {
+      Error error = systemError(boost::system::errc::io_error, ERROR_LOCATION);
+      error.addProperty("path", cacheFile.absolutePath());
+      return error;
+   }
+
+   return Success();
+}
+
+void RSourceIndexCache::add(const FileInfo& fileInfo,
+                            const std::vector<RSourceItem>& items)
+{
+   Entry& entry = entries_[fileInfo.absolutePath()];
+   entry.size = fileInfo.size();
+   entry.lastWriteTime = fileInfo.lastWriteTime();
+   entry.items = items;
+}
+
+bool RSourceIndexCache::find(const FileInfo& fileInfo,
+                             std::vector<RSourceItem>* pItems) const
+{
+   // can't validate entries without a last write time
+   if (fileInfo.lastWriteTime() == 0)
+      return false;
+
+   std::map<std::string,Entry>::const_iterator it =
+                                       entries_.find(fileInfo.absolutePath());
+   if (it == entries_.end() ||
+       it->second.size != fileInfo.size() ||
+       it->second.lastWriteTime != fileInfo.lastWriteTime())
+   {
+      return false;
+   }
+
+   *pItems = it->second.items;
+   return true;
+}
+
+} // namespace r_util
+} // namespace core
@@ -0,0 +1,159 @@
+/*
+ * RSourceSymbolIndex.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/r_util/RSourceSymbolIndex.hpp>
+
+#include <boost/regex.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+
+#include <core/StringUtils.hpp>
+#include <core/RegexUtils.hpp>
+
+namespace core {
+namespace r_util {
+
+namespace {
+
+bool isGlobalFunction(const RSourceItem& item)
+{
+   return item.braceLevel() == 0 &&
+          (item.type() == RSourceItem::Function ||
+           item.type() == RSourceItem::Method);
+}
+
+} // anonymous namespace
+
+void RSourceSymbolIndex::add(boost::shared_ptr<RSourceIndex> pIndex)
+{
+   // remove any existing index for this context
+   remove(pIndex->context());
+
+   // add the index and its items
+   indexes_[pIndex->context()] = pIndex;
+   const std::vector<RSourceItem>& items = pIndex->items();
+   for (std::size_t i = 0; i < items.size(); i++)
+   {
+      symbols_.insert(std::make_pair(string_utils::toLower(items[i].name()),
+                                     ItemRef(pIndex.get(), i)));
+   }
+}
+
+void RSourceSymbolIndex::remove(const std::string& context)
+{
+   Indexes::iterator indexIt = indexes_.find(context);
+   if (indexIt == indexes_.end())
+      return;
+
+   // remove the symbols which refer to this index
+   const RSourceIndex* pIndex = indexIt->second.get();
+   const std::vector<RSourceItem>& items = pIndex->items();
+   for (std::size_t i = 0; i < items.size(); i++)
+   {
+      std::pair<Symbols::iterator,Symbols::iterator> range =
+            symbols_.equal_range(string_utils::toLower(items[i].name()));
+      for (Symbols::iterator it = range.first; it != range.second; )
+      {
+         if (it->second.pIndex == pIndex)
+            symbols_.erase(it++);
+         else
+            ++it;
+      }
+   }
+
+   indexes_.erase(indexIt);
+}
+
+void RSourceSymbolIndex::clear()
+{
+   symbols_.clear();
+   indexes_.clear();
+}
+
+void RSourceSymbolIndex::search(const std::string& term,
+                                bool prefixOnly,
+                                bool caseSensitive,
+                                std::size_t maxResults,
+                                const std::set<std::string>& excludeContexts,
+                                std::vector<RSourceItem>* pItems) const
+{
+   // for prefix searches the symbols we need to look at are the range
+   // beginning with the literal portion of the term (everything prior to
+   // any wildcard). for substring searches we need to look at them all
+   std::string::size_type wildcardPos = term.find('*');
+   std::string prefix;
+   if (prefixOnly)
+      prefix = string_utils::toLower(term.substr(0, wildcardPos));
+
+   // create wildcard regex if necessary
+   boost::regex patternRegex;
+   if (wildcardPos != std::string::npos)
+   {
+      patternRegex = regex_utils::wildcardPatternToRegex(
+                           caseSensitive ? term : string_utils::toLower(term));
+   }
+
+   for (Symbols::const_iterator it = symbols_.lower_bound(prefix);
+        it != symbols_.end() && pItems->size() < maxResults;
+        ++it)
+   {
+      // bail once we are past the prefix range
+      if (!boost::algorithm::starts_with(it->first, prefix))
+         break;
+
+      // skip excluded contexts
+      const std::string& context = it->second.pIndex->context();
+      if (excludeContexts.find(context) != excludeContexts.end())
+         continue;
+
+      // check for a match
+      const RSourceItem& item = it->second.sourceItem();
+      bool matches;
+      if (!patternRegex.empty())
+         matches = item.nameMatches(patternRegex, prefixOnly, caseSensitive);
+      else if (prefixOnly)
+         matches = item.nameStartsWith(term, caseSensitive);
+      else
+         matches = item.nameContains(term, caseSensitive);
+
+      if (matches)
+         pItems->push_back(item.withContext(context));
+   }
+}
+
+bool RSourceSymbolIndex::findGlobalFunction(
+                           const std::string& name,
+                           const std::set<std::string>& excludeContexts,
+                           RSourceItem* pItem) const
+{
+   std::pair<Symbols::const_iterator,Symbols::const_iterator> range =
+                           symbols_.equal_range(string_utils::toLower(name));
+   for (Symbols::const_iterator it = range.first; it != range.second; ++it)
+   {
+      const RSourceItem& item = it->second.sourceItem();
+      const std::string& context = it->second.pIndex->context();
+      if (isGlobalFunction(item) &&
+          item.name() == name &&
+          excludeContexts.find(context) == excludeContexts.end())
+      {
+         *pItem = item.withContext(context);
+         return true;
+      }
+   }
+
+   return false;
+}
+
+} // namespace r_util
+} // namespace core
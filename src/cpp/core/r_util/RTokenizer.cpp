@@ -13,25 +13,10 @@
  *
  */
 
-// A very low level assertion (line 595 of cpp_regex_traits.hpp) is firing
-// on WindowsXP when we create a boost::wregex within R session. This code
-// is part of boost attempting to detect the sort syntax, and the assertion
-// is that there are no nulls in a buffer after a call to locale->transform.
-// Within the same method there are workarounds for both borland c++ and
-// dinkumware c++ std library to strip embedded nulls, so it seems as if
-// there is some variation in whether nulls come out of the call to transforn.
-// Note also that boost has a macro titled BOOST_REGEX_NO_WIN32 which we are
-// not using, which means that boost regex does call into native windows APIs
-// for locale oriented functions (thus explaining a difference in runtime
-// behavior across platforms). Tokenization appears to continue to work
-// correctly in the presence of the assertion (with the annoying side effect
-// of logging an assertion every time the product starts up)
-
 #include <core/r_util/RTokenizer.hpp>
 
-#include <boost/regex.hpp>
-
 #include <iostream>
+#include <algorithm>
 
 #include <core/Error.hpp>
 #include <core/Log.hpp>
@@ -43,35 +28,38 @@ namespace r_util {
 
 namespace {
 
-class TokenPatterns
+bool isWhitespace(wchar_t c)
 {
-private:
-   friend TokenPatterns& tokenPatterns();
-   TokenPatterns()
-      : NUMBER(L"[0-9]*(\\.[0-9]*)?([eE][+-]?[0-9]*)?[Li]?"),
-        HEX_NUMBER(L"0x[0-9a-fA-F]*L?"),
-        USER_OPERATOR(L"%[^%]*%"),
-        QUOTED_IDENTIFIER(L"`[^`]*`"),
-        UNTIL_END_QUOTE(L"[\\\\\'\"]"),
-        WHITESPACE(L"[\\s\x00A0\x3000]+"),
-        COMMENT(L"#.*?$")
+   switch (c)
    {
+   case L' ': case L'\t': case L'\r': case L'\n': case L'\v': case L'\f':
+   case L'\x00A0': case L'\x3000':
+      return true;
+   default:
+      return false;
    }
+}
+
+bool isLineTerminator(wchar_t c)
+{
+   switch (c)
+   {
+   case L'\n': case L'\r': case L'\f':
+   case L'\x0085': case L'\x2028': case L'\x2029':
+      return true;
+   default:
+      return false;
+   }
+}
+
+bool isDigit(wchar_t c)
+{
+   return c >= L'0' && c <= L'9';
+}
 
-public:
-   const boost::wregex NUMBER;
-   const boost::wregex HEX_NUMBER;
-   const boost::wregex USER_OPERATOR;
-   const boost::wregex QUOTED_IDENTIFIER;
-   const boost::wregex UNTIL_END_QUOTE;
-   const boost::wregex WHITESPACE;
-   const boost::wregex COMMENT;
-};
-
-TokenPatterns& tokenPatterns()
+bool isHexDigit(wchar_t c)
 {
-   static TokenPatterns instance;
-   return instance;
+   return isDigit(c) || (c >= L'a' && c <= L'f') || (c >= L'A' && c <= L'F');
 }
 
 } // anonymous namespace
@@ -168,8 +156,14 @@ RToken RTokenizer::nextToken()
 
 RToken RTokenizer::matchWhitespace()
 {
-   std::wstring whitespace = peek(tokenPatterns().WHITESPACE) ;
-   return consumeToken(RToken::WHITESPACE, whitespace.length()) ;
+   std::wstring::const_iterator start = pos_ ;
+   std::wstring::const_iterator end = data_.end();
+   while (pos_ != end && isWhitespace(*pos_))
+      pos_++;
+   return RToken(RToken::WHITESPACE,
+                 start,
+                 pos_,
+                 start - data_.begin());
 }
 
 RToken RTokenizer::matchStringLiteral()
@@ -179,7 +173,10 @@ RToken RTokenizer::matchStringLiteral()
 
    while (!eol())
    {
-      eatUntil(tokenPatterns().UNTIL_END_QUOTE);
+      // skip to the next quote or escape
+      std::wstring::const_iterator end = data_.end();
+      while (pos_ != end && *pos_ != L'\\' && *pos_ != L'\'' && *pos_ != L'"')
+         pos_++;
 
       if (eol())
          break ;
@@ -217,11 +214,41 @@ RToken RTokenizer::matchStringLiteral()
 
 RToken RTokenizer::matchNumber()
 {
-   std::wstring num = peek(tokenPatterns().HEX_NUMBER) ;
-   if (num.empty())
-      num = peek(tokenPatterns().NUMBER) ;
+   std::size_t length = 0;
 
-   return consumeToken(RToken::NUMBER, num.length());
+   // hex: 0x[0-9a-fA-F]*L?
+   if (peek() == L'0' && peek(1) == L'x')
+   {
+      length = 2;
+      while (isHexDigit(peek(length)))
+         length++;
+      if (peek(length) == L'L')
+         length++;
+   }
+   // decimal: [0-9]*(\.[0-9]*)?([eE][+-]?[0-9]*)?[Li]?
+   else
+   {
+      while (isDigit(peek(length)))
+         length++;
+      if (peek(length) == L'.')
+      {
+         length++;
+         while (isDigit(peek(length)))
+            length++;
+      }
+      if (peek(length) == L'e' || peek(length) == L'E')
+      {
+         length++;
+         if (peek(length) == L'+' || peek(length) == L'-')
+            length++;
+         while (isDigit(peek(length)))
+            length++;
+      }
+      if (peek(length) == L'L' || peek(length) == L'i')
+         length++;
+   }
+
+   return consumeToken(RToken::NUMBER, length);
 }
 
 RToken RTokenizer::matchIdentifier()
@@ -238,26 +265,33 @@ RToken RTokenizer::matchIdentifier()
 
 RToken RTokenizer::matchQuotedIdentifier()
 {
-   std::wstring iden = peek(tokenPatterns().QUOTED_IDENTIFIER) ;
-   if (iden.empty())
+   std::size_t length = lengthToDelimiter(L'`');
+   if (length == 0)
       return consumeToken(RToken::ERR, 1);
    else
-      return consumeToken(RToken::ID, iden.length());
+      return consumeToken(RToken::ID, length);
 }
 
 RToken RTokenizer::matchComment()
 {
-   std::wstring comment = peek(tokenPatterns().COMMENT);
-   return consumeToken(RToken::COMMENT, comment.length());
+   // comments run up to the end of the line
+   std::wstring::const_iterator start = pos_ ;
+   std::wstring::const_iterator end = data_.end();
+   while (pos_ != end && !isLineTerminator(*pos_))
+      pos_++;
+   return RToken(RToken::COMMENT,
+                 start,
+                 pos_,
+                 start - data_.begin());
 }
 
 RToken RTokenizer::matchUserOperator()
 {
-   std::wstring oper = peek(tokenPatterns().USER_OPERATOR) ;
-   if (oper.empty())
+   std::size_t length = lengthToDelimiter(L'%');
+   if (length == 0)
       return consumeToken(RToken::ERR, 1) ;
    else
-      return consumeToken(RToken::UOPER, oper.length()) ;
+      return consumeToken(RToken::UOPER, length) ;
 }
 
 
@@ -314,37 +348,18 @@ wchar_t RTokenizer::eat()
    return result ;
 }
 
-std::wstring RTokenizer::peek(const boost::wregex& regex)
-{
-   boost::wsmatch match;
-   std::wstring::const_iterator end = data_.end();
-   boost::match_flag_type flg = boost::match_default | boost::match_continuous;
-   if (boost::regex_search(pos_, end, match, regex, flg))
-   {
-      return match[0];
-   }
-   else
-   {
-      return std::wstring();
-   }
-}
-
-void RTokenizer::eatUntil(const boost::wregex& regex)
+std::size_t RTokenizer::lengthToDelimiter(wchar_t delim)
 {
-   boost::wsmatch match;
+   // length of the token from the delimiter at the current position up to
+   // and including the next one (0 if it isn't closed)
    std::wstring::const_iterator end = data_.end();
-   if (boost::regex_search(pos_, end, match, regex))
-   {
-      pos_ = match[0].first;
-   }
+   std::wstring::const_iterator close = std::find(pos_ + 1, end, delim);
+   if (close == end)
+      return 0;
    else
-   {
-      // eat all on failure to match
-      pos_ = data_.end();
-   }
+      return (close - pos_) + 1;
 }
 
-
 RToken RTokenizer::consumeToken(wchar_t tokenType, std::size_t length)
 {
    if (length == 0)
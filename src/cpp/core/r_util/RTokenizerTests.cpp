@@ -16,6 +16,7 @@
 #include <core/r_util/RTokenizer.hpp>
 
 #include <iostream>
+#include <deque>
 
 #include <boost/assert.hpp>
 #include <boost/foreach.hpp>
@@ -190,6 +190,12 @@ const HunspellCustomDictionaries&  HunspellDictionaryManager::custom() const
    return customDicts_;
 }
 
+FilePath HunspellDictionaryManager::precompiledDicPath(
+                           const HunspellDictionary& dictionary) const
+{
+   return userDir_.childPath("cache").childPath(dictionary.id() + ".dicmap");
+}
+
 FilePath HunspellDictionaryManager::allLanguagesDir() const
 {
    return userDir_.childPath("languages-system");
@@ -15,7 +15,10 @@
 
 #include <core/spelling/HunspellSpellingEngine.hpp>
 
+#include <list>
+
 #include <boost/foreach.hpp>
+#include <boost/unordered_map.hpp>
 #include <boost/algorithm/string.hpp>
 
 #include <core/Error.hpp>
@@ -156,6 +159,7 @@ public:
    }
 
    Error initialize(const HunspellDictionary& dictionary,
+                    const FilePath& precompiledDicPath,
                     const IconvstrFunction& iconvstrFunc)
    {
       // validate that dictionaries exist
@@ -170,9 +174,27 @@ public:
       std::string systemDicPath = string_utils::utf8ToSystem(
                                     dictionary.dicPath().absolutePath());
 
+      // the dictionary's words are read from a precompiled copy which is
+      // memory-mapped read-only (so it's shared by every engine and session
+      // using it). hunspell writes the copy if it's missing or out of date
+      std::string systemPrecompiledPath;
+      Error error = precompiledDicPath.parent().ensureDirectory();
+      if (!error)
+      {
+         systemPrecompiledPath = string_utils::utf8ToSystem(
+                                       precompiledDicPath.absolutePath());
+      }
+      else
+      {
+         LOG_ERROR(error);
+      }
+
       // initialize hunspell, iconvstrFunc_, and encoding_
       pHunspell_.reset(new Hunspell(systemAffPath.c_str(),
-                                    systemDicPath.c_str()));
+                                    systemDicPath.c_str(),
+                                    NULL,
+                                    systemPrecompiledPath.empty() ?
+                                       NULL : systemPrecompiledPath.c_str()));
       iconvstrFunc_ = iconvstrFunc;
       encoding_ = pHunspell_->get_dic_encoding();
 
@@ -180,6 +202,7 @@ public:
       FilePath dicPath = dictionary.dicPath();
       FilePath dicDeltaPath = dicPath.parent().childPath(
                                                 dicPath.stem() + ".dic_delta");
+      // (these words, like custom dictionaries, are kept privately)
       if (dicDeltaPath.exists())
       {
          Error error = mergeDicDeltaFile(dicDeltaPath);
@@ -369,6 +392,59 @@ private:
    std::string encoding_;
 };
 
+// least recently used cache of spell check results. documents are checked
+// in their entirety (and re-checked as they are edited) so the same words
+// are checked again and again
+class SpellingCache : boost::noncopyable
+{
+public:
+   explicit SpellingCache(std::size_t capacity)
+      : capacity_(capacity)
+   {
+   }
+
+   bool lookup(const std::string& word, bool* pCorrect)
+   {
+      Index::iterator it = index_.find(word);
+      if (it == index_.end())
+         return false;
+
+      // move to the front of the list (most recently used)
+      entries_.splice(entries_.begin(), entries_, it->second);
+      *pCorrect = it->second->second;
+      return true;
+   }
+
+   void insert(const std::string& word, bool correct)
+   {
+      if (index_.find(word) != index_.end())
+         return;
+
+      entries_.push_front(std::make_pair(word, correct));
+      index_[word] = entries_.begin();
+
+      // evict the least recently used entry if we are over capacity
+      if (index_.size() > capacity_)
+      {
+         index_.erase(entries_.back().first);
+         entries_.pop_back();
+      }
+   }
+
+   void clear()
+   {
+      index_.clear();
+      entries_.clear();
+   }
+
+private:
+   typedef std::list<std::pair<std::string, bool> > Entries;
+   typedef boost::unordered_map<std::string, Entries::iterator> Index;
+   std::size_t capacity_;
+   Entries entries_;
+   Index index_;
+};
+
 } // anonymous namespace
 
 struct HunspellSpellingEngine::Impl
@@ -378,7 +454,8 @@ struct HunspellSpellingEngine::Impl
         const IconvstrFunction& iconvstrFunction)
       : currentLangId_(langId),
         dictManager_(dictionaryManager),
-        iconvstrFunction_(iconvstrFunction)
+        iconvstrFunction_(iconvstrFunction),
+        cache_(10000)
    {
    }
 
@@ -396,6 +473,22 @@ struct HunspellSpellingEngine::Impl
       return *pSpellChecker_;
    }
 
+   Error checkSpelling(const std::string& word, bool *pCorrect)
+   {
+      // make sure the dictionaries (and therefore the cache) are current
+      SpellChecker& checker = spellChecker();
+
+      if (cache_.lookup(word, pCorrect))
+         return Success();
+
+      Error error = checker.checkSpelling(word, pCorrect);
+      if (error)
+         return error;
+
+      cache_.insert(word, *pCorrect);
+      return Success();
+   }
+
 private:
    bool dictionaryContextChanged(const std::string& langId)
    {
@@ -405,13 +498,19 @@ private:
 
    void resetDictionaries(const std::string& langId)
    {
+      // cached results are only valid for the current dictionaries
+      cache_.clear();
+
       HunspellDictionary dict = dictManager_.dictionaryForLanguageId(langId);
       if (!dict.empty())
       {
          HunspellSpellChecker* pHunspell = new HunspellSpellChecker();
          pSpellChecker_.reset(pHunspell);
 
-         Error error = pHunspell->initialize(dict, iconvstrFunction_);
+         Error error = pHunspell->initialize(
+                                       dict,
+                                       dictManager_.precompiledDicPath(dict),
+                                       iconvstrFunction_);
          if (!error)
          {
             currentLangId_ = langId;
@@ -448,6 +547,7 @@ private:
    HunspellDictionaryManager dictManager_;
    IconvstrFunction iconvstrFunction_;
    boost::shared_ptr<SpellChecker> pSpellChecker_;
+   SpellingCache cache_;
 };
 
 
@@ -468,7 +568,7 @@ void HunspellSpellingEngine::useDictionary(const std::string& langId)
 Error HunspellSpellingEngine::checkSpelling(const std::string& word,
                                             bool *pCorrect)
 {
-   return pImpl_->spellChecker().checkSpelling(word, pCorrect);
+   return pImpl_->checkSpelling(word, pCorrect);
 }
 
 Error HunspellSpellingEngine::suggestionList(const std::string& word,
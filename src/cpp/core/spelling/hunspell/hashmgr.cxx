@@ -5,14 +5,91 @@
 #include <string.h>
 #include <stdio.h> 
 #include <ctype.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
 
 #include "hashmgr.hxx"
 #include "csutil.hxx"
 #include "atypes.hxx"
 
+// precompiled (memory-mappable) hash table: a header, the bucket array
+// and then the entries. entries refer to each other (and buckets to entries)
+// by their offset from the start of the table, 0 meaning none
+
+#define MAPPED_MAGIC "HUNMAP01"
+
+// size of the private hash table used alongside a mapped table
+#define MAPPED_PRIVATE_TABLESIZE (4 * USERWORD + 1)
+
+struct mheader
+{
+  char      magic[8];
+  unsigned int longsize;  // hash values depend on the size of long
+  unsigned int tablesize;
+  unsigned int maxentry;  // size of the largest entry once copied (bytes)
+  unsigned int size;      // size of the whole precompiled table
+  // the dic and aff files the table was precompiled from
+  long long dicsize;
+  long long dicmtime;
+  long long affsize;
+  long long affmtime;
+};
+
+struct mentry
+{
+  unsigned int next;          // next entry with same hash code
+  unsigned int next_homonym;  // next homonym word (with same hash code)
+  short     alen;             // length of affix flag vector
+  unsigned char blen;
+  unsigned char clen;
+  char      var;
+  // followed by the affix flag vector, the word and (with H_OPT) the
+  // morphological description, padded to a multiple of 4 bytes
+};
+
+static inline const unsigned short * mentry_flags(const struct mentry * mp)
+{
+  return (const unsigned short *) (mp + 1);
+}
+
+static inline const char * mentry_word(const struct mentry * mp)
+{
+  return (const char *) (mentry_flags(mp) + mp->alen);
+}
+
+// bytes required to copy the entry into a hentry
+static inline size_t mentry_hentry_size(const struct mentry * mp)
+{
+  size_t size = sizeof(struct hentry) + mp->blen;
+  if (mp->var & H_OPT) size += strlen(mentry_word(mp) + mp->blen + 1) + 1;
+  return size;
+}
+
+// copy an entry into hp (the affix flag vector is left in the table)
+static void mentry_to_hentry(const struct mentry * mp, struct hentry * hp)
+{
+  const char * word = mentry_word(mp);
+  hp->blen = mp->blen;
+  hp->clen = mp->clen;
+  hp->alen = mp->alen;
+  hp->astr = mp->alen ? (unsigned short *) mentry_flags(mp) : NULL;
+  hp->next = NULL;
+  hp->next_homonym = NULL;
+  hp->var = mp->var;
+  memcpy(hp->word, word, mp->blen + 1);
+  if (mp->var & H_OPT) strcpy(hp->word + mp->blen + 1, word + mp->blen + 1);
+}
+
 // build a hash table from a munched word list
 
-HashMgr::HashMgr(const char * tpath, const char * apath, const char * key)
+HashMgr::HashMgr(const char * tpath, const char * apath, const char * key,
+  const char * cpath)
 {
   tablesize = 0;
   tableptr = NULL;
@@ -31,8 +108,25 @@ HashMgr::HashMgr(const char * tpath, const char * apath, const char * key)
   numaliasm = 0;
   aliasm = NULL;
   forbiddenword = FORBIDDENWORD; // forbidden word signing flag
+  mapped = NULL;
+  mappedsize = 0;
+  mappedtablesize = 0;
+  mappedbuckets = NULL;
+  walkentry = NULL;
+  walkoffset = 0;
+  walkkept = NULL;
+  kept = NULL;
+  numkept = 0;
+  maxkept = 0;
   load_config(apath, key);
-  int ec = load_tables(tpath, key);
+  // use the precompiled table at cpath if it's current, otherwise load the
+  // dic file and (re)write it. encrypted dictionaries are never precompiled
+  int ec = (cpath && !key) ? map_tables(cpath, tpath, apath) : 1;
+  if (ec) {
+    ec = load_tables(tpath, key);
+    if (!ec && cpath && !key && !write_tables(cpath, tpath, apath))
+      map_tables(cpath, tpath, apath); // replaces the loaded table
+  }
   if (ec) {
     /* error condition - what should we do here */
     HUNSPELL_WARNING(stderr, "Hash Manager Error : %d\n",ec);
@@ -47,22 +141,10 @@ HashMgr::HashMgr(const char * tpath, const char * apath, const char * key)
 
 HashMgr::~HashMgr()
 {
-  if (tableptr) {
-    // now pass through hash table freeing up everything
-    // go through column by column of the table
-    for (int i=0; i < tablesize; i++) {
-      struct hentry * pt = tableptr[i];
-      struct hentry * nt = NULL;
-      while(pt) {
-        nt = pt->next;
-        if (pt->astr && (!aliasf || TESTAFF(pt->astr, ONLYUPCASEFLAG, pt->alen))) free(pt->astr);
-        free(pt);
-        pt = nt;
-      }
-    }
-    free(tableptr);
-  }
-  tablesize = 0;
+  free_tables();
+  free_kept();
+  if (kept) free(kept);
+  unmap_tables();
 
   if (aliasf) {
     for (int j = 0; j < (numaliasf); j++) free(aliasf[j]);
@@ -96,6 +178,28 @@ HashMgr::~HashMgr()
 #endif
 }
 
+// free the (private) hash table
+void HashMgr::free_tables()
+{
+  if (tableptr) {
+    // now pass through hash table freeing up everything
+    // go through column by column of the table
+    for (int i=0; i < tablesize; i++) {
+      struct hentry * pt = tableptr[i];
+      struct hentry * nt = NULL;
+      while(pt) {
+        nt = pt->next;
+        if (pt->astr && (!aliasf || TESTAFF(pt->astr, ONLYUPCASEFLAG, pt->alen))) free(pt->astr);
+        free(pt);
+        pt = nt;
+      }
+    }
+    free(tableptr);
+    tableptr = NULL;
+  }
+  tablesize = 0;
+}
+
 // lookup a root word in the hashtable
 
 struct hentry * HashMgr::lookup(const char *word) const
@@ -103,14 +207,51 @@ struct hentry * HashMgr::lookup(const char *word) const
     struct hentry * dp;
     if (tableptr) {
        dp = tableptr[hash(word)];
-       if (!dp) return NULL;
        for (  ;  dp != NULL;  dp = dp->next) {
           if (strcmp(word, dp->word) == 0) return dp;
        }
     }
+    if (mapped) return lookup_mapped(word);
     return NULL;
 }
 
+// copy a word (and its homonyms) from the mapped table to the private one
+struct hentry * HashMgr::lookup_mapped(const char * word) const
+{
+    unsigned int offset = mappedbuckets[hash_value(word) % mappedtablesize];
+    for (  ;  offset != 0;  offset = mapped_entry(offset)->next) {
+       if (strcmp(word, mentry_word(mapped_entry(offset))) == 0) break;
+    }
+    if (!offset || !tableptr) return NULL;
+
+    struct hentry * first = NULL;
+    struct hentry * last = NULL;
+    for (  ;  offset != 0;  offset = mapped_entry(offset)->next_homonym) {
+       const struct mentry * mp = mapped_entry(offset);
+       struct hentry * hp = (struct hentry *) malloc(mentry_hentry_size(mp));
+       if (!hp) break;
+       mentry_to_hentry(mp, hp);
+       // the private table owns these flag vectors (see free_tables)
+       if (hp->astr && (!aliasf || TESTAFF(hp->astr, ONLYUPCASEFLAG, hp->alen))) {
+          hp->astr = (unsigned short *) malloc(hp->alen * sizeof(short));
+          if (!hp->astr) {
+             free(hp);
+             break;
+          }
+          memcpy(hp->astr, mentry_flags(mp), hp->alen * sizeof(short));
+       }
+       if (last) last->next = last->next_homonym = hp; else first = hp;
+       last = hp;
+    }
+
+    if (first) {
+       struct hentry ** dp = &tableptr[hash(word)];
+       while (*dp) dp = &((*dp)->next);
+       *dp = first;
+    }
+    return first;
+}
+
 // add a word to the hash table (private)
 int HashMgr::add_word(const char * word, int wbl, int wcl, unsigned short * aff,
     int al, const char * desc, bool onlyupcase)
@@ -134,6 +275,9 @@ int HashMgr::add_word(const char * word, int wbl, int wcl, unsigned short * aff,
         if (utf8) reverseword_utf(hpw); else reverseword(hpw);
     }
 
+    // bring in any mapped homonyms first
+    if (mapped) lookup(hpw);
+
     int i = hash(hpw);
 
     hp->blen = (unsigned char) wbl;
@@ -337,17 +481,69 @@ int HashMgr::add_with_affix(const char * word, const char * example)
 
 // walk the hash table entry by entry - null at end
 // initialize: col=-1; hp = NULL; hp = walk_hashtable(&col, hp);
+// (a mapped table is walked first, skipping the words which have been copied
+// to the private table. walked mapped entries are only valid until the next
+// step of the walk unless they're passed to keep_walked)
 struct hentry * HashMgr::walk_hashtable(int &col, struct hentry * hp) const
 {  
+  walkkept = NULL;
+  if (mapped && col < mappedtablesize) {
+    if (col == -1 && !hp) free_kept();
+    unsigned int offset = (col >= 0 && hp) ? mapped_entry(walkoffset)->next : 0;
+    for (;;) {
+      for (  ;  offset != 0;  offset = mapped_entry(offset)->next) {
+        const struct mentry * mp = mapped_entry(offset);
+        struct hentry * dp = tableptr ? tableptr[hash(mentry_word(mp))] : NULL;
+        while (dp && strcmp(mentry_word(mp), dp->word) != 0) dp = dp->next;
+        if (!dp) {
+          walkoffset = offset;
+          mentry_to_hentry(mp, walkentry);
+          return walkentry;
+        }
+      }
+      if (++col >= mappedtablesize) break;
+      offset = mappedbuckets[col];
+    }
+    col = mappedtablesize - 1;
+    hp = NULL;
+  }
   if (hp && hp->next != NULL) return hp->next;
-  for (col++; col < tablesize; col++) {
-    if (tableptr[col]) return tableptr[col];
+  for (col++; col < mappedtablesize + tablesize; col++) {
+    if (tableptr[col - mappedtablesize]) return tableptr[col - mappedtablesize];
   }
   // null at end and reset to start
   col = -1;
   return NULL;
 }
 
+// keep a walked entry valid until the next walk
+struct hentry * HashMgr::keep_walked(struct hentry * hp) const
+{
+  if (hp != walkentry) return hp;
+  if (walkkept) return walkkept;
+  if (numkept == maxkept) {
+    int n = maxkept ? maxkept * 2 : 64;
+    struct hentry ** k = (struct hentry **) realloc(kept, n * sizeof(struct hentry *));
+    if (!k) return hp;
+    kept = k;
+    maxkept = n;
+  }
+  size_t size = mentry_hentry_size(mapped_entry(walkoffset));
+  struct hentry * copy = (struct hentry *) malloc(size);
+  if (!copy) return hp;
+  memcpy(copy, walkentry, size);
+  kept[numkept++] = copy;
+  walkkept = copy;
+  return copy;
+}
+
+void HashMgr::free_kept() const
+{
+  for (int i = 0; i < numkept; i++) free(kept[i]);
+  numkept = 0;
+  walkkept = NULL;
+}
+
 // load a munched word list and build a hash table on the fly
 int HashMgr::load_tables(const char * tpath, const char * key)
 {
@@ -474,10 +670,211 @@ int HashMgr::load_tables(const char * tpath, const char * key)
   return 0;
 }
 
+// identify the precompiled table for the dic and aff files
+int HashMgr::stamp_tables(struct mheader * header, const char * tpath,
+  const char * apath) const
+{
+  struct stat dicst;
+  struct stat affst;
+  if (stat(tpath, &dicst) || stat(apath, &affst)) return 1;
+  memset(header, 0, sizeof(struct mheader));
+  memcpy(header->magic, MAPPED_MAGIC, sizeof(header->magic));
+  header->longsize = sizeof(long);
+  header->dicsize = dicst.st_size;
+  header->dicmtime = dicst.st_mtime;
+  header->affsize = affst.st_size;
+  header->affmtime = affst.st_mtime;
+  return 0;
+}
+
+// write the loaded hash table as a precompiled table. it's written to a
+// temporary file which is then renamed so readers never see part of one
+int HashMgr::write_tables(const char * cpath, const char * tpath,
+  const char * apath) const
+{
+#ifdef _WIN32
+  return 1;
+#else
+  struct mheader header;
+  if (!tableptr || stamp_tables(&header, tpath, apath)) return 1;
+  header.tablesize = tablesize;
+  header.maxentry = sizeof(struct hentry);
+
+  // size up the entries
+  size_t size = sizeof(struct mheader) + tablesize * sizeof(unsigned int);
+  int maxchain = 0;
+  for (int i = 0; i < tablesize; i++) {
+    int chain = 0;
+    for (struct hentry * hp = tableptr[i]; hp; hp = hp->next) {
+      char * desc = (hp->var & H_OPT) ? HENTRY_DATA(hp) : NULL;
+      size_t descl = (hp->var & H_OPT) ? (desc ? strlen(desc) : 0) + 1 : 0;
+      size += (sizeof(struct mentry) + hp->alen * sizeof(short) + hp->blen + 1 + descl + 3) & ~((size_t) 3);
+      if (sizeof(struct hentry) + hp->blen + descl > header.maxentry)
+        header.maxentry = sizeof(struct hentry) + hp->blen + descl;
+      chain++;
+    }
+    if (chain > maxchain) maxchain = chain;
+  }
+  if (size > 0xFFFFFFFFUL) return 1;
+  header.size = (unsigned int) size;
+
+  char * image = (char *) calloc(size, 1);
+  unsigned int * offsets = (unsigned int *) malloc((maxchain + 1) * sizeof(unsigned int));
+  if (!image || !offsets) {
+    if (image) free(image);
+    if (offsets) free(offsets);
+    return 1;
+  }
+  memcpy(image, &header, sizeof(struct mheader));
+  unsigned int * buckets = (unsigned int *) (image + sizeof(struct mheader));
+
+  size_t offset = sizeof(struct mheader) + tablesize * sizeof(unsigned int);
+  for (int i = 0; i < tablesize; i++) {
+    // entry offsets for the chain (homonyms are always later in the chain)
+    int n = 0;
+    for (struct hentry * hp = tableptr[i]; hp; hp = hp->next) {
+      offsets[n++] = (unsigned int) offset;
+      char * desc = (hp->var & H_OPT) ? HENTRY_DATA(hp) : NULL;
+      size_t descl = (hp->var & H_OPT) ? (desc ? strlen(desc) : 0) + 1 : 0;
+      offset += (sizeof(struct mentry) + hp->alen * sizeof(short) + hp->blen + 1 + descl + 3) & ~((size_t) 3);
+    }
+    offsets[n] = 0;
+    buckets[i] = offsets[0];
+
+    n = 0;
+    for (struct hentry * hp = tableptr[i]; hp; hp = hp->next, n++) {
+      struct mentry * mp = (struct mentry *) (image + offsets[n]);
+      mp->next = offsets[n + 1];
+      mp->next_homonym = 0;
+      int h = n + 1;
+      for (struct hentry * np = hp->next; np && hp->next_homonym; np = np->next, h++) {
+        if (np == hp->next_homonym) {
+          mp->next_homonym = offsets[h];
+          break;
+        }
+      }
+      mp->alen = hp->alen;
+      mp->blen = hp->blen;
+      mp->clen = hp->clen;
+      // descriptions are stored inline (rather than as alias pointers)
+      mp->var = hp->var & ~H_OPT_ALIASM;
+      if (hp->alen) memcpy((char *) (mp + 1), hp->astr, hp->alen * sizeof(short));
+      char * word = (char *) mentry_word(mp);
+      memcpy(word, hp->word, hp->blen + 1);
+      if (hp->var & H_OPT) {
+        char * desc = HENTRY_DATA(hp);
+        if (desc) strcpy(word + hp->blen + 1, desc);
+      }
+    }
+  }
+  free(offsets);
+
+  char * tmppath = (char *) malloc(strlen(cpath) + 32);
+  if (!tmppath) {
+    free(image);
+    return 1;
+  }
+  sprintf(tmppath, "%s.%ld.tmp", cpath, (long) getpid());
+  int ec = 1;
+  FILE * f = fopen(tmppath, "wb");
+  if (f) {
+    ec = (fwrite(image, 1, size, f) != size);
+    if (fclose(f)) ec = 1;
+    if (!ec && rename(tmppath, cpath)) ec = 1;
+    if (ec) unlink(tmppath);
+  }
+  free(tmppath);
+  free(image);
+  return ec;
+#endif
+}
+
+// map the precompiled table at cpath (if it's current) read-only, in place
+// of any loaded table
+int HashMgr::map_tables(const char * cpath, const char * tpath,
+  const char * apath)
+{
+#ifdef _WIN32
+  return 1;
+#else
+  struct mheader stamp;
+  if (stamp_tables(&stamp, tpath, apath)) return 1;
+
+  int fd = open(cpath, O_RDONLY);
+  if (fd == -1) return 1;
+  struct stat st;
+  if (fstat(fd, &st) || st.st_size < (off_t) sizeof(struct mheader)) {
+    close(fd);
+    return 1;
+  }
+  size_t size = (size_t) st.st_size;
+  void * addr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) return 1;
+
+  const struct mheader * header = (const struct mheader *) addr;
+  if (memcmp(header->magic, stamp.magic, sizeof(stamp.magic)) ||
+      header->longsize != stamp.longsize ||
+      header->dicsize != stamp.dicsize || header->dicmtime != stamp.dicmtime ||
+      header->affsize != stamp.affsize || header->affmtime != stamp.affmtime ||
+      header->size != size || header->tablesize == 0 ||
+      header->maxentry < sizeof(struct hentry) ||
+      sizeof(struct mheader) + header->tablesize * (size_t) sizeof(unsigned int) > size) {
+    munmap(addr, size);
+    return 1;
+  }
+
+  struct hentry * entry = (struct hentry *) malloc(header->maxentry);
+  struct hentry ** table = (struct hentry **) malloc(MAPPED_PRIVATE_TABLESIZE * sizeof(struct hentry *));
+  if (!entry || !table) {
+    if (entry) free(entry);
+    if (table) free(table);
+    munmap(addr, size);
+    return 3;
+  }
+
+  free_tables();
+  free_kept();
+  unmap_tables();
+  mapped = (const char *) addr;
+  mappedsize = size;
+  mappedtablesize = header->tablesize;
+  mappedbuckets = (const unsigned int *) (mapped + sizeof(struct mheader));
+  walkentry = entry;
+  tablesize = MAPPED_PRIVATE_TABLESIZE;
+  tableptr = table;
+  for (int i=0; i<tablesize; i++) tableptr[i] = NULL;
+  return 0;
+#endif
+}
+
+void HashMgr::unmap_tables()
+{
+#ifndef _WIN32
+  if (mapped) munmap((void *) mapped, mappedsize);
+#endif
+  mapped = NULL;
+  mappedsize = 0;
+  mappedtablesize = 0;
+  mappedbuckets = NULL;
+  if (walkentry) free(walkentry);
+  walkentry = NULL;
+}
+
+const struct mentry * HashMgr::mapped_entry(unsigned int offset) const
+{
+  return (const struct mentry *) (mapped + offset);
+}
+
 // the hash function is a simple load and rotate
 // algorithm borrowed
 
 int HashMgr::hash(const char * word) const
+{
+    return hash_value(word) % tablesize;
+}
+
+unsigned long HashMgr::hash_value(const char * word) const
 {
     long  hv = 0;
     for (int i=0; i < 4  &&  *word != 0; i++)
@@ -486,7 +883,7 @@ int HashMgr::hash(const char * word) const
       ROTATE(hv,ROTATE_LEN);
       hv ^= (*word++);
     }
-    return (unsigned long) hv % tablesize;
+    return (unsigned long) hv;
 }
 
 int HashMgr::decode_flags(unsigned short ** result, char * flags, FileMgr * af) {
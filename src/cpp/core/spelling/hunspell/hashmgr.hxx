@@ -10,6 +10,9 @@
 
 enum flag { FLAG_CHAR, FLAG_LONG, FLAG_NUM, FLAG_UNI };
 
+struct mheader;
+struct mentry;
+
 class LIBHUNSPELL_DLL_EXPORTED HashMgr
 {
   int               tablesize;
@@ -31,15 +34,30 @@ class LIBHUNSPELL_DLL_EXPORTED HashMgr
   unsigned short *  aliasflen;
   int               numaliasm; // morphological desciption `compression' with aliases
   char **           aliasm;
+  // precompiled table mapped read-only from disk (shared between processes);
+  // when in use the private table above only holds the entries copied from
+  // it by lookups plus the words added at runtime
+  const char *      mapped;
+  size_t            mappedsize;
+  int               mappedtablesize;
+  const unsigned int * mappedbuckets;
+  struct hentry *   walkentry;   // mapped entry most recently walked
+  mutable unsigned int walkoffset;
+  mutable struct hentry * walkkept;
+  mutable struct hentry ** kept; // walked entries kept by keep_walked()
+  mutable int       numkept;
+  mutable int       maxkept;
 
 
 public:
-  HashMgr(const char * tpath, const char * apath, const char * key = NULL);
+  HashMgr(const char * tpath, const char * apath, const char * key = NULL,
+    const char * cpath = NULL);
   ~HashMgr();
 
   struct hentry * lookup(const char *) const;
   int hash(const char *) const;
   struct hentry * walk_hashtable(int & col, struct hentry * hp) const;
+  struct hentry * keep_walked(struct hentry * hp) const;
 
   int add(const char * word);
   int add_with_affix(const char * word, const char * pattern);
@@ -55,6 +73,15 @@ public:
 private:
   int get_clen_and_captype(const char * word, int wbl, int * captype);
   int load_tables(const char * tpath, const char * key);
+  void free_tables();
+  unsigned long hash_value(const char *) const;
+  int stamp_tables(struct mheader * header, const char * tpath, const char * apath) const;
+  int write_tables(const char * cpath, const char * tpath, const char * apath) const;
+  int map_tables(const char * cpath, const char * tpath, const char * apath);
+  void unmap_tables();
+  const struct mentry * mapped_entry(unsigned int offset) const;
+  struct hentry * lookup_mapped(const char * word) const;
+  void free_kept() const;
   int add_word(const char * word, int wbl, int wcl, unsigned short * ap,
     int al, const char * desc, bool onlyupcase);
   int load_config(const char * affpath, const char * key);
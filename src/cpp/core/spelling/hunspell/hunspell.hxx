@@ -35,9 +35,12 @@ public:
 
   /* Hunspell(aff, dic) - constructor of Hunspell class
    * input: path of affix file and dictionary file
+   * (and optionally the path of a precompiled copy of the dictionary, which
+   * is memory-mapped read-only and written when missing or out of date)
    */
 
-  Hunspell(const char * affpath, const char * dpath, const char * key = NULL);
+  Hunspell(const char * affpath, const char * dpath, const char * key = NULL,
+    const char * cpath = NULL);
   ~Hunspell();
 
   /* load extra dictionaries (only dic files) */
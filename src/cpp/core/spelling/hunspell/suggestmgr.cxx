@@ -1115,7 +1115,7 @@ int SuggestMgr::ngsuggest(char** wlst, char * w, int ns, HashMgr** pHMgr, int md
 
     if (sc > scores[lp]) {
       scores[lp] = sc;  
-      roots[lp] = hp;
+      roots[lp] = (pHMgr[i])->keep_walked(hp);
       lval = sc;
       for (j=0; j < MAX_ROOTS; j++)
         if (scores[j] < lval) {
@@ -1127,7 +1127,7 @@ int SuggestMgr::ngsuggest(char** wlst, char * w, int ns, HashMgr** pHMgr, int md
 
     if (scphon > scoresphon[lpphon]) {
       scoresphon[lpphon] = scphon;
-      rootsphon[lpphon] = HENTRY_WORD(hp);
+      rootsphon[lpphon] = HENTRY_WORD((pHMgr[i])->keep_walked(hp));
       lval = scphon;
       for (j=0; j < MAX_ROOTS; j++)
         if (scoresphon[j] < lval) {
@@ -0,0 +1,79 @@
+/*
+ * ChildOutputWatcher.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_SYSTEM_CHILD_OUTPUT_WATCHER_HPP
+#define CORE_SYSTEM_CHILD_OUTPUT_WATCHER_HPP
+
+#include <set>
+#include <vector>
+
+#include <boost/utility.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace core {
+
+class Error;
+
+namespace system {
+
+class AsyncChildProcess;
+
+// output pipe of a child (a file descriptor on posix and a handle to an
+// overlapped named pipe on windows)
+#ifdef _WIN32
+typedef void* OutputPipe;
+#else
+typedef int OutputPipe;
+#endif
+
+// Watches the output pipes of async children on a background thread so
+// that ProcessSupervisor only needs to poll children which actually have
+// output (or hung up). Once one of a child's pipes becomes readable the
+// child is marked ready and is no longer watched until watch is called
+// again (i.e. after the supervisor has polled it). The output handler is
+// called on the background thread so it should do nothing more than
+// wake up whichever thread polls the supervisor. On posix the pipes are
+// polled; on windows zero byte overlapped reads are issued against them
+// and their completions are collected from an I/O completion port.
+class ChildOutputWatcher : boost::noncopyable
+{
+public:
+   ChildOutputWatcher();
+   virtual ~ChildOutputWatcher();
+
+   // COPYING: boost::noncopyable
+
+   Error start(const boost::function<void()>& onOutput);
+
+   // watch (or update the watched pipes of) a child
+   void watch(AsyncChildProcess* pChild, const std::vector<OutputPipe>& pipes);
+
+   // stop watching a child (e.g. because it exited)
+   void unwatch(AsyncChildProcess* pChild);
+
+   // move the children which are ready into pReady
+   void takeReady(std::set<AsyncChildProcess*>* pReady);
+
+private:
+   struct Impl;
+   boost::shared_ptr<Impl> pImpl_;
+};
+
+} // namespace system
+} // namespace core
+
+#endif // CORE_SYSTEM_CHILD_OUTPUT_WATCHER_HPP
+
@@ -21,6 +21,8 @@
 #include <core/Error.hpp>
 #include <core/Log.hpp>
 
+#include "ChildOutputWatcher.hpp"
+
 namespace core {
 
 class ErrorLocation;
@@ -65,6 +67,12 @@ protected:
 
    const ProcessOptions& options() const { return options_; }
 
+private:
+#ifndef _WIN32
+   // run without forking (see spawnChild in PosixChildProcess.cpp)
+   Error spawn();
+#endif
+
 protected:
    // platform specific impl
    struct Impl;
@@ -193,6 +201,13 @@ public:
    // has it exited?
    bool exited();
 
+   // does the child need to be polled even if it has no output?
+   bool hasContinueCallback() const { return !!callbacks_.onContinue; }
+
+   // output pipes which are still open (empty before the first poll, after
+   // both pipes reach eof, and after exit)
+   void outputFds(std::vector<OutputPipe>* pFds) const;
+
    // override of terminate (allow special handling for unix pty termination)
    virtual Error terminate();
 
@@ -0,0 +1,247 @@
+/*
+ * FileChangeEvent.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/system/FileChangeEvent.hpp>
+
+#include <map>
+
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/Thread.hpp>
+#include <core/ThreadPool.hpp>
+
+namespace core {
+namespace system {
+
+namespace {
+
+// trees smaller than this are diffed on the calling thread
+const std::size_t kParallelDiffMinFiles = 20000;
+
+typedef tree<FileInfo>::pre_order_iterator TreeIterator;
+
+// the previous and current ranges of a subtree (either may be empty)
+struct Subtree
+{
+   TreeIterator prevBegin;
+   TreeIterator prevEnd;
+   TreeIterator currBegin;
+   TreeIterator currEnd;
+};
+
+void addSubtree(TreeIterator it,
+                bool includeChildren,
+                bool prev,
+                std::map<std::string, Subtree>* pSubtrees)
+{
+   TreeIterator end = it;
+   if (includeChildren)
+      end.skip_children();
+   ++end;
+
+   Subtree& subtree = (*pSubtrees)[it->absolutePath()];
+   if (prev)
+   {
+      subtree.prevBegin = it;
+      subtree.prevEnd = end;
+   }
+   else
+   {
+      subtree.currBegin = it;
+      subtree.currEnd = end;
+   }
+}
+
+// split a tree into its top level nodes (on their own) and their children's
+// subtrees
+void addSubtrees(const tree<FileInfo>& fileTree,
+                 bool prev,
+                 std::map<std::string, Subtree>* pSubtrees)
+{
+   for (TreeIterator top = fileTree.begin();
+        top != fileTree.end();
+        top.skip_children(), ++top)
+   {
+      addSubtree(top, false, prev, pSubtrees);
+
+      for (tree<FileInfo>::sibling_iterator child = fileTree.begin(top);
+           child != fileTree.end(top);
+           ++child)
+      {
+         addSubtree(child, true, prev, pSubtrees);
+      }
+   }
+}
+
+// scans produce their files in the same order so a subtree which hasn't
+// changed can be detected without sorting it
+bool subtreeUnchanged(const Subtree& subtree)
+{
+   TreeIterator prevIt = subtree.prevBegin;
+   TreeIterator currIt = subtree.currBegin;
+   for (; prevIt != subtree.prevEnd && currIt != subtree.currEnd;
+        ++prevIt, ++currIt)
+   {
+      if (prevIt->lastWriteTime() != currIt->lastWriteTime() ||
+          prevIt->absolutePath() != currIt->absolutePath())
+      {
+         return false;
+      }
+   }
+
+   return prevIt == subtree.prevEnd && currIt == subtree.currEnd;
+}
+
+void diffSubtree(const Subtree& subtree,
+                 const boost::function<bool(const FileInfo&)>& filter,
+                 std::vector<FileChangeEvent>* pEvents)
+{
+   if (subtreeUnchanged(subtree))
+      return;
+
+   collectFileChangeEvents(subtree.prevBegin,
+                           subtree.prevEnd,
+                           subtree.currBegin,
+                           subtree.currEnd,
+                           filter,
+                           pEvents);
+}
+
+// subtrees are handed out one at a time to whichever thread is free (the
+// state is shared with the pool so that work which starts after the diff
+// has completed finds nothing left to do)
+struct ParallelDiff : boost::noncopyable
+{
+   ParallelDiff(const std::vector<Subtree>& subtrees,
+                const boost::function<bool(const FileInfo&)>& filter)
+      : subtrees(subtrees),
+        events(subtrees.size()),
+        filter(filter),
+        next(0),
+        remaining(subtrees.size())
+   {
+   }
+
+   const std::vector<Subtree> subtrees;
+   std::vector<std::vector<FileChangeEvent> > events;
+   const boost::function<bool(const FileInfo&)> filter;
+
+   // protects the members below
+   boost::mutex mutex;
+   boost::condition diffed;
+   std::size_t next;
+   std::size_t remaining;
+};
+
+void diffSubtrees(boost::shared_ptr<ParallelDiff> pDiff)
+{
+   while (true)
+   {
+      std::size_t index = pDiff->subtrees.size();
+      LOCK_MUTEX(pDiff->mutex)
+      {
+         if (pDiff->next < pDiff->subtrees.size())
+            index = pDiff->next++;
+      }
+      END_LOCK_MUTEX
+
+      if (index == pDiff->subtrees.size())
+         return;
+
+      try
+      {
+         diffSubtree(pDiff->subtrees[index],
+                     pDiff->filter,
+                     &(pDiff->events[index]));
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+
+      bool finished = false;
+      LOCK_MUTEX(pDiff->mutex)
+      {
+         finished = (--(pDiff->remaining) == 0);
+      }
+      END_LOCK_MUTEX
+
+      if (finished)
+         pDiff->diffed.notify_all();
+   }
+}
+
+} // anonymous namespace
+
+void collectFileChangeEvents(const tree<FileInfo>& prevTree,
+                             const tree<FileInfo>& currTree,
+                             const boost::function<bool(const FileInfo&)>& filter,
+                             core::thread::ThreadPool* pThreadPool,
+                             std::vector<FileChangeEvent>* pEvents)
+{
+   std::map<std::string, Subtree> subtreesByPath;
+   addSubtrees(prevTree, true, &subtreesByPath);
+   addSubtrees(currTree, false, &subtreesByPath);
+
+   std::vector<Subtree> subtrees;
+   typedef std::pair<const std::string, Subtree> PathSubtree;
+   BOOST_FOREACH(const PathSubtree& pathSubtree, subtreesByPath)
+   {
+      subtrees.push_back(pathSubtree.second);
+   }
+
+   // diff small trees (or all trees if we have no pool) on this thread
+   if (pThreadPool == NULL ||
+       subtrees.size() < 2 ||
+       (prevTree.size() + currTree.size()) < kParallelDiffMinFiles)
+   {
+      BOOST_FOREACH(const Subtree& subtree, subtrees)
+      {
+         diffSubtree(subtree, filter, pEvents);
+      }
+      return;
+   }
+
+   // diff in parallel (this thread takes part)
+   boost::shared_ptr<ParallelDiff> pDiff(new ParallelDiff(subtrees, filter));
+   std::size_t workers = std::min(subtrees.size() - 1, pThreadPool->threads());
+   for (std::size_t i = 0; i < workers; i++)
+      pThreadPool->execute(boost::bind(diffSubtrees, pDiff));
+   diffSubtrees(pDiff);
+
+   // wait for the subtrees other threads are still diffing (they refer to
+   // our trees so we can't be interrupted while they do)
+   try
+   {
+      boost::this_thread::disable_interruption noInterrupt;
+      boost::unique_lock<boost::mutex> lock(pDiff->mutex);
+      while (pDiff->remaining > 0)
+         pDiff->diffed.wait(lock);
+   }
+   catch(const boost::thread_resource_error& e)
+   {
+      Error error(boost::thread_error::ec_from_exception(e), ERROR_LOCATION);
+      LOG_ERROR(error);
+   }
+
+   BOOST_FOREACH(const std::vector<FileChangeEvent>& events, pDiff->events)
+   {
+      pEvents->insert(pEvents->end(), events.begin(), events.end());
+   }
+}
+
+} // namespace system
+} // namespace core
@@ -0,0 +1,282 @@
+/*
+ * PosixChildOutputWatcher.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "ChildOutputWatcher.hpp"
+
+#include <map>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <boost/bind.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/Thread.hpp>
+#include <core/BoostThread.hpp>
+
+namespace core {
+namespace system {
+
+// state is shared with the watcher thread so that it remains valid if
+// the thread outlives the watcher (it is detached on destruction)
+struct ChildOutputWatcher::Impl
+{
+   Impl() : stopping(false)
+   {
+      wakePipe[0] = -1;
+      wakePipe[1] = -1;
+   }
+
+   ~Impl()
+   {
+      if (wakePipe[0] != -1)
+         ::close(wakePipe[0]);
+      if (wakePipe[1] != -1)
+         ::close(wakePipe[1]);
+   }
+
+   // interrupt the watcher thread's poll so that it picks up changes
+   void wake()
+   {
+      char ch = 0;
+      if (::write(wakePipe[1], &ch, 1) == -1 && errno != EAGAIN)
+         LOG_ERROR(systemError(errno, ERROR_LOCATION));
+   }
+
+   void run();
+
+   void drainWakePipe()
+   {
+      char buffer[256];
+      while (::read(wakePipe[0], buffer, sizeof(buffer)) > 0)
+      {
+      }
+   }
+
+   boost::mutex mutex;
+   std::map<AsyncChildProcess*, std::vector<int> > watched;
+   std::set<AsyncChildProcess*> ready;
+   int wakePipe[2];
+   bool stopping;
+   boost::function<void()> onOutput;
+   boost::thread thread;
+};
+
+namespace {
+
+Error setNonBlockingCloseOnExec(int fd)
+{
+   int flags = ::fcntl(fd, F_GETFL);
+   if (flags == -1 || ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1)
+      return systemError(errno, ERROR_LOCATION);
+
+   flags = ::fcntl(fd, F_GETFD);
+   if (flags == -1 || ::fcntl(fd, F_SETFD, flags | FD_CLOEXEC) == -1)
+      return systemError(errno, ERROR_LOCATION);
+
+   return Success();
+}
+
+} // anonymous namespace
+
+void ChildOutputWatcher::Impl::run()
+{
+   try
+   {
+      std::vector<pollfd> fds;
+      std::vector<AsyncChildProcess*> owners;
+
+      while (true)
+      {
+         // build the list of fds to poll (the wake pipe is always first)
+         fds.clear();
+         owners.clear();
+         pollfd wakeFd;
+         wakeFd.fd = wakePipe[0];
+         wakeFd.events = POLLIN;
+         wakeFd.revents = 0;
+         fds.push_back(wakeFd);
+         owners.push_back(NULL);
+
+         LOCK_MUTEX(mutex)
+         {
+            if (stopping)
+               return;
+
+            typedef std::map<AsyncChildProcess*, std::vector<int> > Watched;
+            for (Watched::const_iterator it = watched.begin();
+                 it != watched.end();
+                 ++it)
+            {
+               for (std::size_t i = 0; i < it->second.size(); i++)
+               {
+                  pollfd fd;
+                  fd.fd = it->second[i];
+                  fd.events = POLLIN;
+                  fd.revents = 0;
+                  fds.push_back(fd);
+                  owners.push_back(it->first);
+               }
+            }
+         }
+         END_LOCK_MUTEX
+
+         // wait (indefinitely) for output or a change to the watch list
+         int result = ::poll(&(fds[0]), fds.size(), -1);
+         if (result == -1)
+         {
+            if (errno != EINTR)
+            {
+               LOG_ERROR(systemError(errno, ERROR_LOCATION));
+               boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+            }
+            continue;
+         }
+
+         if (fds[0].revents != 0)
+            drainWakePipe();
+
+         // note which children are ready. any event at all (including
+         // hangups and invalid fds) means the child needs to be polled.
+         // children which were unwatched or rewatched since we built the
+         // list are skipped (at worst this causes a redundant poll)
+         bool haveReady = false;
+         LOCK_MUTEX(mutex)
+         {
+            for (std::size_t i = 1; i < fds.size(); i++)
+            {
+               if (fds[i].revents != 0 && watched.erase(owners[i]))
+               {
+                  ready.insert(owners[i]);
+                  haveReady = true;
+               }
+            }
+         }
+         END_LOCK_MUTEX
+
+         if (haveReady && onOutput)
+            onOutput();
+      }
+   }
+   catch(const boost::thread_interrupted&)
+   {
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+}
+
+ChildOutputWatcher::ChildOutputWatcher()
+   : pImpl_(new Impl())
+{
+}
+
+ChildOutputWatcher::~ChildOutputWatcher()
+{
+   try
+   {
+      if (pImpl_->thread.joinable())
+      {
+         LOCK_MUTEX(pImpl_->mutex)
+         {
+            pImpl_->stopping = true;
+         }
+         END_LOCK_MUTEX
+
+         pImpl_->wake();
+
+         // don't hold up shutdown if the thread doesn't stop promptly
+         // (it holds a reference to the shared state so can be detached)
+         pImpl_->thread.timed_join(boost::posix_time::seconds(1));
+         pImpl_->thread.detach();
+      }
+   }
+   catch(...)
+   {
+   }
+}
+
+Error ChildOutputWatcher::start(const boost::function<void()>& onOutput)
+{
+   if (::pipe(pImpl_->wakePipe) == -1)
+      return systemError(errno, ERROR_LOCATION);
+
+   for (int i = 0; i < 2; i++)
+   {
+      Error error = setNonBlockingCloseOnExec(pImpl_->wakePipe[i]);
+      if (error)
+         return error;
+   }
+
+   pImpl_->onOutput = onOutput;
+
+   core::thread::safeLaunchThread(boost::bind(&Impl::run, pImpl_),
+                                  &(pImpl_->thread));
+   if (!pImpl_->thread.joinable())
+      return systemError(boost::system::errc::resource_unavailable_try_again,
+                         ERROR_LOCATION);
+
+   return Success();
+}
+
+void ChildOutputWatcher::watch(AsyncChildProcess* pChild,
+                               const std::vector<OutputPipe>& fds)
+{
+   bool changed = false;
+   LOCK_MUTEX(pImpl_->mutex)
+   {
+      std::map<AsyncChildProcess*, std::vector<int> >::iterator it =
+                                                pImpl_->watched.find(pChild);
+      if (it == pImpl_->watched.end() || it->second != fds)
+      {
+         pImpl_->watched[pChild] = fds;
+         changed = true;
+      }
+   }
+   END_LOCK_MUTEX
+
+   // only interrupt the watcher thread if there is something new to watch
+   if (changed)
+      pImpl_->wake();
+}
+
+void ChildOutputWatcher::unwatch(AsyncChildProcess* pChild)
+{
+   bool changed = false;
+   LOCK_MUTEX(pImpl_->mutex)
+   {
+      changed = pImpl_->watched.erase(pChild) > 0;
+      pImpl_->ready.erase(pChild);
+   }
+   END_LOCK_MUTEX
+
+   if (changed)
+      pImpl_->wake();
+}
+
+void ChildOutputWatcher::takeReady(std::set<AsyncChildProcess*>* pReady)
+{
+   LOCK_MUTEX(pImpl_->mutex)
+   {
+      pReady->swap(pImpl_->ready);
+      pImpl_->ready.clear();
+   }
+   END_LOCK_MUTEX
+}
+
+} // namespace system
+} // namespace core
+
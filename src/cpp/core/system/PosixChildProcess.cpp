@@ -30,8 +30,14 @@
 
 #include <sys/wait.h>
 #include <sys/types.h>
+#include <sys/resource.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 
 #include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
 
 #include <core/Error.hpp>
 #include <core/Log.hpp>
@@ -130,6 +136,196 @@ Error readPipe(int pipeFd, std::string* pOutput, bool *pEOF = NULL)
    return Success();
 }
 
+// put a pseudoterminal into raw mode (but don't ignore signals -- this is
+// done so we can send Ctrl-C for interrupts), returning its VINTR character
+void setTerminalRawMode(int fdTerminal, char* pCtrlC)
+{
+   // get current attributes
+   struct termios termp;
+   Error error = posixCall<int>(
+      boost::bind(::tcgetattr, fdTerminal, &termp),
+      ERROR_LOCATION);
+   if (!error)
+   {
+      ::cfmakeraw(&termp);
+      termp.c_lflag |= ISIG;
+
+      // set attribs
+      safePosixCall<int>(
+            boost::bind(::tcsetattr, fdTerminal, TCSANOW, &termp),
+            ERROR_LOCATION);
+
+      // save the VINTR character
+      *pCtrlC = termp.c_cc[VINTR];
+   }
+   else
+   {
+      LOG_ERROR(error);
+   }
+}
+
+// NOTE: called in a vforked child so only async-signal-safe calls
+void closeFileDescriptorsFrom(int fdStart, int fdLimit)
+{
+#if defined(__linux__) && defined(SYS_close_range)
+   if (::syscall(SYS_close_range, fdStart, ~0U, 0) == 0)
+      return;
+#endif
+
+   for (int fd = fdStart; fd < fdLimit; fd++)
+      ::close(fd);
+}
+
+// Start a child with vfork rather than fork. A forked child gets a copy of
+// our page tables, which is expensive (and can fail under strict overcommit)
+// when the session holds a large R heap, whereas a vforked child borrows our
+// address space until it execs. Everything the child needs is therefore
+// prepared up front and the child makes only async-signal-safe calls (it
+// can't allocate or log), passing errors back through shared memory. If
+// fdTerminal is specified then it becomes the child's controlling terminal
+// and standard streams
+Error spawnChild(const std::string& exe,
+                 const std::vector<std::string>& args,
+                 const ProcessOptions& options,
+                 int fdStdin,
+                 int fdStdout,
+                 int fdStderr,
+                 int fdTerminal,
+                 pid_t* pPid)
+{
+   // build args (including the cmd)
+   std::vector<std::string> argv;
+   argv.push_back(exe);
+   argv.insert(argv.end(), args.begin(), args.end());
+   ProcessArgs processArgs(argv);
+
+   // build env
+   boost::scoped_ptr<ProcessArgs> pEnvironment;
+   if (options.environment)
+   {
+      std::vector<std::string> env;
+      const Options& envOptions = options.environment.get();
+      for (Options::const_iterator
+               it = envOptions.begin(); it != envOptions.end(); ++it)
+      {
+         env.push_back(it->first + "=" + it->second);
+      }
+      pEnvironment.reset(new ProcessArgs(env));
+   }
+
+   std::string workingDir;
+   if (!options.workingDir.empty())
+      workingDir = options.workingDir.absolutePath();
+
+   if (fdTerminal != -1)
+   {
+      fdStdin = fdTerminal;
+      fdStdout = fdTerminal;
+      fdStderr = fdTerminal;
+   }
+
+   // a pseudoterminal child needs its own session (as with forkpty)
+   bool newSession = fdTerminal != -1 || options.detachSession;
+   bool newProcessGroup = !newSession && options.terminateChildren;
+
+   // limit for closing file descriptors (see closeFileDescriptorsFrom in
+   // PosixSystem.cpp)
+   struct rlimit rl;
+   int fdLimit = 1024;
+   if (::getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_max != RLIM_INFINITY)
+      fdLimit = static_cast<int>(rl.rlim_max);
+
+   // block signals until the child has reset its handlers (our handlers
+   // must never run in the child since it shares our memory)
+   sigset_t blockAllMask, oldMask;
+   ::sigfillset(&blockAllMask);
+   int result = ::pthread_sigmask(SIG_SETMASK, &blockAllMask, &oldMask);
+   if (result != 0)
+      return systemError(result, ERROR_LOCATION);
+
+   volatile int chdirErrno = 0;
+   volatile int execErrno = 0;
+
+   pid_t pid = ::vfork();
+
+   // child
+   if (pid == 0)
+   {
+      // restore default handling of caught signals (exec would do this
+      // anyway) and then unblock everything
+      for (int sig = 1; sig < NSIG; sig++)
+      {
+         struct sigaction sa;
+         if (::sigaction(sig, NULL, &sa) == 0 &&
+             ((sa.sa_flags & SA_SIGINFO) ||
+              (sa.sa_handler != SIG_IGN && sa.sa_handler != SIG_DFL)))
+         {
+            ::memset(&sa, 0, sizeof(sa));
+            sa.sa_handler = SIG_DFL;
+            ::sigaction(sig, &sa, NULL);
+         }
+      }
+
+      // as with the fork codepath failures here intentionally fail
+      // forward (we always want to get to the exec)
+      if (newSession)
+         ::setsid();
+      else if (newProcessGroup)
+         ::setpgid(0, 0);
+
+      if (fdTerminal != -1)
+         ::ioctl(fdTerminal, TIOCSCTTY, 0);
+
+      ::dup2(fdStdin, STDIN_FILENO);
+      ::dup2(fdStdout, STDOUT_FILENO);
+      ::dup2(fdStderr, STDERR_FILENO);
+
+      closeFileDescriptorsFrom(STDERR_FILENO + 1, fdLimit);
+
+      if (!workingDir.empty() && ::chdir(workingDir.c_str()) == -1)
+         chdirErrno = errno;
+
+      sigset_t blockNoneMask;
+      ::sigemptyset(&blockNoneMask);
+      ::sigprocmask(SIG_SETMASK, &blockNoneMask, NULL);
+
+      if (pEnvironment)
+         ::execve(exe.c_str(), processArgs.args(), pEnvironment->args());
+      else
+         ::execv(exe.c_str(), processArgs.args());
+
+      // if we get here then the exec failed
+      execErrno = errno;
+      ::_exit(EXIT_FAILURE);
+   }
+
+   // parent (the child has exec'd or exited by the time we get here)
+   int vforkErrno = errno;
+   ::pthread_sigmask(SIG_SETMASK, &oldMask, NULL);
+
+   if (pid == -1)
+      return systemError(vforkErrno, ERROR_LOCATION);
+
+   if (chdirErrno != 0)
+   {
+      LOG_ERROR(systemError(chdirErrno,
+                            "Error changing directory",
+                            ERROR_LOCATION));
+   }
+
+   // report exec failures the way the fork codepath does (the child has
+   // exited with EXIT_FAILURE and that will be reaped as usual)
+   if (execErrno != 0)
+   {
+      Error error = systemError(execErrno, ERROR_LOCATION);
+      error.addProperty("exe", exe);
+      LOG_ERROR(error);
+   }
+
+   *pPid = pid;
+   return Success();
+}
+
 } // anonymous namespace
 
 
@@ -354,8 +550,110 @@ Error ChildProcess::terminate()
 }
 
 
+Error ChildProcess::spawn()
+{
+   pid_t pid = -1;
+
+   // pseudoterminal mode: create the pseudoterminal and start the child
+   // with the slave as its controlling terminal
+   if (options_.pseudoterminal)
+   {
+      int fdMaster = -1;
+      int fdSlave = -1;
+      char* nullName = NULL;
+      struct termios* nullTermp = NULL;
+      struct winsize winSize;
+      winSize.ws_col = options_.pseudoterminal.get().cols;
+      winSize.ws_row = options_.pseudoterminal.get().rows;
+      winSize.ws_xpixel = 0;
+      winSize.ws_ypixel = 0;
+      Error error = posixCall<int>(
+         boost::bind(::openpty, &fdMaster, &fdSlave, nullName, nullTermp,
+                     &winSize),
+         ERROR_LOCATION);
+      if (error)
+         return error;
+
+      setTerminalRawMode(fdSlave, &pImpl_->ctrlC);
+
+      error = spawnChild(exe_, args_, options_, -1, -1, -1, fdSlave, &pid);
+      closePipe(fdSlave, ERROR_LOCATION);
+      if (error)
+      {
+         closePipe(fdMaster, ERROR_LOCATION);
+         return error;
+      }
+
+      // record masterFd as our handles
+      pImpl_->init(pid, fdMaster);
+   }
+
+   // standard mode: redirect the child's streams to pipes
+   else
+   {
+      int fdInput[2] = {0,0};
+      int fdOutput[2] = {0,0};
+      int fdError[2] = {0,0};
+
+      // standard input
+      Error error = posixCall<int>(boost::bind(::pipe, fdInput), ERROR_LOCATION);
+      if (error)
+         return error;
+
+      // standard output
+      error = posixCall<int>(boost::bind(::pipe, fdOutput), ERROR_LOCATION);
+      if (error)
+      {
+         closePipe(fdInput, ERROR_LOCATION);
+         return error;
+      }
+
+      // standard error
+      error = posixCall<int>(boost::bind(::pipe, fdError), ERROR_LOCATION);
+      if (error)
+      {
+         closePipe(fdInput, ERROR_LOCATION);
+         closePipe(fdOutput, ERROR_LOCATION);
+         return error;
+      }
+
+      error = spawnChild(exe_,
+                         args_,
+                         options_,
+                         fdInput[READ],
+                         fdOutput[WRITE],
+                         options_.redirectStdErrToStdOut ? fdOutput[WRITE]
+                                                         : fdError[WRITE],
+                         -1,
+                         &pid);
+
+      // close the child's ends of the pipes
+      closePipe(fdInput[READ], ERROR_LOCATION);
+      closePipe(fdOutput[WRITE], ERROR_LOCATION);
+      closePipe(fdError[WRITE], ERROR_LOCATION);
+
+      if (error)
+      {
+         closePipe(fdInput[WRITE], ERROR_LOCATION);
+         closePipe(fdOutput[READ], ERROR_LOCATION);
+         closePipe(fdError[READ], ERROR_LOCATION);
+         return error;
+      }
+
+      // record pipe handles
+      pImpl_->init(pid, fdInput[WRITE], fdOutput[READ], fdError[READ]);
+   }
+
+   return Success();
+}
+
 Error ChildProcess::run()
 {  
+   // children which need to run code of ours after the fork require a
+   // copy of our address space, otherwise we avoid copying it
+   if (!options_.onAfterFork)
+      return spawn();
+
    // declarations
    pid_t pid = 0;
    int fdInput[2] = {0,0};
@@ -476,30 +774,7 @@ Error ChildProcess::run()
       // by forkpty, all we need to do is configure terminal behavior
       if (options_.pseudoterminal)
       {
-         // get current attributes
-         struct termios termp;
-         Error error = posixCall<int>(
-            boost::bind(::tcgetattr, STDIN_FILENO, &termp),
-            ERROR_LOCATION);
-         if (!error)
-         {
-            // specify raw mode (but don't ignore signals -- this is done
-            // so we can send Ctrl-C for interrupts)
-            ::cfmakeraw(&termp);
-            termp.c_lflag |= ISIG;
-
-            // set attribs
-            safePosixCall<int>(
-                  boost::bind(::tcsetattr, STDIN_FILENO, TCSANOW, &termp),
-                  ERROR_LOCATION);
-
-            // save the VINTR character
-            pImpl_->ctrlC = termp.c_cc[VINTR];
-         }
-         else
-         {
-            LOG_ERROR(error);
-         }
+         setTerminalRawMode(STDIN_FILENO, &pImpl_->ctrlC);
       }
 
       // standard mode: close/redirect pipes
@@ -648,7 +923,8 @@ struct AsyncChildProcess::AsyncImpl
       : calledOnStarted_(false),
         finishedStdout_(false),
         finishedStderr_(false),
-        exited_(false)
+        exited_(false),
+        outputPaused_(false)
    {
    }
 
@@ -656,6 +932,7 @@ struct AsyncChildProcess::AsyncImpl
    bool finishedStdout_;
    bool finishedStderr_;
    bool exited_;
+   bool outputPaused_;
 };
 
 AsyncChildProcess::AsyncChildProcess(const std::string& exe,
@@ -728,6 +1005,13 @@ void AsyncChildProcess::poll()
       }
    }
 
+   // hold off reading output (and reaping the child) if the consumer
+   // isn't ready for it
+   pAsyncImpl_->outputPaused_ = callbacks_.onReadyForOutput &&
+                                !callbacks_.onReadyForOutput(*this);
+   if (pAsyncImpl_->outputPaused_)
+      return;
+
    // check stdout and fire event if we got output
    if (!pAsyncImpl_->finishedStdout_)
    {
@@ -816,6 +1100,27 @@ bool AsyncChildProcess::exited()
    return pAsyncImpl_->exited_;
 }
 
+void AsyncChildProcess::outputFds(std::vector<OutputPipe>* pFds) const
+{
+   pFds->clear();
+
+   // nothing to watch until poll has configured the pipes (or once the
+   // child has exited and they have been closed). we also don't watch
+   // output that we aren't going to read
+   if (!pAsyncImpl_->calledOnStarted_ ||
+       pAsyncImpl_->exited_ ||
+       pAsyncImpl_->outputPaused_)
+   {
+      return;
+   }
+
+   if (!pAsyncImpl_->finishedStdout_ && pImpl_->fdStdout != -1)
+      pFds->push_back(pImpl_->fdStdout);
+
+   if (!pAsyncImpl_->finishedStderr_ && pImpl_->fdStderr != -1)
+      pFds->push_back(pImpl_->fdStderr);
+}
+
 } // namespace system
 } // namespace core
 
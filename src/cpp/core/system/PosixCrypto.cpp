@@ -98,6 +98,34 @@ private:
    BIO* pMem_;
 };
    
+Error computeHMAC(const EVP_MD* pDigest,
+                  const std::string& data,
+                  const unsigned char* pKey,
+                  std::size_t keyLength,
+                  std::vector<unsigned char>* pHMAC)
+{
+   // perform the hash (directly on the data, no need to copy it)
+   unsigned int md_len = 0;
+   pHMAC->resize(EVP_MAX_MD_SIZE);
+   unsigned char* pResult = ::HMAC(
+            pDigest,
+            pKey,
+            keyLength,
+            reinterpret_cast<const unsigned char*>(data.data()),
+            data.size(),
+            &(pHMAC->operator[](0)),
+            &md_len);
+   if (pResult != NULL)
+   {
+      pHMAC->resize(md_len);
+      return Success();
+   }
+   else
+   {
+      return lastCryptoError(ERROR_LOCATION);
+   }
+}
+   
 } // anonymous namespace
    
 void initialize()
@@ -122,29 +150,18 @@ Error HMAC_SHA1(const std::string& data,
                 const std::vector<unsigned char>& key,
                 std::vector<unsigned char>* pHMAC)
 {
-   // copy data into data vector
-   std::vector<unsigned char> dataVector;
-   std::copy(data.begin(), data.end(), std::back_inserter(dataVector));
-   
-   // perform the hash
-   unsigned int md_len = 0;
-   pHMAC->resize(EVP_MAX_MD_SIZE);
-   unsigned char* pResult = ::HMAC(EVP_sha1(),
-                                   &(key[0]),
-                                   key.size(),
-                                   &(dataVector[0]),
-                                   dataVector.size(),
-                                   &(pHMAC->operator[](0)),
-                                   &md_len);
-   if (pResult != NULL)
-   {
-      pHMAC->resize(md_len);
-      return Success();
-   }
-   else
-   {
-      return lastCryptoError(ERROR_LOCATION);
-   }
+   return computeHMAC(EVP_sha1(), data, &(key[0]), key.size(), pHMAC);
+}
+
+Error HMAC_SHA256(const std::string& data,
+                  const std::string& key,
+                  std::vector<unsigned char>* pHMAC)
+{
+   return computeHMAC(EVP_sha256(),
+                      data,
+                      reinterpret_cast<const unsigned char*>(key.data()),
+                      key.size(),
+                      pHMAC);
 }
 
 Error base64Encode(const std::vector<unsigned char>& data, 
@@ -18,11 +18,18 @@
 #include <dirent.h>
 #include <sys/stat.h>
 
+#include <deque>
+#include <algorithm>
+
+#include <boost/bind.hpp>
 #include <boost/foreach.hpp>
+#include <boost/utility.hpp>
+#include <boost/shared_ptr.hpp>
 
 #include <core/Error.hpp>
 #include <core/Log.hpp>
 #include <core/FilePath.hpp>
+#include <core/Thread.hpp>
 #include <core/BoostThread.hpp>
 
 #include "config.h"
@@ -43,8 +50,21 @@ int entryFilter(const struct dirent *entry)
       return 1;
 }
 
+struct DirectoryEntry
+{
+   DirectoryEntry(const std::string& name, unsigned char type)
+      : name(name), type(type)
+   {
+   }
+
+   std::string name;
+
+   // dirent d_type (DT_UNKNOWN if not provided by the filesystem)
+   unsigned char type;
+};
+
 // wrapper for scandir api
-Error scanDir(const std::string& dirPath, std::vector<std::string>* pNames)
+Error scanDir(const std::string& dirPath, std::vector<DirectoryEntry>* pEntries)
 {
    // read directory contents into namelist
    struct dirent **namelist;
@@ -62,23 +82,327 @@ Error scanDir(const std::string& dirPath, std::vector<std::string>* pNames)
    // extract the namelist then free it
    for(int i=0; i<entries; i++)
    {
-      // get the name (then free it)
-      std::string name(namelist[i]->d_name,
-#ifdef __APPLE__
-                       namelist[i]->d_namlen);
+      // get the name and type (then free it)
+      std::string name(namelist[i]->d_name);
+#if defined(_DIRENT_HAVE_D_TYPE) || defined(__APPLE__)
+      unsigned char type = namelist[i]->d_type;
 #else
-                       namelist[i]->d_reclen);
+      unsigned char type = DT_UNKNOWN;
 #endif
       ::free(namelist[i]);
 
       // add to the vector
-      pNames->push_back(name);
+      pEntries->push_back(DirectoryEntry(name, type));
    }
    ::free(namelist);
 
    return Success();
 }
 
+// get the FileInfo for a directory entry (returns false if the entry
+// no longer exists or can't be read)
+bool entryFileInfo(const std::string& path,
+                   const DirectoryEntry& entry,
+                   FileInfo* pFileInfo)
+{
+   // directories (which aren't links if the type says so) carry no other
+   // attributes so we don't need to stat them
+   if (entry.type == DT_DIR)
+   {
+      *pFileInfo = FileInfo(path, true, false);
+      return true;
+   }
+
+   // get the attributes
+   struct stat st;
+   int res = ::lstat(path.c_str(), &st);
+   if (res == -1)
+   {
+      if (errno != ENOENT)
+      {
+         Error error = systemError(errno, ERROR_LOCATION);
+         error.addProperty("path", path);
+         LOG_ERROR(error);
+      }
+      return false;
+   }
+
+   // create the FileInfo
+   bool isSymlink = S_ISLNK(st.st_mode);
+   if (S_ISDIR(st.st_mode))
+   {
+      *pFileInfo = FileInfo(path, true, isSymlink);
+   }
+   else
+   {
+      *pFileInfo = FileInfo(path,
+                            false,
+                            st.st_size,
+#ifdef __APPLE__
+                            st.st_mtimespec.tv_sec,
+#else
+                            st.st_mtime,
+#endif
+                            isSymlink);
+   }
+
+   return true;
+}
+
+// Scans a tree with several threads. Each directory read is a unit of work
+// and each thread has its own queue of directories: threads take work from
+// the back of their own queue (so they tend to work depth first) and when
+// that's empty steal from the front of other threads' queues. The results
+// are assembled into the tree once all of the directories have been read.
+class ParallelScanner : boost::noncopyable
+{
+public:
+   ParallelScanner(const FileScannerOptions& options)
+      : options_(options), outstanding_(0)
+   {
+   }
+
+   Error scan(const tree<FileInfo>::iterator_base& fromNode,
+              tree<FileInfo>* pTree)
+   {
+      int threads = std::max(options_.threads, 1);
+      for (int i = 0; i < threads; i++)
+         queues_.push_back(boost::shared_ptr<WorkQueue>(new WorkQueue()));
+
+      DirectoryPtr pRoot(new Directory(*fromNode));
+      push(0, pRoot);
+
+      // the calling thread is the first worker
+      std::vector<boost::shared_ptr<boost::thread> > workers;
+      for (int i = 1; i < threads; i++)
+      {
+         boost::shared_ptr<boost::thread> pThread(new boost::thread());
+         core::thread::safeLaunchThread(
+                  boost::bind(&ParallelScanner::worker, this, i),
+                  pThread.get());
+         workers.push_back(pThread);
+      }
+      worker(0);
+
+      BOOST_FOREACH(const boost::shared_ptr<boost::thread>& pThread, workers)
+      {
+         if (pThread->joinable())
+            pThread->join();
+      }
+
+      if (pRoot->error)
+         return pRoot->error;
+
+      addToTree(pRoot, fromNode, pTree);
+      return Success();
+   }
+
+private:
+
+   struct Directory
+   {
+      explicit Directory(const FileInfo& info) : info(info) {}
+
+      FileInfo info;
+      Error error;
+
+      // children (with the directories which were scanned, or null
+      // for files and directories which weren't)
+      std::vector<FileInfo> children;
+      std::vector<boost::shared_ptr<Directory> > childDirectories;
+   };
+   typedef boost::shared_ptr<Directory> DirectoryPtr;
+
+   struct WorkQueue
+   {
+      boost::mutex mutex;
+      std::deque<DirectoryPtr> directories;
+   };
+
+   void push(std::size_t index, const DirectoryPtr& pDirectory)
+   {
+      // count the work before queueing it so that the outstanding count
+      // can't reach zero while there is still work to do
+      LOCK_MUTEX(mutex_)
+      {
+         outstanding_++;
+      }
+      END_LOCK_MUTEX
+
+      LOCK_MUTEX(queues_[index]->mutex)
+      {
+         queues_[index]->directories.push_back(pDirectory);
+      }
+      END_LOCK_MUTEX
+
+      workAvailable_.notify_one();
+   }
+
+   bool take(std::size_t index, DirectoryPtr* pDirectory)
+   {
+      // our own queue first (newest first), then steal (oldest first)
+      for (std::size_t i = 0; i < queues_.size(); i++)
+      {
+         std::size_t queue = (index + i) % queues_.size();
+         LOCK_MUTEX(queues_[queue]->mutex)
+         {
+            std::deque<DirectoryPtr>& directories =
+                                             queues_[queue]->directories;
+            if (!directories.empty())
+            {
+               if (i == 0)
+               {
+                  *pDirectory = directories.back();
+                  directories.pop_back();
+               }
+               else
+               {
+                  *pDirectory = directories.front();
+                  directories.pop_front();
+               }
+               return true;
+            }
+         }
+         END_LOCK_MUTEX
+      }
+
+      return false;
+   }
+
+   void worker(std::size_t index)
+   {
+      try
+      {
+         while (true)
+         {
+            DirectoryPtr pDirectory;
+            if (take(index, &pDirectory))
+            {
+               scanDirectory(index, pDirectory);
+
+               LOCK_MUTEX(mutex_)
+               {
+                  if (--outstanding_ == 0)
+                     workAvailable_.notify_all();
+               }
+               END_LOCK_MUTEX
+
+               continue;
+            }
+
+            // wait for more work (or for all of the work to be done). the
+            // wait is timed since work can be queued between our check of
+            // the queues and the wait
+            boost::unique_lock<boost::mutex> lock(mutex_);
+            if (outstanding_ == 0)
+               return;
+            workAvailable_.timed_wait(lock,
+                                      boost::posix_time::milliseconds(5));
+         }
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
+   void scanDirectory(std::size_t index, const DirectoryPtr& pDirectory)
+   {
+      const std::string& dirPath = pDirectory->info.absolutePath();
+
+      // call onBeforeScanDir hook
+      if (options_.onBeforeScanDir)
+      {
+         LOCK_MUTEX(callbackMutex_)
+         {
+            pDirectory->error = options_.onBeforeScanDir(pDirectory->info);
+         }
+         END_LOCK_MUTEX
+
+         if (pDirectory->error)
+            return;
+      }
+
+      // read directory contents
+      std::vector<DirectoryEntry> entries;
+      pDirectory->error = scanDir(dirPath, &entries);
+      if (pDirectory->error)
+         return;
+
+      // get the attributes
+      FilePath rootPath(dirPath);
+      std::vector<FileInfo> children;
+      children.reserve(entries.size());
+      BOOST_FOREACH(const DirectoryEntry& entry, entries)
+      {
+         FileInfo fileInfo;
+         std::string path = rootPath.childPath(entry.name).absolutePath();
+         if (entryFileInfo(path, entry, &fileInfo))
+            children.push_back(fileInfo);
+      }
+
+      // apply the filter (if any)
+      if (options_.filter)
+      {
+         std::vector<FileInfo> filtered;
+         LOCK_MUTEX(callbackMutex_)
+         {
+            BOOST_FOREACH(const FileInfo& fileInfo, children)
+            {
+               if (options_.filter(fileInfo))
+                  filtered.push_back(fileInfo);
+            }
+         }
+         END_LOCK_MUTEX
+         children.swap(filtered);
+      }
+
+      // queue subdirectories (which aren't links)
+      pDirectory->children = children;
+      BOOST_FOREACH(const FileInfo& fileInfo, children)
+      {
+         DirectoryPtr pChild;
+         if (fileInfo.isDirectory() && !fileInfo.isSymlink())
+         {
+            pChild.reset(new Directory(fileInfo));
+            push(index, pChild);
+         }
+         pDirectory->childDirectories.push_back(pChild);
+      }
+   }
+
+   void addToTree(const DirectoryPtr& pDirectory,
+                  const tree<FileInfo>::iterator_base& node,
+                  tree<FileInfo>* pTree)
+   {
+      for (std::size_t i = 0; i < pDirectory->children.size(); i++)
+      {
+         tree<FileInfo>::iterator_base child =
+                     pTree->append_child(node, pDirectory->children[i]);
+
+         // as with the single threaded scan don't let one "bad" directory
+         // abort the entire scan
+         const DirectoryPtr& pChild = pDirectory->childDirectories[i];
+         if (pChild)
+         {
+            if (pChild->error)
+               LOG_ERROR(pChild->error);
+            else
+               addToTree(pChild, child, pTree);
+         }
+      }
+   }
+
+private:
+   FileScannerOptions options_;
+   std::vector<boost::shared_ptr<WorkQueue> > queues_;
+
+   // work accounting (directories queued or being scanned)
+   boost::mutex mutex_;
+   boost::condition_variable workAvailable_;
+   int outstanding_;
+
+   // serializes calls to filter and onBeforeScanDir
+   boost::mutex callbackMutex_;
+};
+
 } // anonymous namespace
 
 Error scanFiles(const tree<FileInfo>::iterator_base& fromNode,
@@ -88,6 +412,13 @@ Error scanFiles(const tree<FileInfo>::iterator_base& fromNode,
    // clear all existing
    pTree->erase_children(fromNode);
 
+   // use the parallel scanner for recursive scans if requested
+   if (options.recursive && options.threads > 1)
+   {
+      ParallelScanner scanner(options);
+      return scanner.scan(fromNode, pTree);
+   }
+
    // create FilePath for root
    FilePath rootPath(fromNode->absolutePath());
 
@@ -104,50 +435,21 @@ Error scanFiles(const tree<FileInfo>::iterator_base& fromNode,
    }
 
    // read directory contents
-   std::vector<std::string> names;
-   Error error = scanDir(fromNode->absolutePath(), &names);
+   std::vector<DirectoryEntry> entries;
+   Error error = scanDir(fromNode->absolutePath(), &entries);
    if (error)
       return error;
 
-   // iterate over the names
-   BOOST_FOREACH(const std::string& name, names)
+   // iterate over the entries
+   BOOST_FOREACH(const DirectoryEntry& entry, entries)
    {
       // compute the path
-      std::string path = rootPath.childPath(name).absolutePath();
+      std::string path = rootPath.childPath(entry.name).absolutePath();
 
       // get the attributes
-      struct stat st;
-      int res = ::lstat(path.c_str(), &st);
-      if (res == -1)
-      {
-         if (errno != ENOENT)
-         {
-            Error error = systemError(errno, ERROR_LOCATION);
-            error.addProperty("path", path);
-            LOG_ERROR(error);
-         }
-         continue;
-      }
-
-      // create the FileInfo
       FileInfo fileInfo;
-      bool isSymlink = S_ISLNK(st.st_mode);
-      if (S_ISDIR(st.st_mode))
-      {
-         fileInfo = FileInfo(path, true, isSymlink);
-      }
-      else
-      {
-         fileInfo = FileInfo(path,
-                             false,
-                             st.st_size,
-#ifdef __APPLE__
-                             st.st_mtimespec.tv_sec,
-#else
-                             st.st_mtime,
-#endif
-                             isSymlink);
-      }
+      if (!entryFileInfo(path, entry, &fileInfo))
+         continue;
 
       // apply the filter (if any)
       if (!options.filter || options.filter(fileInfo))
@@ -36,6 +36,9 @@
 
 #ifdef __APPLE__
 #include <mach-o/dyld.h>
+#include <malloc/malloc.h>
+#else
+#include <malloc.h>
 #endif
 
 #include <boost/thread.hpp>
@@ -50,6 +53,7 @@
 #include <core/FilePath.hpp>
 #include <core/FileInfo.hpp>
 #include <core/FileLogWriter.hpp>
+#include <core/FileSerializer.hpp>
 #include <core/Exec.hpp>
 #include <core/SyslogLogWriter.hpp>
 #include <core/StderrLogWriter.hpp>
@@ -641,6 +645,36 @@ Error terminateProcess(PidType pid)
       return Success();
 }
 
+HeapStatistics heapStatistics()
+{
+   HeapStatistics stats;
+#if defined(__GLIBC__)
+   // (mallinfo's fields are ints and so wrap beyond 2GB)
+#if __GLIBC_PREREQ(2, 33)
+   struct mallinfo2 info = ::mallinfo2();
+#else
+   struct mallinfo info = ::mallinfo();
+#endif
+   stats.inUse = static_cast<uintmax_t>(info.uordblks) +
+                 static_cast<uintmax_t>(info.hblkhd);
+   stats.free = static_cast<uintmax_t>(info.fordblks);
+#elif defined(__APPLE__)
+   struct mstats info = ::mstats();
+   stats.inUse = info.bytes_used;
+   stats.free = info.bytes_free;
+#endif
+   return stats;
+}
+
+void releaseFreeHeap()
+{
+#if defined(__GLIBC__)
+   ::malloc_trim(0);
+#elif defined(__APPLE__)
+   ::malloc_zone_pressure_relief(NULL, 0);
+#endif
+}
+
 
 Error daemonize()
 {
@@ -817,6 +851,43 @@ Error setProcessLimits(RLimitType memoryLimitBytes,
    }
 }
 
+// create the cgroup, apply its settings, and move the calling process into
+// it (children forked later on are then accounted to it as well)
+Error joinCGroup(const std::string& cgroupPath,
+                 const core::system::Options& settings)
+{
+   FilePath cgroup(cgroupPath);
+   if (::mkdir(cgroup.absolutePath().c_str(), 0755) == -1 && errno != EEXIST)
+      return systemError(errno, ERROR_LOCATION);
+
+   // enable the controllers we need within the parent (this is harmless
+   // if they are already enabled)
+   for (core::system::Options::const_iterator it = settings.begin();
+        it != settings.end(); ++it)
+   {
+      std::string controller = it->first.substr(0, it->first.find('.'));
+      Error error = writeStringToFile(
+                        cgroup.parent().childPath("cgroup.subtree_control"),
+                        "+" + controller);
+      if (error)
+         LOG_ERROR(error);
+   }
+
+   for (core::system::Options::const_iterator it = settings.begin();
+        it != settings.end(); ++it)
+   {
+      Error error = writeStringToFile(cgroup.childPath(it->first), it->second);
+      if (error)
+      {
+         error.addProperty("value", it->second);
+         LOG_ERROR(error);
+      }
+   }
+
+   return writeStringToFile(cgroup.childPath("cgroup.procs"),
+                            safe_convert::numberToString(::getpid()));
+}
+
 void copyEnvironmentVar(const std::string& name,
                         std::vector<std::string>* pVars,
                         bool evenIfEmpty = false)
@@ -925,6 +996,14 @@ Error launchChildProcess(std::string path,
          if (error)
             LOG_ERROR(error);
 
+         // join cgroup
+         if (!config.cgroupPath.empty())
+         {
+            error = joinCGroup(config.cgroupPath, config.cgroupSettings);
+            if (error)
+               LOG_ERROR(error);
+         }
+
          // switch user
          error = permanentlyDropPriv(runAsUser);
          if (error)
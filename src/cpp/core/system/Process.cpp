@@ -15,6 +15,7 @@
 
 #include <core/system/Process.hpp>
 
+#include <set>
 #include <iostream>
 
 #include <boost/bind.hpp>
@@ -28,6 +29,7 @@
 #include <core/PerformanceTimer.hpp>
 
 #include "ChildProcess.hpp"
+#include "ChildOutputWatcher.hpp"
 
 namespace core {
 namespace system {
@@ -65,6 +67,12 @@ struct ProcessSupervisor::Impl
    Impl() : isPolling(false) {}
    bool isPolling;
    std::vector<boost::shared_ptr<AsyncChildProcess> > children;
+
+   // when output is being watched we only poll children which are ready
+   // (plus a full poll every so often as a safety net)
+   boost::scoped_ptr<ChildOutputWatcher> pWatcher;
+   std::set<AsyncChildProcess*> watched;
+   boost::posix_time::ptime lastFullPoll;
 };
 
 ProcessSupervisor::ProcessSupervisor()
@@ -257,6 +265,20 @@ Error ProcessSupervisor::runCommand(
 
 
 
+Error ProcessSupervisor::watchOutput(const boost::function<void()>& onOutput)
+{
+   if (pImpl_->pWatcher)
+      return Success();
+
+   boost::scoped_ptr<ChildOutputWatcher> pWatcher(new ChildOutputWatcher());
+   Error error = pWatcher->start(onOutput);
+   if (error)
+      return error;
+
+   pImpl_->pWatcher.swap(pWatcher);
+   return Success();
+}
+
 bool ProcessSupervisor::hasRunningChildren()
 {
    return !pImpl_->children.empty();
@@ -278,10 +300,17 @@ bool ProcessSupervisor::poll()
    pImpl_->isPolling = true;
    scope::SetOnExit<bool> setOnExit(&pImpl_->isPolling, false);
 
-   // call poll on all of our children
-   std::for_each(pImpl_->children.begin(),
-                 pImpl_->children.end(),
-                 boost::bind(&AsyncChildProcess::poll, _1));
+   if (pImpl_->pWatcher)
+   {
+      pollWatchedChildren();
+   }
+   else
+   {
+      // call poll on all of our children
+      std::for_each(pImpl_->children.begin(),
+                    pImpl_->children.end(),
+                    boost::bind(&AsyncChildProcess::poll, _1));
+   }
 
    // remove any children who have exited from our list
    pImpl_->children.erase(std::remove_if(
@@ -294,6 +323,59 @@ bool ProcessSupervisor::poll()
    return hasRunningChildren();
 }
 
+void ProcessSupervisor::pollWatchedChildren()
+{
+   using namespace boost::posix_time;
+
+   std::set<AsyncChildProcess*> ready;
+   pImpl_->pWatcher->takeReady(&ready);
+
+   ptime now = microsec_clock::universal_time();
+   bool fullPoll = pImpl_->lastFullPoll.is_not_a_date_time() ||
+                   (now - pImpl_->lastFullPoll) >= seconds(1);
+   if (fullPoll)
+      pImpl_->lastFullPoll = now;
+
+   std::vector<OutputPipe> fds;
+   BOOST_FOREACH(boost::shared_ptr<AsyncChildProcess> pChild,
+                 pImpl_->children)
+   {
+      AsyncChildProcess* pRaw = pChild.get();
+
+      // skip children which are being watched and have no output
+      // (children with onContinue callbacks expect to be called
+      // at every poll so are never skipped)
+      if (!fullPoll &&
+          !pChild->hasContinueCallback() &&
+          pImpl_->watched.count(pRaw) &&
+          !ready.count(pRaw))
+      {
+         continue;
+      }
+
+      pChild->poll();
+
+      // (re)watch the child's open pipes. children without any (e.g.
+      // because they closed their output but are still running) are
+      // polled every time so we notice when they exit
+      if (!pChild->exited())
+         pChild->outputFds(&fds);
+      else
+         fds.clear();
+
+      if (!fds.empty())
+      {
+         pImpl_->pWatcher->watch(pRaw, fds);
+         pImpl_->watched.insert(pRaw);
+      }
+      else
+      {
+         pImpl_->pWatcher->unwatch(pRaw);
+         pImpl_->watched.erase(pRaw);
+      }
+   }
+}
+
 void ProcessSupervisor::terminateAll()
 {
    // call terminate on all of our children
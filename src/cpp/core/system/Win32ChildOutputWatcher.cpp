@@ -0,0 +1,291 @@
+/*
+ * Win32ChildOutputWatcher.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "ChildOutputWatcher.hpp"
+
+#include <algorithm>
+#include <map>
+
+#include <windows.h>
+
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/Thread.hpp>
+#include <core/BoostThread.hpp>
+
+namespace core {
+namespace system {
+
+namespace {
+
+// a zero byte read pending against a pipe (it completes once data is
+// available or the pipe is broken, without consuming anything). owned by
+// the watcher until its completion is dequeued since the system writes
+// into the OVERLAPPED structure
+struct PendingRead
+{
+   PendingRead(AsyncChildProcess* pChild, HANDLE hPipe)
+      : pChild(pChild), hPipe(hPipe)
+   {
+      ::ZeroMemory(&overlapped, sizeof(OVERLAPPED));
+   }
+
+   OVERLAPPED overlapped;
+   AsyncChildProcess* pChild;
+   HANDLE hPipe;
+};
+
+// completion key used to stop the watcher thread
+const ULONG_PTR kStopKey = 1;
+
+} // anonymous namespace
+
+// state is shared with the watcher thread so that it remains valid if
+// the thread outlives the watcher (it is detached on destruction)
+struct ChildOutputWatcher::Impl
+{
+   Impl() : hCompletionPort(NULL) {}
+
+   ~Impl()
+   {
+      if (hCompletionPort != NULL)
+         ::CloseHandle(hCompletionPort);
+   }
+
+   void run();
+
+   // NOTE: called with mutex held (returns true if the child is ready
+   // without waiting for a completion)
+   bool issueRead(AsyncChildProcess* pChild, HANDLE hPipe);
+
+   boost::mutex mutex;
+   std::map<AsyncChildProcess*, std::vector<OutputPipe> > watched;
+   std::set<AsyncChildProcess*> ready;
+
+   // pipes associated with the completion port (a handle can only be
+   // associated once) and pipes which have a read pending
+   std::map<AsyncChildProcess*, std::set<HANDLE> > associated;
+   std::set<HANDLE> pending;
+
+   HANDLE hCompletionPort;
+   boost::function<void()> onOutput;
+   boost::thread thread;
+};
+
+bool ChildOutputWatcher::Impl::issueRead(AsyncChildProcess* pChild,
+                                         HANDLE hPipe)
+{
+   if (pending.count(hPipe))
+      return false;
+
+   std::set<HANDLE>& childPipes = associated[pChild];
+   if (!childPipes.count(hPipe))
+   {
+      if (::CreateIoCompletionPort(hPipe, hCompletionPort, 0, 0) == NULL)
+      {
+         LOG_ERROR(systemError(::GetLastError(), ERROR_LOCATION));
+         return false;
+      }
+      childPipes.insert(hPipe);
+   }
+
+   // a read which completes immediately still queues a completion packet
+   // so we learn about it from the port along with those which pend
+   PendingRead* pRead = new PendingRead(pChild, hPipe);
+   if (!::ReadFile(hPipe, NULL, 0, NULL, &(pRead->overlapped)) &&
+       ::GetLastError() != ERROR_IO_PENDING)
+   {
+      // a read which fails (e.g. because the pipe is already broken)
+      // doesn't queue anything so mark the child ready now (its poll
+      // will discover the error)
+      delete pRead;
+      if (watched.erase(pChild))
+      {
+         ready.insert(pChild);
+         return true;
+      }
+      return false;
+   }
+
+   pending.insert(hPipe);
+   return false;
+}
+
+void ChildOutputWatcher::Impl::run()
+{
+   try
+   {
+      while (true)
+      {
+         DWORD dwBytes = 0;
+         ULONG_PTR key = 0;
+         LPOVERLAPPED pOverlapped = NULL;
+         BOOL success = ::GetQueuedCompletionStatus(hCompletionPort,
+                                                    &dwBytes,
+                                                    &key,
+                                                    &pOverlapped,
+                                                    INFINITE);
+         if (key == kStopKey)
+            return;
+
+         if (pOverlapped == NULL)
+         {
+            if (!success)
+            {
+               LOG_ERROR(systemError(::GetLastError(), ERROR_LOCATION));
+               boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+            }
+            continue;
+         }
+
+         // any completion at all (data, eof, a broken pipe, or the pipe
+         // being closed) means the child needs to be polled. children
+         // which were unwatched since the read was issued are skipped
+         PendingRead* pRead = reinterpret_cast<PendingRead*>(pOverlapped);
+         bool haveReady = false;
+         LOCK_MUTEX(mutex)
+         {
+            pending.erase(pRead->hPipe);
+            if (watched.erase(pRead->pChild))
+            {
+               ready.insert(pRead->pChild);
+               haveReady = true;
+            }
+         }
+         END_LOCK_MUTEX
+         delete pRead;
+
+         if (haveReady && onOutput)
+            onOutput();
+      }
+   }
+   catch(const boost::thread_interrupted&)
+   {
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+}
+
+ChildOutputWatcher::ChildOutputWatcher()
+   : pImpl_(new Impl())
+{
+}
+
+ChildOutputWatcher::~ChildOutputWatcher()
+{
+   try
+   {
+      if (pImpl_->thread.joinable())
+      {
+         ::PostQueuedCompletionStatus(pImpl_->hCompletionPort,
+                                      0,
+                                      kStopKey,
+                                      NULL);
+
+         // don't hold up shutdown if the thread doesn't stop promptly
+         // (it holds a reference to the shared state so can be detached)
+         pImpl_->thread.timed_join(boost::posix_time::seconds(1));
+         pImpl_->thread.detach();
+      }
+   }
+   catch(...)
+   {
+   }
+}
+
+Error ChildOutputWatcher::start(const boost::function<void()>& onOutput)
+{
+   pImpl_->hCompletionPort = ::CreateIoCompletionPort(INVALID_HANDLE_VALUE,
+                                                      NULL,
+                                                      0,
+                                                      1);
+   if (pImpl_->hCompletionPort == NULL)
+      return systemError(::GetLastError(), ERROR_LOCATION);
+
+   pImpl_->onOutput = onOutput;
+
+   core::thread::safeLaunchThread(boost::bind(&Impl::run, pImpl_),
+                                  &(pImpl_->thread));
+   if (!pImpl_->thread.joinable())
+      return systemError(boost::system::errc::resource_unavailable_try_again,
+                         ERROR_LOCATION);
+
+   return Success();
+}
+
+void ChildOutputWatcher::watch(AsyncChildProcess* pChild,
+                               const std::vector<OutputPipe>& pipes)
+{
+   // reads are issued from here (rather than from the watcher thread)
+   // since their completions are queued to the port regardless of which
+   // thread issued them
+   bool haveReady = false;
+   LOCK_MUTEX(pImpl_->mutex)
+   {
+      pImpl_->watched[pChild] = pipes;
+
+      // forget pipes which the child has closed
+      std::set<HANDLE>& childPipes = pImpl_->associated[pChild];
+      for (std::set<HANDLE>::iterator it = childPipes.begin();
+           it != childPipes.end(); )
+      {
+         if (std::find(pipes.begin(), pipes.end(), *it) == pipes.end())
+            childPipes.erase(it++);
+         else
+            ++it;
+      }
+
+      BOOST_FOREACH(OutputPipe pipe, pipes)
+      {
+         if (pImpl_->issueRead(pChild, pipe))
+         {
+            haveReady = true;
+            break;
+         }
+      }
+   }
+   END_LOCK_MUTEX
+
+   if (haveReady && pImpl_->onOutput)
+      pImpl_->onOutput();
+}
+
+void ChildOutputWatcher::unwatch(AsyncChildProcess* pChild)
+{
+   // any reads still pending complete (and are discarded) once the child
+   // closes its pipes
+   LOCK_MUTEX(pImpl_->mutex)
+   {
+      pImpl_->watched.erase(pChild);
+      pImpl_->ready.erase(pChild);
+      pImpl_->associated.erase(pChild);
+   }
+   END_LOCK_MUTEX
+}
+
+void ChildOutputWatcher::takeReady(std::set<AsyncChildProcess*>* pReady)
+{
+   LOCK_MUTEX(pImpl_->mutex)
+   {
+      pReady->swap(pImpl_->ready);
+      pImpl_->ready.clear();
+   }
+   END_LOCK_MUTEX
+}
+
+} // namespace system
+} // namespace core
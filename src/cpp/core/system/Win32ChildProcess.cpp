@@ -22,6 +22,7 @@
 
 
 #include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 
 #include <core/system/System.hpp>
@@ -101,14 +102,89 @@ void resolveCommand(std::string* pExecutable, std::vector<std::string>* pArgs)
 }
 
 
-Error readPipeAvailableBytes(HANDLE hPipe, std::string* pOutput)
+// create a pipe whose read end supports overlapped i/o (anonymous pipes
+// don't) so that its output can be watched using a completion port
+Error createOverlappedPipe(HANDLE* phRead, HANDLE* phWrite)
+{
+   static volatile LONG s_pipeCount = 0;
+   std::string name = "\\\\.\\pipe\\rstudio-child-" +
+         boost::lexical_cast<std::string>(::GetCurrentProcessId()) + "-" +
+         boost::lexical_cast<std::string>(::InterlockedIncrement(&s_pipeCount));
+
+   const DWORD kBufferSize = 65536;
+   HANDLE hRead = ::CreateNamedPipeA(name.c_str(),
+                                     PIPE_ACCESS_INBOUND |
+                                     FILE_FLAG_OVERLAPPED |
+                                     FILE_FLAG_FIRST_PIPE_INSTANCE,
+                                     PIPE_TYPE_BYTE | PIPE_WAIT,
+                                     1,
+                                     kBufferSize,
+                                     kBufferSize,
+                                     0,
+                                     NULL);
+   if (hRead == INVALID_HANDLE_VALUE)
+      return systemError(::GetLastError(), ERROR_LOCATION);
+
+   HANDLE hWrite = ::CreateFileA(name.c_str(),
+                                 GENERIC_WRITE,
+                                 0,
+                                 NULL,
+                                 OPEN_EXISTING,
+                                 FILE_ATTRIBUTE_NORMAL,
+                                 NULL);
+   if (hWrite == INVALID_HANDLE_VALUE)
+   {
+      Error error = systemError(::GetLastError(), ERROR_LOCATION);
+      ::CloseHandle(hRead);
+      return error;
+   }
+
+   *phRead = hRead;
+   *phWrite = hWrite;
+   return Success();
+}
+
+// read from an overlapped pipe (we only read what is known to be available
+// so this completes immediately). the low bit of the event handle is set
+// so that the completion isn't queued to any port the pipe is associated
+// with
+BOOL readOverlappedPipe(HANDLE hPipe,
+                        LPVOID pBuffer,
+                        DWORD dwBytes,
+                        DWORD* pBytesRead)
+{
+   HANDLE hEvent = ::CreateEvent(NULL, TRUE, FALSE, NULL);
+   if (hEvent == NULL)
+      return FALSE;
+
+   OVERLAPPED overlapped;
+   ::ZeroMemory(&overlapped, sizeof(OVERLAPPED));
+   overlapped.hEvent = (HANDLE)((DWORD_PTR)hEvent | 1);
+
+   BOOL result = ::ReadFile(hPipe, pBuffer, dwBytes, NULL, &overlapped);
+   if (result || ::GetLastError() == ERROR_IO_PENDING)
+      result = ::GetOverlappedResult(hPipe, &overlapped, pBytesRead, TRUE);
+
+   DWORD dwError = ::GetLastError();
+   ::CloseHandle(hEvent);
+   ::SetLastError(dwError);
+   return result;
+}
+
+Error readPipeAvailableBytes(HANDLE hPipe,
+                             bool overlapped,
+                             bool* pBroken,
+                             std::string* pOutput)
 {
    // check for available bytes
    DWORD dwAvail = 0;
    if (!::PeekNamedPipe(hPipe, NULL, 0, NULL, &dwAvail, NULL))
    {
       if (::GetLastError() == ERROR_BROKEN_PIPE)
+      {
+         *pBroken = true;
          return Success();
+      }
       else
          return systemError(::GetLastError(), ERROR_LOCATION);
    }
@@ -120,7 +196,10 @@ Error readPipeAvailableBytes(HANDLE hPipe, std::string* pOutput)
    // read data which is available
    DWORD nBytesRead;
    std::vector<CHAR> buffer(dwAvail, 0);
-   if (!::ReadFile(hPipe, &(buffer[0]), dwAvail, &nBytesRead, NULL))
+   BOOL result = overlapped ?
+         readOverlappedPipe(hPipe, &(buffer[0]), dwAvail, &nBytesRead) :
+         ::ReadFile(hPipe, &(buffer[0]), dwAvail, &nBytesRead, NULL);
+   if (!result)
       return systemError(::GetLastError(), ERROR_LOCATION);
 
    // append to output
@@ -165,7 +244,8 @@ Error readPipeUntilDone(HANDLE hPipe, std::string* pOutput)
 struct ChildProcess::Impl
 {
    Impl()
-      : hStdInWrite(NULL),
+      : overlappedOutput(false),
+        hStdInWrite(NULL),
         hStdOutRead(NULL),
         hStdErrRead(NULL),
         hProcess(NULL),
@@ -176,6 +256,10 @@ struct ChildProcess::Impl
    {
    }
 
+   // use overlapped pipes for output (async children only, since their
+   // output may be watched using a completion port)
+   bool overlappedOutput;
+
    HANDLE hStdInWrite;
    HANDLE hStdOutRead;
    HANDLE hStdErrRead;
@@ -324,7 +408,13 @@ Error ChildProcess::run()
 
    // Standard output pipe
    HANDLE hStdOutWrite;
-   if (!::CreatePipe(&pImpl_->hStdOutRead, &hStdOutWrite, NULL, 0))
+   if (pImpl_->overlappedOutput)
+   {
+      error = createOverlappedPipe(&pImpl_->hStdOutRead, &hStdOutWrite);
+      if (error)
+         return error;
+   }
+   else if (!::CreatePipe(&pImpl_->hStdOutRead, &hStdOutWrite, NULL, 0))
       return systemError(::GetLastError(), ERROR_LOCATION);
    CloseHandleOnExitScope closeStdOut(&hStdOutWrite, ERROR_LOCATION);
    if (!::SetHandleInformation(hStdOutWrite,
@@ -334,7 +424,13 @@ Error ChildProcess::run()
 
    // Standard error pipe
    HANDLE hStdErrWrite;
-   if (!::CreatePipe(&pImpl_->hStdErrRead, &hStdErrWrite, NULL, 0))
+   if (pImpl_->overlappedOutput)
+   {
+      error = createOverlappedPipe(&pImpl_->hStdErrRead, &hStdErrWrite);
+      if (error)
+         return error;
+   }
+   else if (!::CreatePipe(&pImpl_->hStdErrRead, &hStdErrWrite, NULL, 0))
       return systemError(::GetLastError(), ERROR_LOCATION);
    CloseHandleOnExitScope closeStdErr(&hStdErrWrite, ERROR_LOCATION);
    if (!::SetHandleInformation(hStdErrWrite,
@@ -518,11 +614,12 @@ Error SyncChildProcess::waitForExit(int* pExitStatus)
 struct AsyncChildProcess::AsyncImpl
 {
    AsyncImpl()
-      : calledOnStarted_(false)
+      : calledOnStarted_(false), outputPaused_(false)
    {
    }
 
    bool calledOnStarted_;
+   bool outputPaused_;
 };
 
 AsyncChildProcess::AsyncChildProcess(const std::string& exe,
@@ -530,6 +627,7 @@ AsyncChildProcess::AsyncChildProcess(const std::string& exe,
                                      const ProcessOptions& options)
    : ChildProcess(), pAsyncImpl_(new AsyncImpl())
 {
+   pImpl_->overlappedOutput = true;
    init(exe, args, options);
 }
 
@@ -537,6 +635,7 @@ AsyncChildProcess::AsyncChildProcess(const std::string& command,
                                      const ProcessOptions& options)
    : ChildProcess(), pAsyncImpl_(new AsyncImpl())
 {
+   pImpl_->overlappedOutput = true;
    init(command, options);
 }
 
@@ -573,21 +672,56 @@ void AsyncChildProcess::poll()
       }
    }
 
-   // check stdout
+   // hold off reading output (and checking for exit) if the consumer
+   // isn't ready for it
+   pAsyncImpl_->outputPaused_ = callbacks_.onReadyForOutput &&
+                                !callbacks_.onReadyForOutput(*this);
+   if (pAsyncImpl_->outputPaused_)
+      return;
+
+   // check stdout (we close the pipe once it's broken so that it's no
+   // longer watched)
    std::string stdOut;
-   Error error = readPipeAvailableBytes(pImpl_->hStdOutRead, &stdOut);
-   if (error)
-      reportError(error);
-   if (!stdOut.empty() && callbacks_.onStdout)
-      callbacks_.onStdout(*this, stdOut);
+   bool broken = false;
+   Error error;
+   if (pImpl_->hStdOutRead != NULL)
+   {
+      error = readPipeAvailableBytes(pImpl_->hStdOutRead,
+                                     pImpl_->overlappedOutput,
+                                     &broken,
+                                     &stdOut);
+      if (error)
+         reportError(error);
+      if (broken)
+      {
+         error = closeHandle(&pImpl_->hStdOutRead, ERROR_LOCATION);
+         if (error)
+            LOG_ERROR(error);
+      }
+      if (!stdOut.empty() && callbacks_.onStdout)
+         callbacks_.onStdout(*this, stdOut);
+   }
 
    // check stderr
    std::string stdErr;
-   error = readPipeAvailableBytes(pImpl_->hStdErrRead, &stdErr);
-   if (error)
-      reportError(error);
-   if (!stdErr.empty() && callbacks_.onStderr)
-      callbacks_.onStderr(*this, stdErr);
+   broken = false;
+   if (pImpl_->hStdErrRead != NULL)
+   {
+      error = readPipeAvailableBytes(pImpl_->hStdErrRead,
+                                     pImpl_->overlappedOutput,
+                                     &broken,
+                                     &stdErr);
+      if (error)
+         reportError(error);
+      if (broken)
+      {
+         error = closeHandle(&pImpl_->hStdErrRead, ERROR_LOCATION);
+         if (error)
+            LOG_ERROR(error);
+      }
+      if (!stdErr.empty() && callbacks_.onStderr)
+         callbacks_.onStderr(*this, stdErr);
+   }
 
    // check for process exit
    DWORD result = ::WaitForSingleObject(pImpl_->hProcess, 0);
@@ -626,7 +760,7 @@ void AsyncChildProcess::poll()
       }
 
       // close the process handle
-      Error error = closeHandle(&pImpl_->hProcess, ERROR_LOCATION);
+      error = closeHandle(&pImpl_->hProcess, ERROR_LOCATION);
       if (error)
          LOG_ERROR(error);
 
@@ -641,6 +775,26 @@ bool AsyncChildProcess::exited()
    return pImpl_->hProcess == NULL;
 }
 
+void AsyncChildProcess::outputFds(std::vector<OutputPipe>* pFds) const
+{
+   pFds->clear();
+
+   // nothing to watch until poll has been called for the first time (or
+   // once the child has exited, or while output is paused)
+   if (!pAsyncImpl_->calledOnStarted_ ||
+       pImpl_->hProcess == NULL ||
+       pAsyncImpl_->outputPaused_)
+   {
+      return;
+   }
+
+   if (pImpl_->hStdOutRead != NULL)
+      pFds->push_back(pImpl_->hStdOutRead);
+
+   if (pImpl_->hStdErrRead != NULL)
+      pFds->push_back(pImpl_->hStdErrRead);
+}
+
 } // namespace system
 } // namespace core
 
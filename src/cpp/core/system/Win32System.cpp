@@ -17,6 +17,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <malloc.h>
 #include <io.h>
 
 #include <iostream>
@@ -667,6 +668,16 @@ Error terminateProcess(PidType pid)
    return Success();
 }
 
+HeapStatistics heapStatistics()
+{
+   return HeapStatistics();
+}
+
+void releaseFreeHeap()
+{
+   ::_heapmin();
+}
+
 
 Error closeHandle(HANDLE* pHandle, const ErrorLocation& location)
 {
@@ -51,6 +51,13 @@ namespace {
 // we don't want it to ever be destructed)
 std::list<Handle>* s_pActiveHandles;
 
+// backend requested at initialization (read by the platform-specific
+// implementations on the file-monitor thread)
+Backend s_backend = DefaultBackend;
+
+// pool used to collect the changes found by rescans (optional)
+core::thread::ThreadPool* s_pThreadPool = NULL;
+
 void addEvent(FileChangeEvent::Type type,
               const FileInfo& fileInfo,
               std::vector<FileChangeEvent>* pEvents)
@@ -168,6 +175,7 @@ Error processFileAdded(
       FileScannerOptions options;
       options.recursive = true;
       options.yield = true;
+      options.threads = kScanThreads;
       options.filter = filter;
       options.onBeforeScanDir = onBeforeScanDir;
       Error error = scanFiles(fileChange.fileInfo(), options, &subTree);
@@ -291,6 +299,7 @@ Error discoverAndProcessFileChanges(
    FileScannerOptions options;
    options.recursive = recursive;
    options.yield = true;
+   options.threads = kScanThreads;
    options.filter = filter;
    options.onBeforeScanDir = onBeforeScanDir;
    Error error = scanFiles(fileInfo, options, &subdirTree);
@@ -303,10 +312,10 @@ Error discoverAndProcessFileChanges(
       // check for changes on full subtree
       std::vector<FileChangeEvent> fileChanges;
       tree<FileInfo> existingSubtree(it);
-      collectFileChangeEvents(existingSubtree.begin(),
-                              existingSubtree.end(),
-                              subdirTree.begin(),
-                              subdirTree.end(),
+      collectFileChangeEvents(existingSubtree,
+                              subdirTree,
+                              boost::function<bool(const FileInfo&)>(),
+                              threadPool(),
                               &fileChanges);
 
       // fire events
@@ -382,6 +391,16 @@ std::list<void*> activeEventContexts()
   return contexts;
 }
 
+Backend backend()
+{
+   return s_backend;
+}
+
+core::thread::ThreadPool* threadPool()
+{
+   return s_pThreadPool;
+}
+
 
 } // namespace impl
 
@@ -483,6 +502,17 @@ CallbackQueue& callbackQueue()
    return instance;
 }
 
+// notified (on the file monitor thread) whenever callbacks are queued
+boost::function<void()> s_onCallbacksPending;
+
+void enqueCallback(const boost::function<void()>& callback)
+{
+   callbackQueue().enque(callback);
+
+   if (s_onCallbacksPending)
+      s_onCallbacksPending();
+}
+
 
 void checkForInput()
 {
@@ -575,9 +605,7 @@ void enqueOnRegistered(const Callbacks& callbacks,
 {
    if (callbacks.onRegistered)
    {
-      callbackQueue().enque(boost::bind(callbacks.onRegistered,
-                                        handle,
-                                        fileTree));
+      enqueCallback(boost::bind(callbacks.onRegistered, handle, fileTree));
    }
 }
 
@@ -585,7 +613,7 @@ void enqueOnRegistrationError(const Callbacks& callbacks, const Error& error)
 {
    if (callbacks.onRegistrationError)
    {
-      callbackQueue().enque(boost::bind(callbacks.onRegistrationError, error));
+      enqueCallback(boost::bind(callbacks.onRegistrationError, error));
    }
 }
 
@@ -593,7 +621,7 @@ void enqueOnMonitoringError(const Callbacks& callbacks, const Error& error)
 {
    if (callbacks.onMonitoringError)
    {
-      callbackQueue().enque(boost::bind(callbacks.onMonitoringError, error));
+      enqueCallback(boost::bind(callbacks.onMonitoringError, error));
    }
 }
 
@@ -602,7 +630,7 @@ void enqueOnFilesChanged(const Callbacks& callbacks,
 {
    if (callbacks.onFilesChanged)
    {
-      callbackQueue().enque(boost::bind(callbacks.onFilesChanged, fileChanges));
+      enqueCallback(boost::bind(callbacks.onFilesChanged, fileChanges));
    }
 }
 
@@ -610,7 +638,7 @@ void enqueOnUnregistered(const Callbacks& callbacks, Handle handle)
 {
    if (callbacks.onUnregistered)
    {
-      callbackQueue().enque(boost::bind(callbacks.onUnregistered, handle));
+      enqueCallback(boost::bind(callbacks.onUnregistered, handle));
    }
 }
 
@@ -619,8 +647,13 @@ boost::thread s_fileMonitorThread;
 } // anonymous namespace
 
 
-void initialize()
+void initialize(const boost::function<void()>& onCallbacksPending,
+                Backend backend,
+                core::thread::ThreadPool* pThreadPool)
 {
+   s_onCallbacksPending = onCallbacksPending;
+   s_backend = backend;
+   s_pThreadPool = pThreadPool;
    s_pActiveHandles = new std::list<Handle>();
    core::thread::safeLaunchThread(fileMonitorThreadMain, &s_fileMonitorThread);
 }
@@ -34,6 +34,10 @@ namespace system {
 namespace file_monitor {
 namespace impl {
 
+// threads used for recursive scans of monitored directories (the scans are
+// latency bound on network filesystems so this is more than the core count)
+const int kScanThreads = 8;
+
 Error processFileAdded(
                tree<FileInfo>::iterator parentIt,
                const FileChangeEvent& fileChange,
@@ -113,6 +117,10 @@ Iterator findFile(Iterator begin, Iterator end, const FileInfo& fileInfo)
 
 std::list<void*> activeEventContexts();
 
+Backend backend();
+
+core::thread::ThreadPool* threadPool();
+
 
 } // namespace impl
 } // namespace file_monitor
@@ -18,14 +18,25 @@
 #include <stdio.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <sys/types.h>
 #include <sys/inotify.h>
+#include <limits.h>
+
+#include "config.h"
+
+#ifdef HAVE_FANOTIFY_DFID_NAME
+#include <sys/fanotify.h>
+#endif
 
 #include <set>
+#include <map>
 
 #include <boost/utility.hpp>
 #include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
 #include <boost/algorithm/string/predicate.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/hashed_index.hpp>
@@ -40,8 +51,6 @@
 
 #include "FileMonitorImpl.hpp"
 
-#include "config.h"
-
 namespace core {
 namespace system {
 namespace file_monitor {
@@ -163,6 +172,8 @@ class FileEventContext : boost::noncopyable
 public:
    FileEventContext()
       : fd(-1),
+        fanotify(false),
+        mountFd(-1),
         recursive(false)
    {
       handle = Handle((void*)this);
@@ -170,6 +181,15 @@ public:
    virtual ~FileEventContext() {}
    Handle handle;
    int fd;
+
+   // fanotify state (a descriptor within the marked filesystem for
+   // resolving directory handles, the paths we've resolved, and the root
+   // path with symlinks resolved since that's what handles resolve to)
+   bool fanotify;
+   int mountFd;
+   std::map<std::string,std::string> directoryHandles;
+   std::string realRootPath;
+
    Watches watches;
    FilePath rootPath;
    bool recursive;
@@ -238,6 +258,10 @@ boost::function<Error(const FileInfo&)> addWatchFunction(
                                            FileEventContext* pContext,
                                            bool allowRootSymlink = false)
 {
+   // fanotify marks the whole filesystem so there are no watches to add
+   if (pContext->fanotify)
+      return boost::function<Error(const FileInfo&)>();
+
    return boost::bind(addWatch,
                         _1,
                         pContext->rootPath,
@@ -283,137 +307,571 @@ void closeContext(FileEventContext* pContext)
       // reset file descriptor
       pContext->fd = -1;
    }
+
+   if (pContext->mountFd >= 0)
+   {
+      safePosixCall<int>(boost::bind(::close, pContext->mountFd),
+                         ERROR_LOCATION);
+      pContext->mountFd = -1;
+   }
 }
 
-Error processEvent(FileEventContext* pContext,
-                   struct inotify_event* pEvent,
-                   std::vector<FileChangeEvent>* pFileChanges)
+// raw inotify events are coalesced into a batch before processing: repeated
+// events for the same path are merged (so that each distinct path is only
+// stat'ed and applied to the tree once) and directories with many changes
+// are rescanned rather than having their events processed one by one
+struct PendingEvent
 {
-   // determine event type
-   FileChangeEvent::Type eventType = FileChangeEvent::None;
-   if (pEvent->mask & IN_CREATE)
-      eventType = FileChangeEvent::FileAdded;
-   else if (pEvent->mask & IN_DELETE)
-      eventType = FileChangeEvent::FileRemoved;
-   else if (pEvent->mask & IN_MODIFY)
-      eventType = FileChangeEvent::FileModified;
-   else if (pEvent->mask & IN_MOVED_TO)
-      eventType = FileChangeEvent::FileAdded;
-   else if (pEvent->mask & IN_MOVED_FROM)
-      eventType = FileChangeEvent::FileRemoved;
-
-   // return event if we got a valid event type and the event applies to a
-   // child of the monitored directory (len == 0 occurs for root element)
-   if ((eventType != FileChangeEvent::None) && (pEvent->len > 0))
-   {
-      // find the FileInfo for this wd (ignore if we can't find one)
-      Watch watch = pContext->watches.find(pEvent->wd);
-      if (watch.empty())
-         return Success();
+   PendingEvent(const std::string& dirPath,
+                const std::string& name,
+                uint32_t mask)
+      : dirPath(dirPath), name(name), mask(mask)
+   {
+   }
+
+   // path of the directory containing the file
+   std::string dirPath;
+   std::string name;
 
-      // get an iterator to the parent dir
-      tree<FileInfo>::iterator parentIt = impl::findFile(
-                                                   pContext->fileTree.begin(),
-                                                   pContext->fileTree.end(),
-                                                   watch.path);
+   // inotify event mask (fanotify events are translated)
+   uint32_t mask;
+};
+
+// directories with at least this many distinct changed children are
+// rescanned rather than processed event by event
+const std::size_t kRescanThreshold = 256;
 
-      // if we can't find a parent then return (this directory may have
-      // been excluded from scanning due to a filter)
-      if (parentIt == pContext->fileTree.end())
-         return Success();
+class EventBatch : boost::noncopyable
+{
+public:
+   EventBatch() : overflow_(false) {}
 
-      // get file info
-      FilePath filePath = FilePath(parentIt->absolutePath()).complete(
-                                                                 pEvent->name);
+   bool empty() const { return events_.empty() && !overflow_; }
+   bool overflow() const { return overflow_; }
+   std::size_t size() const { return events_.size(); }
 
+   // buffer overflow means we missed events, at which point the only
+   // thing to do is a full rescan (so there's no point keeping the others)
+   void setOverflow()
+   {
+      overflow_ = true;
+      events_.clear();
+      index_.clear();
+      changesByDir_.clear();
+   }
 
-      // if the file exists then collect as many extended attributes
-      // as necessary -- otherwise just record path and dir status
-      FileInfo fileInfo;
-      if (filePath.exists())
+   void add(const std::string& dirPath,
+            const std::string& name,
+            uint32_t mask)
+   {
+      // ignore events we don't handle and events for the watched
+      // directory itself (empty name)
+      const uint32_t kHandled = IN_CREATE | IN_DELETE | IN_MODIFY |
+                                IN_MOVED_TO | IN_MOVED_FROM;
+      if (overflow_ || !(mask & kHandled) || name.empty())
+         return;
+
+      // merge with any existing event for this path
+      std::pair<std::string,std::string> key(dirPath, name);
+      std::map<std::pair<std::string,std::string>,std::size_t>::const_iterator
+                                                      it = index_.find(key);
+      if (it != index_.end())
       {
-         fileInfo = FileInfo(filePath, filePath.isSymlink());
+         events_[it->second].mask |= mask;
       }
       else
       {
-         fileInfo = FileInfo(filePath.absolutePath(), pEvent->mask & IN_ISDIR);
+         index_[key] = events_.size();
+         events_.push_back(PendingEvent(dirPath, name, mask));
+         changesByDir_[dirPath]++;
       }
+   }
 
-      // if this doesn't meet the filter then ignore
-      if (pContext->filter && !pContext->filter(fileInfo))
-         return Success();
+   const std::vector<PendingEvent>& events() const { return events_; }
 
-      // handle the various types of actions
-      switch(eventType)
+   void directoriesToRescan(std::vector<std::string>* pDirs) const
+   {
+      for (std::map<std::string,std::size_t>::const_iterator it =
+                                                      changesByDir_.begin();
+           it != changesByDir_.end();
+           ++it)
       {
-         case FileChangeEvent::FileRemoved:
-         {
-            // generate events
-            FileChangeEvent event(FileChangeEvent::FileRemoved, fileInfo);
-            std::vector<FileChangeEvent> removeEvents;
-            impl::processFileRemoved(parentIt,
-                                     event,
-                                     pContext->recursive,
-                                     &pContext->fileTree,
-                                     &removeEvents);
-
-            // for each directory remove event remove any watches we have for it
-            BOOST_FOREACH(const FileChangeEvent& event, removeEvents)
-            {
-               if (event.fileInfo().isDirectory())
-               {
-                  Watch watch = pContext->watches.find(
-                                             event.fileInfo().absolutePath());
-                  if (!watch.empty())
-                  {
-                     removeWatch(pContext->fd, watch);
-                     pContext->watches.erase(watch);
-                  }
-               }
-            }
+         if (it->second >= kRescanThreshold)
+            pDirs->push_back(it->first);
+      }
+   }
 
-            // copy to the target events
-            std::copy(removeEvents.begin(),
-                      removeEvents.end(),
-                      std::back_inserter(*pFileChanges));
+private:
+   bool overflow_;
+   std::vector<PendingEvent> events_;
+   std::map<std::pair<std::string,std::string>,std::size_t> index_;
+   std::map<std::string,std::size_t> changesByDir_;
+};
 
-            break;
-         }
-         case FileChangeEvent::FileAdded:
+void removeWatchesForRemovedDirs(FileEventContext* pContext,
+                                 const std::vector<FileChangeEvent>& events)
+{
+   BOOST_FOREACH(const FileChangeEvent& event, events)
+   {
+      if (event.type() == FileChangeEvent::FileRemoved &&
+          event.fileInfo().isDirectory())
+      {
+         Watch watch = pContext->watches.find(event.fileInfo().absolutePath());
+         if (!watch.empty())
          {
-            FileChangeEvent event(FileChangeEvent::FileAdded, fileInfo);
-            Error error = impl::processFileAdded(parentIt,
-                                                 event,
-                                                 pContext->recursive,
-                                                 pContext->filter,
-                                                 addWatchFunction(pContext),
-                                                 &pContext->fileTree,
-                                                 pFileChanges);
-            // log the error if it wasn't no such file/dir (this can happen
-            // in the normal course of business if a file is deleted between
-            // the time the change is detected and we try to inspect it)
-            if (error &&
-               (error.code() != boost::system::errc::no_such_file_or_directory))
-            {
-               LOG_ERROR(error);
-            }
-            break;
+            removeWatch(pContext->fd, watch);
+            pContext->watches.erase(watch);
          }
-         case FileChangeEvent::FileModified:
+      }
+   }
+}
+
+void applyFileChange(FileEventContext* pContext,
+                     tree<FileInfo>::iterator parentIt,
+                     FileChangeEvent::Type eventType,
+                     const FileInfo& fileInfo,
+                     std::vector<FileChangeEvent>* pFileChanges)
+{
+   // handle the various types of actions
+   switch(eventType)
+   {
+      case FileChangeEvent::FileRemoved:
+      {
+         // generate events
+         FileChangeEvent event(FileChangeEvent::FileRemoved, fileInfo);
+         std::vector<FileChangeEvent> removeEvents;
+         impl::processFileRemoved(parentIt,
+                                  event,
+                                  pContext->recursive,
+                                  &pContext->fileTree,
+                                  &removeEvents);
+
+         // for each directory remove event remove any watches we have for it
+         removeWatchesForRemovedDirs(pContext, removeEvents);
+
+         // copy to the target events
+         std::copy(removeEvents.begin(),
+                   removeEvents.end(),
+                   std::back_inserter(*pFileChanges));
+
+         break;
+      }
+      case FileChangeEvent::FileAdded:
+      {
+         FileChangeEvent event(FileChangeEvent::FileAdded, fileInfo);
+         Error error = impl::processFileAdded(parentIt,
+                                              event,
+                                              pContext->recursive,
+                                              pContext->filter,
+                                              addWatchFunction(pContext),
+                                              &pContext->fileTree,
+                                              pFileChanges);
+         // log the error if it wasn't no such file/dir (this can happen
+         // in the normal course of business if a file is deleted between
+         // the time the change is detected and we try to inspect it)
+         if (error &&
+            (error.code() != boost::system::errc::no_such_file_or_directory))
          {
-            FileChangeEvent event(FileChangeEvent::FileModified, fileInfo);
-            impl::processFileModified(parentIt,
-                                      event,
-                                      &pContext->fileTree,
-                                      pFileChanges);
-            break;
+            LOG_ERROR(error);
          }
-         case FileChangeEvent::None:
-            break;
+         break;
+      }
+      case FileChangeEvent::FileModified:
+      {
+         FileChangeEvent event(FileChangeEvent::FileModified, fileInfo);
+         impl::processFileModified(parentIt,
+                                   event,
+                                   &pContext->fileTree,
+                                   pFileChanges);
+         break;
+      }
+      case FileChangeEvent::None:
+         break;
+   }
+}
+
+Error processEvent(FileEventContext* pContext,
+                   const PendingEvent& pendingEvent,
+                   std::vector<FileChangeEvent>* pFileChanges)
+{
+   // get an iterator to the parent dir
+   tree<FileInfo>::iterator parentIt = impl::findFile(
+                                                pContext->fileTree.begin(),
+                                                pContext->fileTree.end(),
+                                                pendingEvent.dirPath);
+
+   // if we can't find a parent then return (this directory may have
+   // been excluded from scanning due to a filter)
+   if (parentIt == pContext->fileTree.end())
+      return Success();
+
+   // get file info
+   FilePath filePath = FilePath(parentIt->absolutePath()).complete(
+                                                         pendingEvent.name);
+
+   // if the file exists then collect as many extended attributes
+   // as necessary -- otherwise just record path and dir status
+   bool exists = filePath.exists();
+   FileInfo fileInfo;
+   if (exists)
+   {
+      fileInfo = FileInfo(filePath, filePath.isSymlink());
+   }
+   else
+   {
+      fileInfo = FileInfo(filePath.absolutePath(),
+                          pendingEvent.mask & IN_ISDIR);
+   }
+
+   // if this doesn't meet the filter then ignore
+   if (pContext->filter && !pContext->filter(fileInfo))
+      return Success();
+
+   // the mask may combine several events so determine what happened based
+   // on whether the file now exists (a file which was created and removed
+   // within the batch is ignored by processFileRemoved since it's not in
+   // the tree). a directory which was removed and recreated needs to be
+   // removed first so that its watches and contents are refreshed
+   uint32_t mask = pendingEvent.mask;
+   bool created = mask & (IN_CREATE | IN_MOVED_TO);
+   bool removed = mask & (IN_DELETE | IN_MOVED_FROM);
+   if (!exists)
+   {
+      applyFileChange(pContext,
+                      parentIt,
+                      FileChangeEvent::FileRemoved,
+                      fileInfo,
+                      pFileChanges);
+   }
+   else if (created)
+   {
+      if (removed && fileInfo.isDirectory())
+      {
+         applyFileChange(pContext,
+                         parentIt,
+                         FileChangeEvent::FileRemoved,
+                         fileInfo,
+                         pFileChanges);
+      }
+
+      applyFileChange(pContext,
+                      parentIt,
+                      FileChangeEvent::FileAdded,
+                      fileInfo,
+                      pFileChanges);
+   }
+   else
+   {
+      applyFileChange(pContext,
+                      parentIt,
+                      FileChangeEvent::FileModified,
+                      fileInfo,
+                      pFileChanges);
+   }
+
+   return Success();
+}
+
+void appendFileChanges(const std::vector<FileChangeEvent>& events,
+                       std::vector<FileChangeEvent>* pFileChanges)
+{
+   std::copy(events.begin(),
+             events.end(),
+             std::back_inserter(*pFileChanges));
+}
+
+Error rescanDirectory(FileEventContext* pContext,
+                      const std::string& path,
+                      std::vector<FileChangeEvent>* pFileChanges)
+{
+   // use the existing tree entry (lookup within the tree is by value)
+   tree<FileInfo>::iterator it = impl::findFile(pContext->fileTree.begin(),
+                                                pContext->fileTree.end(),
+                                                path);
+   if (it == pContext->fileTree.end())
+      return Success();
+
+   std::vector<FileChangeEvent> fileChanges;
+   Error error = impl::discoverAndProcessFileChanges(
+                              *it,
+                              pContext->recursive,
+                              pContext->filter,
+                              addWatchFunction(pContext),
+                              &pContext->fileTree,
+                              boost::bind(appendFileChanges, _1, &fileChanges));
+   if (error)
+      return error;
+
+   removeWatchesForRemovedDirs(pContext, fileChanges);
+   appendFileChanges(fileChanges, pFileChanges);
+   return Success();
+}
+
+bool isWithinDirectories(const std::string& path,
+                         const std::vector<std::string>& dirs)
+{
+   BOOST_FOREACH(const std::string& dir, dirs)
+   {
+      if (path == dir || boost::algorithm::starts_with(path, dir + "/"))
+         return true;
+   }
+   return false;
+}
+
+void addInotifyEvents(FileEventContext* pContext,
+                      char* buffer,
+                      int len,
+                      EventBatch* pBatch)
+{
+   int i = 0;
+   while (i < len)
+   {
+      typedef struct inotify_event* EventPtr;
+      EventPtr pEvent = (EventPtr)&buffer[i];
+      i += sizeof(struct inotify_event) + pEvent->len;
+
+      if (pEvent->mask & IN_Q_OVERFLOW)
+      {
+         pBatch->setOverflow();
+         continue;
+      }
+
+      // ignore events for the watched directory itself (len == 0) or for
+      // watches we don't know about
+      if (pEvent->len == 0)
+         continue;
+      Watch watch = pContext->watches.find(pEvent->wd);
+      if (watch.empty())
+         continue;
+
+      pBatch->add(watch.path, pEvent->name, pEvent->mask);
+   }
+}
+
+#ifdef HAVE_FANOTIFY_DFID_NAME
+
+// resolve the directory referred to by a file handle (handles are cached
+// since resolving requires opening the directory)
+bool resolveDirectoryHandle(FileEventContext* pContext,
+                            struct file_handle* pHandle,
+                            std::string* pPath)
+{
+   std::string key((char*)pHandle,
+                   sizeof(struct file_handle) + pHandle->handle_bytes);
+   std::map<std::string,std::string>::const_iterator it =
+                                       pContext->directoryHandles.find(key);
+   if (it != pContext->directoryHandles.end())
+   {
+      *pPath = it->second;
+      return true;
+   }
+
+   // this fails if the directory has since been removed
+   int fd = ::open_by_handle_at(pContext->mountFd, pHandle, O_PATH);
+   if (fd == -1)
+      return false;
+
+   char path[PATH_MAX + 1];
+   std::string procPath = "/proc/self/fd/" + boost::lexical_cast<std::string>(fd);
+   ssize_t len = ::readlink(procPath.c_str(), path, PATH_MAX);
+   ::close(fd);
+   if (len <= 0)
+      return false;
+
+   *pPath = std::string(path, len);
+   pContext->directoryHandles[key] = *pPath;
+   return true;
+}
+
+void addFanotifyEvents(FileEventContext* pContext,
+                       char* buffer,
+                       int len,
+                       EventBatch* pBatch)
+{
+   std::string rootPath = pContext->rootPath.absolutePath();
+   const std::string& realRootPath = pContext->realRootPath;
+
+   struct fanotify_event_metadata* pEvent =
+                                    (struct fanotify_event_metadata*)buffer;
+   for ( ; FAN_EVENT_OK(pEvent, len); pEvent = FAN_EVENT_NEXT(pEvent, len))
+   {
+      if (pEvent->vers != FANOTIFY_METADATA_VERSION)
+         continue;
+
+      if (pEvent->fd >= 0)
+         ::close(pEvent->fd);
+
+      if (pEvent->mask & FAN_Q_OVERFLOW)
+      {
+         pBatch->setOverflow();
+         continue;
+      }
+
+      // renaming or removing a directory invalidates the resolved paths of
+      // it and its children
+      if ((pEvent->mask & FAN_ONDIR) &&
+          (pEvent->mask & (FAN_MOVED_FROM | FAN_DELETE)))
+      {
+         pContext->directoryHandles.clear();
+      }
+
+      // we only handle events which report the directory and name
+      struct fanotify_event_info_fid* pFid =
+                                    (struct fanotify_event_info_fid*)(pEvent+1);
+      if ((char*)pFid >= (char*)pEvent + pEvent->event_len ||
+          pFid->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME)
+      {
+         continue;
+      }
+      struct file_handle* pHandle = (struct file_handle*)pFid->handle;
+      std::string name((char*)(pHandle->f_handle + pHandle->handle_bytes));
+      if (name.empty() || name == ".")
+         continue;
+
+      // the mark covers the whole filesystem so ignore events outside of
+      // the monitored directory
+      std::string dirPath;
+      if (!resolveDirectoryHandle(pContext, pHandle, &dirPath))
+         continue;
+      if (dirPath != realRootPath &&
+          !boost::algorithm::starts_with(dirPath, realRootPath + "/"))
+      {
+         continue;
+      }
+      dirPath = rootPath + dirPath.substr(realRootPath.size());
+
+      // translate to inotify
+      uint32_t mask = 0;
+      if (pEvent->mask & FAN_CREATE)
+         mask |= IN_CREATE;
+      if (pEvent->mask & FAN_DELETE)
+         mask |= IN_DELETE;
+      if (pEvent->mask & FAN_MODIFY)
+         mask |= IN_MODIFY;
+      if (pEvent->mask & FAN_MOVED_FROM)
+         mask |= IN_MOVED_FROM;
+      if (pEvent->mask & FAN_MOVED_TO)
+         mask |= IN_MOVED_TO;
+      if (pEvent->mask & FAN_ONDIR)
+         mask |= IN_ISDIR;
+
+      pBatch->add(dirPath, name, mask);
+   }
+}
+
+// mark the filesystem containing the root path. returns false (after
+// cleaning up) if fanotify isn't available or permitted
+bool initFanotify(FileEventContext* pContext)
+{
+   int fd = ::fanotify_init(FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME |
+                            FAN_CLOEXEC | FAN_NONBLOCK,
+                            O_RDONLY | O_LARGEFILE);
+   if (fd == -1)
+   {
+      Error error = systemError(errno, ERROR_LOCATION);
+      error.addProperty("description", "fanotify_init failed");
+      LOG_ERROR(error);
+      return false;
+   }
+
+   uint64_t mask = FAN_CREATE | FAN_DELETE | FAN_MODIFY |
+                   FAN_MOVED_FROM | FAN_MOVED_TO | FAN_ONDIR;
+   std::string rootPath = pContext->rootPath.absolutePath();
+   if (::fanotify_mark(fd,
+                       FAN_MARK_ADD | FAN_MARK_FILESYSTEM,
+                       mask,
+                       AT_FDCWD,
+                       rootPath.c_str()) == -1)
+   {
+      Error error = systemError(errno, ERROR_LOCATION);
+      error.addProperty("path", rootPath);
+      LOG_ERROR(error);
+      ::close(fd);
+      return false;
+   }
+
+   char realRootPath[PATH_MAX + 1];
+   int mountFd = ::open(rootPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+   if (mountFd == -1 || ::realpath(rootPath.c_str(), realRootPath) == NULL)
+   {
+      Error error = systemError(errno, ERROR_LOCATION);
+      error.addProperty("path", rootPath);
+      LOG_ERROR(error);
+      if (mountFd != -1)
+         ::close(mountFd);
+      ::close(fd);
+      return false;
+   }
+
+   pContext->fd = fd;
+   pContext->mountFd = mountFd;
+   pContext->realRootPath = realRootPath;
+   pContext->fanotify = true;
+   return true;
+}
+
+#else
+
+void addFanotifyEvents(FileEventContext* pContext,
+                       char* buffer,
+                       int len,
+                       EventBatch* pBatch)
+{
+}
+
+bool initFanotify(FileEventContext* pContext)
+{
+   LOG_WARNING_MESSAGE("fanotify file monitoring is not supported by this "
+                       "build, using inotify");
+   return false;
+}
+
+#endif
+
+Error processEvents(FileEventContext* pContext,
+                    const EventBatch& batch,
+                    std::vector<FileChangeEvent>* pFileChanges)
+{
+   // determine which directories are going to be rescanned (nested
+   // directories are covered by the rescan of their parent when recursive)
+   std::vector<std::string> rescanDirs;
+   batch.directoriesToRescan(&rescanDirs);
+   std::sort(rescanDirs.begin(), rescanDirs.end());
+   if (pContext->recursive)
+   {
+      std::vector<std::string> topLevelDirs;
+      BOOST_FOREACH(const std::string& dir, rescanDirs)
+      {
+         if (!isWithinDirectories(dir, topLevelDirs))
+            topLevelDirs.push_back(dir);
       }
+      rescanDirs = topLevelDirs;
    }
 
+   // process events which aren't covered by a rescan
+   BOOST_FOREACH(const PendingEvent& event, batch.events())
+   {
+      if (!rescanDirs.empty() &&
+          (pContext->recursive ? isWithinDirectories(event.dirPath, rescanDirs)
+                               : std::binary_search(rescanDirs.begin(),
+                                                    rescanDirs.end(),
+                                                    event.dirPath)))
+      {
+         continue;
+      }
+
+      Error error = processEvent(pContext, event, pFileChanges);
+      if (error)
+         return error;
+   }
 
+   // rescan
+   BOOST_FOREACH(const std::string& dir, rescanDirs)
+   {
+      Error error = rescanDirectory(pContext, dir, pFileChanges);
+      if (error)
+         return error;
+   }
 
    return Success();
 }
@@ -448,36 +906,50 @@ Handle registerMonitor(const core::FilePath& filePath,
    pContext->filter = filter;
    std::auto_ptr<FileEventContext> autoPtrContext(pContext);
 
-   // init file descriptor
+   // use fanotify if requested (falling back to inotify if it can't be
+   // initialized, e.g. because we don't have CAP_SYS_ADMIN)
+   bool useFanotify = (impl::backend() == FanotifyBackend) &&
+                      initFanotify(pContext);
+   if (!useFanotify)
+   {
+      // init file descriptor
 #ifdef HAVE_INOTIFY_INIT1
-   pContext->fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
-   if (pContext->fd < 0)
-      return registrationFailure(errno, pContext, callbacks, ERROR_LOCATION);
+      pContext->fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+      if (pContext->fd < 0)
+         return registrationFailure(errno, pContext, callbacks,
+                                    ERROR_LOCATION);
 #else
-   // init file descriptor
-   pContext->fd = ::inotify_init();
-   if (pContext->fd < 0)
-      return registrationFailure(errno, pContext, callbacks, ERROR_LOCATION);
-
-   // set non-blocking
-   int flags = ::fcntl(pContext->fd, F_GETFL);
-   if (flags == -1)
-      return registrationFailure(errno, pContext, callbacks, ERROR_LOCATION);
-   if (::fcntl(pContext->fd, F_SETFL, flags | O_NONBLOCK) == -1)
-      return registrationFailure(errno, pContext, callbacks, ERROR_LOCATION);
-
-   // set close on exec
-   int fdFlags = ::fcntl(pContext->fd, F_GETFD);
-   if (fdFlags == -1)
-      return registrationFailure(errno, pContext, callbacks, ERROR_LOCATION);
-   if (::fcntl(pContext->fd, F_SETFD, fdFlags | FD_CLOEXEC) == -1)
-      return registrationFailure(errno, pContext, callbacks, ERROR_LOCATION);
+      // init file descriptor
+      pContext->fd = ::inotify_init();
+      if (pContext->fd < 0)
+         return registrationFailure(errno, pContext, callbacks,
+                                    ERROR_LOCATION);
+
+      // set non-blocking
+      int flags = ::fcntl(pContext->fd, F_GETFL);
+      if (flags == -1)
+         return registrationFailure(errno, pContext, callbacks,
+                                    ERROR_LOCATION);
+      if (::fcntl(pContext->fd, F_SETFL, flags | O_NONBLOCK) == -1)
+         return registrationFailure(errno, pContext, callbacks,
+                                    ERROR_LOCATION);
+
+      // set close on exec
+      int fdFlags = ::fcntl(pContext->fd, F_GETFD);
+      if (fdFlags == -1)
+         return registrationFailure(errno, pContext, callbacks,
+                                    ERROR_LOCATION);
+      if (::fcntl(pContext->fd, F_SETFD, fdFlags | FD_CLOEXEC) == -1)
+         return registrationFailure(errno, pContext, callbacks,
+                                    ERROR_LOCATION);
 #endif
+   }
 
    // scan the files (use callback to setup watches)
    FileScannerOptions options;
    options.recursive = recursive;
    options.yield = true;
+   options.threads = impl::kScanThreads;
    options.filter = filter;
    options.onBeforeScanDir = addWatchFunction(pContext, true);
    Error error = scanFiles(FileInfo(filePath), options, &pContext->fileTree);
@@ -531,6 +1003,12 @@ void run(const boost::function<void()>& checkForInput)
    const int kEventBufferLength = 5000 * (kEventSize+kFilenameSizeEstimate);
    char eventBuffer[kEventBufferLength];
 
+   // batching limits
+   const int kBatchWindowMs = 50;
+   const std::size_t kMaxBatchSize = 50000;
+   const boost::posix_time::time_duration kMaxBatchDuration =
+                                    boost::posix_time::milliseconds(1000);
+
    while(true)
    {
       std::list<void*> contexts = impl::activeEventContexts();
@@ -554,8 +1032,13 @@ void run(const boost::function<void()>& checkForInput)
             continue;
          }
 
-         // loop reading from this context's fd until EAGAIN or EWOULDBLOCK
-         std::vector<FileChangeEvent> fileChanges;
+         // read this context's events into a batch. once we have events
+         // we keep reading for as long as more arrive within a short window
+         // (up to a limit) so that bursts of changes (e.g. a checkout or
+         // a build) are coalesced and delivered together
+         EventBatch batch;
+         boost::posix_time::ptime batchStart;
+         bool terminated = false;
          while (true)
          {
             // read
@@ -565,60 +1048,78 @@ void run(const boost::function<void()>& checkForInput)
                                                  kEventBufferLength));
             if (len < 0)
             {
-               // don't terminate for errors indicating no events available
+               // errors indicating no events available end the batch
+               // unless we are still within the batching window
                if (errno == EAGAIN || errno == EWOULDBLOCK)
-                  break;
+               {
+                  if (batch.empty() || batch.overflow() ||
+                      batch.size() >= kMaxBatchSize ||
+                      (boost::posix_time::microsec_clock::universal_time() -
+                                          batchStart) > kMaxBatchDuration)
+                  {
+                     break;
+                  }
+
+                  // wait for more events
+                  pollfd pfd;
+                  pfd.fd = pContext->fd;
+                  pfd.events = POLLIN;
+                  pfd.revents = 0;
+                  int result = ::poll(&pfd, 1, kBatchWindowMs);
+                  if (result > 0 || (result < 0 && errno == EINTR))
+                     continue;
+                  else
+                     break;
+               }
 
                // otherwise terminate this watch (notify user and break
                // out of the read loop for this context)
                terminateWithMonitoringError(pContext,
                                             systemError(errno, ERROR_LOCATION));
+               terminated = true;
                break;
             }
 
-            // iterate through the events
-            int i = 0;
-            while (i < len)
-            {
-               // get the event
-               typedef struct inotify_event* EventPtr;
-               EventPtr pEvent = (EventPtr)&eventBuffer[i];
+            if (batch.empty())
+               batchStart = boost::posix_time::microsec_clock::universal_time();
 
-               // buffer overflow is handled specially -- basically
-               // we start over because we missed events
-               if (pEvent->mask & IN_Q_OVERFLOW)
-               {
-                  // remove all watches
-                  removeAllWatches(pContext);
-
-                  // generate events based on scanning
-                  Error error =impl::discoverAndProcessFileChanges(
-                        FileInfo(pContext->rootPath),
-                        pContext->recursive,
-                        pContext->filter,
-                        addWatchFunction(pContext, true),
-                        &pContext->fileTree,
-                        pContext->callbacks.onFilesChanged);
-                  if (error)
-                     terminateWithMonitoringError(pContext, error);
-
-                  // always break here -- we've generated events based on
-                  // a fresh scan so any other events in the queue would
-                  // be duplicates
-                  break;
-               }
+            // add the events to the batch
+            if (pContext->fanotify)
+               addFanotifyEvents(pContext, eventBuffer, len, &batch);
+            else
+               addInotifyEvents(pContext, eventBuffer, len, &batch);
+         }
 
-               // process the event
-               Error error = processEvent(pContext, pEvent, &fileChanges);
-               if (error)
-               {
-                  terminateWithMonitoringError(pContext, error);
-                  break;
-               }
+         if (terminated || batch.empty())
+            continue;
 
-               // advance to next event
-               i += kEventSize + pEvent->len;
-            }
+         // buffer overflow is handled specially -- basically
+         // we start over because we missed events
+         if (batch.overflow())
+         {
+            // remove all watches
+            removeAllWatches(pContext);
+
+            // generate events based on scanning
+            Error error = impl::discoverAndProcessFileChanges(
+                  FileInfo(pContext->rootPath),
+                  pContext->recursive,
+                  pContext->filter,
+                  addWatchFunction(pContext, true),
+                  &pContext->fileTree,
+                  pContext->callbacks.onFilesChanged);
+            if (error)
+               terminateWithMonitoringError(pContext, error);
+            continue;
+         }
+
+         // process the events
+         std::vector<FileChangeEvent> fileChanges;
+         Error error = processEvents(pContext, batch, &fileChanges);
+         if (error)
+         {
+            terminateWithMonitoringError(pContext, error);
+            continue;
          }
 
          // fire any events we got
@@ -17,9 +17,14 @@
 
 #include <CoreServices/CoreServices.h>
 
+#include <map>
+#include <set>
+
 #include <boost/foreach.hpp>
 #include <boost/algorithm/string/trim.hpp>
+#include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/classification.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 
 #include <core/Log.hpp>
 #include <core/Error.hpp>
@@ -31,12 +36,125 @@
 
 #include "FileMonitorImpl.hpp"
 
+// file level events are available as of 10.7 (when they aren't we only
+// get events for directories and rescan them)
+#if MAC_OS_X_VERSION_MAX_ALLOWED >= 1070
+#define MAC_FILE_EVENTS
+#endif
+
 namespace core {
 namespace system {
 namespace file_monitor {
 
 namespace {
 
+// events are coalesced into a batch before processing: repeated events
+// for the same path are merged (so that each distinct path is only stat'ed
+// and applied to the tree once) and directories with many changes (or
+// for which FSEvents only tells us that something changed) are rescanned.
+// the batch is delivered once no events have arrived for the batch window
+// (or it reaches the maximum duration) so that bursts of changes (e.g. a
+// checkout or a build) are delivered together
+const boost::posix_time::time_duration kBatchWindow =
+                                    boost::posix_time::milliseconds(50);
+const boost::posix_time::time_duration kMaxBatchDuration =
+                                    boost::posix_time::milliseconds(1000);
+
+// directories with at least this many distinct changed children are
+// rescanned rather than processed event by event
+const std::size_t kRescanThreshold = 256;
+
+struct PendingEvent
+{
+   PendingEvent(const std::string& dirPath,
+                const std::string& name,
+                FSEventStreamEventFlags flags)
+      : dirPath(dirPath), name(name), flags(flags)
+   {
+   }
+
+   // path of the directory containing the file
+   std::string dirPath;
+   std::string name;
+
+   FSEventStreamEventFlags flags;
+};
+
+class EventBatch : boost::noncopyable
+{
+public:
+   EventBatch() {}
+
+   bool empty() const { return events_.empty() && rescanDirs_.empty(); }
+
+   boost::posix_time::ptime started() const { return started_; }
+   boost::posix_time::ptime updated() const { return updated_; }
+
+   void clear()
+   {
+      events_.clear();
+      index_.clear();
+      changesByDir_.clear();
+      rescanDirs_.clear();
+   }
+
+   // add an event for a file
+   void add(const std::string& dirPath,
+            const std::string& name,
+            FSEventStreamEventFlags flags)
+   {
+      touch();
+
+      // merge with any existing event for this path
+      std::pair<std::string,std::string> key(dirPath, name);
+      std::map<std::pair<std::string,std::string>,std::size_t>::const_iterator
+                                                      it = index_.find(key);
+      if (it != index_.end())
+      {
+         events_[it->second].flags |= flags;
+      }
+      else
+      {
+         index_[key] = events_.size();
+         events_.push_back(PendingEvent(dirPath, name, flags));
+         if (++changesByDir_[dirPath] == kRescanThreshold)
+            rescanDirs_.insert(std::make_pair(dirPath, false));
+      }
+   }
+
+   // add a directory which needs to be rescanned (recursively if the
+   // events for its subdirectories were coalesced or dropped)
+   void addRescan(const std::string& dirPath, bool recursive)
+   {
+      touch();
+      bool& rescanRecursive = rescanDirs_[dirPath];
+      rescanRecursive = rescanRecursive || recursive;
+   }
+
+   const std::vector<PendingEvent>& events() const { return events_; }
+
+   const std::map<std::string,bool>& rescanDirs() const
+   {
+      return rescanDirs_;
+   }
+
+private:
+   void touch()
+   {
+      updated_ = boost::posix_time::microsec_clock::universal_time();
+      if (empty())
+         started_ = updated_;
+   }
+
+private:
+   boost::posix_time::ptime started_;
+   boost::posix_time::ptime updated_;
+   std::vector<PendingEvent> events_;
+   std::map<std::pair<std::string,std::string>,std::size_t> index_;
+   std::map<std::string,std::size_t> changesByDir_;
+   std::map<std::string,bool> rescanDirs_;
+};
+
 class FileEventContext : boost::noncopyable
 {
 public:
@@ -53,6 +171,7 @@ public:
    boost::function<bool(const FileInfo&)> filter;
    tree<FileInfo> fileTree;
    Callbacks callbacks;
+   EventBatch batch;
 };
 
 void fileEventCallback(ConstFSEventStreamRef streamRef,
@@ -71,15 +190,18 @@ void fileEventCallback(ConstFSEventStreamRef streamRef,
    if (!pContext->callbacks.onFilesChanged)
       return;
 
+   const std::string rootPath = pContext->rootPath.absolutePath();
+
    char **paths = (char**)eventPaths;
    for (std::size_t i=0; i<numEvents; i++)
    {
+      FSEventStreamEventFlags flags = eventFlags[i];
+
       // check for root changed (unregister)
-      if (eventFlags[i] & kFSEventStreamEventFlagRootChanged)
+      if (flags & kFSEventStreamEventFlagRootChanged)
       {
          // propagate error to client
-         Error error = fileNotFoundError(pContext->rootPath.absolutePath(),
-                                         ERROR_LOCATION);
+         Error error = fileNotFoundError(rootPath, ERROR_LOCATION);
          pContext->callbacks.onMonitoringError(error);
 
          // unregister this monitor (this is done via postback from the
@@ -93,37 +215,301 @@ void fileEventCallback(ConstFSEventStreamRef streamRef,
       std::string path(paths[i]);
       boost::algorithm::trim_right_if(path, boost::algorithm::is_any_of("/"));
 
-      // if we aren't in recursive mode then ignore this if it isn't for
-      // the root directory
-      if (!pContext->recursive && (path != pContext->rootPath.absolutePath()))
-         continue;
+      // events dropped by FSEvents or coalesced into their parent require
+      // a rescan of the directory (recursive in the former case)
+      const FSEventStreamEventFlags kMustScan =
+                                 kFSEventStreamEventFlagMustScanSubDirs |
+                                 kFSEventStreamEventFlagUserDropped |
+                                 kFSEventStreamEventFlagKernelDropped;
+
+#ifdef MAC_FILE_EVENTS
+      const FSEventStreamEventFlags kItemFlags =
+                                 kFSEventStreamEventFlagItemIsFile |
+                                 kFSEventStreamEventFlagItemIsDir |
+                                 kFSEventStreamEventFlagItemIsSymlink;
+      bool itemEvent = (flags & kItemFlags) && !(flags & kMustScan);
+#else
+      bool itemEvent = false;
+#endif
+
+      if (itemEvent)
+      {
+         // ignore events for the root itself
+         if (path == rootPath)
+            continue;
 
-      // get FileInfo for this directory
-      FileInfo fileInfo(path, true);
+         std::string::size_type pos = path.find_last_of('/');
+         if (pos == std::string::npos)
+            continue;
+         std::string dirPath = path.substr(0, pos);
 
-      // apply the filter (if any)
-      if (!pContext->filter || pContext->filter(fileInfo))
+         // if we aren't in recursive mode then ignore this if it isn't
+         // within the root directory
+         if (!pContext->recursive && (dirPath != rootPath))
+            continue;
+
+         pContext->batch.add(dirPath, path.substr(pos + 1), flags);
+      }
+      else
       {
-         // check for need to do recursive scan
-         bool recursive = pContext->recursive &&
-                          (eventFlags[i] & kFSEventStreamEventFlagMustScanSubDirs);
-
-         // process changes
-         Error error = impl::discoverAndProcessFileChanges(
-                                             fileInfo,
-                                             recursive,
-                                             pContext->filter,
-                                             &(pContext->fileTree),
-                                             pContext->callbacks.onFilesChanged);
+         // if we aren't in recursive mode then ignore this if it isn't for
+         // the root directory
+         if (!pContext->recursive && (path != rootPath))
+            continue;
+
+         pContext->batch.addRescan(path,
+                                   pContext->recursive && (flags & kMustScan));
+      }
+   }
+}
+
+void applyFileChange(FileEventContext* pContext,
+                     tree<FileInfo>::iterator parentIt,
+                     FileChangeEvent::Type eventType,
+                     const FileInfo& fileInfo,
+                     std::vector<FileChangeEvent>* pFileChanges)
+{
+   FileChangeEvent event(eventType, fileInfo);
+   switch(eventType)
+   {
+      case FileChangeEvent::FileRemoved:
+      {
+         impl::processFileRemoved(parentIt,
+                                  event,
+                                  pContext->recursive,
+                                  &pContext->fileTree,
+                                  pFileChanges);
+         break;
+      }
+      case FileChangeEvent::FileAdded:
+      {
+         Error error = impl::processFileAdded(parentIt,
+                                              event,
+                                              pContext->recursive,
+                                              pContext->filter,
+                                              &pContext->fileTree,
+                                              pFileChanges);
+         // log the error if it wasn't no such file/dir (this can happen
+         // in the normal course of business if a file is deleted between
+         // the time the change is detected and we try to inspect it)
          if (error &&
             (error.code() != boost::system::errc::no_such_file_or_directory))
          {
             LOG_ERROR(error);
          }
+         break;
+      }
+      case FileChangeEvent::FileModified:
+      {
+         impl::processFileModified(parentIt,
+                                   event,
+                                   &pContext->fileTree,
+                                   pFileChanges);
+         break;
+      }
+      case FileChangeEvent::None:
+         break;
+   }
+}
+
+#ifdef MAC_FILE_EVENTS
+
+void processEvent(FileEventContext* pContext,
+                  const PendingEvent& pendingEvent,
+                  std::vector<FileChangeEvent>* pFileChanges)
+{
+   // get an iterator to the parent dir (if we can't find it then it may
+   // have been excluded from scanning due to a filter)
+   tree<FileInfo>::iterator parentIt = impl::findFile(
+                                                pContext->fileTree.begin(),
+                                                pContext->fileTree.end(),
+                                                pendingEvent.dirPath);
+   if (parentIt == pContext->fileTree.end())
+      return;
+
+   // get file info (collecting attributes only if the file exists)
+   FilePath filePath = FilePath(parentIt->absolutePath()).complete(
+                                                         pendingEvent.name);
+   bool exists = filePath.exists();
+   FileInfo fileInfo;
+   if (exists)
+   {
+      fileInfo = FileInfo(filePath, filePath.isSymlink());
+   }
+   else
+   {
+      fileInfo = FileInfo(filePath.absolutePath(),
+                          pendingEvent.flags &
+                                    kFSEventStreamEventFlagItemIsDir);
+   }
+
+   // if this doesn't meet the filter then ignore
+   if (pContext->filter && !pContext->filter(fileInfo))
+      return;
+
+   // the flags may combine several events so determine what happened
+   // based on whether the file now exists (renames are reported for both
+   // the old and the new path). a directory which was removed and
+   // recreated needs to be removed first so that its contents are refreshed
+   FSEventStreamEventFlags flags = pendingEvent.flags;
+   bool created = flags & (kFSEventStreamEventFlagItemCreated |
+                           kFSEventStreamEventFlagItemRenamed);
+   bool removed = flags & (kFSEventStreamEventFlagItemRemoved |
+                           kFSEventStreamEventFlagItemRenamed);
+   if (!exists)
+   {
+      applyFileChange(pContext, parentIt, FileChangeEvent::FileRemoved,
+                      fileInfo, pFileChanges);
+   }
+   else if (created)
+   {
+      if (removed && fileInfo.isDirectory())
+      {
+         applyFileChange(pContext, parentIt, FileChangeEvent::FileRemoved,
+                         fileInfo, pFileChanges);
+      }
+
+      applyFileChange(pContext, parentIt, FileChangeEvent::FileAdded,
+                      fileInfo, pFileChanges);
+   }
+   else
+   {
+      applyFileChange(pContext, parentIt, FileChangeEvent::FileModified,
+                      fileInfo, pFileChanges);
+   }
+}
+
+#endif
+
+void appendFileChanges(const std::vector<FileChangeEvent>& events,
+                       std::vector<FileChangeEvent>* pFileChanges)
+{
+   std::copy(events.begin(),
+             events.end(),
+             std::back_inserter(*pFileChanges));
+}
+
+bool isWithinDirectories(const std::string& path,
+                         const std::vector<std::string>& dirs)
+{
+   BOOST_FOREACH(const std::string& dir, dirs)
+   {
+      if (path == dir || boost::algorithm::starts_with(path, dir + "/"))
+         return true;
+   }
+   return false;
+}
+
+void processBatch(FileEventContext* pContext,
+                  std::vector<FileChangeEvent>* pFileChanges)
+{
+   const EventBatch& batch = pContext->batch;
+
+   // events within directories being recursively rescanned are covered by
+   // the rescan (as are those in directories rescanned non-recursively)
+   std::vector<std::string> recursiveRescans;
+   std::set<std::string> rescans;
+   for (std::map<std::string,bool>::const_iterator it =
+                                             batch.rescanDirs().begin();
+        it != batch.rescanDirs().end();
+        ++it)
+   {
+      if (it->second && !isWithinDirectories(it->first, recursiveRescans))
+         recursiveRescans.push_back(it->first);
+   }
+   for (std::map<std::string,bool>::const_iterator it =
+                                             batch.rescanDirs().begin();
+        it != batch.rescanDirs().end();
+        ++it)
+   {
+      if (!it->second && !isWithinDirectories(it->first, recursiveRescans))
+         rescans.insert(it->first);
+   }
+
+#ifdef MAC_FILE_EVENTS
+   BOOST_FOREACH(const PendingEvent& event, batch.events())
+   {
+      if (rescans.count(event.dirPath) ||
+          isWithinDirectories(event.dirPath, recursiveRescans))
+      {
+         continue;
+      }
+
+      processEvent(pContext, event, pFileChanges);
+   }
+#endif
+
+   // rescan (the tree lookup is by value so we use the existing entry)
+   std::vector<std::pair<std::string,bool> > dirs;
+   BOOST_FOREACH(const std::string& dir, recursiveRescans)
+   {
+      dirs.push_back(std::make_pair(dir, true));
+   }
+   BOOST_FOREACH(const std::string& dir, rescans)
+   {
+      dirs.push_back(std::make_pair(dir, false));
+   }
+
+   for (std::size_t i = 0; i < dirs.size(); i++)
+   {
+      tree<FileInfo>::iterator it = impl::findFile(pContext->fileTree.begin(),
+                                                   pContext->fileTree.end(),
+                                                   dirs[i].first);
+      if (it == pContext->fileTree.end())
+         continue;
+
+      // apply the filter (if any)
+      if (pContext->filter && !pContext->filter(*it))
+         continue;
+
+      Error error = impl::discoverAndProcessFileChanges(
+                           *it,
+                           dirs[i].second,
+                           pContext->filter,
+                           &(pContext->fileTree),
+                           boost::bind(appendFileChanges, _1, pFileChanges));
+      if (error &&
+         (error.code() != boost::system::errc::no_such_file_or_directory))
+      {
+         LOG_ERROR(error);
       }
    }
 }
 
+// deliver the batches which are due (returns true if there are batches
+// still waiting for their window to elapse)
+bool deliverBatches()
+{
+   bool pending = false;
+   boost::posix_time::ptime now =
+                        boost::posix_time::microsec_clock::universal_time();
+
+   std::list<void*> contexts = impl::activeEventContexts();
+   BOOST_FOREACH(void* ctx, contexts)
+   {
+      FileEventContext* pContext = (FileEventContext*)ctx;
+      if (pContext->batch.empty())
+         continue;
+
+      if ((now - pContext->batch.updated()) < kBatchWindow &&
+          (now - pContext->batch.started()) < kMaxBatchDuration)
+      {
+         pending = true;
+         continue;
+      }
+
+      std::vector<FileChangeEvent> fileChanges;
+      processBatch(pContext, &fileChanges);
+      pContext->batch.clear();
+
+      // fire any events we got
+      if (!fileChanges.empty() && pContext->callbacks.onFilesChanged)
+         pContext->callbacks.onFilesChanged(fileChanges);
+   }
+
+   return pending;
+}
+
 class CFRefScope : boost::noncopyable
 {
 public:
@@ -217,8 +603,11 @@ Handle registerMonitor(const FilePath& filePath,
                   &context,
                   pathsArrayRef,
                   kFSEventStreamEventIdSinceNow,
-                  1,
+                  kBatchWindow.total_milliseconds() / 1000.0,
                   kFSEventStreamCreateFlagNoDefer |
+#ifdef MAC_FILE_EVENTS
+                  kFSEventStreamCreateFlagFileEvents |
+#endif
                   kFSEventStreamCreateFlagWatchRoot);
    if (pContext->streamRef == NULL)
    {
@@ -248,6 +637,7 @@ Handle registerMonitor(const FilePath& filePath,
    core::system::FileScannerOptions options;
    options.recursive = recursive;
    options.yield = true;
+   options.threads = impl::kScanThreads;
    options.filter = filter;
    Error error = scanFiles(FileInfo(filePath), options, &pContext->fileTree);
    if (error)
@@ -315,6 +705,16 @@ void run(const boost::function<void()>& checkForInput)
          break;
       }
 
+      // deliver batches which are due. if any are still waiting then
+      // wait for more events for the duration of the batch window
+      if (deliverBatches())
+      {
+         ::CFRunLoopRunInMode(kCFRunLoopDefaultMode,
+                              kBatchWindow.total_milliseconds() / 1000.0,
+                              true);
+         continue;
+      }
+
       // check for input
       checkForInput();
    }
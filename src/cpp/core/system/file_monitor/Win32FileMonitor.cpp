@@ -17,10 +17,14 @@
 
 #include <windows.h>
 
+#include <map>
 #include <memory>
 
+#include <boost/foreach.hpp>
 #include <boost/algorithm/string/trim.hpp>
+#include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/classification.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 
 #include <core/FilePath.hpp>
 
@@ -36,8 +40,27 @@ namespace file_monitor {
 
 namespace {
 
-// buffer size for notifications (cannot be > 64kb for network drives)
-const std::size_t kBuffSize = 32768;
+// buffer sizes for notifications. network drives are limited to 64kb,
+// for local drives we start larger and double the buffer (up to the
+// maximum) each time it overflows
+const std::size_t kNetworkBuffSize = 65536;
+const std::size_t kLocalBuffSize = 262144;
+const std::size_t kMaxLocalBuffSize = 2097152;
+
+// changes are delivered in batches: once a completion arrives we keep
+// collecting changes for as long as more completions arrive within the
+// batch window (up to the maximum duration)
+const DWORD kBatchWindowMs = 50;
+const boost::posix_time::time_duration kMaxBatchDuration =
+                                    boost::posix_time::milliseconds(1000);
+
+// subdirectories of the root with changes within this window before an
+// overflow are the only ones rescanned after it
+const boost::posix_time::time_duration kActiveSubtreeWindow =
+                                    boost::posix_time::seconds(5);
+
+// completion port which all of the directory reads complete to
+HANDLE s_hCompletionPort = NULL;
 
 class FileEventContext : boost::noncopyable
 {
@@ -46,11 +69,10 @@ public:
       : recursive(false),
         hDirectory(NULL),
         readDirChangesPending(false),
+        maxBuffSize(kNetworkBuffSize),
         hRestartTimer(NULL),
         restartCount(0)
    {
-      receiveBuffer.resize(kBuffSize);
-      handlingBuffer.resize(kBuffSize);
       handle = Handle((void*)this);
    }
    virtual ~FileEventContext() {}
@@ -69,10 +91,18 @@ public:
    std::vector<BYTE> receiveBuffer;
    std::vector<BYTE> handlingBuffer;
    bool readDirChangesPending;
+   std::size_t maxBuffSize;
 
    // our own snapshot of the file tree
    tree<FileInfo> fileTree;
 
+   // changes not yet delivered to the client
+   std::vector<FileChangeEvent> pendingChanges;
+
+   // when each subdirectory of the root (or the root itself, denoted
+   // by an empty string) last had changes
+   std::map<std::wstring,boost::posix_time::ptime> subtreeActivity;
+
    // timer for attempting restarts on a delayed basis (and counter
    // to enforce a maximum number of retries)
    HANDLE hRestartTimer;
@@ -223,8 +253,8 @@ void processFileChange(DWORD action,
 void processFileChanges(FileEventContext* pContext,
                         DWORD dwNumberOfBytesTransfered)
 {
-   // accumulate file changes
-   std::vector<FileChangeEvent> fileChanges;
+   boost::posix_time::ptime now =
+                        boost::posix_time::microsec_clock::universal_time();
 
    // cycle through the entries in the buffer
    char* pBuffer = (char*)&pContext->handlingBuffer[0];
@@ -249,6 +279,13 @@ void processFileChanges(FileEventContext* pContext,
       removeTrailingSlash(&name);
       FilePath filePath(pContext->rootPath.absolutePathW() + L"\\" + name);
 
+      // note activity within the subtree (changes to entries in the root
+      // itself are recorded against the root)
+      std::wstring::size_type sepPos = name.find(L'\\');
+      pContext->subtreeActivity[sepPos != std::wstring::npos ?
+                                    name.substr(0, sepPos) :
+                                    std::wstring()] = now;
+
       // ensure this is a long file name (docs say it could be short or long!)
       // (note that the call to GetLongFileNameW will fail if the file has
       // already been deleted, therefore if a delete notification using a
@@ -265,7 +302,7 @@ void processFileChanges(FileEventContext* pContext,
                            pContext->recursive,
                            pContext->filter,
                            &(pContext->fileTree),
-                           &fileChanges);
+                           &(pContext->pendingChanges));
       }
 
       // break or advance to next notification as necessary
@@ -274,9 +311,71 @@ void processFileChanges(FileEventContext* pContext,
       else
          pBuffer += fileNotify.NextEntryOffset;
    };
+}
+
+void appendFileChanges(const std::vector<FileChangeEvent>& events,
+                       std::vector<FileChangeEvent>* pFileChanges)
+{
+   std::copy(events.begin(),
+             events.end(),
+             std::back_inserter(*pFileChanges));
+}
+
+// rescan after an overflow. when the changes leading up to the overflow
+// were confined to a few subdirectories of the root (e.g. the output
+// directories of a build) then only those are rescanned, otherwise the
+// whole tree is rescanned
+Error rescanAfterOverflow(FileEventContext* pContext)
+{
+   boost::posix_time::ptime now =
+                        boost::posix_time::microsec_clock::universal_time();
+
+   std::vector<std::wstring> subtrees;
+   bool fullRescan = !pContext->recursive || pContext->subtreeActivity.empty();
+   for (std::map<std::wstring,boost::posix_time::ptime>::const_iterator it =
+                                          pContext->subtreeActivity.begin();
+        it != pContext->subtreeActivity.end() && !fullRescan;
+        ++it)
+   {
+      if ((now - it->second) > kActiveSubtreeWindow)
+         continue;
+      else if (it->first.empty())
+         fullRescan = true;
+      else
+         subtrees.push_back(it->first);
+   }
+   pContext->subtreeActivity.clear();
 
-   // notify client of file changes
-   pContext->callbacks.onFilesChanged(fileChanges);
+   if (fullRescan || subtrees.empty())
+   {
+      return impl::discoverAndProcessFileChanges(
+                     *(pContext->fileTree.begin()),
+                     pContext->recursive,
+                     pContext->filter,
+                     &(pContext->fileTree),
+                     boost::bind(appendFileChanges,
+                                 _1, &(pContext->pendingChanges)));
+   }
+
+   BOOST_FOREACH(const std::wstring& subtree, subtrees)
+   {
+      FileInfo subtreeInfo(FilePath(pContext->rootPath.absolutePathW() +
+                                    L"\\" + subtree));
+      Error error = impl::discoverAndProcessFileChanges(
+                     subtreeInfo,
+                     true,
+                     pContext->filter,
+                     &(pContext->fileTree),
+                     boost::bind(appendFileChanges,
+                                 _1, &(pContext->pendingChanges)));
+      if (error &&
+          (error.code() != boost::system::errc::no_such_file_or_directory))
+      {
+         return error;
+      }
+   }
+
+   return Success();
 }
 
 void terminateWithMonitoringError(FileEventContext* pContext,
@@ -327,13 +426,8 @@ void restartMonitoring(FileEventContext* pContext)
    // successfully restarted monitoring, reset the restart count to 0
    pContext->restartCount = 0;
 
-   // full recursive scan to detect changes and refresh the tree
-   error = impl::discoverAndProcessFileChanges(
-                                       *(pContext->fileTree.begin()),
-                                       pContext->recursive,
-                                       pContext->filter,
-                                       &(pContext->fileTree),
-                                       pContext->callbacks.onFilesChanged);
+   // scan to detect the changes we missed and refresh the tree
+   error = rescanAfterOverflow(pContext);
    if (error)
       terminateWithMonitoringError(pContext, error);
 }
@@ -390,13 +484,10 @@ void enqueRestartMonitoring(FileEventContext* pContext)
 // performed full cleanup for all monitoring contexts before exiting.
 volatile LONG s_activeRequests = 0;
 
-VOID CALLBACK FileChangeCompletionRoutine(DWORD dwErrorCode,									// completion code
-                                          DWORD dwNumberOfBytesTransfered,
-                                          LPOVERLAPPED lpOverlapped)
+void onReadDirectoryChangesCompleted(FileEventContext* pContext,
+                                     DWORD dwErrorCode,
+                                     DWORD dwNumberOfBytesTransfered)
 {
-   // get the context
-   FileEventContext* pContext = (FileEventContext*)(lpOverlapped->hEvent);
-
    // note that read changes is no longer pending
    pContext->readDirChangesPending = false;
 
@@ -434,16 +525,33 @@ VOID CALLBACK FileChangeCompletionRoutine(DWORD dwErrorCode,									// completi
    }
 
    // check for buffer overflow. this means there are too many file changes
-   // for the systme to keep up with -- in this case try to restart monitoring
-   // (after a 1 second delay) and repeat the restart up to 10 times
-   if(dwNumberOfBytesTransfered == 0)
+   // for the systme to keep up with -- in this case grow the buffer (if we
+   // can) and try to restart monitoring (after a 1 second delay) and repeat
+   // the restart up to 10 times
+   if (dwErrorCode == ERROR_NOTIFY_ENUM_DIR || dwNumberOfBytesTransfered == 0)
    {
+      if (pContext->receiveBuffer.size() < pContext->maxBuffSize)
+      {
+         pContext->receiveBuffer.resize(std::min(
+                                          pContext->receiveBuffer.size() * 2,
+                                          pContext->maxBuffSize));
+      }
+
       // attempt to restart monitoring
       enqueRestartMonitoring(pContext);
       return;
    }
 
+   // other errors are fatal
+   if (dwErrorCode != ERROR_SUCCESS)
+   {
+      terminateWithMonitoringError(pContext,
+                                   systemError(dwErrorCode, ERROR_LOCATION));
+      return;
+   }
+
    // copy to processing buffer (so we can immediately begin another read)
+   pContext->handlingBuffer.resize(dwNumberOfBytesTransfered);
    ::CopyMemory(&(pContext->handlingBuffer[0]),
                 &(pContext->receiveBuffer[0]),
                 dwNumberOfBytesTransfered);
@@ -464,6 +572,47 @@ VOID CALLBACK FileChangeCompletionRoutine(DWORD dwErrorCode,									// completi
       terminateWithMonitoringError(pContext, error);
 }
 
+// wait up to timeoutMs for a directory read to complete and process it
+// (returns false if nothing completed)
+bool processCompletion(DWORD timeoutMs)
+{
+   DWORD dwBytes = 0;
+   ULONG_PTR key = 0;
+   LPOVERLAPPED pOverlapped = NULL;
+   BOOL success = ::GetQueuedCompletionStatus(s_hCompletionPort,
+                                              &dwBytes,
+                                              &key,
+                                              &pOverlapped,
+                                              timeoutMs);
+
+   // no completion packet means a timeout (or a problem with the port)
+   if (pOverlapped == NULL)
+      return false;
+
+   onReadDirectoryChangesCompleted((FileEventContext*)key,
+                                   success ? ERROR_SUCCESS : ::GetLastError(),
+                                   dwBytes);
+   return true;
+}
+
+void deliverPendingChanges()
+{
+   std::list<void*> contexts = impl::activeEventContexts();
+   BOOST_FOREACH(void* ctx, contexts)
+   {
+      FileEventContext* pContext = (FileEventContext*)ctx;
+      if (pContext->pendingChanges.empty() ||
+          !pContext->callbacks.onFilesChanged)
+      {
+         continue;
+      }
+
+      std::vector<FileChangeEvent> fileChanges;
+      fileChanges.swap(pContext->pendingChanges);
+      pContext->callbacks.onFilesChanged(fileChanges);
+   }
+}
+
 Error readDirectoryChanges(FileEventContext* pContext)
 {
    DWORD dwBytes = 0;
@@ -476,7 +625,7 @@ Error readDirectoryChanges(FileEventContext* pContext)
                                FILE_NOTIFY_CHANGE_LAST_WRITE,
                                &dwBytes,
                                &(pContext->overlapped),
-                               &FileChangeCompletionRoutine))
+                               NULL))
    {
       return systemError(::GetLastError(), ERROR_LOCATION);
    }
@@ -525,9 +674,34 @@ Handle registerMonitor(const core::FilePath& filePath,
       return Handle();
    }
 
-   // initialize overlapped structure to point to our context
+   // size the buffer (network drives can't take more than 64kb)
+   std::wstring rootPath = pContext->rootPath.absolutePathW() + L"\\";
+   if (::GetDriveTypeW(rootPath.substr(0, 3).c_str()) != DRIVE_REMOTE &&
+       !boost::algorithm::starts_with(rootPath, L"\\\\"))
+   {
+      pContext->maxBuffSize = kMaxLocalBuffSize;
+      pContext->receiveBuffer.resize(kLocalBuffSize);
+   }
+   else
+   {
+      pContext->receiveBuffer.resize(kNetworkBuffSize);
+   }
+
+   // reads complete to our completion port (with the context as the key)
+   if (s_hCompletionPort == NULL ||
+       ::CreateIoCompletionPort(pContext->hDirectory,
+                                s_hCompletionPort,
+                                (ULONG_PTR)pContext,
+                                0) == NULL)
+   {
+      Error error = systemError(::GetLastError(), ERROR_LOCATION);
+      safeCloseHandle(pContext->hDirectory, ERROR_LOCATION);
+      callbacks.onRegistrationError(error);
+      return Handle();
+   }
+
+   // initialize overlapped structure
    ::ZeroMemory(&(pContext->overlapped), sizeof(OVERLAPPED));
-   pContext->overlapped.hEvent = pContext;
 
    // get the monitoring started
    Error error = readDirectoryChanges(pContext);
@@ -554,6 +728,7 @@ Handle registerMonitor(const core::FilePath& filePath,
    core::system::FileScannerOptions options;
    options.recursive = recursive;
    options.yield = true;
+   options.threads = impl::kScanThreads;
    options.filter = filter;
    error = scanFiles(FileInfo(filePath), options, &pContext->fileTree);
    if (error)
@@ -592,13 +767,43 @@ void run(const boost::function<void()>& checkForInput)
    // initialize active requests to zero
    s_activeRequests = 0;
 
+   // create the completion port
+   s_hCompletionPort = ::CreateIoCompletionPort(INVALID_HANDLE_VALUE,
+                                                NULL,
+                                                0,
+                                                1);
+   if (s_hCompletionPort == NULL)
+      LOG_ERROR(systemError(::GetLastError(), ERROR_LOCATION));
+
    // loop waiting for:
-   //   - completion routine callbacks (occur during SleepEx); or
+   //   - read completions (collected into batches and delivered once they
+   //     stop arriving or the batch reaches its maximum duration);
+   //   - restart timer callbacks (occur during SleepEx); or
    //   - inbound commands (occur during checkForInput)
+   bool pending = false;
+   boost::posix_time::ptime batchStart;
    while (true)
    {
-      // look for changes and keep calling SleepEx as long as we have them
-      while(::SleepEx(1, TRUE) == WAIT_IO_COMPLETION) ;
+      bool completed = s_hCompletionPort != NULL &&
+                       processCompletion(pending ? kBatchWindowMs : 1);
+      while(::SleepEx(0, TRUE) == WAIT_IO_COMPLETION) ;
+
+      if (completed)
+      {
+         boost::posix_time::ptime now =
+                        boost::posix_time::microsec_clock::universal_time();
+         if (!pending)
+         {
+            pending = true;
+            batchStart = now;
+         }
+         if ((now - batchStart) < kMaxBatchDuration)
+            continue;
+      }
+
+      // (restarts also generate changes so we always check)
+      deliverPendingChanges();
+      pending = false;
 
       checkForInput();
    }
@@ -606,11 +811,15 @@ void run(const boost::function<void()>& checkForInput)
 
 void stop()
 {
-   // call ::SleepEx until all active requests hae terminated
+   // process completions until all active requests hae terminated
    while (s_activeRequests > 0)
    {
-      ::SleepEx(100, TRUE);
+      if (s_hCompletionPort == NULL || !processCompletion(100))
+         ::SleepEx(0, TRUE);
    }
+
+   safeCloseHandle(s_hCompletionPort, ERROR_LOCATION);
+   s_hCompletionPort = NULL;
 }
 
 } // namespace detail
@@ -15,6 +15,7 @@
 
 #include <core/tex/TexLogParser.hpp>
 
+#include <boost/bind.hpp>
 #include <boost/foreach.hpp>
 #include <boost/regex.hpp>
 #include <boost/lexical_cast.hpp>
@@ -137,74 +138,6 @@ FilePath resolveFilename(const FilePath& rootDir,
       return FilePath();
 }
 
-// TeX wraps lines hard at 79 characters. We use heuristics as described in
-// Sublime Text's TeX plugin to determine where these breaks are.
-void unwrapLines(std::vector<std::string>* pLines,
-                 std::vector<size_t>* pLinesUnwrapped=NULL)
-{
-   static boost::regex regexLine("^l\\.(\\d+)\\s");
-   static boost::regex regexAssignment("^\\\\.*?=");
-
-   std::vector<std::string>::iterator pos = pLines->begin();
-
-   for ( ; pos != pLines->end(); pos++)
-   {
-      // The first line is always long, and not artificially wrapped
-      if (pos == pLines->begin())
-         continue;
-
-      if (pos->length() != 79)
-         continue;
-
-      // The **<filename> line may be long, but we don't care about it
-      if (beginsWith(*pos, "**"))
-         continue;
-
-      while (true)
-      {
-         std::vector<std::string>::iterator nextPos = pos + 1;
-         // No more lines to add
-         if (nextPos == pLines->end())
-            break;
-
-         if (nextPos->empty())
-            break;
-
-         // Underfull/Overfull terminator
-         if (*nextPos == " []")
-            break;
-
-         // Common prefixes
-         if (beginsWith(*nextPos, "File:", "Package:", "Document Class:"))
-            break;
-
-         // More prefixes
-         if (beginsWith(*nextPos, "LaTeX Warning:", "LaTeX Info:", "LaTeX2e <"))
-            break;
-
-         if (boost::regex_search(*nextPos, regexAssignment))
-            break;
-
-         if (boost::regex_search(*nextPos, regexLine))
-            break;
-
-         bool breakAfterAppend = nextPos->length() != 79;
-
-         pos->append(*nextPos);
-         // NOTE: Erase is a simple but inefficient way of handling this. Would
-         //    be way faster to maintain an output iterator that points to the
-         //    correct point in pLines, and when finished, truncate whatever
-         //    elements come after the final position of the output iterator.
-         pLines->erase(nextPos, nextPos+1);
-         if (pLinesUnwrapped)
-            pLinesUnwrapped->push_back(1 + (pos - pLines->begin()));
-
-         if (breakAfterAppend)
-            break;
-      }
-   }
-}
-
 class FileStack : public boost::noncopyable
 {
 public:
@@ -309,200 +242,373 @@ FilePath texFilePath(const std::string& logPath, const FilePath& compileDir)
    }
 }
 
-size_t calculateWrappedLine(const std::vector<size_t>& unwrappedLines,
-                               size_t unwrappedLineNum)
+bool continuesWrappedLine(const std::string& line)
 {
-   for (std::vector<size_t>::const_iterator it = unwrappedLines.begin();
-        it != unwrappedLines.end();
-        it++)
+   static boost::regex regexLine("^l\\.(\\d+)\\s");
+   static boost::regex regexAssignment("^\\\\.*?=");
+
+   if (line.empty())
+      return false;
+
+   // Underfull/Overfull terminator
+   if (line == " []")
+      return false;
+
+   // Common prefixes
+   if (beginsWith(line, "File:", "Package:", "Document Class:"))
+      return false;
+
+   // More prefixes
+   if (beginsWith(line, "LaTeX Warning:", "LaTeX Info:", "LaTeX2e <"))
+      return false;
+
+   if (boost::regex_search(line, regexAssignment))
+      return false;
+
+   if (boost::regex_search(line, regexLine))
+      return false;
+
+   return true;
+}
+
+} // anonymous namespace
+
+struct LatexLogParser::Impl
+{
+   enum State
    {
-      if (*it >= unwrappedLineNum)
-      {
-         return unwrappedLineNum + (it - unwrappedLines.begin());
-      }
+      Normal,
+      BoxDetail,              // skipping to the end of an over/underfull box
+      ErrorContext,           // looking for the line number of an error
+      WarningContinuation     // collecting the rest of a warning message
+   };
+
+   Impl(const FilePath& logFilePath, const Handler& onLogEntry)
+      : logFilePath(logFilePath),
+        rootDir(logFilePath.parent()),
+        onLogEntry(onLogEntry),
+        fileStack(rootDir),
+        physicalLine(0),
+        hasPending(false),
+        pendingLine(0),
+        pendingContinues(false),
+        state(Normal),
+        entryLogLine(0)
+   {
+   }
+
+   void addPhysicalLine(const std::string& line);
+   void flushPending();
+   void processLine(const std::string& line, int logLineNum);
+   void completeWarning(const std::string& line);
+   void finish();
+
+   FilePath logFilePath;
+   FilePath rootDir;
+   Handler onLogEntry;
+   FileStack fileStack;
+
+   // physical lines
+   std::string partialLine;
+   int physicalLine;
+
+   // logical line being unwrapped (TeX wraps lines hard at 79 characters.
+   // We use heuristics as described in Sublime Text's TeX plugin to
+   // determine where these breaks are.)
+   bool hasPending;
+   std::string pendingText;
+   int pendingLine;
+   bool pendingContinues;
+
+   // entry which spans several lines
+   State state;
+   int entryLogLine;
+   FilePath entryFile;
+   std::string entryMessage;
+};
+
+void LatexLogParser::Impl::addPhysicalLine(const std::string& line)
+{
+   physicalLine++;
+
+   if (hasPending && pendingContinues && continuesWrappedLine(line))
+   {
+      pendingText.append(line);
+      pendingContinues = line.length() == 79;
+      return;
    }
 
-   return unwrappedLineNum + unwrappedLines.size();
+   flushPending();
+
+   hasPending = true;
+   pendingText = line;
+   pendingLine = physicalLine;
+
+   // The first line is always long, and not artificially wrapped. The
+   // **<filename> line may be long, but we don't care about it
+   pendingContinues = physicalLine > 1 &&
+                      line.length() == 79 &&
+                      !beginsWith(line, "**");
 }
 
-} // anonymous namespace
+void LatexLogParser::Impl::flushPending()
+{
+   if (!hasPending)
+      return;
 
-Error parseLatexLog(const FilePath& logFilePath, LogEntries* pLogEntries)
+   hasPending = false;
+   processLine(pendingText, pendingLine);
+}
+
+void LatexLogParser::Impl::processLine(const std::string& line, int logLineNum)
 {
    static boost::regex regexOverUnderfullLines(" at lines (\\d+)--(\\d+)\\s*(?:\\[])?$");
    static boost::regex regexWarning("^(?:.*?) Warning: (.+)");
-   static boost::regex regexWarningEnd(" input line (\\d+)\\.$");
    static boost::regex regexLnn("^l\\.(\\d+)\\s");
    static boost::regex regexCStyleError("^(.+):(\\d+):\\s(.+)$");
 
-   std::vector<std::string> lines;
-   Error error = readStringVectorFromFile(logFilePath, &lines, false);
-   if (error)
-      return error;
-
-   std::vector<size_t> linesUnwrapped;
-   unwrapLines(&lines, &linesUnwrapped);
+   // lines consumed by an entry which began on an earlier line
+   switch (state)
+   {
+   case BoxDetail:
+   {
+      // For multi-line case, we're looking for " []" on a line by itself
+      if (line == " []")
+         state = Normal;
+      return;
+   }
 
-   FilePath rootDir = logFilePath.parent();
-   FileStack fileStack(rootDir);
+   case ErrorContext:
+   {
+      boost::smatch match;
+      if (boost::regex_search(line, match, regexLnn))
+      {
+         onLogEntry(LogEntry(logFilePath,
+                             entryLogLine,
+                             LogEntry::Error,
+                             entryFile,
+                             safe_convert::stringTo<int>(match[1], -1),
+                             entryMessage));
+         state = Normal;
+      }
+      return;
+   }
 
-   for (std::vector<std::string>::const_iterator it = lines.begin();
-        it != lines.end();
-        it++)
+   case WarningContinuation:
    {
-      const std::string& line = *it;
-      int logLineNum = (it - lines.begin()) + 1;
+      entryMessage.append(line);
+      if (boost::algorithm::ends_with(entryMessage, "."))
+         completeWarning(line);
+      return;
+   }
+
+   case Normal:
+   default:
+      break;
+   }
 
-      // We slurp overfull/underfull messages with no further processing
-      // (i.e. not manipulating the file stack)
+   // We slurp overfull/underfull messages with no further processing
+   // (i.e. not manipulating the file stack)
 
-      if (beginsWith(line, "Overfull ", "Underfull "))
+   if (beginsWith(line, "Overfull ", "Underfull "))
+   {
+      std::string msg = line;
+      int lineNum = -1;
+
+      // Parse lines, if present
+      boost::smatch overUnderfullLinesMatch;
+      if (boost::regex_search(line,
+                              overUnderfullLinesMatch,
+                              regexOverUnderfullLines))
       {
-         std::string msg = line;
-         int lineNum = -1;
-
-         // Parse lines, if present
-         boost::smatch overUnderfullLinesMatch;
-         if (boost::regex_search(line,
-                                 overUnderfullLinesMatch,
-                                 regexOverUnderfullLines))
-         {
-            lineNum = safe_convert::stringTo<int>(overUnderfullLinesMatch[1],
-                                                  -1);
-         }
+         lineNum = safe_convert::stringTo<int>(overUnderfullLinesMatch[1],
+                                               -1);
+      }
 
-         // Single line case
-         bool singleLine = boost::algorithm::ends_with(line, "[]");
+      // Single line case
+      bool singleLine = boost::algorithm::ends_with(line, "[]");
 
-         if (singleLine)
-         {
-            msg.erase(line.size()-2, 2);
-            boost::algorithm::trim_right(msg);
-         }
+      if (singleLine)
+      {
+         msg.erase(line.size()-2, 2);
+         boost::algorithm::trim_right(msg);
+      }
 
-         pLogEntries->push_back(LogEntry(logFilePath,
-                                         calculateWrappedLine(linesUnwrapped,
-                                                              logLineNum),
-                                         LogEntry::Box,
-                                         fileStack.currentFile(),
-                                         lineNum,
-                                         msg));
+      onLogEntry(LogEntry(logFilePath,
+                          logLineNum,
+                          LogEntry::Box,
+                          fileStack.currentFile(),
+                          lineNum,
+                          msg));
 
-         if (singleLine)
-            continue;
+      if (!singleLine)
+         state = BoxDetail;
+      return;
+   }
 
-         for (; it != lines.end(); it++)
-         {
-            // For multi-line case, we're looking for " []" on a line by itself
-            if (*it == " []")
-               break;
-         }
+   fileStack.processLine(line);
 
-         // The iterator would be incremented by the outer for loop, must not
-         // let it go past the end! (If we did get to the end, it would
-         // mean the log file was malformed, but we still can't crash in this
-         // situation.)
-         if (it == lines.end())
-            break;
-         else
-            continue;
-      }
+   // Now see if it's an error or warning
 
-      fileStack.processLine(line);
+   if (beginsWith(line, "! "))
+   {
+      entryLogLine = logLineNum;
+      entryFile = fileStack.currentFile();
+      entryMessage = line.substr(2);
+      state = ErrorContext;
+      return;
+   }
 
-      // Now see if it's an error or warning
+   boost::smatch warningMatch;
+   if (boost::regex_search(line, warningMatch, regexWarning))
+   {
+      entryLogLine = logLineNum;
+      entryFile = fileStack.currentFile();
+      entryMessage = warningMatch[1];
+      if (boost::algorithm::ends_with(entryMessage, "."))
+         completeWarning(line);
+      else
+         state = WarningContinuation;
+      return;
+   }
 
-      if (beginsWith(line, "! "))
+   boost::smatch cStyleErrorMatch;
+   if (boost::regex_search(line, cStyleErrorMatch, regexCStyleError))
+   {
+      FilePath cstyleFile = resolveFilename(rootDir, cStyleErrorMatch[1]);
+      if (cstyleFile.exists())
       {
-         std::string errorMsg = line.substr(2);
-         int lineNum = -1;
+         int lineNum = safe_convert::stringTo<int>(cStyleErrorMatch[2], -1);
+         onLogEntry(LogEntry(logFilePath,
+                             logLineNum,
+                             LogEntry::Error,
+                             cstyleFile,
+                             lineNum,
+                             cStyleErrorMatch[3]));
+      }
+   }
+}
 
-         boost::smatch match;
-         for (it++; it != lines.end(); it++)
-         {
-            if (boost::regex_search(*it, match, regexLnn))
-            {
-               lineNum = safe_convert::stringTo<int>(match[1], -1);
-               break;
-            }
-         }
+void LatexLogParser::Impl::completeWarning(const std::string& line)
+{
+   static boost::regex regexWarningEnd(" input line (\\d+)\\.$");
 
-         pLogEntries->push_back(LogEntry(logFilePath,
-                                         calculateWrappedLine(linesUnwrapped,
-                                                              logLineNum),
-                                         LogEntry::Error,
-                                         fileStack.currentFile(),
-                                         lineNum,
-                                         errorMsg));
-
-         // The iterator would be incremented by the outer for loop, must not
-         // let it go past the end! (If we did get to the end, it would
-         // mean the log file was malformed, but we still can't crash in this
-         // situation.)
-         if (it == lines.end())
-            break;
-         else
-            continue;
-      }
+   int lineNum = -1;
+   boost::smatch warningEndMatch;
+   if (boost::regex_search(line, warningEndMatch, regexWarningEnd))
+      lineNum = safe_convert::stringTo<int>(warningEndMatch[1], -1);
+
+   onLogEntry(LogEntry(logFilePath,
+                       entryLogLine,
+                       LogEntry::Warning,
+                       entryFile,
+                       lineNum,
+                       entryMessage));
+   state = Normal;
+}
 
-      boost::smatch warningMatch;
-      if (boost::regex_search(line, warningMatch, regexWarning))
-      {
-         std::string warningMsg = warningMatch[1];
-         int lineNum = -1;
-         while (true)
-         {
-            if (boost::algorithm::ends_with(warningMsg, "."))
-            {
-               boost::smatch warningEndMatch;
-               if (boost::regex_search(*it, warningEndMatch, regexWarningEnd))
-               {
-                  lineNum = safe_convert::stringTo<int>(warningEndMatch[1], -1);
-               }
-               break;
-            }
+void LatexLogParser::Impl::finish()
+{
+   if (!partialLine.empty())
+   {
+      addPhysicalLine(partialLine);
+      partialLine.clear();
+   }
+   flushPending();
 
-            if (++it == lines.end())
-               break;
-            warningMsg.append(*it);
-         }
+   // entries cut short by the end of the log (which would mean the log was
+   // malformed) are still reported
+   if (state == ErrorContext || state == WarningContinuation)
+   {
+      onLogEntry(LogEntry(logFilePath,
+                          entryLogLine,
+                          state == ErrorContext ? LogEntry::Error :
+                                                  LogEntry::Warning,
+                          entryFile,
+                          -1,
+                          entryMessage));
+   }
+   state = Normal;
+}
 
-         pLogEntries->push_back(LogEntry(logFilePath,
-                                         calculateWrappedLine(linesUnwrapped,
-                                                              logLineNum),
-                                         LogEntry::Warning,
-                                         fileStack.currentFile(),
-                                         lineNum,
-                                         warningMsg));
-
-         // The iterator would be incremented by the outer for loop, must not
-         // let it go past the end! (If we did get to the end, it would
-         // mean the log file was malformed, but we still can't crash in this
-         // situation.)
-         if (it == lines.end())
-            break;
-         else
-            continue;
+LatexLogParser::LatexLogParser(const FilePath& logFilePath,
+                               const Handler& onLogEntry)
+   : pImpl_(new Impl(logFilePath, onLogEntry))
+{
+}
+
+LatexLogParser::~LatexLogParser()
+{
+}
+
+void LatexLogParser::parse(const std::string& output)
+{
+   std::size_t pos = 0;
+   while (pos < output.size())
+   {
+      std::size_t end = output.find('\n', pos);
+      if (end == std::string::npos)
+      {
+         pImpl_->partialLine.append(output, pos, std::string::npos);
+         break;
       }
 
-      boost::smatch cStyleErrorMatch;
-      if (boost::regex_search(line, cStyleErrorMatch, regexCStyleError))
+      if (pImpl_->partialLine.empty())
       {
-         FilePath cstyleFile = resolveFilename(rootDir, cStyleErrorMatch[1]);
-         if (cstyleFile.exists())
-         {
-            int lineNum = safe_convert::stringTo<int>(cStyleErrorMatch[2], -1);
-            pLogEntries->push_back(LogEntry(logFilePath,
-                                            calculateWrappedLine(linesUnwrapped,
-                                                                 logLineNum),
-                                            LogEntry::Error,
-                                            cstyleFile,
-                                            lineNum,
-                                            cStyleErrorMatch[3]));
-         }
+         pImpl_->addPhysicalLine(output.substr(pos, end - pos));
+      }
+      else
+      {
+         pImpl_->partialLine.append(output, pos, end - pos);
+         pImpl_->addPhysicalLine(pImpl_->partialLine);
+         pImpl_->partialLine.clear();
       }
+
+      pos = end + 1;
+   }
+}
+
+void LatexLogParser::finish()
+{
+   pImpl_->finish();
+}
+
+namespace {
+
+void addLogEntry(const LogEntry& logEntry, LogEntries* pLogEntries)
+{
+   pLogEntries->push_back(logEntry);
+}
+
+} // anonymous namespace
+
+Error parseLatexLog(const FilePath& logFilePath, LogEntries* pLogEntries)
+{
+   boost::shared_ptr<std::istream> pStream;
+   Error error = logFilePath.open_r(&pStream);
+   if (error)
+      return error;
+
+   // read the log in chunks (logs for long documents can be very large)
+   LatexLogParser parser(logFilePath,
+                         boost::bind(addLogEntry, _1, pLogEntries));
+   std::vector<char> buffer(65536);
+   while (pStream->good())
+   {
+      pStream->read(&buffer[0], buffer.size());
+      std::streamsize count = pStream->gcount();
+      if (count > 0)
+         parser.parse(std::string(&buffer[0], count));
+   }
+
+   if (pStream->bad())
+   {
+      error = systemError(boost::system::errc::io_error, ERROR_LOCATION);
+      error.addProperty("path", logFilePath.absolutePath());
+      return error;
    }
 
+   parser.finish();
    return Success();
 }
 
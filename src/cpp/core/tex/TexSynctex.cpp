@@ -15,6 +15,7 @@
 
 #include <core/tex/TexSynctex.hpp>
 
+#include <map>
 #include <iostream>
 
 #include <boost/algorithm/string/trim.hpp>
@@ -72,6 +73,9 @@ struct Synctex::Impl
 
    FilePath pdfPath;
    synctex_scanner_t scanner;
+
+   // synctex names of input files we've searched for
+   std::map<std::string,std::string> inputNames;
 };
 
 
@@ -195,6 +199,20 @@ PdfLocation Synctex::topOfPageContent(int page)
 }
 
 std::string Synctex::synctexNameForInputFile(const FilePath& inputFile)
+{
+   // check the names we've already matched (matching requires comparing
+   // the input file to each of the document's inputs on disk)
+   std::map<std::string,std::string>::const_iterator it =
+                           pImpl_->inputNames.find(inputFile.absolutePath());
+   if (it != pImpl_->inputNames.end())
+      return it->second;
+
+   std::string name = findSynctexNameForInputFile(inputFile);
+   pImpl_->inputNames[inputFile.absolutePath()] = name;
+   return name;
+}
+
+std::string Synctex::findSynctexNameForInputFile(const FilePath& inputFile)
 {
    // get the base directory for the input file
    FilePath parentPath = inputFile.parent();
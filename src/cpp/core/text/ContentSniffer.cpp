@@ -0,0 +1,174 @@
+/*
+ * ContentSniffer.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/text/ContentSniffer.hpp>
+
+#include <ctime>
+#include <cstring>
+#include <iostream>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
+
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+#include <core/StringUtils.hpp>
+#include <core/Thread.hpp>
+
+namespace core {
+namespace text {
+
+namespace {
+
+// number of leading bytes examined
+const std::size_t kSniffBytes = 4096;
+
+// number of results cached (the cache is simply cleared when full)
+const std::size_t kMaxCachedResults = 4096;
+
+struct Magic
+{
+   const char* bytes;
+   std::size_t length;
+   bool isText;
+};
+
+#define MAGIC(bytes, isText) { bytes, sizeof(bytes) - 1, isText }
+
+const Magic kMagics[] = {
+   // unicode byte order marks (utf-16 and utf-32 text has null bytes)
+   MAGIC("\xFF\xFE", true),
+   MAGIC("\xFE\xFF", true),
+   MAGIC("\x00\x00\xFE\xFF", true),
+   MAGIC("%!PS", true),
+
+   // binary formats whose leading bytes could otherwise pass for text
+   MAGIC("%PDF-", false),
+   MAGIC("\x89PNG", false),
+   MAGIC("GIF87a", false),
+   MAGIC("GIF89a", false),
+   MAGIC("\xFF\xD8\xFF", false),
+   MAGIC("PK\x03\x04", false),
+   MAGIC("\x1F\x8B", false),
+   MAGIC("BZh", false),
+   MAGIC("\xFD" "7zXZ", false),
+   MAGIC("\x7F" "ELF", false),
+   MAGIC("\xCA\xFE\xBA\xBE", false),
+   MAGIC("\xCE\xFA\xED\xFE", false),
+   MAGIC("\xCF\xFA\xED\xFE", false),
+   MAGIC("RDX2\n", false),
+   MAGIC("RDX3\n", false)
+};
+
+#undef MAGIC
+
+struct CachedResult
+{
+   std::time_t lastWriteTime;
+   uintmax_t size;
+   bool isText;
+};
+
+boost::mutex s_cacheMutex;
+boost::unordered_map<std::string,CachedResult> s_cache;
+
+bool lookupCachedResult(const std::string& path,
+                        std::time_t lastWriteTime,
+                        uintmax_t size,
+                        bool* pIsText)
+{
+   LOCK_MUTEX(s_cacheMutex)
+   {
+      boost::unordered_map<std::string,CachedResult>::const_iterator it =
+                                                         s_cache.find(path);
+      if (it != s_cache.end() &&
+          it->second.lastWriteTime == lastWriteTime &&
+          it->second.size == size)
+      {
+         *pIsText = it->second.isText;
+         return true;
+      }
+   }
+   END_LOCK_MUTEX
+
+   return false;
+}
+
+void cacheResult(const std::string& path,
+                 std::time_t lastWriteTime,
+                 uintmax_t size,
+                 bool isText)
+{
+   CachedResult result;
+   result.lastWriteTime = lastWriteTime;
+   result.size = size;
+   result.isText = isText;
+
+   LOCK_MUTEX(s_cacheMutex)
+   {
+      if (s_cache.size() >= kMaxCachedResults)
+         s_cache.clear();
+      s_cache[path] = result;
+   }
+   END_LOCK_MUTEX
+}
+
+} // anonymous namespace
+
+bool looksLikeText(const char* begin, const char* end)
+{
+   std::size_t length = end - begin;
+   for (std::size_t i = 0; i < sizeof(kMagics) / sizeof(kMagics[0]); i++)
+   {
+      const Magic& magic = kMagics[i];
+      if (length >= magic.length &&
+          std::memcmp(begin, magic.bytes, magic.length) == 0)
+      {
+         return magic.isText;
+      }
+   }
+
+   return !string_utils::hasBinaryControlChars(begin, end);
+}
+
+Error isTextFile(const FilePath& filePath, bool* pIsText)
+{
+   std::string path = filePath.absolutePath();
+   std::time_t lastWriteTime = filePath.lastWriteTime();
+   uintmax_t size = filePath.size();
+   if (lookupCachedResult(path, lastWriteTime, size, pIsText))
+      return Success();
+
+   boost::shared_ptr<std::istream> pIfs;
+   Error error = filePath.open_r(&pIfs);
+   if (error)
+      return error;
+
+   char buffer[kSniffBytes];
+   pIfs->read(buffer, kSniffBytes);
+   if (pIfs->bad())
+   {
+      error = systemError(boost::system::errc::io_error, ERROR_LOCATION);
+      error.addProperty("path", path);
+      return error;
+   }
+
+   *pIsText = looksLikeText(buffer, buffer + pIfs->gcount());
+   cacheResult(path, lastWriteTime, size, *pIsText);
+   return Success();
+}
+
+} // namespace text
+} // namespace core
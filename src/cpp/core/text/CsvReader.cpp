@@ -0,0 +1,542 @@
+/*
+ * CsvReader.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/text/CsvReader.hpp>
+
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/FilePath.hpp>
+#include <core/Thread.hpp>
+
+// scan for delimiters and quotes 16 bytes at a time where sse2 is available
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CSV_READER_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace core {
+namespace text {
+
+namespace {
+
+// files smaller than this are always parsed on the calling thread
+const std::size_t kMinParallelSize = 4 * 1024 * 1024;
+
+// smallest piece of a file worth handing to its own thread
+const std::size_t kMinChunkSize = 1024 * 1024;
+
+const std::size_t kMaxThreads = 8;
+
+const char kQuote = '"';
+
+// fields longer than this are never numbers
+const std::size_t kMaxNumberLength = 64;
+
+// the first of a, b or c in [begin, end) (or end if there are none)
+const char* findAny(const char* begin, const char* end, char a, char b, char c)
+{
+#ifdef CSV_READER_SSE2
+   __m128i va = _mm_set1_epi8(a);
+   __m128i vb = _mm_set1_epi8(b);
+   __m128i vc = _mm_set1_epi8(c);
+   while (end - begin >= 16)
+   {
+      __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+      __m128i matches = _mm_or_si128(_mm_cmpeq_epi8(block, va),
+                          _mm_or_si128(_mm_cmpeq_epi8(block, vb),
+                                       _mm_cmpeq_epi8(block, vc)));
+      if (_mm_movemask_epi8(matches) != 0)
+         break;
+      begin += 16;
+   }
+#endif
+   for (; begin != end; ++begin)
+   {
+      if (*begin == a || *begin == b || *begin == c)
+         return begin;
+   }
+   return end;
+}
+
+std::size_t countChar(const char* begin, const char* end, char ch)
+{
+   std::size_t count = 0;
+#ifdef CSV_READER_SSE2
+   __m128i vch = _mm_set1_epi8(ch);
+   while (end - begin >= 16)
+   {
+      __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+      unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, vch));
+      for (; mask != 0; mask &= mask - 1)
+         count++;
+      begin += 16;
+   }
+#endif
+   for (; begin != end; ++begin)
+   {
+      if (*begin == ch)
+         count++;
+   }
+   return count;
+}
+
+// copy a (short) field into a null terminated buffer for strtol/strtod,
+// dropping surrounding whitespace
+bool numberText(const CsvField& field, char* buffer)
+{
+   std::string value;
+   const char* begin = field.begin;
+   const char* end = field.begin + field.length;
+   if (field.quoted)
+   {
+      value = csvFieldValue(field);
+      begin = value.data();
+      end = begin + value.size();
+   }
+
+   while (begin != end && (*begin == ' ' || *begin == '\t'))
+      ++begin;
+   while (begin != end && (end[-1] == ' ' || end[-1] == '\t'))
+      --end;
+
+   std::size_t length = end - begin;
+   if (length == 0 || length >= kMaxNumberLength)
+      return false;
+   std::memcpy(buffer, begin, length);
+   buffer[length] = '\0';
+   return true;
+}
+
+} // anonymous namespace
+
+std::string csvFieldValue(const CsvField& field)
+{
+   const char* begin = field.begin;
+   const char* end = field.begin + field.length;
+   if (!field.quoted)
+      return std::string(begin, end);
+
+   std::string value;
+   value.reserve(field.length);
+   bool inQuote = false;
+   for (const char* pos = begin; pos != end; ++pos)
+   {
+      if (*pos != kQuote)
+         value.push_back(*pos);
+      else if (inQuote && pos + 1 != end && pos[1] == kQuote)
+         value.push_back(*(++pos));
+      else
+         inQuote = !inQuote;
+   }
+   return value;
+}
+
+bool isCsvMissing(const CsvField& field)
+{
+   if (field.quoted)
+      return false;
+   return field.length == 0 ||
+          (field.length == 2 && field.begin[0] == 'N' && field.begin[1] == 'A');
+}
+
+bool csvFieldAsLogical(const CsvField& field, bool* pValue)
+{
+   std::string value = csvFieldValue(field);
+   if (value == "TRUE" || value == "true" || value == "True" || value == "T")
+      *pValue = true;
+   else if (value == "FALSE" || value == "false" || value == "False" ||
+            value == "F")
+      *pValue = false;
+   else
+      return false;
+   return true;
+}
+
+bool csvFieldAsInteger(const CsvField& field, int* pValue)
+{
+   char buffer[kMaxNumberLength];
+   if (!numberText(field, buffer))
+      return false;
+
+   errno = 0;
+   char* pEnd = NULL;
+   long value = std::strtol(buffer, &pEnd, 10);
+   if (*pEnd != '\0' || errno == ERANGE || value <= INT_MIN || value > INT_MAX)
+      return false;
+
+   *pValue = static_cast<int>(value);
+   return true;
+}
+
+bool csvFieldAsDouble(const CsvField& field, double* pValue)
+{
+   char buffer[kMaxNumberLength];
+   if (!numberText(field, buffer))
+      return false;
+
+   char* pEnd = NULL;
+   double value = std::strtod(buffer, &pEnd);
+   if (*pEnd != '\0')
+      return false;
+
+   *pValue = value;
+   return true;
+}
+
+struct CsvReader::Impl
+{
+   // the records parsed from one piece of the file
+   struct Chunk
+   {
+      Chunk() : firstRow(0) {}
+      std::size_t firstRow;
+      std::vector<CsvField> fields;
+      std::vector<std::size_t> rowStarts;   // index of each row's first field
+   };
+
+   explicit Impl(char delimiter)
+      : delimiter(delimiter), rows(0), maxFields(0)
+   {
+   }
+
+   void parse(const char* begin,
+              const char* end,
+              std::size_t maxRows,
+              Chunk* pChunk) const
+   {
+      Chunk& chunk = *pChunk;
+      const char* fieldBegin = begin;
+      std::size_t rowStart = 0;
+      bool quoted = false;
+      const char* pos = begin;
+      while (pos != end)
+      {
+         pos = findAny(pos, end, delimiter, kQuote, '\n');
+         if (pos == end)
+            break;
+
+         if (*pos == kQuote)
+         {
+            // skip to the closing quote (an escaped quote is just a closing
+            // quote immediately followed by an opening one)
+            quoted = true;
+            pos = std::find(pos + 1, end, kQuote);
+            if (pos != end)
+               ++pos;
+         }
+         else if (*pos == delimiter)
+         {
+            chunk.fields.push_back(
+                     CsvField(fieldBegin, pos - fieldBegin, quoted));
+            fieldBegin = ++pos;
+            quoted = false;
+         }
+         else // newline
+         {
+            const char* fieldEnd = pos;
+            if (fieldEnd != fieldBegin && fieldEnd[-1] == '\r')
+               --fieldEnd;
+            endRow(fieldBegin, fieldEnd, quoted, &rowStart, &chunk);
+            fieldBegin = ++pos;
+            quoted = false;
+
+            if (maxRows > 0 && chunk.rowStarts.size() >= maxRows)
+               return;
+         }
+      }
+
+      // last line with no line break
+      if (fieldBegin != end || chunk.fields.size() > rowStart)
+         endRow(fieldBegin, end, quoted, &rowStart, &chunk);
+   }
+
+   void endRow(const char* fieldBegin,
+               const char* fieldEnd,
+               bool quoted,
+               std::size_t* pRowStart,
+               Chunk* pChunk) const
+   {
+      // skip blank lines (a row consisting of a single empty field)
+      std::size_t rowFields = pChunk->fields.size() - *pRowStart;
+      if (rowFields == 0 && fieldBegin == fieldEnd && !quoted)
+         return;
+
+      pChunk->fields.push_back(
+                  CsvField(fieldBegin, fieldEnd - fieldBegin, quoted));
+      pChunk->rowStarts.push_back(*pRowStart);
+      *pRowStart = pChunk->fields.size();
+   }
+
+   // split the file into pieces which start at record boundaries (the
+   // quotes before each nominal split point tell us whether it is within
+   // a quoted field)
+   std::vector<const char*> splitPoints(std::size_t pieces) const
+   {
+      const char* begin = file.data();
+      const char* end = begin + file.size();
+
+      std::vector<const char*> nominal;
+      for (std::size_t i = 0; i <= pieces; i++)
+         nominal.push_back(begin + (file.size() / pieces) * i);
+      nominal.back() = end;
+
+      std::vector<std::size_t> quotes(pieces, 0);
+      runInParallel(pieces, boost::bind(&Impl::countQuotes, this,
+                                        boost::cref(nominal),
+                                        boost::ref(quotes), _1));
+
+      std::vector<const char*> points(1, begin);
+      std::size_t quotesBefore = 0;
+      for (std::size_t i = 1; i < pieces; i++)
+      {
+         quotesBefore += quotes[i - 1];
+         bool inQuote = (quotesBefore % 2) == 1;
+         const char* pos = nominal[i];
+
+         // the previous record ran past this split point (so we are now
+         // at a record boundary)
+         if (points.back() > pos)
+         {
+            pos = points.back();
+            inQuote = false;
+         }
+
+         for (; pos != end; ++pos)
+         {
+            if (*pos == kQuote)
+               inQuote = !inQuote;
+            else if (*pos == '\n' && !inQuote)
+               break;
+         }
+         points.push_back(pos != end ? pos + 1 : end);
+      }
+      points.push_back(end);
+      return points;
+   }
+
+   void countQuotes(const std::vector<const char*>& nominal,
+                    std::vector<std::size_t>& quotes,
+                    std::size_t index) const
+   {
+      quotes[index] = countChar(nominal[index], nominal[index + 1], kQuote);
+   }
+
+   void parsePiece(const std::vector<const char*>& points,
+                   std::size_t index)
+   {
+      parse(points[index], points[index + 1], 0, &chunks[index]);
+   }
+
+   // run work(0) ... work(count - 1) on their own threads (falling back to
+   // the calling thread if a thread can't be launched)
+   static void runInParallel(std::size_t count,
+                             const boost::function<void(std::size_t)>& work)
+   {
+      std::vector<boost::shared_ptr<boost::thread> > threads;
+      for (std::size_t i = 1; i < count; i++)
+      {
+         boost::shared_ptr<boost::thread> pThread(new boost::thread());
+         core::thread::safeLaunchThread(boost::bind(work, i), pThread.get());
+         if (pThread->joinable())
+            threads.push_back(pThread);
+         else
+            work(i);
+      }
+
+      work(0);
+
+      for (std::size_t i = 0; i < threads.size(); i++)
+         threads[i]->join();
+   }
+
+   const Chunk& chunkForRow(std::size_t row) const
+   {
+      std::size_t low = 0, high = chunks.size();
+      while (high - low > 1)
+      {
+         std::size_t mid = (low + high) / 2;
+         if (chunks[mid].firstRow <= row)
+            low = mid;
+         else
+            high = mid;
+      }
+      return chunks[low];
+   }
+
+   char delimiter;
+   boost::iostreams::mapped_file_source file;
+   std::vector<Chunk> chunks;
+   std::size_t rows;
+   std::size_t maxFields;
+};
+
+CsvReader::CsvReader(char delimiter)
+   : pImpl_(new Impl(delimiter))
+{
+}
+
+CsvReader::~CsvReader()
+{
+}
+
+Error CsvReader::open(const FilePath& filePath)
+{
+   if (!filePath.exists())
+   {
+      Error error = systemError(boost::system::errc::no_such_file_or_directory,
+                                ERROR_LOCATION);
+      error.addProperty("path", filePath.absolutePath());
+      return error;
+   }
+
+   // empty files can't be mapped (and have no rows)
+   if (filePath.size() == 0)
+      return Success();
+
+   try
+   {
+      pImpl_->file.open(filePath.absolutePathNative());
+   }
+   catch(const std::exception& e)
+   {
+      Error error = systemError(boost::system::errc::io_error,
+                                ERROR_LOCATION);
+      error.addProperty("what", e.what());
+      error.addProperty("path", filePath.absolutePath());
+      return error;
+   }
+
+   return Success();
+}
+
+Error CsvReader::read(std::size_t maxRows)
+{
+   Impl& impl = *pImpl_;
+   impl.chunks.clear();
+   impl.rows = 0;
+   impl.maxFields = 0;
+   if (!impl.file.is_open())
+      return Success();
+
+   const char* begin = impl.file.data();
+   const char* end = begin + impl.file.size();
+
+   std::size_t threads = std::min<std::size_t>(
+                                    boost::thread::hardware_concurrency(),
+                                    kMaxThreads);
+   std::size_t pieces = std::min(threads, impl.file.size() / kMinChunkSize);
+   if (maxRows > 0 || impl.file.size() < kMinParallelSize || pieces < 2)
+   {
+      impl.chunks.resize(1);
+      impl.parse(begin, end, maxRows, &impl.chunks[0]);
+   }
+   else
+   {
+      std::vector<const char*> points = impl.splitPoints(pieces);
+      impl.chunks.resize(pieces);
+      Impl::runInParallel(pieces, boost::bind(&Impl::parsePiece, &impl,
+                                              boost::cref(points), _1));
+   }
+
+   for (std::size_t i = 0; i < impl.chunks.size(); i++)
+   {
+      Impl::Chunk& chunk = impl.chunks[i];
+      chunk.firstRow = impl.rows;
+      impl.rows += chunk.rowStarts.size();
+      for (std::size_t row = 0; row < chunk.rowStarts.size(); row++)
+      {
+         std::size_t next = row + 1 < chunk.rowStarts.size() ?
+                                 chunk.rowStarts[row + 1] : chunk.fields.size();
+         impl.maxFields = std::max(impl.maxFields,
+                                   next - chunk.rowStarts[row]);
+      }
+   }
+
+   return Success();
+}
+
+std::size_t CsvReader::rowCount() const
+{
+   return pImpl_->rows;
+}
+
+std::size_t CsvReader::fieldCount(std::size_t row) const
+{
+   const Impl::Chunk& chunk = pImpl_->chunkForRow(row);
+   std::size_t index = row - chunk.firstRow;
+   std::size_t next = index + 1 < chunk.rowStarts.size() ?
+                           chunk.rowStarts[index + 1] : chunk.fields.size();
+   return next - chunk.rowStarts[index];
+}
+
+std::size_t CsvReader::maxFieldCount() const
+{
+   return pImpl_->maxFields;
+}
+
+CsvField CsvReader::field(std::size_t row, std::size_t column) const
+{
+   if (column >= fieldCount(row))
+      return CsvField();
+
+   const Impl::Chunk& chunk = pImpl_->chunkForRow(row);
+   return chunk.fields[chunk.rowStarts[row - chunk.firstRow] + column];
+}
+
+CsvColumnType CsvReader::inferColumnType(std::size_t column,
+                                         std::size_t firstRow,
+                                         std::size_t sampleRows) const
+{
+   bool canBeLogical = true, canBeInteger = true, canBeDouble = true;
+   std::size_t lastRow = std::min(rowCount(), firstRow + sampleRows);
+   for (std::size_t row = firstRow; row < lastRow; row++)
+   {
+      CsvField value = field(row, column);
+      if (isCsvMissing(value))
+         continue;
+
+      bool logical;
+      int integer;
+      double real;
+      canBeLogical = canBeLogical && csvFieldAsLogical(value, &logical);
+      canBeInteger = canBeInteger && csvFieldAsInteger(value, &integer);
+      canBeDouble = canBeDouble &&
+                    (canBeInteger || csvFieldAsDouble(value, &real));
+      if (!canBeLogical && !canBeDouble)
+         return kCsvString;
+   }
+
+   // (all missing values are read as logical, as with read.csv)
+   if (canBeLogical)
+      return kCsvLogical;
+   else if (canBeInteger)
+      return kCsvInteger;
+   else
+      return kCsvDouble;
+}
+
+} // namespace text
+} // namespace core
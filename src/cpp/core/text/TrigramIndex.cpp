@@ -0,0 +1,408 @@
+/*
+ * TrigramIndex.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/text/TrigramIndex.hpp>
+
+#include <algorithm>
+#include <cctype>
+
+#include <boost/algorithm/string/predicate.hpp>
+
+namespace core {
+namespace text {
+
+namespace {
+
+// compact the document table once it contains this many removed documents
+// (and they outnumber the live ones)
+const std::size_t kCompactThreshold = 1000;
+
+// ascii-only case folding (so that the index works for any encoding)
+inline boost::uint32_t fold(char ch)
+{
+   unsigned char uch = static_cast<unsigned char>(ch);
+   if (uch >= 'A' && uch <= 'Z')
+      uch = uch - 'A' + 'a';
+   return uch;
+}
+
+template <typename Trigram>
+void extractTrigrams(const char* begin,
+                     const char* end,
+                     std::vector<Trigram>* pTrigrams)
+{
+   if (end - begin < 3)
+      return;
+
+   Trigram trigram = (fold(begin[0]) << 8) | fold(begin[1]);
+   for (const char* pos = begin + 2; pos < end; ++pos)
+   {
+      trigram = ((trigram << 8) | fold(*pos)) & 0xFFFFFF;
+      pTrigrams->push_back(trigram);
+   }
+
+   std::sort(pTrigrams->begin(), pTrigrams->end());
+   pTrigrams->erase(std::unique(pTrigrams->begin(), pTrigrams->end()),
+                    pTrigrams->end());
+}
+
+void flushLiteral(std::string* pLiteral, std::vector<std::string>* pLiterals)
+{
+   if (!pLiteral->empty())
+   {
+      pLiterals->push_back(*pLiteral);
+      pLiteral->clear();
+   }
+}
+
+void dropLastChar(std::string* pLiteral)
+{
+   if (!pLiteral->empty())
+      pLiteral->erase(pLiteral->size() - 1);
+}
+
+} // anonymous namespace
+
+void TrigramIndex::add(const std::string& document,
+                       const char* begin,
+                       const char* end)
+{
+   remove(document);
+
+   std::vector<Trigram> trigrams;
+   extractTrigrams(begin, end, &trigrams);
+
+   // document ids are allocated in increasing order so appending keeps
+   // each of the posting lists sorted
+   DocumentId id = addDocument(document);
+   for (std::vector<Trigram>::const_iterator it = trigrams.begin();
+        it != trigrams.end();
+        ++it)
+   {
+      postings_[*it].push_back(id);
+   }
+}
+
+void TrigramIndex::addUnindexed(const std::string& document)
+{
+   remove(document);
+   unindexed_.push_back(addDocument(document));
+}
+
+void TrigramIndex::remove(const std::string& document)
+{
+   std::map<std::string,DocumentId>::iterator it = documents_.find(document);
+   if (it == documents_.end())
+      return;
+
+   removeDocument(it->second);
+   documents_.erase(it);
+
+   if (removedCount_ > kCompactThreshold && removedCount_ > documents_.size())
+      compact();
+}
+
+void TrigramIndex::removePrefix(const std::string& prefix)
+{
+   std::vector<std::string> removed;
+   for (std::map<std::string,DocumentId>::const_iterator
+           it = documents_.lower_bound(prefix);
+        it != documents_.end() && boost::algorithm::starts_with(it->first,
+                                                                prefix);
+        ++it)
+   {
+      removed.push_back(it->first);
+   }
+
+   for (std::vector<std::string>::const_iterator it = removed.begin();
+        it != removed.end();
+        ++it)
+   {
+      remove(*it);
+   }
+}
+
+void TrigramIndex::clear()
+{
+   documents_.clear();
+   documentTable_.clear();
+   unindexed_.clear();
+   postings_.clear();
+   removedCount_ = 0;
+}
+
+bool TrigramIndex::candidates(const std::vector<std::string>& literals,
+                              std::vector<std::string>* pDocuments) const
+{
+   // collect the trigrams which must all be present
+   std::vector<Trigram> trigrams;
+   for (std::vector<std::string>::const_iterator it = literals.begin();
+        it != literals.end();
+        ++it)
+   {
+      std::vector<Trigram> literalTrigrams;
+      extractTrigrams(it->data(), it->data() + it->size(), &literalTrigrams);
+      trigrams.insert(trigrams.end(),
+                      literalTrigrams.begin(),
+                      literalTrigrams.end());
+   }
+   if (trigrams.empty())
+      return false;
+
+   // look up the posting lists (starting with the shortest list so the
+   // intersection shrinks as quickly as possible)
+   std::vector<std::pair<std::size_t, const std::vector<DocumentId>*> > lists;
+   for (std::vector<Trigram>::const_iterator it = trigrams.begin();
+        it != trigrams.end();
+        ++it)
+   {
+      boost::unordered_map<Trigram, std::vector<DocumentId> >::const_iterator
+                                                  found = postings_.find(*it);
+      if (found == postings_.end())
+      {
+         lists.clear();
+         break;
+      }
+      lists.push_back(std::make_pair(found->second.size(), &found->second));
+   }
+   std::sort(lists.begin(), lists.end());
+
+   // intersect them
+   std::vector<DocumentId> ids;
+   if (!lists.empty())
+   {
+      ids = *lists[0].second;
+      for (std::size_t i = 1; i < lists.size() && !ids.empty(); i++)
+      {
+         std::vector<DocumentId> intersection;
+         std::set_intersection(ids.begin(), ids.end(),
+                               lists[i].second->begin(),
+                               lists[i].second->end(),
+                               std::back_inserter(intersection));
+         ids.swap(intersection);
+      }
+   }
+
+   // documents which weren't indexed are always candidates
+   ids.insert(ids.end(), unindexed_.begin(), unindexed_.end());
+
+   for (std::vector<DocumentId>::const_iterator it = ids.begin();
+        it != ids.end();
+        ++it)
+   {
+      const Document& document = documentTable_[*it];
+      if (!document.removed)
+         pDocuments->push_back(document.name);
+   }
+
+   return true;
+}
+
+std::vector<std::string> TrigramIndex::requiredLiterals(
+                                                   const std::string& regex)
+{
+   std::vector<std::string> literals;
+   std::string literal;
+
+   const std::vector<std::string> none;
+   const std::size_t n = regex.size();
+   std::size_t i = 0;
+   while (i < n)
+   {
+      char ch = regex[i];
+      if (ch == '\\')
+      {
+         if (i + 1 >= n)
+            return none;
+
+         char next = regex[i + 1];
+         i += 2;
+         switch (next)
+         {
+         // alternation and groups can make anything optional
+         case '|':
+         case '(':
+         case ')':
+            return none;
+
+         // the previous character is optional
+         case '?':
+            dropLastChar(&literal);
+            flushLiteral(&literal, &literals);
+            break;
+
+         case '{':
+         {
+            std::size_t close = regex.find("\\}", i);
+            if (close == std::string::npos)
+               return none;
+            i = close + 2;
+            dropLastChar(&literal);
+            flushLiteral(&literal, &literals);
+            break;
+         }
+
+         // the previous character is required but may repeat
+         case '+':
+            flushLiteral(&literal, &literals);
+            break;
+
+         default:
+            // character classes, back references and word anchors
+            if (std::isalnum(static_cast<unsigned char>(next)) ||
+                next == '<' || next == '>' || next == '`' || next == '\'')
+            {
+               flushLiteral(&literal, &literals);
+            }
+            // an escaped literal character
+            else
+            {
+               literal.push_back(next);
+            }
+            break;
+         }
+      }
+      else if (ch == '*')
+      {
+         dropLastChar(&literal);
+         flushLiteral(&literal, &literals);
+         i++;
+      }
+      else if (ch == '.' || ch == '^' || ch == '$')
+      {
+         flushLiteral(&literal, &literals);
+         i++;
+      }
+      else if (ch == '[')
+      {
+         flushLiteral(&literal, &literals);
+
+         // skip the bracket expression (note that a ']' which appears
+         // first in the list is part of the list)
+         std::size_t j = i + 1;
+         if (j < n && regex[j] == '^')
+            j++;
+         if (j < n && regex[j] == ']')
+            j++;
+         while (j < n && regex[j] != ']')
+         {
+            if (regex[j] == '[' && j + 1 < n &&
+                (regex[j + 1] == ':' || regex[j + 1] == '.' ||
+                 regex[j + 1] == '='))
+            {
+               std::size_t close = regex.find(std::string(1, regex[j + 1]) + "]",
+                                              j + 2);
+               if (close == std::string::npos)
+                  return none;
+               j = close + 2;
+            }
+            else
+            {
+               j++;
+            }
+         }
+         if (j >= n)
+            return none;
+
+         i = j + 1;
+      }
+      else
+      {
+         literal.push_back(ch);
+         i++;
+      }
+   }
+
+   flushLiteral(&literal, &literals);
+   return literals;
+}
+
+TrigramIndex::DocumentId TrigramIndex::addDocument(const std::string& name)
+{
+   DocumentId id = static_cast<DocumentId>(documentTable_.size());
+   Document document;
+   document.name = name;
+   documentTable_.push_back(document);
+   documents_[name] = id;
+   return id;
+}
+
+void TrigramIndex::removeDocument(DocumentId id)
+{
+   // posting lists are cleaned up lazily (when we compact)
+   Document& document = documentTable_[id];
+   document.removed = true;
+   document.name.clear();
+   removedCount_++;
+}
+
+void TrigramIndex::compact()
+{
+   // assign new ids to the remaining documents (in the same order so that
+   // the posting lists remain sorted)
+   const DocumentId kRemoved = static_cast<DocumentId>(-1);
+   std::vector<DocumentId> newIds(documentTable_.size(), kRemoved);
+   std::vector<Document> documentTable;
+   for (std::size_t i = 0; i < documentTable_.size(); i++)
+   {
+      if (!documentTable_[i].removed)
+      {
+         newIds[i] = static_cast<DocumentId>(documentTable.size());
+         documentTable.push_back(documentTable_[i]);
+         documents_[documentTable_[i].name] = newIds[i];
+      }
+   }
+   documentTable_.swap(documentTable);
+
+   // update the posting lists
+   boost::unordered_map<Trigram, std::vector<DocumentId> >::iterator it =
+                                                            postings_.begin();
+   while (it != postings_.end())
+   {
+      std::vector<DocumentId> ids;
+      for (std::vector<DocumentId>::const_iterator idIt = it->second.begin();
+           idIt != it->second.end();
+           ++idIt)
+      {
+         if (newIds[*idIt] != kRemoved)
+            ids.push_back(newIds[*idIt]);
+      }
+
+      if (ids.empty())
+      {
+         it = postings_.erase(it);
+      }
+      else
+      {
+         it->second.swap(ids);
+         ++it;
+      }
+   }
+
+   std::vector<DocumentId> unindexed;
+   for (std::vector<DocumentId>::const_iterator idIt = unindexed_.begin();
+        idIt != unindexed_.end();
+        ++idIt)
+   {
+      if (newIds[*idIt] != kRemoved)
+         unindexed.push_back(newIds[*idIt]);
+   }
+   unindexed_.swap(unindexed);
+
+   removedCount_ = 0;
+}
+
+} // namespace text
+} // namespace core
@@ -23,7 +23,12 @@
 
 namespace desktop {
 
-bool prepareEnvironment(Options& settings);
+// prepare the environment for the session. R is detected in the background
+// where it can be (so that it overlaps creating the main window) and
+// endPrepareEnvironment waits for the result (returning false if R wasn't
+// found, in which case the user has already been told)
+void beginPrepareEnvironment(Options& settings);
+bool endPrepareEnvironment(Options& settings);
 
 } // namespace desktop
 
@@ -38,6 +38,7 @@
 #include "DesktopOptions.hpp"
 #include "DesktopUtils.hpp"
 #include "DesktopSessionLauncher.hpp"
+#include "DesktopStartup.hpp"
 
 QProcess* pRSessionProcess;
 QString sharedSecret;
@@ -265,9 +266,12 @@ int main(int argc, char* argv[])
       initializeWorkingDirectory(argc, argv, filename);
       initializeStartupEnvironment(&filename);
 
+      // start warming up the gwt assets and detecting R (both happen in
+      // the background where possible while we create the main window)
+      preloadGwtAssets();
       Options& options = desktop::options();
-      if (!prepareEnvironment(options))
-         return 1;
+      beginPrepareEnvironment(options);
+      recordStartupPhase("begin_detect_r");
 
       // get install path
       FilePath installPath;
@@ -327,9 +331,19 @@ int main(int argc, char* argv[])
       // set the scripts path in options
       desktop::options().setScriptsPath(scriptsPath);
 
-      // launch session
+      // create the main window
       SessionLauncher sessionLauncher(sessionPath, confPath);
-      error = sessionLauncher.launchFirstSession(filename, pAppLaunch.get());
+      sessionLauncher.createMainWindow(filename, pAppLaunch.get());
+      recordStartupPhase("main_window");
+
+      // wait for R to be detected
+      if (!endPrepareEnvironment(options))
+         return 1;
+      recordStartupPhase("r_detected");
+
+      // launch session
+      error = sessionLauncher.launchFirstSession();
+      recordStartupPhase("session_launched");
       if (!error)
       {
          int result = pApp->exec();
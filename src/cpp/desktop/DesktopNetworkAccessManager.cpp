@@ -17,8 +17,6 @@
 
 #include <core/FilePath.hpp>
 
-#include <QTimer>
-
 #include "DesktopNetworkReply.hpp"
 #include "DesktopNetworkIOService.hpp"
 #include "DesktopOptions.hpp"
@@ -32,9 +30,9 @@ NetworkAccessManager::NetworkAccessManager(QString secret, QObject *parent) :
 {
    setProxy(QNetworkProxy::NoProxy);
 
-   QTimer* pTimer = new QTimer(this);
-   connect(pTimer, SIGNAL(timeout()), SLOT(pollForIO()));
-   pTimer->start(25);
+   // replies are completed as soon as their i/o is (rather than the io
+   // service being polled on a timer)
+   startIOService();
 }
 
 QNetworkReply* NetworkAccessManager::createRequest(
@@ -60,8 +58,3 @@ QNetworkReply* NetworkAccessManager::createRequest(
    }
 }
 
-
-void NetworkAccessManager::pollForIO()
-{
-   ioServicePoll();
-}
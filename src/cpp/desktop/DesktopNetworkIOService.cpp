@@ -15,26 +15,97 @@
 
 #include <core/Log.hpp>
 #include <core/Error.hpp>
+#include <core/Thread.hpp>
+
+#include <QMetaObject>
 
 using namespace core;
 
 namespace desktop {
 
+namespace {
+
+// heap based so they are never destructed (the io service thread is still
+// running when static destructors are called at exit)
+boost::asio::io_service* s_pIOService = NULL;
+boost::asio::io_service::work* s_pWork = NULL;
+MainThreadInvoker* s_pInvoker = NULL;
+
+void ioServiceThread()
+{
+   // run() only returns if a handler throws, so keep on running
+   for (;;)
+   {
+      try
+      {
+         boost::system::error_code ec;
+         ioService().run(ec);
+         if (ec)
+            LOG_ERROR(Error(ec, ERROR_LOCATION));
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+}
+
+} // anonymous namespace
+
 boost::asio::io_service& ioService()
 {
-   static boost::asio::io_service instance;
-   return instance;
+   if (s_pIOService == NULL)
+      s_pIOService = new boost::asio::io_service();
+   return *s_pIOService;
+}
+
+void startIOService()
+{
+   if (s_pWork != NULL)
+      return;
+
+   // the invoker belongs to the main thread (the thread it was created on)
+   s_pInvoker = new MainThreadInvoker();
+
+   // keep the io service running even when there is no pending i/o
+   s_pWork = new boost::asio::io_service::work(ioService());
+   core::thread::safeLaunchThread(ioServiceThread);
 }
 
-void ioServicePoll()
+void invokeOnMainThread(const boost::function<void()>& function)
 {
-   boost::system::error_code ec;
-   ioService().poll(ec);
-   if (ec)
-      LOG_ERROR(Error(ec, ERROR_LOCATION));
+   s_pInvoker->post(function);
+}
 
-   ioService().reset();
+void MainThreadInvoker::post(const boost::function<void()>& function)
+{
+   bool notify = false;
+   LOCK_MUTEX(mutex_)
+   {
+      notify = pending_.empty();
+      pending_.push_back(function);
+   }
+   END_LOCK_MUTEX
+
+   // one queued invocation drains everything posted before it runs
+   if (notify)
+      QMetaObject::invokeMethod(this, "invokePending", Qt::QueuedConnection);
 }
 
+void MainThreadInvoker::invokePending()
+{
+   std::deque<boost::function<void()> > pending;
+   LOCK_MUTEX(mutex_)
+   {
+      pending.swap(pending_);
+   }
+   END_LOCK_MUTEX
+
+   for (std::size_t i = 0; i < pending.size(); i++)
+   {
+      try
+      {
+         pending[i]();
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+}
 
 } // namespace desktop
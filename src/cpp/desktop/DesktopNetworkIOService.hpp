@@ -14,13 +14,46 @@
 #ifndef DESKTOP_NETWORK_IO_SERVICE_HPP
 #define DESKTOP_NETWORK_IO_SERVICE_HPP
 
+#include <deque>
+
+#include <boost/function.hpp>
 #include <boost/asio/io_service.hpp>
 
+#include <core/BoostThread.hpp>
+
+#include <QObject>
+
 namespace desktop {
 
+// io service used for communicating with the session. it is run by its own
+// thread so handlers are called as soon as i/o completes -- they should use
+// invokeOnMainThread for anything which touches Qt objects
 boost::asio::io_service& ioService();
 
-void ioServicePoll();
+// start the io service thread (must be called on the main thread, calls
+// after the first are no-ops)
+void startIOService();
+
+// run a function on the main thread (safe to call from any thread)
+void invokeOnMainThread(const boost::function<void()>& function);
+
+// QObject used by invokeOnMainThread to deliver functions through the
+// main thread's event loop
+class MainThreadInvoker : public QObject
+{
+   Q_OBJECT
+public:
+   explicit MainThreadInvoker(QObject* parent = 0) : QObject(parent) {}
+
+   void post(const boost::function<void()>& function);
+
+private slots:
+   void invokePending();
+
+private:
+   boost::mutex mutex_;
+   std::deque<boost::function<void()> > pending_;
+};
 
 } // namespace desktop
 
@@ -13,6 +13,8 @@
 
 #include "DesktopNetworkReply.hpp"
 
+#include <map>
+
 #include <boost/bind.hpp>
 #include <boost/foreach.hpp>
 #include <boost/shared_ptr.hpp>
@@ -38,26 +40,75 @@ using namespace core;
 
 namespace desktop {
 
+namespace {
+
+#ifdef _WIN32
+typedef http::NamedPipeAsyncClient SessionClient;
+#else
+typedef http::LocalStreamAsyncClient SessionClient;
+#endif
+
+// replies which haven't been deleted yet, by id (only accessed on the
+// main thread)
+std::map<int, NetworkReply*> s_replies;
+int s_nextReplyId = 0;
+
+// kept-alive connections to the session (so that each request doesn't
+// have to establish a new connection). heap based so that it is never
+// destructed (the io service thread is still running at exit)
+typedef http::AsyncClientPool<SessionClient> SessionClientPool;
+const std::size_t kMaxIdleConnections = 6;
+const int kIdleConnectionTimeoutSeconds = 60;
+
+SessionClientPool& sessionClientPool()
+{
+   static SessionClientPool* pInstance = new SessionClientPool(
+               kMaxIdleConnections,
+               boost::posix_time::seconds(kIdleConnectionTimeoutSeconds));
+   return *pInstance;
+}
+
+void closeClient(boost::shared_ptr<SessionClient> pClient)
+{
+   pClient->disableHandlers();
+   pClient->close();
+}
+
+void checkinClient(const std::string& localPeer,
+                   boost::shared_ptr<SessionClient> pClient)
+{
+   sessionClientPool().checkin(localPeer, pClient);
+}
+
+} // anonymous namespace
+
 struct NetworkReply::Impl
 {
    Impl(const std::string& localPeer)
- #ifdef _WIN32
-      : pClient(new http::NamedPipeAsyncClient(ioService(),
-                                               localPeer,
-                                               retryProfile())),
- #else
-      : pClient(new http::LocalStreamAsyncClient(ioService(),
-                                                 FilePath(localPeer),
-                                                 retryProfile())),
- #endif
+      : pClient(sessionClientPool().checkout(localPeer)),
+        completed(false),
         replyReadOffset(0)
    {
-   }
+      if (!pClient)
+      {
  #ifdef _WIN32
-    boost::shared_ptr<http::NamedPipeAsyncClient> pClient;
+         pClient.reset(new SessionClient(ioService(),
+                                         localPeer,
+                                         retryProfile()));
  #else
-    boost::shared_ptr<http::LocalStreamAsyncClient> pClient;
+         pClient.reset(new SessionClient(ioService(),
+                                         FilePath(localPeer),
+                                         retryProfile()));
  #endif
+         pClient->setKeepAlive(true);
+      }
+      else
+      {
+         pClient->setConnectionRetryProfile(retryProfile());
+      }
+   }
+   boost::shared_ptr<SessionClient> pClient;
+   bool completed;   // response received (client returned to the pool)
    QByteArray replyData;
    qint64 replyReadOffset;
 
@@ -82,6 +133,10 @@ NetworkReply::NetworkReply(const std::string& localPeer,
      secret_(secret),
      redirects_(0)
 {   
+   // register so that i/o completions can find us
+   replyId_ = s_nextReplyId++;
+   s_replies[replyId_] = this;
+
    // set our attributes
    setOperation(op);
    setRequest(req);
@@ -160,17 +215,76 @@ void NetworkReply::executeRequest(const http::Request& request)
    // set the request
    pImpl_->pClient->request().assign(request);
 
-   // execute and bind to response handlers
-   pImpl_->pClient->execute(boost::bind(&NetworkReply::onResponse, this, _1),
-                            boost::bind(&NetworkReply::onError, this, _1));
+   // execute on the io service thread (the handlers are called there too).
+   // the client is returned to the pool once the response is consumed
+   http::ResponseHandler responseHandler =
+                  boost::bind(&NetworkReply::postResponse,
+                              replyId_,
+                              boost::function<void()>(
+                                 boost::bind(checkinClient,
+                                             localPeer_,
+                                             pImpl_->pClient)),
+                              _1);
+   http::ErrorHandler errorHandler =
+                  boost::bind(&NetworkReply::postError, replyId_, _1);
+   ioService().post(boost::bind(&SessionClient::execute,
+                                pImpl_->pClient,
+                                responseHandler,
+                                errorHandler));
+}
+
+void NetworkReply::postResponse(int replyId,
+                                const boost::function<void()>& onConsumed,
+                                const http::Response& response)
+{
+   // the response belongs to the client, which isn't reused until
+   // onConsumed is called (so we can deliver it without copying)
+   invokeOnMainThread(boost::bind(&NetworkReply::deliverResponse,
+                                  replyId,
+                                  &response,
+                                  onConsumed));
+}
+
+void NetworkReply::postError(int replyId, const Error& error)
+{
+   invokeOnMainThread(boost::bind(&NetworkReply::deliverError,
+                                  replyId,
+                                  error));
+}
+
+void NetworkReply::deliverResponse(int replyId,
+                                   const http::Response* pResponse,
+                                   const boost::function<void()>& onConsumed)
+{
+   std::map<int, NetworkReply*>::const_iterator it = s_replies.find(replyId);
+   if (it != s_replies.end())
+   {
+      // the client is no longer ours once it is back in the pool (note
+      // that a redirect replaces pImpl_ with a new request)
+      it->second->pImpl_->completed = true;
+      it->second->onResponse(*pResponse);
+   }
+
+   onConsumed();
+}
+
+void NetworkReply::deliverError(int replyId, const Error& error)
+{
+   std::map<int, NetworkReply*>::const_iterator it = s_replies.find(replyId);
+   if (it != s_replies.end())
+      it->second->onError(error);
 }
 
 NetworkReply::~NetworkReply()
 {
    try
    {
-      pImpl_->pClient->disableHandlers();
-      pImpl_->pClient->close();
+      s_replies.erase(replyId_);
+
+      // abandon the request if it is still in progress (on the io service
+      // thread, which is where the client is used)
+      if (!pImpl_->completed)
+         ioService().post(boost::bind(closeClient, pImpl_->pClient));
    }
    catch(...)
    {
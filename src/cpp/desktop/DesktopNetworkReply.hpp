@@ -15,6 +15,8 @@
 #define DESKTOPNETWORKREPLY_HPP
 
 #include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/function.hpp>
 
 #include <core/FilePath.hpp>
 
@@ -63,9 +65,21 @@ private:
    void handleRedirect(QString location);
    void executeRequest(const core::http::Request& request);
 
+   // i/o completions (called on the io service thread) are posted back to
+   // the main thread and delivered to the reply if it still exists
+   static void postResponse(int replyId,
+                            const boost::function<void()>& onConsumed,
+                            const core::http::Response& response);
+   static void postError(int replyId, const core::Error& error);
+   static void deliverResponse(int replyId,
+                               const core::http::Response* pResponse,
+                               const boost::function<void()>& onConsumed);
+   static void deliverError(int replyId, const core::Error& error);
+
 private:
    struct Impl;
    boost::scoped_ptr<Impl> pImpl_;
+   int replyId_;
    std::string localPeer_;
    QString secret_;
    int redirects_;
@@ -17,6 +17,8 @@
 
 #include <vector>
 
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
 #include <boost/algorithm/string/trim.hpp>
 
 #include <QtCore>
@@ -25,6 +27,7 @@
 #include <core/Error.hpp>
 #include <core/Log.hpp>
 #include <core/FilePath.hpp>
+#include <core/Thread.hpp>
 #include <core/system/System.hpp>
 #include <core/system/Environment.hpp>
 #include <core/r_util/REnvironment.hpp>
@@ -46,45 +49,88 @@ void showRNotFoundError(const std::string& msg)
                   QString::fromUtf8(msg.c_str()));
 }
 
+struct REnvironment
+{
+   REnvironment() : success(false) {}
+
+   FilePath rWhichRPath;
+   FilePath rLdScriptPath;
+   FilePath cacheFile;
+
+   bool success;
+   std::string rScriptPath;
+   r_util::EnvironmentVars rEnvVars;
+   std::string errMsg;
+};
+
+REnvironment s_rEnvironment;
+boost::thread s_detectThread;
+
+// runs in the background (no ui and no changes to our environment)
+void detectREnvironment(REnvironment* pEnv)
+{
+   try
+   {
+      pEnv->success = r_util::detectREnvironment(pEnv->rWhichRPath,
+                                                 pEnv->rLdScriptPath,
+                                                 std::string(),
+                                                 pEnv->cacheFile,
+                                                 &pEnv->rScriptPath,
+                                                 &pEnv->rEnvVars,
+                                                 &pEnv->errMsg);
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+}
+
 } // anonymous namespace
 
-bool prepareEnvironment(Options& options)
+void beginPrepareEnvironment(Options& options)
 {
    // check for which R override
-   FilePath rWhichRPath;
    std::string whichROverride = core::system::getenv("RSTUDIO_WHICH_R");
    if (!whichROverride.empty())
-      rWhichRPath = FilePath(whichROverride);
+      s_rEnvironment.rWhichRPath = FilePath(whichROverride);
 
    // determine rLdPaths script location
    FilePath supportingFilePath = options.supportingFilePath();
-   FilePath rLdScriptPath = supportingFilePath.complete("bin/r-ldpath");
-   if (!rLdScriptPath.exists())
-      rLdScriptPath = supportingFilePath.complete("session/r-ldpath");
+   s_rEnvironment.rLdScriptPath = supportingFilePath.complete("bin/r-ldpath");
+   if (!s_rEnvironment.rLdScriptPath.exists())
+      s_rEnvironment.rLdScriptPath =
+                           supportingFilePath.complete("session/r-ldpath");
+
+   // cache detected locations so we don't need to run R on every startup
+   s_rEnvironment.cacheFile = core::system::userSettingsPath(
+         core::system::userHomePath("R_USER|HOME"),
+         "RStudio-Desktop").childPath("r-environment");
 
    // attempt to detect R environment
-   std::string rScriptPath, errMsg;
-   r_util::EnvironmentVars rEnvVars;
-   bool success = r_util::detectREnvironment(rWhichRPath,
-                                             rLdScriptPath,
-                                             std::string(),
-                                             &rScriptPath,
-                                             &rEnvVars,
-                                             &errMsg);
-   if (!success)
+   core::thread::safeLaunchThread(
+                  boost::bind(detectREnvironment, &s_rEnvironment),
+                  &s_detectThread);
+}
+
+bool endPrepareEnvironment(Options& options)
+{
+   // wait for detection (or do it now if the thread couldn't be started)
+   if (s_detectThread.joinable())
+      s_detectThread.join();
+   else
+      detectREnvironment(&s_rEnvironment);
+
+   if (!s_rEnvironment.success)
    {
-      showRNotFoundError(errMsg);
+      showRNotFoundError(s_rEnvironment.errMsg);
       return false;
    }
 
-   if (desktop::options().runDiagnostics())
+   if (options.runDiagnostics())
    {
-      std::cout << std::endl << "Using R script: " << rScriptPath
-                << std::endl;
+      std::cout << std::endl << "Using R script: "
+                << s_rEnvironment.rScriptPath << std::endl;
    }
 
    // set environment and return true
-   r_util::setREnvironmentVars(rEnvVars);
+   r_util::setREnvironmentVars(s_rEnvironment.rEnvVars);
    return true;
 }
 
@@ -31,6 +31,7 @@
 #include "DesktopOptions.hpp"
 #include "DesktopSlotBinders.hpp"
 #include "DesktopGwtCallback.hpp"
+#include "DesktopStartup.hpp"
 
 #define RUN_DIAGNOSTICS_LOG(message) if (desktop::options().runDiagnostics()) \
              std::cout << (message) << std::endl;
@@ -69,41 +70,15 @@ void logEnvVar(const std::string& name)
 } // anonymous namespace
 
 
-Error SessionLauncher::launchFirstSession(const QString& filename,
-                                          ApplicationLaunch* pAppLaunch)
+void SessionLauncher::createMainWindow(const QString& filename,
+                                       ApplicationLaunch* pAppLaunch)
 {
    // save reference to app launch
    pAppLaunch_ = pAppLaunch;
 
    // build a new new launch context
    QString host, port;
-   QStringList argList;
-   QUrl url;
-   buildLaunchContext(&host, &port, &argList, &url);
-
-   RUN_DIAGNOSTICS_LOG("\nAttempting to launch R session...");
-   logEnvVar("RSTUDIO_WHICH_R");
-   logEnvVar("R_HOME");
-   logEnvVar("R_DOC_DIR");
-   logEnvVar("R_INCLUDE_DIR");
-   logEnvVar("R_SHARE_DIR");
-   logEnvVar("R_LIBS");
-   logEnvVar("R_LIBS_USER");
-   logEnvVar("DYLD_LIBRARY_PATH");
-   logEnvVar("LD_LIBRARY_PATH");
-   logEnvVar("PATH");
-   logEnvVar("HOME");
-   logEnvVar("R_USER");
-
-   // launch the process
-   Error error = launchSession(argList, &pRSessionProcess_);
-   if (error)
-     return error;
-
-   RUN_DIAGNOSTICS_LOG("\nR session launched, "
-                           "attempting to connect on port "
-                           + port.toStdString() +
-                           "...");
+   buildLaunchContext(&host, &port, &firstSessionArgList_, &firstSessionUrl_);
 
    // jcheng 03/16/2011: Due to crashing caused by authenticating
    // proxies, bypass all proxies from Qt until we can get the problem
@@ -113,15 +88,12 @@ Error SessionLauncher::launchFirstSession(const QString& filename,
    //NetworkProxyFactory* pProxyFactory = new NetworkProxyFactory();
    //QNetworkProxyFactory::setApplicationProxyFactory(pProxyFactory);
 
-   pMainWindow_ = new MainWindow(url);
+   pMainWindow_ = new MainWindow(firstSessionUrl_);
    pMainWindow_->setSessionLauncher(this);
-   pMainWindow_->setSessionProcess(pRSessionProcess_);
    pAppLaunch->setActivationWindow(pMainWindow_);
 
    desktop::options().restoreMainWindowBounds(pMainWindow_);
 
-   RUN_DIAGNOSTICS_LOG("\nConnected to R session, attempting to initialize...\n");
-
    // one-time workbench intiailized hook for startup file association
    if (!filename.isNull() && !filename.isEmpty())
    {
@@ -136,10 +108,46 @@ Error SessionLauncher::launchFirstSession(const QString& filename,
                             SLOT(openFileInRStudio(QString)));
    }
 
+   pMainWindow_->connect(pMainWindow_,
+                         SIGNAL(firstWorkbenchInitialized()),
+                         this,
+                         SLOT(onFirstWorkbenchInitialized()));
+
    pMainWindow_->connect(pAppLaunch_,
                          SIGNAL(openFileRequest(QString)),
                          pMainWindow_,
                          SLOT(openFileInRStudio(QString)));
+}
+
+Error SessionLauncher::launchFirstSession()
+{
+   RUN_DIAGNOSTICS_LOG("\nAttempting to launch R session...");
+   logEnvVar("RSTUDIO_WHICH_R");
+   logEnvVar("R_HOME");
+   logEnvVar("R_DOC_DIR");
+   logEnvVar("R_INCLUDE_DIR");
+   logEnvVar("R_SHARE_DIR");
+   logEnvVar("R_LIBS");
+   logEnvVar("R_LIBS_USER");
+   logEnvVar("DYLD_LIBRARY_PATH");
+   logEnvVar("LD_LIBRARY_PATH");
+   logEnvVar("PATH");
+   logEnvVar("HOME");
+   logEnvVar("R_USER");
+
+   // launch the process
+   Error error = launchSession(firstSessionArgList_, &pRSessionProcess_);
+   if (error)
+     return error;
+
+   RUN_DIAGNOSTICS_LOG("\nR session launched, "
+                           "attempting to connect on port "
+                           + QString::number(firstSessionUrl_.port()).toStdString() +
+                           "...");
+
+   pMainWindow_->setSessionProcess(pRSessionProcess_);
+
+   RUN_DIAGNOSTICS_LOG("\nConnected to R session, attempting to initialize...\n");
 
    pMainWindow_->connect(pRSessionProcess_,
                          SIGNAL(finished(int,QProcess::ExitStatus)),
@@ -150,13 +158,19 @@ Error SessionLauncher::launchFirstSession(const QString& filename,
    if (!options().runDiagnostics())
    {
       pMainWindow_->show();
-      pAppLaunch->activateWindow();
-      pMainWindow_->loadUrl(url);
+      pAppLaunch_->activateWindow();
+      pMainWindow_->loadUrl(firstSessionUrl_);
    }
 
    return Success();
 }
 
+void SessionLauncher::onFirstWorkbenchInitialized()
+{
+   recordStartupPhase("workbench_initialized");
+   logStartupPhases();
+}
+
 void SessionLauncher::closeAllSatillites()
 {
    QWidgetList topLevels = QApplication::topLevelWidgets();
@@ -42,8 +42,13 @@ public:
    {
    }
 
-   core::Error launchFirstSession(const QString& filename,
-                                  ApplicationLaunch* pAppLaunch);
+   // create the main window (but don't show it). this is separate from
+   // launching the first session so that it can happen while R is still
+   // being detected
+   void createMainWindow(const QString& filename,
+                         ApplicationLaunch* pAppLaunch);
+
+   core::Error launchFirstSession();
 
    core::Error launchNextSession(bool reload);
 
@@ -54,6 +59,7 @@ public:
 public slots:
    void onRSessionExited(int exitCode, QProcess::ExitStatus exitStatus);
    void onReloadFrameForNextSession();
+   void onFirstWorkbenchInitialized();
 
 private:
 
@@ -77,6 +83,8 @@ private:
    MainWindow* pMainWindow_;
    QProcess* pRSessionProcess_;
    QUrl nextSessionUrl_;
+   QStringList firstSessionArgList_;
+   QUrl firstSessionUrl_;
 };
 
 } // namespace desktop
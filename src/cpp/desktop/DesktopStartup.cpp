@@ -0,0 +1,146 @@
+/*
+ * DesktopStartup.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "DesktopStartup.hpp"
+
+#include <vector>
+#include <fstream>
+#include <iostream>
+
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <core/Log.hpp>
+#include <core/Error.hpp>
+#include <core/Thread.hpp>
+#include <core/FilePath.hpp>
+#include <core/SafeConvert.hpp>
+#include <core/FileSerializer.hpp>
+
+#include "DesktopUtils.hpp"
+#include "DesktopOptions.hpp"
+
+using namespace core;
+
+namespace desktop {
+
+namespace {
+
+const boost::posix_time::ptime s_startTime =
+                        boost::posix_time::microsec_clock::universal_time();
+
+// phases and their elapsed milliseconds (main thread only)
+std::vector<std::pair<std::string, long> > s_phases;
+
+// keep the log from growing without bound (it's just for comparing recent
+// startups)
+const uintmax_t kMaxStartupLogSize = 256 * 1024;
+
+bool addGwtAsset(int, const FilePath& filePath,
+                 std::vector<FilePath>* pAssets)
+{
+   std::string filename = filePath.filename();
+   if (!filePath.isDirectory() &&
+       (filename.find(".cache.") != std::string::npos ||
+        filename.find(".nocache.") != std::string::npos))
+   {
+      pAssets->push_back(filePath);
+   }
+   return true;
+}
+
+void readGwtAssets(const FilePath& gwtPath)
+{
+   try
+   {
+      std::vector<FilePath> assets;
+      Error error = gwtPath.childrenRecursive(
+                              boost::bind(addGwtAsset, _1, _2, &assets));
+      if (error)
+      {
+         LOG_ERROR(error);
+         return;
+      }
+
+      // the content is discarded, we just want it in the cache
+      std::vector<char> buffer(64 * 1024);
+      BOOST_FOREACH(const FilePath& asset, assets)
+      {
+         std::ifstream ifs(asset.absolutePath().c_str(),
+                           std::ios_base::in | std::ios_base::binary);
+         while (ifs.read(&buffer[0], buffer.size()))
+         {
+         }
+      }
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+}
+
+} // anonymous namespace
+
+void recordStartupPhase(const std::string& phase)
+{
+   boost::posix_time::time_duration elapsed =
+         boost::posix_time::microsec_clock::universal_time() - s_startTime;
+   s_phases.push_back(std::make_pair(phase,
+                                     static_cast<long>(
+                                           elapsed.total_milliseconds())));
+}
+
+void logStartupPhases()
+{
+   if (s_phases.empty())
+      return;
+
+   std::string line = boost::posix_time::to_simple_string(
+                     boost::posix_time::second_clock::local_time());
+   typedef std::pair<std::string, long> Phase;
+   BOOST_FOREACH(const Phase& phase, s_phases)
+   {
+      line += " " + phase.first + "=" +
+              safe_convert::numberToString(phase.second) + "ms";
+   }
+   s_phases.clear();
+
+   if (desktop::options().runDiagnostics())
+      std::cout << "\nStartup: " << line << std::endl;
+
+   FilePath logPath = desktop::userLogPath().complete("startup-timings.log");
+   if (logPath.exists() && logPath.size() > kMaxStartupLogSize)
+   {
+      Error error = logPath.remove();
+      if (error)
+         LOG_ERROR(error);
+   }
+
+   Error error = core::appendToFile(logPath, line + "\n");
+   if (error)
+      LOG_ERROR(error);
+}
+
+void preloadGwtAssets()
+{
+   // the compiled client is the bootstrap script and the (content named)
+   // permutation and fragment files alongside it
+   FilePath gwtPath = desktop::options().wwwDocsPath().parent()
+                                                      .complete("rstudio");
+   if (!gwtPath.exists())
+      return;
+
+   core::thread::safeLaunchThread(boost::bind(readGwtAssets, gwtPath));
+}
+
+} // namespace desktop
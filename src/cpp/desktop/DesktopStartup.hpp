@@ -0,0 +1,38 @@
+/*
+ * DesktopStartup.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef DESKTOP_STARTUP_HPP
+#define DESKTOP_STARTUP_HPP
+
+#include <string>
+
+namespace desktop {
+
+// record the end of a startup phase (timed from the start of the process,
+// or more precisely from static initialization of the desktop binary)
+void recordStartupPhase(const std::string& phase);
+
+// append the phases recorded so far to the startup log (one line per
+// startup, so regressions show up by comparing lines)
+void logStartupPhases();
+
+// read the compiled GWT client into the file system cache in the
+// background, so that when the session serves it (once R has started) it
+// doesn't have to wait on the disk
+void preloadGwtAssets();
+
+} // namespace desktop
+
+#endif // DESKTOP_STARTUP_HPP
@@ -32,6 +32,12 @@ using namespace core;
 
 namespace desktop {
 
+namespace {
+
+// detection can involve the user choosing a version of R, so it's done
+// on the main thread in beginPrepareEnvironment
+bool s_environmentPrepared = false;
+
 bool prepareEnvironment(Options &options)
 {
    bool forceUi = ::GetAsyncKeyState(VK_CONTROL) & ~1;
@@ -70,4 +76,16 @@ bool prepareEnvironment(Options &options)
    return true;
 }
 
+} // anonymous namespace
+
+void beginPrepareEnvironment(Options& options)
+{
+   s_environmentPrepared = prepareEnvironment(options);
+}
+
+bool endPrepareEnvironment(Options&)
+{
+   return s_environmentPrepared;
+}
+
 } // namespace desktop
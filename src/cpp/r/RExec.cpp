@@ -16,6 +16,10 @@
 #define R_INTERNAL_FUNCTIONS
 #include <r/RExec.hpp>
 
+#include <map>
+
+#include <boost/algorithm/string/predicate.hpp>
+
 #include <core/FilePath.hpp>
 #include <core/Log.hpp>
 
@@ -41,6 +45,57 @@ namespace exec {
    
 namespace {
 
+// the tools:rstudio environment (where .rs.* functions are defined)
+SEXP toolsEnv()
+{
+   static SEXP s_toolsEnvSEXP = R_UnboundValue;
+   if (s_toolsEnvSEXP == R_UnboundValue)
+   {
+      for (SEXP envSEXP = ENCLOS(R_GlobalEnv);
+           envSEXP != R_EmptyEnv;
+           envSEXP = ENCLOS(envSEXP))
+      {
+         SEXP nameSEXP = Rf_getAttrib(envSEXP, Rf_install("name"));
+         if (TYPEOF(nameSEXP) == STRSXP && Rf_length(nameSEXP) > 0 &&
+             std::string(CHAR(STRING_ELT(nameSEXP, 0))) == "tools:rstudio")
+         {
+            // environments on the search path aren't collected, but
+            // preserve it anyway in case it is ever detached
+            R_PreserveObject(envSEXP);
+            s_toolsEnvSEXP = envSEXP;
+            break;
+         }
+      }
+   }
+   return s_toolsEnvSEXP;
+}
+
+// look up an .rs.* function directly within the tools environment (this
+// is used for nearly every RFunction and is much cheaper than walking the
+// search path with findFunction). symbols are cached by name so repeated
+// lookups don't have to re-hash the name, however the binding itself is
+// looked up each time so functions which are re-added (e.g. when the tools
+// are re-sourced) are always current
+SEXP findToolsFunction(const std::string& name)
+{
+   SEXP envSEXP = toolsEnv();
+   if (envSEXP == R_UnboundValue)
+      return R_UnboundValue;
+
+   typedef std::map<std::string,SEXP> SymbolMap;
+   static SymbolMap s_symbols;
+   SymbolMap::const_iterator it = s_symbols.find(name);
+   if (it == s_symbols.end())
+      it = s_symbols.insert(std::make_pair(name,
+                                           Rf_install(name.c_str()))).first;
+
+   SEXP functionSEXP = Rf_findVarInFrame(envSEXP, it->second);
+   if (Rf_isFunction(functionSEXP))
+      return functionSEXP;
+   else
+      return R_UnboundValue;
+}
+
 // create a scope for disabling any installed error handlers (e.g. recover)
 // we need to do this so that recover isn't invoked while we are running
 // R code within an r::exec scope -- when the user presses 0 to exit
@@ -293,8 +348,12 @@ void RFunction::commonInit(const std::string& functionName)
       name = functionName_; 
    }
    
-   // lookup function
-   functionSEXP_ = sexp::findFunction(name, ns);
+   // lookup function (checking tools:rstudio first for .rs.* functions)
+   functionSEXP_ = R_UnboundValue;
+   if (ns.empty() && boost::algorithm::starts_with(name, ".rs."))
+      functionSEXP_ = findToolsFunction(name);
+   if (functionSEXP_ == R_UnboundValue)
+      functionSEXP_ = sexp::findFunction(name, ns);
    if (functionSEXP_ != R_UnboundValue)
       rProtect_.add(functionSEXP_);
 }
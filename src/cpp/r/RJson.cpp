@@ -37,7 +37,9 @@
 5) R data frame (class="data.frame") are returned as arrays of json objects
    JsArray<Object>. Note that when creating a data frame to be marshalled
    back to javascript that check.rows = TRUE & stringsAsFactors = FALSE
-   should be specified.
+   should be specified. Data frames which also inherit from "rs.columns"
+   are instead returned column-wise as a json object with an array for each
+   column (this avoids repeating the field names for every row)
  
 4) R old style lists (LISTSXP) are not currently supported.
 
@@ -47,6 +49,9 @@
 */
 
 #include <iostream>
+#include <map>
+
+#include <boost/utility.hpp>
 
 #define R_INTERNAL_FUNCTIONS
 #include <r/RJson.hpp>
@@ -152,6 +157,137 @@ Error jsonValueFromVectorElement(SEXP vectorSEXP,
    return Success();
 }  
 
+// converts R strings to utf8. R shares a single CHARSXP between all
+// occurrences of a string so we can cache conversions by CHARSXP (this
+// helps with vectors and data frames that contain many repeated values)
+class StringCache : boost::noncopyable
+{
+public:
+   const std::string& utf8(SEXP charSEXP)
+   {
+      std::map<SEXP,std::string>::iterator it = cache_.find(charSEXP);
+      if (it == cache_.end())
+      {
+         it = cache_.insert(std::make_pair(
+                     charSEXP, std::string(Rf_translateCharUTF8(charSEXP)))).first;
+      }
+      return it->second;
+   }
+
+private:
+   std::map<SEXP,std::string> cache_;
+};
+
+// convert all of the elements of a vector (dispatching on the type once
+// rather than for each element)
+Error jsonArrayFromVector(SEXP vectorSEXP,
+                          StringCache* pStrings,
+                          core::json::Array* pArray)
+{
+   int vectorLength = Rf_length(vectorSEXP);
+   pArray->reserve(pArray->size() + vectorLength);
+
+   switch(TYPEOF(vectorSEXP))
+   {
+      case NILSXP:
+      {
+         break;
+      }
+      case STRSXP:
+      {
+         for (int i=0; i<vectorLength; i++)
+         {
+            SEXP stringSEXP = STRING_ELT(vectorSEXP, i);
+            if (stringSEXP != NA_STRING)
+               pArray->push_back(core::json::Value(pStrings->utf8(stringSEXP)));
+            else
+               pArray->push_back(core::json::Value());
+         }
+         break;
+      }
+      case INTSXP:
+      {
+         const int* pValues = INTEGER(vectorSEXP);
+         for (int i=0; i<vectorLength; i++)
+         {
+            if (pValues[i] != NA_INTEGER)
+               pArray->push_back(core::json::Value(pValues[i]));
+            else
+               pArray->push_back(core::json::Value());
+         }
+         break;
+      }
+      case REALSXP:
+      {
+         const double* pValues = REAL(vectorSEXP);
+         for (int i=0; i<vectorLength; i++)
+         {
+            if (!ISNAN(pValues[i]))
+               pArray->push_back(core::json::Value(pValues[i]));
+            else
+               pArray->push_back(core::json::Value());
+         }
+         break;
+      }
+      case LGLSXP:
+      {
+         const int* pValues = LOGICAL(vectorSEXP);
+         for (int i=0; i<vectorLength; i++)
+         {
+            if (pValues[i] != NA_LOGICAL)
+               pArray->push_back(core::json::Value(pValues[i] == TRUE));
+            else
+               pArray->push_back(core::json::Value());
+         }
+         break;
+      }
+      default:
+      {
+         // less common types are converted element by element
+         for (int i=0; i<vectorLength; i++)
+         {
+            core::json::Value elementValue;
+            Error error = jsonValueFromVectorElement(vectorSEXP,
+                                                     i,
+                                                     &elementValue);
+            if (error)
+               return error;
+            pArray->push_back(elementValue);
+         }
+         break;
+      }
+   }
+
+   return Success();
+}
+
+// convert a data frame column (list columns have their elements converted
+// individually)
+Error jsonArrayFromColumn(SEXP columnSEXP,
+                          StringCache* pStrings,
+                          core::json::Array* pArray)
+{
+   if (TYPEOF(columnSEXP) == VECSXP)
+   {
+      int columnLength = Rf_length(columnSEXP);
+      pArray->reserve(columnLength);
+      for (int i=0; i<columnLength; i++)
+      {
+         core::json::Value elementValue;
+         Error error = jsonValueFromObject(VECTOR_ELT(columnSEXP, i),
+                                           &elementValue);
+         if (error)
+            return error;
+         pArray->push_back(elementValue);
+      }
+      return Success();
+   }
+   else
+   {
+      return jsonArrayFromVector(columnSEXP, pStrings, pArray);
+   }
+}
+
 
 Error jsonValueArrayFromList(SEXP listSEXP, core::json::Value* pValue)
 {
@@ -205,55 +341,6 @@ bool isNamedList(SEXP listSEXP)
    return true;
 }
    
-Error jsonObjectFromListElement(SEXP listSEXP, 
-                                const std::vector<std::string>& fieldNames,
-                                int index,
-                                core::json::Value* pValue)
-{
-   // note list length
-   int listLength = Rf_length(listSEXP);
-   
-   // compose an object by iterating through the fields
-   core::json::Object jsonObject ;
-   for (int f=0; f<listLength; f++)
-   {
-      // get the field
-      SEXP fieldSEXP = VECTOR_ELT(listSEXP, f);
-      
-      // extract the value
-      core::json::Value fieldValue ;
-      switch(TYPEOF(fieldSEXP))
-      {
-         case VECSXP:
-         {
-            SEXP valueSEXP = VECTOR_ELT(fieldSEXP, index);
-            Error error = jsonValueFromObject(valueSEXP, &fieldValue);
-            if (error)
-               return error;
-            
-            break;
-         }
-         default:
-         {
-            Error error = jsonValueFromVectorElement(fieldSEXP, 
-                                                     index,
-                                                     &fieldValue);
-            if (error)
-               return error;
-            
-            break;
-         }
-      }
-      
-      // add it to the json object
-      jsonObject[fieldNames[f]] = fieldValue;
-   }
-   
-   // set value and return success
-   *pValue = jsonObject;
-   return Success();
-}
-
 //   
 // NOTE: this function assumes that isNamedList has been called
 // and returned true for this list (validates a name for each element)
@@ -298,23 +385,68 @@ Error jsonObjectArrayFromDataFrame(SEXP listSEXP, core::json::Value* pValue)
    if (error)
       return error;
    
-   // object array to return
-   core::json::Array jsonObjectArray ;
-   
-   // iterate through the values
-   int values = Rf_length(VECTOR_ELT(listSEXP, 0));
-   for (int v=0; v<values; v++)
+   // convert the columns up front (so that each is converted in one pass)
+   StringCache strings;
+   int fields = Rf_length(listSEXP);
+   std::vector<core::json::Array> columns(fields);
+   for (int f=0; f<fields; f++)
    {
-      core::json::Value objectValue ;
-      error = jsonObjectFromListElement(listSEXP, fieldNames, v, &objectValue);
+      error = jsonArrayFromColumn(VECTOR_ELT(listSEXP, f),
+                                  &strings,
+                                  &columns[f]);
       if (error)
-         return error ;
-      
-      jsonObjectArray.push_back(objectValue);
+         return error;
+   }
+
+   // compose an object for each row (built in place within the result)
+   *pValue = core::json::Array();
+   core::json::Array& jsonObjectArray = pValue->get_array();
+   std::size_t values = fields > 0 ? columns[0].size() : 0;
+   jsonObjectArray.reserve(values);
+   for (std::size_t v=0; v<values; v++)
+   {
+      jsonObjectArray.push_back(core::json::Object());
+      core::json::Object& jsonObject = jsonObjectArray.back().get_obj();
+      for (int f=0; f<fields; f++)
+      {
+         if (v < columns[f].size())
+            jsonObject[fieldNames[f]] = columns[f][v];
+         else
+            jsonObject[fieldNames[f]] = core::json::Value();
+      }
    }
    
-   // return array and success
-   *pValue = jsonObjectArray;
+   return Success();
+}
+
+//   
+// NOTE: this function assumes that isNamedList has been called
+// and returned true for this list (validates a name for each element)
+//   
+Error jsonColumnsFromDataFrame(SEXP listSEXP, core::json::Value* pValue)
+{
+   // get the names of the list elements
+   std::vector<std::string> fieldNames ;
+   Error error = sexp::getNames(listSEXP, &fieldNames);
+   if (error)
+      return error;
+
+   // an array for each column (built in place within the result)
+   *pValue = core::json::Object();
+   core::json::Object& jsonObject = pValue->get_obj();
+   StringCache strings;
+   int fields = Rf_length(listSEXP);
+   for (int f=0; f<fields; f++)
+   {
+      core::json::Value& columnValue = jsonObject[fieldNames[f]];
+      columnValue = core::json::Array();
+      error = jsonArrayFromColumn(VECTOR_ELT(listSEXP, f),
+                                  &strings,
+                                  &columnValue.get_array());
+      if (error)
+         return error;
+   }
+
    return Success();
 }
 
@@ -347,19 +479,10 @@ Error jsonValueFromVector(SEXP vectorSEXP, core::json::Value* pValue)
       }
    }
 
-   core::json::Array vectorValues ;
-   for (int i=0; i<vectorLength; i++)
-   {
-      core::json::Value elementValue ;
-      Error error = jsonValueFromVectorElement(vectorSEXP, i, &elementValue);
-      if (error)
-         return error;
-      
-      vectorValues.push_back(elementValue);
-   }
-   
-   *pValue = vectorValues;
-   return Success();
+   // convert directly into the result (rather than copying an array in)
+   *pValue = core::json::Array();
+   StringCache strings;
+   return jsonArrayFromVector(vectorSEXP, &strings, &pValue->get_array());
 }   
    
    
@@ -368,7 +491,12 @@ Error jsonValueFromList(SEXP listSEXP, core::json::Value* pValue)
    if (isNamedList(listSEXP))
    {
       if (Rf_inherits(listSEXP, "data.frame"))
-          return jsonObjectArrayFromDataFrame(listSEXP, pValue);
+      {
+         if (Rf_inherits(listSEXP, "rs.columns"))
+            return jsonColumnsFromDataFrame(listSEXP, pValue);
+         else
+            return jsonObjectArrayFromDataFrame(listSEXP, pValue);
+      }
       else
           return jsonObjectFromList(listSEXP, pValue);
    }
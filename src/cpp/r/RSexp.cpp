@@ -110,6 +110,47 @@ void listEnvironment(SEXP env,
    }
 }
 
+namespace {
+
+void addFrameBindings(SEXP frame,
+                      bool includeAll,
+                      std::vector<Binding>* pBindings)
+{
+   for ( ; frame != R_NilValue; frame = CDR(frame))
+   {
+      SEXP sym = TAG(frame);
+      SEXP value = CAR(frame);
+      if (value == R_UnboundValue)
+         continue;
+
+      if (!includeAll && CHAR(PRINTNAME(sym))[0] == '.')
+         continue;
+
+      pBindings->push_back(std::make_pair(sym, value));
+   }
+}
+
+} // anonymous namespace
+
+void listBindings(SEXP env,
+                  bool includeAll,
+                  std::vector<Binding>* pBindings)
+{
+   pBindings->clear();
+
+   SEXP hashTable = HASHTAB(env);
+   if (hashTable != R_NilValue)
+   {
+      int buckets = Rf_length(hashTable);
+      for (int i = 0; i < buckets; i++)
+         addFrameBindings(VECTOR_ELT(hashTable, i), includeAll, pBindings);
+   }
+   else
+   {
+      addFrameBindings(FRAME(env), includeAll, pBindings);
+   }
+}
+
 SEXP findVar(const std::string& name, const std::string& ns)
 {
    if (name.empty())
@@ -37,9 +37,22 @@ SourceManager& sourceManager()
    return instance ;
 }
    
+namespace {
+
+std::string escapedPath(const FilePath& filePath)
+{
+   // do \ and quote escaping (for windows)
+   std::string path = filePath.absolutePath();
+   boost::algorithm::replace_all(path, "\\", "\\\\");
+   boost::algorithm::replace_all(path, "\"", "\\\"");
+   return path;
+}
+
+} // anonymous namespace
+   
 Error SourceManager::sourceTools(const core::FilePath& filePath)
 {
-   Error error = sourceLocal(filePath);
+   Error error = sourceToolsFile(filePath);
    if (error)
       return error;
 
@@ -87,10 +100,68 @@ void SourceManager::reloadIfNecessary()
 
 void SourceManager::reSourceTools(const core::FilePath& filePath)
 {
-   Error error = source(filePath, true);
+   Error error = sourceToolsFile(filePath);
    if (error)
       LOG_ERROR(error);
 }
+
+Error SourceManager::sourceToolsFile(const FilePath& filePath)
+{
+   if (toolsCachePath_.empty())
+      return sourceLocal(filePath);
+   else
+      return sourceCompiled(filePath);
+}
+
+Error SourceManager::sourceCompiled(const FilePath& filePath)
+{
+   Error error = toolsCachePath_.ensureDirectory();
+   if (error)
+      return error;
+
+   // the compiled expressions are cached per R version and keyed by the
+   // source file's modification time. if compilation isn't possible (no
+   // compiler package) we still cache the parsed expressions. expressions
+   // are evaluated one at a time (just as source does) so any top level
+   // side effects of the file still occur
+   std::string rCode =
+      "local({\n"
+      "   src <- \"" + escapedPath(filePath) + "\"\n"
+      "   dir <- file.path(\"" + escapedPath(toolsCachePath_) + "\",\n"
+      "                    paste(R.version$major, R.version$minor, sep = \".\"))\n"
+      "   prefix <- paste(basename(src), \"-\", sep = \"\")\n"
+      "   cache <- file.path(dir, paste(prefix,\n"
+      "                                 as.numeric(file.info(src)$mtime),\n"
+      "                                 \".rds\", sep = \"\"))\n"
+      "   env <- new.env(parent = globalenv())\n"
+      "   exprs <- NULL\n"
+      "   if (file.exists(cache))\n"
+      "      exprs <- tryCatch(readRDS(cache), error = function(e) NULL)\n"
+      "   if (is.null(exprs)) {\n"
+      "      exprs <- parse(src, keep.source = FALSE, encoding = \"UTF-8\")\n"
+      "      exprs <- tryCatch(lapply(exprs, compiler::compile, env = env,\n"
+      "                               options = list(suppressAll = TRUE)),\n"
+      "                        error = function(e) as.list(exprs))\n"
+      "      try(silent = TRUE, {\n"
+      "         dir.create(dir, showWarnings = FALSE, recursive = TRUE)\n"
+      "         unlink(list.files(dir, full.names = TRUE,\n"
+      "                           pattern = paste(\"^\", prefix, sep = \"\")))\n"
+      "         tmp <- tempfile(prefix, tmpdir = dir)\n"
+      "         saveRDS(exprs, tmp)\n"
+      "         if (!file.rename(tmp, cache))\n"
+      "            unlink(tmp)\n"
+      "      })\n"
+      "   }\n"
+      "   for (expr in exprs)\n"
+      "      eval(expr, env)\n"
+      "   invisible(NULL)\n"
+      "})";
+
+   // record that we sourced the file
+   recordSourcedFile(filePath, true);
+
+   return r::exec::executeString(rCode);
+}
    
 Error SourceManager::source(const FilePath& filePath, bool local)
 {
@@ -98,9 +169,7 @@ Error SourceManager::source(const FilePath& filePath, bool local)
    std::string localParam = local ? "TRUE" : "FALSE" ;
    std::string localSuffix = local ? ")" : "";
       
-   // do \ escaping (for windows)
-   std::string path = filePath.absolutePath();
-   boost::algorithm::replace_all(path, "\\", "\\\\");
+   std::string path = escapedPath(filePath);
 
    // build the code 
    std::string rCode = localPrefix + "source(\"" 
@@ -16,12 +16,17 @@
 
 #include <r/RUtil.hpp>
 
+#include <map>
+
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/regex.hpp>
 
 #include <core/FilePath.hpp>
 #include <core/StringUtils.hpp>
 #include <core/Error.hpp>
+#include <core/Thread.hpp>
 
 #include <r/RExec.hpp>
 
@@ -90,36 +95,114 @@ std::string rconsole2utf8(const std::string& encoded)
    return output;
 }
 
+namespace {
+
+std::string normalizedEncoding(const std::string& encoding)
+{
+   if (encoding.empty())
+      return "UTF-8";
+
+   std::string normalized = boost::algorithm::to_upper_copy(encoding);
+   if (normalized == "UTF8")
+      return "UTF-8";
+   else
+      return normalized;
+}
+
+// encodings in which ascii text is represented by the same bytes (so
+// conversions of ascii text between them are no-ops)
+bool isAsciiCompatible(const std::string& encoding)
+{
+   return !boost::algorithm::starts_with(encoding, "UTF-16") &&
+          !boost::algorithm::starts_with(encoding, "UTF-32") &&
+          !boost::algorithm::starts_with(encoding, "UCS-") &&
+          !boost::algorithm::starts_with(encoding, "UNICODE") &&
+          !boost::algorithm::starts_with(encoding, "UTF-7") &&
+          !boost::algorithm::starts_with(encoding, "EBCDIC") &&
+          !boost::algorithm::starts_with(encoding, "IBM0") &&
+          !boost::algorithm::starts_with(encoding, "CP0");
+}
+
+// cache of idle iconv handles by (from, to) encoding. handles are taken out
+// of the cache while in use since they carry conversion state
+typedef std::pair<std::string,std::string> ConversionKey;
+boost::mutex s_iconvMutex;
+std::multimap<ConversionKey,void*> s_iconvHandles;
+const std::size_t kMaxIdleHandles = 16;
+
+void* acquireIconvHandle(const std::string& from, const std::string& to)
+{
+   ConversionKey key(from, to);
+   LOCK_MUTEX(s_iconvMutex)
+   {
+      std::multimap<ConversionKey,void*>::iterator it =
+                                                s_iconvHandles.find(key);
+      if (it != s_iconvHandles.end())
+      {
+         void* handle = it->second;
+         s_iconvHandles.erase(it);
+         return handle;
+      }
+   }
+   END_LOCK_MUTEX
+
+   return ::Riconv_open(to.c_str(), from.c_str());
+}
+
+void releaseIconvHandle(const std::string& from,
+                        const std::string& to,
+                        void* handle)
+{
+   // reset the conversion state
+   ::Riconv(handle, NULL, NULL, NULL, NULL);
+
+   LOCK_MUTEX(s_iconvMutex)
+   {
+      if (s_iconvHandles.size() < kMaxIdleHandles)
+      {
+         s_iconvHandles.insert(std::make_pair(ConversionKey(from, to),
+                                              handle));
+         return;
+      }
+   }
+   END_LOCK_MUTEX
+
+   ::Riconv_close(handle);
+}
+
+} // anonymous namespace
+
 core::Error iconvstr(const std::string& value,
                      const std::string& from,
                      const std::string& to,
                      bool allowSubstitution,
                      std::string* pResult)
 {
-   std::string effectiveFrom = from;
-   if (effectiveFrom.empty())
-      effectiveFrom = "UTF-8";
-   std::string effectiveTo = to;
-   if (effectiveTo.empty())
-      effectiveTo = "UTF-8";
-
-   if (effectiveFrom == effectiveTo)
+   std::string effectiveFrom = normalizedEncoding(from);
+   std::string effectiveTo = normalizedEncoding(to);
+
+   // no conversion necessary (the common case of ascii text in ascii
+   // compatible encodings is checked for before paying for iconv)
+   if (effectiveFrom == effectiveTo ||
+       (isAsciiCompatible(effectiveFrom) && isAsciiCompatible(effectiveTo) &&
+        string_utils::isAscii(value)))
    {
       *pResult = value;
       return Success();
    }
 
-   std::vector<char> output;
-   output.reserve(value.length());
-
-   void* handle = ::Riconv_open(to.c_str(), from.c_str());
+   void* handle = acquireIconvHandle(from, to);
    if (handle == (void*)(-1))
       return systemError(errno, ERROR_LOCATION);
 
+   std::string output;
+   output.reserve(value.length());
+
    const char* pIn = value.data();
    size_t inBytes = value.size();
 
-   char buffer[256];
+   // convert in chunks (output is appended to as each chunk completes)
+   char buffer[16384];
    while (inBytes > 0)
    {
       const char* pInOrig = pIn;
@@ -128,7 +211,7 @@ core::Error iconvstr(const std::string& value,
 
       size_t result = ::Riconv(handle, &pIn, &inBytes, &pOut, &outBytes);
       if (buffer != pOut)
-         output.insert(output.end(), buffer, pOut);
+         output.append(buffer, pOut);
 
       if (result == (size_t)(-1))
       {
@@ -144,17 +227,25 @@ core::Error iconvstr(const std::string& value,
          }
          else
          {
-            ::Riconv_close(handle);
             Error error = systemError(errno, ERROR_LOCATION);
+            releaseIconvHandle(from, to, handle);
             error.addProperty("str", value);
             error.addProperty("len", value.length());
             return error;
          }
       }
    }
-   ::Riconv_close(handle);
 
-   *pResult = std::string(output.begin(), output.end());
+   // flush any shift sequence required by the target encoding
+   char* pOut = buffer;
+   size_t outBytes = sizeof(buffer);
+   ::Riconv(handle, NULL, NULL, &pOut, &outBytes);
+   if (buffer != pOut)
+      output.append(buffer, pOut);
+
+   releaseIconvHandle(from, to, handle);
+
+   pResult->swap(output);
    return Success();
 }
 
@@ -51,6 +51,15 @@ void listEnvironment(SEXP env,
                      bool includeAll,
                      Protect* pProtect,
                      std::vector<Variable>* pVariables);
+
+// bindings (symbol and value) within an environment's frame. this is much
+// cheaper than listEnvironment (no names are allocated, no lookups are done
+// and the result isn't sorted) however the values are the raw binding values
+// (so may be promises or active binding functions) and are not protected
+typedef std::pair<SEXP,SEXP> Binding ;
+void listBindings(SEXP env,
+                  bool includeAll,
+                  std::vector<Binding>* pBindings);
       
 // object info
 SEXP findVar(const std::string& name,
@@ -48,6 +48,13 @@ public:
    bool autoReload() const { return autoReload_; }
    void setAutoReload(bool autoReload) { autoReload_ = autoReload; }
    
+   // when a cache path is set tools files are byte-compiled once and the
+   // compiled code is loaded from the cache by subsequent sessions
+   void setToolsCachePath(const core::FilePath& cachePath)
+   {
+      toolsCachePath_ = cachePath;
+   }
+
    core::Error sourceTools(const core::FilePath& filePath);
    void ensureToolsLoaded();
 
@@ -72,6 +79,8 @@ private:
    
    // helper functions
    core::Error source(const core::FilePath& filePath, bool local);
+   core::Error sourceCompiled(const core::FilePath& filePath);
+   core::Error sourceToolsFile(const core::FilePath& filePath);
    void reSourceTools(const core::FilePath& filePath);
    void recordSourcedFile(const core::FilePath& filePath, bool local);
    void reloadSourceIfNecessary(const SourcedFileMap::value_type& value);
@@ -80,6 +89,7 @@ private:
    bool autoReload_ ;
    SourcedFileMap sourcedFiles_ ;
    std::vector<core::FilePath> toolsFilePaths_;
+   core::FilePath toolsCachePath_;
 };
    
 } // namespace r
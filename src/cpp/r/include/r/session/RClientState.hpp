@@ -17,6 +17,8 @@
 #define R_SESSION_CLIENT_STATE_HPP
 
 #include <string>
+#include <map>
+#include <vector>
 
 #include <boost/utility.hpp>
 
@@ -80,11 +82,20 @@ public:
 private:
    void restoreGlobalState(const core::FilePath& stateFile);
    void restoreProjectState(const core::FilePath& stateFile);
+   void restoreState(const core::FilePath& stateFile);
+   void ensureParsed() const;
 
 private:
-   core::json::Object temporaryState_ ;
-   core::json::Object persistentState_ ;
-   core::json::Object projectPersistentState_;
+   // restored state files are only parsed once the state is used (so
+   // these are mutable)
+   mutable core::json::Object temporaryState_ ;
+   mutable core::json::Object persistentState_ ;
+   mutable core::json::Object projectPersistentState_;
+   mutable std::vector<std::pair<core::FilePath,std::string> > unparsedState_;
+
+   // contents of the state files as last written or read (by path) so
+   // that commits only write the files which have changed
+   std::map<std::string,std::string> writtenState_;
 };
       
 } // namespace session
@@ -16,6 +16,8 @@
 #ifndef R_SESSION_CONSOLE_ACTIONS_HPP
 #define R_SESSION_CONSOLE_ACTIONS_HPP
 
+#include <string>
+
 #include <boost/utility.hpp>
 #include <boost/circular_buffer.hpp>
 
@@ -49,6 +51,9 @@ public:
    int capacity() const ;
    void setCapacity(int capacity);
 
+   // approximate bytes held by the actions
+   std::size_t memoryUsage() const;
+
    void add(int type, const std::string& data);
    
    // reset to all but the last prompt
@@ -57,6 +62,20 @@ public:
    // get actions in their wire-representation (two identically sized arrays, 
    // one for type and one for data)
    void asJson(core::json::Object* pActions) const;
+
+   // Get the actions which a client doesn't have, given the id and next
+   // sequence number of the actions it has cached. Returns true if only
+   // newer actions were provided, or false if all actions were provided
+   // (because the cache is from another buffer or is too old). Also
+   // provides the id of the buffer (which changes whenever it is reset)
+   // and the next sequence number for the client to cache. The actions
+   // provided are sealed: output is no longer combined into them, so they
+   // don't change after the client has cached them.
+   bool asJson(const std::string& cacheId,
+               int cacheSequence,
+               core::json::Object* pActions,
+               std::string* pId,
+               int* pNextSequence);
    
    core::Error loadFromFile(const core::FilePath& filePath);
    core::Error saveToFile(const core::FilePath& filePath) const;
@@ -67,6 +86,12 @@ private:
    mutable boost::mutex mutex_;
    boost::circular_buffer<core::json::Value> actionsType_;
    boost::circular_buffer<core::json::Value> actionsData_;
+
+   // sequence numbers of the first action in the buffer and of the first
+   // action which can still be combined with subsequent output
+   std::string id_;
+   int firstSequence_;
+   int sealedSequence_;
 };
 
    
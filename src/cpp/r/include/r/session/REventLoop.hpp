@@ -52,6 +52,11 @@ void permanentlyDisablePolledEventHandler();
 // check whether the polled event handler has already been initialized
 bool polledEventHandlerInitialized();
 
+// wake R's event loop so that the polled event handler is called promptly
+// even if R is blocked waiting for input (e.g. during Sys.sleep). safe to
+// call from any thread
+void wakeup();
+
 // event processing (allowing R gui components like GraphApp or the quartz
 // device to remain responsive)
 void processEvents();
@@ -108,6 +108,8 @@ public:
    virtual int plotCount() const = 0 ;
    virtual core::Error plotImageFilename(int index, 
                                          std::string* pImageFilename) const = 0;
+   virtual core::Error plotSnapshotFile(int index,
+                                        core::FilePath* pSnapshotFile) const = 0;
    virtual int activePlotIndex() const = 0;
    virtual core::Error setActivePlot(int index) = 0;
    virtual core::Error removePlot(int index) = 0;
@@ -143,12 +145,20 @@ public:
    // subscribe to showManipulator event
    virtual boost::signal<void ()>& onShowManipulator() = 0;
 
-   // set manipulator values
-   virtual void setPlotManipulatorValues(const core::json::Object& values) = 0;
+   // set manipulator values. pass deferReplay when newer values are
+   // already on their way (the manipulator is then only replayed if the
+   // values include a button press). returns true if it was replayed
+   virtual bool setPlotManipulatorValues(const core::json::Object& values,
+                                         bool deferReplay) = 0;
    virtual void manipulatorPlotClicked(int x, int y) = 0;
 
    // notify that we are about to execute code
    virtual void onBeforeExecute() = 0;
+
+   // apply a resize of the display once the size has stopped changing
+   // (returns true if a resize is still pending, in which case this
+   // should be called again shortly)
+   virtual bool applyPendingResize() = 0;
 };
    
 // singleton
@@ -53,7 +53,8 @@ struct ROptions
          autoReloadSource(false),
          restoreWorkspace(true),
          saveWorkspace(SA_SAVEASK),
-         rProfileOnResume(false)
+         rProfileOnResume(false),
+         restartZygote(false)
    {
    }
    core::FilePath userHomePath;
@@ -76,6 +77,7 @@ struct ROptions
    bool restoreWorkspace;
    SA_TYPE saveWorkspace;
    bool rProfileOnResume;
+   bool restartZygote;
 };
       
 struct RInitInfo
@@ -134,6 +136,7 @@ struct RCallbacks
    boost::function<void(const std::string&)> suicide;
    boost::function<void(bool)> cleanup;
    boost::function<void(int,const core::FilePath&)> serialization;
+   boost::function<bool()> waitForRestart;
 };
 
 // run the session   
@@ -152,6 +155,10 @@ void reportAndLogWarning(const std::string& warning);
 bool isSuspendable(const std::string& prompt);
 bool suspend(bool force);
 
+// note that the session has been active (so that the state being saved by a
+// background suspend is out of date)
+void invalidateBackgroundSuspend();
+
 struct RSuspendOptions
 {
    RSuspendOptions()
@@ -15,9 +15,11 @@
 
 #include <r/session/RClientState.hpp>
 
+#include <set>
 #include <algorithm>
 
 #include <boost/bind.hpp>
+#include <boost/foreach.hpp>
 #include <boost/function.hpp>
 
 #include <core/Log.hpp>
@@ -81,37 +83,76 @@ void mergeState(const json::Object& sourceState,
                  boost::bind(mergeStateScope, _1, pTargetState));
 }
 
+// write the state scopes within a container, skipping files which already
+// have the same contents (commits typically change very few scopes)
 void commitState(const json::Object& stateContainer,
                  const std::string& fileExt,
-                 const core::FilePath& stateDir)
+                 const core::FilePath& stateDir,
+                 std::map<std::string,std::string>* pWrittenState,
+                 std::set<std::string>* pCommittedFiles)
 {
    for (json::Object::const_iterator
         it = stateContainer.begin(); it != stateContainer.end(); ++it)
    {
-      // generate json
+      // generate json (compact, this is only ever read by us)
       std::ostringstream ostr ;
-      json::writeFormatted(it->second, ostr);
-      
-      // write to file
+      json::write(it->second, ostr);
+      std::string contents = ostr.str();
+
+      // note that the file is still in use
       FilePath stateFile = stateDir.complete(it->first + fileExt);
-      Error error = writeStringToFile(stateFile, ostr.str());
+      std::string path = stateFile.absolutePath();
+      pCommittedFiles->insert(path);
+
+      // skip if it hasn't changed
+      std::map<std::string,std::string>::const_iterator writtenIt =
+                                                   pWrittenState->find(path);
+      if (writtenIt != pWrittenState->end() &&
+          writtenIt->second == contents &&
+          stateFile.exists())
+      {
+         continue;
+      }
+
+      // write to file
+      Error error = writeStringToFile(stateFile, contents);
       if (error)
-         LOG_ERROR(error);   
+         LOG_ERROR(error);
+      else
+         (*pWrittenState)[path] = contents;
    }
 }
-   
-void restoreState(const core::FilePath& stateFilePath,
-                  json::Object* pStateContainer)
+
+// remove state files which are no longer part of the committed state
+void removeStaleStateFiles(const FilePath& stateDir,
+                           const std::set<std::string>& committedFiles,
+                           std::map<std::string,std::string>* pWrittenState)
 {
-   // read the contents of the file
-   std::string contents ;
-   Error error = readStringFromFile(stateFilePath, &contents);
+   std::vector<FilePath> childPaths;
+   Error error = stateDir.children(&childPaths);
    if (error)
    {
       LOG_ERROR(error);
       return;
    }
-   
+
+   BOOST_FOREACH(const FilePath& childPath, childPaths)
+   {
+      std::string path = childPath.absolutePath();
+      if (committedFiles.find(path) != committedFiles.end())
+         continue;
+
+      error = childPath.removeIfExists();
+      if (error)
+         LOG_ERROR(error);
+      pWrittenState->erase(path);
+   }
+}
+
+void parseState(const core::FilePath& stateFilePath,
+                const std::string& contents,
+                json::Object* pStateContainer)
+{
    // parse the json
    json::Value value;
    if ( !json::parse(contents, &value) )
@@ -124,14 +165,6 @@ void restoreState(const core::FilePath& stateFilePath,
    pStateContainer->insert(std::make_pair(stateFilePath.stem(), value));
 }
 
-Error removeAndRecreateStateDir(const FilePath& stateDir)
-{
-   Error error = stateDir.removeIfExists();
-   if (error)
-      return error;
-   return stateDir.ensureDirectory();
-}
-
 Error restoreStateFiles(const FilePath& sourceDir,
                         boost::function<void(const FilePath&)> restoreFunc)
 {
@@ -182,16 +215,48 @@ ClientState::ClientState()
 
 void ClientState::restoreGlobalState(const FilePath& stateFile)
 {
-   if (stateFile.extension() == kTemporaryExt)
-      restoreState(stateFile, &temporaryState_);
-   else if (stateFile.extension() == kPersistentExt)
-      restoreState(stateFile, &persistentState_);
+   if (stateFile.extension() == kTemporaryExt ||
+       stateFile.extension() == kPersistentExt)
+   {
+      restoreState(stateFile);
+   }
 }
 
 void ClientState::restoreProjectState(const FilePath& stateFile)
 {
    if (stateFile.extension() == kProjPersistentExt)
-      restoreState(stateFile, &projectPersistentState_);
+      restoreState(stateFile);
+}
+
+void ClientState::restoreState(const FilePath& stateFile)
+{
+   // read the contents of the file (these are parsed on first use)
+   std::string contents ;
+   Error error = readStringFromFile(stateFile, &contents);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return;
+   }
+
+   unparsedState_.push_back(std::make_pair(stateFile, contents));
+   writtenState_[stateFile.absolutePath()] = contents;
+}
+
+void ClientState::ensureParsed() const
+{
+   typedef std::pair<FilePath,std::string> UnparsedState;
+   BOOST_FOREACH(const UnparsedState& state, unparsedState_)
+   {
+      const FilePath& stateFile = state.first;
+      if (stateFile.extension() == kTemporaryExt)
+         parseState(stateFile, state.second, &temporaryState_);
+      else if (stateFile.extension() == kPersistentExt)
+         parseState(stateFile, state.second, &persistentState_);
+      else if (stateFile.extension() == kProjPersistentExt)
+         parseState(stateFile, state.second, &projectPersistentState_);
+   }
+   unparsedState_.clear();
 }
    
 void ClientState::clear()  
@@ -199,6 +264,7 @@ void ClientState::clear()
    temporaryState_.clear();
    persistentState_.clear();
    projectPersistentState_.clear();
+   unparsedState_.clear();
 }
  
 void ClientState::putTemporary(const std::string& scope, 
@@ -212,6 +278,7 @@ void ClientState::putTemporary(const std::string& scope,
    
 void ClientState::putTemporary(const json::Object& temporaryState)
 {
+   ensureParsed();
    mergeState(temporaryState, &temporaryState_);
 }
 
@@ -226,6 +293,7 @@ void ClientState::putPersistent(const std::string& scope,
 
 void ClientState::putPersistent(const json::Object& persistentState)
 {
+   ensureParsed();
    mergeState(persistentState, &persistentState_);
 }
 
@@ -241,6 +309,7 @@ void ClientState::putProjectPersistent(const std::string& scope,
 void ClientState::putProjectPersistent(
                               const json::Object& projectPersistentState)
 {
+   ensureParsed();
    mergeState(projectPersistentState, &projectPersistentState_);
 }
 
@@ -249,23 +318,33 @@ Error ClientState::commit(ClientStateCommitType commitType,
                           const core::FilePath& stateDir,
                           const core::FilePath& projectStateDir)
 {
-   // remove and re-create the stateDirs
-   Error error = removeAndRecreateStateDir(stateDir);
+   ensureParsed();
+
+   // ensure the stateDirs exist
+   Error error = stateDir.ensureDirectory();
    if (error)
       return error;
-   error = removeAndRecreateStateDir(projectStateDir);
+   error = projectStateDir.ensureDirectory();
    if (error)
       return error;
 
    // always commit persistent state
-   commitState(persistentState_, kPersistentExt, stateDir);
-   commitState(projectPersistentState_, kProjPersistentExt, projectStateDir);
+   std::set<std::string> committedFiles;
+   commitState(persistentState_, kPersistentExt, stateDir,
+               &writtenState_, &committedFiles);
+   commitState(projectPersistentState_, kProjPersistentExt, projectStateDir,
+               &writtenState_, &committedFiles);
   
    // commit all state if requested
    if (commitType == ClientStateCommitAll)
-      commitState(temporaryState_, kTemporaryExt, stateDir);
+      commitState(temporaryState_, kTemporaryExt, stateDir,
+                  &writtenState_, &committedFiles);
    else
       temporaryState_.clear();
+
+   // remove anything else (e.g. scopes which no longer exist)
+   removeStaleStateFiles(stateDir, committedFiles, &writtenState_);
+   removeStaleStateFiles(projectStateDir, committedFiles, &writtenState_);
    
    return Success();
 }
@@ -292,6 +371,8 @@ Error ClientState::restore(const FilePath& stateDir,
 // generate current state by merging temporary and persistent states
 void ClientState::currentState(json::Object* pCurrentState) const
 {
+   ensureParsed();
+
    // start with copy of persistent state
    pCurrentState->clear();
    pCurrentState->insert(persistentState_.begin(), persistentState_.end());
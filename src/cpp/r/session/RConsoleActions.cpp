@@ -21,7 +21,9 @@
 #include <core/Error.hpp>
 #include <core/FilePath.hpp>
 #include <core/FileSerializer.hpp>
+#include <core/StringUtils.hpp>
 #include <core/Thread.hpp>
+#include <core/system/System.hpp>
 
 using namespace core ;
 
@@ -31,6 +33,11 @@ namespace session {
 namespace {   
 const char * const kActionType = "type";
 const char * const kActionData = "data";
+const char * const kActionsId = "id";
+const char * const kActionsFirstSequence = "first";
+
+// largest single output action retained
+const std::size_t kMaxActionSize = 1024 * 1024;
 }
    
 ConsoleActions& consoleActions()
@@ -40,6 +47,7 @@ ConsoleActions& consoleActions()
 }
    
 ConsoleActions::ConsoleActions()
+   : id_(core::system::generateUuid()), firstSequence_(0), sealedSequence_(0)
 {
    setCapacity(1000);
 }
@@ -66,27 +74,62 @@ void ConsoleActions::setCapacity(int capacity)
    END_LOCK_MUTEX
 }
    
+std::size_t ConsoleActions::memoryUsage() const
+{
+   LOCK_MUTEX(mutex_)
+   {
+      std::size_t bytes = 0;
+      for (std::size_t i = 0; i < actionsData_.size(); i++)
+         bytes += json::estimatedSize(actionsData_[i]);
+      bytes += actionsType_.capacity() * sizeof(json::Value);
+      return bytes;
+   }
+   END_LOCK_MUTEX
+
+   // keep compiler happy
+   return 0;
+}
+
 void ConsoleActions::add(int type, const std::string& data)
 {
    LOCK_MUTEX(mutex_)
    {
-      // automatically combine consecutive output actions (up to 512 bytes)
-      // we enforce a limit so that the limit defined for our circular buffer
-      // (see setCapacity above) implies a content size limit as well (if we
-      // didn't cap the size of combined output then the output actions could
-      // grow to arbitrary size)
-      if (type == kConsoleActionOutput &&
+      // automatically combine consecutive output (or error) actions (up
+      // to 512 bytes) we enforce a limit so that the limit defined for our
+      // circular buffer (see setCapacity above) implies a content size limit
+      // as well (if we didn't cap the size of combined output then the
+      // output actions could grow to arbitrary size)
+      bool isOutput = type == kConsoleActionOutput ||
+                      type == kConsoleActionOutputError;
+      int lastSequence = firstSequence_ + (int)actionsType_.size() - 1;
+      if (isOutput &&
           actionsType_.size() > 0      &&
-          actionsType_.back().get_value<int>() == kConsoleActionOutput &&
+          lastSequence >= sealedSequence_ &&
+          actionsType_.back().get_value<int>() == type &&
           actionsData_.back().get_str().size() < 512)
       {
          actionsData_.back() = actionsData_.back().get_str() + data;
       }
       else
       {
+         if (actionsType_.full())
+            firstSequence_++;
          actionsType_.push_back(type);
          actionsData_.push_back(data);
       }
+
+      // a single write can still be arbitrarily large so keep no more of
+      // it than the console can show (this bounds the size of the
+      // scrollback which is sent to the client when it reconnects)
+      if (isOutput &&
+          actionsData_.back().get_str().size() > kMaxActionSize)
+      {
+         std::string trimmed = actionsData_.back().get_str();
+         string_utils::trimLeadingLines(actionsType_.capacity(), &trimmed);
+         if (trimmed.size() > kMaxActionSize)
+            trimmed.erase(0, trimmed.size() - kMaxActionSize);
+         actionsData_.back() = trimmed;
+      }
    }
    END_LOCK_MUTEX
 }
@@ -95,9 +138,13 @@ void ConsoleActions::reset()
 {
    LOCK_MUTEX(mutex_)
    {
-      // clear the existing actions
+      // clear the existing actions (as a new buffer so that clients
+      // discard the actions they have cached)
       actionsType_.clear();
       actionsData_.clear();
+      id_ = core::system::generateUuid();
+      firstSequence_ = 0;
+      sealedSequence_ = 0;
    }
    END_LOCK_MUTEX
 }
@@ -126,12 +173,54 @@ void ConsoleActions::asJson(json::Object* pActions) const
    END_LOCK_MUTEX
 }
 
+bool ConsoleActions::asJson(const std::string& cacheId,
+                            int cacheSequence,
+                            json::Object* pActions,
+                            std::string* pId,
+                            int* pNextSequence)
+{
+   LOCK_MUTEX(mutex_)
+   {
+      int nextSequence = firstSequence_ + (int)actionsType_.size();
+      bool delta = cacheId == id_ &&
+                   cacheSequence >= firstSequence_ &&
+                   cacheSequence <= nextSequence;
+      std::size_t offset = delta ? cacheSequence - firstSequence_ : 0;
+
+      pActions->clear();
+
+      json::Array actionsType;
+      std::copy(actionsType_.begin() + offset,
+                actionsType_.end(),
+                std::back_inserter(actionsType));
+      pActions->operator[](kActionType) = actionsType;
+
+      json::Array actionsData;
+      std::copy(actionsData_.begin() + offset,
+                actionsData_.end(),
+                std::back_inserter(actionsData));
+      pActions->operator[](kActionData) = actionsData;
+
+      *pId = id_;
+      *pNextSequence = nextSequence;
+      sealedSequence_ = nextSequence;
+      return delta;
+   }
+   END_LOCK_MUTEX
+
+   // keep compiler happy
+   return false;
+}
+
 Error ConsoleActions::loadFromFile(const FilePath& filePath)
 {
    LOCK_MUTEX(mutex_)
    {
       actionsType_.clear();
       actionsData_.clear();
+      id_ = core::system::generateUuid();
+      firstSequence_ = 0;
+      sealedSequence_ = 0;
 
       if (filePath.exists())
       {
@@ -148,6 +237,15 @@ Error ConsoleActions::loadFromFile(const FilePath& filePath)
          {
             json::Object& actions = value.get_obj();
 
+            // files written by earlier versions have no id or sequence
+            // (in which case clients will get a full copy of the actions)
+            const json::Value& idValue = actions[kActionsId];
+            if (idValue.type() == json::StringType)
+               id_ = idValue.get_str();
+            const json::Value& firstValue = actions[kActionsFirstSequence];
+            if (firstValue.type() == json::IntegerType)
+               firstSequence_ = firstValue.get_int();
+
             const json::Value& typeValue = actions[kActionType] ;
             if (typeValue.type() == json::ArrayType)
             {
@@ -179,6 +277,9 @@ Error ConsoleActions::loadFromFile(const FilePath& filePath)
             LOG_WARNING_MESSAGE("unexpected json type in: " + actionsJson);
          }
       }
+
+      // clients may already have cached the actions we loaded
+      sealedSequence_ = firstSequence_ + (int)actionsType_.size();
    }
    END_LOCK_MUTEX
    
@@ -187,9 +288,16 @@ Error ConsoleActions::loadFromFile(const FilePath& filePath)
    
 Error ConsoleActions::saveToFile(const core::FilePath& filePath) const
 {
-   // write actions
+   // write actions (along with the id and sequence of the buffer so clients
+   // which have cached them can still get just the newer actions)
    json::Object actionsObject;
    asJson(&actionsObject);
+   LOCK_MUTEX(mutex_)
+   {
+      actionsObject[kActionsId] = id_;
+      actionsObject[kActionsFirstSequence] = firstSequence_;
+   }
+   END_LOCK_MUTEX
    std::ostringstream ostr ;
    json::writeFormatted(actionsObject, ostr);
    
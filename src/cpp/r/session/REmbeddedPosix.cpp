@@ -29,6 +29,10 @@
 
 #include <Rembedded.h>
 
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
 #ifdef __APPLE__
 #include <dlfcn.h>
 extern "C" void R_ProcessEvents(void);
@@ -176,6 +180,70 @@ void polledEventHandler()
       s_oldPolledEventHandler();
 }
 
+// self-pipe registered as an R input handler so that other threads can
+// wake R's event loop (e.g. when it is blocked in select during Sys.sleep)
+const int kWakeupActivity = 74;
+int s_wakeupPipe[2] = { -1, -1 };
+InputHandler* s_pWakeupHandler = NULL;
+
+void onWakeup(void*)
+{
+   char buffer[256];
+   while (::read(s_wakeupPipe[0], buffer, sizeof(buffer)) > 0)
+   {
+   }
+
+   // R only calls R_PolledEvents when there was no input activity
+   polledEventHandler();
+}
+
+Error setNonBlockingCloseOnExec(int fd)
+{
+   int flags = ::fcntl(fd, F_GETFL);
+   if (flags == -1 || ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1)
+      return systemError(errno, ERROR_LOCATION);
+
+   flags = ::fcntl(fd, F_GETFD);
+   if (flags == -1 || ::fcntl(fd, F_SETFD, flags | FD_CLOEXEC) == -1)
+      return systemError(errno, ERROR_LOCATION);
+
+   return Success();
+}
+
+void closeWakeupPipe()
+{
+   for (int i = 0; i < 2; i++)
+   {
+      if (s_wakeupPipe[i] != -1)
+      {
+         ::close(s_wakeupPipe[i]);
+         s_wakeupPipe[i] = -1;
+      }
+   }
+}
+
+Error initializeWakeup()
+{
+   if (::pipe(s_wakeupPipe) == -1)
+      return systemError(errno, ERROR_LOCATION);
+
+   for (int i = 0; i < 2; i++)
+   {
+      Error error = setNonBlockingCloseOnExec(s_wakeupPipe[i]);
+      if (error)
+      {
+         closeWakeupPipe();
+         return error;
+      }
+   }
+
+   s_pWakeupHandler = ::addInputHandler(R_InputHandlers,
+                                        s_wakeupPipe[0],
+                                        onWakeup,
+                                        kWakeupActivity);
+   return Success();
+}
+
 
 #ifdef __APPLE__
 
@@ -320,9 +388,23 @@ void initializePolledEventHandler(void (*newPolledEventHandler)(void))
    s_oldPolledEventHandler = R_PolledEvents;
    R_PolledEvents = polledEventHandler;
 
-   // set R_wait_usec
-   if (R_wait_usec > 10000 || R_wait_usec == 0)
-      R_wait_usec = 10000;
+   // register the wakeup input handler. since input handlers wake R
+   // immediately we can use a more relaxed R_wait_usec (matching the
+   // interval at which the session performs background processing)
+   // rather than waking 100 times per second
+   Error error = initializeWakeup();
+   if (!error)
+   {
+      if (R_wait_usec > 50000 || R_wait_usec == 0)
+         R_wait_usec = 50000;
+   }
+   else
+   {
+      LOG_ERROR(error);
+
+      if (R_wait_usec > 10000 || R_wait_usec == 0)
+         R_wait_usec = 10000;
+   }
 }
 
 // NOTE: this call is used in child process after multicore forks
@@ -339,6 +421,15 @@ void permanentlyDisablePolledEventHandler()
 {
    s_polledEventHandler = NULL;
    s_oldPolledEventHandler = NULL;
+
+   // the wakeup pipe is shared with the parent after a fork so make
+   // sure we don't consume its wakeups
+   if (s_pWakeupHandler != NULL)
+   {
+      ::removeInputHandler(&R_InputHandlers, s_pWakeupHandler);
+      s_pWakeupHandler = NULL;
+   }
+   closeWakeupPipe();
 }
 
 bool polledEventHandlerInitialized()
@@ -346,6 +437,18 @@ bool polledEventHandlerInitialized()
    return s_polledEventHandler != NULL;
 }
 
+void wakeup()
+{
+   int fd = s_wakeupPipe[1];
+   if (fd == -1)
+      return;
+
+   // a full pipe already guarantees a wakeup so EAGAIN is fine
+   char ch = 0;
+   if (::write(fd, &ch, 1) == -1 && errno != EAGAIN)
+      LOG_ERROR(systemError(errno, ERROR_LOCATION));
+}
+
 void processEvents()
 {
 #ifdef __APPLE__
@@ -256,6 +256,12 @@ bool polledEventHandlerInitialized()
    return s_polledEventHandler != NULL;
 }
 
+void wakeup()
+{
+   // R on windows has no input handlers to wake (the polled event handler
+   // is called back from R_ProcessEvents) so there is nothing to do
+}
+
 void processEvents()
 {
    R_ProcessEvents();
@@ -25,21 +25,35 @@
 #include <vector>
 #include <algorithm>
 
+#include <map>
+#include <set>
+#include <deque>
+
 #include <boost/bind.hpp>
 #include <boost/function.hpp>
 #include <boost/format.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/algorithm/string/predicate.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
 
 #include <core/Log.hpp>
+#include <core/Hash.hpp>
 #include <core/Error.hpp>
+#include <core/Thread.hpp>
 #include <core/FilePath.hpp>
+#include <core/BoostThread.hpp>
 #include <core/SafeConvert.hpp>
+#include <core/StringUtils.hpp>
 #include <core/FileSerializer.hpp>
 
+#include <core/json/Json.hpp>
+
 #define R_INTERNAL_FUNCTIONS
 #include <r/RInternal.hpp>
 #include <r/RExec.hpp>
+#include <r/RSexp.hpp>
 #include <r/RInterface.hpp>
 
 using namespace core ;
@@ -60,6 +74,19 @@ const char * const kSearchPathElementsDir = "search_path_elements";
 const char * const kPackagePaths = "package_paths";
 const char * const kEnvDataDir = "environment_data";
 
+// the global environment is saved one object per file (named by a hash of
+// the serialized object) plus an index of object names to files. objects
+// which haven't changed since the last save are therefore not rewritten
+const char * const kEnvironmentObjectsDir = "environment_objects";
+const char * const kEnvironmentObjectsIndex = "INDEX";
+
+// objects larger than this are saved directly by R rather than being
+// serialized into memory (buffering them would double memory usage)
+const double kMaxBufferedObjectSize = 256.0 * 1024 * 1024;
+
+// limit on the serialized bytes waiting to be compressed and written
+const std::size_t kMaxPendingBytes = 512 * 1024 * 1024;
+
 void reportRestoreError(const std::string& context, 
                         const Error& error,
                         const ErrorLocation& location)
@@ -79,13 +106,392 @@ void reportRestoreError(const std::string& context,
    REprintf(report.c_str());
 }   
    
+// objects restored lazily which haven't been accessed yet
+struct DeferredObject
+{
+   DeferredObject() : promiseSEXP(R_NilValue) {}
+   DeferredObject(SEXP promiseSEXP, const std::string& filename)
+      : promiseSEXP(promiseSEXP), filename(filename)
+   {
+   }
+
+   // (the promise is protected by its binding in the global environment,
+   // we only compare against it)
+   SEXP promiseSEXP;
+   std::string filename;
+};
+std::map<std::string, DeferredObject> s_deferredObjects;
+
+bool isUnforcedPromise(SEXP valueSEXP)
+{
+   return TYPEOF(valueSEXP) == PROMSXP && PRVALUE(valueSEXP) == R_UnboundValue;
+}
+
+// returns the file a lazily restored object can still be read from (or an
+// empty string if the object has since been accessed or reassigned)
+std::string deferredObjectFilename(const std::string& name)
+{
+   std::map<std::string, DeferredObject>::const_iterator it =
+                                                s_deferredObjects.find(name);
+   if (it == s_deferredObjects.end())
+      return std::string();
+
+   // look up the binding without forcing it
+   SEXP valueSEXP = Rf_findVarInFrame(R_GlobalEnv, Rf_install(name.c_str()));
+   if (valueSEXP != it->second.promiseSEXP || !isUnforcedPromise(valueSEXP))
+      return std::string();
+
+   return it->second.filename;
+}
+
+// force any lazily restored objects (required before the environment is
+// saved somewhere other than the objects directory)
+void forceDeferredObjects()
+{
+   for (std::map<std::string, DeferredObject>::const_iterator it =
+           s_deferredObjects.begin(); it != s_deferredObjects.end(); ++it)
+   {
+      if (!deferredObjectFilename(it->first).empty())
+      {
+         Error error = RFunction(".rs.forceGlobalObject", it->first).call();
+         if (error)
+            LOG_ERROR(error);
+      }
+   }
+   s_deferredObjects.clear();
+}
+
 Error saveGlobalEnvironmentToFile(const FilePath& environmentFile)
 {
+   forceDeferredObjects();
+
    std::string envPath =
             string_utils::utf8ToSystem(environmentFile.absolutePath());
    return executeSafely(boost::bind(R_SaveGlobalEnvToFile, envPath.c_str()));
 }
    
+// compresses and writes serialized objects on background threads (so
+// that R can continue serializing the next object)
+class ObjectWriter : boost::noncopyable
+{
+public:
+   explicit ObjectWriter(int threads)
+      : pendingBytes_(0), stopping_(false)
+   {
+      for (int i = 0; i < threads; i++)
+      {
+         boost::shared_ptr<boost::thread> pThread(new boost::thread());
+         core::thread::safeLaunchThread(boost::bind(&ObjectWriter::run, this),
+                                        pThread.get());
+         threads_.push_back(pThread);
+      }
+   }
+
+   virtual ~ObjectWriter()
+   {
+      try
+      {
+         finish();
+      }
+      catch(...)
+      {
+      }
+   }
+
+   // COPYING: boost::noncopyable
+
+   // queue a write (blocks while too many bytes are pending)
+   void write(const FilePath& filePath,
+              const boost::shared_ptr<std::string>& pData)
+   {
+      // write synchronously if no threads could be launched
+      if (threads_.empty() || !threads_[0]->joinable())
+      {
+         Error error = writeCompressed(filePath, *pData);
+         if (error && !error_)
+            error_ = error;
+         return;
+      }
+
+      boost::unique_lock<boost::mutex> lock(mutex_);
+      while (pendingBytes_ > kMaxPendingBytes)
+         condition_.wait(lock);
+      pendingBytes_ += pData->size();
+      queue_.push_back(std::make_pair(filePath, pData));
+      condition_.notify_all();
+   }
+
+   // wait for all writes to complete (returns the first error, if any)
+   Error finish()
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         stopping_ = true;
+      }
+      END_LOCK_MUTEX
+      condition_.notify_all();
+
+      for (std::size_t i = 0; i < threads_.size(); i++)
+      {
+         if (threads_[i]->joinable())
+            threads_[i]->join();
+      }
+      threads_.clear();
+
+      return error_;
+   }
+
+private:
+   void run()
+   {
+      try
+      {
+         while (true)
+         {
+            std::pair<FilePath, boost::shared_ptr<std::string> > write;
+            {
+               boost::unique_lock<boost::mutex> lock(mutex_);
+               while (queue_.empty() && !stopping_)
+                  condition_.wait(lock);
+               if (queue_.empty())
+                  return;
+               write = queue_.front();
+               queue_.pop_front();
+            }
+
+            Error error = writeCompressed(write.first, *write.second);
+
+            LOCK_MUTEX(mutex_)
+            {
+               pendingBytes_ -= write.second->size();
+               if (error && !error_)
+                  error_ = error;
+            }
+            END_LOCK_MUTEX
+            condition_.notify_all();
+         }
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
+   static Error writeCompressed(const FilePath& filePath,
+                                const std::string& data)
+   {
+      // write to a temporary file and then move it into place so that
+      // partially written objects are never referenced
+      FilePath tempPath(filePath.absolutePath() + ".tmp");
+      boost::shared_ptr<std::ostream> pOfs;
+      Error error = tempPath.open_w(&pOfs);
+      if (error)
+         return error;
+
+      try
+      {
+         // favor speed over size (readRDS handles gzip transparently)
+         using namespace boost::iostreams;
+         filtering_ostream out;
+         out.push(gzip_compressor(gzip_params(gzip::best_speed)));
+         out.push(*pOfs);
+         out.write(data.data(), data.size());
+         out.reset();
+         pOfs->flush();
+         if (!pOfs->good())
+            return systemError(boost::system::errc::io_error, ERROR_LOCATION);
+      }
+      catch(const std::exception& e)
+      {
+         Error error = systemError(boost::system::errc::io_error,
+                                   ERROR_LOCATION);
+         error.addProperty("what", e.what());
+         error.addProperty("path", tempPath.absolutePath());
+         return error;
+      }
+      pOfs.reset();
+
+      return tempPath.move(filePath);
+   }
+
+private:
+   boost::mutex mutex_;
+   boost::condition condition_;
+   std::deque<std::pair<FilePath, boost::shared_ptr<std::string> > > queue_;
+   std::size_t pendingBytes_;
+   bool stopping_;
+   Error error_;
+   std::vector<boost::shared_ptr<boost::thread> > threads_;
+};
+
+Error saveGlobalObject(const std::string& name,
+                       const FilePath& objectsDir,
+                       ObjectWriter* pWriter,
+                       std::string* pFilename)
+{
+   // serialize the object (on this thread, R isn't thread safe)
+   SEXP serializedSEXP;
+   r::sexp::Protect rProtect;
+   Error error = RFunction(".rs.serializeGlobalObject",
+                           name,
+                           kMaxBufferedObjectSize).call(&serializedSEXP,
+                                                        &rProtect);
+   if (error)
+      return error;
+
+   if (TYPEOF(serializedSEXP) == RAWSXP)
+   {
+      // unchanged objects will already have been written
+      boost::shared_ptr<std::string> pData(new std::string(
+                  reinterpret_cast<const char*>(RAW(serializedSEXP)),
+                  Rf_length(serializedSEXP)));
+      *pFilename = hash::xxHash64(*pData) + ".rds";
+      FilePath objectPath = objectsDir.complete(*pFilename);
+      if (!objectPath.exists())
+         pWriter->write(objectPath, pData);
+      return Success();
+   }
+   else
+   {
+      // too large to buffer so have R write it
+      *pFilename = "L" + hash::xxHash64(name) + ".rds";
+      FilePath objectPath = objectsDir.complete(*pFilename);
+      return RFunction(".rs.saveGlobalObject",
+                       name,
+                       string_utils::utf8ToSystem(
+                             objectPath.absolutePath())).call();
+   }
+}
+
+Error saveGlobalEnvironmentObjects(const FilePath& objectsDir)
+{
+   Error error = objectsDir.ensureDirectory();
+   if (error)
+      return error;
+
+   std::vector<std::string> names;
+   RFunction lsFunction("ls");
+   lsFunction.addParam("envir", R_GlobalEnv);
+   lsFunction.addParam("all.names", true);
+   error = lsFunction.call(&names);
+   if (error)
+      return error;
+
+   int threads = std::max(1,
+                     static_cast<int>(boost::thread::hardware_concurrency()));
+   ObjectWriter writer(threads);
+
+   json::Object indexJson;
+   std::set<std::string> filenames;
+   for (std::vector<std::string>::const_iterator it = names.begin();
+        it != names.end();
+        ++it)
+   {
+      // objects which were lazily restored and never accessed are unchanged
+      std::string filename = deferredObjectFilename(*it);
+      if (filename.empty() || !objectsDir.complete(filename).exists())
+      {
+         error = saveGlobalObject(*it, objectsDir, &writer, &filename);
+         if (error)
+            return error;
+      }
+
+      indexJson[*it] = filename;
+      filenames.insert(filename);
+   }
+
+   error = writer.finish();
+   if (error)
+      return error;
+
+   // write the index (atomically, it is what makes the new objects live)
+   FilePath indexPath = objectsDir.complete(kEnvironmentObjectsIndex);
+   FilePath indexTempPath = objectsDir.complete(
+                              std::string(kEnvironmentObjectsIndex) + ".tmp");
+   std::ostringstream ostr;
+   json::write(indexJson, ostr);
+   filenames.insert(kEnvironmentObjectsIndex);
+   error = writeStringToFile(indexTempPath, ostr.str());
+   if (error)
+      return error;
+   error = indexTempPath.move(indexPath);
+   if (error)
+      return error;
+
+   // remove objects which are no longer referenced
+   std::vector<FilePath> children;
+   error = objectsDir.children(&children);
+   if (error)
+      return error;
+   for (std::vector<FilePath>::const_iterator it = children.begin();
+        it != children.end();
+        ++it)
+   {
+      if (filenames.count(it->filename()) == 0)
+      {
+         Error error = it->removeIfExists();
+         if (error)
+            LOG_ERROR(error);
+      }
+   }
+
+   return Success();
+}
+
+Error restoreGlobalEnvironmentObjects(const FilePath& objectsDir,
+                                      bool lazyLoad)
+{
+   std::string index;
+   Error error = readStringFromFile(
+                     objectsDir.complete(kEnvironmentObjectsIndex), &index);
+   if (error)
+      return error;
+
+   json::Value indexJson;
+   if (!json::parse(index, &indexJson) ||
+       indexJson.type() != json::ObjectType)
+   {
+      return systemError(boost::system::errc::protocol_error, ERROR_LOCATION);
+   }
+
+   std::vector<std::string> names, filenames;
+   const json::Object& indexObject = indexJson.get_obj();
+   for (json::Object::const_iterator it = indexObject.begin();
+        it != indexObject.end();
+        ++it)
+   {
+      if (it->second.type() != json::StringType)
+         continue;
+
+      names.push_back(it->first);
+      filenames.push_back(string_utils::utf8ToSystem(
+            objectsDir.complete(it->second.get_str()).absolutePath()));
+   }
+
+   s_deferredObjects.clear();
+   error = RFunction(".rs.restoreGlobalObjects",
+                     names,
+                     filenames,
+                     lazyLoad).call();
+   if (error)
+      return error;
+
+   // note the promises created so they can be recognized when saving
+   if (lazyLoad)
+   {
+      for (std::size_t i = 0; i < names.size(); i++)
+      {
+         SEXP valueSEXP = Rf_findVarInFrame(R_GlobalEnv,
+                                            Rf_install(names[i].c_str()));
+         if (isUnforcedPromise(valueSEXP))
+         {
+            s_deferredObjects[names[i]] = DeferredObject(
+                  valueSEXP,
+                  indexObject.find(names[i])->second.get_str());
+         }
+      }
+   }
+
+   return Success();
+}
+
 Error restoreGlobalEnvironment(const core::FilePath& environmentFile)
 {
    // tolerate no environment saved
@@ -227,11 +633,16 @@ void attachEnvironmentData(const FilePath& dataFilePath,
 
 Error save(const FilePath& statePath)
 {
-   // save the global environment
-   FilePath environmentFile = statePath.complete(kEnvironmentFile);
-   Error error = saveGlobalEnvironmentToFile(environmentFile);
+   // save the global environment (incrementally)
+   Error error = saveGlobalEnvironmentObjects(
+                              statePath.complete(kEnvironmentObjectsDir));
    if (error)
       return error;
+
+   // remove any environment file saved by saveGlobalEnvironment
+   error = statePath.complete(kEnvironmentFile).removeIfExists();
+   if (error)
+      LOG_ERROR(error);
    
    // reset the contents of the search path dir
    FilePath searchPathDir = statePath.complete(kSearchPathDir);
@@ -322,14 +733,25 @@ Error save(const FilePath& statePath)
 Error saveGlobalEnvironment(const FilePath& statePath)
 {
    FilePath environmentFile = statePath.complete(kEnvironmentFile);
-   return saveGlobalEnvironmentToFile(environmentFile);
+   Error error = saveGlobalEnvironmentToFile(environmentFile);
+   if (error)
+      return error;
+
+   // the environment file supersedes any saved objects (the objects are
+   // left in place as they may be reused by the next incremental save)
+   return statePath.complete(kEnvironmentObjectsDir)
+                   .complete(kEnvironmentObjectsIndex).removeIfExists();
 }
 
-Error restore(const FilePath& statePath)
+Error restore(const FilePath& statePath, bool lazyLoadEnvironment)
 {
    // restore global environment
-   FilePath environmentFile = statePath.complete(kEnvironmentFile);
-   Error error = restoreGlobalEnvironment(environmentFile);
+   Error error;
+   FilePath objectsDir = statePath.complete(kEnvironmentObjectsDir);
+   if (objectsDir.complete(kEnvironmentObjectsIndex).exists())
+      error = restoreGlobalEnvironmentObjects(objectsDir, lazyLoadEnvironment);
+   else
+      error = restoreGlobalEnvironment(statePath.complete(kEnvironmentFile));
    if (error)
       return error;
    
@@ -27,7 +27,11 @@ namespace search_path {
 
 core::Error save(const core::FilePath& statePath);
 core::Error saveGlobalEnvironment(const core::FilePath& statePath);
-core::Error restore(const core::FilePath& statePath);
+
+// if lazyLoadEnvironment is true then objects in the global environment
+// are restored as promises which read the object when first accessed (so
+// the state must remain in place for the lifetime of the session)
+core::Error restore(const core::FilePath& statePath, bool lazyLoadEnvironment);
    
 } // namespace search_path
 } // namespace session
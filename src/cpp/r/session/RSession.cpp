@@ -18,6 +18,12 @@
 
 #include <iostream>
 
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
 #include <boost/regex.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/replace.hpp>
@@ -105,6 +111,27 @@ bool s_initialized = false;
 // are in the middle of servicing a suspend request?
 bool s_suspended = false;
 
+#ifndef _WIN32
+// child process saving the session state for a background suspend (and
+// whether the session has been active since it was forked)
+pid_t s_suspendChildPid = -1;
+bool s_suspendChildStale = false;
+#endif
+
+// wait for any background suspend to finish writing the session state
+void waitForBackgroundSuspend()
+{
+#ifndef _WIN32
+   if (s_suspendChildPid != -1)
+   {
+      int status = 0;
+      if (::waitpid(s_suspendChildPid, &status, 0) == -1)
+         LOG_ERROR(systemError(errno, ERROR_LOCATION));
+      s_suspendChildPid = -1;
+   }
+#endif
+}
+
 // temporarily suppress output
 bool s_suppressOuput = false;
 
@@ -340,6 +367,7 @@ const int kSerializationActionResumeSession = 4;
 const int kSerializationActionCompleted = 5;
 
 void restoreSession(const FilePath& suspendedSessionPath,
+                    bool lazyLoadEnvironment,
                     std::string* pErrorMessages)
 {
    // don't show output during deserialization (packages loaded
@@ -354,6 +382,7 @@ void restoreSession(const FilePath& suspendedSessionPath,
    boost::function<Error()> deferredRestoreAction;
    r::session::state::restore(suspendedSessionPath,
                               s_options.serverMode,
+                              lazyLoadEnvironment,
                               &deferredRestoreAction,
                               pErrorMessages);
 
@@ -365,6 +394,33 @@ void restoreSession(const FilePath& suspendedSessionPath,
    }
 }
 
+// load the user's profile the way R does at startup (used by restart
+// zygotes, which start R without it)
+void loadUserProfile()
+{
+   FilePath profilePath;
+   std::string profileUser = core::system::getenv("R_PROFILE_USER");
+   if (!profileUser.empty())
+   {
+      profilePath = FilePath(profileUser);
+   }
+   else
+   {
+      profilePath = FilePath::safeCurrentPath(s_options.userHomePath)
+                                                      .complete(".Rprofile");
+      if (!profilePath.exists())
+         profilePath = s_options.userHomePath.complete(".Rprofile");
+   }
+
+   if (!profilePath.exists())
+      return;
+
+   std::string path = string_utils::utf8ToSystem(profilePath.absolutePath());
+   Error error = r::exec::RFunction("source", path).call();
+   if (error)
+      reportAndLogWarning(r::endUserErrorMessage(error));
+}
+
 // one-time per session initialization
 Error initialize()
 {
@@ -383,12 +439,30 @@ Error initialize()
    // initialize console history capacity
    r::session::consoleHistory().setCapacityFromRHistsize();
 
-   // install R tools
+   // install R tools (byte-compiling them into the user scratch path)
+   r::sourceManager().setToolsCachePath(
+                        s_options.userScratchPath.complete("compiled-tools"));
    FilePath toolsFilePath = s_options.rSourcePath.complete("Tools.R");
    Error error = r::sourceManager().sourceTools(toolsFilePath);
    if (error)
       return error ;
 
+   // a restart zygote waits here (with R and the tools loaded but before
+   // any session state or user code) until its session restarts
+   if (s_options.restartZygote)
+   {
+      if (!s_callbacks.waitForRestart())
+      {
+         R_CleanTempDir();
+         ::_exit(EXIT_SUCCESS);
+      }
+
+      restartContext().initialize(s_options.scopedScratchPath,
+                                  s_options.sessionPort);
+      if (restartContext().rProfileOnRestore())
+         loadUserProfile();
+   }
+
    // initialize graphics device -- use a stable directory for server mode
    // and temp directory for desktop mode (so that we can support multiple
    // concurrent processes using the same project)
@@ -421,9 +495,12 @@ Error initialize()
    // first check for a pending restart
    if (restartContext().hasSessionState())
    {
-      // restore session
+      // restore session (the restart state is removed once init
+      // completes so the environment can't be lazily loaded from it)
       std::string errorMessages ;
-      restoreSession(restartContext().sessionStatePath(), &errorMessages);
+      restoreSession(restartContext().sessionStatePath(),
+                     false,
+                     &errorMessages);
 
       // show any error messages
       if (!errorMessages.empty())
@@ -436,7 +513,7 @@ Error initialize()
    {  
       // restore session
       std::string errorMessages ;
-      restoreSession(s_suspendedSessionPath, &errorMessages);
+      restoreSession(s_suspendedSessionPath, true, &errorMessages);
       
       // show any error messages
       if (!errorMessages.empty())
@@ -1182,6 +1259,7 @@ void RCleanUp(SA_TYPE saveact, int status, int runLast)
          // data loss when the previous session is read rather than the
          // contents of .RData. therefore, we refuse to quit if we can't
          // successfully destroy the suspended session
+         waitForBackgroundSuspend();
          if (!r::session::state::destroy(s_suspendedSessionPath))
          {
             // this will cause us to jump back to the REPL loop
@@ -1368,6 +1446,14 @@ Error run(const ROptions& options, const RCallbacks& callbacks)
    bool quiet = restartContext().hasSessionState() ||
                 s_suspendedSessionPath.exists();
 
+   // a restart zygote loads the profile (if required) once it knows
+   // whether the restarting session wants it
+   if (s_options.restartZygote)
+   {
+      loadInitFile = false;
+      quiet = true;
+   }
+
    r::session::Callbacks cb;
    cb.showMessage = RShowMessage;
    cb.readConsole = RReadConsole;
@@ -1456,11 +1542,31 @@ bool isSuspendable(const std::string& currentPrompt)
 }
    
 
+namespace {
+
+void completeSuspend()
+{
+   // set suspended flag so cleanup code can act accordingly
+   s_suspended = true;
+
+   // call suspend hook
+   s_callbacks.suspended();
+
+   // clean up but don't save workspace or runLast because we have
+   // been suspended
+   RCleanUp(SA_NOSAVE, 0, FALSE);
+}
+
+} // anonymous namespace
+
 bool suspend(const RSuspendOptions& options,
              const FilePath& suspendedSessionPath,
              bool disableSaveCompression,
              bool force)
 {
+   // don't save state while a background suspend is writing it
+   waitForBackgroundSuspend();
+
    // validate that force == true if disableSaveCompression is specified
    // this is because save compression is disabled and the previous options
    // are not restored, so it is only suitable to use this when we know
@@ -1494,16 +1600,8 @@ bool suspend(const RSuspendOptions& options,
    // only continue with exiting the process if we actually succeed in saving
    if(suspend)
    {      
-      // set suspended flag so cleanup code can act accordingly
-      s_suspended = true;
-      
-      // call suspend hook
-      s_callbacks.suspended();
-   
-      // clean up but don't save workspace or runLast because we have
-      // been suspended
-      RCleanUp(SA_NOSAVE, 0, FALSE);
-      
+      completeSuspend();
+
       // keep compiler happy (this line will never execute)
       return true;
    }
@@ -1513,11 +1611,86 @@ bool suspend(const RSuspendOptions& options,
    }
 }
 
+namespace {
+
+#ifndef _WIN32
+
+// save the session state in a forked child (which serializes the copy on
+// write image of the workspace) so that the session remains responsive
+// while it is saved. once the child has saved the state we exit (if the
+// session was active in the meantime we instead save it again)
+bool suspendInBackground()
+{
+   if (s_suspendChildPid != -1)
+   {
+      int status = 0;
+      pid_t result = ::waitpid(s_suspendChildPid, &status, WNOHANG);
+      if (result == 0)
+         return true;
+      if (result == -1)
+         LOG_ERROR(systemError(errno, ERROR_LOCATION));
+
+      bool saved = result == s_suspendChildPid &&
+                   WIFEXITED(status) &&
+                   WEXITSTATUS(status) == EXIT_SUCCESS;
+      s_suspendChildPid = -1;
+
+      if (!saved)
+         return false;
+      else if (!s_suspendChildStale)
+      {
+         completeSuspend();
+         return true;
+      }
+   }
+
+   // commit client state here (it isn't part of the snapshot)
+   saveClientState(ClientStateCommitAll);
+
+   pid_t pid = ::fork();
+   if (pid == -1)
+   {
+      // fall back to suspending in the foreground
+      LOG_ERROR(systemError(errno, ERROR_LOCATION));
+      return suspend(RSuspendOptions(), s_suspendedSessionPath, false, false);
+   }
+   else if (pid == 0)
+   {
+      // child: save and exit without running any cleanup (the parent
+      // still owns the session)
+      bool saved = saveSessionState(RSuspendOptions(),
+                                    s_suspendedSessionPath,
+                                    false);
+      ::_exit(saved ? EXIT_SUCCESS : EXIT_FAILURE);
+   }
+
+   s_suspendChildPid = pid;
+   s_suspendChildStale = false;
+   return true;
+}
+
+#endif
+
+} // anonymous namespace
+
 bool suspend(bool force)
 {
+#ifndef _WIN32
+   if (!force)
+      return suspendInBackground();
+#endif
+
    return suspend(RSuspendOptions(), s_suspendedSessionPath, false, force);
 }
 
+void invalidateBackgroundSuspend()
+{
+#ifndef _WIN32
+   if (s_suspendChildPid != -1)
+      s_suspendChildStale = true;
+#endif
+}
+
 void suspendForRestart(const RSuspendOptions& options)
 {
    suspend(options,
@@ -417,10 +417,12 @@ bool rProfileOnRestore(const core::FilePath& statePath)
    return settings.getBool(kRProfileOnRestore, true);
 }
 
-Error deferredRestore(const FilePath& statePath, bool serverMode)
+Error deferredRestore(const FilePath& statePath,
+                      bool serverMode,
+                      bool lazyLoadEnvironment)
 {
    // search path
-   Error error = search_path::restore(statePath);
+   Error error = search_path::restore(statePath, lazyLoadEnvironment);
    if (error)
       return error;
 
@@ -442,6 +444,7 @@ Error deferredRestore(const FilePath& statePath, bool serverMode)
    
 bool restore(const FilePath& statePath,
              bool serverMode,
+             bool lazyLoadEnvironment,
              boost::function<Error()>* pDeferredRestoreAction,
              std::string* pErrorMessages)
 {
@@ -508,7 +511,9 @@ bool restore(const FilePath& statePath,
    // to bring their UI up and then receive an event indicating that the
    // latent deserialization actions are taking place
    *pDeferredRestoreAction = boost::bind(deferredRestore,
-                                             statePath, serverMode);
+                                         statePath,
+                                         serverMode,
+                                         lazyLoadEnvironment);
    
    // return true if there were no error messages
    return pErrorMessages->empty();
@@ -43,6 +43,7 @@ bool rProfileOnRestore(const core::FilePath& statePath);
 
 bool restore(const core::FilePath& statePath, 
              bool serverMode,
+             bool lazyLoadEnvironment,
              boost::function<core::Error()>* pDeferredRestoreAction,
              std::string* pErrorMessages); 
    
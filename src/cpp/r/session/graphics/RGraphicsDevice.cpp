@@ -31,6 +31,7 @@
 #include "RGraphicsUtils.hpp"
 #include "RGraphicsPlotManager.hpp"
 #include "RGraphicsHandler.hpp"
+#include "RGraphicsSvgRecorder.hpp"
 
 #include "config.h"
 
@@ -70,6 +71,25 @@ boost::function<bool(double*,double*)> s_locatorFunction;
 // global size attributes (used to initialize new devices)
 int s_width = 0;
 int s_height = 0;   
+
+// resizes of an active device are deferred until the requested size has
+// been stable for kResizeQuietPeriodMs (replaying the display list at
+// every intermediate size while e.g. a splitter is dragged is expensive)
+const int kResizeQuietPeriodMs = 250;
+bool s_resizePending = false;
+int s_pendingWidth = 0;
+int s_pendingHeight = 0;
+boost::posix_time::ptime s_resizeRequestTime;
+
+void takePendingSize()
+{
+   if (s_resizePending)
+   {
+      s_width = s_pendingWidth;
+      s_height = s_pendingHeight;
+      s_resizePending = false;
+   }
+}
    
 // provide GraphicsDeviceEvents for plot manager
 GraphicsDeviceEvents s_graphicsDeviceEvents;   
@@ -83,6 +103,7 @@ void GD_NewPage(const pGEcontext gc, pDevDesc dev)
 
    // delegate
    handler::newPage(gc, dev);
+   svg::newPage(s_width, s_height, gc);
 
    // fire event (pass previousPageSnapshot)
    SEXP previousPageSnapshot = s_pGEDevDesc->savedSnapshot;
@@ -132,6 +153,7 @@ void GD_Clip(double x0, double x1, double y0, double y1, pDevDesc dev)
    TRACE_GD_CALL
 
    handler::clip(x0, x1, y0, y1, dev);
+   svg::clip(x0, x1, y0, y1);
 }
 
 
@@ -145,6 +167,7 @@ void GD_Rect(double x0,
    TRACE_GD_CALL
 
    handler::rect(x0, y0, x1, y1, gc, dev);
+   svg::rect(x0, y0, x1, y1, gc);
 }
 
 void GD_Path(double *x,
@@ -158,6 +181,7 @@ void GD_Path(double *x,
    TRACE_GD_CALL
 
    handler::path(x, y, npoly, nper, winding, gc, dd);
+   svg::path(x, y, npoly, nper, winding, gc);
 }
 
 void GD_Raster(unsigned int *raster,
@@ -175,6 +199,7 @@ void GD_Raster(unsigned int *raster,
    TRACE_GD_CALL
 
    handler::raster(raster, w, h, x, y, width, height, rot, interpolate, gc, dd);
+   svg::raster();
 }
 
 SEXP GD_Cap(pDevDesc dd)
@@ -193,6 +218,7 @@ void GD_Circle(double x,
    TRACE_GD_CALL
 
    handler::circle(x, y, r, gc, dev);
+   svg::circle(x, y, r, gc);
 }
 
 void GD_Line(double x1,
@@ -205,6 +231,7 @@ void GD_Line(double x1,
    TRACE_GD_CALL
 
    handler::line(x1, y1, x2, y2, gc, dev);
+   svg::line(x1, y1, x2, y2, gc);
 }
 
 void GD_Polyline(int n,
@@ -216,6 +243,7 @@ void GD_Polyline(int n,
    TRACE_GD_CALL
 
    handler::polyline(n, x, y, gc, dev);
+   svg::polyline(n, x, y, gc);
 }
 
 void GD_Polygon(int n,
@@ -227,6 +255,7 @@ void GD_Polygon(int n,
    TRACE_GD_CALL
 
    handler::polygon(n, x, y, gc, dev);
+   svg::polygon(n, x, y, gc);
 }
 
 void GD_MetricInfo(int c,
@@ -266,6 +295,7 @@ void GD_Text(double x,
    TRACE_GD_CALL
 
    handler::text(x, y, str, rot, hadj, gc, dev);
+   svg::text(x, y, string_utils::systemToUtf8(str), rot, hadj, gc);
 }
 
 void GD_TextUTF8(double x,
@@ -279,6 +309,7 @@ void GD_TextUTF8(double x,
    TRACE_GD_CALL
 
    handler::text(x, y, str, rot, hadj, gc, dev);
+   svg::text(x, y, str, rot, hadj, gc);
 }
 
 
@@ -433,6 +464,9 @@ SEXP createGD()
       return R_NilValue;
    }
 
+   // create the device at the latest requested size
+   takePendingSize();
+
 
    R_CheckDeviceAvailable();
    
@@ -608,9 +642,12 @@ Error saveSnapshot(const core::FilePath& snapshotFile,
    if (error)
       return error;
 
-   // save png file
+   // save image file
    DeviceContext* pDC = (DeviceContext*)s_pGEDevDesc->dev->deviceSpecific;
-   return handler::writeToPNG(imageFile, pDC);
+   if (imageFile.extensionLowerCase() == ".svg")
+      return svg::writeToSVG(imageFile, boost::bind(handler::writeToPNG, _1, pDC));
+   else
+      return handler::writeToPNG(imageFile, pDC);
 }
 
 Error restoreSnapshot(const core::FilePath& snapshotFile)
@@ -633,11 +670,20 @@ void copyToActiveDevice()
    
 std::string imageFileExtension()
 {
-   return "png";
+   return svg::enabled() ? "svg" : "png";
+}
+
+bool applyDeferredResize()
+{
+   return applyPendingResize(
+               boost::posix_time::milliseconds(kResizeQuietPeriodMs));
 }
 
 void onBeforeExecute()
 {
+   // code about to be executed should see the current size
+   applyPendingResize(boost::posix_time::time_duration());
+
    if (s_pGEDevDesc != NULL)
    {
       DeviceContext* pDC = (DeviceContext*)s_pGEDevDesc->dev->deviceSpecific;
@@ -676,6 +722,7 @@ Error initialize(
    graphicsDevice.imageFileExtension = imageFileExtension;
    graphicsDevice.close = close;
    graphicsDevice.onBeforeExecute = onBeforeExecute;
+   graphicsDevice.applyPendingResize = applyDeferredResize;
    Error error = plotManager().initialize(graphicsPath,
                                           graphicsDevice,
                                           &s_graphicsDeviceEvents);
@@ -723,25 +770,55 @@ void setSize(int width, int height)
 {
    // only set if the values have changed (prevents unnecessary plot 
    // invalidations from occuring)
-   if ( width != s_width || height != s_height )
+   if ( width == getWidth() && height == getHeight() )
+      return;
+
+   // if there is no active device then just note the size
+   if (s_pGEDevDesc == NULL)
    {
       s_width = width;
       s_height = height;
-      
-      // if there is a device active sync its size
-      if (s_pGEDevDesc != NULL)
-         resizeGraphicsDevice();
+      s_resizePending = false;
+      return;
    }
+
+   // otherwise defer the resize (cancelling it if we are back to the
+   // current size)
+   s_pendingWidth = width;
+   s_pendingHeight = height;
+   s_resizePending = width != s_width || height != s_height;
+   s_resizeRequestTime = boost::posix_time::microsec_clock::universal_time();
+}
+
+bool applyPendingResize(const boost::posix_time::time_duration& quietPeriod)
+{
+   if (!s_resizePending)
+      return false;
+
+   // nothing to replay if the device has been closed
+   if (s_pGEDevDesc == NULL)
+   {
+      takePendingSize();
+      return false;
+   }
+
+   using namespace boost::posix_time;
+   if (microsec_clock::universal_time() - s_resizeRequestTime < quietPeriod)
+      return true;
+
+   takePendingSize();
+   resizeGraphicsDevice();
+   return false;
 }
    
 int getWidth()
 {
-   return s_width;
+   return s_resizePending ? s_pendingWidth : s_width;
 }
    
 int getHeight()
 {
-   return s_height;
+   return s_resizePending ? s_pendingHeight : s_height;
 }
    
 void close()
@@ -17,6 +17,7 @@
 #define R_SESSION_GRAPHICS_DEVICE_HPP
 
 #include <boost/function.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 
 namespace core {
    class Error;
@@ -36,11 +37,17 @@ core::Error initialize(
           const core::FilePath& graphicsPath,
           const boost::function<bool(double*,double*)>& locatorFunction);
    
-// device size
+// device size. resizes of an active device are deferred until
+// applyPendingResize is called (getWidth and getHeight return the
+// requested size)
 void setSize(int width, int height);
 int getWidth();
 int getHeight();
 
+// apply a deferred resize if no further resizes have been requested for
+// the quiet period. returns true if a resize is still pending
+bool applyPendingResize(const boost::posix_time::time_duration& quietPeriod);
+
 // reset
 void close();
 
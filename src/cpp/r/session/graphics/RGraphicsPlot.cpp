@@ -121,9 +121,11 @@ void Plot::saveManipulator() const
 Error Plot::renderFromDisplay()
 {
    // we can use our cached representation if we don't need an update and our 
-   // rendered size is the same as the current graphics device size
+   // rendered size is the same as the current graphics device size (and the
+   // image format hasn't changed since we rendered it)
    if ( !needsUpdate_ &&
-        (renderedSize() == graphicsDevice_.displaySize()) )
+        (renderedSize() == graphicsDevice_.displaySize()) &&
+        imageFilePath(storageUuid_).exists() )
    {
       return Success();
    }
@@ -232,6 +234,56 @@ Error Plot::removeFiles()
       return Success();
 }
 
+uintmax_t Plot::imageFileSize() const
+{
+   if (!hasStorage())
+      return 0;
+
+   FilePath imagePath = imageFilePath(storageUuid_);
+   return imagePath.exists() ? imagePath.size() : 0;
+}
+
+Error Plot::removeImageFile()
+{
+   if (!hasStorage())
+      return Success();
+
+   invalidate();
+
+   Error error = imageFilePath(storageUuid_).removeIfExists();
+   if (error)
+      return Error(errc::PlotFileError, error, ERROR_LOCATION);
+   else
+      return Success();
+}
+
+Error Plot::copyFiles(const FilePath& targetDirPath) const
+{
+   if (!hasStorage())
+      return Success();
+
+   std::vector<FilePath> files;
+   files.push_back(snapshotFilePath(storageUuid_));
+   files.push_back(imageFilePath(storageUuid_));
+   files.push_back(manipulatorFilePath(storageUuid_));
+   for (std::vector<FilePath>::const_iterator it = files.begin();
+        it != files.end();
+        ++it)
+   {
+      if (!it->exists())
+         continue;
+
+      FilePath targetPath = targetDirPath.complete(it->filename());
+      Error error = targetPath.removeIfExists();
+      if (!error)
+         error = it->copy(targetPath);
+      if (error)
+         return Error(errc::PlotFileError, error, ERROR_LOCATION);
+   }
+
+   return Success();
+}
+
 void Plot::purgeInMemoryResources()
 {
    manipulator_.clear();
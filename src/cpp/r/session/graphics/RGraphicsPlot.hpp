@@ -52,7 +52,10 @@ public:
         const DisplaySize& renderedSize);
    
    std::string storageUuid() const;  
+   const core::FilePath& baseDirPath() const { return baseDirPath_; }
    bool hasValidStorage() const;
+   bool needsUpdate() const { return needsUpdate_; }
+   core::FilePath snapshotFilePath() const;
    const DisplaySize& renderedSize() const { return renderedSize_; }
 
    bool hasManipulator() const;
@@ -70,12 +73,19 @@ public:
    
    core::Error removeFiles();
 
+   // copy the snapshot, image, and manipulator files to another directory
+   core::Error copyFiles(const core::FilePath& targetDirPath) const;
+
+   // the image file can be removed independently of the snapshot (the
+   // image will be re-rendered from the snapshot when next displayed)
+   uintmax_t imageFileSize() const;
+   core::Error removeImageFile();
+
    void purgeInMemoryResources();
    
 private:
    bool hasStorage() const;
 
-   core::FilePath snapshotFilePath() const ;
    core::FilePath snapshotFilePath(const std::string& storageUuid) const;
    core::FilePath imageFilePath(const std::string& storageUuid) const;
 
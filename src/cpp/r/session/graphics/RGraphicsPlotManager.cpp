@@ -50,6 +50,13 @@ double pixelsToInches(int pixels)
    return (double)pixels / 96.0;
 }
 
+// maximum number of rendered bitmaps to keep (across all plots)
+const std::size_t kImageCacheSize = 16;
+
+// quota (in megabytes) for the image files of the plot history
+const char * const kImageQuotaOption = "RStudioGD.imageQuotaMB";
+const double kDefaultImageQuotaMB = 64;
+
 } // anonymous namespace
 
 const char * const kPngFormat = "png";
@@ -101,6 +108,14 @@ Error PlotManager::initialize(const FilePath& graphicsPath,
    
    // save reference to graphics device functions
    graphicsDevice_ = graphicsDevice;
+
+   // establish the default image quota
+   if (r::options::getOption(kImageQuotaOption) == R_NilValue)
+   {
+      error = r::options::setOption(kImageQuotaOption, kDefaultImageQuotaMB);
+      if (error)
+         LOG_ERROR(error);
+   }
    
    // sign up for graphics device events
    using boost::bind;
@@ -131,6 +146,18 @@ Error PlotManager::plotImageFilename(int index,
       return Success();
    }
 }      
+
+Error PlotManager::plotSnapshotFile(int index, FilePath* pSnapshotFile) const
+{
+   if (!isValidPlotIndex(index))
+      return plotIndexError(index, ERROR_LOCATION);
+
+   if (!plots_[index]->hasValidStorage())
+      return Error(errc::PlotFileError, ERROR_LOCATION);
+
+   *pSnapshotFile = plots_[index]->snapshotFilePath();
+   return Success();
+}
    
 int PlotManager::activePlotIndex() const
 {
@@ -155,6 +182,11 @@ Error PlotManager::setActivePlot(int index)
 
       // set index
       activePlot_ = index;
+
+      // make sure its files are in the graphics path
+      Error error = materializePlot(index);
+      if (error)
+         logAndReportError(error, ERROR_LOCATION);
       
       // render it
       renderActivePlotToDisplay();
@@ -179,10 +211,13 @@ Error PlotManager::removePlot(int index)
       return plotIndexError(index, ERROR_LOCATION);
    
    // remove the plot files 
-   Error removeError = plots_[index]->removeFiles();
+   Error removeError = removePlotFiles(plots_[index].get());
    if (removeError)
       logAndReportError(removeError, ERROR_LOCATION);
    
+   // remove any bitmaps rendered from it
+   removeCachedImages(plots_[index]->storageUuid());
+
    // erase the plot from the internal list
    plots_.erase(plots_.begin() + index);
    
@@ -297,6 +332,15 @@ Error PlotManager::savePlotAsBitmapFile(const FilePath& targetPath,
    // add extra bitmap params
    extraParams += r::session::graphics::extraBitmapParams();
 
+   // re-use a previous rendering if we have one (zoom windows and export
+   // previews frequently request the same sizes)
+   std::string cacheKey = imageCacheKey(bitmapFileType,
+                                        width,
+                                        height,
+                                        extraParams);
+   if (!cacheKey.empty() && copyCachedImage(cacheKey, targetPath))
+      return Success();
+
    // generate code for creating bitmap file device
    boost::format fmt(
       "{ require(grDevices, quietly=TRUE); "
@@ -309,7 +353,155 @@ Error PlotManager::savePlotAsBitmapFile(const FilePath& targetPath,
                                                      extraParams);
 
    // save the file
-   return savePlotAsFile(deviceCreationCode);
+   Error error = savePlotAsFile(deviceCreationCode);
+   if (error)
+      return error;
+
+   // cache it
+   if (!cacheKey.empty())
+      cacheImage(cacheKey,
+                 activePlot().storageUuid(),
+                 bitmapFileType,
+                 targetPath);
+
+   return Success();
+}
+
+void PlotManager::enforceImageQuota()
+{
+   // a quota of zero (or less) means no quota
+   double quotaMB = r::options::getOption<double>(kImageQuotaOption,
+                                                  kDefaultImageQuotaMB);
+   if (quotaMB <= 0)
+      return;
+   uintmax_t quota = static_cast<uintmax_t>(quotaMB * 1024 * 1024);
+
+   uintmax_t totalSize = 0;
+   for (int i = 0; i < static_cast<int>(plots_.size()); i++)
+   {
+      if (!isDeferredPlot(*plots_[i]))
+         totalSize += plots_[i]->imageFileSize();
+   }
+
+   // remove images (but not snapshots) oldest first. the active plot's
+   // image is always kept since the client is displaying it
+   for (int i = 0;
+        i < static_cast<int>(plots_.size()) && totalSize > quota;
+        i++)
+   {
+      if (i == activePlot_ || isDeferredPlot(*plots_[i]))
+         continue;
+
+      uintmax_t imageSize = plots_[i]->imageFileSize();
+      if (imageSize == 0)
+         continue;
+
+      Error error = plots_[i]->removeImageFile();
+      if (error)
+         LOG_ERROR(error);
+      else
+         totalSize -= imageSize;
+   }
+}
+
+std::string PlotManager::imageCacheKey(const std::string& bitmapFileType,
+                                       int width,
+                                       int height,
+                                       const std::string& extraParams) const
+{
+   // renderings can only be cached when the display is known to match the
+   // active plot's storage (otherwise there are unrendered changes)
+   if (!hasPlot() ||
+       activePlot().storageUuid().empty() ||
+       activePlot().needsUpdate())
+   {
+      return std::string();
+   }
+
+   boost::format fmt("%1%:%2%:%3%x%4%%5%");
+   return boost::str(fmt % activePlot().storageUuid() %
+                           bitmapFileType %
+                           width %
+                           height %
+                           extraParams);
+}
+
+bool PlotManager::copyCachedImage(const std::string& key,
+                                  const FilePath& targetPath)
+{
+   for (std::list<CachedImage>::iterator it = imageCache_.begin();
+        it != imageCache_.end();
+        ++it)
+   {
+      if (it->key != key)
+         continue;
+
+      Error error = targetPath.removeIfExists();
+      if (!error)
+         error = it->path.copy(targetPath);
+      if (error)
+      {
+         // drop the entry and fall back to rendering
+         LOG_ERROR(error);
+         error = it->path.removeIfExists();
+         if (error)
+            LOG_ERROR(error);
+         imageCache_.erase(it);
+         return false;
+      }
+
+      // move to the front
+      imageCache_.splice(imageCache_.begin(), imageCache_, it);
+      return true;
+   }
+
+   return false;
+}
+
+void PlotManager::cacheImage(const std::string& key,
+                             const std::string& storageUuid,
+                             const std::string& bitmapFileType,
+                             const FilePath& imagePath)
+{
+   CachedImage image;
+   image.key = key;
+   image.storageUuid = storageUuid;
+   image.path = r::session::utils::tempFile("plotcache", bitmapFileType);
+   Error error = imagePath.copy(image.path);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return;
+   }
+   imageCache_.push_front(image);
+
+   // evict least recently used
+   while (imageCache_.size() > kImageCacheSize)
+   {
+      error = imageCache_.back().path.removeIfExists();
+      if (error)
+         LOG_ERROR(error);
+      imageCache_.pop_back();
+   }
+}
+
+void PlotManager::removeCachedImages(const std::string& storageUuid)
+{
+   std::list<CachedImage>::iterator it = imageCache_.begin();
+   while (it != imageCache_.end())
+   {
+      if (storageUuid.empty() || it->storageUuid == storageUuid)
+      {
+         Error error = it->path.removeIfExists();
+         if (error)
+            LOG_ERROR(error);
+         it = imageCache_.erase(it);
+      }
+      else
+      {
+         ++it;
+      }
+   }
 }
 
 Error PlotManager::savePlotAsPdf(const FilePath& filePath, 
@@ -450,6 +642,9 @@ void PlotManager::render(boost::function<void(DisplayState)> outputFunction)
          return;
       }
 
+      // keep the plot history within its quota
+      enforceImageQuota();
+
       // get manipulator
       activePlot().manipulatorAsJson(&plotManipulatorJson);
    }
@@ -512,9 +707,11 @@ boost::signal<void ()>& PlotManager::onShowManipulator()
 
 
 
-void PlotManager::setPlotManipulatorValues(const json::Object& values)
+bool PlotManager::setPlotManipulatorValues(const json::Object& values,
+                                           bool deferReplay)
 {
-   return plotManipulatorManager().setPlotManipulatorValues(values);
+   return plotManipulatorManager().setPlotManipulatorValues(values,
+                                                            deferReplay);
 }
 
 void PlotManager::manipulatorPlotClicked(int x, int y)
@@ -528,6 +725,11 @@ void PlotManager::onBeforeExecute()
    graphicsDevice_.onBeforeExecute();
 }
 
+bool PlotManager::applyPendingResize()
+{
+   return graphicsDevice_.applyPendingResize();
+}
+
 Error PlotManager::savePlotsState()
 {
    // list to write
@@ -559,14 +761,20 @@ Error PlotManager::savePlotsState()
 }
    
 Error PlotManager::restorePlotsState()
+{
+   return restorePlotsState(graphicsPath_);
+}
+
+Error PlotManager::restorePlotsState(const FilePath& plotsPath)
 {
    // exit if we don't have a plot list
-   if (!plotsStateFile_.exists())
+   FilePath plotsStateFile = plotsPath.complete(plotsStateFile_.filename());
+   if (!plotsStateFile.exists())
       return Success() ;
    
    // read plot list from file
    std::vector<std::string> plots;
-   Error error = readStringVectorFromFile(plotsStateFile_, &plots);
+   Error error = readStringVectorFromFile(plotsStateFile, &plots);
    if (error)
       return error;
 
@@ -602,7 +810,7 @@ Error PlotManager::restorePlotsState()
       
       // create next plot
       PtrPlot ptrPlot(new Plot(graphicsDevice_,
-                               graphicsPath_,
+                               plotsPath,
                                plotStorageId,
                                renderedSize));
 
@@ -628,11 +836,48 @@ Error PlotManager::restorePlotsState()
    
    // restore snapshot for the active plot
    if (hasPlot())
+   {
+      error = materializePlot(activePlot_);
+      if (error)
+         LOG_ERROR(error);
+
       renderActivePlotToDisplay();
+   }
+
+   return Success();
+}
+
+bool PlotManager::isDeferredPlot(const Plot& plot) const
+{
+   return plot.baseDirPath() != graphicsPath_;
+}
+
+Error PlotManager::materializePlot(int index)
+{
+   if (!isDeferredPlot(*plots_[index]))
+      return Success();
+
+   Error error = plots_[index]->copyFiles(graphicsPath_);
+   if (error)
+      return error;
 
+   plots_[index].reset(new Plot(graphicsDevice_,
+                                graphicsPath_,
+                                plots_[index]->storageUuid(),
+                                plots_[index]->renderedSize()));
    return Success();
 }
 
+Error PlotManager::removePlotFiles(Plot* pPlot)
+{
+   // the files of deferred plots belong to the directory they were
+   // restored from
+   if (isDeferredPlot(*pPlot))
+      return Success();
+   else
+      return pPlot->removeFiles();
+}
+
 namespace {
 
 Error copyDirectory(const FilePath& srcDir, const FilePath& targetDir)
@@ -664,6 +909,15 @@ Error copyDirectory(const FilePath& srcDir, const FilePath& targetDir)
 
 Error PlotManager::serialize(const FilePath& saveToPath)
 {
+   // bring over any plots which are still deferred (they may refer to
+   // the directory we are about to replace)
+   for (int i = 0; i < static_cast<int>(plots_.size()); i++)
+   {
+      Error error = materializePlot(i);
+      if (error)
+         return error;
+   }
+
    // save plots state
    Error error = savePlotsState();
    if (error)
@@ -675,13 +929,18 @@ Error PlotManager::serialize(const FilePath& saveToPath)
 
 Error PlotManager::deserialize(const FilePath& restoreFromPath)
 {
-   // copy the restoreFromPath to the graphics path
-   Error error = copyDirectory(restoreFromPath, graphicsPath_);
+   // start with an empty graphics path
+   Error error = graphicsPath_.removeIfExists();
+   if (error)
+      return error;
+   error = graphicsPath_.ensureDirectory();
    if (error)
       return error;
 
-   // restore plots state
-   return restorePlotsState();
+   // restore plots state directly from the restoreFromPath (only the
+   // active plot's files are copied now, the others are copied when
+   // they are activated)
+   return restorePlotsState(restoreFromPath);
 }
 
    
@@ -736,7 +995,8 @@ void PlotManager::onDeviceNewPage(SEXP previousPageSnapshot)
       // if we're full then remove the first plot's files before adding a new one
       if (plots_.full())
       {
-         Error error = plots_.front()->removeFiles();
+         removeCachedImages(plots_.front()->storageUuid());
+         Error error = removePlotFiles(plots_.front().get());
          if (error)
             LOG_ERROR(error);
       }
@@ -777,6 +1037,7 @@ void PlotManager::onDeviceClosed()
    // clear plots
    activePlot_ = -1;
    plots_.clear();
+   removeCachedImages();
    
    // trip changes flag to ensure repaint
    displayHasChanges_ = true;
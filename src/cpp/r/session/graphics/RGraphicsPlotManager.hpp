@@ -16,6 +16,7 @@
 #ifndef R_SESSION_GRAPHICS_PLOT_MANAGER_HPP
 #define R_SESSION_GRAPHICS_PLOT_MANAGER_HPP
 
+#include <list>
 #include <string>
 #include <vector>
 
@@ -69,6 +70,8 @@ public:
    virtual int plotCount() const;
    virtual core::Error plotImageFilename(int index, 
                                          std::string* pImageFilename) const;
+   virtual core::Error plotSnapshotFile(int index,
+                                        core::FilePath* pSnapshotFile) const;
    virtual int activePlotIndex() const;
    virtual core::Error setActivePlot(int index) ;
    virtual core::Error removePlot(int index);
@@ -101,11 +104,14 @@ public:
    virtual void clear();
 
    virtual boost::signal<void ()>& onShowManipulator() ;
-   virtual void setPlotManipulatorValues(const core::json::Object& values);
+   virtual bool setPlotManipulatorValues(const core::json::Object& values,
+                                         bool deferReplay);
    virtual void manipulatorPlotClicked(int x, int y);
 
    virtual void onBeforeExecute();
 
+   virtual bool applyPendingResize();
+
    // manipulate persistent state
    core::Error savePlotsState();
    core::Error restorePlotsState();
@@ -136,6 +142,14 @@ private:
    // invalidate the active plot
    void invalidateActivePlot();
 
+   // plots restored by deserialize (other than the active plot) initially
+   // refer to the files in the directory they were restored from. they
+   // are copied into the graphics path when they are activated
+   core::Error restorePlotsState(const core::FilePath& plotsPath);
+   bool isDeferredPlot(const Plot& plot) const;
+   core::Error materializePlot(int index);
+   core::Error removePlotFiles(Plot* pPlot);
+
    // render active plot to display (used in setActivePlot and onSessionResume)
    void renderActivePlotToDisplay();
    
@@ -149,6 +163,23 @@ private:
                                     int width,
                                     int height);
 
+   // cache of bitmaps rendered from plots (keyed by plot storage and
+   // rendering parameters)
+   std::string imageCacheKey(const std::string& bitmapFileType,
+                             int width,
+                             int height,
+                             const std::string& extraParams) const;
+   bool copyCachedImage(const std::string& key,
+                        const core::FilePath& targetPath);
+   void cacheImage(const std::string& key,
+                   const std::string& storageUuid,
+                   const std::string& bitmapFileType,
+                   const core::FilePath& imagePath);
+   void removeCachedImages(const std::string& storageUuid = std::string());
+
+   // remove the image files of the oldest plots if they exceed the quota
+   void enforceImageQuota();
+
    core::Error savePlotAsSvg(const core::FilePath& targetPath,
                              int width,
                              int height);
@@ -180,6 +211,15 @@ private:
    
    int activePlot_;
    boost::circular_buffer<PtrPlot> plots_ ;
+
+   // most recently used first
+   struct CachedImage
+   {
+      std::string key;
+      std::string storageUuid;
+      core::FilePath path;
+   };
+   std::list<CachedImage> imageCache_;
    
    boost::regex plotInfoRegex_;
 };
@@ -20,6 +20,7 @@
 
 #include <boost/bind.hpp>
 #include <boost/function.hpp>
+#include <boost/foreach.hpp>
 
 #include <core/Log.hpp>
 #include <core/Error.hpp>
@@ -79,12 +80,29 @@ void safeExecuteManipulator(SEXP manipulatorSEXP)
    CATCH_UNEXPECTED_EXCEPTION
 }
 
+Error getManipulatorButtonNames(SEXP manipulatorSEXP,
+                                std::vector<std::string>* pButtonNames)
+{
+   return r::exec::RFunction("manipulate:::buttonNames",
+                             manipulatorSEXP).call(pButtonNames);
+}
+
+bool includesButton(const json::Object& values,
+                    const std::vector<std::string>& buttonNames)
+{
+   BOOST_FOREACH(const std::string& buttonName, buttonNames)
+   {
+      if (values.find(buttonName) != values.end())
+         return true;
+   }
+   return false;
+}
+
 void setManipulatorButtonsToFalse(SEXP manipulatorSEXP)
 {
    // get the list of buttons
    std::vector<std::string> buttonNames;
-   Error error = r::exec::RFunction("manipulate:::buttonNames",
-                                    manipulatorSEXP).call(&buttonNames);
+   Error error = getManipulatorButtonNames(manipulatorSEXP, &buttonNames);
    if (error)
    {
       logAndReportError(error, ERROR_LOCATION);
@@ -263,7 +281,9 @@ void PlotManipulatorManager::replayManipulator(SEXP manipulatorSEXP)
    replayingManipulator_ = false;
 }
 
-void PlotManipulatorManager::setPlotManipulatorValues(const json::Object& values)
+bool PlotManipulatorManager::setPlotManipulatorValues(
+                                                const json::Object& values,
+                                                bool deferReplay)
 {
    if (manipulatorIsActive())
    {
@@ -275,16 +295,31 @@ void PlotManipulatorManager::setPlotManipulatorValues(const json::Object& values
                     values.end(),
                     boost::bind(setManipulatorJsonValue, manipulatorSEXP, _1));
 
+      // values which are about to be superseded (e.g. the intermediate
+      // positions of a slider being dragged) don't need to be rendered.
+      // button presses always do since they are momentary
+      if (deferReplay)
+      {
+         std::vector<std::string> buttonNames;
+         Error error = getManipulatorButtonNames(manipulatorSEXP,
+                                                 &buttonNames);
+         if (!error && !includesButton(values, buttonNames))
+            return false;
+      }
+
       // replay the manipulator
       replayManipulator(manipulatorSEXP);
 
       // set all of the buttons to false
       setManipulatorButtonsToFalse(manipulatorSEXP);
+
+      return true;
    }
    else
    {
       LOG_WARNING_MESSAGE("called setPlotManipulatorValues but active plot "
                           "has no manipulator");
+      return false;
    }
 }
 
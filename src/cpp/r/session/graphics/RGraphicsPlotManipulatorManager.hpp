@@ -51,7 +51,8 @@ public:
    core::Error initialize(const UnitConversionFunctions& convert);
 
    boost::signal<void ()>& onShowManipulator() ;
-   void setPlotManipulatorValues(const core::json::Object& values);
+   bool setPlotManipulatorValues(const core::json::Object& values,
+                                 bool deferReplay);
    void manipulatorPlotClicked(int x, int y);
    
    void executeAndAttachManipulator(SEXP manipulatorSEXP);
@@ -0,0 +1,388 @@
+/*
+ * RGraphicsSvgRecorder.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "RGraphicsSvgRecorder.hpp"
+
+#include <cmath>
+#include <sstream>
+#include <algorithm>
+
+#include <boost/format.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/Base64.hpp>
+#include <core/StringUtils.hpp>
+
+#include <r/ROptions.hpp>
+#include <r/session/RSessionUtils.hpp>
+
+using namespace core;
+
+namespace r {
+namespace session {
+namespace graphics {
+namespace svg {
+
+namespace {
+
+const char * const kSvgOption = "RStudioGD.svg";
+
+struct Page
+{
+   Page() : recording(false), complete(false), width(0), height(0),
+            clipCount(0), clipOpen(false)
+   {
+   }
+
+   bool recording;
+   bool complete;
+   int width;
+   int height;
+   std::ostringstream body;
+   int clipCount;
+   bool clipOpen;
+};
+
+Page s_page;
+
+bool isRecording()
+{
+   return s_page.recording && s_page.complete;
+}
+
+std::string color(unsigned int col)
+{
+   if (R_TRANSPARENT(col))
+      return "none";
+
+   boost::format fmt("#%02X%02X%02X");
+   return boost::str(fmt % R_RED(col) % R_GREEN(col) % R_BLUE(col));
+}
+
+std::string opacity(const char* attribute, unsigned int col)
+{
+   if (R_OPAQUE(col) || R_TRANSPARENT(col))
+      return std::string();
+
+   boost::format fmt(" %1%=\"%2%\"");
+   return boost::str(fmt % attribute % (R_ALPHA(col) / 255.0));
+}
+
+std::string fillStyle(const pGEcontext gc)
+{
+   return " fill=\"" + color(gc->fill) + "\"" + opacity("fill-opacity",
+                                                        gc->fill);
+}
+
+std::string strokeStyle(const pGEcontext gc)
+{
+   if (gc->lty == LTY_BLANK || R_TRANSPARENT(gc->col))
+      return " stroke=\"none\"";
+
+   std::ostringstream ostr;
+   ostr << " stroke=\"" << color(gc->col) << "\""
+        << opacity("stroke-opacity", gc->col)
+        << " stroke-width=\"" << gc->lwd << "\"";
+
+   // dashes are encoded as up to 8 nibbles of (lwd relative) lengths
+   if (gc->lty != LTY_SOLID)
+   {
+      ostr << " stroke-dasharray=\"";
+      unsigned int lty = gc->lty;
+      for (int i = 0; i < 8 && (lty & 15); i++, lty >>= 4)
+         ostr << (i > 0 ? "," : "") << (lty & 15) * gc->lwd;
+      ostr << "\"";
+   }
+
+   switch (gc->lend)
+   {
+      case GE_ROUND_CAP:  ostr << " stroke-linecap=\"round\"";    break;
+      case GE_BUTT_CAP:   ostr << " stroke-linecap=\"butt\"";     break;
+      case GE_SQUARE_CAP: ostr << " stroke-linecap=\"square\"";   break;
+   }
+
+   switch (gc->ljoin)
+   {
+      case GE_ROUND_JOIN: ostr << " stroke-linejoin=\"round\"";   break;
+      case GE_MITRE_JOIN: ostr << " stroke-linejoin=\"miter\""
+                               << " stroke-miterlimit=\""
+                               << gc->lmitre << "\"";             break;
+      case GE_BEVEL_JOIN: ostr << " stroke-linejoin=\"bevel\"";   break;
+   }
+
+   return ostr.str();
+}
+
+void writePoints(int n, double* x, double* y, std::ostream& ostr)
+{
+   for (int i = 0; i < n; i++)
+      ostr << (i > 0 ? " " : "") << x[i] << "," << y[i];
+}
+
+std::string fontStyle(const pGEcontext gc)
+{
+   std::ostringstream ostr;
+
+   std::string family(gc->fontfamily);
+   if (gc->fontface == 5 || family == "symbol")
+      ostr << " font-family=\"Symbol\"";
+   else if (family == "serif")
+      ostr << " font-family=\"serif\"";
+   else if (family == "mono")
+      ostr << " font-family=\"monospace\"";
+   else if (family.empty() || family == "sans")
+      ostr << " font-family=\"sans-serif\"";
+   else
+      ostr << " font-family=\"" << string_utils::htmlEscape(family, true)
+           << "\"";
+
+   if (gc->fontface == 2 || gc->fontface == 4)
+      ostr << " font-weight=\"bold\"";
+   if (gc->fontface == 3 || gc->fontface == 4)
+      ostr << " font-style=\"italic\"";
+
+   // the shadow device renders at 72 dpi so points are pixels
+   ostr << " font-size=\"" << gc->cex * gc->ps << "\"";
+
+   return ostr.str();
+}
+
+void closeClip()
+{
+   if (s_page.clipOpen)
+   {
+      s_page.body << "</g>\n";
+      s_page.clipOpen = false;
+   }
+}
+
+std::string svgHeader(int width, int height)
+{
+   boost::format fmt("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                     "<svg xmlns=\"http://www.w3.org/2000/svg\" "
+                     "xmlns:xlink=\"http://www.w3.org/1999/xlink\" "
+                     "width=\"%1%\" height=\"%2%\" "
+                     "viewBox=\"0 0 %1% %2%\">\n");
+   return boost::str(fmt % width % height);
+}
+
+Error writeEmbeddedPNG(
+      const FilePath& targetPath,
+      const boost::function<Error(const FilePath&)>& writePNG)
+{
+   FilePath pngPath = r::session::utils::tempFile("svgpage", "png");
+   Error error = writePNG(pngPath);
+   if (error)
+      return error;
+
+   std::string png;
+   error = base64::encode(pngPath, &png);
+   Error removeError = pngPath.removeIfExists();
+   if (removeError)
+      LOG_ERROR(removeError);
+   if (error)
+      return error;
+
+   boost::format fmt("<image width=\"%1%\" height=\"%2%\" "
+                     "xlink:href=\"data:image/png;base64,%3%\"/>\n");
+   std::string svg = svgHeader(s_page.width, s_page.height) +
+                     boost::str(fmt % s_page.width % s_page.height % png) +
+                     "</svg>\n";
+   return writeStringToFile(targetPath, svg);
+}
+
+} // anonymous namespace
+
+bool enabled()
+{
+   // avoid getOption<bool> as it logs an error for an unset option
+   SEXP valueSEXP = r::options::getOption(kSvgOption);
+   return TYPEOF(valueSEXP) == LGLSXP &&
+          Rf_length(valueSEXP) > 0 &&
+          LOGICAL(valueSEXP)[0] == TRUE;
+}
+
+void newPage(int width, int height, const pGEcontext gc)
+{
+   s_page.recording = enabled();
+   s_page.complete = true;
+   s_page.width = width;
+   s_page.height = height;
+   s_page.body.str(std::string());
+   s_page.clipCount = 0;
+   s_page.clipOpen = false;
+
+   if (!s_page.recording)
+      return;
+
+   // background
+   if (!R_TRANSPARENT(gc->fill))
+   {
+      s_page.body << "<rect width=\"100%\" height=\"100%\""
+                  << fillStyle(gc) << "/>\n";
+   }
+}
+
+void clip(double x0, double x1, double y0, double y1)
+{
+   if (!isRecording())
+      return;
+
+   closeClip();
+
+   int id = ++s_page.clipCount;
+   s_page.body << "<clipPath id=\"c" << id << "\">"
+               << "<rect x=\"" << std::min(x0, x1)
+               << "\" y=\"" << std::min(y0, y1)
+               << "\" width=\"" << std::abs(x1 - x0)
+               << "\" height=\"" << std::abs(y1 - y0) << "\"/>"
+               << "</clipPath>\n"
+               << "<g clip-path=\"url(#c" << id << ")\">\n";
+   s_page.clipOpen = true;
+}
+
+void circle(double x, double y, double r, const pGEcontext gc)
+{
+   if (!isRecording())
+      return;
+
+   s_page.body << "<circle cx=\"" << x << "\" cy=\"" << y
+               << "\" r=\"" << r << "\""
+               << fillStyle(gc) << strokeStyle(gc) << "/>\n";
+}
+
+void line(double x1, double y1, double x2, double y2, const pGEcontext gc)
+{
+   if (!isRecording())
+      return;
+
+   s_page.body << "<line x1=\"" << x1 << "\" y1=\"" << y1
+               << "\" x2=\"" << x2 << "\" y2=\"" << y2 << "\""
+               << strokeStyle(gc) << "/>\n";
+}
+
+void polyline(int n, double *x, double *y, const pGEcontext gc)
+{
+   if (!isRecording())
+      return;
+
+   s_page.body << "<polyline points=\"";
+   writePoints(n, x, y, s_page.body);
+   s_page.body << "\" fill=\"none\"" << strokeStyle(gc) << "/>\n";
+}
+
+void polygon(int n, double *x, double *y, const pGEcontext gc)
+{
+   if (!isRecording())
+      return;
+
+   s_page.body << "<polygon points=\"";
+   writePoints(n, x, y, s_page.body);
+   s_page.body << "\"" << fillStyle(gc) << strokeStyle(gc) << "/>\n";
+}
+
+void rect(double x0, double y0, double x1, double y1, const pGEcontext gc)
+{
+   if (!isRecording())
+      return;
+
+   s_page.body << "<rect x=\"" << std::min(x0, x1)
+               << "\" y=\"" << std::min(y0, y1)
+               << "\" width=\"" << std::abs(x1 - x0)
+               << "\" height=\"" << std::abs(y1 - y0) << "\""
+               << fillStyle(gc) << strokeStyle(gc) << "/>\n";
+}
+
+void path(double *x,
+          double *y,
+          int npoly,
+          int *nper,
+          Rboolean winding,
+          const pGEcontext gc)
+{
+   if (!isRecording())
+      return;
+
+   s_page.body << "<path d=\"";
+   int offset = 0;
+   for (int i = 0; i < npoly; i++)
+   {
+      for (int j = 0; j < nper[i]; j++, offset++)
+      {
+         s_page.body << (j == 0 ? "M" : "L")
+                     << x[offset] << "," << y[offset] << " ";
+      }
+      s_page.body << "Z ";
+   }
+   s_page.body << "\" fill-rule=\"" << (winding ? "nonzero" : "evenodd")
+               << "\"" << fillStyle(gc) << strokeStyle(gc) << "/>\n";
+}
+
+void raster()
+{
+   s_page.complete = false;
+}
+
+void text(double x,
+          double y,
+          const std::string& utf8Str,
+          double rot,
+          double hadj,
+          const pGEcontext gc)
+{
+   if (!isRecording() || R_TRANSPARENT(gc->col))
+      return;
+
+   const char* anchor = "start";
+   if (hadj == 0.5)
+      anchor = "middle";
+   else if (hadj == 1)
+      anchor = "end";
+
+   s_page.body << "<text x=\"" << x << "\" y=\"" << y << "\""
+               << " text-anchor=\"" << anchor << "\"";
+   if (rot != 0)
+   {
+      s_page.body << " transform=\"rotate(" << -rot << "," << x << ","
+                  << y << ")\"";
+   }
+   s_page.body << " fill=\"" << color(gc->col) << "\""
+               << opacity("fill-opacity", gc->col)
+               << fontStyle(gc) << ">"
+               << string_utils::htmlEscape(utf8Str) << "</text>\n";
+}
+
+Error writeToSVG(const FilePath& targetPath,
+                 const boost::function<Error(const FilePath&)>& writePNG)
+{
+   if (!isRecording())
+      return writeEmbeddedPNG(targetPath, writePNG);
+
+   // (drawing may continue on this page so leave any clip group open)
+   std::string svg = svgHeader(s_page.width, s_page.height) +
+                     s_page.body.str() +
+                     (s_page.clipOpen ? "</g>\n" : "") +
+                     "</svg>\n";
+   return writeStringToFile(targetPath, svg);
+}
+
+} // namespace svg
+} // namespace graphics
+} // namespace session
+} // namespace r
+
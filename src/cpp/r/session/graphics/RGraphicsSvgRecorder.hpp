@@ -0,0 +1,86 @@
+/*
+ * RGraphicsSvgRecorder.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef R_SESSION_GRAPHICS_SVG_RECORDER_HPP
+#define R_SESSION_GRAPHICS_SVG_RECORDER_HPP
+
+#include <string>
+
+#include <boost/function.hpp>
+
+#include "RGraphicsDevDesc.hpp"
+
+namespace core {
+   class Error;
+   class FilePath;
+}
+
+namespace r {
+namespace session {
+namespace graphics {
+namespace svg {
+
+// The svg recorder mirrors the primitives drawn on the current page of the
+// RStudio device as svg elements (coordinates are device pixels, which are
+// also the svg user units). Recording is enabled with
+// options(RStudioGD.svg = TRUE) and the option is checked at each new page.
+
+bool enabled();
+
+void newPage(int width, int height, const pGEcontext gc);
+
+void clip(double x0, double x1, double y0, double y1);
+
+void circle(double x, double y, double r, const pGEcontext gc);
+
+void line(double x1, double y1, double x2, double y2, const pGEcontext gc);
+
+void polyline(int n, double *x, double *y, const pGEcontext gc);
+
+void polygon(int n, double *x, double *y, const pGEcontext gc);
+
+void rect(double x0, double y0, double x1, double y1, const pGEcontext gc);
+
+void path(double *x,
+          double *y,
+          int npoly,
+          int *nper,
+          Rboolean winding,
+          const pGEcontext gc);
+
+// rasters aren't recorded (pages which contain them are written as an
+// embedded png)
+void raster();
+
+void text(double x,
+          double y,
+          const std::string& utf8Str,
+          double rot,
+          double hadj,
+          const pGEcontext gc);
+
+// write the current page. if the page couldn't be recorded then the png
+// written by writePNG is embedded instead
+core::Error writeToSVG(
+      const core::FilePath& targetPath,
+      const boost::function<core::Error(const core::FilePath&)>& writePNG);
+
+} // namespace svg
+} // namespace graphics
+} // namespace session
+} // namespace r
+
+#endif // R_SESSION_GRAPHICS_SVG_RECORDER_HPP
+
@@ -69,6 +69,7 @@ struct GraphicsDeviceFunctions
    boost::function<std::string()> imageFileExtension;
    boost::function<void()> close;
    boost::function<void()> onBeforeExecute;
+   boost::function<bool()> applyPendingResize;
 };  
 
 
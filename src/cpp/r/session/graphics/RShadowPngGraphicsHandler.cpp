@@ -67,8 +67,12 @@ private:
 
 struct ShadowDeviceData
 {
-   ShadowDeviceData() : pShadowPngDevice(NULL) {}
+   ShadowDeviceData() : pShadowPngDevice(NULL), pendingSync(false) {}
    pDevDesc pShadowPngDevice;
+
+   // the shadow device was turned off to write a png and needs to have
+   // the display list replayed onto it before it is drawn on again
+   bool pendingSync;
 };
 
 void shadowDevOff(DeviceContext* pDC)
@@ -134,34 +138,6 @@ Error shadowDevDesc(DeviceContext* pDC, pDevDesc* pDev)
    return Success();
 }
 
-// this version of the function is called from R graphics primitives
-// so can (and should) throw errors in R longjmp style
-pDevDesc shadowDevDesc(pDevDesc dev)
-{
-   try
-   {
-      DeviceContext* pDC = (DeviceContext*)dev->deviceSpecific;
-
-      pDevDesc shadowDev = NULL;
-      Error error = shadowDevDesc(pDC, &shadowDev);
-      if (error)
-      {
-         LOG_ERROR(error);
-         throw r::exec::RErrorException(error.summary());
-      }
-
-      return shadowDev;
-   }
-   catch(const r::exec::RErrorException& e)
-   {
-      r::exec::error("Shadow graphics device error: " +
-                     std::string(e.message()));
-   }
-
-   // keep compiler happy
-   return NULL;
-}
-
 FilePath tempFile(const std::string& extension)
 {
    FilePath tempFileDir(string_utils::systemToUtf8(R_TempDir));
@@ -173,6 +149,9 @@ FilePath tempFile(const std::string& extension)
 
 void shadowDevSync(DeviceContext* pDC)
 {
+   ShadowDeviceData* pDevData = (ShadowDeviceData*)pDC->pDeviceSpecific;
+   pDevData->pendingSync = false;
+
    // get the rstudio device number
    pGEDevDesc rsGEDevDesc = desc2GEDesc(pDC->dev);
    int rsDeviceNumber = GEdeviceNumber(rsGEDevDesc);
@@ -197,6 +176,41 @@ void shadowDevSync(DeviceContext* pDC)
       LOG_ERROR(error);
 }
 
+// this version of the function is called from R graphics primitives
+// so can (and should) throw errors in R longjmp style
+pDevDesc shadowDevDesc(pDevDesc dev)
+{
+   try
+   {
+      DeviceContext* pDC = (DeviceContext*)dev->deviceSpecific;
+
+      // bring the shadow device up to date if it was turned off to write
+      // a png (this is deferred until it is needed since the next thing
+      // drawn is often a new page, which makes the replay unnecessary)
+      ShadowDeviceData* pDevData = (ShadowDeviceData*)pDC->pDeviceSpecific;
+      if (pDevData->pendingSync)
+         shadowDevSync(pDC);
+
+      pDevDesc shadowDev = NULL;
+      Error error = shadowDevDesc(pDC, &shadowDev);
+      if (error)
+      {
+         LOG_ERROR(error);
+         throw r::exec::RErrorException(error.summary());
+      }
+
+      return shadowDev;
+   }
+   catch(const r::exec::RErrorException& e)
+   {
+      r::exec::error("Shadow graphics device error: " +
+                     std::string(e.message()));
+   }
+
+   // keep compiler happy
+   return NULL;
+}
+
 } // anonymous namespace
 
 
@@ -297,7 +311,7 @@ Error writeToPNG(const FilePath& targetPath, DeviceContext* pDC)
    // turn the shadow device off to write the file
    shadowDevOff(pDC);
 
-   // if the targetPath != the bitmap path then copy it
+   // if the targetPath != the bitmap path then move it there
    Error error;
    if (targetPath != pDC->targetPath)
    {
@@ -309,31 +323,24 @@ Error writeToPNG(const FilePath& targetPath, DeviceContext* pDC)
       }
       else
       {
-         error = pDC->targetPath.copy(targetPath);
-
-         Error deleteError = pDC->targetPath.remove();
-         if (deleteError)
-            LOG_ERROR(error);
+         // fall back to copying if we can't move (e.g. the target is on
+         // another filesystem)
+         error = pDC->targetPath.move(targetPath);
+         if (error)
+         {
+            error = pDC->targetPath.copy(targetPath);
+
+            Error deleteError = pDC->targetPath.remove();
+            if (deleteError)
+               LOG_ERROR(deleteError);
+         }
       }
    }
 
-   // regenerate the shadow device
-   pDevDesc dev = pDC->dev;
-   int width = pDC->width;
-   int height = pDC->height;
-   handler::destroy(pDC);
-   pDC = handler::allocate(dev);
-   dev->deviceSpecific = pDC;
-
-   // re-create with the correct size
-   if (!handler::initialize(width, height, pDC))
-      return systemError(boost::system::errc::not_connected, ERROR_LOCATION);
-
-   // now update the device structure
-   handler::setSize(dev);
-
-   // replay the rstudio graphics device context onto the png
-   shadowDevSync(pDC);
+   // the shadow device is re-created (and the display list replayed onto
+   // it) on demand the next time it is drawn on
+   ShadowDeviceData* pDevData = (ShadowDeviceData*)pDC->pDeviceSpecific;
+   pDevData->pendingSync = true;
 
    // return status
    return error;
@@ -497,7 +504,11 @@ void newPage(const pGEcontext gc, pDevDesc dev)
 {
    // close existing shadow dev (this is so that new plots don't
    // paint transparently over old plots -- this might occur because
-   // we now set bg = transparent)
+   // we now set bg = transparent). there is no need to replay the old
+   // plot onto it if it was pending a sync
+   DeviceContext* pDC = (DeviceContext*)dev->deviceSpecific;
+   if (pDC)
+      ((ShadowDeviceData*)pDC->pDeviceSpecific)->pendingSync = false;
    shadowDevOff(dev);
 
    // create a new shadow dev
@@ -17,9 +17,18 @@
 #include <pthread.h>
 #include <signal.h>
 
+#include <vector>
+#include <algorithm>
+
+#include <boost/foreach.hpp>
+#include <boost/shared_ptr.hpp>
+
 #include <core/Error.hpp>
 #include <core/ProgramStatus.hpp>
 #include <core/ProgramOptions.hpp>
+#include <core/PeriodicCommand.hpp>
+#include <core/Metrics.hpp>
+#include <core/Trace.hpp>
 
 #include <core/text/TemplateFilter.hpp>
 
@@ -27,6 +36,7 @@
 #include <core/system/Crypto.hpp>
 
 #include <core/http/URL.hpp>
+#include <core/http/Response.hpp>
 #include <core/http/AsyncUriHandler.hpp>
 #include <core/http/TcpIpAsyncServer.hpp>
 
@@ -50,6 +60,8 @@
 #include "ServerBrowser.hpp"
 #include "ServerOffline.hpp"
 #include "ServerPAMAuth.hpp"
+#include "ServerNodes.hpp"
+#include "ServerRepositoryIndex.hpp"
 #include "ServerSessionProxy.hpp"
 #include "ServerREnvironment.hpp"
 #include "ServerSessionManager.hpp"
@@ -105,29 +117,78 @@ auth::SecureAsyncUriHandlerFunction secureAsyncFileHandler()
    return boost::bind(asyncFileHandler, _2);
 }
 
-// http server
-boost::scoped_ptr<http::TcpIpAsyncServer> s_pHttpServer;
+// http servers. there is normally just one, however when acceptor
+// sharding is enabled there is one per shard, each with its own
+// io_service, acceptor (bound with SO_REUSEPORT), threads and copy of
+// the uri handlers (proxied connections run on their shard's io_service)
+typedef boost::shared_ptr<http::TcpIpAsyncServer> HttpServerPtr;
+std::vector<HttpServerPtr> s_httpServers;
 
 Error httpServerInit()
 {
-   // create http server
-   s_pHttpServer.reset(new http::TcpIpAsyncServer("RStudio"));
+   Options& options = server::options();
 
-   // set server options
-   s_pHttpServer->setAbortOnResourceError(true);
+   // set compression policy
+   http::CompressionPolicy compressionPolicy;
+   compressionPolicy.level = options.wwwCompressionLevel();
+   compressionPolicy.minimumSize = std::max(0, options.wwwCompressionMinSize());
+   compressionPolicy.precompressedFiles = options.wwwCompressionPrecompressed();
+   http::setCompressionPolicy(compressionPolicy);
 
-   // initialize the http server
-   Options& options = server::options();
-   return s_pHttpServer->init(options.wwwAddress(), options.wwwPort());
+   // create and initialize the http server(s)
+   int shards = std::max(1, options.wwwAcceptorShards());
+   for (int i = 0; i < shards; i++)
+   {
+      HttpServerPtr pServer(new http::TcpIpAsyncServer("RStudio"));
+      pServer->setAbortOnResourceError(true);
+      pServer->setRequestMetricName("rserver_http_request");
+      Error error = pServer->init(options.wwwAddress(),
+                                  options.wwwPort(),
+                                  shards > 1);
+      if (error)
+         return error;
+      s_httpServers.push_back(pServer);
+   }
+
+   return Success();
+}
+
+Error httpServerRun(std::size_t threadPoolSize)
+{
+   BOOST_FOREACH(const HttpServerPtr& pServer, s_httpServers)
+   {
+      Error error = pServer->run(threadPoolSize);
+      if (error)
+         return error;
+   }
+
+   return Success();
 }
 
 void httpServerAddHandlers()
 {
+   // request latency metrics (unauthenticated so only when enabled)
+   if (server::options().wwwMetrics())
+      uri_handlers::addBlocking("/metrics", metrics::handleMetricsRequest);
+
+   // request tracing (likewise unauthenticated so only when enabled)
+   if (server::options().wwwRequestTracing())
+   {
+      trace::setRequestTracingEnabled(true);
+      uri_handlers::addBlocking("/trace", trace::handleTraceRequest);
+   }
+
+   // load reporting for a front end server (only when this is a node)
+   if (server::options().serverNodeStatus())
+      uri_handlers::addBlocking("/node_status", nodes::handleNodeStatusRequest);
+
    // establish json-rpc handlers
    using namespace server::auth;
    using namespace server::session_proxy;
    uri_handlers::add("/rpc", secureAsyncJsonRpcHandler(proxyRpcRequest));
    uri_handlers::add("/events", secureAsyncJsonRpcHandler(proxyEventsRequest));
+   uri_handlers::add("/event_stream",
+                     secureAsyncHttpHandler(proxyEventStreamRequest));
 
    // establish content handlers
    uri_handlers::add("/graphics", secureAsyncHttpHandler(proxyContentRequest));
@@ -266,24 +327,28 @@ namespace uri_handlers {
 void add(const std::string& prefix,
          const http::AsyncUriHandlerFunction& handler)
 {
-   s_pHttpServer->addHandler(prefix, handler);
+   BOOST_FOREACH(const HttpServerPtr& pServer, s_httpServers)
+      pServer->addHandler(prefix, handler);
 }
 
 void addBlocking(const std::string& prefix,
                  const http::UriHandlerFunction& handler)
 {
-   s_pHttpServer->addBlockingHandler(prefix, handler);
+   BOOST_FOREACH(const HttpServerPtr& pServer, s_httpServers)
+      pServer->addBlockingHandler(prefix, handler);
 }
 
 void setDefault(const http::AsyncUriHandlerFunction& handler)
 {
-   s_pHttpServer->setDefaultHandler(handler);
+   BOOST_FOREACH(const HttpServerPtr& pServer, s_httpServers)
+      pServer->setDefaultHandler(handler);
 }
 
 // set blocking default handler
 void setBlockingDefault(const http::UriHandlerFunction& handler)
 {
-  s_pHttpServer->setBlockingDefaultHandler(handler);
+   BOOST_FOREACH(const HttpServerPtr& pServer, s_httpServers)
+      pServer->setBlockingDefaultHandler(handler);
 }
 
 } // namespace uri_handlers
@@ -292,7 +357,9 @@ namespace scheduler {
 
 void addCommand(boost::shared_ptr<ScheduledCommand> pCmd)
 {
-   s_pHttpServer->addScheduledCommand(pCmd);
+   // scheduled commands are global rather than per connection so only
+   // the first server runs them
+   s_httpServers.front()->addScheduledCommand(pCmd);
 }
 
 } // namespace scheduler
@@ -371,6 +438,16 @@ int main(int argc, char * const argv[])
       if (error)
          return core::system::exitFailure(error, ERROR_LOCATION);
 
+      // initialize placement of sessions on other nodes
+      error = nodes::initialize();
+      if (error)
+         return core::system::exitFailure(error, ERROR_LOCATION);
+
+      // initialize shared repository indexes
+      error = repos_index::initialize();
+      if (error)
+         return core::system::exitFailure(error, ERROR_LOCATION);
+
       // initialize http server
       error = httpServerInit();
       if (error)
@@ -386,6 +463,28 @@ int main(int argc, char * const argv[])
          // add handlers
          httpServerAddHandlers();
 
+         // suspend idle sessions when the host is low on memory
+         if (options.rsessionSuspendMemoryPercent() > 0)
+         {
+            scheduler::addCommand(boost::shared_ptr<core::ScheduledCommand>(
+               new core::PeriodicCommand(boost::posix_time::seconds(30),
+                                   boost::bind(
+                                      &SessionManager::suspendIdleSessions,
+                                      &sessionManager()),
+                                   false)));
+         }
+
+         // publish session resource usage when sessions have cgroups
+         if (!options.rsessionCGroupRoot().empty())
+         {
+            scheduler::addCommand(boost::shared_ptr<core::ScheduledCommand>(
+               new core::PeriodicCommand(boost::posix_time::seconds(15),
+                                   boost::bind(
+                                      &SessionManager::updateSessionMetrics,
+                                      &sessionManager()),
+                                   false)));
+         }
+
          // initialize addins
          error = addins::initialize();
          if (error)
@@ -432,7 +531,7 @@ int main(int argc, char * const argv[])
       }
 
       // run http server
-      error = s_pHttpServer->run(options.wwwThreadPoolSize());
+      error = httpServerRun(options.wwwThreadPoolSize());
       if (error)
          return core::system::exitFailure(error, ERROR_LOCATION);
 
@@ -0,0 +1,324 @@
+/*
+ * ServerNodes.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "ServerNodes.hpp"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <map>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/format.hpp>
+#include <boost/algorithm/string/trim.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/Thread.hpp>
+
+#include <core/http/Request.hpp>
+#include <core/http/Response.hpp>
+#include <core/http/BlockingClient.hpp>
+#include <core/http/TcpIpAsyncClient.hpp>
+#include <core/http/TcpIpAsyncClientSsl.hpp>
+#include <core/http/ConnectionRetryProfile.hpp>
+
+#include <server/ServerOptions.hpp>
+
+#include "ServerSessionManager.hpp"
+
+using namespace core;
+
+namespace server {
+namespace nodes {
+
+namespace {
+
+const char * const kNodeStatusUri = "/node_status";
+
+// interval between health checks
+const int kHealthCheckSeconds = 10;
+
+struct Node
+{
+   Node() : healthy(false), load(0) {}
+   std::string address;
+   std::string port;
+   bool healthy;
+   double load;      // max of cpu and memory utilization (0-1)
+};
+
+boost::mutex s_nodesMutex;
+std::vector<Node> s_nodes;
+
+// node each user has been placed on (sessions stay on their node for as
+// long as it is healthy)
+std::map<std::string,std::size_t> s_userNodes;
+
+// a node is considered down if we can't connect to it within a couple of
+// seconds (retrying in between so that a brief hiccup isn't fatal)
+http::ConnectionRetryProfile nodeRetryProfile()
+{
+   return http::ConnectionRetryProfile(boost::posix_time::seconds(2),
+                                       boost::posix_time::milliseconds(250));
+}
+
+Error requestNodeStatus(const Node& node, http::Response* pResponse)
+{
+   http::Request request;
+   request.setMethod("GET");
+   request.setUri(kNodeStatusUri);
+   request.setHost(node.address);
+
+   boost::asio::io_service ioService;
+   if (server::options().serverNodesSsl())
+   {
+      typedef boost::asio::ssl::stream<boost::asio::ip::tcp::socket> Socket;
+      boost::shared_ptr<http::AsyncClient<Socket> > pClient(
+            new http::TcpIpAsyncClientSsl(ioService, node.address, node.port));
+      pClient->setConnectionRetryProfile(nodeRetryProfile());
+      return http::sendRequest<Socket>(ioService, pClient, request, pResponse);
+   }
+   else
+   {
+      typedef boost::asio::ip::tcp::socket Socket;
+      boost::shared_ptr<http::AsyncClient<Socket> > pClient(
+            new http::TcpIpAsyncClient(ioService, node.address, node.port));
+      pClient->setConnectionRetryProfile(nodeRetryProfile());
+      return http::sendRequest<Socket>(ioService, pClient, request, pResponse);
+   }
+}
+
+// check the health of a node, returning its load if it is healthy
+bool checkNode(const Node& node, double* pLoad)
+{
+   http::Response response;
+   Error error = requestNodeStatus(node, &response);
+   if (error || response.statusCode() != http::status::Ok)
+      return false;
+
+   // status is reported as lines of "<name> <utilization>"
+   *pLoad = 0;
+   std::istringstream istr(response.body());
+   std::string name;
+   double value;
+   while (istr >> name >> value)
+      *pLoad = std::max(*pLoad, value);
+
+   return true;
+}
+
+void healthCheckThread()
+{
+   try
+   {
+      while (true)
+      {
+         std::vector<Node> nodes;
+         LOCK_MUTEX(s_nodesMutex)
+         {
+            nodes = s_nodes;
+         }
+         END_LOCK_MUTEX
+
+         // check the nodes outside of the lock (this can take a while if
+         // nodes are down)
+         for (std::size_t i = 0; i < nodes.size(); i++)
+         {
+            double load = 0;
+            bool healthy = checkNode(nodes[i], &load);
+            if (healthy != nodes[i].healthy)
+            {
+               boost::format fmt("Server node %1%:%2% is %3%");
+               std::string msg = boost::str(fmt % nodes[i].address %
+                                            nodes[i].port %
+                                            (healthy ? "up" : "down"));
+               if (healthy)
+                  LOG_INFO_MESSAGE(msg);
+               else
+                  LOG_WARNING_MESSAGE(msg);
+            }
+            nodes[i].healthy = healthy;
+            nodes[i].load = load;
+         }
+
+         LOCK_MUTEX(s_nodesMutex)
+         {
+            for (std::size_t i = 0; i < nodes.size(); i++)
+            {
+               s_nodes[i].healthy = nodes[i].healthy;
+               s_nodes[i].load = nodes[i].load;
+            }
+         }
+         END_LOCK_MUTEX
+
+         boost::this_thread::sleep(
+                        boost::posix_time::seconds(kHealthCheckSeconds));
+      }
+   }
+   catch(const boost::thread_interrupted&)
+   {
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+}
+
+// node for the user (placing them on the least loaded node if necessary)
+bool nodeForUser(const std::string& username, Node* pNode)
+{
+   LOCK_MUTEX(s_nodesMutex)
+   {
+      std::map<std::string,std::size_t>::const_iterator it =
+                                                s_userNodes.find(username);
+      if (it != s_userNodes.end() && s_nodes[it->second].healthy)
+      {
+         *pNode = s_nodes[it->second];
+         return true;
+      }
+
+      std::size_t best = s_nodes.size();
+      for (std::size_t i = 0; i < s_nodes.size(); i++)
+      {
+         if (s_nodes[i].healthy &&
+             (best == s_nodes.size() || s_nodes[i].load < s_nodes[best].load))
+         {
+            best = i;
+         }
+      }
+      if (best == s_nodes.size())
+         return false;
+
+      // account for the session we are about to place so that a burst of
+      // new users doesn't all land on the same node before the next check
+      s_nodes[best].load += 1.0 / 100;
+
+      s_userNodes[username] = best;
+      *pNode = s_nodes[best];
+      return true;
+   }
+   END_LOCK_MUTEX
+
+   // keep compiler happy
+   return false;
+}
+
+void handleNodeResponse(
+      boost::shared_ptr<core::http::AsyncConnection> ptrConnection,
+      const http::Response& response)
+{
+   ptrConnection->writeResponse(response);
+}
+
+template <typename Client>
+void proxyToNode(const Node& node,
+                 boost::shared_ptr<core::http::AsyncConnection> ptrConnection,
+                 const http::ErrorHandler& errorHandler)
+{
+   boost::shared_ptr<Client> pClient(new Client(ptrConnection->ioService(),
+                                                node.address,
+                                                node.port));
+   pClient->setConnectionRetryProfile(nodeRetryProfile());
+   pClient->request().assign(ptrConnection->request());
+   pClient->execute(boost::bind(handleNodeResponse, ptrConnection, _1),
+                    errorHandler);
+}
+
+} // anonymous namespace
+
+Error initialize()
+{
+   std::string nodesOption = server::options().serverNodes();
+   if (nodesOption.empty())
+      return Success();
+
+   std::vector<std::string> addresses;
+   boost::algorithm::split(addresses, nodesOption, boost::is_any_of(","));
+   BOOST_FOREACH(std::string address, addresses)
+   {
+      boost::algorithm::trim(address);
+      if (address.empty())
+         continue;
+
+      Node node;
+      std::string::size_type pos = address.rfind(':');
+      node.address = address.substr(0, pos);
+      node.port = pos != std::string::npos ? address.substr(pos + 1) : "8787";
+      s_nodes.push_back(node);
+   }
+
+   if (!s_nodes.empty())
+      core::thread::safeLaunchThread(healthCheckThread);
+
+   return Success();
+}
+
+bool enabled()
+{
+   return !s_nodes.empty();
+}
+
+void proxyRequest(const std::string& username,
+                  boost::shared_ptr<core::http::AsyncConnection> ptrConnection,
+                  const core::http::ErrorHandler& errorHandler)
+{
+   Node node;
+   if (!nodeForUser(username, &node))
+   {
+      // no healthy nodes (report as unavailable, the client will retry)
+      errorHandler(Error(boost::asio::error::connection_refused,
+                         ERROR_LOCATION));
+      return;
+   }
+
+   if (server::options().serverNodesSsl())
+      proxyToNode<http::TcpIpAsyncClientSsl>(node, ptrConnection, errorHandler);
+   else
+      proxyToNode<http::TcpIpAsyncClient>(node, ptrConnection, errorHandler);
+}
+
+void handleNodeStatusRequest(const http::Request& request,
+                             http::Response* pResponse)
+{
+   std::ostringstream ostr;
+
+   // cpu (1 minute load average relative to the number of cpus)
+   double loadAverage = 0;
+   long cpus = ::sysconf(_SC_NPROCESSORS_ONLN);
+   if (::getloadavg(&loadAverage, 1) == 1 && cpus > 0)
+      ostr << "cpu " << (loadAverage / cpus) << "\n";
+
+   // memory
+   long totalKb = 0, availableKb = 0;
+   Error error = hostMemory(&totalKb, &availableKb);
+   if (!error && totalKb > 0)
+   {
+      ostr << "memory "
+           << (static_cast<double>(totalKb - availableKb) / totalKb) << "\n";
+   }
+
+   pResponse->setNoCacheHeaders();
+   pResponse->setContentType("text/plain");
+   error = pResponse->setBody(ostr.str());
+   if (error)
+      LOG_ERROR(error);
+}
+
+} // namespace nodes
+} // namespace server
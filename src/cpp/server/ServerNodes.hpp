@@ -0,0 +1,61 @@
+/*
+ * ServerNodes.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SERVER_NODES_HPP
+#define SERVER_NODES_HPP
+
+#include <string>
+
+#include <core/http/AsyncConnection.hpp>
+#include <core/http/AsyncClient.hpp>
+
+namespace core {
+   class Error;
+   namespace http {
+      class Request;
+      class Response;
+   }
+}
+
+// Placement of sessions on other rserver nodes. When server-nodes is
+// specified this server acts as a front end: users sign in here and their
+// session requests are forwarded (over tcp or ssl) to the node they have
+// been placed on, which launches and proxies to the session as usual.
+// Nodes must share this server's secure cookie key so that they accept
+// the forwarded requests, and must have server-node-status enabled
+// so that we can check their health and load.
+
+namespace server {
+namespace nodes {
+
+core::Error initialize();
+
+// are sessions placed on other nodes?
+bool enabled();
+
+// forward a session request to the user's node (placing them on the least
+// loaded healthy node if they don't have one yet)
+void proxyRequest(const std::string& username,
+                  boost::shared_ptr<core::http::AsyncConnection> ptrConnection,
+                  const core::http::ErrorHandler& errorHandler);
+
+// health and load of this server (when it is a node)
+void handleNodeStatusRequest(const core::http::Request& request,
+                             core::http::Response* pResponse);
+
+} // namespace nodes
+} // namespace server
+
+#endif // SERVER_NODES_HPP
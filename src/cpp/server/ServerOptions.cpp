@@ -85,7 +85,22 @@ ProgramStatus Options::read(int argc, char * const argv[])
          "run program as daemon")
       ("server-app-armor-enabled",
          value<bool>(&serverAppArmorEnabled_)->default_value(1),
-         "is app armor enabled for this session");
+         "is app armor enabled for this session")
+      ("server-nodes",
+         value<std::string>(&serverNodes_)->default_value(""),
+         "rserver nodes to place sessions on (comma separated host:port)")
+      ("server-nodes-ssl",
+         value<bool>(&serverNodesSsl_)->default_value(false),
+         "connect to server-nodes using ssl")
+      ("server-node-status",
+         value<bool>(&serverNodeStatus_)->default_value(false),
+         "report load to a front rserver (when this is a server node)")
+      ("server-repos-index-urls",
+         value<std::string>(&serverReposIndexUrls_)->default_value(""),
+         "repository contrib urls to index for sessions (comma separated)")
+      ("server-repos-index-ttl-minutes",
+         value<int>(&serverReposIndexTtlMinutes_)->default_value(60),
+         "minutes between updates of repository indexes");
 
    // www - web server options
    options_description www("www") ;
@@ -101,7 +116,27 @@ ProgramStatus Options::read(int argc, char * const argv[])
          "www files path")
       ("www-thread-pool-size",
          value<int>(&wwwThreadPoolSize_)->default_value(2),
-         "thread pool size");
+         "thread pool size (per acceptor shard)")
+      ("www-metrics",
+         value<bool>(&wwwMetrics_)->default_value(false),
+         "serve request latency metrics (unauthenticated) at /metrics")
+      ("www-request-tracing",
+         value<bool>(&wwwRequestTracing_)->default_value(false),
+         "record the time spent in each stage of handling requests and "
+         "serve the spans (unauthenticated) at /trace")
+      ("www-acceptor-shards",
+         value<int>(&wwwAcceptorShards_)->default_value(1),
+         "number of independent acceptors (each with its own thread pool) "
+         "listening on the www port via SO_REUSEPORT")
+      ("www-compression-level",
+         value<int>(&wwwCompressionLevel_)->default_value(6),
+         "gzip compression level (1-9)")
+      ("www-compression-min-size",
+         value<int>(&wwwCompressionMinSize_)->default_value(1024),
+         "minimum size of responses which are compressed")
+      ("www-compression-precompressed",
+         value<bool>(&wwwCompressionPrecompressed_)->default_value(false),
+         "serve precompressed (.gz) versions of files if they exist");
 
    // rsession
    options_description rsession("rsession");
@@ -129,7 +164,34 @@ ProgramStatus Options::read(int argc, char * const argv[])
          "rsession stack limit (mb)")
       ("rsession-process-limit",
          value<int>(&rsessionUserProcessLimit_)->default_value(0),
-         "rsession user process limit");
+         "rsession user process limit")
+      ("rsession-launch-limit",
+         value<int>(&rsessionLaunchLimit_)->default_value(0),
+         "maximum number of rsessions launching concurrently")
+      ("rsession-suspend-memory-percent",
+         value<int>(&rsessionSuspendMemoryPercent_)->default_value(0),
+         "suspend idle rsessions when host memory in use exceeds this percent")
+      ("rsession-suspend-idle-minutes",
+         value<int>(&rsessionSuspendIdleMinutes_)->default_value(10),
+         "minutes without requests before an rsession may be suspended")
+      ("rsession-resident-projects",
+         value<int>(&rsessionResidentProjects_)->default_value(0),
+         "number of recent projects whose rsessions stay resident after a switch")
+      ("rsession-cgroup-root",
+         value<std::string>(&rsessionCGroupRoot_)->default_value(""),
+         "cgroup (v2) within which to create a cgroup for each rsession")
+      ("rsession-cpu-weight",
+         value<int>(&rsessionCpuWeight_)->default_value(0),
+         "rsession cgroup cpu weight (1-10000)")
+      ("rsession-memory-high-mb",
+         value<int>(&rsessionMemoryHighMb_)->default_value(0),
+         "rsession cgroup memory throttling threshold (mb)")
+      ("rsession-memory-max-mb",
+         value<int>(&rsessionMemoryMaxMb_)->default_value(0),
+         "rsession cgroup memory limit (mb)")
+      ("rsession-io-weight",
+         value<int>(&rsessionIoWeight_)->default_value(0),
+         "rsession cgroup io weight (1-10000)");
    
    // still read depracated options (so we don't break config files)
    bool deprecatedAuthPamRequiresPriv;
@@ -15,7 +15,12 @@
 #include "ServerPAMAuth.hpp"
 
 
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
 #include <core/Error.hpp>
+#include <core/Metrics.hpp>
+#include <core/Thread.hpp>
 #include <core/PeriodicCommand.hpp>
 #include <core/system/Process.hpp>
 #include <core/system/Crypto.hpp>
@@ -222,9 +227,122 @@ void publicKey(const http::Request&,
    pResponse->setContentType("text/plain");
 }
 
-void doSignIn(const http::Request& request,
-              http::Response* pResponse)
+// sign ins are authenticated by a fixed pool of worker threads (pam can be
+// slow, e.g. for kerberos or two factor auth, and we don't want it to tie
+// up the threads which serve http requests)
+const int kSignInWorkers = 4;
+const std::size_t kMaxPendingSignIns = 256;
+
+const char * const kSignInQueueMetric = "rserver_pam_sign_in_queue_wait";
+const char * const kSignInMetric = "rserver_pam_sign_in";
+
+struct SignInRequest
+{
+   boost::shared_ptr<core::http::AsyncConnection> pConnection;
+   std::string username;
+   std::string password;
+   std::string appUri;
+   bool persist;
+   boost::posix_time::ptime enqueuedAt;
+};
+
+core::thread::ThreadsafeQueue<SignInRequest> s_signInQueue;
+boost::mutex s_pendingSignInsMutex;
+std::size_t s_pendingSignIns = 0;
+
+void writeSignInError(boost::shared_ptr<core::http::AsyncConnection> pConnection,
+                      const std::string& appUri,
+                      const std::string& errorMessage)
+{
+   const http::Request& request = pConnection->request();
+   pConnection->response().setMovedTemporarily(
+            request,
+            applicationSignInURL(request, appUri, errorMessage));
+   pConnection->writeResponse();
+}
+
+// called back on the connection's io service once authentication is done
+void completeSignIn(const SignInRequest& signIn, bool authenticated)
 {
+   if (!authenticated)
+   {
+      writeSignInError(signIn.pConnection,
+                       signIn.appUri,
+                       "Incorrect or invalid username/password");
+      return;
+   }
+
+   std::string appUri = signIn.appUri;
+   if (appUri.size() > 0 && appUri[0] != '/')
+      appUri = "/" + appUri;
+
+   boost::optional<boost::gregorian::days> expiry;
+   if (signIn.persist)
+      expiry = boost::gregorian::days(3652);
+   else
+      expiry = boost::none;
+
+   const http::Request& request = signIn.pConnection->request();
+   http::Response* pResponse = &(signIn.pConnection->response());
+   auth::secure_cookie::set(kUserId,
+                            signIn.username,
+                            request,
+                            boost::posix_time::time_duration(24*3652,
+                                                             0,
+                                                             0,
+                                                             0),
+                            expiry,
+                            std::string(),
+                            pResponse);
+   pResponse->setMovedTemporarily(request, appUri);
+   signIn.pConnection->writeResponse();
+}
+
+void signInWorkerThread()
+{
+   try
+   {
+      while (true)
+      {
+         SignInRequest signIn;
+         while (s_signInQueue.deque(&signIn))
+         {
+            LOCK_MUTEX(s_pendingSignInsMutex)
+            {
+               s_pendingSignIns--;
+            }
+            END_LOCK_MUTEX
+
+            using namespace boost::posix_time;
+            ptime startTime = microsec_clock::universal_time();
+            core::metrics::recordLatency(kSignInQueueMetric, "handler",
+                                         kDoSignIn,
+                                         startTime - signIn.enqueuedAt);
+
+            bool authenticated =
+                  pamLogin(signIn.username, signIn.password) &&
+                  server::auth::validateUser(signIn.username, false);
+
+            core::metrics::recordLatencySince(kSignInMetric, "handler",
+                                              kDoSignIn, startTime);
+
+            // finish up on the io service (we don't want to touch the
+            // connection from this thread)
+            signIn.password.clear();
+            signIn.pConnection->ioService().post(
+                     boost::bind(completeSignIn, signIn, authenticated));
+         }
+
+         // (wake periodically in case we miss a notification)
+         s_signInQueue.wait(boost::posix_time::milliseconds(100));
+      }
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+}
+
+void doSignIn(boost::shared_ptr<core::http::AsyncConnection> pConnection)
+{
+   const http::Request& request = pConnection->request();
    std::string appUri = request.formFieldValue(kAppUri);
    if (appUri.empty())
       appUri = "/";
@@ -237,12 +355,9 @@ void doSignIn(const http::Request& request,
    if (error)
    {
       LOG_ERROR(error);
-      pResponse->setMovedTemporarily(
-            request,
-            applicationSignInURL(request,
-                                 appUri,
-                                 "Temporary server error,"
-                                 " please try again"));
+      writeSignInError(pConnection,
+                       appUri,
+                       "Temporary server error, please try again");
       return;
    }
 
@@ -250,50 +365,40 @@ void doSignIn(const http::Request& request,
    if (splitAt == std::string::npos)
    {
       LOG_ERROR_MESSAGE("Didn't find newline in plaintext");
-      pResponse->setMovedTemporarily(
-            request,
-            applicationSignInURL(request,
-                                 appUri,
-                                 "Temporary server error,"
-                                 " please try again"));
+      writeSignInError(pConnection,
+                       appUri,
+                       "Temporary server error, please try again");
       return;
    }
 
-   std::string username = plainText.substr(0, splitAt);
-   std::string password = plainText.substr(splitAt + 1, plainText.size());
-
-   if ( pamLogin(username, password) &&
-        server::auth::validateUser(username))
+   // turn sign ins away rather than letting the queue grow without bound
+   bool accepted = false;
+   LOCK_MUTEX(s_pendingSignInsMutex)
    {
-      if (appUri.size() > 0 && appUri[0] != '/')
-         appUri = "/" + appUri;
-
-      boost::optional<boost::gregorian::days> expiry;
-      if (persist)
-         expiry = boost::gregorian::days(3652);
-      else
-         expiry = boost::none;
-
-      auth::secure_cookie::set(kUserId,
-                               username,
-                               request,
-                               boost::posix_time::time_duration(24*3652,
-                                                                0,
-                                                                0,
-                                                                0),
-                               expiry,
-                               std::string(),
-                               pResponse);
-      pResponse->setMovedTemporarily(request, appUri);
+      if (s_pendingSignIns < kMaxPendingSignIns)
+      {
+         s_pendingSignIns++;
+         accepted = true;
+      }
    }
-   else
+   END_LOCK_MUTEX
+   if (!accepted)
    {
-      pResponse->setMovedTemporarily(
-            request,
-            applicationSignInURL(request,
-                                 appUri,
-                                 "Incorrect or invalid username/password"));
+      LOG_WARNING_MESSAGE("Too many pending sign ins");
+      writeSignInError(pConnection,
+                       appUri,
+                       "Server is busy, please try again");
+      return;
    }
+
+   SignInRequest signIn;
+   signIn.pConnection = pConnection;
+   signIn.username = plainText.substr(0, splitAt);
+   signIn.password = plainText.substr(splitAt + 1, plainText.size());
+   signIn.appUri = appUri;
+   signIn.persist = persist;
+   signIn.enqueuedAt = boost::posix_time::microsec_clock::universal_time();
+   s_signInQueue.enque(signIn);
 }
 
 void signOut(const std::string&,
@@ -321,9 +426,13 @@ Error initialize()
    auth::handler::registerHandler(pamHandler);
 
    // add pam-specific auth handlers
-   uri_handlers::addBlocking(kDoSignIn, doSignIn);
+   uri_handlers::add(kDoSignIn, doSignIn);
    uri_handlers::addBlocking(kPublicKey, publicKey);
 
+   // start the sign in workers
+   for (int i = 0; i < kSignInWorkers; i++)
+      core::thread::safeLaunchThread(signInWorkerThread);
+
    // initialize crypto
    return core::system::crypto::rsaInit();
 }
@@ -18,6 +18,7 @@
 #include <core/Error.hpp>
 #include <core/Log.hpp>
 #include <core/Thread.hpp>
+#include <core/system/PosixSystem.hpp>
 #include <core/r_util/REnvironment.hpp>
 
 #include <server/ServerOptions.hpp>
@@ -49,9 +50,17 @@ bool initialize(std::string* pErrMsg)
 
    // attempt to detect R environment
    std::string rScriptPath;
+   // cache detected locations so we don't need to run R on every startup
+   FilePath cacheFile;
+   if (core::system::effectiveUserIsRoot())
+      cacheFile = FilePath("/var/lib/rstudio-server/r-environment");
+   else
+      cacheFile = FilePath("/tmp/rstudio-server/r-environment");
+
    return r_util::detectREnvironment(rWhichRPath,
                                      rLdScriptPath,
                                      ldLibraryPath,
+                                     cacheFile,
                                      &rScriptPath,
                                      &s_rEnvironmentVars,
                                      pErrMsg);
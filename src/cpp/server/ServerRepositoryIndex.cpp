@@ -0,0 +1,269 @@
+/*
+ * ServerRepositoryIndex.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "ServerRepositoryIndex.hpp"
+
+#include <unistd.h>
+
+#include <vector>
+
+#include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string/trim.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/algorithm/string/classification.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/FilePath.hpp>
+#include <core/Thread.hpp>
+
+#include <core/system/System.hpp>
+#include <core/system/PosixSystem.hpp>
+#include <core/system/PosixUser.hpp>
+
+#include <core/http/URL.hpp>
+#include <core/http/Request.hpp>
+#include <core/http/Response.hpp>
+#include <core/http/BlockingClient.hpp>
+#include <core/http/TcpIpAsyncClient.hpp>
+#include <core/http/TcpIpAsyncClientSsl.hpp>
+#include <core/http/ConnectionRetryProfile.hpp>
+
+#include <core/r_util/RRepositoryIndex.hpp>
+
+#include <server/ServerOptions.hpp>
+
+using namespace core;
+
+namespace server {
+namespace repos_index {
+
+namespace {
+
+// number of redirects we follow when downloading a PACKAGES file
+const int kMaxRedirects = 3;
+
+FilePath s_indexDir;
+std::vector<std::string> s_contribUrls;
+
+http::ConnectionRetryProfile downloadRetryProfile()
+{
+   return http::ConnectionRetryProfile(boost::posix_time::seconds(10),
+                                       boost::posix_time::milliseconds(500));
+}
+
+Error sendRequest(const http::URL& url,
+                  const http::Request& request,
+                  http::Response* pResponse)
+{
+   boost::asio::io_service ioService;
+   if (url.protocol() == "https")
+   {
+      std::string port = url.host().find(':') != std::string::npos ?
+                     boost::lexical_cast<std::string>(url.port()) : "443";
+      typedef boost::asio::ssl::stream<boost::asio::ip::tcp::socket> Socket;
+      boost::shared_ptr<http::AsyncClient<Socket> > pClient(
+            new http::TcpIpAsyncClientSsl(ioService, url.hostname(), port));
+      pClient->setConnectionRetryProfile(downloadRetryProfile());
+      return http::sendRequest<Socket>(ioService, pClient, request, pResponse);
+   }
+   else
+   {
+      std::string port = boost::lexical_cast<std::string>(url.port());
+      typedef boost::asio::ip::tcp::socket Socket;
+      boost::shared_ptr<http::AsyncClient<Socket> > pClient(
+            new http::TcpIpAsyncClient(ioService, url.hostname(), port));
+      pClient->setConnectionRetryProfile(downloadRetryProfile());
+      return http::sendRequest<Socket>(ioService, pClient, request, pResponse);
+   }
+}
+
+Error downloadPackagesFile(const std::string& contribUrl,
+                           std::string* pContents)
+{
+   http::URL url(contribUrl + "/PACKAGES");
+   for (int i = 0; i <= kMaxRedirects; i++)
+   {
+      if (!url.isValid() ||
+          (url.protocol() != "http" && url.protocol() != "https"))
+      {
+         Error error = systemError(boost::system::errc::invalid_argument,
+                                   ERROR_LOCATION);
+         error.addProperty("url", url.absoluteURL());
+         return error;
+      }
+
+      http::Request request;
+      request.setMethod("GET");
+      request.setUri(url.path());
+      request.setHost(url.host());
+      request.setHeader("Accept", "*/*");
+      request.setHeader("Connection", "close");
+
+      http::Response response;
+      Error error = sendRequest(url, request, &response);
+      if (error)
+      {
+         error.addProperty("url", url.absoluteURL());
+         return error;
+      }
+
+      int status = response.statusCode();
+      if (status == http::status::Ok)
+      {
+         *pContents = response.body();
+         return Success();
+      }
+      else if (status == http::status::MovedPermanently ||
+               status == http::status::MovedTemporarily)
+      {
+         std::string location = response.headerValue("Location");
+         http::URL redirectUrl(location);
+         if (redirectUrl.isValid())
+            url = redirectUrl;
+         else
+            url = http::URL(http::URL::complete(url.absoluteURL(), location));
+      }
+      else
+      {
+         Error error = systemError(boost::system::errc::protocol_error,
+                                   ERROR_LOCATION);
+         error.addProperty("url", url.absoluteURL());
+         error.addProperty("status", status);
+         return error;
+      }
+   }
+
+   Error error = systemError(boost::system::errc::protocol_error,
+                             ERROR_LOCATION);
+   error.addProperty("url", contribUrl);
+   return error;
+}
+
+Error updateIndex(const std::string& contribUrl)
+{
+   std::string contents;
+   Error error = downloadPackagesFile(contribUrl, &contents);
+   if (error)
+      return error;
+
+   r_util::RRepositoryIndex index;
+   error = index.parse(contents);
+   if (error)
+      return error;
+
+   // don't replace a good index with an empty one (e.g. if a mirror
+   // returned an error page with an ok status)
+   if (index.empty())
+   {
+      LOG_WARNING_MESSAGE("No packages found at " + contribUrl);
+      return Success();
+   }
+
+   return index.writeToFile(s_indexDir.complete(
+                              r_util::repositoryIndexFilename(contribUrl)));
+}
+
+void updateIndexesThread()
+{
+   try
+   {
+      while (true)
+      {
+         BOOST_FOREACH(const std::string& contribUrl, s_contribUrls)
+         {
+            Error error = updateIndex(contribUrl);
+            if (error)
+               LOG_ERROR(error);
+         }
+
+         boost::this_thread::sleep(boost::posix_time::minutes(
+                  std::max(1, server::options().serverReposIndexTtlMinutes())));
+      }
+   }
+   catch(const boost::thread_interrupted&)
+   {
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+}
+
+} // anonymous namespace
+
+Error initialize()
+{
+   std::string urlsOption = server::options().serverReposIndexUrls();
+   std::vector<std::string> urls;
+   boost::algorithm::split(urls, urlsOption, boost::is_any_of(","));
+   BOOST_FOREACH(std::string url, urls)
+   {
+      boost::algorithm::trim(url);
+      while (boost::algorithm::ends_with(url, "/"))
+         url.erase(url.size() - 1);
+      if (!url.empty())
+         s_contribUrls.push_back(url);
+   }
+   if (s_contribUrls.empty())
+      return Success();
+
+   FilePath indexDir;
+   if (core::system::effectiveUserIsRoot())
+      indexDir = FilePath("/var/lib/rstudio-server/repos-index");
+   else
+      indexDir = FilePath("/tmp/rstudio-server/repos-index");
+   Error error = indexDir.ensureDirectory();
+   if (error)
+      return error;
+
+   // the directory is readable by everyone but writeable only by the user
+   // we run as (after dropping privilege)
+   std::string serverUser = server::options().serverUser();
+   if (core::system::effectiveUserIsRoot() && !serverUser.empty())
+   {
+      core::system::user::User user;
+      error = core::system::user::userFromUsername(serverUser, &user);
+      if (error)
+         return error;
+
+      if (::chown(indexDir.absolutePath().c_str(),
+                  user.userId,
+                  user.groupId) == -1)
+      {
+         error = systemError(errno, ERROR_LOCATION);
+         error.addProperty("path", indexDir.absolutePath());
+         return error;
+      }
+   }
+   if (::chmod(indexDir.absolutePath().c_str(), 0755) == -1)
+   {
+      error = systemError(errno, ERROR_LOCATION);
+      error.addProperty("path", indexDir.absolutePath());
+      return error;
+   }
+
+   s_indexDir = indexDir;
+   core::thread::safeLaunchThread(updateIndexesThread);
+
+   return Success();
+}
+
+std::string indexDir()
+{
+   return s_indexDir.empty() ? std::string() : s_indexDir.absolutePath();
+}
+
+} // namespace repos_index
+} // namespace server
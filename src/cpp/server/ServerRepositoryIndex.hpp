@@ -0,0 +1,45 @@
+/*
+ * ServerRepositoryIndex.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SERVER_REPOSITORY_INDEX_HPP
+#define SERVER_REPOSITORY_INDEX_HPP
+
+#include <string>
+
+namespace core {
+   class Error;
+}
+
+// Shared indexes of the packages available from repositories. When
+// server-repos-index-urls is specified we download the PACKAGES file for
+// each of the contrib urls once per server-repos-index-ttl-minutes and
+// write a pre-parsed index of it to a directory which sessions read from
+// (rather than each session downloading and parsing the file itself).
+// Only the server user can write to the directory so that users can't
+// substitute an index for their own purposes.
+
+namespace server {
+namespace repos_index {
+
+// (must be called before root privilege is dropped)
+core::Error initialize();
+
+// directory sessions read indexes from (empty if indexing is disabled)
+std::string indexDir();
+
+} // namespace repos_index
+} // namespace server
+
+#endif // SERVER_REPOSITORY_INDEX_HPP
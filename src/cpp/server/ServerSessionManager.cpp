@@ -16,15 +16,23 @@
 #include "ServerSessionManager.hpp"
 
 #include <sys/wait.h>
+#include <signal.h>
+#include <unistd.h>
 
 #include <vector>
+#include <sstream>
+#include <algorithm>
 
 #include <boost/foreach.hpp>
 #include <boost/format.hpp>
+#include <boost/algorithm/string/trim.hpp>
+#include <boost/algorithm/string/predicate.hpp>
 
 #include <core/Error.hpp>
 #include <core/Log.hpp>
 #include <core/SafeConvert.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/Metrics.hpp>
 #include <core/system/PosixSystem.hpp>
 #include <core/system/PosixUser.hpp>
 #include <core/system/Environment.hpp>
@@ -37,6 +45,7 @@
 #include <server/auth/ServerValidateUser.hpp>
 
 #include "ServerREnvironment.hpp"
+#include "ServerRepositoryIndex.hpp"
 
 
 using namespace core;
@@ -77,6 +86,17 @@ Error SessionManager::launchSession(const std::string& username)
          }
       }
 
+      // if too many sessions are already starting up then defer this
+      // launch (the proxy calls us again each time it retries connecting
+      // to the session). this keeps a burst of logins from starting every
+      // session at once, which would slow all of them down
+      int launchLimit = server::options().rsessionLaunchLimit();
+      if (launchLimit > 0 &&
+          activeLaunches() >= static_cast<std::size_t>(launchLimit))
+      {
+         return Success();
+      }
+
       // record the launch
       pendingLaunches_[username] =  microsec_clock::universal_time();
    }
@@ -93,13 +113,30 @@ Error SessionManager::launchSession(const std::string& username)
    else
    {
       // add it to our active pids
-      addActivePid(pid);
+      addActivePid(pid, username);
 
       // return success
       return Success();
    }
 }
 
+// number of launches which are underway (launches which haven't completed
+// within a minute are treated as abandoned). must be called with the
+// launchesMutex_ held
+std::size_t SessionManager::activeLaunches() const
+{
+   using namespace boost::posix_time;
+   ptime cutoff = microsec_clock::universal_time() - minutes(1);
+   std::size_t count = 0;
+   for (LaunchMap::const_iterator it = pendingLaunches_.begin();
+        it != pendingLaunches_.end(); ++it)
+   {
+      if (it->second > cutoff)
+         count++;
+   }
+   return count;
+}
+
 void SessionManager::removePendingLaunch(const std::string& username)
 {
    LOCK_MUTEX(launchesMutex_)
@@ -127,90 +164,441 @@ int waitPid(PidType pid, int* pStatus)
 
 void SessionManager::notifySIGCHLD()
 {
-   // We make a copy of hte active pids so that we can do the reaping
-   // outside of the pidsMutex_. This is an extra conservative precaution
-   // in case there is ever an issue with waitpid blocking.
-   std::vector<PidType> pids = activePids();
-
-   // reap all that we can
-   BOOST_FOREACH(PidType pid, pids)
+   // signals coalesce so a single SIGCHLD may stand for any number of
+   // exits. rather than trying each of our pids we ask which children have
+   // exited, peeking (WNOWAIT) rather than reaping since some children
+   // aren't ours to reap (e.g. the pam helper, whose launcher waits on it)
+   for (;;)
    {
-      // non-blocking wait for the child
-      int status;
-      int result = waitPid(pid, &status);
+      siginfo_t info;
+      ::memset(&info, 0, sizeof(info));
+      int result = ::waitid(P_ALL, 0, &info, WEXITED | WNOHANG | WNOWAIT);
+      if (result == -1)
+      {
+         if (errno == EINTR)
+            continue;
+         else if (errno != ECHILD)
+            LOG_ERROR(systemError(errno, ERROR_LOCATION));
+         return;
+      }
+
+      // no more exited children
+      if (info.si_pid == 0)
+         return;
 
-      // reaped the child
-      if (result == pid)
+      if (isActivePid(info.si_pid))
       {
-         // confirm this was a real exit
-         bool exited = false;
-         if (WIFEXITED(status))
-         {
-            exited = true;
-            status = WEXITSTATUS(status);
-         }
-         else if (WIFSIGNALED(status))
+         reapChild(info.si_pid);
+      }
+      else
+      {
+         // an exited child which isn't ours hides any others behind it
+         // until its launcher reaps it, so fall back to trying each of
+         // our pids (we make a copy so that we can do the reaping outside
+         // of the pidsMutex_)
+         BOOST_FOREACH(PidType pid, activePids())
          {
-            exited = true;
+            reapChild(pid);
          }
+         return;
+      }
+   }
+}
 
-         // if it was a real exit (as opposed to a SIGSTOP or SIGCONT)
-         // then remove the pid from our table and fire the event
-         if (exited)
-         {
-            // all done with this pid
-            removeActivePid(pid);
-         }
-         else
-         {
-            boost::format fmt("Received SIGCHLD when child did not "
-                              "actually exit (pid=%1%, status=%2%");
-            LOG_WARNING_MESSAGE(boost::str(fmt % pid % status));
-         }
+void SessionManager::reapChild(PidType pid)
+{
+   // non-blocking wait for the child
+   int status;
+   int result = waitPid(pid, &status);
+
+   // reaped the child
+   if (result == pid)
+   {
+      // confirm this was a real exit
+      bool exited = false;
+      if (WIFEXITED(status))
+      {
+         exited = true;
+         status = WEXITSTATUS(status);
       }
-      // error occured
-      else if (result == -1)
+      else if (WIFSIGNALED(status))
       {
-         Error error = systemError(errno, ERROR_LOCATION);
-         error.addProperty("pid", pid);
-         LOG_ERROR(error);
+         exited = true;
+      }
+
+      // if it was a real exit (as opposed to a SIGSTOP or SIGCONT)
+      // then remove the pid from our table and fire the event
+      if (exited)
+      {
+         // all done with this pid
+         removeActivePid(pid);
       }
+      else
+      {
+         boost::format fmt("Received SIGCHLD when child did not "
+                           "actually exit (pid=%1%, status=%2%");
+         LOG_WARNING_MESSAGE(boost::str(fmt % pid % status));
+      }
+   }
+   // error occured
+   else if (result == -1)
+   {
+      Error error = systemError(errno, ERROR_LOCATION);
+      error.addProperty("pid", pid);
+      LOG_ERROR(error);
    }
 }
 
-void SessionManager::addActivePid(PidType pid)
+void SessionManager::addActivePid(PidType pid, const std::string& username)
 {
    LOCK_MUTEX(pidsMutex_)
    {
-      activePids_.push_back(pid);
+      pidUsers_[pid] = username;
    }
    END_LOCK_MUTEX
+
+   // a newly launched session counts as active
+   notifyActivity(username);
 }
 
 void SessionManager::removeActivePid(PidType pid)
+{
+   std::string username;
+   LOCK_MUTEX(pidsMutex_)
+   {
+      PidUserMap::iterator it = pidUsers_.find(pid);
+      if (it != pidUsers_.end())
+      {
+         username = it->second;
+         pidUsers_.erase(it);
+      }
+   }
+   END_LOCK_MUTEX
+
+   // stop reporting usage for the session
+   if (!username.empty())
+   {
+      metrics::removeGauge("rserver_session_memory_bytes", username);
+      metrics::removeGauge("rserver_session_cpu_seconds", username);
+   }
+}
+
+bool SessionManager::isActivePid(PidType pid)
 {
    LOCK_MUTEX(pidsMutex_)
    {
-      activePids_.erase(std::remove(activePids_.begin(),
-                                    activePids_.end(),
-                                    pid),
-                        activePids_.end());
+      return pidUsers_.find(pid) != pidUsers_.end();
    }
    END_LOCK_MUTEX
+
+   // keep compiler happy
+   return false;
 }
 
 std::vector<PidType> SessionManager::activePids()
 {
+   std::vector<PidType> pids;
    LOCK_MUTEX(pidsMutex_)
    {
-      return activePids_;
+      pids.reserve(pidUsers_.size());
+      for (PidUserMap::const_iterator it = pidUsers_.begin();
+           it != pidUsers_.end(); ++it)
+      {
+         pids.push_back(it->first);
+      }
    }
    END_LOCK_MUTEX
 
+   return pids;
+
    // keep compiler happy
    return std::vector<PidType>();
 }
 
+void SessionManager::notifyActivity(const std::string& username)
+{
+   using namespace boost::posix_time;
+   LOCK_MUTEX(activityMutex_)
+   {
+      lastActivity_[username] = microsec_clock::universal_time();
+   }
+   END_LOCK_MUTEX
+}
+
+namespace {
+
+// read a field (in kB) from /proc/meminfo
+bool readMemInfoField(const std::string& memInfo,
+                      const std::string& field,
+                      long* pValueKb)
+{
+   std::string::size_type pos = memInfo.find(field + ":");
+   if (pos == std::string::npos)
+      return false;
+
+   pos += field.length() + 1;
+   std::string::size_type endPos = memInfo.find('\n', pos);
+   std::string value = boost::algorithm::trim_copy(
+            memInfo.substr(pos, endPos == std::string::npos ?
+                                   std::string::npos : endPos - pos));
+   if (boost::algorithm::ends_with(value, "kB"))
+      value = boost::algorithm::trim_copy(value.substr(0, value.length() - 2));
+
+   *pValueKb = safe_convert::stringTo<long>(value, -1);
+   return *pValueKb >= 0;
+}
+
+} // anonymous namespace
+
+Error hostMemory(long* pTotalKb, long* pAvailableKb)
+{
+   std::string memInfo;
+   Error error = readStringFromFile(FilePath("/proc/meminfo"), &memInfo);
+   if (error)
+      return error;
+
+   if (!readMemInfoField(memInfo, "MemTotal", pTotalKb))
+      return systemError(boost::system::errc::protocol_error, ERROR_LOCATION);
+
+   // MemAvailable is only reported by newer kernels, approximate it
+   // with free memory plus the page cache otherwise
+   if (!readMemInfoField(memInfo, "MemAvailable", pAvailableKb))
+   {
+      long freeKb = 0, cachedKb = 0;
+      if (!readMemInfoField(memInfo, "MemFree", &freeKb) ||
+          !readMemInfoField(memInfo, "Cached", &cachedKb))
+      {
+         return systemError(boost::system::errc::protocol_error,
+                            ERROR_LOCATION);
+      }
+      *pAvailableKb = freeKb + cachedKb;
+   }
+
+   return Success();
+}
+
+namespace {
+
+// resident memory of a process (from the second field of /proc/<pid>/statm)
+Error processResidentKb(PidType pid, long* pResidentKb)
+{
+   std::string statm;
+   FilePath statmPath("/proc/" + safe_convert::numberToString(pid) + "/statm");
+   Error error = readStringFromFile(statmPath, &statm);
+   if (error)
+      return error;
+
+   std::istringstream istr(statm);
+   long sizePages = 0, residentPages = 0;
+   if (!(istr >> sizePages >> residentPages))
+      return systemError(boost::system::errc::protocol_error, ERROR_LOCATION);
+
+   *pResidentKb = residentPages * (::sysconf(_SC_PAGESIZE) / 1024);
+   return Success();
+}
+
+// is this a session parked after a project switch (rsession renames
+// itself while parked)
+bool isParkedSession(PidType pid)
+{
+   std::string comm;
+   FilePath commPath("/proc/" + safe_convert::numberToString(pid) + "/comm");
+   Error error = readStringFromFile(commPath, &comm);
+   if (error)
+      return false;
+
+   return boost::algorithm::trim_copy(comm) == kParkedSessionProcessName;
+}
+
+// send a signal to a session. sessions run as other users so we need root
+// to signal them -- rather than restoring root in this (multi-threaded)
+// process we do it within a short-lived child
+Error signalSession(PidType pid, int sig)
+{
+   if (!core::system::realUserIsRoot())
+   {
+      if (::kill(pid, sig) == -1)
+         return systemError(errno, ERROR_LOCATION);
+      return Success();
+   }
+
+   PidType child = ::fork();
+   if (child == -1)
+      return systemError(errno, ERROR_LOCATION);
+
+   if (child == 0)
+   {
+      if (core::system::restorePriv())
+         ::_exit(EXIT_FAILURE);
+      ::_exit(::kill(pid, sig) == -1 ? EXIT_FAILURE : EXIT_SUCCESS);
+   }
+
+   int status = 0;
+   while (::waitpid(child, &status, 0) == -1)
+   {
+      if (errno != EINTR)
+         return systemError(errno, ERROR_LOCATION);
+   }
+
+   if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+   {
+      Error error = systemError(boost::system::errc::operation_not_permitted,
+                                ERROR_LOCATION);
+      error.addProperty("pid", pid);
+      return error;
+   }
+
+   return Success();
+}
+
+} // anonymous namespace
+
+bool SessionManager::suspendIdleSessions()
+{
+   using namespace boost::posix_time;
+
+   int watermark = server::options().rsessionSuspendMemoryPercent();
+   if (watermark <= 0)
+      return true;
+
+   long totalKb = 0, availableKb = 0;
+   Error error = hostMemory(&totalKb, &availableKb);
+   if (error || totalKb <= 0)
+      return true;
+
+   // nothing to do unless we are above the watermark
+   long targetUsedKb = (totalKb / 100) * watermark;
+   long excessKb = (totalKb - availableKb) - targetUsedKb;
+   if (excessKb <= 0)
+      return true;
+
+   // collect sessions which have been idle long enough (oldest first).
+   // sessions parked after a project switch aren't serving their user so
+   // they always go first, whatever the user's recent activity
+   ptime idleCutoff = microsec_clock::universal_time() -
+                      minutes(server::options().rsessionSuspendIdleMinutes());
+   std::vector<std::pair<ptime,PidType> > candidates;
+   PidUserMap pidUsers;
+   LOCK_MUTEX(pidsMutex_)
+   {
+      pidUsers = pidUsers_;
+   }
+   END_LOCK_MUTEX
+   PidUserMap activePidUsers;
+   for (PidUserMap::const_iterator it = pidUsers.begin();
+        it != pidUsers.end(); ++it)
+   {
+      if (isParkedSession(it->first))
+         candidates.push_back(std::make_pair(ptime(min_date_time), it->first));
+      else
+         activePidUsers.insert(*it);
+   }
+   LOCK_MUTEX(activityMutex_)
+   {
+      for (PidUserMap::const_iterator it = activePidUsers.begin();
+           it != activePidUsers.end(); ++it)
+      {
+         std::map<std::string,ptime>::const_iterator activity =
+                                             lastActivity_.find(it->second);
+         ptime lastActivity = activity != lastActivity_.end() ?
+                                 activity->second : ptime(min_date_time);
+         if (lastActivity < idleCutoff)
+            candidates.push_back(std::make_pair(lastActivity, it->first));
+      }
+   }
+   END_LOCK_MUTEX
+   std::sort(candidates.begin(), candidates.end());
+
+   // ask sessions to suspend until we expect to be back under the watermark
+   // (SIGUSR1 is a cooperative suspend, so a busy session will carry on and
+   // be asked again next time around). suspended sessions resume on their
+   // user's next request
+   long freedKb = 0;
+   for (std::size_t i = 0; i < candidates.size() && freedKb < excessKb; i++)
+   {
+      PidType pid = candidates[i].second;
+
+      long residentKb = 0;
+      if (processResidentKb(pid, &residentKb))
+         continue;
+
+      error = signalSession(pid, SIGUSR1);
+      if (error)
+      {
+         LOG_ERROR(error);
+         continue;
+      }
+
+      boost::format fmt("Requested suspend of idle session for %1% "
+                        "(pid=%2%, resident=%3%kB) due to memory pressure");
+      LOG_INFO_MESSAGE(boost::str(fmt % pidUsers[pid] % pid % residentKb));
+
+      freedKb += residentKb;
+   }
+
+   return true;
+}
+
+bool SessionManager::updateSessionMetrics()
+{
+   PidUserMap pidUsers;
+   LOCK_MUTEX(pidsMutex_)
+   {
+      pidUsers = pidUsers_;
+   }
+   END_LOCK_MUTEX
+
+   for (PidUserMap::const_iterator it = pidUsers.begin();
+        it != pidUsers.end(); ++it)
+   {
+      const std::string& username = it->second;
+      FilePath cgroup(sessionCGroupPath(username));
+      if (cgroup.empty())
+         return true;
+
+      // memory in use (bytes)
+      std::string memory;
+      Error error = readStringFromFile(cgroup.childPath("memory.current"),
+                                       &memory);
+      if (!error)
+      {
+         double bytes = safe_convert::stringTo<double>(
+                              boost::algorithm::trim_copy(memory), -1);
+         if (bytes >= 0)
+            metrics::setGauge("rserver_session_memory_bytes", "user",
+                              username, bytes);
+      }
+
+      // cpu time consumed (from the usage_usec line of cpu.stat)
+      std::string cpuStat;
+      error = readStringFromFile(cgroup.childPath("cpu.stat"), &cpuStat);
+      if (!error)
+      {
+         std::istringstream istr(cpuStat);
+         std::string key;
+         double value;
+         while (istr >> key >> value)
+         {
+            if (key == "usage_usec")
+            {
+               metrics::setGauge("rserver_session_cpu_seconds", "user",
+                                 username, value / 1000000.0);
+               break;
+            }
+         }
+      }
+   }
+
+   return true;
+}
+
+std::string sessionCGroupPath(const std::string& username)
+{
+   std::string root = server::options().rsessionCGroupRoot();
+   if (root.empty() || !core::system::realUserIsRoot())
+      return std::string();
+   return FilePath(root).childPath("rsession-" + username).absolutePath();
+}
 
 Error launchSession(const std::string& username,
                     const core::system::Options& extraArgs,
@@ -245,6 +633,19 @@ Error launchSession(const std::string& username,
    if (!timeout.empty())
       args.push_back(std::make_pair("--" kTimeoutSessionOption, timeout));
 
+   // point the session at shared repository indexes
+   std::string reposIndexDir = repos_index::indexDir();
+   if (!reposIndexDir.empty())
+      args.push_back(std::make_pair("--" kReposIndexDirSessionOption,
+                                    reposIndexDir));
+
+   // keep sessions for recent projects resident across project switches
+   int residentProjects = server::options().rsessionResidentProjects();
+   if (residentProjects > 0)
+      args.push_back(std::make_pair(
+                        "--" kResidentProjectsSessionOption,
+                        safe_convert::numberToString(residentProjects)));
+
    // pass our uid to instruct rsession to limit rpc clients to us and itself
    core::system::Options environment;
    uid_t uid = core::system::user::currentUserIdentity().userId;
@@ -272,6 +673,40 @@ Error launchSession(const std::string& username,
                                options.rsessionStackLimitMb() * 1024L * 1024L);
    config.userProcessesLimit = static_cast<RLimitType>(
                                options.rsessionUserProcessLimit());
+
+   // put the session (and everything it starts) in its own cgroup so that
+   // one user can't starve the others
+   config.cgroupPath = sessionCGroupPath(username);
+   if (!config.cgroupPath.empty())
+   {
+      if (options.rsessionCpuWeight() > 0)
+      {
+         config.cgroupSettings.push_back(std::make_pair(
+               "cpu.weight",
+               safe_convert::numberToString(options.rsessionCpuWeight())));
+      }
+      if (options.rsessionIoWeight() > 0)
+      {
+         config.cgroupSettings.push_back(std::make_pair(
+               "io.weight",
+               safe_convert::numberToString(options.rsessionIoWeight())));
+      }
+      if (options.rsessionMemoryHighMb() > 0)
+      {
+         config.cgroupSettings.push_back(std::make_pair(
+               "memory.high",
+               safe_convert::numberToString(options.rsessionMemoryHighMb())
+                  + "M"));
+      }
+      if (options.rsessionMemoryMaxMb() > 0)
+      {
+         config.cgroupSettings.push_back(std::make_pair(
+               "memory.max",
+               safe_convert::numberToString(options.rsessionMemoryMaxMb())
+                  + "M"));
+      }
+   }
+
    return core::system::launchChildProcess(options.rsessionPath(),
                                            runAsUser,
                                            config,
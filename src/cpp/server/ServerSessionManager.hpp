@@ -21,6 +21,7 @@
 #include <map>
 
 #include <boost/signals.hpp>
+#include <boost/unordered_map.hpp>
 
 #include <core/Thread.hpp>
 #include <core/system/PosixSystem.hpp>
@@ -54,22 +55,51 @@ public:
    // notificatio that a SIGCHLD was received
    void notifySIGCHLD();
 
+   // notification that a user's session received a request (used to
+   // determine which sessions are idle)
+   void notifyActivity(const std::string& username);
+
+   // ask the least recently used idle sessions to suspend when the host
+   // is low on memory (scheduled periodically, always returns true)
+   bool suspendIdleSessions();
+
+   // publish the resource usage of each session's cgroup as metrics
+   // (scheduled periodically, always returns true)
+   bool updateSessionMetrics();
+
 private:
-   void addActivePid(PidType pid);
+   std::size_t activeLaunches() const;
+
+   void addActivePid(PidType pid, const std::string& username);
    void removeActivePid(PidType pid);
+   bool isActivePid(PidType pid);
    std::vector<PidType> activePids();
 
+   void reapChild(PidType pid);
+
 private:
    // pending launches
    boost::mutex launchesMutex_;
    typedef std::map<std::string,boost::posix_time::ptime> LaunchMap;
    LaunchMap pendingLaunches_;
 
-   // pids we have launched
+   // pids we have launched (and the users they were launched for)
+   typedef boost::unordered_map<PidType,std::string> PidUserMap;
    boost::mutex pidsMutex_;
-   std::vector<PidType> activePids_;
+   PidUserMap pidUsers_;
+
+   // time of the most recent request for each user's session
+   boost::mutex activityMutex_;
+   std::map<std::string,boost::posix_time::ptime> lastActivity_;
 };
 
+// total and available memory on the host (linux only, other platforms
+// return an error and idle sessions are simply never suspended)
+core::Error hostMemory(long* pTotalKb, long* pAvailableKb);
+
+// cgroup for a user's session (empty if sessions don't have cgroups)
+std::string sessionCGroupPath(const std::string& username);
+
 // Lower-level global functions for launching sessions. These are used
 // internally by the SessionManager as well as for verify-installation
 //
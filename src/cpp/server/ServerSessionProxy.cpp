@@ -18,6 +18,7 @@
 #include <vector>
 #include <sstream>
 #include <map>
+#include <deque>
 
 #include <boost/date_time/posix_time/posix_time.hpp>
 
@@ -27,10 +28,16 @@
 
 #include <boost/algorithm/string/predicate.hpp>
 
+#include <boost/array.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/enable_shared_from_this.hpp>
+
 #include <core/Error.hpp>
 #include <core/BoostErrors.hpp>
 #include <core/Log.hpp>
 #include <core/Thread.hpp>
+#include <core/Trace.hpp>
 #include <core/WaitUtils.hpp>
 
 #include <core/http/SocketUtils.hpp>
@@ -38,6 +45,7 @@
 #include <core/http/Response.hpp>
 #include <core/http/LocalStreamAsyncClient.hpp>
 #include <core/http/Util.hpp>
+#include <core/http/WebSocket.hpp>
 #include <core/system/PosixSystem.hpp>
 #include <core/system/PosixUser.hpp>
 
@@ -50,6 +58,7 @@
 
 #include <server/ServerOptions.hpp>
 
+#include "ServerNodes.hpp"
 #include "ServerSessionManager.hpp"
 
 using namespace core ;
@@ -59,6 +68,22 @@ namespace session_proxy {
    
 namespace {
 
+// pool of kept-alive connections to user sessions. we retain a small
+// number of idle connections per user (enough to cover the concurrent
+// rpc and content requests typically made by a client) and close them
+// after a minute of inactivity
+typedef http::AsyncClientPool<http::LocalStreamAsyncClient> SessionClientPool;
+const std::size_t kMaxIdleConnectionsPerUser = 4;
+const int kIdleConnectionTimeoutSeconds = 60;
+
+SessionClientPool& sessionClientPool()
+{
+   static SessionClientPool instance(
+                  kMaxIdleConnectionsPerUser,
+                  boost::posix_time::seconds(kIdleConnectionTimeoutSeconds));
+   return instance;
+}
+
 void launchSessionRecovery(const std::string& username)
 {
    Error error = sessionManager().launchSession(username);
@@ -81,13 +106,24 @@ http::ConnectionRetryProfile sessionRetryProfile(const std::string& username)
 void handleProxyResponse(
       boost::shared_ptr<core::http::AsyncConnection> ptrConnection,
       std::string username,
+      boost::shared_ptr<http::LocalStreamAsyncClient> pClient,
+      boost::posix_time::ptime proxyStartTime,
       const http::Response& response)
 {
+   // time spent connecting to the session and waiting for it to respond
+   // (the session records its own spans for the latter)
+   trace::recordSpanSince(trace::traceId(ptrConnection->request()),
+                          "proxy",
+                          proxyStartTime);
+
    // if there was a launch pending then remove it
    sessionManager().removePendingLaunch(username);
 
-   // write the response
+   // write the response (copies it so the client is free to be reused)
    ptrConnection->writeResponse(response);
+
+   // return the client to the pool (no-op if the connection was closed)
+   sessionClientPool().checkin(username, pClient);
 }
 
 
@@ -188,23 +224,42 @@ void proxyRequest(
       const http::ConnectionRetryProfile& connectionRetryProfile =
                                              http::ConnectionRetryProfile())
 {
-   // calculate stream path
-   FilePath streamPath = session::local_streams::streamPath(username);
+   // sessions live on other nodes when this is a front end server
+   if (nodes::enabled())
+   {
+      nodes::proxyRequest(username, ptrConnection, errorHandler);
+      return;
+   }
 
-   // create async client
-   boost::shared_ptr<http::LocalStreamAsyncClient> pClient(
-    new http::LocalStreamAsyncClient(ptrConnection->ioService(), streamPath));
+   // use an existing kept-alive connection if one is available
+   boost::shared_ptr<http::LocalStreamAsyncClient> pClient =
+                                    sessionClientPool().checkout(username);
+   if (!pClient)
+   {
+      // calculate stream path
+      FilePath streamPath = session::local_streams::streamPath(username);
 
-   // setup retry context
-   if (!connectionRetryProfile.empty())
-      pClient->setConnectionRetryProfile(connectionRetryProfile);
+      // create async client
+      pClient.reset(new http::LocalStreamAsyncClient(
+                                    ptrConnection->ioService(), streamPath));
+      pClient->setKeepAlive(true);
+   }
+
+   // setup retry context (always set so that a pooled client doesn't
+   // carry over the profile used for a previous request)
+   pClient->setConnectionRetryProfile(connectionRetryProfile);
 
    // assign request
    pClient->request().assign(ptrConnection->request());
 
    // execute
    pClient->execute(
-         boost::bind(handleProxyResponse, ptrConnection, username, _1),
+         boost::bind(handleProxyResponse,
+                     ptrConnection,
+                     username,
+                     pClient,
+                     boost::posix_time::microsec_clock::universal_time(),
+                     _1),
          errorHandler);
 }
 
@@ -237,6 +292,414 @@ bool validateUser(boost::shared_ptr<http::AsyncConnection> ptrConnection,
    }
 }
 
+// tunnel between a client's event stream (websocket) connection and the
+// user's session. the upgrade request is forwarded to the session and
+// from then on the bytes going in each direction are passed through as-is
+class EventStreamTunnel
+   : public boost::enable_shared_from_this<EventStreamTunnel>,
+     boost::noncopyable
+{
+public:
+   static void create(const std::string& username,
+                      boost::shared_ptr<http::AsyncConnection> ptrConnection)
+   {
+      boost::shared_ptr<EventStreamTunnel> pTunnel(
+                     new EventStreamTunnel(username, ptrConnection));
+      pTunnel->connect();
+   }
+
+private:
+   EventStreamTunnel(const std::string& username,
+                     boost::shared_ptr<http::AsyncConnection> ptrConnection)
+      : username_(username),
+        ptrConnection_(ptrConnection),
+        socket_(ptrConnection->ioService()),
+        closed_(false)
+   {
+   }
+
+   void connect()
+   {
+      using boost::asio::local::stream_protocol;
+      FilePath streamPath = session::local_streams::streamPath(username_);
+      stream_protocol::endpoint endpoint(streamPath.absolutePath());
+      socket_.async_connect(endpoint,
+                            boost::bind(&EventStreamTunnel::handleConnect,
+                                        shared_from_this(),
+                                        boost::asio::placeholders::error));
+   }
+
+   void handleConnect(const boost::system::error_code& ec)
+   {
+      try
+      {
+         if (ec)
+         {
+            // event streams don't initiate session launches so just let
+            // the client know the session isn't available (it will fall
+            // back to polling for events)
+            Error error(ec, ERROR_LOCATION);
+            if (!http::isConnectionUnavailableError(error))
+               logIfNotConnectionTerminated(error, ptrConnection_->request());
+
+            http::Response& response = ptrConnection_->response();
+            response.setStatusCode(http::status::ServiceUnavailable);
+            ptrConnection_->writeResponse();
+            ptrConnection_.reset();
+            return;
+         }
+
+         // forward the upgrade request
+         std::vector<boost::asio::const_buffer> buffers =
+               ptrConnection_->request().toBuffers(http::Header());
+         for (std::size_t i = 0; i < buffers.size(); i++)
+         {
+            request_.append(boost::asio::buffer_cast<const char*>(buffers[i]),
+                            boost::asio::buffer_size(buffers[i]));
+         }
+         boost::asio::async_write(
+                     socket_,
+                     boost::asio::buffer(request_),
+                     boost::bind(&EventStreamTunnel::handleRequestWritten,
+                                 shared_from_this(),
+                                 boost::asio::placeholders::error));
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
+   void handleRequestWritten(const boost::system::error_code& ec)
+   {
+      try
+      {
+         if (ec)
+         {
+            logIfNotConnectionTerminated(Error(ec, ERROR_LOCATION),
+                                         ptrConnection_->request());
+            ptrConnection_->writeError(Error(ec, ERROR_LOCATION));
+            close();
+            ptrConnection_.reset();
+            return;
+         }
+
+         // pass data through in both directions
+         ptrConnection_->startStreaming(
+               boost::bind(&EventStreamTunnel::onClientData,
+                           shared_from_this(), _1, _2),
+               boost::bind(&EventStreamTunnel::onClientClosed,
+                           shared_from_this()));
+         readSession();
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
+   void readSession()
+   {
+      socket_.async_read_some(
+            boost::asio::buffer(buffer_),
+            boost::bind(&EventStreamTunnel::handleSessionRead,
+                        shared_from_this(),
+                        boost::asio::placeholders::error,
+                        boost::asio::placeholders::bytes_transferred));
+   }
+
+   void handleSessionRead(const boost::system::error_code& ec,
+                          std::size_t bytesTransferred)
+   {
+      try
+      {
+         if (!ec)
+         {
+            ptrConnection_->writeStreamData(
+                        std::string(buffer_.data(), bytesTransferred));
+            readSession();
+         }
+         else
+         {
+            // the session closed its end (or we closed it because the
+            // client went away) so close the client's end too
+            close();
+            ptrConnection_->closeStream();
+            ptrConnection_.reset();
+         }
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
+   void onClientData(const char* data, std::size_t size)
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         if (closed_)
+            return;
+
+         // writes are queued so that only one is outstanding at a time
+         writes_.push_back(std::string(data, size));
+         if (writes_.size() == 1)
+            writeNext();
+      }
+      END_LOCK_MUTEX
+   }
+
+   void onClientClosed()
+   {
+      // closing our end aborts the outstanding read from the session
+      close();
+   }
+
+   // NOTE: must be called with mutex_ held
+   void writeNext()
+   {
+      boost::asio::async_write(
+                     socket_,
+                     boost::asio::buffer(writes_.front()),
+                     boost::bind(&EventStreamTunnel::handleSessionWrite,
+                                 shared_from_this(),
+                                 boost::asio::placeholders::error));
+   }
+
+   void handleSessionWrite(const boost::system::error_code& ec)
+   {
+      try
+      {
+         LOCK_MUTEX(mutex_)
+         {
+            if (ec)
+            {
+               doClose();
+               return;
+            }
+
+            if (!writes_.empty())
+               writes_.pop_front();
+            if (!writes_.empty() && !closed_)
+               writeNext();
+         }
+         END_LOCK_MUTEX
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
+   void close()
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         doClose();
+      }
+      END_LOCK_MUTEX
+   }
+
+   // NOTE: must be called with mutex_ held
+   void doClose()
+   {
+      if (closed_)
+         return;
+
+      closed_ = true;
+      writes_.clear();
+      Error error = http::closeSocket(socket_);
+      if (error)
+         LOG_ERROR(error);
+   }
+
+private:
+   std::string username_;
+   boost::shared_ptr<http::AsyncConnection> ptrConnection_;
+   boost::asio::local::stream_protocol::socket socket_;
+   std::string request_;
+   boost::array<char, 8192> buffer_;
+   boost::mutex mutex_;
+   std::deque<std::string> writes_;
+   bool closed_;
+};
+
+// content requests which can produce large responses (exports, file
+// downloads, pdfs) -- these are streamed rather than buffered
+bool isLargeContentRequest(const http::Request& request)
+{
+   if (request.method() != "GET")
+      return false;
+
+   const char * const kPrefixes[] = { "/export/", "/files/",
+                                      "/file_show", "/view_pdf" };
+   for (std::size_t i = 0; i < sizeof(kPrefixes) / sizeof(kPrefixes[0]); i++)
+   {
+      if (boost::algorithm::starts_with(request.uri(), kPrefixes[i]))
+         return true;
+   }
+   return false;
+}
+
+// relay for large content. rather than reading the entire response into
+// memory (as the AsyncClient does) the session's response is passed through
+// to the client as it arrives, reading the next chunk from the session only
+// once the previous one has been written to the client. memory use is
+// therefore constant regardless of the size of the response
+class ContentStreamRelay
+   : public boost::enable_shared_from_this<ContentStreamRelay>,
+     boost::noncopyable
+{
+public:
+   static void create(const std::string& username,
+                      boost::shared_ptr<http::AsyncConnection> ptrConnection,
+                      const http::ErrorHandler& errorHandler)
+   {
+      boost::shared_ptr<ContentStreamRelay> pRelay(
+               new ContentStreamRelay(username, ptrConnection, errorHandler));
+      pRelay->connect();
+   }
+
+private:
+   ContentStreamRelay(const std::string& username,
+                      boost::shared_ptr<http::AsyncConnection> ptrConnection,
+                      const http::ErrorHandler& errorHandler)
+      : username_(username),
+        ptrConnection_(ptrConnection),
+        errorHandler_(errorHandler),
+        socket_(ptrConnection->ioService()),
+        closed_(false)
+   {
+   }
+
+   void connect()
+   {
+      using boost::asio::local::stream_protocol;
+      FilePath streamPath = session::local_streams::streamPath(username_);
+      stream_protocol::endpoint endpoint(streamPath.absolutePath());
+      socket_.async_connect(endpoint,
+                            boost::bind(&ContentStreamRelay::handleConnect,
+                                        shared_from_this(),
+                                        boost::asio::placeholders::error));
+   }
+
+   void handleConnect(const boost::system::error_code& ec)
+   {
+      try
+      {
+         if (ec)
+         {
+            // fall back to the regular proxy (which takes care of launching
+            // the session and retrying)
+            proxyRequest(username_,
+                         ptrConnection_,
+                         errorHandler_,
+                         sessionRetryProfile(username_));
+            ptrConnection_.reset();
+            return;
+         }
+
+         // forward the request (asking the session to close the connection
+         // once it has written the response, which tells us we are done)
+         http::Request request;
+         request.assign(ptrConnection_->request());
+         request.setHeader("Connection", "close");
+         std::vector<boost::asio::const_buffer> buffers =
+                                          request.toBuffers(http::Header());
+         for (std::size_t i = 0; i < buffers.size(); i++)
+         {
+            request_.append(boost::asio::buffer_cast<const char*>(buffers[i]),
+                            boost::asio::buffer_size(buffers[i]));
+         }
+         boost::asio::async_write(
+                     socket_,
+                     boost::asio::buffer(request_),
+                     boost::bind(&ContentStreamRelay::handleRequestWritten,
+                                 shared_from_this(),
+                                 boost::asio::placeholders::error));
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
+   void handleRequestWritten(const boost::system::error_code& ec)
+   {
+      try
+      {
+         if (ec)
+         {
+            logIfNotConnectionTerminated(Error(ec, ERROR_LOCATION),
+                                         ptrConnection_->request());
+            ptrConnection_->writeError(Error(ec, ERROR_LOCATION));
+            close();
+            ptrConnection_.reset();
+            return;
+         }
+
+         // we don't expect anything more from the client however watching
+         // its end lets us stop reading from the session if it goes away
+         ptrConnection_->startStreaming(
+               http::AsyncConnection::StreamDataHandler(),
+               boost::bind(&ContentStreamRelay::close, shared_from_this()));
+         readSession();
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
+   void readSession()
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         if (closed_)
+            return;
+
+         socket_.async_read_some(
+               boost::asio::buffer(buffer_),
+               boost::bind(&ContentStreamRelay::handleSessionRead,
+                           shared_from_this(),
+                           boost::asio::placeholders::error,
+                           boost::asio::placeholders::bytes_transferred));
+      }
+      END_LOCK_MUTEX
+   }
+
+   void handleSessionRead(const boost::system::error_code& ec,
+                          std::size_t bytesTransferred)
+   {
+      try
+      {
+         if (!ec)
+         {
+            ptrConnection_->writeStreamData(
+                  std::string(buffer_.data(), bytesTransferred),
+                  boost::bind(&ContentStreamRelay::readSession,
+                              shared_from_this()));
+         }
+         else
+         {
+            // the session has finished writing the response (or we closed
+            // our end because the client went away)
+            close();
+            ptrConnection_->closeStream();
+            ptrConnection_.reset();
+         }
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
+   void close()
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         if (closed_)
+            return;
+
+         closed_ = true;
+         Error error = http::closeSocket(socket_);
+         if (error)
+            LOG_ERROR(error);
+      }
+      END_LOCK_MUTEX
+   }
+
+private:
+   std::string username_;
+   boost::shared_ptr<http::AsyncConnection> ptrConnection_;
+   http::ErrorHandler errorHandler_;
+   boost::asio::local::stream_protocol::socket socket_;
+   std::string request_;
+   boost::array<char, 65536> buffer_;
+   boost::mutex mutex_;
+   bool closed_;
+};
+
 } // anonymous namespace
 
 
@@ -269,9 +732,23 @@ void proxyContentRequest(
       const std::string& username,
       boost::shared_ptr<core::http::AsyncConnection> ptrConnection)
 {
+   sessionManager().notifyActivity(username);
+
+   http::ErrorHandler errorHandler = boost::bind(handleContentError,
+                                                 ptrConnection,
+                                                 username,
+                                                 _1);
+
+   // stream responses which may be large rather than buffering them
+   if (!nodes::enabled() && isLargeContentRequest(ptrConnection->request()))
+   {
+      ContentStreamRelay::create(username, ptrConnection, errorHandler);
+      return;
+   }
+
    proxyRequest(username,
                 ptrConnection,
-                boost::bind(handleContentError, ptrConnection, username, _1),
+                errorHandler,
                 sessionRetryProfile(username));
 }
 
@@ -287,6 +764,8 @@ void proxyRpcRequest(
          return;
    }
 
+   sessionManager().notifyActivity(username);
+
    proxyRequest(username,
                 ptrConnection,
                 boost::bind(handleRpcError, ptrConnection, username, _1),
@@ -306,6 +785,40 @@ void proxyEventsRequest(
                 boost::bind(handleEventsError, ptrConnection, _1));
 }
 
+void proxyEventStreamRequest(
+      const std::string& username,
+      boost::shared_ptr<core::http::AsyncConnection> ptrConnection)
+{
+   // only websocket upgrades are valid here (clients which can't use
+   // them poll for events instead)
+   if (!http::websocket::isUpgradeRequest(ptrConnection->request()))
+   {
+      ptrConnection->response().setStatusCode(http::status::BadRequest);
+      ptrConnection->writeResponse();
+      return;
+   }
+
+   // validate the user
+   if (!server::auth::validateUser(username))
+   {
+      ptrConnection->response().setStatusCode(http::status::Unauthorized);
+      ptrConnection->writeResponse();
+      return;
+   }
+
+   // event streams aren't tunneled to other nodes (clients fall back to
+   // polling for events, which is proxied like any other request)
+   if (nodes::enabled())
+   {
+      ptrConnection->response().setStatusCode(
+                                    http::status::ServiceUnavailable);
+      ptrConnection->writeResponse();
+      return;
+   }
+
+   EventStreamTunnel::create(username, ptrConnection);
+}
+
 } // namespace session_proxy
 } // namespace server
 
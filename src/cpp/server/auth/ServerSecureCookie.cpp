@@ -17,6 +17,8 @@
 
 #include <sys/stat.h>
 
+#include <map>
+
 #include <boost/optional.hpp>
 #include <boost/tokenizer.hpp>
 #include <boost/algorithm/string/predicate.hpp>
@@ -24,6 +26,7 @@
 #include <boost/date_time/gregorian/gregorian.hpp>
 
 #include <core/Log.hpp>
+#include <core/Thread.hpp>
 #include <core/FileSerializer.hpp>
 
 #include <core/http/URL.hpp>
@@ -52,19 +55,28 @@ std::string s_secureCookieKey ;
 
 Error base64HMAC(const std::string& value,
                  const std::string& expires,
-                 std::string* pHMAC)
+                 std::string* pHMAC,
+                 bool legacy = false)
 {
    // compute message to apply hmac to
    std::string message = value + expires;
 
-   // get cookie key
-   // NOTE: threadsafe because we never modify s_secureCookieKey and
-   // the c_str accessor just returns a pointer to the internal data
-   const char * cookieKey = s_secureCookieKey.c_str();
-
    // compute hmac for the message
+   // NOTE: threadsafe because we never modify s_secureCookieKey
    std::vector<unsigned char> hmac;
-   Error error = core::system::crypto::HMAC_SHA1(message, cookieKey, &hmac);
+   Error error;
+   if (legacy)
+   {
+      error = core::system::crypto::HMAC_SHA1(message,
+                                              s_secureCookieKey.c_str(),
+                                              &hmac);
+   }
+   else
+   {
+      error = core::system::crypto::HMAC_SHA256(message,
+                                                s_secureCookieKey,
+                                                &hmac);
+   }
    if (error)
       return error;
 
@@ -72,6 +84,64 @@ Error base64HMAC(const std::string& value,
    return core::system::crypto::base64Encode(hmac, pHMAC);
 }
 
+// cookies which have already been verified (signed value => value and
+// expiration) so that repeat requests don't need to check the hmac
+struct VerifiedCookie
+{
+   std::string value;
+   boost::posix_time::ptime expires;
+};
+
+// once this many cookies are cached the cache is reset
+const std::size_t kMaxVerifiedCookies = 4096;
+
+boost::mutex s_verifiedCookiesMutex;
+std::map<std::string,VerifiedCookie> s_verifiedCookies;
+
+bool lookupVerifiedCookie(const std::string& signedCookieValue,
+                          std::string* pValue)
+{
+   using namespace boost::posix_time;
+
+   LOCK_MUTEX(s_verifiedCookiesMutex)
+   {
+      std::map<std::string,VerifiedCookie>::iterator it =
+                                 s_verifiedCookies.find(signedCookieValue);
+      if (it == s_verifiedCookies.end())
+         return false;
+
+      if (it->second.expires <= second_clock::universal_time())
+      {
+         s_verifiedCookies.erase(it);
+         pValue->clear();
+      }
+      else
+      {
+         *pValue = it->second.value;
+      }
+      return true;
+   }
+   END_LOCK_MUTEX
+
+   return false;
+}
+
+void addVerifiedCookie(const std::string& signedCookieValue,
+                       const std::string& value,
+                       const boost::posix_time::ptime& expires)
+{
+   LOCK_MUTEX(s_verifiedCookiesMutex)
+   {
+      if (s_verifiedCookies.size() >= kMaxVerifiedCookies)
+         s_verifiedCookies.clear();
+
+      VerifiedCookie& verifiedCookie = s_verifiedCookies[signedCookieValue];
+      verifiedCookie.value = value;
+      verifiedCookie.expires = expires;
+   }
+   END_LOCK_MUTEX
+}
+
 http::Cookie createSecureCookie(
                           const std::string& name,
                           const std::string& value,
@@ -122,6 +192,11 @@ std::string readSecureCookie(const core::http::Request& request,
    if (signedCookieValue.empty())
       return std::string();
 
+   // check whether we've already verified this cookie
+   std::string verifiedValue;
+   if (lookupVerifiedCookie(signedCookieValue, &verifiedValue))
+      return verifiedValue;
+
    // split it into its parts (url decode them as well)
    std::string value, expires, hmac;
    using namespace boost;
@@ -155,7 +230,17 @@ std::string readSecureCookie(const core::http::Request& request,
       return std::string();
    }
 
-   // compare hmac to the one in the cookie
+   // compare hmac to the one in the cookie (accept cookies signed before
+   // we moved from sha1 to sha256 so that users aren't all signed out)
+   if (hmac != computedHmac)
+   {
+      error = base64HMAC(value, expires, &computedHmac, true);
+      if (error)
+      {
+         LOG_ERROR(error);
+         return std::string();
+      }
+   }
    if (hmac != computedHmac)
    {
       // will occur in normal course of operations if the user upgrades
@@ -173,6 +258,7 @@ std::string readSecureCookie(const core::http::Request& request,
       return std::string();
 
    // ok to return the value
+   addVerifiedCookie(signedCookieValue, value, expiresTime);
    return value;
 }
 
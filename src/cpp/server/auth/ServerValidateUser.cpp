@@ -15,9 +15,15 @@
 
 #include <server/auth/ServerValidateUser.hpp>
 
+#include <map>
+
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
 #include <core/Error.hpp>
 #include <core/Log.hpp>
 #include <core/StringUtils.hpp>
+#include <core/Thread.hpp>
 
 #include <core/system/PosixSystem.hpp>
 #include <core/system/PosixUser.hpp>
@@ -29,12 +35,10 @@ using namespace core;
 namespace server {
 namespace auth {
 
-bool validateUser(const std::string& username)
+namespace {
+
+bool lookupUser(const std::string& username)
 {
-   // short circuit if we aren't validating users
-   if (!server::options().authValidateUsers())
-      return true;
-   
    // get the user
    core::system::user::User user;
    Error error = userFromUsername(username, &user);
@@ -77,6 +81,104 @@ bool validateUser(const std::string& username)
    }
 }
 
+// validation is done on every request to the session proxy and user
+// lookups can be slow (e.g. when nss is backed by ldap) so results are
+// cached. valid results are trusted for a minute and after that are used
+// for a further few minutes while they are refreshed in the background.
+// invalid results are trusted for a shorter period (so that newly added
+// users don't need to wait long to be able to sign in)
+const boost::posix_time::time_duration kValidUserTTL =
+                                       boost::posix_time::minutes(1);
+const boost::posix_time::time_duration kValidUserMaxStale =
+                                       boost::posix_time::minutes(5);
+const boost::posix_time::time_duration kInvalidUserTTL =
+                                       boost::posix_time::seconds(10);
+
+struct ValidationResult
+{
+   ValidationResult() : valid(false), refreshing(false) {}
+   bool valid;
+   bool refreshing;
+   boost::posix_time::ptime validatedAt;
+};
+
+boost::mutex s_validationMutex;
+std::map<std::string,ValidationResult> s_validationCache;
+
+bool updateValidation(const std::string& username)
+{
+   bool valid = lookupUser(username);
+
+   LOCK_MUTEX(s_validationMutex)
+   {
+      ValidationResult& result = s_validationCache[username];
+      result.valid = valid;
+      result.refreshing = false;
+      result.validatedAt = boost::posix_time::microsec_clock::universal_time();
+   }
+   END_LOCK_MUTEX
+
+   return valid;
+}
+
+void refreshValidation(const std::string& username)
+{
+   updateValidation(username);
+}
+
+} // anonymous namespace
+
+bool validateUser(const std::string& username, bool useCache)
+{
+   using namespace boost::posix_time;
+
+   // short circuit if we aren't validating users
+   if (!server::options().authValidateUsers())
+      return true;
+
+   if (!useCache)
+      return updateValidation(username);
+
+   bool refresh = false;
+   LOCK_MUTEX(s_validationMutex)
+   {
+      std::map<std::string,ValidationResult>::iterator it =
+                                          s_validationCache.find(username);
+      if (it != s_validationCache.end())
+      {
+         ValidationResult& result = it->second;
+         time_duration age = microsec_clock::universal_time() -
+                             result.validatedAt;
+         if (result.valid)
+         {
+            if (age < kValidUserTTL)
+               return true;
+
+            // serve the stale result while we refresh it
+            if (age < kValidUserTTL + kValidUserMaxStale)
+            {
+               refresh = !result.refreshing;
+               result.refreshing = true;
+            }
+         }
+         else if (age < kInvalidUserTTL)
+         {
+            return false;
+         }
+      }
+   }
+   END_LOCK_MUTEX
+
+   if (refresh)
+   {
+      core::thread::safeLaunchThread(boost::bind(refreshValidation, username));
+      return true;
+   }
+
+   // no usable result so look the user up now
+   return updateValidation(username);
+}
+
 } // namespace auth
 } // namespace server
 
@@ -58,6 +58,31 @@ public:
       return serverOffline_;
    }
    
+   std::string serverNodes() const
+   {
+      return std::string(serverNodes_.c_str());
+   }
+
+   bool serverNodesSsl() const
+   {
+      return serverNodesSsl_;
+   }
+
+   bool serverNodeStatus() const
+   {
+      return serverNodeStatus_;
+   }
+
+   std::string serverReposIndexUrls() const
+   {
+      return std::string(serverReposIndexUrls_.c_str());
+   }
+
+   int serverReposIndexTtlMinutes() const
+   {
+      return serverReposIndexTtlMinutes_;
+   }
+
    std::string serverUser() const
    { 
       return std::string(serverUser_.c_str());
@@ -88,6 +113,36 @@ public:
       return wwwThreadPoolSize_;
    }
 
+   int wwwAcceptorShards() const
+   {
+      return wwwAcceptorShards_;
+   }
+
+   bool wwwMetrics() const
+   {
+      return wwwMetrics_;
+   }
+
+   bool wwwRequestTracing() const
+   {
+      return wwwRequestTracing_;
+   }
+
+   int wwwCompressionLevel() const
+   {
+      return wwwCompressionLevel_;
+   }
+
+   int wwwCompressionMinSize() const
+   {
+      return wwwCompressionMinSize_;
+   }
+
+   bool wwwCompressionPrecompressed() const
+   {
+      return wwwCompressionPrecompressed_;
+   }
+
    // auth
    bool authValidateUsers()
    {
@@ -145,6 +200,51 @@ public:
       return rsessionUserProcessLimit_;
    }
 
+   int rsessionLaunchLimit() const
+   {
+      return rsessionLaunchLimit_;
+   }
+
+   int rsessionSuspendMemoryPercent() const
+   {
+      return rsessionSuspendMemoryPercent_;
+   }
+
+   int rsessionSuspendIdleMinutes() const
+   {
+      return rsessionSuspendIdleMinutes_;
+   }
+
+   int rsessionResidentProjects() const
+   {
+      return rsessionResidentProjects_;
+   }
+
+   std::string rsessionCGroupRoot() const
+   {
+      return std::string(rsessionCGroupRoot_.c_str());
+   }
+
+   int rsessionCpuWeight() const
+   {
+      return rsessionCpuWeight_;
+   }
+
+   int rsessionMemoryHighMb() const
+   {
+      return rsessionMemoryHighMb_;
+   }
+
+   int rsessionMemoryMaxMb() const
+   {
+      return rsessionMemoryMaxMb_;
+   }
+
+   int rsessionIoWeight() const
+   {
+      return rsessionIoWeight_;
+   }
+
 private:
    bool verifyInstallation_;
    std::string serverWorkingDir_;
@@ -152,10 +252,21 @@ private:
    bool serverDaemonize_;
    bool serverAppArmorEnabled_;
    bool serverOffline_;
+   std::string serverNodes_;
+   bool serverNodesSsl_;
+   bool serverNodeStatus_;
+   std::string serverReposIndexUrls_;
+   int serverReposIndexTtlMinutes_;
    std::string wwwAddress_ ;
    std::string wwwPort_ ;
    std::string wwwLocalPath_ ;
    int wwwThreadPoolSize_;
+   int wwwAcceptorShards_;
+   bool wwwMetrics_;
+   bool wwwRequestTracing_;
+   int wwwCompressionLevel_;
+   int wwwCompressionMinSize_;
+   bool wwwCompressionPrecompressed_;
    bool authValidateUsers_;
    std::string authRequiredUserGroup_;
    std::string authPamHelperPath_;
@@ -167,6 +278,15 @@ private:
    int rsessionMemoryLimitMb_;
    int rsessionStackLimitMb_;
    int rsessionUserProcessLimit_;
+   int rsessionLaunchLimit_;
+   int rsessionSuspendMemoryPercent_;
+   int rsessionSuspendIdleMinutes_;
+   int rsessionResidentProjects_;
+   std::string rsessionCGroupRoot_;
+   int rsessionCpuWeight_;
+   int rsessionMemoryHighMb_;
+   int rsessionMemoryMaxMb_;
+   int rsessionIoWeight_;
 };
       
 } // namespace server
@@ -21,7 +21,9 @@
 namespace server {
 namespace auth {
    
-bool validateUser(const std::string& username);
+// check that the user exists (and belongs to the required group if there
+// is one). results are cached briefly unless useCache is false
+bool validateUser(const std::string& username, bool useCache = true);
 
 } // namespace auth
 } // namespace server
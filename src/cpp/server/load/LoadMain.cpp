@@ -0,0 +1,720 @@
+/*
+ * LoadMain.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+// rserver-load: drives a running rserver with synthetic users which replay
+// the traffic a browser client generates (client_init, a get_events long
+// poll, console input, file listings, code searches, and plot fetches) at
+// configurable rates, then reports throughput and latencies along with the
+// session resource use reported by rserver's /metrics (if enabled).
+//
+// users are signed in by minting their user-id cookies with the server's
+// secure cookie key, so this must run on the server host as the user
+// rserver runs as (normally root). the synthetic users must be existing
+// system accounts (e.g. loadtest1..loadtestN).
+
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/format.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/program_options.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/deadline_timer.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/Metrics.hpp>
+#include <core/SafeConvert.hpp>
+#include <core/system/System.hpp>
+
+#include <core/http/Request.hpp>
+#include <core/http/Response.hpp>
+#include <core/http/TcpIpAsyncClient.hpp>
+
+#include <core/json/Json.hpp>
+
+#include <server/auth/ServerSecureCookie.hpp>
+
+using namespace core ;
+
+namespace {
+
+const char * const kRequestMetric = "rserver_load_request";
+const char * const kRoundtripMetric = "rserver_load_roundtrip";
+
+struct LoadOptions
+{
+   std::string address;
+   std::string port;
+   int users;
+   std::string userPrefix;
+   int durationSeconds;
+   int rampUpSeconds;
+   int consoleInputMs;
+   int listFilesMs;
+   int searchCodeMs;
+   int plotMs;
+   std::string consoleCode;
+   std::string plotCode;
+   std::string searchTerm;
+};
+
+LoadOptions s_options;
+
+// errors by method (only touched from the io_service thread)
+std::map<std::string,int> s_errors;
+
+void recordError(const std::string& method)
+{
+   s_errors[method]++;
+}
+
+boost::posix_time::ptime now()
+{
+   return boost::posix_time::microsec_clock::universal_time();
+}
+
+// jitter intervals by +/- 50% so that users don't act in lockstep
+boost::posix_time::time_duration jittered(int milliseconds)
+{
+   int jitter = milliseconds > 1 ? (std::rand() % milliseconds) : 0;
+   return boost::posix_time::milliseconds(milliseconds / 2 + jitter);
+}
+
+std::string userIdCookie(const std::string& username)
+{
+   // have the secure cookie module mint the same cookie rserver sets when
+   // the user signs in and pull its value out of the response
+   http::Request request;
+   request.setHeader("Host", s_options.address + ":" + s_options.port);
+   http::Response response;
+   server::auth::secure_cookie::set("user-id",
+                                    username,
+                                    request,
+                                    boost::posix_time::hours(24),
+                                    "/",
+                                    &response);
+
+   std::string setCookie = response.headerValue("Set-Cookie");
+   return setCookie.substr(0, setCookie.find(';'));
+}
+
+class SyntheticUser : public boost::enable_shared_from_this<SyntheticUser>
+{
+public:
+   SyntheticUser(boost::asio::io_service& ioService,
+                 const std::string& username)
+      : ioService_(ioService),
+        username_(username),
+        cookie_(userIdCookie(username)),
+        clientVersion_(0),
+        lastEventId_(-1),
+        consoleBusy_(false),
+        plotPending_(false),
+        consoleTimer_(ioService),
+        listFilesTimer_(ioService),
+        searchCodeTimer_(ioService),
+        plotTimer_(ioService),
+        retryTimer_(ioService)
+   {
+   }
+
+   void start()
+   {
+      sendRpc("client_init",
+              json::Array(),
+              boost::bind(&SyntheticUser::onClientInit, shared_from_this(), _1));
+   }
+
+private:
+
+   typedef boost::function<void(const json::Value&)> ResultHandler;
+
+   void sendRequest(const std::string& uri,
+                    const std::string& metricLabel,
+                    const std::string& method,
+                    const std::string& body,
+                    const boost::function<void(const http::Response&)>& onResponse)
+   {
+      boost::shared_ptr<http::TcpIpAsyncClient> pClient(
+            new http::TcpIpAsyncClient(ioService_,
+                                       s_options.address,
+                                       s_options.port));
+
+      http::Request& request = pClient->request();
+      request.setMethod(method);
+      request.setUri(uri);
+      request.setHost(s_options.address + ":" + s_options.port);
+      request.setHeader("Cookie", cookie_);
+      if (!body.empty())
+      {
+         request.setContentType("application/json");
+         request.setBody(body);
+      }
+
+      pClient->execute(
+            boost::bind(&SyntheticUser::onResponse,
+                        shared_from_this(),
+                        metricLabel,
+                        now(),
+                        onResponse,
+                        _1),
+            boost::bind(&SyntheticUser::onError,
+                        shared_from_this(),
+                        metricLabel,
+                        _1));
+   }
+
+   void onResponse(const std::string& metricLabel,
+                   boost::posix_time::ptime startTime,
+                   const boost::function<void(const http::Response&)>& onResponse,
+                   const http::Response& response)
+   {
+      // long polls are expected to take as long as the server holds them
+      if (metricLabel != "get_events")
+      {
+         metrics::recordLatencySince(kRequestMetric,
+                                     "method",
+                                     metricLabel,
+                                     startTime);
+      }
+
+      if (response.statusCode() != http::status::Ok)
+         recordError(metricLabel);
+
+      onResponse(response);
+   }
+
+   void onError(const std::string& metricLabel, const Error& error)
+   {
+      recordError(metricLabel);
+
+      // keep the event loop alive (other activities just try again on
+      // their next interval)
+      if (metricLabel == "get_events")
+         retryEvents();
+      else if (metricLabel == "client_init")
+         retryClientInit();
+      else if (metricLabel == "console_input" || metricLabel == "plot")
+         consoleBusy_ = plotPending_ = false;
+   }
+
+   void sendRpc(const std::string& method,
+                const json::Array& params,
+                const ResultHandler& onResult,
+                const std::string& scope = "rpc")
+   {
+      json::Object rpc;
+      rpc["method"] = method;
+      rpc["params"] = params;
+      rpc["clientId"] = clientId_;
+      rpc["version"] = clientVersion_;
+
+      std::ostringstream ostr;
+      json::write(rpc, ostr);
+
+      sendRequest("/" + scope + "/" + method,
+                  method,
+                  "POST",
+                  ostr.str(),
+                  boost::bind(&SyntheticUser::onRpcResponse,
+                              shared_from_this(),
+                              method,
+                              onResult,
+                              _1));
+   }
+
+   void onRpcResponse(const std::string& method,
+                      const ResultHandler& onResult,
+                      const http::Response& response)
+   {
+      json::Value value;
+      if (!json::parse(response.body(), &value) ||
+          value.type() != json::ObjectType)
+      {
+         recordError(method);
+         onResult(json::Value());
+         return;
+      }
+
+      const json::Object& rpcResponse = value.get_obj();
+      json::Object::const_iterator it = rpcResponse.find("result");
+      if (it == rpcResponse.end())
+      {
+         recordError(method);
+         onResult(json::Value());
+         return;
+      }
+
+      onResult(it->second);
+   }
+
+   void onClientInit(const json::Value& result)
+   {
+      if (result.type() != json::ObjectType)
+      {
+         retryClientInit();
+         return;
+      }
+
+      const json::Object& sessionInfo = result.get_obj();
+      json::Object::const_iterator it = sessionInfo.find("clientId");
+      if (it != sessionInfo.end() && it->second.type() == json::StringType)
+         clientId_ = it->second.get_str();
+      it = sessionInfo.find("version");
+      if (it != sessionInfo.end() && json::isType<double>(it->second))
+         clientVersion_ = it->second.get_value<double>();
+
+      pollEvents();
+      schedule(&consoleTimer_, s_options.consoleInputMs,
+               &SyntheticUser::consoleInput);
+      schedule(&listFilesTimer_, s_options.listFilesMs,
+               &SyntheticUser::listFiles);
+      schedule(&searchCodeTimer_, s_options.searchCodeMs,
+               &SyntheticUser::searchCode);
+      schedule(&plotTimer_, s_options.plotMs,
+               &SyntheticUser::plot);
+   }
+
+   void retryClientInit()
+   {
+      retryTimer_.expires_from_now(boost::posix_time::seconds(1));
+      retryTimer_.async_wait(boost::bind(&SyntheticUser::start,
+                                         shared_from_this()));
+   }
+
+   void schedule(boost::asio::deadline_timer* pTimer,
+                 int intervalMs,
+                 void (SyntheticUser::*activity)())
+   {
+      if (intervalMs <= 0)
+         return;
+
+      pTimer->expires_from_now(jittered(intervalMs));
+      pTimer->async_wait(boost::bind(&SyntheticUser::onTimer,
+                                     shared_from_this(),
+                                     pTimer,
+                                     intervalMs,
+                                     activity,
+                                     _1));
+   }
+
+   void onTimer(boost::asio::deadline_timer* pTimer,
+                int intervalMs,
+                void (SyntheticUser::*activity)(),
+                const boost::system::error_code& ec)
+   {
+      if (ec)
+         return;
+
+      (this->*activity)();
+      schedule(pTimer, intervalMs, activity);
+   }
+
+   // events
+
+   void pollEvents()
+   {
+      json::Array params;
+      params.push_back(lastEventId_);
+      sendRpc("get_events",
+              params,
+              boost::bind(&SyntheticUser::onEvents, shared_from_this(), _1),
+              "events");
+   }
+
+   void retryEvents()
+   {
+      retryTimer_.expires_from_now(boost::posix_time::seconds(1));
+      retryTimer_.async_wait(boost::bind(&SyntheticUser::pollEvents,
+                                         shared_from_this()));
+   }
+
+   void onEvents(const json::Value& result)
+   {
+      if (result.type() != json::ArrayType)
+      {
+         retryEvents();
+         return;
+      }
+
+      BOOST_FOREACH(const json::Value& eventValue, result.get_array())
+      {
+         if (eventValue.type() != json::ObjectType)
+            continue;
+         const json::Object& event = eventValue.get_obj();
+
+         json::Object::const_iterator it = event.find("id");
+         if (it != event.end() && json::isType<int>(it->second))
+            lastEventId_ = std::max(lastEventId_, it->second.get_int());
+
+         it = event.find("type");
+         if (it == event.end() || it->second.type() != json::StringType)
+            continue;
+         std::string type = it->second.get_str();
+
+         if (type == "console_prompt" && consoleBusy_)
+         {
+            consoleBusy_ = false;
+            metrics::recordLatencySince(kRoundtripMetric,
+                                        "activity",
+                                        plotPending_ ? "plot_prompt"
+                                                     : "console_input",
+                                        consoleStartTime_);
+         }
+         else if (type == "plots_state_changed" && plotPending_)
+         {
+            json::Object::const_iterator dataIt = event.find("data");
+            if (dataIt != event.end() &&
+                dataIt->second.type() == json::ObjectType)
+            {
+               const json::Object& data = dataIt->second.get_obj();
+               json::Object::const_iterator fileIt = data.find("filename");
+               if (fileIt != data.end() &&
+                   fileIt->second.type() == json::StringType)
+               {
+                  fetchPlot(fileIt->second.get_str());
+               }
+            }
+         }
+      }
+
+      pollEvents();
+   }
+
+   // activities
+
+   void sendConsoleInput(const std::string& code, bool plot)
+   {
+      // like a user we wait for the prompt before typing more
+      if (consoleBusy_)
+         return;
+
+      consoleBusy_ = true;
+      plotPending_ = plot;
+      consoleStartTime_ = now();
+
+      json::Array params;
+      params.push_back(code);
+      sendRpc("console_input", params, ignoreResult);
+   }
+
+   void consoleInput()
+   {
+      sendConsoleInput(s_options.consoleCode, false);
+   }
+
+   void plot()
+   {
+      sendConsoleInput(s_options.plotCode, true);
+   }
+
+   void fetchPlot(const std::string& filename)
+   {
+      plotPending_ = false;
+      sendRequest("/graphics/" + filename,
+                  "plot",
+                  "GET",
+                  std::string(),
+                  boost::bind(&SyntheticUser::onPlotFetched,
+                              shared_from_this(),
+                              _1));
+   }
+
+   void onPlotFetched(const http::Response&)
+   {
+      metrics::recordLatencySince(kRoundtripMetric,
+                                  "activity",
+                                  "plot",
+                                  consoleStartTime_);
+   }
+
+   void listFiles()
+   {
+      json::Array params;
+      params.push_back("~");
+      params.push_back(false);
+      sendRpc("list_files", params, ignoreResult);
+   }
+
+   void searchCode()
+   {
+      json::Array params;
+      params.push_back(s_options.searchTerm);
+      params.push_back(20);
+      sendRpc("search_code", params, ignoreResult);
+   }
+
+   static void ignoreResult(const json::Value&)
+   {
+   }
+
+private:
+   boost::asio::io_service& ioService_;
+   std::string username_;
+   std::string cookie_;
+   std::string clientId_;
+   double clientVersion_;
+   int lastEventId_;
+   bool consoleBusy_;
+   bool plotPending_;
+   boost::posix_time::ptime consoleStartTime_;
+   boost::asio::deadline_timer consoleTimer_;
+   boost::asio::deadline_timer listFilesTimer_;
+   boost::asio::deadline_timer searchCodeTimer_;
+   boost::asio::deadline_timer plotTimer_;
+   boost::asio::deadline_timer retryTimer_;
+};
+
+double toMs(boost::uint64_t microseconds)
+{
+   return static_cast<double>(microseconds) / 1000.0;
+}
+
+void printHistograms(const std::string& title,
+                     const metrics::Histograms& histograms)
+{
+   std::cout << std::endl << title << std::endl;
+   std::cout << boost::format("  %-20s %8s %8s %7s %9s %9s %9s %9s\n") %
+                "" % "count" % "per sec" % "errors" %
+                "p50 ms" % "p90 ms" % "p99 ms" % "p99.9 ms";
+
+   for (metrics::Histograms::const_iterator it = histograms.begin();
+        it != histograms.end();
+        ++it)
+   {
+      const metrics::LatencyHistogram& histogram = it->second;
+      double perSecond = static_cast<double>(histogram.count()) /
+                         std::max(1, s_options.rampUpSeconds +
+                                     s_options.durationSeconds);
+      std::cout << boost::format(
+                     "  %-20s %8d %8.1f %7d %9.1f %9.1f %9.1f %9.1f\n") %
+                   it->first %
+                   histogram.count() %
+                   perSecond %
+                   s_errors[it->first] %
+                   toMs(histogram.valueAtQuantile(0.5)) %
+                   toMs(histogram.valueAtQuantile(0.9)) %
+                   toMs(histogram.valueAtQuantile(0.99)) %
+                   toMs(histogram.valueAtQuantile(0.999));
+   }
+}
+
+void printServerMetricsUnavailable()
+{
+   std::cout << std::endl
+             << "(server metrics unavailable, enable www-metrics to "
+                "report session resource use)" << std::endl;
+}
+
+void printServerMetrics(const http::Response& response)
+{
+   if (response.statusCode() != http::status::Ok)
+   {
+      printServerMetricsUnavailable();
+      return;
+   }
+
+   // report the per session resource gauges
+   std::cout << std::endl << "Session resource use" << std::endl;
+   std::istringstream istr(response.body());
+   std::string line;
+   while (std::getline(istr, line))
+   {
+      if (boost::algorithm::starts_with(line, "rserver_session_"))
+         std::cout << "  " << line << std::endl;
+   }
+}
+
+void fetchServerMetrics(boost::asio::io_service& ioService)
+{
+   boost::shared_ptr<http::TcpIpAsyncClient> pClient(
+         new http::TcpIpAsyncClient(ioService,
+                                    s_options.address,
+                                    s_options.port));
+   pClient->request().setMethod("GET");
+   pClient->request().setUri("/metrics");
+   pClient->request().setHost(s_options.address + ":" + s_options.port);
+   pClient->execute(printServerMetrics,
+                    boost::bind(printServerMetricsUnavailable));
+}
+
+void stopUsers(boost::asio::io_service* pIoService,
+               const boost::system::error_code& ec)
+{
+   if (!ec)
+      pIoService->stop();
+}
+
+void startUser(boost::shared_ptr<SyntheticUser> pUser,
+               boost::shared_ptr<boost::asio::deadline_timer>,
+               const boost::system::error_code& ec)
+{
+   if (!ec)
+      pUser->start();
+}
+
+bool readOptions(int argc, char * const argv[])
+{
+   using namespace boost::program_options;
+   options_description options("rserver-load");
+   options.add_options()
+      ("help", "print usage")
+      ("address",
+         value<std::string>(&s_options.address)->default_value("127.0.0.1"),
+         "rserver address")
+      ("port",
+         value<std::string>(&s_options.port)->default_value("8787"),
+         "rserver port")
+      ("users",
+         value<int>(&s_options.users)->default_value(10),
+         "number of synthetic users")
+      ("user-prefix",
+         value<std::string>(&s_options.userPrefix)->default_value("loadtest"),
+         "synthetic user accounts are <prefix>1..<prefix>N")
+      ("duration",
+         value<int>(&s_options.durationSeconds)->default_value(60),
+         "seconds to run for")
+      ("ramp-up",
+         value<int>(&s_options.rampUpSeconds)->default_value(10),
+         "seconds over which users are started")
+      ("console-input-ms",
+         value<int>(&s_options.consoleInputMs)->default_value(5000),
+         "mean interval between console inputs (0 to disable)")
+      ("list-files-ms",
+         value<int>(&s_options.listFilesMs)->default_value(15000),
+         "mean interval between file listings (0 to disable)")
+      ("search-code-ms",
+         value<int>(&s_options.searchCodeMs)->default_value(20000),
+         "mean interval between code searches (0 to disable)")
+      ("plot-ms",
+         value<int>(&s_options.plotMs)->default_value(30000),
+         "mean interval between plots (0 to disable)")
+      ("console-code",
+         value<std::string>(&s_options.consoleCode)->default_value(
+                                          "x <- rnorm(10000); summary(x)"),
+         "code sent as console input")
+      ("plot-code",
+         value<std::string>(&s_options.plotCode)->default_value(
+                                          "plot(rnorm(1000))"),
+         "code sent to create plots")
+      ("search-term",
+         value<std::string>(&s_options.searchTerm)->default_value("rnorm"),
+         "term used for code searches");
+
+   try
+   {
+      variables_map vm;
+      store(parse_command_line(argc, argv, options), vm);
+      notify(vm);
+
+      if (vm.count("help") || s_options.users <= 0)
+      {
+         std::cout << options << std::endl;
+         return false;
+      }
+   }
+   catch(const boost::program_options::error& e)
+   {
+      std::cerr << e.what() << std::endl << options << std::endl;
+      return false;
+   }
+
+   return true;
+}
+
+} // anonymous namespace
+
+int main(int argc, char * const argv[])
+{
+   try
+   {
+      // initialize log
+      initializeStderrLog("rserver-load", core::system::kLogLevelWarning);
+
+      // ignore sigpipe
+      Error error = core::system::ignoreSignal(core::system::SigPipe);
+      if (error)
+         LOG_ERROR(error);
+
+      if (!readOptions(argc, argv))
+         return EXIT_FAILURE;
+
+      // read the secure cookie key so we can sign users in
+      error = server::auth::secure_cookie::initialize();
+      if (error)
+      {
+         LOG_ERROR(error);
+         return EXIT_FAILURE;
+      }
+
+      boost::asio::io_service ioService;
+
+      // start users evenly over the ramp up period
+      std::vector<boost::shared_ptr<SyntheticUser> > users;
+      for (int i = 0; i < s_options.users; i++)
+      {
+         std::string username = s_options.userPrefix +
+                                safe_convert::numberToString(i + 1);
+         boost::shared_ptr<SyntheticUser> pUser(
+                                    new SyntheticUser(ioService, username));
+         users.push_back(pUser);
+
+         boost::shared_ptr<boost::asio::deadline_timer> pTimer(
+                                 new boost::asio::deadline_timer(ioService));
+         pTimer->expires_from_now(boost::posix_time::milliseconds(
+               (s_options.rampUpSeconds * 1000 * i) / s_options.users));
+         pTimer->async_wait(boost::bind(startUser, pUser, pTimer, _1));
+      }
+
+      // run for the requested duration (a single thread drives all of the
+      // users so they need no synchronization)
+      boost::asio::deadline_timer stopTimer(ioService);
+      stopTimer.expires_from_now(boost::posix_time::seconds(
+                        s_options.rampUpSeconds + s_options.durationSeconds));
+      stopTimer.async_wait(boost::bind(stopUsers, &ioService, _1));
+      ioService.run();
+
+      // report
+      std::cout << boost::format("%1% users for %2%s (after %3%s ramp up)\n")
+                   % s_options.users
+                   % s_options.durationSeconds
+                   % s_options.rampUpSeconds;
+      printHistograms("Requests", metrics::latencyHistograms(kRequestMetric));
+      printHistograms("Round trips (until the prompt returns or the plot "
+                      "is fetched)",
+                      metrics::latencyHistograms(kRoundtripMetric));
+
+      // then ask the server for session resource use
+      boost::asio::io_service metricsIoService;
+      fetchServerMetrics(metricsIoService);
+      metricsIoService.run();
+
+      return EXIT_SUCCESS;
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+
+   // if we got this far we had an unexpected exception
+   return EXIT_FAILURE ;
+}
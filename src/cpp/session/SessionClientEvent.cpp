@@ -98,6 +98,8 @@ const int kSourceCppCompleted = 70;
 const int kLoadedPackageUpdates = 71;
 const int kActivatePane = 72;
 const int kShowPresentationPane = 73;
+const int kPlotsExportStatus = 74;
+const int kUploadProgress = 75;
 }
 
 void ClientEvent::init(int type, const json::Value& data)
@@ -253,6 +255,10 @@ std::string ClientEvent::typeName() const
          return "activate_pane";
       case client_events::kShowPresentationPane:
          return "show_presentation_pane";
+      case client_events::kPlotsExportStatus:
+         return "plots_export_status";
+      case client_events::kUploadProgress:
+         return "upload_progress";
       default:
          LOG_WARNING_MESSAGE("unexpected event type: " + 
                              safe_convert::numberToString(type_));
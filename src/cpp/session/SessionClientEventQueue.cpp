@@ -15,24 +15,78 @@
 
 #include "SessionClientEventQueue.hpp"
 
+#include <algorithm>
+
+#include <boost/bind.hpp>
 #include <boost/foreach.hpp>
 
 
 #include <core/BoostThread.hpp>
 #include <core/Thread.hpp>
 #include <core/json/Json.hpp>
+#include <core/SafeConvert.hpp>
 #include <core/StringUtils.hpp>
 
 #include <r/session/RConsoleActions.hpp>
 
+#include <session/SessionOptions.hpp>
+
 using namespace core ;
 
 namespace session {
  
 namespace {
+
 ClientEventQueue* s_pClientEventQueue = NULL;
+
+// name of the variable a workspace assign/remove event refers to
+std::string workspaceEventVariable(const ClientEvent& event)
+{
+   const json::Value& data = event.data();
+   if (data.type() == json::StringType)
+   {
+      return data.get_str();
+   }
+   else if (data.type() == json::ObjectType)
+   {
+      const json::Object& dataObject = data.get_obj();
+      json::Object::const_iterator it = dataObject.find("name");
+      if (it != dataObject.end() && it->second.type() == json::StringType)
+         return it->second.get_str();
+   }
+
+   return std::string();
 }
 
+bool isWorkspaceChange(const ClientEvent& event)
+{
+   int type = event.type();
+   return type == client_events::kWorkspaceRefresh ||
+          type == client_events::kWorkspaceAssign ||
+          type == client_events::kWorkspaceRemove;
+}
+
+bool isWorkspaceChangeFor(const ClientEvent& event, const std::string& name)
+{
+   int type = event.type();
+   return (type == client_events::kWorkspaceAssign ||
+           type == client_events::kWorkspaceRemove) &&
+          workspaceEventVariable(event) == name;
+}
+
+bool isPlotsStateChange(const ClientEvent& event)
+{
+   return event.type() == client_events::kPlotsStateChanged;
+}
+
+bool isConsoleOutput(int type)
+{
+   return type == client_events::kConsoleWriteOutput ||
+          type == client_events::kConsoleWriteError;
+}
+
+} // anonymous namespace
+
 void initializeClientEventQueue()
 {
    BOOST_ASSERT(s_pClientEventQueue == NULL);
@@ -47,19 +101,29 @@ ClientEventQueue& clientEventQueue()
 ClientEventQueue::ClientEventQueue()
    :  pMutex_(new boost::mutex()),
       pWaitForEventCondition_(new boost::condition()),
-      lastEventAddTime_(boost::posix_time::not_a_date_time)
+      pendingConsoleOutputType_(client_events::kConsoleWriteOutput),
+      droppedConsoleOutput_(0),
+      lastEventAddTime_(boost::posix_time::not_a_date_time),
+      addGeneration_(0),
+      waitGeneration_(0),
+      notifiedGeneration_(0),
+      waiters_(0)
 {
 }
 
 void ClientEventQueue::add(const ClientEvent& event)
 { 
+   using namespace boost::posix_time;
+   ptime now = microsec_clock::universal_time();
+
+   bool notify = false;
    LOCK_MUTEX(*pMutex_)
    {
       // console output is batched up for compactness/efficiency.
-      if (event.type() == client_events::kConsoleWriteOutput)
+      if (isConsoleOutput(event.type()))
       {
          if (event.data().type() == json::StringType)
-            pendingConsoleOutput_ += event.data().get_str();
+            appendPendingConsoleOutput(event.type(), event.data().get_str());
       }
       else
       {
@@ -68,17 +132,54 @@ void ClientEventQueue::add(const ClientEvent& event)
          flushPendingConsoleOutput() ;
          
          // add event to queue
-         pendingEvents_.push_back(event) ;
+         addCoalesced(event) ;
       }
       
-      lastEventAddTime_ = boost::posix_time::microsec_clock::universal_time();
+      lastEventAddTime_ = now;
+      notify = notifyRequired();
    }
    END_LOCK_MUTEX
    
    // notify listeners that an event has been added
-   pWaitForEventCondition_->notify_all();
+   if (notify)
+      pWaitForEventCondition_->notify_all();
 }
    
+void ClientEventQueue::addConsoleOutput(int type, const std::string& output)
+{
+   using namespace boost::posix_time;
+   ptime now = microsec_clock::universal_time();
+
+   bool notify = false;
+   LOCK_MUTEX(*pMutex_)
+   {
+      appendPendingConsoleOutput(type, output);
+
+      lastEventAddTime_ = now;
+      notify = notifyRequired();
+   }
+   END_LOCK_MUTEX
+
+   // notify listeners that an event has been added
+   if (notify)
+      pWaitForEventCondition_->notify_all();
+}
+
+bool ClientEventQueue::notifyRequired()
+{
+   // NOTE: private helper so no lock required (mutex is not recursive)
+
+   addGeneration_++;
+
+   // waiters which started waiting before the last notification have
+   // already been woken up
+   if (waiters_ == 0 || notifiedGeneration_ > waitGeneration_)
+      return false;
+
+   notifiedGeneration_ = addGeneration_;
+   return true;
+}
+
 bool ClientEventQueue::hasEvents() 
 {
    LOCK_MUTEX(*pMutex_)
@@ -91,6 +192,26 @@ bool ClientEventQueue::hasEvents()
    return false ;
 }
   
+std::size_t ClientEventQueue::memoryUsage()
+{
+   LOCK_MUTEX(*pMutex_)
+   {
+      std::size_t bytes = pendingConsoleOutput_.capacity();
+      for (std::vector<ClientEvent>::const_iterator it = pendingEvents_.begin();
+           it != pendingEvents_.end();
+           ++it)
+      {
+         bytes += sizeof(ClientEvent) + it->id().capacity() +
+                  json::estimatedSize(it->data());
+      }
+      return bytes;
+   }
+   END_LOCK_MUTEX
+
+   // keep compiler happy
+   return 0;
+}
+
 void ClientEventQueue::remove(std::vector<ClientEvent>* pEvents)
 {
    LOCK_MUTEX(*pMutex_)
@@ -114,6 +235,7 @@ void ClientEventQueue::clear()
    LOCK_MUTEX(*pMutex_)
    {
       pendingConsoleOutput_.clear();
+      droppedConsoleOutput_ = 0;
       pendingEvents_.clear();
    }
    END_LOCK_MUTEX
@@ -128,7 +250,19 @@ bool ClientEventQueue::waitForEvent(
    {
       unique_lock<mutex> lock(*pMutex_);
       system_time timeoutTime = get_system_time() + waitDuration;
-      return pWaitForEventCondition_->timed_wait(lock, timeoutTime);
+
+      // wait until an event is added (ignoring spurious wakeups)
+      unsigned long generation = addGeneration_;
+      waitGeneration_ = generation;
+      waiters_++;
+      while (addGeneration_ == generation)
+      {
+         if (!pWaitForEventCondition_->timed_wait(lock, timeoutTime))
+            break;
+      }
+      waiters_--;
+
+      return addGeneration_ != generation;
    }
    catch(const thread_resource_error& e) 
    { 
@@ -156,6 +290,88 @@ bool ClientEventQueue::eventAddedSince(const boost::posix_time::ptime& time)
 }
    
 
+void ClientEventQueue::addCoalesced(const ClientEvent& event)
+{
+   // NOTE: private helper so no lock required (mutex is not recursive)
+
+   // events which are made redundant by this one are dropped so that the
+   // number of events pending is bounded by the number of distinct things
+   // which changed rather than by how often they changed
+   int type = event.type();
+
+   // a workspace refresh supersedes all prior workspace changes
+   if (type == client_events::kWorkspaceRefresh)
+   {
+      pendingEvents_.erase(std::remove_if(pendingEvents_.begin(),
+                                          pendingEvents_.end(),
+                                          isWorkspaceChange),
+                           pendingEvents_.end());
+   }
+
+   // an assignment or removal supersedes prior ones for the same variable
+   else if (type == client_events::kWorkspaceAssign ||
+            type == client_events::kWorkspaceRemove)
+   {
+      std::string name = workspaceEventVariable(event);
+      if (!name.empty())
+      {
+         pendingEvents_.erase(std::remove_if(pendingEvents_.begin(),
+                                             pendingEvents_.end(),
+                                             boost::bind(isWorkspaceChangeFor,
+                                                         _1,
+                                                         name)),
+                              pendingEvents_.end());
+      }
+   }
+
+   // plot state changes are complete snapshots of the state
+   else if (type == client_events::kPlotsStateChanged)
+   {
+      pendingEvents_.erase(std::remove_if(pendingEvents_.begin(),
+                                          pendingEvents_.end(),
+                                          isPlotsStateChange),
+                           pendingEvents_.end());
+   }
+
+   pendingEvents_.push_back(event);
+}
+
+void ClientEventQueue::appendPendingConsoleOutput(int type,
+                                                  const std::string& output)
+{
+   // NOTE: private helper so no lock required (mutex is not recursive)
+
+   // output and errors are batched separately (but kept in order)
+   if (type != pendingConsoleOutputType_)
+   {
+      flushPendingConsoleOutput();
+      pendingConsoleOutputType_ = type;
+   }
+
+   pendingConsoleOutput_.append(output);
+
+   // if output is arriving faster than the client is collecting it then
+   // discard the oldest (trimming back to half the limit so that this
+   // isn't done for every write)
+   std::size_t limit = session::options().limitConsoleOutputKb() * 1024;
+   if (limit > 0 && pendingConsoleOutput_.length() > limit)
+   {
+      int lineLimit = r::session::consoleActions().capacity() + 1;
+      string_utils::trimLeadingLines(lineLimit, &pendingConsoleOutput_);
+
+      std::size_t excess = pendingConsoleOutput_.length() > (limit / 2) ?
+                           pendingConsoleOutput_.length() - (limit / 2) : 0;
+      if (excess > 0)
+      {
+         std::size_t pos = pendingConsoleOutput_.find('\n', excess);
+         if (pos != std::string::npos)
+            excess = pos + 1;
+         pendingConsoleOutput_.erase(0, excess);
+         droppedConsoleOutput_ += excess;
+      }
+   }
+}
+
 void ClientEventQueue::flushPendingConsoleOutput()
 {
    // NOTE: private helper so no lock required (mutex is not recursive) 
@@ -168,7 +384,18 @@ void ClientEventQueue::flushPendingConsoleOutput()
       int limit = r::session::consoleActions().capacity() + 1;
       string_utils::trimLeadingLines(limit, &pendingConsoleOutput_);
 
-      pendingEvents_.push_back(ClientEvent(client_events::kConsoleWriteOutput, 
+      // let the user know if output was discarded
+      if (droppedConsoleOutput_ > 0)
+      {
+         pendingEvents_.push_back(ClientEvent(
+            client_events::kConsoleWriteError,
+            "[Console output limit reached: " +
+            safe_convert::numberToString(droppedConsoleOutput_) +
+            " characters of output omitted]\n"));
+         droppedConsoleOutput_ = 0;
+      }
+
+      pendingEvents_.push_back(ClientEvent(pendingConsoleOutputType_,
                                            pendingConsoleOutput_)); 
       pendingConsoleOutput_.clear() ;
    }
@@ -47,12 +47,20 @@ public:
      
    // add an event
    void add(const ClientEvent& event);
+
+   // add console output (kConsoleWriteOutput or kConsoleWriteError). this
+   // is equivalent to adding an event of that type but output is appended
+   // to that already pending rather than creating an event per write
+   void addConsoleOutput(int type, const std::string& output);
    
    // remove all available events
    void remove(std::vector<ClientEvent>* pEvents);
    
    // are there any events pending?
    bool hasEvents();
+
+   // approximate bytes held by pending events
+   std::size_t memoryUsage();
    
    // clear the event queue
    void clear();
@@ -64,7 +72,10 @@ public:
    bool eventAddedSince(const boost::posix_time::ptime& time);
       
 private:   
+   void addCoalesced(const ClientEvent& event);
+   void appendPendingConsoleOutput(int type, const std::string& output);
    void flushPendingConsoleOutput();
+   bool notifyRequired();
  
 private:
    // synchronization objects. heap based so they are never destructed
@@ -76,9 +87,19 @@ private:
    boost::condition* pWaitForEventCondition_ ;
 
    // instance data
+   int pendingConsoleOutputType_;
    std::string pendingConsoleOutput_ ;
+   std::size_t droppedConsoleOutput_;
    std::vector<ClientEvent> pendingEvents_ ; 
    boost::posix_time::ptime lastEventAddTime_;
+
+   // waiters are only notified once per wait (and not at all if nobody is
+   // waiting) so that adding events (e.g. on every console write) doesn't
+   // usually require waking the event service thread
+   unsigned long addGeneration_;
+   unsigned long waitGeneration_;
+   unsigned long notifiedGeneration_;
+   std::size_t waiters_;
    
 
 };
@@ -16,6 +16,7 @@
 #include "SessionClientEventService.hpp"
 
 #include <algorithm>
+#include <sstream>
 
 #include <boost/function.hpp>
 
@@ -24,15 +25,21 @@
 #include <core/Error.hpp>
 #include <core/BoostErrors.hpp>
 #include <core/Thread.hpp>
+#include <core/Metrics.hpp>
 #include <core/system/System.hpp>
 
 
+#include <core/SafeConvert.hpp>
+
 #include <core/http/Request.hpp>
+#include <core/http/Response.hpp>
+#include <core/http/SocketUtils.hpp>
 
 #include <session/SessionOptions.hpp>
 #include <session/SessionHttpConnectionListener.hpp>
 
 #include "SessionClientEventQueue.hpp"
+#include "http/SessionHttpConnectionUtils.hpp"
 
 using namespace core;
 
@@ -48,6 +55,136 @@ bool hasEventIdLessThanOrEqualTo(const json::Value& event, int targetId)
    int eventId = eventJSON.find("id")->second.get_int();
    return eventId <= targetId;
 }
+
+// batching of events into responses to event requests adapts to the
+// recent event rate and to the client's round trip time. events which
+// follow an idle period or arrive at a low rate (e.g. echoing typing) are
+// sent immediately. while output is sustained the batching window doubles
+// with each response (up to the maximum) and is never less than the round
+// trip time (the client can't request more events any sooner than that)
+class EventBatching
+{
+public:
+   EventBatching(const boost::posix_time::time_duration& batchDelay,
+                 const boost::posix_time::time_duration& maxTotalBatchDelay)
+      : batchDelay_(batchDelay),
+        maxTotalBatchDelay_(maxTotalBatchDelay),
+        window_(boost::posix_time::seconds(0)),
+        roundTrip_(boost::posix_time::seconds(0)),
+        eventRate_(0)
+   {
+   }
+
+   // COPYING: via compiler
+
+   // events which arrive within this delay of each other are batched
+   const boost::posix_time::time_duration& batchDelay() const
+   {
+      return batchDelay_;
+   }
+
+   // called for each request for events (the time between our previous
+   // response and this request is a sample of the round trip time)
+   void onRequest(const boost::posix_time::ptime& receivedTime)
+   {
+      using namespace boost::posix_time;
+      if (receivedTime.is_not_a_date_time() ||
+          lastResponseTime_.is_not_a_date_time())
+      {
+         return;
+      }
+
+      // ignore gaps which are clearly the client doing something else
+      // (e.g. being suspended or reconnecting)
+      time_duration sample = receivedTime - lastResponseTime_;
+      if (sample.is_negative() || sample > seconds(kMaxRoundTripSeconds))
+         return;
+
+      roundTrip_ = (roundTrip_ * 3 + sample) / 4;
+   }
+
+   // the total time to batch events over once the first is available
+   boost::posix_time::time_duration beginBatch(
+                                    const boost::posix_time::ptime& now)
+   {
+      using namespace boost::posix_time;
+      bool idle = lastEventsTime_.is_not_a_date_time() ||
+                  (now - lastEventsTime_) > milliseconds(kIdleMs);
+      if (idle || eventRate_ < kSustainedEventsPerSecond)
+      {
+         window_ = seconds(0);
+      }
+      else
+      {
+         window_ = std::max(window_ * 2, std::max(batchDelay_, roundTrip_));
+         window_ = std::min(window_, maxTotalBatchDelay_);
+      }
+      return window_;
+   }
+
+   // called once a response has been sent (batched is the time spent
+   // waiting for additional events)
+   void onResponse(const boost::posix_time::ptime& now,
+                   std::size_t events,
+                   std::size_t bytes,
+                   const boost::posix_time::time_duration& batched)
+   {
+      if (events > 0)
+      {
+         // rate over the interval since our previous response (reset after
+         // idle periods so that they don't drag down sustained output)
+         if (!lastResponseTime_.is_not_a_date_time() &&
+             !lastEventsTime_.is_not_a_date_time() &&
+             (now - lastEventsTime_) <=
+                           boost::posix_time::milliseconds(kIdleMs))
+         {
+            double secs = (now - lastResponseTime_).total_microseconds() /
+                          1000000.0;
+            if (secs > 0)
+               eventRate_ = (eventRate_ * 0.75) + ((events / secs) * 0.25);
+         }
+         else
+         {
+            eventRate_ = 0;
+         }
+
+         lastEventsTime_ = now;
+
+         core::metrics::recordLatency("rsession_client_events_batch",
+                                      "window",
+                                      window_.total_microseconds() > 0 ?
+                                                  "sustained" : "immediate",
+                                      batched);
+         core::metrics::recordSize("rsession_client_events_response",
+                                   "transport", "poll",
+                                   bytes);
+      }
+      lastResponseTime_ = now;
+
+      core::metrics::setGauge("rsession_client_events_rate",
+                              "transport", "poll",
+                              eventRate_);
+      core::metrics::setGauge("rsession_client_events_round_trip_seconds",
+                              "transport", "poll",
+                              roundTrip_.total_microseconds() / 1000000.0);
+      core::metrics::setGauge("rsession_client_events_window_seconds",
+                              "transport", "poll",
+                              window_.total_microseconds() / 1000000.0);
+   }
+
+private:
+   static const int kIdleMs = 500;
+   static const int kSustainedEventsPerSecond = 20;
+   static const int kMaxRoundTripSeconds = 5;
+
+   boost::posix_time::time_duration batchDelay_;
+   boost::posix_time::time_duration maxTotalBatchDelay_;
+   boost::posix_time::time_duration window_;
+   boost::posix_time::time_duration roundTrip_;
+   double eventRate_;
+   boost::posix_time::ptime lastResponseTime_;
+   boost::posix_time::ptime lastEventsTime_;
+};
          
 } // anonymous namespace
 
@@ -151,6 +288,26 @@ void ClientEventService::erasePreviouslyDeliveredEvents(int lastClientEventIdSee
    END_LOCK_MUTEX
 }
 
+void ClientEventService::dequeClientEvents(int* pNextEventId,
+                                           json::Array* pNewEvents)
+{
+   // deque the events
+   std::vector<ClientEvent> events;
+   clientEventQueue().remove(&events);
+
+   // convert to json and add event id (they are retained until the client
+   // confirms that it has seen them)
+   for (std::vector<ClientEvent>::const_iterator
+        it = events.begin(); it != events.end(); ++it)
+   {
+      json::Object event ;
+      it->asJsonObject((*pNextEventId)++, &event);
+      addClientEvent(event);
+      if (pNewEvents)
+         pNewEvents->push_back(event);
+   }
+}
+
 bool ClientEventService::havePendingClientEvents()
 {
    LOCK_MUTEX(mutex_)
@@ -172,14 +329,46 @@ void ClientEventService::addClientEvent(const json::Object& eventObject)
    END_LOCK_MUTEX
 }
 
-void ClientEventService::setClientEventResult(
-                                       core::json::JsonRpcResponse* pResponse)
+std::size_t ClientEventService::setClientEventResult(
+                                       core::json::JsonRpcResponse* pResponse,
+                                       std::size_t maxBytes)
 {
    LOCK_MUTEX(mutex_)
    {
-      pResponse->setResult(clientEvents_);
+      // send as many events as fit within maxBytes (but always at least
+      // one). the rest remain pending and are sent in response to the
+      // client's next request (which it makes as soon as it has handled
+      // this one)
+      std::size_t count = clientEvents_.size();
+      if (count > 1)
+      {
+         std::size_t bytes = 0;
+         for (count = 0; count < clientEvents_.size(); count++)
+         {
+            std::ostringstream ostr;
+            json::write(clientEvents_[count], ostr);
+            bytes += ostr.str().size();
+            if (bytes > maxBytes && count > 0)
+               break;
+         }
+      }
+
+      if (count == clientEvents_.size())
+      {
+         pResponse->setResult(clientEvents_);
+      }
+      else
+      {
+         json::Array events(clientEvents_.begin(),
+                            clientEvents_.begin() + count);
+         pResponse->setResult(events);
+      }
+      return count;
    }
    END_LOCK_MUTEX
+
+   // keep compiler happy
+   return 0;
 }
 
 
@@ -192,13 +381,16 @@ void ClientEventService::run()
       time_duration maxRequestSec = seconds(50);
       time_duration batchDelay = milliseconds(20);
       time_duration maxTotalBatchDelay = seconds(2);
+      std::size_t maxResponseBytes = 2 * 1024 * 1024;
 
       // make much shorter for desktop mode
       if (session::options().programMode() == kSessionProgramModeDesktop)
       {
          batchDelay = milliseconds(2);
          maxTotalBatchDelay = milliseconds(10);
+         maxResponseBytes = 8 * 1024 * 1024;
       }
+      EventBatching batching(batchDelay, maxTotalBatchDelay);
       
       // get alias to client event queue
       ClientEventQueue& clientEventQueue = session::clientEventQueue();
@@ -244,10 +436,19 @@ void ClientEventService::run()
             continue;
          }
 
+         // event streams are served until they close or are superseded
+         if (connection::isEventStream(ptrConnection))
+         {
+            serveEventStream(ptrConnection, &nextEventId, &stopServer);
+            continue;
+         }
+
          // parse the json rpc request
          json::JsonRpcRequest request;
-         Error error = json::parseJsonRpcRequest(ptrConnection->request().body(),
-                                                 &request);
+         Error error = json::parseJsonRpcRequest(
+                        ptrConnection->request().body(),
+                        &request,
+                        connection::requestEncoding(ptrConnection->request()));
          if (error)
          {
             ptrConnection->sendJsonRpcError(error);
@@ -263,6 +464,8 @@ void ClientEventService::run()
             continue;
          }
 
+         batching.onRequest(ptrConnection->receivedTime());
+
          // get the last event id seen by the client
          int lastClientEventIdSeen = -1;
          Error paramError = json::readParam(request.params, 
@@ -284,23 +487,33 @@ void ClientEventService::run()
          nextEventId = std::max(nextEventId, lastClientEventIdSeen + 1);
 
          // check for events (and wait a specified internal if there are none)
+         time_duration batched = seconds(0);
          try
          {
-            // wait for the specified maximum time
-            if (havePendingClientEvents() || clientEventQueue.hasEvents() ||
-                clientEventQueue.waitForEvent(maxRequestSec))
+            // events which the client hasn't seen yet (e.g. those which
+            // didn't fit in the previous response) are sent right away,
+            // otherwise wait for the specified maximum time
+            if (!havePendingClientEvents() &&
+                (clientEventQueue.hasEvents() ||
+                 clientEventQueue.waitForEvent(maxRequestSec)))
             {
                // ...got at least one event
                
                // wait for additional events that occur in rapid succession 
-               // but don't wait for more than the specified maximum seconds
-               boost::system_time maxBatchDelayTime = 
-                              boost::get_system_time() + maxTotalBatchDelay;
-               
-               while ( clientEventQueue.waitForEvent(batchDelay) &&
-                       (boost::get_system_time() < maxBatchDelayTime) )
+               // but don't wait for longer than the batching window
+               boost::system_time batchStartTime = boost::get_system_time();
+               time_duration window = batching.beginBatch(batchStartTime);
+               if (window > seconds(0))
                {
+                  boost::system_time maxBatchDelayTime =
+                                                   batchStartTime + window;
+
+                  while ( clientEventQueue.waitForEvent(batching.batchDelay()) &&
+                          (boost::get_system_time() < maxBatchDelayTime) )
+                  {
+                  }
                }
+               batched = boost::get_system_time() - batchStartTime;
            }
          }
          catch(const boost::thread_interrupted& e)
@@ -320,25 +533,21 @@ void ClientEventService::run()
          if (request.clientId == clientId())
          {
             // deque the events
-            std::vector<ClientEvent> events;
-            clientEventQueue.remove(&events);
-            
-            // convert to json and add event id
-            for (std::vector<ClientEvent>::const_iterator 
-                 it = events.begin(); it != events.end(); ++it)
-            {
-               json::Object event ;
-               it->asJsonObject(nextEventId++, &event);
-               addClientEvent(event);
-            }
+            dequeClientEvents(&nextEventId, NULL);
 
             // send them (pass false for kEventsPending b/c responses from the
             // event service shouldn't interact with automatic event service
             // starting/re-starting)
             json::JsonRpcResponse response;
-            setClientEventResult(&response);
+            std::size_t events = setClientEventResult(&response,
+                                                      maxResponseBytes);
             response.setField(kEventsPending, "false");
-            ptrConnection->sendJsonRpcResponse(response);
+            std::size_t bytes = 0;
+            ptrConnection->sendJsonRpcResponse(response, &bytes);
+            batching.onResponse(microsec_clock::universal_time(),
+                                events,
+                                bytes,
+                                batched);
          }
          else
          {
@@ -349,5 +558,126 @@ void ClientEventService::run()
    }
    CATCH_UNEXPECTED_EXCEPTION
 }
+
+// push events to the client over a websocket as soon as they are queued
+// (rather than waiting for the client to poll for them). returns once the
+// client disconnects or is superseded by another client or connection
+void ClientEventService::serveEventStream(
+                           boost::shared_ptr<HttpConnection> ptrConnection,
+                           int* pNextEventId,
+                           bool* pStopServer)
+{
+   // events which occur in rapid succession are still coalesced (but
+   // only over a very short window). when there are no events we send an
+   // empty list periodically so intermediaries don't close the connection
+   using namespace boost::posix_time;
+   time_duration batchDelay = milliseconds(2);
+   time_duration maxTotalBatchDelay = milliseconds(10);
+   time_duration heartbeatInterval = seconds(30);
+
+   // only the active client can receive events
+   const http::Request& request = ptrConnection->request();
+   std::string streamClientId = request.queryParamValue("client_id");
+   if (streamClientId != clientId())
+   {
+      http::Response response;
+      response.setStatusCode(http::status::Forbidden);
+      ptrConnection->sendResponse(response);
+      return;
+   }
+
+   // remove events already seen by the client and sync the next event id
+   // (see the comments on the equivalent code in run)
+   int lastClientEventIdSeen = request.queryParamValue("last_event_id", -1);
+   erasePreviouslyDeliveredEvents(lastClientEventIdSeen);
+   *pNextEventId = std::max(*pNextEventId, lastClientEventIdSeen + 1);
+
+   // accept the connection (the client falls back to polling if we can't)
+   if (!ptrConnection->acceptWebSocket(boost::bind(
+                  &ClientEventService::onEventStreamMessage, this, _1)))
+   {
+      http::Response response;
+      response.setStatusCode(http::status::BadRequest);
+      ptrConnection->sendResponse(response);
+      return;
+   }
+
+   // start with any events which were never confirmed by the client
+   json::Array events;
+   LOCK_MUTEX(mutex_)
+   {
+      events = clientEvents_;
+   }
+   END_LOCK_MUTEX
+
+   ClientEventQueue& clientEventQueue = session::clientEventQueue();
+   boost::system_time lastSendTime = boost::get_system_time();
+   while (true)
+   {
+      // send events (or a heartbeat)
+      if (!events.empty() ||
+          (boost::get_system_time() - lastSendTime) > heartbeatInterval)
+      {
+         std::ostringstream ostr;
+         json::write(events, ostr);
+         Error error = ptrConnection->sendWebSocketMessage(ostr.str());
+         if (error)
+         {
+            if (!http::isConnectionTerminatedError(error))
+               LOG_ERROR(error);
+            break;
+         }
+
+         events.clear();
+         lastSendTime = boost::get_system_time();
+      }
+
+      // stop if we're shutting down, the client went away, or another
+      // client (or connection from this client) needs to be served
+      if (*pStopServer ||
+          !ptrConnection->isWebSocketOpen() ||
+          streamClientId != clientId() ||
+          !httpConnectionListener().eventsConnectionQueue()
+                                       .peekNextConnectionUri().empty())
+      {
+         break;
+      }
+
+      // wait for events
+      try
+      {
+         if (clientEventQueue.hasEvents() ||
+             clientEventQueue.waitForEvent(seconds(1)))
+         {
+            boost::system_time maxBatchDelayTime =
+                           boost::get_system_time() + maxTotalBatchDelay;
+
+            while ( clientEventQueue.waitForEvent(batchDelay) &&
+                    (boost::get_system_time() < maxBatchDelayTime) )
+            {
+            }
+         }
+      }
+      catch(const boost::thread_interrupted& e)
+      {
+         // set flag so we stop once we've sent any remaining events
+         // (e.g. the quit event)
+         *pStopServer = true;
+      }
+
+      dequeClientEvents(pNextEventId, &events);
+   }
+
+   ptrConnection->close();
+}
+
+void ClientEventService::onEventStreamMessage(const std::string& message)
+{
+   // the client confirms receipt of events by sending the last event id
+   // it has seen (called on the connection listener's thread)
+   int lastClientEventIdSeen = safe_convert::stringTo<int>(message, -1);
+   if (lastClientEventIdSeen >= 0)
+      erasePreviouslyDeliveredEvents(lastClientEventIdSeen);
+}
       
 } // namespace session
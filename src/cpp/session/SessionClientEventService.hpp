@@ -19,6 +19,7 @@
 #include <string>
 
 #include <boost/utility.hpp>
+#include <boost/shared_ptr.hpp>
 
 #include <core/BoostThread.hpp>
 
@@ -31,6 +32,8 @@ namespace core {
 
 namespace session {
 
+class HttpConnection;
+
 // singleton
 class ClientEventService;
 ClientEventService& clientEventService();
@@ -54,11 +57,17 @@ private:
    std::string clientId();
 
    void run();
+   void serveEventStream(boost::shared_ptr<HttpConnection> ptrConnection,
+                         int* pNextEventId,
+                         bool* pStopServer);
+   void onEventStreamMessage(const std::string& message);
 
+   void dequeClientEvents(int* pNextEventId, core::json::Array* pNewEvents);
    void erasePreviouslyDeliveredEvents(int lastClientEventIdSeen);
    bool havePendingClientEvents();
    void addClientEvent(const core::json::Object& eventObject);
-   void setClientEventResult(core::json::JsonRpcResponse* pResponse);
+   std::size_t setClientEventResult(core::json::JsonRpcResponse* pResponse,
+                                    std::size_t maxBytes);
 
   
 private:
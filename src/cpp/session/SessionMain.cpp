@@ -17,6 +17,7 @@
 
 #include <string>
 #include <vector>
+#include <sstream>
 #include <queue>
 #include <map>
 #include <algorithm>
@@ -37,14 +38,18 @@
 #include <core/BoostThread.hpp>
 #include <core/FilePath.hpp>
 #include <core/Exec.hpp>
+#include <core/PerformanceTimer.hpp>
 #include <core/Scope.hpp>
 #include <core/Settings.hpp>
 #include <core/Thread.hpp>
 #include <core/Log.hpp>
+#include <core/Metrics.hpp>
 #include <core/system/System.hpp>
 #include <core/ProgramStatus.hpp>
 #include <core/system/System.hpp>
 #include <core/FileSerializer.hpp>
+#include <core/Hash.hpp>
+#include <core/Trace.hpp>
 #include <core/http/Request.hpp>
 #include <core/http/Response.hpp>
 #include <core/http/UriHandler.hpp>
@@ -77,6 +82,8 @@ extern "C" const char *locale2charset(const char *);
 #include <session/SessionUserSettings.hpp>
 #include <session/SessionSourceDatabase.hpp>
 #include <session/SessionPersistentState.hpp>
+#include <session/SessionSharedFileMonitor.hpp>
+#include <session/SessionRestartZygote.hpp>
 
 #include "SessionAddins.hpp"
 
@@ -85,11 +92,14 @@ extern "C" const char *locale2charset(const char *);
 #include "SessionClientEventQueue.hpp"
 #include "SessionClientEventService.hpp"
 
+#include "http/SessionHttpConnectionUtils.hpp"
+
 #include "modules/SessionAgreement.hpp"
 #include "modules/SessionAskPass.hpp"
 #include "modules/SessionAuthoring.hpp"
 #include "modules/SessionHTMLPreview.hpp"
 #include "modules/SessionCodeSearch.hpp"
+#include "modules/SessionCompletion.hpp"
 #include "modules/SessionConsole.hpp"
 #include "modules/SessionConsoleProcess.hpp"
 #include "modules/SessionCrypto.hpp"
@@ -98,6 +108,7 @@ extern "C" const char *locale2charset(const char *);
 #include "modules/SessionWorkspace.hpp"
 #include "modules/SessionWorkbench.hpp"
 #include "modules/SessionData.hpp"
+#include "modules/SessionLargeFiles.hpp"
 #include "modules/SessionHelp.hpp"
 #include "modules/SessionPlots.hpp"
 #include "modules/SessionPath.hpp"
@@ -137,6 +148,21 @@ http::UriHandlerFunction s_defaultUriHandler;
 
 // json rpc methods
 core::json::JsonRpcAsyncMethods s_jsonRpcMethods;
+
+// json rpc methods which don't use R (or any other state which isn't
+// threadsafe) and are therefore executed by background workers. these
+// are registered on the main thread and looked up on the connection
+// listener and worker threads (the sync objects are heap based so they
+// are never destructed, see HttpConnectionQueue)
+boost::mutex* s_pRFreeRpcMutex = new boost::mutex();
+boost::condition* s_pRFreeRpcCondition = new boost::condition();
+core::json::JsonRpcMethods s_rFreeRpcMethods;
+std::map<std::string,module_context::RFreeRpcPredicate> s_rFreeRpcPredicates;
+std::queue<boost::shared_ptr<HttpConnection> > s_rFreeRpcConnections;
+const int kRFreeRpcWorkers = 2;
+
+// active client id (for validation of requests by background workers)
+core::thread::ThreadsafeValue<std::string> s_activeClientId("");
    
 // R browseUrl handlers
 std::vector<module_context::RBrowseUrlHandler> s_rBrowseUrlHandlers;
@@ -170,6 +196,11 @@ std::queue<r::session::RConsoleInput> s_consoleInputBuffer;
 // sweave operation still hogging cpu after we exit)
 core::system::ProcessSupervisor s_interruptableChildSupervisor;
 
+// request latency metrics
+const char * const kRpcQueueWaitMetric = "rsession_rpc_queue_wait";
+const char * const kRpcExecutionMetric = "rsession_rpc_execution";
+const char * const kRpcResponseSizeMetric = "rsession_rpc_response";
+
 // json rpc methods we handle (the rest are delegated to the HttpServer)
 const char * const kClientInit = "client_init" ;
 const char * const kConsoleInput = "console_input" ;
@@ -179,6 +210,7 @@ const char * const kLocatorCompleted = "locator_completed";
 const char * const kHandleUnsavedChangesCompleted = "handle_unsaved_changes_completed";
 const char * const kQuitSession = "quit_session" ;   
 const char * const kInterrupt = "interrupt";
+const char * const kRpcBatch = "batch";
 
 // convenience function for disallowing suspend (note still doesn't override
 // the presence of s_forceSuspend = 1)
@@ -213,6 +245,12 @@ void handleUSR2(int unused)
    s_forceSuspend = 1;
 }
 
+// has a suspend (cooperative or forced) been requested
+bool suspendRequested()
+{
+   return s_suspendRequested || s_forceSuspend;
+}
+
 // version of the executable
 double s_version = 0;
    
@@ -317,6 +355,59 @@ FilePath getInitialWorkingDirectory()
 }
 
 
+// sections of the client_init response which the client caches (keyed by
+// a hash of their contents) and so which needn't be resent when unchanged
+const char * const kCacheableSections[] = {
+   "source_documents",
+   "console_history",
+   "lists",
+   "ui_prefs",
+   "project_ui_prefs",
+   "client_state",
+   "find_in_files_state",
+   "presentation_state",
+   "build_state",
+   "compile_pdf_state",
+   "tex_capabilities",
+   "html_capabilities"
+};
+
+// tag the cacheable sections of the session info and remove those which
+// match the tags the client already has (the client restores these from
+// its cache using the list of cached_sections)
+void omitCachedSections(const json::Object& clientTags,
+                        json::Object* pSessionInfo)
+{
+   json::Object sectionTags;
+   json::Array cachedSections;
+
+   std::size_t count = sizeof(kCacheableSections) / sizeof(const char*);
+   for (std::size_t i = 0; i < count; i++)
+   {
+      std::string name(kCacheableSections[i]);
+      json::Object::iterator it = pSessionInfo->find(name);
+      if (it == pSessionInfo->end())
+         continue;
+
+      std::ostringstream ostr;
+      json::write(it->second, ostr);
+      std::string tag = core::hash::xxHash64(ostr.str());
+      sectionTags[name] = tag;
+
+      json::Object::const_iterator clientIt = clientTags.find(name);
+      if (clientIt != clientTags.end() &&
+          clientIt->second.type() == json::StringType &&
+          clientIt->second.get_str() == tag)
+      {
+         pSessionInfo->erase(it);
+         cachedSections.push_back(name);
+      }
+   }
+
+   (*pSessionInfo)["section_tags"] = sectionTags;
+   (*pSessionInfo)["cached_sections"] = cachedSections;
+}
+
 void handleClientInit(const boost::function<void()>& initFunction,
                       boost::shared_ptr<HttpConnection> ptrConnection)
 {
@@ -325,8 +416,29 @@ void handleClientInit(const boost::function<void()>& initFunction,
    
    // calculate initialization parameters
    std::string clientId = session::persistentState().newActiveClientId();
+   s_activeClientId.set(clientId);
    bool resumed = s_rSessionResumed || s_sessionInitialized;
 
+   // read what the client has cached from previous inits: the console
+   // actions it last played back and the tags of the cached sections
+   // (older clients send no params)
+   std::string cacheId;
+   int cacheSequence = -1;
+   json::Object clientTags;
+   json::JsonRpcRequest request;
+   if (!json::parseJsonRpcRequest(
+                  ptrConnection->request().body(),
+                  &request,
+                  connection::requestEncoding(ptrConnection->request())))
+   {
+      Error error = json::readParams(request.params,
+                                     &cacheId,
+                                     &cacheSequence,
+                                     &clientTags);
+      if (error)
+         clientTags.clear();
+   }
+
    // if we are resuming then we don't need to worry about events queued up
    // by R during startup (e.g. printing of the banner) being sent to the
    // client. so, clear out the events which might be pending in the
@@ -395,10 +507,20 @@ void handleClientInit(const boost::function<void()>& initFunction,
    sessionInfo["resumed"] = resumed; 
    if (resumed)
    {
-      // console actions
+      // console actions (just those newer than the ones the client has
+      // cached if it tells us which ones it has)
       json::Object actionsObject;
-      consoleActions.asJson(&actionsObject);
+      std::string id;
+      int nextSequence = 0;
+      bool delta = consoleActions.asJson(cacheId,
+                                         cacheSequence,
+                                         &actionsObject,
+                                         &id,
+                                         &nextSequence);
       sessionInfo["console_actions"] = actionsObject;
+      sessionInfo["console_actions_delta"] = delta;
+      sessionInfo["console_actions_id"] = id;
+      sessionInfo["console_actions_sequence"] = nextSequence;
    }
 
    sessionInfo["rnw_weave_types"] = modules::authoring::supportedRnwWeaveTypes();
@@ -499,6 +621,13 @@ void handleClientInit(const boost::function<void()>& initFunction,
 
    sessionInfo["have_cairo_pdf"] = modules::plots::haveCairoPdf();
 
+   // encodings we'll accept for json-rpc requests and send responses in
+   // (clients opt in to cbor via their content type and accept headers)
+   json::Array wireEncodings;
+   wireEncodings.push_back("json");
+   wireEncodings.push_back("cbor");
+   sessionInfo["wire_encodings"] = wireEncodings;
+
    // console history -- we do this at the end because
    // restoreBuildRestartContext may have reset it
    json::Array historyArray;
@@ -507,6 +636,8 @@ void handleClientInit(const boost::function<void()>& initFunction,
    sessionInfo["console_history_capacity"] =
                               r::session::consoleHistory().capacity();
 
+   // don't resend sections which the client already has
+   omitCachedSections(clientTags, &sessionInfo);
 
    // send response  (we always set kEventsPending to false so that the client
    // won't poll for events until it is ready)
@@ -531,11 +662,70 @@ enum ConnectionType
    BackgroundConnection
 };
 
+// describe the sizes of a request's params (for tracing slow calls). this
+// is only done when tracing is enabled (and is cheap, we don't serialize the
+// params to measure them)
+std::string rpcParamSizes(const json::JsonRpcRequest& request)
+{
+   if (session::options().rpcSlowCallMs() <= 0)
+      return std::string();
+
+   std::ostringstream ostr;
+   for (std::size_t i = 0; i < request.params.size(); i++)
+   {
+      if (i > 0)
+         ostr << ", ";
+
+      const json::Value& param = request.params[i];
+      if (param.type() == json::StringType)
+         ostr << param.get_str().size() << " chars";
+      else if (param.type() == json::ArrayType)
+         ostr << param.get_array().size() << " items";
+      else if (param.type() == json::ObjectType)
+         ostr << param.get_obj().size() << " fields";
+      else
+         ostr << "scalar";
+   }
+   return ostr.str();
+}
+
+// record the execution time of an rpc (logging it if it was slow)
+void recordRpcExecution(const std::string& method,
+                        const std::string& paramSizes,
+                        boost::posix_time::ptime executeStartTime)
+{
+   metrics::recordLatencySince(kRpcExecutionMetric, "method", method,
+                               executeStartTime);
+
+   int slowCallMs = session::options().rpcSlowCallMs();
+   if (slowCallMs <= 0 || executeStartTime.is_not_a_date_time())
+      return;
+
+   using namespace boost::posix_time;
+   boost::int64_t elapsedMs =
+      (microsec_clock::universal_time() - executeStartTime).total_milliseconds();
+   if (elapsedMs >= slowCallMs)
+   {
+      boost::format fmt("Slow rpc call %1% took %2%ms (params: %3%)");
+      LOG_WARNING_MESSAGE(boost::str(fmt %
+                                     method %
+                                     elapsedMs %
+                                     (paramSizes.empty() ? "none" : paramSizes)));
+   }
+}
+
 void endHandleRpcRequestDirect(boost::shared_ptr<HttpConnection> ptrConnection,
+                         const std::string& method,
+                         const std::string& paramSizes,
                          boost::posix_time::ptime executeStartTime,
                          const core::Error& executeError,
                          json::JsonRpcResponse* pJsonRpcResponse)
 {
+   recordRpcExecution(method, paramSizes, executeStartTime);
+   trace::recordSpanSince(trace::traceId(ptrConnection->request()),
+                          "session_execute",
+                          executeStartTime);
+
    // return error or result then continue waiting for requests
    if (executeError)
    {
@@ -556,7 +746,10 @@ void endHandleRpcRequestDirect(boost::shared_ptr<HttpConnection> ptrConnection,
       }
 
       // send the response
-      ptrConnection->sendJsonRpcResponse(*pJsonRpcResponse);
+      std::size_t responseBytes = 0;
+      ptrConnection->sendJsonRpcResponse(*pJsonRpcResponse, &responseBytes);
+      metrics::recordSize(kRpcResponseSizeMetric, "method", method,
+                          responseBytes);
 
       // run after response if we have one (then detect changes again)
       if (pJsonRpcResponse->hasAfterResponse())
@@ -570,9 +763,14 @@ void endHandleRpcRequestDirect(boost::shared_ptr<HttpConnection> ptrConnection,
 
 void endHandleRpcRequestIndirect(
       const std::string& asyncHandle,
+      const std::string& method,
+      const std::string& paramSizes,
+      boost::posix_time::ptime executeStartTime,
       const core::Error& executeError,
       json::JsonRpcResponse* pJsonRpcResponse)
 {
+   recordRpcExecution(method, paramSizes, executeStartTime);
+
    json::JsonRpcResponse temp;
    json::JsonRpcResponse& jsonRpcResponse =
                                  pJsonRpcResponse ? *pJsonRpcResponse : temp;
@@ -603,6 +801,21 @@ void handleRpcRequest(const core::json::JsonRpcRequest& request,
                                      s_jsonRpcMethods.find(request.method);
    if (it != s_jsonRpcMethods.end())
    {
+      // note how long the request waited to be handled (includes time
+      // spent queued behind R)
+      ptime receivedTime = ptrConnection->receivedTime();
+      if (!receivedTime.is_not_a_date_time())
+      {
+         metrics::recordLatency(kRpcQueueWaitMetric,
+                                "method",
+                                request.method,
+                                executeStartTime - receivedTime);
+         trace::recordSpan(trace::traceId(ptrConnection->request()),
+                           "session_queue_wait",
+                           receivedTime,
+                           executeStartTime);
+      }
+
       std::pair<bool, json::JsonRpcAsyncFunction> reg = it->second;
       json::JsonRpcAsyncFunction handlerFunction = reg.second;
 
@@ -612,6 +825,8 @@ void handleRpcRequest(const core::json::JsonRpcRequest& request,
          handlerFunction(request,
                          boost::bind(endHandleRpcRequestDirect,
                                      ptrConnection,
+                                     request.method,
+                                     rpcParamSizes(request),
                                      executeStartTime,
                                      _1,
                                      _2));
@@ -628,6 +843,9 @@ void handleRpcRequest(const core::json::JsonRpcRequest& request,
          handlerFunction(request,
                          boost::bind(endHandleRpcRequestIndirect,
                                      handle,
+                                     request.method,
+                                     rpcParamSizes(request),
+                                     executeStartTime,
                                      _1,
                                      _2));
       }
@@ -641,7 +859,13 @@ void handleRpcRequest(const core::json::JsonRpcRequest& request,
       // application states
       LOG_ERROR(executeError);
 
-      endHandleRpcRequestDirect(ptrConnection, executeStartTime, executeError, NULL);
+      // (not recorded under the requested name since it is arbitrary)
+      endHandleRpcRequestDirect(ptrConnection,
+                                "(not found)",
+                                std::string(),
+                                executeStartTime,
+                                executeError,
+                                NULL);
    }
 
 
@@ -675,40 +899,399 @@ bool isWaitForMethodUri(const std::string& uri)
    return false;
 }
 
+Error validateJsonRpcRequest(const json::JsonRpcRequest& request,
+                             const std::string& activeClientId)
+{
+   // check for invalid client id
+   if (request.clientId != activeClientId)
+      return Error(json::errc::InvalidClientId, ERROR_LOCATION);
+
+   // check for old client version
+   if ( (request.version > 0) && (s_version > request.version) )
+      return Error(json::errc::InvalidClientVersion, ERROR_LOCATION);
+
+   return Success();
+}
+
 bool parseAndValidateJsonRpcConnection(
          boost::shared_ptr<HttpConnection> ptrConnection,
+         const std::string& activeClientId,
          json::JsonRpcRequest* pJsonRpcRequest)
 {
    // attempt to parse the request into a json-rpc request
-   Error error = json::parseJsonRpcRequest(ptrConnection->request().body(),
-                                           pJsonRpcRequest);
+   Error error = json::parseJsonRpcRequest(
+                  ptrConnection->request().body(),
+                  pJsonRpcRequest,
+                  connection::requestEncoding(ptrConnection->request()));
+   if (!error)
+      error = validateJsonRpcRequest(*pJsonRpcRequest, activeClientId);
+
    if (error)
    {
       ptrConnection->sendJsonRpcError(error);
       return false;
    }
 
-   // check for invalid client id
-   if (pJsonRpcRequest->clientId != session::persistentState().activeClientId())
+   // got through all of the validation, return true
+   return true;
+}
+
+bool parseAndValidateJsonRpcConnection(
+         boost::shared_ptr<HttpConnection> ptrConnection,
+         json::JsonRpcRequest* pJsonRpcRequest)
+{
+   return parseAndValidateJsonRpcConnection(
+                                 ptrConnection,
+                                 session::persistentState().activeClientId(),
+                                 pJsonRpcRequest);
+}
+
+// a batch of rpc requests sent in a single http request. the requests are
+// executed in order (each starting once the previous one has completed) and
+// their responses are returned together once they have all completed
+struct RpcBatch
+{
+   explicit RpcBatch(boost::shared_ptr<HttpConnection> ptrConnection)
+      : ptrConnection(ptrConnection),
+        startTime(boost::posix_time::microsec_clock::universal_time())
    {
-      Error error(json::errc::InvalidClientId, ERROR_LOCATION);
-      ptrConnection->sendJsonRpcError(error);
-      return false;
    }
 
-   // check for old client version
-   if ( (pJsonRpcRequest->version > 0) &&
-        (s_version > pJsonRpcRequest->version) )
+   boost::shared_ptr<HttpConnection> ptrConnection;
+   boost::posix_time::ptime startTime;
+   std::vector<json::JsonRpcRequest> requests;
+   std::vector<json::JsonRpcResponse> responses;
+};
+
+void executeRpcBatchRequest(boost::shared_ptr<RpcBatch> pBatch,
+                            std::size_t index);
+
+void endHandleRpcBatchRequest(boost::shared_ptr<RpcBatch> pBatch,
+                              std::size_t index,
+                              boost::posix_time::ptime executeStartTime,
+                              const core::Error& executeError,
+                              json::JsonRpcResponse* pJsonRpcResponse)
+{
+   const json::JsonRpcRequest& request = pBatch->requests[index];
+   recordRpcExecution(request.method, rpcParamSizes(request), executeStartTime);
+   trace::recordSpanSince(trace::traceId(pBatch->ptrConnection->request()),
+                          "session_execute",
+                          executeStartTime);
+
+   json::JsonRpcResponse& response = pBatch->responses[index];
+   if (executeError)
+   {
+      response.setError(executeError);
+   }
+   else
+   {
+      response = *pJsonRpcResponse;
+
+      // allow modules to detect changes after each call (subsequent calls
+      // in the batch may depend on them)
+      if (!response.suppressDetectChanges())
+         detectChanges(module_context::ChangeSourceRPC);
+   }
+
+   executeRpcBatchRequest(pBatch, index + 1);
+}
+
+void endRpcBatch(boost::shared_ptr<RpcBatch> pBatch)
+{
+   // are there (or will there likely be) events pending?
+   // (if not then notify the client)
+   bool hasAfterResponse = false;
+   BOOST_FOREACH(const json::JsonRpcResponse& response, pBatch->responses)
+   {
+      if (response.hasAfterResponse())
+         hasAfterResponse = true;
+   }
+   if (!clientEventQueue().eventAddedSince(pBatch->startTime) &&
+       !hasAfterResponse)
+   {
+      BOOST_FOREACH(json::JsonRpcResponse& response, pBatch->responses)
+      {
+         response.setField(kEventsPending, "false");
+      }
+   }
+
+   std::size_t responseBytes = 0;
+   pBatch->ptrConnection->sendJsonRpcBatchResponse(pBatch->responses,
+                                                   &responseBytes);
+   metrics::recordSize(kRpcResponseSizeMetric, "method", kRpcBatch,
+                       responseBytes);
+
+   // run after responses in order (then detect changes again)
+   if (hasAfterResponse)
+   {
+      BOOST_FOREACH(json::JsonRpcResponse& response, pBatch->responses)
+      {
+         response.runAfterResponse();
+      }
+      detectChanges(module_context::ChangeSourceRPC);
+   }
+}
+
+void executeRpcBatchRequest(boost::shared_ptr<RpcBatch> pBatch,
+                            std::size_t index)
+{
+   if (index >= pBatch->requests.size())
+   {
+      endRpcBatch(pBatch);
+      return;
+   }
+
+   using namespace boost::posix_time;
+   ptime executeStartTime = microsec_clock::universal_time();
+
+   const json::JsonRpcRequest& request = pBatch->requests[index];
+   json::JsonRpcAsyncMethods::const_iterator it =
+                                     s_jsonRpcMethods.find(request.method);
+
+   // methods which act on the session itself can't be batched
+   if (it == s_jsonRpcMethods.end() ||
+       request.method == kQuitSession ||
+       request.method == kInterrupt)
+   {
+      Error executeError = Error(json::errc::MethodNotFound, ERROR_LOCATION);
+      executeError.addProperty("method", request.method);
+      LOG_ERROR(executeError);
+
+      pBatch->responses[index].setError(executeError);
+      executeRpcBatchRequest(pBatch, index + 1);
+      return;
+   }
+
+   std::pair<bool, json::JsonRpcAsyncFunction> reg = it->second;
+   json::JsonRpcAsyncFunction handlerFunction = reg.second;
+   if (reg.first)
+   {
+      // direct return (continue with the next request once complete)
+      handlerFunction(request,
+                      boost::bind(endHandleRpcBatchRequest,
+                                  pBatch,
+                                  index,
+                                  executeStartTime,
+                                  _1,
+                                  _2));
+   }
+   else
+   {
+      // indirect return (the handle is returned in the batch response and
+      // the result delivered as an async completion event, as usual)
+      std::string handle = core::system::generateUuid(true);
+      pBatch->responses[index].setAsyncHandle(handle);
+      pBatch->responses[index].setField(kEventsPending, "false");
+
+      handlerFunction(request,
+                      boost::bind(endHandleRpcRequestIndirect,
+                                  handle,
+                                  request.method,
+                                  rpcParamSizes(request),
+                                  executeStartTime,
+                                  _1,
+                                  _2));
+
+      executeRpcBatchRequest(pBatch, index + 1);
+   }
+}
+
+void handleRpcBatchRequest(boost::shared_ptr<HttpConnection> ptrConnection,
+                           ConnectionType connectionType)
+{
+   boost::shared_ptr<RpcBatch> pBatch(new RpcBatch(ptrConnection));
+
+   // parse & validate (any invalid request fails the whole batch since the
+   // client id and version are the same for all of them)
+   Error error = json::parseJsonRpcBatchRequest(
+                  ptrConnection->request().body(),
+                  &(pBatch->requests),
+                  connection::requestEncoding(ptrConnection->request()));
+   BOOST_FOREACH(json::JsonRpcRequest& request, pBatch->requests)
+   {
+      if (error)
+         break;
+
+      error = validateJsonRpcRequest(
+                           request, session::persistentState().activeClientId());
+      request.isBackgroundConnection =
+                           (connectionType == BackgroundConnection);
+   }
+   if (error)
    {
-      Error error(json::errc::InvalidClientVersion, ERROR_LOCATION);
       ptrConnection->sendJsonRpcError(error);
+      return;
+   }
+
+   boost::posix_time::ptime receivedTime = ptrConnection->receivedTime();
+   if (!receivedTime.is_not_a_date_time())
+   {
+      boost::posix_time::time_duration wait = pBatch->startTime - receivedTime;
+      BOOST_FOREACH(const json::JsonRpcRequest& request, pBatch->requests)
+      {
+         metrics::recordLatency(kRpcQueueWaitMetric,
+                                "method",
+                                request.method,
+                                wait);
+      }
+      trace::recordSpan(trace::traceId(ptrConnection->request()),
+                        "session_queue_wait",
+                        receivedTime,
+                        pBatch->startTime);
+   }
+
+   pBatch->responses.resize(pBatch->requests.size());
+   executeRpcBatchRequest(pBatch, 0);
+}
+
+std::string rpcMethodName(boost::shared_ptr<HttpConnection> ptrConnection)
+{
+   const std::string& uri = ptrConnection->request().uri();
+   std::string::size_type pos = uri.find_last_of('/');
+   if (pos == std::string::npos)
+      return std::string();
+   else
+      return uri.substr(pos + 1);
+}
+
+// called on the connection listener thread for every connection bound
+// for the main connection queue. returns true (taking the connection off
+// of the main thread's hands) for requests for r-free methods
+bool dispatchRFreeRpcConnection(boost::shared_ptr<HttpConnection> ptrConnection)
+{
+   if (!isJsonRpcRequest(ptrConnection))
+      return false;
+
+   // until there is an active client only the main thread can validate
+   // requests (determining the active client id may create it)
+   if (s_activeClientId.get().empty())
       return false;
+
+   std::string method = rpcMethodName(ptrConnection);
+   LOCK_MUTEX(*s_pRFreeRpcMutex)
+   {
+      if (s_rFreeRpcMethods.find(method) == s_rFreeRpcMethods.end())
+         return false;
+
+      s_rFreeRpcConnections.push(ptrConnection);
    }
+   END_LOCK_MUTEX
 
-   // got through all of the validation, return true
+   s_pRFreeRpcCondition->notify_one();
    return true;
 }
 
+void handleRFreeRpcConnection(boost::shared_ptr<HttpConnection> ptrConnection)
+{
+   json::JsonRpcRequest request;
+   if (!parseAndValidateJsonRpcConnection(ptrConnection,
+                                          s_activeClientId.get(),
+                                          &request))
+   {
+      return;
+   }
+
+   using namespace boost::posix_time;
+   ptime executeStartTime = microsec_clock::universal_time();
+   ptime receivedTime = ptrConnection->receivedTime();
+   if (!receivedTime.is_not_a_date_time())
+   {
+      metrics::recordLatency(kRpcQueueWaitMetric,
+                             "method",
+                             request.method,
+                             executeStartTime - receivedTime);
+      trace::recordSpan(trace::traceId(ptrConnection->request()),
+                        "session_queue_wait",
+                        receivedTime,
+                        executeStartTime);
+   }
+
+   json::JsonRpcFunction function;
+   module_context::RFreeRpcPredicate canHandle;
+   LOCK_MUTEX(*s_pRFreeRpcMutex)
+   {
+      json::JsonRpcMethods::const_iterator it =
+                                 s_rFreeRpcMethods.find(request.method);
+      if (it != s_rFreeRpcMethods.end())
+         function = it->second;
+
+      std::map<std::string,module_context::RFreeRpcPredicate>::const_iterator
+                     predIt = s_rFreeRpcPredicates.find(request.method);
+      if (predIt != s_rFreeRpcPredicates.end())
+         canHandle = predIt->second;
+   }
+   END_LOCK_MUTEX
+
+   // hand requests which need R back to the main thread (bypassing the
+   // filter which sent them here)
+   if (function && canHandle && !canHandle(request))
+   {
+      httpConnectionListener().mainConnectionQueue().enqueConnection(
+                                                      ptrConnection, false);
+      return;
+   }
+
+   Error error;
+   json::JsonRpcResponse response;
+   if (function)
+   {
+      error = function(request, &response);
+   }
+   else
+   {
+      // the uri and the method named in the request body disagree
+      error = Error(json::errc::MethodNotFound, ERROR_LOCATION);
+      error.addProperty("method", request.method);
+      LOG_ERROR(error);
+   }
+
+   recordRpcExecution(request.method, rpcParamSizes(request), executeStartTime);
+   trace::recordSpanSince(trace::traceId(ptrConnection->request()),
+                          "session_execute",
+                          executeStartTime);
+
+   // note that unlike main thread rpcs we don't detect changes or report
+   // whether events are pending (both require the main thread)
+   if (error)
+   {
+      ptrConnection->sendJsonRpcError(error);
+   }
+   else
+   {
+      BOOST_ASSERT(!response.hasAfterResponse());
+      std::size_t responseBytes = 0;
+      ptrConnection->sendJsonRpcResponse(response, &responseBytes);
+      metrics::recordSize(kRpcResponseSizeMetric, "method", request.method,
+                          responseBytes);
+   }
+}
+
+void rFreeRpcWorkerMain()
+{
+   while (true)
+   {
+      try
+      {
+         boost::shared_ptr<HttpConnection> ptrConnection;
+         {
+            boost::unique_lock<boost::mutex> lock(*s_pRFreeRpcMutex);
+            while (s_rFreeRpcConnections.empty())
+               s_pRFreeRpcCondition->wait(lock);
+
+            ptrConnection = s_rFreeRpcConnections.front();
+            s_rFreeRpcConnections.pop();
+         }
+
+         handleRFreeRpcConnection(ptrConnection);
+      }
+      catch(const boost::thread_interrupted&)
+      {
+         break;
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+}
+
 void endHandleConnection(boost::shared_ptr<HttpConnection> ptrConnection,
                          ConnectionType connectionType,
                          http::Response* pResponse)
@@ -718,6 +1301,11 @@ void endHandleConnection(boost::shared_ptr<HttpConnection> ptrConnection,
       detectChanges(module_context::ChangeSourceURI);
 }
 
+void acknowledgeRequest(boost::shared_ptr<HttpConnection> ptrConnection)
+{
+   ptrConnection->sendJsonRpcResponse();
+}
+
 void handleConnection(boost::shared_ptr<HttpConnection> ptrConnection,
                       ConnectionType connectionType)
 {
@@ -741,9 +1329,16 @@ void handleConnection(boost::shared_ptr<HttpConnection> ptrConnection,
       // r code may execute - ensure session is initialized
       ensureSessionInitialized();
 
-      // attempt to parse & validate
+      // batch of requests
       json::JsonRpcRequest jsonRpcRequest;
-      if (parseAndValidateJsonRpcConnection(ptrConnection, &jsonRpcRequest))
+      if (isMethod(ptrConnection, kRpcBatch))
+      {
+         handleRpcBatchRequest(ptrConnection, connectionType);
+      }
+
+      // attempt to parse & validate
+      else if (parseAndValidateJsonRpcConnection(ptrConnection,
+                                                 &jsonRpcRequest))
       {
          // quit_session: exit process
          if (jsonRpcRequest.method == kQuitSession)
@@ -757,6 +1352,20 @@ void handleConnection(boost::shared_ptr<HttpConnection> ptrConnection,
             if (error)
                LOG_ERROR(error);
 
+#ifndef _WIN32
+            // keep this session resident when switching projects (if we
+            // are resumed we simply carry on serving the client)
+            if (!switchToProject.empty() &&
+                session::projects::parkForProjectSwitch(
+                   switchToProject,
+                   saveWorkspace,
+                   boost::bind(acknowledgeRequest, ptrConnection),
+                   suspendRequested))
+            {
+               return;
+            }
+#endif
+
             // note switch to project
             if (!switchToProject.empty())
             {
@@ -811,6 +1420,9 @@ void handleConnection(boost::shared_ptr<HttpConnection> ptrConnection,
 boost::thread::id s_mainThreadId;
 bool s_wasForked = false;
 
+// are we suspending in order to restart
+bool s_restartPending = false;
+
 // fork handlers (only applicatable to Unix platforms)
 #ifndef _WIN32
 
@@ -850,6 +1462,29 @@ void setupForkHandlers()
 }
 #endif
 
+// set (from any thread) when there is work pending for the main thread
+// (connections, child output, file changes) so that background processing
+// is performed right away rather than at the next polling interval
+core::thread::ThreadsafeValue<bool> s_wakeupPending(false);
+
+void onConnectionEnqueued()
+{
+   s_wakeupPending.set(true);
+
+   // wake R's event loop in case it is blocked waiting for input (the
+   // connection queue itself takes care of waking waitForMethod)
+   r::session::event_loop::wakeup();
+}
+
+void onBackgroundWorkPending()
+{
+   s_wakeupPending.set(true);
+   r::session::event_loop::wakeup();
+
+   // wake up waitForMethod if it is waiting on the connection queue
+   httpConnectionListener().mainConnectionQueue().notifyWaiters();
+}
+
 void polledEventHandler()
 {
    // if R is getting called after a fork this is likely multicore or
@@ -871,12 +1506,17 @@ void polledEventHandler()
    if (s_lastPerformed.is_not_a_date_time())
       s_lastPerformed = microsec_clock::universal_time();
 
-   // throttle to no more than once every 50ms
+   // throttle to no more than once every 50ms (unless there is work
+   // pending, in which case we want to attend to it right away)
    static time_duration s_intervalMs = milliseconds(50);
-   if (microsec_clock::universal_time() <= (s_lastPerformed + s_intervalMs))
+   bool wakeupPending = s_wakeupPending.get();
+   if (!wakeupPending &&
+       microsec_clock::universal_time() <= (s_lastPerformed + s_intervalMs))
       return;
 
    // notify modules
+   if (wakeupPending)
+      s_wakeupPending.set(false);
    module_context::onBackgroundProcessing(false);
 
    // set last performed (should be set after calling onBackgroundProcessing so
@@ -965,13 +1605,13 @@ void suspendIfRequested(const boost::function<bool()>& allowSuspend)
    // cooperative suspend request
    else if (s_suspendRequested && allowSuspend())
    {
-      // reset flag (if for any reason we fail we don't want to keep
-      // hammering away on the failure case)
-      s_suspendRequested = false;
-
       // attempt suspend -- if this succeeds it doesn't return; if it fails
-      // errors will be logged/reported internally and we will move on
-      suspendSession(false);
+      // errors will be logged/reported internally and we will move on. if
+      // the state is being saved in the background then we keep checking
+      // on it (otherwise reset the flag so we don't keep hammering away
+      // on the failure case)
+      if (!suspendSession(false))
+         s_suspendRequested = false;
    }
 }
 
@@ -999,6 +1639,16 @@ bool isTimedOut(const boost::posix_time::ptime& timeoutTime)
       return boost::posix_time::second_clock::universal_time() > timeoutTime;
 }
 
+// once the session has been idle (waiting for input with no requests) for
+// this long it releases the memory it can do without
+const int kIdleMemoryReleaseSeconds = 120;
+
+boost::posix_time::ptime memoryReleaseTimeFromNow()
+{
+   return boost::posix_time::second_clock::universal_time() +
+          boost::posix_time::seconds(kIdleMemoryReleaseSeconds);
+}
+
 boost::posix_time::ptime timeoutTimeFromNow()
 {
    int timeoutMinutes = session::options().timeoutMinutes();
@@ -1027,6 +1677,37 @@ void processDesktopGuiEvents()
    }
 }
 
+// how long waitForMethod should wait for a connection before performing
+// background processing. in desktop mode (where we pump gui events) and
+// while children are running we use a fixed polling interval. otherwise
+// we sleep until scheduled work is due, relying on connections, child
+// output, and file changes to wake us up early. we still wake once a
+// second to check for suspend requests and timeouts
+boost::posix_time::time_duration connectionQueueTimeout()
+{
+   using namespace boost::posix_time;
+   const time_duration kPollingInterval = milliseconds(50);
+   const time_duration kMaxIdleInterval = seconds(1);
+
+   if (s_wakeupPending.get())
+      return milliseconds(0);
+
+   if (session::options().programMode() == kSessionProgramModeDesktop ||
+       haveRunningChildren())
+   {
+      return kPollingInterval;
+   }
+
+   ptime nextWorkTime = module_context::nextScheduledWorkTime(true);
+   if (nextWorkTime.is_not_a_date_time())
+      return kMaxIdleInterval;
+
+   time_duration timeout = nextWorkTime - microsec_clock::universal_time();
+   if (timeout.is_negative())
+      return milliseconds(0);
+   else
+      return std::min(timeout, kMaxIdleInterval);
+}
 
 // wait for the specified method. will either:
 //   - return true and the method request in pRequest
@@ -1046,8 +1727,7 @@ bool waitForMethod(const std::string& method,
 
    // establish timeouts
    boost::posix_time::ptime timeoutTime = timeoutTimeFromNow();
-   boost::posix_time::time_duration connectionQueueTimeout =
-                                   boost::posix_time::milliseconds(50);
+   boost::posix_time::ptime memoryReleaseTime = memoryReleaseTimeFromNow();
 
    // wait until we get the method we are looking for
    while(true)
@@ -1075,15 +1755,25 @@ bool waitForMethod(const std::string& method,
       if(haveRunningChildren())
          timeoutTime = timeoutTimeFromNow();
 
-      // look for a connection (waiting for the specified interval)
+      // look for a connection (waiting until background processing is due)
       boost::shared_ptr<HttpConnection> ptrConnection =
           httpConnectionListener().mainConnectionQueue().dequeConnection(
-                                            connectionQueueTimeout);
+                                            connectionQueueTimeout());
 
 
       // perform background processing (true for isIdle)
+      s_wakeupPending.set(false);
       module_context::onBackgroundProcessing(true);
 
+      // release memory (just once per idle period)
+      if (!memoryReleaseTime.is_not_a_date_time() &&
+          boost::posix_time::second_clock::universal_time() > memoryReleaseTime)
+      {
+         module_context::releaseMemory();
+         memoryReleaseTime = boost::posix_time::ptime(
+                                       boost::posix_time::not_a_date_time);
+      }
+
       // process pending events in desktop mode
       processDesktopGuiEvents();
 
@@ -1117,8 +1807,11 @@ bool waitForMethod(const std::string& method,
             handleConnection(ptrConnection, ForegroundConnection);
          }
 
-         // since we got a connection we can reset the timeout time
+         // since we got a connection we can reset the timeout time (and
+         // any state being saved by a background suspend is now stale)
          timeoutTime = timeoutTimeFromNow();
+         memoryReleaseTime = memoryReleaseTimeFromNow();
+         r::session::invalidateBackgroundSuspend();
 
          // after we've processed at least one waitForMethod it is now safe to
          // initialize the polledEventHandler (which is used to maintain rsession
@@ -1226,7 +1919,10 @@ void doSuspendForRestart(const r::session::RSuspendOptions& options)
 {
    module_context::consoleWriteOutput("\nRestarting R session...\n\n");
 
+   // returns only if the state couldn't be saved
+   s_restartPending = true;
    r::session::suspendForRestart(options);
+   s_restartPending = false;
 }
 
 Error suspendForRestart(const core::json::JsonRpcRequest& request,
@@ -1256,12 +1952,83 @@ Error ping(const core::json::JsonRpcRequest& request,
 Error startHttpConnectionListener()
 {
    initializeHttpConnectionListener();
+
+   HttpConnectionQueue& mainQueue =
+                           httpConnectionListener().mainConnectionQueue();
+   mainQueue.setOnEnqueued(onConnectionEnqueued);
+   mainQueue.setConnectionFilter(dispatchRFreeRpcConnection);
+
+   for (int i = 0; i < kRFreeRpcWorkers; i++)
+      core::thread::safeLaunchThread(rFreeRpcWorkerMain);
+
+   // a restart zygote doesn't listen until it takes over from its session
+   if (session::options().zygote())
+      return Success();
+
    return httpConnectionListener().start();
 }
 
 Error startClientEventService()
 {
-   return clientEventService().start(session::persistentState().activeClientId());
+   std::string clientId = session::persistentState().activeClientId();
+   s_activeClientId.set(clientId);
+   return clientEventService().start(clientId);
+}
+
+std::size_t clientEventsMemoryUsage()
+{
+   return clientEventQueue().memoryUsage();
+}
+
+std::size_t consoleActionsMemoryUsage()
+{
+   return r::session::consoleActions().memoryUsage();
+}
+
+// approximate bytes held by each subsystem (outside of R) and by the heap
+Error getMemoryUsage(const core::json::JsonRpcRequest& request,
+                     json::JsonRpcResponse* pResponse)
+{
+   json::Object subsystemsJson;
+   std::map<std::string,std::size_t> usage = module_context::memoryUsage();
+   for (std::map<std::string,std::size_t>::const_iterator it = usage.begin();
+        it != usage.end();
+        ++it)
+   {
+      subsystemsJson[it->first] = static_cast<double>(it->second);
+   }
+
+   core::system::HeapStatistics heap = core::system::heapStatistics();
+
+   json::Object usageJson;
+   usageJson["subsystems"] = subsystemsJson;
+   usageJson["heap_in_use"] = static_cast<double>(heap.inUse);
+   usageJson["heap_free"] = static_cast<double>(heap.free);
+   pResponse->setResult(usageJson);
+   return Success();
+}
+
+// memory usage is only computed on demand so the gauges are updated as
+// metrics are requested
+void handleMetricsRequest(const http::Request& request,
+                          http::Response* pResponse)
+{
+   std::map<std::string,std::size_t> usage = module_context::memoryUsage();
+   for (std::map<std::string,std::size_t>::const_iterator it = usage.begin();
+        it != usage.end();
+        ++it)
+   {
+      metrics::setGauge("rsession_memory_bytes", "subsystem", it->first,
+                        static_cast<double>(it->second));
+   }
+
+   core::system::HeapStatistics heap = core::system::heapStatistics();
+   metrics::setGauge("rsession_heap_bytes", "state", "in_use",
+                     static_cast<double>(heap.inUse));
+   metrics::setGauge("rsession_heap_bytes", "state", "free",
+                     static_cast<double>(heap.free));
+
+   metrics::handleMetricsRequest(request, pResponse);
 }
 
 void registerGwtHandlers()
@@ -1281,6 +2048,22 @@ void registerGwtHandlers()
          "/progress",
           boost::bind(text::handleTemplateRequest, progressPagePath, _1, _2));
 
+   // establish metrics handler
+   module_context::registerUriHandler("/metrics", handleMetricsRequest);
+
+   // establish handler for the spans of traced requests (requests are
+   // only traced when rserver assigns them a trace id). the uri is under
+   // /session so that rserver proxies it like other session content
+   module_context::registerUriHandler("/session_trace",
+                                      trace::handleTraceRequest);
+
+   // set compression policy for responses (including www files)
+   http::CompressionPolicy compressionPolicy;
+   compressionPolicy.level = options.wwwCompressionLevel();
+   compressionPolicy.minimumSize = std::max(0, options.wwwCompressionMinSize());
+   compressionPolicy.precompressedFiles = options.wwwCompressionPrecompressed();
+   http::setCompressionPolicy(compressionPolicy);
+
    // set default handler
    s_defaultUriHandler = gwt::fileHandlerFunction(options.wwwLocalPath(), "/");
 }
@@ -1342,6 +2125,99 @@ Error runPreflightScript()
    return Success();
 }
       
+// startup trace (time taken by each step of session initialization)
+std::vector<std::pair<std::string,double> > s_startupTrace;
+
+Error timedInitStep(const std::string& step, const ExecBlock::Function& function)
+{
+   PerformanceTimer timer(step);
+   Error error = function();
+   timer.stop();
+   double ms = timer.steps().back().second.total_microseconds() * 0.001;
+   s_startupTrace.push_back(std::make_pair(step, ms));
+   return error;
+}
+
+ExecBlock::Function timedInit(const std::string& step,
+                              const ExecBlock::Function& function)
+{
+   return boost::bind(timedInitStep, step, function);
+}
+
+void logStartupTrace(const std::string& phase)
+{
+   std::ostringstream ostr;
+   ostr << "Session " << phase << " timing:";
+   typedef std::pair<std::string,double> Step;
+   BOOST_FOREACH(const Step& step, s_startupTrace)
+      ostr << " " << step.first << "=" << step.second << "ms";
+   LOG_DEBUG_MESSAGE(ostr.str());
+}
+
+Error getStartupTrace(const core::json::JsonRpcRequest& request,
+                      json::JsonRpcResponse* pResponse)
+{
+   json::Array traceJson;
+   typedef std::pair<std::string,double> Step;
+   BOOST_FOREACH(const Step& step, s_startupTrace)
+   {
+      json::Object stepJson;
+      stepJson["step"] = step.first;
+      stepJson["ms"] = step.second;
+      traceJson.push_back(stepJson);
+   }
+   pResponse->setResult(traceJson);
+   return Success();
+}
+
+json::Object histogramAsJson(const metrics::LatencyHistogram& histogram,
+                             double scale)
+{
+   json::Object histogramJson;
+   histogramJson["count"] = static_cast<double>(histogram.count());
+   histogramJson["sum"] = histogram.sum() / scale;
+   histogramJson["p50"] = histogram.valueAtQuantile(0.5) / scale;
+   histogramJson["p90"] = histogram.valueAtQuantile(0.9) / scale;
+   histogramJson["p99"] = histogram.valueAtQuantile(0.99) / scale;
+   histogramJson["max"] = histogram.valueAtQuantile(1.0) / scale;
+   return histogramJson;
+}
+
+// per-method rpc timings (in ms) and response sizes (in bytes)
+Error getRpcMetrics(const core::json::JsonRpcRequest& request,
+                    json::JsonRpcResponse* pResponse)
+{
+   metrics::Histograms queueWait =
+                        metrics::latencyHistograms(kRpcQueueWaitMetric);
+   metrics::Histograms execution =
+                        metrics::latencyHistograms(kRpcExecutionMetric);
+   metrics::Histograms responseSize =
+                        metrics::sizeHistograms(kRpcResponseSizeMetric);
+
+   json::Array methodsJson;
+   for (metrics::Histograms::const_iterator it = execution.begin();
+        it != execution.end();
+        ++it)
+   {
+      json::Object methodJson;
+      methodJson["method"] = it->first;
+      methodJson["execution_ms"] = histogramAsJson(it->second, 1000.0);
+
+      metrics::Histograms::const_iterator waitIt = queueWait.find(it->first);
+      if (waitIt != queueWait.end())
+         methodJson["queue_wait_ms"] = histogramAsJson(waitIt->second, 1000.0);
+
+      metrics::Histograms::const_iterator sizeIt = responseSize.find(it->first);
+      if (sizeIt != responseSize.end())
+         methodJson["response_bytes"] = histogramAsJson(sizeIt->second, 1.0);
+
+      methodsJson.push_back(methodJson);
+   }
+
+   pResponse->setResult(methodsJson);
+   return Success();
+}
+
 Error rInit(const r::session::RInitInfo& rInitInfo) 
 {
    // save state we need to reference later
@@ -1353,6 +2229,12 @@ Error rInit(const r::session::RInitInfo& rInitInfo)
    s_waitForMethodNames.push_back(kChooseFileCompleted);
    s_waitForMethodNames.push_back(kHandleUnsavedChangesCompleted);
 
+   // account for memory held by our own queues and buffers
+   module_context::registerMemoryUsage("client_events",
+                                       clientEventsMemoryUsage);
+   module_context::registerMemoryUsage("console_actions",
+                                       consoleActionsMemoryUsage);
+
    // execute core initialization functions
    using boost::bind;
    using namespace core::system;
@@ -1367,59 +2249,65 @@ Error rInit(const r::session::RInitInfo& rInitInfo)
       (bind(registerRpcMethod, kConsoleInput, bufferConsoleInput))
       (bind(registerRpcMethod, "suspend_for_restart", suspendForRestart))
       (bind(registerRpcMethod, "ping", ping))
+      (bind(registerRpcMethod, "get_startup_trace", getStartupTrace))
+      (bind(registerRpcMethod, "get_rpc_metrics", getRpcMetrics))
+      (bind(registerRpcMethod, "get_memory_usage", getMemoryUsage))
 
       // signal handlers
       (registerSignalHandlers)
 
       // main module context
-      (module_context::initialize)
+      (timedInit("module_context", module_context::initialize))
 
       // projects (early project init required -- module inits below
       // can then depend on e.g. computed defaultEncoding)
-      (projects::initialize)
+      (timedInit("projects", projects::initialize))
 
       // source database
-      (source_database::initialize)
+      (timedInit("source_database", source_database::initialize))
    
       // modules with c++ implementations
-      (modules::spelling::initialize)
-      (modules::lists::initialize)
-      (modules::path::initialize)
-      (modules::content_urls::initialize)
-      (modules::limits::initialize)
-      (modules::ask_pass::initialize)
-      (modules::agreement::initialize)
-      (modules::console::initialize)
-      (modules::console_process::initialize)
+      (timedInit("spelling", modules::spelling::initialize))
+      (timedInit("lists", modules::lists::initialize))
+      (timedInit("path", modules::path::initialize))
+      (timedInit("content_urls", modules::content_urls::initialize))
+      (timedInit("limits", modules::limits::initialize))
+      (timedInit("ask_pass", modules::ask_pass::initialize))
+      (timedInit("agreement", modules::agreement::initialize))
+      (timedInit("console", modules::console::initialize))
+      (timedInit("console_process", modules::console_process::initialize))
 #ifdef RSTUDIO_SERVER
-      (modules::crypto::initialize)
+      (timedInit("crypto", modules::crypto::initialize))
 #endif
-      (modules::files::initialize)
-      (modules::find::initialize)
-      (modules::workspace::initialize)
-      (modules::workbench::initialize)
-      (modules::data::initialize)
-      (modules::help::initialize)
-      (modules::presentation::initialize)
-      (modules::plots::initialize)
-      (modules::packages::initialize)
-      (modules::rpubs::initialize)
-      (modules::source::initialize)
-      (modules::source_control::initialize)
-      (modules::authoring::initialize)
-      (modules::html_preview::initialize)
-      (modules::history::initialize)
-      (modules::code_search::initialize)
-      (modules::build::initialize)
+      (timedInit("files", modules::files::initialize))
+      (timedInit("find", modules::find::initialize))
+      (timedInit("workspace", modules::workspace::initialize))
+      (timedInit("workbench", modules::workbench::initialize))
+      (timedInit("data", modules::data::initialize))
+      (timedInit("large_files", modules::large_files::initialize))
+      (timedInit("help", modules::help::initialize))
+      (timedInit("presentation", modules::presentation::initialize))
+      (timedInit("plots", modules::plots::initialize))
+      (timedInit("packages", modules::packages::initialize))
+      (timedInit("rpubs", modules::rpubs::initialize))
+      (timedInit("source", modules::source::initialize))
+      (timedInit("source_control", modules::source_control::initialize))
+      (timedInit("authoring", modules::authoring::initialize))
+      (timedInit("html_preview", modules::html_preview::initialize))
+      (timedInit("history", modules::history::initialize))
+      (timedInit("code_search", modules::code_search::initialize))
+      (timedInit("completion", modules::completion::initialize))
+      (timedInit("build", modules::build::initialize))
 
       // workers
-      (workers::web_request::initialize)
+      (timedInit("web_request", workers::web_request::initialize))
 
       // addins
-      (addins::initialize)
+      (timedInit("addins", addins::initialize))
 
       // R code
-      (bind(sourceModuleRFile, "SessionCodeTools.R"))
+      (timedInit("SessionCodeTools.R",
+                 bind(sourceModuleRFile, "SessionCodeTools.R")))
    
       // unsupported functions
       (bind(r::function_hook::registerUnsupported, "bug.report", "utils"))
@@ -1501,13 +2389,32 @@ Error rInit(const r::session::RInitInfo& rInitInfo)
    // setup fork handlers
    setupForkHandlers();
 
+   logStartupTrace("init");
+
    // success!
    return Success();
 }
 
-void rDeferredInit(bool newSession)
+Error fireDeferredInit(bool newSession)
 {
    module_context::events().onDeferredInit(newSession);
+   return Success();
+}
+
+void rDeferredInit(bool newSession)
+{
+   Error error = timedInitStep("deferred_init",
+                               boost::bind(fireDeferredInit, newSession));
+   if (error)
+      LOG_ERROR(error);
+   logStartupTrace("deferred init");
+
+#ifndef _WIN32
+   // now that we are up have a zygote ready for the next restart
+   error = restart_zygote::launch();
+   if (error)
+      LOG_ERROR(error);
+#endif
 
    // fire an event to the client
    ClientEvent event(client_events::kDeferredInitCompleted);
@@ -1721,8 +2628,7 @@ void rConsoleWrite(const std::string& output, int otype)
       return;
 
    int event = otype == 1 ? kConsoleWriteError : kConsoleWriteOutput;
-   ClientEvent writeEvent(event, output);
-   session::clientEventQueue().add(writeEvent);
+   session::clientEventQueue().addConsoleOutput(event, output);
 
    // fire event
    module_context::events().onConsoleOutput(
@@ -1983,6 +2889,12 @@ void rCleanup(bool terminatedNormally)
       {
          clientEventService().stop();
          httpConnectionListener().stop();
+
+#ifndef _WIN32
+         // let our restart zygote (if any) take over
+         if (s_restartPending)
+            restart_zygote::handOff();
+#endif
       }
 
       // terminate known child processes
@@ -2312,6 +3224,45 @@ Error registerRpcMethod(const std::string& name,
    return Success();
 }
 
+Error registerRFreeRpcMethod(const std::string& name,
+                             const core::json::JsonRpcFunction& function)
+{
+   // also register as a normal method (requests which arrive before there
+   // is an active client are still handled on the main thread)
+   Error error = registerRpcMethod(name, function);
+   if (error)
+      return error;
+
+   LOCK_MUTEX(*s_pRFreeRpcMutex)
+   {
+      s_rFreeRpcMethods.insert(std::make_pair(name, function));
+   }
+   END_LOCK_MUTEX
+
+   return Success();
+}
+
+bool isNextRpcMethod(const std::string& name)
+{
+   std::string uri =
+      httpConnectionListener().mainConnectionQueue().peekNextConnectionUri();
+   return boost::algorithm::starts_with(uri, "/rpc/") &&
+          isMethod(uri, "/" + name);
+}
+
+Error registerConditionalRFreeRpcMethod(const std::string& name,
+                                        const json::JsonRpcFunction& function,
+                                        const RFreeRpcPredicate& canHandle)
+{
+   LOCK_MUTEX(*s_pRFreeRpcMutex)
+   {
+      s_rFreeRpcPredicates.insert(std::make_pair(name, canHandle));
+   }
+   END_LOCK_MUTEX
+
+   return registerRFreeRpcMethod(name, function);
+}
+
 namespace {
 
 bool continueChildProcess(core::system::ProcessOperations&)
@@ -2580,6 +3531,11 @@ int main (int argc, char * const argv[])
       // set version
       s_version = installedVersion();
 
+#ifndef _WIN32
+      // note how we were launched (restart zygotes are launched the same way)
+      restart_zygote::initialize(argc, argv);
+#endif
+
       // set the rstudio environment variable so code can check for
       // whether rstudio is running
       core::system::setenv("RSTUDIO", "1");
@@ -2612,9 +3568,6 @@ int main (int argc, char * const argv[])
       }
 #endif
 
-      // start the file monitor
-      core::system::file_monitor::initialize();
-
       // initialize client event queue. this must be done very early
       // in main so that any other code which needs to enque an event
       // has access to the queue
@@ -2663,6 +3616,33 @@ int main (int argc, char * const argv[])
       if (error)
          return sessionExitFailure(error, ERROR_LOCATION);
 
+      // start the file monitor (after the http connection listener since
+      // pending file monitor callbacks wake up its connection queue)
+      core::system::file_monitor::Backend fileMonitorBackend =
+            core::system::file_monitor::DefaultBackend;
+      if (session::options().fileMonitorBackend() == "fanotify")
+         fileMonitorBackend = core::system::file_monitor::FanotifyBackend;
+      core::system::file_monitor::initialize(
+                                    onBackgroundWorkPending,
+                                    fileMonitorBackend,
+                                    &module_context::backgroundThreadPool());
+
+#ifndef _WIN32
+      if (session::options().sharedFileMonitor())
+      {
+         error = shared_file_monitor::initialize(onBackgroundWorkPending);
+         if (error)
+            LOG_ERROR(error);
+      }
+#endif
+
+      // watch child process output so that it is delivered as soon as it
+      // arrives (rather than at the next background processing interval)
+      error = module_context::processSupervisor().watchOutput(
+                                                   onBackgroundWorkPending);
+      if (error)
+         LOG_ERROR(error);
+
       // run optional preflight script -- needs to be after the http listeners
       // so the proxy server sees that we have startup up
       error = runPreflightScript();
@@ -2718,6 +3698,7 @@ int main (int argc, char * const argv[])
       rOptions.saveWorkspace = saveWorkspaceOption();
       rOptions.rProfileOnResume = serverMode &&
                                   userSettings().rProfileOnResume();
+      rOptions.restartZygote = options.zygote();
       
       // r callbacks
       r::session::RCallbacks rCallbacks;
@@ -2742,6 +3723,9 @@ int main (int argc, char * const argv[])
       rCallbacks.showHelp = rShowHelp;
       rCallbacks.showMessage = rShowMessage;
       rCallbacks.serialization = rSerialization;
+#ifndef _WIN32
+      rCallbacks.waitForRestart = restart_zygote::waitForRestart;
+#endif
       
       // run r (does not return, terminates process using exit)
       error = r::session::run(rOptions, rCallbacks) ;
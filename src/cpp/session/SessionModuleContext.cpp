@@ -15,6 +15,7 @@
 
 #include "SessionModuleContextInternal.hpp"
 
+#include <map>
 #include <vector>
 
 #include <boost/assert.hpp>
@@ -35,7 +36,10 @@
 #include <core/system/FileScanner.hpp>
 #include <core/IncrementalCommand.hpp>
 #include <core/PeriodicCommand.hpp>
+#include <core/Thread.hpp>
+#include <core/ThreadPool.hpp>
 #include <core/collection/Tree.hpp>
+#include <core/text/ContentSniffer.hpp>
 
 #include <core/http/Util.hpp>
 
@@ -274,25 +278,53 @@ boost::shared_ptr<tree<FileInfo> > monitoredPathTree()
    return pMonitoredTree;
 }
 
-bool scanForMonitoredPathChanges(boost::shared_ptr<tree<FileInfo> > pPrevTree)
+// scanning interval (backs off while nothing is changing so that idle
+// sessions, typically on network filesystems where file monitoring isn't
+// available, don't continually rescan)
+const int kMinScanIntervalSeconds = 3;
+const int kMaxScanIntervalSeconds = 30;
+
+boost::shared_ptr<tree<FileInfo> > s_pMonitoredTree;
+int s_scanIntervalSeconds = kMinScanIntervalSeconds;
+
+void scheduleMonitoredPathScan();
+
+void scanForMonitoredPathChanges()
 {
    // check for changes
    std::vector<core::system::FileChangeEvent> changes;
    boost::shared_ptr<tree<FileInfo> > pCurrentTree = monitoredPathTree();
-   core::system::collectFileChangeEvents(pPrevTree->begin(),
-                                         pPrevTree->end(),
-                                         pCurrentTree->begin(),
-                                         pCurrentTree->end(),
-                                         &changes);
+   core::system::collectFileChangeEvents(
+                                    *s_pMonitoredTree,
+                                    *pCurrentTree,
+                                    boost::function<bool(const FileInfo&)>(),
+                                    &backgroundThreadPool(),
+                                    &changes);
 
    // fire events
    onFilesChanged(changes);
 
-   // reset the tree
-   *pPrevTree = *pCurrentTree;
+   // the current tree becomes the one we compare against next time
+   s_pMonitoredTree = pCurrentTree;
+
+   // scan more frequently while things are changing
+   if (!changes.empty())
+      s_scanIntervalSeconds = kMinScanIntervalSeconds;
+   else
+      s_scanIntervalSeconds = std::min(s_scanIntervalSeconds * 2,
+                                       kMaxScanIntervalSeconds);
 
    // scan again after interval
-   return true;
+   scheduleMonitoredPathScan();
+}
+
+void scheduleMonitoredPathScan()
+{
+   module_context::scheduleDelayedWork(
+         boost::posix_time::seconds(s_scanIntervalSeconds),
+         scanForMonitoredPathChanges,
+         true,
+         module_context::WorkPriorityLow);
 }
 
 void onMonitoringError(const Error& error)
@@ -304,10 +336,8 @@ void onMonitoringError(const Error& error)
    if (!s_monitorByScanning)
    {
       s_monitorByScanning = true;
-      module_context::schedulePeriodicWork(
-         boost::posix_time::seconds(3),
-         boost::bind(scanForMonitoredPathChanges, monitoredPathTree()),
-         true);
+      s_pMonitoredTree = monitoredPathTree();
+      scheduleMonitoredPathScan();
    }
 }
 
@@ -346,6 +376,47 @@ FilePath registerMonitoredUserScratchDir(const std::string& dirName,
 
 
 
+core::thread::ThreadPool& backgroundThreadPool()
+{
+   // allocated on the heap so it is never destroyed (the threads are stopped
+   // explicitly at shutdown)
+   static core::thread::ThreadPool* pPool = new core::thread::ThreadPool();
+   return *pPool;
+}
+
+namespace {
+
+// completion callbacks for background work (run on the main thread)
+core::thread::ThreadsafeQueue<boost::function<void()> > s_backgroundCompletions;
+
+void executeBackgroundWork(const boost::function<void()>& work,
+                           const boost::function<void()>& onCompleted)
+{
+   work();
+   if (onCompleted)
+      s_backgroundCompletions.enque(onCompleted);
+}
+
+void processBackgroundCompletions()
+{
+   boost::function<void()> onCompleted;
+   while (s_backgroundCompletions.deque(&onCompleted))
+   {
+      try
+      {
+         onCompleted();
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+}
+
+void stopBackgroundThreadPool(bool)
+{
+   backgroundThreadPool().stop();
+}
+
+} // anonymous namespace
+
 Error initialize()
 {
    // register rs_enqueClientEvent with R 
@@ -414,6 +485,9 @@ Error initialize()
    // initialize monitored scratch dir
    initializeMonitoredUserScratchDir();
 
+   // stop background threads at shutdown
+   events().onShutdown.connect(stopBackgroundThreadPool);
+
    // source the ModuleTools.R file
    FilePath modulesPath = session::options().modulesRSourcePath();
    return r::sourceManager().sourceTools(modulesPath.complete("ModuleTools.R"));
@@ -491,72 +565,196 @@ void onResumed(const Settings& persistentState)
 
 namespace {
 
-typedef std::vector<boost::shared_ptr<ScheduledCommand> >
-                                                      ScheduledCommands;
+// scheduled command along with its priority and timing stats
+struct ScheduledWork
+{
+   ScheduledWork(boost::shared_ptr<ScheduledCommand> pCommand,
+                 WorkPriority priority)
+      : pCommand(pCommand), priority(priority), executions(0)
+   {
+   }
+   boost::shared_ptr<ScheduledCommand> pCommand;
+   WorkPriority priority;
+   std::size_t executions;
+   boost::posix_time::time_duration totalTime;
+   boost::posix_time::time_duration maxTime;
+};
+
+typedef std::vector<ScheduledWork> ScheduledCommands;
 ScheduledCommands s_scheduledCommands;
 ScheduledCommands s_idleScheduledCommands;
 
-void addScheduledCommand(boost::shared_ptr<ScheduledCommand> pCommand,
-                         bool idleOnly)
+// commands scheduled while we are executing commands (added once the
+// current pass completes so we don't modify the lists as we iterate them)
+bool s_executingScheduledCommands = false;
+std::vector<std::pair<ScheduledWork,bool> > s_pendingScheduledCommands;
+
+// maximum time to spend executing scheduled commands in a single pass of
+// background processing (so that background work adds only a bounded
+// amount of latency to handling console input)
+const boost::posix_time::time_duration kScheduledWorkBudget =
+                                    boost::posix_time::milliseconds(25);
+
+boost::posix_time::ptime now()
 {
-   if (idleOnly)
-      s_idleScheduledCommands.push_back(pCommand);
+   return boost::posix_time::microsec_clock::universal_time();
+}
+
+void addScheduledCommand(boost::shared_ptr<ScheduledCommand> pCommand,
+                         bool idleOnly,
+                         WorkPriority priority)
+{
+   ScheduledWork work(pCommand, priority);
+   if (s_executingScheduledCommands)
+      s_pendingScheduledCommands.push_back(std::make_pair(work, idleOnly));
+   else if (idleOnly)
+      s_idleScheduledCommands.push_back(work);
    else
-      s_scheduledCommands.push_back(pCommand);
+      s_scheduledCommands.push_back(work);
+}
+
+bool isHigherPriority(const ScheduledWork& a, const ScheduledWork& b)
+{
+   return a.priority > b.priority;
+}
+
+bool isFinished(const ScheduledWork& work)
+{
+   return work.pCommand->finished();
+}
+
+void recordExecution(ScheduledWork* pWork,
+                     const boost::posix_time::time_duration& elapsed)
+{
+   pWork->executions++;
+   pWork->totalTime += elapsed;
+   if (elapsed > pWork->maxTime)
+      pWork->maxTime = elapsed;
+
+   if (elapsed > kScheduledWorkBudget)
+   {
+      boost::format fmt("Scheduled work (priority %1%) took %2%ms "
+                        "(%3% executions, %4%ms average, %5%ms max)");
+      LOG_DEBUG_MESSAGE(boost::str(
+         fmt % pWork->priority
+             % elapsed.total_milliseconds()
+             % pWork->executions
+             % (pWork->totalTime.total_milliseconds() / pWork->executions)
+             % pWork->maxTime.total_milliseconds()));
+   }
 }
 
-void executeScheduledCommands(ScheduledCommands* pCommands)
+void executeScheduledCommands(ScheduledCommands* pCommands,
+                              const boost::posix_time::ptime& deadline,
+                              bool* pExecutedAny)
 {
-   // execute all commands
-   std::for_each(pCommands->begin(),
-                 pCommands->end(),
-                 boost::bind(&ScheduledCommand::execute, _1));
+   // order by priority (the sort is stable so commands which didn't get to
+   // execute during the last pass stay ahead of those which did)
+   std::stable_sort(pCommands->begin(), pCommands->end(), isHigherPriority);
+
+   // execute commands until we exceed the time budget (always execute at
+   // least one command per pass so that we make progress)
+   std::size_t executed = 0;
+   for (; executed < pCommands->size(); executed++)
+   {
+      if (*pExecutedAny && now() >= deadline)
+         break;
+
+      ScheduledWork& work = pCommands->at(executed);
+      boost::posix_time::ptime started = now();
+      work.pCommand->execute();
+      recordExecution(&work, now() - started);
+      *pExecutedAny = true;
+   }
+
+   // move the commands we executed to the back for round-robin fairness
+   std::rotate(pCommands->begin(),
+               pCommands->begin() + executed,
+               pCommands->end());
 
    // remove any commands which are finished
-   pCommands->erase(
-                 std::remove_if(
-                    pCommands->begin(),
-                    pCommands->end(),
-                    boost::bind(&ScheduledCommand::finished, _1)),
-                 pCommands->end());
+   pCommands->erase(std::remove_if(pCommands->begin(),
+                                   pCommands->end(),
+                                   isFinished),
+                    pCommands->end());
 }
 
+void executeScheduledCommands(bool isIdle)
+{
+   boost::posix_time::ptime deadline = now() + kScheduledWorkBudget;
+   bool executedAny = false;
+
+   s_executingScheduledCommands = true;
+   executeScheduledCommands(&s_scheduledCommands, deadline, &executedAny);
+   if (isIdle)
+      executeScheduledCommands(&s_idleScheduledCommands, deadline, &executedAny);
+   s_executingScheduledCommands = false;
+
+   // add commands which were scheduled while we were executing
+   std::vector<std::pair<ScheduledWork,bool> > pending;
+   pending.swap(s_pendingScheduledCommands);
+   for (std::size_t i = 0; i < pending.size(); i++)
+   {
+      if (pending[i].second)
+         s_idleScheduledCommands.push_back(pending[i].first);
+      else
+         s_scheduledCommands.push_back(pending[i].first);
+   }
+}
+
+boost::posix_time::ptime nextExecutionTime(const ScheduledCommands& commands)
+{
+   boost::posix_time::ptime next(boost::posix_time::not_a_date_time);
+   BOOST_FOREACH(const ScheduledWork& work, commands)
+   {
+      boost::posix_time::ptime time = work.pCommand->nextExecutionTime();
+      if (next.is_not_a_date_time() || time < next)
+         next = time;
+   }
+   return next;
+}
 
 } // anonymous namespace
 
 void scheduleIncrementalWork(
          const boost::posix_time::time_duration& incrementalDuration,
          const boost::function<bool()>& execute,
-         bool idleOnly)
+         bool idleOnly,
+         WorkPriority priority)
 {
    addScheduledCommand(boost::shared_ptr<ScheduledCommand>(
                            new IncrementalCommand(incrementalDuration,
                                                   execute)),
-                         idleOnly);
+                       idleOnly,
+                       priority);
 }
 
 void scheduleIncrementalWork(
          const boost::posix_time::time_duration& initialDuration,
          const boost::posix_time::time_duration& incrementalDuration,
          const boost::function<bool()>& execute,
-         bool idleOnly)
+         bool idleOnly,
+         WorkPriority priority)
 {
    addScheduledCommand(boost::shared_ptr<ScheduledCommand>(
                            new IncrementalCommand(initialDuration,
                                                   incrementalDuration,
                                                   execute)),
-                           idleOnly);
+                       idleOnly,
+                       priority);
 }
 
 
 void schedulePeriodicWork(const boost::posix_time::time_duration& period,
                           const boost::function<bool()> &execute,
                           bool idleOnly,
-                          bool immediate)
+                          bool immediate,
+                          WorkPriority priority)
 {
    addScheduledCommand(boost::shared_ptr<ScheduledCommand>(
                            new PeriodicCommand(period, execute, immediate)),
-                       idleOnly);
+                       idleOnly,
+                       priority);
 }
 
 
@@ -572,15 +770,24 @@ bool performDelayedWork(const boost::function<void()> &execute)
 
 void scheduleDelayedWork(const boost::posix_time::time_duration& period,
                          const boost::function<void()> &execute,
-                         bool idleOnly)
+                         bool idleOnly,
+                         WorkPriority priority)
 {
    schedulePeriodicWork(period,
                         boost::bind(performDelayedWork, execute),
                         idleOnly,
-                        false);
+                        false,
+                        priority);
 }
 
 
+void executeInBackground(const boost::function<void()>& work,
+                         const boost::function<void()>& onCompleted)
+{
+   backgroundThreadPool().execute(
+                  boost::bind(executeBackgroundWork, work, onCompleted));
+}
+
 void onBackgroundProcessing(bool isIdle)
 {
    // allow process supervisor to poll for events
@@ -592,10 +799,31 @@ void onBackgroundProcessing(bool isIdle)
    // fire event
    events().onBackgroundProcessing(isIdle);
 
+   // notify of background work which has completed
+   processBackgroundCompletions();
+
    // execute incremental commands
-   executeScheduledCommands(&s_scheduledCommands);
+   executeScheduledCommands(isIdle);
+}
+
+boost::posix_time::ptime nextScheduledWorkTime(bool isIdle)
+{
+   // completed background work is processed right away
+   if (!s_backgroundCompletions.isEmpty())
+      return now();
+
+   boost::posix_time::ptime next = nextExecutionTime(s_scheduledCommands);
    if (isIdle)
-      executeScheduledCommands(&s_idleScheduledCommands);
+   {
+      boost::posix_time::ptime idleNext =
+                              nextExecutionTime(s_idleScheduledCommands);
+      if (next.is_not_a_date_time() ||
+          (!idleNext.is_not_a_date_time() && idleNext < next))
+      {
+         next = idleNext;
+      }
+   }
+   return next;
 }
 
 Error readAndDecodeFile(const FilePath& filePath,
@@ -645,7 +873,25 @@ FilePath userHomePath()
 
 std::string createAliasedPath(const FileInfo& fileInfo)
 {
-   return createAliasedPath(FilePath(fileInfo.absolutePath()));
+   // alias using the path string directly (this is called for every file
+   // in a listing so we avoid constructing a FilePath for each one). note
+   // that the home path is fixed for the lifetime of the session
+   static std::string s_homePath;
+   if (s_homePath.empty())
+      s_homePath = userHomePath().absolutePath();
+
+   std::string path = fileInfo.absolutePath();
+   if (path == s_homePath)
+      return "~";
+   else if (s_homePath.length() > 1 &&
+            path.length() > s_homePath.length() + 1 &&
+            path[s_homePath.length()] == '/' &&
+            path.compare(0, s_homePath.length(), s_homePath) == 0)
+      return "~" + path.substr(s_homePath.length());
+   else if (s_homePath.length() > 1)
+      return path;
+   else
+      return createAliasedPath(FilePath(path));
 }
    
 std::string createAliasedPath(const FilePath& path)
@@ -751,46 +997,16 @@ bool isTextFile(const FilePath& targetPath)
    if (targetPath.size() == 0)
       return true;
 
-#ifndef _WIN32
-   core::shell_utils::ShellCommand cmd("file");
-   cmd << "--dereference";
-   cmd << "--mime-type";
-   cmd << "--brief";
-   cmd << targetPath;
-   core::system::ProcessResult result;
-   Error error = core::system::runCommand(cmd,
-                                          core::system::ProcessOptions(),
-                                          &result);
-   if (error)
-   {
-      LOG_ERROR(error);
-      return error;
-   }
-
-   std::string fileType = boost::algorithm::trim_copy(result.stdOut);
-   return boost::algorithm::starts_with(fileType, "text/") ||
-          boost::algorithm::ends_with(fileType, "+xml") ||
-          boost::algorithm::ends_with(fileType, "x-empty") ||
-          boost::algorithm::equals(fileType, "application/postscript");
-#else
-
-   // read contents of file
-   std::string contents;
-   Error error = core::readStringFromFile(targetPath, &contents);
+   // examine the start of the file (in process rather than running
+   // `file` since we may be asked about many files)
+   bool isText;
+   Error error = core::text::isTextFile(targetPath, &isText);
    if (error)
    {
       LOG_ERROR(error);
-      return error;
+      return false;
    }
-
-   // does it have null bytes?
-   std::string nullBytes;
-   nullBytes.push_back('\0');
-   nullBytes.push_back('\0');
-   return !boost::algorithm::contains(contents, nullBytes);
-
-#endif
-
+   return isText;
 }
 
 Error rBinDir(core::FilePath* pRBinDirPath)
@@ -847,9 +1063,10 @@ json::Object createFileSystemItem(const FileInfo& fileInfo)
 {
    json::Object entry ;
 
+   // (the raw path is the same as the path we aliased, resolving the
+   // alias just gets us back to where we started)
    std::string aliasedPath = module_context::createAliasedPath(fileInfo);
-   std::string rawPath =
-         module_context::resolveAliasedPath(aliasedPath).absolutePath();
+   std::string rawPath = fileInfo.absolutePath();
 
    entry["path"] = aliasedPath;
    if (aliasedPath != rawPath)
@@ -1152,8 +1369,21 @@ void showContent(const std::string& title, const core::FilePath& filePath)
 }
 
 
+namespace {
+
+// resource files are part of the installation (and so never change while
+// the session is running) so they are read once and then served from memory
+std::map<std::string,std::string> s_resourceFileCache;
+
+} // anonymous namespace
+
 std::string resourceFileAsString(const std::string& fileName)
 {
+   std::map<std::string,std::string>::const_iterator it =
+                                       s_resourceFileCache.find(fileName);
+   if (it != s_resourceFileCache.end())
+      return it->second;
+
    FilePath resPath = session::options().rResourcesPath();
    FilePath filePath = resPath.complete(fileName);
    std::string fileContents;
@@ -1164,9 +1394,78 @@ std::string resourceFileAsString(const std::string& fileName)
       return std::string();
    }
 
+   s_resourceFileCache[fileName] = fileContents;
    return fileContents;
 }
 
+namespace {
+
+struct MemoryUser
+{
+   MemoryUsageFunction usageFunction;
+   ReleaseMemoryFunction releaseFunction;
+};
+std::map<std::string,MemoryUser> s_memoryUsers;
+
+std::size_t resourceFileCacheMemoryUsage()
+{
+   std::size_t bytes = 0;
+   for (std::map<std::string,std::string>::const_iterator it =
+                                                s_resourceFileCache.begin();
+        it != s_resourceFileCache.end();
+        ++it)
+   {
+      bytes += it->first.capacity() + it->second.capacity();
+   }
+   return bytes;
+}
+
+void releaseResourceFileCache()
+{
+   std::map<std::string,std::string>().swap(s_resourceFileCache);
+}
+
+} // anonymous namespace
+
+void registerMemoryUsage(const std::string& subsystem,
+                         const MemoryUsageFunction& usageFunction,
+                         const ReleaseMemoryFunction& releaseFunction)
+{
+   MemoryUser user;
+   user.usageFunction = usageFunction;
+   user.releaseFunction = releaseFunction;
+   s_memoryUsers[subsystem] = user;
+}
+
+std::map<std::string,std::size_t> memoryUsage()
+{
+   std::map<std::string,std::size_t> usage;
+   for (std::map<std::string,MemoryUser>::const_iterator it =
+                                                      s_memoryUsers.begin();
+        it != s_memoryUsers.end();
+        ++it)
+   {
+      usage[it->first] = it->second.usageFunction();
+   }
+   usage["resource_files"] = resourceFileCacheMemoryUsage();
+   return usage;
+}
+
+void releaseMemory()
+{
+   for (std::map<std::string,MemoryUser>::const_iterator it =
+                                                      s_memoryUsers.begin();
+        it != s_memoryUsers.end();
+        ++it)
+   {
+      if (it->second.releaseFunction)
+         it->second.releaseFunction();
+   }
+   releaseResourceFileCache();
+
+   core::system::releaseFreeHeap();
+}
+
 
 void activatePane(const std::string& pane)
 {
@@ -37,6 +37,10 @@ void onResumed(const core::Settings& persistentState);
 // notify of backgound processing
 void onBackgroundProcessing(bool isIdle);
 
+// time at which scheduled work next needs background processing (or
+// not_a_date_time if there is no scheduled work)
+boost::posix_time::ptime nextScheduledWorkTime(bool isIdle);
+
 // source diagnostics
 core::FilePath sourceDiagnostics();
 
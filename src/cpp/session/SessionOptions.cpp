@@ -139,7 +139,16 @@ core::ProgramStatus Options::read(int argc, char * const argv[])
          "www local path")
       ("www-port",
          value<std::string>(&wwwPort_)->default_value("8787"),
-         "port to listen on");
+         "port to listen on")
+      ("www-compression-level",
+         value<int>(&wwwCompressionLevel_)->default_value(6),
+         "gzip compression level (1-9)")
+      ("www-compression-min-size",
+         value<int>(&wwwCompressionMinSize_)->default_value(1024),
+         "minimum size of responses which are compressed")
+      ("www-compression-precompressed",
+         value<bool>(&wwwCompressionPrecompressed_)->default_value(false),
+         "serve precompressed (.gz) versions of files if they exist");
 
    // session options
    options_description session("session") ;
@@ -155,7 +164,34 @@ core::ProgramStatus Options::read(int argc, char * const argv[])
          "automatically create public folder")
       ("session-rprofile-on-resume-default",
           value<bool>(&rProfileOnResumeDefault_)->default_value(false),
-          "default user setting for running Rprofile on resume");
+          "default user setting for running Rprofile on resume")
+      ("session-file-monitor-backend",
+          value<std::string>(&fileMonitorBackend_)->default_value("default"),
+          "file monitoring backend (default or fanotify)")
+      ("session-shared-file-monitor",
+          value<bool>(&sharedFileMonitor_)->default_value(false),
+          "share project file monitors between a user's sessions")
+      ("session-rpc-slow-call-ms",
+          value<int>(&rpcSlowCallMs_)->default_value(2000),
+          "log rpc calls which take longer than this (0 to disable)")
+      ("session-named-pipe-instances",
+          value<int>(&namedPipeInstances_)->default_value(4),
+          "number of idle named pipe instances to keep (desktop on windows)")
+      ("session-repos-index-dir",
+          value<std::string>(&reposIndexDir_)->default_value(""),
+          "directory of shared repository indexes (maintained by rserver)")
+      ("session-resident-projects",
+          value<int>(&residentProjects_)->default_value(0),
+          "number of recent projects whose sessions stay resident after a switch")
+      ("session-restart-zygote",
+          value<bool>(&restartZygote_)->default_value(false),
+          "keep an initialized R process ready to take over on restart")
+      (kZygoteSessionOption,
+          value<bool>(&zygote_)->default_value(false),
+          "run as the restart zygote of another session (internal)")
+      (kZygoteProjectSessionOption,
+          value<std::string>(&zygoteProject_)->default_value(""),
+          "project of the session a restart zygote takes over from (internal)");
 
    // r options
    bool rShellEscape; // no longer works but don't want to break any
@@ -211,7 +247,10 @@ core::ProgramStatus Options::read(int argc, char * const argv[])
        "limit on time of top level computations")
       ("limit-xfs-disk-quota",
        value<bool>(&limitXfsDiskQuota_)->default_value(false),
-       "limit xfs disk quota");
+       "limit xfs disk quota")
+      ("limit-console-output-kb",
+       value<int>(&limitConsoleOutputKb_)->default_value(1024),
+       "limit on console output pending delivery to the client");
    
    // external options
    options_description external("external");
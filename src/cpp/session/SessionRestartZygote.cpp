@@ -0,0 +1,264 @@
+/*
+ * SessionRestartZygote.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+// The session and its zygote are connected by a pipe which is the zygote's
+// stdin. The session writes a single byte to it once it has saved its
+// restart state and stopped listening; the zygote then starts listening
+// (the session waits for its stream to appear before exiting). If the
+// session exits without restarting the zygote sees end of file and exits.
+//
+// Note that a zygote is a fresh exec of rsession rather than a fork of the
+// session: the session is multi-threaded (connection listener, file
+// monitors, rpc workers) so a fork of it can't safely carry on as a session.
+
+#include <session/SessionRestartZygote.hpp>
+
+#include <poll.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <vector>
+
+#include <boost/foreach.hpp>
+#include <boost/thread.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/FilePath.hpp>
+#include <core/SafeConvert.hpp>
+
+#include <core/system/System.hpp>
+#include <core/system/Environment.hpp>
+#include <core/system/ProcessArgs.hpp>
+
+#include <session/SessionOptions.hpp>
+#include <session/SessionConstants.hpp>
+#include <session/SessionLocalStreams.hpp>
+#include <session/SessionPersistentState.hpp>
+#include <session/SessionHttpConnectionListener.hpp>
+#include <session/projects/SessionProjects.hpp>
+
+using namespace core;
+
+namespace session {
+namespace restart_zygote {
+
+namespace {
+
+const char kRestartByte = 'r';
+
+// how long we wait for the zygote to start listening
+const int kHandOffTimeoutSeconds = 10;
+
+std::vector<std::string> s_args;
+std::vector<std::string> s_environment;
+
+pid_t s_zygotePid = -1;
+int s_zygoteFd = -1;
+
+bool zygoteIsRunning()
+{
+   if (s_zygotePid == -1)
+      return false;
+
+   int status = 0;
+   pid_t result = ::waitpid(s_zygotePid, &status, WNOHANG);
+   if (result == 0)
+      return true;
+   if (result == -1)
+      LOG_ERROR(systemError(errno, ERROR_LOCATION));
+
+   ::close(s_zygoteFd);
+   s_zygoteFd = -1;
+   s_zygotePid = -1;
+   return false;
+}
+
+void abandonZygote()
+{
+   if (::kill(s_zygotePid, SIGKILL) == -1)
+      LOG_ERROR(systemError(errno, ERROR_LOCATION));
+   zygoteIsRunning();
+}
+
+} // anonymous namespace
+
+void initialize(int argc, char * const argv[])
+{
+   if (options().programMode() != kSessionProgramModeServer ||
+       !options().restartZygote())
+   {
+      return;
+   }
+
+   // our own arguments (less any which made us a zygote)
+   for (int i = 0; i < argc; i++)
+   {
+      std::string arg(argv[i]);
+      if (!boost::algorithm::starts_with(arg, "--" kZygoteSessionOption))
+         s_args.push_back(arg);
+   }
+
+   // the environment as it was before any user code could change it
+   core::system::Options environment;
+   core::system::environment(&environment);
+   BOOST_FOREACH(const core::system::Option& var, environment)
+   {
+      s_environment.push_back(var.first + "=" + var.second);
+   }
+}
+
+Error launch()
+{
+   if (s_args.empty() || zygoteIsRunning())
+      return Success();
+
+   std::vector<std::string> args = s_args;
+   args.push_back("--" kZygoteSessionOption "=1");
+   projects::ProjectContext& context = projects::projectContext();
+   if (context.hasProject())
+   {
+      args.push_back("--" kZygoteProjectSessionOption "=" +
+                     context.file().absolutePath());
+   }
+
+   // allocate everything the child needs before forking
+   core::system::ProcessArgs processArgs(args);
+   core::system::ProcessArgs processEnvironment(s_environment);
+
+   int fds[2];
+   if (::pipe(fds) == -1)
+      return systemError(errno, ERROR_LOCATION);
+
+   // our end mustn't leak into other children (the zygote relies on
+   // seeing end of file when we go away)
+   if (::fcntl(fds[1], F_SETFD, FD_CLOEXEC) == -1)
+   {
+      Error error = systemError(errno, ERROR_LOCATION);
+      ::close(fds[0]);
+      ::close(fds[1]);
+      return error;
+   }
+
+   pid_t pid = ::fork();
+   if (pid == -1)
+   {
+      Error error = systemError(errno, ERROR_LOCATION);
+      ::close(fds[0]);
+      ::close(fds[1]);
+      return error;
+   }
+   else if (pid == 0)
+   {
+      // child: the pipe becomes stdin and nothing else of ours survives
+      ::dup2(fds[0], STDIN_FILENO);
+      core::system::closeNonStdFileDescriptors();
+      ::execve(args[0].c_str(), processArgs.args(), processEnvironment.args());
+      ::_exit(EXIT_FAILURE);
+   }
+
+   ::close(fds[0]);
+   s_zygoteFd = fds[1];
+   s_zygotePid = pid;
+
+   return Success();
+}
+
+bool waitForRestart()
+{
+   while (true)
+   {
+      struct pollfd pfd;
+      pfd.fd = STDIN_FILENO;
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+      int result = ::poll(&pfd, 1, 500);
+      if (result == -1)
+      {
+         if (errno == EINTR)
+            continue;
+         LOG_ERROR(systemError(errno, ERROR_LOCATION));
+         return false;
+      }
+      else if (result == 0)
+      {
+         continue;
+      }
+
+      char ch = 0;
+      ssize_t bytesRead = ::read(STDIN_FILENO, &ch, 1);
+      if (bytesRead == -1 && errno == EINTR)
+         continue;
+      if (bytesRead != 1 || ch != kRestartByte)
+         return false;
+
+      break;
+   }
+
+   // the session wrote its state (and our project) on the way out
+   Error error = persistentState().initialize();
+   if (error)
+      LOG_ERROR(error);
+   projects::projectContext().setNextSessionProject("");
+
+   error = httpConnectionListener().start();
+   if (error)
+   {
+      LOG_ERROR(error);
+      return false;
+   }
+
+   return true;
+}
+
+bool handOff()
+{
+   if (!zygoteIsRunning())
+      return false;
+
+   if (::write(s_zygoteFd, &kRestartByte, 1) != 1)
+   {
+      LOG_ERROR(systemError(errno, ERROR_LOCATION));
+      abandonZygote();
+      return false;
+   }
+
+   using namespace boost::posix_time;
+   FilePath streamPath = local_streams::streamPath(options().userIdentity());
+   ptime timeout = microsec_clock::universal_time() +
+                   seconds(kHandOffTimeoutSeconds);
+   while (!streamPath.exists())
+   {
+      if (microsec_clock::universal_time() > timeout)
+      {
+         // don't leave it to compete with the session rserver will launch
+         LOG_WARNING_MESSAGE("Restart zygote didn't take over within " +
+                             safe_convert::numberToString(
+                                                   kHandOffTimeoutSeconds) +
+                             " sec");
+         abandonZygote();
+         return false;
+      }
+      boost::this_thread::sleep(milliseconds(20));
+   }
+
+   return true;
+}
+
+} // namespace restart_zygote
+} // namespace session
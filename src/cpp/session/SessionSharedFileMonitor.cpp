@@ -0,0 +1,1044 @@
+/*
+ * SessionSharedFileMonitor.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <session/SessionSharedFileMonitor.hpp>
+
+#include <unistd.h>
+
+#include <map>
+#include <deque>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/utility.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/FilePath.hpp>
+#include <core/Thread.hpp>
+#include <core/BoostThread.hpp>
+#include <core/json/Json.hpp>
+#include <core/json/JsonRpc.hpp>
+#include <core/http/Request.hpp>
+#include <core/http/Response.hpp>
+#include <core/http/LocalStreamAsyncServer.hpp>
+#include <core/http/LocalStreamBlockingClient.hpp>
+
+#include <session/SessionOptions.hpp>
+#include <session/SessionLocalStreams.hpp>
+#include <session/SessionModuleContext.hpp>
+
+using namespace core;
+
+namespace session {
+namespace shared_file_monitor {
+
+namespace {
+
+typedef core::system::file_monitor::Callbacks Callbacks;
+typedef core::system::file_monitor::Handle Handle;
+typedef core::system::FileChangeEvent FileChangeEvent;
+typedef boost::function<bool(const FileInfo&)> FileFilter;
+
+const char * const kSubscribeUri = "/subscribe";
+const char * const kEventsUri = "/events";
+
+// monitors which have no local subscribers and haven't been polled for
+// this long are unregistered
+const int kIdleTimeoutSeconds = 120;
+
+// events retained for subscribers (subscribers which fall further behind
+// than this are reset)
+const std::size_t kMaxEvents = 100000;
+
+// interval at which subscribers poll the host
+const int kPollIntervalMs = 250;
+
+FilePath hostStreamPath()
+{
+   return local_streams::streamPath(options().userIdentity() +
+                                    "-file-monitor");
+}
+
+std::string monitorId(const FilePath& filePath, bool recursive)
+{
+   return (recursive ? "R:" : "N:") + filePath.absolutePath();
+}
+
+struct Subscription
+{
+   Subscription(const FilePath& path,
+                bool recursive,
+                const FileFilter& filter,
+                const Callbacks& callbacks)
+      : path(path), recursive(recursive), filter(filter),
+        callbacks(callbacks), subscribed(false), seq(0)
+   {
+      handle = Handle((void*)this);
+   }
+
+   FilePath path;
+   bool recursive;
+   FileFilter filter;
+   Callbacks callbacks;
+   Handle handle;
+
+   // state of remote subscriptions (only accessed on the polling thread)
+   bool subscribed;
+   std::string id;
+   boost::uint64_t seq;
+};
+typedef boost::shared_ptr<Subscription> SubscriptionPtr;
+
+boost::function<void()> s_onCallbacksPending;
+
+// callbacks queued for the main thread
+core::thread::ThreadsafeQueue<boost::function<void()> >& callbackQueue()
+{
+   static core::thread::ThreadsafeQueue<boost::function<void()> > instance;
+   return instance;
+}
+
+void enqueCallback(const boost::function<void()>& callback)
+{
+   callbackQueue().enque(callback);
+   if (s_onCallbacksPending)
+      s_onCallbacksPending();
+}
+
+void onHostLost(SubscriptionPtr pSubscription);
+
+// serialization of files and events
+
+json::Array fileInfoToJson(const FileInfo& fileInfo)
+{
+   json::Array fileInfoJson;
+   fileInfoJson.push_back(fileInfo.absolutePath());
+   fileInfoJson.push_back(fileInfo.isDirectory());
+   fileInfoJson.push_back(static_cast<boost::int64_t>(fileInfo.size()));
+   fileInfoJson.push_back(
+                  static_cast<boost::int64_t>(fileInfo.lastWriteTime()));
+   fileInfoJson.push_back(fileInfo.isSymlink());
+   return fileInfoJson;
+}
+
+bool fileInfoFromJson(const json::Value& value, FileInfo* pFileInfo)
+{
+   if (!json::isType<json::Array>(value))
+      return false;
+
+   const json::Array& fileInfoJson = value.get_array();
+   if (fileInfoJson.size() != 5 ||
+       !json::isType<std::string>(fileInfoJson[0]) ||
+       !json::isType<bool>(fileInfoJson[1]) ||
+       fileInfoJson[2].type() != json::IntegerType ||
+       fileInfoJson[3].type() != json::IntegerType ||
+       !json::isType<bool>(fileInfoJson[4]))
+   {
+      return false;
+   }
+
+   *pFileInfo = FileInfo(fileInfoJson[0].get_str(),
+                         fileInfoJson[1].get_bool(),
+                         fileInfoJson[2].get_int64(),
+                         fileInfoJson[3].get_int64(),
+                         fileInfoJson[4].get_bool());
+   return true;
+}
+
+// build a tree from files in path order (which means parents come before
+// their children)
+void filesToTree(const std::vector<FileInfo>& files,
+                 const FileFilter& filter,
+                 tree<FileInfo>* pTree)
+{
+   if (files.empty())
+      return;
+
+   std::map<std::string, tree<FileInfo>::iterator> dirs;
+   tree<FileInfo>::iterator root = pTree->set_head(files.front());
+   dirs[files.front().absolutePath()] = root;
+
+   for (std::size_t i = 1; i < files.size(); i++)
+   {
+      const FileInfo& fileInfo = files[i];
+
+      // files whose parent was filtered out are skipped along with it
+      std::string parent = FilePath(fileInfo.absolutePath()).parent()
+                                                            .absolutePath();
+      std::map<std::string, tree<FileInfo>::iterator>::iterator parentIt =
+                                                         dirs.find(parent);
+      if (parentIt == dirs.end())
+         continue;
+
+      if (filter && !filter(fileInfo))
+         continue;
+
+      tree<FileInfo>::iterator it = pTree->append_child(parentIt->second,
+                                                        fileInfo);
+      if (fileInfo.isDirectory())
+         dirs[fileInfo.absolutePath()] = it;
+   }
+
+   // children are in the same order as the file monitor's trees
+   pTree->sort(pTree->begin(root), pTree->end(root), fileInfoPathLessThan, true);
+}
+
+std::vector<FileChangeEvent> filterEvents(
+                                 const std::vector<FileChangeEvent>& events,
+                                 const FileFilter& filter)
+{
+   if (!filter)
+      return events;
+
+   std::vector<FileChangeEvent> filtered;
+   BOOST_FOREACH(const FileChangeEvent& event, events)
+   {
+      if (filter(event.fileInfo()))
+         filtered.push_back(event);
+   }
+   return filtered;
+}
+
+void notifyRegistered(SubscriptionPtr pSubscription,
+                      boost::shared_ptr<tree<FileInfo> > pTree)
+{
+   if (pSubscription->callbacks.onRegistered)
+      pSubscription->callbacks.onRegistered(pSubscription->handle, *pTree);
+}
+
+void notifyFilesChanged(SubscriptionPtr pSubscription,
+                        const std::vector<FileChangeEvent>& events)
+{
+   if (!events.empty() && pSubscription->callbacks.onFilesChanged)
+      pSubscription->callbacks.onFilesChanged(events);
+}
+
+void notifyRegistrationError(SubscriptionPtr pSubscription, Error error)
+{
+   if (pSubscription->callbacks.onRegistrationError)
+      pSubscription->callbacks.onRegistrationError(error);
+}
+
+// Host: shares monitors with the other sessions (and with this one). State
+// is accessed both from the server thread (requests from subscribers) and
+// the main thread (file monitor callbacks and local subscriptions).
+
+struct SharedMonitor
+{
+   SharedMonitor(const FilePath& path, bool recursive)
+      : path(path), recursive(recursive), registered(false), firstSeq(0),
+        lastPolled(boost::posix_time::second_clock::universal_time())
+   {
+   }
+
+   boost::uint64_t nextSeq() const { return firstSeq + events.size(); }
+
+   FilePath path;
+   bool recursive;
+
+   Handle handle;
+   bool registered;
+
+   // current files (kept up to date with events for new subscribers)
+   std::map<std::string, FileInfo> files;
+
+   // recent events (firstSeq is the sequence number of the first event)
+   std::deque<FileChangeEvent> events;
+   boost::uint64_t firstSeq;
+
+   boost::posix_time::ptime lastPolled;
+   std::vector<SubscriptionPtr> localSubscriptions;
+};
+typedef boost::shared_ptr<SharedMonitor> SharedMonitorPtr;
+
+class Host : boost::noncopyable
+{
+public:
+   Error start()
+   {
+      pServer_.reset(new http::LocalStreamAsyncServer("Shared File Monitor"));
+      pServer_->addBlockingHandler(kSubscribeUri,
+                                   boost::bind(&Host::handleSubscribe,
+                                               this, _1, _2));
+      pServer_->addBlockingHandler(kEventsUri,
+                                   boost::bind(&Host::handleEvents,
+                                               this, _1, _2));
+
+      Error error = pServer_->init(hostStreamPath());
+      if (error)
+         return error;
+
+      return pServer_->run();
+   }
+
+   void stop()
+   {
+      if (pServer_)
+         pServer_->stop();
+   }
+
+   void addLocalSubscription(SubscriptionPtr pSubscription)
+   {
+      boost::shared_ptr<tree<FileInfo> > pTree;
+      LOCK_MUTEX(mutex_)
+      {
+         SharedMonitorPtr pMonitor = ensureMonitor(pSubscription->path,
+                                                   pSubscription->recursive,
+                                                   pSubscription->filter);
+         pMonitor->localSubscriptions.push_back(pSubscription);
+
+         // if the monitor is already registered then we can notify
+         // right away (otherwise we'll notify when it is)
+         if (pMonitor->registered)
+            pTree = filesTree(pMonitor, pSubscription->filter);
+      }
+      END_LOCK_MUTEX
+
+      if (pTree)
+         notifyRegistered(pSubscription, pTree);
+   }
+
+   void unregisterIdleMonitors()
+   {
+      using namespace boost::posix_time;
+      ptime now = second_clock::universal_time();
+
+      std::vector<Handle> idle;
+      LOCK_MUTEX(mutex_)
+      {
+         std::map<std::string, SharedMonitorPtr>::iterator it =
+                                                         monitors_.begin();
+         while (it != monitors_.end())
+         {
+            SharedMonitorPtr pMonitor = it->second;
+            if (pMonitor->registered &&
+                pMonitor->localSubscriptions.empty() &&
+                (now - pMonitor->lastPolled) > seconds(kIdleTimeoutSeconds))
+            {
+               idle.push_back(pMonitor->handle);
+               monitors_.erase(it++);
+            }
+            else
+            {
+               ++it;
+            }
+         }
+      }
+      END_LOCK_MUTEX
+
+      BOOST_FOREACH(const Handle& handle, idle)
+      {
+         core::system::file_monitor::unregisterMonitor(handle);
+      }
+   }
+
+private:
+
+   // (mutex must be held)
+   SharedMonitorPtr ensureMonitor(const FilePath& path,
+                                  bool recursive,
+                                  const FileFilter& filter)
+   {
+      std::string id = monitorId(path, recursive);
+      std::map<std::string, SharedMonitorPtr>::iterator it =
+                                                      monitors_.find(id);
+      if (it != monitors_.end())
+         return it->second;
+
+      SharedMonitorPtr pMonitor(new SharedMonitor(path, recursive));
+      monitors_[id] = pMonitor;
+
+      Callbacks cb;
+      cb.onRegistered = boost::bind(&Host::onRegistered, this, id, _1, _2);
+      cb.onRegistrationError = boost::bind(&Host::onRegistrationError,
+                                           this, id, _1);
+      cb.onMonitoringError = boost::bind(&Host::onMonitoringError,
+                                         this, id, _1);
+      cb.onFilesChanged = boost::bind(&Host::onFilesChanged, this, id, _1);
+      cb.onUnregistered = boost::bind(&Host::onUnregistered, this, id, _1);
+      core::system::file_monitor::registerMonitor(path, recursive, filter, cb);
+
+      return pMonitor;
+   }
+
+   // (mutex must be held)
+   boost::shared_ptr<tree<FileInfo> > filesTree(SharedMonitorPtr pMonitor,
+                                                const FileFilter& filter)
+   {
+      std::vector<FileInfo> files;
+      files.reserve(pMonitor->files.size());
+      for (std::map<std::string, FileInfo>::const_iterator it =
+                                                   pMonitor->files.begin();
+           it != pMonitor->files.end();
+           ++it)
+      {
+         files.push_back(it->second);
+      }
+
+      boost::shared_ptr<tree<FileInfo> > pTree(new tree<FileInfo>());
+      filesToTree(files, filter, pTree.get());
+      return pTree;
+   }
+
+   // (mutex must be held)
+   SharedMonitorPtr findMonitor(const std::string& id)
+   {
+      std::map<std::string, SharedMonitorPtr>::iterator it =
+                                                      monitors_.find(id);
+      if (it != monitors_.end())
+         return it->second;
+      else
+         return SharedMonitorPtr();
+   }
+
+   // (mutex must be held)
+   SharedMonitorPtr removeMonitor(const std::string& id)
+   {
+      SharedMonitorPtr pMonitor = findMonitor(id);
+      if (pMonitor)
+         monitors_.erase(id);
+      return pMonitor;
+   }
+
+   void onRegistered(const std::string& id,
+                     Handle handle,
+                     const tree<FileInfo>& files)
+   {
+      std::vector<SubscriptionPtr> subscriptions;
+      bool stale = false;
+      LOCK_MUTEX(mutex_)
+      {
+         SharedMonitorPtr pMonitor = findMonitor(id);
+         if (pMonitor)
+         {
+            pMonitor->handle = handle;
+            pMonitor->registered = true;
+            for (tree<FileInfo>::iterator it = files.begin();
+                 it != files.end();
+                 ++it)
+            {
+               pMonitor->files[it->absolutePath()] = *it;
+            }
+            subscriptions = pMonitor->localSubscriptions;
+         }
+         else
+         {
+            stale = true;
+         }
+      }
+      END_LOCK_MUTEX
+
+      // the monitor was removed while it was being registered
+      if (stale)
+      {
+         core::system::file_monitor::unregisterMonitor(handle);
+         return;
+      }
+
+      BOOST_FOREACH(SubscriptionPtr pSubscription, subscriptions)
+      {
+         boost::shared_ptr<tree<FileInfo> > pTree(new tree<FileInfo>());
+         std::vector<FileInfo> fileList(files.begin(), files.end());
+         filesToTree(fileList, pSubscription->filter, pTree.get());
+         notifyRegistered(pSubscription, pTree);
+      }
+   }
+
+   void onRegistrationError(const std::string& id, const Error& error)
+   {
+      SharedMonitorPtr pMonitor;
+      LOCK_MUTEX(mutex_)
+      {
+         pMonitor = removeMonitor(id);
+      }
+      END_LOCK_MUTEX
+
+      if (!pMonitor)
+         return;
+
+      BOOST_FOREACH(SubscriptionPtr pSubscription,
+                    pMonitor->localSubscriptions)
+      {
+         notifyRegistrationError(pSubscription, error);
+      }
+   }
+
+   void onMonitoringError(const std::string& id, const Error& error)
+   {
+      SharedMonitorPtr pMonitor;
+      LOCK_MUTEX(mutex_)
+      {
+         pMonitor = removeMonitor(id);
+      }
+      END_LOCK_MUTEX
+
+      if (!pMonitor)
+         return;
+
+      BOOST_FOREACH(SubscriptionPtr pSubscription,
+                    pMonitor->localSubscriptions)
+      {
+         if (pSubscription->callbacks.onMonitoringError)
+            pSubscription->callbacks.onMonitoringError(error);
+      }
+   }
+
+   void onUnregistered(const std::string& id, Handle handle)
+   {
+      // monitors we unregister ourselves have already been removed (so
+      // this only does something if e.g. the file monitor was stopped)
+      SharedMonitorPtr pMonitor;
+      LOCK_MUTEX(mutex_)
+      {
+         pMonitor = findMonitor(id);
+         if (pMonitor && pMonitor->handle == handle)
+            monitors_.erase(id);
+         else
+            pMonitor.reset();
+      }
+      END_LOCK_MUTEX
+
+      if (!pMonitor)
+         return;
+
+      BOOST_FOREACH(SubscriptionPtr pSubscription,
+                    pMonitor->localSubscriptions)
+      {
+         if (pSubscription->callbacks.onUnregistered)
+            pSubscription->callbacks.onUnregistered(pSubscription->handle);
+      }
+   }
+
+   void onFilesChanged(const std::string& id,
+                       const std::vector<FileChangeEvent>& events)
+   {
+      std::vector<SubscriptionPtr> subscriptions;
+      LOCK_MUTEX(mutex_)
+      {
+         SharedMonitorPtr pMonitor = findMonitor(id);
+         if (!pMonitor)
+            return;
+
+         BOOST_FOREACH(const FileChangeEvent& event, events)
+         {
+            // update files
+            std::string path = event.fileInfo().absolutePath();
+            if (event.type() == FileChangeEvent::FileRemoved)
+            {
+               pMonitor->files.erase(path);
+               std::string prefix = path + "/";
+               std::map<std::string, FileInfo>::iterator it =
+                                       pMonitor->files.lower_bound(prefix);
+               while (it != pMonitor->files.end() &&
+                      boost::algorithm::starts_with(it->first, prefix))
+               {
+                  pMonitor->files.erase(it++);
+               }
+            }
+            else
+            {
+               pMonitor->files[path] = event.fileInfo();
+            }
+
+            // record event
+            pMonitor->events.push_back(event);
+         }
+
+         while (pMonitor->events.size() > kMaxEvents)
+         {
+            pMonitor->events.pop_front();
+            pMonitor->firstSeq++;
+         }
+
+         subscriptions = pMonitor->localSubscriptions;
+      }
+      END_LOCK_MUTEX
+
+      BOOST_FOREACH(SubscriptionPtr pSubscription, subscriptions)
+      {
+         notifyFilesChanged(pSubscription,
+                            filterEvents(events, pSubscription->filter));
+      }
+   }
+
+   bool authorize(const http::Request& request, http::Response* pResponse)
+   {
+      // only the user's own sessions can subscribe
+      if (request.remoteUid() != static_cast<int>(::getuid()))
+      {
+         pResponse->setStatusCode(http::status::Forbidden);
+         return false;
+      }
+      return true;
+   }
+
+   void setJsonResponse(const json::Object& result, http::Response* pResponse)
+   {
+      std::ostringstream ostr;
+      json::write(result, ostr);
+      pResponse->setContentType("application/json");
+      pResponse->setBody(ostr.str());
+   }
+
+   bool readRequest(const http::Request& request,
+                    json::Object* pRequest,
+                    http::Response* pResponse)
+   {
+      json::Value value;
+      if (!json::parse(request.body(), &value) ||
+          !json::isType<json::Object>(value))
+      {
+         pResponse->setStatusCode(http::status::BadRequest);
+         return false;
+      }
+      *pRequest = value.get_obj();
+      return true;
+   }
+
+   void handleSubscribe(const http::Request& request,
+                        http::Response* pResponse)
+   {
+      json::Object requestJson;
+      if (!authorize(request, pResponse) ||
+          !readRequest(request, &requestJson, pResponse))
+      {
+         return;
+      }
+
+      std::string path;
+      bool recursive;
+      Error error = json::readObject(requestJson,
+                                     "path", &path,
+                                     "recursive", &recursive);
+      if (error)
+      {
+         pResponse->setStatusCode(http::status::BadRequest);
+         return;
+      }
+
+      json::Object result;
+      LOCK_MUTEX(mutex_)
+      {
+         SharedMonitorPtr pMonitor = ensureMonitor(
+                                          FilePath(path),
+                                          recursive,
+                                          module_context::fileListingFilter);
+         pMonitor->lastPolled = boost::posix_time::second_clock::universal_time();
+         if (pMonitor->registered)
+         {
+            json::Array files;
+            for (std::map<std::string, FileInfo>::const_iterator it =
+                                                   pMonitor->files.begin();
+                 it != pMonitor->files.end();
+                 ++it)
+            {
+               files.push_back(fileInfoToJson(it->second));
+            }
+
+            result["id"] = monitorId(FilePath(path), recursive);
+            result["seq"] = static_cast<boost::int64_t>(pMonitor->nextSeq());
+            result["files"] = files;
+         }
+         else
+         {
+            result["pending"] = true;
+         }
+      }
+      END_LOCK_MUTEX
+
+      setJsonResponse(result, pResponse);
+   }
+
+   void handleEvents(const http::Request& request, http::Response* pResponse)
+   {
+      json::Object requestJson;
+      if (!authorize(request, pResponse) ||
+          !readRequest(request, &requestJson, pResponse))
+      {
+         return;
+      }
+
+      std::string id;
+      double seqValue;
+      Error error = json::readObject(requestJson,
+                                     "id", &id,
+                                     "seq", &seqValue);
+      if (error)
+      {
+         pResponse->setStatusCode(http::status::BadRequest);
+         return;
+      }
+      boost::uint64_t seq = static_cast<boost::uint64_t>(seqValue);
+
+      json::Object result;
+      LOCK_MUTEX(mutex_)
+      {
+         // subscribers need to start over if the monitor is gone or they
+         // have missed events
+         SharedMonitorPtr pMonitor = findMonitor(id);
+         if (!pMonitor || !pMonitor->registered ||
+             seq < pMonitor->firstSeq || seq > pMonitor->nextSeq())
+         {
+            result["reset"] = true;
+         }
+         else
+         {
+            pMonitor->lastPolled =
+                        boost::posix_time::second_clock::universal_time();
+
+            json::Array events;
+            for (std::size_t i = seq - pMonitor->firstSeq;
+                 i < pMonitor->events.size();
+                 i++)
+            {
+               const FileChangeEvent& event = pMonitor->events[i];
+               json::Array eventJson;
+               eventJson.push_back(static_cast<int>(event.type()));
+               eventJson.push_back(fileInfoToJson(event.fileInfo()));
+               events.push_back(eventJson);
+            }
+
+            result["seq"] = static_cast<boost::int64_t>(pMonitor->nextSeq());
+            result["events"] = events;
+         }
+      }
+      END_LOCK_MUTEX
+
+      setJsonResponse(result, pResponse);
+   }
+
+private:
+   boost::mutex mutex_;
+   std::map<std::string, SharedMonitorPtr> monitors_;
+   boost::scoped_ptr<http::LocalStreamAsyncServer> pServer_;
+};
+
+// naked pointer since the server threads may still be running at exit
+Host* s_pHost = NULL;
+
+// Client: polls the host for each remote subscription on a background
+// thread (callbacks are queued for the main thread)
+
+Error sendHostRequest(const std::string& uri,
+                      const json::Object& body,
+                      json::Object* pResult)
+{
+   std::ostringstream ostr;
+   json::write(body, ostr);
+
+   http::Request request;
+   request.setMethod("POST");
+   request.setUri(uri);
+   request.setHeader("Accept", "*/*");
+   request.setHeader("Connection", "close");
+   request.setBody(ostr.str());
+
+   http::Response response;
+   Error error = http::sendRequest(hostStreamPath(), request, &response);
+   if (error)
+      return error;
+
+   json::Value value;
+   if (response.statusCode() != http::status::Ok ||
+       !json::parse(response.body(), &value) ||
+       !json::isType<json::Object>(value))
+   {
+      Error error = systemError(boost::system::errc::protocol_error,
+                                ERROR_LOCATION);
+      error.addProperty("status", response.statusCode());
+      return error;
+   }
+
+   *pResult = value.get_obj();
+   return Success();
+}
+
+class Client : boost::noncopyable
+{
+public:
+   void addSubscription(SubscriptionPtr pSubscription)
+   {
+      bool start = false;
+      LOCK_MUTEX(mutex_)
+      {
+         subscriptions_.push_back(pSubscription);
+         start = !thread_.joinable();
+      }
+      END_LOCK_MUTEX
+
+      if (start)
+         core::thread::safeLaunchThread(boost::bind(&Client::run, this),
+                                        &thread_);
+   }
+
+private:
+   void removeSubscription(SubscriptionPtr pSubscription)
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         subscriptions_.erase(std::remove(subscriptions_.begin(),
+                                          subscriptions_.end(),
+                                          pSubscription),
+                              subscriptions_.end());
+      }
+      END_LOCK_MUTEX
+   }
+
+   void run()
+   {
+      try
+      {
+         while (true)
+         {
+            boost::this_thread::sleep(
+                           boost::posix_time::milliseconds(kPollIntervalMs));
+
+            std::vector<SubscriptionPtr> subscriptions;
+            LOCK_MUTEX(mutex_)
+            {
+               subscriptions = subscriptions_;
+            }
+            END_LOCK_MUTEX
+
+            BOOST_FOREACH(SubscriptionPtr pSubscription, subscriptions)
+            {
+               if (pSubscription->subscribed)
+                  poll(pSubscription);
+               else
+                  subscribe(pSubscription);
+            }
+         }
+      }
+      catch(const boost::thread_interrupted&)
+      {
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
+   void hostLost(SubscriptionPtr pSubscription)
+   {
+      removeSubscription(pSubscription);
+      pSubscription->subscribed = false;
+      enqueCallback(boost::bind(onHostLost, pSubscription));
+   }
+
+   void subscribe(SubscriptionPtr pSubscription)
+   {
+      json::Object body;
+      body["path"] = pSubscription->path.absolutePath();
+      body["recursive"] = pSubscription->recursive;
+      json::Object result;
+      Error error = sendHostRequest(kSubscribeUri, body, &result);
+      if (error)
+      {
+         hostLost(pSubscription);
+         return;
+      }
+
+      // try again at the next poll if the host is still registering
+      if (result.find("pending") != result.end())
+         return;
+
+      std::string id;
+      double seq;
+      json::Array filesJson;
+      error = json::readObject(result,
+                               "id", &id,
+                               "seq", &seq,
+                               "files", &filesJson);
+      if (error)
+      {
+         LOG_ERROR(error);
+         hostLost(pSubscription);
+         return;
+      }
+
+      std::vector<FileInfo> files;
+      files.reserve(filesJson.size());
+      BOOST_FOREACH(const json::Value& fileJson, filesJson)
+      {
+         FileInfo fileInfo;
+         if (fileInfoFromJson(fileJson, &fileInfo))
+            files.push_back(fileInfo);
+      }
+
+      boost::shared_ptr<tree<FileInfo> > pTree(new tree<FileInfo>());
+      filesToTree(files, pSubscription->filter, pTree.get());
+
+      pSubscription->id = id;
+      pSubscription->seq = static_cast<boost::uint64_t>(seq);
+      pSubscription->subscribed = true;
+      enqueCallback(boost::bind(notifyRegistered, pSubscription, pTree));
+   }
+
+   void poll(SubscriptionPtr pSubscription)
+   {
+      json::Object body;
+      body["id"] = pSubscription->id;
+      body["seq"] = static_cast<boost::int64_t>(pSubscription->seq);
+      json::Object result;
+      Error error = sendHostRequest(kEventsUri, body, &result);
+      if (error)
+      {
+         hostLost(pSubscription);
+         return;
+      }
+
+      // start over if we missed events (subscribing again results in a
+      // new onRegistered with the current files)
+      if (result.find("reset") != result.end())
+      {
+         pSubscription->subscribed = false;
+         return;
+      }
+
+      double seq;
+      json::Array eventsJson;
+      error = json::readObject(result,
+                               "seq", &seq,
+                               "events", &eventsJson);
+      if (error)
+      {
+         LOG_ERROR(error);
+         pSubscription->subscribed = false;
+         return;
+      }
+
+      std::vector<FileChangeEvent> events;
+      BOOST_FOREACH(const json::Value& eventJson, eventsJson)
+      {
+         FileInfo fileInfo;
+         if (!json::isType<json::Array>(eventJson) ||
+             eventJson.get_array().size() != 2 ||
+             !json::isType<int>(eventJson.get_array()[0]) ||
+             !fileInfoFromJson(eventJson.get_array()[1], &fileInfo))
+         {
+            continue;
+         }
+
+         FileChangeEvent::Type type = static_cast<FileChangeEvent::Type>(
+                                          eventJson.get_array()[0].get_int());
+         if (!pSubscription->filter || pSubscription->filter(fileInfo))
+            events.push_back(FileChangeEvent(type, fileInfo));
+      }
+
+      pSubscription->seq = static_cast<boost::uint64_t>(seq);
+      if (!events.empty())
+         enqueCallback(boost::bind(notifyFilesChanged, pSubscription, events));
+   }
+
+private:
+   boost::mutex mutex_;
+   std::vector<SubscriptionPtr> subscriptions_;
+   boost::thread thread_;
+};
+
+Client& client()
+{
+   static Client instance;
+   return instance;
+}
+
+// become the host for this user's sessions (falls back to monitoring on
+// our own if we can't)
+void hostSubscription(SubscriptionPtr pSubscription)
+{
+   if (!s_pHost)
+   {
+      Host* pHost = new Host();
+      Error error = pHost->start();
+      if (error)
+      {
+         LOG_ERROR(error);
+         delete pHost;
+         core::system::file_monitor::registerMonitor(pSubscription->path,
+                                                     pSubscription->recursive,
+                                                     pSubscription->filter,
+                                                     pSubscription->callbacks);
+         return;
+      }
+      s_pHost = pHost;
+   }
+
+   s_pHost->addLocalSubscription(pSubscription);
+}
+
+void onHostLost(SubscriptionPtr pSubscription)
+{
+   hostSubscription(pSubscription);
+}
+
+void onBackgroundProcessing(bool)
+{
+   // deliver queued callbacks
+   boost::function<void()> callback;
+   while (callbackQueue().deque(&callback))
+      callback();
+
+   if (s_pHost)
+      s_pHost->unregisterIdleMonitors();
+}
+
+void onShutdown(bool)
+{
+   if (s_pHost)
+   {
+      s_pHost->stop();
+      Error error = hostStreamPath().removeIfExists();
+      if (error)
+         LOG_ERROR(error);
+   }
+}
+
+} // anonymous namespace
+
+void registerMonitor(const FilePath& filePath,
+                     bool recursive,
+                     const FileFilter& filter,
+                     const Callbacks& callbacks)
+{
+   SubscriptionPtr pSubscription(new Subscription(filePath,
+                                                  recursive,
+                                                  filter,
+                                                  callbacks));
+
+   // subscribe to the existing host if there is one (if it turns out not
+   // to be running we'll become the host)
+   if (!s_pHost && hostStreamPath().exists())
+      client().addSubscription(pSubscription);
+   else
+      hostSubscription(pSubscription);
+}
+
+Error initialize(const boost::function<void()>& onCallbacksPending)
+{
+   s_onCallbacksPending = onCallbacksPending;
+
+   using namespace module_context;
+   events().onBackgroundProcessing.connect(onBackgroundProcessing);
+   events().onShutdown.connect(onShutdown);
+
+   return local_streams::createStreamsDir();
+}
+
+} // namespace shared_file_monitor
+} // namespace session
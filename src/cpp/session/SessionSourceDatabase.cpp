@@ -15,8 +15,12 @@
 
 #include <session/SessionSourceDatabase.hpp>
 
+#include <map>
+#include <set>
+#include <deque>
 #include <string>
 #include <vector>
+#include <sstream>
 #include <algorithm>
 
 #include <boost/bind.hpp>
@@ -32,6 +36,9 @@
 #include <core/FileSerializer.hpp>
 #include <core/FileUtils.hpp>
 #include <core/DateTime.hpp>
+#include <core/Settings.hpp>
+#include <core/Thread.hpp>
+#include <core/BoostThread.hpp>
 
 #include <core/system/System.hpp>
 
@@ -61,6 +68,10 @@ namespace source_database {
 
 namespace {
 
+// properties most recently written for each path (so we can skip
+// rewriting properties which haven't changed)
+std::map<std::string,std::string> s_writtenProperties;
+
 struct PropertiesDatabase
 {
    FilePath path;
@@ -88,6 +99,14 @@ Error putProperties(const std::string& path, const json::Object& properties)
    // url escape path (so we can use key=value persistence)
    std::string escapedPath = http::util::urlEncode(path);
 
+   // nothing to do if these are the properties we last wrote
+   std::ostringstream ostr ;
+   json::writeFormatted(properties, ostr);
+   std::map<std::string,std::string>::const_iterator it =
+                                          s_writtenProperties.find(path);
+   if (it != s_writtenProperties.end() && it->second == ostr.str())
+      return Success();
+
    // get properties database
    PropertiesDatabase propertiesDB;
    Error error = getPropertiesDatabase(&propertiesDB);
@@ -106,12 +125,11 @@ Error putProperties(const std::string& path, const json::Object& properties)
    }
 
    // write the file
-   std::ostringstream ostr ;
-   json::writeFormatted(properties, ostr);
    FilePath propertiesFilePath = propertiesDB.path.complete(propertiesFile);
    error = writeStringToFile(propertiesFilePath, ostr.str());
    if (error)
       return error;
+   s_writtenProperties[path] = ostr.str();
 
    // update the index if necessary
    if (updateIndex)
@@ -159,6 +177,30 @@ Error getProperties(const std::string& path, json::Object* pProperties)
    return Success();
 }
 
+// compute the single edit which transforms one string into another
+// (i.e. everything between their common prefix and suffix)
+void diffContents(const std::string& from,
+                  const std::string& to,
+                  SourceDocument::ContentsEdit* pEdit)
+{
+   std::string::size_type maxPrefix = std::min(from.size(), to.size());
+   std::string::size_type prefix = 0;
+   while (prefix < maxPrefix && from[prefix] == to[prefix])
+      prefix++;
+
+   std::string::size_type maxSuffix = maxPrefix - prefix;
+   std::string::size_type suffix = 0;
+   while (suffix < maxSuffix &&
+          from[from.size() - suffix - 1] == to[to.size() - suffix - 1])
+   {
+      suffix++;
+   }
+
+   pEdit->offset = prefix;
+   pEdit->length = from.size() - prefix - suffix;
+   pEdit->text = to.substr(prefix, to.size() - prefix - suffix);
+}
+
 }  // anonymous namespace
 
 SourceDocument::SourceDocument(const std::string& type)
@@ -167,6 +209,7 @@ SourceDocument::SourceDocument(const std::string& type)
    FilePath docPath = file_utils::uniqueFilePath(srcDBPath);
    id_ = docPath.filename();
    type_ = type;
+   editsSincePersistedKnown_ = false;
    setContents("");
    dirty_ = false;
    created_ = date_time::millisecondsSinceEpoch();
@@ -199,8 +242,64 @@ bool SourceDocument::isUntitled() const
 // set contents from string
 void SourceDocument::setContents(const std::string& contents)
 {
+   // nothing to do if the contents haven't changed (this is common, e.g.
+   // when a save sets the contents read back from disk and then the
+   // contents sent by the client)
+   if (contents == contents_ && !hash_.empty())
+      return;
+
+   // track the edit relative to the persisted contents so that it can be
+   // journaled
+   if (editsSincePersistedKnown_)
+   {
+      ContentsEdit edit;
+      diffContents(contents_, contents, &edit);
+      addEditSincePersisted(edit);
+   }
+
    contents_ = contents;
-   hash_ = hash::crc32Hash(contents_);
+   hash_ = hash::xxHash64(contents_);
+}
+
+bool SourceDocument::applyEdits(const std::vector<ContentsEdit>& edits)
+{
+   // validate the ranges before touching the contents
+   std::string::size_type size = contents_.size();
+   BOOST_FOREACH(const ContentsEdit& edit, edits)
+   {
+      if (edit.offset > size || edit.length > size - edit.offset)
+         return false;
+      size = size - edit.length + edit.text.size();
+   }
+
+   BOOST_FOREACH(const ContentsEdit& edit, edits)
+   {
+      contents_.replace(edit.offset, edit.length, edit.text);
+      if (editsSincePersistedKnown_)
+         addEditSincePersisted(edit);
+   }
+
+   hash_ = hash::xxHash64(contents_);
+   return true;
+}
+
+// long runs of edits are cheaper to persist by rewriting the document
+const std::size_t kMaxEditsSincePersisted = 64;
+
+void SourceDocument::addEditSincePersisted(const ContentsEdit& edit)
+{
+   if (edit.length == 0 && edit.text.empty())
+      return;
+
+   if (editsSincePersisted_.size() < kMaxEditsSincePersisted)
+   {
+      editsSincePersisted_.push_back(edit);
+   }
+   else
+   {
+      editsSincePersistedKnown_ = false;
+      editsSincePersisted_.clear();
+   }
 }
 
 // set contents from file
@@ -222,6 +321,7 @@ Error SourceDocument::setPathAndContents(const std::string& path,
    path_ = path;
    setContents(contents);
    lastKnownWriteTime_ = docPath.lastWriteTime();
+   diskHash_ = hash_;
 
    return Success();
 }
@@ -247,7 +347,22 @@ Error SourceDocument::updateDirty()
       // and the UI logic is a little complicated.
 
       FilePath docPath = module_context::resolveAliasedPath(path());
-      if (docPath.exists() && docPath.size() <= (1024*1024))
+      if (!docPath.exists())
+         return Success();
+
+      // if the file has been written since we last read it then it was
+      // edited externally. that is reported to the client separately (see
+      // checkForExternalEdit) so we leave the document dirty rather than
+      // reading the file to compare it
+      if (lastKnownWriteTime_ == 0 ||
+          docPath.lastWriteTime() != lastKnownWriteTime_)
+      {
+         return Success();
+      }
+
+      // otherwise we know the hash of the file's contents (reading it once
+      // to find out for documents persisted without one)
+      if (diskHash_.empty() && docPath.size() <= (1024*1024))
       {
          std::string contents;
          Error error = module_context::readAndDecodeFile(docPath,
@@ -256,10 +371,11 @@ Error SourceDocument::updateDirty()
                                                          &contents);
          if (error)
             return error;
-
-         if (contents_.length() == contents.length() && hash_ == hash::crc32Hash(contents))
-            dirty_ = false;
+         diskHash_ = hash::xxHash64(contents);
       }
+
+      if (!diskHash_.empty() && hash_ == diskHash_)
+         dirty_ = false;
    }
    return Success();
 }
@@ -292,7 +408,9 @@ void SourceDocument::checkForExternalEdit(std::time_t* pTime)
 
 void SourceDocument::updateLastKnownWriteTime()
 {
+   // we don't know what the file contains at the new write time
    lastKnownWriteTime_ = 0;
+   diskHash_.clear();
    if (path_.empty())
       return;
 
@@ -320,6 +438,11 @@ Error SourceDocument::readFromJson(json::Object* pDocJson)
       json::Value path = docJson["path"];
       path_ = !path.is_null() ? path.get_str() : std::string();
 
+      // the caller marks the document persisted if appropriate
+      persistedHash_.clear();
+      editsSincePersistedKnown_ = false;
+      editsSincePersisted_.clear();
+
       json::Value type = docJson["type"];
       type_ = !type.is_null() ? type.get_str() : std::string();
 
@@ -337,6 +460,9 @@ Error SourceDocument::readFromJson(json::Object* pDocJson)
                                ? lastKnownWriteTime.get_int64()
                                : 0;
 
+      json::Value diskHash = docJson["disk_hash"];
+      diskHash_ = !diskHash.is_null() ? diskHash.get_str() : std::string();
+
       json::Value encoding = docJson["encoding"];
       encoding_ = !encoding.is_null() ? encoding.get_str() : std::string();
 
@@ -369,6 +495,7 @@ void SourceDocument::writeToJson(json::Object* pDocJson) const
    jsonDoc["lastKnownWriteTime"] = json::Value(
          static_cast<boost::int64_t>(lastKnownWriteTime_));
    jsonDoc["encoding"] = encoding_;
+   jsonDoc["disk_hash"] = diskHash_;
 }
 
 Error SourceDocument::writeToFile(const FilePath& filePath) const
@@ -383,6 +510,23 @@ Error SourceDocument::writeToFile(const FilePath& filePath) const
    return writeStringToFile(filePath, ostr.str());
 }
 
+bool SourceDocument::contentsEditsSincePersisted(
+                              std::vector<ContentsEdit>* pEdits) const
+{
+   if (persistedHash_.empty() || !editsSincePersistedKnown_)
+      return false;
+
+   *pEdits = editsSincePersisted_;
+   return true;
+}
+
+void SourceDocument::setPersisted()
+{
+   persistedHash_ = hash_;
+   editsSincePersistedKnown_ = true;
+   editsSincePersisted_.clear();
+}
+
 void SourceDocument::editProperty(const json::Object::value_type& property)
 {
    if (property.second.is_null())
@@ -405,6 +549,426 @@ namespace {
 
 FilePath s_sourceDBPath;
 
+// Rather than rewriting the whole document every time it is put we append
+// the edit (along with the rest of the document's state, which is small)
+// to a journal which sits alongside it. The journal is compacted back into
+// the document once it grows to a fraction of the document's size.
+const char * const kJournalExtension = ".journal";
+const char * const kTempExtension = ".tmp";
+const uintmax_t kMinJournalCompactionSize = 256 * 1024;
+
+FilePath journalPath(const FilePath& docPath)
+{
+   return docPath.parent().complete(docPath.filename() + kJournalExtension);
+}
+
+void writeJournalEntry(const SourceDocument& doc,
+                       const std::vector<SourceDocument::ContentsEdit>& edits,
+                       const json::Object& docJson,
+                       std::ostream* pOS)
+{
+   json::Array editsJson;
+   BOOST_FOREACH(const SourceDocument::ContentsEdit& edit, edits)
+   {
+      json::Object editJson;
+      editJson["offset"] = static_cast<int>(edit.offset);
+      editJson["length"] = static_cast<int>(edit.length);
+      editJson["text"] = edit.text;
+      editsJson.push_back(editJson);
+   }
+
+   json::Object entryJson;
+   entryJson["base_hash"] = doc.persistedHash();
+   entryJson["hash"] = doc.hash();
+   entryJson["edits"] = editsJson;
+   entryJson["doc"] = docJson;
+   json::write(entryJson, *pOS);
+   *pOS << std::endl;
+}
+
+// apply a journaled edit to the contents (returns false if its range is
+// out of bounds)
+bool applyJournalEdit(json::Object& editJson, std::string* pContents)
+{
+   std::string::size_type offset = editJson["offset"].get_int();
+   std::string::size_type length = editJson["length"].get_int();
+   if (offset > pContents->size() || length > pContents->size() - offset)
+      return false;
+
+   pContents->replace(offset, length, editJson["text"].get_str());
+   return true;
+}
+
+// replay the journal (if any) onto the document json. returns false if
+// the journal couldn't be applied (e.g. it doesn't match the document)
+bool replayJournal(const FilePath& docPath,
+                   json::Object* pDocJson,
+                   uintmax_t* pJournalSize)
+{
+   *pJournalSize = 0;
+   FilePath journalFilePath = journalPath(docPath);
+   if (!journalFilePath.exists())
+      return true;
+
+   std::string journal;
+   Error error = readStringFromFile(journalFilePath, &journal);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return false;
+   }
+   *pJournalSize = journal.size();
+
+   try
+   {
+      json::Object& docJson = *pDocJson;
+      std::string contents = docJson["contents"].get_str();
+      std::string expectedHash = hash::xxHash64(contents);
+      json::Object lastDocJson;
+
+      std::istringstream istr(journal);
+      std::string line;
+      while (std::getline(istr, line))
+      {
+         // ignore incomplete entries (e.g. from an interrupted write)
+         json::Value entryValue;
+         if (line.empty() ||
+             !json::parse(line, &entryValue) ||
+             !json::isType<json::Object>(entryValue))
+         {
+            continue;
+         }
+
+         json::Object& entryJson = entryValue.get_obj();
+         if (entryJson["base_hash"].get_str() != expectedHash)
+            return false;
+
+         // entries hold a list of edits (or, in older journals, a single
+         // edit inline)
+         json::Value editsJson = entryJson["edits"];
+         if (json::isType<json::Array>(editsJson))
+         {
+            BOOST_FOREACH(json::Value& editJson, editsJson.get_array())
+            {
+               if (!applyJournalEdit(editJson.get_obj(), &contents))
+                  return false;
+            }
+         }
+         else if (!applyJournalEdit(entryJson, &contents))
+         {
+            return false;
+         }
+
+         expectedHash = entryJson["hash"].get_str();
+         lastDocJson = entryJson["doc"].get_obj();
+      }
+
+      // hashes are only checked between entries, so verify the result
+      if (hash::xxHash64(contents) != expectedHash)
+         return false;
+
+      if (!lastDocJson.empty())
+      {
+         lastDocJson["contents"] = contents;
+         docJson = lastDocJson;
+      }
+      return true;
+   }
+   catch(const std::exception& e)
+   {
+      LOG_ERROR_MESSAGE(std::string("Error replaying source journal: ") +
+                        e.what());
+      return false;
+   }
+}
+
+// pending write of a document to the database
+struct DocumentWrite
+{
+   DocumentWrite() : generation(0), remove(false), snapshot(false) {}
+
+   int generation;
+
+   // remove the document (and its journal)
+   bool remove;
+
+   // replace the document (and discard its journal)
+   bool snapshot;
+   std::string snapshotContents;
+
+   // journal entries to append (after writing the snapshot if any)
+   std::string journal;
+};
+
+void performDocumentWrite(const std::string& id, const DocumentWrite& write)
+{
+   FilePath docPath = source_database::path().complete(id);
+   FilePath journalFilePath = journalPath(docPath);
+
+   if (write.remove)
+   {
+      Error error = journalFilePath.removeIfExists();
+      if (error)
+         LOG_ERROR(error);
+      error = docPath.removeIfExists();
+      if (error)
+         LOG_ERROR(error);
+      return;
+   }
+
+   if (write.snapshot)
+   {
+      // write to a temporary file and then move it into place so that the
+      // document is never left partially written
+      FilePath tempPath = docPath.parent().complete(id + kTempExtension);
+      Error error = writeStringToFile(tempPath, write.snapshotContents);
+      if (!error)
+         error = tempPath.move(docPath);
+      if (error)
+      {
+         LOG_ERROR(error);
+         return;
+      }
+
+      error = journalFilePath.removeIfExists();
+      if (error)
+         LOG_ERROR(error);
+   }
+
+   if (!write.journal.empty())
+   {
+      Error error = appendToFile(journalFilePath, write.journal);
+      if (error)
+         LOG_ERROR(error);
+   }
+}
+
+// Writes to the database are performed on a background thread so that
+// slow (e.g. network) filesystems don't stall the main thread. Writes to
+// the same document are coalesced while they are waiting, and until a
+// document's writes complete its latest state is served from memory so
+// that readers never see the database lagging behind.
+class WriteQueue : boost::noncopyable
+{
+public:
+   WriteQueue()
+      : pMutex_(new boost::mutex()),
+        pCondition_(new boost::condition()),
+        running_(false),
+        writing_(false),
+        generation_(0)
+   {
+   }
+
+   // COPYING: boost::noncopyable
+
+   void start()
+   {
+      core::thread::safeLaunchThread(boost::bind(&WriteQueue::run, this),
+                                     &thread_);
+      running_ = thread_.joinable();
+   }
+
+   // enqueue a write. pDocJson is the state of the document after the
+   // write (NULL if the write removes it)
+   void enqueue(const std::string& id,
+                DocumentWrite write,
+                boost::shared_ptr<json::Object> pDocJson)
+   {
+      LOCK_MUTEX(*pMutex_)
+      {
+         write.generation = ++generation_;
+         outstanding_[id] = std::make_pair(write.generation, pDocJson);
+
+         std::map<std::string,DocumentWrite>::iterator it = pending_.find(id);
+         if (it == pending_.end())
+         {
+            pending_[id] = write;
+            order_.push_back(id);
+         }
+         else if (write.remove || write.snapshot)
+         {
+            it->second = write;
+         }
+         else
+         {
+            it->second.generation = write.generation;
+            it->second.journal.append(write.journal);
+         }
+      }
+      END_LOCK_MUTEX
+
+      // without a writer thread write synchronously
+      if (running_)
+         pCondition_->notify_all();
+      else
+         writeNext();
+   }
+
+   // the latest state of a document with outstanding writes. returns
+   // false if it has none (*ppDocJson is set to NULL if it was removed)
+   bool outstanding(const std::string& id,
+                    boost::shared_ptr<json::Object>* ppDocJson) const
+   {
+      LOCK_MUTEX(*pMutex_)
+      {
+         Outstanding::const_iterator it = outstanding_.find(id);
+         if (it == outstanding_.end())
+            return false;
+         *ppDocJson = it->second.second;
+         return true;
+      }
+      END_LOCK_MUTEX
+
+      return false;
+   }
+
+   std::vector<std::string> outstandingIds() const
+   {
+      std::vector<std::string> ids;
+      LOCK_MUTEX(*pMutex_)
+      {
+         for (Outstanding::const_iterator it = outstanding_.begin();
+              it != outstanding_.end();
+              ++it)
+         {
+            ids.push_back(it->first);
+         }
+      }
+      END_LOCK_MUTEX
+      return ids;
+   }
+
+   // approximate bytes held by writes which haven't completed (including
+   // the in-memory copies of their documents)
+   std::size_t memoryUsage() const
+   {
+      std::size_t bytes = 0;
+      LOCK_MUTEX(*pMutex_)
+      {
+         for (std::map<std::string,DocumentWrite>::const_iterator it =
+                                                         pending_.begin();
+              it != pending_.end();
+              ++it)
+         {
+            bytes += it->second.snapshotContents.capacity() +
+                     it->second.journal.capacity();
+         }
+         for (Outstanding::const_iterator it = outstanding_.begin();
+              it != outstanding_.end();
+              ++it)
+         {
+            if (it->second.second)
+               bytes += json::estimatedSize(*(it->second.second));
+         }
+      }
+      END_LOCK_MUTEX
+      return bytes;
+   }
+
+   // wait for all writes to complete
+   void flush()
+   {
+      try
+      {
+         boost::unique_lock<boost::mutex> lock(*pMutex_);
+         while (!pending_.empty() || writing_)
+            pCondition_->wait(lock);
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
+private:
+
+   void run()
+   {
+      try
+      {
+         while (true)
+         {
+            {
+               boost::unique_lock<boost::mutex> lock(*pMutex_);
+               while (pending_.empty())
+                  pCondition_->wait(lock);
+            }
+
+            writeNext();
+         }
+      }
+      catch(const boost::thread_interrupted&)
+      {
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
+   void writeNext()
+   {
+      std::string id;
+      DocumentWrite write;
+      LOCK_MUTEX(*pMutex_)
+      {
+         if (order_.empty())
+            return;
+         id = order_.front();
+         order_.pop_front();
+         write = pending_[id];
+         pending_.erase(id);
+         writing_ = true;
+      }
+      END_LOCK_MUTEX
+
+      performDocumentWrite(id, write);
+
+      LOCK_MUTEX(*pMutex_)
+      {
+         writing_ = false;
+
+         // the state on disk is current unless there were further writes
+         Outstanding::iterator it = outstanding_.find(id);
+         if (it != outstanding_.end() && it->second.first == write.generation)
+            outstanding_.erase(it);
+      }
+      END_LOCK_MUTEX
+
+      pCondition_->notify_all();
+   }
+
+private:
+   // NOTE: these are heap allocated and never freed so that they remain
+   // valid for the writer thread during process shutdown
+   boost::mutex* pMutex_;
+   boost::condition* pCondition_;
+
+   boost::thread thread_;
+   bool running_;
+   bool writing_;
+   int generation_;
+
+   std::map<std::string,DocumentWrite> pending_;
+   std::deque<std::string> order_;
+
+   typedef std::map<std::string,
+                    std::pair<int,boost::shared_ptr<json::Object> > >
+                                                               Outstanding;
+   Outstanding outstanding_;
+};
+
+WriteQueue& writeQueue()
+{
+   static WriteQueue* pInstance = new WriteQueue();
+   return *pInstance;
+}
+
+// sizes of documents (and their journals) in the database, tracked so that
+// put can decide when to compact without hitting the filesystem
+struct DocumentSize
+{
+   DocumentSize() : snapshot(0), journal(0) {}
+   uintmax_t snapshot;
+   uintmax_t journal;
+};
+std::map<std::string,DocumentSize> s_documentSizes;
+
 } // anonymous namespace
 
 FilePath path()
@@ -414,6 +978,25 @@ FilePath path()
    
 Error get(const std::string& id, boost::shared_ptr<SourceDocument> pDoc)
 {
+   // documents with outstanding writes are read from memory
+   boost::shared_ptr<json::Object> pOutstandingJson;
+   if (writeQueue().outstanding(id, &pOutstandingJson))
+   {
+      if (!pOutstandingJson)
+      {
+         return systemError(boost::system::errc::no_such_file_or_directory,
+                            ERROR_LOCATION);
+      }
+
+      json::Object jsonDoc = *pOutstandingJson;
+      Error error = pDoc->readFromJson(&jsonDoc);
+      if (error)
+         return error;
+
+      pDoc->setPersisted();
+      return Success();
+   }
+
    FilePath filePath = source_database::path().complete(id);
    if (filePath.exists())
    {
@@ -432,9 +1015,25 @@ Error get(const std::string& id, boost::shared_ptr<SourceDocument> pDoc)
                             ERROR_LOCATION);
       }
       
-      // initialize doc from json
+      // apply any journaled edits. if the journal can't be applied then
+      // we don't mark the document as persisted, which causes the next
+      // put to rewrite it (and discard the journal)
       json::Object jsonDoc = value.get_obj();
-      return pDoc->readFromJson(&jsonDoc);
+      DocumentSize size;
+      size.snapshot = contents.size();
+      bool journalApplied = replayJournal(filePath, &jsonDoc, &size.journal);
+      if (!journalApplied)
+         LOG_WARNING_MESSAGE("Discarding source journal for " + id);
+
+      // initialize doc from json
+      error = pDoc->readFromJson(&jsonDoc);
+      if (error)
+         return error;
+
+      s_documentSizes[id] = size;
+      if (journalApplied)
+         pDoc->setPersisted();
+      return Success();
    }
    else
    {
@@ -456,6 +1055,10 @@ bool isSourceDocument(const FilePath& filePath)
       return false;
    else if (filePath.filename() == "lock_file")
       return false;
+   else if (filePath.extension() == kJournalExtension)
+      return false;
+   else if (filePath.extension() == kTempExtension)
+      return false;
    else
       return true;
 }
@@ -478,7 +1081,7 @@ bool hasNullByteSequence(const std::string& contents)
    return boost::algorithm::contains(contents, nullBytes);
 }
 
-bool isSafeSourceDocument(const FilePath& docDbPath,
+bool isSafeSourceDocument(uintmax_t docDbSize,
                           boost::shared_ptr<SourceDocument> pDoc)
 {
    // get a filepath and use it for filtering if we can
@@ -494,7 +1097,7 @@ bool isSafeSourceDocument(const FilePath& docDbPath,
    }
 
    // get the size of the file in KB
-   uintmax_t docSizeKb = docDbPath.size() / 1024;
+   uintmax_t docSizeKb = docDbSize / 1024;
    std::string kbStr = safe_convert::numberToString(docSizeKb);
 
    // if it's larger than 2MB then always drop it (that's the limit
@@ -534,23 +1137,30 @@ Error list(std::vector<boost::shared_ptr<SourceDocument> >* pDocs)
    Error error = source_database::path().children(&files);
    if (error)
       return error ;
-   
+
+   // documents in the database as well as those not yet written to it
+   std::set<std::string> ids;
    BOOST_FOREACH( FilePath& filePath, files )
    {
       if (isSourceDocument(filePath))
+         ids.insert(filePath.filename());
+   }
+   std::vector<std::string> outstandingIds = writeQueue().outstandingIds();
+   ids.insert(outstandingIds.begin(), outstandingIds.end());
+   
+   BOOST_FOREACH( const std::string& id, ids )
+   {
+      // get the source doc (skipping those which have been removed)
+      boost::shared_ptr<SourceDocument> pDoc(new SourceDocument()) ;
+      Error error = source_database::get(id, pDoc);
+      if (!error)
       {
-         // get the source doc
-         boost::shared_ptr<SourceDocument> pDoc(new SourceDocument()) ;
-         Error error = source_database::get(filePath.filename(), pDoc);
-         if (!error)
-         {
-            // safety filter
-            if (isSafeSourceDocument(filePath, pDoc))
-               pDocs->push_back(pDoc);
-         }
-         else
-            LOG_ERROR(error);
+         // safety filter
+         if (isSafeSourceDocument(s_documentSizes[id].snapshot, pDoc))
+            pDocs->push_back(pDoc);
       }
+      else if (error.code() != boost::system::errc::no_such_file_or_directory)
+         LOG_ERROR(error);
    }
    
    return Success();
@@ -558,16 +1168,45 @@ Error list(std::vector<boost::shared_ptr<SourceDocument> >* pDocs)
    
 Error put(boost::shared_ptr<SourceDocument> pDoc)
 {   
-   // write to file
-   FilePath filePath = source_database::path().complete(pDoc->id());
-   Error error = pDoc->writeToFile(filePath);
-   if (error)
-      return error ;
+   // serialize the document (other than its contents, which are only
+   // written when we snapshot)
+   json::Object docJson;
+   pDoc->writeToJson(&docJson);
+   docJson.erase("contents");
+
+   // journal the edits if we can and the journal isn't due for compaction
+   DocumentWrite write;
+   DocumentSize& size = s_documentSizes[pDoc->id()];
+   std::vector<SourceDocument::ContentsEdit> edits;
+   if (pDoc->contentsEditsSincePersisted(&edits) &&
+       size.journal < std::max(kMinJournalCompactionSize, size.snapshot / 2))
+   {
+      std::ostringstream ostr;
+      writeJournalEntry(*pDoc, edits, docJson, &ostr);
+      write.journal = ostr.str();
+      size.journal += write.journal.size();
+   }
+
+   // otherwise write the whole document (discarding its journal)
+   boost::shared_ptr<json::Object> pDocJson(new json::Object(docJson));
+   (*pDocJson)["contents"] = pDoc->contents();
+   if (write.journal.empty())
+   {
+      std::ostringstream ostr ;
+      json::writeFormatted(*pDocJson, ostr);
+      write.snapshot = true;
+      write.snapshotContents = ostr.str();
+      size.snapshot = write.snapshotContents.size();
+      size.journal = 0;
+   }
+
+   writeQueue().enqueue(pDoc->id(), write, pDocJson);
+   pDoc->setPersisted();
 
    // write properties to durable storage (if there is a path)
    if (!pDoc->path().empty())
    {
-      error = putProperties(pDoc->path(), pDoc->properties());
+      Error error = putProperties(pDoc->path(), pDoc->properties());
       if (error)
          LOG_ERROR(error);
    }
@@ -577,11 +1216,19 @@ Error put(boost::shared_ptr<SourceDocument> pDoc)
    
 Error remove(const std::string& id)
 {
-   return source_database::path().complete(id).removeIfExists();
+   DocumentWrite write;
+   write.remove = true;
+   writeQueue().enqueue(id, write, boost::shared_ptr<json::Object>());
+   s_documentSizes.erase(id);
+   return Success();
 }
    
 Error removeAll()
 {
+   // wait for outstanding writes so they don't race with the removal
+   writeQueue().flush();
+   s_documentSizes.clear();
+
    std::vector<FilePath> files ;
    Error error = source_database::path().children(&files);
    if (error)
@@ -599,8 +1246,19 @@ Error removeAll()
 
 namespace {
 
+void onSuspend(Settings*)
+{
+   writeQueue().flush();
+}
+
+void onResume(const Settings&)
+{
+}
+
 void onShutdown(bool)
 {
+   writeQueue().flush();
+
    Error error = supervisor::detachFromSourceDatabase();
    if (error)
       LOG_ERROR(error);
@@ -615,7 +1273,15 @@ Error initialize()
    if (error)
       return error;
 
-   // signup for the shutdown event
+   // start writing to it in the background
+   writeQueue().start();
+   module_context::registerMemoryUsage(
+                  "source_database",
+                  boost::bind(&WriteQueue::memoryUsage, &writeQueue()));
+
+   // flush writes on suspend and shutdown
+   module_context::addSuspendHandler(
+                  module_context::SuspendHandler(onSuspend, onResume));
    module_context::events().onShutdown.connect(onShutdown);
 
    return Success();
@@ -623,4 +1289,3 @@ Error initialize()
 
 } // namespace source_database
 } // namesapce session
-
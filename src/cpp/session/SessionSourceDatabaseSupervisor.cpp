@@ -15,8 +15,16 @@
 
 #include "SessionSourceDatabaseSupervisor.hpp"
 
+#ifndef _WIN32
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+#include <map>
 #include <vector>
 
+#include <boost/bind.hpp>
 #include <boost/foreach.hpp>
 #include <boost/scope_exit.hpp>
 #include <boost/algorithm/string/predicate.hpp>
@@ -27,6 +35,8 @@
 #include <core/FileLock.hpp>
 #include <core/FileUtils.hpp>
 #include <core/BoostErrors.hpp>
+#include <core/SafeConvert.hpp>
+#include <core/Thread.hpp>
 
 
 #include <core/system/System.hpp>
@@ -91,6 +101,110 @@ FilePath sessionLockFilePath(const FilePath& sessionDir)
 // session dir lock (initialized by attachToSourceDatabase)
 FileLock s_sessionDirLock;
 
+// The session dirs index records the owner (host and pid) of each session
+// dir so that at startup we can tell that the dirs of sessions on this
+// host are (or aren't) orphaned without checking their locks (which can be
+// very slow on network filesystems). It is only a hint: dirs which aren't
+// in it (or are owned by other hosts) still have their locks checked.
+typedef std::map<std::string,std::string> SessionDirsIndex;
+
+// maximum number of session dir locks checked at once
+const std::size_t kMaxLockCheckThreads = 8;
+
+FilePath sessionDirsIndexPath()
+{
+   return sourceDatabaseRoot().complete("sessions");
+}
+
+SessionDirsIndex readSessionDirsIndex()
+{
+   SessionDirsIndex index;
+   FilePath indexPath = sessionDirsIndexPath();
+   if (indexPath.exists())
+   {
+      Error error = readStringMapFromFile(indexPath, &index);
+      if (error)
+         LOG_ERROR(error);
+   }
+   return index;
+}
+
+// update the index entry for a session dir (an empty owner removes it)
+void updateSessionDirsIndex(const FilePath& sessionDir,
+                            const std::string& owner)
+{
+   SessionDirsIndex index = readSessionDirsIndex();
+
+   // prune entries for dirs which no longer exist
+   for (SessionDirsIndex::iterator it = index.begin(); it != index.end(); )
+   {
+      if (!sourceDatabaseRoot().complete(it->first).exists())
+         index.erase(it++);
+      else
+         ++it;
+   }
+
+   if (!owner.empty())
+      index[sessionDir.filename()] = owner;
+   else
+      index.erase(sessionDir.filename());
+
+   Error error = writeStringMapToFile(sessionDirsIndexPath(), index);
+   if (error)
+      LOG_ERROR(error);
+}
+
+std::string hostName()
+{
+#ifndef _WIN32
+   char buffer[256];
+   if (::gethostname(buffer, sizeof(buffer)) == 0)
+   {
+      buffer[sizeof(buffer) - 1] = '\0';
+      return buffer;
+   }
+#endif
+   return std::string();
+}
+
+std::string currentOwner()
+{
+#ifndef _WIN32
+   std::string host = hostName();
+   if (!host.empty())
+      return host + ":" + safe_convert::numberToString(::getpid());
+#endif
+   return std::string();
+}
+
+enum OwnerState
+{
+   OwnerUnknown,
+   OwnerRunning,
+   OwnerExited
+};
+
+// is the owner of a session dir still running? (we can only tell for
+// owners on this host)
+OwnerState ownerState(const std::string& owner)
+{
+#ifndef _WIN32
+   std::string::size_type pos = owner.rfind(':');
+   if (pos == std::string::npos || owner.substr(0, pos) != hostName())
+      return OwnerUnknown;
+
+   pid_t pid = safe_convert::stringTo<pid_t>(owner.substr(pos + 1), -1);
+   if (pid <= 0)
+      return OwnerUnknown;
+
+   if (::kill(pid, 0) == 0 || errno == EPERM)
+      return OwnerRunning;
+   else if (errno == ESRCH)
+      return OwnerExited;
+#endif
+   return OwnerUnknown;
+}
+
 Error removeSessionDir(const FilePath& sessionDir)
 {
    // first remove children
@@ -233,14 +347,35 @@ Error createSessionDirFromOldSourceDatabase(FilePath* pSessionDir)
 
 Error createSessionDirFromPersistent(FilePath* pSessionDir)
 {
-   // create new session dir
-   Error error = createSessionDir(pSessionDir);
-   if (error)
-      return error;
-
-   // move persistent titled files
+   // the persistent titled dir is rewritten in its entirety by each session
+   // that detaches so we can take it over with a single rename rather than
+   // moving its files one by one
+   bool movedTitledDir = false;
    if (persistentTitledDir().exists())
-      attemptToMoveSourceDbFiles(persistentTitledDir(), *pSessionDir);
+   {
+      FilePath sessionDir = generateSessionDirPath();
+      Error error = persistentTitledDir().move(sessionDir);
+      if (!error)
+      {
+         movedTitledDir = true;
+         *pSessionDir = sessionDir;
+         error = s_sessionDirLock.acquire(sessionLockFilePath(*pSessionDir));
+         if (error)
+            LOG_ERROR(error);
+      }
+   }
+
+   // otherwise create new session dir
+   if (!movedTitledDir)
+   {
+      Error error = createSessionDir(pSessionDir);
+      if (error)
+         return error;
+
+      // move persistent titled files
+      if (persistentTitledDir().exists())
+         attemptToMoveSourceDbFiles(persistentTitledDir(), *pSessionDir);
+   }
 
    // get legacy titled docs if they exist
    if (oldPersistentTitledDir().exists())
@@ -258,25 +393,85 @@ Error createSessionDirFromPersistent(FilePath* pSessionDir)
    return Success();
 }
 
+void checkLocks(const std::vector<FilePath>& sessionDirs,
+                std::size_t first,
+                std::size_t stride,
+                std::vector<char>* pLocked)
+{
+   for (std::size_t i = first; i < sessionDirs.size(); i += stride)
+      (*pLocked)[i] = FileLock::isLocked(sessionLockFilePath(sessionDirs[i]));
+}
+
+// determine which session dirs are orphaned (i.e. not locked by a running
+// session). the owners recorded in the index are used where possible and
+// the remaining locks are checked in parallel
+std::vector<FilePath> orphanedSessionDirs(
+                                 const std::vector<FilePath>& sessionDirs)
+{
+   SessionDirsIndex index = readSessionDirsIndex();
+
+   std::vector<FilePath> orphans, unknown;
+   BOOST_FOREACH(const FilePath& sessionDir, sessionDirs)
+   {
+      SessionDirsIndex::const_iterator it = index.find(sessionDir.filename());
+      OwnerState state = it != index.end() ? ownerState(it->second) :
+                                             OwnerUnknown;
+      if (state == OwnerExited)
+         orphans.push_back(sessionDir);
+      else if (state == OwnerUnknown)
+         unknown.push_back(sessionDir);
+   }
+
+   std::vector<char> locked(unknown.size(), 1);
+   std::size_t threads = std::min(unknown.size(), kMaxLockCheckThreads);
+   std::vector<boost::shared_ptr<boost::thread> > workers;
+   for (std::size_t i = 1; i < threads; i++)
+   {
+      boost::shared_ptr<boost::thread> pWorker(new boost::thread());
+      core::thread::safeLaunchThread(boost::bind(checkLocks,
+                                                 boost::cref(unknown),
+                                                 i, threads, &locked),
+                                     pWorker.get());
+      if (pWorker->joinable())
+         workers.push_back(pWorker);
+      else
+         checkLocks(unknown, i, threads, &locked);
+   }
+   if (threads > 0)
+      checkLocks(unknown, 0, threads, &locked);
+   BOOST_FOREACH(boost::shared_ptr<boost::thread> pWorker, workers)
+   {
+      pWorker->join();
+   }
+
+   for (std::size_t i = 0; i < unknown.size(); i++)
+   {
+      if (!locked[i])
+         orphans.push_back(unknown[i]);
+   }
+
+   return orphans;
+}
+
 bool reclaimOrphanedSession(const std::vector<FilePath>& sessionDirs,
                             FilePath* pSessionDir)
 {
-   BOOST_FOREACH(const FilePath& sessionDir, sessionDirs)
+   BOOST_FOREACH(const FilePath& orphanDir, orphanedSessionDirs(sessionDirs))
    {
-      FilePath lockFilePath = sessionLockFilePath(sessionDir);
-      if (!FileLock::isLocked(lockFilePath))
-      {
-         Error error = s_sessionDirLock.acquire(lockFilePath);
-         if (!error)
-         {
-            *pSessionDir = sessionDir;
-            return true;
-         }
-         else
-         {
-            LOG_ERROR(error);
-         }
-      }
+      // claim the dir by renaming it (this is atomic so if another session
+      // is starting up at the same time only one of us gets it, even on
+      // filesystems without locks)
+      FilePath sessionDir = generateSessionDirPath();
+      Error error = orphanDir.move(sessionDir);
+      if (error)
+         continue;
+
+      error = s_sessionDirLock.acquire(sessionLockFilePath(sessionDir));
+      if (error)
+         LOG_ERROR(error);
+
+      *pSessionDir = sessionDir;
+      return true;
    }
 
    return false;
@@ -326,15 +521,22 @@ Error attachToSourceDatabase(FilePath* pSessionDir)
 
    // attempt to migrate if necessary
    if (needToMigrate)
-      return createSessionDirFromOldSourceDatabase(pSessionDir);
+      error = createSessionDirFromOldSourceDatabase(pSessionDir);
 
    // if there is an orphan (crash) then reclaim it
    else if (reclaimOrphanedSession(sessionDirs, pSessionDir))
-      return Success();
+      error = Success();
 
    // attempt to create from persistent
    else
-      return createSessionDirFromPersistent(pSessionDir);
+      error = createSessionDirFromPersistent(pSessionDir);
+
+   if (error)
+      return error;
+
+   // record that we own the session dir
+   updateSessionDirsIndex(*pSessionDir, currentOwner());
+   return Success();
 }
 
 Error detachFromSourceDatabase()
@@ -389,6 +591,9 @@ Error detachFromSourceDatabase()
    // record session dir (parent of lock file)
    FilePath sessionDir = s_sessionDirLock.lockFilePath().parent();
 
+   // remove our entry from the session dirs index
+   updateSessionDirsIndex(sessionDir, std::string());
+
    // give up our lock
    error = s_sessionDirLock.release();
    if (error)
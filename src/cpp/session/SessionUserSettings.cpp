@@ -76,6 +76,9 @@ void setBioconductorReposOption(const std::string& mirror)
    }
 }
 
+// interval at which pending settings changes are written
+const int kFlushSettingsSeconds = 2;
+
 
 
 } // anonymous namespace
@@ -103,11 +106,25 @@ Error UserSettings::initialize()
          oldSettingsPath.move(settingsFilePath_);
    }
 
-   // read the settings
+   // read the settings (changes are written behind so that a series of
+   // them results in a single write of the file)
+   settings_.setWriteBehind(true);
    Error error = settings_.initialize(settingsFilePath_);
    if (error)
       return error;
 
+   // flush pending changes periodically and before we suspend or exit
+   module_context::schedulePeriodicWork(
+            boost::posix_time::seconds(kFlushSettingsSeconds),
+            boost::bind(&UserSettings::flushPeriodically, this),
+            false,
+            false);
+   module_context::addSuspendHandler(module_context::SuspendHandler(
+            boost::bind(&UserSettings::flush, this),
+            boost::bind(&UserSettings::flush, this)));
+   module_context::events().onShutdown.connect(
+            boost::bind(&UserSettings::flush, this));
+
    // make sure we have a context id
    if (contextId().empty())
       setContextId(core::system::generateShortenedUuid());
@@ -115,6 +132,17 @@ Error UserSettings::initialize()
    return Success();
 }
 
+void UserSettings::flush()
+{
+   settings_.flush();
+}
+
+bool UserSettings::flushPeriodically()
+{
+   flush();
+   return true;
+}
+
 void UserSettings::onSettingsFileChanged(
                      const core::system::FileChangeEvent& changeEvent)
 {
@@ -16,6 +16,7 @@
 #ifndef SESSION_HTTP_CONNECTION_IMPL_HPP
 #define SESSION_HTTP_CONNECTION_IMPL_HPP
 
+#include <map>
 
 #include <boost/array.hpp>
 
@@ -24,15 +25,21 @@
 #include <boost/asio/write.hpp>
 #include <boost/asio/placeholders.hpp>
 #include <boost/enable_shared_from_this.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 
 #include <core/Error.hpp>
 #include <core/Log.hpp>
 #include <core/SafeConvert.hpp>
+#include <core/Thread.hpp>
+#include <core/Trace.hpp>
 
+#include <core/http/FileBody.hpp>
 #include <core/http/Request.hpp>
 #include <core/http/Response.hpp>
 #include <core/http/RequestParser.hpp>
 #include <core/http/SocketUtils.hpp>
+#include <core/http/WebSocket.hpp>
 
 #include <core/json/JsonRpc.hpp>
 
@@ -42,98 +49,489 @@
 
 namespace session {
 
+// state shared by all of the requests read from a single connection. when
+// a client keeps a connection alive (and possibly pipelines requests over
+// it) each request is handed to the Handler as a distinct HttpConnection,
+// however responses still need to be written in the order in which the
+// requests were read. responses which are ready early are held here until
+// the responses to all of the requests that preceded them are written.
 template <typename ProtocolType>
-class HttpConnectionImpl :
-   public HttpConnection,
-   public boost::enable_shared_from_this<HttpConnectionImpl<ProtocolType> >,
+class HttpConnectionStream :
+   public boost::enable_shared_from_this<HttpConnectionStream<ProtocolType> >,
    boost::noncopyable
 {
 public:
-   typedef boost::function<void(
-         boost::shared_ptr<HttpConnectionImpl<ProtocolType> >)> Handler;
+   // maximum number of requests read ahead of their responses
+   static const std::size_t kMaxPipelinedRequests = 16;
+
+   explicit HttpConnectionStream(boost::asio::io_service& ioService)
+      : ioService_(ioService),
+        socket_(ioService),
+        nextRequest_(0),
+        nextResponse_(0),
+        closed_(false),
+        streaming_(false)
+   {
+   }
 
+   boost::asio::io_service& ioService() { return ioService_; }
 
-public:
-   HttpConnectionImpl(boost::asio::io_service& ioService,
-                      const Handler& handler)
-      : socket_(ioService), handler_(handler)
+   typename ProtocolType::socket& socket() { return socket_; }
+
+   // assign a sequence number to a request (called when we begin reading)
+   std::size_t beginRequest()
    {
+      LOCK_MUTEX(mutex_)
+      {
+         return nextRequest_++;
+      }
+      END_LOCK_MUTEX
+
+      // keep compiler happy
+      return 0;
    }
 
-   virtual ~HttpConnectionImpl()
+   // check whether the client has too many requests outstanding for us
+   // to read another one. if it does then the resume function is posted
+   // to the io service once another response has been written
+   bool deferReading(const boost::function<void()>& resume)
    {
-      // close here as a precaution
-      try
+      LOCK_MUTEX(mutex_)
       {
-         close();
+         if (!closed_ &&
+             (nextRequest_ - nextResponse_) > kMaxPipelinedRequests)
+         {
+            resumeReading_ = resume;
+            return true;
+         }
       }
-      catch(...)
+      END_LOCK_MUTEX
+
+      return false;
+   }
+
+   void writeResponse(std::size_t sequence,
+                      const core::http::Response& response,
+                      bool keepAlive,
+                      const std::string& requestUri)
+   {
+      boost::function<void()> resumeReading;
+
+      LOCK_MUTEX(mutex_)
+      {
+         // if this response is early then hold it
+         if (sequence != nextResponse_)
+         {
+            boost::shared_ptr<PendingResponse> pPending(new PendingResponse());
+            pPending->response.assign(response);
+            pPending->keepAlive = keepAlive;
+            pPending->requestUri = requestUri;
+            pending_[sequence] = pPending;
+            return;
+         }
+
+         // write it along with any responses which were waiting on it
+         doWriteResponse(response, keepAlive, requestUri);
+         typename PendingResponses::iterator it;
+         while ((it = pending_.find(nextResponse_)) != pending_.end())
+         {
+            boost::shared_ptr<PendingResponse> pPending = it->second;
+            pending_.erase(it);
+            doWriteResponse(pPending->response,
+                            pPending->keepAlive,
+                            pPending->requestUri);
+         }
+
+         resumeReading = resumeReading_;
+         resumeReading_ = boost::function<void()>();
+      }
+      END_LOCK_MUTEX
+
+      // resume reading (on the listener thread) if we had deferred it
+      if (resumeReading)
+         ioService_.post(resumeReading);
+   }
+
+   // write data directly to the connection (used once it has been
+   // upgraded to a websocket)
+   core::Error writeData(const std::string& data)
+   {
+      LOCK_MUTEX(mutex_)
       {
+         if (closed_)
+            return core::Error(boost::asio::error::not_connected,
+                               ERROR_LOCATION);
+
+         try
+         {
+            boost::asio::write(socket_, boost::asio::buffer(data));
+         }
+         catch(const boost::system::system_error& e)
+         {
+            doClose();
+            return core::Error(e.code(), ERROR_LOCATION);
+         }
       }
+      END_LOCK_MUTEX
+
+      return core::Success();
    }
 
-public:
+   bool isClosed()
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         return closed_;
+      }
+      END_LOCK_MUTEX
 
-   // request/resposne (used by Handler)
-   virtual const core::http::Request& request() { return request_; }
+      // keep compiler happy
+      return true;
+   }
 
-   virtual void sendResponse(const core::http::Response &response)
+   void close()
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         doClose();
+      }
+      END_LOCK_MUTEX
+   }
+
+private:
+
+   // NOTE: must be called with mutex_ held
+   void doWriteResponse(const core::http::Response& response,
+                        bool keepAlive,
+                        const std::string& requestUri)
    {
+      nextResponse_++;
+
+      // nothing to do if the connection has already been closed
+      if (closed_)
+         return;
+
       try
       {
-         // write the response
-         boost::asio::write(socket_,
-                            response.toBuffers(
-                                  core::http::Header::connectionClose()));
+         // write the response (upgrade responses specify their own
+         // Connection header)
+         core::http::Header connectionHeader;
+         if (response.statusCode() != core::http::status::SwitchingProtocols)
+         {
+            connectionHeader = (keepAlive && !response.hasStreamBody()) ?
+                                 core::http::Header("Connection", "keep-alive") :
+                                 core::http::Header::connectionClose();
+         }
+         boost::asio::write(socket_, response.toBuffers(connectionHeader));
+
+         // streamed bodies are written on a background thread which then
+         // closes the connection (so nothing more can be written to it)
+         if (response.hasStreamBody())
+         {
+            closed_ = true;
+            streaming_ = true;
+            core::thread::safeLaunchThread(boost::bind(
+                  &HttpConnectionStream<ProtocolType>::writeStreamBody,
+                  HttpConnectionStream<ProtocolType>::shared_from_this(),
+                  response.streamBodyWriter(),
+                  requestUri));
+            return;
+         }
+
+         // send file bodies directly from disk
+         core::Error error = core::http::writeFileBody(response, socket_);
+         if (error)
+         {
+            error.addProperty("request-uri", requestUri);
+            if (!core::http::isConnectionTerminatedError(error))
+               LOG_ERROR(error);
+            keepAlive = false;
+         }
       }
       catch(const boost::system::system_error& e)
       {
          // establish error
          core::Error error = core::Error(e.code(), ERROR_LOCATION);
-         error.addProperty("request-uri", request_.uri());
+         error.addProperty("request-uri", requestUri);
 
          // log the error if it wasn't connection terminated
          if (!core::http::isConnectionTerminatedError(error))
             LOG_ERROR(error);
+
+         keepAlive = false;
       }
       CATCH_UNEXPECTED_EXCEPTION
 
-      // always close connection
+      // close the connection unless we are keeping it alive
+      if (!keepAlive)
+         doClose();
+   }
+
+   void writeStreamBody(
+            const core::http::Response::StreamBodyWriter& writer,
+            const std::string& requestUri)
+   {
       try
       {
-         close();
+         core::Error error = writer(boost::bind(
+               &HttpConnectionStream<ProtocolType>::writeStreamData,
+               this, _1, _2));
+         if (error)
+         {
+            error.addProperty("request-uri", requestUri);
+            if (!core::http::isConnectionTerminatedError(error))
+               LOG_ERROR(error);
+         }
       }
       CATCH_UNEXPECTED_EXCEPTION
+
+      LOCK_MUTEX(mutex_)
+      {
+         streaming_ = false;
+         doClose();
+      }
+      END_LOCK_MUTEX
    }
 
-   // close (occurs automatically after writeResponse, here in case it
-   // need to be closed in other circumstances
-   virtual void close()
+   // NOTE: only called by writeStreamBody (which owns the socket)
+   core::Error writeStreamData(const char* data, std::size_t size)
    {
-      // always close connection
+      try
+      {
+         boost::asio::write(socket_, boost::asio::buffer(data, size));
+         return core::Success();
+      }
+      catch(const boost::system::system_error& e)
+      {
+         return core::Error(e.code(), ERROR_LOCATION);
+      }
+   }
+
+   // NOTE: must be called with mutex_ held
+   void doClose()
+   {
+      closed_ = true;
+      pending_.clear();
+      resumeReading_ = boost::function<void()>();
+
+      // the socket is closed once a streamed body has been written
+      if (streaming_)
+         return;
+
       core::Error error = core::http::closeSocket(socket_);
       if (error)
          LOG_ERROR(error);
    }
 
+private:
+   struct PendingResponse
+   {
+      core::http::Response response;
+      bool keepAlive;
+      std::string requestUri;
+   };
+   typedef std::map<std::size_t, boost::shared_ptr<PendingResponse> >
+                                                         PendingResponses;
+
+   boost::asio::io_service& ioService_;
+   typename ProtocolType::socket socket_;
+   boost::mutex mutex_;
+   std::size_t nextRequest_;
+   std::size_t nextResponse_;
+   PendingResponses pending_;
+   boost::function<void()> resumeReading_;
+   bool closed_;
+   bool streaming_;
+};
+
+template <typename ProtocolType>
+class HttpConnectionImpl :
+   public HttpConnection,
+   public boost::enable_shared_from_this<HttpConnectionImpl<ProtocolType> >,
+   boost::noncopyable
+{
+public:
+   typedef boost::function<void(
+         boost::shared_ptr<HttpConnectionImpl<ProtocolType> >)> Handler;
+
+
+public:
+   HttpConnectionImpl(boost::asio::io_service& ioService,
+                      const Handler& handler)
+      : pStream_(new HttpConnectionStream<ProtocolType>(ioService)),
+        handler_(handler),
+        sequence_(0),
+        keepAlive_(false),
+        responded_(false),
+        webSocket_(false)
+   {
+      requestParser_.setBodySpooling(connection::uploadSpoolPath(),
+                                     connection::onUploadProgress);
+   }
+
+   virtual ~HttpConnectionImpl()
+   {
+      // close here as a precaution (if we never responded then whatever
+      // follows us on the connection can't be responded to either)
+      try
+      {
+         if (!responded_)
+            close();
+      }
+      catch(...)
+      {
+      }
+   }
+
+public:
+
+   // request/resposne (used by Handler)
+   virtual const core::http::Request& request() { return request_; }
+
+   virtual void sendResponse(const core::http::Response &response)
+   {
+      responded_ = true;
+
+      // the connection can only be kept alive if the client asked for
+      // it and the response can be delimited by its content length
+      bool keepAlive = keepAlive_ && response.containsHeader("Content-Length");
+
+      // write the response (closes the connection if not kept alive)
+      using namespace boost::posix_time;
+      ptime writeTime = microsec_clock::universal_time();
+      pStream_->writeResponse(sequence_, response, keepAlive, request_.uri());
+      core::trace::recordSpanSince(core::trace::traceId(request_),
+                                   "session_write_response",
+                                   writeTime);
+   }
+
+   // close (occurs automatically after writeResponse, here in case it
+   // need to be closed in other circumstances
+   virtual void close()
+   {
+      responded_ = true;
+
+      // let websocket clients know we're closing intentionally
+      if (webSocket_ && !pStream_->isClosed())
+         pStream_->writeData(core::http::websocket::frame(
+                                 core::http::websocket::Close, std::string()));
+
+      pStream_->close();
+   }
+
    // other useful introspection methods
    virtual std::string requestId() const { return requestId_; }
 
+   virtual boost::posix_time::ptime receivedTime() const
+   {
+      return receivedTime_;
+   }
+
+   // websockets
+   virtual bool acceptWebSocket(const WebSocketMessageHandler& onMessage)
+   {
+      using namespace core::http;
+
+      if (!websocket::isUpgradeRequest(request_))
+         return false;
+
+      Response response;
+      core::Error error = websocket::setHandshakeResponse(request_, &response);
+      if (error)
+      {
+         LOG_ERROR(error);
+         return false;
+      }
+
+      // write the handshake (the connection stays open afterwards)
+      responded_ = true;
+      pStream_->writeResponse(sequence_, response, true, request_.uri());
+      if (pStream_->isClosed())
+         return false;
+
+      // begin reading messages (on the listener thread)
+      webSocket_ = true;
+      onWebSocketMessage_ = onMessage;
+      pStream_->ioService().post(boost::bind(
+               &HttpConnectionImpl<ProtocolType>::readWebSocket,
+               HttpConnectionImpl<ProtocolType>::shared_from_this()));
+
+      return true;
+   }
+
+   virtual core::Error sendWebSocketMessage(const std::string& message)
+   {
+      return pStream_->writeData(core::http::websocket::frame(
+                                    core::http::websocket::Text, message));
+   }
+
+   virtual bool isWebSocketOpen()
+   {
+      return webSocket_ && !pStream_->isClosed();
+   }
+
    // start reading the request from the connection. once a request
    // is successfully read the Connection is passed to the Handler
    void startReading()
    {
+      sequence_ = pStream_->beginRequest();
       readSome();
    }
 
    // get the socket
-   typename ProtocolType::socket& socket() { return socket_; }
+   typename ProtocolType::socket& socket() { return pStream_->socket(); }
 
 
 private:
 
+   // construct the reader for the next request on a kept-alive connection
+   HttpConnectionImpl(
+         boost::shared_ptr<HttpConnectionStream<ProtocolType> > pStream,
+         const Handler& handler)
+      : pStream_(pStream),
+        handler_(handler),
+        sequence_(0),
+        keepAlive_(false),
+        responded_(false),
+        webSocket_(false)
+   {
+      requestParser_.setBodySpooling(connection::uploadSpoolPath(),
+                                     connection::onUploadProgress);
+   }
+
+   // start reading the next request, beginning with any bytes which
+   // were read after the end of the previous request
+   void startReading(const char* begin, const char* end)
+   {
+      sequence_ = pStream_->beginRequest();
+      if (begin != end)
+      {
+         std::size_t size = end - begin;
+         std::copy(begin, end, buffer_.begin());
+         handleRead(boost::system::error_code(), size);
+      }
+      else
+      {
+         readSome();
+      }
+   }
+
    // async request reading interface
    void readSome()
+   {
+      // if the client has too many requests outstanding then wait until
+      // some responses have been written before reading any more
+      if (pStream_->deferReading(boost::bind(
+               &HttpConnectionImpl<ProtocolType>::doReadSome,
+               HttpConnectionImpl<ProtocolType>::shared_from_this())))
+      {
+         return;
+      }
+
+      doReadSome();
+   }
+
+   void doReadSome()
    {
       // NOTE: the call to HttpConnection::shared_from_this() is what
       // continues to keep this object alive during processing. when we
@@ -141,7 +539,7 @@ private:
       // (unless the handler chooses to retain a copy of it e.g. to perform
       // processing in a background thread)
 
-      socket_.async_read_some(
+      socket().async_read_some(
          boost::asio::buffer(buffer_),
          boost::bind(
                &HttpConnectionImpl<ProtocolType>::handleRead,
@@ -150,6 +548,13 @@ private:
                boost::asio::placeholders::bytes_transferred));
    }
 
+   static bool isKeepAlive(const core::http::Request& request)
+   {
+      return !request.isHttp10() &&
+             boost::algorithm::iequals(request.headerValue("Connection"),
+                                       "keep-alive");
+   }
+
    void handleRead(const boost::system::error_code& e,
                    std::size_t bytesTransferred)
    {
@@ -158,10 +563,11 @@ private:
          if (!e)
          {
             // parse next chunk
+            const char* begin = buffer_.data();
+            const char* end = buffer_.data() + bytesTransferred;
+            const char* next = end;
             core::http::RequestParser::status status = requestParser_.parse(
-                                        request_,
-                                        buffer_.data(),
-                                        buffer_.data() + bytesTransferred);
+                                        request_, begin, end, &next);
 
             // error - return bad request
             if (status == core::http::RequestParser::error)
@@ -185,6 +591,13 @@ private:
             {
                // establish request id
                requestId_ = connection::rstudioRequestIdFromRequest(request_);
+               receivedTime_ =
+                     boost::posix_time::microsec_clock::universal_time();
+
+               // note whether the client wants to keep the connection alive
+               // (connections upgraded to websockets are handled separately)
+               keepAlive_ = isKeepAlive(request_) &&
+                            !core::http::websocket::isUpgradeRequest(request_);
 
                // call handler
                handler_(HttpConnectionImpl<ProtocolType>::shared_from_this());
@@ -193,6 +606,17 @@ private:
                // object has no more references to it and will be destroyed. note
                // though that the handler may choose to retain a reference
                // (e.g. if it handles the connection in a background thread)
+
+               // if the connection is being kept alive then begin reading
+               // the next request (this is done after calling the handler
+               // so that requests are always handled in the order read)
+               if (keepAlive_)
+               {
+                  boost::shared_ptr<HttpConnectionImpl<ProtocolType> > pNext(
+                        new HttpConnectionImpl<ProtocolType>(pStream_,
+                                                             handler_));
+                  pNext->startReading(next, end);
+               }
             }
          }
          else // error reading
@@ -212,16 +636,96 @@ private:
       CATCH_UNEXPECTED_EXCEPTION
    }
 
+   void readWebSocket()
+   {
+      socket().async_read_some(
+         boost::asio::buffer(buffer_),
+         boost::bind(
+               &HttpConnectionImpl<ProtocolType>::handleWebSocketRead,
+               HttpConnectionImpl<ProtocolType>::shared_from_this(),
+               boost::asio::placeholders::error,
+               boost::asio::placeholders::bytes_transferred));
+   }
+
+   void handleWebSocketRead(const boost::system::error_code& e,
+                            std::size_t bytesTransferred)
+   {
+      using namespace core::http;
+
+      try
+      {
+         if (e)
+         {
+            // log the error if it wasn't connection terminated (or caused
+            // by our closing the connection)
+            core::Error error(e, ERROR_LOCATION);
+            if (!isConnectionTerminatedError(error) &&
+                e != boost::asio::error::operation_aborted)
+            {
+               LOG_ERROR(error);
+            }
+
+            pStream_->close();
+            return;
+         }
+
+         std::vector<websocket::Message> messages;
+         if (!webSocketParser_.parse(buffer_.data(),
+                                     buffer_.data() + bytesTransferred,
+                                     &messages))
+         {
+            close();
+            return;
+         }
+
+         for (std::vector<websocket::Message>::const_iterator
+                 it = messages.begin(); it != messages.end(); ++it)
+         {
+            switch (it->opcode)
+            {
+            case websocket::Text:
+            case websocket::Binary:
+               if (onWebSocketMessage_)
+                  onWebSocketMessage_(it->payload);
+               break;
+
+            case websocket::Ping:
+               pStream_->writeData(websocket::frame(websocket::Pong,
+                                                    it->payload));
+               break;
+
+            case websocket::Close:
+               close();
+               return;
+
+            default:
+               break;
+            }
+         }
+
+         readWebSocket();
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
 private:
-   typename ProtocolType::socket socket_;
+   boost::shared_ptr<HttpConnectionStream<ProtocolType> > pStream_;
    boost::array<char, 8192> buffer_ ;
    core::http::RequestParser requestParser_ ;
    core::http::Request request_;
    std::string requestId_;
+   boost::posix_time::ptime receivedTime_;
    Handler handler_;
+   std::size_t sequence_;
+   bool keepAlive_;
+   bool responded_;
+
+   // websocket state
+   bool webSocket_;
+   core::http::websocket::FrameParser webSocketParser_;
+   WebSocketMessageHandler onWebSocketMessage_;
 };
 
 } // namespace session
 
 #endif // SESSION_HTTP_CONNECTION_HPP
-
@@ -87,6 +87,10 @@ public:
       if (error)
          return error ;
 
+      // the listener may be restarted after a stop (e.g. when a parked
+      // session is resumed) so the io service needs resetting
+      ioService().reset();
+
       // initialize acceptor
       error = initializeAcceptor(&acceptorService_);
       if (error)
@@ -15,39 +15,87 @@
 
 #include <session/SessionHttpConnectionQueue.hpp>
 
+#include <boost/algorithm/string/predicate.hpp>
+
 #include <core/Log.hpp>
 #include <core/Error.hpp>
 #include <core/Thread.hpp>
 
 #include <core/http/Request.hpp>
 
+#include "SessionHttpConnectionUtils.hpp"
+
 using namespace core ;
 
 namespace session {
 
+namespace {
+
+HttpConnectionPriority connectionPriority(
+                           boost::shared_ptr<HttpConnection> ptrConnection)
+{
+   if (!boost::algorithm::starts_with(ptrConnection->request().uri(), "/rpc/"))
+      return ContentConnectionPriority;
+
+   if (connection::isMethod(ptrConnection, "interrupt") ||
+       connection::isMethod(ptrConnection, "console_input"))
+   {
+      return UrgentConnectionPriority;
+   }
+
+   return InteractiveConnectionPriority;
+}
+
+} // anonymous namespace
+
 void HttpConnectionQueue::enqueConnection(
-                              boost::shared_ptr<HttpConnection> ptrConnection)
+                              boost::shared_ptr<HttpConnection> ptrConnection,
+                              bool applyFilter)
 {
+   if (applyFilter && filter_ && filter_(ptrConnection))
+      return;
+
+   HttpConnectionPriority priority = connectionPriority(ptrConnection);
+
+   bool notify = false;
    LOCK_MUTEX(*pMutex_)
    {
       // enque
-      queue_.push(ptrConnection);
+      queues_[priority].push(ptrConnection);
+      notify = notifyRequired();
    }
    END_LOCK_MUTEX
 
-   pWaitCondition_->notify_all();
+   if (notify)
+      pWaitCondition_->notify_all();
+
+   if (onEnqueued_)
+      onEnqueued_();
 }
 
 
+// highest priority queue with a connection in it (NULL if there are none).
+// must be called with the mutex held
+std::queue<boost::shared_ptr<HttpConnection> >* HttpConnectionQueue::nextQueue()
+{
+   for (int i = 0; i < HttpConnectionPriorityCount; i++)
+   {
+      if (!queues_[i].empty())
+         return &queues_[i];
+   }
+   return NULL;
+}
+
 boost::shared_ptr<HttpConnection> HttpConnectionQueue::doDequeConnection()
 {
    LOCK_MUTEX(*pMutex_)
    {
-      if (!queue_.empty())
+      std::queue<boost::shared_ptr<HttpConnection> >* pQueue = nextQueue();
+      if (pQueue)
       {
          // remove it
-         boost::shared_ptr<HttpConnection> next = queue_.front();
-         queue_.pop();
+         boost::shared_ptr<HttpConnection> next = pQueue->front();
+         pQueue->pop();
 
          // return it
          return next;
@@ -91,8 +139,9 @@ std::string HttpConnectionQueue::peekNextConnectionUri()
 {
    LOCK_MUTEX(*pMutex_)
    {
-      if (!queue_.empty())
-         return queue_.front()->request().uri();
+      std::queue<boost::shared_ptr<HttpConnection> >* pQueue = nextQueue();
+      if (pQueue)
+         return pQueue->front()->request().uri();
       else
          return std::string();
    }
@@ -102,6 +151,32 @@ std::string HttpConnectionQueue::peekNextConnectionUri()
    return std::string();
 }
 
+void HttpConnectionQueue::notifyWaiters()
+{
+   LOCK_MUTEX(*pMutex_)
+   {
+      enqueGeneration_++;
+      notifiedGeneration_ = enqueGeneration_;
+   }
+   END_LOCK_MUTEX
+
+   pWaitCondition_->notify_all();
+}
+
+// must be called with the mutex held
+bool HttpConnectionQueue::notifyRequired()
+{
+   enqueGeneration_++;
+
+   // waiters which started waiting before the last notification have
+   // already been woken up
+   if (waiters_ == 0 || notifiedGeneration_ > waitGeneration_)
+      return false;
+
+   notifiedGeneration_ = enqueGeneration_;
+   return true;
+}
+
 bool HttpConnectionQueue::waitForConnection(
                      const boost::posix_time::time_duration& waitDuration)
 {
@@ -110,7 +185,24 @@ bool HttpConnectionQueue::waitForConnection(
    {
       unique_lock<mutex> lock(*pMutex_);
       system_time timeoutTime = get_system_time() + waitDuration;
-      return pWaitCondition_->timed_wait(lock, timeoutTime);
+
+      // a connection may have arrived since the caller last checked
+      if (nextQueue())
+         return true;
+
+      // wait until a connection is enqueued or we are explicitly woken
+      // (ignoring spurious wakeups)
+      unsigned long generation = enqueGeneration_;
+      waitGeneration_ = generation;
+      waiters_++;
+      while (enqueGeneration_ == generation)
+      {
+         if (!pWaitCondition_->timed_wait(lock, timeoutTime))
+            break;
+      }
+      waiters_--;
+
+      return enqueGeneration_ != generation;
    }
    catch(const thread_resource_error& e)
    {
@@ -27,11 +27,15 @@
 
 #include <core/http/Response.hpp>
 #include <core/http/Request.hpp>
+#include <core/http/WebSocket.hpp>
 
 #include <core/json/JsonRpc.hpp>
+#include <core/json/JsonCbor.hpp>
 
 #include <session/SessionOptions.hpp>
 #include <session/SessionConstants.hpp>
+#include <session/SessionClientEvent.hpp>
+#include <session/SessionModuleContext.hpp>
 
 
 
@@ -51,7 +55,8 @@ void HttpConnection::sendJsonRpcResponse()
 }
 
 void HttpConnection::sendJsonRpcResponse(
-                     const core::json::JsonRpcResponse& jsonRpcResponse)
+                     const core::json::JsonRpcResponse& jsonRpcResponse,
+                     std::size_t* pBodyBytes)
 {
    // setup response
    core::http::Response response ;
@@ -61,12 +66,52 @@ void HttpConnection::sendJsonRpcResponse(
       response.setContentEncoding(core::http::kGzipEncoding);
 
    // set response
-   core::json::setJsonRpcResponse(jsonRpcResponse, &response);
+   core::json::setJsonRpcResponse(jsonRpcResponse,
+                                  &response,
+                                  connection::responseEncoding(request()));
+   if (pBodyBytes)
+      *pBodyBytes = response.body().size();
 
    // send the response
    sendResponse(response);
 }
 
+void HttpConnection::sendJsonRpcBatchResponse(
+         const std::vector<core::json::JsonRpcResponse>& jsonRpcResponses,
+         std::size_t* pBodyBytes)
+{
+   core::http::Response response ;
+   if (request().acceptsEncoding(core::http::kGzipEncoding))
+      response.setContentEncoding(core::http::kGzipEncoding);
+   core::json::setJsonRpcBatchResponse(
+                                  jsonRpcResponses,
+                                  &response,
+                                  connection::responseEncoding(request()));
+   if (pBodyBytes)
+      *pBodyBytes = response.body().size();
+   sendResponse(response);
+}
+
+boost::posix_time::ptime HttpConnection::receivedTime() const
+{
+   return boost::posix_time::ptime();
+}
+
+bool HttpConnection::acceptWebSocket(const WebSocketMessageHandler&)
+{
+   return false;
+}
+
+core::Error HttpConnection::sendWebSocketMessage(const std::string&)
+{
+   return core::systemError(boost::system::errc::not_supported,
+                            ERROR_LOCATION);
+}
+
+bool HttpConnection::isWebSocketOpen()
+{
+   return false;
+}
 
 
 namespace connection {
@@ -84,10 +129,33 @@ bool isMethod(boost::shared_ptr<HttpConnection> ptrConnection,
                                       "rpc/" + method);
 }
 
+core::json::Encoding requestEncoding(const core::http::Request& request)
+{
+   return boost::algorithm::starts_with(request.headerValue("Content-Type"),
+                                        core::json::kCborContentType)
+             ? core::json::CborEncoding
+             : core::json::JsonEncoding;
+}
+
+core::json::Encoding responseEncoding(const core::http::Request& request)
+{
+   return request.acceptsContentType(core::json::kCborContentType)
+             ? core::json::CborEncoding
+             : core::json::JsonEncoding;
+}
+
 bool isGetEvents(boost::shared_ptr<HttpConnection> ptrConnection)
 {
    return boost::algorithm::ends_with(ptrConnection->request().uri(),
-                                      "events/get_events");
+                                      "events/get_events") ||
+          isEventStream(ptrConnection);
+}
+
+bool isEventStream(boost::shared_ptr<HttpConnection> ptrConnection)
+{
+   const core::http::Request& request = ptrConnection->request();
+   return boost::algorithm::starts_with(request.uri(), kEventStreamUri) &&
+          core::http::websocket::isUpgradeRequest(request);
 }
 
 void handleAbortNextProjParam(
@@ -96,8 +164,9 @@ void handleAbortNextProjParam(
    std::string nextProj;
    core::json::JsonRpcRequest jsonRpcRequest;
    core::Error error = core::json::parseJsonRpcRequest(
-                                         ptrConnection->request().body(),
-                                         &jsonRpcRequest);
+                                 ptrConnection->request().body(),
+                                 &jsonRpcRequest,
+                                 requestEncoding(ptrConnection->request()));
    if (!error)
    {
       error = core::json::readParam(jsonRpcRequest.params, 0, &nextProj);
@@ -184,6 +253,27 @@ bool authenticate(boost::shared_ptr<HttpConnection> ptrConnection,
    return secret == ptrConnection->request().headerValue("X-Shared-Secret");
 }
 
+core::FilePath uploadSpoolPath()
+{
+   return session::options().userScratchPath().complete("upload-spool");
+}
+
+void onUploadProgress(const core::http::Request& request,
+                      std::size_t bytesRead,
+                      std::size_t totalBytes)
+{
+   if (!boost::algorithm::starts_with(request.uri(), "/upload"))
+      return;
+
+   core::json::Object progressJson;
+   progressJson["bytes_read"] = static_cast<double>(bytesRead);
+   progressJson["total_bytes"] = static_cast<double>(totalBytes);
+
+   // the client event queue is safe to add to from any thread
+   module_context::enqueClientEvent(
+            ClientEvent(client_events::kUploadProgress, progressJson));
+}
+
 } // namespace connection
 } // namespace session
 
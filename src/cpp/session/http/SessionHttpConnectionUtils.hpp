@@ -22,7 +22,10 @@
 
 #include <boost/function.hpp>
 
+#include <core/json/Json.hpp>
+
 namespace core {
+   class FilePath;
 namespace http {
    class Request;
 }
@@ -36,9 +39,18 @@ std::string rstudioRequestIdFromRequest(const core::http::Request& request);
 bool isMethod(boost::shared_ptr<HttpConnection> ptrConnection,
               const std::string& method);
 
+// clients which opt in to cbor (advertised by client_init) send requests
+// with a cbor content type and/or accept cbor responses. everything else
+// is json
+core::json::Encoding requestEncoding(const core::http::Request& request);
+core::json::Encoding responseEncoding(const core::http::Request& request);
+
 
+// get_events requests and event stream (websocket) connections
 bool isGetEvents(boost::shared_ptr<HttpConnection> ptrConnection);
 
+bool isEventStream(boost::shared_ptr<HttpConnection> ptrConnection);
+
 void handleAbortNextProjParam(
                boost::shared_ptr<HttpConnection> ptrConnection);
 
@@ -50,6 +62,16 @@ bool authenticate(boost::shared_ptr<HttpConnection> ptrConnection,
                   const std::string& secret);
 
 
+// multipart uploads are spooled to disk as they are read (with progress
+// reported to the client). the progress handler is called on the thread
+// reading the request
+core::FilePath uploadSpoolPath();
+
+void onUploadProgress(const core::http::Request& request,
+                      std::size_t bytesRead,
+                      std::size_t totalBytes);
+
+
 } // namespace connection
 } // namespace session
 
@@ -18,17 +18,23 @@
 // Necessary to avoid compile error on Win x64
 #include <winsock2.h>
 
+#include <algorithm>
 #include <string>
 
+#include <boost/array.hpp>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
 #include <boost/utility.hpp>
 #include <boost/format.hpp>
 #include <boost/algorithm/string/predicate.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/asio/buffer.hpp>
 
 #include <core/Log.hpp>
 #include <core/Error.hpp>
 #include <core/Thread.hpp>
 
+#include <core/http/FileBody.hpp>
 #include <core/http/Request.hpp>
 #include <core/http/Response.hpp>
 #include <core/http/RequestParser.hpp>
@@ -64,12 +70,21 @@ using namespace core ;
 
 namespace session {
 
+// called with the pipe (and any bytes already read beyond the end of the
+// request) once a response has been written over a kept-alive connection
+typedef boost::function<void(HANDLE, const std::string&)> KeepAliveHandler;
+
 class NamedPipeHttpConnection : public HttpConnection,
                                 boost::noncopyable
 {
 public:
-   explicit NamedPipeHttpConnection(HANDLE hPipe)
-      : hPipe_(hPipe)
+   NamedPipeHttpConnection(HANDLE hPipe,
+                           const std::string& pending,
+                           const KeepAliveHandler& onKeepAlive)
+      : hPipe_(hPipe),
+        pending_(pending),
+        onKeepAlive_(onKeepAlive),
+        keepAlive_(false)
    {
    }
 
@@ -88,10 +103,26 @@ public:
       CHAR buff[kReadBufferSize];
       DWORD bytesRead;
 
+      // start with anything left over from the previous request (clients
+      // may pipeline requests over a kept-alive connection)
+      std::string pending;
+      pending.swap(pending_);
+
       while(TRUE)
       {
          // read from pipe
-         BOOL result = ::ReadFile(hPipe_, buff, kReadBufferSize, &bytesRead, NULL);
+         BOOL result = TRUE;
+         if (!pending.empty())
+         {
+            bytesRead = static_cast<DWORD>(
+                  std::min(pending.size(), std::size_t(kReadBufferSize)));
+            std::copy(pending.begin(), pending.begin() + bytesRead, buff);
+            pending.erase(0, bytesRead);
+         }
+         else
+         {
+            result = ::ReadFile(hPipe_, buff, kReadBufferSize, &bytesRead, NULL);
+         }
 
          // check for error
          if (!result)
@@ -122,10 +153,12 @@ public:
          else
          {
             // parse next chunk
+            CHAR* next = buff + bytesRead;
             http::RequestParser::status status = parser.parse(
                                                    request_,
                                                    buff,
-                                                   buff + bytesRead);
+                                                   buff + bytesRead,
+                                                   &next);
 
             // error - return bad request
             if (status == core::http::RequestParser::error)
@@ -147,6 +180,17 @@ public:
             else
             {
                requestId_ = request_.headerValue("X-RS-RID");
+               receivedTime_ =
+                     boost::posix_time::microsec_clock::universal_time();
+
+               // note whether the client wants to keep the connection
+               // alive (and save what we read of the next request)
+               keepAlive_ = !request_.isHttp10() &&
+                            boost::algorithm::iequals(
+                                 request_.headerValue("Connection"),
+                                 "keep-alive");
+               pending_.assign(next, buff + bytesRead);
+               pending_.append(pending);
                return true;
             }
          }
@@ -160,37 +204,76 @@ public:
 
    virtual void sendResponse(const core::http::Response &response)
    {
+      // the connection can only be kept alive if the client asked for it
+      // and the response can be delimited by its content length
+      bool keepAlive = keepAlive_ &&
+                       onKeepAlive_ &&
+                       !response.hasStreamBody() &&
+                       response.containsHeader("Content-Length");
+
       // get the buffers
       std::vector<boost::asio::const_buffer> buffers =response.toBuffers(
-                                        core::http::Header::connectionClose());
+                  keepAlive ? core::http::Header("Connection", "keep-alive") :
+                              core::http::Header::connectionClose());
 
       // write them
-      DWORD bytesWritten;
       for (std::size_t i=0; i<buffers.size(); i++)
       {
-         DWORD bytesToWrite = boost::asio::buffer_size(buffers[i]);
-         BOOL success = ::WriteFile(
-                  hPipe_,
-                  boost::asio::buffer_cast<const unsigned char*>(buffers[i]),
-                  bytesToWrite,
-                  &bytesWritten,
-                  NULL);
-
-         if (!success || (bytesWritten != bytesToWrite))
+         if (!write(boost::asio::buffer_cast<const char*>(buffers[i]),
+                    boost::asio::buffer_size(buffers[i])))
          {
-            // establish error
-            Error error = systemError(::GetLastError(), ERROR_LOCATION);
-            error.addProperty("request-uri", request_.uri());
+            return;
+         }
+      }
 
-            // log the error if it wasn't connection terminated
-            if (!core::http::isConnectionTerminatedError(error))
-               LOG_ERROR(error);
+      // send file bodies directly from disk
+      if (response.hasFileBody())
+      {
+         core::http::FileBodyReader reader(response);
+         Error error = reader.open();
+         boost::array<char, 65536> buffer;
+         while (!error)
+         {
+            std::size_t bytesRead;
+            error = reader.read(buffer.data(), buffer.size(), &bytesRead);
+            if (error || bytesRead == 0)
+               break;
+
+            if (!write(buffer.data(), bytesRead))
+               return;
+         }
 
-            // close and terminate
+         if (error)
+         {
+            error.addProperty("request-uri", request_.uri());
+            LOG_ERROR(error);
+            close();
+         }
+      }
+
+      // streamed bodies are generated as they are written (the pipe is
+      // closed once the response has been written so this ends the body)
+      else if (response.hasStreamBody())
+      {
+         Error error = response.streamBodyWriter()(boost::bind(
+                        &NamedPipeHttpConnection::writeStreamData,
+                        this, _1, _2));
+         if (error && hPipe_ != INVALID_HANDLE_VALUE)
+         {
+            error.addProperty("request-uri", request_.uri());
+            LOG_ERROR(error);
             close();
-            break;
          }
       }
+
+      // hand the pipe back to the listener to read the next request (it is
+      // no longer ours to close)
+      if (keepAlive && hPipe_ != INVALID_HANDLE_VALUE)
+      {
+         HANDLE hPipe = hPipe_;
+         hPipe_ = INVALID_HANDLE_VALUE;
+         onKeepAlive_(hPipe, pending_);
+      }
    }
 
    // close (occurs automatically after writeResponse, here in case it
@@ -215,11 +298,58 @@ public:
    // other useful introspection methods
    virtual std::string requestId() const { return requestId_; }
 
+   virtual boost::posix_time::ptime receivedTime() const
+   {
+      return receivedTime_;
+   }
+
+
+private:
+   // write to the pipe (closes it and returns false on error)
+   bool write(const char* data, std::size_t size)
+   {
+      DWORD bytesWritten;
+      DWORD bytesToWrite = static_cast<DWORD>(size);
+      BOOL success = ::WriteFile(hPipe_,
+                                 data,
+                                 bytesToWrite,
+                                 &bytesWritten,
+                                 NULL);
+
+      if (!success || (bytesWritten != bytesToWrite))
+      {
+         // establish error
+         Error error = systemError(::GetLastError(), ERROR_LOCATION);
+         error.addProperty("request-uri", request_.uri());
+
+         // log the error if it wasn't connection terminated
+         if (!core::http::isConnectionTerminatedError(error))
+            LOG_ERROR(error);
+
+         // close and terminate
+         close();
+         return false;
+      }
+
+      return true;
+   }
+
+   Error writeStreamData(const char* data, std::size_t size)
+   {
+      // (write logs its own errors)
+      if (!write(data, size))
+         return systemError(boost::system::errc::broken_pipe, ERROR_LOCATION);
+      return Success();
+   }
 
 private:
    HANDLE hPipe_;
+   std::string pending_;
+   KeepAliveHandler onKeepAlive_;
+   bool keepAlive_;
    core::http::Request request_;
    std::string requestId_;
+   boost::posix_time::ptime receivedTime_;
 };
 
 
@@ -227,18 +357,23 @@ class NamedPipeHttpConnectionListener : public HttpConnectionListener,
                                         boost::noncopyable
 {
 public:
-   explicit NamedPipeHttpConnectionListener(const std::string& pipeName,
-                                            const std::string& secret)
-      : pipeName_(pipeName), secret_(secret)
+   NamedPipeHttpConnectionListener(const std::string& pipeName,
+                                   const std::string& secret,
+                                   int instances)
+      : pipeName_(pipeName),
+        secret_(secret),
+        instances_(std::max(1, instances))
    {
    }
 
 
    virtual Error start()
    {
-      core::thread::safeLaunchThread(
-         boost::bind(&NamedPipeHttpConnectionListener::listenerThread,
-                     this));
+      // create a pool of pipe instances waiting for clients (so that a
+      // client connecting doesn't have to wait for an instance to be
+      // created after the previous client connected)
+      for (int i = 0; i < instances_; i++)
+         launchInstance();
 
       return Success();
    }
@@ -262,52 +397,69 @@ public:
 
 
 private:
-   void listenerThread()
+   void launchInstance()
+   {
+      core::thread::safeLaunchThread(
+         boost::bind(&NamedPipeHttpConnectionListener::instanceThread,
+                     this));
+   }
+
+   HANDLE createPipeInstance()
+   {
+      // create security attributes
+      PSECURITY_ATTRIBUTES pSA = NULL;
+      SECURITY_ATTRIBUTES sa;
+      ZeroMemory(&sa, sizeof(sa));
+      sa.nLength = sizeof(sa);
+      sa.lpSecurityDescriptor = NULL;
+      sa.bInheritHandle = FALSE;
+
+      // get login session only descriptor -- proceed without one
+      // if we fail since we don't have 100% assurance this will
+      // work in all configurations and the world ends if we don't
+      // proceed with creating the pipe
+      sa.lpSecurityDescriptor = pipeServerSecurityDescriptor();
+      if (sa.lpSecurityDescriptor)
+         pSA = &sa;
+
+      // set pipe mode, specify rejection of remote clients if >= vista
+      DWORD dwPipeMode = PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT;
+      if (core::system::isVistaOrLater())
+          dwPipeMode |= PIPE_REJECT_REMOTE_CLIENTS;
+
+      // create pipe
+      HANDLE hPipe = ::CreateNamedPipeA(pipeName_.c_str(),
+                                        PIPE_ACCESS_DUPLEX,
+                                        dwPipeMode,
+                                        PIPE_UNLIMITED_INSTANCES,
+                                        kReadBufferSize,
+                                        kReadBufferSize,
+                                        0,
+                                        pSA);
+      DWORD lastError = ::GetLastError(); // capture err before LocalFree
+
+      // free security descriptor if we used one
+      if (pSA)
+         ::LocalFree(pSA->lpSecurityDescriptor);
+
+      // check for error
+      if (hPipe == INVALID_HANDLE_VALUE)
+         LOG_ERROR(systemError(lastError, ERROR_LOCATION));
+
+      return hPipe;
+   }
+
+   // wait for a client to connect to a new pipe instance then serve it
+   void instanceThread()
    {
       try
       {
          while (true)
          {
-            // create security attributes
-            PSECURITY_ATTRIBUTES pSA = NULL;
-            SECURITY_ATTRIBUTES sa;
-            ZeroMemory(&sa, sizeof(sa));
-            sa.nLength = sizeof(sa);
-            sa.lpSecurityDescriptor = NULL;
-            sa.bInheritHandle = FALSE;
-
-            // get login session only descriptor -- proceed without one
-            // if we fail since we don't have 100% assurance this will
-            // work in all configurations and the world ends if we don't
-            // proceed with creating the pipe
-            sa.lpSecurityDescriptor = pipeServerSecurityDescriptor();
-            if (sa.lpSecurityDescriptor)
-               pSA = &sa;
-
-            // set pipe mode, specify rejection of remote clients if >= vista
-            DWORD dwPipeMode = PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT;
-            if (core::system::isVistaOrLater())
-                dwPipeMode |= PIPE_REJECT_REMOTE_CLIENTS;
-
-            // create pipe
-            HANDLE hPipe = ::CreateNamedPipeA(pipeName_.c_str(),
-                                              PIPE_ACCESS_DUPLEX,
-                                              dwPipeMode,
-                                              PIPE_UNLIMITED_INSTANCES,
-                                              kReadBufferSize,
-                                              kReadBufferSize,
-                                              0,
-                                              pSA);
-            DWORD lastError = ::GetLastError(); // capture err before LocalFree
-
-            // free security descriptor if we used one
-            if (pSA)
-               ::LocalFree(pSA->lpSecurityDescriptor);
-
-            // check for error
+            HANDLE hPipe = createPipeInstance();
             if (hPipe == INVALID_HANDLE_VALUE)
             {
-               LOG_ERROR(systemError(lastError, ERROR_LOCATION));
+               boost::this_thread::sleep(boost::posix_time::seconds(1));
                continue;
             }
 
@@ -317,23 +469,57 @@ private:
 
             if (connected)
             {
-               // create connection
-               boost::shared_ptr<NamedPipeHttpConnection> ptrPipeConnection(
-                                         new NamedPipeHttpConnection(hPipe));
-
-               // if we can successfully read a request then enque it
-               if (ptrPipeConnection->readRequest())
-                  enqueConnection(ptrPipeConnection);
+               // replace this instance in the pool then serve the client
+               launchInstance();
+               serveClient(hPipe, std::string());
+               return;
             }
             else
             {
                LOG_ERROR(systemError(::GetLastError(), ERROR_LOCATION));
+               ::CloseHandle(hPipe);
             }
          }
       }
       CATCH_UNEXPECTED_EXCEPTION
    }
 
+   // read the next request from a connected pipe (the connection closes
+   // the pipe unless the client keeps it alive, in which case we are
+   // called again once the response has been written)
+   void serveClient(HANDLE hPipe, const std::string& pending)
+   {
+      // create connection
+      boost::shared_ptr<NamedPipeHttpConnection> ptrPipeConnection(
+           new NamedPipeHttpConnection(
+                 hPipe,
+                 pending,
+                 boost::bind(&NamedPipeHttpConnectionListener::onKeepAlive,
+                             this, _1, _2)));
+
+      // if we can successfully read a request then enque it
+      if (ptrPipeConnection->readRequest())
+         enqueConnection(ptrPipeConnection);
+   }
+
+   // NOTE: called on the thread which wrote the response (typically the
+   // main thread) so we read the next request on another thread
+   void onKeepAlive(HANDLE hPipe, const std::string& pending)
+   {
+      core::thread::safeLaunchThread(
+         boost::bind(&NamedPipeHttpConnectionListener::serveClientThread,
+                     this, hPipe, pending));
+   }
+
+   void serveClientThread(HANDLE hPipe, const std::string& pending)
+   {
+      try
+      {
+         serveClient(hPipe, pending);
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
    // NOTE: this logic is duplicated btw here and HttpConnectionListenerImpl
 
    void enqueConnection(
@@ -474,6 +660,7 @@ private:
 private:
    std::string pipeName_;
    std::string secret_;
+   int instances_;
    HttpConnectionQueue mainConnectionQueue_;
    HttpConnectionQueue eventsConnectionQueue_;
 };
@@ -41,8 +41,10 @@ void initializeHttpConnectionListener()
    session::Options& options = session::options();
    std::string pipeName = core::system::getenv("RS_LOCAL_PEER");
    std::string secret = options.sharedSecret();
-   s_pHttpConnectionListener = new NamedPipeHttpConnectionListener(pipeName,
-                                                                   secret);
+   s_pHttpConnectionListener = new NamedPipeHttpConnectionListener(
+                                                pipeName,
+                                                secret,
+                                                options.namedPipeInstances());
 }
 
 HttpConnectionListener& httpConnectionListener()
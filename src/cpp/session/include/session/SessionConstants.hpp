@@ -17,6 +17,7 @@
 #define SESSION_CONSTANTS_HPP
 
 #define kEventsPending                    "ep"
+#define kEventStreamUri                   "/event_stream"
 
 #define kRStudioUserIdentity              "RSTUDIO_USER_IDENTITY"
 #define kRStudioLimitRpcClientUid         "RSTUDIO_LIMIT_RPC_CLIENT_UID"
@@ -33,6 +34,17 @@
 
 #define kTimeoutSessionOption             "session-timeout-minutes"
 
+#define kReposIndexDirSessionOption       "session-repos-index-dir"
+
+#define kResidentProjectsSessionOption    "session-resident-projects"
+
+#define kZygoteSessionOption              "session-zygote"
+#define kZygoteProjectSessionOption       "session-zygote-project"
+
+// process name used by sessions parked after a project switch (rserver
+// treats these as the first candidates for suspension)
+#define kParkedSessionProcessName         "rsession-park"
+
 // NOTE: literal versions of these are depended upon by the desktop/rsinverse
 // project so they should be updated there as well if they are changed
 #define kLocalUriLocationPrefix           "/rsession-local/"
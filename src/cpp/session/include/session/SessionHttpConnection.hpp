@@ -17,9 +17,11 @@
 #define SESSION_HTTP_CONNECTION_HPP
 
 #include <string>
+#include <vector>
 
 #include <boost/shared_ptr.hpp>
 #include <boost/function.hpp>
+#include <boost/date_time/posix_time/ptime.hpp>
 
 /*
  HttpConnection plays two related roles in the system:
@@ -61,8 +63,13 @@ public:
 
    void sendJsonRpcError(const core::Error& error);
    void sendJsonRpcResponse();
+   // (optionally returning the size of the response body sent)
    void sendJsonRpcResponse(
-                  const core::json::JsonRpcResponse& jsonRpcResponse);
+                  const core::json::JsonRpcResponse& jsonRpcResponse,
+                  std::size_t* pBodyBytes = NULL);
+   void sendJsonRpcBatchResponse(
+                  const std::vector<core::json::JsonRpcResponse>& responses,
+                  std::size_t* pBodyBytes = NULL);
 
 
    // close (occurs automatically after writeResponse, here in case it
@@ -71,6 +78,20 @@ public:
 
    // other useful introspection methods
    virtual std::string requestId() const = 0;
+
+   // time at which the request was fully read (not_a_date_time if the
+   // connection doesn't track it)
+   virtual boost::posix_time::ptime receivedTime() const;
+
+   // websocket support (for requests which asked to upgrade to one).
+   // accepting writes the handshake response and then begins reading
+   // messages from the client, which are passed to the handler on the
+   // listener's background thread. messages are sent synchronously.
+   // connections which can't support websockets decline to accept them
+   typedef boost::function<void(const std::string&)> WebSocketMessageHandler;
+   virtual bool acceptWebSocket(const WebSocketMessageHandler& onMessage);
+   virtual core::Error sendWebSocketMessage(const std::string& message);
+   virtual bool isWebSocketOpen();
 };
 
 
@@ -21,6 +21,7 @@
 #include <boost/shared_ptr.hpp>
 
 #include <boost/utility.hpp>
+#include <boost/function.hpp>
 
 #include <core/BoostThread.hpp>
 
@@ -32,16 +33,34 @@ namespace core {
 
 namespace session {
 
+// connections are dequeued in priority order (and in the order they
+// arrived within a priority) so that interactive requests never wait
+// behind bulk content
+enum HttpConnectionPriority
+{
+   UrgentConnectionPriority = 0,       // interrupt and console input
+   InteractiveConnectionPriority = 1,  // other rpcs
+   ContentConnectionPriority = 2,      // everything else
+   HttpConnectionPriorityCount = 3
+};
+
 class HttpConnectionQueue : boost::noncopyable
 {
 public:
    HttpConnectionQueue()
       : pMutex_(new boost::mutex()),
-        pWaitCondition_(new boost::condition())
+        pWaitCondition_(new boost::condition()),
+        enqueGeneration_(0),
+        waitGeneration_(0),
+        notifiedGeneration_(0),
+        waiters_(0)
    {
    }
 
-   void enqueConnection(boost::shared_ptr<HttpConnection> ptrConnection);
+   // enque a connection (applyFilter = false bypasses the connection
+   // filter, e.g. for a connection which the filter's handler declined)
+   void enqueConnection(boost::shared_ptr<HttpConnection> ptrConnection,
+                        bool applyFilter = true);
 
    boost::shared_ptr<HttpConnection> dequeConnection();
 
@@ -50,8 +69,31 @@ public:
 
    std::string peekNextConnectionUri();
 
+   // wake up anyone waiting for a connection (e.g. so they can attend to
+   // other work such as pending child process output)
+   void notifyWaiters();
+
+   // handler called (on the enqueing thread) after a connection is
+   // enqueued. must be set before any connections are enqueued
+   void setOnEnqueued(const boost::function<void()>& onEnqueued)
+   {
+      onEnqueued_ = onEnqueued;
+   }
+
+   // filter called (on the enqueing thread) before a connection is
+   // enqueued. connections for which the filter returns true have been
+   // handled by it and are not enqueued. must be set before any
+   // connections are enqueued
+   void setConnectionFilter(
+      const boost::function<bool(boost::shared_ptr<HttpConnection>)>& filter)
+   {
+      filter_ = filter;
+   }
+
 private:
+   std::queue<boost::shared_ptr<HttpConnection> >* nextQueue();
    boost::shared_ptr<HttpConnection> doDequeConnection();
+   bool notifyRequired();
    bool waitForConnection(const boost::posix_time::time_duration& waitDuration);
 
 private:
@@ -64,7 +106,18 @@ private:
    boost::condition* pWaitCondition_ ;
 
    // instance data
-   std::queue<boost::shared_ptr<HttpConnection> > queue_;
+   std::queue<boost::shared_ptr<HttpConnection> >
+                                       queues_[HttpConnectionPriorityCount];
+   boost::function<void()> onEnqueued_;
+
+   // waiters are only notified once per wait (and not at all if nobody
+   // is waiting)
+   unsigned long enqueGeneration_;
+   unsigned long waitGeneration_;
+   unsigned long notifiedGeneration_;
+   std::size_t waiters_;
+
+   boost::function<bool(boost::shared_ptr<HttpConnection>)> filter_;
 };
 
 } // namespace session
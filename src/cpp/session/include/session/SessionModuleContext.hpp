@@ -16,6 +16,7 @@
 #ifndef SESSION_MODULE_CONTEXT_HPP
 #define SESSION_MODULE_CONTEXT_HPP
 
+#include <map>
 #include <string>
 
 #include <boost/utility.hpp>
@@ -45,6 +46,9 @@ namespace core {
    namespace shell_utils {
       class ShellCommand;
    }
+   namespace thread {
+      class ThreadPool;
+   }
 }
 
 namespace session {   
@@ -134,6 +138,28 @@ core::Error registerAsyncRpcMethod(
 core::Error registerRpcMethod(const std::string& name,
                               const core::json::JsonRpcFunction& function);
 
+// register an rpc method which doesn't use R (or anything else which isn't
+// threadsafe). these methods are executed on background threads so that
+// they remain responsive while R is busy. note that changes are not
+// detected after they execute
+core::Error registerRFreeRpcMethod(const std::string& name,
+                                   const core::json::JsonRpcFunction& function);
+
+// register an rpc method which can handle some (but not all) requests
+// without R. requests for which canHandle returns false (it is called on
+// a background thread) are executed on the main thread instead
+typedef boost::function<bool(const core::json::JsonRpcRequest&)>
+                                                      RFreeRpcPredicate;
+core::Error registerConditionalRFreeRpcMethod(
+                                 const std::string& name,
+                                 const core::json::JsonRpcFunction& function,
+                                 const RFreeRpcPredicate& canHandle);
+
+
+// is the next request waiting to be handled by the main thread a call to
+// the specified rpc method? (handlers can use this to skip work which the
+// next request supersedes)
+bool isNextRpcMethod(const std::string& name);
 
 core::Error executeAsync(const core::json::JsonRpcFunction& function,
                          const core::json::JsonRpcRequest& request,
@@ -233,6 +259,17 @@ core::Error executeInterruptableChild(const std::string& path,
 // ProcessSupervisor
 core::system::ProcessSupervisor& processSupervisor();
 
+// priority of scheduled work. background processing runs scheduled work
+// within a fixed time budget per pass: higher priority work runs first
+// and work of the same priority is run round-robin (work which didn't
+// get to run in one pass runs first in the next pass)
+enum WorkPriority
+{
+   WorkPriorityLow = 0,
+   WorkPriorityNormal = 1,
+   WorkPriorityHigh = 2
+};
+
 // schedule incremental work. execute will be called back periodically
 // (up to every 25ms if the process is completely idle). if execute
 // returns true then it will be called back again, if it returns false
@@ -247,7 +284,8 @@ core::system::ProcessSupervisor& processSupervisor();
 void scheduleIncrementalWork(
          const boost::posix_time::time_duration& incrementalDuration,
          const boost::function<bool()>& execute,
-         bool idleOnly = true);
+         bool idleOnly = true,
+         WorkPriority priority = WorkPriorityNormal);
 
 // variation of scheduleIncrementalWork which performs a configurable
 // amount of work immediately. this work occurs synchronously with the
@@ -257,7 +295,8 @@ void scheduleIncrementalWork(
          const boost::posix_time::time_duration& initialDuration,
          const boost::posix_time::time_duration& incrementalDuration,
          const boost::function<bool()>& execute,
-         bool idleOnly = true);
+         bool idleOnly = true,
+         WorkPriority priority = WorkPriorityNormal);
 
 
 // schedule work to done every time the specified period elapses.
@@ -267,13 +306,46 @@ void scheduleIncrementalWork(
 void schedulePeriodicWork(const boost::posix_time::time_duration& period,
                           const boost::function<bool()> &execute,
                           bool idleOnly = true,
-                          bool immediate = true);
+                          bool immediate = true,
+                          WorkPriority priority = WorkPriorityNormal);
 
 
 // schedule work to be done after a fixed delay
 void scheduleDelayedWork(const boost::posix_time::time_duration& period,
                          const boost::function<void()> &execute,
-                         bool idleOnly = true);
+                         bool idleOnly = true,
+                         WorkPriority priority = WorkPriorityNormal);
+
+// execute work on the shared pool of background threads (the work must not
+// touch R or any other main thread state). if provided, onCompleted is
+// called back on the main thread (during background processing) once the
+// work has executed. to return results from the work bind both functions
+// to a shared_ptr which holds them
+void executeInBackground(
+      const boost::function<void()>& work,
+      const boost::function<void()>& onCompleted = boost::function<void()>());
+
+// the shared pool of background threads itself (for core algorithms which
+// split their work across a pool, e.g. collectFileChangeEvents)
+core::thread::ThreadPool& backgroundThreadPool();
+
+// memory accounting for memory held outside of R. subsystems register a
+// function which returns the (approximate) bytes they hold and optionally
+// one which drops whatever they can cheaply rebuild on demand (called
+// once the session has been idle for a while). usage functions are called
+// on the main thread and should be cheap (e.g. sums over containers)
+typedef boost::function<std::size_t()> MemoryUsageFunction;
+typedef boost::function<void()> ReleaseMemoryFunction;
+void registerMemoryUsage(const std::string& subsystem,
+                         const MemoryUsageFunction& usageFunction,
+                         const ReleaseMemoryFunction& releaseFunction =
+                                                   ReleaseMemoryFunction());
+
+// bytes held by each subsystem
+std::map<std::string,std::size_t> memoryUsage();
+
+// drop rebuildable caches then return free heap to the operating system
+void releaseMemory();
 
 
 core::Error readAndDecodeFile(const core::FilePath& filePath,
@@ -329,6 +401,8 @@ void showFile(const core::FilePath& filePath,
 
 void showContent(const std::string& title, const core::FilePath& filePath);
 
+// contents of a file within the resources directory (files are read once
+// and then cached for the life of the process)
 std::string resourceFileAsString(const std::string& fileName);
 
 void activatePane(const std::string& pane);
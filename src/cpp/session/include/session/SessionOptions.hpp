@@ -106,6 +106,21 @@ public:
       return std::string(wwwPort_.c_str());
    }
 
+   int wwwCompressionLevel() const
+   {
+      return wwwCompressionLevel_;
+   }
+
+   int wwwCompressionMinSize() const
+   {
+      return wwwCompressionMinSize_;
+   }
+
+   bool wwwCompressionPrecompressed() const
+   {
+      return wwwCompressionPrecompressed_;
+   }
+
    std::string sharedSecret() const
    {
       return std::string(secret_.c_str());
@@ -122,6 +137,33 @@ public:
 
    bool rProfileOnResumeDefault() const { return rProfileOnResumeDefault_; }
 
+   std::string fileMonitorBackend() const
+   {
+      return std::string(fileMonitorBackend_.c_str());
+   }
+
+   bool sharedFileMonitor() const { return sharedFileMonitor_; }
+
+   int rpcSlowCallMs() const { return rpcSlowCallMs_; }
+
+   int namedPipeInstances() const { return namedPipeInstances_; }
+
+   core::FilePath reposIndexDir() const
+   {
+      return core::FilePath(reposIndexDir_.c_str());
+   }
+
+   int residentProjects() const { return residentProjects_; }
+
+   bool restartZygote() const { return restartZygote_; }
+
+   bool zygote() const { return zygote_; }
+
+   core::FilePath zygoteProject() const
+   {
+      return core::FilePath(zygoteProject_.c_str());
+   }
+
    unsigned int minimumUserId() const { return 100; }
    
    core::FilePath coreRSourcePath() const 
@@ -183,6 +225,8 @@ public:
    int limitRpcClientUid() const { return limitRpcClientUid_; }
 
    bool limitXfsDiskQuota() const { return limitXfsDiskQuota_; }
+
+   int limitConsoleOutputKb() const { return limitConsoleOutputKb_; }
    
    // external
    core::FilePath rpostbackPath() const
@@ -310,6 +354,9 @@ private:
    // www
    std::string wwwLocalPath_;
    std::string wwwPort_;
+   int wwwCompressionLevel_;
+   int wwwCompressionMinSize_;
+   bool wwwCompressionPrecompressed_;
 
    // session
    std::string secret_;
@@ -317,6 +364,15 @@ private:
    int timeoutMinutes_;
    bool createPublicFolder_;
    bool rProfileOnResumeDefault_;
+   std::string fileMonitorBackend_;
+   bool sharedFileMonitor_;
+   int rpcSlowCallMs_;
+   int namedPipeInstances_;
+   std::string reposIndexDir_;
+   int residentProjects_;
+   bool restartZygote_;
+   bool zygote_;
+   std::string zygoteProject_;
 
    // r
    std::string coreRSourcePath_;
@@ -336,6 +392,7 @@ private:
    int limitCpuTimeMinutes_;
    int limitRpcClientUid_;
    bool limitXfsDiskQuota_;
+   int limitConsoleOutputKb_;
    
    // external
    std::string rpostbackPath_;
@@ -0,0 +1,51 @@
+/*
+ * SessionRestartZygote.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SESSION_RESTART_ZYGOTE_HPP
+#define SESSION_RESTART_ZYGOTE_HPP
+
+namespace core {
+   class Error;
+}
+
+namespace session {
+namespace restart_zygote {
+
+// A server session can keep a "zygote" ready to take over when the user
+// restarts R: a copy of rsession (launched with the session's original
+// arguments and environment) which starts R and loads the session tools
+// and then waits, without a listener and before any session state or user
+// code is loaded. On restart the session saves its state as usual and then
+// hands its listener over to the zygote, which restores the state and
+// carries on as the session (launching a zygote of its own).
+
+// record the arguments and environment the session was launched with
+void initialize(int argc, char * const argv[]);
+
+// launch a zygote for this session (if enabled and not already running)
+core::Error launch();
+
+// wait (as a zygote) for the session to restart. returns true once we
+// have taken over from it and false if the session went away instead
+bool waitForRestart();
+
+// hand over to the zygote (the restart state must already be saved and
+// our listener stopped). returns true if the zygote took over
+bool handOff();
+
+} // namespace restart_zygote
+} // namespace session
+
+#endif // SESSION_RESTART_ZYGOTE_HPP
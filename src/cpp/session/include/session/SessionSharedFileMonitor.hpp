@@ -0,0 +1,53 @@
+/*
+ * SessionSharedFileMonitor.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SESSION_SHARED_FILE_MONITOR_HPP
+#define SESSION_SHARED_FILE_MONITOR_HPP
+
+#include <boost/function.hpp>
+
+#include <core/FileInfo.hpp>
+#include <core/system/FileMonitor.hpp>
+
+namespace core {
+   class Error;
+   class FilePath;
+}
+
+namespace session {
+namespace shared_file_monitor {
+
+// Sessions for the same user can share file monitors. The first session to
+// initialize hosts a local stream server through which the user's other
+// sessions subscribe to its monitors, so each directory is only watched
+// (and scanned) once per user. Subscribers poll the host for events and if
+// the host goes away they re-register (at which point one of them becomes
+// the new host). Callbacks have the same semantics as they do for
+// core::system::file_monitor and are called on the main thread. Note that
+// the host's filter applies to shared monitors (subscribers also apply
+// their own filter to the files and events they receive).
+
+core::Error initialize(const boost::function<void()>& onCallbacksPending);
+
+void registerMonitor(
+         const core::FilePath& filePath,
+         bool recursive,
+         const boost::function<bool(const core::FileInfo&)>& filter,
+         const core::system::file_monitor::Callbacks& callbacks);
+
+} // namespace shared_file_monitor
+} // namespace session
+
+#endif // SESSION_SHARED_FILE_MONITOR_HPP
@@ -36,6 +36,16 @@ namespace source_database {
 class SourceDocument : boost::noncopyable
 {
 public:
+   // an edit which replaces [offset, offset + length) of the contents
+   // (in bytes) with text
+   struct ContentsEdit
+   {
+      ContentsEdit() : offset(0), length(0) {}
+      std::string::size_type offset;
+      std::string::size_type length;
+      std::string text;
+   };
+
    SourceDocument(const std::string& type = std::string());
    virtual ~SourceDocument() {}
    // COPYING: via compiler
@@ -60,6 +70,11 @@ public:
    // set contents from string
    void setContents(const std::string& contents);
 
+   // apply a sequence of edits to the contents (each edit's range refers to
+   // the contents as left by the previous edits). returns false (leaving
+   // the contents unchanged) if an edit's range is out of bounds
+   bool applyEdits(const std::vector<ContentsEdit>& edits);
+
    // set contents from file
    core::Error setPathAndContents(const std::string& path,
                                   bool allowSubstChars = true);
@@ -109,6 +124,18 @@ public:
 
    core::Error writeToFile(const core::FilePath& filePath) const;
 
+   // hash of the contents as of the last read from or write to the source
+   // database (empty if the document hasn't been persisted)
+   const std::string& persistedHash() const { return persistedHash_; }
+
+   // the edits which transform the persisted contents into the current
+   // contents. returns false if they aren't known (e.g. because there were
+   // too many of them)
+   bool contentsEditsSincePersisted(std::vector<ContentsEdit>* pEdits) const;
+
+   // note that the document has been read from or written to the database
+   void setPersisted();
+
 private:
    void editProperty(const core::json::Object::value_type& property);
 
@@ -121,10 +148,18 @@ private:
    std::string encoding_;
    std::string folds_;
    std::time_t lastKnownWriteTime_;
+   // hash of the file's contents as of lastKnownWriteTime_ (if known)
+   std::string diskHash_;
    bool dirty_;
    double created_;
    bool sourceOnSave_;
    core::json::Object properties_;
+
+   // state used to journal edits rather than rewriting the whole document
+   std::string persistedHash_;
+   void addEditSincePersisted(const ContentsEdit& edit);
+   bool editsSincePersistedKnown_;
+   std::vector<ContentsEdit> editsSincePersisted_;
 };
 
 bool sortByCreated(const boost::shared_ptr<SourceDocument>& pDoc1,
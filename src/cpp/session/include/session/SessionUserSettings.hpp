@@ -68,6 +68,10 @@ public:
    void beginUpdate() { settings_.beginUpdate(); }
    void endUpdate() { settings_.endUpdate(); }
 
+   // write any pending changes (changes are otherwise written within a
+   // couple of seconds)
+   void flush();
+
    // context id
    std::string contextId() const;
    void setContextId(const std::string& contextId);
@@ -168,6 +172,8 @@ private:
 
    void updatePrefsCache(const core::json::Object& uiPrefs) const;
 
+   bool flushPeriodically();
+
    template <typename T>
    T readUiPref(const boost::scoped_ptr<T>& pPref) const
    {
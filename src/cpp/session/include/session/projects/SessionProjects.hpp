@@ -201,6 +201,17 @@ private:
 
 ProjectContext& projectContext();
 
+// park this session (rather than quitting) when switching projects. returns
+// false if the session isn't eligible (the caller should quit as usual);
+// otherwise returns only once the session has been switched back to. the
+// quit response is sent via acknowledge once the switch has been arranged.
+// while parked the session quits if quitRequested returns true or if it
+// reaches the session timeout
+bool parkForProjectSwitch(const std::string& switchToProject,
+                          bool saveWorkspace,
+                          const boost::function<void()>& acknowledge,
+                          const boost::function<bool()>& quitRequested);
+
 
 } // namespace projects
 } // namesapce session
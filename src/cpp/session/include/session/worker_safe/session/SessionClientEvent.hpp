@@ -96,6 +96,8 @@ extern const int kSourceCppCompleted;
 extern const int kLoadedPackageUpdates;
 extern const int kActivatePane;
 extern const int kShowPresentationPane;
+extern const int kPlotsExportStatus;
+extern const int kUploadProgress;
 }
    
 class ClientEvent
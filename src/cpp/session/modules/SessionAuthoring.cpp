@@ -39,6 +39,7 @@
 #include "tex/SessionCompilePdf.hpp"
 #include "tex/SessionCompilePdfSupervisor.hpp"
 #include "tex/SessionSynctex.hpp"
+#include "tex/SessionTexUtils.hpp"
 #include "tex/SessionViewPdf.hpp"
 
 using namespace core;
@@ -258,6 +259,7 @@ Error initialize()
    ExecBlock initBlock ;
    initBlock.addFunctions()
       (bind(sourceModuleRFile, "SessionAuthoring.R"))
+      (tex::utils::initialize)
       (tex::compile_pdf::initialize)
       (tex::compile_pdf_supervisor::initialize)
       (tex::synctex::initialize)
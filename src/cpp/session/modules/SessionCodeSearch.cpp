@@ -18,6 +18,8 @@
 #include <iostream>
 #include <vector>
 #include <set>
+#include <map>
+#include <algorithm>
 
 #include <boost/bind.hpp>
 #include <boost/shared_ptr.hpp>
@@ -25,14 +27,18 @@
 #include <boost/format.hpp>
 #include <boost/regex.hpp>
 #include <boost/algorithm/string/predicate.hpp>
+#include <boost/thread/thread.hpp>
 
 #include <core/Error.hpp>
 #include <core/Exec.hpp>
 #include <core/FilePath.hpp>
 #include <core/FileSerializer.hpp>
 #include <core/SafeConvert.hpp>
+#include <core/Thread.hpp>
 
 #include <core/r_util/RSourceIndex.hpp>
+#include <core/r_util/RSourceIndexCache.hpp>
+#include <core/r_util/RSourceSymbolIndex.hpp>
 
 #include <core/system/FileChangeEvent.hpp>
 #include <core/system/FileMonitor.hpp>
@@ -93,11 +99,98 @@ bool enforceMaxResults(std::size_t maxResults,
 }
 
 
+// request to index an R source file (and its result). the generation is
+// used to discard results which have been superseded by a later change
+// to (or removal of) the file while the request was being processed
+struct IndexRequest
+{
+   FileInfo fileInfo;
+   std::string encoding;
+   std::string context;
+   unsigned long generation;
+};
+
+struct IndexResult
+{
+   IndexResult() : generation(0), succeeded(false) {}
+
+   FileInfo fileInfo;
+   unsigned long generation;
+   bool succeeded;
+   boost::shared_ptr<r_util::RSourceIndex> pIndex;
+};
+
+// reads, tokenizes and indexes R source files on the shared background
+// thread pool. requests are submitted and results collected on the main
+// thread; the only state shared with the background work is the results
+// queue
+class IndexingWorkers : boost::noncopyable
+{
+public:
+   IndexingWorkers()
+   {
+   }
+
+   // COPYING: prohibited
+
+   void enque(const IndexRequest& request)
+   {
+      module_context::executeInBackground(
+               boost::bind(&IndexingWorkers::indexAndEnque, this, request));
+   }
+
+   bool dequeResult(IndexResult* pResult)
+   {
+      return results_.deque(pResult);
+   }
+
+private:
+
+   void indexAndEnque(const IndexRequest& request)
+   {
+      results_.enque(indexFile(request));
+   }
+
+   static IndexResult indexFile(const IndexRequest& request)
+   {
+      IndexResult result;
+      result.fileInfo = request.fileInfo;
+      result.generation = request.generation;
+
+      // read the file (note that decoding is done with iconv via Riconv
+      // which doesn't touch any R interpreter state)
+      FilePath filePath(request.fileInfo.absolutePath());
+      std::string code;
+      Error error = module_context::readAndDecodeFile(filePath,
+                                                      request.encoding,
+                                                      true,
+                                                      &code);
+      if (error)
+      {
+         error.addProperty("src-file", filePath.absolutePath());
+         LOG_ERROR(error);
+         return result;
+      }
+
+      // index it
+      result.pIndex.reset(new r_util::RSourceIndex(request.context, code));
+      result.succeeded = true;
+      return result;
+   }
+
+private:
+   core::thread::ThreadsafeQueue<IndexResult> results_;
+};
+
+
 class SourceFileIndex : boost::noncopyable
 {
 public:
    SourceFileIndex()
-      : indexing_(false)
+      : indexing_(false),
+        generation_(0),
+        pWorkers_(NULL),
+        cacheDirty_(false)
    {
    }
 
@@ -121,19 +214,9 @@ public:
          }
       }
 
-      // schedule indexing if necessary. perform up to 200ms of work
-      // immediately and then continue in periodic 20ms chunks until
-      // we are completed.
-      if (!indexingQueue_.empty() && !indexing_)
-      {
-         indexing_ = true;
-
-         module_context::scheduleIncrementalWork(
-                           boost::posix_time::milliseconds(200),
-                           boost::posix_time::milliseconds(20),
-                           boost::bind(&SourceFileIndex::dequeAndIndex, this),
-                           false /* allow indexing even when non-idle */);
-      }
+      // schedule indexing if necessary
+      if (!indexingQueue_.empty())
+         scheduleIndexing();
    }
 
    void enqueFileChange(const core::system::FileChangeEvent& event)
@@ -145,55 +228,17 @@ public:
       // add to the queue
       indexingQueue_.push(event);
 
-      // schedule indexing if necessary. don't index anything immediately
-      // (this is to defend against large numbers of files being enqued
-      // at once and typing up the main thread). rather, schedule indexing
-      // to occur during idle time in 20ms chunks
-      if (!indexing_)
-      {
-         indexing_ = true;
-
-         module_context::scheduleIncrementalWork(
-                           boost::posix_time::milliseconds(20),
-                           boost::bind(&SourceFileIndex::dequeAndIndex, this),
-                           false /* allow indexing even when non-idle */);
-      }
+      // schedule indexing if necessary
+      scheduleIndexing();
    }
 
    bool findGlobalFunction(const std::string& functionName,
                            const std::set<std::string>& excludeContexts,
                            r_util::RSourceItem* pFunctionItem)
    {
-      std::vector<r_util::RSourceItem> sourceItems;
-      BOOST_FOREACH(const Entry& entry, entries_)
-      {
-         // bail if there is no index
-         if (!entry.hasIndex())
-            continue;
-
-         // bail if this is an exluded context
-         if (excludeContexts.find(entry.pIndex->context()) !=
-             excludeContexts.end())
-         {
-            continue;
-         }
-
-         // scan the next index
-         sourceItems.clear();
-         entry.pIndex->search(
-                  boost::bind(isGlobalFunctionNamed, _1, functionName),
-                  std::back_inserter(sourceItems));
-
-         // return if we got a hit
-         if (sourceItems.size() > 0)
-         {
-            *pFunctionItem = sourceItems[0];
-            return true;
-         }
-      }
-
-      // none found
-      return false;
+      return symbolIndex_.findGlobalFunction(functionName,
+                                             excludeContexts,
+                                             pFunctionItem);
    }
 
    void searchSource(const std::string& term,
@@ -202,32 +247,12 @@ public:
                      const std::set<std::string>& excludeContexts,
                      std::vector<r_util::RSourceItem>* pItems)
    {
-      BOOST_FOREACH(const Entry& entry, entries_)
-      {
-         // skip if it has no index
-         if (!entry.hasIndex())
-            continue;
-
-         // bail if this is an exluded context
-         if (excludeContexts.find(entry.pIndex->context()) !=
-             excludeContexts.end())
-         {
-            continue;
-         }
-
-         // scan the next index
-         entry.pIndex->search(term,
-                              prefixOnly,
-                              false,
-                              std::back_inserter(*pItems));
-
-         // return if we are past maxResults
-         if (pItems->size() >= maxResults)
-         {
-            pItems->resize(maxResults);
-            return;
-         }
-      }
+      symbolIndex_.search(term,
+                          prefixOnly,
+                          false,
+                          maxResults,
+                          excludeContexts,
+                          pItems);
    }
 
    void searchFiles(const std::string& term,
@@ -281,11 +306,84 @@ public:
       }
    }
 
+   // load previously computed indexes from the cache (files which haven't
+   // changed since they were cached won't need to be indexed again)
+   void loadCache(const FilePath& cacheFile)
+   {
+      cacheFile_ = cacheFile;
+      if (!cacheFile_.exists())
+         return;
+
+      Error error = cache_.readFromFile(cacheFile_);
+      if (error)
+         LOG_ERROR(error);
+   }
+
+   // save the current indexes to the cache (if they have changed)
+   void saveCache()
+   {
+      // don't save while we are still indexing (we'd lose cached indexes
+      // for files which haven't yet been processed)
+      if (indexing_)
+         return;
+
+      // discard anything remaining from the loaded cache (it's now either
+      // been used or is for files which no longer exist)
+      cache_.clear();
+
+      if (!cacheDirty_ || cacheFile_.empty())
+         return;
+
+      r_util::RSourceIndexCache cache;
+      BOOST_FOREACH(const Entry& entry, entries_)
+      {
+         if (entry.hasIndex())
+            cache.add(entry.fileInfo, entry.pIndex->items());
+      }
+
+      Error error = cache.writeToFile(cacheFile_);
+      if (error)
+         LOG_ERROR(error);
+
+      cacheDirty_ = false;
+   }
+
+   void listIndexes(
+         std::vector<boost::shared_ptr<r_util::RSourceIndex> >* pIndexes) const
+   {
+      BOOST_FOREACH(const Entry& entry, entries_)
+      {
+         if (entry.hasIndex())
+            pIndexes->push_back(entry.pIndex);
+      }
+   }
+
    void clear()
    {
-      indexing_ = false;
+      // NOTE: indexing_ remains true until the scheduled work observes
+      // that there is nothing left to do. requests which are still being
+      // processed will have their results discarded since they are
+      // no longer pending
       indexingQueue_ = std::queue<core::system::FileChangeEvent>();
+      pending_.clear();
+      cache_.clear();
+      cacheFile_ = FilePath();
+      cacheDirty_ = false;
       entries_.clear();
+      symbolIndex_.clear();
+   }
+
+   // approximate bytes held by the index entries
+   std::size_t memoryUsage() const
+   {
+      std::size_t bytes = 0;
+      BOOST_FOREACH(const Entry& entry, entries_)
+      {
+         bytes += sizeof(Entry) + entry.fileInfo.absolutePath().length();
+         if (entry.hasIndex())
+            bytes += entry.pIndex->memoryUsage();
+      }
+      return bytes;
    }
 
 private:
@@ -318,69 +416,143 @@ private:
 
 private:
 
-   bool dequeAndIndex()
+   void scheduleIndexing()
    {
-      using namespace core::system;
+      // the actual tokenizing and indexing of files is done by background
+      // workers so all we need to do on the main thread is dispatch file
+      // changes to them and publish their results. do this periodically
+      // (in slices of up to 20ms) until there is no more work pending
+      if (!indexing_)
+      {
+         indexing_ = true;
 
-      if (!indexingQueue_.empty())
+         module_context::schedulePeriodicWork(
+                           boost::posix_time::milliseconds(50),
+                           boost::bind(&SourceFileIndex::processIndexing, this),
+                           false /* allow indexing even when non-idle */,
+                           true,
+                           module_context::WorkPriorityLow);
+      }
+   }
+
+   bool processIndexing()
+   {
+      using namespace boost::posix_time;
+      ptime endTime = microsec_clock::universal_time() + milliseconds(20);
+
+      // publish the results of completed indexing requests
+      IndexResult result;
+      while (microsec_clock::universal_time() < endTime &&
+             workers().dequeResult(&result))
       {
-         // remove the event from the queue
-         FileChangeEvent event = indexingQueue_.front();
+         publishResult(result);
+      }
+
+      // dispatch queued file changes
+      while (microsec_clock::universal_time() < endTime &&
+             !indexingQueue_.empty())
+      {
+         core::system::FileChangeEvent event = indexingQueue_.front();
          indexingQueue_.pop();
+         dispatchFileChange(event);
+      }
+
+      // return status (saving the cache once we are all caught up)
+      indexing_ = !indexingQueue_.empty() || !pending_.empty();
+      if (!indexing_)
+         saveCache();
+      return indexing_;
+   }
 
-         // process the change
-         const FileInfo& fileInfo = event.fileInfo();
-         switch(event.type())
+   void dispatchFileChange(const core::system::FileChangeEvent& event)
+   {
+      using namespace core::system;
+
+      const FileInfo& fileInfo = event.fileInfo();
+      switch(event.type())
+      {
+         case FileChangeEvent::FileAdded:
+         case FileChangeEvent::FileModified:
          {
-            case FileChangeEvent::FileAdded:
-            case FileChangeEvent::FileModified:
+            if (isIndexableSourceFile(fileInfo))
             {
-               updateIndexEntry(fileInfo);
-               break;
+               std::string context = module_context::createAliasedPath(
+                                          FilePath(fileInfo.absolutePath()));
+
+               // use the cached index if the file hasn't changed
+               std::vector<r_util::RSourceItem> items;
+               if (cache_.find(fileInfo, &items))
+               {
+                  pending_.erase(fileInfo.absolutePath());
+                  cache_.remove(fileInfo.absolutePath());
+                  updateIndexEntry(fileInfo,
+                                   boost::shared_ptr<r_util::RSourceIndex>(
+                                      new r_util::RSourceIndex(context, items)));
+                  break;
+               }
+
+               // send to the workers for indexing
+               IndexRequest request;
+               request.fileInfo = fileInfo;
+               request.encoding = projects::projectContext().defaultEncoding();
+               request.context = context;
+               request.generation = ++generation_;
+               pending_[fileInfo.absolutePath()] = request.generation;
+               workers().enque(request);
             }
-
-            case FileChangeEvent::FileRemoved:
+            else
             {
-               removeIndexEntry(fileInfo);
-               break;
+               // add an entry without an index
+               pending_.erase(fileInfo.absolutePath());
+               updateIndexEntry(fileInfo,
+                                boost::shared_ptr<r_util::RSourceIndex>());
             }
+            break;
+         }
 
-            case FileChangeEvent::None:
-               break;
+         case FileChangeEvent::FileRemoved:
+         {
+            pending_.erase(fileInfo.absolutePath());
+            removeIndexEntry(fileInfo);
+            cacheDirty_ = true;
+            break;
          }
-      }
 
-      // return status
-      indexing_ = !indexingQueue_.empty();
-      return indexing_;
+         case FileChangeEvent::None:
+            break;
+      }
    }
 
-   void updateIndexEntry(const FileInfo& fileInfo)
+   void publishResult(const IndexResult& result)
    {
-      // index the source if necessary
-      boost::shared_ptr<r_util::RSourceIndex> pIndex;
-      if (isIndexableSourceFile(fileInfo))
-      {
-         // read the file
-         FilePath filePath(fileInfo.absolutePath());
-         std::string code;
-         Error error = module_context::readAndDecodeFile(
-                                 filePath,
-                                 projects::projectContext().defaultEncoding(),
-                                 true,
-                                 &code);
-         if (error)
-         {
-            error.addProperty("src-file", filePath.absolutePath());
-            LOG_ERROR(error);
-            return;
-         }
+      // ignore results which are no longer pending (the file was changed
+      // again or removed in the meantime)
+      std::map<std::string,unsigned long>::iterator it =
+                                 pending_.find(result.fileInfo.absolutePath());
+      if (it == pending_.end() || it->second != result.generation)
+         return;
+      pending_.erase(it);
 
-         // add index entry
-         std::string context = module_context::createAliasedPath(filePath);
-         pIndex.reset(new r_util::RSourceIndex(context, code));
+      // if we failed to read the file then leave the existing entry as-is
+      if (result.succeeded)
+      {
+         updateIndexEntry(result.fileInfo, result.pIndex);
+         cacheDirty_ = true;
       }
+   }
+
+   IndexingWorkers& workers()
+   {
+      // NOTE: allocated on the heap and never freed so that it is never
+      // destroyed out from under background work which is still running
+      if (pWorkers_ == NULL)
+         pWorkers_ = new IndexingWorkers();
+      return *pWorkers_;
+   }
 
+   void updateIndexEntry(const FileInfo& fileInfo,
+                         boost::shared_ptr<r_util::RSourceIndex> pIndex)
+   {
       // attempt to add the entry
       Entry entry(fileInfo, pIndex);
       std::pair<std::set<Entry>::iterator,bool> result = entries_.insert(entry);
@@ -388,6 +560,10 @@ private:
       // insert failed, remove then re-add
       if (result.second == false)
       {
+         // remove the symbols of the entry we are replacing
+         if (result.first->hasIndex())
+            symbolIndex_.remove(result.first->pIndex->context());
+
          // was the first item, erase and re-insert without a hint
          if (result.first == entries_.begin())
          {
@@ -406,6 +582,10 @@ private:
             entries_.insert(hintIter, entry);
          }
       }
+
+      // add the symbols of the new entry
+      if (entry.hasIndex())
+         symbolIndex_.add(entry.pIndex);
    }
 
    void removeIndexEntry(const FileInfo& fileInfo)
@@ -416,7 +596,11 @@ private:
       // do the find (will use Entry::operator< for equivilance test)
       std::set<Entry>::iterator it = entries_.find(entry);
       if (it != entries_.end())
+      {
+         if (it->hasIndex())
+            symbolIndex_.remove(it->pIndex->context());
          entries_.erase(it);
+      }
    }
 
    static bool isSourceFile(const FileInfo& fileInfo)
@@ -464,9 +648,25 @@ private:
    // index entries
    std::set<Entry> entries_;
 
+   // project-wide index of the source items within the entries
+   r_util::RSourceSymbolIndex symbolIndex_;
+
    // indexing queue
    bool indexing_;
    std::queue<core::system::FileChangeEvent> indexingQueue_;
+
+   // files with an indexing request outstanding (and the generation of
+   // the most recent request for each)
+   unsigned long generation_;
+   std::map<std::string,unsigned long> pending_;
+
+   // background indexing workers
+   IndexingWorkers* pWorkers_;
+
+   // on-disk cache of indexes
+   FilePath cacheFile_;
+   r_util::RSourceIndexCache cache_;
+   bool cacheDirty_;
 };
 
 // global source file index
@@ -1008,6 +1208,136 @@ std::string baseMethodName(const std::string& name)
    }
 }
 
+// Deparsed sources of package functions and method listings. Sources are
+// keyed by namespace and package version (and are only used while the
+// name is still bound to the same function object). Method listings
+// depend on every loaded namespace and on the global environment so they
+// are discarded whenever the loaded namespaces change or console input
+// is executed.
+class FunctionDefinitionCache : boost::noncopyable
+{
+public:
+   bool findSource(const std::string& namespaceName,
+                   const std::string& version,
+                   const std::string& name,
+                   SEXP functionSEXP,
+                   std::string* pCode,
+                   bool* pFromSrcAttrib) const
+   {
+      Sources::const_iterator it =
+                     sources_.find(sourceKey(namespaceName, version, name));
+      if (it == sources_.end() || it->second.functionSEXP != functionSEXP)
+         return false;
+
+      *pCode = it->second.code;
+      *pFromSrcAttrib = it->second.fromSrcAttrib;
+      return true;
+   }
+
+   void addSource(const std::string& namespaceName,
+                  const std::string& version,
+                  const std::string& name,
+                  SEXP functionSEXP,
+                  const std::string& code,
+                  bool fromSrcAttrib)
+   {
+      if (sources_.size() >= kMaxSources)
+         sources_.clear();
+
+      Source& source = sources_[sourceKey(namespaceName, version, name)];
+      source.functionSEXP = functionSEXP;
+      source.code = code;
+      source.fromSrcAttrib = fromSrcAttrib;
+   }
+
+   bool findMethods(const std::string& methodName, json::Array* pMethods)
+   {
+      checkLoadedNamespaces();
+
+      std::map<std::string,json::Array>::const_iterator it =
+                                                   methods_.find(methodName);
+      if (it == methods_.end())
+         return false;
+
+      *pMethods = it->second;
+      return true;
+   }
+
+   void addMethods(const std::string& methodName, const json::Array& methods)
+   {
+      if (methods_.size() >= kMaxSources)
+         methods_.clear();
+
+      methods_[methodName] = methods;
+   }
+
+   void clearMethods()
+   {
+      methods_.clear();
+   }
+
+private:
+   static std::string sourceKey(const std::string& namespaceName,
+                                const std::string& version,
+                                const std::string& name)
+   {
+      return namespaceName + "\n" + version + "\n" + name;
+   }
+
+   void checkLoadedNamespaces()
+   {
+      std::vector<std::string> loaded;
+      Error error = r::exec::RFunction("loadedNamespaces").call(&loaded);
+      if (error)
+      {
+         LOG_ERROR(error);
+         loaded.clear();
+      }
+
+      if (loaded != loadedNamespaces_)
+      {
+         methods_.clear();
+         loadedNamespaces_.swap(loaded);
+      }
+   }
+
+private:
+   static const std::size_t kMaxSources = 500;
+
+   // NOTE: the function object isn't protected (it's only compared with
+   // the object the name is currently bound to)
+   struct Source
+   {
+      Source() : functionSEXP(R_NilValue), fromSrcAttrib(false) {}
+      SEXP functionSEXP;
+      std::string code;
+      bool fromSrcAttrib;
+   };
+   typedef std::map<std::string,Source> Sources;
+   Sources sources_;
+
+   std::vector<std::string> loadedNamespaces_;
+   std::map<std::string,json::Array> methods_;
+};
+
+FunctionDefinitionCache s_functionDefinitionCache;
+
+// version of the package whose namespace this is (empty for anything which
+// isn't a package, e.g. the global environment, and so isn't cached)
+std::string packageVersion(const std::string& namespaceName)
+{
+   std::string pkgName;
+   if (!namespaceIsPackage(namespaceName, &pkgName))
+      return std::string();
+
+   std::string version;
+   Error error = r::exec::RFunction(".rs.getNamespaceVersion", pkgName).call(
+                                                                     &version);
+   if (error)
+      LOG_ERROR(error);
+   return version;
+}
+
 json::Object createFunctionDefinition(const std::string& name,
                                       const std::string& namespaceName,
                                       SEXP functionSEXP)
@@ -1017,29 +1347,49 @@ json::Object createFunctionDefinition(const std::string& name,
    funDef["name"] = name;
    funDef["namespace"] = namespaceName;
 
-   // function source code
+   // function source code (deparsing is slow for large functions so the
+   // sources of package functions are cached)
+   std::string version = packageVersion(namespaceName);
    bool fromSrcAttrib = false;
-   std::vector<std::string> lines;
-   getFunctionSource(functionSEXP, &lines, &fromSrcAttrib);
-
-   // did we get some lines back?
-   if (lines.size() > 0)
+   std::string code;
+   if (version.empty() ||
+       !s_functionDefinitionCache.findSource(namespaceName, version, name,
+                                             functionSEXP, &code,
+                                             &fromSrcAttrib))
    {
-      // append the lines to the code and set it
-      std::string code;
+      std::vector<std::string> lines;
+      getFunctionSource(functionSEXP, &lines, &fromSrcAttrib);
+
+      // append the lines to the code
       BOOST_FOREACH(const std::string& line, lines)
       {
          code.append(line);
          code.append("\n");
       }
+
+      if (!version.empty() && !code.empty())
+      {
+         s_functionDefinitionCache.addSource(namespaceName, version, name,
+                                             functionSEXP, code,
+                                             fromSrcAttrib);
+      }
+   }
+
+   // did we get some lines back?
+   if (!code.empty())
+   {
       funDef["code"] = code;
       funDef["from_src_attrib"] = fromSrcAttrib;
 
       // methods
       std::string methodName = baseMethodName(name);
       json::Array methodsJson;
-      getFunctionS4Methods(methodName, &methodsJson);
-      getFunctionS3Methods(methodName, &methodsJson);
+      if (!s_functionDefinitionCache.findMethods(methodName, &methodsJson))
+      {
+         getFunctionS4Methods(methodName, &methodsJson);
+         getFunctionS3Methods(methodName, &methodsJson);
+         s_functionDefinitionCache.addMethods(methodName, methodsJson);
+      }
       funDef["methods"] = methodsJson;
 
       return funDef;
@@ -1389,6 +1739,8 @@ Error findFunctionInSearchPath(const json::JsonRpcRequest& request,
 
 void onFileMonitorEnabled(const tree<core::FileInfo>& files)
 {
+   s_projectIndex.loadCache(
+         projects::projectContext().scratchPath().complete("code_index"));
    s_projectIndex.enqueFiles(files.begin_leaf(), files.end_leaf());
 }
 
@@ -1402,12 +1754,34 @@ void onFilesChanged(const std::vector<core::system::FileChangeEvent>& events)
 
 void onFileMonitorDisabled()
 {
-   // clear the index so we don't ever get stale results
+   // save any changes to the cache then clear the index so we don't
+   // ever get stale results
+   s_projectIndex.saveCache();
    s_projectIndex.clear();
 }
 
+void onShutdown(bool)
+{
+   s_projectIndex.saveCache();
+}
+
+void onDetectChanges(module_context::ChangeSource source)
+{
+   // console input may have defined (or removed) methods
+   if (source == module_context::ChangeSourceREPL)
+      s_functionDefinitionCache.clearMethods();
+}
+
    
 } // anonymous namespace
+
+std::vector<boost::shared_ptr<r_util::RSourceIndex> > sourceIndexes()
+{
+   std::vector<boost::shared_ptr<r_util::RSourceIndex> > indexes =
+                                                   modules::source::rIndexes();
+   s_projectIndex.listIndexes(&indexes);
+   return indexes;
+}
    
 Error initialize()
 {
@@ -1420,8 +1794,14 @@ Error initialize()
    projects::projectContext().subscribeToFileMonitor("R source file indexing",
                                                      cb);
 
+   // save the cache of indexes at shutdown
+   module_context::events().onShutdown.connect(onShutdown);
+   module_context::events().onDetectChanges.connect(onDetectChanges);
+
    using boost::bind;
    using namespace module_context;
+   registerMemoryUsage("code_search",
+                       bind(&SourceFileIndex::memoryUsage, &s_projectIndex));
    ExecBlock initBlock ;
    initBlock.addFunctions()
       (bind(registerRpcMethod, "search_code", searchCode))
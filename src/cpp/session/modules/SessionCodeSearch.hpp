@@ -16,14 +16,25 @@
 #ifndef SESSION_CODE_SEARCH_HPP
 #define SESSION_CODE_SEARCH_HPP
 
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
 namespace core {
    class Error;
+   namespace r_util {
+      class RSourceIndex;
+   }
 }
 
 namespace session {
 namespace modules {
 namespace code_search {
 
+// source indexes of the open source documents and the project's files.
+// indexes aren't modified once created so they may be read on any thread
+std::vector<boost::shared_ptr<core::r_util::RSourceIndex> > sourceIndexes();
+
 core::Error initialize();
    
 } // namespace code_search
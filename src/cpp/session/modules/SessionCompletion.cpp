@@ -0,0 +1,767 @@
+/*
+ * SessionCompletion.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "SessionCompletion.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <deque>
+#include <map>
+#include <set>
+
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/Exec.hpp>
+#include <core/Thread.hpp>
+#include <core/BoostThread.hpp>
+#include <core/json/JsonRpc.hpp>
+#include <core/r_util/RSourceIndex.hpp>
+
+#include <r/RInternal.hpp>
+#include <r/RSexp.hpp>
+#include <r/RExec.hpp>
+#include <r/RJson.hpp>
+
+#include <session/SessionModuleContext.hpp>
+
+#include "SessionCodeSearch.hpp"
+
+using namespace core;
+
+namespace session {
+namespace modules {
+namespace completion {
+
+namespace {
+
+typedef std::vector<std::string> Names;
+
+// names (sorted) and function formals of an attached package or of a
+// namespace which is loaded but not attached
+struct PackageEntry
+{
+   PackageEntry() : attached(false) {}
+   std::string name;
+   bool attached;
+   Names names;
+   std::map<std::string,Names> formals;
+};
+
+// attached packages (in search path order) followed by loaded namespaces
+typedef std::vector<boost::shared_ptr<const PackageEntry> > Packages;
+
+// The completion index is read on the r-free rpc threads (so completions
+// keep working while R is busy) and written on the main thread. Each part
+// is immutable once published, so readers only hold the mutex for long
+// enough to copy the pointers.
+struct IndexSnapshot
+{
+   IndexSnapshot() : packagesPending(false) {}
+   bool packagesPending;
+   boost::shared_ptr<const Names> pGlobalNames;
+   boost::shared_ptr<const Names> pSourceNames;
+   boost::shared_ptr<const Packages> pPackages;
+};
+
+boost::mutex s_indexMutex;
+IndexSnapshot s_index;
+
+IndexSnapshot indexSnapshot()
+{
+   IndexSnapshot snapshot;
+   LOCK_MUTEX(s_indexMutex)
+   {
+      snapshot = s_index;
+   }
+   END_LOCK_MUTEX
+   return snapshot;
+}
+
+boost::shared_ptr<const Names> sortedNames(Names* pNames)
+{
+   std::sort(pNames->begin(), pNames->end());
+   pNames->erase(std::unique(pNames->begin(), pNames->end()), pNames->end());
+
+   boost::shared_ptr<Names> pSorted(new Names());
+   pSorted->swap(*pNames);
+   return pSorted;
+}
+
+// main thread state: the search path and loaded namespaces as of the last
+// check, the package entries computed for them, and the packages still
+// waiting to be indexed (along with whether they are attached)
+std::vector<std::string> s_attachedPackages;
+std::vector<std::string> s_loadedNamespaces;
+std::map<std::string,boost::shared_ptr<const PackageEntry> > s_packageEntries;
+std::deque<std::pair<std::string,bool> > s_pendingPackages;
+bool s_indexingPackages = false;
+
+std::vector<boost::shared_ptr<core::r_util::RSourceIndex> > s_sourceIndexes;
+
+void publishPackages()
+{
+   boost::shared_ptr<Packages> pPackages(new Packages());
+
+   BOOST_FOREACH(const std::string& name, s_attachedPackages)
+   {
+      std::map<std::string,boost::shared_ptr<const PackageEntry> >::const_iterator
+                                          it = s_packageEntries.find(name);
+      if (it != s_packageEntries.end())
+         pPackages->push_back(it->second);
+   }
+
+   BOOST_FOREACH(const std::string& name, s_loadedNamespaces)
+   {
+      std::map<std::string,boost::shared_ptr<const PackageEntry> >::const_iterator
+                                          it = s_packageEntries.find(name);
+      if (it != s_packageEntries.end() && !it->second->attached)
+         pPackages->push_back(it->second);
+   }
+
+   LOCK_MUTEX(s_indexMutex)
+   {
+      s_index.pPackages = pPackages;
+      s_index.packagesPending = !s_pendingPackages.empty();
+   }
+   END_LOCK_MUTEX
+}
+
+Error readPackageEntry(const std::string& name,
+                       bool attached,
+                       PackageEntry* pEntry)
+{
+   r::sexp::Protect rProtect;
+   SEXP entrySEXP;
+   r::exec::RFunction func(".rs.getCompletionIndexEntry", name, attached);
+   Error error = func.call(&entrySEXP, &rProtect);
+   if (error)
+      return error;
+
+   pEntry->name = name;
+   pEntry->attached = attached;
+   error = r::sexp::getNamedListElement(entrySEXP, "names", &(pEntry->names));
+   if (error)
+      return error;
+
+   SEXP formalsSEXP = R_NilValue;
+   int formalsIndex = r::sexp::indexOfElementNamed(entrySEXP, "formals");
+   if (formalsIndex != -1)
+      formalsSEXP = VECTOR_ELT(entrySEXP, formalsIndex);
+   if (r::sexp::length(formalsSEXP) != (int)pEntry->names.size())
+      return Success();
+
+   for (std::size_t i = 0; i < pEntry->names.size(); i++)
+   {
+      Names formals;
+      error = r::sexp::extract(VECTOR_ELT(formalsSEXP, i), &formals);
+      if (!error && !formals.empty())
+         pEntry->formals[pEntry->names[i]] = formals;
+   }
+
+   return Success();
+}
+
+bool indexNextPackage()
+{
+   while (!s_pendingPackages.empty())
+   {
+      std::pair<std::string,bool> next = s_pendingPackages.front();
+      s_pendingPackages.pop_front();
+
+      // skip packages which were detached or unloaded while pending
+      const std::vector<std::string>& current =
+                     next.second ? s_attachedPackages : s_loadedNamespaces;
+      if (std::find(current.begin(), current.end(), next.first) ==
+          current.end())
+      {
+         continue;
+      }
+
+      // a package which fails to index (e.g. an environment attached
+      // under a package name) gets an empty entry so it isn't retried
+      boost::shared_ptr<PackageEntry> pEntry(new PackageEntry());
+      Error error = readPackageEntry(next.first, next.second, pEntry.get());
+      if (error)
+      {
+         pEntry.reset(new PackageEntry());
+         pEntry->name = next.first;
+         pEntry->attached = next.second;
+      }
+      s_packageEntries[next.first] = pEntry;
+      publishPackages();
+      break;
+   }
+
+   s_indexingPackages = !s_pendingPackages.empty();
+   if (!s_indexingPackages)
+      publishPackages();
+   return s_indexingPackages;
+}
+
+void enquePackage(const std::string& name, bool attached)
+{
+   std::pair<std::string,bool> request = std::make_pair(name, attached);
+   if (std::find(s_pendingPackages.begin(),
+                 s_pendingPackages.end(),
+                 request) == s_pendingPackages.end())
+   {
+      s_pendingPackages.push_back(request);
+   }
+}
+
+// reindex packages which have been attached or loaded since we last
+// checked. reading the names and formals of a package means forcing its
+// (lazy loaded) functions so it's done one package at a time while idle
+void updatePackages()
+{
+   std::vector<std::string> searchPath;
+   Error error = r::exec::RFunction("search").call(&searchPath);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return;
+   }
+
+   std::vector<std::string> loaded;
+   error = r::exec::RFunction("loadedNamespaces").call(&loaded);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return;
+   }
+
+   std::vector<std::string> attached;
+   BOOST_FOREACH(const std::string& entry, searchPath)
+   {
+      if (boost::algorithm::starts_with(entry, "package:"))
+         attached.push_back(entry.substr(8));
+   }
+
+   if (attached == s_attachedPackages && loaded == s_loadedNamespaces)
+      return;
+
+   s_attachedPackages = attached;
+   s_loadedNamespaces = loaded;
+
+   // drop entries for packages which are gone (or whose state changed)
+   std::set<std::string> attachedSet(attached.begin(), attached.end());
+   std::set<std::string> loadedSet(loaded.begin(), loaded.end());
+   for (std::map<std::string,boost::shared_ptr<const PackageEntry> >::iterator
+        it = s_packageEntries.begin(); it != s_packageEntries.end(); )
+   {
+      bool isAttached = attachedSet.count(it->first) != 0;
+      bool isLoaded = loadedSet.count(it->first) != 0;
+      if ((!isAttached && !isLoaded) || it->second->attached != isAttached)
+         s_packageEntries.erase(it++);
+      else
+         ++it;
+   }
+
+   // index the packages which don't have entries
+   BOOST_FOREACH(const std::string& name, attached)
+   {
+      if (!s_packageEntries.count(name))
+         enquePackage(name, true);
+   }
+   BOOST_FOREACH(const std::string& name, loaded)
+   {
+      if (!s_packageEntries.count(name) && !attachedSet.count(name))
+         enquePackage(name, false);
+   }
+
+   publishPackages();
+
+   if (!s_indexingPackages && !s_pendingPackages.empty())
+   {
+      s_indexingPackages = true;
+      module_context::schedulePeriodicWork(
+                                 boost::posix_time::milliseconds(50),
+                                 indexNextPackage,
+                                 true,
+                                 true,
+                                 module_context::WorkPriorityLow);
+   }
+}
+
+bool sameIndexes(
+      const std::vector<boost::shared_ptr<core::r_util::RSourceIndex> >& a,
+      const std::vector<boost::shared_ptr<core::r_util::RSourceIndex> >& b)
+{
+   if (a.size() != b.size())
+      return false;
+
+   for (std::size_t i = 0; i < a.size(); i++)
+   {
+      if (a[i].get() != b[i].get())
+         return false;
+   }
+   return true;
+}
+
+// names of the global functions and classes defined in the project and in
+// open source documents (rebuilt only when one of the indexes changes)
+void updateSourceNames()
+{
+   std::vector<boost::shared_ptr<core::r_util::RSourceIndex> > indexes =
+                                                code_search::sourceIndexes();
+   if (s_index.pSourceNames && sameIndexes(indexes, s_sourceIndexes))
+      return;
+
+   Names names;
+   BOOST_FOREACH(const boost::shared_ptr<core::r_util::RSourceIndex>& pIndex,
+                 indexes)
+   {
+      BOOST_FOREACH(const core::r_util::RSourceItem& item, pIndex->items())
+      {
+         if (item.braceLevel() == 0 &&
+             item.type() != core::r_util::RSourceItem::None)
+         {
+            names.push_back(item.name());
+         }
+      }
+   }
+
+   boost::shared_ptr<const Names> pSourceNames = sortedNames(&names);
+   LOCK_MUTEX(s_indexMutex)
+   {
+      s_index.pSourceNames = pSourceNames;
+   }
+   END_LOCK_MUTEX
+
+   s_sourceIndexes.swap(indexes);
+}
+
+void onDetectChanges(module_context::ChangeSource source)
+{
+   updateSourceNames();
+   updatePackages();
+}
+
+void onDeferredInit(bool)
+{
+   updateSourceNames();
+   updatePackages();
+}
+
+
+// the part of a line being completed (the token, which may be qualified
+// by a package, and the function whose arguments it's within if any)
+struct CompletionRequest
+{
+   std::string token;
+   std::string package;
+   std::string prefix;
+   std::string function;
+};
+
+bool isIdentifierChar(char ch)
+{
+   return std::isalnum(static_cast<unsigned char>(ch)) ||
+          ch == '.' || ch == '_';
+}
+
+// scan back over an identifier (optionally qualified with pkg::) ending
+// at end, returning its start
+std::size_t identifierStart(const std::string& text,
+                            std::size_t end,
+                            std::string* pPackage,
+                            std::string* pName)
+{
+   std::size_t start = end;
+   while (start > 0 && isIdentifierChar(text[start - 1]))
+      start--;
+   *pName = text.substr(start, end - start);
+
+   if (start >= 2 && text[start - 1] == ':' && text[start - 2] == ':' &&
+       (start < 3 || text[start - 3] != ':'))
+   {
+      std::size_t pkgEnd = start - 2;
+      std::size_t pkgStart = pkgEnd;
+      while (pkgStart > 0 && isIdentifierChar(text[pkgStart - 1]))
+         pkgStart--;
+      *pPackage = text.substr(pkgStart, pkgEnd - pkgStart);
+      return pkgStart;
+   }
+
+   pPackage->clear();
+   return start;
+}
+
+// parse the line up to the cursor. returns false for requests which need
+// R: members of objects ($ and @), namespace internals (:::), file names
+// (within strings), roxygen tags (within comments), and explicit requests
+// for everything (an empty token outside of a function call)
+bool parseCompletionRequest(const std::string& line,
+                            int cursorPos,
+                            CompletionRequest* pRequest)
+{
+   if (cursorPos < 0 || cursorPos > (int)line.size())
+      return false;
+   std::string text = line.substr(0, cursorPos);
+
+   // the cursor position is in characters so bail on anything non-ascii
+   BOOST_FOREACH(char ch, text)
+   {
+      if (static_cast<unsigned char>(ch) >= 0x80)
+         return false;
+   }
+
+   // find the unclosed parentheses (outside of strings and comments)
+   std::vector<std::size_t> openParens;
+   char quote = 0;
+   for (std::size_t i = 0; i < text.size(); i++)
+   {
+      char ch = text[i];
+      if (quote)
+      {
+         if (ch == '\\')
+            i++;
+         else if (ch == quote)
+            quote = 0;
+      }
+      else if (ch == '"' || ch == '\'' || ch == '`')
+      {
+         quote = ch;
+      }
+      else if (ch == '#')
+      {
+         return false;
+      }
+      else if (ch == '(')
+      {
+         openParens.push_back(i);
+      }
+      else if (ch == ')' && !openParens.empty())
+      {
+         openParens.pop_back();
+      }
+   }
+   if (quote)
+      return false;
+
+   // the token being completed
+   if (text.size() >= 3 && text.compare(text.size() - 3, 3, ":::") == 0)
+      return false;
+   std::size_t tokenStart = identifierStart(text,
+                                            text.size(),
+                                            &(pRequest->package),
+                                            &(pRequest->prefix));
+   if (tokenStart > 0 &&
+       (text[tokenStart - 1] == '$' || text[tokenStart - 1] == '@' ||
+        text[tokenStart - 1] == ':'))
+   {
+      return false;
+   }
+   if (tokenStart < text.size() &&
+       std::isdigit(static_cast<unsigned char>(text[tokenStart])))
+   {
+      return false;
+   }
+   if (text.size() >= 2 && text.compare(text.size() - 2, 2, "::") == 0 &&
+       pRequest->package.empty())
+   {
+      return false;
+   }
+   pRequest->token = text.substr(tokenStart);
+
+   // the function whose arguments we're within
+   if (!openParens.empty())
+   {
+      std::size_t end = openParens.back();
+      while (end > 0 && std::isspace(static_cast<unsigned char>(text[end - 1])))
+         end--;
+
+      std::string package, name;
+      identifierStart(text, end, &package, &name);
+      if (!name.empty() && name != "if" && name != "for" &&
+          name != "while" && name != "function")
+      {
+         pRequest->function = package.empty() ? name : package + "::" + name;
+      }
+   }
+
+   return !pRequest->token.empty() || !pRequest->function.empty();
+}
+
+const PackageEntry* findPackage(const Packages& packages,
+                                const std::string& name)
+{
+   BOOST_FOREACH(const boost::shared_ptr<const PackageEntry>& pEntry, packages)
+   {
+      if (pEntry->name == name)
+         return pEntry.get();
+   }
+   return NULL;
+}
+
+// can the index answer the request? (it needs to have been populated, and
+// packages which were attached or loaded need to have been indexed)
+bool canComplete(const CompletionRequest& request, const IndexSnapshot& index)
+{
+   if (!index.pGlobalNames || !index.pSourceNames || !index.pPackages)
+      return false;
+
+   if (index.packagesPending || index.pPackages->empty())
+      return false;
+
+   if (!request.package.empty())
+      return findPackage(*index.pPackages, request.package) != NULL;
+
+   return true;
+}
+
+// formals of the function (if it comes from a package: we don't know the
+// formals of functions which are defined in the global environment or
+// in source files)
+const Names* findFormals(const std::string& function,
+                         const IndexSnapshot& index)
+{
+   std::string::size_type pos = function.find("::");
+   if (pos != std::string::npos)
+   {
+      const PackageEntry* pEntry = findPackage(*index.pPackages,
+                                               function.substr(0, pos));
+      if (pEntry == NULL)
+         return NULL;
+      std::map<std::string,Names>::const_iterator it =
+                              pEntry->formals.find(function.substr(pos + 2));
+      return it != pEntry->formals.end() ? &(it->second) : NULL;
+   }
+
+   if (std::binary_search(index.pGlobalNames->begin(),
+                          index.pGlobalNames->end(),
+                          function))
+   {
+      return NULL;
+   }
+
+   BOOST_FOREACH(const boost::shared_ptr<const PackageEntry>& pEntry,
+                 *index.pPackages)
+   {
+      if (!pEntry->attached)
+         break;
+
+      std::map<std::string,Names>::const_iterator it =
+                                             pEntry->formals.find(function);
+      if (it != pEntry->formals.end())
+         return &(it->second);
+   }
+
+   return NULL;
+}
+
+class CompletionResults
+{
+public:
+   explicit CompletionResults(const std::string& prefix)
+      : prefix_(prefix), includeHidden_(boost::algorithm::starts_with(prefix, "."))
+   {
+   }
+
+   // add the names (which are sorted) which start with the prefix
+   void addMatching(const Names& names,
+                    const std::string& qualifier,
+                    const std::string& package)
+   {
+      for (Names::const_iterator it = std::lower_bound(names.begin(),
+                                                       names.end(),
+                                                       prefix_);
+           it != names.end() && boost::algorithm::starts_with(*it, prefix_);
+           ++it)
+      {
+         if (!includeHidden_ && boost::algorithm::starts_with(*it, "."))
+            continue;
+         add(qualifier + *it, package);
+      }
+   }
+
+   void add(const std::string& result, const std::string& package)
+   {
+      if (seen_.insert(result).second)
+      {
+         results_.push_back(result);
+         packages_.push_back(package);
+      }
+   }
+
+   const json::Array& results() const { return results_; }
+   const json::Array& packages() const { return packages_; }
+
+private:
+   std::string prefix_;
+   bool includeHidden_;
+   std::set<std::string> seen_;
+   json::Array results_;
+   json::Array packages_;
+};
+
+json::Object complete(const CompletionRequest& request,
+                      const IndexSnapshot& index)
+{
+   CompletionResults results(request.prefix);
+
+   // arguments of the function we're within
+   if (!request.function.empty() && request.package.empty())
+   {
+      const Names* pFormals = findFormals(request.function, index);
+      if (pFormals != NULL)
+      {
+         BOOST_FOREACH(const std::string& formal, *pFormals)
+         {
+            if (formal != "..." &&
+                boost::algorithm::starts_with(formal, request.prefix))
+            {
+               results.add(formal + "=", "");
+            }
+         }
+      }
+   }
+
+   if (!request.package.empty())
+   {
+      const PackageEntry* pEntry = findPackage(*index.pPackages,
+                                               request.package);
+      if (pEntry != NULL)
+         results.addMatching(pEntry->names, request.package + "::",
+                             request.package);
+   }
+   else if (!request.prefix.empty())
+   {
+      results.addMatching(*index.pGlobalNames, "", "");
+      results.addMatching(*index.pSourceNames, "", "");
+      BOOST_FOREACH(const boost::shared_ptr<const PackageEntry>& pEntry,
+                    *index.pPackages)
+      {
+         if (pEntry->attached)
+            results.addMatching(pEntry->names, "", pEntry->name);
+      }
+   }
+
+   // same shape as the completions computed by R (vectors are arrays)
+   json::Object result;
+   json::Array token;
+   token.push_back(request.token);
+   result["token"] = token;
+   result["results"] = results.results();
+   result["packages"] = results.packages();
+   if (!request.function.empty())
+   {
+      json::Array fguess;
+      fguess.push_back(request.function);
+      result["fguess"] = fguess;
+   }
+   else
+   {
+      result["fguess"] = json::Value();
+   }
+   return result;
+}
+
+bool readCompletionRequest(const json::JsonRpcRequest& request,
+                           std::string* pLine,
+                           int* pCursorPos,
+                           CompletionRequest* pCompletionRequest)
+{
+   Error error = json::readParams(request.params, pLine, pCursorPos);
+   if (error)
+      return false;
+
+   return parseCompletionRequest(*pLine, *pCursorPos, pCompletionRequest);
+}
+
+// called on an r-free rpc thread to decide whether a request can be
+// answered there (anything else goes to the main thread)
+bool canCompleteWithoutR(const json::JsonRpcRequest& request)
+{
+   std::string line;
+   int cursorPos;
+   CompletionRequest completionRequest;
+   if (!readCompletionRequest(request, &line, &cursorPos, &completionRequest))
+      return false;
+
+   return canComplete(completionRequest, indexSnapshot());
+}
+
+Error getCompletions(const json::JsonRpcRequest& request,
+                     json::JsonRpcResponse* pResponse)
+{
+   std::string line;
+   int cursorPos = 0;
+   CompletionRequest completionRequest;
+   if (readCompletionRequest(request, &line, &cursorPos, &completionRequest))
+   {
+      IndexSnapshot index = indexSnapshot();
+      if (canComplete(completionRequest, index))
+      {
+         pResponse->setResult(complete(completionRequest, index));
+         return Success();
+      }
+   }
+
+   // read the params again in case they were the problem
+   Error error = json::readParams(request.params, &line, &cursorPos);
+   if (error)
+      return error;
+
+   // everything else is completed by R (we are on the main thread since
+   // canCompleteWithoutR declined the request)
+   r::sexp::Protect rProtect;
+   SEXP completionsSEXP;
+   r::exec::RFunction func(".rs.getCompletions", line, cursorPos);
+   error = func.call(&completionsSEXP, &rProtect);
+   if (error)
+      return error;
+
+   json::Value completionsJson;
+   error = r::json::jsonValueFromObject(completionsSEXP, &completionsJson);
+   if (error)
+      return error;
+
+   pResponse->setResult(completionsJson);
+   return Success();
+}
+
+} // anonymous namespace
+
+void setGlobalEnvironmentNames(const std::vector<std::string>& names)
+{
+   Names namesCopy(names);
+   boost::shared_ptr<const Names> pGlobalNames = sortedNames(&namesCopy);
+   LOCK_MUTEX(s_indexMutex)
+   {
+      s_index.pGlobalNames = pGlobalNames;
+   }
+   END_LOCK_MUTEX
+}
+
+Error initialize()
+{
+   using namespace module_context;
+   events().onDetectChanges.connect(onDetectChanges);
+   events().onDeferredInit.connect(onDeferredInit);
+
+   return registerConditionalRFreeRpcMethod("get_completions",
+                                            getCompletions,
+                                            canCompleteWithoutR);
+}
+
+} // namespace completion
+} // namespace modules
+} // namesapce session
@@ -43,6 +43,16 @@ namespace console_process {
 
 namespace {
    const size_t OUTPUT_BUFFER_SIZE = 8192;
+
+   // window within which output is combined into a single client event
+   const int kOutputBatchMs = 50;
+
+   // stop reading output once this much of it hasn't been acknowledged by
+   // the client (and resume regardless if the client doesn't acknowledge
+   // anything for this long, e.g. because it missed the events)
+   const std::size_t kMaxUnackedOutputBytes = 256 * 1024;
+   const int kAckTimeoutSeconds = 30;
+
    typedef std::map<std::string, boost::shared_ptr<ConsoleProcess> > ProcTable;
    ProcTable s_procs;
 } // anonymous namespace
@@ -52,7 +62,9 @@ const int kDefaultMaxOutputLines = 500;
 ConsoleProcess::ConsoleProcess()
    : dialog_(false), showOnOutput_(false), interactionMode_(InteractionNever),
      maxOutputLines_(kDefaultMaxOutputLines), started_(true),
-     interrupt_(false), outputBuffer_(OUTPUT_BUFFER_SIZE)
+     interrupt_(false), outputBuffer_(OUTPUT_BUFFER_SIZE),
+     pendingOutputError_(false), nextOutputSequence_(0),
+     pendingOutputBytes_(0), unackedOutputBytes_(0)
 {
    regexInit();
 
@@ -71,7 +83,8 @@ ConsoleProcess::ConsoleProcess(const std::string& command,
      showOnOutput_(false),
      interactionMode_(interactionMode), maxOutputLines_(maxOutputLines),
      started_(false), interrupt_(false),
-     outputBuffer_(OUTPUT_BUFFER_SIZE)
+     outputBuffer_(OUTPUT_BUFFER_SIZE), pendingOutputError_(false),
+     nextOutputSequence_(0), pendingOutputBytes_(0), unackedOutputBytes_(0)
 {
    commonInit();
 }
@@ -87,7 +100,8 @@ ConsoleProcess::ConsoleProcess(const std::string& program,
      showOnOutput_(false),
      interactionMode_(interactionMode), maxOutputLines_(maxOutputLines),
      started_(false),  interrupt_(false),
-     outputBuffer_(OUTPUT_BUFFER_SIZE)
+     outputBuffer_(OUTPUT_BUFFER_SIZE), pendingOutputError_(false),
+     nextOutputSequence_(0), pendingOutputBytes_(0), unackedOutputBytes_(0)
 {
    commonInit();
 }
@@ -205,6 +219,22 @@ void ConsoleProcess::interrupt()
    interrupt_ = true;
 }
 
+void ConsoleProcess::ackOutput(int sequence)
+{
+   while (!unackedOutput_.empty() && unackedOutput_.front().first <= sequence)
+   {
+      unackedOutputBytes_ -= unackedOutput_.front().second;
+      unackedOutput_.pop_front();
+   }
+}
+
+void ConsoleProcess::resetFlowControl()
+{
+   unackedOutput_.clear();
+   unackedOutputBytes_ = 0;
+   outputPausedTime_ = boost::posix_time::ptime();
+}
+
 bool ConsoleProcess::onContinue(core::system::ProcessOperations& ops)
 {
    // full stop interrupt if requested
@@ -251,9 +281,46 @@ bool ConsoleProcess::onContinue(core::system::ProcessOperations& ops)
    return true;
 }
 
+bool ConsoleProcess::onReadyForOutput(core::system::ProcessOperations& ops)
+{
+   using namespace boost::posix_time;
+
+   // always drain the output of an interrupted process (so that we see
+   // it exit)
+   if (interrupt_ ||
+       (unackedOutputBytes_ + pendingOutputBytes_) < kMaxUnackedOutputBytes)
+   {
+      outputPausedTime_ = ptime();
+      return true;
+   }
+
+   // the process blocks once its output fills the pipe so we can hold it
+   // there until the client catches up
+   ptime now = microsec_clock::universal_time();
+   if (outputPausedTime_.is_not_a_date_time())
+      outputPausedTime_ = now;
+
+   if ((now - outputPausedTime_) >= seconds(kAckTimeoutSeconds))
+   {
+      resetFlowControl();
+      return true;
+   }
+
+   return false;
+}
+
 void ConsoleProcess::appendToOutputBuffer(const std::string &str)
 {
-   std::copy(str.begin(), str.end(), std::back_inserter(outputBuffer_));
+   // write in bulk (only the tail of the string can survive anyway)
+   std::size_t capacity = outputBuffer_.capacity();
+   if (str.size() >= capacity)
+   {
+      outputBuffer_.assign(str.end() - capacity, str.end());
+   }
+   else
+   {
+      outputBuffer_.insert(outputBuffer_.end(), str.begin(), str.end());
+   }
 }
 
 void ConsoleProcess::enqueOutputEvent(const std::string &output, bool error)
@@ -261,16 +328,53 @@ void ConsoleProcess::enqueOutputEvent(const std::string &output, bool error)
    // copy to output buffer
    appendToOutputBuffer(output);
 
+   // output is accumulated and sent as a single event once the batching
+   // window elapses (chatty processes otherwise produce thousands of events)
+   if (!pendingOutput_.empty() && pendingOutputError_ != error)
+      flushPendingOutput();
+
+   if (pendingOutput_.empty())
+   {
+      module_context::scheduleDelayedWork(
+            boost::posix_time::milliseconds(kOutputBatchMs),
+            boost::bind(&ConsoleProcess::flushPendingOutput,
+                        ConsoleProcess::shared_from_this()),
+            false,
+            module_context::WorkPriorityHigh);
+   }
+
+   pendingOutput_.append(output);
+   pendingOutputBytes_ += output.size();
+   pendingOutputError_ = error;
+}
+
+void ConsoleProcess::flushPendingOutput()
+{
+   if (pendingOutput_.empty())
+      return;
+
+   json::Object data;
+   data["handle"] = handle_;
+   data["error"] = pendingOutputError_;
+
    // If there's more output than the client can even show, then
    // truncate it to the amount that the client can show. Too much
    // output can overwhelm the client, making it unresponsive.
-   std::string trimmedOutput = output;
-   string_utils::trimLeadingLines(maxOutputLines_, &trimmedOutput);
+   // (trimLeadingLines never trims output shorter than this)
+   if (pendingOutput_.length() > static_cast<std::size_t>(maxOutputLines_ * 2))
+      string_utils::trimLeadingLines(maxOutputLines_, &pendingOutput_);
+   data["output"] = pendingOutput_;
+   pendingOutput_.clear();
+
+   // the client acknowledges output by sequence number. we account for
+   // everything that was read for the event (rather than what remains
+   // after truncation) so that flow control limits the process itself
+   int sequence = nextOutputSequence_++;
+   data["seq"] = sequence;
+   unackedOutput_.push_back(std::make_pair(sequence, pendingOutputBytes_));
+   unackedOutputBytes_ += pendingOutputBytes_;
+   pendingOutputBytes_ = 0;
 
-   json::Object data;
-   data["handle"] = handle_;
-   data["error"] = error;
-   data["output"] = trimmedOutput;
    module_context::enqueClientEvent(
          ClientEvent(client_events::kConsoleProcessOutput, data));
 }
@@ -278,10 +382,16 @@ void ConsoleProcess::enqueOutputEvent(const std::string &output, bool error)
 void ConsoleProcess::onStdout(core::system::ProcessOperations& ops,
                               const std::string& output)
 {
-   // convert line endings to posix
-   std::string posixOutput = output;
-   string_utils::convertLineEndings(&posixOutput,
-                                    string_utils::LineEndingPosix);
+   // convert line endings to posix (only copy if there is a \r to remove)
+   std::string convertedOutput;
+   if (output.find('\r') != std::string::npos)
+   {
+      convertedOutput = output;
+      string_utils::convertLineEndings(&convertedOutput,
+                                       string_utils::LineEndingPosix);
+   }
+   const std::string& posixOutput =
+                     convertedOutput.empty() ? output : convertedOutput;
 
    // process as normal output or detect a prompt if there is one
    if (boost::algorithm::ends_with(posixOutput, "\n"))
@@ -349,7 +459,8 @@ void ConsoleProcess::handleConsolePrompt(core::system::ProcessOperations& ops,
 
    }
 
-   // enque a prompt event
+   // enque a prompt event (after any output which preceded it)
+   flushPendingOutput();
    json::Object data;
    data["handle"] = handle_;
    data["prompt"] = prompt;
@@ -361,6 +472,8 @@ void ConsoleProcess::onExit(int exitCode)
 {
    exitCode_.reset(exitCode);
 
+   flushPendingOutput();
+
    json::Object data;
    data["handle"] = handle_;
    data["exitCode"] = exitCode;
@@ -414,8 +527,7 @@ boost::shared_ptr<ConsoleProcess> ConsoleProcess::fromJson(
       pProc->maxOutputLines_ = kDefaultMaxOutputLines;
 
    std::string bufferedOutput = obj["buffered_output"].get_str();
-   std::copy(bufferedOutput.begin(), bufferedOutput.end(),
-             std::back_inserter(pProc->outputBuffer_));
+   pProc->appendToOutputBuffer(bufferedOutput);
    json::Value exitCode = obj["exit_code"];
    if (exitCode.is_null())
       pProc->exitCode_.reset();
@@ -429,6 +541,7 @@ core::system::ProcessCallbacks ConsoleProcess::createProcessCallbacks()
 {
    core::system::ProcessCallbacks cb;
    cb.onContinue = boost::bind(&ConsoleProcess::onContinue, ConsoleProcess::shared_from_this(), _1);
+   cb.onReadyForOutput = boost::bind(&ConsoleProcess::onReadyForOutput, ConsoleProcess::shared_from_this(), _1);
    cb.onStdout = boost::bind(&ConsoleProcess::onStdout, ConsoleProcess::shared_from_this(), _1, _2);
    cb.onExit = boost::bind(&ConsoleProcess::onExit, ConsoleProcess::shared_from_this(), _1);
    return cb;
@@ -535,6 +648,23 @@ Error procWriteStdin(const json::JsonRpcRequest& request,
    }
 }
 
+Error procAckOutput(const json::JsonRpcRequest& request,
+                     json::JsonRpcResponse* pResponse)
+{
+   std::string handle;
+   int sequence;
+   Error error = json::readParams(request.params, &handle, &sequence);
+   if (error)
+      return error;
+
+   // (acks can arrive after the process has been reaped)
+   ProcTable::const_iterator pos = s_procs.find(handle);
+   if (pos != s_procs.end())
+      pos->second->ackOutput(sequence);
+
+   return Success();
+}
+
 boost::shared_ptr<ConsoleProcess> ConsoleProcess::create(
       const std::string& command,
       core::system::ProcessOptions options,
@@ -695,11 +825,14 @@ bool PasswordManager::forgetOnExit(const CachedPassword& cachedPassword,
 
 core::json::Array processesAsJson()
 {
+   // a (re)connecting client starts over with the buffered output so it
+   // won't be acknowledging any earlier output events
    json::Array procInfos;
    for (ProcTable::const_iterator it = s_procs.begin();
         it != s_procs.end();
         it++)
    {
+      it->second->resetFlowControl();
       procInfos.push_back(it->second->toJson());
    }
    return procInfos;
@@ -755,7 +888,8 @@ Error initialize()
       (bind(registerRpcMethod, "process_start", procStart))
       (bind(registerRpcMethod, "process_interrupt", procInterrupt))
       (bind(registerRpcMethod, "process_reap", procReap))
-      (bind(registerRpcMethod, "process_write_stdin", procWriteStdin));
+      (bind(registerRpcMethod, "process_write_stdin", procWriteStdin))
+      (bind(registerRpcMethod, "process_ack_output", procAckOutput));
 
    return initBlock.execute();
 }
@@ -15,12 +15,14 @@
 #ifndef SESSION_CONSOLE_PROCESS_HPP
 #define SESSION_CONSOLE_PROCESS_HPP
 
+#include <deque>
 #include <queue>
 
 #include <boost/regex.hpp>
 #include <boost/signals.hpp>
 #include <boost/circular_buffer.hpp>
 #include <boost/enable_shared_from_this.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 
 #include <core/system/Process.hpp>
 #include <core/Log.hpp>
@@ -129,6 +131,11 @@ public:
    void enqueInput(const Input& input);
    void interrupt();
 
+   // the client acknowledges output events as it handles them (we stop
+   // reading output when too much of it is unacknowledged)
+   void ackOutput(int sequence);
+   void resetFlowControl();
+
    void setShowOnOutput(bool showOnOutput) { showOnOutput_ = showOnOutput; }
 
    core::json::Object toJson() const;
@@ -138,6 +145,7 @@ public:
 private:
    core::system::ProcessCallbacks createProcessCallbacks();
    bool onContinue(core::system::ProcessOperations& ops);
+   bool onReadyForOutput(core::system::ProcessOperations& ops);
    void onStdout(core::system::ProcessOperations& ops,
                  const std::string& output);
    void onExit(int exitCode);
@@ -145,6 +153,7 @@ private:
    std::string bufferedOutput() const;
    void appendToOutputBuffer(const std::string& str);
    void enqueOutputEvent(const std::string& output, bool error);
+   void flushPendingOutput();
    void handleConsolePrompt(core::system::ProcessOperations& ops,
                             const std::string& prompt);
    void maybeConsolePrompt(core::system::ProcessOperations& ops,
@@ -179,6 +188,19 @@ private:
    // to recover some history
    boost::circular_buffer<char> outputBuffer_;
 
+   // Output not yet sent to the client (sent in batches)
+   std::string pendingOutput_;
+   bool pendingOutputError_;
+
+   // Flow control: bytes of output read for each output event which the
+   // client hasn't acknowledged yet (by sequence number), along with when
+   // we stopped reading because of them
+   int nextOutputSequence_;
+   std::size_t pendingOutputBytes_;
+   std::size_t unackedOutputBytes_;
+   std::deque<std::pair<int,std::size_t> > unackedOutput_;
+   boost::posix_time::ptime outputPausedTime_;
+
    boost::optional<int> exitCode_;
 
    boost::function<bool(const std::string&, Input*)> onPrompt_;
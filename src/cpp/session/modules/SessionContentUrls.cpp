@@ -96,6 +96,38 @@ Error contentFileInfo(const std::string& contentUrl,
    return Success();
 }
 
+// bytes of a text file which are examined when guessing its encoding
+const std::size_t kEncodingSniffBytes = 64 * 1024;
+
+bool looksLikeUtf8(const FilePath& filePath)
+{
+   boost::shared_ptr<std::istream> pStream;
+   Error error = filePath.open_r(&pStream);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return true;
+   }
+
+   std::string contents(kEncodingSniffBytes, '\0');
+   pStream->read(&contents[0], contents.size());
+   contents.resize(pStream->gcount());
+   bool truncated = contents.size() == kEncodingSniffBytes;
+
+   if (string_utils::isValidUtf8(contents))
+      return true;
+
+   // a multi-byte character split by the end of the sample is fine
+   for (std::size_t trim = 1; truncated && trim < 4; trim++)
+   {
+      const char* begin = contents.data();
+      if (contents.size() > trim &&
+          string_utils::isValidUtf8(begin, begin + contents.size() - trim))
+         return true;
+   }
+
+   return false;
+}
 
 } // anonymous namespace
 
@@ -150,32 +182,25 @@ void handleContentRequest(const http::Request& request, http::Response* pRespons
    // set private cache forever headers
    pResponse->setPrivateCacheForeverHeaders();
 
+   // non-text content (images, pdfs, media, etc.) is streamed from disk so
+   // that viewers can request just the byte ranges they need
+   std::string mimeType = contentFilePath.mimeContentType();
+   if (!boost::algorithm::starts_with(mimeType, "text/"))
+   {
+      pResponse->setRangeableFile(contentFilePath, request);
+      pResponse->setHeader("Title", title);
+      return;
+   }
+
    // set file
    pResponse->setFile(contentFilePath, request);
 
-   bool isUtf8 = true;
-   if (boost::algorithm::starts_with(contentFilePath.mimeContentType(), "text/"))
-   {
-      // If the content looks like valid UTF-8, assume it is. Otherwise, assume
-      // it's the system encoding.
-      std::string contents;
-      error = core::readStringFromFile(contentFilePath, &contents);
-      if (!error)
-      {
-         for (std::string::iterator pos = contents.begin(); pos != contents.end(); )
-         {
-            error = string_utils::utf8Advance(pos, 1, contents.end(), &pos);
-            if (error)
-            {
-               isUtf8 = false;
-               break;
-            }
-         }
-      }
-   }
+   // If the content looks like valid UTF-8, assume it is. Otherwise, assume
+   // it's the system encoding.
+   bool isUtf8 = looksLikeUtf8(contentFilePath);
 
    // reset content-type with charset
-   pResponse->setContentType(contentFilePath.mimeContentType() +
+   pResponse->setContentType(mimeType +
                              std::string("; charset=") +
                              (isUtf8 ? "UTF-8" : ::locale2charset(NULL)));
 
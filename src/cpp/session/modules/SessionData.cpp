@@ -15,18 +15,30 @@
 
 #include "SessionData.hpp"
 
+#include <algorithm>
+#include <cstring>
+#include <list>
 #include <string>
 #include <vector>
 #include <sstream>
 
 #include <boost/bind.hpp>
 #include <boost/format.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/algorithm/string/replace.hpp>
 
 #include <core/Log.hpp>
 #include <core/Error.hpp>
 #include <core/Exec.hpp>
 #include <core/FileSerializer.hpp>
+#include <core/SafeConvert.hpp>
 #include <core/StringUtils.hpp>
+#include <core/http/Request.hpp>
+#include <core/http/Response.hpp>
+#include <core/BoostThread.hpp>
+#include <core/Thread.hpp>
+#include <core/system/System.hpp>
 
 #define R_INTERNAL_FUNCTIONS
 #include <r/RInternal.hpp>
@@ -48,36 +60,893 @@ namespace modules {
 namespace data {
 
 namespace {   
-     
-void appendTag(std::string* pHTML,
-               const std::string& text,
-               const std::string& tag,
-               const std::string& className = std::string())
+
+// maximum size of a single viewport request
+const int kMaxViewportRows = 500;
+const int kMaxViewportColumns = 100;
+
+// size of the viewport rendered into the page itself (so that the page
+// is still useful if the data is no longer available for paging)
+const int kInitialRows = 100;
+const int kInitialColumns = 50;
+
+// number of data sets kept available for paging (the least recently
+// viewed are released first)
+const std::size_t kMaxViewedData = 10;
+
+// number of (equal width) bins in the histograms of numeric columns
+const int kHistogramBins = 10;
+
+// distinct counts are HyperLogLog estimates using 2^12 registers (a
+// standard error of about 1.6%)
+const int kDistinctPrecision = 12;
+const int kDistinctRegisters = 1 << kDistinctPrecision;
+
+// columns are summarized in parallel once there are enough values
+const std::size_t kMinParallelValues = 1000000;
+const std::size_t kMaxStatsThreads = 8;
+
+inline char asciiToLower(char ch)
+{
+   return (ch >= 'A' && ch <= 'Z') ? static_cast<char>(ch - 'A' + 'a') : ch;
+}
+
+bool containsIgnoreCase(const std::string& text, const std::string& lowerTerm)
+{
+   std::string lowerText(text);
+   std::transform(lowerText.begin(), lowerText.end(), lowerText.begin(),
+                  asciiToLower);
+   return lowerText.find(lowerTerm) != std::string::npos;
+}
+
+// orders rows by the values within a numeric column (NA always last)
+class NumericRowLess
+{
+public:
+   NumericRowLess(SEXP columnSEXP, bool ascending)
+      : pValues_(REAL(columnSEXP)),
+        length_(r::sexp::length(columnSEXP)),
+        ascending_(ascending)
+   {
+   }
+
+   bool operator()(int lhs, int rhs) const
+   {
+      bool lhsNA = lhs >= length_ || ISNAN(pValues_[lhs]);
+      bool rhsNA = rhs >= length_ || ISNAN(pValues_[rhs]);
+      if (lhsNA || rhsNA)
+         return !lhsNA && rhsNA;
+      else if (ascending_)
+         return pValues_[lhs] < pValues_[rhs];
+      else
+         return pValues_[rhs] < pValues_[lhs];
+   }
+
+private:
+   const double* pValues_;
+   int length_;
+   bool ascending_;
+};
+
+// orders rows by the values within a character column (NA always last).
+// note that this is a bytewise rather than locale aware comparison
+class StringRowLess
+{
+public:
+   StringRowLess(SEXP columnSEXP, bool ascending)
+      : columnSEXP_(columnSEXP),
+        length_(r::sexp::length(columnSEXP)),
+        ascending_(ascending)
+   {
+   }
+
+   bool operator()(int lhs, int rhs) const
+   {
+      SEXP lhsSEXP = lhs < length_ ? STRING_ELT(columnSEXP_, lhs) : NA_STRING;
+      SEXP rhsSEXP = rhs < length_ ? STRING_ELT(columnSEXP_, rhs) : NA_STRING;
+      bool lhsNA = lhsSEXP == NA_STRING;
+      bool rhsNA = rhsSEXP == NA_STRING;
+      if (lhsNA || rhsNA)
+         return !lhsNA && rhsNA;
+      else if (ascending_)
+         return std::strcmp(CHAR(lhsSEXP), CHAR(rhsSEXP)) < 0;
+      else
+         return std::strcmp(CHAR(rhsSEXP), CHAR(lhsSEXP)) < 0;
+   }
+
+private:
+   SEXP columnSEXP_;
+   int length_;
+   bool ascending_;
+};
+
+// column summaries -------------------------------------------------------
+
+struct ColumnStats
+{
+   ColumnStats()
+      : computed(false), numeric(false), naCount(0), count(0),
+        min(0), max(0), mean(0), distinct(0)
+   {
+   }
+
+   bool computed;
+   bool numeric;
+   int naCount;
+   int count;
+
+   // numeric columns only (and only if there are non-NA values)
+   double min;
+   double max;
+   double mean;
+   std::vector<int> histogram;
+
+   double distinct;
+};
+
+// finalizer of the splitmix64 generator (spreads the bits of values which
+// are close together, e.g. consecutive integers or pointers)
+inline boost::uint64_t mixBits(boost::uint64_t x)
+{
+   x ^= x >> 30;
+   x *= static_cast<boost::uint64_t>(0xbf58476d1ce4e5b9ULL);
+   x ^= x >> 27;
+   x *= static_cast<boost::uint64_t>(0x94d049bb133111ebULL);
+   x ^= x >> 31;
+   return x;
+}
+
+class DistinctEstimator
+{
+public:
+   DistinctEstimator()
+      : registers_(kDistinctRegisters, 0)
+   {
+   }
+
+   void add(boost::uint64_t value)
+   {
+      boost::uint64_t hash = mixBits(value);
+      std::size_t index = static_cast<std::size_t>(
+                                       hash >> (64 - kDistinctPrecision));
+
+      // rank of the first set bit within the remaining bits
+      const boost::uint64_t topBit = static_cast<boost::uint64_t>(1) << 63;
+      boost::uint64_t rest = hash << kDistinctPrecision;
+      unsigned char rank = 1;
+      while (!(rest & topBit) && rank <= 64 - kDistinctPrecision)
+      {
+         rest <<= 1;
+         rank++;
+      }
+
+      if (rank > registers_[index])
+         registers_[index] = rank;
+   }
+
+   double estimate() const
+   {
+      double m = kDistinctRegisters;
+      double sum = 0;
+      int zeros = 0;
+      for (int i = 0; i < kDistinctRegisters; i++)
+      {
+         sum += std::ldexp(1.0, -registers_[i]);
+         if (registers_[i] == 0)
+            zeros++;
+      }
+
+      double estimate = (0.7213 / (1 + 1.079 / m)) * m * m / sum;
+
+      // small cardinalities are better estimated by linear counting
+      if (estimate <= 2.5 * m && zeros > 0)
+         estimate = m * std::log(m / zeros);
+
+      return std::floor(estimate + 0.5);
+   }
+
+private:
+   std::vector<unsigned char> registers_;
+};
+
+inline bool isNAValue(double value) { return ISNAN(value); }
+inline bool isNAValue(int value) { return value == NA_INTEGER; }
+
+inline boost::uint64_t valueBits(double value)
+{
+   // (0 and -0 are the same value)
+   if (value == 0)
+      value = 0;
+   boost::uint64_t bits;
+   std::memcpy(&bits, &value, sizeof(bits));
+   return bits;
+}
+
+inline boost::uint64_t valueBits(int value)
+{
+   return static_cast<boost::uint64_t>(static_cast<unsigned int>(value));
+}
+
+// summarize a numeric (or integer or logical) column. the range, sum and
+// NA count are accumulated across several independent lanes to keep the
+// loop free of dependencies between consecutive values (so the compiler
+// can interleave and vectorize them)
+template <typename T>
+void summarizeNumeric(const T* pValues, int length, ColumnStats* pStats)
+{
+   const int kLanes = 4;
+   double sum[kLanes], min[kLanes], max[kLanes];
+   int naCount[kLanes];
+   for (int lane = 0; lane < kLanes; lane++)
+   {
+      sum[lane] = 0;
+      min[lane] = R_PosInf;
+      max[lane] = R_NegInf;
+      naCount[lane] = 0;
+   }
+
+   int i = 0;
+   for (; i + kLanes <= length; i += kLanes)
+   {
+      for (int lane = 0; lane < kLanes; lane++)
+      {
+         T value = pValues[i + lane];
+         if (isNAValue(value))
+         {
+            naCount[lane]++;
+         }
+         else
+         {
+            double x = value;
+            sum[lane] += x;
+            min[lane] = std::min(min[lane], x);
+            max[lane] = std::max(max[lane], x);
+         }
+      }
+   }
+   for (; i < length; i++)
+   {
+      T value = pValues[i];
+      if (isNAValue(value))
+      {
+         naCount[0]++;
+      }
+      else
+      {
+         double x = value;
+         sum[0] += x;
+         min[0] = std::min(min[0], x);
+         max[0] = std::max(max[0], x);
+      }
+   }
+
+   for (int lane = 1; lane < kLanes; lane++)
+   {
+      sum[0] += sum[lane];
+      min[0] = std::min(min[0], min[lane]);
+      max[0] = std::max(max[0], max[lane]);
+      naCount[0] += naCount[lane];
+   }
+
+   pStats->numeric = true;
+   pStats->naCount = naCount[0];
+   pStats->count = length - naCount[0];
+   int count = pStats->count;
+   if (count > 0)
+   {
+      pStats->min = min[0];
+      pStats->max = max[0];
+      pStats->mean = sum[0] / count;
+   }
+
+   // histogram (only for a finite range) and distinct values
+   DistinctEstimator distinct;
+   bool histogram = count > 0 && R_FINITE(min[0]) && R_FINITE(max[0]);
+   double width = (max[0] - min[0]) / kHistogramBins;
+   if (histogram)
+      pStats->histogram.assign(kHistogramBins, 0);
+   for (i = 0; i < length; i++)
+   {
+      T value = pValues[i];
+      if (isNAValue(value))
+         continue;
+
+      distinct.add(valueBits(value));
+
+      double x = value;
+      if (histogram && R_FINITE(x))
+      {
+         int bin = width > 0 ? static_cast<int>((x - min[0]) / width) : 0;
+         pStats->histogram[std::min(bin, kHistogramBins - 1)]++;
+      }
+   }
+   pStats->distinct = distinct.estimate();
+}
+
+// summarize a character column. identical strings share a CHARSXP (R keeps
+// a global cache of them) so values are told apart by address
+void summarizeStrings(const SEXP* pValues,
+                      int length,
+                      SEXP naString,
+                      ColumnStats* pStats)
+{
+   DistinctEstimator distinct;
+   int naCount = 0;
+   for (int i = 0; i < length; i++)
+   {
+      if (pValues[i] == naString)
+         naCount++;
+      else
+         distinct.add(reinterpret_cast<std::size_t>(pValues[i]));
+   }
+
+   pStats->naCount = naCount;
+   pStats->count = length - naCount;
+   pStats->distinct = distinct.estimate();
+}
+
+// the values of a column (these are accessed off the main thread so they
+// are resolved up front; the summaries themselves don't touch R)
+struct ColumnValues
+{
+   ColumnValues()
+      : type(NILSXP), pValues(NULL), length(0), naString(NULL)
+   {
+   }
+
+   explicit ColumnValues(SEXP columnSEXP)
+      : type(TYPEOF(columnSEXP)),
+        pValues(NULL),
+        length(r::sexp::length(columnSEXP)),
+        naString(NA_STRING)
+   {
+      switch (type)
+      {
+         case REALSXP:
+            pValues = REAL(columnSEXP);
+            break;
+         case INTSXP:
+            pValues = INTEGER(columnSEXP);
+            break;
+         case LGLSXP:
+            pValues = LOGICAL(columnSEXP);
+            break;
+         case STRSXP:
+            pValues = STRING_PTR(columnSEXP);
+            break;
+      }
+   }
+
+   int type;
+   const void* pValues;
+   int length;
+   SEXP naString;
+};
+
+void summarizeColumn(const ColumnValues& values, ColumnStats* pStats)
 {
-   std::string classAttrib;
-   if (!className.empty())
-      classAttrib = " class=\"" + className + "\"";
-
-   boost::format fmt("<%1%%2%>%3%</%1%>");
-   pHTML->append(boost::str(fmt % tag %
-                                  classAttrib %
-                                  string_utils::textToHtml(text)));
+   switch (values.type)
+   {
+      case REALSXP:
+         summarizeNumeric(static_cast<const double*>(values.pValues),
+                          values.length, pStats);
+         break;
+      case INTSXP:
+      case LGLSXP:
+         summarizeNumeric(static_cast<const int*>(values.pValues),
+                          values.length, pStats);
+         break;
+      case STRSXP:
+         summarizeStrings(static_cast<const SEXP*>(values.pValues),
+                          values.length, values.naString, pStats);
+         break;
+   }
+   pStats->computed = true;
 }
 
-void appendTD(std::string* pHTML,
-              const std::string& text,
-              const std::string& className = std::string())
+// summarize every stride'th column starting with the first'th
+void summarizeColumnSlice(const std::vector<ColumnValues>& values,
+                          std::size_t first,
+                          std::size_t stride,
+                          std::vector<ColumnStats>* pStats)
 {
-   appendTag(pHTML, text, "td", className);
+   for (std::size_t i = first; i < values.size(); i += stride)
+      summarizeColumn(values[i], &(*pStats)[i]);
 }
 
-void appendTH(std::string* pHTML, const std::string& text)
+void summarizeColumns(const std::vector<ColumnValues>& values,
+                      std::vector<ColumnStats>* pStats)
 {
-   appendTag(pHTML, text, "th");
+   pStats->assign(values.size(), ColumnStats());
+
+   std::size_t totalValues = 0;
+   for (std::size_t i = 0; i < values.size(); i++)
+      totalValues += values[i].length;
+
+   std::size_t threads = std::min<std::size_t>(
+                           std::min<std::size_t>(
+                                    boost::thread::hardware_concurrency(),
+                                    kMaxStatsThreads),
+                           values.size());
+   if (totalValues < kMinParallelValues || threads < 2)
+   {
+      summarizeColumnSlice(values, 0, 1, pStats);
+      return;
+   }
+
+   std::vector<boost::shared_ptr<boost::thread> > workers;
+   for (std::size_t i = 1; i < threads; i++)
+   {
+      boost::function<void()> work = boost::bind(summarizeColumnSlice,
+                                                 boost::cref(values),
+                                                 i,
+                                                 threads,
+                                                 pStats);
+
+      boost::shared_ptr<boost::thread> pThread(new boost::thread());
+      core::thread::safeLaunchThread(work, pThread.get());
+      if (pThread->joinable())
+         workers.push_back(pThread);
+      else
+         work();
+   }
+
+   summarizeColumnSlice(values, 0, threads, pStats);
+
+   for (std::size_t i = 0; i < workers.size(); i++)
+      workers[i]->join();
 }
 
+// json for numbers which may not be finite (which json can't represent)
+json::Value numberAsJson(double value)
+{
+   if (R_FINITE(value))
+      return value;
+   else if (ISNAN(value))
+      return std::string("NaN");
+   else
+      return std::string(value > 0 ? "Inf" : "-Inf");
+}
 
-SEXP rs_viewData(SEXP dataSEXP, SEXP captionSEXP)
+json::Object columnStatsAsJson(const ColumnStats& stats,
+                               const std::string& type)
+{
+   json::Object statsJson;
+   statsJson["type"] = type;
+   statsJson["na"] = stats.naCount;
+   statsJson["distinct"] = stats.distinct;
+   if (stats.numeric && stats.count > 0)
+   {
+      statsJson["min"] = numberAsJson(stats.min);
+      statsJson["max"] = numberAsJson(stats.max);
+      statsJson["mean"] = numberAsJson(stats.mean);
+
+      json::Array histogramJson;
+      std::copy(stats.histogram.begin(),
+                stats.histogram.end(),
+                std::back_inserter(histogramJson));
+      statsJson["histogram"] = histogramJson;
+   }
+   return statsJson;
+}
+
+// a data set passed to View. the data is retained so that the client can
+// request viewports of it (formatted on demand) and sort and filter it
+class ViewedData : boost::noncopyable
+{
+public:
+   ViewedData(SEXP dataSEXP,
+              const std::vector<std::string>& columnNames,
+              const std::vector<std::string>& columnTypes)
+      : data_(dataSEXP),
+        columnNames_(columnNames),
+        columnTypes_(columnTypes),
+        rowCount_(0),
+        hasIndex_(false),
+        sortColumn_(-1),
+        ascending_(true),
+        filterColumn_(-1)
+   {
+      // calculate # of rows based on the maximum # of elements in a single
+      // column (technically R can pass columns which have a disparate # of
+      // rows to this method)
+      for (std::size_t i = 0; i < columnNames_.size(); i++)
+      {
+         int columnLength = r::sexp::length(VECTOR_ELT(dataSEXP, i));
+         columnLengths_.push_back(columnLength);
+         rowCount_ = std::max(columnLength, rowCount_);
+      }
+      columnTypes_.resize(columnNames_.size());
+   }
+
+   // COPYING: prohibited
+
+   int rowCount() const { return rowCount_; }
+   int columnCount() const { return static_cast<int>(columnNames_.size()); }
+   const std::vector<std::string>& columnNames() const { return columnNames_; }
+
+   // get the rows within the viewport (in display order) for the specified
+   // sort and filter. a sort/filter index is built on demand and cached
+   // for the most recently requested sort/filter
+   void viewportRows(int sortColumn,
+                     bool ascending,
+                     int filterColumn,
+                     const std::string& filter,
+                     int firstRow,
+                     int rowCount,
+                     std::vector<int>* pRows,
+                     int* pTotalRows)
+   {
+      if (sortColumn >= columnCount())
+         sortColumn = -1;
+      if (filterColumn >= columnCount() || filter.empty())
+         filterColumn = -1;
+
+      // no index necessary if we aren't sorting or filtering
+      if (sortColumn < 0 && filterColumn < 0)
+      {
+         *pTotalRows = rowCount_;
+         for (int row = firstRow; row < std::min(firstRow + rowCount, rowCount_); row++)
+            pRows->push_back(row);
+         return;
+      }
+
+      if (!hasIndex_ ||
+          sortColumn != sortColumn_ ||
+          ascending != ascending_ ||
+          filterColumn != filterColumn_ ||
+          filter != filter_)
+      {
+         buildIndex(sortColumn, ascending, filterColumn, filter);
+      }
+
+      int totalRows = static_cast<int>(index_.size());
+      *pTotalRows = totalRows;
+      for (int i = firstRow; i < std::min(firstRow + rowCount, totalRows); i++)
+         pRows->push_back(index_[i]);
+   }
+
+   // format the values of a column at the specified rows
+   Error formatColumn(int column,
+                      const std::vector<int>& rows,
+                      std::vector<std::string>* pValues) const
+   {
+      SEXP columnSEXP = VECTOR_ELT(data_.get(), column);
+      int columnType = TYPEOF(columnSEXP);
+      if (columnType != REALSXP && columnType != STRSXP)
+         return Error(json::errc::ParamInvalid, ERROR_LOCATION);
+
+      // extract the values at the requested rows
+      int length = columnLengths_[column];
+      r::sexp::Protect rProtect;
+      SEXP subsetSEXP = Rf_allocVector(columnType, rows.size());
+      rProtect.add(subsetSEXP);
+      for (std::size_t i = 0; i < rows.size(); i++)
+      {
+         int row = rows[i];
+         if (columnType == REALSXP)
+            REAL(subsetSEXP)[i] = row < length ? REAL(columnSEXP)[row] : NA_REAL;
+         else
+            SET_STRING_ELT(subsetSEXP, i, row < length ?
+                                 STRING_ELT(columnSEXP, row) : NA_STRING);
+      }
+
+      // format them for presentation
+      SEXP formattedSEXP;
+      r::exec::RFunction formatFx(".rs.formatDataColumn");
+      formatFx.addParam(subsetSEXP);
+      formatFx.addParam(static_cast<int>(rows.size()));
+      Error error = formatFx.call(&formattedSEXP, &rProtect);
+      if (error)
+         return error;
+
+      for (std::size_t i = 0; i < rows.size(); i++)
+      {
+         SEXP stringSEXP = STRING_ELT(formattedSEXP, i);
+         if (rows[i] < length &&
+             stringSEXP != NULL &&
+             stringSEXP != NA_STRING &&
+             r::sexp::length(stringSEXP) > 0)
+         {
+            pValues->push_back(Rf_translateCharUTF8(stringSEXP));
+         }
+         else
+         {
+            pValues->push_back(std::string());
+         }
+      }
+
+      return Success();
+   }
+
+   // summaries of the specified columns. these are computed on demand and
+   // cached (the data is a snapshot taken by View so they never go stale)
+   void columnStats(int firstColumn, int count, json::Array* pStatsJson)
+   {
+      int lastColumn = std::min(firstColumn + count, columnCount());
+      stats_.resize(columnNames_.size());
+
+      std::vector<int> columns;
+      std::vector<ColumnValues> values;
+      for (int column = firstColumn; column < lastColumn; column++)
+      {
+         if (!stats_[column].computed)
+         {
+            columns.push_back(column);
+            values.push_back(ColumnValues(VECTOR_ELT(data_.get(), column)));
+         }
+      }
+
+      std::vector<ColumnStats> stats;
+      summarizeColumns(values, &stats);
+      for (std::size_t i = 0; i < columns.size(); i++)
+         stats_[columns[i]] = stats[i];
+
+      for (int column = firstColumn; column < lastColumn; column++)
+      {
+         pStatsJson->push_back(columnStatsAsJson(stats_[column],
+                                                 columnTypes_[column]));
+      }
+   }
+
+private:
+
+   void buildIndex(int sortColumn,
+                   bool ascending,
+                   int filterColumn,
+                   const std::string& filter)
+   {
+      std::vector<int> index;
+
+      // filter (case insensitive substring match)
+      if (filterColumn >= 0)
+      {
+         std::string lowerFilter(filter);
+         std::transform(lowerFilter.begin(), lowerFilter.end(),
+                        lowerFilter.begin(), asciiToLower);
+
+         SEXP columnSEXP = VECTOR_ELT(data_.get(), filterColumn);
+         int length = columnLengths_[filterColumn];
+         bool isNumeric = TYPEOF(columnSEXP) == REALSXP;
+         for (int row = 0; row < length; row++)
+         {
+            if (isNumeric)
+            {
+               double value = REAL(columnSEXP)[row];
+               if (!ISNAN(value) &&
+                   containsIgnoreCase(safe_convert::numberToString(value),
+                                      lowerFilter))
+               {
+                  index.push_back(row);
+               }
+            }
+            else
+            {
+               SEXP stringSEXP = STRING_ELT(columnSEXP, row);
+               if (stringSEXP != NA_STRING &&
+                   containsIgnoreCase(CHAR(stringSEXP), lowerFilter))
+               {
+                  index.push_back(row);
+               }
+            }
+         }
+      }
+      else
+      {
+         index.reserve(rowCount_);
+         for (int row = 0; row < rowCount_; row++)
+            index.push_back(row);
+      }
+
+      // sort (stable so that ties keep their original order)
+      if (sortColumn >= 0)
+      {
+         SEXP columnSEXP = VECTOR_ELT(data_.get(), sortColumn);
+         if (TYPEOF(columnSEXP) == REALSXP)
+         {
+            std::stable_sort(index.begin(), index.end(),
+                             NumericRowLess(columnSEXP, ascending));
+         }
+         else if (TYPEOF(columnSEXP) == STRSXP)
+         {
+            std::stable_sort(index.begin(), index.end(),
+                             StringRowLess(columnSEXP, ascending));
+         }
+      }
+
+      index_.swap(index);
+      hasIndex_ = true;
+      sortColumn_ = sortColumn;
+      ascending_ = ascending;
+      filterColumn_ = filterColumn;
+      filter_ = filter;
+   }
+
+private:
+   r::sexp::PreservedSEXP data_;
+   std::vector<std::string> columnNames_;
+   std::vector<std::string> columnTypes_;
+   std::vector<int> columnLengths_;
+   int rowCount_;
+   std::vector<ColumnStats> stats_;
+
+   bool hasIndex_;
+   int sortColumn_;
+   bool ascending_;
+   int filterColumn_;
+   std::string filter_;
+   std::vector<int> index_;
+};
+
+// data sets available for paging (most recently viewed first)
+class ViewedDataStore : boost::noncopyable
+{
+public:
+   std::string add(boost::shared_ptr<ViewedData> pData)
+   {
+      std::string id = core::system::generateUuid(false);
+      data_.push_front(std::make_pair(id, pData));
+      if (data_.size() > kMaxViewedData)
+         data_.pop_back();
+      return id;
+   }
+
+   boost::shared_ptr<ViewedData> find(const std::string& id)
+   {
+      for (Entries::iterator it = data_.begin(); it != data_.end(); ++it)
+      {
+         if (it->first == id)
+         {
+            // move to the front
+            data_.splice(data_.begin(), data_, it);
+            return data_.front().second;
+         }
+      }
+      return boost::shared_ptr<ViewedData>();
+   }
+
+private:
+   typedef std::list<std::pair<std::string, boost::shared_ptr<ViewedData> > >
+                                                                     Entries;
+   Entries data_;
+};
+
+ViewedDataStore& viewedData()
+{
+   static ViewedDataStore instance;
+   return instance;
+}
+
+Error viewportAsJson(ViewedData* pData,
+                     int firstRow,
+                     int rowCount,
+                     int firstColumn,
+                     int columnCount,
+                     int sortColumn,
+                     bool ascending,
+                     int filterColumn,
+                     const std::string& filter,
+                     json::Object* pViewport)
+{
+   // constrain the viewport
+   firstRow = std::max(firstRow, 0);
+   rowCount = std::max(std::min(rowCount, kMaxViewportRows), 0);
+   firstColumn = std::max(std::min(firstColumn, pData->columnCount()), 0);
+   columnCount = std::max(std::min(std::min(columnCount, kMaxViewportColumns),
+                                   pData->columnCount() - firstColumn), 0);
+
+   std::vector<int> rows;
+   int totalRows;
+   pData->viewportRows(sortColumn, ascending, filterColumn, filter,
+                       firstRow, rowCount, &rows, &totalRows);
+
+   json::Array rowNumbersJson;
+   for (std::vector<int>::const_iterator it = rows.begin();
+        it != rows.end();
+        ++it)
+   {
+      rowNumbersJson.push_back(*it + 1);
+   }
+
+   json::Array dataJson;
+   for (int column = firstColumn; column < firstColumn + columnCount; column++)
+   {
+      std::vector<std::string> values;
+      Error error = pData->formatColumn(column, rows, &values);
+      if (error)
+         return error;
+
+      json::Array valuesJson;
+      std::copy(values.begin(), values.end(), std::back_inserter(valuesJson));
+      dataJson.push_back(valuesJson);
+   }
+
+   (*pViewport)["totalRows"] = totalRows;
+   (*pViewport)["row"] = firstRow;
+   (*pViewport)["rowNumbers"] = rowNumbersJson;
+   (*pViewport)["column"] = firstColumn;
+   (*pViewport)["data"] = dataJson;
+   (*pViewport)["sortColumn"] = sortColumn;
+   (*pViewport)["ascending"] = ascending;
+   return Success();
+}
+
+// serve viewports of viewed data sets to the data viewer page
+void handleGridDataRequest(const http::Request& request,
+                           http::Response* pResponse)
+{
+   json::Object resultJson;
+
+   boost::shared_ptr<ViewedData> pData =
+                           viewedData().find(request.queryParamValue("id"));
+   if (pData)
+   {
+      Error error = viewportAsJson(
+                        pData.get(),
+                        request.queryParamValue("row", 0),
+                        request.queryParamValue("nrow", kInitialRows),
+                        request.queryParamValue("col", 0),
+                        request.queryParamValue("ncol", kInitialColumns),
+                        request.queryParamValue("sort", -1),
+                        request.queryParamValue("asc", 1) != 0,
+                        request.queryParamValue("fcol", -1),
+                        request.queryParamValue("filter"),
+                        &resultJson);
+      if (error)
+      {
+         LOG_ERROR(error);
+         resultJson["error"] = error.summary();
+      }
+   }
+   else
+   {
+      resultJson["error"] = std::string("This data is no longer available "
+                                        "(call View again to see all of it)");
+   }
+
+   std::ostringstream ostr;
+   json::write(resultJson, ostr);
+   pResponse->setNoCacheHeaders();
+   pResponse->setContentType("application/json");
+   pResponse->setBody(ostr.str());
+}
+
+// serve column summaries of viewed data sets to the data viewer page
+void handleGridStatsRequest(const http::Request& request,
+                            http::Response* pResponse)
+{
+   json::Object resultJson;
+
+   boost::shared_ptr<ViewedData> pData =
+                           viewedData().find(request.queryParamValue("id"));
+   if (pData)
+   {
+      int firstColumn = std::max(std::min(request.queryParamValue("col", 0),
+                                          pData->columnCount()), 0);
+      int columnCount = std::max(std::min(
+                                    request.queryParamValue("ncol",
+                                                            kInitialColumns),
+                                    kMaxViewportColumns), 0);
+
+      json::Array statsJson;
+      pData->columnStats(firstColumn, columnCount, &statsJson);
+      resultJson["column"] = firstColumn;
+      resultJson["stats"] = statsJson;
+   }
+   else
+   {
+      resultJson["error"] = std::string("This data is no longer available "
+                                        "(call View again to see all of it)");
+   }
+
+   std::ostringstream ostr;
+   json::write(resultJson, ostr);
+   pResponse->setNoCacheHeaders();
+   pResponse->setContentType("application/json");
+   pResponse->setBody(ostr.str());
+}
+
+SEXP rs_viewData(SEXP dataSEXP, SEXP captionSEXP, SEXP typesSEXP)
 {    
    try
    {
@@ -98,13 +967,6 @@ SEXP rs_viewData(SEXP dataSEXP, SEXP captionSEXP)
                               "invalid data argument (names not specified)");
       }
 
-      // get column count
-      int columnCount = r::sexp::length(dataSEXP);
-
-      // calculate columns to display
-      const int kMaxColumns = 100;
-      int displayedColumns = std::min(columnCount, kMaxColumns);
-
       // extract caption and column names
       std::string caption = r::sexp::asString(captionSEXP);
       std::vector<std::string> columnNames;
@@ -113,121 +975,83 @@ SEXP rs_viewData(SEXP dataSEXP, SEXP captionSEXP)
          throw r::exec::RErrorException("invalid names: " +
                                         error.code().message());
 
-      // truncate columns names to displayedColumns
-      columnNames.resize(displayedColumns);
-
-      // get column lenghts and then calculate # of rows based on the maximum #
-      // of elements in single column (technically R can pass columns which have
-      // a disparate # of rows to this method)
-      int rowCount = 0;
-      std::vector<int> columnLengths;
-      for (int i=0; i<displayedColumns; i++)
+      // extract the (original) classes of the columns
+      std::vector<std::string> columnTypes;
+      if (TYPEOF(typesSEXP) == STRSXP)
       {
-          // get the column and record its length (updating rowCount)
-          SEXP columnSEXP = VECTOR_ELT(dataSEXP, i);
-          int columnLength = r::sexp::length(columnSEXP);
-          columnLengths.push_back(columnLength);
-          rowCount = std::max(columnLength, rowCount);
+         error = r::sexp::extract(typesSEXP, &columnTypes);
+         if (error)
+            LOG_ERROR(error);
       }
 
-      // calculate rows to display
-      const int kMaxRows = 1000;
-      int displayedRows = std::min(rowCount, kMaxRows);
+      // retain the data so it can be paged through
+      boost::shared_ptr<ViewedData> pData(new ViewedData(dataSEXP,
+                                                         columnNames,
+                                                         columnTypes));
+      std::string id = viewedData().add(pData);
 
-      // format the data for presentation
-      r::sexp::Protect rProtect;
-      SEXP formattedDataSEXP = Rf_allocVector(VECSXP, displayedColumns);
-      rProtect.add(formattedDataSEXP);
-      for (int i=0; i<displayedColumns; i++)
-      {
-         SEXP columnSEXP = VECTOR_ELT(dataSEXP, i);
-         SEXP formattedColumnSEXP;
-         r::exec::RFunction formatFx(".rs.formatDataColumn");
-         formatFx.addParam(columnSEXP);
-         formatFx.addParam(displayedRows);
-         Error error = formatFx.call(&formattedColumnSEXP, &rProtect);
-         if (error)
-            throw r::exec::RErrorException(error.summary());
-         SET_VECTOR_ELT(formattedDataSEXP, i, formattedColumnSEXP);
-       }
+      // render the initial viewport into the page
+      json::Object initialJson;
+      error = viewportAsJson(pData.get(),
+                             0, kInitialRows,
+                             0, kInitialColumns,
+                             -1, true, -1, std::string(),
+                             &initialJson);
+      if (error)
+         throw r::exec::RErrorException(error.summary());
 
-      // write html header
-      boost::format headerFmt(
+      json::Array columnsJson;
+      std::copy(columnNames.begin(),
+                columnNames.end(),
+                std::back_inserter(columnsJson));
+
+      json::Object configJson;
+      configJson["id"] = id;
+      configJson["url"] = std::string("grid_data");
+      configJson["statsUrl"] = std::string("grid_stats");
+      configJson["rowCount"] = pData->rowCount();
+      configJson["columns"] = columnsJson;
+      configJson["maxRows"] = kMaxViewportRows;
+      configJson["maxColumns"] = kMaxViewportColumns;
+      configJson["initial"] = initialJson;
+      std::ostringstream ostr;
+      json::write(configJson, ostr);
+      std::string config = boost::algorithm::replace_all_copy(ostr.str(),
+                                                              "</", "<\\/");
+
+      // write html (the viewer script renders and pages the data)
+      boost::format htmlFmt(
          "<html>\n"
          "  <head>\n"
          "     <title>%1%</title>\n"
          "     <meta charset=\"utf-8\"/>\n"
          "     <link rel=\"stylesheet\" type=\"text/css\" href=\"css/data.css\"/>\n"
+         "     <script type=\"text/javascript\" src=\"js/dataviewer.js\"></script>\n"
          "  </head>\n"
-         "  <body>\n");
-      std::string html = boost::str(headerFmt % caption);
-
-      // output begin table & header
-      html += "<table>\n";
-      html += "<thead><tr>\n";
-      html += "<td id=\"origin\">&nbsp;</td>"; // above row numbers
-      std::for_each(columnNames.begin(),
-                    columnNames.end(),
-                    boost::bind(appendTH, &html, _1));
-      html += "\n</tr></thead>\n";
-
-      html += "<tbody>\n";
-      // output rows
-      for (int row=0; row<displayedRows; row++)
-      {
-         html += "<tr>\n";
-
-         // row number
-         appendTD(&html, safe_convert::numberToString(row+1), "rn");
-
-         // output a data element from each column where this row is available
-         for (int col=0; col<Rf_length(formattedDataSEXP); col++)
-         {
-            if (columnLengths[col] > row)
-            {
-               SEXP columnSEXP = VECTOR_ELT(formattedDataSEXP, col);
-               SEXP stringSEXP = STRING_ELT(columnSEXP, row);
-               if (stringSEXP != NULL &&
-                   stringSEXP != NA_STRING &&
-                   r::sexp::length(stringSEXP) > 0)
-               {
-                  std::string text(Rf_translateChar(stringSEXP));
-                  appendTD(&html, text);
-               }
-               else
-               {
-                  html += "<td>&nbsp;</td>";
-               }
-            }
-            else
-            {
-               html += "<td>&nbsp;</td>";
-            }
-         }
-
-         html += "\n</tr>\n";
-      }
-      html += "</tbody>\n";
-
-      // append table footer
-      html += "\n</table>\n";
-
-      // append document footer
-      html += "</body></html>\n";
-
+         "  <body>\n"
+         "     <div id=\"viewer\"></div>\n"
+         "     <script type=\"text/javascript\">\n"
+         "        dataViewer.init(document.getElementById('viewer'), %2%);\n"
+         "     </script>\n"
+         "  </body>\n"
+         "</html>\n");
+      std::string html = boost::str(htmlFmt %
+                                    string_utils::textToHtml(caption) %
+                                    config);
 
       // compute variables based on presence of row.names
+      int columnCount = pData->columnCount();
       int variables = columnCount;
       if (columnNames.size() > 0 && columnNames[0] == "row.names")
          variables--;
 
-      // fire show data event
+      // fire show data event (all of the data can now be displayed)
       json::Object dataItem;
       dataItem["caption"] = caption;
-      dataItem["totalObservations"] = rowCount;
-      dataItem["displayedObservations"] = displayedRows;
+      dataItem["totalObservations"] = pData->rowCount();
+      dataItem["displayedObservations"] = pData->rowCount();
       dataItem["variables"] = variables;
-      dataItem["displayedVariables"] = displayedColumns;
+      dataItem["displayedVariables"] = columnCount;
       dataItem["contentUrl"] = content_urls::provision(caption, html, ".htm");
       ClientEvent event(client_events::kShowData, dataItem);
       module_context::enqueClientEvent(event);
@@ -254,7 +1078,7 @@ Error initialize()
    R_CallMethodDef methodDef ;
    methodDef.name = "rs_viewData" ;
    methodDef.fun = (DL_FUNC) rs_viewData ;
-   methodDef.numArgs = 2;
+   methodDef.numArgs = 3;
    r::routines::addCallMethod(methodDef);
 
    using boost::bind;
@@ -262,6 +1086,8 @@ Error initialize()
    using namespace session::module_context;
    ExecBlock initBlock ;
    initBlock.addFunctions()
+      (bind(registerUriHandler, "/grid_data", handleGridDataRequest))
+      (bind(registerUriHandler, "/grid_stats", handleGridStatsRequest))
       (bind(sourceModuleRFile, "SessionData.R"));
    
    return initBlock.execute();
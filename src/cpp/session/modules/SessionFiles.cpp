@@ -35,6 +35,7 @@
 #include <core/Settings.hpp>
 #include <core/Exec.hpp>
 #include <core/DateTime.hpp>
+#include <core/ZipStreamWriter.hpp>
 
 #include <core/http/Util.hpp>
 #include <core/http/Request.hpp>
@@ -205,6 +206,43 @@ Error listFiles(const json::JsonRpcRequest& request, json::JsonRpcResponse* pRes
    return Success();
 }
 
+// IN: String path, Boolean monitor, Int offset, Int limit
+// OUT: { files, offset, total }
+Error listFilesPage(const json::JsonRpcRequest& request,
+                    json::JsonRpcResponse* pResponse)
+{
+   std::string path;
+   bool monitor;
+   int offset, limit;
+   Error error = json::readParams(request.params,
+                                  &path,
+                                  &monitor,
+                                  &offset,
+                                  &limit);
+   if (error)
+      return error;
+   FilePath targetPath = module_context::resolveAliasedPath(path) ;
+
+   // only monitor if we aren't already covered by the project monitor
+   if (monitor &&
+       session::projects::projectContext().isMonitoringDirectory(targetPath))
+   {
+      monitor = false;
+   }
+
+   json::Object result;
+   error = s_filesListingMonitor.listPage(targetPath,
+                                          monitor,
+                                          std::max(offset, 0),
+                                          std::max(limit, 0),
+                                          &result);
+   if (error)
+      return error;
+
+   pResponse->setResult(result);
+   return Success();
+}
+
 
 // IN: String path
 core::Error createFolder(const core::json::JsonRpcRequest& request,
@@ -610,7 +648,9 @@ bool validateUploadedFile(const http::File& file, http::Response* pResponse)
    size_t byteLimit = mbLimit * 1024 * 1024;
    
    // compare to file size
-   if (file.contents.size() > byteLimit)
+   uintmax_t fileSize = file.path.empty() ? file.contents.size()
+                                          : file.path.size();
+   if (fileSize > byteLimit)
    {
       Error fileTooLargeError = systemError(boost::system::errc::file_too_large,
                                             ERROR_LOCATION);
@@ -656,8 +696,20 @@ void handleFileUploadRequest(const http::Request& request,
    FilePath tempFilePath = module_context::tempFile("upload", 
                                                     isZip ? "zip" : "bin");
    
-   // attempt to write the temp file
-   Error saveError = core::writeStringToFile(tempFilePath, file.contents);
+   // attempt to write the temp file (uploads which were spooled to disk
+   // as they were read are moved into place, falling back to a copy if
+   // the spool is on another device)
+   Error saveError;
+   if (!file.path.empty())
+   {
+      saveError = file.path.move(tempFilePath);
+      if (saveError)
+         saveError = file.path.copy(tempFilePath);
+   }
+   else
+   {
+      saveError = core::writeStringToFile(tempFilePath, file.contents);
+   }
    if (saveError)
    {
       LOG_ERROR(saveError);
@@ -696,10 +748,9 @@ void handleFileUploadRequest(const http::Request& request,
    json::setJsonRpcResult(uploadJson, pResponse);   
 }
    
-void setAttachmentResponse(const http::Request& request,
-                           const std::string& filename,
-                           const FilePath& attachmentPath,
-                           http::Response* pResponse)
+void setAttachmentHeaders(const http::Request& request,
+                          const std::string& filename,
+                          http::Response* pResponse)
 {
    if (request.headerValue("User-Agent").find("MSIE") == std::string::npos)
    {
@@ -719,8 +770,31 @@ void setAttachmentResponse(const http::Request& request,
                         "attachment; filename*=UTF-8''"
                         + http::util::urlEncode(filename, false));
    pResponse->setHeader("Content-Type", "application/octet-stream");
+}
+
+void setAttachmentResponse(const http::Request& request,
+                           const std::string& filename,
+                           const FilePath& attachmentPath,
+                           http::Response* pResponse)
+{
+   setAttachmentHeaders(request, filename, pResponse);
    pResponse->setBody(attachmentPath);
 }
+
+// write a zip of files (paths relative to parent) to the response body
+Error writeZipArchive(const FilePath& parentPath,
+                      const std::vector<std::string>& files,
+                      const http::Response::StreamBodySink& sink)
+{
+   ZipStreamWriter zipWriter(sink);
+   BOOST_FOREACH(const std::string& file, files)
+   {
+      Error error = zipWriter.addPath(parentPath.complete(file), file);
+      if (error)
+         return error;
+   }
+   return zipWriter.finish();
+}
    
 void handleMultipleFileExportRequest(const http::Request& request, 
                                      http::Response* pResponse)
@@ -770,21 +844,11 @@ void handleMultipleFileExportRequest(const http::Request& request,
       files.push_back(file);
    }
    
-   // create the zip file
-   FilePath tempZipFilePath = module_context::tempFile("export", "zip");
-   Error error = r::exec::RFunction(".rs.createZipFile",
-                                    tempZipFilePath.absolutePath(),
-                                    parentPath.absolutePath(),
-                                    files).call();
-   if (error)
-   {
-      LOG_ERROR(error);
-      pResponse->setError(error);
-      return;
-   }
-   
-   // return attachment
-   setAttachmentResponse(request, name, tempZipFilePath, pResponse);
+   // return attachment (the zip is built as it is sent so the download
+   // begins right away and nothing is written to disk)
+   setAttachmentHeaders(request, name, pResponse);
+   pResponse->setStreamBody(boost::bind(writeZipArchive,
+                                        parentPath, files, _1));
 }
    
 void handleFileExportRequest(const http::Request& request, 
@@ -898,6 +962,7 @@ Error initialize()
       (bind(registerRpcMethod, "stat", stat))
       (bind(registerRpcMethod, "is_text_file", isTextFile))
       (bind(registerRpcMethod, "list_files", listFiles))
+      (bind(registerRpcMethod, "list_files_page", listFilesPage))
       (bind(registerRpcMethod, "create_folder", createFolder))
       (bind(registerRpcMethod, "delete_files", deleteFiles))
       (bind(registerRpcMethod, "copy_file", copyFile))
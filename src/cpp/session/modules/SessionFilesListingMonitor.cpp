@@ -60,23 +60,138 @@ Error FilesListingMonitor::start(const FilePath& filePath, json::Array* pJsonFil
                   core::toFileInfo);
 
    // kickoff new monitor
+   registerMonitor(filePath, prevFiles);
+
+   return Success();
+}
+
+Error FilesListingMonitor::listPage(const FilePath& filePath,
+                                    bool monitor,
+                                    std::size_t offset,
+                                    std::size_t limit,
+                                    json::Object* pResult)
+{
+   // the first page (re)reads the listing
+   if (offset == 0 || filePath != cursorPath_)
+   {
+      stop();
+
+      Error error = scanFiles(filePath, &cursorFiles_);
+      if (error)
+         return error;
+      cursorPath_ = filePath;
+      paged_ = true;
+
+      if (monitor)
+      {
+         std::vector<FileInfo> prevFiles;
+         std::transform(cursorFiles_.begin(),
+                        cursorFiles_.end(),
+                        std::back_inserter(prevFiles),
+                        core::toFileInfo);
+         registerMonitor(filePath, prevFiles);
+      }
+   }
+
+   std::size_t begin = std::min(offset, cursorFiles_.size());
+   std::size_t end = std::min(begin + limit, cursorFiles_.size());
+   json::Array jsonFiles;
+   filesToJson(filePath,
+               cursorFiles_.begin() + begin,
+               cursorFiles_.begin() + end,
+               &jsonFiles);
+   loadedCount_ = std::max(loadedCount_, end);
+
+   json::Object& result = *pResult;
+   result["files"] = jsonFiles;
+   result["offset"] = static_cast<boost::uint64_t>(begin);
+   result["total"] = static_cast<boost::uint64_t>(cursorFiles_.size());
+   return Success();
+}
+
+void FilesListingMonitor::registerMonitor(const FilePath& filePath,
+                                          const std::vector<FileInfo>& prevFiles)
+{
    core::system::file_monitor::Callbacks cb;
    cb.onRegistered = boost::bind(&FilesListingMonitor::onRegistered,
                                     this, _1, filePath, prevFiles, _2);
    cb.onRegistrationError =  boost::bind(core::log::logError, _1, ERROR_LOCATION);
-   cb.onFilesChanged = boost::bind(module_context::enqueFileChangedEvents, filePath, _1);
+   cb.onFilesChanged = boost::bind(&FilesListingMonitor::onFilesChanged,
+                                   this, filePath, _1);
    cb.onMonitoringError = boost::bind(core::log::logError, _1, ERROR_LOCATION);
    cb.onUnregistered = boost::bind(&FilesListingMonitor::onUnregistered, this, _1);
    core::system::file_monitor::registerMonitor(filePath,
                                                false,
                                                module_context::fileListingFilter,
                                                cb);
+}
 
-   return Success();
+void FilesListingMonitor::onFilesChanged(
+                  const FilePath& filePath,
+                  const std::vector<core::system::FileChangeEvent>& events)
+{
+   if (!paged_ || filePath != cursorPath_)
+   {
+      module_context::enqueFileChangedEvents(filePath, events);
+      return;
+   }
+
+   // keep the cursor up to date and only send events for files within the
+   // pages which the client has loaded
+   using namespace core::system;
+   std::vector<FileChangeEvent> loadedEvents;
+   BOOST_FOREACH(const FileChangeEvent& event, events)
+   {
+      FilePath changedPath(event.fileInfo().absolutePath());
+      std::vector<FilePath>::iterator it = std::lower_bound(
+                                             cursorFiles_.begin(),
+                                             cursorFiles_.end(),
+                                             changedPath,
+                                             core::compareAbsolutePathNoCase);
+      std::size_t index = it - cursorFiles_.begin();
+      bool found = it != cursorFiles_.end() && *it == changedPath;
+      bool loaded = index < loadedCount_;
+
+      switch (event.type())
+      {
+         case FileChangeEvent::FileAdded:
+            if (!found)
+            {
+               cursorFiles_.insert(it, changedPath);
+               if (loaded)
+                  loadedCount_++;
+            }
+            break;
+
+         case FileChangeEvent::FileRemoved:
+            if (found)
+            {
+               cursorFiles_.erase(it);
+               if (loaded)
+                  loadedCount_--;
+            }
+            break;
+
+         default:
+            break;
+      }
+
+      if (loaded)
+         loadedEvents.push_back(event);
+   }
+
+   if (!loadedEvents.empty())
+      module_context::enqueFileChangedEvents(filePath, loadedEvents);
 }
 
 void FilesListingMonitor::stop()
 {
+   // reset the paging cursor
+   paged_ = false;
+   cursorPath_ = FilePath();
+   cursorFiles_.clear();
+   loadedCount_ = 0;
+
    // reset monitored path and unregister any existing handle
    currentPath_ = FilePath();
    if (!currentHandle_.empty())
@@ -152,7 +267,7 @@ void FilesListingMonitor::onRegistered(core::system::file_monitor::Handle handle
 
    // enque any events we discovered
    if (!events.empty())
-      module_context::enqueFileChangedEvents(filePath, events);
+      onFilesChanged(filePath, events);
 }
 
 void FilesListingMonitor::onUnregistered(core::system::file_monitor::Handle handle)
@@ -178,27 +293,72 @@ Error FilesListingMonitor::listFiles(const FilePath& rootPath,
    if (error)
       return error;
 
-   using namespace source_control;
-   boost::shared_ptr<FileDecorationContext> pCtx =
-                  source_control::fileDecorationContext(rootPath);
-
    // sort the files by name
    std::sort(pFiles->begin(), pFiles->end(), core::compareAbsolutePathNoCase);
 
    // produce json listing
-   BOOST_FOREACH( core::FilePath& filePath, *pFiles)
+   filesToJson(rootPath, pFiles->begin(), pFiles->end(), pJsonFiles);
+
+   return Success();
+}
+
+Error FilesListingMonitor::scanFiles(const FilePath& rootPath,
+                                     std::vector<FilePath>* pFiles)
+{
+   std::vector<FilePath> children;
+   core::Error error = rootPath.children(&children) ;
+   if (error)
+      return error;
+
+   // only files which are end-user visible (so that offsets into the
+   // listing are stable)
+   pFiles->clear();
+   BOOST_FOREACH(const FilePath& filePath, children)
+   {
+      if (module_context::fileListingFilter(core::FileInfo(filePath)))
+         pFiles->push_back(filePath);
+   }
+
+   std::sort(pFiles->begin(), pFiles->end(), core::compareAbsolutePathNoCase);
+   return Success();
+}
+
+void FilesListingMonitor::filesToJson(
+                        const FilePath& rootPath,
+                        std::vector<FilePath>::const_iterator begin,
+                        std::vector<FilePath>::const_iterator end,
+                        json::Array* pJsonFiles)
+{
+   using namespace source_control;
+   boost::shared_ptr<FileDecorationContext> pCtx =
+                  source_control::fileDecorationContext(rootPath);
+
+   // the file info for each file is read once and the files are then
+   // decorated as a batch
+   std::vector<core::FileInfo> fileInfos;
+   std::vector<core::json::Object> fileObjects;
+   fileInfos.reserve(end - begin);
+   fileObjects.reserve(end - begin);
+   for (std::vector<FilePath>::const_iterator it = begin; it != end; ++it)
    {
       // files which may have been deleted after the listing or which
       // are not end-user visible
-      if (filePath.exists() && module_context::fileListingFilter(core::FileInfo(filePath)))
+      if (!it->exists())
+         continue;
+
+      core::FileInfo fileInfo(*it);
+      if (module_context::fileListingFilter(fileInfo))
       {
-         core::json::Object fileObject = module_context::createFileSystemItem(filePath);
-         pCtx->decorateFile(filePath, &fileObject);
-         pJsonFiles->push_back(fileObject) ;
+         fileObjects.push_back(module_context::createFileSystemItem(fileInfo));
+         fileInfos.push_back(fileInfo);
       }
    }
 
-   return Success();
+   pCtx->decorateFiles(fileInfos, &fileObjects);
+
+   pJsonFiles->reserve(pJsonFiles->size() + fileObjects.size());
+   std::copy(fileObjects.begin(), fileObjects.end(),
+             std::back_inserter(*pJsonFiles));
 }
 
 
@@ -47,11 +47,24 @@ namespace files {
 class FilesListingMonitor : boost::noncopyable
 {
 public:
+   FilesListingMonitor() : paged_(false), loadedCount_(0) {}
+
    // kickoff monitoring
    core::Error start(const core::FilePath& filePath, core::json::Array* pJsonFiles);
 
    void stop();
 
+   // list a page of a directory. the sorted listing is read when the first
+   // page is requested and kept as a cursor which subsequent pages are read
+   // from. if monitor is true then the directory is monitored, with change
+   // events sent only for files within the pages which have been loaded.
+   // the result has the files, their offset, and the total file count
+   core::Error listPage(const core::FilePath& filePath,
+                        bool monitor,
+                        std::size_t offset,
+                        std::size_t limit,
+                        core::json::Object* pResult);
+
    // what path are we currently monitoring?
    const core::FilePath& currentMonitoredPath() const;
 
@@ -73,14 +86,34 @@ private:
 
    void onUnregistered(core::system::file_monitor::Handle handle);
 
+   void onFilesChanged(const core::FilePath& filePath,
+                       const std::vector<core::system::FileChangeEvent>& events);
+
+   void registerMonitor(const core::FilePath& filePath,
+                        const std::vector<core::FileInfo>& prevFiles);
+
    // helpers
    static core::Error listFiles(const core::FilePath& rootPath,
                                 std::vector<core::FilePath>* pFiles,
                                 core::json::Array* pJsonFiles);
 
+   static core::Error scanFiles(const core::FilePath& rootPath,
+                                std::vector<core::FilePath>* pFiles);
+
+   static void filesToJson(const core::FilePath& rootPath,
+                           std::vector<core::FilePath>::const_iterator begin,
+                           std::vector<core::FilePath>::const_iterator end,
+                           core::json::Array* pJsonFiles);
+
 private:
    core::FilePath currentPath_;
    core::system::file_monitor::Handle currentHandle_;
+
+   // paged listing cursor (sorted files and how many the client has)
+   bool paged_;
+   core::FilePath cursorPath_;
+   std::vector<core::FilePath> cursorFiles_;
+   std::size_t loadedCount_;
 };
 
 
@@ -15,16 +15,29 @@
 
 #include "SessionFilesQuotas.hpp"
 
+#include <ctime>
 #include <iostream>
 
+#ifdef __linux__
+#include <stdio.h>
+#include <errno.h>
+#include <mntent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/quota.h>
+#include <linux/dqblk_xfs.h>
+#endif
+
+#include <boost/bind.hpp>
 #include <boost/tokenizer.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/make_shared.hpp>
 #include <boost/numeric/conversion/cast.hpp>
 
-#include <core/BoostThread.hpp>
 #include <core/Error.hpp>
-#include <core/BoostErrors.hpp>
 #include <core/Log.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/SafeConvert.hpp>
 
 #include <core/system/Process.hpp>
 
@@ -43,6 +56,17 @@ namespace {
 
 // does the system have quotas?
 bool s_systemHasQuotas = false;   
+
+// quota status is cached (for all of the user's sessions) for this long
+const std::time_t kQuotaCacheSeconds = 60;
+
+// only report changes in usage of at least this fraction of the quota
+const double kReportThreshold = 0.01;
+
+// home directory (whose filesystem's quota we report) and cache file
+// (resolved on the main thread so the background check needn't)
+FilePath s_homePath;
+FilePath s_quotaCachePath;
    
 struct QuotaInfo
 {
@@ -91,6 +115,75 @@ QuotaInfo::size_type quotaBytes(const std::string& quotaKb)
    return kb * 1024L;
 }
 
+#ifdef __linux__
+
+// query the quota directly via quotactl for the xfs filesystem containing
+// the home directory. returns an error if that isn't possible (e.g. the
+// home directory isn't on xfs) in which case we fall back to xfs_quota
+Error queryXfsQuota(const FilePath& homePath, QuotaInfo* pInfo)
+{
+   struct stat homeStat;
+   if (::stat(homePath.absolutePath().c_str(), &homeStat) != 0)
+      return systemError(errno, ERROR_LOCATION);
+
+   // find the device of the xfs mount the home directory is on
+   std::string device;
+   FILE* pMounts = ::setmntent("/proc/mounts", "r");
+   if (pMounts == NULL)
+      return systemError(errno, ERROR_LOCATION);
+   struct mntent* pEntry;
+   while ((pEntry = ::getmntent(pMounts)) != NULL)
+   {
+      if (std::string(pEntry->mnt_type) != "xfs")
+         continue;
+
+      struct stat mountStat;
+      if (::stat(pEntry->mnt_dir, &mountStat) == 0 &&
+          mountStat.st_dev == homeStat.st_dev)
+      {
+         device = pEntry->mnt_fsname;
+         break;
+      }
+   }
+   ::endmntent(pMounts);
+
+   if (device.empty())
+   {
+      Error error = systemError(boost::system::errc::not_supported,
+                                ERROR_LOCATION);
+      error.addProperty("path", homePath);
+      return error;
+   }
+
+   struct fs_disk_quota quota;
+   if (::quotactl(QCMD(Q_XGETQUOTA, USRQUOTA),
+                  device.c_str(),
+                  ::getuid(),
+                  reinterpret_cast<caddr_t>(&quota)) != 0)
+   {
+      // no quota for this user (or quotas aren't enabled)
+      if (errno == ESRCH || errno == ENOENT)
+      {
+         pInfo->hasQuota = false;
+         return Success();
+      }
+
+      Error error = systemError(errno, ERROR_LOCATION);
+      error.addProperty("device", device);
+      return error;
+   }
+
+   // (xfs reports sizes in 512 byte basic blocks)
+   const QuotaInfo::size_type kBasicBlockSize = 512;
+   pInfo->used = quota.d_bcount * kBasicBlockSize;
+   pInfo->quota = quota.d_blk_softlimit * kBasicBlockSize;
+   pInfo->limit = quota.d_blk_hardlimit * kBasicBlockSize;
+   pInfo->hasQuota = (pInfo->quota > 0 || pInfo->limit > 0);
+   return Success();
+}
+
+#endif
+
 Error parseQuotaInfo(const std::string& quotaInfo, QuotaInfo* pInfo)
 {
    // if there was no quota info returned then there is no quota on this box
@@ -157,42 +250,144 @@ Error parseQuotaInfo(const std::string& quotaInfo, QuotaInfo* pInfo)
    }
 }
 
-void checkQuotaThread()
+Error queryQuotaCommand(QuotaInfo* pInfo)
+{
+   core::system::ProcessResult result;
+   Error error = runCommand("xfs_quota -c 'quota -N'",
+                            core::system::ProcessOptions(),
+                            &result);
+   if (error)
+      return error;
+
+   return parseQuotaInfo(result.stdOut, pInfo);
+}
+
+bool readCachedQuotaInfo(QuotaInfo* pInfo)
+{
+   if (!s_quotaCachePath.exists() ||
+       (std::time(NULL) - s_quotaCachePath.lastWriteTime()) > kQuotaCacheSeconds)
+   {
+      return false;
+   }
+
+   std::map<std::string,std::string> values;
+   Error error = readStringMapFromFile(s_quotaCachePath, &values);
+   if (error || values.size() != 4)
+      return false;
+
+   pInfo->hasQuota = values["hasQuota"] == "1";
+   pInfo->used = safe_convert::stringTo<QuotaInfo::size_type>(values["used"], 0);
+   pInfo->quota = safe_convert::stringTo<QuotaInfo::size_type>(values["quota"], 0);
+   pInfo->limit = safe_convert::stringTo<QuotaInfo::size_type>(values["limit"], 0);
+   return true;
+}
+
+void writeCachedQuotaInfo(const QuotaInfo& info)
+{
+   std::map<std::string,std::string> values;
+   values["hasQuota"] = info.hasQuota ? "1" : "0";
+   values["used"] = safe_convert::numberToString(info.used);
+   values["quota"] = safe_convert::numberToString(info.quota);
+   values["limit"] = safe_convert::numberToString(info.limit);
+   Error error = writeStringMapToFile(s_quotaCachePath, values);
+   if (error)
+      LOG_ERROR(error);
+}
+
+struct QuotaCheck
+{
+   QuotaCheck() : succeeded(false) {}
+   bool succeeded;
+   QuotaInfo quotaInfo;
+};
+
+// runs on a background thread
+void checkQuota(boost::shared_ptr<QuotaCheck> pCheck)
 {
    try
    {
-      // run the command
-      core::system::ProcessResult result;
-      Error error = runCommand("xfs_quota -c 'quota -N'",
-                               core::system::ProcessOptions(),
-                               &result);
-      if (error)
+      // use the status another of the user's sessions recently determined
+      if (readCachedQuotaInfo(&pCheck->quotaInfo))
       {
-         LOG_ERROR(error);
+         pCheck->succeeded = true;
          return;
       }
 
-      // parse output
-      QuotaInfo quotaInfo;
-      error = parseQuotaInfo(result.stdOut, &quotaInfo);
+      Error error;
+#ifdef __linux__
+      error = queryXfsQuota(s_homePath, &pCheck->quotaInfo);
       if (error)
       {
-         LOG_ERROR(error);
-         return;
+         LOG_DEBUG_MESSAGE("Using xfs_quota (" + error.summary() + ")");
+         error = queryQuotaCommand(&pCheck->quotaInfo);
       }
-      
-      // send event only if there are quotas established
-      if (quotaInfo.hasQuota)
+#else
+      error = queryQuotaCommand(&pCheck->quotaInfo);
+#endif
+      if (error)
       {
-         json::Object quotaInfoJson;
-         quotaInfoToJson(quotaInfo, &quotaInfoJson);
-         ClientEvent event(client_events::kQuotaStatus, quotaInfoJson);
-         module_context::enqueClientEvent(event);
+         LOG_ERROR(error);
+         return;
       }
+
+      writeCachedQuotaInfo(pCheck->quotaInfo);
+      pCheck->succeeded = true;
    }
    CATCH_UNEXPECTED_EXCEPTION
 }
 
+// the quota status most recently reported to the client
+bool s_reportedQuota = false;
+QuotaInfo s_reportedQuotaInfo;
+
+bool isOverQuota(const QuotaInfo& info)
+{
+   return info.quota > 0 && info.used >= info.quota;
+}
+
+bool isOverLimit(const QuotaInfo& info)
+{
+   return info.limit > 0 && info.used >= info.limit;
+}
+
+bool shouldReportQuota(const QuotaInfo& info)
+{
+   if (!s_reportedQuota)
+      return true;
+
+   const QuotaInfo& last = s_reportedQuotaInfo;
+   if (info.quota != last.quota || info.limit != last.limit ||
+       isOverQuota(info) != isOverQuota(last) ||
+       isOverLimit(info) != isOverLimit(last))
+   {
+      return true;
+   }
+
+   QuotaInfo::size_type change = info.used > last.used ?
+                                    info.used - last.used :
+                                    last.used - info.used;
+   QuotaInfo::size_type size = info.quota > 0 ? info.quota : info.limit;
+   return change >= (size * kReportThreshold);
+}
+
+// runs on the main thread once the check is complete
+void onQuotaChecked(boost::shared_ptr<QuotaCheck> pCheck)
+{
+   // send event only if there are quotas established (and the usage has
+   // changed enough to be worth reporting)
+   const QuotaInfo& quotaInfo = pCheck->quotaInfo;
+   if (pCheck->succeeded && quotaInfo.hasQuota && shouldReportQuota(quotaInfo))
+   {
+      json::Object quotaInfoJson;
+      quotaInfoToJson(quotaInfo, &quotaInfoJson);
+      ClientEvent event(client_events::kQuotaStatus, quotaInfoJson);
+      module_context::enqueClientEvent(event);
+
+      s_reportedQuota = true;
+      s_reportedQuotaInfo = quotaInfo;
+   }
+}
+
 } // anonymous namespace
 
 Error initialize()
@@ -204,6 +399,10 @@ Error initialize()
       std::string out;
       Error error = r::exec::system("which xfs_quota", &out);
       s_systemHasQuotas = !out.empty();
+
+      s_homePath = module_context::userHomePath();
+      s_quotaCachePath = module_context::userScratchPath().complete(
+                                                               "quota-status");
    }
    else
    {
@@ -218,22 +417,9 @@ void checkQuotaStatus()
 {
    if (s_systemHasQuotas)
    {
-      try
-      {
-         // block all signals for launch of background thread (will cause it
-         // to never receive signals)
-         core::system::SignalBlocker signalBlocker;
-         Error error = signalBlocker.blockAll();
-         if (error)
-            LOG_ERROR(error);
-         
-         boost::thread t(checkQuotaThread);
-      }
-      catch(const boost::thread_resource_error& e)
-      {
-         LOG_ERROR(Error(boost::thread_error::ec_from_exception(e),
-                         ERROR_LOCATION));
-      }
+      boost::shared_ptr<QuotaCheck> pCheck = boost::make_shared<QuotaCheck>();
+      module_context::executeInBackground(boost::bind(checkQuota, pCheck),
+                                          boost::bind(onQuotaChecked, pCheck));
    }
 }
 
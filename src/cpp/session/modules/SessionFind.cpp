@@ -16,16 +16,23 @@
 #include "SessionFind.hpp"
 
 #include <algorithm>
+#include <cctype>
+#include <cstring>
 
-#include <boost/algorithm/string.hpp>
 #include <boost/bind.hpp>
 #include <boost/enable_shared_from_this.hpp>
+#include <boost/foreach.hpp>
+#include <boost/regex.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
 
 #include <core/Exec.hpp>
+#include <core/FileInfo.hpp>
+#include <core/RegexUtils.hpp>
 #include <core/StringUtils.hpp>
-#include <core/system/Environment.hpp>
-#include <core/system/Process.hpp>
-#include <core/system/ShellUtils.hpp>
+#include <core/Thread.hpp>
+#include <core/text/TrigramIndex.hpp>
+#include <core/system/FileScanner.hpp>
+#include <core/system/System.hpp>
 
 #include <r/RUtil.hpp>
 
@@ -192,20 +199,239 @@ FindInFilesState& findResults()
    return *s_pFindResults;
 }
 
-class GrepOperation : public boost::enable_shared_from_this<GrepOperation>
+// number of leading bytes examined when deciding whether a file is binary
+const std::size_t kBinaryCheckBytes = 8192;
+
+// line contents sent to the client are truncated to this many bytes
+const std::size_t kMaxLineContents = 300;
+
+bool isIgnoredDirectory(const std::string& name)
+{
+   return name == ".Rproj.user" || name == ".git" || name == ".svn";
+}
+
+bool isIncludedFile(const std::string& name,
+                    const std::vector<boost::regex>& includePatterns)
+{
+   if (includePatterns.empty())
+      return true;
+
+   BOOST_FOREACH(const boost::regex& pattern, includePatterns)
+   {
+      if (boost::regex_match(name, pattern))
+         return true;
+   }
+   return false;
+}
+
+// a single matching line (produced on a worker thread)
+struct FindMatch
+{
+   FindMatch() : lineNum(-1) {}
+
+   std::string file;
+   int lineNum;
+   std::string contents;
+   std::vector<int> matchOn;
+   std::vector<int> matchOff;
+};
+
+// locates occurrences of the search pattern within a buffer. literal
+// searches scan for the first character with memchr and then compare the
+// remainder; regex searches use boost::regex with the same basic syntax
+// (including the GNU \+, \? and \| extensions) that grep accepted
+class FindMatcher
 {
 public:
-   static boost::shared_ptr<GrepOperation> create(const std::string& encoding,
-                                                  const FilePath& tempFile)
+   FindMatcher(const std::string& pattern, bool asRegex, bool ignoreCase)
+      : literal_(pattern),
+        asRegex_(asRegex && !pattern.empty()),
+        ignoreCase_(ignoreCase)
    {
-      return boost::shared_ptr<GrepOperation>(new GrepOperation(encoding,
-                                                                tempFile));
+      if (asRegex_)
+      {
+         using namespace boost::regex_constants;
+         syntax_option_type flags = basic | bk_plus_qm | bk_vbar;
+         if (ignoreCase_)
+            flags |= icase;
+
+         // NOTE: throws boost::regex_error if pattern is invalid
+         regex_.assign(pattern, flags);
+      }
+      else if (ignoreCase_)
+      {
+         for (std::size_t i = 0; i < literal_.size(); i++)
+            literal_[i] = toLower(literal_[i]);
+      }
+   }
+
+   // find the start of the first match within [begin, end) (NULL if there
+   // is none). begin must be the start of a line
+   const char* findNext(const char* begin, const char* end) const
+   {
+      if (asRegex_)
+      {
+         boost::cmatch match;
+         if (boost::regex_search(begin, end, match, regex_,
+                                 boost::match_not_dot_newline))
+         {
+            return match[0].first;
+         }
+         else
+         {
+            return NULL;
+         }
+      }
+      else
+      {
+         return findLiteral(begin, end);
+      }
+   }
+
+   // determine whether the line matches and if so return the byte ranges
+   // of (non-empty) matches within it
+   bool matchLine(const char* begin,
+                  const char* end,
+                  std::vector<std::pair<std::size_t,std::size_t> >* pRanges)
+                                                                     const
+   {
+      bool matched = false;
+      if (asRegex_)
+      {
+         boost::cregex_iterator it(begin, end, regex_);
+         for ( ; it != boost::cregex_iterator(); ++it)
+         {
+            matched = true;
+            const boost::cmatch& match = *it;
+            if (match.length() > 0)
+            {
+               std::size_t on = match[0].first - begin;
+               pRanges->push_back(std::make_pair(on, on + match.length()));
+            }
+         }
+      }
+      else if (literal_.empty())
+      {
+         matched = true;
+      }
+      else
+      {
+         const char* pos = begin;
+         while (const char* hit = findLiteral(pos, end))
+         {
+            matched = true;
+            std::size_t on = hit - begin;
+            pRanges->push_back(std::make_pair(on, on + literal_.size()));
+            pos = hit + literal_.size();
+         }
+      }
+      return matched;
+   }
+
+private:
+
+   static char toLower(char ch)
+   {
+      return static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+   }
+
+   static char toUpper(char ch)
+   {
+      return static_cast<char>(std::toupper(static_cast<unsigned char>(ch)));
+   }
+
+   const char* findLiteral(const char* begin, const char* end) const
+   {
+      const std::size_t length = literal_.size();
+      if (length == 0)
+         return begin;
+
+      const char* pos = begin;
+      while (static_cast<std::size_t>(end - pos) >= length)
+      {
+         pos = findFirstChar(pos, end - length + 1);
+         if (pos == NULL)
+            return NULL;
+         else if (equalsLiteral(pos))
+            return pos;
+         else
+            ++pos;
+      }
+      return NULL;
+   }
+
+   const char* findFirstChar(const char* begin, const char* end) const
+   {
+      const char first = literal_[0];
+      const char* pos = static_cast<const char*>(
+                                 std::memchr(begin, first, end - begin));
+
+      // for case-insensitive search also look for the upper case variant
+      // (but only up to the first lower case occurrence)
+      if (ignoreCase_)
+      {
+         const char upper = toUpper(first);
+         if (upper != first)
+         {
+            const char* stop = (pos != NULL) ? pos : end;
+            const char* upperPos = static_cast<const char*>(
+                                 std::memchr(begin, upper, stop - begin));
+            if (upperPos != NULL)
+               pos = upperPos;
+         }
+      }
+
+      return pos;
+   }
+
+   bool equalsLiteral(const char* pos) const
+   {
+      if (!ignoreCase_)
+         return std::memcmp(pos, literal_.data(), literal_.size()) == 0;
+
+      for (std::size_t i = 0; i < literal_.size(); i++)
+      {
+         if (toLower(pos[i]) != literal_[i])
+            return false;
+      }
+      return true;
+   }
+
+private:
+   std::string literal_;
+   bool asRegex_;
+   bool ignoreCase_;
+   boost::regex regex_;
+};
+
+// searches a directory tree using a pool of worker threads. directories
+// and files to search are placed on a shared work queue (so that both the
+// directory walk and file searching proceed in parallel) and matches are
+// collected on a results queue which is drained periodically on the main
+// thread and then forwarded to the client
+class FindOperation : public boost::enable_shared_from_this<FindOperation>
+{
+public:
+   static boost::shared_ptr<FindOperation> create(
+                        const FindMatcher& matcher,
+                        const std::string& encoding,
+                        const std::vector<boost::regex>& includePatterns)
+   {
+      return boost::shared_ptr<FindOperation>(
+                  new FindOperation(matcher, encoding, includePatterns));
    }
 
 private:
-   GrepOperation(const std::string& encoding,
-                 const FilePath& tempFile)
-      : firstDecodeError_(true), encoding_(encoding), tempFile_(tempFile)
+   FindOperation(const FindMatcher& matcher,
+                 const std::string& encoding,
+                 const std::vector<boost::regex>& includePatterns)
+      : matcher_(matcher),
+        encoding_(encoding),
+        includePatterns_(includePatterns),
+        pendingItems_(0),
+        matchCount_(0),
+        cancelled_(false),
+        firstDecodeError_(true)
    {
       handle_ = core::system::generateUuid(false);
    }
@@ -216,28 +442,164 @@ public:
       return handle_;
    }
 
-   core::system::ProcessCallbacks createProcessCallbacks()
+   // search the specified files and directories (directories are
+   // searched recursively)
+   void start(const std::vector<FileInfo>& roots)
    {
-      core::system::ProcessCallbacks callbacks;
-      callbacks.onContinue = boost::bind(&GrepOperation::onContinue,
-                                         shared_from_this(),
-                                         _1);
-      callbacks.onStdout = boost::bind(&GrepOperation::onStdout,
-                                       shared_from_this(),
-                                       _1, _2);
-      callbacks.onStderr = boost::bind(&GrepOperation::onStderr,
-                                       shared_from_this(),
-                                       _1, _2);
-      callbacks.onExit = boost::bind(&GrepOperation::onExit,
-                                     shared_from_this(),
-                                     _1);
-      return callbacks;
+      std::for_each(roots.begin(),
+                    roots.end(),
+                    boost::bind(&FindOperation::addWorkItem,
+                                shared_from_this(),
+                                _1));
+
+      // one thread per core (within reason). if there is nothing to search
+      // then no threads are needed (the periodic callback will end the
+      // operation the first time it runs)
+      unsigned int threads = boost::thread::hardware_concurrency();
+      threads = std::max(1u, std::min(threads, 8u));
+      for (unsigned int i = 0; i < threads && !roots.empty(); i++)
+      {
+         core::thread::safeLaunchThread(
+                  boost::bind(&FindOperation::workerMain, shared_from_this()));
+      }
+
+      // forward results to the client as they become available
+      module_context::schedulePeriodicWork(
+                  boost::posix_time::milliseconds(50),
+                  boost::bind(&FindOperation::publishResults, shared_from_this()),
+                  false /* publish results even when non-idle */);
    }
 
 private:
-   bool onContinue(const core::system::ProcessOperations& ops) const
+
+   // main thread ------------------------------------------------------------
+
+   bool publishResults()
    {
-      return findResults().isRunning() && findResults().handle() == handle();
+      // stop if the find was stopped or superseded by another one
+      if (!findResults().isRunning() || findResults().handle() != handle())
+         cancel();
+
+      // check for completion before draining so that we don't miss any
+      // results which are enqued between draining and completion
+      bool finished = isFinished();
+
+      json::Array files;
+      json::Array lineNums;
+      json::Array contents;
+      json::Array matchOns;
+      json::Array matchOffs;
+
+      FindMatch match;
+      while (results_.deque(&match))
+      {
+         files.push_back(module_context::createAliasedPath(
+                        FilePath(string_utils::systemToUtf8(match.file))));
+         lineNums.push_back(match.lineNum);
+         contents.push_back(match.contents);
+
+         json::Array matchOn, matchOff;
+         std::copy(match.matchOn.begin(),
+                   match.matchOn.end(),
+                   std::back_inserter(matchOn));
+         std::copy(match.matchOff.begin(),
+                   match.matchOff.end(),
+                   std::back_inserter(matchOff));
+         matchOns.push_back(matchOn);
+         matchOffs.push_back(matchOff);
+      }
+
+      if (files.size() > 0 &&
+          findResults().addResult(handle(),
+                                  files,
+                                  lineNums,
+                                  contents,
+                                  matchOns,
+                                  matchOffs))
+      {
+         json::Object result;
+         result["handle"] = handle();
+         json::Object results;
+         results["file"] = files;
+         results["line"] = lineNums;
+         results["lineValue"] = contents;
+         results["matchOn"] = matchOns;
+         results["matchOff"] = matchOffs;
+         result["results"] = results;
+
+         module_context::enqueClientEvent(
+                  ClientEvent(client_events::kFindResult, result));
+      }
+
+      if (finished)
+      {
+         findResults().onFindEnd(handle());
+         module_context::enqueClientEvent(
+               ClientEvent(client_events::kFindOperationEnded, handle()));
+         return false;
+      }
+      else
+      {
+         return true;
+      }
+   }
+
+   // shared state -----------------------------------------------------------
+
+   void cancel()
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         cancelled_ = true;
+      }
+      END_LOCK_MUTEX
+   }
+
+   bool isFinished()
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         return cancelled_ || pendingItems_ == 0 || matchCount_ > MAX_COUNT;
+      }
+      END_LOCK_MUTEX
+
+      return true;
+   }
+
+   void addWorkItem(const FileInfo& fileInfo)
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         pendingItems_++;
+      }
+      END_LOCK_MUTEX
+
+      workQueue_.enque(fileInfo);
+   }
+
+   void completeWorkItem()
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         pendingItems_--;
+      }
+      END_LOCK_MUTEX
+   }
+
+   bool addMatch(const FindMatch& match)
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         // we collect one result beyond MAX_COUNT so the client
+         // knows that the results were truncated
+         if (matchCount_ > MAX_COUNT)
+            return false;
+         matchCount_++;
+      }
+      END_LOCK_MUTEX
+
+      results_.enque(match);
+      return true;
    }
 
    std::string decode(const std::string& encoded)
@@ -245,168 +607,550 @@ private:
       if (encoded.empty())
          return encoded;
 
+      // NOTE: iconvstr goes through Riconv which doesn't touch any
+      // R interpreter state so it is safe to call on a worker thread
       std::string decoded;
       Error error = r::util::iconvstr(encoded, encoding_, "UTF-8", true,
                                       &decoded);
 
-      // Log error, but only once per grep operation
-      if (error && firstDecodeError_)
+      // Log error, but only once per find operation
+      if (error)
       {
-         firstDecodeError_ = false;
-         LOG_ERROR(error);
+         bool logError = false;
+         LOCK_MUTEX(mutex_)
+         {
+            logError = firstDecodeError_;
+            firstDecodeError_ = false;
+         }
+         END_LOCK_MUTEX
+
+         if (logError)
+            LOG_ERROR(error);
       }
 
       return decoded;
    }
 
-   void processContents(std::string* pContent,
-                        json::Array* pMatchOn,
-                        json::Array* pMatchOff)
+   // worker threads ---------------------------------------------------------
+
+   void workerMain()
    {
-      using namespace boost;
+      try
+      {
+         while (!isFinished())
+         {
+            FileInfo fileInfo;
+            if (!workQueue_.deque(&fileInfo, boost::posix_time::milliseconds(50)))
+               continue;
 
-      std::string decodedLine;
+            // always mark the item complete (even if processing it
+            // throws) so that the operation is guaranteed to finish
+            try
+            {
+               if (fileInfo.isDirectory())
+                  scanDirectory(fileInfo);
+               else
+                  searchFile(fileInfo);
+            }
+            CATCH_UNEXPECTED_EXCEPTION
+
+            completeWorkItem();
+         }
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
 
-      std::string::iterator inputPos = pContent->begin();
+   void scanDirectory(const FileInfo& dirInfo)
+   {
+      core::system::FileScannerOptions options;
+      options.recursive = false;
+      tree<FileInfo> files;
+      Error error = core::system::scanFiles(dirInfo, options, &files);
+      if (error)
+      {
+         LOG_ERROR(error);
+         return;
+      }
 
-      smatch match;
-      while (regex_search(std::string(inputPos, pContent->end()), match,
-                          regex("\x1B\\[(\\d\\d)?m(\x1B\\[K)?")))
+      tree<FileInfo>::iterator root = files.begin();
+      for (tree<FileInfo>::sibling_iterator it = files.begin(root);
+           it != files.end(root);
+           ++it)
       {
-         std::string match1 = match[1];
+         // like grep -r we don't follow symlinks
+         const FileInfo& fileInfo = *it;
+         if (fileInfo.isSymlink())
+            continue;
 
-         decodedLine.append(decode(
-               std::string(inputPos, inputPos + match.position())));
+         std::string name = FilePath(fileInfo.absolutePath()).filename();
+         if (fileInfo.isDirectory())
+         {
+            if (!isIgnoredDirectory(name))
+               addWorkItem(fileInfo);
+         }
+         else if (fileInfo.size() > 0 &&
+                  isIncludedFile(name, includePatterns_))
+         {
+            addWorkItem(fileInfo);
+         }
+      }
+   }
+
+   void searchFile(const FileInfo& fileInfo)
+   {
+      // map the file (files which can't be mapped e.g. because of
+      // insufficient permissions are skipped)
+      boost::iostreams::mapped_file_source file;
+      try
+      {
+         file.open(FilePath(fileInfo.absolutePath()).absolutePathNative());
+      }
+      catch(const std::exception&)
+      {
+         return;
+      }
+      if (!file.is_open() || file.size() == 0)
+         return;
 
-         inputPos += match.position() + match.length();
+      const char* begin = file.data();
+      const char* end = begin + file.size();
 
-         size_t charSize;
-         Error error = string_utils::utf8Distance(decodedLine.begin(),
-                                                  decodedLine.end(),
-                                                  &charSize);
-         if (error)
-            charSize = decodedLine.size();
+      // skip binary files
+      std::size_t checkBytes = std::min(file.size(), kBinaryCheckBytes);
+      if (std::memchr(begin, '\0', checkBytes) != NULL)
+         return;
 
-         if (match1 == "01")
-            pMatchOn->push_back(static_cast<int>(charSize));
-         else
-            pMatchOff->push_back(static_cast<int>(charSize));
+      const char* pos = begin;
+      int lineNum = 1;
+      while (pos < end && !isFinished())
+      {
+         const char* hit = matcher_.findNext(pos, end);
+         if (hit == NULL)
+            break;
+
+         // find the line containing the hit
+         const char* lineBegin = hit;
+         while (lineBegin > pos && *(lineBegin - 1) != '\n')
+            --lineBegin;
+         lineNum += static_cast<int>(std::count(pos, lineBegin, '\n'));
+
+         const char* lineEnd = static_cast<const char*>(
+                                 std::memchr(hit, '\n', end - hit));
+         if (lineEnd == NULL)
+            lineEnd = end;
+
+         const char* contentEnd = lineEnd;
+         if (contentEnd > lineBegin && *(contentEnd - 1) == '\r')
+            --contentEnd;
+
+         std::vector<std::pair<std::size_t,std::size_t> > ranges;
+         if (matcher_.matchLine(lineBegin, contentEnd, &ranges))
+         {
+            FindMatch match;
+            match.file = fileInfo.absolutePath();
+            match.lineNum = lineNum;
+            processContents(lineBegin, contentEnd, ranges, &match);
+            if (!addMatch(match))
+               break;
+         }
+
+         // advance to the next line
+         pos = lineEnd + 1;
+         lineNum++;
       }
-      if (inputPos != pContent->end())
-         decodedLine.append(decode(std::string(inputPos, pContent->end())));
+   }
 
-      if (decodedLine.size() > 300)
+   void processContents(
+            const char* begin,
+            const char* end,
+            const std::vector<std::pair<std::size_t,std::size_t> >& ranges,
+            FindMatch* pMatch)
+   {
+      // trim whitespace (match offsets are relative to the trimmed line)
+      const char* trimBegin = begin;
+      while (trimBegin < end && std::isspace(static_cast<unsigned char>(*trimBegin)))
+         ++trimBegin;
+      const char* trimEnd = end;
+      while (trimEnd > trimBegin && std::isspace(static_cast<unsigned char>(*(trimEnd - 1))))
+         --trimEnd;
+
+      std::string line(trimBegin, trimEnd);
+      std::size_t offset = trimBegin - begin;
+
+      // decode the line piecewise so we can compute character offsets for
+      // the start and end of each match
+      std::string decodedLine;
+      std::size_t prev = 0;
+      typedef std::pair<std::size_t,std::size_t> Range;
+      BOOST_FOREACH(const Range& range, ranges)
       {
-         decodedLine = decodedLine.erase(300);
+         std::size_t on = std::min(line.size(),
+                                   range.first > offset ? range.first - offset : 0);
+         std::size_t off = std::min(line.size(),
+                                    range.second > offset ? range.second - offset : 0);
+         if (on < prev || off <= on)
+            continue;
+
+         decodedLine.append(decode(line.substr(prev, on - prev)));
+         pMatch->matchOn.push_back(charCount(decodedLine));
+         decodedLine.append(decode(line.substr(on, off - on)));
+         pMatch->matchOff.push_back(charCount(decodedLine));
+         prev = off;
+      }
+      if (prev < line.size())
+         decodedLine.append(decode(line.substr(prev)));
+
+      if (decodedLine.size() > kMaxLineContents)
+      {
+         decodedLine = decodedLine.erase(kMaxLineContents);
          decodedLine.append("...");
       }
 
-      *pContent = decodedLine;
+      pMatch->contents = decodedLine;
    }
 
-   void onStdout(const core::system::ProcessOperations& ops, const std::string& data)
+   static int charCount(const std::string& str)
    {
-      json::Array files;
-      json::Array lineNums;
-      json::Array contents;
-      json::Array matchOns;
-      json::Array matchOffs;
+      size_t charSize;
+      Error error = string_utils::utf8Distance(str.begin(),
+                                               str.end(),
+                                               &charSize);
+      if (error)
+         charSize = str.size();
+      return static_cast<int>(charSize);
+   }
+
+private:
+   std::string handle_;
+   const FindMatcher matcher_;
+   const std::string encoding_;
+   const std::vector<boost::regex> includePatterns_;
+
+   core::thread::ThreadsafeQueue<FileInfo> workQueue_;
+   core::thread::ThreadsafeQueue<FindMatch> results_;
+
+   boost::mutex mutex_;
+   int pendingItems_;
+   std::size_t matchCount_;
+   bool cancelled_;
+   bool firstDecodeError_;
+};
+
+// files larger than this are searched but not indexed
+const boost::uintmax_t kMaxIndexedFileSize = 8 * 1024 * 1024;
+
+// projects with more files than this aren't indexed at all
+const std::size_t kMaxIndexedFiles = 50000;
 
-      int recordsToProcess = MAX_COUNT + 1 - findResults().resultCount();
-      if (recordsToProcess < 0)
-         recordsToProcess = 0;
+// trigram index of the files within the current project, kept up to date
+// from the project file monitor. it is used to limit find in files to
+// files which could possibly contain a match. reading and indexing files
+// is done on a background thread; until the initial set of files has been
+// indexed the index is not ready and searches scan the directory instead.
+// note that there is a window (between a file changing on disk and the
+// file monitor reporting it) where the index can be stale
+class ProjectFindIndex : boost::noncopyable
+{
+private:
+   struct Task
+   {
+      enum Type { None, Update, Remove, Ready, Reset };
 
-      stdOutBuf_.append(data);
-      size_t nextLineStart = 0;
-      size_t pos = -1;
-      while (recordsToProcess &&
-             std::string::npos != (pos = stdOutBuf_.find('\n', pos + 1)))
+      Task() : type(None) {}
+      Task(Type type, const FileInfo& fileInfo = FileInfo())
+         : type(type), fileInfo(fileInfo)
       {
-         std::string line = stdOutBuf_.substr(nextLineStart, pos - nextLineStart);
-         nextLineStart = pos + 1;
+      }
+
+      Type type;
+      FileInfo fileInfo;
+   };
 
-         boost::smatch match;
-         if (boost::regex_match(line, match, boost::regex("^((?:[a-zA-Z]:)?[^:]+):(\\d+):(.*)")))
+public:
+   ProjectFindIndex()
+      : started_(false), ready_(false), disabled_(false)
+   {
+   }
+
+   // COPYING: prohibited
+
+   void onMonitoringEnabled(const tree<core::FileInfo>& files)
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         root_ = projects::projectContext().directory();
+      }
+      END_LOCK_MUTEX
+
+      start();
+      for (tree<core::FileInfo>::leaf_iterator it = files.begin_leaf();
+           it != files.end_leaf();
+           ++it)
+      {
+         if (!it->isDirectory())
+            tasks_.enque(Task(Task::Update, *it));
+      }
+      tasks_.enque(Task(Task::Ready));
+   }
+
+   void onFileChange(const core::system::FileChangeEvent& event)
+   {
+      switch (event.type())
+      {
+      case core::system::FileChangeEvent::FileAdded:
+      case core::system::FileChangeEvent::FileModified:
+         if (!event.fileInfo().isDirectory())
+            tasks_.enque(Task(Task::Update, event.fileInfo()));
+         break;
+      case core::system::FileChangeEvent::FileRemoved:
+         tasks_.enque(Task(Task::Remove, event.fileInfo()));
+         break;
+      default:
+         break;
+      }
+   }
+
+   void onMonitoringDisabled()
+   {
+      tasks_.enque(Task(Task::Reset));
+   }
+
+   // get the files within directory which could contain all of the
+   // literals. returns false if the index can't be used for this search
+   bool candidates(const FilePath& directory,
+                   const std::vector<std::string>& literals,
+                   const std::vector<boost::regex>& includePatterns,
+                   std::vector<FileInfo>* pFiles)
+   {
+      std::vector<std::string> paths;
+      FilePath root;
+      LOCK_MUTEX(mutex_)
+      {
+         if (!ready_ || disabled_ || !directory.isWithin(root_))
+            return false;
+         root = root_;
+
+         if (!index_.candidates(literals, &paths))
+            return false;
+      }
+      END_LOCK_MUTEX
+
+      BOOST_FOREACH(const std::string& path, paths)
+      {
+         FilePath filePath(path);
+         if (!filePath.isWithin(directory))
+            continue;
+
+         // apply the same filters as are used for directory scans
+         if (!isIncludedFile(filePath.filename(), includePatterns))
+            continue;
+
+         bool ignored = false;
+         for (FilePath parent = filePath.parent();
+              parent.isWithin(root) && parent != root;
+              parent = parent.parent())
          {
-            std::string file = module_context::createAliasedPath(
-                  FilePath(string_utils::systemToUtf8(match[1])));
+            if (isIgnoredDirectory(parent.filename()))
+            {
+               ignored = true;
+               break;
+            }
+         }
 
-            if (file.find("/.Rproj.user/") != std::string::npos)
-               continue;
-            if (file.find("/.git/") != std::string::npos)
-               continue;
-            if (file.find("/.svn/") != std::string::npos)
-               continue;
+         if (!ignored)
+            pFiles->push_back(FileInfo(path, false));
+      }
+
+      return true;
+   }
+
+private:
 
-            int lineNum = safe_convert::stringTo<int>(std::string(match[2]), -1);
-            std::string lineContents = match[3];
-            boost::algorithm::trim(lineContents);
-            json::Array matchOn, matchOff;
-            processContents(&lineContents, &matchOn, &matchOff);
+   void start()
+   {
+      if (started_)
+         return;
+      started_ = true;
 
-            files.push_back(file);
-            lineNums.push_back(lineNum);
-            contents.push_back(lineContents);
-            matchOns.push_back(matchOn);
-            matchOffs.push_back(matchOff);
+      core::thread::safeLaunchThread(
+                     boost::bind(&ProjectFindIndex::workerMain, this));
+   }
 
-            recordsToProcess--;
+   void workerMain()
+   {
+      try
+      {
+         while (true)
+         {
+            Task task;
+            if (tasks_.deque(&task, boost::posix_time::seconds(1)))
+               processTask(task);
          }
       }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
 
-      if (nextLineStart)
+   void processTask(const Task& task)
+   {
+      const std::string& path = task.fileInfo.absolutePath();
+
+      switch (task.type)
       {
-         stdOutBuf_.erase(0, nextLineStart);
+      case Task::Update:
+         indexFile(task.fileInfo);
+         break;
+
+      case Task::Remove:
+         LOCK_MUTEX(mutex_)
+         {
+            index_.remove(path);
+            index_.removePrefix(path + "/");
+         }
+         END_LOCK_MUTEX
+         break;
+
+      case Task::Ready:
+         LOCK_MUTEX(mutex_)
+         {
+            ready_ = true;
+         }
+         END_LOCK_MUTEX
+         break;
+
+      case Task::Reset:
+         LOCK_MUTEX(mutex_)
+         {
+            index_.clear();
+            ready_ = false;
+            disabled_ = false;
+         }
+         END_LOCK_MUTEX
+         break;
+
+      default:
+         break;
       }
+   }
+
+   void indexFile(const FileInfo& fileInfo)
+   {
+      const std::string& path = fileInfo.absolutePath();
 
-      if (files.size() > 0)
+      LOCK_MUTEX(mutex_)
       {
-         json::Object result;
-         result["handle"] = handle();
-         json::Object results;
-         results["file"] = files;
-         results["line"] = lineNums;
-         results["lineValue"] = contents;
-         results["matchOn"] = matchOns;
-         results["matchOff"] = matchOffs;
-         result["results"] = results;
+         if (disabled_)
+            return;
+
+         // give up on very large projects (searches will always scan)
+         if (index_.size() >= kMaxIndexedFiles)
+         {
+            disabled_ = true;
+            index_.clear();
+            return;
+         }
+      }
+      END_LOCK_MUTEX
 
-         findResults().addResult(handle(),
-                                 files,
-                                 lineNums,
-                                 contents,
-                                 matchOns,
-                                 matchOffs);
+      // empty files and symlinks are never searched
+      if (fileInfo.size() == 0 || fileInfo.isSymlink())
+      {
+         removeFile(path);
+         return;
+      }
 
-         module_context::enqueClientEvent(
-                  ClientEvent(client_events::kFindResult, result));
+      // large files are always searched
+      if (fileInfo.size() > kMaxIndexedFileSize)
+      {
+         addUnindexedFile(path);
+         return;
       }
 
-      if (recordsToProcess <= 0)
-         findResults().onFindEnd(handle());
+      boost::iostreams::mapped_file_source file;
+      try
+      {
+         file.open(FilePath(path).absolutePathNative());
+      }
+      catch(const std::exception&)
+      {
+      }
+      if (!file.is_open())
+      {
+         addUnindexedFile(path);
+         return;
+      }
+
+      // binary files are never searched
+      const char* begin = file.data();
+      std::size_t checkBytes = std::min(file.size(), kBinaryCheckBytes);
+      if (std::memchr(begin, '\0', checkBytes) != NULL)
+      {
+         removeFile(path);
+         return;
+      }
+
+      LOCK_MUTEX(mutex_)
+      {
+         index_.add(path, begin, begin + file.size());
+      }
+      END_LOCK_MUTEX
    }
 
-   void onStderr(const core::system::ProcessOperations& ops, const std::string& data)
+   void addUnindexedFile(const std::string& path)
    {
-      LOG_ERROR_MESSAGE("grep: " + data);
+      LOCK_MUTEX(mutex_)
+      {
+         index_.addUnindexed(path);
+      }
+      END_LOCK_MUTEX
    }
 
-   void onExit(int exitCode)
+   void removeFile(const std::string& path)
    {
-      findResults().onFindEnd(handle());
-      module_context::enqueClientEvent(
-            ClientEvent(client_events::kFindOperationEnded, handle()));
-      if (!tempFile_.empty())
-         tempFile_.removeIfExists();
+      LOCK_MUTEX(mutex_)
+      {
+         index_.remove(path);
+      }
+      END_LOCK_MUTEX
    }
 
-   bool firstDecodeError_;
-   std::string encoding_;
-   FilePath tempFile_;
-   std::string stdOutBuf_;
-   std::string handle_;
+private:
+   bool started_;
+   core::thread::ThreadsafeQueue<Task> tasks_;
+
+   boost::mutex mutex_;
+   core::text::TrigramIndex index_;
+   FilePath root_;
+   bool ready_;
+   bool disabled_;
 };
 
+ProjectFindIndex& projectFindIndex()
+{
+   static ProjectFindIndex* s_pIndex = NULL;
+   if (s_pIndex == NULL)
+      s_pIndex = new ProjectFindIndex();
+   return *s_pIndex;
+}
+
+void onFileMonitorEnabled(const tree<core::FileInfo>& files)
+{
+   projectFindIndex().onMonitoringEnabled(files);
+}
+
+void onFilesChanged(const std::vector<core::system::FileChangeEvent>& events)
+{
+   std::for_each(events.begin(),
+                 events.end(),
+                 boost::bind(&ProjectFindIndex::onFileChange,
+                             &projectFindIndex(),
+                             _1));
+}
+
+void onFileMonitorDisabled()
+{
+   projectFindIndex().onMonitoringDisabled();
+}
+
 } // namespace
 
 core::Error beginFind(const json::JsonRpcRequest& request,
@@ -426,26 +1170,8 @@ core::Error beginFind(const json::JsonRpcRequest& request,
    if (error)
       return error;
 
-   core::system::ProcessOptions options;
-
-   core::system::Options childEnv;
-   core::system::environment(&childEnv);
-   core::system::setenv(&childEnv, "GREP_COLOR", "01");
-   core::system::setenv(&childEnv, "GREP_COLORS", "ne:fn=:ln=:se=:mt=01");
-#ifdef _WIN32
-   FilePath gnuGrepPath = session::options().gnugrepPath();
-   core::system::addToPath(
-            &childEnv,
-            string_utils::utf8ToSystem(gnuGrepPath.absolutePath()));
-#endif
-   options.environment = childEnv;
-
-   // Put the grep pattern in a file
-   FilePath tempFile = module_context::tempFile("rs_grep", "txt");
-   boost::shared_ptr<std::ostream> pStream;
-   error = tempFile.open_w(&pStream);
-   if (error)
-      return error;
+   // encode the search string using the default encoding (files are
+   // searched in their raw form and decoded only for display)
    std::string encoding = projects::projectContext().hasProject() ?
                           projects::projectContext().defaultEncoding() :
                           userSettings().defaultEncoding();
@@ -461,56 +1187,68 @@ core::Error beginFind(const json::JsonRpcRequest& request,
       encodedString = searchString;
    }
 
-   *pStream << encodedString << std::endl;
-   pStream.reset(); // release file handle
-
-   boost::shared_ptr<GrepOperation> ptrGrepOp = GrepOperation::create(encoding,
-                                                                      tempFile);
-   core::system::ProcessCallbacks callbacks =
-                                       ptrGrepOp->createProcessCallbacks();
-
-#ifdef _WIN32
-   shell_utils::ShellCommand cmd(gnuGrepPath.complete("grep"));
-#else
-   shell_utils::ShellCommand cmd("grep");
-#endif
-   cmd << "-rHn" << "--binary-files=without-match" << "--color=always";
-#ifndef _WIN32
-   cmd << "--devices=skip";
-#endif
-
-   if (ignoreCase)
-      cmd << "-i";
+   // only search files whose names match one of the file patterns (if any)
+   std::vector<boost::regex> includePatterns;
+   BOOST_FOREACH(json::Value filePattern, filePatterns)
+   {
+      includePatterns.push_back(
+            regex_utils::wildcardPatternToRegex(filePattern.get_str()));
+   }
 
-   // Use -f to pass pattern via file, so we don't have to worry about
-   // escaping double quotes, etc.
-   cmd << "-f";
-   cmd << tempFile;
-   if (!asRegex)
-      cmd << "-F";
+   boost::shared_ptr<FindOperation> ptrFindOp;
+   try
+   {
+      FindMatcher matcher(encodedString, asRegex, ignoreCase);
+      ptrFindOp = FindOperation::create(matcher, encoding, includePatterns);
+   }
+   catch(const boost::regex_error& e)
+   {
+      error = Error(json::errc::ParamInvalid, ERROR_LOCATION);
+      error.addProperty("description", e.what());
+      return error;
+   }
 
-   BOOST_FOREACH(json::Value filePattern, filePatterns)
+   // use the project index to narrow the files to search (if it's ready
+   // and the search has literals which can be looked up in it). the index
+   // folds ascii case only so non-ascii case insensitive searches must scan
+   FilePath searchPath = module_context::resolveAliasedPath(directory);
+   std::vector<std::string> literals;
+   if (asRegex)
+      literals = core::text::TrigramIndex::requiredLiterals(encodedString);
+   else
+      literals.push_back(encodedString);
+   bool asciiLiterals = true;
+   BOOST_FOREACH(const std::string& literal, literals)
    {
-      cmd << "--include=" + filePattern.get_str();
+      for (std::string::const_iterator it = literal.begin();
+           it != literal.end();
+           ++it)
+      {
+         if (static_cast<unsigned char>(*it) >= 0x80)
+            asciiLiterals = false;
+      }
    }
 
-   cmd << shell_utils::EscapeFilesOnly << "--" << shell_utils::EscapeAll;
-   cmd << module_context::resolveAliasedPath(directory);
+   std::vector<FileInfo> roots;
+   bool useIndex = asciiLiterals || !ignoreCase;
+   if (!useIndex || !projectFindIndex().candidates(searchPath,
+                                                   literals,
+                                                   includePatterns,
+                                                   &roots))
+   {
+      roots.clear();
+      roots.push_back(FileInfo(searchPath));
+   }
 
    // Clear existing results
    findResults().clear();
 
-   error = module_context::processSupervisor().runCommand(cmd,
-                                                          options,
-                                                          callbacks);
-   if (error)
-      return error;
-
-   findResults().onFindBegin(ptrGrepOp->handle(),
+   findResults().onFindBegin(ptrFindOp->handle(),
                              searchString,
                              directory,
                              asRegex);
-   pResponse->setResult(ptrGrepOp->handle());
+   ptrFindOp->start(roots);
+   pResponse->setResult(ptrFindOp->handle());
 
    return Success();
 }
@@ -572,6 +1310,15 @@ core::Error initialize()
    // register suspend handler
    addSuspendHandler(SuspendHandler(onSuspend, onResume));
 
+   // keep the project find index up to date with the file monitor
+   // (note that if there is no project this will no-op)
+   session::projects::FileMonitorCallbacks cb;
+   cb.onMonitoringEnabled = onFileMonitorEnabled;
+   cb.onFilesChanged = onFilesChanged;
+   cb.onMonitoringDisabled = onFileMonitorDisabled;
+   projects::projectContext().subscribeToFileMonitor("Find in files indexing",
+                                                     cb);
+
    // install handlers
    using boost::bind;
    ExecBlock initBlock ;
@@ -35,11 +35,13 @@
 #include <core/BoostLamda.hpp>
 
 #include <core/json/JsonRpc.hpp>
+#include <core/json/JsonWriter.hpp>
 #include <core/system/Crypto.hpp>
 #include <core/system/ShellUtils.hpp>
 #include <core/system/System.hpp>
 #include <core/system/Process.hpp>
 #include <core/system/Environment.hpp>
+#include <core/system/FileChangeEvent.hpp>
 #include <core/Exec.hpp>
 #include <core/FileSerializer.hpp>
 #include <core/GitGraph.hpp>
@@ -87,6 +89,8 @@ uint64_t s_gitVersion;
 const uint64_t GIT_1_7_2 = ((uint64_t)1 << 48) |
                            ((uint64_t)7 << 32) |
                            ((uint64_t)2 << 16);
+const uint64_t GIT_2_26 = ((uint64_t)2 << 48) |
+                          ((uint64_t)26 << 32);
 
 core::system::ProcessOptions procOptions()
 {
@@ -173,6 +177,112 @@ struct RemoteBranchInfo
    }
 };
 
+// commit graph lines computed for a revision (graph state is kept so that
+// paging through the history only needs to compute the new lines)
+struct GraphCache
+{
+   void reset(const std::string& newRev, const std::string& newHead)
+   {
+      rev = newRev;
+      head = newHead;
+      pGraph.reset(new gitgraph::GitGraph());
+      lines.clear();
+      complete = false;
+   }
+
+   std::string rev;
+   std::string head;
+   boost::shared_ptr<gitgraph::GitGraph> pGraph;
+   std::vector<std::string> lines;
+   bool complete;
+};
+
+// read the next line of process output (lines may be terminated by any
+// combination of \r and \n; empty lines are returned as such)
+bool nextLine(const std::string& output,
+              std::string::size_type* pPos,
+              std::string* pLine)
+{
+   if (*pPos >= output.size())
+      return false;
+
+   std::string::size_type end = output.find_first_of("\r\n", *pPos);
+   if (end == std::string::npos)
+      end = output.size();
+
+   pLine->assign(output, *pPos, end - *pPos);
+   *pPos = end + 1;
+   return true;
+}
+
+bool isWordChar(char ch)
+{
+   return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') ||
+          (ch >= '0' && ch <= '9') || ch == '_';
+}
+
+// split a "key value" line of raw git log output
+bool parseKeyValue(const std::string& line,
+                   std::string* pKey,
+                   std::string* pValue)
+{
+   std::string::size_type space = line.find(' ');
+   if (space == 0 || space == std::string::npos)
+      return false;
+
+   for (std::string::size_type i = 0; i < space; i++)
+   {
+      if (!isWordChar(line[i]))
+         return false;
+   }
+
+   pKey->assign(line, 0, space);
+   pValue->assign(line, space + 1, std::string::npos);
+   return true;
+}
+
+bool isDigits(const std::string& str,
+              std::string::size_type begin,
+              std::string::size_type end)
+{
+   if (begin >= end)
+      return false;
+   for (std::string::size_type i = begin; i < end; i++)
+   {
+      if (str[i] < '0' || str[i] > '9')
+         return false;
+   }
+   return true;
+}
+
+// parse an author/committer value ("name <email> time tz")
+bool parseAuthorTime(const std::string& value,
+                     std::string* pAuthor,
+                     std::string* pTime,
+                     std::string* pTz)
+{
+   std::string::size_type tzPos = value.rfind(' ');
+   if (tzPos == std::string::npos || tzPos == 0)
+      return false;
+   std::string::size_type timePos = value.rfind(' ', tzPos - 1);
+   if (timePos == std::string::npos)
+      return false;
+
+   std::string::size_type tzBegin = tzPos + 1;
+   if (tzBegin < value.size() && (value[tzBegin] == '+' || value[tzBegin] == '-'))
+      tzBegin++;
+   if (!isDigits(value, timePos + 1, tzPos) ||
+       !isDigits(value, tzBegin, value.size()))
+   {
+      return false;
+   }
+
+   pAuthor->assign(value, 0, timePos);
+   pTime->assign(value, timePos + 1, tzPos - timePos - 1);
+   pTz->assign(value, tzPos + 1, std::string::npos);
+   return true;
+}
+
 class Git;
 
 std::vector<PidType> s_pidsToTerminate_;
@@ -203,7 +313,8 @@ std::string gitBin()
 
 Error gitExec(const ShellArgs& args,
               const core::FilePath& workingDir,
-              core::system::ProcessResult* pResult)
+              core::system::ProcessResult* pResult,
+              const std::string& input = std::string())
 {
    core::system::ProcessOptions options = procOptions();
    options.workingDir = workingDir;
@@ -215,17 +326,204 @@ Error gitExec(const ShellArgs& args,
 #ifdef _WIN32
       return runProgram(gitBin(),
                         args.args(),
-                        "",
+                        input,
                         options,
                         pResult);
 #else
       return runCommand(git() << args.args(),
-                        "",
+                        input,
                         options,
                         pResult);
 #endif
 }
 
+// a long running "git cat-file --batch" process which is used to read
+// objects (e.g. the contents of files at a given commit) without starting
+// a new git process for each one. the process is run under its own
+// supervisor (so it doesn't count as a running child of the session) and
+// requests are written and their responses read by polling it
+class CatFileBatch : boost::noncopyable
+{
+public:
+   CatFileBatch() : pState_(new State()) {}
+
+   virtual ~CatFileBatch()
+   {
+      try
+      {
+         stop();
+      }
+      catch(...)
+      {
+      }
+   }
+
+   // COPYING: boost::noncopyable
+
+   // read an object (pFound is set to false if it doesn't exist)
+   Error readObject(const FilePath& root,
+                    const std::string& object,
+                    std::string* pContents,
+                    bool* pFound)
+   {
+      // objects names can't contain newlines (they delimit requests)
+      if (object.find_first_of("\r\n") != std::string::npos)
+         return systemError(boost::system::errc::invalid_argument,
+                            ERROR_LOCATION);
+
+      Error error = ensureRunning(root);
+      if (error)
+         return error;
+
+      pState_->input.append(object + "\n");
+
+      boost::posix_time::ptime timeout =
+            boost::posix_time::microsec_clock::universal_time() +
+            boost::posix_time::seconds(30);
+      while (true)
+      {
+         supervisor_.poll();
+
+         if (takeResponse(object, pContents, pFound))
+            return Success();
+
+         if (!pState_->running ||
+             boost::posix_time::microsec_clock::universal_time() > timeout)
+         {
+            stop();
+            return systemError(boost::system::errc::timed_out,
+                               ERROR_LOCATION);
+         }
+
+         boost::this_thread::sleep(boost::posix_time::milliseconds(2));
+      }
+   }
+
+   void stop()
+   {
+      supervisor_.terminateAll();
+      supervisor_.wait(boost::posix_time::milliseconds(10),
+                       boost::posix_time::seconds(1));
+      pState_.reset(new State());
+      root_ = FilePath();
+   }
+
+private:
+   struct State
+   {
+      State() : running(false) {}
+      bool running;
+      std::string input;
+      std::string output;
+   };
+
+   static bool onContinue(boost::shared_ptr<State> pState,
+                          core::system::ProcessOperations& ops)
+   {
+      if (!pState->input.empty())
+      {
+         Error error = ops.writeToStdin(pState->input, false);
+         if (error)
+         {
+            LOG_ERROR(error);
+            return false;
+         }
+         pState->input.clear();
+      }
+      return true;
+   }
+
+   static void onStdout(boost::shared_ptr<State> pState,
+                        core::system::ProcessOperations&,
+                        const std::string& output)
+   {
+      pState->output.append(output);
+   }
+
+   static void onExit(boost::shared_ptr<State> pState, int)
+   {
+      pState->running = false;
+   }
+
+   Error ensureRunning(const FilePath& root)
+   {
+      if (pState_->running && root == root_)
+         return Success();
+
+      stop();
+
+      core::system::ProcessOptions options = procOptions();
+      options.workingDir = root;
+#ifdef _WIN32
+      options.detachProcess = true;
+#endif
+
+      core::system::ProcessCallbacks cb;
+      cb.onContinue = boost::bind(onContinue, pState_, _1);
+      cb.onStdout = boost::bind(onStdout, pState_, _1, _2);
+      cb.onExit = boost::bind(onExit, pState_, _1);
+
+      ShellArgs args = ShellArgs() << "cat-file" << "--batch";
+#ifdef _WIN32
+      Error error = supervisor_.runProgram(gitBin(), args.args(), options, cb);
+#else
+      Error error = supervisor_.runCommand(git() << args.args(), options, cb);
+#endif
+      if (error)
+         return error;
+
+      pState_->running = true;
+      root_ = root;
+      return Success();
+   }
+
+   // responses are "<sha> <type> <size>\n<contents>\n" or
+   // "<object> missing\n" (or "ambiguous")
+   bool takeResponse(const std::string& object,
+                     std::string* pContents,
+                     bool* pFound)
+   {
+      std::string& output = pState_->output;
+      std::string::size_type headerEnd = output.find('\n');
+      if (headerEnd == std::string::npos)
+         return false;
+
+      std::string header = output.substr(0, headerEnd);
+      std::string::size_type sizePos = header.rfind(' ');
+      std::string size = sizePos != std::string::npos ?
+                                    header.substr(sizePos + 1) : std::string();
+      if (size.empty() ||
+          size.find_first_not_of("0123456789") != std::string::npos ||
+          header == object + " missing")
+      {
+         output.erase(0, headerEnd + 1);
+         pContents->clear();
+         *pFound = false;
+         return true;
+      }
+
+      std::size_t length = safe_convert::stringTo<std::size_t>(size, 0);
+      if (output.size() < headerEnd + 1 + length + 1)
+         return false;
+
+      pContents->assign(output, headerEnd + 1, length);
+      output.erase(0, headerEnd + 1 + length + 1);
+      *pFound = true;
+      return true;
+   }
+
+private:
+   FilePath root_;
+   core::system::ProcessSupervisor supervisor_;
+   boost::shared_ptr<State> pState_;
+};
+
+bool isObjectId(const std::string& rev)
+{
+   return rev.size() == 40 &&
+          rev.find_first_not_of("0123456789abcdef") == std::string::npos;
+}
+
 bool commitIsMatch(const std::vector<std::string>& patterns,
                    const CommitInfo& commit)
 {
@@ -260,21 +558,214 @@ bool isUntracked(const source_control::StatusResult& statusResult,
    return statusResult.getStatus(filePath).status() == "??";
 }
 
+// git commands which don't change the status of the working tree
+bool isReadOnlyGitCommand(const std::vector<std::string>& args)
+{
+   if (args.empty())
+      return false;
+
+   const std::string& command = args.front();
+   return command == "status" || command == "log" || command == "rev-list" ||
+          command == "rev-parse" || command == "show" || command == "diff" ||
+          command == "branch" || command == "config" || command == "remote" ||
+          command == "ls-files" || command == "for-each-ref" ||
+          command == "cat-file" || command == "--version";
+}
+
+// the git status of the working tree, seeded by a full status and then
+// updated from file monitor events (re-running git status only for the
+// paths which changed). changes to the index or HEAD (which don't show up
+// as file changes) cause a full refresh
+class StatusCache : boost::noncopyable
+{
+public:
+   StatusCache() : enabled_(false), valid_(false) {}
+
+   bool enabled() const { return enabled_; }
+
+   void setEnabled(bool enabled)
+   {
+      enabled_ = enabled;
+      invalidate();
+   }
+
+   void invalidate()
+   {
+      valid_ = false;
+      files_.clear();
+      pendingPaths_.clear();
+   }
+
+   bool valid(const FilePath& gitDir) const
+   {
+      return valid_ && signature(gitDir) == signature_;
+   }
+
+   void seed(const FilePath& gitDir, const std::vector<FileWithStatus>& files)
+   {
+      files_.clear();
+      pendingPaths_.clear();
+      update(files);
+      signature_ = signature(gitDir);
+      valid_ = true;
+   }
+
+   void onFilesChanged(
+         const std::vector<core::system::FileChangeEvent>& events)
+   {
+      if (!valid_)
+         return;
+
+      BOOST_FOREACH(const core::system::FileChangeEvent& event, events)
+      {
+         FilePath path(event.fileInfo().absolutePath());
+
+         // ignore rules may change the status of any number of files
+         if (path.filename() == ".gitignore")
+         {
+            invalidate();
+            return;
+         }
+
+         pendingPaths_.insert(path.absolutePath());
+      }
+   }
+
+   // paths whose status we changed ourselves (e.g. by staging them). we
+   // know what changed so the index having been rewritten needn't cause a
+   // full refresh
+   void onPathsChanged(const FilePath& gitDir,
+                       const std::vector<FilePath>& paths)
+   {
+      if (!valid_)
+         return;
+
+      BOOST_FOREACH(const FilePath& path, paths)
+      {
+         if (path.filename() == ".gitignore")
+         {
+            invalidate();
+            return;
+         }
+
+         pendingPaths_.insert(path.absolutePath());
+      }
+      signature_ = signature(gitDir);
+   }
+
+   bool hasPendingPaths() const { return !pendingPaths_.empty(); }
+
+   std::vector<FilePath> takePendingPaths()
+   {
+      std::vector<FilePath> paths;
+      BOOST_FOREACH(const std::string& path, pendingPaths_)
+      {
+         paths.push_back(FilePath(path));
+      }
+      pendingPaths_.clear();
+      return paths;
+   }
+
+   // replace the status of paths (and anything beneath them). note that
+   // git status may itself rewrite the index (to refresh stat info) so we
+   // take a new signature as well
+   void update(const FilePath& gitDir,
+               const std::vector<FilePath>& paths,
+               const std::vector<FileWithStatus>& files)
+   {
+      BOOST_FOREACH(const FilePath& path, paths)
+      {
+         std::string prefix = path.absolutePath() + "/";
+         std::map<std::string, FileWithStatus>::iterator it =
+                                       files_.lower_bound(path.absolutePath());
+         while (it != files_.end() &&
+                (it->first == path.absolutePath() ||
+                 boost::algorithm::starts_with(it->first, prefix)))
+         {
+            files_.erase(it++);
+         }
+      }
+
+      update(files);
+      signature_ = signature(gitDir);
+   }
+
+   StatusResult status(const FilePath& dir) const
+   {
+      std::vector<FileWithStatus> files;
+      for (std::map<std::string, FileWithStatus>::const_iterator it =
+              files_.begin(); it != files_.end(); ++it)
+      {
+         if (it->second.path == dir || it->second.path.isWithin(dir))
+            files.push_back(it->second);
+      }
+      return StatusResult(files);
+   }
+
+private:
+   void update(const std::vector<FileWithStatus>& files)
+   {
+      BOOST_FOREACH(const FileWithStatus& file, files)
+      {
+         files_[file.path.absolutePath()] = file;
+      }
+   }
+
+   static std::string signature(const FilePath& gitDir)
+   {
+      std::ostringstream ostr;
+      const char* files[] = { "index", "HEAD" };
+      for (std::size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++)
+      {
+         FilePath filePath = gitDir.childPath(files[i]);
+         if (filePath.exists())
+            ostr << filePath.lastWriteTime() << ":" << filePath.size() << ";";
+      }
+      return ostr.str();
+   }
+
+private:
+   bool enabled_;
+   bool valid_;
+   std::string signature_;
+   std::map<std::string, FileWithStatus> files_;
+   std::set<std::string> pendingPaths_;
+};
+
 class Git : public boost::noncopyable
 {
 private:
    FilePath root_;
+   GraphCache graphCache_;
+   StatusCache statusCache_;
+   CatFileBatch catFileBatch_;
 
 protected:
    core::Error runGit(const ShellArgs& args,
                       std::string* pStdOut=NULL,
                       std::string* pStdErr=NULL,
-                      int* pExitCode=NULL)
+                      int* pExitCode=NULL,
+                      const std::string& input=std::string())
+   {
+      using namespace core::system;
+
+      // commands which change the repository invalidate cached status
+      if (!isReadOnlyGitCommand(args.args()))
+         statusCache_.invalidate();
+
+      return execGit(args, pStdOut, pStdErr, pExitCode, input);
+   }
+
+   core::Error execGit(const ShellArgs& args,
+                       std::string* pStdOut=NULL,
+                       std::string* pStdErr=NULL,
+                       int* pExitCode=NULL,
+                       const std::string& input=std::string())
    {
       using namespace core::system;
 
       ProcessResult result;
-      Error error = gitExec(args, root_, &result);
+      Error error = gitExec(args, root_, &result, input);
       if (error)
          return error;
 
@@ -327,6 +818,8 @@ protected:
                                      console_process::kDefaultMaxOutputLines);
 #endif
 
+      (*ppCP)->onExit().connect(boost::bind(&StatusCache::invalidate,
+                                            &statusCache_));
       (*ppCP)->onExit().connect(boost::bind(&enqueueRefreshEvent));
 
       return Success();
@@ -341,8 +834,7 @@ protected:
    }
 
 
-   void appendPathArgs(const std::vector<FilePath>& filePaths,
-                       ShellArgs* pArgs)
+   std::string pathArg(const FilePath& filePath)
    {
       // On OSX we observed that staging and unstaging operations involving
       // directories that didn't exist would fail with an "unable to switch
@@ -351,16 +843,73 @@ protected:
       // we could, so below we use git root relative paths whenever we can
       // on OSX, but on other platforms continue to use full absolute paths
 #ifdef __APPLE__
+      if (filePath.isWithin(root_))
+         return filePath.relativePath(root_);
+#endif
+      return string_utils::utf8ToSystem(filePath.absolutePath());
+   }
+
+   void appendPathArgs(const std::vector<FilePath>& filePaths,
+                       ShellArgs* pArgs)
+   {
       BOOST_FOREACH(const FilePath& filePath, filePaths)
       {
-         if (filePath.isWithin(root_))
-            *pArgs << filePath.relativePath(root_);
-         else
-            *pArgs << filePath;
+         *pArgs << pathArg(filePath);
       }
-#else
-      *pArgs << filePaths;
-#endif
+   }
+
+   // run a command which operates on paths (e.g. add or reset). the paths
+   // are fed to git over stdin where it supports that so that any number
+   // of them can be handled by a single invocation, otherwise they're
+   // passed on the command line a batch at a time (to stay well within
+   // ARG_MAX). the status of just the paths is refreshed afterwards
+   core::Error runGitWithPaths(const ShellArgs& args,
+                               const std::vector<FilePath>& filePaths)
+   {
+      // (note that git commands such as checkout mean something else
+      // entirely when no paths are given)
+      if (filePaths.empty())
+         return Success();
+
+      FilePath gitDir = root_.childPath(".git");
+      bool statusCacheValid = statusCache_.valid(gitDir);
+
+      Error error;
+      if (s_gitVersion >= GIT_2_26)
+      {
+         std::string input;
+         BOOST_FOREACH(const FilePath& filePath, filePaths)
+         {
+            input.append(pathArg(filePath));
+            input.push_back('\0');
+         }
+
+         ShellArgs pathspecArgs = args;
+         pathspecArgs << "--pathspec-from-file=-" << "--pathspec-file-nul";
+         error = execGit(pathspecArgs, NULL, NULL, NULL, input);
+      }
+      else
+      {
+         const std::size_t kMaxPathArgs = 1000;
+         for (std::size_t i = 0; i < filePaths.size() && !error;
+              i += kMaxPathArgs)
+         {
+            std::vector<FilePath> batch(
+                  filePaths.begin() + i,
+                  filePaths.begin() + std::min(i + kMaxPathArgs,
+                                               filePaths.size()));
+            ShellArgs batchArgs = args;
+            batchArgs << "--";
+            appendPathArgs(batch, &batchArgs);
+            error = execGit(batchArgs);
+         }
+      }
+
+      if (statusCacheValid && !error)
+         statusCache_.onPathsChanged(gitDir, filePaths);
+      else
+         statusCache_.invalidate();
+      return error;
    }
 
 public:
@@ -385,21 +934,17 @@ public:
       root_ = path;
    }
 
-   core::Error status(const FilePath& dir,
-                      StatusResult* pStatusResult)
+   core::Error runStatus(const std::vector<FilePath>& paths,
+                         std::vector<FileWithStatus>* pFiles)
    {
-      using namespace boost;
-
-      std::vector<FileWithStatus> files;
-
-      std::vector<std::string> lines;
       std::string output;
-      Error error = runGit(ShellArgs() << "status" << "--porcelain" << "--" << dir,
+      Error error = runGit(ShellArgs() << "status" << "--porcelain" << "--"
+                                       << paths,
                            &output);
       if (error)
          return error;
-      lines = split(output);
 
+      std::vector<std::string> lines = split(output);
       for (std::vector<std::string>::iterator it = lines.begin();
            it != lines.end();
            it++)
@@ -416,25 +961,101 @@ public:
             filePath = filePath.substr(0, filePath.size() - 1);
          file.path = root_.childPath(string_utils::systemToUtf8(filePath));
 
-         files.push_back(file);
+         pFiles->push_back(file);
+      }
+
+      return Success();
+   }
+
+   // bring the cached status up to date
+   core::Error updateStatusCache()
+   {
+      // refresh everything if too many paths have changed (one status of
+      // the whole tree is cheaper than very long path lists)
+      const std::size_t kMaxIncrementalPaths = 256;
+
+      FilePath gitDir = root_.childPath(".git");
+      if (statusCache_.valid(gitDir))
+      {
+         std::vector<FilePath> paths = statusCache_.takePendingPaths();
+         if (paths.empty())
+            return Success();
+
+         if (paths.size() <= kMaxIncrementalPaths)
+         {
+            std::vector<FileWithStatus> files;
+            Error error = runStatus(paths, &files);
+            if (error)
+            {
+               statusCache_.invalidate();
+               return error;
+            }
+
+            statusCache_.update(gitDir, paths, files);
+            return Success();
+         }
       }
 
+      std::vector<FileWithStatus> files;
+      Error error = runStatus(std::vector<FilePath>(1, root_), &files);
+      if (error)
+      {
+         statusCache_.invalidate();
+         return error;
+      }
+
+      statusCache_.seed(gitDir, files);
+      return Success();
+   }
+
+   core::Error status(const FilePath& dir,
+                      StatusResult* pStatusResult)
+   {
+      if (statusCache_.enabled() && (dir == root_ || dir.isWithin(root_)))
+      {
+         Error error = updateStatusCache();
+         if (error)
+            return error;
+
+         *pStatusResult = statusCache_.status(dir);
+         return Success();
+      }
+
+      std::vector<FileWithStatus> files;
+      Error error = runStatus(std::vector<FilePath>(1, dir), &files);
+      if (error)
+         return error;
+
       *pStatusResult = StatusResult(files);
 
       return Success();
    }
 
+   void stopBatchProcesses()
+   {
+      catFileBatch_.stop();
+   }
+
+   void setStatusCacheEnabled(bool enabled)
+   {
+      statusCache_.setEnabled(enabled);
+   }
+
+   void onFilesChanged(
+         const std::vector<core::system::FileChangeEvent>& events)
+   {
+      if (statusCache_.enabled())
+         statusCache_.onFilesChanged(events);
+   }
+
    core::Error add(const std::vector<FilePath>& filePaths)
    {
-      return runGit(ShellArgs() << "add" << "--" << filePaths);
+      return runGitWithPaths(ShellArgs() << "add", filePaths);
    }
 
    core::Error remove(const std::vector<FilePath>& filePaths)
    {
-      ShellArgs args;
-      args << "rm" << "--";
-      appendPathArgs(filePaths, &args);
-      return runGit(args);
+      return runGitWithPaths(ShellArgs() << "rm", filePaths);
    }
 
    core::Error discard(const std::vector<FilePath>& filePaths)
@@ -451,7 +1072,7 @@ public:
                           boost::bind(isUntracked, statusResult, _1));
 
       // -f means don't fail on unmerged entries
-      return runGit(ShellArgs() << "checkout" << "-f" << "--" << trackedPaths);
+      return runGitWithPaths(ShellArgs() << "checkout" << "-f", trackedPaths);
    }
 
    core::Error stage(const std::vector<FilePath> &filePaths)
@@ -522,11 +1143,10 @@ public:
 
       ShellArgs args;
       if (exitCode == 0)
-         args << "reset" << "HEAD" << "--" ;
+         args << "reset" << "HEAD";
       else
-         args << "rm" << "--cached" << "--";
-      appendPathArgs(trackedPaths, &args);
-      return runGit(args);
+         args << "rm" << "--cached";
+      return runGitWithPaths(args, trackedPaths);
    }
 
    core::Error listBranches(std::vector<std::string>* pBranches,
@@ -822,37 +1442,118 @@ public:
    void parseCommitValue(const std::string& value,
                          CommitInfo* pCommitInfo)
    {
-      static boost::regex commitRegex("^([a-z0-9]+)(\\s+\\((.*)\\))?");
-      boost::smatch smatch;
-      if (boost::regex_match(value, smatch, commitRegex))
+      // "id" optionally followed by whitespace and "(refs)"
+      std::string::size_type idEnd = value.find_first_not_of(
+                                 "abcdefghijklmnopqrstuvwxyz0123456789");
+      std::string::size_type refsBegin = std::string::npos;
+      if (idEnd != 0 && idEnd != std::string::npos)
+      {
+         std::string::size_type paren = value.find_first_not_of(" \t", idEnd);
+         if (paren != idEnd && paren != std::string::npos &&
+             value[paren] == '(' && value[value.size() - 1] == ')')
+         {
+            refsBegin = paren + 1;
+         }
+      }
+
+      if (idEnd == 0 || (idEnd != std::string::npos &&
+                         refsBegin == std::string::npos))
+      {
+         pCommitInfo->id = value;
+         return;
+      }
+
+      pCommitInfo->id = value.substr(0, idEnd);
+      if (refsBegin != std::string::npos)
       {
-         pCommitInfo->id = smatch[1];
          std::vector<std::string> refs;
-         if (smatch[3].matched)
+         boost::algorithm::split(refs,
+                                 value.substr(refsBegin,
+                                              value.size() - refsBegin - 1),
+                                 boost::algorithm::is_any_of(","));
+         BOOST_FOREACH(std::string ref, refs)
          {
-            boost::algorithm::split(refs,
-                                    static_cast<const std::string>(smatch[3]),
-                                    boost::algorithm::is_any_of(","));
-            BOOST_FOREACH(std::string ref, refs)
+            boost::algorithm::trim(ref);
+            if (boost::algorithm::starts_with(ref, "tag: "))
+               pCommitInfo->tags.push_back(ref.substr(5));
+            else if (boost::algorithm::starts_with(ref, "refs/tags/"))
             {
-               boost::algorithm::trim(ref);
-               if (boost::algorithm::starts_with(ref, "tag: "))
-                  pCommitInfo->tags.push_back(ref.substr(5));
-               else if (boost::algorithm::starts_with(ref, "refs/tags/"))
-               {
-                  // Sometimes with git 1.7.0 tags appear without the "tags: "
-                  // prefix, e.g. plyr-1.6
-                  pCommitInfo->tags.push_back(ref);
-               }
-               else if (!boost::algorithm::starts_with(ref, "refs/bisect/"))
-                  pCommitInfo->refs.push_back(ref);
+               // Sometimes with git 1.7.0 tags appear without the "tags: "
+               // prefix, e.g. plyr-1.6
+               pCommitInfo->tags.push_back(ref);
             }
+            else if (!boost::algorithm::starts_with(ref, "refs/bisect/"))
+               pCommitInfo->refs.push_back(ref);
          }
       }
-      else
+   }
+
+   // ensure that the graph lines for the first count commits of rev have
+   // been computed (count < 0 for all commits)
+   core::Error ensureGraphLines(const std::string& rev, int count)
+   {
+      std::string head;
+      Error error = runGit(ShellArgs() << "rev-parse" << rev, &head);
+      if (error)
+         return error;
+
+      if (!graphCache_.pGraph || graphCache_.rev != rev ||
+          graphCache_.head != head)
       {
-         pCommitInfo->id = value;
+         graphCache_.reset(rev, head);
+      }
+
+      std::size_t computed = graphCache_.lines.size();
+      if (graphCache_.complete ||
+          (count >= 0 && computed >= static_cast<std::size_t>(count)))
+      {
+         return Success();
       }
+
+      ShellArgs revListArgs = ShellArgs() << "rev-list" << "--date-order"
+                                          << "--parents";
+      if (computed > 0)
+         revListArgs << "--skip=" + safe_convert::numberToString(computed);
+      if (count >= 0)
+      {
+         revListArgs << "--max-count=" + safe_convert::numberToString(
+                                                         count - computed);
+      }
+      revListArgs << rev;
+
+      std::string revOutput;
+      error = runGit(revListArgs, &revOutput);
+      if (error)
+         return error;
+
+      std::vector<std::string> parents;
+      std::string::size_type pos = 0;
+      std::string line;
+      while (nextLine(revOutput, &pos, &line))
+      {
+         if (line.empty())
+            continue;
+
+         parents.clear();
+         boost::algorithm::split(parents, line,
+                                 boost::algorithm::is_any_of(" "));
+
+         std::string commit = parents.front();
+         parents.erase(parents.begin());
+
+         gitgraph::Line graphLine = graphCache_.pGraph->addCommit(commit,
+                                                                  parents);
+         graphCache_.lines.push_back(graphLine.string());
+      }
+
+      // fewer commits than requested means we have reached the end
+      if (count < 0 ||
+          graphCache_.lines.size() < static_cast<std::size_t>(count))
+      {
+         graphCache_.complete = true;
+      }
+
+      return Success();
    }
 
    core::Error logLength(const std::string &rev,
@@ -900,14 +1601,11 @@ public:
                        << "--pretty=raw" << "--decorate=full"
                        << "--date-order";
 
-      ShellArgs revListArgs = ShellArgs() << "rev-list" << "--date-order" << "--parents";
       int revListSkip = skip;
+      int revListCount = -1;
 
       if (!fileFilter.empty())
-      {
          args << "--" << fileFilter;
-         revListArgs << "--" << fileFilter;
-      }
 
       if (searchText.empty() && fileFilter.empty())
       {
@@ -921,82 +1619,46 @@ public:
          if (maxentries >= 0)
          {
             args << "--max-count=" + safe_convert::numberToString(maxentries);
+            revListCount = revListSkip + maxentries;
             maxentries = -1;
-
-            revListArgs << "--max-count=" + safe_convert::numberToString(
-                  (skip < 0 ? 0 : skip) + maxentries);
          }
       }
 
       if (!rev.empty())
-      {
          args << rev;
-         revListArgs << rev;
-      }
-      else
-      {
-         revListArgs << "HEAD";
-      }
 
       if (maxentries < 0)
          maxentries = std::numeric_limits<int>::max();
 
-      std::vector<std::string> outLines;
       std::string output;
       Error error = runGit(args, &output);
       if (error)
          return error;
-      outLines = split(output);
-      output.clear();
 
-      std::vector<std::string> graphLines;
+      // graph lines (computed incrementally and cached per revision)
+      std::size_t graphLineIndex = 0;
+      const std::vector<std::string>* pGraphLines = NULL;
       if (searchText.empty() && fileFilter.empty())
       {
-         std::vector<std::string> revOutLines;
-         std::string revOutput;
-         error = runGit(revListArgs, &revOutput);
+         error = ensureGraphLines(rev.empty() ? "HEAD" : rev, revListCount);
          if (error)
             return error;
-         revOutLines = split(revOutput);
-         revOutput.clear();
-
-         gitgraph::GitGraph graph;
-         for (size_t i = 0; i < revOutLines.size(); i++)
-         {
-            typedef std::vector<std::string> find_vector_type;
-            find_vector_type parents;
-            boost::algorithm::split(parents, revOutLines[i],
-                                    boost::algorithm::is_any_of(" "));
-            if (parents.size() < 1)
-               break;
-
-            std::string commit = parents.front();
-            parents.erase(parents.begin());
-
-            gitgraph::Line line = graph.addCommit(commit, parents);
-            if (revListSkip <= 0 || static_cast<int>(i) >= revListSkip)
-               graphLines.push_back(line.string());
-         }
+         pGraphLines = &graphCache_.lines;
+         graphLineIndex = std::max(revListSkip, 0);
       }
 
       boost::function<bool(CommitInfo)> filter = createSearchTextPredicate(searchText);
 
-      boost::regex kvregex("^(\\w+) (.*)$");
-      boost::regex authTimeRegex("^(.*?) (\\d+) ([+\\-]?\\d+)$");
-
-      size_t graphLineIndex = 0;
       int skipped = 0;
       CommitInfo currentCommit;
 
-      for (std::vector<std::string>::const_iterator it = outLines.begin();
-           it != outLines.end() && pOutput->size() < static_cast<size_t>(maxentries);
-           it++)
+      std::string line, key, value, author, time, tz;
+      std::string::size_type pos = 0;
+      while (pOutput->size() < static_cast<size_t>(maxentries) &&
+             nextLine(output, &pos, &line))
       {
-         boost::smatch smatch;
-         if (boost::regex_search(*it, smatch, kvregex))
+         if (parseKeyValue(line, &key, &value))
          {
-            std::string key = smatch[1];
-            std::string value = smatch[2];
             if (key == "commit")
             {
                if (!currentCommit.id.empty() && filter(currentCommit))
@@ -1005,8 +1667,8 @@ public:
                      skipped++;
                   else
                   {
-                     if (graphLineIndex < graphLines.size())
-                        currentCommit.graph = graphLines[graphLineIndex];
+                     if (pGraphLines && graphLineIndex < pGraphLines->size())
+                        currentCommit.graph = (*pGraphLines)[graphLineIndex];
                      pOutput->push_back(currentCommit);
                   }
 
@@ -1018,13 +1680,8 @@ public:
             }
             else if (key == "author" || key == "committer")
             {
-               boost::smatch authTimeMatch;
-               if (boost::regex_search(value, authTimeMatch, authTimeRegex))
+               if (parseAuthorTime(value, &author, &time, &tz))
                {
-                  std::string author = authTimeMatch[1];
-                  std::string time = authTimeMatch[2];
-                  std::string tz = authTimeMatch[3];
-
                   if (key == "author")
                      currentCommit.author = author;
                   else // if (key == "committer")
@@ -1038,16 +1695,16 @@ public:
                currentCommit.parent.append(value, 0, 8);
             }
          }
-         else if (boost::starts_with(*it, "    "))
+         else if (boost::starts_with(line, "    "))
          {
             if (currentCommit.subject.empty())
-               currentCommit.subject = it->substr(4);
+               currentCommit.subject = line.substr(4);
 
             if (!currentCommit.description.empty())
                currentCommit.description.append("\n");
-            currentCommit.description.append(it->substr(4));
+            currentCommit.description.append(line, 4, std::string::npos);
          }
-         else if (it->length() == 0)
+         else if (line.length() == 0)
          {
          }
          else
@@ -1064,8 +1721,8 @@ public:
             skipped++;
          else
          {
-            if (graphLineIndex < graphLines.size())
-               currentCommit.graph = graphLines[graphLineIndex];
+            if (pGraphLines && graphLineIndex < pGraphLines->size())
+               currentCommit.graph = (*pGraphLines)[graphLineIndex];
             pOutput->push_back(currentCommit);
          }
          graphLineIndex++;
@@ -1090,6 +1747,25 @@ public:
                                 std::string* pOutput)
    {
       boost::format fmt("%1%:%2%");
+
+      // the contents of files at a specific commit never change so we can
+      // read them from the batch process (which doesn't see ref updates)
+      if (isObjectId(rev))
+      {
+         bool found = false;
+         Error error = catFileBatch_.readObject(root_,
+                                                boost::str(fmt % rev % filename),
+                                                pOutput,
+                                                &found);
+         if (!error)
+         {
+            if (!found)
+               pOutput->clear();
+            return Success();
+         }
+         LOG_ERROR(error);
+      }
+
       ShellArgs args =
             ShellArgs() << "show" << boost::str(fmt % rev % filename);
 
@@ -1226,6 +1902,26 @@ GitFileDecorationContext::~GitFileDecorationContext()
       enqueueRefreshEvent();
 }
 
+bool GitFileDecorationContext::isWithinUntrackedDirectory(
+                                                   const FilePath& filePath)
+{
+   // the files in a listing generally share a parent so cache the result
+   // for each parent directory
+   FilePath parent = filePath.parent();
+   if (parent == filePath)
+      return false;
+
+   std::map<std::string, bool>::const_iterator it =
+                           untrackedDirectories_.find(parent.absolutePath());
+   if (it != untrackedDirectories_.end())
+      return it->second;
+
+   bool untracked = vcsStatus_.getStatus(parent).status() == "??" ||
+                    isWithinUntrackedDirectory(parent);
+   untrackedDirectories_[parent.absolutePath()] = untracked;
+   return untracked;
+}
+
 void GitFileDecorationContext::decorateFile(const FilePath &filePath,
                                             json::Object *pFileObject)
 {
@@ -1236,20 +1932,8 @@ void GitFileDecorationContext::decorateFile(const FilePath &filePath,
       // Special edge case when file is inside an untracked directory
       // that may or may not be known to the client. (It wouldn't be
       // known if the directory was empty until this file event.)
-
-      FilePath parent = filePath;
-      while (true)
-      {
-         if (parent == parent.parent())
-            break;
-
-         parent = parent.parent();
-         if (vcsStatus_.getStatus(parent).status() == "??")
-         {
-            fullRefreshRequired_ = true;
-            break;
-         }
-      }
+      if (isWithinUntrackedDirectory(filePath))
+         fullRefreshRequired_ = true;
    }
 
    json::Object vcsObj;
@@ -1259,6 +1943,35 @@ void GitFileDecorationContext::decorateFile(const FilePath &filePath,
    (*pFileObject)["git_status"] = vcsObj;
 }
 
+void GitFileDecorationContext::decorateFiles(
+                              const std::vector<FileInfo>& files,
+                              std::vector<json::Object>* pFileObjects)
+{
+   for (std::size_t i = 0; i < files.size(); i++)
+   {
+      FilePath filePath(files[i].absolutePath());
+      json::Object& fileObject = pFileObjects->at(i);
+
+      VCSStatus status = vcsStatus_.getStatus(filePath);
+      if (status.status().empty() && !fullRefreshRequired_ &&
+          isWithinUntrackedDirectory(filePath))
+      {
+         fullRefreshRequired_ = true;
+      }
+
+      // reuse what the file system item already knows about the file
+      // rather than querying the file system again
+      json::Object vcsObj;
+      vcsObj["status"] = status.status();
+      vcsObj["path"] = filePath.relativePath(s_git_.root());
+      vcsObj["raw_path"] = fileObject["path"];
+      vcsObj["discardable"] = status.status()[1] != ' ' &&
+                              status.status()[1] != '?';
+      vcsObj["is_directory"] = files[i].isDirectory();
+      fileObject["git_status"] = vcsObj;
+   }
+}
+
 core::Error status(const FilePath& dir, StatusResult* pStatusResult)
 {
    if (s_git_.root().empty())
@@ -1526,6 +2239,25 @@ Error vcsPull(const json::JsonRpcRequest& request,
    return Success();
 }
 
+// diffs are delivered a page of hunks at a time. the diff being paged
+// through is kept so that later pages needn't rerun git diff (the first
+// page always does)
+struct DiffPages
+{
+   DiffPages() : mode(-1), contextLines(-1), lineCount(0) {}
+   std::string path;
+   int mode;
+   int contextLines;
+   std::string diff;
+   std::string header;
+   std::vector<vcs_utils::DiffHunk> hunks;
+   std::size_t lineCount;
+};
+DiffPages s_diffPages;
+
+// pages are filled with hunks up to roughly this size
+const std::size_t kDiffPageSize = 64 * 1024;
+
 Error vcsDiffFile(const json::JsonRpcRequest& request,
                   json::JsonRpcResponse* pResponse)
 {
@@ -1533,11 +2265,13 @@ Error vcsDiffFile(const json::JsonRpcRequest& request,
    int mode;
    int contextLines;
    bool noSizeWarning;
+   int firstHunk;
    Error error = json::readParams(request.params,
                                   &path,
                                   &mode,
                                   &contextLines,
-                                  &noSizeWarning);
+                                  &noSizeWarning,
+                                  &firstHunk);
    if (error)
       return error;
 
@@ -1546,35 +2280,76 @@ Error vcsDiffFile(const json::JsonRpcRequest& request,
 
    splitRename(path, NULL, &path);
 
-   std::string output;
-   error = s_git_.diffFile(resolveAliasedPath(path),
-                                 static_cast<PatchMode>(mode),
-                                 contextLines,
-                                 &output);
-   if (error)
-      return error;
+   if (firstHunk <= 0 ||
+       path != s_diffPages.path ||
+       mode != s_diffPages.mode ||
+       contextLines != s_diffPages.contextLines)
+   {
+      firstHunk = 0;
+      s_diffPages = DiffPages();
 
-   std::string sourceEncoding = projects::projectContext().defaultEncoding();
-   bool usedSourceEncoding;
-   output = convertDiff(output, sourceEncoding, "UTF-8", false,
-                        &usedSourceEncoding);
-   if (!usedSourceEncoding)
-      sourceEncoding = "";
+      std::string output;
+      error = s_git_.diffFile(resolveAliasedPath(path),
+                                    static_cast<PatchMode>(mode),
+                                    contextLines,
+                                    &output);
+      if (error)
+         return error;
 
-   if (!noSizeWarning && output.size() > source_control::WARN_SIZE)
+      s_diffPages.path = path;
+      s_diffPages.mode = mode;
+      s_diffPages.contextLines = contextLines;
+      s_diffPages.diff.swap(output);
+      vcs_utils::splitDiff(s_diffPages.diff,
+                           &s_diffPages.header,
+                           &s_diffPages.hunks);
+      BOOST_FOREACH(const vcs_utils::DiffHunk& hunk, s_diffPages.hunks)
+      {
+         s_diffPages.lineCount += hunk.lineCount;
+      }
+   }
+   const std::vector<vcs_utils::DiffHunk>& hunks = s_diffPages.hunks;
+
+   // the header followed by as many hunks as fit on the page (always at
+   // least one)
+   std::string page = s_diffPages.header;
+   std::size_t nextHunk = std::min(static_cast<std::size_t>(firstHunk),
+                                   hunks.size());
+   while (nextHunk < hunks.size() &&
+          (nextHunk == static_cast<std::size_t>(firstHunk) ||
+           page.size() + hunks[nextHunk].length <= kDiffPageSize))
+   {
+      page.append(s_diffPages.diff, hunks[nextHunk].offset,
+                  hunks[nextHunk].length);
+      nextHunk++;
+   }
+
+   if (!noSizeWarning && page.size() > source_control::WARN_SIZE)
    {
       error = systemError(boost::system::errc::file_too_large,
                           ERROR_LOCATION);
       pResponse->setError(error,
-                          json::Value(static_cast<uint64_t>(output.size())));
-   }
-   else
-   {
-      json::Object result;
-      result["source_encoding"] = sourceEncoding;
-      result["decoded_value"] = output;
-      pResponse->setResult(result);
+                          json::Value(static_cast<uint64_t>(page.size())));
+      return Success();
    }
+
+   // only the page is converted
+   std::string sourceEncoding = projects::projectContext().defaultEncoding();
+   bool usedSourceEncoding;
+   page = convertDiff(page, sourceEncoding, "UTF-8", false,
+                      &usedSourceEncoding);
+   if (!usedSourceEncoding)
+      sourceEncoding = "";
+
+   json::Object result;
+   result["source_encoding"] = sourceEncoding;
+   result["decoded_value"] = page;
+   result["first_hunk"] = firstHunk;
+   result["next_hunk"] = nextHunk < hunks.size() ?
+                                    static_cast<int>(nextHunk) : -1;
+   result["total_hunks"] = static_cast<int>(hunks.size());
+   result["total_lines"] = static_cast<int>(s_diffPages.lineCount);
+   pResponse->setResult(result);
    return Success();
 }
 
@@ -1702,6 +2477,63 @@ Error vcsHistoryCount(const json::JsonRpcRequest& request,
    return Success();
 }
 
+void writeCommits(boost::shared_ptr<std::vector<CommitInfo> > pCommits,
+                  json::Writer& writer)
+{
+   typedef std::vector<CommitInfo>::const_iterator iterator;
+   const std::vector<CommitInfo>& commits = *pCommits;
+
+   // the result is written column-wise
+   writer.startObject();
+
+   writer.key("id").startArray();
+   for (iterator it = commits.begin(); it != commits.end(); it++)
+      writer.value(it->id.substr(0, 8));
+   writer.endArray();
+
+   writer.key("author").startArray();
+   for (iterator it = commits.begin(); it != commits.end(); it++)
+      writer.value(string_utils::filterControlChars(it->author));
+   writer.endArray();
+
+   writer.key("parent").startArray();
+   for (iterator it = commits.begin(); it != commits.end(); it++)
+      writer.value(string_utils::filterControlChars(it->parent));
+   writer.endArray();
+
+   writer.key("subject").startArray();
+   for (iterator it = commits.begin(); it != commits.end(); it++)
+      writer.value(string_utils::filterControlChars(it->subject));
+   writer.endArray();
+
+   writer.key("description").startArray();
+   for (iterator it = commits.begin(); it != commits.end(); it++)
+      writer.value(string_utils::filterControlChars(it->description));
+   writer.endArray();
+
+   writer.key("date").startArray();
+   for (iterator it = commits.begin(); it != commits.end(); it++)
+      writer.value(static_cast<double>(it->date));
+   writer.endArray();
+
+   writer.key("refs").startArray();
+   for (iterator it = commits.begin(); it != commits.end(); it++)
+      writer.array(it->refs.begin(), it->refs.end());
+   writer.endArray();
+
+   writer.key("tags").startArray();
+   for (iterator it = commits.begin(); it != commits.end(); it++)
+      writer.array(it->tags.begin(), it->tags.end());
+   writer.endArray();
+
+   writer.key("graph").startArray();
+   for (iterator it = commits.begin(); it != commits.end(); it++)
+      writer.value(it->graph);
+   writer.endArray();
+
+   writer.endObject();
+}
+
 Error vcsHistory(const json::JsonRpcRequest& request,
                  json::JsonRpcResponse* pResponse)
 {
@@ -1726,49 +2558,11 @@ Error vcsHistory(const json::JsonRpcRequest& request,
    if (error)
       return error;
 
-   json::Array ids;
-   json::Array authors;
-   json::Array parents;
-   json::Array subjects;
-   json::Array dates;
-   json::Array descriptions;
-   json::Array refs;
-   json::Array tags;
-   json::Array graphs;
-
-   for (std::vector<CommitInfo>::const_iterator it = commits.begin();
-        it != commits.end();
-        it++)
-   {
-      ids.push_back(it->id.substr(0, 8));
-      authors.push_back(string_utils::filterControlChars(it->author));
-      parents.push_back(string_utils::filterControlChars(it->parent));
-      subjects.push_back(string_utils::filterControlChars(it->subject));
-      descriptions.push_back(string_utils::filterControlChars(it->description));
-      dates.push_back(static_cast<double>(it->date));
-      graphs.push_back(it->graph);
-
-      json::Array theseRefs;
-      std::copy(it->refs.begin(), it->refs.end(), std::back_inserter(theseRefs));
-      refs.push_back(theseRefs);
-
-      json::Array theseTags;
-      std::copy(it->tags.begin(), it->tags.end(), std::back_inserter(theseTags));
-      tags.push_back(theseTags);
-   }
-
-   json::Object result;
-   result["id"] = ids;
-   result["author"] = authors;
-   result["parent"] = parents;
-   result["subject"] = subjects;
-   result["description"] = descriptions;
-   result["date"] = dates;
-   result["refs"] = refs;
-   result["tags"] = tags;
-   result["graph"] = graphs;
-
-   pResponse->setResult(result);
+   // stream the result (history can contain many thousands of commits)
+   boost::shared_ptr<std::vector<CommitInfo> > pCommits(
+                                 new std::vector<CommitInfo>());
+   pCommits->swap(commits);
+   pResponse->setResultWriter(boost::bind(writeCommits, pCommits, _1));
 
    return Success();
 }
@@ -2275,6 +3069,8 @@ Error detectAndSaveGitExePath()
 
 void onShutdown(bool)
 {
+   s_git_.stopBatchProcesses();
+
    std::for_each(s_pidsToTerminate_.begin(), s_pidsToTerminate_.end(),
                  &core::system::terminateProcess);
    s_pidsToTerminate_.clear();
@@ -2558,6 +3354,25 @@ std::string remoteOriginUrl(const FilePath& workingDir)
    return remoteOriginUrl;
 }
 
+void onFileMonitorEnabled(const tree<core::FileInfo>& files)
+{
+   // the file monitor only covers the project directory so we can only
+   // maintain the status of repositories rooted there
+   s_git_.setStatusCacheEnabled(
+         !s_git_.root().empty() &&
+         s_git_.root() == projects::projectContext().directory());
+}
+
+void onFilesChanged(const std::vector<core::system::FileChangeEvent>& events)
+{
+   s_git_.onFilesChanged(events);
+}
+
+void onFileMonitorDisabled()
+{
+   s_git_.setStatusCacheEnabled(false);
+}
+
 core::Error initializeGit(const core::FilePath& workingDir)
 {
    s_git_.setRoot(detectGitDir(workingDir));
@@ -2634,6 +3449,13 @@ core::Error initialize()
    // add suspend/resume handler
    addSuspendHandler(SuspendHandler(onSuspend, onResume));
 
+   // maintain git status from file changes (no-op if there is no project)
+   projects::FileMonitorCallbacks cb;
+   cb.onMonitoringEnabled = onFileMonitorEnabled;
+   cb.onFilesChanged = onFilesChanged;
+   cb.onMonitoringDisabled = onFileMonitorDisabled;
+   projects::projectContext().subscribeToFileMonitor("Git status", cb);
+
    // add settings changed handler
    userSettings().onChanged.connect(onUserSettingsChanged);
 
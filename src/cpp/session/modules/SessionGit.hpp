@@ -43,9 +43,15 @@ public:
    virtual ~GitFileDecorationContext();
    virtual void decorateFile(const core::FilePath &filePath,
                              core::json::Object *pFileObject);
+   virtual void decorateFiles(const std::vector<core::FileInfo>& files,
+                              std::vector<core::json::Object>* pFileObjects);
+
+private:
+   bool isWithinUntrackedDirectory(const core::FilePath& filePath);
 
 private:
    source_control::StatusResult vcsStatus_;
+   std::map<std::string, bool> untrackedDirectories_;
    bool fullRefreshRequired_;
 };
 
@@ -31,6 +31,7 @@
 #include <core/Error.hpp>
 #include <core/Exec.hpp>
 #include <core/FileSerializer.hpp>
+#include <core/Hash.hpp>
 #include <core/HtmlUtils.hpp>
 #include <core/http/Util.hpp>
 #include <core/PerformanceTimer.hpp>
@@ -62,6 +63,15 @@ namespace html_preview {
 
 namespace {
 
+// renderer shared by previews so that re-previewing a document only
+// renders the sections which changed since the last preview
+markdown::IncrementalRenderer& markdownRenderer()
+{
+   static markdown::IncrementalRenderer instance((markdown::Extensions()),
+                                                 markdown::HTMLOptions());
+   return instance;
+}
+
 class HTMLPreview : boost::noncopyable,
                     public boost::enable_shared_from_this<HTMLPreview>
 {
@@ -135,6 +145,9 @@ public:
 
    bool requiresKnit() { return requiresKnit_; }
 
+   // only valid for internal markdown
+   const markdown::RenderInfo& renderInfo() const { return renderInfo_; }
+
    FilePath targetFile() const
    {
       return targetFile_;
@@ -222,7 +235,7 @@ private:
                                 "knit('%2%');");
          }
          std::string cmd = boost::str(fmt % encoding % targetFile_.filename());
-         args.push_back(cmd);
+         args.push_back(chunkCacheOptions() + cmd);
       }
       else
       {
@@ -245,7 +258,7 @@ private:
          std::string cmd = boost::str(fmt % encoding
                                           % targetFile_.filename()
                                           % tempFilePath);
-         args.push_back(cmd);
+         args.push_back(chunkCacheOptions() + cmd);
       }
 
       // options
@@ -273,6 +286,31 @@ private:
                                                      cb);
    }
 
+   // knitr chunk options which cache chunk results between previews. chunks
+   // are keyed by a hash of their source and options and autodep tracks the
+   // objects they use, so an edit re-evaluates only the changed chunks and
+   // the chunks which depend on them. users can opt out by setting the
+   // rstudio.htmlPreview.cache option to FALSE in their profile
+   std::string chunkCacheOptions() const
+   {
+      // notebooks are generated from scripts which are re-run in full
+      if (isNotebook_)
+         return std::string();
+
+      FilePath cacheDir = module_context::userScratchPath()
+                              .complete(kHTMLPreview "_cache")
+                              .complete(hash::xxHash64(
+                                          targetFile_.absolutePath()));
+      std::string cachePath = string_utils::utf8ToSystem(
+                                          cacheDir.absolutePath() + "/");
+
+      boost::format fmt(
+         "if (suppressWarnings(require(knitr, quietly=TRUE)) && "
+         "    isTRUE(getOption('rstudio.htmlPreview.cache', TRUE))) "
+         "   knitr::opts_chunk$set(cache=TRUE, autodep=TRUE, cache.path='%1%'); ");
+      return boost::str(fmt % string_utils::jsLiteralEscape(cachePath));
+   }
+
    bool hasEncodingParam() const
    {
       bool hasEncoding = false;
@@ -402,11 +440,10 @@ private:
 
             // run markdownToHTML
             std::string htmlContent;
-            Error error = markdown::markdownToHTML(
-                                            content,
-                                            markdown::Extensions(),
-                                            markdown::HTMLOptions(),
-                                            &htmlContent);
+            renderInfo_ = markdown::RenderInfo();
+            Error error = markdownRenderer().render(content,
+                                                    &htmlContent,
+                                                    &renderInfo_);
             if (error)
             {
                terminateWithError(error);
@@ -507,6 +544,7 @@ private:
    bool isInternalMarkdown_;
    bool isNotebook_;
    bool requiresKnit_;
+   markdown::RenderInfo renderInfo_;
 
    FilePath knitrOutputFile_;
    FilePath outputFile_;
@@ -760,13 +798,6 @@ Error createNotebook(const json::JsonRpcRequest& request,
 }
 
 
-bool requiresHighlighting(const std::string& htmlOutput)
-{
-   boost::regex hlRegex("<pre><code class=\"(r|cpp)\"");
-   return boost::regex_search(htmlOutput, hlRegex);
-}
-
-
 // for whatever reason when we host an iFrame in a Qt WebKit instance
 // it only looks at the very first font listed in the font-family
 // attribute. if the font isn't found then it displays a non-monospace
@@ -852,8 +883,13 @@ Error readPreviewTemplate(const FilePath& resPath,
                           std::string* pPreviewTemplate)
 {
 
-   FilePath htmlPreviewFile = resPath.childPath("markdown.html");
-   return core::readStringFromFile(htmlPreviewFile, pPreviewTemplate);
+   *pPreviewTemplate = module_context::resourceFileAsString("markdown.html");
+   if (pPreviewTemplate->empty())
+   {
+      return core::fileNotFoundError(resPath.childPath("markdown.html"),
+                                     ERROR_LOCATION);
+   }
+   return Success();
 }
 
 void setVarFromHtmlResourceFile(const std::string& name,
@@ -888,48 +924,71 @@ void handleInternalMarkdownPreviewRequest(
 
       // read output
       std::string htmlOutput = s_pCurrentPreview_->readOutput();
+      const markdown::RenderInfo& renderInfo =
+                                       s_pCurrentPreview_->renderInfo();
 
-      // define template filter
+      // define template filter (the html output itself is substituted
+      // separately below so the template passes touch only the page chrome)
+      const std::string kHtmlOutputMarker = "#!html_output#";
       std::map<std::string,std::string> vars;
       vars["title"] = html_utils::defaultTitle(htmlOutput);
       setVarFromHtmlResourceFile("markdown_css", "markdown.css", &vars);
-      if (requiresHighlighting(htmlOutput))
+      if (renderInfo.requiresHighlighting)
          setVarFromHtmlResourceFile("r_highlight", &vars);
       else
          vars["r_highlight"]  = "";
-      if (markdown::isMathJaxRequired(htmlOutput))
+      if (renderInfo.requiresMathjax)
          setVarFromHtmlResourceFile("mathjax", &vars);
       else
          vars["mathjax"] = "";
-      vars["html_output"] = htmlOutput;
+      vars["html_output"] = kHtmlOutputMarker;
       text::TemplateFilter templateFilter(vars);
 
-      // define base64 image filter
-      html_utils::Base64ImageFilter imageFilter(
-                                    s_pCurrentPreview_->targetDirectory());
-
-      // write into in-memory string
+      // apply it to the template
       std::istringstream previewInputStream(previewTemplate);
       std::stringstream previewStrStream;
       previewStrStream.exceptions(std::istream::failbit | std::istream::badbit);
       boost::iostreams::filtering_ostream previewOutputStream ;
       previewOutputStream.push(templateFilter);
-      previewOutputStream.push(imageFilter);
       previewOutputStream.push(previewStrStream);
       boost::iostreams::copy(previewInputStream,
                              previewOutputStream,
                              128);
 
+      // split it around the html output
+      std::string pageHeader = previewStrStream.str();
+      std::string pageFooter;
+      std::size_t markerPos = pageHeader.find(kHtmlOutputMarker);
+      if (markerPos != std::string::npos)
+      {
+         pageFooter = pageHeader.substr(markerPos + kHtmlOutputMarker.size());
+         pageHeader.erase(markerPos);
+      }
+
+      // base64 encode images within the html output
+      htmlOutput = html_utils::base64EncodeImages(
+                                    htmlOutput,
+                                    s_pCurrentPreview_->targetDirectory());
 
       // write to output file
-      std::string previewHtml = previewStrStream.str();
-      error = core::writeStringToFile(s_pCurrentPreview_->htmlPreviewFile(),
-                                      previewHtml);
+      boost::shared_ptr<std::ostream> pFileStream;
+      error = s_pCurrentPreview_->htmlPreviewFile().open_w(&pFileStream);
       if (error)
       {
          pResponse->setError(error);
          return;
       }
+      *pFileStream << pageHeader << htmlOutput << pageFooter;
+      pFileStream->flush();
+      if (pFileStream->fail())
+      {
+         error = systemError(boost::system::errc::io_error, ERROR_LOCATION);
+         error.addProperty("path",
+                           s_pCurrentPreview_->htmlPreviewFile().absolutePath());
+         pResponse->setError(error);
+         return;
+      }
+      pFileStream.reset();
 
       // remove generated files if this was a notebook
       if (s_pCurrentPreview_->isNotebook())
@@ -949,9 +1008,15 @@ void handleInternalMarkdownPreviewRequest(
             LOG_ERROR(error);
       }
 
-      // modify outpout then write back to client
-      modifyOutputForPreview(&previewHtml);
-      pResponse->setDynamicHtml(previewHtml, request);
+      // modify outpout then write back to client (everything we modify
+      // lives in the page header so the html output needn't be rescanned)
+      modifyOutputForPreview(&pageHeader);
+      pageHeader.reserve(pageHeader.size() +
+                         htmlOutput.size() +
+                         pageFooter.size());
+      pageHeader.append(htmlOutput);
+      pageHeader.append(pageFooter);
+      pResponse->setDynamicHtml(pageHeader, request);
    }
    catch(const std::exception& e)
    {
@@ -15,10 +15,15 @@
 
 #include "SessionHelp.hpp"
 
+#include <map>
+#include <ctime>
+#include <sstream>
 #include <algorithm>
 
 #include <boost/regex.hpp>
+#include <boost/foreach.hpp>
 #include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/range/iterator_range.hpp>
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/algorithm/string.hpp>
@@ -27,10 +32,13 @@
 #include <core/Error.hpp>
 #include <core/Exec.hpp>
 #include <core/Log.hpp>
+#include <core/StringUtils.hpp>
+#include <core/json/JsonRpc.hpp>
 
 #include <core/http/Request.hpp>
 #include <core/http/Response.hpp>
 #include <core/http/URL.hpp>
+#include <core/http/Util.hpp>
 #include <core/FileSerializer.hpp>
 #include <core/system/Process.hpp>
 #include <core/system/ShellUtils.hpp>
@@ -47,6 +55,8 @@
 
 #include <session/SessionModuleContext.hpp>
 
+#include "SessionHelpIndex.hpp"
+
 #include "presentation/SlideRequestHandler.hpp"
 
 // protect R against windows TRUE/FALSE defines
@@ -210,7 +220,10 @@ class HelpContentsFilter : public boost::iostreams::aggregate_filter<char>
 public:
    typedef std::vector<char> Characters ;
 
-   HelpContentsFilter(const http::Request& request)
+   HelpContentsFilter(const http::Request& request,
+                      boost::shared_ptr<std::string> pFiltered =
+                                          boost::shared_ptr<std::string>())
+      : pFiltered_(pFiltered)
    {
       requestUri_ = request.uri();
    }
@@ -239,9 +252,14 @@ public:
       // append javascript callbacks
       std::string js(kJsCallbacks);
       std::copy(js.begin(), js.end(), std::back_inserter(dest));
+
+      // keep a copy of the result if requested (used to cache pages)
+      if (pFiltered_)
+         pFiltered_->assign(dest.begin(), dest.end());
    }
 private:
    std::string requestUri_;
+   boost::shared_ptr<std::string> pFiltered_;
 };
 
 
@@ -776,16 +794,263 @@ void handleSessionRequest(const http::Request& request, http::Response* pRespons
    pResponse->setCacheableFile(tempFilePath, request);
 }
 
+// rendered (and filtered) package help pages are cached so that pages
+// which are visited repeatedly don't need to be re-rendered by R. entries
+// are validated against the modification time of the package's DESCRIPTION
+// file so that they are discarded when the package is reinstalled.
+struct CachedHelpPage
+{
+   FilePath descriptionPath;
+   std::time_t descriptionTime;
+   std::string eTag;
+   std::string contents;
+   std::string gzipContents;
+};
+
+// once this much is cached the cache is reset
+const std::size_t kMaxHelpCacheSize = 16 * 1024 * 1024;
+
+std::map<std::string, boost::shared_ptr<CachedHelpPage> > s_helpCache;
+std::size_t s_helpCacheSize = 0;
+
+bool isCacheableHelpPage(const http::Request& request, std::string* pPackage)
+{
+   std::string path = http::util::pathAfterPrefix(request, kHelpLocation);
+   boost::regex pageRegex("^/library/([^/]+)/html/[^/]+\\.html$");
+   boost::smatch match;
+   if (!boost::regex_match(path, match, pageRegex))
+      return false;
+
+   *pPackage = match[1];
+   return true;
+}
+
+bool serveCachedHelpPage(const http::Request& request,
+                         http::Response* pResponse)
+{
+   std::map<std::string, boost::shared_ptr<CachedHelpPage> >::iterator it =
+                                               s_helpCache.find(request.uri());
+   if (it == s_helpCache.end())
+      return false;
+
+   // discard the page if its package has changed since it was rendered
+   const CachedHelpPage& page = *(it->second);
+   if (!page.descriptionPath.exists() ||
+       page.descriptionPath.lastWriteTime() != page.descriptionTime)
+   {
+      s_helpCacheSize -= page.contents.size() + page.gzipContents.size();
+      s_helpCache.erase(it);
+      return false;
+   }
+
+   pResponse->setStatusCode(http::status::Ok);
+   pResponse->setCacheWithRevalidationHeaders();
+   pResponse->setHeader("ETag", page.eTag);
+   if (page.eTag == request.headerValue("If-None-Match"))
+   {
+      pResponse->setStatusCode(http::status::NotModified);
+      return true;
+   }
+
+   // body is already encoded so set it directly
+   pResponse->setContentType("text/html");
+   if (!page.gzipContents.empty() &&
+       request.acceptsEncoding(http::kGzipEncoding))
+   {
+      pResponse->setBodyUnencoded(page.gzipContents);
+      pResponse->setContentEncoding(http::kGzipEncoding);
+   }
+   else
+   {
+      pResponse->setBodyUnencoded(page.contents);
+   }
+   return true;
+}
+
+void cacheHelpPage(const http::Request& request,
+                   const std::string& package,
+                   const std::string& contents,
+                   const std::string& eTag)
+{
+   // (the eTag is needed so the client can revalidate cached copies)
+   if (eTag.empty())
+      return;
+
+   std::string packageDir;
+   Error error = r::exec::RFunction("find.package", package).call(&packageDir);
+   if (error || packageDir.empty())
+      return;
+
+   boost::shared_ptr<CachedHelpPage> pPage(new CachedHelpPage());
+   pPage->descriptionPath = FilePath(string_utils::systemToUtf8(packageDir))
+                                                   .childPath("DESCRIPTION");
+   if (!pPage->descriptionPath.exists())
+      return;
+   pPage->descriptionTime = pPage->descriptionPath.lastWriteTime();
+   pPage->eTag = eTag;
+   pPage->contents = contents;
+
+#ifndef _WIN32
+   // the result is cached so use the best compression available
+   error = http::gzipContent(contents, 9, &(pPage->gzipContents));
+   if (error)
+   {
+      // serve uncompressed
+      LOG_ERROR(error);
+      pPage->gzipContents.clear();
+   }
+#endif
+
+   std::size_t size = pPage->contents.size() + pPage->gzipContents.size();
+   if (s_helpCacheSize + size > kMaxHelpCacheSize)
+   {
+      s_helpCache.clear();
+      s_helpCacheSize = 0;
+   }
+
+   std::map<std::string, boost::shared_ptr<CachedHelpPage> >::iterator it =
+                                               s_helpCache.find(request.uri());
+   if (it != s_helpCache.end())
+   {
+      s_helpCacheSize -= it->second->contents.size() +
+                         it->second->gzipContents.size();
+   }
+   s_helpCache[request.uri()] = pPage;
+   s_helpCacheSize += size;
+}
+
+std::size_t helpCacheMemoryUsage()
+{
+   return s_helpCacheSize;
+}
+
+void releaseHelpCache()
+{
+   std::map<std::string, boost::shared_ptr<CachedHelpPage> >().swap(
+                                                               s_helpCache);
+   s_helpCacheSize = 0;
+}
+
+// searches from the help pane are answered from our topic index rather than
+// by R's help.search database (which can take a very long time to build)
+const std::size_t kMaxSearchResults = 200;
+
+bool handleSearchRequest(const http::Request& request,
+                         http::Response* pResponse)
+{
+   std::string pattern = request.queryParamValue("pattern");
+   std::vector<topic_index::HelpTopic> topics;
+   Error error = topic_index::searchTopics(pattern, kMaxSearchResults, &topics);
+   if (error)
+   {
+      // let R handle it
+      LOG_ERROR(error);
+      return false;
+   }
+
+   std::ostringstream ostr;
+   ostr << "<!DOCTYPE html PUBLIC \"-//W3C//DTD HTML 4.01 Transitional//EN\">\n"
+        << "<html><head><title>R: Search Results</title>\n"
+        << "<meta http-equiv=\"Content-Type\" "
+        << "content=\"text/html; charset=utf-8\">\n"
+        << "<link rel=\"stylesheet\" type=\"text/css\" "
+        << "href=\"/doc/html/R.css\">\n"
+        << "</head><body>\n"
+        << "<h2>Search Results</h2>\n"
+        << "<p>The search string was <b>\""
+        << string_utils::htmlEscape(pattern) << "\"</b></p>\n";
+
+   if (topics.empty())
+   {
+      ostr << "<p>No results found</p>\n";
+   }
+   else
+   {
+      ostr << "<table width=\"100%\">\n";
+      BOOST_FOREACH(const topic_index::HelpTopic& topic, topics)
+      {
+         ostr << "<tr><td style=\"width: 25%;\"><a href=\"/library/"
+              << http::util::urlEncode(topic.package) << "/html/"
+              << http::util::urlEncode(topic.topic) << ".html\">"
+              << string_utils::htmlEscape(topic.package) << "::"
+              << string_utils::htmlEscape(topic.alias) << "</a></td>\n"
+              << "<td>" << string_utils::htmlEscape(topic.title)
+              << "</td></tr>\n";
+      }
+      ostr << "</table>\n";
+      if (topics.size() == kMaxSearchResults)
+         ostr << "<p>Only the first " << kMaxSearchResults
+              << " results are shown</p>\n";
+   }
+   ostr << "</body></html>\n";
+
+   pResponse->setStatusCode(http::status::Ok);
+   pResponse->setContentType("text/html");
+   setDynamicContentResponse(ostr.str(),
+                             request,
+                             HelpContentsFilter(request),
+                             pResponse);
+   return true;
+}
+
+Error suggestTopics(const json::JsonRpcRequest& request,
+                    json::JsonRpcResponse* pResponse)
+{
+   std::string prefix;
+   Error error = json::readParams(request.params, &prefix);
+   if (error)
+      return error;
+
+   std::vector<std::string> aliases;
+   error = topic_index::suggestTopics(prefix, &aliases);
+   if (error)
+   {
+      // fall back to asking R
+      LOG_ERROR(error);
+      aliases.clear();
+      error = r::exec::RFunction(".rs.suggestTopics", prefix).call(&aliases);
+      if (error)
+         return error;
+   }
+
+   json::Array aliasesJson;
+   std::copy(aliases.begin(), aliases.end(), std::back_inserter(aliasesJson));
+   pResponse->setResult(aliasesJson);
+   return Success();
+}
+
 // the ShowHelp event will result in the Help pane requesting the specified
 // help url. we handle this request directly by calling the R httpd function
 // to dynamically form the correct http response
 void handleHelpRequest(const http::Request& request, http::Response* pResponse)
 {
+   // serve package help pages we've already rendered without calling R
+   std::string package;
+   bool cacheable = isCacheableHelpPage(request, &package);
+   if (cacheable && serveCachedHelpPage(request, pResponse))
+      return;
+
+   // search results
+   if (http::util::pathAfterPrefix(request, kHelpLocation) == "/doc/html/Search" &&
+       handleSearchRequest(request, pResponse))
+   {
+      return;
+   }
+
+   boost::shared_ptr<std::string> pFiltered(new std::string());
    handleHttpdRequest(kHelpLocation,
                       boost::bind(r::sexp::findFunction, "httpd", "tools"),
                       request,
-                      HelpContentsFilter(request),
+                      HelpContentsFilter(request, pFiltered),
                       pResponse);
+
+   // the filter only runs when a page was actually rendered and sent
+   if (cacheable &&
+       pResponse->statusCode() == http::status::Ok &&
+       !pFiltered->empty())
+   {
+      cacheHelpPage(request, package, *pFiltered, pResponse->headerValue("ETag"));
+   }
 }
 
 } // anonymous namespace
@@ -799,11 +1064,13 @@ Error initialize()
    using core::http::UriHandler;
    using namespace module_context;
    using namespace r::function_hook ;
+   registerMemoryUsage("help_cache", helpCacheMemoryUsage, releaseHelpCache);
    ExecBlock initBlock ;
    initBlock.addFunctions()
       (bind(registerRBrowseUrlHandler, handleLocalHttpUrl))
       (bind(registerRBrowseFileHandler, handleRShowDocFile))
       (bind(registerUriHandler, kHelpLocation, handleHelpRequest))
+      (bind(registerRpcMethod, "suggest_topics", suggestTopics))
       (bind(sourceModuleRFile, "SessionHelp.R"));
    Error error = initBlock.execute();
    if (error)
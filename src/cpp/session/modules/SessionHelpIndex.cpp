@@ -0,0 +1,515 @@
+/*
+ * SessionHelpIndex.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "SessionHelpIndex.hpp"
+
+#include <set>
+#include <map>
+#include <cctype>
+#include <algorithm>
+
+#include <boost/regex.hpp>
+#include <boost/foreach.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/algorithm/string/replace.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/trim.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/Hash.hpp>
+#include <core/SafeConvert.hpp>
+#include <core/StringUtils.hpp>
+#include <core/system/System.hpp>
+
+#include <r/RExec.hpp>
+
+#include <session/SessionModuleContext.hpp>
+
+using namespace core;
+
+namespace session {
+namespace modules {
+namespace help {
+namespace topic_index {
+
+namespace {
+
+// first line of persisted library indexes (bump when the format changes)
+const char * const kIndexFormat = "help-index-1";
+
+// how often installed packages are checked for changes
+const int kValidationIntervalSeconds = 5;
+
+struct PackageTopics
+{
+   PackageTopics() : descriptionTime(0) {}
+   std::time_t descriptionTime;
+   std::vector<HelpTopic> topics;
+};
+
+struct Library
+{
+   Library() : loaded(false) {}
+   bool loaded;
+   std::map<std::string, PackageTopics> packages;
+};
+
+// libraries (in .libPaths order) and what we know about their packages
+std::vector<std::string> s_libPaths;
+std::map<std::string, Library> s_libraries;
+boost::posix_time::ptime s_lastValidated;
+bool s_built = false;
+
+// the index itself: all topics, their (sorted) aliases, and the topics
+// each word of an alias or title appears in
+std::vector<HelpTopic> s_topics;
+std::vector<std::string> s_aliases;
+std::map<std::string, std::vector<std::size_t> > s_words;
+
+void tokenize(const std::string& text, std::set<std::string>* pWords)
+{
+   std::string word;
+   for (std::size_t i = 0; i <= text.size(); i++)
+   {
+      char ch = i < text.size() ? text[i] : ' ';
+      if (std::isalnum(static_cast<unsigned char>(ch)) ||
+          ch == '.' || ch == '_' || (ch & 0x80))
+      {
+         word.push_back(std::tolower(static_cast<unsigned char>(ch)));
+      }
+      else if (!word.empty())
+      {
+         // don't let trailing periods (e.g. end of sentence) be significant
+         boost::algorithm::trim_right_if(word, boost::algorithm::is_any_of("."));
+         if (!word.empty())
+            pWords->insert(word);
+         word.clear();
+      }
+   }
+}
+
+std::string titleText(std::string html)
+{
+   // strip tags and decode the entities which Rd emits
+   html = boost::regex_replace(html, boost::regex("<[^>]*>"), "");
+   boost::algorithm::replace_all(html, "&lt;", "<");
+   boost::algorithm::replace_all(html, "&gt;", ">");
+   boost::algorithm::replace_all(html, "&quot;", "\"");
+   boost::algorithm::replace_all(html, "&amp;", "&");
+   html = boost::regex_replace(html, boost::regex("\\s+"), " ");
+   boost::algorithm::trim(html);
+   return html;
+}
+
+void readPackageTopics(const FilePath& packageDir,
+                       const std::string& package,
+                       std::vector<HelpTopic>* pTopics)
+{
+   // aliases (alias<tab>topic on each line)
+   FilePath anIndexPath = packageDir.childPath("help/AnIndex");
+   if (!anIndexPath.exists())
+      return;
+   std::vector<std::string> lines;
+   Error error = readStringVectorFromFile(anIndexPath, &lines);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return;
+   }
+
+   // titles are taken from the package's html index
+   std::map<std::string, std::string> titles;
+   FilePath htmlIndexPath = packageDir.childPath("html/00Index.html");
+   std::string htmlIndex;
+   if (htmlIndexPath.exists() &&
+       !readStringFromFile(htmlIndexPath, &htmlIndex))
+   {
+      boost::regex rowRegex("<a href=\"([^\"]+)\\.html\">[^<]*</a></td>\\s*"
+                            "<td>(.*?)</td>");
+      boost::sregex_iterator it(htmlIndex.begin(), htmlIndex.end(), rowRegex);
+      boost::sregex_iterator end;
+      for (; it != end; ++it)
+         titles[(*it)[1]] = titleText((*it)[2]);
+   }
+
+   BOOST_FOREACH(const std::string& line, lines)
+   {
+      std::size_t tabLoc = line.find('\t');
+      if (tabLoc == std::string::npos || tabLoc == 0)
+         continue;
+
+      HelpTopic topic;
+      topic.package = package;
+      topic.alias = line.substr(0, tabLoc);
+      topic.topic = line.substr(tabLoc + 1);
+      boost::algorithm::trim(topic.topic);
+      std::map<std::string, std::string>::const_iterator titleIt =
+                                                titles.find(topic.topic);
+      if (titleIt != titles.end())
+         topic.title = titleIt->second;
+      pTopics->push_back(topic);
+   }
+}
+
+FilePath libraryIndexPath(const std::string& libPath)
+{
+   return module_context::userScratchPath().complete("help_index")
+                                 .childPath(hash::xxHash64(libPath));
+}
+
+// persisted format:
+//
+//   <package><tab><description time>
+//   <tab><alias><tab><topic><tab><title>
+//   ...
+void loadLibraryIndex(const std::string& libPath, Library* pLibrary)
+{
+   FilePath indexPath = libraryIndexPath(libPath);
+   if (!indexPath.exists())
+      return;
+
+   std::vector<std::string> lines;
+   Error error = readStringVectorFromFile(indexPath, &lines, false);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return;
+   }
+   if (lines.empty() || lines[0] != kIndexFormat)
+      return;
+
+   PackageTopics* pPackage = NULL;
+   std::string package;
+   for (std::size_t i = 1; i < lines.size(); i++)
+   {
+      const std::string& line = lines[i];
+      if (line.empty())
+         continue;
+
+      std::vector<std::string> fields;
+      boost::algorithm::split(fields, line, boost::algorithm::is_any_of("\t"));
+      if (line[0] != '\t')
+      {
+         if (fields.size() != 2)
+            return;
+         package = fields[0];
+         pPackage = &(pLibrary->packages[package]);
+         pPackage->descriptionTime =
+                     safe_convert::stringTo<std::time_t>(fields[1], 0);
+      }
+      else if (pPackage != NULL && fields.size() == 4)
+      {
+         HelpTopic topic;
+         topic.package = package;
+         topic.alias = fields[1];
+         topic.topic = fields[2];
+         topic.title = fields[3];
+         pPackage->topics.push_back(topic);
+      }
+   }
+}
+
+void saveLibraryIndex(const std::string& libPath, const Library& library)
+{
+   std::string index(kIndexFormat);
+   index.append("\n");
+   for (std::map<std::string, PackageTopics>::const_iterator it =
+        library.packages.begin(); it != library.packages.end(); ++it)
+   {
+      index.append(it->first + "\t" +
+                   safe_convert::numberToString(it->second.descriptionTime) +
+                   "\n");
+      BOOST_FOREACH(const HelpTopic& topic, it->second.topics)
+      {
+         index.append("\t" + topic.alias + "\t" + topic.topic + "\t" +
+                      topic.title + "\n");
+      }
+   }
+
+   // write to a temporary file and then move it into place so that other
+   // sessions never read a partially written index
+   FilePath indexPath = libraryIndexPath(libPath);
+   Error error = indexPath.parent().ensureDirectory();
+   if (error)
+   {
+      LOG_ERROR(error);
+      return;
+   }
+   FilePath tempPath(indexPath.absolutePath() + "." +
+                     core::system::generateUuid(false));
+   error = writeStringToFile(tempPath, index);
+   if (!error)
+      error = tempPath.move(indexPath);
+   if (error)
+      LOG_ERROR(error);
+}
+
+bool validateLibrary(const std::string& libPath, Library* pLibrary)
+{
+   std::vector<FilePath> children;
+   Error error = FilePath(libPath).children(&children);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return false;
+   }
+
+   bool changed = false;
+   std::set<std::string> packages;
+   BOOST_FOREACH(const FilePath& packageDir, children)
+   {
+      FilePath descriptionPath = packageDir.childPath("DESCRIPTION");
+      if (!descriptionPath.exists())
+         continue;
+
+      std::string package = packageDir.filename();
+      packages.insert(package);
+
+      // re-read packages which were installed since we last looked
+      std::time_t descriptionTime = descriptionPath.lastWriteTime();
+      PackageTopics& topics = pLibrary->packages[package];
+      if (topics.descriptionTime != descriptionTime)
+      {
+         topics.descriptionTime = descriptionTime;
+         topics.topics.clear();
+         readPackageTopics(packageDir, package, &topics.topics);
+         changed = true;
+      }
+   }
+
+   // forget packages which have been removed
+   std::map<std::string, PackageTopics>::iterator it =
+                                             pLibrary->packages.begin();
+   while (it != pLibrary->packages.end())
+   {
+      if (packages.find(it->first) == packages.end())
+      {
+         pLibrary->packages.erase(it++);
+         changed = true;
+      }
+      else
+      {
+         ++it;
+      }
+   }
+
+   return changed;
+}
+
+void rebuildIndex()
+{
+   s_topics.clear();
+   s_aliases.clear();
+   s_words.clear();
+
+   // packages in earlier libraries mask those in later ones
+   std::set<std::string> packages;
+   BOOST_FOREACH(const std::string& libPath, s_libPaths)
+   {
+      const Library& library = s_libraries[libPath];
+      for (std::map<std::string, PackageTopics>::const_iterator it =
+           library.packages.begin(); it != library.packages.end(); ++it)
+      {
+         if (!packages.insert(it->first).second)
+            continue;
+
+         s_topics.insert(s_topics.end(),
+                         it->second.topics.begin(),
+                         it->second.topics.end());
+      }
+   }
+
+   for (std::size_t i = 0; i < s_topics.size(); i++)
+   {
+      const HelpTopic& topic = s_topics[i];
+      s_aliases.push_back(topic.alias);
+
+      std::set<std::string> words;
+      tokenize(topic.alias + " " + topic.title, &words);
+      BOOST_FOREACH(const std::string& word, words)
+         s_words[word].push_back(i);
+   }
+
+   std::sort(s_aliases.begin(), s_aliases.end());
+   s_aliases.erase(std::unique(s_aliases.begin(), s_aliases.end()),
+                   s_aliases.end());
+
+   s_built = true;
+}
+
+Error updateIndex()
+{
+   using namespace boost::posix_time;
+   ptime now = microsec_clock::universal_time();
+   if (s_built && !s_lastValidated.is_not_a_date_time() &&
+       now - s_lastValidated < seconds(kValidationIntervalSeconds))
+   {
+      return Success();
+   }
+
+   std::vector<std::string> libPaths;
+   Error error = r::exec::RFunction(".libPaths").call(&libPaths);
+   if (error)
+      return error;
+   BOOST_FOREACH(std::string& libPath, libPaths)
+      libPath = string_utils::systemToUtf8(libPath);
+
+   bool changed = !s_built || libPaths != s_libPaths;
+   BOOST_FOREACH(const std::string& libPath, libPaths)
+   {
+      Library& library = s_libraries[libPath];
+      if (!library.loaded)
+      {
+         loadLibraryIndex(libPath, &library);
+         library.loaded = true;
+      }
+
+      if (validateLibrary(libPath, &library))
+      {
+         saveLibraryIndex(libPath, library);
+         changed = true;
+      }
+   }
+   s_libPaths = libPaths;
+   s_lastValidated = now;
+
+   if (changed)
+      rebuildIndex();
+
+   return Success();
+}
+
+int matchScore(const HelpTopic& topic, const std::string& query)
+{
+   if (topic.alias == query)
+      return 0;
+
+   std::string alias = string_utils::toLower(topic.alias);
+   std::string lowerQuery = string_utils::toLower(query);
+   if (alias == lowerQuery)
+      return 1;
+   else if (boost::algorithm::starts_with(alias, lowerQuery))
+      return 2;
+   else
+      return 3;
+}
+
+struct CompareMatches
+{
+   CompareMatches(const std::string& query) : query_(query) {}
+
+   bool operator()(std::size_t lhs, std::size_t rhs) const
+   {
+      int lhsScore = matchScore(s_topics[lhs], query_);
+      int rhsScore = matchScore(s_topics[rhs], query_);
+      if (lhsScore != rhsScore)
+         return lhsScore < rhsScore;
+      else
+         return s_topics[lhs].alias < s_topics[rhs].alias;
+   }
+
+private:
+   std::string query_;
+};
+
+} // anonymous namespace
+
+Error suggestTopics(const std::string& prefix,
+                    std::vector<std::string>* pAliases)
+{
+   Error error = updateIndex();
+   if (error)
+      return error;
+
+   std::vector<std::string>::const_iterator it =
+         std::lower_bound(s_aliases.begin(), s_aliases.end(), prefix);
+   for (; it != s_aliases.end() && boost::algorithm::starts_with(*it, prefix);
+        ++it)
+   {
+      pAliases->push_back(*it);
+   }
+
+   return Success();
+}
+
+Error searchTopics(const std::string& query,
+                   std::size_t maxResults,
+                   std::vector<HelpTopic>* pTopics)
+{
+   Error error = updateIndex();
+   if (error)
+      return error;
+
+   std::set<std::string> words;
+   tokenize(query, &words);
+   if (words.empty())
+      return Success();
+
+   // topics must match every word (words match as prefixes)
+   std::vector<std::size_t> matches;
+   bool first = true;
+   BOOST_FOREACH(const std::string& word, words)
+   {
+      std::vector<std::size_t> wordMatches;
+      std::map<std::string, std::vector<std::size_t> >::const_iterator it =
+                                                   s_words.lower_bound(word);
+      for (; it != s_words.end() &&
+             boost::algorithm::starts_with(it->first, word); ++it)
+      {
+         wordMatches.insert(wordMatches.end(),
+                            it->second.begin(),
+                            it->second.end());
+      }
+      std::sort(wordMatches.begin(), wordMatches.end());
+      wordMatches.erase(std::unique(wordMatches.begin(), wordMatches.end()),
+                        wordMatches.end());
+
+      if (first)
+      {
+         matches.swap(wordMatches);
+         first = false;
+      }
+      else
+      {
+         std::vector<std::size_t> intersection;
+         std::set_intersection(matches.begin(), matches.end(),
+                               wordMatches.begin(), wordMatches.end(),
+                               std::back_inserter(intersection));
+         matches.swap(intersection);
+      }
+
+      if (matches.empty())
+         return Success();
+   }
+
+   std::stable_sort(matches.begin(), matches.end(), CompareMatches(query));
+   if (matches.size() > maxResults)
+      matches.resize(maxResults);
+
+   BOOST_FOREACH(std::size_t match, matches)
+      pTopics->push_back(s_topics[match]);
+
+   return Success();
+}
+
+} // namespace topic_index
+} // namespace help
+} // namespace modules
+} // namesapce session
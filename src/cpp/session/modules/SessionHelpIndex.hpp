@@ -0,0 +1,60 @@
+/*
+ * SessionHelpIndex.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SESSION_SESSION_HELP_INDEX_HPP
+#define SESSION_SESSION_HELP_INDEX_HPP
+
+#include <string>
+#include <vector>
+
+namespace core {
+   class Error;
+}
+
+namespace session {
+namespace modules {
+namespace help {
+namespace topic_index {
+
+struct HelpTopic
+{
+   std::string package;
+   std::string alias;
+   std::string topic;   // name of the help page (html/<topic>.html)
+   std::string title;
+};
+
+// Index of the help topics (aliases and titles) of all installed packages.
+// The index for each library is persisted within the user scratch path
+// (so it is shared across sessions) and packages are only re-read when
+// their DESCRIPTION file changes. The index is brought up to date lazily
+// by the functions below (which must be called on the main thread).
+
+// aliases which start with the given prefix (sorted, without duplicates)
+core::Error suggestTopics(const std::string& prefix,
+                          std::vector<std::string>* pAliases);
+
+// topics which match all of the words in the query (by alias or title),
+// ordered from best to worst match
+core::Error searchTopics(const std::string& query,
+                         std::size_t maxResults,
+                         std::vector<HelpTopic>* pTopics);
+
+} // namespace topic_index
+} // namespace help
+} // namespace modules
+} // namesapce session
+
+#endif // SESSION_SESSION_HELP_INDEX_HPP
@@ -15,6 +15,9 @@
 
 #include "SessionHistory.hpp"
 
+#include <set>
+#include <cctype>
+#include <cstdlib>
 #include <iostream>
 #include <sstream>
 #include <vector>
@@ -25,6 +28,7 @@
 #include <boost/function.hpp>
 #include <boost/format.hpp>
 #include <boost/tokenizer.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
 #include <boost/algorithm/string/trim.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 
@@ -84,58 +88,100 @@ void historyEntriesAsJson(const std::vector<HistoryEntry>& entries,
 }
    
 
-// simple reader for parsing lines of history file
-class HistoryEntryReader
+// history lines are of the form <timestamp>:<command>; lines without a
+// ':' are ignored (and don't count as entries)
+bool isHistoryLine(const char* begin, const char* end)
 {
-public:
-   HistoryEntryReader() : nextIndex_(0) {}
-   
-   ReadCollectionAction operator()(const std::string& line, 
-                                   HistoryEntry* pEntry)
+   return std::find(begin, end, ':') != end;
+}
+
+// parse a (trimmed) history line
+bool parseHistoryLine(const char* begin,
+                      const char* end,
+                      int index,
+                      HistoryEntry* pEntry)
+{
+   // the line contains a ':' so strtod won't read past the end of it
+   char* timestampEnd = NULL;
+   double timestamp = std::strtod(begin, &timestampEnd);
+   if (timestampEnd == begin || timestampEnd >= end)
    {
-      // if the line doesn't have a ':' then ignore it
-      if (line.find(':') == std::string::npos)
-         return ReadCollectionIgnoreLine;
-
-      pEntry->index = nextIndex_++; 
-      std::istringstream istr(line);
-      istr >> pEntry->timestamp ;
-      istr.ignore(1, ':');
-      std::getline(istr, pEntry->command);
-      
-      // if we had a read failure log it and return ignore state
-      if (!istr.fail())
-      {
-         return ReadCollectionAddLine;
-      }
-      else
-      {
-         LOG_ERROR_MESSAGE("unexpected io error reading history line: " + 
-                           line);
-         return ReadCollectionIgnoreLine;  
-      }
+      LOG_ERROR_MESSAGE("unexpected io error reading history line: " +
+                        std::string(begin, end));
+      return false;
    }
-private:
-   int nextIndex_;
-};
-   
-   
+
+   pEntry->index = index;
+   pEntry->timestamp = timestamp;
+   pEntry->command.assign(static_cast<const char*>(timestampEnd) + 1, end);
+   return true;
+}
+
+// find the (trimmed) line which starts at or after pos. returns a pointer
+// to the start of the following line
+const char* nextLine(const char* pos,
+                     const char* end,
+                     const char** pLineBegin,
+                     const char** pLineEnd)
+{
+   const char* lineEnd = std::find(pos, end, '\n');
+   const char* next = lineEnd == end ? end : lineEnd + 1;
+
+   while (pos < lineEnd && std::isspace(static_cast<unsigned char>(*pos)))
+      ++pos;
+   while (lineEnd > pos &&
+          std::isspace(static_cast<unsigned char>(*(lineEnd - 1))))
+      --lineEnd;
+
+   *pLineBegin = pos;
+   *pLineEnd = lineEnd;
+   return next;
+}
+
+// find the (trimmed) line which ends at or before end. returns a pointer
+// to the end of the preceding line
+const char* previousLine(const char* begin,
+                         const char* end,
+                         const char** pLineBegin,
+                         const char** pLineEnd)
+{
+   // skip the newline which terminates this line
+   const char* lineEnd = end;
+   if (lineEnd > begin && *(lineEnd - 1) == '\n')
+      --lineEnd;
+
+   const char* lineBegin = lineEnd;
+   while (lineBegin > begin && *(lineBegin - 1) != '\n')
+      --lineBegin;
+   const char* previous = lineBegin;
+
+   nextLine(lineBegin, lineEnd, pLineBegin, pLineEnd);
+   return previous;
+}
+
+// The history database is an append-only log which can contain millions
+// of entries, so rather than keeping the entries in memory we map the
+// file on demand and keep only a sparse index of it: the offset of every
+// kIndexInterval'th entry. Ranges of entries are materialized by seeking
+// to the nearest indexed entry and parsing forward, and searches scan the
+// mapped file backwards. When the file grows (because we or another
+// session appended to it) only the new tail is indexed; the file is
+// re-indexed from scratch only if it shrinks or is rewritten.
 class History : boost::noncopyable
 {
 private:
-   History() : entryCacheLastWriteTime_(-1) {}
+   History()
+      : fileSize_(0), fileLastWriteTime_(-1), indexedSize_(0), entryCount_(0)
+   {
+   }
    friend History& historyArchive();
    
 public:
    
    Error add(const std::string& command)
    {
-      // reset the cache (since this write will invalidate the current one,
-      // no sense in keeping our cache around in memory)
-      entries_.clear();
-      entryCacheLastWriteTime_ = -1;
-
-      // write the entry to the file
+      // write the entry to the file (the index picks it up the next
+      // time it is used)
       std::ostringstream ostrEntry ;
       double currentTime = core::date_time::millisecondsSinceEpoch();
       writeEntry(currentTime, command, &ostrEntry);
@@ -143,39 +189,95 @@ public:
       return appendToFile(historyDatabaseFilePath(), ostrEntry.str());
    }
 
-   const std::vector<HistoryEntry>& entries() const
+   int size() const
    {
-      // calculate path to history db
-      FilePath historyDBPath = historyDatabaseFilePath();
+      sync();
+      return entryCount_;
+   }
 
-      // if the file doesn't exist then clear the collection
-      if (!historyDBPath.exists())
-      {
-         entries_.clear();
-      }
+   std::size_t memoryUsage() const
+   {
+      return entryOffsets_.capacity() * sizeof(uintmax_t);
+   }
+
+   // drop the index (it's rebuilt the next time it's used)
+   void releaseIndex()
+   {
+      clear();
+      std::vector<uintmax_t>().swap(entryOffsets_);
+   }
 
-      // otherwise check for divergent lastWriteTime and read the file
-      // if our internal list isn't up to date
-      else if (historyDBPath.lastWriteTime() != entryCacheLastWriteTime_)
+   // entries in the range [startIndex, endIndex)
+   void entries(int startIndex,
+                int endIndex,
+                std::vector<HistoryEntry>* pEntries) const
+   {
+      sync();
+      startIndex = std::max(0, startIndex);
+      endIndex = std::min(endIndex, entryCount_);
+      if (startIndex >= endIndex)
+         return;
+
+      boost::iostreams::mapped_file_source file;
+      if (!mapFile(&file))
+         return;
+
+      // start from the nearest indexed entry
+      int block = startIndex / kIndexInterval;
+      int index = block * kIndexInterval;
+      const char* pos = file.data() + entryOffsets_[block];
+      const char* end = file.data() + indexedSize_;
+
+      while (pos < end && index < endIndex)
       {
-         entries_.clear();
-         Error error = readCollectionFromFile<std::vector<HistoryEntry> >(
-                                                      historyDBPath,
-                                                      &entries_,
-                                                      HistoryEntryReader());
-         if (error)
+         const char* lineBegin;
+         const char* lineEnd;
+         pos = nextLine(pos, end, &lineBegin, &lineEnd);
+         if (!isHistoryLine(lineBegin, lineEnd))
+            continue;
+
+         HistoryEntry entry;
+         if (index >= startIndex &&
+             parseHistoryLine(lineBegin, lineEnd, index, &entry))
          {
-            LOG_ERROR(error);
+            pEntries->push_back(entry);
          }
-         else
+         index++;
+      }
+   }
+
+   // most recent entries (most recent first) which satisfy the predicate
+   void search(const boost::function<bool(const HistoryEntry&)>& predicate,
+               std::size_t maxEntries,
+               std::vector<HistoryEntry>* pMatches) const
+   {
+      sync();
+      if (maxEntries == 0 || entryCount_ == 0)
+         return;
+
+      boost::iostreams::mapped_file_source file;
+      if (!mapFile(&file))
+         return;
+
+      const char* begin = file.data();
+      const char* pos = begin + indexedSize_;
+      int index = entryCount_;
+      HistoryEntry entry;
+      while (pos > begin && pMatches->size() < maxEntries)
+      {
+         const char* lineBegin;
+         const char* lineEnd;
+         pos = previousLine(begin, pos, &lineBegin, &lineEnd);
+         if (!isHistoryLine(lineBegin, lineEnd))
+            continue;
+
+         index--;
+         if (parseHistoryLine(lineBegin, lineEnd, index, &entry) &&
+             predicate(entry))
          {
-            entryCacheLastWriteTime_ = historyDBPath.lastWriteTime();
+            pMatches->push_back(entry);
          }
-
       }
-      
-      // return entries
-      return entries_;
    }
 
    static void migrateRhistoryIfNecessary()
@@ -190,6 +292,93 @@ public:
    
 private:
 
+   void clear() const
+   {
+      fileSize_ = 0;
+      fileLastWriteTime_ = -1;
+      indexedSize_ = 0;
+      entryCount_ = 0;
+      entryOffsets_.clear();
+   }
+
+   bool mapFile(boost::iostreams::mapped_file_source* pFile) const
+   {
+      try
+      {
+         pFile->open(historyDatabaseFilePath().absolutePathNative());
+      }
+      catch(const std::exception& e)
+      {
+         LOG_ERROR_MESSAGE(std::string("Error mapping history: ") + e.what());
+         return false;
+      }
+
+      // if the file is shorter than what we indexed then it was truncated
+      // since we synced (we'll re-index next time)
+      return pFile->is_open() && pFile->size() >= indexedSize_;
+   }
+
+   // bring the index up to date with the history database
+   void sync() const
+   {
+      // if the file doesn't exist then clear the index
+      FilePath historyDBPath = historyDatabaseFilePath();
+      if (!historyDBPath.exists())
+      {
+         clear();
+         return;
+      }
+
+      // nothing to do if the file hasn't changed
+      uintmax_t size = historyDBPath.size();
+      std::time_t lastWriteTime = historyDBPath.lastWriteTime();
+      if (size == fileSize_ && lastWriteTime == fileLastWriteTime_)
+         return;
+
+      // re-index from scratch if the file isn't an extension of what we
+      // indexed (i.e. it didn't grow or our last line is no longer there)
+      if (size <= indexedSize_)
+         clear();
+
+      if (size > 0)
+      {
+         boost::iostreams::mapped_file_source file;
+         if (!mapFile(&file))
+         {
+            clear();
+            return;
+         }
+
+         const char* begin = file.data();
+         if (indexedSize_ > 0 && begin[indexedSize_ - 1] != '\n')
+            clear();
+
+         // only index complete lines (a write may be in progress)
+         const char* end = begin + file.size();
+         while (end > begin && *(end - 1) != '\n')
+            --end;
+
+         const char* pos = begin + indexedSize_;
+         while (pos < end)
+         {
+            const char* lineBegin;
+            const char* lineEnd;
+            const char* next = nextLine(pos, end, &lineBegin, &lineEnd);
+            if (isHistoryLine(lineBegin, lineEnd))
+            {
+               if (entryCount_ % kIndexInterval == 0)
+                  entryOffsets_.push_back(pos - begin);
+               entryCount_++;
+            }
+            pos = next;
+         }
+         indexedSize_ = end - begin;
+      }
+
+      fileSize_ = size;
+      fileLastWriteTime_ = lastWriteTime;
+   }
+
    static void writeEntry(double timestamp, 
                           const std::string& command, 
                           std::ostream* pOS) 
@@ -224,8 +413,16 @@ private:
    
    
 private:
-   mutable std::time_t entryCacheLastWriteTime_;
-   mutable std::vector<HistoryEntry> entries_;
+   static const int kIndexInterval = 64;
+
+   // size and write time of the file when we last synced
+   mutable uintmax_t fileSize_;
+   mutable std::time_t fileLastWriteTime_;
+
+   // extent of the file which is indexed (always a complete line)
+   mutable uintmax_t indexedSize_;
+   mutable int entryCount_;
+   mutable std::vector<uintmax_t> entryOffsets_;
 };
    
 History& historyArchive()
@@ -238,11 +435,8 @@ Error setJsonResultFromHistory(int startIndex,
                                int endIndex,
                                json::JsonRpcResponse* pResponse)
 {
-   // get all entries
-   const std::vector<HistoryEntry>& allEntries = historyArchive().entries();
-
    // validate indexes
-   int historySize = allEntries.size();
+   int historySize = historyArchive().size();
    if ( (startIndex < 0)               ||
         (startIndex > historySize)     ||
         (endIndex < 0)                 ||
@@ -253,9 +447,7 @@ Error setJsonResultFromHistory(int startIndex,
    
    // return the entries
    std::vector<HistoryEntry> entries;
-   std::copy(allEntries.begin() + startIndex,
-             allEntries.begin() + endIndex,
-             std::back_inserter(entries));
+   historyArchive().entries(startIndex, endIndex, &entries);
    json::Object entriesJson;
    historyEntriesAsJson(entries, &entriesJson);
    pResponse->setResult(entriesJson);
@@ -278,6 +470,21 @@ bool matches(const HistoryEntry& entry,
    return true;
 }
 
+bool matchesPrefix(const HistoryEntry& entry,
+                   const std::string& prefix,
+                   bool uniqueOnly,
+                   std::set<std::string>* pMatchedCommands)
+{
+   if (!boost::algorithm::starts_with(entry.command, prefix))
+      return false;
+
+   // for unique searches only the most recent entry for each command
+   // matches (the archive is searched most recent first)
+   if (!uniqueOnly)
+      return true;
+   return pMatchedCommands->insert(entry.command).second;
+}
+
 
 void historyRangeAsJson(int startIndex,
                         int endIndex,
@@ -407,7 +614,7 @@ Error getHistoryArchiveItems(const json::JsonRpcRequest& request,
       return error;
    
    // truncate indexes if necessary
-   int historySize = historyArchive().entries().size();
+   int historySize = historyArchive().size();
    startIndex = std::min(startIndex, historySize);
    endIndex = std::min(endIndex, historySize);
    
@@ -432,24 +639,10 @@ Error searchHistoryArchive(const json::JsonRpcRequest& request,
    std::copy(tok.begin(), tok.end(), std::back_inserter(searchTerms));
    
    // examine the items in the history for matches
-   const std::vector<HistoryEntry>& allEntries =  historyArchive().entries();
    std::vector<HistoryEntry> matchingEntries;
-   for (std::vector<HistoryEntry>::const_reverse_iterator 
-            it = allEntries.rbegin();
-            it != allEntries.rend();
-            ++it)
-   {
-      // check limit
-      if (matchingEntries.size() >= static_cast<std::size_t>(maxEntries))
-         break;
-
-      // look for match
-      if (matches(*it, searchTerms))
-      {
-         // add entry
-         matchingEntries.push_back(*it);
-      }
-   }
+   historyArchive().search(boost::bind(matches, _1, searchTerms),
+                           std::max(maxEntries, 0),
+                           &matchingEntries);
 
    // return json
    json::Object entriesJson;
@@ -474,28 +667,15 @@ Error searchHistoryArchiveByPrefix(const json::JsonRpcRequest& request,
    boost::algorithm::trim(prefix);
    
    // examine the items in the history for matches
-   const std::vector<HistoryEntry>& allEntries = historyArchive().entries();
    std::set<std::string> matchedCommands;
    std::vector<HistoryEntry> matchingEntries;
-   for (std::vector<HistoryEntry>::const_reverse_iterator 
-        it = allEntries.rbegin();
-        it != allEntries.rend();
-        ++it)
-   {
-      // check limit
-      if (matchingEntries.size() >= static_cast<std::size_t>(maxEntries))
-         break;
-      
-      // look for match 
-      if (boost::algorithm::starts_with(it->command, prefix))
-      {
-         if (!uniqueOnly || (matchedCommands.count(it->command) == 0))
-         {
-            matchingEntries.push_back(*it);
-            matchedCommands.insert(it->command);
-         }
-      }
-   }
+   historyArchive().search(boost::bind(matchesPrefix,
+                                       _1,
+                                       prefix,
+                                       uniqueOnly,
+                                       &matchedCommands),
+                           std::max(maxEntries, 0),
+                           &matchingEntries);
    
    // return json
    json::Object entriesJson;
@@ -530,6 +710,19 @@ SEXP rs_timestamp(SEXP dateSEXP)
    return R_NilValue;
 }
 
+std::size_t consoleHistoryMemoryUsage()
+{
+   std::size_t bytes = 0;
+   r::session::ConsoleHistory& history = r::session::consoleHistory();
+   for (r::session::ConsoleHistory::const_iterator it = history.begin();
+        it != history.end();
+        ++it)
+   {
+      bytes += sizeof(std::string) + it->capacity();
+   }
+   return bytes;
+}
+
 } // anonymous namespace
    
    
@@ -551,6 +744,10 @@ Error initialize()
    // install handlers
    using boost::bind;
    using namespace session::module_context;
+   registerMemoryUsage("history",
+                       bind(&History::memoryUsage, &historyArchive()),
+                       bind(&History::releaseIndex, &historyArchive()));
+   registerMemoryUsage("console_history", consoleHistoryMemoryUsage);
    ExecBlock initBlock ;
    initBlock.addFunctions()
       (bind(registerRpcMethod, "get_recent_history", getRecentHistory))
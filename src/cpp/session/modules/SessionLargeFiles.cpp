@@ -0,0 +1,454 @@
+/*
+ * SessionLargeFiles.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+// Files too large for the source editor are viewed read-only: the file is
+// memory mapped, indexed by line and served to the viewer page a window of
+// lines at a time. Unlike source documents nothing is copied into memory,
+// added to the source database or indexed for code search.
+
+#include "SessionLargeFiles.hpp"
+
+#include <ctime>
+#include <cstring>
+#include <list>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+
+#include <boost/bind.hpp>
+#include <boost/format.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/utility.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/algorithm/string/replace.hpp>
+
+// see the note on BOOST_USE_WINDOWS_H in BoostErrors.cpp
+#if defined(__GNUC__) && defined(_WIN64)
+   #undef BOOST_USE_WINDOWS_H
+#endif
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <core/Log.hpp>
+#include <core/Error.hpp>
+#include <core/Exec.hpp>
+#include <core/FilePath.hpp>
+#include <core/BoostErrors.hpp>
+#include <core/StringUtils.hpp>
+#include <core/http/Request.hpp>
+#include <core/http/Response.hpp>
+#include <core/system/System.hpp>
+
+#include <r/RUtil.hpp>
+
+#include <session/SessionModuleContext.hpp>
+
+#include "SessionContentUrls.hpp"
+
+using namespace core;
+
+namespace session {
+namespace modules {
+namespace large_files {
+
+namespace {
+
+// maximum number of lines in a single window request
+const int kMaxWindowLines = 1000;
+
+// number of lines rendered into the page itself
+const int kInitialLines = 200;
+
+// lines longer than this are truncated for display
+const std::size_t kMaxLineLength = 4096;
+
+// the index records the offset of every kLineIndexStride'th line (so it
+// stays small even for files with tens of millions of lines)
+const std::size_t kLineIndexStride = 64;
+
+// number of files kept mapped for paging (the least recently viewed are
+// released first)
+const std::size_t kMaxViewedFiles = 5;
+
+class LargeFile : boost::noncopyable
+{
+public:
+   LargeFile(const FilePath& filePath, const std::string& encoding)
+      : filePath_(filePath), encoding_(encoding), size_(0),
+        lastWriteTime_(0), lineCount_(0)
+   {
+   }
+
+   // (re)map the file and index its lines
+   Error open()
+   {
+      region_.reset();
+      mapping_.reset();
+      lineIndex_.clear();
+      lineCount_ = 0;
+
+      size_ = filePath_.size();
+      lastWriteTime_ = filePath_.lastWriteTime();
+
+      // mapping an empty file fails (and there's nothing to index)
+      if (size_ == 0)
+         return Success();
+
+      try
+      {
+         using namespace boost::interprocess;
+         mapping_.reset(new file_mapping(
+                              filePath_.absolutePath().c_str(), read_only));
+         region_.reset(new mapped_region(*mapping_, read_only, 0, size_));
+      }
+      catch(const boost::interprocess::interprocess_exception& e)
+      {
+         region_.reset();
+         mapping_.reset();
+         Error error(boost::interprocess::ec_from_exception(e),
+                     ERROR_LOCATION);
+         error.addProperty("path", filePath_);
+         return error;
+      }
+
+      const char* begin = data();
+      const char* end = begin + size_;
+      const char* pos = begin;
+      while (pos < end)
+      {
+         if ((lineCount_ % kLineIndexStride) == 0)
+            lineIndex_.push_back(pos - begin);
+         lineCount_++;
+
+         const char* newline = static_cast<const char*>(
+                                       std::memchr(pos, '\n', end - pos));
+         pos = newline ? newline + 1 : end;
+      }
+
+      return Success();
+   }
+
+   // re-read the file if it has changed since it was mapped (a file which
+   // shrinks while mapped can't be read safely)
+   Error ensureCurrent()
+   {
+      if (!filePath_.exists())
+      {
+         return systemError(boost::system::errc::no_such_file_or_directory,
+                            ERROR_LOCATION);
+      }
+
+      if (filePath_.size() != size_ ||
+          filePath_.lastWriteTime() != lastWriteTime_)
+      {
+         return open();
+      }
+
+      return Success();
+   }
+
+   const FilePath& filePath() const { return filePath_; }
+
+   int lineCount() const { return static_cast<int>(lineCount_); }
+
+   Error readLines(int firstLine, int count, std::vector<std::string>* pLines)
+   {
+      if (firstLine < 0 || count <= 0 ||
+          static_cast<std::size_t>(firstLine) >= lineCount_)
+      {
+         return Success();
+      }
+
+      const char* begin = data();
+      const char* end = begin + size_;
+
+      // seek from the nearest indexed line
+      std::size_t line = firstLine - (firstLine % kLineIndexStride);
+      const char* pos = begin + lineIndex_[line / kLineIndexStride];
+      for (; line < static_cast<std::size_t>(firstLine); line++)
+         pos = nextLine(pos, end);
+
+      for (int i = 0; i < count && pos < end; i++)
+      {
+         const char* next = nextLine(pos, end);
+
+         const char* lineEnd = next;
+         if (lineEnd > pos && *(lineEnd - 1) == '\n')
+            lineEnd--;
+         if (lineEnd > pos && *(lineEnd - 1) == '\r')
+            lineEnd--;
+
+         std::string text;
+         Error error = decode(pos, lineEnd, &text);
+         if (error)
+            return error;
+         pLines->push_back(text);
+
+         pos = next;
+      }
+
+      return Success();
+   }
+
+private:
+   const char* data() const
+   {
+      return static_cast<const char*>(region_->get_address());
+   }
+
+   static const char* nextLine(const char* pos, const char* end)
+   {
+      const char* newline = static_cast<const char*>(
+                                       std::memchr(pos, '\n', end - pos));
+      return newline ? newline + 1 : end;
+   }
+
+   Error decode(const char* begin, const char* end, std::string* pText)
+   {
+      bool truncated = false;
+      if (static_cast<std::size_t>(end - begin) > kMaxLineLength)
+      {
+         // don't split a multi-byte utf-8 sequence
+         end = begin + kMaxLineLength;
+         while (end > begin && (static_cast<unsigned char>(*end) & 0xC0) == 0x80)
+            end--;
+         truncated = true;
+      }
+
+      std::string encoded(begin, end);
+      if (encoding_.empty() || encoding_ == "UTF-8")
+      {
+         pText->swap(encoded);
+      }
+      else
+      {
+         // NOTE: iconvstr goes through Riconv which doesn't touch any
+         // R interpreter state
+         Error error = r::util::iconvstr(encoded, encoding_, "UTF-8", true,
+                                         pText);
+         if (error)
+            return error;
+      }
+
+      if (truncated)
+         pText->append(" ...");
+
+      return Success();
+   }
+
+private:
+   FilePath filePath_;
+   std::string encoding_;
+   uintmax_t size_;
+   std::time_t lastWriteTime_;
+   boost::shared_ptr<boost::interprocess::file_mapping> mapping_;
+   boost::shared_ptr<boost::interprocess::mapped_region> region_;
+   std::vector<boost::uint64_t> lineIndex_;
+   std::size_t lineCount_;
+};
+
+// files available for paging (most recently viewed first)
+class ViewedFileStore : boost::noncopyable
+{
+public:
+   std::string add(boost::shared_ptr<LargeFile> pFile)
+   {
+      std::string id = core::system::generateUuid(false);
+      files_.push_front(std::make_pair(id, pFile));
+      if (files_.size() > kMaxViewedFiles)
+         files_.pop_back();
+      return id;
+   }
+
+   boost::shared_ptr<LargeFile> find(const std::string& id)
+   {
+      for (Entries::iterator it = files_.begin(); it != files_.end(); ++it)
+      {
+         if (it->first == id)
+         {
+            // move to the front
+            files_.splice(files_.begin(), files_, it);
+            return files_.front().second;
+         }
+      }
+      return boost::shared_ptr<LargeFile>();
+   }
+
+private:
+   typedef std::list<std::pair<std::string, boost::shared_ptr<LargeFile> > >
+                                                                     Entries;
+   Entries files_;
+};
+
+ViewedFileStore& viewedFiles()
+{
+   static ViewedFileStore instance;
+   return instance;
+}
+
+Error windowAsJson(LargeFile* pFile,
+                   int firstLine,
+                   int lineCount,
+                   json::Object* pWindow)
+{
+   firstLine = std::max(firstLine, 0);
+   lineCount = std::max(std::min(lineCount, kMaxWindowLines), 0);
+
+   std::vector<std::string> lines;
+   Error error = pFile->readLines(firstLine, lineCount, &lines);
+   if (error)
+      return error;
+
+   json::Array linesJson;
+   std::copy(lines.begin(), lines.end(), std::back_inserter(linesJson));
+
+   (*pWindow)["totalLines"] = pFile->lineCount();
+   (*pWindow)["line"] = firstLine;
+   (*pWindow)["lines"] = linesJson;
+   return Success();
+}
+
+// serve windows of viewed files to the file viewer page
+void handleFileLinesRequest(const http::Request& request,
+                            http::Response* pResponse)
+{
+   json::Object resultJson;
+
+   boost::shared_ptr<LargeFile> pFile =
+                           viewedFiles().find(request.queryParamValue("id"));
+   if (pFile)
+   {
+      Error error = pFile->ensureCurrent();
+      if (!error)
+      {
+         error = windowAsJson(pFile.get(),
+                              request.queryParamValue("line", 0),
+                              request.queryParamValue("n", kInitialLines),
+                              &resultJson);
+      }
+      if (error)
+      {
+         LOG_ERROR(error);
+         resultJson["error"] = error.summary();
+      }
+   }
+   else
+   {
+      resultJson["error"] = std::string("This file is no longer available "
+                                        "(open it again to see all of it)");
+   }
+
+   std::ostringstream ostr;
+   json::write(resultJson, ostr);
+   pResponse->setNoCacheHeaders();
+   pResponse->setContentType("application/json");
+   pResponse->setBody(ostr.str());
+}
+
+Error viewLargeFile(const json::JsonRpcRequest& request,
+                    json::JsonRpcResponse* pResponse)
+{
+   std::string path, encoding;
+   Error error = json::readParams(request.params, &path, &encoding);
+   if (error)
+      return error;
+
+   FilePath filePath = module_context::resolveAliasedPath(path);
+   if (!filePath.exists())
+   {
+      return systemError(boost::system::errc::no_such_file_or_directory,
+                         ERROR_LOCATION);
+   }
+
+   if (!module_context::isTextFile(filePath))
+   {
+      Error error = systemError(boost::system::errc::illegal_byte_sequence,
+                                ERROR_LOCATION);
+      pResponse->setError(error, "File is binary rather than text so cannot "
+                                 "be viewed.");
+      return Success();
+   }
+
+   boost::shared_ptr<LargeFile> pFile(new LargeFile(filePath, encoding));
+   error = pFile->open();
+   if (error)
+      return error;
+   std::string id = viewedFiles().add(pFile);
+
+   // render the initial window into the page
+   json::Object initialJson;
+   error = windowAsJson(pFile.get(), 0, kInitialLines, &initialJson);
+   if (error)
+      return error;
+
+   json::Object configJson;
+   configJson["id"] = id;
+   configJson["url"] = std::string("file_lines");
+   configJson["maxLines"] = kMaxWindowLines;
+   configJson["initial"] = initialJson;
+   std::ostringstream ostr;
+   json::write(configJson, ostr);
+   std::string config = boost::algorithm::replace_all_copy(ostr.str(),
+                                                           "</", "<\\/");
+
+   std::string title = filePath.filename();
+   boost::format htmlFmt(
+      "<html>\n"
+      "  <head>\n"
+      "     <title>%1%</title>\n"
+      "     <meta charset=\"utf-8\"/>\n"
+      "     <link rel=\"stylesheet\" type=\"text/css\" href=\"css/fileviewer.css\"/>\n"
+      "     <script type=\"text/javascript\" src=\"js/fileviewer.js\"></script>\n"
+      "  </head>\n"
+      "  <body>\n"
+      "     <div id=\"viewer\"></div>\n"
+      "     <script type=\"text/javascript\">\n"
+      "        fileViewer.init(document.getElementById('viewer'), %2%);\n"
+      "     </script>\n"
+      "  </body>\n"
+      "</html>\n");
+   std::string html = boost::str(htmlFmt %
+                                 string_utils::textToHtml(title) %
+                                 config);
+
+   json::Object contentItem;
+   contentItem["title"] = title;
+   contentItem["contentUrl"] = content_urls::provision(title, html, ".htm");
+   ClientEvent event(client_events::kShowContent, contentItem);
+   module_context::enqueClientEvent(event);
+
+   return Success();
+}
+
+} // anonymous namespace
+
+Error initialize()
+{
+   using boost::bind;
+   using namespace session::module_context;
+   ExecBlock initBlock ;
+   initBlock.addFunctions()
+      (bind(registerUriHandler, "/file_lines", handleFileLinesRequest))
+      (bind(registerRpcMethod, "view_large_file", viewLargeFile));
+
+   return initBlock.execute();
+}
+
+
+} // namespace large_files
+} // namespace modules
+} // namesapce session
@@ -104,7 +104,6 @@ Error writeList(const std::string& name, const T& list)
    return writeCollectionToFile<T>(listPath(name), list, stringifyString);
 }
 
-
 json::Array listToJson(const std::list<std::string>& list)
 {
    json::Array jsonArray;
@@ -115,29 +114,172 @@ json::Array listToJson(const std::list<std::string>& list)
    return jsonArray;
 }
 
-void onListsFileChanged(const core::system::FileChangeEvent& fileChange)
+bool isListNameValid(const std::string& name)
 {
-   // ignore if deleted
-   if (fileChange.type() == core::system::FileChangeEvent::FileRemoved)
-      return;
+   return s_lists.find(name) != s_lists.end();
+}
 
-   // ignore if it is the lists directory
-   if (fileChange.fileInfo().absolutePath() == s_listsPath.absolutePath())
+// Changes to a list are appended to its change log (and applied to our
+// in-memory copy) rather than rewriting the whole list. Other sessions are
+// notified of the change by the lists directory monitor and apply just the
+// entries they haven't seen yet. Once the log gets long it is compacted
+// into the list file.
+const char * const kLogExtension = ".log";
+
+// log entries written before the log is compacted into its list
+const std::size_t kMaxLogEntries = 100;
+
+// change log operations (each entry is the operation followed by its value)
+const char kPrependOp = '+';
+const char kAppendOp = '>';
+const char kRemoveOp = '-';
+const char kClearOp = '!';
+
+struct ListState
+{
+   ListState()
+      : loaded(false), logOffset(0), logEntries(0), compactPending(false)
+   {
+   }
+   bool loaded;
+   std::list<std::string> items;
+   uintmax_t logOffset;       // bytes of the change log already applied
+   std::size_t logEntries;
+   bool compactPending;
+};
+
+typedef std::map<std::string, ListState> ListStates;
+ListStates s_listStates;
+
+FilePath listLogPath(const std::string& name)
+{
+   return s_listsPath.complete(name + kLogExtension);
+}
+
+void applyLogEntry(const std::string& entry,
+                   std::size_t maxSize,
+                   std::list<std::string>* pList)
+{
+   if (entry.empty())
       return;
 
-   // get the name of the list
-   FilePath filePath(fileChange.fileInfo().absolutePath());
-   std::string name = filePath.filename();
+   char op = entry[0];
+   std::string value = entry.substr(1);
+   switch(op)
+   {
+      case kPrependOp:
+         pList->remove(value);
+         while (!pList->empty() && pList->size() >= maxSize)
+            pList->pop_back();
+         pList->push_front(value);
+         break;
+      case kAppendOp:
+         pList->remove(value);
+         while (!pList->empty() && pList->size() >= maxSize)
+            pList->pop_front();
+         pList->push_back(value);
+         break;
+      case kRemoveOp:
+         pList->remove(value);
+         break;
+      case kClearOp:
+         pList->clear();
+         break;
+      default:
+         LOG_WARNING_MESSAGE("Unexpected list log entry: " + entry);
+         break;
+   }
+}
 
-   // read it
-   std::list<std::string> list;
-   Error error = readList(name, &list);
+Error loadList(const std::string& name, ListState* pState);
+
+// apply the entries which have been added to the change log since we last
+// looked at it
+Error applyLogTail(const std::string& name, ListState* pState)
+{
+   FilePath logPath = listLogPath(name);
+   uintmax_t logSize = logPath.exists() ? logPath.size() : 0;
+
+   // the log was compacted by another session (start over from the list)
+   if (logSize < pState->logOffset)
+      return loadList(name, pState);
+
+   if (logSize == pState->logOffset)
+      return Success();
+
+   boost::shared_ptr<std::istream> pStream;
+   Error error = logPath.open_r(&pStream);
    if (error)
+      return error;
+
+   std::string tail;
+   try
    {
-      LOG_ERROR(error);
-      return;
+      pStream->seekg(pState->logOffset);
+      tail.resize(logSize - pState->logOffset);
+      pStream->read(&tail[0], tail.size());
+      tail.resize(pStream->gcount());
+   }
+   catch(const std::exception& e)
+   {
+      error = systemError(boost::system::errc::io_error, ERROR_LOCATION);
+      error.addProperty("what", e.what());
+      error.addProperty("path", logPath.absolutePath());
+      return error;
    }
 
+   // apply complete entries only (the rest may still be being written)
+   std::size_t maxSize = listSize(name.c_str());
+   std::string::size_type begin = 0, end;
+   while ((end = tail.find('\n', begin)) != std::string::npos)
+   {
+      applyLogEntry(tail.substr(begin, end - begin), maxSize, &pState->items);
+      pState->logEntries++;
+      begin = end + 1;
+   }
+   pState->logOffset += begin;
+
+   return Success();
+}
+
+// (re)load a list from its file and change log
+Error loadList(const std::string& name, ListState* pState)
+{
+   Error error = readList(name, &pState->items);
+   if (error)
+      return error;
+
+   pState->loaded = true;
+   pState->logOffset = 0;
+   pState->logEntries = 0;
+   return applyLogTail(name, pState);
+}
+
+Error getListState(const std::string& name, ListState** ppState)
+{
+   if (!isListNameValid(name))
+   {
+      Error error = systemError(boost::system::errc::invalid_argument,
+                                ERROR_LOCATION);
+      error.addProperty("name", name);
+      return error;
+   }
+
+   ListState& state = s_listStates[name];
+   if (!state.loaded)
+   {
+      Error error = loadList(name, &state);
+      if (error)
+         return error;
+   }
+
+   *ppState = &state;
+   return Success();
+}
+
+void enqueListChanged(const std::string& name,
+                      const std::list<std::string>& list)
+{
    json::Object eventJson;
    eventJson["name"] = name;
    eventJson["list"] = listToJson(list);
@@ -146,46 +288,134 @@ void onListsFileChanged(const core::system::FileChangeEvent& fileChange)
    module_context::enqueClientEvent(event);
 }
 
-bool isListNameValid(const std::string& name)
+// replace the list's file with its current contents and empty its log
+Error writeListState(const std::string& name, ListState* pState)
 {
-   return listSize(name.c_str()) > 0;
+   Error error = writeList(name, pState->items);
+   if (error)
+      return error;
+
+   error = writeStringToFile(listLogPath(name), std::string());
+   if (error)
+      return error;
+
+   pState->logOffset = 0;
+   pState->logEntries = 0;
+   return Success();
 }
 
-Error getListName(const json::JsonRpcRequest& request, std::string* pName)
+void compactList(const std::string& name)
 {
-   Error error = json::readParam(request.params, 0, pName);
+   ListState* pState = NULL;
+   Error error = getListState(name, &pState);
+   if (!error)
+   {
+      pState->compactPending = false;
+      error = applyLogTail(name, pState);
+   }
+   if (!error)
+      error = writeListState(name, pState);
+   if (error)
+      LOG_ERROR(error);
+}
+
+Error changeList(const std::string& name,
+                 char op,
+                 const std::string& value)
+{
+   ListState* pState = NULL;
+   Error error = getListState(name, &pState);
    if (error)
       return error;
 
-   if (!isListNameValid(*pName))
-      return Error(json::errc::ParamInvalid, ERROR_LOCATION);
-   else
-      return Success();
+   // append the change then apply the log (so that our copy reflects the
+   // order of any changes which other sessions made concurrently)
+   std::string entry = op + value + "\n";
+   error = appendToFile(listLogPath(name), entry);
+   if (error)
+      return error;
+   error = applyLogTail(name, pState);
+   if (error)
+      return error;
+
+   enqueListChanged(name, pState->items);
+
+   // compact long logs (deferred so that bursts of changes share a write)
+   if (pState->logEntries >= kMaxLogEntries && !pState->compactPending)
+   {
+      pState->compactPending = true;
+      module_context::scheduleDelayedWork(boost::posix_time::seconds(5),
+                                          boost::bind(compactList, name));
+   }
+
+   return Success();
 }
 
+void onListsFileChanged(const core::system::FileChangeEvent& fileChange)
+{
+   // ignore if it is the lists directory
+   if (fileChange.fileInfo().absolutePath() == s_listsPath.absolutePath())
+      return;
 
-Error getListNameAndContents(const json::JsonRpcRequest& request,
-                             std::string* pName,
-                             std::list<std::string>* pList)
+   // get the name of the list (and whether it is the list's change log)
+   FilePath filePath(fileChange.fileInfo().absolutePath());
+   bool isLog = filePath.extension() == kLogExtension;
+   std::string name = isLog ? filePath.stem() : filePath.filename();
+   if (!isListNameValid(name))
+      return;
+
+   // ignore removal of lists (their logs are just treated as empty)
+   if (fileChange.type() == core::system::FileChangeEvent::FileRemoved &&
+       !isLog)
+   {
+      return;
+   }
+
+   // lists we haven't loaded yet are read in full, otherwise we apply
+   // just what has changed
+   ListState& state = s_listStates[name];
+   std::list<std::string> previous = state.items;
+   bool wasLoaded = state.loaded;
+   Error error = (wasLoaded && isLog) ? applyLogTail(name, &state) :
+                                        loadList(name, &state);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return;
+   }
+
+   // notify the client (our own changes have already been applied so they
+   // don't result in a second notification)
+   if (!wasLoaded || state.items != previous)
+      enqueListChanged(name, state.items);
+}
+
+Error getListName(const json::JsonRpcRequest& request, std::string* pName)
 {
-   Error error = getListName(request, pName);
+   Error error = json::readParam(request.params, 0, pName);
    if (error)
       return error;
 
-   return readList(*pName, pList);
+   if (!isListNameValid(*pName))
+      return Error(json::errc::ParamInvalid, ERROR_LOCATION);
+   else
+      return Success();
 }
 
-
 Error listGet(const json::JsonRpcRequest& request,
               json::JsonRpcResponse* pResponse)
 {
    std::string name;
-   std::list<std::string> list;
-   Error error = getListNameAndContents(request, &name, &list);
+   Error error = getListName(request, &name);
+   if (error)
+      return error;
+
+   ListState* pState = NULL;
+   error = getListState(name, &pState);
    if (error)
       return error;
 
-   pResponse->setResult(listToJson(list));
+   pResponse->setResult(listToJson(pState->items));
 
    return Success();
 }
@@ -199,6 +429,11 @@ Error listSetContents(const json::JsonRpcRequest& request,
    if (error)
       return error;
 
+   ListState* pState = NULL;
+   error = getListState(name, &pState);
+   if (error)
+      return error;
+
    std::list<std::string> list;
    BOOST_FOREACH(const json::Value& val, jsonList)
    {
@@ -211,81 +446,49 @@ Error listSetContents(const json::JsonRpcRequest& request,
       list.push_back(val.get_str());
    }
 
-   return writeList(name, list);
+   // replacing the contents is written out in full
+   pState->items = list;
+   error = writeListState(name, pState);
+   if (error)
+      return error;
+
+   enqueListChanged(name, pState->items);
+   return Success();
 }
 
-Error listInsertItem(bool prepend,
+Error listChangeItem(char op,
                      const json::JsonRpcRequest& request,
                      json::JsonRpcResponse* pResponse)
 {
-   // get params and other context
    std::string name, value;
-   std::list<std::string> list;
-   std::size_t maxSize;
-   Error error = getListNameAndContents(request, &name, &list);
+   Error error = getListName(request, &name);
    if (error)
       return error;
    error = json::readParam(request.params, 1, &value);
    if (error)
       return error;
-   maxSize = listSize(name.c_str());
-
-   // remove any existing item with this value
-   list.remove(value);
-
-   // enforce size constraints
-   while (list.size() >= maxSize)
-   {
-      if (prepend)
-         list.pop_back();
-      else
-         list.pop_front();
-   }
 
-   // do the insert
-   if (prepend)
-      list.push_front(value);
-   else
-      list.push_back(value);
-
-   // update the list
-   return writeList(name, list);
+   return changeList(name, op, value);
 }
 
-
 Error listPrependItem(const json::JsonRpcRequest& request,
                       json::JsonRpcResponse* pResponse)
 {
-   return listInsertItem(true, request, pResponse);
+   return listChangeItem(kPrependOp, request, pResponse);
 }
 
 
 Error listAppendItem(const json::JsonRpcRequest& request,
                      json::JsonRpcResponse* pResponse)
 {
-   return listInsertItem(false, request, pResponse);
+   return listChangeItem(kAppendOp, request, pResponse);
 }
 
 
 Error listRemoveItem(const json::JsonRpcRequest& request,
                      json::JsonRpcResponse* pResponse)
 {
-   // get list name and contents
-   std::string name;
-   std::list<std::string> list;
-   Error error = getListNameAndContents(request, &name, &list);
-   if (error)
-      return error;
-
-   // get value to remove
-   std::string value;
-   error = json::readParam(request.params, 1, &value);
-
-   // remove it
-   list.remove(value);
-
-   // update the list
-   return writeList(name, list);
+   return listChangeItem(kRemoveOp, request, pResponse);
 }
 
 Error listClear(const json::JsonRpcRequest& request,
@@ -297,8 +500,19 @@ Error listClear(const json::JsonRpcRequest& request,
    if (error)
       return error;
 
-   // write empty list
-   return writeList(name, std::list<std::string>());
+   return changeList(name, kClearOp, std::string());
+}
+
+void onShutdown(bool)
+{
+   // compact any logs which were waiting to be
+   for (ListStates::iterator it = s_listStates.begin();
+        it != s_listStates.end();
+        ++it)
+   {
+      if (it->second.compactPending)
+         compactList(it->first);
+   }
 }
 
 } // anonymous namespace
@@ -309,12 +523,16 @@ json::Object allListsAsJson()
    json::Object allListsJson;
    for (Lists::const_iterator it = s_lists.begin(); it != s_lists.end(); ++it)
    {
-      std::list<std::string> list;
-      Error error = readList(it->first, &list);
+      ListState* pState = NULL;
+      Error error = getListState(it->first, &pState);
       if (error)
+      {
          LOG_ERROR(error);
+         allListsJson[it->first] = json::Array();
+         continue;
+      }
 
-      allListsJson[it->first] = listToJson(list);
+      allListsJson[it->first] = listToJson(pState->items);
    }
 
    return allListsJson;
@@ -333,6 +551,8 @@ Error initialize()
                                                       "lists",
                                                       onListsFileChanged);
 
+   module_context::events().onShutdown.connect(onShutdown);
+
    using boost::bind;
    using namespace module_context;
    ExecBlock initBlock ;
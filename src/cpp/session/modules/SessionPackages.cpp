@@ -20,20 +20,40 @@
 
 #include "SessionPackages.hpp"
 
+#include <set>
+#include <map>
+#include <ctime>
+#include <algorithm>
+
 #include <boost/bind.hpp>
 #include <boost/regex.hpp>
+#include <boost/foreach.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
 
 #include <core/Error.hpp>
 #include <core/Exec.hpp>
+#include <core/Log.hpp>
+#include <core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/Hash.hpp>
+#include <core/SafeConvert.hpp>
+#include <core/StringUtils.hpp>
+#include <core/system/System.hpp>
+#include <core/r_util/RPackageInfo.hpp>
+#include <core/r_util/RRepositoryIndex.hpp>
 #include <core/http/URL.hpp>
 #include <core/http/TcpIpBlockingClient.hpp>
 
+#define R_INTERNAL_FUNCTIONS
+#include <r/RInternal.hpp>
 #include <r/RSexp.hpp>
 #include <r/RExec.hpp>
 #include <r/RFunctionHook.hpp>
 #include <r/RRoutines.hpp>
 
 #include <session/SessionModuleContext.hpp>
+#include <session/SessionOptions.hpp>
 
 #include "config.h"
 
@@ -102,6 +122,30 @@ private:
    std::map<std::string, std::vector<std::string> > cache_;
 };
 
+// read the index of a repository which rserver shares between sessions
+// (returns false if the repository isn't indexed)
+bool readSharedRepositoryIndex(const std::string& contribUrl,
+                               r_util::RRepositoryIndex* pIndex)
+{
+   FilePath indexDir = session::options().reposIndexDir();
+   if (indexDir.empty())
+      return false;
+
+   FilePath indexFile = indexDir.complete(
+                           r_util::repositoryIndexFilename(contribUrl));
+   if (!indexFile.exists())
+      return false;
+
+   Error error = pIndex->readFromFile(indexFile);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return false;
+   }
+
+   return !pIndex->empty();
+}
+
 void downloadAvailablePackages(const std::string& contribUrl,
                                std::vector<std::string>* pAvailablePackages)
 {
@@ -118,6 +162,20 @@ void downloadAvailablePackages(const std::string& contribUrl,
       return;
    }
 
+   // use the shared index if there is one (Package is its first field)
+   r_util::RRepositoryIndex index;
+   if (readSharedRepositoryIndex(contribUrl, &index))
+   {
+      std::vector<std::string> results;
+      BOOST_FOREACH(const std::vector<std::string>& package, index.packages())
+      {
+         results.push_back(package[0]);
+         pAvailablePackages->push_back(package[0]);
+      }
+      s_availablePackagesCache.insert(contribUrl, results);
+      return;
+   }
+
    http::URL url(contribUrl + "/PACKAGES");
    http::Request pkgRequest;
    pkgRequest.setMethod("GET");
@@ -179,6 +237,246 @@ Error availablePackagesEnd(const core::json::JsonRpcRequest& request,
    return Success();
 }
 
+// installed packages are listed from an index of each library rather than
+// by having R scan (and parse the DESCRIPTION of) every package each time
+// the packages pane is refreshed. a library is only rescanned when the
+// modification time of its directory changes (as it does when packages
+// are installed or removed) and within a rescan only packages whose
+// directory changed are re-read. the index of each library is persisted
+// within the user scratch path so it is shared across sessions.
+struct InstalledPackage
+{
+   InstalledPackage() : dirTime(0) {}
+   std::string name;
+   std::string version;
+   std::string title;
+   std::time_t dirTime;
+};
+
+struct PackageLibrary
+{
+   PackageLibrary() : loaded(false), dirTime(0) {}
+   bool loaded;
+   std::time_t dirTime;
+   std::vector<InstalledPackage> packages;
+};
+
+// first line of persisted library indexes (bump when the format changes)
+const char * const kPackageIndexFormat = "package-index-1";
+
+std::map<std::string, PackageLibrary> s_packageLibraries;
+
+FilePath packageIndexPath(const std::string& libPath)
+{
+   return module_context::userScratchPath().complete("package_index")
+                                 .childPath(hash::xxHash64(libPath));
+}
+
+// persisted format:
+//
+//   <format>
+//   <library dir time>
+//   <name><tab><version><tab><package dir time><tab><title>
+//   ...
+void loadPackageIndex(const std::string& libPath, PackageLibrary* pLibrary)
+{
+   FilePath indexPath = packageIndexPath(libPath);
+   if (!indexPath.exists())
+      return;
+
+   std::vector<std::string> lines;
+   Error error = readStringVectorFromFile(indexPath, &lines, false);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return;
+   }
+   if (lines.size() < 2 || lines[0] != kPackageIndexFormat)
+      return;
+
+   std::vector<InstalledPackage> packages;
+   for (std::size_t i = 2; i < lines.size(); i++)
+   {
+      if (lines[i].empty())
+         continue;
+
+      std::vector<std::string> fields;
+      boost::algorithm::split(fields, lines[i],
+                              boost::algorithm::is_any_of("\t"));
+      if (fields.size() != 4)
+         return;
+
+      InstalledPackage package;
+      package.name = fields[0];
+      package.version = fields[1];
+      package.dirTime = safe_convert::stringTo<std::time_t>(fields[2], 0);
+      package.title = fields[3];
+      packages.push_back(package);
+   }
+
+   pLibrary->dirTime = safe_convert::stringTo<std::time_t>(lines[1], 0);
+   pLibrary->packages.swap(packages);
+}
+
+void savePackageIndex(const std::string& libPath,
+                      const PackageLibrary& library)
+{
+   std::string index(kPackageIndexFormat);
+   index.append("\n" + safe_convert::numberToString(library.dirTime) + "\n");
+   BOOST_FOREACH(const InstalledPackage& package, library.packages)
+   {
+      index.append(package.name + "\t" +
+                   package.version + "\t" +
+                   safe_convert::numberToString(package.dirTime) + "\t" +
+                   package.title + "\n");
+   }
+
+   // write to a temporary file and then move it into place so that other
+   // sessions never read a partially written index
+   FilePath indexPath = packageIndexPath(libPath);
+   Error error = indexPath.parent().ensureDirectory();
+   if (error)
+   {
+      LOG_ERROR(error);
+      return;
+   }
+   FilePath tempPath(indexPath.absolutePath() + "." +
+                     core::system::generateUuid(false));
+   error = writeStringToFile(tempPath, index);
+   if (!error)
+      error = tempPath.move(indexPath);
+   if (error)
+      LOG_ERROR(error);
+}
+
+bool readInstalledPackage(const FilePath& packageDir,
+                          InstalledPackage* pPackage)
+{
+   // only consider installed packages (not e.g. 00LOCK directories or
+   // the remains of a failed install)
+   if (!packageDir.childPath("Meta/package.rds").exists())
+      return false;
+
+   r_util::RPackageInfo pkgInfo;
+   Error error = pkgInfo.read(packageDir);
+   if (error)
+      return false;
+
+   pPackage->name = pkgInfo.name();
+   pPackage->version = pkgInfo.version();
+
+   // keep the title on one line (and out of our tab delimited index)
+   pPackage->title = pkgInfo.title();
+   std::replace(pPackage->title.begin(), pPackage->title.end(), '\t', ' ');
+   std::replace(pPackage->title.begin(), pPackage->title.end(), '\n', ' ');
+   return true;
+}
+
+void updatePackageLibrary(const std::string& libPath, PackageLibrary* pLibrary)
+{
+   if (!pLibrary->loaded)
+   {
+      loadPackageIndex(libPath, pLibrary);
+      pLibrary->loaded = true;
+   }
+
+   FilePath libDir(string_utils::systemToUtf8(libPath));
+   std::time_t dirTime = libDir.lastWriteTime();
+   if (dirTime == pLibrary->dirTime)
+      return;
+
+   std::map<std::string, InstalledPackage> previous;
+   BOOST_FOREACH(const InstalledPackage& package, pLibrary->packages)
+      previous[package.name] = package;
+
+   std::vector<FilePath> children;
+   Error error = libDir.children(&children);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return;
+   }
+
+   std::vector<InstalledPackage> packages;
+   BOOST_FOREACH(const FilePath& packageDir, children)
+   {
+      if (!packageDir.isDirectory())
+         continue;
+
+      InstalledPackage package;
+      package.dirTime = packageDir.lastWriteTime();
+
+      std::map<std::string, InstalledPackage>::const_iterator it =
+                                          previous.find(packageDir.filename());
+      if (it != previous.end() && it->second.dirTime == package.dirTime)
+         packages.push_back(it->second);
+      else if (readInstalledPackage(packageDir, &package))
+         packages.push_back(package);
+   }
+
+   pLibrary->dirTime = dirTime;
+   pLibrary->packages.swap(packages);
+   savePackageIndex(libPath, *pLibrary);
+}
+
+bool comparePackageNames(const json::Value& lhs, const json::Value& rhs)
+{
+   std::string lhsName = lhs.get_obj().find("name")->second.get_str();
+   std::string rhsName = rhs.get_obj().find("name")->second.get_str();
+   std::string lhsLower = string_utils::toLower(lhsName);
+   std::string rhsLower = string_utils::toLower(rhsName);
+   if (lhsLower != rhsLower)
+      return lhsLower < rhsLower;
+   else
+      return lhsName < rhsName;
+}
+
+Error listPackages(const json::JsonRpcRequest& request,
+                   json::JsonRpcResponse* pResponse)
+{
+   std::vector<std::string> libPaths;
+   Error error = r::exec::RFunction(".rs.uniqueLibraryPaths").call(&libPaths);
+   if (error)
+      return error;
+
+   // paths of loaded packages (library/name)
+   std::vector<std::string> loadedPaths;
+   error = r::exec::RFunction(".rs.pathPackage").call(&loadedPaths);
+   if (error)
+      return error;
+   std::set<std::string> loaded(loadedPaths.begin(), loadedPaths.end());
+
+   json::Array packagesJson;
+   BOOST_FOREACH(const std::string& libPath, libPaths)
+   {
+      PackageLibrary& library = s_packageLibraries[libPath];
+      updatePackageLibrary(libPath, &library);
+
+      std::string libPathUtf8 = string_utils::systemToUtf8(libPath);
+      BOOST_FOREACH(const InstalledPackage& package, library.packages)
+      {
+         if (package.name == "base")
+            continue;
+
+         json::Object packageJson;
+         packageJson["name"] = package.name;
+         packageJson["library"] = libPathUtf8;
+         packageJson["version"] = package.version;
+         packageJson["desc"] = package.title;
+         packageJson["url"] = "help/library/" + package.name +
+                              "/html/00Index.html";
+         packageJson["loaded"] =
+               loaded.find(libPath + "/" + package.name) != loaded.end();
+         packagesJson.push_back(packageJson);
+      }
+   }
+
+   std::stable_sort(packagesJson.begin(), packagesJson.end(),
+                    comparePackageNames);
+   pResponse->setResult(packagesJson);
+   return Success();
+}
+
 SEXP rs_enqueLoadedPackageUpdates(SEXP installCmdSEXP)
 {
    std::string installCmd;
@@ -191,6 +489,57 @@ SEXP rs_enqueLoadedPackageUpdates(SEXP installCmdSEXP)
    return R_NilValue;
 }
 
+// shared index of a repository as list(fields, values) where values holds
+// the fields of each package in turn (NULL if the repository isn't indexed)
+SEXP rs_repositoryIndex(SEXP contribUrlSEXP)
+{
+   try
+   {
+      r_util::RRepositoryIndex index;
+      if (!readSharedRepositoryIndex(r::sexp::asString(contribUrlSEXP),
+                                     &index))
+      {
+         return R_NilValue;
+      }
+
+      const std::vector<std::string>& fields = index.fields();
+      const std::vector<std::vector<std::string> >& packages =
+                                                         index.packages();
+
+      r::sexp::Protect rProtect;
+      SEXP valuesSEXP = Rf_allocVector(STRSXP,
+                                       packages.size() * fields.size());
+      rProtect.add(valuesSEXP);
+      std::size_t elt = 0;
+      for (std::size_t i = 0; i < packages.size(); i++)
+      {
+         for (std::size_t j = 0; j < fields.size(); j++)
+         {
+            const std::string& value = packages[i][j];
+            SET_STRING_ELT(valuesSEXP, elt++, Rf_mkCharLenCE(value.data(),
+                                                             value.size(),
+                                                             CE_NATIVE));
+         }
+      }
+
+      SEXP indexSEXP = Rf_allocVector(VECSXP, 2);
+      rProtect.add(indexSEXP);
+      SET_VECTOR_ELT(indexSEXP, 0, r::sexp::create(fields, &rProtect));
+      SET_VECTOR_ELT(indexSEXP, 1, valuesSEXP);
+
+      SEXP namesSEXP = Rf_allocVector(STRSXP, 2);
+      rProtect.add(namesSEXP);
+      SET_STRING_ELT(namesSEXP, 0, Rf_mkChar("fields"));
+      SET_STRING_ELT(namesSEXP, 1, Rf_mkChar("values"));
+      Rf_setAttrib(indexSEXP, R_NamesSymbol, namesSEXP);
+
+      return indexSEXP;
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+
+   return R_NilValue;
+}
+
 void initializeRStudioPackages(bool newSession)
 {
    if (newSession)
@@ -212,6 +561,39 @@ void initializeRStudioPackages(bool newSession)
 
 } // anonymous namespace
 
+bool repositoryIndex(const std::string& contribUrl,
+                     r_util::RRepositoryIndex* pIndex)
+{
+   if (readSharedRepositoryIndex(contribUrl, pIndex))
+      return true;
+
+   http::URL url(contribUrl + "/PACKAGES");
+   http::Request pkgRequest;
+   pkgRequest.setMethod("GET");
+   pkgRequest.setHost(url.hostname());
+   pkgRequest.setUri(url.path());
+   pkgRequest.setHeader("Accept", "*/*");
+   pkgRequest.setHeader("Connection", "close");
+   http::Response pkgResponse;
+
+   // (as above failures are expected so aren't logged)
+   Error error = http::sendRequest(url.hostname(),
+                                   safe_convert::numberToString(url.port()),
+                                   pkgRequest,
+                                   &pkgResponse);
+   if (error || (pkgResponse.statusCode() != 200))
+      return false;
+
+   error = pIndex->parse(pkgResponse.body());
+   if (error)
+   {
+      LOG_ERROR(error);
+      return false;
+   }
+
+   return !pIndex->empty();
+}
+
 Error initialize()
 {
    // register deferred init
@@ -224,6 +606,12 @@ Error initialize()
    methodDef.numArgs = 1;
    r::routines::addCallMethod(methodDef);
 
+   R_CallMethodDef repositoryIndexMethodDef ;
+   repositoryIndexMethodDef.name = "rs_repositoryIndex" ;
+   repositoryIndexMethodDef.fun = (DL_FUNC) rs_repositoryIndex ;
+   repositoryIndexMethodDef.numArgs = 1;
+   r::routines::addCallMethod(repositoryIndexMethodDef);
+
    using boost::bind;
    using namespace module_context;
    ExecBlock initBlock ;
@@ -232,6 +620,7 @@ Error initialize()
             "available_packages",
             availablePackagesBegin,
             availablePackagesEnd))
+      (bind(registerRpcMethod, "list_packages", listPackages))
       (bind(sourceModuleRFile, "SessionPackages.R"))
       (bind(r::exec::executeString, ".rs.packages.initialize()"));
    return initBlock.execute();
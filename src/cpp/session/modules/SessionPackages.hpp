@@ -16,13 +16,24 @@
 #ifndef SESSION_PACKAGES_HPP
 #define SESSION_PACKAGES_HPP
 
+#include <string>
+
 namespace core {
    class Error;
+   namespace r_util {
+      class RRepositoryIndex;
+   }
 }
  
 namespace session {
 namespace modules { 
 namespace packages {
+
+// read the index of the packages available from a repository (the index
+// rserver shares between sessions if there is one, otherwise the PACKAGES
+// file under the contrib url). returns false if it can't be read
+bool repositoryIndex(const std::string& contribUrl,
+                     core::r_util::RRepositoryIndex* pIndex);
    
 core::Error initialize();
                        
@@ -15,7 +15,12 @@
 
 #include "SessionPlots.hpp"
 
+#include <deque>
+
 #include <boost/format.hpp>
+#include <boost/utility.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
 #include <boost/iostreams/filter/regex.hpp>
 
 #include <core/Error.hpp>
@@ -24,8 +29,10 @@
 #include <core/Predicate.hpp>
 #include <core/FilePath.hpp>
 #include <core/BoostErrors.hpp>
+#include <core/BoostThread.hpp>
 #include <core/FileSerializer.hpp>
 
+#include <core/system/Process.hpp>
 #include <core/system/Environment.hpp>
 
 #include <core/text/TemplateFilter.hpp>
@@ -38,6 +45,7 @@
 #include <r/RRoutines.hpp>
 #include <r/session/RGraphics.hpp>
 
+#include <session/SessionOptions.hpp>
 #include <session/SessionModuleContext.hpp>
 
 using namespace core;
@@ -354,6 +362,255 @@ Error getSavePlotContext(const json::JsonRpcRequest& request,
    return Success();
 }
    
+void renderGraphicsOutput(bool activatePlots, bool showManipulator);
+
+// Exports plots from the history by replaying copies of their snapshots in
+// child R processes (one per core) so that the console isn't blocked.
+// Progress is reported to the client via plots_export_status events.
+class PlotsExport : boost::noncopyable,
+                    public boost::enable_shared_from_this<PlotsExport>
+{
+public:
+   static boost::shared_ptr<PlotsExport> create()
+   {
+      return boost::shared_ptr<PlotsExport>(new PlotsExport());
+   }
+
+   bool isRunning() const { return running_ > 0 || !pending_.empty(); }
+
+   Error start(const FilePath& directoryPath,
+               const std::string& stem,
+               const std::string& format,
+               int width,
+               int height)
+   {
+      format_ = format;
+      width_ = width;
+      height_ = height;
+
+      // copy the snapshots so that the plots can change during the export
+      workingDir_ = module_context::tempFile("plotsexport", "dir");
+      Error error = workingDir_.ensureDirectory();
+      if (error)
+         return error;
+
+      r::session::graphics::Display& display = r::session::graphics::display();
+      for (int i = 0; i < display.plotCount(); i++)
+      {
+         FilePath snapshotFile;
+         Error error = display.plotSnapshotFile(i, &snapshotFile);
+         if (error)
+         {
+            // no snapshot (e.g. a plot with nothing drawn on it yet)
+            LOG_ERROR(error);
+            continue;
+         }
+
+         Job job;
+         job.snapshotFile = workingDir_.complete(snapshotFile.filename());
+         error = snapshotFile.copy(job.snapshotFile);
+         if (error)
+            return error;
+
+         boost::format fmt("%1%%2%.%3%");
+         job.targetFile = directoryPath.complete(boost::str(
+               fmt % stem % boost::io::group(std::setfill('0'),
+                                              std::setw(2),
+                                              i + 1) % format));
+         pending_.push_back(job);
+      }
+      total_ = pending_.size();
+
+      // use all available cores
+      int processes = std::max(1,
+                        static_cast<int>(boost::thread::hardware_concurrency()));
+      for (int i = 0; i < processes && !pending_.empty(); i++)
+      {
+         error = runNext();
+         if (error)
+            return error;
+      }
+
+      enqueStatus();
+      return Success();
+   }
+
+private:
+   PlotsExport()
+      : width_(0), height_(0), total_(0), completed_(0), running_(0)
+   {
+   }
+
+   struct Job
+   {
+      FilePath snapshotFile;
+      FilePath targetFile;
+   };
+
+   Error runNext()
+   {
+      Job job = pending_.front();
+      pending_.pop_front();
+
+      FilePath rProgramPath;
+      Error error = module_context::rScriptPath(&rProgramPath);
+      if (error)
+         return error;
+
+      using namespace string_utils;
+      FilePath modulesPath = session::options().modulesRSourcePath();
+      std::string scriptPath = utf8ToSystem(
+                  modulesPath.complete("SessionPlotsExport.R").absolutePath());
+      boost::format fmt("source('%1%'); exportPlot('%2%', '%3%', '%4%', %5%, %6%)");
+      std::string cmd = boost::str(fmt %
+            jsLiteralEscape(scriptPath) %
+            jsLiteralEscape(utf8ToSystem(job.snapshotFile.absolutePath())) %
+            jsLiteralEscape(utf8ToSystem(job.targetFile.absolutePath())) %
+            jsLiteralEscape(format_) %
+            width_ %
+            height_);
+
+      std::vector<std::string> args;
+      args.push_back("--slave");
+      args.push_back("--vanilla");
+      args.push_back("-e");
+      args.push_back(cmd);
+
+      // allow the child to find packages used by the plots (e.g. lattice)
+      core::system::ProcessOptions options;
+      options.terminateChildren = true;
+      options.workingDir = workingDir_;
+      core::system::Options childEnv;
+      core::system::environment(&childEnv);
+      std::string libPaths = module_context::libPathsString();
+      if (!libPaths.empty())
+         core::system::setenv(&childEnv, "R_LIBS", libPaths);
+      options.environment = childEnv;
+
+      boost::shared_ptr<std::string> pStderr(new std::string());
+      core::system::ProcessCallbacks cb;
+      cb.onStderr = boost::bind(appendOutput, pStderr, _2);
+      cb.onExit = boost::bind(&PlotsExport::onJobExit,
+                              PlotsExport::shared_from_this(),
+                              job,
+                              pStderr,
+                              _1);
+
+      error = module_context::processSupervisor().runProgram(
+                                                rProgramPath.absolutePath(),
+                                                args,
+                                                options,
+                                                cb);
+      if (error)
+         return error;
+
+      running_++;
+      return Success();
+   }
+
+   static void appendOutput(boost::shared_ptr<std::string> pOutput,
+                            const std::string& output)
+   {
+      pOutput->append(output);
+   }
+
+   void onJobExit(const Job& job,
+                  boost::shared_ptr<std::string> pStderr,
+                  int exitStatus)
+   {
+      running_--;
+      completed_++;
+
+      if (exitStatus != EXIT_SUCCESS)
+      {
+         error_ = *pStderr;
+         if (error_.empty())
+            error_ = "Error exporting " + job.targetFile.filename();
+      }
+
+      Error error = job.snapshotFile.removeIfExists();
+      if (error)
+         LOG_ERROR(error);
+
+      if (!pending_.empty())
+      {
+         error = runNext();
+         if (error)
+         {
+            error_ = error.summary();
+            pending_.clear();
+         }
+      }
+
+      if (!isRunning())
+      {
+         error = workingDir_.removeIfExists();
+         if (error)
+            LOG_ERROR(error);
+      }
+
+      enqueStatus();
+   }
+
+   void enqueStatus()
+   {
+      json::Object statusJson;
+      statusJson["completed"] = completed_;
+      statusJson["total"] = total_;
+      statusJson["done"] = !isRunning();
+      statusJson["error"] = error_;
+      ClientEvent event(client_events::kPlotsExportStatus, statusJson);
+      module_context::enqueClientEvent(event);
+   }
+
+private:
+   std::string format_;
+   int width_;
+   int height_;
+   FilePath workingDir_;
+   std::deque<Job> pending_;
+   int total_;
+   int completed_;
+   int running_;
+   std::string error_;
+};
+
+boost::shared_ptr<PlotsExport> s_pPlotsExport;
+
+Error exportPlots(const json::JsonRpcRequest& request,
+                  json::JsonRpcResponse* pResponse)
+{
+   std::string directory, stem, format;
+   int width, height;
+   Error error = json::readParams(request.params,
+                                  &directory,
+                                  &stem,
+                                  &format,
+                                  &width,
+                                  &height);
+   if (error)
+      return error;
+
+   // only one export at a time
+   if (s_pPlotsExport && s_pPlotsExport->isRunning())
+   {
+      return systemError(boost::system::errc::device_or_resource_busy,
+                         ERROR_LOCATION);
+   }
+
+   // make sure the snapshot of the active plot is current
+   using namespace r::session;
+   if (graphics::display().hasChanges())
+      renderGraphicsOutput(false, false);
+
+   s_pPlotsExport = PlotsExport::create();
+   return s_pPlotsExport->start(module_context::resolveAliasedPath(directory),
+                                stem,
+                                format,
+                                width,
+                                height);
+}
+
 template <typename T>
 bool extractSizeParams(const http::Request& request,
                        T min, 
@@ -652,10 +909,30 @@ void onClientInit()
    renderGraphicsOutput(false, false);
 }
 
+bool s_resizeCheckScheduled = false;
+
+void detectChanges(bool activatePlots);
+
+void onResizeCheck()
+{
+   s_resizeCheckScheduled = false;
+   detectChanges(false);
+}
+
 void detectChanges(bool activatePlots)
 {
-   // check for changes
+   // apply any resize which has settled (if the size is still changing
+   // then check back shortly rather than waiting for the next event)
    using namespace r::session;
+   if (graphics::display().applyPendingResize() && !s_resizeCheckScheduled)
+   {
+      s_resizeCheckScheduled = true;
+      module_context::scheduleDelayedWork(boost::posix_time::milliseconds(100),
+                                          onResizeCheck,
+                                          false);
+   }
+
+   // check for changes
    if (graphics::display().hasChanges())
    {
       graphics::display().render(boost::bind(enquePlotsChanged,
@@ -696,12 +973,16 @@ Error setManipulatorValues(const json::JsonRpcRequest& request,
    if (error)
       return error;
 
-   // set them
+   // set them (deferring the replay if newer values are already waiting
+   // to be handled, e.g. while a slider is being dragged)
    using namespace r::session;
-   graphics::display().setPlotManipulatorValues(jsObject);
-
-   // render
-   renderGraphicsOutput(true, false);
+   bool deferReplay =
+         module_context::isNextRpcMethod("set_manipulator_values");
+   if (graphics::display().setPlotManipulatorValues(jsObject, deferReplay))
+   {
+      // render
+      renderGraphicsOutput(true, false);
+   }
 
    return Success();
 }
@@ -777,6 +1058,7 @@ Error initialize()
       (bind(registerRpcMethod, "copy_plot_to_clipboard_metafile", copyPlotToClipboardMetafile))
       (bind(registerRpcMethod, "get_unique_save_plot_stem", getUniqueSavePlotStem))
       (bind(registerRpcMethod, "get_save_plot_context", getSavePlotContext))
+      (bind(registerRpcMethod, "export_plots", exportPlots))
       (bind(registerRpcMethod, "set_manipulator_values", setManipulatorValues))
       (bind(registerRpcMethod, "manipulator_plot_clicked", manipulatorPlotClicked))
       (bind(registerUriHandler, kGraphics "/plot_zoom_png", handleZoomPngRequest))
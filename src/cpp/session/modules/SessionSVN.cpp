@@ -21,6 +21,9 @@
 #include <shlwapi.h>
 #endif
 
+#include <limits>
+#include <map>
+
 #include <boost/algorithm/string.hpp>
 #include <boost/bind.hpp>
 #include <boost/date_time.hpp>
@@ -1139,11 +1142,8 @@ boost::function<bool(const CommitInfo&)> createSearchTextPredicate(
    return boost::bind(commitIsMatch, results, _1);
 }
 
-Error parseHistoryXml(int skip,
-                      int maxentries,
-                      const std::string& searchText,
-                      const std::string& output,
-                      const boost::function<Error(const CommitInfo&)>& callback)
+Error parseHistoryXml(const std::string& output,
+                      std::vector<CommitInfo>* pCommits)
 {
    using namespace rapidxml;
    using namespace boost::posix_time;
@@ -1155,9 +1155,8 @@ Error parseHistoryXml(int skip,
       return error;
 
    xml_node<>* pLog = doc.first_node("log");
-
-   boost::function<bool(const CommitInfo&)> filter =
-         createSearchTextPredicate(searchText);
+   if (!pLog)
+      return Success();
 
    const std::string NAME_REVISION = "revision";
    const std::string NAME_AUTHOR = "author";
@@ -1165,23 +1164,9 @@ Error parseHistoryXml(int skip,
    const std::string NAME_DATE = "date";
    const ptime epoch(boost::gregorian::date(1970,1,1));
 
-   CommitInfo commit;
-
-   int count = 0;
    FOREACH_NODE(pLog, pEntry, "logentry")
    {
-      if (count > maxentries)
-         break;
-
-      // This is not strictly necessary as "skip > 0" below would catch
-      // this case. But this saves us from doing some work for the common
-      // case of not searching.
-      if (searchText.empty() && skip > 0)
-      {
-         skip--;
-         continue;
-      }
-
+      CommitInfo commit;
       commit.id = attr_value(pEntry, NAME_REVISION);
       commit.author = string_utils::filterControlChars(node_value(pEntry, NAME_AUTHOR));
       std::string message = string_utils::filterControlChars(node_value(pEntry, NAME_MSG));
@@ -1191,120 +1176,260 @@ Error parseHistoryXml(int skip,
             node_value(pEntry, NAME_DATE), 'T');
       commit.date = (date - epoch).total_seconds();
 
-      // If we're searching and this doesn't match, skip it and don't decrement
-      // the skip--it's as if this one doesn't count
-      if (!filter(commit))
-      {
-         continue;
-      }
-
-      if (skip > 0)
-      {
-         skip--;
-         continue;
-      }
-
-      error = callback(commit);
-      if (error)
-         return error;
-
-      count++;
+      pCommits->push_back(commit);
    }
 
    return Success();
 }
 
-void historyEnd(boost::function<void(Error, const std::string&)> callback,
-                const Error& error,
-                const core::system::ProcessResult& result)
+int revisionNumber(const CommitInfo& commit)
+{
+   return safe_convert::stringTo<int>(commit.id, 0);
+}
+
+// log entries are cached per file filter (history never changes so we only
+// need to ask the server for revisions newer or older than those we have)
+struct LogCache
+{
+   LogCache() : complete(false) {}
+
+   // entries in descending revision order
+   std::vector<CommitInfo> entries;
+
+   // do the entries go all the way back to the first revision?
+   bool complete;
+};
+
+std::map<std::string, LogCache> s_logCache;
+
+typedef boost::function<void(Error, const std::vector<CommitInfo>&)>
+                                                         HistoryCallback;
+
+void logEnd(const HistoryCallback& callback,
+            const Error& error,
+            const core::system::ProcessResult& result)
 {
    if (!error && result.exitStatus != EXIT_SUCCESS && !result.stdErr.empty())
       LOG_ERROR_MESSAGE(result.stdErr);
 
+   std::vector<CommitInfo> commits;
    if (error)
+   {
       LOG_ERROR(error);
+      callback(error, commits);
+      return;
+   }
 
-   callback(error, result.stdOut);
+   Error parseError = parseHistoryXml(result.stdOut, &commits);
+   callback(parseError, commits);
 }
 
-void history(int rev,
-             FilePath fileFilter,
-             ShellArgs options,
-             boost::function<void(Error, const std::string&)> callback)
+void log(const std::string& range,
+         int limit,
+         const FilePath& fileFilter,
+         const HistoryCallback& callback)
 {
    ShellArgs args;
    args << "log";
    args << "--xml";
-
-   args << options.args();
-
-   if (rev > 0)
-      args << "-r" << safe_convert::numberToString(rev) + ":1";
-   else
-      args << "-r" << "HEAD:1";
-
+   args << "-r" << range;
+   if (limit > 0)
+      args << "--limit" << safe_convert::numberToString(limit);
    if (!fileFilter.empty())
       args << fileFilter;
 
    runSvnAsync(args,
                "SVN History",
                false,
-               boost::bind(historyEnd, callback, _1, _2));
+               boost::bind(logEnd, callback, _1, _2));
 }
 
-Error svnHistoryCountEnd_CommitCallback(int* pCount, const CommitInfo&)
-{
-   (*pCount)++;
-   return Success();
-}
+void cachedHistory(const FilePath& fileFilter, int needed, HistoryCallback callback);
 
-void svnHistoryCountEnd(const std::string& searchText,
-                        const json::JsonRpcFunctionContinuation& cont,
-                        Error error, const std::string& output)
+void onOlderEntries(const FilePath& fileFilter,
+                    int requested,
+                    HistoryCallback callback,
+                    Error error,
+                    const std::vector<CommitInfo>& commits)
 {
-   using namespace rapidxml;
-
-   json::JsonRpcResponse response;
    if (error)
    {
-      cont(error, &response);
+      callback(error, std::vector<CommitInfo>());
       return;
    }
 
-   int count = 0;
+   // append (ignoring anything we already have)
+   LogCache& cache = s_logCache[fileFilter.absolutePath()];
+   int low = cache.entries.empty() ? std::numeric_limits<int>::max() :
+                                     revisionNumber(cache.entries.back());
+   BOOST_FOREACH(const CommitInfo& commit, commits)
+   {
+      if (revisionNumber(commit) < low)
+         cache.entries.push_back(commit);
+   }
 
-   if (searchText.empty())
+   if (requested <= 0 || static_cast<int>(commits.size()) < requested ||
+       (!cache.entries.empty() && revisionNumber(cache.entries.back()) <= 1))
    {
-      std::vector<char> buffer;
-      xml_document<> doc;
-      error = parseXml(output, &buffer, &doc);
-      if (error)
+      cache.complete = true;
+   }
+
+   callback(Success(), cache.entries);
+}
+
+void fetchOlderEntries(const FilePath& fileFilter,
+                       int needed,
+                       HistoryCallback callback)
+{
+   LogCache& cache = s_logCache[fileFilter.absolutePath()];
+   if (cache.complete ||
+       (needed >= 0 && static_cast<int>(cache.entries.size()) >= needed))
+   {
+      callback(Success(), cache.entries);
+      return;
+   }
+
+   std::string range = "HEAD:1";
+   int limit = needed;
+   if (!cache.entries.empty())
+   {
+      int low = revisionNumber(cache.entries.back());
+      if (low <= 1)
       {
-         cont(error, &response);
+         cache.complete = true;
+         callback(Success(), cache.entries);
          return;
       }
+      range = safe_convert::numberToString(low - 1) + ":1";
+      if (needed >= 0)
+         limit = needed - cache.entries.size();
+   }
 
-      xml_node<>* pLog = doc.first_node("log");
-      if (pLog)
-      {
-         FOREACH_NODE(pLog, pEntry, "logentry")
-         {
-            count++;
-         }
-      }
+   log(range,
+       limit,
+       fileFilter,
+       boost::bind(onOlderEntries, fileFilter, limit, callback, _1, _2));
+}
+
+void onNewerEntries(const FilePath& fileFilter,
+                    int needed,
+                    HistoryCallback callback,
+                    Error error,
+                    const std::vector<CommitInfo>& commits)
+{
+   if (error)
+   {
+      callback(error, std::vector<CommitInfo>());
+      return;
    }
-   else
+
+   // prepend revisions newer than those we have
+   LogCache& cache = s_logCache[fileFilter.absolutePath()];
+   int high = cache.entries.empty() ? 0 : revisionNumber(cache.entries.front());
+   std::vector<CommitInfo> newer;
+   BOOST_FOREACH(const CommitInfo& commit, commits)
    {
-      error = parseHistoryXml(0, 999999999, searchText, output,
-                              boost::bind(svnHistoryCountEnd_CommitCallback,
-                                          &count,
-                                          _1));
-      if (error)
+      if (revisionNumber(commit) > high)
+         newer.push_back(commit);
+   }
+   cache.entries.insert(cache.entries.begin(), newer.begin(), newer.end());
+
+   fetchOlderEntries(fileFilter, needed, callback);
+}
+
+// get (at least) the needed number of history entries (or all of them if
+// needed is negative), only going to the server for entries we don't have
+void cachedHistory(const FilePath& fileFilter, int needed, HistoryCallback callback)
+{
+   LogCache& cache = s_logCache[fileFilter.absolutePath()];
+   if (cache.entries.empty())
+   {
+      fetchOlderEntries(fileFilter, needed, callback);
+      return;
+   }
+
+   // check for new revisions (the newest revision we have is included in
+   // the range so that the range is always valid)
+   std::string high = cache.entries.front().id;
+   log("HEAD:" + high,
+       -1,
+       fileFilter,
+       boost::bind(onNewerEntries, fileFilter, needed, callback, _1, _2));
+}
+
+// apply the search, skip and max entries to history entries
+template <typename Callback>
+void filterHistory(const std::vector<CommitInfo>& commits,
+                   int skip,
+                   int maxentries,
+                   const std::string& searchText,
+                   Callback callback)
+{
+   boost::function<bool(const CommitInfo&)> filter =
+         createSearchTextPredicate(searchText);
+
+   int count = 0;
+   BOOST_FOREACH(const CommitInfo& commit, commits)
+   {
+      if (count >= maxentries)
+         break;
+
+      // If we're searching and this doesn't match, skip it and don't decrement
+      // the skip--it's as if this one doesn't count
+      if (!filter(commit))
+         continue;
+
+      if (skip > 0)
       {
-         cont(error, &response);
-         return;
+         skip--;
+         continue;
       }
+
+      callback(commit);
+      count++;
    }
+}
+
+// history entries up to (and including) rev
+std::vector<CommitInfo> historyFromRevision(int rev,
+                                            const std::vector<CommitInfo>& commits)
+{
+   if (rev <= 0)
+      return commits;
+
+   std::vector<CommitInfo> result;
+   BOOST_FOREACH(const CommitInfo& commit, commits)
+   {
+      if (revisionNumber(commit) <= rev)
+         result.push_back(commit);
+   }
+   return result;
+}
+
+void countCommit(int* pCount, const CommitInfo&)
+{
+   (*pCount)++;
+}
+
+void svnHistoryCountEnd(int rev,
+                        const std::string& searchText,
+                        const json::JsonRpcFunctionContinuation& cont,
+                        Error error,
+                        const std::vector<CommitInfo>& commits)
+{
+   json::JsonRpcResponse response;
+   if (error)
+   {
+      cont(error, &response);
+      return;
+   }
+
+   int count = 0;
+   filterHistory(historyFromRevision(rev, commits),
+                 0,
+                 std::numeric_limits<int>::max(),
+                 searchText,
+                 boost::bind(countCommit, &count, _1));
 
    json::Object result;
    result["count"] = count;
@@ -1332,38 +1457,34 @@ void svnHistoryCount(const json::JsonRpcRequest& request,
 
    ask_pass::setActiveWindow(request.sourceWindow);
 
-   ShellArgs options;
-   options << "-q";
    FilePath fileFilter = fileFilterPath(fileFilterJson);
-   history(rev, fileFilter, options,
-           boost::bind(svnHistoryCountEnd, searchText, cont, _1, _2));
+   cachedHistory(fileFilter,
+                 -1,
+                 boost::bind(svnHistoryCountEnd, rev, searchText, cont, _1, _2));
 }
 
-Error svnHistoryEnd_CommitCallback(json::Array *pIds,
-                                   json::Array *pAuthors,
-                                   json::Array *pSubjects,
-                                   json::Array *pDescriptions,
-                                   json::Array *pDates,
-                                   const CommitInfo& commit)
+void appendCommit(json::Array *pIds,
+                  json::Array *pAuthors,
+                  json::Array *pSubjects,
+                  json::Array *pDescriptions,
+                  json::Array *pDates,
+                  const CommitInfo& commit)
 {
    pIds->push_back(commit.id);
    pAuthors->push_back(commit.author);
    pSubjects->push_back(commit.subject);
    pDescriptions->push_back(commit.description);
    pDates->push_back(commit.date);
-   return Success();
 }
 
-void svnHistoryEnd(int skip,
+void svnHistoryEnd(int rev,
+                   int skip,
                    int maxentries,
                    const std::string& searchText,
                    const json::JsonRpcFunctionContinuation& cont,
                    Error error,
-                   const std::string& output)
+                   const std::vector<CommitInfo>& commits)
 {
-   using namespace boost::posix_time;
-   using namespace rapidxml;
-
    json::JsonRpcResponse response;
 
    if (error)
@@ -1378,19 +1499,17 @@ void svnHistoryEnd(int skip,
    json::Array descriptions;
    json::Array dates;
 
-   error = parseHistoryXml(skip, maxentries, searchText, output,
-                           boost::bind(svnHistoryEnd_CommitCallback,
-                                       &ids,
-                                       &authors,
-                                       &subjects,
-                                       &descriptions,
-                                       &dates,
-                                       _1));
-   if (error)
-   {
-      cont(error, &response);
-      return;
-   }
+   filterHistory(historyFromRevision(rev, commits),
+                 skip,
+                 maxentries,
+                 searchText,
+                 boost::bind(appendCommit,
+                             &ids,
+                             &authors,
+                             &subjects,
+                             &descriptions,
+                             &dates,
+                             _1));
 
    json::Object result;
    result["id"] = ids;
@@ -1424,22 +1543,24 @@ void svnHistory(const json::JsonRpcRequest& request,
 
    ask_pass::setActiveWindow(request.sourceWindow);
 
-   ShellArgs options;
-   if (searchText.empty())
-   {
-      int limit = skip + maxentries;
-      options << "--limit" << safe_convert::numberToString(limit);
-   }
+   // searches need all of the history. requests for history from a given
+   // revision also need all of it (we don't know how many newer revisions
+   // there are)
+   int needed = -1;
+   if (searchText.empty() && rev <= 0)
+      needed = skip + maxentries;
 
    FilePath fileFilter = fileFilterPath(fileFilterJson);
-   history(rev, fileFilter, options,
-           boost::bind(svnHistoryEnd,
-                       skip,
-                       maxentries,
-                       searchText,
-                       cont,
-                       _1,
-                       _2));
+   cachedHistory(fileFilter,
+                 needed,
+                 boost::bind(svnHistoryEnd,
+                             rev,
+                             skip,
+                             maxentries,
+                             searchText,
+                             cont,
+                             _1,
+                             _2));
 }
 
 void svnShowEnd(bool noSizeWarning,
@@ -1720,6 +1841,31 @@ void SvnFileDecorationContext::decorateFile(const core::FilePath& filePath,
    (*pFileObject)["svn_status"] = jsonStatus;
 }
 
+void SvnFileDecorationContext::decorateFiles(
+                              const std::vector<core::FileInfo>& files,
+                              std::vector<core::json::Object>* pFileObjects)
+{
+   using namespace source_control;
+
+   for (std::size_t i = 0; i < files.size(); i++)
+   {
+      FilePath filePath(files[i].absolutePath());
+      json::Object& fileObject = pFileObjects->at(i);
+
+      // reuse what the file system item already knows about the file
+      // rather than querying the file system again
+      VCSStatus status = vcsResult_.getStatus(filePath);
+      json::Object jsonStatus;
+      jsonStatus["status"] = status.status();
+      jsonStatus["path"] = filePath.relativePath(s_workingDir);
+      jsonStatus["raw_path"] = fileObject["path"];
+      jsonStatus["is_directory"] = files[i].isDirectory();
+      if (!status.changelist().empty())
+         jsonStatus["changelist"] = status.changelist();
+      fileObject["svn_status"] = jsonStatus;
+   }
+}
+
 Error augmentSvnIgnore()
 {
    // check for existing svn:ignore
@@ -1809,6 +1955,7 @@ Error initialize()
 Error initializeSvn(const core::FilePath& workingDir)
 {
    s_workingDir = workingDir;
+   s_logCache.clear();
 
    Error error = augmentSvnIgnore();
    if (error)
@@ -40,6 +40,8 @@ public:
    virtual ~SvnFileDecorationContext();
    void decorateFile(const core::FilePath& filePath,
                      core::json::Object* pFileObject);
+   void decorateFiles(const std::vector<core::FileInfo>& files,
+                      std::vector<core::json::Object>* pFileObjects);
 private:
    source_control::StatusResult vcsResult_;
 };
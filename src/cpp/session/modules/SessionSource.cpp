@@ -17,6 +17,7 @@
 
 #include <string>
 #include <map>
+#include <set>
 
 #include <boost/bind.hpp>
 #include <boost/foreach.hpp>
@@ -86,22 +87,72 @@ public:
          return;
       }
 
-      // index the source
-      boost::shared_ptr<r_util::RSourceIndex> pIndex(
-                 new r_util::RSourceIndex(pDoc->path(), pDoc->contents()));
+      // nothing to do if we've already indexed these contents
+      IndexMap::const_iterator it = indexes_.find(pDoc->id());
+      std::map<std::string,std::string>::const_iterator hashIt =
+                                             indexedHashes_.find(pDoc->id());
+      if (it != indexes_.end() && it->second->context() == pDoc->path() &&
+          hashIt != indexedHashes_.end() && hashIt->second == pDoc->hash())
+      {
+         return;
+      }
+
+      // index the source (incrementally if we've indexed it before)
+      boost::shared_ptr<r_util::RSourceIndex> pIndex;
+      if (it != indexes_.end() && it->second->context() == pDoc->path())
+      {
+         pIndex.reset(new r_util::RSourceIndex(pDoc->path(),
+                                               pDoc->contents(),
+                                               *(it->second)));
+      }
+      else
+      {
+         pIndex.reset(new r_util::RSourceIndex(pDoc->path(),
+                                               pDoc->contents()));
+      }
 
       // insert it
       indexes_[pDoc->id()] = pIndex;
+      indexedHashes_[pDoc->id()] = pDoc->hash();
    }
 
    void remove(const std::string& id)
    {
       indexes_.erase(id);
+      indexedHashes_.erase(id);
    }
 
    void removeAll()
    {
       indexes_.clear();
+      indexedHashes_.clear();
+   }
+
+   // remove the indexes of documents other than those specified
+   void retainOnly(const std::set<std::string>& ids)
+   {
+      for (IndexMap::iterator it = indexes_.begin(); it != indexes_.end(); )
+      {
+         if (ids.find(it->first) == ids.end())
+         {
+            indexedHashes_.erase(it->first);
+            indexes_.erase(it++);
+         }
+         else
+         {
+            ++it;
+         }
+      }
+   }
+
+   std::size_t memoryUsage() const
+   {
+      std::size_t bytes = 0;
+      BOOST_FOREACH(const IndexMap::value_type& index, indexes_)
+      {
+         bytes += index.first.capacity() + index.second->memoryUsage();
+      }
+      return bytes;
    }
 
    std::vector<boost::shared_ptr<r_util::RSourceIndex> > indexes()
@@ -118,6 +169,9 @@ private:
    typedef std::map<std::string, boost::shared_ptr<r_util::RSourceIndex> >
                                                                     IndexMap;
    IndexMap indexes_;
+
+   // hash of the contents each index was built from
+   std::map<std::string,std::string> indexedHashes_;
 };
 
 RSourceIndexes& rSourceIndexes()
@@ -251,12 +305,16 @@ Error openDocument(const json::JsonRpcRequest& request,
    return Success();
 } 
 
+// pEdits (if provided) are the edits which transform the document's
+// current contents into contents
 Error saveDocumentCore(const std::string& contents,
                        const json::Value& jsonPath,
                        const json::Value& jsonType,
                        const json::Value& jsonEncoding,
                        const json::Value& jsonFoldSpec,
-                       boost::shared_ptr<SourceDocument> pDoc)
+                       boost::shared_ptr<SourceDocument> pDoc,
+                       const std::vector<SourceDocument::ContentsEdit>* pEdits
+                                                                     = NULL)
 {
    // check whether we have a path and if we do get/resolve its value
    std::string path;
@@ -271,7 +329,8 @@ Error saveDocumentCore(const std::string& contents,
    // update dirty state: dirty if there was no path AND the new contents
    // are different from the old contents (and was thus a content autosave
    // as distinct from a fold-spec or scroll-position/selection autosave)
-   pDoc->setDirty(!hasPath && (contents != pDoc->contents()));
+   bool changed = pEdits ? !pEdits->empty() : contents != pDoc->contents();
+   pDoc->setDirty(!hasPath && changed);
    
    bool hasType = json::isType<std::string>(jsonType);
    if (hasType)
@@ -349,7 +408,9 @@ Error saveDocumentCore(const std::string& contents,
    }
 
    // always update the contents so it holds the original UTF-8 data
-   pDoc->setContents(contents);
+   // (patching them in place if we have the edits)
+   if (!pEdits || hasPath || !pDoc->applyEdits(*pEdits))
+      pDoc->setContents(contents);
 
    return Success();
 }
@@ -392,18 +453,48 @@ Error saveDocument(const json::JsonRpcRequest& request,
    return Success();
 }
 
-Error saveDocumentDiff(const json::JsonRpcRequest& request,
-                       json::JsonRpcResponse* pResponse)
+// convert an edit whose range is in characters to one in bytes (returns
+// false if the range isn't within the contents)
+bool contentsEditFromChars(const std::string& contents,
+                           int offset,
+                           int length,
+                           const std::string& text,
+                           SourceDocument::ContentsEdit* pEdit)
 {
    using namespace core::string_utils;
 
+   if (offset < 0 || length < 0)
+      return false;
+
+   std::string::const_iterator rangeBegin = contents.begin();
+   Error error = utf8Advance(rangeBegin, offset, contents.end(), &rangeBegin);
+   if (error)
+      return false;
+
+   std::string::const_iterator rangeEnd = rangeBegin;
+   error = utf8Advance(rangeEnd, length, contents.end(), &rangeEnd);
+   if (error)
+      return false;
+
+   pEdit->offset = rangeBegin - contents.begin();
+   pEdit->length = rangeEnd - rangeBegin;
+   pEdit->text = text;
+   return true;
+}
+
+Error saveDocumentDiff(const json::JsonRpcRequest& request,
+                       json::JsonRpcResponse* pResponse)
+{
    // unique id and jsonPath (can be null for auto-save)
    std::string id;
    json::Value jsonPath, jsonType, jsonEncoding, jsonFoldSpec;
    
-   // This is a chunk of text that should be inserted into the
-   // current document. It replaces the subrange [offset, offset+length).
-   std::string replacement;
+   // The edits to apply to the current document. This is either a chunk
+   // of text to be inserted into the document (replacing the subrange
+   // [offset, offset+length)) or an array of edits ({offset, length,
+   // text}) applied in order, each relative to the result of the last.
+   // Offsets and lengths are in characters.
+   json::Value jsonEdits;
    int offset, length;
    
    // This is the expected hash of the current document. If the
@@ -418,7 +509,7 @@ Error saveDocumentDiff(const json::JsonRpcRequest& request,
                                   &jsonType,
                                   &jsonEncoding,
                                   &jsonFoldSpec,
-                                  &replacement,
+                                  &jsonEdits,
                                   &offset,
                                   &length,
                                   &hash);
@@ -438,38 +529,68 @@ Error saveDocumentDiff(const json::JsonRpcRequest& request,
       return error ;
    
    // Don't even attempt anything if we're not working off the same original
-   if (pDoc->hash() == hash)
+   if (pDoc->hash() != hash)
+      return Success();
+
+   // Convert the edits to byte ranges, applying them as we go (to compute
+   // the ranges of subsequent edits). If any of them fail to apply then
+   // abort the differential save (the client will fall back to sending
+   // the whole document).
+   std::string contents(pDoc->contents());
+   std::vector<SourceDocument::ContentsEdit> edits;
+   if (json::isType<std::string>(jsonEdits))
+   {
+      SourceDocument::ContentsEdit edit;
+      if (!contentsEditFromChars(contents, offset, length,
+                                 jsonEdits.get_str(), &edit))
+      {
+         return Success();
+      }
+      contents.replace(edit.offset, edit.length, edit.text);
+      edits.push_back(edit);
+   }
+   else if (json::isType<json::Array>(jsonEdits))
    {
-      std::string contents(pDoc->contents());
+      BOOST_FOREACH(const json::Value& jsonEdit, jsonEdits.get_array())
+      {
+         int editOffset, editLength;
+         std::string editText;
+         if (!json::isType<json::Object>(jsonEdit))
+            return Error(json::errc::ParamInvalid, ERROR_LOCATION);
+         error = json::readObject(jsonEdit.get_obj(),
+                                  "offset", &editOffset,
+                                  "length", &editLength,
+                                  "text", &editText);
+         if (error)
+            return error;
 
-      // Offset and length are specified in characters, but contents
-      // is in UTF8 bytes. Convert before using.
-      std::string::iterator rangeBegin = contents.begin();
-      error = utf8Advance(rangeBegin, offset, contents.end(), &rangeBegin);
-      if (error)
-         return Success(); // UTF8 decoding failed. Abort differential save.
+         SourceDocument::ContentsEdit edit;
+         if (!contentsEditFromChars(contents, editOffset, editLength,
+                                    editText, &edit))
+         {
+            return Success();
+         }
+         contents.replace(edit.offset, edit.length, edit.text);
+         edits.push_back(edit);
+      }
+   }
+   else
+   {
+      return Error(json::errc::ParamTypeMismatch, ERROR_LOCATION);
+   }
 
-      std::string::iterator rangeEnd = rangeBegin;
-      error = utf8Advance(rangeEnd, length, contents.end(), &rangeEnd);
-      if (error)
-         return Success(); // UTF8 decoding failed. Abort differential save.
+   error = saveDocumentCore(contents, jsonPath, jsonType, jsonEncoding,
+                            jsonFoldSpec, pDoc, &edits);
+   if (error)
+      return error;
 
-      contents.erase(rangeBegin, rangeEnd);
-      contents.insert(rangeBegin, replacement.begin(), replacement.end());
-      
-      error = saveDocumentCore(contents, jsonPath, jsonType, jsonEncoding,
-                               jsonFoldSpec, pDoc);
-      if (error)
-         return error;
-      
-      // write to the source_database
-      error = sourceDatabasePutWithUpdatedContents(pDoc);
-      if (error)
-         return error;
+   // write to the source_database (which journals just the edits) and
+   // update its index (which re-indexes just the lines around them)
+   error = sourceDatabasePutWithUpdatedContents(pDoc);
+   if (error)
+      return error;
 
-      pResponse->setResult(pDoc->hash());
-   }
-   
+   pResponse->setResult(pDoc->hash());
    return Success();
 }
 
@@ -928,9 +1049,6 @@ SEXP rs_fileEdit(SEXP fileSEXP)
 
 Error clientInitDocuments(core::json::Array* pJsonDocs)
 {
-   // remove all items from the source index database
-   rSourceIndexes().removeAll();
-
    // get the docs and sort them by created
    std::vector<boost::shared_ptr<SourceDocument> > docs ;
    Error error = source_database::list(&docs);
@@ -940,6 +1058,7 @@ Error clientInitDocuments(core::json::Array* pJsonDocs)
 
    // populate the array
    pJsonDocs->clear();
+   std::set<std::string> ids;
    BOOST_FOREACH( boost::shared_ptr<SourceDocument>& pDoc, docs )
    {
       // Force dirty state to be checked.
@@ -961,10 +1080,15 @@ Error clientInitDocuments(core::json::Array* pJsonDocs)
       pDoc->writeToJson(&jsonDoc);
       pJsonDocs->push_back(jsonDoc);
 
-      // update the source index
+      // update the source index (documents whose contents haven't changed
+      // since they were last indexed keep their existing index)
       rSourceIndexes().update(pDoc);
+      ids.insert(pDoc->id());
    }
 
+   // drop the indexes of documents which are no longer open
+   rSourceIndexes().retainOnly(ids);
+
    return Success();
 }
 
@@ -989,6 +1113,10 @@ Error initialize()
    methodDef.numArgs = 1;
    r::routines::addCallMethod(methodDef);
 
+   registerMemoryUsage("source_indexes",
+                       boost::bind(&RSourceIndexes::memoryUsage,
+                                   &rSourceIndexes()));
+
    // install rpc methods
    using boost::bind;
    using namespace r::function_hook;
@@ -19,6 +19,7 @@
 
 #include <core/Error.hpp>
 #include <core/Exec.hpp>
+#include <core/Thread.hpp>
 
 #include <core/spelling/HunspellSpellingEngine.hpp>
 
@@ -38,16 +39,152 @@ namespace spelling {
 
 namespace {
 
-// underlying spelling engine
-boost::scoped_ptr<core::spelling::SpellingEngine> s_pSpellingEngine;
+// pool of spelling engines. check_spelling and suggestion_list are
+// executed concurrently by background rpc workers and hunspell isn't
+// threadsafe (nor can instances share dictionary data) so each concurrent
+// user of the engine is given an instance of its own
+class SpellingEnginePool : boost::noncopyable
+{
+private:
+   struct Entry
+   {
+      Entry() : generation(0) {}
+      boost::shared_ptr<core::spelling::SpellingEngine> pEngine;
+      int generation;
+   };
+
+public:
+   SpellingEnginePool() : generation_(0), engineCount_(0) {}
+
+   // COPYING: boost::noncopyable
+
+   // must be called (on the main thread) before the pool is used
+   void initialize(const std::string& langId,
+                   const core::spelling::HunspellDictionaryManager& dictManager)
+   {
+      langId_ = langId;
+      pDictManager_.reset(
+               new core::spelling::HunspellDictionaryManager(dictManager));
+   }
+
+   // switch all engines to the specified language (also picks up changes
+   // to the custom dictionaries). engines which are in use are switched
+   // the next time they are acquired
+   void useDictionary(const std::string& langId)
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         langId_ = langId;
+         generation_++;
+      }
+      END_LOCK_MUTEX
+   }
+
+   // use a lease (below) rather than calling these directly
+   Entry acquire()
+   {
+      Entry entry;
+      std::string langId;
+      int generation;
+      {
+         boost::unique_lock<boost::mutex> lock(mutex_);
+         while (idle_.empty() && engineCount_ >= kMaxEngines)
+            condition_.wait(lock);
+
+         if (!idle_.empty())
+         {
+            entry = idle_.back();
+            idle_.pop_back();
+         }
+         else
+         {
+            // (dictionaries are loaded lazily on first use)
+            core::spelling::SpellingEngine* pEngine =
+                  new core::spelling::HunspellSpellingEngine(
+                                                      langId_,
+                                                      *pDictManager_,
+                                                      &r::util::iconvstr);
+            entry.pEngine.reset(pEngine);
+            entry.generation = generation_;
+            engineCount_++;
+         }
+
+         langId = langId_;
+         generation = generation_;
+      }
+
+      if (entry.generation != generation)
+      {
+         entry.pEngine->useDictionary(langId);
+         entry.generation = generation;
+      }
+
+      return entry;
+   }
+
+   void release(const Entry& entry)
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         idle_.push_back(entry);
+      }
+      END_LOCK_MUTEX
+
+      condition_.notify_one();
+   }
+
+   class Lease : boost::noncopyable
+   {
+   public:
+      explicit Lease(SpellingEnginePool& pool)
+         : pool_(pool), entry_(pool.acquire())
+      {
+      }
+
+      ~Lease()
+      {
+         try
+         {
+            pool_.release(entry_);
+         }
+         catch(...)
+         {
+         }
+      }
+
+      core::spelling::SpellingEngine* operator->() const
+      {
+         return entry_.pEngine.get();
+      }
+
+   private:
+      SpellingEnginePool& pool_;
+      Entry entry_;
+   };
+
+private:
+   // one for each background rpc worker plus the main thread
+   static const int kMaxEngines = 3;
+
+   boost::mutex mutex_;
+   boost::condition condition_;
+   std::string langId_;
+   boost::scoped_ptr<core::spelling::HunspellDictionaryManager> pDictManager_;
+   std::vector<Entry> idle_;
+   int generation_;
+   int engineCount_;
+};
+
+SpellingEnginePool s_spellingEngines;
 
 // R function for testing & debugging
 SEXP rs_checkSpelling(SEXP wordSEXP)
 {
-   bool isCorrect;
+   bool isCorrect = true;
    std::string word = r::sexp::asString(wordSEXP);
 
-   Error error = s_pSpellingEngine->checkSpelling(word, &isCorrect);
+   Error error = SpellingEnginePool::Lease(s_spellingEngines)->checkSpelling(
+                                                            word, &isCorrect);
 
    // We'll return true here so as not to tie up the front end.
    if (error)
@@ -77,7 +214,7 @@ FilePath userDictionariesDir()
 
 void syncSpellingEngineDictionaries()
 {
-   s_pSpellingEngine->useDictionary(userSettings().spellingLanguage());
+   s_spellingEngines.useDictionary(userSettings().spellingLanguage());
 }
 
 
@@ -105,6 +242,7 @@ Error checkSpelling(const json::JsonRpcRequest& request,
       return error;
 
    json::Array misspelledIndexes;
+   SpellingEnginePool::Lease pEngine(s_spellingEngines);
    for (std::size_t i=0; i<words.size(); i++)
    {
       if (!json::isType<std::string>(words[i]))
@@ -115,7 +253,7 @@ Error checkSpelling(const json::JsonRpcRequest& request,
 
       std::string word = words[i].get_str();
       bool isCorrect = true;
-      error = s_pSpellingEngine->checkSpelling(word, &isCorrect);
+      error = pEngine->checkSpelling(word, &isCorrect);
       if (error)
          return error;
 
@@ -137,7 +275,8 @@ Error suggestionList(const json::JsonRpcRequest& request,
       return error;
 
    std::vector<std::string> sugs;
-   error = s_pSpellingEngine->suggestionList(word, &sugs);
+   error = SpellingEnginePool::Lease(s_spellingEngines)->suggestionList(word,
+                                                                       &sugs);
    if (error)
       return error;
 
@@ -155,7 +294,8 @@ Error getWordChars(const json::JsonRpcRequest& request,
                    json::JsonRpcResponse* pResponse)
 {
    std::wstring wordChars;
-   Error error = s_pSpellingEngine->wordChars(&wordChars);
+   Error error = SpellingEnginePool::Lease(s_spellingEngines)->wordChars(
+                                                                  &wordChars);
    if (error)
       return error;
 
@@ -296,13 +436,9 @@ Error initialize()
    methodDef.numArgs = 1;
    r::routines::addCallMethod(methodDef);
 
-   // initialize spelling engine
-   using namespace core::spelling;
-   HunspellSpellingEngine* pHunspell = new HunspellSpellingEngine(
-                                             userSettings().spellingLanguage(),
-                                             hunspellDictionaryManager(),
-                                             &r::util::iconvstr);
-   s_pSpellingEngine.reset(pHunspell);
+   // initialize spelling engines
+   s_spellingEngines.initialize(userSettings().spellingLanguage(),
+                                hunspellDictionaryManager());
 
    // connect to user settings changed
    userSettings().onChanged.connect(onUserSettingsChanged);
@@ -312,8 +448,8 @@ Error initialize()
    using namespace module_context;
    ExecBlock initBlock ;
    initBlock.addFunctions()
-      (bind(registerRpcMethod, "check_spelling", checkSpelling))
-      (bind(registerRpcMethod, "suggestion_list", suggestionList))
+      (bind(registerRFreeRpcMethod, "check_spelling", checkSpelling))
+      (bind(registerRFreeRpcMethod, "suggestion_list", suggestionList))
       (bind(registerRpcMethod, "get_word_chars", getWordChars))
       (bind(registerRpcMethod, "add_custom_dictionary", addCustomDictionary))
       (bind(registerRpcMethod, "remove_custom_dictionary", removeCustomDictionary))
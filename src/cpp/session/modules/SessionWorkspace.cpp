@@ -15,19 +15,27 @@
 
 #include "SessionWorkspace.hpp"
 
+#include <cstdlib>
 #include <algorithm>
+#include <map>
 
 #include <boost/bind.hpp>
 #include <boost/format.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/unordered_map.hpp>
 #include <boost/utility.hpp>
 
 #include <core/Error.hpp>
 #include <core/Log.hpp>
 #include <core/Exec.hpp>
 #include <core/FilePath.hpp>
+#include <core/SafeConvert.hpp>
+#include <core/text/CsvReader.hpp>
 
 #include <core/json/JsonRpc.hpp>
 
+#define R_INTERNAL_FUNCTIONS
+#include <r/RInternal.hpp>
 #include <r/RExec.hpp>
 #include <r/RRoutines.hpp>
 #include <r/RErrorCategory.hpp>
@@ -36,6 +44,8 @@
 #include <session/SessionModuleContext.hpp>
 #include <session/SessionUserSettings.hpp>
 
+#include "SessionCompletion.hpp"
+
 using namespace core ;
 using namespace r::sexp;
 using namespace r::exec;
@@ -107,7 +117,147 @@ json::Value descriptionOfGlobalVar(SEXP globalVar)
    }
 }
 
-json::Value jsonValueForGlobalVar(const std::string& name)
+// native equivalents of .rs.getSingleClass, .rs.valueAsString, and
+// .rs.valueDescription. these cover the common cases without calling back
+// into R and return false for objects which need R (S4 objects, functions,
+// and scalars, whose values are formatted using deparse)
+
+bool nativeClassOfGlobalVar(SEXP globalVar, std::string* pClass)
+{
+   if (IS_S4_OBJECT(globalVar))
+      return false;
+
+   // explicit class
+   SEXP classSEXP = Rf_getAttrib(globalVar, R_ClassSymbol);
+   if (TYPEOF(classSEXP) == STRSXP && Rf_length(classSEXP) > 0)
+   {
+      *pClass = Rf_translateCharUTF8(STRING_ELT(classSEXP, 0));
+      return true;
+   }
+
+   // implicit class
+   SEXP dimSEXP = Rf_getAttrib(globalVar, R_DimSymbol);
+   if (dimSEXP != R_NilValue)
+   {
+      *pClass = Rf_length(dimSEXP) == 2 ? "matrix" : "array";
+      return true;
+   }
+
+   switch(TYPEOF(globalVar))
+   {
+      case NILSXP:
+         *pClass = "NULL";
+         return true;
+      case LGLSXP:
+         *pClass = "logical";
+         return true;
+      case INTSXP:
+         *pClass = "integer";
+         return true;
+      case REALSXP:
+         *pClass = "numeric";
+         return true;
+      case CPLXSXP:
+         *pClass = "complex";
+         return true;
+      case STRSXP:
+         *pClass = "character";
+         return true;
+      case VECSXP:
+         *pClass = "list";
+         return true;
+      case RAWSXP:
+         *pClass = "raw";
+         return true;
+      case ENVSXP:
+         *pClass = "environment";
+         return true;
+      case CLOSXP:
+      case SPECIALSXP:
+      case BUILTINSXP:
+         *pClass = "function";
+         return true;
+      default:
+         return false;
+   }
+}
+
+bool nativeValueOfGlobalVar(SEXP globalVar, std::string* pValue)
+{
+   if (IS_S4_OBJECT(globalVar) || Rf_isFunction(globalVar))
+      return false;
+
+   // scalars are deparsed by R
+   if (Rf_length(globalVar) == 1 && ATTRIB(globalVar) == R_NilValue)
+   {
+      switch(TYPEOF(globalVar))
+      {
+         case LGLSXP:
+         case INTSXP:
+         case REALSXP:
+         case CPLXSXP:
+         case STRSXP:
+            return false;
+         default:
+            break;
+      }
+   }
+
+   *pValue = "NO_VALUE";
+   return true;
+}
+
+bool nativeDescriptionOfGlobalVar(SEXP globalVar, std::string* pDescription)
+{
+   if (IS_S4_OBJECT(globalVar) || Rf_inherits(globalVar, "ore.frame"))
+      return false;
+
+   if (Rf_inherits(globalVar, "data.frame"))
+   {
+      // read the row count from the row names (which R stores in the
+      // compact form c(NA, -n) for automatic row names)
+      int rows = 0;
+      for (SEXP attribSEXP = ATTRIB(globalVar);
+           attribSEXP != R_NilValue;
+           attribSEXP = CDR(attribSEXP))
+      {
+         if (TAG(attribSEXP) != R_RowNamesSymbol)
+            continue;
+
+         SEXP rowNamesSEXP = CAR(attribSEXP);
+         if (TYPEOF(rowNamesSEXP) == INTSXP &&
+             Rf_length(rowNamesSEXP) == 2 &&
+             INTEGER(rowNamesSEXP)[0] == NA_INTEGER)
+         {
+            rows = std::abs(INTEGER(rowNamesSEXP)[1]);
+         }
+         else
+         {
+            rows = Rf_length(rowNamesSEXP);
+         }
+         break;
+      }
+
+      boost::format fmt("%1% obs. of %2% variables");
+      *pDescription = boost::str(fmt % rows % Rf_length(globalVar));
+      return true;
+   }
+
+   SEXP dimSEXP = Rf_getAttrib(globalVar, R_DimSymbol);
+   if (TYPEOF(dimSEXP) == INTSXP && Rf_length(dimSEXP) == 2)
+   {
+      boost::format fmt("%1% x %2% %3% matrix");
+      *pDescription = boost::str(fmt % INTEGER(dimSEXP)[0] %
+                                       INTEGER(dimSEXP)[1] %
+                                       Rf_type2char(TYPEOF(globalVar)));
+      return true;
+   }
+
+   *pDescription = "";
+   return true;
+}
+
+json::Object jsonValueForGlobalVar(const std::string& name, SEXP globalVar)
 {
    json::Object jsonObject ;
    jsonObject["name"] = name;
@@ -123,14 +273,27 @@ json::Value jsonValueForGlobalVar(const std::string& name)
    // assignment language expressions show up as "(unknown)" but then are
    // correctly displayed in refreshed listings of the workspace.
    //
-   SEXP globalVar = findVar(name);
    if ((globalVar != R_UnboundValue) && !r::sexp::isLanguage(globalVar))
    {
       Protect rProtect(globalVar);
-      jsonObject["type"] = classOfGlobalVar(globalVar);
+      std::string value;
+
+      if (nativeClassOfGlobalVar(globalVar, &value))
+         jsonObject["type"] = value;
+      else
+         jsonObject["type"] = classOfGlobalVar(globalVar);
+
       jsonObject["len"] = length(globalVar);
-      jsonObject["value"] = valueOfGlobalVar(globalVar);
-      jsonObject["extra"] = descriptionOfGlobalVar(globalVar);
+
+      if (nativeValueOfGlobalVar(globalVar, &value))
+         jsonObject["value"] = value;
+      else
+         jsonObject["value"] = valueOfGlobalVar(globalVar);
+
+      if (nativeDescriptionOfGlobalVar(globalVar, &value))
+         jsonObject["extra"] = value;
+      else
+         jsonObject["extra"] = descriptionOfGlobalVar(globalVar);
    }
    else
    {
@@ -143,6 +306,64 @@ json::Value jsonValueForGlobalVar(const std::string& name)
    return jsonObject;
 }
 
+// descriptions of global environment objects. computing these requires
+// calling back into R formatting code so they are computed lazily and
+// cached by name (an entry is valid only while the name is bound to the
+// same SEXP). the environment monitor removes entries for names which
+// it sees removed or reassigned
+class GlobalVarDescriptions : boost::noncopyable
+{
+public:
+   json::Object get(const std::string& name)
+   {
+      return get(name, findVar(name));
+   }
+
+   // get the description given the current value of the name (saves
+   // looking it up again when the caller already has the binding)
+   json::Object get(const std::string& name, SEXP globalVar)
+   {
+      Cache::const_iterator it = cache_.find(name);
+      if (it != cache_.end() && it->second.first == globalVar)
+         return it->second.second;
+
+      json::Object jsonObject = jsonValueForGlobalVar(name, globalVar);
+
+      // don't cache unknown or language objects (see note above)
+      if ((globalVar != R_UnboundValue) && !r::sexp::isLanguage(globalVar))
+         cache_[name] = std::make_pair(globalVar, jsonObject);
+      else
+         cache_.erase(name);
+
+      return jsonObject;
+   }
+
+   void remove(const std::string& name)
+   {
+      cache_.erase(name);
+   }
+
+   void clear()
+   {
+      cache_.clear();
+   }
+
+private:
+   typedef std::map<std::string, std::pair<SEXP,json::Object> > Cache;
+   Cache cache_;
+};
+
+GlobalVarDescriptions& globalVarDescriptions()
+{
+   static GlobalVarDescriptions instance;
+   return instance;
+}
+
+json::Value jsonValueForGlobalVar(const std::string& name)
+{
+   return globalVarDescriptions().get(name);
+}
+
 void enqueRefreshEvent()
 {
    ClientEvent refreshEvent(client_events::kWorkspaceRefresh);
@@ -151,13 +372,16 @@ void enqueRefreshEvent()
 
 void enqueRemovedEvent(const r::sexp::Variable& variable)   
 {
+   globalVarDescriptions().remove(variable.first);
+
    ClientEvent removedEvent(client_events::kWorkspaceRemove, variable.first);
    module_context::enqueClientEvent(removedEvent);
 }
 
 void enqueAssignedEvent(const r::sexp::Variable& variable)
 {   
-   // get object info
+   // get object info (discarding any previously computed description)
+   globalVarDescriptions().remove(variable.first);
    json::Value objInfo = jsonValueForGlobalVar(variable.first);
    
    // enque event
@@ -217,29 +441,54 @@ void onResume(const Settings& settings)
 }
 
 
-// detect changes in the environment by inspecting the list of variable
-// names as well as the SEXP pointers (a new pointer implies a mutation of
-// an object)
+// detect changes in the environment by inspecting the bindings within the
+// global environment's frame (a new value pointer implies a mutation of
+// an object). to keep the cost of unchanged environments low we first
+// compare a fingerprint of the frame and only diff individual bindings
+// when it has changed
 class GlobalEnvironmentMonitor : boost::noncopyable
 {
 public:
    GlobalEnvironmentMonitor() 
-      : initialized_(false) 
+      : initialized_(false), lastFingerprint_(0)
    {
    }
    
    void reset()
    {
       initialized_ = false;
+      lastFingerprint_ = 0;
       lastEnv_.clear();
    }
    
    void checkForChanges()
    {
-      // get the current environment
-      std::vector<r::sexp::Variable> currentEnv ;
-      listEnvironment(&currentEnv);
-      
+      // get the current bindings
+      std::vector<r::sexp::Binding> currentBindings;
+      r::sexp::listBindings(R_GlobalEnv, false, &currentBindings);
+
+      // bail early if nothing has changed
+      std::size_t currentFingerprint = fingerprint(currentBindings);
+      if (initialized_ &&
+          currentFingerprint == lastFingerprint_ &&
+          currentBindings.size() == lastEnv_.size())
+      {
+         return;
+      }
+
+      Environment currentEnv(currentBindings.begin(), currentBindings.end());
+
+      // give the completion index the current names (it can't look
+      // them up itself while R is busy)
+      std::vector<std::string> names;
+      names.reserve(currentBindings.size());
+      for (std::vector<r::sexp::Binding>::const_iterator it =
+              currentBindings.begin(); it != currentBindings.end(); ++it)
+      {
+         names.push_back(CHAR(PRINTNAME(it->first)));
+      }
+      completion::setGlobalEnvironmentNames(names);
+
       // force refresh event the first time
       if (!initialized_)
       {
@@ -247,79 +496,379 @@ public:
          initialized_ = true;
       }
       
-      // if there are changes
-      else if (currentEnv != lastEnv_)
-      {      
-         // optimize for empty currentEnv (user reset workspace) or empty 
-         // lastEnv_ (startup) by just sending a single WorkspaceRefresh event
-         if (currentEnv.empty() || lastEnv_.empty())
+      // optimize for empty currentEnv (user reset workspace) or empty 
+      // lastEnv_ (startup) by just sending a single WorkspaceRefresh event
+      else if (currentEnv.empty() || lastEnv_.empty())
+      {
+         globalVarDescriptions().clear();
+         enqueRefreshEvent();
+      }
+
+      else
+      {
+         // find deletes (all symbols in the previous environment but
+         // NOT in the current environment)
+         std::vector<Variable> removedVars ;
+         for (Environment::const_iterator it = lastEnv_.begin();
+              it != lastEnv_.end();
+              ++it)
          {
-            enqueRefreshEvent();
+            if (currentEnv.find(it->first) == currentEnv.end())
+               removedVars.push_back(asVariable(*it));
          }
-         else
+         std::sort(removedVars.begin(), removedVars.end());
+
+         // fire removed event for deletes
+         std::for_each(removedVars.begin(), 
+                       removedVars.end(), 
+                       enqueRemovedEvent);
+         
+         // find adds & assigns (all symbols which are new or which have
+         // a different value than they did in the previous environment)
+         std::vector<Variable> addedVars ;
+         for (Environment::const_iterator it = currentEnv.begin();
+              it != currentEnv.end();
+              ++it)
          {
-            // find deletes (all variable names in the previous environment but
-            // NOT in the current environment)
-            std::vector<Variable> removedVars ;
-            std::set_difference(lastEnv_.begin(), lastEnv_.end(),
-                                currentEnv.begin(), currentEnv.end(),
-                                std::back_inserter(removedVars),
-                                boost::bind(
-                                  &GlobalEnvironmentMonitor::compareVarName,
-                                  this, _1, _2));
-                                
-            // fire removed event for deletes
-            std::for_each(removedVars.begin(), 
-                          removedVars.end(), 
-                          enqueRemovedEvent);
-            
-            // find adds & assigns (all variable name/value combinations in the 
-            // current environment but NOT in the previous environment)
-            std::vector<Variable> addedVars ;
-            std::set_difference(currentEnv.begin(), currentEnv.end(),
-                                lastEnv_.begin(), lastEnv_.end(),
-                                std::back_inserter(addedVars));
-                                
-            // fire assigned event for adds & assigns
-            std::for_each(addedVars.begin(), 
-                          addedVars.end(), 
-                          enqueAssignedEvent);
+            Environment::const_iterator lastIt = lastEnv_.find(it->first);
+            if (lastIt == lastEnv_.end() || lastIt->second != it->second)
+               addedVars.push_back(asVariable(*it));
          }
+         std::sort(addedVars.begin(), addedVars.end());
+
+         // fire assigned event for adds & assigns
+         std::for_each(addedVars.begin(), 
+                       addedVars.end(), 
+                       enqueAssignedEvent);
       }
       
-      // set the "last environment" list to the current env
+      // set the "last environment" to the current env
       // note that the SEXP values within the currentEnv are not protected
       // beyond the scope of this call. this is OK because we only reference
       // the pointer values not the underlying R objects. if we want to be
       // able to manipulate the SEXPs directly we'll need a static protection
       // context so the objects are guaranteed to survive until the next call
-      lastEnv_ = currentEnv;
+      lastEnv_.swap(currentEnv);
+      lastFingerprint_ = currentFingerprint;
    }
    
 private:
-   
-   void listEnvironment(std::vector<r::sexp::Variable>* pEnvironment)
+
+   // symbol => value
+   typedef boost::unordered_map<SEXP,SEXP> Environment;
+
+   // order independent hash of the bindings (the frame's order can change
+   // when its hash table is resized)
+   static std::size_t fingerprint(const std::vector<r::sexp::Binding>& bindings)
    {
-      // get the variables currently in the global environment (note this list
-      // is guaranteed to be sorted based on the behavior of R_lsInternal)
-      r::sexp::Protect rProtect;
-      r::sexp::listEnvironment(R_GlobalEnv, false, &rProtect, pEnvironment);   
+      std::size_t result = 0;
+      for (std::vector<r::sexp::Binding>::const_iterator it = bindings.begin();
+           it != bindings.end();
+           ++it)
+      {
+         std::size_t hash = 0;
+         boost::hash_combine(hash, it->first);
+         boost::hash_combine(hash, it->second);
+         result += hash;
+      }
+      return result;
    }
-   
-   // helper to deterine whether two variables have the same name
-   bool compareVarName(const Variable& var1, const Variable& var2)
+
+   static Variable asVariable(const Environment::value_type& binding)
    {
-      return var1.first < var2.first ;
+      return std::make_pair(std::string(CHAR(PRINTNAME(binding.first))),
+                            binding.second);
    }
    
 private:
-   std::vector<r::sexp::Variable> lastEnv_; 
+   Environment lastEnv_;
    bool initialized_ ;
+   std::size_t lastFingerprint_;
 };
 
 // global environment monitor
 GlobalEnvironmentMonitor s_globalEnvironmentMonitor;
    
+// list a window of the (sorted) objects in the global environment. only
+// the objects within the window are described (and their descriptions are
+// cached) so paging through a large environment is cheap
+Error listObjectsPage(const json::JsonRpcRequest& request,
+                      json::JsonRpcResponse* pResponse)
+{
+   int offset, count;
+   Error error = json::readParams(request.params, &offset, &count);
+   if (error)
+      return error;
+
+   // read all of the bindings in a single pass over the frame
+   std::vector<r::sexp::Binding> bindings;
+   r::sexp::listBindings(R_GlobalEnv, false, &bindings);
+   std::vector<Variable> vars;
+   vars.reserve(bindings.size());
+   for (std::vector<r::sexp::Binding>::const_iterator it = bindings.begin();
+        it != bindings.end();
+        ++it)
+   {
+      vars.push_back(std::make_pair(std::string(CHAR(PRINTNAME(it->first))),
+                                    it->second));
+   }
+   std::sort(vars.begin(), vars.end());
+
+   json::Array namesJson, typesJson, lengthsJson, valuesJson, extrasJson;
+   std::size_t begin = std::min(vars.size(),
+                                static_cast<std::size_t>(std::max(offset, 0)));
+   std::size_t end = std::min(vars.size(),
+                              begin + static_cast<std::size_t>(
+                                                       std::max(count, 0)));
+   for (std::size_t i = begin; i < end; i++)
+   {
+      json::Object objectJson = globalVarDescriptions().get(vars[i].first,
+                                                            vars[i].second);
+      namesJson.push_back(objectJson["name"]);
+      typesJson.push_back(objectJson["type"]);
+      lengthsJson.push_back(objectJson["len"]);
+      valuesJson.push_back(objectJson["value"]);
+      extrasJson.push_back(objectJson["extra"]);
+   }
+
+   json::Object objectsJson;
+   objectsJson["name"] = namesJson;
+   objectsJson["type"] = typesJson;
+   objectsJson["len"] = lengthsJson;
+   objectsJson["value"] = valuesJson;
+   objectsJson["extra"] = extrasJson;
+
+   json::Object resultJson;
+   resultJson["total"] = static_cast<int>(vars.size());
+   resultJson["offset"] = static_cast<int>(begin);
+   resultJson["objects"] = objectsJson;
+   pResponse->setResult(resultJson);
+
+   return Success();
+}
+
+// rows parsed for a data import preview
+const std::size_t kCsvPreviewRows = 1000;
+
+// rows examined when inferring the type of an imported column
+const std::size_t kCsvTypeSampleRows = 1000;
+
+std::string csvColumnName(const text::CsvReader& reader,
+                          bool header,
+                          std::size_t column)
+{
+   if (header && reader.rowCount() > 0)
+      return text::csvFieldValue(reader.field(0, column));
+   else
+      return "V" + safe_convert::numberToString(column + 1);
+}
+
+// build an R vector of the given type for a column (returns false if one
+// of the values doesn't have that type)
+bool csvColumnSEXP(const text::CsvReader& reader,
+                   std::size_t column,
+                   std::size_t firstRow,
+                   text::CsvColumnType type,
+                   r::sexp::Protect* pProtect,
+                   SEXP* pColumnSEXP)
+{
+   std::size_t rows = reader.rowCount() - firstRow;
+   SEXP columnSEXP = R_NilValue;
+   switch(type)
+   {
+      case text::kCsvLogical:
+         pProtect->add(columnSEXP = Rf_allocVector(LGLSXP, rows));
+         break;
+      case text::kCsvInteger:
+         pProtect->add(columnSEXP = Rf_allocVector(INTSXP, rows));
+         break;
+      case text::kCsvDouble:
+         pProtect->add(columnSEXP = Rf_allocVector(REALSXP, rows));
+         break;
+      case text::kCsvString:
+         pProtect->add(columnSEXP = Rf_allocVector(STRSXP, rows));
+         break;
+   }
+
+   for (std::size_t i = 0; i < rows; i++)
+   {
+      text::CsvField field = reader.field(firstRow + i, column);
+      bool missing = text::isCsvMissing(field);
+      bool ok = true;
+      switch(type)
+      {
+         case text::kCsvLogical:
+         {
+            bool value = false;
+            ok = missing || text::csvFieldAsLogical(field, &value);
+            LOGICAL(columnSEXP)[i] = missing ? NA_LOGICAL : value;
+            break;
+         }
+         case text::kCsvInteger:
+         {
+            int value = 0;
+            ok = missing || text::csvFieldAsInteger(field, &value);
+            INTEGER(columnSEXP)[i] = missing ? NA_INTEGER : value;
+            break;
+         }
+         case text::kCsvDouble:
+         {
+            double value = 0;
+            ok = missing || text::csvFieldAsDouble(field, &value);
+            REAL(columnSEXP)[i] = missing ? NA_REAL : value;
+            break;
+         }
+         case text::kCsvString:
+         {
+            if (missing)
+            {
+               SET_STRING_ELT(columnSEXP, i, NA_STRING);
+            }
+            else if (field.quoted)
+            {
+               std::string value = text::csvFieldValue(field);
+               SET_STRING_ELT(columnSEXP, i,
+                              Rf_mkCharLenCE(value.data(), value.size(),
+                                             CE_NATIVE));
+            }
+            else
+            {
+               SET_STRING_ELT(columnSEXP, i,
+                              Rf_mkCharLenCE(field.begin, field.length,
+                                             CE_NATIVE));
+            }
+            break;
+         }
+      }
+
+      if (!ok)
+         return false;
+   }
+
+   *pColumnSEXP = columnSEXP;
+   return true;
+}
+
+// read a delimited file directly into a (named) list of column vectors.
+// column types are inferred from a sample of the rows (and re-inferred
+// from all of them if a later value doesn't fit)
+SEXP rs_readCsv(SEXP pathSEXP, SEXP headerSEXP, SEXP sepSEXP)
+{
+   try
+   {
+      if (!Rf_isString(pathSEXP) || Rf_length(pathSEXP) != 1)
+         throw r::exec::RErrorException("invalid path argument");
+      std::string sep = r::sexp::asString(sepSEXP);
+      if (sep.size() != 1)
+         throw r::exec::RErrorException("sep must be a single character");
+
+      FilePath filePath =
+             module_context::resolveAliasedPath(r::sexp::asString(pathSEXP));
+      bool header = r::sexp::asLogical(headerSEXP);
+
+      text::CsvReader reader(sep[0]);
+      Error error = reader.open(filePath);
+      if (!error)
+         error = reader.read();
+      if (error)
+         throw r::exec::RErrorException(error.summary());
+
+      std::size_t firstRow = header ? 1 : 0;
+      if (reader.rowCount() < firstRow)
+         firstRow = reader.rowCount();
+      std::size_t columns = reader.maxFieldCount();
+
+      r::sexp::Protect rProtect;
+      SEXP dataSEXP = Rf_allocVector(VECSXP, columns);
+      rProtect.add(dataSEXP);
+      SEXP namesSEXP = Rf_allocVector(STRSXP, columns);
+      rProtect.add(namesSEXP);
+      for (std::size_t i = 0; i < columns; i++)
+      {
+         SEXP columnSEXP = R_NilValue;
+         text::CsvColumnType type = reader.inferColumnType(i,
+                                                           firstRow,
+                                                           kCsvTypeSampleRows);
+         if (!csvColumnSEXP(reader, i, firstRow, type, &rProtect, &columnSEXP))
+         {
+            type = reader.inferColumnType(i, firstRow, reader.rowCount());
+            csvColumnSEXP(reader, i, firstRow, type, &rProtect, &columnSEXP);
+         }
+         SET_VECTOR_ELT(dataSEXP, i, columnSEXP);
+
+         std::string name = csvColumnName(reader, header, i);
+         SET_STRING_ELT(namesSEXP, i, Rf_mkCharLenCE(name.data(),
+                                                     name.size(),
+                                                     CE_NATIVE));
+      }
+      Rf_setAttrib(dataSEXP, R_NamesSymbol, namesSEXP);
+
+      return dataSEXP;
+   }
+   catch(r::exec::RErrorException& e)
+   {
+      r::exec::error(e.message());
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+
+   return R_NilValue;
+}
+
+// preview the start of a delimited file (only the rows previewed are read
+// so this returns right away even for very large files)
+Error getCsvPreview(const json::JsonRpcRequest& request,
+                    json::JsonRpcResponse* pResponse)
+{
+   std::string path, sep;
+   bool header;
+   Error error = json::readParams(request.params, &path, &header, &sep);
+   if (error)
+      return error;
+   if (sep.size() != 1)
+      return Error(json::errc::ParamInvalid, ERROR_LOCATION);
+
+   std::size_t firstRow = header ? 1 : 0;
+   text::CsvReader reader(sep[0]);
+   error = reader.open(module_context::resolveAliasedPath(path));
+   if (!error)
+      error = reader.read(kCsvPreviewRows + firstRow);
+   if (error)
+      return error;
+   if (reader.rowCount() < firstRow)
+      firstRow = reader.rowCount();
+
+   const char* const kTypeNames[] = { "logical", "integer",
+                                      "numeric", "character" };
+   json::Array namesJson, typesJson, columnsJson;
+   for (std::size_t i = 0; i < reader.maxFieldCount(); i++)
+   {
+      namesJson.push_back(csvColumnName(reader, header, i));
+      text::CsvColumnType type = reader.inferColumnType(i,
+                                                        firstRow,
+                                                        kCsvTypeSampleRows);
+      typesJson.push_back(std::string(kTypeNames[type]));
+
+      json::Array columnJson;
+      for (std::size_t row = firstRow; row < reader.rowCount(); row++)
+      {
+         text::CsvField field = reader.field(row, i);
+         if (text::isCsvMissing(field))
+            columnJson.push_back(json::Value());
+         else
+            columnJson.push_back(text::csvFieldValue(field));
+      }
+      columnsJson.push_back(columnJson);
+   }
+
+   json::Object resultJson;
+   resultJson["names"] = namesJson;
+   resultJson["types"] = typesJson;
+   resultJson["columns"] = columnsJson;
+   resultJson["rows"] = static_cast<int>(reader.rowCount() - firstRow);
+   pResponse->setResult(resultJson);
+   return Success();
+}
+
 void onClientInit()
 {
    // reset monitor and check for changes for brand new client
@@ -343,6 +892,13 @@ void onDetectChanges(module_context::ChangeSource source)
  
 Error initialize()
 {         
+   // register rs_readCsv
+   R_CallMethodDef readCsvMethodDef ;
+   readCsvMethodDef.name = "rs_readCsv" ;
+   readCsvMethodDef.fun = (DL_FUNC) rs_readCsv ;
+   readCsvMethodDef.numArgs = 3;
+   r::routines::addCallMethod(readCsvMethodDef);
+
    // add suspend handler
    using namespace session::module_context;
    addSuspendHandler(SuspendHandler(onSuspend, onResume));
@@ -356,6 +912,8 @@ Error initialize()
    ExecBlock initBlock ;
    initBlock.addFunctions()
       (bind(registerRBrowseFileHandler, handleRBrowseEnv))
+      (bind(registerRpcMethod, "list_objects_page", listObjectsPage))
+      (bind(registerRpcMethod, "get_csv_preview", getCsvPreview))
       (bind(sourceModuleRFile, "SessionWorkspace.R"));
    return initBlock.execute();
 }
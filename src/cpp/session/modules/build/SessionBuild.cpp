@@ -15,15 +15,20 @@
 
 #include "SessionBuild.hpp"
 
+#include <set>
 #include <vector>
 
 #include <boost/utility.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/format.hpp>
+#include <boost/regex.hpp>
+#include <boost/foreach.hpp>
 #include <boost/scope_exit.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/enable_shared_from_this.hpp>
 #include <boost/algorithm/string/split.hpp>
 #include <boost/algorithm/string/join.hpp>
+#include <boost/thread/thread.hpp>
 
 #include <core/Exec.hpp>
 #include <core/FileSerializer.hpp>
@@ -50,7 +55,9 @@
 #include "SessionBuildEnvironment.hpp"
 #include "SessionBuildErrors.hpp"
 #include "SessionBuildUtils.hpp"
+#include "SessionInstallPackages.hpp"
 #include "SessionSourceCpp.hpp"
+#include "SessionTestPackage.hpp"
 
 using namespace core;
 
@@ -138,10 +145,10 @@ namespace build {
 
 namespace {
 
-// track whether to force a package rebuild. we do this if the user
-// saves a header file (since the R CMD INSTALL makefile doesn't
-// force a rebuild for those changes)
-bool s_forcePackageRebuild = false;
+// track package header files which have changed since the last build
+// (since the R CMD INSTALL makefile doesn't force a rebuild for those
+// changes we need to remove the objects which depend on them)
+std::set<std::string> s_changedPackageHeaders;
 
 bool isPackageHeaderFile(const FilePath& filePath)
 {
@@ -163,36 +170,135 @@ bool isPackageHeaderFile(const FilePath& filePath)
 
 void onFileChanged(FilePath sourceFilePath)
 {
-   if (!s_forcePackageRebuild)
+   if (isPackageHeaderFile(sourceFilePath))
+      s_changedPackageHeaders.insert(sourceFilePath.filename());
+}
+
+void onFilesChanged(const std::vector<core::system::FileChangeEvent>& events)
+{
+   for (size_t i=0; i<events.size(); i++)
    {
-      if (isPackageHeaderFile(sourceFilePath))
-         s_forcePackageRebuild = true;
+      FilePath filePath(events[i].fileInfo().absolutePath());
+      onFileChanged(filePath);
    }
 }
 
-void onFilesChanged(const std::vector<core::system::FileChangeEvent>& events)
+std::set<std::string> collectChangedPackageHeaders()
+{
+   std::set<std::string> headers;
+   headers.swap(s_changedPackageHeaders);
+   return headers;
+}
+
+bool isCompiledSourceFile(const FilePath& filePath)
+{
+   std::string ext = filePath.extensionLowerCase();
+   return ext == ".c" || ext == ".cc" || ext == ".cpp" || ext == ".cxx" ||
+          ext == ".m" || ext == ".mm";
+}
+
+void collectPackageSourceFile(const FilePath& filePath,
+                              std::vector<FilePath>* pFiles)
 {
-   if (!s_forcePackageRebuild)
+   if (!filePath.isDirectory() &&
+       (isCompiledSourceFile(filePath) ||
+        boost::algorithm::starts_with(filePath.extensionLowerCase(), ".h")))
    {
-      for (size_t i=0; i<events.size(); i++)
-      {
-         FilePath filePath(events[i].fileInfo().absolutePath());
-         onFileChanged(filePath);
-      }
+      pFiles->push_back(filePath);
    }
 }
 
-bool collectForcePackageRebuild()
+// filenames of the headers included by a source or header file
+std::set<std::string> includedHeaders(const FilePath& filePath)
 {
-   if (s_forcePackageRebuild)
+   std::set<std::string> headers;
+
+   std::string contents;
+   Error error = readStringFromFile(filePath, &contents);
+   if (error)
    {
-      s_forcePackageRebuild = false;
-      return true;
+      LOG_ERROR(error);
+      return headers;
    }
-   else
+
+   boost::regex includeRegex("^\\s*#\\s*include\\s*[\"<]([^\">]+)[\">]");
+   boost::sregex_iterator it(contents.begin(), contents.end(), includeRegex);
+   boost::sregex_iterator end;
+   for (; it != end; ++it)
+      headers.insert(FilePath((*it)[1].str()).filename());
+   return headers;
+}
+
+bool includesAny(const std::set<std::string>& included,
+                 const std::set<std::string>& headers)
+{
+   BOOST_FOREACH(const std::string& header, included)
    {
-      return false;
+      if (headers.find(header) != headers.end())
+         return true;
+   }
+   return false;
+}
+
+// remove the object files for sources which (directly or indirectly)
+// include any of the specified headers so that only those sources are
+// recompiled by the next R CMD INSTALL. headers are matched by filename
+// so different headers with the same name cause extra (but not missing)
+// recompilation
+Error removeObjectsDependingOn(const FilePath& packagePath,
+                               std::set<std::string> headers)
+{
+   std::vector<FilePath> files;
+   FilePath srcPath = packagePath.childPath("src");
+   Error error = srcPath.childrenRecursive(
+                     boost::bind(collectPackageSourceFile, _2, &files));
+   if (error)
+      return error;
+   FilePath includePath = packagePath.childPath("inst/include");
+   if (includePath.exists())
+   {
+      error = includePath.childrenRecursive(
+                     boost::bind(collectPackageSourceFile, _2, &files));
+      if (error)
+         return error;
+   }
+
+   std::vector<std::pair<FilePath,std::set<std::string> > > includes;
+   BOOST_FOREACH(const FilePath& file, files)
+      includes.push_back(std::make_pair(file, includedHeaders(file)));
+
+   // add headers which include changed headers until there are no more
+   bool added = true;
+   while (added)
+   {
+      added = false;
+      for (std::size_t i = 0; i < includes.size(); i++)
+      {
+         const FilePath& file = includes[i].first;
+         if (!isCompiledSourceFile(file) &&
+             headers.find(file.filename()) == headers.end() &&
+             includesAny(includes[i].second, headers))
+         {
+            headers.insert(file.filename());
+            added = true;
+         }
+      }
+   }
+
+   // remove the objects for the sources which depend on them
+   for (std::size_t i = 0; i < includes.size(); i++)
+   {
+      const FilePath& file = includes[i].first;
+      if (isCompiledSourceFile(file) && includesAny(includes[i].second, headers))
+      {
+         FilePath objectPath = file.parent().childPath(file.stem() + ".o");
+         error = objectPath.removeIfExists();
+         if (error)
+            return error;
+      }
    }
+
+   return Success();
 }
 
 
@@ -200,6 +306,7 @@ const char * const kRoxygenizePackage = "roxygenize-package";
 const char * const kBuildSourcePackage = "build-source-package";
 const char * const kBuildBinaryPackage = "build-binary-package";
 const char * const kCheckPackage = "check-package";
+const char * const kTestPackage = "test-package";
 const char * const kBuildAndReload = "build-all";
 const char * const kRebuildAll = "rebuild-all";
 
@@ -214,9 +321,21 @@ public:
       return pBuild;
    }
 
+   static boost::shared_ptr<Build> createPackageInstall(
+                              const std::vector<PackageInstall>& installs,
+                              const std::string& libPath,
+                              const std::string& pkgType,
+                              std::size_t maxJobs)
+   {
+      boost::shared_ptr<Build> pBuild(new Build());
+      pBuild->startPackageInstall(installs, libPath, pkgType, maxJobs);
+      return pBuild;
+   }
+
 private:
    Build()
-      : isRunning_(false), terminationRequested_(false), restartR_(false)
+      : isRunning_(false), terminationRequested_(false), restartR_(false),
+        testShardsRunning_(0), testShardsPassed_(0), testLoadAll_(false)
    {
    }
 
@@ -251,6 +370,228 @@ private:
       executeBuild(type, cb);
    }
 
+   // install packages from the repositories, running installs which don't
+   // depend on each other concurrently (each in its own R process, which
+   // downloads the package and runs R CMD INSTALL on it)
+   void startPackageInstall(const std::vector<PackageInstall>& installs,
+                            const std::string& libPath,
+                            const std::string& pkgType,
+                            std::size_t maxJobs)
+   {
+      ClientEvent event(client_events::kBuildStarted);
+      module_context::enqueClientEvent(event);
+
+      isRunning_ = true;
+
+      pInstallScheduler_.reset(new PackageInstallScheduler(installs, maxJobs));
+      installLibPath_ = libPath;
+      installType_ = pkgType;
+
+      Error error = module_context::rScriptPath(&rScriptPath_);
+      if (error)
+      {
+         terminateWithError("attempting to locate R binary", error);
+         return;
+      }
+
+      childOptions_.terminateChildren = true;
+      core::system::Options childEnv;
+      core::system::environment(&childEnv);
+      std::string libPaths = module_context::libPathsString();
+      if (!libPaths.empty())
+         core::system::setenv(&childEnv, "R_LIBS", libPaths);
+#ifdef _WIN32
+      core::system::setenv(&childEnv, "CYGWIN", "nodosfilewarning");
+#endif
+      addRtoolsToPathIfNecessary(&childEnv, &postBuildWarning_);
+
+      // the cores are shared between the installs running at once (rather
+      // than each install's make using all of them)
+      if (core::system::getenv(childEnv, "MAKEFLAGS").empty())
+      {
+         std::size_t cores = std::max(1u, boost::thread::hardware_concurrency());
+         std::size_t jobs = std::max(static_cast<std::size_t>(1),
+                                     cores / std::max(maxJobs,
+                                                 static_cast<std::size_t>(1)));
+         core::system::setenv(&childEnv,
+                              "MAKEFLAGS",
+                              "-j" + safe_convert::numberToString(jobs));
+      }
+      addCompilationAccelerators(&childEnv);
+      childOptions_.environment = childEnv;
+
+      errorOutputFilterFunction_ = isPackageBuildError;
+
+      boost::format fmt("Installing %1% package(s) into %2% "
+                        "(up to %3% at once)");
+      enqueCommandString(boost::str(fmt % installs.size() %
+                                    module_context::createAliasedPath(
+                                       module_context::resolveAliasedPath(
+                                          libPath)) %
+                                    maxJobs));
+
+      startPackageInstalls();
+   }
+
+   void startPackageInstalls()
+   {
+      PackageInstall install;
+      while (!terminationRequested_ && pInstallScheduler_->next(&install))
+      {
+         Error error = runPackageInstall(install);
+         if (error)
+         {
+            enqueBuildOutput(kBuildOutputError,
+                             "* " + install.name + " failed to start: " +
+                             error.summary() + "\n");
+            packageInstallCompleted(install.name, false);
+         }
+      }
+
+      if (pInstallScheduler_->running() == 0 &&
+          (terminationRequested_ || pInstallScheduler_->finished()))
+      {
+         onPackageInstallsCompleted();
+      }
+   }
+
+   Error runPackageInstall(const PackageInstall& install)
+   {
+      using namespace core::string_utils;
+
+      std::string ext = ".tgz";
+      if (installType_ == "source")
+         ext = ".tar.gz";
+      else if (installType_ == "win.binary")
+         ext = ".zip";
+      std::string url = install.contribUrl + "/" + install.name + "_" +
+                        install.version + ext;
+
+      boost::format fmt(
+         "f <- file.path(tempdir(), basename('%1%')); "
+         "utils::download.file('%1%', f, mode = 'wb', quiet = TRUE); "
+         "quit(status = system2(file.path(R.home('bin'), 'R'), "
+                               "c('CMD', 'INSTALL', '-l', shQuote('%2%'), "
+                                 "shQuote(f))))");
+
+      std::vector<std::string> args;
+      args.push_back("--slave");
+      args.push_back("--no-save");
+      args.push_back("--no-restore");
+      args.push_back("-e");
+      args.push_back(boost::str(fmt % jsLiteralEscape(url) %
+                                jsLiteralEscape(installLibPath_)));
+
+      core::system::ProcessCallbacks cb;
+      cb.onContinue = boost::bind(&Build::onContinue,
+                                  Build::shared_from_this());
+      cb.onStdout = boost::bind(&Build::onChildOutput,
+                                Build::shared_from_this(), install.name, _2);
+      cb.onStderr = boost::bind(&Build::onChildOutput,
+                                Build::shared_from_this(), install.name, _2);
+      cb.onExit = boost::bind(&Build::onPackageInstallExit,
+                              Build::shared_from_this(), install.name, _1);
+
+      enqueBuildOutput(kBuildOutputNormal,
+                       "* installing " + install.name + " " +
+                       install.version + "\n");
+
+      return module_context::processSupervisor().runProgram(
+                                          rScriptPath_.absolutePath(),
+                                          args,
+                                          childOptions_,
+                                          cb);
+   }
+
+   // output of concurrent children (installs or test shards) is interleaved
+   // a line at a time, with each line prefixed by the child's name
+   void onChildOutput(const std::string& name, const std::string& output)
+   {
+      std::string& pending = childOutput_[name];
+      pending.append(output);
+
+      std::string::size_type pos;
+      while ((pos = pending.find('\n')) != std::string::npos)
+      {
+         enqueChildLine(name, pending.substr(0, pos));
+         pending.erase(0, pos + 1);
+      }
+   }
+
+   void enqueChildLine(const std::string& name, const std::string& line)
+   {
+      // the error parsers only ever see whole lines (so the output of one
+      // child can't be mixed into an error from another)
+      parseErrors(line + "\n");
+
+      int type = errorOutputFilterFunction_(line) ? kBuildOutputError :
+                                                    kBuildOutputNormal;
+      enqueBuildOutput(type, "[" + name + "] " + line + "\n");
+   }
+
+   void flushChildOutput(const std::string& name)
+   {
+      std::map<std::string, std::string>::iterator it =
+                                                   childOutput_.find(name);
+      if (it != childOutput_.end())
+      {
+         if (!it->second.empty())
+            enqueChildLine(name, it->second);
+         childOutput_.erase(it);
+      }
+   }
+
+   void onPackageInstallExit(const std::string& name, int exitStatus)
+   {
+      flushChildOutput(name);
+
+      bool succeeded = (exitStatus == EXIT_SUCCESS);
+      if (!succeeded && !terminationRequested_)
+      {
+         boost::format fmt("* %1% failed (exited with status %2%)\n");
+         enqueBuildOutput(kBuildOutputError, boost::str(fmt % name %
+                                                        exitStatus));
+      }
+      else if (succeeded)
+      {
+         enqueBuildOutput(kBuildOutputNormal, "* " + name + " installed\n");
+      }
+
+      packageInstallCompleted(name, succeeded);
+      startPackageInstalls();
+   }
+
+   void packageInstallCompleted(const std::string& name, bool succeeded)
+   {
+      std::vector<std::string> abandoned;
+      pInstallScheduler_->completed(name, succeeded, &abandoned);
+      BOOST_FOREACH(const std::string& package, abandoned)
+      {
+         enqueBuildOutput(kBuildOutputError,
+                          "* " + package + " not installed (depends on " +
+                          name + ")\n");
+      }
+   }
+
+   void onPackageInstallsCompleted()
+   {
+      std::size_t succeeded = pInstallScheduler_->succeeded();
+      std::size_t total = pInstallScheduler_->total();
+      boost::format fmt("\n%1% of %2% package(s) installed.\n\n");
+      enqueBuildOutput(succeeded == total ? kBuildOutputNormal :
+                                            kBuildOutputError,
+                       boost::str(fmt % succeeded % total));
+
+      // same housekeeping as after install.packages
+      Error error = r::exec::executeString(".rs.updatePackageEvents()");
+      if (error)
+         LOG_ERROR(error);
+      ClientEvent event(client_events::kInstalledPackagesChanged);
+      module_context::enqueClientEvent(event);
+
+      enqueBuildCompleted();
+   }
+
 
    void executeBuild(const std::string& type,
                      const core::system::ProcessCallbacks& cb)
@@ -318,6 +659,10 @@ private:
          if (roxygenize(packagePath))
             enqueBuildCompleted();
       }
+      else if (type == kTestPackage)
+      {
+         testPackage(packagePath, options);
+      }
       else
       {
          if (roxygenizeRequired(type))
@@ -503,6 +848,9 @@ private:
       // add r tools to path if necessary
       addRtoolsToPathIfNecessary(&childEnv, &postBuildWarning_);
 
+      // parallel make and ccache (if available)
+      addCompilationAccelerators(&childEnv);
+
       pkgOptions.environment = childEnv;
 
       // get R bin directory
@@ -531,8 +879,22 @@ private:
          // get extra args
          std::string extraArgs = projectConfig().packageInstallArgs;
 
-         // add --preclean if this is a rebuild all
-         if (collectForcePackageRebuild() || (type == kRebuildAll))
+         // add --preclean if this is a rebuild all. otherwise if headers
+         // have changed remove just the objects which depend on them (and
+         // fall back to a full rebuild if we can't)
+         std::set<std::string> changedHeaders = collectChangedPackageHeaders();
+         bool preclean = (type == kRebuildAll);
+         if (!preclean && !changedHeaders.empty())
+         {
+            Error error = removeObjectsDependingOn(packagePath,
+                                                   changedHeaders);
+            if (error)
+            {
+               LOG_ERROR(error);
+               preclean = true;
+            }
+         }
+         if (preclean)
          {
             if (!boost::algorithm::contains(extraArgs, "--preclean"))
                rCmd << "--preclean";
@@ -676,6 +1038,205 @@ private:
    }
 
 
+   // run the package's tests sharded across several R processes (long
+   // suites finish sooner and failures are reported as each shard finds
+   // them rather than at the end)
+   void testPackage(const FilePath& packagePath,
+                    const core::system::ProcessOptions& options)
+   {
+      Error error = findPackageTests(packagePath, &packageTests_);
+      if (error)
+      {
+         terminateWithError("finding package tests", error);
+         return;
+      }
+      if (packageTests_.files.empty())
+      {
+         boost::format fmt("ERROR: No tests found for package %1% "
+                           "(expected R files in tests/testthat or tests)\n");
+         terminateWithError(boost::str(fmt % pkgInfo_.name()));
+         return;
+      }
+
+      error = module_context::rScriptPath(&rScriptPath_);
+      if (error)
+      {
+         terminateWithError("attempting to locate R binary", error);
+         return;
+      }
+
+      childOptions_ = options;
+      childOptions_.terminateChildren = true;
+      core::system::Options childEnv;
+      core::system::environment(&childEnv);
+      std::string libPaths = module_context::libPathsString();
+      if (!libPaths.empty())
+         core::system::setenv(&childEnv, "R_LIBS", libPaths);
+#ifdef _WIN32
+      core::system::setenv(&childEnv, "CYGWIN", "nodosfilewarning");
+#endif
+      addRtoolsToPathIfNecessary(&childEnv, &postBuildWarning_);
+      addCompilationAccelerators(&childEnv);
+      childOptions_.environment = childEnv;
+
+      // failures are flagged in the output and added to the error list
+      // (along with any errors compiling the package's code)
+      CompileErrorParsers parsers;
+      parsers.add(testErrorParser(packageTests_.testsPath));
+      parsers.add(gccErrorParser(packagePath.complete("src")));
+      initErrorParser(packageTests_.testsPath, parsers);
+      errorOutputFilterFunction_ = isTestFailure;
+
+      std::size_t cores = std::max(1u, boost::thread::hardware_concurrency());
+      shardPackageTests(packageTests_.files, cores, &testShards_);
+
+      boost::format fmt("Testing %1% (%2% file(s) in %3% shard(s))");
+      enqueCommandString(boost::str(fmt % pkgInfo_.name() %
+                                    packageTests_.files.size() %
+                                    testShards_.size()));
+
+      // testthat tests are run against the package source when devtools
+      // is available. load_all compiles the package's code so we do that
+      // once up front (rather than in every shard at once)
+      testLoadAll_ = packageTests_.testthat &&
+                     module_context::isPackageInstalled("devtools");
+      if (testLoadAll_ && packagePath.childPath("src").exists())
+      {
+         error = runTestChild("compile",
+                              "devtools::compile_dll('" +
+                                 testRPath(packagePath) + "')",
+                              boost::bind(&Build::onTestCompileExit,
+                                          Build::shared_from_this(), _1));
+         if (error)
+            terminateWithError("compiling package", error);
+      }
+      else
+      {
+         startTestShards();
+      }
+   }
+
+   std::string testRPath(const FilePath& filePath)
+   {
+      return string_utils::jsLiteralEscape(
+                  string_utils::utf8ToSystem(filePath.absolutePath()));
+   }
+
+   Error runTestChild(const std::string& name,
+                      const std::string& code,
+                      const boost::function<void(int)>& onExit)
+   {
+      std::vector<std::string> args;
+      args.push_back("--slave");
+      args.push_back("--no-save");
+      args.push_back("--no-restore");
+      args.push_back("-e");
+      args.push_back(code);
+
+      core::system::ProcessCallbacks cb;
+      cb.onContinue = boost::bind(&Build::onContinue,
+                                  Build::shared_from_this());
+      cb.onStdout = boost::bind(&Build::onChildOutput,
+                                Build::shared_from_this(), name, _2);
+      cb.onStderr = boost::bind(&Build::onChildOutput,
+                                Build::shared_from_this(), name, _2);
+      cb.onExit = onExit;
+
+      return module_context::processSupervisor().runProgram(
+                                          rScriptPath_.absolutePath(),
+                                          args,
+                                          childOptions_,
+                                          cb);
+   }
+
+   void onTestCompileExit(int exitStatus)
+   {
+      flushChildOutput("compile");
+      if (exitStatus == EXIT_SUCCESS && !terminationRequested_)
+         startTestShards();
+      else
+         terminateWithErrorStatus(exitStatus);
+   }
+
+   void startTestShards()
+   {
+      FilePath modulesPath = session::options().modulesRSourcePath();
+      boost::format fmt("source('%1%'); runTestShard('%2%', '%3%', c(%4%), "
+                        "%5%, %6%)");
+
+      for (std::size_t i = 0; i < testShards_.size(); i++)
+      {
+         std::vector<std::string> files;
+         BOOST_FOREACH(const FilePath& file, testShards_[i])
+         {
+            files.push_back("'" + string_utils::jsLiteralEscape(
+                                 string_utils::utf8ToSystem(file.filename())) +
+                            "'");
+         }
+
+         std::string code = boost::str(
+               fmt % testRPath(modulesPath.complete("SessionTestPackage.R")) %
+                     testRPath(projects::projectContext().buildTargetPath()) %
+                     testRPath(packageTests_.testsPath) %
+                     boost::algorithm::join(files, ", ") %
+                     (packageTests_.testthat ? "TRUE" : "FALSE") %
+                     (testLoadAll_ ? "TRUE" : "FALSE"));
+
+         std::string name = "shard " + safe_convert::numberToString(i + 1);
+         Error error = runTestChild(name,
+                                    code,
+                                    boost::bind(&Build::onTestShardExit,
+                                                Build::shared_from_this(),
+                                                name,
+                                                _1));
+         if (error)
+         {
+            enqueBuildOutput(kBuildOutputError,
+                             "* " + name + " failed to start: " +
+                             error.summary() + "\n");
+            continue;
+         }
+
+         testShardsRunning_++;
+      }
+
+      if (testShardsRunning_ == 0)
+         onTestShardsCompleted();
+   }
+
+   void onTestShardExit(const std::string& name, int exitStatus)
+   {
+      flushChildOutput(name);
+
+      if (exitStatus == EXIT_SUCCESS)
+      {
+         testShardsPassed_++;
+         enqueBuildOutput(kBuildOutputNormal, "* " + name + " passed\n");
+      }
+      else if (!terminationRequested_)
+      {
+         boost::format fmt("* %1% failed (exited with status %2%)\n");
+         enqueBuildOutput(kBuildOutputError, boost::str(fmt % name %
+                                                        exitStatus));
+      }
+
+      if (testShardsRunning_ > 0 && --testShardsRunning_ == 0)
+         onTestShardsCompleted();
+   }
+
+   void onTestShardsCompleted()
+   {
+      addErrors(errorParsers_.finish());
+
+      bool succeeded = (testShardsPassed_ == testShards_.size());
+      boost::format fmt("\n%1% of %2% test shard(s) passed.\n\n");
+      enqueBuildOutput(succeeded ? kBuildOutputNormal : kBuildOutputError,
+                       boost::str(fmt % testShardsPassed_ %
+                                  testShards_.size()));
+
+      enqueBuildCompleted();
+   }
+
    void onBuildForCheckCompleted(
                          int exitStatus,
                          const RCommand& checkCmd,
@@ -747,7 +1308,9 @@ private:
       }
 
       // install the gcc error parser
-      initErrorParser(targetPath, gccErrorParser(targetPath));
+      CompileErrorParsers parsers;
+      parsers.add(gccErrorParser(targetPath));
+      initErrorParser(targetPath, parsers);
 
       std::string make = "make";
       if (!options_.makefileArgs.empty())
@@ -825,16 +1388,6 @@ public:
       return outputJson;
    }
 
-   std::string outputAsText()
-   {
-      std::string output;
-      BOOST_FOREACH(const BuildOutput& buildOutput, output_)
-      {
-         output.append(buildOutput.output);
-      }
-      return output;
-   }
-
    void terminate()
    {
       enqueBuildOutput(kBuildOutputNormal, "\n");
@@ -873,6 +1426,8 @@ private:
 
    void onStandardOutput(const std::string& output)
    {
+      parseErrors(output);
+
       if (errorOutputFilterFunction_)
          outputWithFilter(output);
       else
@@ -881,6 +1436,8 @@ private:
 
    void onStandardError(const std::string& output)
    {
+      parseErrors(output);
+
       if (errorOutputFilterFunction_)
          outputWithFilter(output);
       else
@@ -889,16 +1446,8 @@ private:
 
    void onCompleted(int exitStatus)
    {
-      // call the error parser if one has been specified
-      if (errorParser_)
-      {
-         std::vector<CompileError> errors = errorParser_(outputAsText());
-         if (!errors.empty())
-         {
-            errorsJson_ = compileErrorsAsJson(errors);
-            enqueBuildErrors(errorsJson_);
-         }
-      }
+      // parse errors from any trailing output
+      addErrors(errorParsers_.finish());
 
       if (exitStatus != EXIT_SUCCESS)
       {
@@ -939,6 +1488,24 @@ private:
       enqueBuildCompleted();
    }
 
+   void parseErrors(const std::string& output)
+   {
+      addErrors(errorParsers_.parse(output));
+   }
+
+   void addErrors(const std::vector<CompileError>& errors)
+   {
+      // errors are sent as they are found (each time with the full list)
+      if (!errors.empty())
+      {
+         json::Array errorsJson = compileErrorsAsJson(errors);
+         std::copy(errorsJson.begin(),
+                   errorsJson.end(),
+                   std::back_inserter(errorsJson_));
+         enqueBuildErrors(errorsJson_);
+      }
+   }
+
    void enqueBuildOutput(int type, const std::string& output)
    {
       BuildOutput buildOutput(type, output);
@@ -999,7 +1566,8 @@ private:
       return type + " package written to " + written;
    }
 
-   void initErrorParser(const FilePath& baseDir, CompileErrorParser parser)
+   void initErrorParser(const FilePath& baseDir,
+                        const CompileErrorParsers& parsers)
    {
       // set base dir -- make sure it ends with a / so the slash is
       // excluded from error display
@@ -1010,14 +1578,14 @@ private:
          errorsBaseDir_.append("/");
       }
 
-      errorParser_ = parser;
+      errorParsers_ = parsers;
    }
 
 private:
    bool isRunning_;
    bool terminationRequested_;
    std::vector<BuildOutput> output_;
-   CompileErrorParser errorParser_;
+   CompileErrorParsers errorParsers_;
    std::string errorsBaseDir_;
    json::Array errorsJson_;
    r_util::RPackageInfo pkgInfo_;
@@ -1028,6 +1596,21 @@ private:
    boost::function<void()> failureFunction_;
    boost::function<bool(const std::string&)> errorOutputFilterFunction_;
    bool restartR_;
+
+   // package installs
+   boost::scoped_ptr<PackageInstallScheduler> pInstallScheduler_;
+   std::string installLibPath_;
+   std::string installType_;
+   FilePath rScriptPath_;
+   core::system::ProcessOptions childOptions_;
+   std::map<std::string, std::string> childOutput_;
+
+   // package tests
+   PackageTests packageTests_;
+   std::vector<std::vector<FilePath> > testShards_;
+   std::size_t testShardsRunning_;
+   std::size_t testShardsPassed_;
+   bool testLoadAll_;
 };
 
 boost::shared_ptr<Build> s_pBuild;
@@ -1063,6 +1646,90 @@ Error startBuild(const json::JsonRpcRequest& request,
 
 
 
+Error installPackages(const json::JsonRpcRequest& request,
+                      json::JsonRpcResponse* pResponse)
+{
+   json::Array packagesJson;
+   std::string libPath;
+   Error error = json::readParams(request.params, &packagesJson, &libPath);
+   if (error)
+      return error;
+
+   // if we have a build already running then just return false
+   if (isBuildRunning())
+   {
+      pResponse->setResult(false);
+      return Success();
+   }
+
+   std::vector<std::string> packages;
+   BOOST_FOREACH(const json::Value& packageJson, packagesJson)
+   {
+      if (json::isType<std::string>(packageJson))
+         packages.push_back(packageJson.get_str());
+   }
+
+   std::vector<std::string> contribUrls;
+   error = r::exec::evaluateString<std::vector<std::string> >(
+         "contrib.url(getOption('repos'), .rs.packageInstallType())",
+         &contribUrls);
+   if (error)
+      return error;
+
+   std::string pkgType;
+   error = r::exec::evaluateString(".rs.packageInstallType()", &pkgType);
+   if (error)
+      return error;
+
+   std::vector<std::string> libPathStrings;
+   error = r::exec::evaluateString<std::vector<std::string> >(
+                                             ".libPaths()", &libPathStrings);
+   if (error)
+      return error;
+   std::vector<FilePath> libPaths;
+   BOOST_FOREACH(const std::string& libPathString, libPathStrings)
+   {
+      libPaths.push_back(FilePath(string_utils::systemToUtf8(libPathString)));
+   }
+
+   // the core budget is the one install.packages uses (getOption("Ncpus"))
+   // falling back to all of the cores
+   int ncpus = 0;
+   error = r::exec::evaluateString("as.integer(getOption('Ncpus', 0L))",
+                                   &ncpus);
+   if (error)
+      LOG_ERROR(error);
+   std::size_t maxJobs = ncpus > 0 ?
+                     static_cast<std::size_t>(ncpus) :
+                     std::max(1u, boost::thread::hardware_concurrency());
+
+   // if the repositories don't have every package we need then return
+   // false (the client falls back to install.packages, which reports it)
+   std::vector<PackageInstall> installs;
+   std::string unavailablePackage;
+   if (packages.empty() ||
+       !resolvePackageInstalls(packages,
+                               contribUrls,
+                               libPaths,
+                               &installs,
+                               &unavailablePackage))
+   {
+      pResponse->setResult(false);
+      return Success();
+   }
+
+   if (libPath.empty())
+      libPath = libPathStrings.empty() ? std::string() : libPathStrings[0];
+   else
+      libPath = string_utils::utf8ToSystem(
+                  module_context::resolveAliasedPath(libPath).absolutePath());
+
+   s_pBuild = Build::createPackageInstall(installs, libPath, pkgType, maxJobs);
+   pResponse->setResult(true);
+
+   return Success();
+}
+
 Error terminateBuild(const json::JsonRpcRequest& request,
                      json::JsonRpcResponse* pResponse)
 {
@@ -1319,6 +1986,7 @@ Error initialize()
    initBlock.addFunctions()
       (bind(registerRpcMethod, "start_build", startBuild))
       (bind(registerRpcMethod, "terminate_build", terminateBuild))
+      (bind(registerRpcMethod, "install_packages", installPackages))
       (bind(registerRpcMethod, "can_build_cpp", canBuildCpp))
       (bind(registerRpcMethod, "devtools_load_all_path", devtoolsLoadAllPath))
       (bind(sourceModuleRFile, "SessionBuild.R"))
@@ -17,12 +17,16 @@
 
 #include <string>
 #include <vector>
+#include <algorithm>
 
 #include <boost/regex.hpp>
 #include <boost/format.hpp>
 
 #include <core/Error.hpp>
+#include <core/Log.hpp>
 #include <core/FilePath.hpp>
+#include <core/BoostThread.hpp>
+#include <core/SafeConvert.hpp>
 
 #include <core/FileSerializer.hpp>
 #include <core/system/System.hpp>
@@ -231,6 +235,77 @@ bool addRtoolsToPathIfNecessary(core::system::Options* pEnvironment,
 
 #endif
 
+void addCompilationAccelerators(core::system::Options* pEnvironment)
+{
+   // parallel make
+   if (core::system::getenv(*pEnvironment, "MAKEFLAGS").empty())
+   {
+      unsigned int jobs = std::max(1u, boost::thread::hardware_concurrency());
+      core::system::setenv(pEnvironment,
+                           "MAKEFLAGS",
+                           "-j" + safe_convert::numberToString(jobs));
+   }
+
+#ifndef _WIN32
+   // ccache. we do this via a user Makevars file which wraps the compilers
+   // (including the user's own Makevars if they have one). if the user has
+   // already configured this themselves then we leave things alone
+   if (!core::system::getenv(*pEnvironment, "R_MAKEVARS_USER").empty())
+      return;
+
+   FilePath ccachePath = module_context::findProgram("ccache");
+   if (ccachePath.empty())
+      return;
+
+   std::string makevars;
+   FilePath userMakevarsPath =
+               module_context::userHomePath().childPath(".R/Makevars");
+   if (userMakevarsPath.exists())
+   {
+      std::string userMakevars;
+      Error error = readStringFromFile(userMakevarsPath, &userMakevars);
+      if (error)
+      {
+         LOG_ERROR(error);
+         return;
+      }
+      if (userMakevars.find("ccache") != std::string::npos)
+         return;
+
+      makevars.append("include " + userMakevarsPath.absolutePath() + "\n");
+   }
+
+   std::string ccache = ccachePath.absolutePath();
+   makevars.append("CC := " + ccache + " $(CC)\n");
+   makevars.append("CXX := " + ccache + " $(CXX)\n");
+
+   FilePath makevarsPath =
+      module_context::userScratchPath().childPath("build/ccache-Makevars");
+   std::string existing;
+   if (makevarsPath.exists())
+   {
+      Error error = readStringFromFile(makevarsPath, &existing);
+      if (error)
+         LOG_ERROR(error);
+   }
+   if (existing != makevars)
+   {
+      Error error = makevarsPath.parent().ensureDirectory();
+      if (!error)
+         error = writeStringToFile(makevarsPath, makevars);
+      if (error)
+      {
+         LOG_ERROR(error);
+         return;
+      }
+   }
+
+   core::system::setenv(pEnvironment,
+                        "R_MAKEVARS_USER",
+                        makevarsPath.absolutePath());
+#endif
+}
+
 
 } // namespace build
 } // namespace modules
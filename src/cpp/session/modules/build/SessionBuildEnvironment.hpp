@@ -30,6 +30,11 @@ bool addRtoolsToPathIfNecessary(std::string* pPath,
 bool addRtoolsToPathIfNecessary(core::system::Options* pEnvironment,
                                 std::string* pWarningMessage);
 
+// speed up compilation of package sources: run make in parallel (one job
+// per core) unless MAKEFLAGS is already set and, when it is installed,
+// compile through ccache (which can be disabled with CCACHE_DISABLE)
+void addCompilationAccelerators(core::system::Options* pEnvironment);
+
 } // namespace build
 } // namespace modules
 } // namespace session
@@ -15,9 +15,12 @@
 
 #include "SessionBuildErrors.hpp"
 
+#include <map>
+#include <deque>
 #include <algorithm>
 
 #include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/regex.hpp>
 #include <boost/foreach.hpp>
 #include <boost/format.hpp>
@@ -58,74 +61,57 @@ bool isMatchingFile(const std::vector<std::string>& lines,
           boost::algorithm::starts_with(lines[diagLine], nextLineContents);
 }
 
-FilePath scanForRSourceFile(const FilePath& basePath,
-                            std::size_t diagLine,
-                            const std::string& lineContents,
-                            const std::string& nextLineContents)
+class RErrorParser
 {
-   std::vector<FilePath> children;
-   Error error = basePath.children(&children);
-   if (error)
+public:
+   explicit RErrorParser(const FilePath& basePath)
+      : basePath_(basePath), sourceFilesRead_(false)
    {
-      LOG_ERROR(error);
-      return FilePath();
    }
 
-   BOOST_FOREACH(const FilePath& child, children)
+   std::vector<CompileError> operator()(const std::string& line)
    {
-      if (isRSourceFile(child))
+      std::vector<CompileError> errors;
+
+      // errors span three lines (the error and then two lines of context)
+      lines_.push_back(line);
+      if (lines_.size() > 3)
+         lines_.pop_front();
+      if (lines_.size() < 3)
+         return errors;
+
+      boost::regex errorRe("^Error in parse\\(outFile\\) : "
+                           "([0-9]+?):([0-9]+?): (.+?)$");
+      boost::regex lineRe("^([0-9]+?): (.*?)$");
+      boost::regex nextLineRe("^([0-9]+?): (.+?)$");
+      boost::smatch errorMatch, lineMatch, nextLineMatch;
+      if (!boost::regex_match(lines_[0], errorMatch, errorRe) ||
+          !boost::regex_match(lines_[1], lineMatch, lineRe) ||
+          !boost::regex_match(lines_[2], nextLineMatch, nextLineRe))
       {
-         std::vector<std::string> lines;
-         Error error = core::readStringVectorFromFile(child, &lines, false);
-         if (error)
-         {
-            LOG_ERROR(error);
-            continue;
-         }
-
-         if (isMatchingFile(lines, diagLine, lineContents, nextLineContents))
-            return child;
+         return errors;
       }
-   }
-
-   return FilePath();
-}
-
-std::vector<CompileError> parseRErrors(const FilePath& basePath,
-                                       const std::string& output)
-{
-   std::vector<CompileError> errors;
-
-   boost::regex re("^Error in parse\\(outFile\\) : ([0-9]+?):([0-9]+?): (.+?)\\n"
-                   "([0-9]+?): (.*?)\\n([0-9]+?): (.+?)$");
-   boost::sregex_iterator iter(output.begin(), output.end(), re,
-                               boost::regex_constants::match_not_dot_newline);
-   boost::sregex_iterator end;
-   for (; iter != end; iter++)
-   {
-      boost::smatch match = *iter;
-      BOOST_ASSERT(match.size() == 8);
+      lines_.clear();
 
       // first part is straightforward
-      std::string line = match[1];
-      std::string column = match[2];
-      std::string message = match[3];
+      std::string errLine = errorMatch[1];
+      std::string column = errorMatch[2];
+      std::string message = errorMatch[3];
 
       // we need to guess the file based on the contextual information
       // provided in the error message
-      int diagLine = core::safe_convert::stringTo<int>(match[4], -1);
+      int diagLine = core::safe_convert::stringTo<int>(lineMatch[1], -1);
       if (diagLine != -1)
       {
-         FilePath rSrcFile = scanForRSourceFile(basePath,
-                                                diagLine,
-                                                match[5],
-                                                match[7]);
+         FilePath rSrcFile = scanForRSourceFile(diagLine,
+                                                lineMatch[2],
+                                                nextLineMatch[2]);
          if (!rSrcFile.empty())
          {
             // create error and add it
             CompileError err(CompileError::Error,
                              rSrcFile,
-                             core::safe_convert::stringTo<int>(line, 1),
+                             core::safe_convert::stringTo<int>(errLine, 1),
                              core::safe_convert::stringTo<int>(column, 1),
                              message,
                              false);
@@ -133,55 +119,139 @@ std::vector<CompileError> parseRErrors(const FilePath& basePath,
          }
       }
 
+      return errors;
    }
 
-   return errors;
+private:
+   FilePath scanForRSourceFile(std::size_t diagLine,
+                               const std::string& lineContents,
+                               const std::string& nextLineContents)
+   {
+      // read the source files once (rather than for every error)
+      if (!sourceFilesRead_)
+      {
+         sourceFilesRead_ = true;
 
-}
+         std::vector<FilePath> children;
+         Error error = basePath_.children(&children);
+         if (error)
+            LOG_ERROR(error);
+
+         BOOST_FOREACH(const FilePath& child, children)
+         {
+            if (isRSourceFile(child))
+            {
+               std::vector<std::string> lines;
+               Error error = core::readStringVectorFromFile(child,
+                                                            &lines,
+                                                            false);
+               if (error)
+               {
+                  LOG_ERROR(error);
+                  continue;
+               }
+
+               sourceFiles_.push_back(std::make_pair(child, lines));
+            }
+         }
+      }
+
+      typedef std::pair<FilePath,std::vector<std::string> > SourceFile;
+      BOOST_FOREACH(const SourceFile& sourceFile, sourceFiles_)
+      {
+         if (isMatchingFile(sourceFile.second,
+                            diagLine,
+                            lineContents,
+                            nextLineContents))
+         {
+            return sourceFile.first;
+         }
+      }
+
+      return FilePath();
+   }
 
+private:
+   FilePath basePath_;
+   std::deque<std::string> lines_;
+   bool sourceFilesRead_;
+   std::vector<std::pair<FilePath,std::vector<std::string> > > sourceFiles_;
+};
 
-std::vector<CompileError> parseGccErrors(const FilePath& basePath,
-                                         const std::string& output)
+class GccErrorParser
 {
-   std::vector<CompileError> errors;
-
-   // parse standard gcc errors and warning lines but also pickup "from"
-   // prefixed errors and substitute the from file for the error/warning file
-   boost::regex re("(?:from (.+?):([0-9]+?).+?\\n)?"
-                   "^(.+?):([0-9]+?):(?:([0-9]+?):)? (error|warning): (.+)$");
-   boost::sregex_iterator iter(output.begin(), output.end(), re,
-                               boost::regex_constants::match_not_dot_newline);
-   boost::sregex_iterator end;
-   for (; iter != end; iter++)
+public:
+   explicit GccErrorParser(const FilePath& basePath)
+      : basePath_(basePath)
    {
-      boost::smatch match = *iter;
-      BOOST_ASSERT(match.size() == 8);
+   }
 
-      std::string file, line, column, type, message;
-      std::string match1 = match[1];
-      if (!match1.empty() && FilePath::isRootPath(match[1]))
-      {
-         file = match[1];
-         line = match[2];
-         column = "1";
-      }
-      else
+   std::vector<CompileError> operator()(const std::string& line)
+   {
+      std::vector<CompileError> errors;
+
+      // parse standard gcc errors and warning lines but also pickup "from"
+      // prefixed errors (on the previous line) and substitute the from
+      // file for the error/warning file
+      boost::regex re("^(.+?):([0-9]+?):(?:([0-9]+?):)? "
+                      "(error|warning): (.+)$");
+      boost::regex fromRe("from (.+?):([0-9]+?).+$");
+      boost::smatch match;
+      if (boost::regex_match(line, match, re))
       {
-         file = match[3];
-         line = match[4];
-         column = match[5];
-         if (column.empty())
+         std::string file, errLine, column, type, message;
+         boost::smatch fromMatch;
+         if (boost::regex_search(previousLine_, fromMatch, fromRe) &&
+             FilePath::isRootPath(fromMatch[1]))
+         {
+            file = fromMatch[1];
+            errLine = fromMatch[2];
             column = "1";
+         }
+         else
+         {
+            file = match[1];
+            errLine = match[2];
+            column = match[3];
+            if (column.empty())
+               column = "1";
+         }
+         type = match[4];
+         message = match[5];
+
+         // resolve type
+         CompileError::Type errType = (type == "warning") ?
+                                                   CompileError::Warning :
+                                                   CompileError::Error;
+
+         // create error and add it
+         CompileError err(errType,
+                          resolvePath(file),
+                          core::safe_convert::stringTo<int>(errLine, 1),
+                          core::safe_convert::stringTo<int>(column, 1),
+                          message,
+                          true);
+         errors.push_back(err);
       }
-      type = match[6];
-      message = match[7];
 
-      // resolve file path
+      previousLine_ = line;
+      return errors;
+   }
+
+private:
+   // the same few files tend to be reported over and over so cache the
+   // (comparatively expensive) resolution of their real paths
+   const FilePath& resolvePath(const std::string& file)
+   {
+      std::map<std::string,FilePath>::const_iterator it = paths_.find(file);
+      if (it != paths_.end())
+         return it->second;
+
       FilePath filePath;
       if (FilePath::isRootPath(file))
          filePath = FilePath(file);
       else
-         filePath = basePath.complete(file);
+         filePath = basePath_.complete(file);
       FilePath realPath;
       Error error = core::system::realPath(filePath, &realPath);
       if (error)
@@ -189,22 +259,51 @@ std::vector<CompileError> parseGccErrors(const FilePath& basePath,
       else
          filePath = realPath;
 
-      // resolve type
-      CompileError::Type errType = (type == "warning") ? CompileError::Warning :
-                                                         CompileError::Error;
-
-      // create error and add it
-      CompileError err(errType,
-                       filePath,
-                       core::safe_convert::stringTo<int>(line, 1),
-                       core::safe_convert::stringTo<int>(column, 1),
-                       message,
-                       true);
-      errors.push_back(err);
+      return paths_[file] = filePath;
    }
 
-   return errors;
-}
+private:
+   FilePath basePath_;
+   std::string previousLine_;
+   std::map<std::string,FilePath> paths_;
+};
+
+class TestErrorParser
+{
+public:
+   explicit TestErrorParser(const FilePath& basePath)
+      : basePath_(basePath)
+   {
+   }
+
+   std::vector<CompileError> operator()(const std::string& line)
+   {
+      std::vector<CompileError> errors;
+
+      // * FAILED <file>: <test> or * ERROR <file>: <message>
+      boost::regex re("^\\* (FAILED|ERROR) (.+?): (.*)$");
+      boost::smatch match;
+      if (boost::regex_match(line, match, re))
+      {
+         std::string message = match[3];
+         if (match[1] == "FAILED")
+            message = "Test failed: " + message;
+
+         CompileError err(CompileError::Error,
+                          basePath_.complete(match[2]),
+                          1,
+                          1,
+                          message,
+                          true);
+         errors.push_back(err);
+      }
+
+      return errors;
+   }
+
+private:
+   FilePath basePath_;
+};
 
 // NOTE: sync changes with SessionCompilePdf.cpp logEntryJson
 json::Value compileErrorJson(const CompileError& compileError)
@@ -236,12 +335,20 @@ json::Array compileErrorsAsJson(const std::vector<CompileError>& errors)
 
 CompileErrorParser gccErrorParser(const FilePath& basePath)
 {
-   return boost::bind(parseGccErrors, basePath, _1);
+   boost::shared_ptr<GccErrorParser> pParser(new GccErrorParser(basePath));
+   return boost::bind(&GccErrorParser::operator(), pParser, _1);
 }
 
 CompileErrorParser rErrorParser(const FilePath& basePath)
 {
-   return boost::bind(parseRErrors, basePath, _1);
+   boost::shared_ptr<RErrorParser> pParser(new RErrorParser(basePath));
+   return boost::bind(&RErrorParser::operator(), pParser, _1);
+}
+
+CompileErrorParser testErrorParser(const FilePath& basePath)
+{
+   boost::shared_ptr<TestErrorParser> pParser(new TestErrorParser(basePath));
+   return boost::bind(&TestErrorParser::operator(), pParser, _1);
 }
 
 
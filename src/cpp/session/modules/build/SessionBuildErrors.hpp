@@ -58,7 +58,10 @@ struct CompileError
 };
 
 core::json::Array compileErrorsAsJson(const std::vector<CompileError>& errors);
-   
+
+// error parsers are called with each line of output (without its line
+// terminator) as the output arrives and return any errors the line
+// completes (parsers can keep state between lines)
 typedef boost::function<std::vector<CompileError>(const std::string&)>
                                                          CompileErrorParser;
 
@@ -75,26 +78,61 @@ public:
    }
 
 public:
-   std::vector<CompileError> operator()(const std::string& output)
+   // parse a chunk of output (lines may be split across chunks)
+   std::vector<CompileError> parse(const std::string& output)
    {
       std::vector<CompileError> allErrors;
-      BOOST_FOREACH(const CompileErrorParser& parser, parsers_)
+
+      pending_.append(output);
+      std::size_t begin = 0;
+      std::size_t end;
+      while ((end = pending_.find('\n', begin)) != std::string::npos)
       {
-         std::vector<CompileError> errors = parser(output);
-         std::copy(errors.begin(), errors.end(), std::back_inserter(allErrors));
+         parseLine(pending_.substr(begin, end - begin), &allErrors);
+         begin = end + 1;
       }
+      pending_.erase(0, begin);
+
+      return allErrors;
+   }
 
+   // parse any remaining output (call once the output is complete)
+   std::vector<CompileError> finish()
+   {
+      std::vector<CompileError> allErrors;
+      if (!pending_.empty())
+      {
+         parseLine(pending_, &allErrors);
+         pending_.clear();
+      }
       return allErrors;
    }
 
+private:
+   void parseLine(std::string line, std::vector<CompileError>* pErrors)
+   {
+      if (!line.empty() && line[line.size()-1] == '\r')
+         line.erase(line.size()-1);
+
+      BOOST_FOREACH(const CompileErrorParser& parser, parsers_)
+      {
+         std::vector<CompileError> errors = parser(line);
+         std::copy(errors.begin(), errors.end(), std::back_inserter(*pErrors));
+      }
+   }
+
 private:
    std::vector<CompileErrorParser> parsers_;
+   std::string pending_;
 };
 
 CompileErrorParser gccErrorParser(const core::FilePath& basePath);
 
 CompileErrorParser rErrorParser(const core::FilePath& basePath);
 
+// failures reported by the package test runner (one per failed test)
+CompileErrorParser testErrorParser(const core::FilePath& basePath);
+
 
 } // namespace build
 } // namespace modules
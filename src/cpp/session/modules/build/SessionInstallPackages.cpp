@@ -0,0 +1,312 @@
+/*
+ * SessionInstallPackages.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "SessionInstallPackages.hpp"
+
+#include <set>
+#include <deque>
+#include <algorithm>
+
+#include <boost/foreach.hpp>
+#include <boost/algorithm/string/trim.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
+
+#include <core/FilePath.hpp>
+#include <core/r_util/RRepositoryIndex.hpp>
+
+#include "../SessionPackages.hpp"
+
+using namespace core;
+
+namespace session {
+namespace modules {
+namespace build {
+
+namespace {
+
+// the dependency fields which install.packages follows by default
+const char * const kDependencyFields[] = { "Depends", "Imports", "LinkingTo" };
+
+struct AvailablePackage
+{
+   std::string version;
+   std::string contribUrl;
+   std::vector<std::string> dependencies;
+};
+
+typedef std::map<std::string, AvailablePackage> AvailablePackages;
+
+void parseDependencies(const std::string& field,
+                       std::vector<std::string>* pDependencies)
+{
+   std::vector<std::string> entries;
+   boost::algorithm::split(entries, field, boost::algorithm::is_any_of(","));
+   BOOST_FOREACH(std::string entry, entries)
+   {
+      // drop any version requirement, e.g. Rcpp (>= 0.10.1)
+      std::string::size_type pos = entry.find('(');
+      if (pos != std::string::npos)
+         entry.erase(pos);
+      boost::algorithm::trim(entry);
+
+      if (!entry.empty() && entry != "R")
+         pDependencies->push_back(entry);
+   }
+}
+
+int fieldIndex(const std::vector<std::string>& fields, const std::string& name)
+{
+   std::vector<std::string>::const_iterator it =
+                              std::find(fields.begin(), fields.end(), name);
+   return it != fields.end() ? static_cast<int>(it - fields.begin()) : -1;
+}
+
+void addAvailablePackages(const std::string& contribUrl,
+                          const r_util::RRepositoryIndex& index,
+                          AvailablePackages* pAvailable)
+{
+   const std::vector<std::string>& fields = index.fields();
+   int versionIndex = fieldIndex(fields, "Version");
+   std::vector<int> dependencyIndexes;
+   for (std::size_t i = 0;
+        i < sizeof(kDependencyFields) / sizeof(kDependencyFields[0]);
+        i++)
+   {
+      int index = fieldIndex(fields, kDependencyFields[i]);
+      if (index != -1)
+         dependencyIndexes.push_back(index);
+   }
+
+   if (versionIndex == -1)
+      return;
+
+   BOOST_FOREACH(const std::vector<std::string>& package, index.packages())
+   {
+      // repositories earlier in the list take precedence (Package is always
+      // the first field of the index)
+      if (pAvailable->find(package[0]) != pAvailable->end())
+         continue;
+
+      AvailablePackage& available = (*pAvailable)[package[0]];
+      available.version = package[versionIndex];
+      available.contribUrl = contribUrl;
+      BOOST_FOREACH(int index, dependencyIndexes)
+      {
+         parseDependencies(package[index], &available.dependencies);
+      }
+   }
+}
+
+bool isInstalled(const std::string& package,
+                 const std::vector<FilePath>& libPaths)
+{
+   BOOST_FOREACH(const FilePath& libPath, libPaths)
+   {
+      if (libPath.childPath(package).childPath("DESCRIPTION").exists())
+         return true;
+   }
+   return false;
+}
+
+// depth first walk of the dependency graph (installs are appended once all
+// of their dependencies have been, so the result is topologically ordered)
+class InstallResolver
+{
+public:
+   InstallResolver(const AvailablePackages& available,
+                   const std::vector<FilePath>& libPaths,
+                   std::vector<PackageInstall>* pInstalls)
+      : available_(available), libPaths_(libPaths), pInstalls_(pInstalls)
+   {
+   }
+
+   bool resolve(const std::string& package,
+                bool requested,
+                std::string* pUnavailablePackage)
+   {
+      // already resolved (or a dependency cycle, which R doesn't allow
+      // for these fields but a broken repository could still contain)
+      if (visited_.count(package))
+         return true;
+      visited_.insert(package);
+
+      // dependencies which are already installed are left alone (we don't
+      // attempt to satisfy version requirements)
+      if (!requested && isInstalled(package, libPaths_))
+         return true;
+
+      AvailablePackages::const_iterator it = available_.find(package);
+      if (it == available_.end())
+      {
+         *pUnavailablePackage = package;
+         return false;
+      }
+
+      PackageInstall install;
+      install.name = package;
+      install.version = it->second.version;
+      install.contribUrl = it->second.contribUrl;
+      BOOST_FOREACH(const std::string& dependency, it->second.dependencies)
+      {
+         if (!resolve(dependency, false, pUnavailablePackage))
+            return false;
+
+         if (installing_.count(dependency) &&
+             std::find(install.dependencies.begin(),
+                       install.dependencies.end(),
+                       dependency) == install.dependencies.end())
+         {
+            install.dependencies.push_back(dependency);
+         }
+      }
+
+      pInstalls_->push_back(install);
+      installing_.insert(package);
+      return true;
+   }
+
+private:
+   const AvailablePackages& available_;
+   const std::vector<FilePath>& libPaths_;
+   std::vector<PackageInstall>* pInstalls_;
+   std::set<std::string> visited_;
+   std::set<std::string> installing_;
+};
+
+} // anonymous namespace
+
+bool resolvePackageInstalls(const std::vector<std::string>& packages,
+                            const std::vector<std::string>& contribUrls,
+                            const std::vector<FilePath>& libPaths,
+                            std::vector<PackageInstall>* pInstalls,
+                            std::string* pUnavailablePackage)
+{
+   AvailablePackages available;
+   BOOST_FOREACH(const std::string& contribUrl, contribUrls)
+   {
+      r_util::RRepositoryIndex index;
+      if (packages::repositoryIndex(contribUrl, &index))
+         addAvailablePackages(contribUrl, index, &available);
+   }
+
+   InstallResolver resolver(available, libPaths, pInstalls);
+   BOOST_FOREACH(const std::string& package, packages)
+   {
+      if (!resolver.resolve(package, true, pUnavailablePackage))
+         return false;
+   }
+
+   return true;
+}
+
+PackageInstallScheduler::PackageInstallScheduler(
+                                 const std::vector<PackageInstall>& installs,
+                                 std::size_t maxJobs)
+   : installs_(installs),
+     maxJobs_(std::max(maxJobs, static_cast<std::size_t>(1))),
+     running_(0),
+     succeeded_(0)
+{
+   for (std::size_t i = 0; i < installs_.size(); i++)
+   {
+      waiting_[i] = installs_[i].dependencies.size();
+      BOOST_FOREACH(const std::string& dependency, installs_[i].dependencies)
+      {
+         dependents_[dependency].push_back(i);
+      }
+   }
+}
+
+bool PackageInstallScheduler::next(PackageInstall* pInstall)
+{
+   if (running_ >= maxJobs_)
+      return false;
+
+   // prefer installs in dependency order so the longest chains start first
+   for (std::map<std::size_t, std::size_t>::iterator it = waiting_.begin();
+        it != waiting_.end();
+        ++it)
+   {
+      if (it->second == 0)
+      {
+         *pInstall = installs_[it->first];
+         waiting_.erase(it);
+         running_++;
+         return true;
+      }
+   }
+
+   return false;
+}
+
+void PackageInstallScheduler::completed(const std::string& name,
+                                        bool succeeded,
+                                        std::vector<std::string>* pAbandoned)
+{
+   if (running_ > 0)
+      running_--;
+
+   if (succeeded)
+   {
+      succeeded_++;
+      BOOST_FOREACH(std::size_t dependent, dependents_[name])
+      {
+         std::map<std::size_t, std::size_t>::iterator it =
+                                                   waiting_.find(dependent);
+         if (it != waiting_.end() && it->second > 0)
+            it->second--;
+      }
+      return;
+   }
+
+   std::deque<std::string> failed;
+   failed.push_back(name);
+   while (!failed.empty())
+   {
+      std::string package = failed.front();
+      failed.pop_front();
+
+      BOOST_FOREACH(std::size_t dependent, dependents_[package])
+      {
+         if (waiting_.erase(dependent))
+         {
+            pAbandoned->push_back(installs_[dependent].name);
+            failed.push_back(installs_[dependent].name);
+         }
+      }
+   }
+}
+
+bool PackageInstallScheduler::finished() const
+{
+   if (running_ > 0)
+      return false;
+
+   for (std::map<std::size_t, std::size_t>::const_iterator it =
+                                                         waiting_.begin();
+        it != waiting_.end();
+        ++it)
+   {
+      if (it->second == 0)
+         return false;
+   }
+
+   return true;
+}
+
+} // namespace build
+} // namespace modules
+} // namespace session
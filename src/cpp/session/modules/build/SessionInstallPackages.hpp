@@ -0,0 +1,96 @@
+/*
+ * SessionInstallPackages.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SESSION_INSTALL_PACKAGES_HPP
+#define SESSION_INSTALL_PACKAGES_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace core {
+   class FilePath;
+}
+
+namespace session {
+namespace modules {
+namespace build {
+
+struct PackageInstall
+{
+   std::string name;
+   std::string version;
+   std::string contribUrl;
+
+   // packages within the same set of installs which must install first
+   std::vector<std::string> dependencies;
+};
+
+// resolve the installs required to install packages from the repositories
+// at contribUrls: the packages themselves along with those of their
+// (recursive) Depends, Imports and LinkingTo which aren't installed within
+// any of libPaths. installs are ordered so each follows its dependencies.
+// returns false (with the offending package) if a package isn't available
+bool resolvePackageInstalls(const std::vector<std::string>& packages,
+                            const std::vector<std::string>& contribUrls,
+                            const std::vector<core::FilePath>& libPaths,
+                            std::vector<PackageInstall>* pInstalls,
+                            std::string* pUnavailablePackage);
+
+// hands out installs once all of their dependencies have installed, with
+// no more than maxJobs of them running at once
+class PackageInstallScheduler
+{
+public:
+   PackageInstallScheduler(const std::vector<PackageInstall>& installs,
+                           std::size_t maxJobs);
+
+   // COPYING: via compiler
+
+   // take the next install which can start (false if none can yet)
+   bool next(PackageInstall* pInstall);
+
+   // record that an install finished. if it failed then the installs which
+   // depend on it (directly or not) are abandoned and returned
+   void completed(const std::string& name,
+                  bool succeeded,
+                  std::vector<std::string>* pAbandoned);
+
+   // true once no installs are running and no more can start
+   bool finished() const;
+
+   std::size_t total() const { return installs_.size(); }
+   std::size_t running() const { return running_; }
+   std::size_t succeeded() const { return succeeded_; }
+
+private:
+   std::vector<PackageInstall> installs_;
+   std::size_t maxJobs_;
+   std::size_t running_;
+   std::size_t succeeded_;
+
+   // installs which haven't started yet (by index) and the number of
+   // their dependencies still to install
+   std::map<std::size_t, std::size_t> waiting_;
+
+   // installs which depend on each package
+   std::map<std::string, std::vector<std::size_t> > dependents_;
+};
+
+} // namespace build
+} // namespace modules
+} // namespace session
+
+#endif // SESSION_INSTALL_PACKAGES_HPP
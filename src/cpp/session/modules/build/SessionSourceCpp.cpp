@@ -25,6 +25,8 @@
 #include <core/StringUtils.hpp>
 
 #include <r/RSexp.hpp>
+#include <r/RExec.hpp>
+#include <r/ROptions.hpp>
 #include <r/RRoutines.hpp>
 
 #include <session/SessionModuleContext.hpp>
@@ -90,8 +92,11 @@ void enqueSourceCppCompleted(const FilePath& sourceFile,
 
    // parse errors
    std::string allOutput = output + "\n" + errorOutput;
-   CompileErrorParser errorParser = gccErrorParser(sourceFile.parent());
-   std::vector<CompileError> errors = errorParser(allOutput);
+   CompileErrorParsers errorParsers;
+   errorParsers.add(gccErrorParser(sourceFile.parent()));
+   std::vector<CompileError> errors = errorParsers.parse(allOutput);
+   std::vector<CompileError> lastErrors = errorParsers.finish();
+   errors.insert(errors.end(), lastErrors.begin(), lastErrors.end());
    sourceCppState.errors = compileErrorsAsJson(errors);
 
    // enque event
@@ -259,6 +264,34 @@ SEXP rs_sourceCppOnBuildComplete(SEXP sSucceeded, SEXP sOutput)
 }
 
 
+// keep sourceCpp builds in the user scratch path (rather than the session
+// temp dir) so they survive restarts. Rcpp keys the builds within the cache
+// dir by platform and Rcpp version and only rebuilds when the source file
+// or its dependencies change; we add the R version
+Error initializeCacheDir()
+{
+   // respect the user's own setting
+   if (r::options::getOption("rcpp.cache.dir") != R_NilValue)
+      return Success();
+
+   std::string rVersion;
+   Error error = r::exec::evaluateString(
+         "paste(R.version$major, R.version$minor, sep = '.')", &rVersion);
+   if (error)
+      return error;
+
+   FilePath cacheDir = module_context::userScratchPath()
+                              .complete("sourceCpp-cache")
+                              .complete(rVersion);
+   error = cacheDir.ensureDirectory();
+   if (error)
+      return error;
+
+   return r::options::setOption(
+            "rcpp.cache.dir",
+            string_utils::utf8ToSystem(cacheDir.absolutePath()));
+}
+
 } // anonymous namespace
 
 
@@ -279,6 +312,11 @@ Error initialize()
    sourceCppOnBuildCompleteMethodDef.numArgs = 2;
    r::routines::addCallMethod(sourceCppOnBuildCompleteMethodDef);
 
+   // persistent build cache (not fatal if we can't set it up)
+   Error error = initializeCacheDir();
+   if (error)
+      LOG_ERROR(error);
+
    return Success();
 }
 
@@ -0,0 +1,118 @@
+/*
+ * SessionTestPackage.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "SessionTestPackage.hpp"
+
+#include <algorithm>
+
+#include <boost/foreach.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+
+#include <core/Error.hpp>
+
+using namespace core;
+
+namespace session {
+namespace modules {
+namespace build {
+
+namespace {
+
+bool isTestFile(const FilePath& filePath, bool testthat)
+{
+   if (filePath.isDirectory() || filePath.extensionLowerCase() != ".r")
+      return false;
+
+   // testthat only runs files named test*
+   if (testthat)
+      return boost::algorithm::starts_with(filePath.filename(), "test");
+   else
+      return true;
+}
+
+bool compareSizeDescending(const FilePath& a, const FilePath& b)
+{
+   return a.size() > b.size();
+}
+
+} // anonymous namespace
+
+Error findPackageTests(const FilePath& packagePath, PackageTests* pTests)
+{
+   pTests->testsPath = packagePath.childPath("tests");
+   pTests->testthat = false;
+   pTests->files.clear();
+   if (!pTests->testsPath.exists())
+      return Success();
+
+   FilePath testthatPath = pTests->testsPath.childPath("testthat");
+   if (testthatPath.exists())
+   {
+      pTests->testsPath = testthatPath;
+      pTests->testthat = true;
+   }
+
+   std::vector<FilePath> children;
+   Error error = pTests->testsPath.children(&children);
+   if (error)
+      return error;
+
+   BOOST_FOREACH(const FilePath& child, children)
+   {
+      if (isTestFile(child, pTests->testthat))
+         pTests->files.push_back(child);
+   }
+
+   return Success();
+}
+
+void shardPackageTests(const std::vector<FilePath>& files,
+                       std::size_t maxShards,
+                       std::vector<std::vector<FilePath> >* pShards)
+{
+   std::size_t shards = std::min(files.size(),
+                                 std::max(maxShards,
+                                          static_cast<std::size_t>(1)));
+   pShards->assign(shards, std::vector<FilePath>());
+   std::vector<uintmax_t> sizes(shards, 0);
+
+   // file size is only a proxy for how long the tests take to run but it
+   // keeps one shard from ending up with all of the big suites
+   std::vector<FilePath> sorted(files);
+   std::stable_sort(sorted.begin(), sorted.end(), compareSizeDescending);
+   BOOST_FOREACH(const FilePath& file, sorted)
+   {
+      std::size_t smallest = std::min_element(sizes.begin(), sizes.end()) -
+                             sizes.begin();
+      pShards->at(smallest).push_back(file);
+      sizes[smallest] += file.size();
+   }
+
+   // within a shard run files in their usual (alphabetical) order
+   BOOST_FOREACH(std::vector<FilePath>& shard, *pShards)
+   {
+      std::sort(shard.begin(), shard.end());
+   }
+}
+
+bool isTestFailure(const std::string& line)
+{
+   return boost::algorithm::starts_with(line, "* FAILED ") ||
+          boost::algorithm::starts_with(line, "* ERROR ");
+}
+
+} // namespace build
+} // namespace modules
+} // namespace session
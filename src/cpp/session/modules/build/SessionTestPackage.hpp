@@ -0,0 +1,61 @@
+/*
+ * SessionTestPackage.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SESSION_TEST_PACKAGE_HPP
+#define SESSION_TEST_PACKAGE_HPP
+
+#include <string>
+#include <vector>
+
+#include <core/FilePath.hpp>
+
+namespace core {
+   class Error;
+}
+
+namespace session {
+namespace modules {
+namespace build {
+
+struct PackageTests
+{
+   PackageTests() : testthat(false) {}
+
+   // directory the tests are run from
+   core::FilePath testsPath;
+
+   // tests/testthat/test*.R (otherwise plain R scripts in tests/)
+   bool testthat;
+
+   std::vector<core::FilePath> files;
+};
+
+core::Error findPackageTests(const core::FilePath& packagePath,
+                             PackageTests* pTests);
+
+// divide test files between (at most) maxShards shards of roughly equal
+// size (the largest files are assigned first, each to the smallest shard)
+void shardPackageTests(const std::vector<core::FilePath>& files,
+                       std::size_t maxShards,
+                       std::vector<std::vector<core::FilePath> >* pShards);
+
+// lines written by the shard runner (SessionTestPackage.R) for failures
+bool isTestFailure(const std::string& line);
+
+} // namespace build
+} // namespace modules
+} // namespace session
+
+#endif // SESSION_TEST_PACKAGE_HPP
@@ -26,7 +26,6 @@
 #include <core/DateTime.hpp>
 #include <core/StringUtils.hpp>
 #include <core/SafeConvert.hpp>
-#include <core/FileSerializer.hpp>
 
 #include <r/RSexp.hpp>
 #include <r/RExec.hpp>
@@ -39,6 +38,17 @@ namespace session {
 namespace modules { 
 namespace presentation {
 
+namespace {
+
+// how long entries are buffered before being written
+const int kFlushDelaySeconds = 5;
+
+// error output retained for each input entry (output beyond this is
+// dropped rather than accumulated)
+const std::size_t kMaxErrorOutput = 4096;
+
+} // anonymous namespace
+
 Log& log()
 {
    static Log instance;
@@ -48,6 +58,8 @@ Log& log()
 
 Error Log::initialize()
 {
+   logFilePath_ = module_context::userScratchPath().childPath(
+                                       "presentation/presentation-log.csv");
 
    // connect to console events
    using namespace boost;
@@ -59,6 +71,7 @@ Error Log::initialize()
                                                this, _1));
    events().onConsoleOutput.connect(boost::bind(&Log::onConsoleOutput,
                                                 this, _1, _2));
+   events().onShutdown.connect(boost::bind(&Log::onShutdown, this, _1));
 
    return Success();
 }
@@ -130,6 +143,7 @@ void Log::onConsolePrompt(const std::string& prompt)
 
    consoleInputBuffer_.clear();
    errorOutputBuffer_.clear();
+   errorOutputSize_ = 0;
 }
 
 
@@ -141,6 +155,7 @@ void Log::onConsoleInput(const std::string& text)
    consoleInputBuffer_.push_back(text);
 
    errorOutputBuffer_.clear();
+   errorOutputSize_ = 0;
 }
 
 
@@ -150,8 +165,13 @@ void Log::onConsoleOutput(module_context::ConsoleOutputType type,
    if (!presentation::state::isActive())
       return;
 
-   if (type == module_context::ConsoleOutputError)
-      errorOutputBuffer_.push_back(output);
+   if (type == module_context::ConsoleOutputError &&
+       errorOutputSize_ < kMaxErrorOutput)
+   {
+      errorOutputBuffer_.push_back(output.substr(0,
+                                       kMaxErrorOutput - errorOutputSize_));
+      errorOutputSize_ += errorOutputBuffer_.back().size();
+   }
 
 }
 
@@ -172,28 +192,6 @@ void Log::append(EntryType type,
                  const std::string& input,
                  const std::string& errors)
 {
-   // determine log file path and ensure it exists
-   using namespace module_context;
-   FilePath presDir =  userScratchPath().childPath("presentation");
-   Error error = presDir.ensureDirectory();
-   if (error)
-   {
-      LOG_ERROR(error);
-      return;
-   }
-
-   FilePath logFilePath = presDir.childPath("presentation-log.csv");
-   if (!logFilePath.exists())
-   {
-      Error error = core::writeStringToFile(logFilePath,
-         "type, timestamp, presentation, slide, input, errors\n");
-      if (error)
-      {
-         LOG_ERROR(error);
-         return;
-      }
-   }
-
    // generate timestamp
    using namespace boost::posix_time;
    ptime time = microsec_clock::universal_time();
@@ -209,10 +207,87 @@ void Log::append(EntryType type,
    fields.push_back(csvString(errors));
    std::string entry = boost::algorithm::join(fields, ",");
 
-   // append entry
-   error = core::appendToFile(logFilePath, entry + "\n");
-   if (error)
-      LOG_ERROR(error);
+   // buffer entry (scheduling a flush if there isn't one pending)
+   bool scheduleFlush = false;
+   LOCK_MUTEX(*pMutex_)
+   {
+      pendingEntries_.append(entry + "\n");
+      if (!flushScheduled_)
+      {
+         flushScheduled_ = true;
+         scheduleFlush = true;
+      }
+   }
+   END_LOCK_MUTEX
+
+   if (scheduleFlush)
+   {
+      module_context::scheduleDelayedWork(
+                        boost::posix_time::seconds(kFlushDelaySeconds),
+                        boost::bind(&Log::flushInBackground, this),
+                        false);
+   }
+}
+
+void Log::flushInBackground()
+{
+   module_context::executeInBackground(boost::bind(&Log::flush, this));
+}
+
+void Log::flush()
+{
+   LOCK_MUTEX(*pWriteMutex_)
+   {
+      std::string entries;
+      LOCK_MUTEX(*pMutex_)
+      {
+         entries.swap(pendingEntries_);
+         flushScheduled_ = false;
+      }
+      END_LOCK_MUTEX
+
+      if (entries.empty())
+         return;
+
+      // open the log file (writing the header if it's new)
+      if (!pLogStream_)
+      {
+         Error error = logFilePath_.parent().ensureDirectory();
+         if (error)
+         {
+            LOG_ERROR(error);
+            return;
+         }
+
+         bool exists = logFilePath_.exists();
+         error = logFilePath_.open_w(&pLogStream_, false);
+         if (error)
+         {
+            LOG_ERROR(error);
+            return;
+         }
+
+         if (!exists)
+            *pLogStream_ << "type, timestamp, presentation, slide, input, "
+                            "errors\n";
+      }
+
+      *pLogStream_ << entries;
+      pLogStream_->flush();
+
+      // reopen on the next flush if the write failed
+      if (pLogStream_->fail())
+      {
+         LOG_ERROR_MESSAGE("Error writing " + logFilePath_.absolutePath());
+         pLogStream_.reset();
+      }
+   }
+   END_LOCK_MUTEX
+}
+
+void Log::onShutdown(bool terminatedNormally)
+{
+   flush();
 }
 
 
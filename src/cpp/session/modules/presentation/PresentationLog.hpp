@@ -21,6 +21,10 @@
 #include <vector>
 
 #include <boost/utility.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <core/FilePath.hpp>
+#include <core/Thread.hpp>
 
 #include <session/SessionModuleContext.hpp>
 
@@ -28,7 +32,6 @@
 
 namespace core {
    class Error;
-   class FilePath;
 }
 
 namespace session {
@@ -41,7 +44,14 @@ Log& log();
 class Log : boost::noncopyable
 {
 private:
-   Log() : currentSlideIndex_(0) {}
+   Log()
+      : currentSlideIndex_(0),
+        errorOutputSize_(0),
+        pMutex_(new boost::mutex()),
+        flushScheduled_(false),
+        pWriteMutex_(new boost::mutex())
+   {
+   }
    friend Log& log();
 
 public:
@@ -58,12 +68,17 @@ private:
 
    enum EntryType { NavigationEntry, InputEntry };
 
-   static void append(EntryType type,
-                      const core::FilePath& presPath,
-                      int slideIndex,
-                      const std::string& input,
-                      const std::string& errors);
+   void append(EntryType type,
+               const core::FilePath& presPath,
+               int slideIndex,
+               const std::string& input,
+               const std::string& errors);
 
+   // entries are buffered and written a batch at a time on a background
+   // thread (or at shutdown) to the log file, which is kept open
+   void flushInBackground();
+   void flush();
+   void onShutdown(bool terminatedNormally);
 
 private:
    int currentSlideIndex_;
@@ -71,8 +86,16 @@ private:
 
    std::vector<std::string> consoleInputBuffer_;
    std::vector<std::string> errorOutputBuffer_;
-
-
+   std::size_t errorOutputSize_;
+
+   // mutexes are heap based to avoid boost mutex assertions when they
+   // are destructed in a multicore forked child
+   core::FilePath logFilePath_;
+   boost::mutex* pMutex_;
+   std::string pendingEntries_;
+   bool flushScheduled_;
+   boost::mutex* pWriteMutex_;
+   boost::shared_ptr<std::ostream> pLogStream_;
 };
 
 } // namespace presentation
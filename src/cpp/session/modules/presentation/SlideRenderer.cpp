@@ -19,6 +19,7 @@
 #include <boost/foreach.hpp>
 #include <boost/format.hpp>
 #include <boost/regex.hpp>
+#include <boost/unordered_map.hpp>
 #include <boost/algorithm/string.hpp>
 
 #include <core/Error.hpp>
@@ -127,10 +128,10 @@ void addFragmentClass(const std::string& fragmentClass,
                                    bqWithClass + "\n<p>");
 }
 
-Error slideMarkdownToHtml(const Slide& slide,
-                          const std::string& extraContent,
-                          const std::string& incremental,
-                          std::string* pHTML)
+Error renderSlideMarkdownToHtml(const Slide& slide,
+                                const std::string& extraContent,
+                                const std::string& incremental,
+                                std::string* pHTML)
 {
    // render the markdown
    Error error = renderMarkdown(slide.content(), pHTML);
@@ -188,6 +189,73 @@ Error slideMarkdownToHtml(const Slide& slide,
    return Success();
 }
 
+// rendered html for slides keyed by everything that goes into rendering
+// them (so editing one slide only requires re-rendering that slide).
+// entries not used by the most recent render of the deck are discarded
+struct RenderedSlide
+{
+   RenderedSlide() : generation(0) {}
+   std::string html;
+   unsigned long generation;
+};
+typedef boost::unordered_map<std::string,RenderedSlide> RenderedSlides;
+RenderedSlides s_renderedSlides;
+unsigned long s_renderGeneration = 0;
+
+std::string renderedSlideKey(const Slide& slide,
+                             const std::string& extraContent,
+                             const std::string& incremental)
+{
+   std::string key;
+   key.reserve(slide.content().size() + extraContent.size() + 16);
+   key.append(slide.showTitle() ? "1" : "0");
+   key.append(incremental);
+   key.append("\n");
+   key.append(extraContent);
+   key.append("\n");
+   key.append(slide.content());
+   return key;
+}
+
+void removeUnusedRenderedSlides()
+{
+   for (RenderedSlides::iterator it = s_renderedSlides.begin();
+        it != s_renderedSlides.end(); )
+   {
+      if (it->second.generation != s_renderGeneration)
+         it = s_renderedSlides.erase(it);
+      else
+         ++it;
+   }
+}
+
+Error slideMarkdownToHtml(const Slide& slide,
+                          const std::string& extraContent,
+                          const std::string& incremental,
+                          std::string* pHTML)
+{
+   std::string key = renderedSlideKey(slide, extraContent, incremental);
+   RenderedSlides::iterator it = s_renderedSlides.find(key);
+   if (it != s_renderedSlides.end())
+   {
+      it->second.generation = s_renderGeneration;
+      *pHTML = it->second.html;
+      return Success();
+   }
+
+   Error error = renderSlideMarkdownToHtml(slide,
+                                           extraContent,
+                                           incremental,
+                                           pHTML);
+   if (error)
+      return error;
+
+   RenderedSlide& rendered = s_renderedSlides[key];
+   rendered.html = *pHTML;
+   rendered.generation = s_renderGeneration;
+   return Success();
+}
+
 void validateTransitionType(const std::string& type)
 {
    bool isValid = boost::iequals(type, "none") ||
@@ -248,6 +316,9 @@ Error renderSlides(const SlideDeck& slideDeck,
    // validate global slide deck fields (will just print warnings)
    validateSlideDeckFields(slideDeck);
 
+   // new generation of rendered slides
+   s_renderGeneration++;
+
    // render the slides to HTML and slide commands to case statements
    std::ostringstream ostr, ostrRevealConfig, ostrInitActions, ostrSlideActions;
 
@@ -419,6 +490,9 @@ Error renderSlides(const SlideDeck& slideDeck,
       slideNumber++;
    }
 
+   // discard rendered html for slides which are no longer in the deck
+   removeUnusedRenderedSlides();
+
    // init slide list as part of actions
    navigationList.complete();
    ostrInitActions << navigationList.asCall() << "\n";
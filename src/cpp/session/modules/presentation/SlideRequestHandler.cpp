@@ -16,6 +16,7 @@
 
 #include "SlideRequestHandler.hpp"
 
+#include <map>
 #include <iostream>
 
 #include <boost/utility.hpp>
@@ -26,6 +27,7 @@
 #include <boost/regex.hpp>
 #include <boost/iostreams/filter/regex.hpp>
 
+#include <core/Hash.hpp>
 #include <core/FileSerializer.hpp>
 #include <core/HtmlUtils.hpp>
 #include <core/markdown/Markdown.hpp>
@@ -50,31 +52,6 @@ namespace presentation {
 
 namespace {
 
-class ResourceFiles : boost::noncopyable
-{
-private:
-   ResourceFiles() {}
-
-public:
-   std::string get(const std::string& path)
-   {
-      if (cache_.find(path) == cache_.end())
-         cache_[path] = module_context::resourceFileAsString(path);
-      return cache_[path];
-   }
-
-private:
-   friend ResourceFiles& resourceFiles();
-   std::map<std::string,std::string> cache_;
-};
-
-ResourceFiles& resourceFiles()
-{
-   static ResourceFiles instance;
-   return instance;
-}
-
-
 std::string revealResource(const std::string& path,
                            bool embed,
                            const std::string& extraAttribs)
@@ -89,14 +66,14 @@ std::string revealResource(const std::string& path,
       if (isCss)
       {
          code = "<style type=\"text/css\" " + extraAttribs + " >\n" +
-               resourceFiles().get("presentation/" + path) + "\n"
-               + "</style>";
+               module_context::resourceFileAsString("presentation/" + path) +
+               "\n</style>";
       }
       else
       {
          code = "<script type=\"text/javascript\" " + extraAttribs + " >\n" +
-               resourceFiles().get("presentation/" + path) + "\n"
-               + "</script>";
+               module_context::resourceFileAsString("presentation/" + path) +
+               "\n</script>";
       }
    }
    else
@@ -130,7 +107,7 @@ std::string revealLink(const std::string& path,
 
 std::string remoteMathjax()
 {
-   return resourceFiles().get("presentation/mathjax.html");
+   return module_context::resourceFileAsString("presentation/mathjax.html");
 }
 
 std::string alternateMathjax(const std::string& prefix)
@@ -192,8 +169,9 @@ std::string remoteWebFonts()
 std::string embeddedWebFonts()
 {
    std::string fonts = "presentation/revealjs/fonts";
-   std::string css = resourceFiles().get(fonts + "/Lato.css") +
-                     resourceFiles().get(fonts + "/NewsCycle.css");
+   std::string css =
+         module_context::resourceFileAsString(fonts + "/Lato.css") +
+         module_context::resourceFileAsString(fonts + "/NewsCycle.css");
 
    try
    {
@@ -413,8 +391,9 @@ bool readPresentation(SlideDeck* pSlideDeck,
    std::map<std::string,std::string>& vars = *pVars;
    vars["title"] = pSlideDeck->title();
    vars["slides"] = *pSlides;
-   vars["slides_css"] =  resourceFiles().get("presentation/slides.css");
-   vars["r_highlight"] = resourceFiles().get("r_highlight.html");
+   vars["slides_css"] =
+         module_context::resourceFileAsString("presentation/slides.css");
+   vars["r_highlight"] = module_context::resourceFileAsString("r_highlight.html");
    vars["reveal_config"] = revealConfig;
 
 
@@ -428,7 +407,7 @@ bool renderPresentation(
                    std::string* pErrMsg)
 {
    std::string presentationTemplate =
-                           resourceFiles().get("presentation/slides.html");
+         module_context::resourceFileAsString("presentation/slides.html");
    std::istringstream templateStream(presentationTemplate);
 
    try
@@ -650,7 +629,7 @@ void handlePresentationRootRequest(const std::string& path,
 
    // javascript supporting IDE interaction
    vars["slide_commands"] = slideCommands;
-   vars["slides_js"] = resourceFiles().get("presentation/slides.js");
+   vars["slides_js"] = module_context::resourceFileAsString("presentation/slides.js");
    vars["init_commands"] = initCommands;
 
    // width and height are dynamic
@@ -723,8 +702,8 @@ void handlePresentationHelpMarkdownRequest(const FilePath& filePath,
    // process the template
    std::map<std::string,std::string> vars;
    vars["title"] = html_utils::defaultTitle(helpDoc);
-   vars["styles"] = resourceFiles().get("presentation/helpdoc.css");
-   vars["r_highlight"] = resourceFiles().get("r_highlight.html");
+   vars["styles"] = module_context::resourceFileAsString("presentation/helpdoc.css");
+   vars["r_highlight"] = module_context::resourceFileAsString("r_highlight.html");
    if (markdown::isMathJaxRequired(helpDoc))
       vars["mathjax"] = localMathjax();
    else
@@ -732,8 +711,9 @@ void handlePresentationHelpMarkdownRequest(const FilePath& filePath,
    vars["content"] = helpDoc;
    vars["js_callbacks"] = jsCallbacks;
    pResponse->setNoCacheHeaders();
-   pResponse->setBody(resourceFiles().get("presentation/helpdoc.html"),
-                      text::TemplateFilter(vars));
+   pResponse->setBody(
+         module_context::resourceFileAsString("presentation/helpdoc.html"),
+         text::TemplateFilter(vars));
 }
 
 void handleRangeRequest(const FilePath& targetFile,
@@ -784,6 +764,58 @@ void handleRangeRequest(const FilePath& targetFile,
 
 }
 
+void handleFileRequest(const FilePath& targetFile,
+                       const http::Request& request,
+                       http::Response* pResponse)
+{
+   // indicate that we accept byte range requests
+   pResponse->addHeader("Accept-Ranges", "bytes");
+
+   // large files (e.g. video) just use the modification time
+   const uintmax_t kMaxHashedFileSize = 4 * 1024 * 1024;
+   if (!targetFile.exists() || targetFile.size() > kMaxHashedFileSize)
+   {
+      pResponse->setCacheableFile(targetFile, request);
+      return;
+   }
+
+   // otherwise use an eTag based on the file's contents so that media
+   // which is regenerated with the same contents (e.g. plots written by
+   // a re-knit) isn't sent to the browser again. hashes are cached by
+   // path and invalidated when the size or modification time changes
+   struct ContentHash
+   {
+      ContentHash() : lastWriteTime(0), size(0) {}
+      std::time_t lastWriteTime;
+      uintmax_t size;
+      std::string eTag;
+   };
+   static std::map<std::string,ContentHash> s_contentHashes;
+
+   ContentHash& hash = s_contentHashes[targetFile.absolutePath()];
+   if (hash.eTag.empty() ||
+       hash.lastWriteTime != targetFile.lastWriteTime() ||
+       hash.size != targetFile.size())
+   {
+      std::string contents;
+      Error error = core::readStringFromFile(targetFile, &contents);
+      if (error)
+      {
+         pResponse->setError(error);
+         return;
+      }
+      hash.lastWriteTime = targetFile.lastWriteTime();
+      hash.size = targetFile.size();
+      hash.eTag = core::hash::xxHash64(contents);
+   }
+
+   pResponse->setHeader("ETag", hash.eTag);
+   if (hash.eTag == request.headerValue("If-None-Match"))
+      pResponse->setStatusCode(http::status::NotModified);
+   else
+      pResponse->setFile(targetFile, request);
+}
+
 void handlePresentationViewInBrowserRequest(const http::Request& request,
                                             http::Response* pResponse)
 {
@@ -887,11 +919,7 @@ void handlePresentationPaneRequest(const http::Request& request,
       }
       else
       {
-         // indicate that we accept byte range requests
-         pResponse->addHeader("Accept-Ranges", "bytes");
-
-         // return the file
-         pResponse->setCacheableFile(targetFile, request);
+         handleFileRequest(targetFile, request, pResponse);
       }
    }
 }
@@ -17,6 +17,7 @@
 
 #include <set>
 
+#include <boost/bind.hpp>
 #include <boost/format.hpp>
 #include <boost/foreach.hpp>
 #include <boost/enable_shared_from_this.hpp>
@@ -553,7 +554,8 @@ private:
       : targetFilePath_(targetFilePath),
         encoding_(encoding),
         sourceLocation_(sourceLocation),
-        onCompleted_(onCompleted)
+        onCompleted_(onCompleted),
+        showInterimErrors_(false)
    {
       if (targetFilePath_.exists())
       {
@@ -688,10 +690,24 @@ private:
       enqueOutputEvent("Running " + texProgramPath_.filename() +
                        " on " + texFilePath.filename() + "...");
 
-      error = tex::pdflatex::texToPdf(texProgramPath_,
-                                      texFilePath,
-                                      options,
-                                      &result);
+      // parse the compiler's output as it runs so errors can be shown
+      // before the compile completes (the log is parsed again at the end
+      // to get the definitive list of issues)
+      showInterimErrors_ = !isTargetRnw() || !concordances.empty();
+      interimErrors_.clear();
+      interimErrorKeys_.clear();
+      core::tex::LatexLogParser outputParser(
+               ancillaryFilePath(texFilePath, ".log"),
+               boost::bind(&AsyncPdfCompiler::onLatexOutputEntry, this, _1));
+
+      error = tex::pdflatex::texToPdf(
+                      texProgramPath_,
+                      texFilePath,
+                      options,
+                      boost::bind(&AsyncPdfCompiler::onLatexOutput,
+                                  this, _1, boost::ref(outputParser),
+                                  boost::cref(concordances)),
+                      &result);
 
       if (error)
       {
@@ -706,6 +722,29 @@ private:
 
    }
 
+   void onLatexOutput(const std::string& output,
+                      core::tex::LatexLogParser& outputParser,
+                      const rnw_concordance::Concordances& concordances)
+   {
+      std::size_t previousErrors = interimErrors_.size();
+      outputParser.parse(output);
+      if (interimErrors_.size() > previousErrors)
+         showLogEntries(interimErrors_, concordances);
+   }
+
+   void onLatexOutputEntry(const core::tex::LogEntry& logEntry)
+   {
+      if (!showInterimErrors_ || logEntry.type() != core::tex::LogEntry::Error)
+         return;
+
+      // each latex pass reports the same errors again
+      std::string key = logEntry.filePath().absolutePath() + ":" +
+                        safe_convert::numberToString(logEntry.line()) + ":" +
+                        logEntry.message();
+      if (interimErrorKeys_.insert(key).second)
+         interimErrors_.push_back(logEntry);
+   }
+
    void onLatexCompileCompleted(int exitStatus,
                                 const FilePath& texFilePath,
                                 const rnw_concordance::Concordances& concords)
@@ -730,6 +769,11 @@ private:
          showLogEntries(logEntries, concords);
          issuesMsg = buildIssuesMessage(logEntries);
       }
+      else if (!interimErrors_.empty())
+      {
+         // clear errors we showed while compiling
+         showLogEntries(logEntries, concords);
+      }
 
       if (exitStatus == EXIT_SUCCESS)
       {
@@ -803,6 +847,9 @@ private:
    core::tex::TexMagicComments magicComments_;
    FilePath texProgramPath_;
    AuxillaryFileCleanupContext auxillaryFileCleanupContext_;
+   bool showInterimErrors_;
+   core::tex::LogEntries interimErrors_;
+   std::set<std::string> interimErrorKeys_;
 };
 
 
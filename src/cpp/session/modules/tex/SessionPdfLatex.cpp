@@ -15,9 +15,13 @@
 
 #include "SessionPdfLatex.hpp"
 
+#include <map>
+
 #include <boost/regex.hpp>
+#include <boost/foreach.hpp>
 #include <boost/algorithm/string.hpp>
 
+#include <core/Hash.hpp>
 #include <core/system/Environment.hpp>
 #include <core/FileSerializer.hpp>
 
@@ -136,7 +140,7 @@ bool validateLatexProgram(const std::string& program,
    std::string programName = string_utils::toLower(program);
 
    // try to find on the path
-   *pTexProgramPath = module_context::findProgram(programName);
+   *pTexProgramPath = utils::texProgramPath(programName);
    if (pTexProgramPath->empty())
    {
       *pUserErrMsg = "Unabled to find specified LaTeX program '" +
@@ -201,7 +205,7 @@ FilePath programPath(const std::string& name, const std::string& envOverride)
 {
    std::string envProgram = core::system::getenv(envOverride);
    std::string program = envProgram.empty() ? name : envProgram;
-   return module_context::findProgram(program);
+   return utils::texProgramPath(program);
 }
 
 
@@ -244,6 +248,123 @@ bool logIncludesRerun(const FilePath& logFilePath)
    return logContents.find("Rerun to get") != std::string::npos;
 }
 
+// fingerprint of a file's contents (empty if it doesn't exist)
+std::string fileHash(const FilePath& filePath)
+{
+   if (!filePath.exists())
+      return std::string();
+
+   std::string contents;
+   Error error = core::readStringFromFile(filePath, &contents);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return std::string();
+   }
+
+   return hash::xxHash64(contents);
+}
+
+std::vector<std::string> readAuxLines(const FilePath& auxFilePath)
+{
+   std::vector<std::string> lines;
+   if (auxFilePath.exists())
+   {
+      Error error = core::readStringVectorFromFile(auxFilePath, &lines);
+      if (error)
+         LOG_ERROR(error);
+   }
+   return lines;
+}
+
+// aux files written by the compile: the main aux file along with those of
+// any \include'd files (which the main aux file \@input's)
+std::vector<FilePath> auxFiles(const FilePath& baseFilePath)
+{
+   std::vector<FilePath> files;
+   FilePath auxFilePath(baseFilePath.absolutePath() + ".aux");
+   files.push_back(auxFilePath);
+
+   boost::regex inputRegex("^\\\\@input\\{([^}]+)\\}");
+   BOOST_FOREACH(const std::string& line, readAuxLines(auxFilePath))
+   {
+      boost::smatch match;
+      if (boost::regex_search(line, match, inputRegex))
+         files.push_back(baseFilePath.parent().complete(match[1]));
+   }
+
+   return files;
+}
+
+// the state which a latex pass leaves for the next one. once a pass leaves
+// it unchanged the document has reached a fixed point (further passes
+// would produce the same output)
+std::string passStateHash(const FilePath& baseFilePath)
+{
+   std::string state;
+   BOOST_FOREACH(const FilePath& auxFile, auxFiles(baseFilePath))
+      state += auxFile.filename() + ":" + fileHash(auxFile) + ";";
+
+   const char* exts[] = { ".toc", ".lof", ".lot", ".out",
+                          ".bbl", ".ind", ".nav", ".snm" };
+   for (std::size_t i = 0; i < sizeof(exts) / sizeof(exts[0]); i++)
+   {
+      FilePath filePath(baseFilePath.absolutePath() + exts[i]);
+      state += std::string(exts[i]) + ":" + fileHash(filePath) + ";";
+   }
+
+   return hash::xxHash64(state);
+}
+
+// the inputs to bibtex: the citation, style and database commands within
+// the aux files along with the contents of the databases
+std::string bibtexInputsHash(const FilePath& baseFilePath)
+{
+   std::string inputs;
+   BOOST_FOREACH(const FilePath& auxFile, auxFiles(baseFilePath))
+   {
+      BOOST_FOREACH(const std::string& line, readAuxLines(auxFile))
+      {
+         using namespace boost::algorithm;
+         if (!starts_with(line, "\\citation") &&
+             !starts_with(line, "\\bibstyle") &&
+             !starts_with(line, "\\bibdata"))
+         {
+            continue;
+         }
+
+         inputs += line + "\n";
+
+         std::string::size_type begin = line.find('{');
+         std::string::size_type end = line.rfind('}');
+         if (starts_with(line, "\\bibdata") &&
+             begin != std::string::npos && end != std::string::npos &&
+             end > begin)
+         {
+            std::vector<std::string> databases;
+            boost::algorithm::split(databases,
+                                    line.substr(begin + 1, end - begin - 1),
+                                    boost::algorithm::is_any_of(","));
+            BOOST_FOREACH(std::string database, databases)
+            {
+               trim(database);
+               if (!ends_with(database, ".bib"))
+                  database += ".bib";
+               FilePath bibFilePath = baseFilePath.parent().complete(database);
+               inputs += database + ":" + fileHash(bibFilePath) + "\n";
+            }
+         }
+      }
+   }
+
+   return hash::xxHash64(inputs);
+}
+
+// inputs seen by the most recent bibtex and makeindex runs for each
+// document (so we can skip runs which would produce the same output)
+std::map<std::string,std::string> s_bibtexInputs;
+std::map<std::string,std::string> s_makeindexInputs;
+
 } // anonymous namespace
 
 const char * const kFileLineErrorOption = "-file-line-error";
@@ -254,7 +375,7 @@ const char * const kSynctexOption = "-synctex=1";
 
 bool isInstalled()
 {
-   return !module_context::findProgram("pdflatex").empty();
+   return !utils::texProgramPath("pdflatex").empty();
 }
 
 
@@ -352,12 +473,15 @@ bool latexProgramForFile(const core::tex::TexMagicComments& magicComments,
 core::Error texToPdf(const core::FilePath& texProgramPath,
                      const core::FilePath& texFilePath,
                      const tex::pdflatex::PdfLatexOptions& options,
+                     const boost::function<void(const std::string&)>& onOutput,
                      core::system::ProcessResult* pResult)
 {
    // input file paths
    FilePath baseFilePath = texFilePath.parent().complete(texFilePath.stem());
    FilePath idxFilePath(baseFilePath.absolutePath() + ".idx");
    FilePath logFilePath(baseFilePath.absolutePath() + ".log");
+   FilePath bblFilePath(baseFilePath.absolutePath() + ".bbl");
+   FilePath indFilePath(baseFilePath.absolutePath() + ".ind");
 
    // bibtex and makeindex program paths
    FilePath bibtexProgramPath = programPath("bibtex", "BIBTEX");
@@ -368,28 +492,40 @@ core::Error texToPdf(const core::FilePath& texProgramPath,
    bibtexArgs << string_utils::utf8ToSystem(baseFilePath.filename());
    core::shell_utils::ShellArgs makeindexArgs;
    makeindexArgs << string_utils::utf8ToSystem(idxFilePath.filename());
+   core::system::Options texInputsEnvVars = utils::rTexInputsEnvVars();
    core::system::ProcessOptions procOptions;
-   procOptions.environment = utils::rTexInputsEnvVars();
+   procOptions.environment = texInputsEnvVars;
    procOptions.workingDir = texFilePath.parent();
 
    // run the initial compile
+   std::string passState = passStateHash(baseFilePath);
    Error error = utils::runTexCompile(texProgramPath,
-                                      utils::rTexInputsEnvVars(),
+                                      texInputsEnvVars,
                                       shellArgs(options),
                                       texFilePath,
+                                      onOutput,
                                       pResult);
    if (error)
       return error;
 
    // count misses
    int misses = countCitationMisses(logFilePath);
-   int previousMisses = 0;
 
    // resolve citation misses and index
+   std::string& lastBibtexInputs = s_bibtexInputs[baseFilePath.absolutePath()];
+   std::string& lastMakeindexInputs =
+                              s_makeindexInputs[baseFilePath.absolutePath()];
    for (int i=0; i<10; i++)
    {
-      // run bibtex if necessary
-      if (misses > 0 && !bibtexProgramPath.empty())
+      bool ranTool = false;
+
+      // run bibtex if there are misses or the bibliography has changed --
+      // but not if bibtex has already seen the same citations and databases
+      // (it would produce the same output)
+      std::string bibtexInputs = bibtexInputsHash(baseFilePath);
+      if ((misses > 0 || !lastBibtexInputs.empty()) &&
+          (bibtexInputs != lastBibtexInputs || !bblFilePath.exists()) &&
+          !bibtexProgramPath.empty())
       {
          core::system::ProcessResult result;
          Error error = core::system::runProgram(
@@ -402,11 +538,16 @@ core::Error texToPdf(const core::FilePath& texProgramPath,
             LOG_ERROR(error);
          else if (pResult->exitStatus != EXIT_SUCCESS)
             return Success(); // pass error state on to caller
+         else
+            lastBibtexInputs = bibtexInputs;
+         ranTool = true;
       }
-      previousMisses = misses;
 
-      // run makeindex if necessary
-      if (idxFilePath.exists() && !makeindexProgramPath.empty())
+      // run makeindex if the index entries have changed
+      std::string makeindexInputs = fileHash(idxFilePath);
+      if (idxFilePath.exists() &&
+          (makeindexInputs != lastMakeindexInputs || !indFilePath.exists()) &&
+          !makeindexProgramPath.empty())
       {
          Error error = core::system::runProgram(
                string_utils::utf8ToSystem(makeindexProgramPath.absolutePath()),
@@ -418,24 +559,34 @@ core::Error texToPdf(const core::FilePath& texProgramPath,
             LOG_ERROR(error);
          else if (pResult->exitStatus != EXIT_SUCCESS)
             return Success(); // pass error state on to caller
+         else
+            lastMakeindexInputs = makeindexInputs;
+         ranTool = true;
       }
 
+      // if the last pass left the aux files etc. as it found them and
+      // neither bibtex nor makeindex produced anything new then we're done
+      std::string newPassState = passStateHash(baseFilePath);
+      if (!ranTool &&
+          newPassState == passState &&
+          !logIncludesRerun(logFilePath))
+      {
+         break;
+      }
+      passState = newPassState;
+
       // re-run latex
       Error error = utils::runTexCompile(texProgramPath,
-                                         utils::rTexInputsEnvVars(),
+                                         texInputsEnvVars,
                                          shellArgs(options),
                                          texFilePath,
+                                         onOutput,
                                          pResult);
       if (error)
          return error;
 
       // count misses
       misses = countCitationMisses(logFilePath);
-
-      // if there is no change in misses and there is no "Rerun to get"
-      // in the log file then break
-      if ((misses == previousMisses) && !logIncludesRerun(logFilePath))
-         break;
    }
 
    return Success();
@@ -68,9 +68,11 @@ struct PdfLatexOptions
    std::string versionInfo;
 };
 
+// output from the latex passes is passed to onOutput as it is produced
 core::Error texToPdf(const core::FilePath& texProgramPath,
                      const core::FilePath& texFilePath,
                      const tex::pdflatex::PdfLatexOptions& options,
+                     const boost::function<void(const std::string&)>& onOutput,
                      core::system::ProcessResult* pResult);
 
 bool isInstalled();
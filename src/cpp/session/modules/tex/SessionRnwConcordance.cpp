@@ -16,6 +16,8 @@
 #include "SessionRnwConcordance.hpp"
 
 #include <iostream>
+#include <limits>
+#include <algorithm>
 
 #include <boost/foreach.hpp>
 #include <boost/regex.hpp>
@@ -28,7 +30,6 @@
 #include <core/FilePath.hpp>
 #include <core/FileSerializer.hpp>
 #include <core/SafeConvert.hpp>
-#include <core/Algorithm.hpp>
 
 #include <core/tex/TexSynctex.hpp>
 
@@ -178,6 +179,8 @@ Error Concordance::parse(const FilePath& sourceFile,
       pos += diffs[i];
    }
 
+   indexRnwLines();
+
    return Success();
 }
 
@@ -219,52 +222,141 @@ void Concordance::append(const Concordance& concordance)
    std::copy(concordance.mapping_.begin(),
              concordance.mapping_.end(),
              std::back_inserter(mapping_));
+
+   indexRnwLines();
 }
 
-std::ostream& operator << (std::ostream& stream, const FileAndLine& fileLine)
+int Concordance::texLine(int rnwLine) const
 {
-   stream << fileLine.filePath() << ":" << fileLine.line();
-   return stream;
-}
+   if (rnwIndex_.empty())
+      return -1;
+
+   // the first entry for the closest rnw line at or after this one and
+   // for the closest before it (entries for the same rnw line are in
+   // mapping order so the first is the earliest tex line)
+   typedef std::vector<std::pair<int,int> >::const_iterator Iterator;
+   const int kFirst = std::numeric_limits<int>::min();
+   Iterator after = std::lower_bound(rnwIndex_.begin(),
+                                     rnwIndex_.end(),
+                                     std::make_pair(rnwLine, kFirst));
+   Iterator before = rnwIndex_.end();
+   if (after != rnwIndex_.begin())
+   {
+      int beforeLine = (after - 1)->first;
+      before = std::lower_bound(rnwIndex_.begin(),
+                                after,
+                                std::make_pair(beforeLine, kFirst));
+   }
 
+   // take the closer of the two (or the earlier tex line if they're
+   // equally close)
+   Iterator closest;
+   if (after == rnwIndex_.end())
+      closest = before;
+   else if (before == rnwIndex_.end())
+      closest = after;
+   else
+   {
+      int afterDistance = after->first - rnwLine;
+      int beforeDistance = rnwLine - before->first;
+      if (afterDistance < beforeDistance ||
+          (afterDistance == beforeDistance && after->second < before->second))
+         closest = after;
+      else
+         closest = before;
+   }
 
-namespace {
+   return closest->second + 1 + offset_;
+}
 
-bool hasOutputFile(const Concordance& concord, const FilePath& outputFile)
+void Concordance::indexRnwLines()
 {
-   return concord.outputFile().isEquivalentTo(outputFile);
+   rnwIndex_.clear();
+   rnwIndex_.reserve(mapping_.size());
+   for (std::size_t i = 0; i < mapping_.size(); i++)
+      rnwIndex_.push_back(std::make_pair(mapping_[i], static_cast<int>(i)));
+   std::sort(rnwIndex_.begin(), rnwIndex_.end());
 }
 
-bool hasInputFile(const Concordance& concord, const FilePath& inputFile)
+std::ostream& operator << (std::ostream& stream, const FileAndLine& fileLine)
 {
-   return concord.inputFile().isEquivalentTo(inputFile);
+   stream << fileLine.filePath() << ":" << fileLine.line();
+   return stream;
 }
 
-} // anonymous namespace
+
+void Concordances::add(const Concordance& concordance)
+{
+   std::size_t index = concordances_.size();
+   concordances_.push_back(concordance);
+
+   // index by output file (keeping offsets in order, and concordances with
+   // the same offset in the order they were added)
+   std::vector<OutputFileIndex>::iterator outputIt;
+   for (outputIt = outputFileIndexes_.begin();
+        outputIt != outputFileIndexes_.end();
+        ++outputIt)
+   {
+      if (outputIt->outputFile.isEquivalentTo(concordance.outputFile()))
+         break;
+   }
+   if (outputIt == outputFileIndexes_.end())
+   {
+      OutputFileIndex outputFileIndex;
+      outputFileIndex.outputFile = concordance.outputFile();
+      outputIt = outputFileIndexes_.insert(outputFileIndexes_.end(),
+                                           outputFileIndex);
+   }
+   std::pair<std::size_t,std::size_t> offset(concordance.offset(), index);
+   outputIt->offsets.insert(std::upper_bound(outputIt->offsets.begin(),
+                                             outputIt->offsets.end(),
+                                             offset),
+                            offset);
+
+   // combine with the other concordances for the input file
+   std::vector<Concordance>::iterator inputIt;
+   for (inputIt = inputFileConcordances_.begin();
+        inputIt != inputFileConcordances_.end();
+        ++inputIt)
+   {
+      if (inputIt->inputFile().isEquivalentTo(concordance.inputFile()))
+         break;
+   }
+   if (inputIt == inputFileConcordances_.end())
+   {
+      inputIt = inputFileConcordances_.insert(inputFileConcordances_.end(),
+                                              Concordance());
+   }
+   inputIt->append(concordance);
+}
 
 FileAndLine Concordances::rnwLine(const FileAndLine& texLine) const
 {
    if (texLine.filePath().empty())
       return FileAndLine();
 
-   // inspect concordance where output file is equivliant to tex file
-   std::vector<Concordance> texFileConcords;
-   algorithm::copy_if(
-      concordances_.begin(),
-      concordances_.end(),
-      std::back_inserter(texFileConcords),
-      boost::bind(hasOutputFile, _1, texLine.filePath()));
-
-   // reverse search for the first concordances whose offset is less than
-   // the text line we are seeking concordance for
-   for (std::vector<Concordance>::const_reverse_iterator it =
-      texFileConcords.rbegin(); it != texFileConcords.rend(); ++it)
+   // inspect concordances where output file is equivalent to tex file
+   BOOST_FOREACH(const OutputFileIndex& outputFileIndex, outputFileIndexes_)
    {
-      if (texLine.line() > static_cast<int>(it->offset()))
-      {
-          return FileAndLine(it->inputFile(),
-                             it->rnwLine(texLine.line()));
-      }
+      if (!outputFileIndex.outputFile.isEquivalentTo(texLine.filePath()))
+         continue;
+
+      // find the last concordance whose offset is less than the tex line
+      // we are seeking concordance for
+      if (texLine.line() < 1)
+         return FileAndLine();
+      std::pair<std::size_t,std::size_t> key(texLine.line() - 1,
+                              std::numeric_limits<std::size_t>::max());
+      std::vector<std::pair<std::size_t,std::size_t> >::const_iterator it =
+                  std::upper_bound(outputFileIndex.offsets.begin(),
+                                   outputFileIndex.offsets.end(),
+                                   key);
+      if (it == outputFileIndex.offsets.begin())
+         return FileAndLine();
+
+      const Concordance& concord = concordances_[(it - 1)->second];
+      return FileAndLine(concord.inputFile(),
+                         concord.rnwLine(texLine.line()));
    }
 
    return FileAndLine();
@@ -276,28 +368,18 @@ FileAndLine Concordances::texLine(const FileAndLine& rnwLine) const
    if (rnwLine.filePath().empty())
       return FileAndLine();
 
-   // inspect concordance where input file is equivilant to rnw file
-   std::vector<Concordance> rnwFileConcords;
-   algorithm::copy_if(
-      concordances_.begin(),
-      concordances_.end(),
-      std::back_inserter(rnwFileConcords),
-      boost::bind(hasInputFile, _1, rnwLine.filePath()));
-   if (rnwFileConcords.size() == 0)
-      return FileAndLine();
-
-   // build a single concordance structure for seeking
-   Concordance rnwFileConcord;
-   for (std::vector<Concordance>::const_iterator
-      it = rnwFileConcords.begin(); it != rnwFileConcords.end(); ++it)
+   // seek within the concordances for the input file equivalent to the
+   // rnw file (combined into one when they were added)
+   BOOST_FOREACH(const Concordance& rnwFileConcord, inputFileConcordances_)
    {
-      rnwFileConcord.append(*it);
+      if (rnwFileConcord.inputFile().isEquivalentTo(rnwLine.filePath()))
+      {
+         return FileAndLine(rnwFileConcord.outputFile(),
+                            rnwFileConcord.texLine(rnwLine.line()));
+      }
    }
 
-   // seek
-   FileAndLine texLine(rnwFileConcord.outputFile(),
-                       rnwFileConcord.texLine(rnwLine.line()));
-   return texLine;
+   return FileAndLine();
 }
 
 std::string fixup_formatter(const Concordances& concordances,
@@ -337,7 +419,8 @@ core::tex::LogEntry Concordances::fixup(const core::tex::LogEntry &entry,
    if (!mapped.empty())
    {
       boost::function<std::string(boost::smatch)> formatter =
-            boost::bind(fixup_formatter, *this, entry.filePath(), _1);
+            boost::bind(fixup_formatter, boost::cref(*this),
+                        entry.filePath(), _1);
       std::string mappedMsg =
             boost::regex_replace(entry.message(), regexLines, formatter);
 
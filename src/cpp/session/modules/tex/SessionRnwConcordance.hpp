@@ -18,6 +18,7 @@
 
 #include <string>
 #include <vector>
+#include <utility>
 
 #include <boost/utility.hpp>
 
@@ -83,39 +84,20 @@ public:
    // checked access to tex lines from rnw lines. note that this returns
    // the tex line which is closest to the specified rnw line (since some
    // rnw lines don't result in tex output e.g. ones in hidden sweave chunks)
-   int texLine(int rnwLine) const
-   {
-      int texLine = -1;
-      int smallestDistance = -1;
-      for (std::size_t i = 0; i<mapping_.size(); i++)
-      {
-         if (texLine == -1)
-         {
-            texLine = i + 1 + offset_;
-            smallestDistance = std::abs(mapping_[i] - rnwLine);
-         }
-         else
-         {
-            int thisDistance = std::abs(mapping_[i] - rnwLine);
-            if (thisDistance < smallestDistance)
-            {
-               texLine = i + 1 + offset_;
-               smallestDistance = thisDistance;
-
-               if (smallestDistance == 0)
-                  break;
-            }
-         }
-      }
-
-      return texLine;
-   }
+   int texLine(int rnwLine) const;
+
+private:
+   void indexRnwLines();
 
 private:
    core::FilePath outputFile_;
    core::FilePath inputFile_;
    std::size_t offset_;
    std::vector<int> mapping_;
+
+   // (rnw line, mapping index) for each entry of the mapping, sorted so
+   // the closest tex line can be found with a binary search
+   std::vector<std::pair<int,int> > rnwIndex_;
 };
 
 class FileAndLine
@@ -154,10 +136,7 @@ public:
 
    bool empty() const { return concordances_.empty(); }
 
-   void add(Concordance& concordance)
-   {
-      concordances_.push_back(concordance);
-   }
+   void add(const Concordance& concordance);
 
    FileAndLine rnwLine(const FileAndLine& texLine) const;
    FileAndLine texLine(const FileAndLine& rnwLine) const;
@@ -167,6 +146,17 @@ public:
 
 private:
    std::vector<Concordance> concordances_;
+
+   // lookups are indexed as concordances are added: for each output file
+   // the (offset, concordance index) of its concordances in offset order,
+   // and for each input file all of its concordances appended together
+   struct OutputFileIndex
+   {
+      core::FilePath outputFile;
+      std::vector<std::pair<std::size_t,std::size_t> > offsets;
+   };
+   std::vector<OutputFileIndex> outputFileIndexes_;
+   std::vector<Concordance> inputFileConcordances_;
 };
 
 void removePrevious(const core::FilePath& rnwFile);
@@ -15,12 +15,20 @@
 
 #include "SessionRnwWeave.hpp"
 
+#include <csignal>
+
+#include <boost/bind.hpp>
 #include <boost/utility.hpp>
 #include <boost/foreach.hpp>
 #include <boost/format.hpp>
+#include <boost/regex.hpp>
+#include <boost/thread.hpp>
 
+#include <boost/algorithm/string/join.hpp>
 #include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/trim.hpp>
 
+#include <core/SafeConvert.hpp>
 #include <core/FileSerializer.hpp>
 
 #include <core/tex/TexLogParser.hpp>
@@ -466,6 +474,213 @@ void onWeaveProcessExit(boost::shared_ptr<RnwWeave> pRnwWeave,
    }
 }
 
+// knitr chunks marked with parallel=TRUE (which must also be cached) are
+// evaluated ahead of the weave by a pool of worker processes. each worker
+// knits a copy of the document in which only its share of the parallel
+// chunks and any uncached chunks (e.g. setup code) are evaluated. this
+// populates the knitr cache so the weave itself just loads their results,
+// so parallel chunks must depend only on uncached chunks
+
+bool chunkOptionIsTrue(const std::string& options, const std::string& name)
+{
+   boost::regex re("(^|,)\\s*" + name + "\\s*=\\s*(TRUE|T)\\s*(,|$)");
+   return boost::regex_search(options, re);
+}
+
+std::string disabledChunkHeader(const std::string& options)
+{
+   // keep the label so that the labels (and therefore cache keys) of
+   // other chunks aren't affected
+   std::string label = options.substr(0, options.find(','));
+   boost::algorithm::trim(label);
+   if (label.empty() || label.find('=') != std::string::npos)
+      return "<<eval=FALSE>>=";
+   else
+      return "<<" + label + ", eval=FALSE>>=";
+}
+
+std::size_t parallelWorkers(const core::tex::TexMagicComments& magicComments)
+{
+   BOOST_FOREACH(const core::tex::TexMagicComment& mc, magicComments)
+   {
+      if (boost::algorithm::iequals(mc.scope(), "rnw") &&
+          boost::algorithm::iequals(mc.variable(), "workers"))
+      {
+         return std::max(1, safe_convert::stringTo<int>(mc.value(), 1));
+      }
+   }
+
+   unsigned int processors = boost::thread::hardware_concurrency();
+   return processors > 2 ? processors - 1 : 2;
+}
+
+FilePath parallelWorkerFile(const FilePath& rnwPath, std::size_t worker)
+{
+   return rnwPath.parent().complete(
+            "." + rnwPath.stem() + "-parallel-" +
+            safe_convert::numberToString(worker + 1) + rnwPath.extension());
+}
+
+void removeParallelWorkerFiles(const std::vector<FilePath>& workerFiles)
+{
+   BOOST_FOREACH(const FilePath& workerFile, workerFiles)
+   {
+      FilePath parentDir = workerFile.parent();
+      std::string stem = workerFile.stem();
+      const char* exts[] = { "", ".tex", "-concordance.tex" };
+      for (std::size_t i = 0; i < sizeof(exts) / sizeof(exts[0]); i++)
+      {
+         FilePath filePath = (i == 0) ? workerFile :
+                                        parentDir.complete(stem + exts[i]);
+         Error error = filePath.removeIfExists();
+         if (error)
+            LOG_ERROR(error);
+      }
+   }
+}
+
+// write the copies of the document for each worker (returns the number of
+// parallel chunks, no files are written if there are none)
+std::size_t writeParallelWorkerFiles(
+                        const FilePath& rnwPath,
+                        const core::tex::TexMagicComments& magicComments,
+                        std::vector<FilePath>* pWorkerFiles)
+{
+   std::string contents;
+   Error error = core::readStringFromFile(rnwPath, &contents);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return 0;
+   }
+   std::vector<std::string> lines;
+   boost::algorithm::split(lines, contents, boost::is_any_of("\n"));
+
+   // find the chunks which are parallel or cached
+   enum ChunkType { Uncached, Cached, Parallel };
+   std::vector<std::pair<std::size_t, ChunkType> > chunks;
+   std::vector<std::string> chunkOptions;
+   std::size_t parallelChunks = 0;
+   boost::regex re("^\\s*<<(.*)>>=.*$");
+   for (std::size_t i = 0; i < lines.size(); i++)
+   {
+      boost::smatch match;
+      if (!boost::regex_match(lines[i], match, re))
+         continue;
+
+      std::string options = match[1];
+      ChunkType type = Uncached;
+      if (chunkOptionIsTrue(options, "cache"))
+      {
+         if (chunkOptionIsTrue(options, "parallel"))
+         {
+            type = Parallel;
+            parallelChunks++;
+         }
+         else
+         {
+            type = Cached;
+         }
+      }
+      chunks.push_back(std::make_pair(i, type));
+      chunkOptions.push_back(options);
+   }
+
+   if (parallelChunks == 0)
+      return 0;
+
+   // divide the parallel chunks between the workers
+   std::size_t workers = std::min(parallelChunks,
+                                  parallelWorkers(magicComments));
+   for (std::size_t worker = 0; worker < workers; worker++)
+   {
+      std::vector<std::string> workerLines = lines;
+      std::size_t parallelChunk = 0;
+      for (std::size_t i = 0; i < chunks.size(); i++)
+      {
+         bool evaluate = chunks[i].second == Uncached ||
+                         (chunks[i].second == Parallel &&
+                          (parallelChunk++ % workers) == worker);
+         if (!evaluate)
+            workerLines[chunks[i].first] = disabledChunkHeader(chunkOptions[i]);
+      }
+
+      FilePath workerFile = parallelWorkerFile(rnwPath, worker);
+      Error error = core::writeStringToFile(
+                           workerFile,
+                           boost::algorithm::join(workerLines, "\n"));
+      if (error)
+      {
+         LOG_ERROR(error);
+         removeParallelWorkerFiles(*pWorkerFiles);
+         pWorkerFiles->clear();
+         return 0;
+      }
+      pWorkerFiles->push_back(workerFile);
+   }
+
+   return parallelChunks;
+}
+
+struct ParallelWeave
+{
+   ParallelWeave() : pending(0), terminated(false) {}
+   std::vector<FilePath> workerFiles;
+   std::size_t pending;
+   bool terminated;
+   boost::function<void()> onWorkersCompleted;
+   CompletedFunction onCompleted;
+};
+
+void ignoreOutput(const std::string&)
+{
+}
+
+void onParallelWorkerExit(boost::shared_ptr<ParallelWeave> pParallelWeave,
+                          int exitCode)
+{
+   // a worker which was killed means the compile was stopped (other
+   // failures are left for the weave itself to report)
+   if (exitCode == SIGTERM)
+      pParallelWeave->terminated = true;
+
+   if (--pParallelWeave->pending > 0)
+      return;
+
+   removeParallelWorkerFiles(pParallelWeave->workerFiles);
+
+   if (pParallelWeave->terminated)
+      pParallelWeave->onCompleted(Result::error(std::string()));
+   else
+      pParallelWeave->onWorkersCompleted();
+}
+
+void runWeaveProcess(const FilePath& rBinPath,
+                     boost::shared_ptr<RnwWeave> pRnwWeave,
+                     const FilePath& rnwPath,
+                     const std::string& encoding,
+                     const boost::function<void(const std::string&)>& onOutput,
+                     const CompletedFunction& onCompleted)
+{
+   std::vector<std::string> args = pRnwWeave->commandArgs(rnwPath.filename(),
+                                                          encoding);
+
+   // call back-end
+   Error error = compile_pdf_supervisor::runProgram(
+            rBinPath,
+            args,
+            core::system::Options(),
+            rnwPath.parent(),
+            onOutput,
+            boost::bind(onWeaveProcessExit,
+                              pRnwWeave, _1, _2, rnwPath, onCompleted));
+   if (error)
+   {
+      LOG_ERROR(error);
+      onCompleted(Result::error(error.summary()));
+   }
+}
+
 } // anonymous namespace
 
 void runTangle(const std::string& filePath, const std::string& rnwWeave)
@@ -519,23 +734,52 @@ void runWeave(const core::FilePath& rnwPath,
    // run the weave
    if (pRnwWeave)
    {
-      std::vector<std::string> args = pRnwWeave->commandArgs(
-                                                         rnwPath.filename(),
-                                                         encoding);
-
-      // call back-end
-      Error error = compile_pdf_supervisor::runProgram(
-               rBinPath,
-               args,
-               core::system::Options(),
-               rnwPath.parent(),
-               onOutput,
-               boost::bind(onWeaveProcessExit,
-                                 pRnwWeave, _1, _2, rnwPath, onCompleted));
-      if (error)
+      boost::function<void()> weave = boost::bind(runWeaveProcess,
+                                                  rBinPath,
+                                                  pRnwWeave,
+                                                  rnwPath,
+                                                  encoding,
+                                                  onOutput,
+                                                  onCompleted);
+
+      // evaluate parallel chunks first if there are any
+      boost::shared_ptr<ParallelWeave> pParallelWeave(new ParallelWeave());
+      std::size_t parallelChunks = 0;
+      if (pRnwWeave->name() == "knitr")
       {
-         LOG_ERROR(error);
-         onCompleted(Result::error(error.summary()));
+         parallelChunks = writeParallelWorkerFiles(
+                                             rnwPath,
+                                             magicComments,
+                                             &(pParallelWeave->workerFiles));
+      }
+      if (parallelChunks == 0)
+      {
+         weave();
+         return;
+      }
+
+      boost::format fmt("Evaluating %1% parallel chunks using %2% "
+                        "worker processes...\n");
+      onOutput(boost::str(fmt % parallelChunks
+                              % pParallelWeave->workerFiles.size()));
+
+      pParallelWeave->onWorkersCompleted = weave;
+      pParallelWeave->onCompleted = onCompleted;
+      pParallelWeave->pending = pParallelWeave->workerFiles.size();
+      BOOST_FOREACH(const FilePath& workerFile, pParallelWeave->workerFiles)
+      {
+         Error error = compile_pdf_supervisor::runProgram(
+                  rBinPath,
+                  pRnwWeave->commandArgs(workerFile.filename(), encoding),
+                  core::system::Options(),
+                  rnwPath.parent(),
+                  ignoreOutput,
+                  boost::bind(onParallelWorkerExit, pParallelWeave, _1));
+         if (error)
+         {
+            LOG_ERROR(error);
+            onParallelWorkerExit(pParallelWeave, EXIT_FAILURE);
+         }
       }
    }
    else
@@ -15,6 +15,11 @@
 
 #include "SessionSynctex.hpp"
 
+#include <map>
+#include <ctime>
+
+#include <boost/shared_ptr.hpp>
+
 #include <core/Error.hpp>
 #include <core/FilePath.hpp>
 #include <core/Exec.hpp>
@@ -37,6 +42,64 @@ namespace synctex {
 
 namespace {
 
+// parsing synctex data means reading and decompressing the whole synctex
+// file, so we keep the parsed data for recently searched pdfs around until
+// their synctex file is rewritten by another compile
+struct CachedSynctex
+{
+   CachedSynctex() : lastWriteTime(0), size(0) {}
+   std::time_t lastWriteTime;
+   uintmax_t size;
+   boost::shared_ptr<core::tex::Synctex> pSynctex;
+};
+
+const std::size_t kMaxCachedSynctex = 4;
+std::map<std::string,CachedSynctex> s_synctexCache;
+
+boost::shared_ptr<core::tex::Synctex> synctexForPdf(const FilePath& pdfPath)
+{
+   FilePath synctexPath = pdfPath.parent().complete(pdfPath.stem() +
+                                                    ".synctex.gz");
+   if (!synctexPath.exists())
+      synctexPath = pdfPath.parent().complete(pdfPath.stem() + ".synctex");
+
+   std::string key = pdfPath.absolutePath();
+   if (!synctexPath.exists())
+   {
+      s_synctexCache.erase(key);
+      return boost::shared_ptr<core::tex::Synctex>();
+   }
+
+   // use the cached copy if the synctex file hasn't changed
+   std::map<std::string,CachedSynctex>::const_iterator it =
+                                                   s_synctexCache.find(key);
+   if (it != s_synctexCache.end() &&
+       it->second.lastWriteTime == synctexPath.lastWriteTime() &&
+       it->second.size == synctexPath.size())
+   {
+      return it->second.pSynctex;
+   }
+
+   // parse it
+   CachedSynctex cached;
+   cached.lastWriteTime = synctexPath.lastWriteTime();
+   cached.size = synctexPath.size();
+   cached.pSynctex.reset(new core::tex::Synctex());
+   if (!cached.pSynctex->parse(pdfPath))
+   {
+      s_synctexCache.erase(key);
+      return boost::shared_ptr<core::tex::Synctex>();
+   }
+
+   // make room then cache it
+   s_synctexCache.erase(key);
+   if (s_synctexCache.size() >= kMaxCachedSynctex)
+      s_synctexCache.erase(s_synctexCache.begin());
+   s_synctexCache[key] = cached;
+
+   return cached.pSynctex;
+}
+
 json::Value toJson(const FilePath& pdfFile,
                    const core::tex::PdfLocation& pdfLoc,
                    bool fromClick)
@@ -244,8 +307,8 @@ Error synctexInverseSearch(const json::JsonRpcRequest& request,
       return error;
    FilePath pdfPath = module_context::resolveAliasedPath(file);
 
-   core::tex::Synctex synctex;
-   if (synctex.parse(pdfPath))
+   boost::shared_ptr<core::tex::Synctex> pSynctex = synctexForPdf(pdfPath);
+   if (pSynctex)
    {
       if (!fromClick)
       {
@@ -253,14 +316,14 @@ Error synctexInverseSearch(const json::JsonRpcRequest& request,
          // the passed x and y coordinates since they represent the
          // top of the user-visible content (in case the page is
          // scrolled down from the top)
-         core::tex::PdfLocation contLoc = synctex.topOfPageContent(page);
+         core::tex::PdfLocation contLoc = pSynctex->topOfPageContent(page);
          x = std::max((float)x, contLoc.x());
          y = std::max((float)y, contLoc.y());
       }
 
       core::tex::PdfLocation pdfLocation(page, x, y, width, height);
 
-      core::tex::SourceLocation srcLoc = synctex.inverseSearch(pdfLocation);
+      core::tex::SourceLocation srcLoc = pSynctex->inverseSearch(pdfLocation);
       applyInverseConcordance(&srcLoc);
 
       pResponse->setResult(toJson(srcLoc));
@@ -323,13 +386,13 @@ Error forwardSearch(const FilePath& rootFile,
    // determine pdf
    FilePath pdfFile = rootFile.parent().complete(rootFile.stem() + ".pdf");
 
-   core::tex::Synctex synctex;
-   if (synctex.parse(pdfFile))
+   boost::shared_ptr<core::tex::Synctex> pSynctex = synctexForPdf(pdfFile);
+   if (pSynctex)
    {
       core::tex::SourceLocation srcLoc(inputFile, line, column);
       applyForwardConcordance(rootFile, &srcLoc);
 
-      core::tex::PdfLocation pdfLoc = synctex.forwardSearch(srcLoc);
+      core::tex::PdfLocation pdfLoc = pSynctex->forwardSearch(srcLoc);
       *pPdfLocation = toJson(pdfFile, pdfLoc, fromClick);
    }
    else
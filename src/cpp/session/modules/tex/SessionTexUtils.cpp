@@ -15,14 +15,19 @@
 
 #include "SessionTexUtils.hpp"
 
+#include <map>
+
+#include <boost/bind.hpp>
 #include <boost/foreach.hpp>
 #include <boost/algorithm/string.hpp>
 
+#include <core/Thread.hpp>
 #include <core/system/Process.hpp>
 #include <core/system/Environment.hpp>
 
 #include <r/RExec.hpp>
 
+#include <session/SessionUserSettings.hpp>
 #include <session/SessionModuleContext.hpp>
 
 #include "SessionCompilePdfSupervisor.hpp"
@@ -73,9 +78,19 @@ void ignoreOutput(const std::string& output)
 {
 }
 
-} // anonymous namespace
+void onTexOutput(const boost::function<void(const std::string&)>& onOutput,
+                 const std::string& output)
+{
+   if (onOutput)
+      onOutput(output);
+}
 
-RTexmfPaths rTexmfPaths()
+void setExitStatus(int exitStatus, core::system::ProcessResult* pResult)
+{
+   pResult->exitStatus = exitStatus;
+}
+
+RTexmfPaths computeRTexmfPaths()
 {
    // first determine the R share directory
    std::string rHomeShare;
@@ -113,10 +128,9 @@ RTexmfPaths rTexmfPaths()
 
 // build TEXINPUTS, BIBINPUTS etc. by composing any existing value in
 // the environment (or . if none) with the R dirs in share/texmf
-core::system::Options rTexInputsEnvVars()
+core::system::Options computeRTexInputsEnvVars(const RTexmfPaths& texmfPaths)
 {
    core::system::Options envVars;
-   RTexmfPaths texmfPaths = rTexmfPaths();
    if (!texmfPaths.empty())
    {
       envVars.push_back(inputsEnvVar("TEXINPUTS",
@@ -132,6 +146,108 @@ core::system::Options rTexInputsEnvVars()
    return envVars;
 }
 
+// the tex environment is computed once for each R home (and set of
+// inherited input paths) rather than for every compile pass, and programs
+// are located once until the user settings change. it's shared between
+// threads so the mutex is heap based (to avoid boost mutex assertions when
+// it is destructed in a multicore forked child)
+struct TexEnvironment
+{
+   std::string key;
+   RTexmfPaths texmfPaths;
+   core::system::Options inputsEnvVars;
+   std::map<std::string,FilePath> programPaths;
+};
+
+boost::mutex* s_pTexEnvironmentMutex = new boost::mutex();
+TexEnvironment s_texEnvironment;
+
+std::string texEnvironmentKey()
+{
+   return core::system::getenv("R_HOME") + "\n" +
+          core::system::getenv("TEXINPUTS") + "\n" +
+          core::system::getenv("BIBINPUTS") + "\n" +
+          core::system::getenv("BSTINPUTS");
+}
+
+// NOTE: must be called with s_pTexEnvironmentMutex held
+void ensureTexEnvironment()
+{
+   std::string key = texEnvironmentKey();
+   if (s_texEnvironment.key != key || s_texEnvironment.texmfPaths.empty())
+   {
+      s_texEnvironment.key = key;
+      s_texEnvironment.texmfPaths = computeRTexmfPaths();
+      s_texEnvironment.inputsEnvVars =
+                     computeRTexInputsEnvVars(s_texEnvironment.texmfPaths);
+   }
+}
+
+void onUserSettingsChanged()
+{
+   clearTexEnvironment();
+}
+
+} // anonymous namespace
+
+RTexmfPaths rTexmfPaths()
+{
+   LOCK_MUTEX(*s_pTexEnvironmentMutex)
+   {
+      ensureTexEnvironment();
+      return s_texEnvironment.texmfPaths;
+   }
+   END_LOCK_MUTEX
+
+   // keep compiler happy
+   return RTexmfPaths();
+}
+
+core::system::Options rTexInputsEnvVars()
+{
+   LOCK_MUTEX(*s_pTexEnvironmentMutex)
+   {
+      ensureTexEnvironment();
+      return s_texEnvironment.inputsEnvVars;
+   }
+   END_LOCK_MUTEX
+
+   // keep compiler happy
+   return core::system::Options();
+}
+
+FilePath texProgramPath(const std::string& program)
+{
+   LOCK_MUTEX(*s_pTexEnvironmentMutex)
+   {
+      std::map<std::string,FilePath>::const_iterator it =
+                              s_texEnvironment.programPaths.find(program);
+      if (it != s_texEnvironment.programPaths.end())
+         return it->second;
+   }
+   END_LOCK_MUTEX
+
+   // (searching the path can be slow so don't hold the lock meanwhile)
+   FilePath programPath = module_context::findProgram(program);
+
+   LOCK_MUTEX(*s_pTexEnvironmentMutex)
+   {
+      s_texEnvironment.programPaths[program] = programPath;
+   }
+   END_LOCK_MUTEX
+
+   return programPath;
+}
+
+void clearTexEnvironment()
+{
+   LOCK_MUTEX(*s_pTexEnvironmentMutex)
+   {
+      s_texEnvironment = TexEnvironment();
+   }
+   END_LOCK_MUTEX
+}
+
 Error runTexCompile(const FilePath& texProgramPath,
                     const core::system::Options& envVars,
                     const shell_utils::ShellArgs& args,
@@ -162,6 +278,43 @@ Error runTexCompile(const FilePath& texProgramPath,
                pResult);
 }
 
+core::Error runTexCompile(
+              const core::FilePath& texProgramPath,
+              const core::system::Options& envVars,
+              const core::shell_utils::ShellArgs& args,
+              const core::FilePath& texFilePath,
+              const boost::function<void(const std::string&)>& onOutput,
+              core::system::ProcessResult* pResult)
+{
+   // set options
+   core::system::ProcessOptions procOptions;
+   procOptions.terminateChildren = true;
+   procOptions.redirectStdErrToStdOut = true;
+   core::system::Options env;
+   core::system::getModifiedEnv(envVars, &env);
+   procOptions.environment = env;
+   procOptions.workingDir = texFilePath.parent();
+
+   // callbacks
+   core::system::ProcessCallbacks cb;
+   cb.onStdout = cb.onStderr = boost::bind(onTexOutput, onOutput, _2);
+   cb.onExit = boost::bind(setExitStatus, _1, pResult);
+
+   // run the program with a supervisor of its own and wait for it to exit
+   *pResult = core::system::ProcessResult();
+   core::system::ProcessSupervisor supervisor;
+   Error error = supervisor.runProgram(
+               string_utils::utf8ToSystem(texProgramPath.absolutePath()),
+               buildArgs(args, texFilePath),
+               procOptions,
+               cb);
+   if (error)
+      return error;
+
+   supervisor.wait(boost::posix_time::milliseconds(50));
+   return Success();
+}
+
 core::Error runTexCompile(
               const core::FilePath& texProgramPath,
               const core::system::Options& envVars,
@@ -179,6 +332,21 @@ core::Error runTexCompile(
 
 }
 
+Error initialize()
+{
+   userSettings().onChanged.connect(onUserSettingsChanged);
+
+   // compute the environment now (on the main thread) so compiles needn't
+   // call into R for it
+   LOCK_MUTEX(*s_pTexEnvironmentMutex)
+   {
+      ensureTexEnvironment();
+   }
+   END_LOCK_MUTEX
+
+   return Success();
+}
+
 } // namespace utils
 } // namespace tex
 } // namespace modules
@@ -40,16 +40,35 @@ struct RTexmfPaths
    core::FilePath bstInputsPath;
 };
 
+// the R texmf paths and the TEXINPUTS, BIBINPUTS, and BSTINPUTS which
+// include them (both cached per R home)
 RTexmfPaths rTexmfPaths();
 
 core::system::Options rTexInputsEnvVars();
 
+// location of a tex program (e.g. pdflatex, bibtex) on the path -- empty
+// if it isn't found. cached until the user settings change
+core::FilePath texProgramPath(const std::string& program);
+
+// discard the cached environment and program locations
+void clearTexEnvironment();
+
 core::Error runTexCompile(const core::FilePath& texProgramPath,
                           const core::system::Options& envVars,
                           const core::shell_utils::ShellArgs& args,
                           const core::FilePath& texFilePath,
                           core::system::ProcessResult* pResult);
 
+// run synchronously but pass output to onOutput as it is produced (output
+// isn't accumulated in pResult)
+core::Error runTexCompile(
+              const core::FilePath& texProgramPath,
+              const core::system::Options& envVars,
+              const core::shell_utils::ShellArgs& args,
+              const core::FilePath& texFilePath,
+              const boost::function<void(const std::string&)>& onOutput,
+              core::system::ProcessResult* pResult);
+
 core::Error runTexCompile(
               const core::FilePath& texProgramPath,
               const core::system::Options& envVars,
@@ -57,6 +76,8 @@ core::Error runTexCompile(
               const core::FilePath& texFilePath,
               const boost::function<void(int,const std::string&)>& onExited);
 
+core::Error initialize();
+
 } // namespace utils
 } // namespace tex
 } // namespace modules
@@ -42,9 +42,10 @@ void handleViewPdf(const http::Request& request, http::Response* pResponse)
       return;
    }
 
-   // send it back
+   // send it back (streamed from disk and honoring byte ranges so that the
+   // viewer can display the first pages of large documents right away)
    pResponse->setNoCacheHeaders();
-   pResponse->setFile(filePath, request);
+   pResponse->setRangeableFile(filePath, request);
    pResponse->setContentType("application/pdf");
 }
 
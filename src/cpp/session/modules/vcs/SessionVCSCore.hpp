@@ -22,6 +22,7 @@
 #include <boost/noncopyable.hpp>
 
 #include <core/json/Json.hpp>
+#include <core/FileInfo.hpp>
 #include <core/FilePath.hpp>
 
 namespace session {
@@ -86,6 +87,17 @@ public:
 
    virtual void decorateFile(const core::FilePath& filePath,
                              core::json::Object* pFileObject) = 0;
+
+   // decorate a listing of files (pFileObjects holds the corresponding
+   // file system items). contexts can override this to avoid repeating
+   // work which is common to all of the files
+   virtual void decorateFiles(const std::vector<core::FileInfo>& files,
+                              std::vector<core::json::Object>* pFileObjects)
+   {
+      for (std::size_t i = 0; i < files.size(); i++)
+         decorateFile(core::FilePath(files[i].absolutePath()),
+                      &(pFileObjects->at(i)));
+   }
 };
 
 } // namespace source_control
@@ -14,6 +14,8 @@
  */
 #include "SessionVCSUtils.hpp"
 
+#include <cstring>
+
 #include <boost/regex.hpp>
 
 #include <core/json/Json.hpp>
@@ -201,6 +203,50 @@ std::string convertDiff(const std::string& diff,
    return result;
 }
 
+void splitDiff(const std::string& diff,
+               std::string* pHeader,
+               std::vector<DiffHunk>* pHunks)
+{
+   pHeader->clear();
+   pHunks->clear();
+
+   bool inHeader = true;
+   const char* begin = diff.data();
+   const char* end = begin + diff.size();
+   for (const char* line = begin; line < end; )
+   {
+      const char* lineEnd = static_cast<const char*>(
+                                    std::memchr(line, '\n', end - line));
+      lineEnd = lineEnd ? lineEnd + 1 : end;
+
+      if (end - line >= 2 && line[0] == '@' && line[1] == '@')
+      {
+         if (inHeader)
+         {
+            pHeader->assign(begin, line);
+            inHeader = false;
+         }
+
+         DiffHunk hunk;
+         hunk.offset = line - begin;
+         hunk.length = 0;
+         hunk.lineCount = 0;
+         pHunks->push_back(hunk);
+      }
+
+      if (!pHunks->empty())
+      {
+         pHunks->back().length += lineEnd - line;
+         pHunks->back().lineCount++;
+      }
+
+      line = lineEnd;
+   }
+
+   if (inHeader)
+      *pHeader = diff;
+}
+
 } // namespace vcs_utils
 } // namespace modules
 } // namespace session
@@ -16,6 +16,9 @@
 #ifndef SESSION_VCS_UTILS_HPP
 #define SESSION_VCS_UTILS_HPP
 
+#include <string>
+#include <vector>
+
 #include <boost/noncopyable.hpp>
 
 #include <core/json/Json.hpp>
@@ -54,6 +57,19 @@ std::string convertDiff(const std::string& diff,
                         bool allowSubst,
                         bool* pSuccess=NULL);
 
+// A unified diff split into its file header and hunks (so that large diffs
+// can be delivered a few hunks at a time rather than all at once)
+struct DiffHunk
+{
+   std::size_t offset;     // of the hunk's @@ line within the diff
+   std::size_t length;
+   std::size_t lineCount;  // including the @@ line
+};
+
+void splitDiff(const std::string& diff,
+               std::string* pHeader,
+               std::vector<DiffHunk>* pHunks);
+
 struct RefreshOnExit : public boost::noncopyable
 {
    ~RefreshOnExit()
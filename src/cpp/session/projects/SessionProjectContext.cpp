@@ -29,6 +29,8 @@
 
 #include <session/SessionUserSettings.hpp>
 #include <session/SessionModuleContext.hpp>
+#include <session/SessionOptions.hpp>
+#include <session/SessionSharedFileMonitor.hpp>
 
 using namespace core;
 
@@ -370,6 +372,17 @@ void ProjectContext::onDeferredInit(bool newSession)
                             this, _1);
    cb.onUnregistered = bind(&ProjectContext::fileMonitorTermination,
                             this, Success());
+#ifndef _WIN32
+   if (session::options().sharedFileMonitor())
+   {
+      shared_file_monitor::registerMonitor(directory(),
+                                           true,
+                                           module_context::fileListingFilter,
+                                           cb);
+      return;
+   }
+#endif
+
    core::system::file_monitor::registerMonitor(
                                          directory(),
                                          true,
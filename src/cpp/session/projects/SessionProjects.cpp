@@ -446,6 +446,12 @@ Error writeProjectVcsOptions(const json::JsonRpcRequest& request,
 
 void onQuit()
 {
+#ifndef _WIN32
+   // a parked session quitting isn't the user's last project
+   if (sessionIsParked())
+      return;
+#endif
+
    s_projectContext.setLastProjectPath(s_projectContext.file());
 }
 
@@ -517,8 +523,15 @@ void startup()
    std::string nextSessionProject = s_projectContext.nextSessionProject();
    FilePath lastProjectPath = s_projectContext.lastProjectPath();
 
+   // a restart zygote takes over from a session with a known project (and
+   // mustn't consume the settings used to choose the project of a session)
+   if (session::options().zygote())
+   {
+      projectFilePath = session::options().zygoteProject();
+   }
+
    // check for next session project path (see above for comment)
-   if (!nextSessionProject.empty())
+   else if (!nextSessionProject.empty())
    {
       // reset next session project path so its a one shot deal
       s_projectContext.setNextSessionProject("");
@@ -30,6 +30,8 @@ void startup();
 
 core::Error initialize();
 
+bool sessionIsParked();
+
 core::Error computeScratchPath(const core::FilePath& projectFile,
                                core::FilePath* pScratchPath);
 
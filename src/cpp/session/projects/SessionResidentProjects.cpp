@@ -0,0 +1,327 @@
+/*
+ * SessionResidentProjects.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+// Sessions for recently used projects can be kept resident rather than
+// quitting when the user switches to another project. A resident session
+// is "parked": it stops listening, records itself in a per-user registry
+// and waits. Switching back to its project hands the listener back to it
+// rather than starting (and initializing) a new session.
+//
+// The registry holds one entry per parked project (named by a hash of the
+// project file) containing the pid of its session. To resume a parked
+// session the active session stops its listener and renames the entry to
+// <entry>.resuming; the parked session then restarts its listener and
+// removes the .resuming file to acknowledge the handoff.
+
+#include <session/projects/SessionProjects.hpp>
+
+#include <signal.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+#include <vector>
+#include <algorithm>
+
+#include <boost/foreach.hpp>
+#include <boost/thread.hpp>
+#include <boost/algorithm/string/trim.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/Hash.hpp>
+#include <core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/SafeConvert.hpp>
+
+#include <r/session/RSession.hpp>
+
+#include <session/SessionOptions.hpp>
+#include <session/SessionConstants.hpp>
+#include <session/SessionModuleContext.hpp>
+#include <session/SessionHttpConnectionListener.hpp>
+
+#include "SessionProjectsInternal.hpp"
+
+using namespace core;
+
+namespace session {
+namespace projects {
+
+namespace {
+
+const char * const kResumingExt = ".resuming";
+
+// how long we wait for a parked session to take over the listener
+const int kResumeTimeoutSeconds = 10;
+
+bool s_parked = false;
+
+FilePath registryPath()
+{
+   return module_context::userScratchPath().complete("resident-projects");
+}
+
+FilePath registryEntry(const FilePath& projectFile)
+{
+   return registryPath().complete(hash::xxHash64(projectFile.absolutePath()));
+}
+
+FilePath resumingFile(const FilePath& entry)
+{
+   return FilePath(entry.absolutePath() + kResumingExt);
+}
+
+pid_t entryPid(const FilePath& entry)
+{
+   std::string contents;
+   Error error = readStringFromFile(entry, &contents);
+   if (error)
+      return -1;
+
+   return safe_convert::stringTo<pid_t>(boost::algorithm::trim_copy(contents),
+                                        -1);
+}
+
+bool isOtherLiveProcess(pid_t pid)
+{
+   return pid > 0 && pid != ::getpid() && ::kill(pid, 0) == 0;
+}
+
+void setProcessName(const char* name)
+{
+#ifdef __linux__
+   if (::prctl(PR_SET_NAME, name, 0, 0, 0) == -1)
+      LOG_ERROR(systemError(errno, ERROR_LOCATION));
+#endif
+}
+
+bool waitForRemoval(const FilePath& filePath, int timeoutSeconds)
+{
+   using namespace boost::posix_time;
+   ptime timeout = microsec_clock::universal_time() + seconds(timeoutSeconds);
+   while (filePath.exists())
+   {
+      if (microsec_clock::universal_time() > timeout)
+         return false;
+      boost::this_thread::sleep(milliseconds(50));
+   }
+   return true;
+}
+
+bool newerEntry(const FilePath& lhs, const FilePath& rhs)
+{
+   return lhs.lastWriteTime() > rhs.lastWriteTime();
+}
+
+// remove entries for sessions which are no longer running and ask the
+// oldest parked sessions beyond the resident limit to quit
+void enforceResidentLimit()
+{
+   std::vector<FilePath> children;
+   Error error = registryPath().children(&children);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return;
+   }
+
+   std::vector<FilePath> entries;
+   BOOST_FOREACH(const FilePath& child, children)
+   {
+      if (boost::algorithm::ends_with(child.filename(), kResumingExt))
+         continue;
+
+      pid_t pid = entryPid(child);
+      if (pid == ::getpid() || isOtherLiveProcess(pid))
+         entries.push_back(child);
+      else
+         child.removeIfExists();
+   }
+
+   std::sort(entries.begin(), entries.end(), newerEntry);
+
+   std::size_t limit = options().residentProjects();
+   for (std::size_t i = limit; i < entries.size(); i++)
+   {
+      pid_t pid = entryPid(entries[i]);
+      if (pid == ::getpid())
+         continue;
+
+      // SIGUSR1 is a suspend request, which a parked session treats as a
+      // request to quit (it has already been asked to quit by its user)
+      if (::kill(pid, SIGUSR1) == -1)
+         LOG_ERROR(systemError(errno, ERROR_LOCATION));
+   }
+}
+
+// hand the listener over to the parked session for targetProject (if there
+// is one). returns true if the parked session acknowledged the handoff
+bool resumeParkedSession(const FilePath& targetProject)
+{
+   FilePath entry = registryEntry(targetProject);
+   if (!entry.exists())
+      return false;
+
+   if (!isOtherLiveProcess(entryPid(entry)))
+   {
+      entry.removeIfExists();
+      return false;
+   }
+
+   FilePath resuming = resumingFile(entry);
+   Error error = entry.move(resuming);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return false;
+   }
+
+   if (!waitForRemoval(resuming, kResumeTimeoutSeconds))
+   {
+      LOG_WARNING_MESSAGE("Parked session for " +
+                          targetProject.absolutePath() +
+                          " didn't resume within " +
+                          safe_convert::numberToString(kResumeTimeoutSeconds) +
+                          " sec");
+      resuming.removeIfExists();
+      return false;
+   }
+
+   return true;
+}
+
+void quitParkedSession(const FilePath& entry, bool saveWorkspace)
+{
+   entry.removeIfExists();
+   r::session::quit(saveWorkspace); // does not return
+}
+
+} // anonymous namespace
+
+bool parkForProjectSwitch(const std::string& switchToProject,
+                          bool saveWorkspace,
+                          const boost::function<void()>& acknowledge,
+                          const boost::function<bool()>& quitRequested)
+{
+   using namespace boost::posix_time;
+
+   // only server sessions (which are launched on demand by rserver) with an
+   // active project can be parked
+   if (options().programMode() != kSessionProgramModeServer ||
+       options().residentProjects() <= 0 ||
+       !projectContext().hasProject())
+   {
+      return false;
+   }
+
+   FilePath projectFile = projectContext().file();
+   FilePath targetProject;
+   if (switchToProject != "none")
+   {
+      targetProject = module_context::resolveAliasedPath(switchToProject);
+      if (targetProject == projectFile)
+         return false;
+   }
+
+   Error error = registryPath().ensureDirectory();
+   if (error)
+   {
+      LOG_ERROR(error);
+      return false;
+   }
+
+   // stop listening before we acknowledge the quit (the client reconnects
+   // as soon as it gets the response and must reach the next session)
+   httpConnectionListener().stop();
+
+   if (targetProject.empty() || !resumeParkedSession(targetProject))
+      projectContext().setNextSessionProject(switchToProject);
+
+   acknowledge();
+
+   // register and wait to be resumed
+   FilePath entry = registryEntry(projectFile);
+   resumingFile(entry).removeIfExists();
+   error = writeStringToFile(entry,
+                             safe_convert::numberToString(::getpid()));
+   if (error)
+   {
+      LOG_ERROR(error);
+      r::session::quit(saveWorkspace); // does not return
+   }
+
+   s_parked = true;
+   setProcessName(kParkedSessionProcessName);
+   enforceResidentLimit();
+
+   ptime timeoutTime(not_a_date_time);
+   if (options().timeoutMinutes() > 0)
+   {
+      timeoutTime = second_clock::universal_time() +
+                    minutes(options().timeoutMinutes());
+   }
+
+   while (true)
+   {
+      boost::this_thread::sleep(milliseconds(100));
+
+      if (quitRequested() ||
+          (!timeoutTime.is_not_a_date_time() &&
+           second_clock::universal_time() > timeoutTime))
+      {
+         quitParkedSession(entry, saveWorkspace);
+      }
+
+      if (entry.exists())
+         continue;
+
+      // our entry was removed by someone other than a resuming session
+      FilePath resuming = resumingFile(entry);
+      if (!resuming.exists())
+         quitParkedSession(entry, saveWorkspace);
+
+      error = httpConnectionListener().start();
+      if (error)
+      {
+         // leave the resuming file in place so the other session falls
+         // back to launching a new session for us
+         LOG_ERROR(error);
+         quitParkedSession(entry, saveWorkspace);
+      }
+
+      error = resuming.remove();
+      if (error)
+         LOG_ERROR(error);
+
+      s_parked = false;
+      setProcessName("rsession");
+      projectContext().setLastProjectPath(projectFile);
+
+      return true;
+   }
+}
+
+bool sessionIsParked()
+{
+   return s_parked;
+}
+
+} // namespace projects
+} // namesapce session
+
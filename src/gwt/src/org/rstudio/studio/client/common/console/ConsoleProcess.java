@@ -15,6 +15,8 @@
 package org.rstudio.studio.client.common.console;
 
 import com.google.gwt.core.client.JsArray;
+import com.google.gwt.core.client.Scheduler;
+import com.google.gwt.core.client.Scheduler.ScheduledCommand;
 import com.google.gwt.event.shared.GwtEvent;
 import com.google.gwt.event.shared.HandlerManager;
 import com.google.gwt.event.shared.HandlerRegistration;
@@ -251,8 +253,11 @@ public class ConsoleProcess implements ConsoleOutputEvent.HasHandlers,
                                              ServerConsoleOutputEvent event)
                {
                   if (event.getProcessHandle().equals(procInfo.getHandle()))
+                  {
                      fireEvent(new ConsoleOutputEvent(event.getOutput(),
                                                       event.getError()));
+                     ackOutput(event.getSequence());
+                  }
                }
             }));
       registrations_.add(eventBus.addHandler(
@@ -312,6 +317,30 @@ public class ConsoleProcess implements ConsoleOutputEvent.HasHandlers,
       server_.processReap(procInfo_.getHandle(), requestCallback);
    }
 
+   // the server stops reading output from the process when too much of it
+   // is unacknowledged. we acknowledge once the output has been handled
+   // (deferred so that a burst of events results in a single ack)
+   private void ackOutput(int sequence)
+   {
+      boolean scheduled = ackSequence_ >= 0;
+      ackSequence_ = Math.max(ackSequence_, sequence);
+      if (scheduled)
+         return;
+
+      Scheduler.get().scheduleDeferred(new ScheduledCommand()
+      {
+         @Override
+         public void execute()
+         {
+            int sequence = ackSequence_;
+            ackSequence_ = -1;
+            server_.processAckOutput(procInfo_.getHandle(),
+                                     sequence,
+                                     new VoidServerRequestCallback());
+         }
+      });
+   }
+
    @Override
    public HandlerRegistration addConsoleOutputHandler(
                                              ConsoleOutputEvent.Handler handler)
@@ -343,4 +372,5 @@ public class ConsoleProcess implements ConsoleOutputEvent.HasHandlers,
    private final HandlerManager handlers_ = new HandlerManager(this);
    private final ConsoleServerOperations server_;
    private final ConsoleProcessInfo procInfo_;
+   private int ackSequence_ = -1;
 }
@@ -33,17 +33,20 @@ public class ServerConsoleOutputEvent
       public native final String getHandle() /*-{ return this.handle; }-*/;
       public native final String getOutput() /*-{ return this.output; }-*/;
       public native final boolean isError() /*-{ return this.error; }-*/;
+      public native final int getSequence() /*-{ return this.seq; }-*/;
    }
 
 
    public ServerConsoleOutputEvent(String procHandle,
                                    String output,
-                                   boolean error)
+                                   boolean error,
+                                   int sequence)
    {
 
       procHandle_ = procHandle;
       output_ = output;
       error_ = error;
+      sequence_ = sequence;
    }
 
    public String getProcessHandle()
@@ -61,6 +64,12 @@ public class ServerConsoleOutputEvent
       return error_;
    }
 
+   // sequence number used to acknowledge the output (for flow control)
+   public int getSequence()
+   {
+      return sequence_;
+   }
+
    @Override
    public Type<Handler> getAssociatedType()
    {
@@ -76,6 +85,7 @@ public class ServerConsoleOutputEvent
    private final String procHandle_;
    private final String output_;
    private final boolean error_;
+   private final int sequence_;
 
    public static final Type<Handler> TYPE = new Type<Handler>();
 }
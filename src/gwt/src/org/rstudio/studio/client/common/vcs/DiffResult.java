@@ -36,4 +36,27 @@ public class DiffResult extends JavaScriptObject
    public native final String getDecodedValue() /*-{
       return this.decoded_value;
    }-*/;
+
+   /**
+    * Large diffs are delivered a page of hunks at a time (each page begins
+    * with the file header). The first hunk on this page.
+    */
+   public native final int getFirstHunk() /*-{
+      return this.first_hunk;
+   }-*/;
+
+   /**
+    * The first hunk on the next page (or -1 if this is the last page).
+    */
+   public native final int getNextHunk() /*-{
+      return this.next_hunk;
+   }-*/;
+
+   public native final int getTotalHunks() /*-{
+      return this.total_hunks;
+   }-*/;
+
+   public native final int getTotalLines() /*-{
+      return this.total_lines;
+   }-*/;
 }
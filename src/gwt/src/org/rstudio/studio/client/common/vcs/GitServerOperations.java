@@ -75,10 +75,15 @@ public interface GitServerOperations extends VCSServerOperations
                   boolean signOff,
                   ServerRequestCallback<ConsoleProcess> requestCallback);
 
+   /**
+    * @param firstHunk The first hunk of the page of the diff to return (the
+    *    diff is recomputed when this is 0)
+    */
    void gitDiffFile(String path,
                     PatchMode patchMode,
                     int contextLines,
                     boolean noSizeWarning,
+                    int firstHunk,
                     ServerRequestCallback<DiffResult> requestCallback);
 
    /**
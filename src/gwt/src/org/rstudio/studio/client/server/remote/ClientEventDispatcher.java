@@ -306,7 +306,8 @@ public class ClientEventDispatcher
             ServerConsoleOutputEvent.Data data = event.getData();
             eventBus_.fireEvent(new ServerConsoleOutputEvent(data.getHandle(),
                                                             data.getOutput(),
-                                                            data.isError()));
+                                                            data.isError(),
+                                                            data.getSequence()));
          }
          else if (type.equals(ClientEvent.ConsoleProcessPrompt))
          {
@@ -0,0 +1,140 @@
+/*
+ * EventStream.java
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+package org.rstudio.studio.client.server.remote;
+
+import com.google.gwt.core.client.JavaScriptObject;
+import com.google.gwt.core.client.JsArray;
+import com.google.gwt.json.client.JSONParser;
+import com.google.gwt.json.client.JSONValue;
+
+// websocket over which the server pushes client events as they occur
+class EventStream
+{
+   interface Handler
+   {
+      void onOpen(EventStream stream);
+      void onEvents(EventStream stream, JsArray<ClientEvent> events);
+      void onClose(EventStream stream);
+   }
+
+   public static native boolean isSupported() /*-{
+      return !!$wnd.WebSocket;
+   }-*/;
+
+   public EventStream(String url, Handler handler)
+   {
+      handler_ = handler;
+      socket_ = open(url);
+   }
+
+   // false if the socket couldn't be created at all
+   public boolean isValid()
+   {
+      return socket_ != null;
+   }
+
+   // whether the connection was ever established
+   public boolean wasOpened()
+   {
+      return wasOpened_;
+   }
+
+   // confirm receipt of events (so the server doesn't need to retain them)
+   public void confirmEvents(int lastEventId)
+   {
+      send(String.valueOf(lastEventId));
+   }
+
+   public void close()
+   {
+      closed_ = true;
+      if (socket_ != null)
+         closeSocket();
+   }
+
+   private native JavaScriptObject open(String url) /*-{
+      var self = this;
+      try
+      {
+         var socket = new $wnd.WebSocket(url);
+         socket.onopen = $entry(function() {
+            self.@org.rstudio.studio.client.server.remote.EventStream::onOpen()();
+         });
+         socket.onmessage = $entry(function(e) {
+            self.@org.rstudio.studio.client.server.remote.EventStream::onMessage(Ljava/lang/String;)(e.data);
+         });
+         socket.onclose = $entry(function() {
+            self.@org.rstudio.studio.client.server.remote.EventStream::onClose()();
+         });
+         return socket;
+      }
+      catch(e)
+      {
+         return null;
+      }
+   }-*/;
+
+   private native void send(String data) /*-{
+      var socket = this.@org.rstudio.studio.client.server.remote.EventStream::socket_;
+      if (socket != null && socket.readyState == 1)
+         socket.send(data);
+   }-*/;
+
+   private native void closeSocket() /*-{
+      this.@org.rstudio.studio.client.server.remote.EventStream::socket_.close();
+   }-*/;
+
+   private void onOpen()
+   {
+      wasOpened_ = true;
+      if (!closed_)
+         handler_.onOpen(this);
+   }
+
+   private void onMessage(String data)
+   {
+      if (closed_)
+         return;
+
+      JsArray<ClientEvent> events = null;
+      try
+      {
+         JSONValue val = JSONParser.parseStrict(data);
+         events = val.isArray().getJavaScriptObject().cast();
+      }
+      catch(Exception e)
+      {
+         // see RpcResponse.parse for why we fall back to parseLenient
+         JSONValue val = JSONParser.parseLenient(data);
+         events = val.isArray().getJavaScriptObject().cast();
+      }
+
+      handler_.onEvents(this, events);
+   }
+
+   private void onClose()
+   {
+      if (!closed_)
+      {
+         closed_ = true;
+         handler_.onClose(this);
+      }
+   }
+
+   private final Handler handler_;
+   private final JavaScriptObject socket_;
+   private boolean wasOpened_ = false;
+   private boolean closed_ = false;
+}
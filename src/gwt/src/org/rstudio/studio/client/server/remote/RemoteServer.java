@@ -57,6 +57,8 @@ import org.rstudio.studio.client.workbench.codesearch.model.CodeSearchResults;
 import org.rstudio.studio.client.workbench.codesearch.model.FunctionDefinition;
 import org.rstudio.studio.client.workbench.codesearch.model.SearchPathFunctionDefinition;
 import org.rstudio.studio.client.workbench.model.Agreement;
+import org.rstudio.studio.client.workbench.model.ClientInitCache;
+import org.rstudio.studio.client.workbench.model.ConsoleActionCache;
 import org.rstudio.studio.client.workbench.model.HTMLCapabilities;
 import org.rstudio.studio.client.workbench.model.Session;
 import org.rstudio.studio.client.workbench.model.SessionInfo;
@@ -169,13 +171,21 @@ public class RemoteServer implements Server
    public void clientInit(
                      final ServerRequestCallback<SessionInfo> requestCallback)
    {      
+      // tell the session which console actions and sections we have cached
+      JSONArray params = new JSONArray();
+      params.set(0, new JSONString(ConsoleActionCache.getCachedId()));
+      params.set(1, new JSONNumber(ConsoleActionCache.getCachedSequence()));
+      params.set(2, new JSONObject(ClientInitCache.getSectionTags()));
+
       // send init request (record clientId and version contained in response)
       sendRequest(RPC_SCOPE, 
                   CLIENT_INIT, 
+                  params,
                   new ServerRequestCallback<SessionInfo>() {
 
          public void onResponseReceived(SessionInfo sessionInfo)
          {
+            ClientInitCache.update(sessionInfo);
             clientId_ = sessionInfo.getClientId();
             clientVersion_ = sessionInfo.getClientVersion();
             requestCallback.onResponseReceived(sessionInfo);
@@ -428,6 +438,17 @@ public class RemoteServer implements Server
       sendRequest(RPC_SCOPE, PROCESS_WRITE_STDIN, params, requestCallback);
    }
 
+   @Override
+   public void processAckOutput(String handle,
+                                int sequence,
+                                ServerRequestCallback<Void> requestCallback)
+   {
+      JSONArray params = new JSONArray();
+      params.set(0, new JSONString(handle));
+      params.set(1, new JSONNumber(sequence));
+      sendRequest(RPC_SCOPE, PROCESS_ACK_OUTPUT, params, requestCallback);
+   }
+
 
    public void interrupt(ServerRequestCallback<Void> requestCallback)
    {
@@ -472,6 +493,17 @@ public class RemoteServer implements Server
       sendRequest(RPC_SCOPE, LIST_OBJECTS, requestCallback);
    }
 
+   public void listObjectsPage(
+         int offset,
+         int count,
+         ServerRequestCallback<WorkspaceObjectPage> requestCallback)
+   {
+      JSONArray params = new JSONArray();
+      params.set(0, new JSONNumber(offset));
+      params.set(1, new JSONNumber(count));
+      sendRequest(RPC_SCOPE, LIST_OBJECTS_PAGE, params, requestCallback);
+   }
+
   
    public void removeAllObjects(boolean includeHidden,
                                 ServerRequestCallback<Void> requestCallback)
@@ -616,6 +648,16 @@ public class RemoteServer implements Server
    {
       sendRequest(RPC_SCOPE, IGNORE_NEXT_LOADED_PACKAGE_CHECK, requestCallback);
    }
+   
+   public void installPackages(List<String> packages,
+                               String libPath,
+                               ServerRequestCallback<Boolean> requestCallback)
+   {
+      JSONArray params = new JSONArray();
+      params.set(0, new JSONArray(JsUtil.toJsArrayString(packages)));
+      params.set(1, new JSONString(libPath));
+      sendRequest(RPC_SCOPE, INSTALL_PACKAGES, params, requestCallback);
+   }
 
    public void setCRANMirror(CRANMirror mirror,
                              ServerRequestCallback<Void> requestCallback)
@@ -1047,6 +1089,16 @@ public class RemoteServer implements Server
       sendRequest(RPC_SCOPE, OPEN_DOCUMENT, params, requestCallback);
    }
 
+   public void viewLargeFile(String path,
+                             String encoding,
+                             ServerRequestCallback<Void> requestCallback)
+   {
+      JSONArray params = new JSONArray();
+      params.set(0, new JSONString(path));
+      params.set(1, new JSONString(encoding != null ? encoding : ""));
+      sendRequest(RPC_SCOPE, VIEW_LARGE_FILE, params, requestCallback);
+   }
+
    public void saveDocument(String id,
                             String path,
                             String fileType,
@@ -1542,6 +1594,7 @@ public class RemoteServer implements Server
                            PatchMode mode,
                            int contextLines,
                            boolean noSizeWarning,
+                           int firstHunk,
                            ServerRequestCallback<DiffResult> requestCallback)
    {
       JSONArray params = new JSONArray();
@@ -1549,6 +1602,7 @@ public class RemoteServer implements Server
       params.set(1, new JSONNumber(mode.getValue()));
       params.set(2, new JSONNumber(contextLines));
       params.set(3, JSONBoolean.getInstance(noSizeWarning));
+      params.set(4, new JSONNumber(firstHunk));
       sendRequest(RPC_SCOPE, GIT_DIFF_FILE, params, requestCallback);
    }
 
@@ -1737,6 +1791,21 @@ public class RemoteServer implements Server
                          retryHandler);
    }
 
+   String getEventStreamUrl(int lastEventId)
+   {
+      String url = GWT.getHostPageBaseURL() + EVENT_STREAM_SCOPE +
+                   "?client_id=" + URL.encodeQueryString(clientId_) +
+                   "&last_event_id=" + lastEventId;
+      
+      // websockets use their own url schemes
+      if (url.startsWith("https:"))
+         return "wss:" + url.substring("https:".length());
+      else if (url.startsWith("http:"))
+         return "ws:" + url.substring("http:".length());
+      else
+         return url;
+   }
+
    void handleUnauthorizedError()
    {
       // disconnect
@@ -2767,6 +2836,7 @@ public class RemoteServer implements Server
    private static final String RPC_SCOPE = "rpc";
    private static final String FILES_SCOPE = "files";
    private static final String EVENTS_SCOPE = "events";
+   private static final String EVENT_STREAM_SCOPE = "event_stream";
    private static final String UPLOAD_SCOPE = "upload";
    private static final String EXPORT_SCOPE = "export";
    private static final String GRAPHICS_SCOPE = "graphics";
@@ -2808,8 +2878,10 @@ public class RemoteServer implements Server
    private static final String PROCESS_INTERRUPT = "process_interrupt";
    private static final String PROCESS_REAP = "process_reap";
    private static final String PROCESS_WRITE_STDIN = "process_write_stdin";
+   private static final String PROCESS_ACK_OUTPUT = "process_ack_output";
 
    private static final String LIST_OBJECTS = "list_objects";
+   private static final String LIST_OBJECTS_PAGE = "list_objects_page";
    private static final String REMOVE_ALL_OBJECTS = "remove_all_objects";
    private static final String SET_OBJECT_VALUE = "set_object_value";
    private static final String GET_OBJECT_VALUE = "get_object_value";
@@ -2826,6 +2898,7 @@ public class RemoteServer implements Server
    private static final String INIT_DEFAULT_USER_LIBRARY = "init_default_user_library";
    private static final String LOADED_PACKAGE_UPDATES_REQUIRED = "loaded_package_updates_required";
    private static final String IGNORE_NEXT_LOADED_PACKAGE_CHECK = "ignore_next_loaded_package_check";
+   private static final String INSTALL_PACKAGES = "install_packages";
    private static final String GET_PACKAGE_INSTALL_CONTEXT = "get_package_install_context";
    private static final String IS_PACKAGE_LOADED = "is_package_loaded";
    private static final String SET_CRAN_MIRROR = "set_cran_mirror";
@@ -2868,6 +2941,7 @@ public class RemoteServer implements Server
    
    private static final String NEW_DOCUMENT = "new_document";
    private static final String OPEN_DOCUMENT = "open_document";
+   private static final String VIEW_LARGE_FILE = "view_large_file";
    private static final String SAVE_DOCUMENT = "save_document";
    private static final String SAVE_DOCUMENT_DIFF = "save_document_diff";
    private static final String CHECK_FOR_EXTERNAL_EDIT = "check_for_external_edit";
@@ -24,6 +24,7 @@ import org.rstudio.core.client.jsonrpc.RpcError;
 import org.rstudio.core.client.jsonrpc.RpcRequest;
 import org.rstudio.core.client.jsonrpc.RpcRequestCallback;
 import org.rstudio.core.client.jsonrpc.RpcResponse;
+import org.rstudio.studio.client.application.Desktop;
 import org.rstudio.studio.client.application.events.*;
 import org.rstudio.studio.client.server.ServerError;
 import org.rstudio.studio.client.server.ServerRequestCallback;
@@ -121,6 +122,9 @@ class RemoteServerEventListener
       // eliminate this scenario then
       lastEventId_ = -1;
       
+      // give the event stream another chance if it failed previously
+      eventStreamFailed_ = false;
+      
       // start listening
       listen();
    }
@@ -139,6 +143,11 @@ class RemoteServerEventListener
          activeRequest_.cancel();
          activeRequest_ = null;
       }
+      if (eventStream_ != null)
+      {
+         eventStream_.close();
+         eventStream_ = null;
+      }
    }
    
    // ensure that we are actively listening for events (used to make 
@@ -183,8 +192,9 @@ class RemoteServerEventListener
      } 
      
      // if we are listening then use the Watchdog to still make sure we 
-     // receive the events even if it requires restarting
-     else
+     // receive the events even if it requires restarting (not necessary
+     // for the event stream since we are always notified when it closes)
+     else if (eventStream_ == null)
      {     
         // NOTE: Watchdog is required to work around pathological cases
         // where the browser has terminated our request for events but
@@ -246,6 +256,13 @@ class RemoteServerEventListener
       // abort if we are no longer running
       if (!isListening_)
          return;
+      
+      // use the event stream if we can
+      if (useEventStream())
+      {
+         openEventStream();
+         return;
+      }
           
       // setup request callback (save reference for cancellation)
       activeRequestCallback_ = new ServerRequestCallback<JsArray<ClientEvent>>() 
@@ -261,20 +278,8 @@ class RemoteServerEventListener
                // only processs events if we are still listening
                if (isListening_ && (events != null))
                {
-                  for (int i=0; i<events.length(); i++)
-                  {
-                     // we can stop listening in the middle of dispatching
-                     // events (e.g. if we dispatch a Suicide event) so we 
-                     // need to check the listening_ flag before each event
-                     // is dispatched
-                     if (!isListening_)
-                        return;
-                     
-                     // disppatch event
-                     ClientEvent event = events.get(i);
-                     dispatchEvent(event);
-                     lastEventId_ = event.getId();
-                  }   
+                  if (!dispatchEvents(events))
+                     return;
                }
             }
             // catch all here to make sure that in all cases we call
@@ -356,6 +361,99 @@ class RemoteServerEventListener
    }
    
    
+   private boolean useEventStream()
+   {
+      // desktop mode connects to the session directly (and already has
+      // minimal batching delays on its event requests)
+      return !eventStreamFailed_ &&
+             !Desktop.isDesktop() &&
+             EventStream.isSupported();
+   }
+   
+   private void openEventStream()
+   {
+      EventStream stream = new EventStream(
+                                 server_.getEventStreamUrl(lastEventId_),
+                                 new EventStream.Handler() {
+         
+         public void onOpen(EventStream stream)
+         {
+            listenErrorCount_ = 0;
+         }
+         
+         public void onEvents(EventStream stream, JsArray<ClientEvent> events)
+         {
+            if (stream != eventStream_)
+               return;
+            
+            watchdog_.notifyResponseReceived();
+            
+            try
+            {
+               if (!dispatchEvents(events))
+                  return;
+            }
+            catch(Throwable e)
+            {
+               GWT.log("ERROR: Processing client events", e);
+            }
+            
+            if (events.length() > 0 && stream == eventStream_)
+               stream.confirmEvents(lastEventId_);
+         }
+         
+         public void onClose(EventStream stream)
+         {
+            if (stream != eventStream_)
+               return;
+            eventStream_ = null;
+            
+            if (!isListening_)
+               return;
+            
+            // if we never managed to connect (e.g. an intermediary doesn't
+            // support websockets) then fall back to polling for events
+            if (!stream.wasOpened())
+               eventStreamFailed_ = true;
+            
+            // reconnect (or poll)
+            listen();
+         }
+      });
+      
+      if (stream.isValid())
+      {
+         eventStream_ = stream;
+      }
+      else
+      {
+         eventStreamFailed_ = true;
+         listen();
+      }
+   }
+   
+   // dispatch events, returning false if we stopped listening while
+   // doing so
+   private boolean dispatchEvents(JsArray<ClientEvent> events)
+   {
+      for (int i=0; i<events.length(); i++)
+      {
+         // we can stop listening in the middle of dispatching
+         // events (e.g. if we dispatch a Suicide event) so we 
+         // need to check the listening_ flag before each event
+         // is dispatched
+         if (!isListening_)
+            return false;
+         
+         // disppatch event
+         ClientEvent event = events.get(i);
+         dispatchEvent(event);
+         lastEventId_ = event.getId();
+      }
+      
+      return true;
+   }
+   
    private void dispatchEvent(ClientEvent event)
    {
       // do some special handling before calling the standard dispatcher
@@ -489,6 +587,9 @@ class RemoteServerEventListener
    
    private RpcRequest activeRequest_ ;
    private ServerRequestCallback<JsArray<ClientEvent>> activeRequestCallback_;
+   
+   private EventStream eventStream_ ;
+   private boolean eventStreamFailed_ ;
 
    private final ClientEventDispatcher eventDispatcher_;
    
@@ -273,6 +273,7 @@ public abstract class
    public abstract AppCommand buildBinaryPackage();
    public abstract AppCommand roxygenizePackage();
    public abstract AppCommand checkPackage();
+   public abstract AppCommand testPackage();
    public abstract AppCommand stopBuild();
    public abstract AppCommand buildToolsProjectSetup();
    public abstract AppCommand activateBuild();
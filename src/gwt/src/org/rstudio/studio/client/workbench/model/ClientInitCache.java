@@ -0,0 +1,99 @@
+/*
+ * ClientInitCache.java
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+package org.rstudio.studio.client.workbench.model;
+
+import com.google.gwt.core.client.JavaScriptObject;
+
+/**
+ * Caches the tagged sections of the client_init response in local storage
+ * so that when the page is reloaded the session only needs to send the
+ * sections whose contents have changed.
+ */
+public class ClientInitCache
+{
+   /**
+    * The tags of the sections we have cached (section name => tag)
+    */
+   public static native JavaScriptObject getSectionTags() /*-{
+      var tags = {};
+      var cache = @org.rstudio.studio.client.workbench.model.ClientInitCache::readCache()();
+      if (cache)
+      {
+         for (var name in cache)
+            tags[name] = cache[name].tag;
+      }
+      return tags;
+   }-*/;
+
+   /**
+    * Restore the sections which the session omitted (because our cached
+    * copies are current) and cache the sections it sent.
+    */
+   public static native void update(SessionInfo sessionInfo) /*-{
+      var tags = sessionInfo.section_tags;
+      if (!tags)
+         return;
+
+      var cache = @org.rstudio.studio.client.workbench.model.ClientInitCache::readCache()() || {};
+
+      var cached = sessionInfo.cached_sections || [];
+      for (var i = 0; i < cached.length; i++)
+      {
+         var name = cached[i];
+         if (cache[name])
+            sessionInfo[name] = cache[name].value;
+      }
+
+      var updated = {};
+      for (var name in tags)
+      {
+         if (sessionInfo.hasOwnProperty(name))
+            updated[name] = { tag: tags[name], value: sessionInfo[name] };
+      }
+      @org.rstudio.studio.client.workbench.model.ClientInitCache::writeCache(Lcom/google/gwt/core/client/JavaScriptObject;)(updated);
+   }-*/;
+
+   // local storage may be unavailable (or full) in which case we just
+   // don't cache
+   private static native JavaScriptObject readCache() /*-{
+      try
+      {
+         var value = $wnd.localStorage.getItem("rstudio.clientInit");
+         return value ? $wnd.JSON.parse(value) : null;
+      }
+      catch (e)
+      {
+         return null;
+      }
+   }-*/;
+
+   private static native void writeCache(JavaScriptObject cache) /*-{
+      try
+      {
+         $wnd.localStorage.setItem("rstudio.clientInit",
+                                   $wnd.JSON.stringify(cache));
+      }
+      catch (e)
+      {
+         try
+         {
+            $wnd.localStorage.removeItem("rstudio.clientInit");
+         }
+         catch (e2)
+         {
+         }
+      }
+   }-*/;
+}
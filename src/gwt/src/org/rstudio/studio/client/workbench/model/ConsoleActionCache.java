@@ -0,0 +1,122 @@
+/*
+ * ConsoleActionCache.java
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+package org.rstudio.studio.client.workbench.model;
+
+import com.google.gwt.core.client.JavaScriptObject;
+import org.rstudio.core.client.jsonrpc.RpcObjectList;
+
+/**
+ * Caches the console actions played back at client_init in local storage
+ * so that when the page is reloaded the session only needs to send the
+ * actions which are newer than those cached.
+ */
+public class ConsoleActionCache
+{
+   public static native String getCachedId() /*-{
+      var cache = @org.rstudio.studio.client.workbench.model.ConsoleActionCache::readCache()();
+      return cache ? cache.id : "";
+   }-*/;
+
+   public static native int getCachedSequence() /*-{
+      var cache = @org.rstudio.studio.client.workbench.model.ConsoleActionCache::readCache()();
+      return cache ? cache.sequence : -1;
+   }-*/;
+
+   /**
+    * Combine the console actions sent by the session with those cached
+    * (if the session only sent newer actions), update the cache, and
+    * return the actions to play back.
+    */
+   public static native RpcObjectList<ConsoleAction> update(
+                                          SessionInfo sessionInfo) /*-{
+      var actions = sessionInfo.console_actions;
+      var limit = sessionInfo.console_actions_limit;
+
+      // nothing to play back (a new session) so nothing to cache either
+      if (!actions || !sessionInfo.console_actions_id)
+      {
+         @org.rstudio.studio.client.workbench.model.ConsoleActionCache::writeCache(Lcom/google/gwt/core/client/JavaScriptObject;)(null);
+         return actions;
+      }
+
+      var type = actions.type;
+      var data = actions.data;
+      if (sessionInfo.console_actions_delta)
+      {
+         var cache = @org.rstudio.studio.client.workbench.model.ConsoleActionCache::readCache()();
+         if (cache && cache.id === sessionInfo.console_actions_id)
+         {
+            type = cache.type.concat(type);
+            data = cache.data.concat(data);
+         }
+      }
+
+      // keep no more than the session would
+      if (limit > 0 && type.length > limit)
+      {
+         type = type.slice(type.length - limit);
+         data = data.slice(data.length - limit);
+      }
+
+      @org.rstudio.studio.client.workbench.model.ConsoleActionCache::writeCache(Lcom/google/gwt/core/client/JavaScriptObject;)({
+         id: sessionInfo.console_actions_id,
+         sequence: sessionInfo.console_actions_sequence,
+         type: type,
+         data: data
+      });
+
+      return { type: type, data: data };
+   }-*/;
+
+   // local storage may be unavailable (or full) in which case we just
+   // don't cache
+   private static native JavaScriptObject readCache() /*-{
+      try
+      {
+         var value = $wnd.localStorage.getItem("rstudio.consoleActions");
+         if (!value)
+            return null;
+         var cache = $wnd.JSON.parse(value);
+         if (!cache || !cache.type || !cache.data)
+            return null;
+         return cache;
+      }
+      catch (e)
+      {
+         return null;
+      }
+   }-*/;
+
+   private static native void writeCache(JavaScriptObject cache) /*-{
+      try
+      {
+         if (cache)
+            $wnd.localStorage.setItem("rstudio.consoleActions",
+                                      $wnd.JSON.stringify(cache));
+         else
+            $wnd.localStorage.removeItem("rstudio.consoleActions");
+      }
+      catch (e)
+      {
+         try
+         {
+            $wnd.localStorage.removeItem("rstudio.consoleActions");
+         }
+         catch (e2)
+         {
+         }
+      }
+   }-*/;
+}
@@ -80,6 +80,8 @@ public class BuildPane extends WorkbenchPane implements BuildPresenter.Display
          moreMenu.addSeparator();
          moreMenu.addItem(commands_.rebuildAll().createMenuItem(false));
          moreMenu.addSeparator();
+         moreMenu.addItem(commands_.testPackage().createMenuItem(false));
+         moreMenu.addSeparator();
          moreMenu.addItem(commands_.buildSourcePackage().createMenuItem(false));
          moreMenu.addItem(commands_.buildBinaryPackage().createMenuItem(false));
          moreMenu.addSeparator();
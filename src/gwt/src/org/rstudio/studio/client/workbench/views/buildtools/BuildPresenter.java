@@ -282,6 +282,11 @@ public class BuildPresenter extends BasePresenter
       startBuild("check-package");
    }
    
+   void onTestPackage()
+   {
+      startBuild("test-package");
+   }
+   
   
    void onRebuildAll()
    {
@@ -57,6 +57,8 @@ public class BuildTab extends DelayLoadWorkbenchTab<BuildPresenter>
       public abstract void onStopBuild();
       @Handler
       public abstract void onCheckPackage();
+      @Handler
+      public abstract void onTestPackage();
       
       abstract void initialize(BuildState buildState);
    }
@@ -105,6 +107,7 @@ public class BuildTab extends DelayLoadWorkbenchTab<BuildPresenter>
                commands.buildBinaryPackage().remove();
                commands.roxygenizePackage().remove();
                commands.checkPackage().remove();
+               commands.testPackage().remove();
                commands.buildAll().setImageResource(
                                  BuildPaneResources.INSTANCE.iconBuild());
                commands.buildAll().setMenuLabel("_Build All");
@@ -44,4 +44,9 @@ public interface ConsoleServerOperations extends CodeToolsServerOperations,
    void processWriteStdin(String handle,
                           ShellInput input,
                           ServerRequestCallback<Void> requestCallback);
+
+   // acknowledge receipt of output events (up to and including sequence)
+   void processAckOutput(String handle,
+                         int sequence,
+                         ServerRequestCallback<Void> requestCallback);
 }
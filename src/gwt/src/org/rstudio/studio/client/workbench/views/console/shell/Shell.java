@@ -39,6 +39,7 @@ import org.rstudio.studio.client.workbench.commands.Commands;
 import org.rstudio.studio.client.workbench.model.ClientInitState;
 import org.rstudio.studio.client.workbench.model.ClientState;
 import org.rstudio.studio.client.workbench.model.ConsoleAction;
+import org.rstudio.studio.client.workbench.model.ConsoleActionCache;
 import org.rstudio.studio.client.workbench.model.Session;
 import org.rstudio.studio.client.workbench.model.SessionInfo;
 import org.rstudio.studio.client.workbench.model.helper.StringStateValue;
@@ -161,7 +162,8 @@ public class Shell implements ConsoleInputHandler,
       if (history != null)
          setHistory(history);
 
-      RpcObjectList<ConsoleAction> actions = sessionInfo.getConsoleActions();
+      RpcObjectList<ConsoleAction> actions =
+                                    ConsoleActionCache.update(sessionInfo);
       if (actions != null)
       {
          view_.playbackActions(actions);
@@ -45,6 +45,7 @@ import org.rstudio.studio.client.workbench.WorkbenchView;
 import org.rstudio.studio.client.workbench.commands.Commands;
 import org.rstudio.studio.client.workbench.model.ClientState;
 import org.rstudio.studio.client.workbench.model.Session;
+import org.rstudio.studio.client.workbench.model.SessionInfo;
 import org.rstudio.studio.client.workbench.model.helper.JSObjectStateValue;
 import org.rstudio.studio.client.workbench.views.BasePresenter;
 import org.rstudio.studio.client.workbench.views.console.events.ConsolePromptEvent;
@@ -110,6 +111,7 @@ public class Packages
       super(view);
       view_ = view;
       server_ = server;
+      session_ = session;
       globalDisplay_ = globalDisplay ;
       view_.setObserver(this) ;
       events_ = events ;
@@ -314,7 +316,19 @@ public class Packages
                
                command.append(")");
                String cmd = command.toString();
-               executeWithLoadedPackageCheck(new InstallCommand(packages, cmd));
+               
+               // repository installs (along with their dependencies) can
+               // be run in parallel within the build pane
+               InstallCommand installCommand = new InstallCommand(packages, cmd);
+               if (packages != null &&
+                   request.getOptions().getInstallDependencies() &&
+                   !session_.getSessionInfo().getBuildToolsType().equals(
+                                                SessionInfo.BUILD_TOOLS_NONE))
+               {
+                  installCommand.libPath =
+                                    request.getOptions().getLibraryPath();
+               }
+               executeWithLoadedPackageCheck(installCommand);
            }
          });
    }
@@ -726,6 +740,10 @@ public class Packages
       }
       public final List<String> packages;
       public final String cmd;
+      
+      // library to install into within the build pane (null to install
+      // using the console)
+      public String libPath = null;
    }
    
    private void executeWithLoadedPackageCheck(final InstallCommand command)
@@ -747,7 +765,7 @@ public class Packages
                      }
                      else
                      {
-                        executePkgCommand(command.cmd);
+                        executeInstallCommand(command);
                      }
                   }
 
@@ -755,7 +773,7 @@ public class Packages
                   public void onError(ServerError error)
                   {
                      Debug.logError(error);
-                     executePkgCommand(command.cmd);
+                     executeInstallCommand(command);
                   }
 
                }); 
@@ -766,6 +784,38 @@ public class Packages
       }
    }
 
+   private void executeInstallCommand(final InstallCommand command)
+   {
+      if (command.libPath == null)
+      {
+         executePkgCommand(command.cmd);
+         return;
+      }
+      
+      // fall back to the console if the packages can't be installed in
+      // the build pane (e.g. a build is running or a package isn't
+      // available from the repositories)
+      server_.installPackages(
+            command.packages,
+            command.libPath,
+            new ServerRequestCallback<Boolean>() {
+
+               @Override
+               public void onResponseReceived(Boolean started)
+               {
+                  if (!started)
+                     executePkgCommand(command.cmd);
+               }
+
+               @Override
+               public void onError(ServerError error)
+               {
+                  Debug.logError(error);
+                  executePkgCommand(command.cmd);
+               }
+            });
+   }
+
    private void executePkgCommand(String cmd)
    {
       events_.fireEvent(new SendToConsoleEvent(cmd, true));
@@ -818,6 +868,7 @@ public class Packages
    private final EventBus events_ ;
    private final GlobalDisplay globalDisplay_ ;
    private final WorkbenchContext workbenchContext_;
+   private final Session session_;
    private final DefaultCRANMirror defaultCRANMirror_;
    private PackageInstallOptions installOptions_ = 
                                   PackageInstallOptions.create(true, "", true);
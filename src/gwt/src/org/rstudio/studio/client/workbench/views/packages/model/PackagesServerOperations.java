@@ -50,4 +50,10 @@ public interface PackagesServerOperations
    
    void ignoreNextLoadedPackageCheck(
                         ServerRequestCallback<Void> requestCallback);
+   
+   // install packages from the repositories within the build pane (returns
+   // false if they can't be installed that way)
+   void installPackages(List<String> packages,
+                        String libPath,
+                        ServerRequestCallback<Boolean> requestCallback);
 }
@@ -1279,7 +1279,7 @@ public class Source implements InsertSourceHandler,
       {
          if (resultCallback != null)
             resultCallback.onCancelled();
-         showFileTooLargeWarning(file, target.getFileSizeLimit());
+         confirmViewLargeFile(file, target.getFileSizeLimit());
       }
       else if (file.getLength() > target.getLargeFileSize())
       {
@@ -1303,19 +1303,37 @@ public class Source implements InsertSourceHandler,
       }
    }
   
-   private void showFileTooLargeWarning(FileSystemItem file,
-                                        long sizeLimit)
+   private void confirmViewLargeFile(final FileSystemItem file,
+                                     long sizeLimit)
    {
       StringBuilder msg = new StringBuilder();
       msg.append("The file '" + file.getName() + "' is too ");
       msg.append("large to open in the source editor (the file is ");
       msg.append(StringUtil.formatFileSize(file.getLength()) + " and the ");
       msg.append("maximum file size is ");
-      msg.append(StringUtil.formatFileSize(sizeLimit) + ")");
+      msg.append(StringUtil.formatFileSize(sizeLimit) + "). ");
+      msg.append("Do you want to view it read-only instead?");
 
-      globalDisplay_.showMessage(GlobalDisplay.MSG_WARNING,
-                                 "Selected File Too Large",
-                                 msg.toString());
+      globalDisplay_.showYesNoMessage(GlobalDisplay.MSG_WARNING,
+                                      "Selected File Too Large",
+                                      msg.toString(),
+                                      new Operation() {
+         public void execute()
+         {
+            viewLargeFile(file);
+         }
+      }, true);
+   }
+
+   private void viewLargeFile(FileSystemItem file)
+   {
+      // the viewer is shown by the ShowContent event
+      ProgressIndicator indicator = globalDisplay_.getProgressIndicator(
+                                                      "Error Opening File");
+      indicator.onProgress("Opening file...");
+      server_.viewLargeFile(file.getPath(),
+                            uiPrefs_.defaultEncoding().getValue(),
+                            new VoidServerRequestCallback(indicator));
    }
 
    private void confirmOpenLargeFile(FileSystemItem file,
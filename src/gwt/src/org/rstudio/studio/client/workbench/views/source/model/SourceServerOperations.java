@@ -64,6 +64,14 @@ public interface SourceServerOperations extends FilesServerOperations,
                      String encoding,
                      ServerRequestCallback<SourceDocument> requestCallback);
 
+   /**
+    * Opens a file which is too large for the source editor in a read-only
+    * viewer (the viewer is shown via a ShowContent event).
+    */
+   void viewLargeFile(String path,
+                      String encoding,
+                      ServerRequestCallback<Void> requestCallback);
+
    /**
     * Saves the given contents for the given ID, and optionally saves it to
     * a path on disk.
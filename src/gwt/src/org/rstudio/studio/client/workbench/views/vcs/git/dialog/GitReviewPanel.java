@@ -530,6 +530,21 @@ public class GitReviewPanel extends ResizeComposite implements Display
    {
       diffScroll_.setWidget(lines_);
    }
+
+   @Override
+   public HandlerRegistration addDiffScrollHandler(ScrollHandler handler)
+   {
+      return diffScroll_.addScrollHandler(handler);
+   }
+
+   @Override
+   public boolean isDiffScrolledNearEnd()
+   {
+      // within a couple of screens of the end
+      int remaining = diffScroll_.getMaximumVerticalScrollPosition() -
+                      diffScroll_.getVerticalScrollPosition();
+      return remaining <= 2 * diffScroll_.getOffsetHeight();
+   }
    
    @Override
    public void showContextMenu(final int clientX, 
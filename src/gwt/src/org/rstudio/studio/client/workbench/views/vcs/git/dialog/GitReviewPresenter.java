@@ -111,6 +111,9 @@ public class GitReviewPresenter implements ReviewPresenter
       void showSizeWarning(long sizeInBytes);
       void hideSizeWarning();
 
+      HandlerRegistration addDiffScrollHandler(ScrollHandler handler);
+      boolean isDiffScrolledNearEnd();
+
       void showContextMenu(int clientX, 
                            int clientY, 
                            Command openSelectedCommand);
@@ -487,6 +490,14 @@ public class GitReviewPresenter implements ReviewPresenter
             });
       view_.getLineTableDisplay().addDiffChunkActionHandler(new ApplyPatchHandler());
       view_.getLineTableDisplay().addDiffLineActionHandler(new ApplyPatchHandler());
+      view_.addDiffScrollHandler(new ScrollHandler()
+      {
+         @Override
+         public void onScroll(ScrollEvent event)
+         {
+            maybeRequestNextDiffPage();
+         }
+      });
 
       new IntStateValue(MODULE_GIT, KEY_CONTEXT_LINES, ClientState.PERSISTENT,
                         session.getSessionInfo().getClientState())
@@ -660,17 +671,31 @@ public class GitReviewPresenter implements ReviewPresenter
          currentFilename_ = item.getPath();
       }
 
-      diffInvalidation_.invalidate();
-      final Token token = diffInvalidation_.getInvalidationToken();
-
       final PatchMode patchMode = view_.getStagedCheckBox().getValue()
                                   ? PatchMode.Stage
                                   : PatchMode.Working;
+      requestDiffPage(item, patchMode, 0);
+   }
+
+   // large diffs are delivered a page of hunks at a time, with later pages
+   // requested as the user scrolls towards the end of the diff
+   private void requestDiffPage(final StatusAndPath item,
+                                final PatchMode patchMode,
+                                final int firstHunk)
+   {
+      diffInvalidation_.invalidate();
+      final Token token = diffInvalidation_.getInvalidationToken();
+
+      diffPageItem_ = item;
+      diffPagePatchMode_ = patchMode;
+      nextDiffHunk_ = -1;
+
       server_.gitDiffFile(
             item.getPath(),
             patchMode,
             view_.getContextLines().getValue(),
             overrideSizeWarning_,
+            firstHunk,
             new SimpleRequestCallback<DiffResult>("Diff Error")
             {
                @Override
@@ -679,32 +704,59 @@ public class GitReviewPresenter implements ReviewPresenter
                   if (token.isInvalid())
                      return;
 
+                  boolean firstPage = diffResult.getFirstHunk() == 0;
+                  nextDiffHunk_ = diffResult.getNextHunk();
+
                   // Use lastResponse_ to prevent unnecessary flicker
                   String response = diffResult.getDecodedValue();
-                  if (response.equals(currentResponse_))
-                     return;
-                  currentResponse_ = response;
-                  currentSourceEncoding_ = diffResult.getSourceEncoding();
+                  if (firstPage)
+                  {
+                     if (response.equals(currentResponse_) &&
+                         nextDiffHunk_ < 0)
+                     {
+                        return;
+                     }
+                     currentResponse_ = response;
+                     currentSourceEncoding_ = diffResult.getSourceEncoding();
+                     activeChunks_.clear();
+                     diffLines_ = new ArrayList<ChunkOrLine>();
+                     nextDiffIndex_ = 0;
+                  }
+                  else
+                  {
+                     currentResponse_ = null;
+                  }
 
-                  UnifiedParser parser = new UnifiedParser(response);
+                  // (diff indexes continue from the previous page so that
+                  // lines remain distinct)
+                  UnifiedParser parser = new UnifiedParser(response,
+                                                           nextDiffIndex_);
                   parser.nextFilePair();
 
-                  ArrayList<ChunkOrLine> allLines = new ArrayList<ChunkOrLine>();
-
-                  activeChunks_.clear();
                   for (DiffChunk chunk;
                        null != (chunk = parser.nextChunk());)
                   {
                      activeChunks_.add(chunk);
-                     allLines.add(new ChunkOrLine(chunk));
+                     diffLines_.add(new ChunkOrLine(chunk));
                      for (Line line : chunk.getLines())
-                        allLines.add(new ChunkOrLine(line));
+                        diffLines_.add(new ChunkOrLine(line));
                   }
+                  nextDiffIndex_ = parser.getDiffIndex();
 
                   view_.setShowActions(
                         !"??".equals(item.getStatus()) &&
                         !"UU".equals(item.getStatus()));
-                  view_.setData(allLines, patchMode);
+                  view_.setData(diffLines_, patchMode);
+
+                  // keep going if the page doesn't fill the view
+                  Scheduler.get().scheduleDeferred(new ScheduledCommand()
+                  {
+                     @Override
+                     public void execute()
+                     {
+                        maybeRequestNextDiffPage();
+                     }
+                  });
                }
 
                @Override
@@ -719,9 +771,20 @@ public class GitReviewPresenter implements ReviewPresenter
             });
    }
 
+   private void maybeRequestNextDiffPage()
+   {
+      if (nextDiffHunk_ < 0 || !view_.isDiffScrolledNearEnd())
+         return;
+
+      int firstHunk = nextDiffHunk_;
+      nextDiffHunk_ = -1;
+      requestDiffPage(diffPageItem_, diffPagePatchMode_, firstHunk);
+   }
+
    private void clearDiff()
    {
       softModeSwitch_ = false;
+      nextDiffHunk_ = -1;
       currentResponse_ = null;
       currentFilename_ = null;
       view_.getLineTableDisplay().clear();
@@ -797,6 +860,11 @@ public class GitReviewPresenter implements ReviewPresenter
    private final Display view_;
    private final GlobalDisplay globalDisplay_;
    private ArrayList<DiffChunk> activeChunks_ = new ArrayList<DiffChunk>();
+   private ArrayList<ChunkOrLine> diffLines_ = new ArrayList<ChunkOrLine>();
+   private int nextDiffIndex_;
+   private int nextDiffHunk_ = -1;
+   private StatusAndPath diffPageItem_;
+   private PatchMode diffPagePatchMode_;
    private String currentResponse_;
    private String currentSourceEncoding_;
    private String currentFilename_;
@@ -43,11 +43,13 @@ import org.rstudio.studio.client.workbench.views.workspace.dataimport.ImportFile
 import org.rstudio.studio.client.workbench.views.workspace.events.*;
 import org.rstudio.studio.client.workbench.views.workspace.model.DownloadInfo;
 import org.rstudio.studio.client.workbench.views.workspace.model.WorkspaceObjectInfo;
+import org.rstudio.studio.client.workbench.views.workspace.model.WorkspaceObjectPage;
 import org.rstudio.studio.client.workbench.views.workspace.model.WorkspaceServerOperations;
 import org.rstudio.studio.client.workbench.views.workspace.table.WorkspaceObjectTable;
 
 import java.util.ArrayList;
 import java.util.HashMap;
+import java.util.HashSet;
 
 public class Workspace
       extends BasePresenter
@@ -356,12 +358,33 @@ public class Workspace
       // clean out existing if we doing a reseta 
       if (reset)
          objects_.clearObjects();
-       
-      server_.listObjects(new ServerRequestCallback<RpcObjectList<WorkspaceObjectInfo>>()
+
+      // each refresh gets a new generation so that pages which arrive after
+      // a subsequent refresh has started are ignored
+      refreshGeneration_++;
+      listObjectsPage(refreshGeneration_, 0, reset, showProgress,
+                      new HashSet<String>());
+   }
+
+   // request a page of objects, continuing with the next page once it has
+   // been received (the server describes only the objects we ask for)
+   private void listObjectsPage(final int generation,
+                                final int offset,
+                                final boolean reset,
+                                final boolean showProgress,
+                                final HashSet<String> listedNames)
+   {
+      server_.listObjectsPage(
+            offset,
+            OBJECTS_PAGE_SIZE,
+            new ServerRequestCallback<WorkspaceObjectPage>()
       {
          @Override
          public void onError(ServerError error)
          {
+            if (generation != refreshGeneration_)
+               return;
+
             // ignore errors when a restart is in progress
             if (!workbenchContext_.isRestartInProgress())
             {
@@ -374,8 +397,33 @@ public class Workspace
          }
 
          @Override
-         public void onResponseReceived(RpcObjectList<WorkspaceObjectInfo> response)
+         public void onResponseReceived(WorkspaceObjectPage page)
          {
+            if (generation != refreshGeneration_)
+               return;
+
+            // perform updates (will add or update as necessary)
+            RpcObjectList<WorkspaceObjectInfo> objects = page.getObjects();
+            for (int i = 0; i < objects.length(); i++)
+            {
+               WorkspaceObjectInfo objectInfo = objects.get(i);
+               listedNames.add(objectInfo.getName());
+               if (!objectInfo.isHidden())
+                  objects_.updateObject(objectInfo);
+            }
+
+            // we can hide progress once the first page is displayed
+            if (showProgress && page.getOffset() == 0)
+               view_.setProgress(false);
+
+            int nextOffset = page.getOffset() + objects.length();
+            if (objects.length() > 0 && nextOffset < page.getTotal())
+            {
+               listObjectsPage(generation, nextOffset, reset, false,
+                               listedNames);
+               return;
+            }
+
             // if this is not a full reset then we need to perform the 
             // deletes manually because we never cleared the existing
             // object table. this state is here so we can implement "silent"
@@ -387,38 +435,17 @@ public class Workspace
                for (int i=0; i<objectNames.size(); i++)
                {
                   String objectName = objectNames.get(i);
-                  if (!containsObject(response, objectName))
+                  if (!listedNames.contains(objectName))
                      objects_.removeObject(objectName);
                }
             }
-            
-            // perform updates (will add or update as necessary)
-            for (int i = 0; i < response.length(); i++)
-            {
-               WorkspaceObjectInfo objectInfo = response.get(i);
-               if (!objectInfo.isHidden())
-                  objects_.updateObject(objectInfo);
-            } 
-            
-            if (showProgress)
-               view_.setProgress(false);
          }
       });
    }
-   
-   
-   public boolean containsObject(RpcObjectList<WorkspaceObjectInfo> objects,
-                                 String name)
-   {
-      for (int i=0; i<objects.length(); i++)
-      {
-         if (objects.get(i).getName().equals(name))
-            return true;
-      }
-      
-      // didn't find it
-      return false;
-   }
+
+   private int refreshGeneration_ = 0;
+
+   private static final int OBJECTS_PAGE_SIZE = 250;
 
    private final Workspace.Display view_ ;
    private final WorkspaceServerOperations server_;
@@ -0,0 +1,40 @@
+/*
+ * WorkspaceObjectPage.java
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+package org.rstudio.studio.client.workbench.views.workspace.model;
+
+import com.google.gwt.core.client.JavaScriptObject;
+
+import org.rstudio.core.client.jsonrpc.RpcObjectList;
+
+public class WorkspaceObjectPage extends JavaScriptObject
+{
+   protected WorkspaceObjectPage()
+   {
+   }
+
+   // total number of objects in the workspace
+   public final native int getTotal() /*-{
+      return this.total;
+   }-*/;
+
+   // index of the first object in this page
+   public final native int getOffset() /*-{
+      return this.offset;
+   }-*/;
+
+   public final native RpcObjectList<WorkspaceObjectInfo> getObjects() /*-{
+      return this.objects;
+   }-*/;
+}
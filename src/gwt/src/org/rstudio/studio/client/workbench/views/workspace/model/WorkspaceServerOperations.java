@@ -23,6 +23,12 @@ public interface WorkspaceServerOperations
    // list all objects in the global namespace
    void listObjects(
          ServerRequestCallback<RpcObjectList<WorkspaceObjectInfo>> requestCallback);
+
+   // list a window of the objects in the global namespace
+   void listObjectsPage(
+         int offset,
+         int count,
+         ServerRequestCallback<WorkspaceObjectPage> requestCallback);
    
    void removeAllObjects(boolean includeHidden,
                          ServerRequestCallback<Void> requestCallback);
@@ -0,0 +1,385 @@
+/*
+ * dataviewer.js
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+// Virtualized viewer for data passed to View(). Only the rows which are
+// scrolled into view are rendered; they're requested from the server a
+// viewport at a time (sorting and filtering are also done on the server).
+var dataViewer = (function() {
+
+   var ROW_HEIGHT = 20;
+   var OVERSCAN_ROWS = 50;
+   var SPARK_CHARS = "▁▂▃▄▅▆▇█";
+
+   var config_;
+   var container_;
+   var scroller_;
+   var spacer_;
+   var table_;
+   var status_;
+
+   var columnCount_ = 50;
+   var firstColumn_ = 0;
+   var sortColumn_ = -1;
+   var ascending_ = true;
+   var filterColumn_ = -1;
+   var filter_ = "";
+
+   var totalRows_ = 0;
+   var viewport_ = null;
+   var pending_ = null;
+   var requestId_ = 0;
+   var filterTimer_ = null;
+
+   // column summaries (by column index) and the pending request for them
+   var stats_ = {};
+   var statsPending_ = null;
+
+   function el(tag, className, text) {
+      var e = document.createElement(tag);
+      if (className)
+         e.className = className;
+      if (text !== undefined)
+         e.appendChild(document.createTextNode(text));
+      return e;
+   }
+
+   function visibleColumnCount() {
+      return Math.min(columnCount_, config_.columns.length - firstColumn_);
+   }
+
+   function render() {
+      if (!viewport_)
+         return;
+
+      var thead = el("thead");
+      var headerRow = el("tr");
+      headerRow.appendChild(el("th", "rn", ""));
+      for (var c = 0; c < viewport_.data.length; c++) {
+         var column = viewport_.column + c;
+         var label = config_.columns[column];
+         if (column === sortColumn_)
+            label += ascending_ ? " ▲" : " ▼";
+         var stats = stats_[column];
+         if (stats && stats.histogram)
+            label += " " + sparkline(stats.histogram);
+         var th = el("th", "sortable", label);
+         if (stats)
+            th.title = statsText(stats);
+         th.setAttribute("data-column", column);
+         th.onclick = onHeaderClick;
+         headerRow.appendChild(th);
+      }
+      thead.appendChild(headerRow);
+
+      var tbody = el("tbody");
+      for (var r = 0; r < viewport_.rowNumbers.length; r++) {
+         var tr = el("tr");
+         tr.appendChild(el("td", "rn", String(viewport_.rowNumbers[r])));
+         for (var c2 = 0; c2 < viewport_.data.length; c2++)
+            tr.appendChild(el("td", null, viewport_.data[c2][r]));
+         tbody.appendChild(tr);
+      }
+
+      var table = el("table");
+      table.appendChild(thead);
+      table.appendChild(tbody);
+      table.style.top = (viewport_.row * ROW_HEIGHT) + "px";
+      scroller_.replaceChild(table, table_);
+      table_ = table;
+
+      spacer_.style.height = ((totalRows_ + 1) * ROW_HEIGHT) + "px";
+      updateStatus();
+   }
+
+   function sparkline(counts) {
+      var max = 0;
+      for (var i = 0; i < counts.length; i++)
+         max = Math.max(max, counts[i]);
+      var text = "";
+      for (var j = 0; j < counts.length; j++) {
+         var level = max > 0 ?
+               Math.ceil((counts[j] / max) * SPARK_CHARS.length) - 1 : 0;
+         text += SPARK_CHARS.charAt(Math.max(level, 0));
+      }
+      return text;
+   }
+
+   function formatNumber(value) {
+      return typeof value === "number" ? String(+value.toPrecision(6)) : value;
+   }
+
+   function statsText(stats) {
+      var lines = [stats.type,
+                   "NA: " + stats.na,
+                   "Distinct: " + (stats.distinct < 1000 ? "" : "~") +
+                         stats.distinct];
+      if (stats.min !== undefined) {
+         lines.push("Min: " + formatNumber(stats.min));
+         lines.push("Max: " + formatNumber(stats.max));
+         lines.push("Mean: " + formatNumber(stats.mean));
+      }
+      return lines.join("\n");
+   }
+
+   // request summaries of the columns in view (which we don't already have)
+   function requestStats() {
+      if (!viewport_ || !config_.statsUrl)
+         return;
+
+      var first = -1;
+      var last = -1;
+      for (var c = 0; c < viewport_.data.length; c++) {
+         var column = viewport_.column + c;
+         if (!stats_[column]) {
+            if (first < 0)
+               first = column;
+            last = column;
+         }
+      }
+      if (first < 0)
+         return;
+
+      var key = first + "," + (last - first + 1);
+      if (key === statsPending_)
+         return;
+      statsPending_ = key;
+
+      var url = config_.statsUrl +
+                "?id=" + encodeURIComponent(config_.id) +
+                "&col=" + first +
+                "&ncol=" + (last - first + 1);
+
+      var xhr = new XMLHttpRequest();
+      xhr.open("GET", url, true);
+      xhr.onreadystatechange = function() {
+         if (xhr.readyState !== 4)
+            return;
+         if (statsPending_ === key)
+            statsPending_ = null;
+
+         // summaries are an extra so failures are silently ignored
+         if (xhr.status !== 200)
+            return;
+         var result;
+         try {
+            result = JSON.parse(xhr.responseText);
+         }
+         catch (e) {
+            return;
+         }
+         if (result.error)
+            return;
+
+         for (var i = 0; i < result.stats.length; i++)
+            stats_[result.column + i] = result.stats[i];
+         render();
+      };
+      xhr.send(null);
+   }
+
+   function updateStatus() {
+      var lastColumn = firstColumn_ + visibleColumnCount();
+      var text = "Columns " + (firstColumn_ + 1) + "-" + lastColumn +
+                 " of " + config_.columns.length;
+      if (totalRows_ !== config_.rowCount)
+         text += "; " + totalRows_ + " of " + config_.rowCount +
+                 " rows match filter";
+      status_.firstChild.nodeValue = text;
+   }
+
+   function showError(message) {
+      status_.firstChild.nodeValue = message;
+   }
+
+   function requestViewport(force) {
+      var rowsVisible = Math.ceil(scroller_.clientHeight / ROW_HEIGHT);
+      var firstRow = Math.floor(scroller_.scrollTop / ROW_HEIGHT);
+      var row = Math.max(0, firstRow - OVERSCAN_ROWS);
+      var nrow = Math.min(rowsVisible + (2 * OVERSCAN_ROWS), config_.maxRows);
+
+      // nothing to do if the current viewport already covers the view
+      if (!force && viewport_ &&
+          viewport_.row <= firstRow &&
+          (viewport_.row + viewport_.rowNumbers.length >=
+                Math.min(firstRow + rowsVisible, totalRows_))) {
+         return;
+      }
+
+      var key = [row, nrow, firstColumn_, columnCount_, sortColumn_,
+                 ascending_, filterColumn_, filter_].join(",");
+      if (key === pending_)
+         return;
+      pending_ = key;
+
+      var url = config_.url +
+                "?id=" + encodeURIComponent(config_.id) +
+                "&row=" + row +
+                "&nrow=" + nrow +
+                "&col=" + firstColumn_ +
+                "&ncol=" + columnCount_ +
+                "&sort=" + sortColumn_ +
+                "&asc=" + (ascending_ ? 1 : 0) +
+                "&fcol=" + filterColumn_ +
+                "&filter=" + encodeURIComponent(filter_);
+
+      var id = ++requestId_;
+      var xhr = new XMLHttpRequest();
+      xhr.open("GET", url, true);
+      xhr.onreadystatechange = function() {
+         if (xhr.readyState !== 4)
+            return;
+         if (id !== requestId_)
+            return;
+         pending_ = null;
+
+         if (xhr.status !== 200) {
+            showError("Error retrieving data (" + xhr.status + ")");
+            return;
+         }
+
+         var result;
+         try {
+            result = JSON.parse(xhr.responseText);
+         }
+         catch (e) {
+            showError("Error retrieving data");
+            return;
+         }
+
+         if (result.error) {
+            showError(result.error);
+            return;
+         }
+
+         totalRows_ = result.totalRows;
+         viewport_ = result;
+         render();
+         requestStats();
+
+         // the view may have moved while we were waiting
+         requestViewport(false);
+      };
+      xhr.send(null);
+   }
+
+   function onHeaderClick() {
+      var column = parseInt(this.getAttribute("data-column"), 10);
+      if (column === sortColumn_) {
+         if (ascending_)
+            ascending_ = false;
+         else
+            sortColumn_ = -1;
+      }
+      else {
+         sortColumn_ = column;
+         ascending_ = true;
+      }
+      scroller_.scrollTop = 0;
+      requestViewport(true);
+   }
+
+   function pageColumns(delta) {
+      var first = firstColumn_ + (delta * columnCount_);
+      first = Math.max(0, Math.min(first, config_.columns.length - 1));
+      if (first === firstColumn_)
+         return;
+      firstColumn_ = first;
+      requestViewport(true);
+   }
+
+   function buildToolbar() {
+      var toolbar = el("div", "toolbar");
+
+      var prev = el("button", null, "◀");
+      prev.title = "Previous columns";
+      prev.onclick = function() { pageColumns(-1); };
+      toolbar.appendChild(prev);
+
+      var next = el("button", null, "▶");
+      next.title = "Next columns";
+      next.onclick = function() { pageColumns(1); };
+      toolbar.appendChild(next);
+
+      toolbar.appendChild(el("span", "label", "Filter:"));
+
+      var select = el("select");
+      select.appendChild(el("option", null, "(column)"));
+      for (var i = 0; i < config_.columns.length; i++)
+         select.appendChild(el("option", null, config_.columns[i]));
+      toolbar.appendChild(select);
+
+      var input = el("input");
+      input.type = "text";
+      toolbar.appendChild(input);
+
+      var applyFilter = function() {
+         filterColumn_ = select.selectedIndex - 1;
+         filter_ = filterColumn_ >= 0 ? input.value : "";
+         scroller_.scrollTop = 0;
+         requestViewport(true);
+      };
+      select.onchange = applyFilter;
+      input.onkeyup = function() {
+         if (filterTimer_)
+            clearTimeout(filterTimer_);
+         filterTimer_ = setTimeout(applyFilter, 250);
+      };
+
+      status_ = el("span", "status", "");
+      toolbar.appendChild(status_);
+
+      return toolbar;
+   }
+
+   function init(container, config) {
+      config_ = config;
+      container_ = container;
+      totalRows_ = config.rowCount;
+      columnCount_ = Math.max(1, config.initial.data.length);
+
+      container_.className = "dataViewer";
+      container_.appendChild(buildToolbar());
+
+      scroller_ = el("div", "scroller");
+      spacer_ = el("div", "spacer");
+      table_ = el("table");
+      scroller_.appendChild(spacer_);
+      scroller_.appendChild(table_);
+      container_.appendChild(scroller_);
+
+      var resize = function() {
+         scroller_.style.height =
+               Math.max(0, window.innerHeight - scroller_.offsetTop) + "px";
+      };
+      window.onresize = function() {
+         resize();
+         requestViewport(false);
+      };
+      resize();
+
+      scroller_.onscroll = function() {
+         requestViewport(false);
+      };
+
+      // render the initial viewport (embedded in the page) immediately
+      viewport_ = config.initial;
+      render();
+      requestStats();
+      requestViewport(false);
+   }
+
+   return {
+      init: init
+   };
+
+})();
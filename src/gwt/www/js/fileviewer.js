@@ -0,0 +1,213 @@
+/*
+ * fileviewer.js
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+// Read-only viewer for files too large for the source editor. Only the
+// lines which are scrolled into view are rendered; they're requested from
+// the server a window at a time.
+var fileViewer = (function() {
+
+   var LINE_HEIGHT = 16;
+   var OVERSCAN_LINES = 100;
+
+   // browsers can't scroll elements much taller than this so beyond it the
+   // scroll position maps proportionally onto the file
+   var MAX_SCROLL_HEIGHT = 8000000;
+
+   var config_;
+   var container_;
+   var scroller_;
+   var spacer_;
+   var content_;
+   var status_;
+
+   var totalLines_ = 0;
+   var window_ = null;
+   var pending_ = null;
+   var requestId_ = 0;
+
+   function el(tag, className, text) {
+      var e = document.createElement(tag);
+      if (className)
+         e.className = className;
+      if (text !== undefined)
+         e.appendChild(document.createTextNode(text));
+      return e;
+   }
+
+   function scrollHeight() {
+      return Math.min((totalLines_ + 1) * LINE_HEIGHT, MAX_SCROLL_HEIGHT);
+   }
+
+   function visibleLines() {
+      return Math.ceil(scroller_.clientHeight / LINE_HEIGHT);
+   }
+
+   // the first line in view for the current scroll position
+   function firstVisibleLine() {
+      var range = scrollHeight() - scroller_.clientHeight;
+      if (range <= 0)
+         return 0;
+      var lastFirstLine = Math.max(0, totalLines_ - visibleLines());
+      var line = Math.round((scroller_.scrollTop / range) * lastFirstLine);
+      return Math.max(0, Math.min(line, lastFirstLine));
+   }
+
+   function render() {
+      if (!window_)
+         return;
+
+      var firstLine = firstVisibleLine();
+      var count = Math.min(visibleLines() + 1,
+                           window_.line + window_.lines.length - firstLine);
+
+      var gutterWidth = String(totalLines_).length;
+      var content = el("div", "content");
+      for (var i = 0; i < count; i++) {
+         var index = firstLine - window_.line + i;
+         if (index < 0 || index >= window_.lines.length)
+            continue;
+         var row = el("div", "line");
+         var number = String(firstLine + i + 1);
+         while (number.length < gutterWidth)
+            number = " " + number;
+         row.appendChild(el("span", "ln", number));
+         row.appendChild(el("span", "text", window_.lines[index]));
+         content.appendChild(row);
+      }
+
+      // keep the rendered lines pinned to the top of the view
+      content.style.top = scroller_.scrollTop + "px";
+      scroller_.replaceChild(content, content_);
+      content_ = content;
+
+      spacer_.style.height = scrollHeight() + "px";
+      status_.firstChild.nodeValue = "Lines " + (firstLine + 1) + "-" +
+                  Math.min(firstLine + visibleLines(), totalLines_) +
+                  " of " + totalLines_ + " (read-only)";
+   }
+
+   function showError(message) {
+      status_.firstChild.nodeValue = message;
+   }
+
+   function requestWindow() {
+      var firstLine = firstVisibleLine();
+      var lastLine = Math.min(firstLine + visibleLines(), totalLines_);
+
+      // nothing to do if the current window already covers the view
+      if (window_ &&
+          window_.line <= firstLine &&
+          window_.line + window_.lines.length >= lastLine) {
+         return;
+      }
+
+      var line = Math.max(0, firstLine - OVERSCAN_LINES);
+      var n = Math.min(visibleLines() + (2 * OVERSCAN_LINES),
+                       config_.maxLines);
+
+      var key = line + "," + n;
+      if (key === pending_)
+         return;
+      pending_ = key;
+
+      var url = config_.url +
+                "?id=" + encodeURIComponent(config_.id) +
+                "&line=" + line +
+                "&n=" + n;
+
+      var id = ++requestId_;
+      var xhr = new XMLHttpRequest();
+      xhr.open("GET", url, true);
+      xhr.onreadystatechange = function() {
+         if (xhr.readyState !== 4)
+            return;
+         if (id !== requestId_)
+            return;
+         pending_ = null;
+
+         if (xhr.status !== 200) {
+            showError("Error retrieving lines (" + xhr.status + ")");
+            return;
+         }
+
+         var result;
+         try {
+            result = JSON.parse(xhr.responseText);
+         }
+         catch (e) {
+            showError("Error retrieving lines");
+            return;
+         }
+
+         if (result.error) {
+            showError(result.error);
+            return;
+         }
+
+         // the file may have changed on disk (and been re-indexed)
+         totalLines_ = result.totalLines;
+         window_ = result;
+         render();
+
+         // the view may have moved while we were waiting
+         requestWindow();
+      };
+      xhr.send(null);
+   }
+
+   function update() {
+      render();
+      requestWindow();
+   }
+
+   function init(container, config) {
+      config_ = config;
+      container_ = container;
+      totalLines_ = config.initial.totalLines;
+
+      container_.className = "fileViewer";
+
+      var toolbar = el("div", "toolbar");
+      status_ = el("span", "status", "");
+      toolbar.appendChild(status_);
+      container_.appendChild(toolbar);
+
+      scroller_ = el("div", "scroller");
+      spacer_ = el("div", "spacer");
+      content_ = el("div", "content");
+      scroller_.appendChild(spacer_);
+      scroller_.appendChild(content_);
+      container_.appendChild(scroller_);
+
+      var resize = function() {
+         scroller_.style.height =
+               Math.max(0, window.innerHeight - scroller_.offsetTop) + "px";
+      };
+      window.onresize = function() {
+         resize();
+         update();
+      };
+      resize();
+
+      scroller_.onscroll = update;
+
+      // render the initial window (embedded in the page) immediately
+      window_ = config.initial;
+      update();
+   }
+
+   return {
+      init: init
+   };
+
+})();